@@ -36,12 +36,18 @@ public:
     if (!error && bytes_recvd > 0)
     {
       std::string msg(data_, bytes_recvd);
-      std::cout << "received '" << msg << "'\n";
+      if (gr::digitizers::is_binary_edge_detect(msg)) {
+        std::cout << "received binary datagram, " << bytes_recvd << " bytes\n";
+      }
+      else {
+        std::cout << "received '" << msg << "'\n";
+      }
 
-      gr::digitizers::edge_detect_t ed;
-      auto retval = gr::digitizers::decode_edge_detect(msg, ed);
+      std::vector<gr::digitizers::edge_detect_t> edges;
+      auto retval = gr::digitizers::decode_edge_detect_batch(msg, edges);
 
-      std::cout << "decoding " << std::string(retval ? "succeeded" : "failed") << "\n";
+      std::cout << "decoding " << std::string(retval ? "succeeded" : "failed")
+                << ", edges: " << edges.size() << "\n";
     }
 
     socket_.async_receive_from(
@@ -0,0 +1,68 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_AGGREGATED_SOURCE_H
+#define INCLUDED_DIGITIZERS_AGGREGATED_SOURCE_H
+
+#include <digitizers/api.h>
+#include <digitizers/digitizer_block.h>
+#include <gnuradio/sync_block.h>
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Aggregated stream of a digitizer, delivered next to its full-rate outputs.
+     *
+     * The digitizer hands over every streaming chunk and the source aggregates it over windows
+     * of factor samples the same way the devices do:
+     *  - MIN_MAX_AGG: value is the mid-range, error a quarter of the spread
+     *  - AVERAGE: value is the mean, error the mean error divided by sqrt(factor)
+     *  - DECIMATE: first sample of each window
+     *
+     * Analog channel c of the digitizer uses the output ports 2c (values) and 2c+1 (errors),
+     * disabled channels deliver zeros. A timebase_info tag is published after each arm, acq_info
+     * and trigger tags of the digitizer are decimated onto the values (see decimate_tags).
+     * Aggregated items are queued until delivered, if the queue is full they are dropped (see
+     * get_dropped_items).
+     *
+     * Instances are created by digitizer_block::set_aggregated_output.
+     *
+     * \ingroup digitizers
+     */
+    class DIGITIZERS_API aggregated_source : virtual public gr::sync_block
+    {
+     public:
+      typedef boost::shared_ptr<aggregated_source> sptr;
+
+      /*!
+       * \brief Return a shared_ptr to a new instance of digitizers::aggregated_source.
+       *
+       * \param nchannels number of analog channels of the digitizer
+       * \param mode MIN_MAX_AGG, AVERAGE or DECIMATE
+       * \param factor number of samples per aggregated item, at least 2
+       * \param max_queued_items max number of aggregated items queued per channel
+       */
+      static sptr make(int nchannels, downsampling_mode_t mode, int factor,
+          int max_queued_items=65536);
+
+      virtual int nchannels() const = 0;
+
+      virtual downsampling_mode_t get_mode() const = 0;
+
+      virtual int get_factor() const = 0;
+
+      /*!
+       * \brief Returns number of aggregated items (per channel) dropped because the queue was
+       * full, since start.
+       */
+      virtual uint64_t get_dropped_items() const = 0;
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_AGGREGATED_SOURCE_H */
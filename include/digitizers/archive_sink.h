@@ -0,0 +1,181 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_ARCHIVE_SINK_H
+#define INCLUDED_DIGITIZERS_ARCHIVE_SINK_H
+
+#include <digitizers/api.h>
+#include <digitizers/tags.h>
+#include <gnuradio/sync_block.h>
+
+#include <string>
+#include <vector>
+
+namespace gr {
+  namespace digitizers {
+
+    const uint32_t ARCHIVE_CHUNK_MAGIC = 0x5a444341;    // "ACDZ" in the file
+    const uint16_t ARCHIVE_VERSION = 1;
+
+    // Chunks start and end at multiples of the block size, required for direct I/O
+    const uint32_t ARCHIVE_BLOCK_SIZE = 4096;
+
+    enum archive_chunk_flags_t
+    {
+      ARCHIVE_CHUNK_HAS_ERRORS = 1,
+      ARCHIVE_CHUNK_RAW_COMPRESSED = 2,
+      ARCHIVE_CHUNK_LOSSY_COMPRESSED = 4
+    };
+
+    /*!
+     * \brief Header of an archive chunk.
+     *
+     * A chunk holds a number of packages stored column by column. The column offsets are
+     * relative to the start of the chunk:
+     *  - values: npackages * package_size floats
+     *  - timestamps: npackages int64_t, timestamp of the first sample of each package (ns UTC),
+     *    -1 if unknown
+     *  - status: npackages uint32_t, acq_info and trigger status bits of each package
+     *  - errors: npackages * package_size floats, present if flagged
+     *
+     * Chunks of a raw input sink hold the raw ADC counts of all the packages encoded by raw_encode
+     * (see raw_codec.h) in the values column instead, the column size varies from chunk to chunk
+     * and scaling describes the conversion into volts. There are no errors.
+     *
+     * Lossy compressed chunks (see archive_sink::make) hold the values encoded by lossy_encode
+     * (see lossy_codec.h) with the errors as bounds, and the errors encoded with themselves as
+     * bounds in the errors column. The column sizes vary from chunk to chunk, quantization is
+     * the step relative to the errors, i.e. the values are accurate to quantization / 2 of their
+     * errors.
+     *
+     * Fields and samples are in the byte order of the writing host.
+     *
+     * \ingroup digitizers
+     */
+    struct DIGITIZERS_API archive_chunk_header_t
+    {
+      uint32_t magic;                // ARCHIVE_CHUNK_MAGIC
+      uint16_t version;              // ARCHIVE_VERSION
+      uint16_t flags;                // see archive_chunk_flags_t
+      uint32_t header_size;          // size of this header
+      uint32_t package_size;         // samples per package
+      uint32_t npackages;            // packages stored in the chunk
+      uint32_t chunk_size;           // size of the chunk including padding, next chunk follows
+      uint64_t offset;               // stream offset of the first sample
+      uint64_t packages_dropped;     // packages dropped right before this chunk (disk lagging)
+      double timebase;               // distance between samples (in seconds)
+      uint32_t values_offset;
+      uint32_t timestamps_offset;
+      uint32_t status_offset;
+      uint32_t errors_offset;
+      uint32_t values_size;          // size of the values column in bytes
+      float quantization;            // lossy compressed only, see lossy_encode
+      raw_scaling_t scaling;         // raw input only, raw_scaling tag valid at chunk start
+    };
+
+    /*!
+     * \brief Entry of the archive index, one per chunk.
+     *
+     * \ingroup digitizers
+     */
+    struct DIGITIZERS_API archive_index_entry_t
+    {
+      int64_t first_timestamp;       // timestamp of the first package of the chunk
+      int64_t last_timestamp;        // timestamp of the last package of the chunk
+      uint64_t file_offset;          // position of the chunk within the data file
+      uint64_t offset;               // stream offset of the first sample
+      uint32_t chunk_size;
+      uint32_t npackages;
+    };
+
+    /*!
+     * \brief Archives the input to a chunked, columnar file.
+     *
+     * Packages of package_size samples are batched into chunks (see archive_chunk_header_t),
+     * chunks are written to the data file by a background writer thread, i.e. the work function
+     * only copies the samples. Each chunk written is recorded in the index file (path + ".idx"),
+     * see find_chunks.
+     *
+     * Memory is bounded: at most max_pending_chunks chunks are filled or waiting for the writer.
+     * If the disk is lagging and all the chunks are pending, incoming packages are dropped
+     * (counted in the header of the next chunk written and by get_dropped_packages) instead of
+     * throttling the flowgraph.
+     *
+     * Chunks are written with large, block-aligned writes. Optionally the data file is opened for
+     * direct I/O (O_DIRECT) in order to bypass the page cache, the sink falls back to buffered
+     * I/O if the file system doesn't support it.
+     *
+     * Values are expected on the first input, errors on the optional second one. Timestamps and
+     * status are taken from the acq_info and trigger tags (see tags.h). Existing files are
+     * truncated on start, the partially filled chunk is written on stop.
+     *
+     * With raw input the sink takes the raw ADC counts of a digitizer in raw output mode (a single
+     * int16_t input) and stores them losslessly compressed, for typical signals a fraction of the
+     * size of the float values. The writer thread does the encoding.
+     *
+     * Aggregated values (e.g. of a cascade_sink level) mostly need to be accurate to a fraction
+     * of their error estimate only. With a quantization given the values are quantized to that
+     * fraction of their errors and compressed (see lossy_codec.h), typically five to twenty
+     * times smaller than the floats. Chunks without errors are stored uncompressed.
+     *
+     * \ingroup digitizers
+     */
+    class DIGITIZERS_API archive_sink : virtual public gr::sync_block
+    {
+     public:
+      typedef boost::shared_ptr<archive_sink> sptr;
+
+      /*!
+       * \brief Return a shared_ptr to a new instance of digitizers::archive_sink.
+       *
+       * \param path data file, the index is written to path + ".idx"
+       * \param package_size number of samples per package
+       * \param packages_per_chunk number of packages written at once
+       * \param max_pending_chunks max number of chunks held in memory
+       * \param direct_io bypass the page cache if supported
+       * \param raw_input raw ADC counts are expected, stored compressed
+       * \param quantization quantization step relative to the errors, zero to store the values
+       * losslessly (default), not applicable to raw input
+       */
+      static sptr make(const std::string &path, int package_size, int packages_per_chunk=64,
+              int max_pending_chunks=4, bool direct_io=false, bool raw_input=false,
+              float quantization=0.0f);
+
+      /*!
+       * \brief Returns the index entries of the chunks overlapping the given time range.
+       *
+       * Timestamps are expected to be monotonic within the archive. Chunks without timestamps
+       * are not returned.
+       *
+       * \param path data file as passed to make
+       * \param from_timestamp start of the range, ns UTC
+       * \param to_timestamp end of the range, ns UTC
+       */
+      static std::vector<archive_index_entry_t> find_chunks(const std::string &path,
+              int64_t from_timestamp, int64_t to_timestamp);
+
+      virtual uint64_t get_written_chunks() const = 0;
+
+      /*!
+       * \brief Returns the number of packages dropped since start because the disk was lagging.
+       */
+      virtual uint64_t get_dropped_packages() const = 0;
+
+      /*!
+       * \brief Returns the number of failed writes since start, data of such chunks is lost.
+       */
+      virtual uint64_t get_write_errors() const = 0;
+
+      /*!
+       * \brief Returns true if the data file is opened for direct I/O.
+       */
+      virtual bool is_direct_io() const = 0;
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_ARCHIVE_SINK_H */
@@ -33,7 +33,7 @@ namespace gr {
       /*!
        * \brief Return a shared_ptr to a new instance of digitizers::block_aggregation.
        *
-       * \param alg_id Chosen algorithm of the circuit that later maps to an enum(valid:0-6).
+       * \param alg_id Chosen algorithm of the circuit that later maps to an enum(valid:0-9, see algorithm_id_t).
        * \param decim decimation factor.
        * \param delay The delay of the samples on output.
        * \param fir_taps user defined FIR-filter taps.
@@ -43,6 +43,9 @@ namespace gr {
        * \param fb_user_taps feed backward user taps.
        * \param fw_user_taps feed forward user taps.
        * \param samp_rate Sampling rate of the whole circuit.
+       * \param compute_errors If false, the block has a single input and output (values) and
+       * only the value filter is instantiated, the errors path (mean and mean-of-squares
+       * filters, error filter and the helper circuit) is skipped.
        */
       static sptr make(int alg_id,
           int decim,
@@ -53,11 +56,16 @@ namespace gr {
           double tr_width,
           const std::vector<double> &fb_user_taps,
           const std::vector<double> &fw_user_taps,
-          double samp_rate);
+          double samp_rate,
+          bool compute_errors=true);
 
       /**
        * \brief Updates the circuit when any of the parameters change.
        *
+       * The filters are designed by the calling thread. The running FIR and IIR filters swap in
+       * the new coefficients at a sample boundary, i.e. the call doesn't wait for the work
+       * function and the filter state is carried over.
+       *
        * \param delay The delay of the samples on output.
        * \param fir_taps user defined FIR-filter taps.
        * \param low_freq lower frequency boundary.
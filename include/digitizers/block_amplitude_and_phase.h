@@ -14,12 +14,35 @@
 namespace gr {
   namespace digitizers {
 
+    /*!
+     * \brief Source of the reference of block_amplitude_and_phase
+     * \ingroup digitizers
+     */
+    enum DIGITIZERS_API amplitude_phase_reference_t
+    {
+      REFERENCE_INPUT       = 0,    // second input
+      REFERENCE_NCO         = 1,    // internal, at ref_freq
+      REFERENCE_NCO_LOCKED  = 2     // internal, at the frequency of the second input
+    };
+
     /*!
      * \brief Estimates signals frequency and amplitude, given a reference
      * signal. Amplitude is calculated as a coefficient of(signal/reference),
      * while the phase shift is in degrees between the signal and rhe
      * reference signal. The estimates are passed as seperate outputs for the
      * different estimations for each individual sample.
+     *
+     * With large decimation factors the Hilbert transforms and the mixing can be evaluated
+     * at the output rate only (decimate_products). The low pass then runs at the output rate,
+     * which requires twice the signal frequency to be below the decimated Nyquist frequency.
+     *
+     * For a clean tone of known frequency the reference can be synthesised by a phase
+     * continuous NCO instead (REFERENCE_NCO), i.e. there is no reference input and no Hilbert
+     * transform of it. The output is the one for a reference input cos(2 pi ref_freq n /
+     * samp_rate), n counted from the first sample. With REFERENCE_NCO_LOCKED the NCO follows
+     * the frequency (Hz) of the second input instead, e.g. the output of freq_estimator with
+     * one value per freq_decim samples. Until the first positive frequency arrives the NCO
+     * runs at ref_freq.
      * \ingroup digitizers
      *
      */
@@ -38,6 +61,10 @@ namespace gr {
        * \param up_freq upper frequency of the window
        * \param tr_width transition width from full response to zero.
        * \param hilbert_window window selection.
+       * \param decimate_products mix at the output rate only, see class description.
+       * \param reference reference input or NCO, see class description.
+       * \param ref_freq frequency of the NCO
+       * \param freq_decim input samples per frequency value (REFERENCE_NCO_LOCKED)
        */
       static sptr make(double samp_rate,
         double delay,
@@ -45,7 +72,11 @@ namespace gr {
         double gain,
         double up_freq,
         double tr_width,
-        int hilbert_window);
+        int hilbert_window,
+        bool decimate_products=false,
+        amplitude_phase_reference_t reference=REFERENCE_INPUT,
+        double ref_freq=0.0,
+        int freq_decim=1);
 
       /*!
        * \brief Updates the parameters of the amplitude phase and frequency
@@ -60,6 +91,12 @@ namespace gr {
         double gain,
         double up_freq,
         double tr_width) = 0;
+
+      /*!
+       * \brief Sets the NCO frequency, the phase is continuous. No effect with an external
+       * reference, with REFERENCE_NCO_LOCKED only until the first measured frequency.
+       */
+      virtual void set_reference_freq(double ref_freq) = 0;
     };
 
   } // namespace digitizers
@@ -17,7 +17,13 @@ namespace gr {
     /*!
      * \brief The block recieves a char(8bit) input and extracts
      * the n-th bit the user wants. If this bit is zero, then zero is passed along,
-     * otherwise 255.
+     * otherwise 1.
+     *
+     * Alternatively several bits can be extracted at once, given as bit mask. There is one
+     * output per bit set in the mask, ordered from the least significant bit. For example
+     * all the bits of a digital port are extracted by a single block with the mask 0xff.
+     *
+     * The outputs are float by default, or uint8_t (0 or 1) if requested.
      *
      * \ingroup digitizers
      */
@@ -27,11 +33,13 @@ namespace gr {
       typedef boost::shared_ptr<block_demux> sptr;
 
       /*!
-       * \brief Creates the demux block, where only one bit is kept.
+       * \brief Creates the demux block, where only one bit is kept unless a bit mask is given.
        *
-       * \param bit_to_keep Which bit should be extracted from the sequence.
+       * \param bit_to_keep Which bit should be extracted from the sequence, ignored if a bit mask is given.
+       * \param bit_mask Bits to be extracted, one output per bit. Zero means bit_to_keep only.
+       * \param byte_output Output uint8_t instead of float.
        */
-      static sptr make(int bit_to_keep);
+      static sptr make(int bit_to_keep, int bit_mask=0, bool byte_output=false);
     };
 
   } // namespace digitizers
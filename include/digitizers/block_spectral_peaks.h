@@ -61,7 +61,13 @@ namespace gr {
      *                           <--|--> PEAK f STDEV
      *\endverbatim
      *
+     * The filters and the peak finder are evaluated by a single block that smooths only the bins
+     * within the frequency ranges, i.e. FILTERED f RESPONSE holds the smoothed response within
+     * [f_min, f_max] and the response as received elsewhere.
      *
+     * Several peaks can be tracked (e.g. harmonics), each within its own frequency range, see
+     * peak_detector. The f_min, f_max, PEAK f and PEAK f STDEV ports are then vectors of n_peaks
+     * items.
      *
      */
     class DIGITIZERS_API block_spectral_peaks : virtual public gr::hier_block2
@@ -78,12 +84,14 @@ namespace gr {
        * \param n_med median filter window size
        * \param n_avg averaging filter window size
        * \param n_prox size of proximity window
+       * \param n_peaks number of peaks (frequency ranges)
        */
       static sptr make(double samp_rate,
           int fft_window,
           int n_med,
           int n_avg,
-          int n_prox);
+          int n_prox,
+          int n_peaks=1);
     };
 
   } // namespace digitizers
@@ -0,0 +1,95 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_BLOCK_STATS_H
+#define INCLUDED_DIGITIZERS_BLOCK_STATS_H
+
+#include <digitizers/api.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Performance counters of a single block, see get_block_stats.
+     *
+     * The age of the data is the time elapsed between the acquisition of the first input sample
+     * of a work call (as given by the acq_info tags, i.e. acq_info_t::timestamp plus the
+     * timebase times the distance to the tag) and the start of the work call. Blocks without
+     * inputs count produced items and don't measure the age.
+     *
+     * Heap allocations within work are counted only if the executable installs allocation
+     * hooks, see thread_allocation_count.
+     *
+     * The buffer occupancy is the fill level of the fullest input buffer at the start of a work
+     * call (of the fullest output buffer for sources), i.e. close to one if the block can't keep
+     * up. Losses are counted by the blocks dropping data (application buffers of the digitizers,
+     * packages and frames of the sinks), zero for the other blocks.
+     *
+     * \ingroup digitizers
+     */
+    struct DIGITIZERS_API block_stats_t
+    {
+      std::string name;           // block alias if set, else e.g. demux_ff(42)
+      uint64_t work_calls;
+      uint64_t work_time_ns;      // total time spent within work
+      uint64_t items;             // input items consumed (items produced for sources)
+      uint64_t tags;              // input tags consumed
+      double items_per_second;    // since enabled or reset
+      double load;                // fraction of the time spent within work
+      int64_t data_age_ns;        // at the last work call, zero if unknown
+      int64_t max_data_age_ns;
+      double avg_data_age_ns;
+      uint64_t allocations;       // heap allocations within work
+      uint64_t allocating_calls;  // work calls that allocated
+      double buffer_occupancy;    // at the last work call, 0 to 1
+      double max_buffer_occupancy;
+      uint64_t lost;              // chunks, packages or frames lost
+    };
+
+    /*!
+     * \brief Enables or disables the collection of the performance counters for all the blocks
+     * of this module. Disabled by default, in which case the overhead is a single relaxed atomic
+     * load per work call. Enabling resets all the counters.
+     *
+     * \ingroup digitizers
+     */
+    DIGITIZERS_API void set_block_stats_enabled(bool enabled);
+
+    DIGITIZERS_API bool get_block_stats_enabled();
+
+    /*!
+     * \brief Returns the performance counters of all the existing blocks of this module.
+     *
+     * \ingroup digitizers
+     */
+    DIGITIZERS_API std::vector<block_stats_t> get_block_stats();
+
+    /*!
+     * \brief Resets the performance counters of all the blocks.
+     *
+     * \ingroup digitizers
+     */
+    DIGITIZERS_API void reset_block_stats();
+
+    /*!
+     * \brief Heap allocations made by the calling thread.
+     *
+     * The module only reads the counter, it is incremented by allocation hooks of the executable,
+     * e.g. a replaced global operator new as installed by the test and benchmark binaries (see
+     * lib/alloc_hooks.cc). Without hooks the counter and the allocations reported by
+     * get_block_stats stay zero.
+     *
+     * \ingroup digitizers
+     */
+    DIGITIZERS_API uint64_t &thread_allocation_count();
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_BLOCK_STATS_H */
@@ -17,6 +17,73 @@
 namespace gr {
   namespace digitizers {
 
+    /*!
+     * \brief Aggregation level of a cascade_sink.
+     *
+     * Each level aggregates (decimates) the output of its parent level, or the raw input if the
+     * parent is empty. The level feeds a streaming time-domain sink named signal_name@name if
+     * the package size is non-zero. Levels neither feeding a sink nor any other level are not
+     * instantiated at all. A level with a decimation of one does not aggregate, it forwards
+     * the output of its parent (e.g. a rate already delivered by the digitizer, see
+     * cascade_sink::hardware_levels).
+     *
+     * The sink of a values-only level gets no errors. The errors are not computed at all
+     * unless needed by a child level or the triggered sinks, i.e. the level only runs the
+     * value filter (see block_aggregation::make).
+     *
+     * \ingroup digitizers
+     */
+    struct DIGITIZERS_API cascade_level_t
+    {
+      std::string name;          // e.g. "1kHz", unique within the cascade
+      std::string parent;        // name of the parent level, empty for the raw input
+      int decimation;            // with respect to the parent level
+      int package_size;          // streaming sink data package size, 0 for no sink
+      bool values_only;          // the sink doesn't publish the errors
+    };
+
+    /*!
+     * \brief Worst-case memory of a cascade, see cascade_sink::plan_buffers.
+     *
+     * \ingroup digitizers
+     */
+    struct DIGITIZERS_API buffer_plan_t
+    {
+      uint64_t stream_buffer_bytes;  // output buffers of the blocks within the cascade
+      uint64_t sink_bytes;           // post-mortem and spectrum buffers held by the sinks
+      uint64_t total_bytes;          // sum of the above
+      uint32_t nbuffers;             // number of output buffers sized
+      double max_latency;            // longest time span held by a single output buffer (in seconds)
+    };
+
+    /*!
+     * \brief Arguments of cascade_sink::make, see cascade_sink::make_many.
+     *
+     * \ingroup digitizers
+     */
+    struct DIGITIZERS_API cascade_sink_config_t
+    {
+      int alg_id;
+      int delay;
+      std::vector<float> fir_taps;
+      double low_freq;
+      double up_freq;
+      double tr_width;
+      std::vector<double> fb_user_taps;
+      std::vector<double> fw_user_taps;
+      double samp_rate;
+      float pm_buffer;
+      std::string signal_name;
+      std::string unit_name;
+      std::vector<cascade_level_t> levels;
+      bool triggered_sinks_enabled;
+      bool frequency_sinks_enabled;
+      bool postmortem_sinks_enabled;
+      bool interlocks_enabled;
+      unsigned pre_trigger_window_raw;
+      unsigned post_trigger_window_raw;
+    };
+
     /*!
      * \brief Receives a signal and error estimation, and publishes it to FESA at 10Hz and 1Hz. The
      * signal_name is used for all four exposed signals, where each signal gets a correspondent signal
@@ -44,7 +111,7 @@ namespace gr {
       /*!
        * \brief Return a shared_ptr to a new instance of digitizers::cascade_sink.
        *
-       * \param alg_id Chosen algorithm of the circuit that later maps to an enum(valid:0-6).
+       * \param alg_id Chosen algorithm of the circuit that later maps to an enum(valid:0-9, see algorithm_id_t).
        * \param delay The delay of the samples on output.
        * \param fir_taps user defined FIR-filter taps.
        * \param low_freq lower frequency boundary.
@@ -82,6 +149,193 @@ namespace gr {
           unsigned pre_trigger_window_raw,
           unsigned post_trigger_window_raw);
 
+      /*!
+       * \brief Same as above, except that the streaming aggregation ladder is given by the
+       * levels instead of being fixed, see cascade_level_t and default_levels.
+       */
+      static sptr make(int alg_id,
+          int delay,
+          const std::vector<float> &fir_taps,
+          double low_freq,
+          double up_freq,
+          double tr_width,
+          const std::vector<double> &fb_user_taps,
+          const std::vector<double> &fw_user_taps,
+          double samp_rate,
+          float pm_buffer,
+          std::string signal_name,
+          std::string unit_name,
+          const std::vector<cascade_level_t> &levels,
+          bool triggered_sinks_enabled,
+          bool frequency_sinks_enabled,
+          bool postmortem_sinks_enabled,
+          bool interlocks_enabled,
+          unsigned pre_trigger_window_raw,
+          unsigned post_trigger_window_raw);
+
+      /*!
+       * \brief Creates many cascades at once, e.g. one per channel of a large digitizer.
+       *
+       * The filter designs of all the cascades are computed first, concurrently on nthreads
+       * threads (including the calling thread) and once per distinct design, i.e. cascades with
+       * the same settings and sample rate share the design. The blocks are then created
+       * sequentially, GNU Radio's block construction is not thread safe, and find their designs
+       * in memory (see design_cache_t). Equal coefficient sets are held once and shared by the
+       * blocks of all the cascades.
+       *
+       * \param configs arguments of each cascade, see make
+       * \param nthreads number of threads designing filters, 0 for one per core
+       * \returns the cascades, in the order of the configs
+       */
+      static std::vector<sptr> make_many(const std::vector<cascade_sink_config_t> &configs,
+          int nthreads=0);
+
+      /*!
+       * \brief Levels used if streaming sinks are enabled: 10 kHz, 1 kHz, 100 Hz, 25 Hz, 10 Hz
+       * and 1 Hz.
+       */
+      static std::vector<cascade_level_t> default_levels(double samp_rate);
+
+      /*!
+       * \brief Adapts levels designed for the raw sample rate to an input downsampled by the
+       * digitizer (MIN_MAX_AGG or AVERAGE mode, see digitizer_block::set_downsampling).
+       *
+       * The hardware takes over the equivalent part of the top levels, i.e. the decimation of
+       * each level fed by the raw input is divided by the downsampling factor. Top levels fully
+       * covered by the hardware become pass-through levels, their sinks are fed by the digitizer
+       * output directly. The cascade has to be created with the downsampled rate, e.g.:
+       *
+       *   auto factor = digitizer->get_downsampling_factor();
+       *   auto levels = cascade_sink::hardware_levels(
+       *           cascade_sink::default_levels(digitizer->get_samp_rate()), factor);
+       *   auto cascade = cascade_sink::make(..., digitizer->get_samp_rate() / factor, ..., levels, ...);
+       *
+       * Errors and timebase_info tags are taken from the digitizer output as is, the digitizer
+       * provides the error of the downsampled samples (derived from min and max values or scaled
+       * by the averaging) and the downsampled timebase.
+       *
+       * Throws std::invalid_argument if the factor is not positive or if it does not divide the
+       * decimation of a top level, i.e. if a level needs a higher rate than delivered.
+       */
+      static std::vector<cascade_level_t> hardware_levels(const std::vector<cascade_level_t> &levels,
+              int downsampling_factor);
+
+      /*!
+       * \brief Reconfigures the aggregation ladder.
+       *
+       * Only the levels which are new or changed (including the levels whose parent changed)
+       * are rebuilt, the others, including their sinks, are left untouched. The flowgraph is
+       * locked while reconnecting, i.e. the cascade must be part of a flowgraph. Throws
+       * std::invalid_argument if the levels are not valid (e.g. unknown parent), in which case
+       * the cascade is not changed.
+       */
+      virtual void set_levels(const std::vector<cascade_level_t> &levels) = 0;
+
+      /*!
+       * \brief Returns the levels as instantiated, i.e. without the pruned ones.
+       */
+      virtual std::vector<cascade_level_t> get_levels() = 0;
+
+      /*!
+       * \brief Returns the names of the levels being computed.
+       *
+       * A level is computed while one of its sinks, or a sink of its children, has a consumer,
+       * i.e. a callback or the shared memory export set. The aggregation of the other levels is
+       * paused: outputs are zero (tags are still passed on) and the filters restart from a clean
+       * state once a consumer is registered again. Only the fused FIR and CIC algorithms pause,
+       * the others keep computing.
+       */
+      virtual std::vector<std::string> get_active_levels() = 0;
+
+      /*!
+       * \brief Enables or disables the triggered sinks at runtime.
+       *
+       * The triggered demux blocks and sinks are created when first enabled and kept when
+       * disabled, i.e. re-enabling returns the same sinks. The level feeding the triggered
+       * 10 kHz sink is added if missing, and pruned again when disabled unless it feeds other
+       * sinks. The flowgraph is locked while reconnecting, see set_levels.
+       */
+      virtual void set_triggered_sinks_enabled(bool enabled) = 0;
+
+      /*!
+       * \brief Sizes the output buffers of all the blocks within the cascade to fit the memory
+       * budget of the channel.
+       *
+       * Each output buffer is sized to hold the latency target worth of samples at the rate of
+       * the block, but never less than twice what its consumers take at once (package size,
+       * decimation or trigger window). If the budget doesn't allow for the target, the part
+       * above the minimum is scaled down evenly. The buffers of the sinks themselves (post-mortem
+       * history, spectra) are fixed at construction and are accounted for as is.
+       *
+       * Buffers are allocated when the flowgraph is started, i.e. the plan must be made before.
+       * The plan is kept and reapplied to the levels and sinks added later (set_levels,
+       * set_triggered_sinks_enabled). Throws std::invalid_argument if the latency is not
+       * positive or if even the minimal buffers exceed the budget, in which case nothing is
+       * changed.
+       *
+       * \param memory_budget bytes available to the cascade
+       * \param latency target buffering latency per block (in seconds)
+       * \returns worst-case memory of the cascade
+       */
+      virtual buffer_plan_t plan_buffers(uint64_t memory_budget, double latency) = 0;
+
+      /*!
+       * \brief Pins the threads of the blocks within the cascade to the given cores.
+       *
+       * The blocks are grouped into chains: each level fed by the input starts a chain and its
+       * descendant levels, the sinks and the triggered demux blocks join the chain of their
+       * producer. All the blocks of a chain share a core, i.e. a consumer runs where the data
+       * was just produced. Chains are distributed over the cores round-robin, the raw-rate
+       * triggered chain included.
+       *
+       * The assignment is kept and reapplied to the levels and sinks added later (set_levels,
+       * set_triggered_sinks_enabled). Takes effect immediately if the flowgraph is running.
+       *
+       * \param cores cores to use, empty to let the threads run on any core (default)
+       */
+      virtual void set_core_affinity(const std::vector<int> &cores) = 0;
+
+      /*!
+       * \brief Cores the blocks are pinned to, empty if not pinned.
+       */
+      virtual std::vector<int> get_core_affinity() = 0;
+
+      /*!
+       * \brief Persists the state of the aggregation filters (FIR/IIR histories, the fused and
+       * CIC accumulators) in a memory mapped file, i.e. a restarted process continues where the
+       * previous one stopped instead of waiting for the filters to settle.
+       *
+       * Each level keeps a record named after the level, saved every period from the work
+       * function and restored by its first work call. A record is only restored if the level
+       * design is unchanged and the record is not older than max_age. The post-mortem sinks (if
+       * enabled) are backed by path + ".pm_raw" and path + ".pm_1000" and resume their frozen
+       * history, see post_mortem_sink::set_backing_file.
+       *
+       * Must be called before the flowgraph is started, levels added later (set_levels) are
+       * attached as well.
+       *
+       * \param path state file, empty to disable (default)
+       * \param period save period (in seconds)
+       * \param max_age records saved longer ago are not restored (in seconds)
+       */
+      virtual void set_state_file(const std::string &path, double period=1.0, double max_age=3600.0) = 0;
+
+      /*!
+       * \brief Real-time memory mode, the buffers the time-domain sinks read (the outputs of
+       * the levels and of the triggered demux blocks) are prefaulted and locked into RAM on
+       * start, i.e. the first packages after arm do not stall on page faults. Complements
+       * digitizer_block::set_realtime_memory. Locking is best-effort (see RLIMIT_MEMLOCK).
+       *
+       * Kept for the sinks added later (set_levels, set_triggered_sinks_enabled).
+       * \param enabled lock the buffers
+       */
+      virtual void set_realtime_memory(bool enabled) = 0;
+
+      /*!
+       * \brief Number of bytes currently locked into RAM, see set_realtime_memory.
+       */
+      virtual size_t get_locked_memory() = 0;
+
       /*!
        * \brief Returns all time-domain sinks contained within this module.
        */
@@ -22,6 +22,22 @@ namespace gr {
      *
      * The initial values of the parameter are supplied in par_init.
      *
+     * The function is interpreted by ROOT (TF1), except for the following compiled models
+     * which are fitted by a built-in Levenberg-Marquardt solver using analytic derivatives:
+     *
+     *  - gaus: [0]*exp(-0.5*((x-[1])/[2])^2)
+     *  - lorentzian: [0]*[2]^2/((x-[1])^2+[2]^2)
+     *  - step_response: [1]*(0.5+0.5*TMath::Erf((x-[0])/[2]))
+     *  - exp_step_response: [1]*(1-exp(-(x-[0])/[2])) for x >= [0], 0 otherwise
+     *  - polN: [0] + [1]*x + ... + [N]*x^N
+     *  - [0]*x + [1]
+     *
+     * Where the explicit formulas given above are recognized too.
+     *
+     * ROOT is loaded on demand, by the first block fitting an interpreted formula. make and
+     * update_design throw std::runtime_error for such formulas if the library was built
+     * without ROOT.
+     *
      * \ingroup digitizers
      *
      */
@@ -75,6 +91,41 @@ namespace gr {
           const std::vector<double> &par_lim_up,
           const std::vector<double> &par_lim_dn,
           double chi_square_error) = 0;
+
+      /*!
+       * \brief Number of threads used for fitting, 1 by default (the scheduler thread).
+       *
+       * If several input vectors are available up to nthreads of them are fitted concurrently,
+       * results are output in order. Multi-threaded fitting requires ROOT 6.06 or newer, and
+       * Minuit2 is used as the (process-wide) default minimizer in that case.
+       */
+      virtual void set_nthreads(int nthreads) = 0;
+
+      /*!
+       * \brief Warm start, disabled by default.
+       *
+       * If enabled the fit starts from the parameters of the last converged fit instead of
+       * par_init (fixed parameters are kept). If the warm started fit fails or its chi square
+       * is not within chi_square_error, the vector is fitted again starting from par_init.
+       * The solution is reset on start and with each update_design.
+       *
+       * Note, vectors fitted concurrently (see set_nthreads) start from the same solution,
+       * i.e. the last converged one of the previous batch.
+       */
+      virtual void set_warm_start(bool enable) = 0;
+
+      /*!
+       * \brief Coarse-to-fine fitting of the compiled models, disabled by default (decimation
+       * 1). Ignored for formulas interpreted by ROOT.
+       *
+       * Each vector is first fitted on the averages of decimation consecutive samples, which
+       * converges at a fraction of the cost. The full resolution fit then starts from that
+       * solution and is given a few iterations, for the Gaussian only within 8 sigma of the
+       * coarse peak. Chi square and errors are evaluated on the whole vector, i.e. the result
+       * is the one of the full resolution fit. If the refinement doesn't converge within its
+       * iterations it continues on the whole vector.
+       */
+      virtual void set_coarse_fit(int decimation) = 0;
     };
 
   } // namespace digitizers
@@ -21,6 +21,10 @@ namespace gr {
      * are fixed with the decimation factor and user provided delay. If more than one acq_info
      * tags falls into the same output offset then the tags get merged.
      *
+     * With raw input the block takes the raw ADC counts of a digitizer in raw output mode
+     * (int16_t), only the samples kept are converted to volts (see signal_averager for the
+     * raw_scaling tag handling).
+     *
      * \ingroup digitizers
      *
      */
@@ -35,8 +39,9 @@ namespace gr {
        * \param decimation The decimation factor.
        * \param delay The acq info tag delay addition.
        * \param samp_rate sampel rate on input
+       * \param raw_input raw ADC counts (int16_t) are expected on the input
        */
-      static sptr make(int decimation, double delay, float samp_rate);
+      static sptr make(int decimation, double delay, float samp_rate, bool raw_input=false);
     };
 
   } // namespace digitizers
@@ -0,0 +1,79 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_DELAY_ESTIMATOR_FF_H
+#define INCLUDED_DIGITIZERS_DELAY_ESTIMATOR_FF_H
+
+#include <digitizers/api.h>
+#include <gnuradio/sync_block.h>
+
+#include <vector>
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Continuously estimates the delays (e.g. cable and driver skews) of a number of
+     * channels relative to the first one, input i is forwarded to output i.
+     *
+     * Every update_interval the channels are averaged over decim samples until window_size
+     * decimated samples are collected. The windows are handed over to a background thread,
+     * which cross-correlates each channel with the first one (FFT, see cross_correlator.h) and
+     * refines the peak to a fraction of a decimated sample. The work function only copies and
+     * averages the samples, windows are skipped while an estimate is ongoing.
+     *
+     * Each estimate is published as a channel_delay tag on all the outputs (zero delay on the
+     * reference output), e.g. time_realignment_ff corrects the timestamps of the channel
+     * accordingly. Channels whose correlation is below min_correlation keep their previous delay
+     * and are not tagged, i.e. the channels need a common signal content within the decimated
+     * bandwidth.
+     *
+     * \ingroup digitizers
+     */
+    class DIGITIZERS_API delay_estimator_ff : virtual public gr::sync_block
+    {
+     public:
+      typedef boost::shared_ptr<delay_estimator_ff> sptr;
+
+      /*!
+       * \brief Create a delay estimator.
+       *
+       * \param nchannels number of channels, i.e. inputs and outputs, at least two
+       * \param samp_rate sample rate of the inputs
+       * \param decim decimation applied before correlating
+       * \param window_size decimated samples correlated per estimate
+       * \param max_delay maximum absolute delay searched (in seconds)
+       * \param update_interval minimum time between estimates (in seconds)
+       * \param min_correlation normalized correlation peak required to accept an estimate
+       */
+      static sptr make(int nchannels, double samp_rate, int decim=8, int window_size=4096,
+              double max_delay=1e-6, double update_interval=1.0, float min_correlation=0.5f);
+
+      /*!
+       * \brief Latest delays of the channels relative to the first one (in seconds), positive
+       * if the channel is late.
+       */
+      virtual std::vector<double> get_delays() = 0;
+
+      /*!
+       * \brief Normalized correlation peaks of the latest estimate.
+       */
+      virtual std::vector<float> get_correlations() = 0;
+
+      /*!
+       * \brief Number of estimates done.
+       */
+      virtual uint64_t get_nr_estimates() = 0;
+
+      virtual void set_update_interval(double update_interval) = 0;
+
+      virtual double get_update_interval() = 0;
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_DELAY_ESTIMATOR_FF_H */
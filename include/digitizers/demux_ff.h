@@ -23,6 +23,11 @@ namespace gr {
     * Trigger and AcqInfo tags in each window are as well forwarded to the outputs.
     * Tags are re-created in order to reset the offset. (Just passing them to the output would result in wrong offset values)
     *
+    * Windows of tightly spaced triggers may overlap, every trigger yields a complete window. All
+    * the windows completed by the input at hand are output within a single work call. Triggers
+    * without enough pre-trigger samples (at the start of the stream) or exceeding the max number
+    * of pending windows are skipped, see get_skipped_triggers.
+    *
     * \ingroup digitizers
     */
     class DIGITIZERS_API demux_ff : virtual public gr::block
@@ -39,6 +44,11 @@ namespace gr {
        * creating new instances.
        */
       static sptr make(unsigned post_trigger_window, unsigned pre_trigger_window=0);
+
+      /*!
+       * \brief Returns the number of skipped triggers since start.
+       */
+      virtual uint64_t get_skipped_triggers() const = 0;
     };
 
   } // namespace digitizers
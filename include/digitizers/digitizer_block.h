@@ -9,7 +9,10 @@
 #define INCLUDED_DIGITIZERS_DIGITIZER_BLOCK_H
 
 #include <digitizers/api.h>
+#include <digitizers/frame_layout.h>
+#include <digitizers/interlock_generation_ff.h>
 #include <digitizers/range.h>
+#include <digitizers/status.h>
 #include <gnuradio/sync_block.h>
 #include <system_error>
 #include <string>
@@ -50,6 +53,28 @@ namespace gr {
       TRIGGER_DIRECTION_HIGH
     };
 
+    /*!
+     * \brief Software trigger condition evaluated per AI channel (streaming mode)
+     * \ingroup digitizers
+     */
+    enum DIGITIZERS_API trigger_condition_t
+    {
+      TRIGGER_CONDITION_ABOVE,   // signal at or above the lower threshold
+      TRIGGER_CONDITION_BELOW,   // signal at or below the lower threshold
+      TRIGGER_CONDITION_INSIDE,  // signal within [lower, upper] band
+      TRIGGER_CONDITION_OUTSIDE  // signal outside of [lower, upper] band
+    };
+
+    /*!
+     * \brief Specifies how multiple trigger conditions are combined
+     * \ingroup digitizers
+     */
+    enum DIGITIZERS_API trigger_logic_t
+    {
+      TRIGGER_LOGIC_AND,
+      TRIGGER_LOGIC_OR
+    };
+
     /*!
      * \brief Downsampling mode
      * \ingroup digitizers
@@ -72,6 +97,49 @@ namespace gr {
       std::error_code code;
     };
 
+    /*!
+     * \brief Application buffer and data path metrics (streaming mode).
+     * \ingroup digitizers
+     */
+    struct DIGITIZERS_API digitizer_metrics_t
+    {
+      static const int LATENCY_HISTOGRAM_SIZE = 16;
+
+      uint32_t free_buffers;         // number of free application buffers
+      uint32_t full_buffers;         // number of application buffers waiting to be processed
+      uint32_t min_free_buffers;     // min number of free application buffers since last read
+      uint64_t lost_buffers;         // number of application buffers lost since configure
+      uint64_t shed_buffers;         // of those, shed to keep the trigger reserve (see set_trigger_reserve)
+
+      // Callback-to-work latency histogram, bucket i counts chunks with latency in range
+      // [2^i, 2^(i+1)) us. The first bucket includes latencies below 1 us and the last bucket
+      // all the latencies above its lower bound. Counts since configure.
+      std::vector<uint64_t> latency_histogram;
+
+      double conversion_ns_per_sample; // average raw sample conversion time since last read
+      double estimated_samp_rate;      // as estimated by the watchdog
+      double samp_rate;                // as configured
+
+      // Streaming chunk timestamps are reconstructed from the sample counter by a clock model
+      // disciplined against the callback times
+      double clock_samp_rate;          // sample rate as tracked by the clock model
+      double timestamp_error_ns;       // smoothed callback time error (i.e. the jitter removed)
+
+      // Low-latency interlocks (see set_fast_interlock), latency is measured from the modeled
+      // acquisition time of the first sample out of bounds to the callback invocation
+      uint64_t fast_interlocks;              // number of interlocks issued since configure
+      double fast_interlock_latency_ns;      // latency of the last interlock
+      double max_fast_interlock_latency_ns;  // max latency since configure
+
+      // Buffer sizing, see set_auto_buffer_tuning. Recommendation and poll gap are zero unless
+      // the tuning is enabled and the first observation window has completed.
+      uint32_t driver_buffer_size;           // as applied on configure
+      uint32_t recommended_buffer_size;      // chunk size meeting the latency target
+      double max_poll_gap_ns;                // longest gap between polls, last window
+    };
+
+    class aggregated_source;
+
     /*! 
      * \brief Base class for digitizer blocks
      *
@@ -143,6 +211,109 @@ namespace gr {
        */
       virtual void set_nr_buffers(int nr_buffers) = 0;
 
+      /*!
+       * \brief Sets memory budget of the application buffer in bytes.
+       *
+       * The number of application buffers set via set_nr_buffers determines the initial pool size.
+       * If no free buffer is available the pool grows on demand, until the memory budget is
+       * exhausted. The initial pool is clamped to the budget as well. Zero (default) disables
+       * growth.
+       *
+       * Applicable in streaming mode only. The setting is applied on configure.
+       * \param max_bytes the memory budget in bytes
+       */
+      virtual void set_buffer_memory_budget(size_t max_bytes) = 0;
+
+      /*!
+       * \brief Returns number of application buffers currently allocated, which might be more
+       * than set via set_nr_buffers if the pool has grown (see set_buffer_memory_budget).
+       */
+      virtual size_t get_nr_allocated_buffers() = 0;
+
+      /*!
+       * \brief Returns the maximum number of application buffers being in use at once since
+       * the last configure. Useful for sizing the application buffer.
+       */
+      virtual size_t get_buffers_high_water_mark() = 0;
+
+      /*!
+       * \brief Returns application buffer and data path metrics. Lock-free, intended to be
+       * polled periodically.
+       *
+       * Note, the min_free_buffers and the conversion_ns_per_sample observation windows are
+       * restarted on each call (including when published via message port).
+       */
+      virtual digitizer_metrics_t get_metrics() = 0;
+
+      /*!
+       * \brief Sets the interval in seconds the metrics get published on the "metrics" message
+       * port, as a PMT dictionary with the keys named after the digitizer_metrics_t members.
+       * Zero (default) disables publishing.
+       *
+       * \param interval interval in seconds
+       */
+      virtual void set_metrics_interval(double interval) = 0;
+
+      /*!
+       * \brief Enables trace mode, a trace tag (see trace_tag_name) carrying the callback
+       * timestamp of the chunk is attached to every Nth chunk in streaming mode. The blocks of
+       * this module forward the tag and record the time it passes them, the sinks publish the
+       * hop-by-hop latency breakdown on their "trace" message port (see trace.h). Zero (default)
+       * disables tracing.
+       *
+       * \param chunks trace every chunks-th chunk
+       */
+      virtual void set_trace_interval(int chunks) = 0;
+
+      /*!
+       * \brief Enables delta emission of the acq_info tags in streaming mode.
+       *
+       * By default an acq_info tag is attached to each output for every chunk. With delta
+       * emission it is attached only if its content apart from the timestamp (timebase, delays,
+       * status, calibration and configuration version) differs from the last tag attached to the
+       * same output, and to all the outputs every Nth chunk, anchoring the timestamp. The
+       * timestamps of the samples in between are extrapolated from the last tag and the timebase,
+       * as done by the blocks of this module anyway. Fewer tags are passed through (and merged by)
+       * the flowgraph, up to N times fewer.
+       *
+       * Frames and triggered windows (see set_frame_output and set_triggered_windows) always
+       * carry the acq_info tag. Note, blocks cutting windows out of the stream, e.g. demux_ff,
+       * forward only the acq_info tags within the windows, the anchor interval shouldn't exceed
+       * the window length there. Zero (default) disables delta emission.
+       *
+       * \param chunks anchor every chunks-th chunk
+       */
+      virtual void set_acq_info_anchor_interval(int chunks) = 0;
+
+      /*!
+       * \brief Realigns the trigger tags to WR events within the digitizer, i.e. without a
+       * time_realignment_ff per channel copying the samples.
+       *
+       * Same as time_realignment_ff in streaming mode: the samples and the trigger tags are
+       * forwarded right away. Once the WR event of a trigger is received (see add_timing_event),
+       * known to be missing or max_buffer_time passed, a realignment tag (see realignment_t) is
+       * attached to all the outputs carrying the trigger. Used in streaming mode only, not
+       * with frames or triggered windows.
+       *
+       * \param enabled enables the realignment
+       * \param triggerstamp_matching_tolerance maximum difference between the trigger timestamp
+       * and the WR event (UTC) in seconds
+       * \param max_buffer_time maximum time in seconds a trigger waits for its WR event
+       */
+      virtual void set_timing_realignment(bool enabled, float triggerstamp_matching_tolerance=0.03f,
+              float max_buffer_time=0.3f) = 0;
+
+      /*!
+       * \brief Add information about the timing event, see set_timing_realignment.
+       *
+       * \param event_id An arbitrary event descriptor
+       * \param wr_trigger_stamp event timestamp, TAI ns
+       * \param wr_trigger_stamp_utc event timestamp UTC
+       * \returns false if the oldest event had to be dropped
+       */
+      virtual bool add_timing_event(const std::string &event_id, int64_t wr_trigger_stamp,
+              int64_t wr_trigger_stamp_utc) = 0;
+
       /*!
        * \brief Sets driver buffer size in samples per channel.
        *
@@ -150,6 +321,183 @@ namespace gr {
        */
       virtual void set_driver_buffer_size(int driver_buffer_size) = 0;
 
+      /*!
+       * \brief Enables automatic driver buffer sizing (streaming mode).
+       *
+       * The poll thread observes the polls over windows of two seconds, starting on arm: the
+       * longest gap between polls and the largest number of samples received by a poll. At the
+       * end of each window the driver buffer is sized to hold four times the worst case. If the
+       * driver buffer needs to grow, or it is much larger than needed, the new size replaces
+       * the one set by set_driver_buffer_size and the device is re-armed (and thereby
+       * reconfigured) by the work thread, i.e. the stream is interrupted briefly.
+       *
+       * The chunk size (see set_buffer_size) meeting the latency target, given the observed
+       * poll gaps, is recommended via the metrics (see get_metrics). It is not applied, the
+       * chunk size determines the GR output multiple and can't change while the flowgraph is
+       * running.
+       *
+       * \param latency_target max latency in seconds, zero disables the tuning
+       */
+      virtual void set_auto_buffer_tuning(double latency_target) = 0;
+
+      /*!
+       * \brief Enables or disables zero-copy mode.
+       *
+       * In zero-copy mode the driver hands over raw ADC samples to the application buffer as they
+       * are, and those samples get converted directly into the GR output buffers. That way the
+       * intermediate copy of the converted values and errors is avoided. Drivers not supporting
+       * this mode ignore the setting.
+       *
+       * Applicable in streaming mode only. The setting is applied on configure.
+       * \param enabled true to enable zero-copy mode
+       */
+      virtual void set_zero_copy(bool enabled) = 0;
+
+      /*!
+       * \brief Configures how the work thread waits for data chunks to become available.
+       *
+       * The work thread first busy-waits for the given number of iterations, then it yields the
+       * CPU for the given number of iterations, and only then it is put to sleep. Waking up a
+       * sleeping thread involves a syscall on both sides, which for small buffer sizes might cap
+       * the usable chunk rate. Setting both values to zero (default) parks the thread right away.
+       *
+       * Applicable in streaming mode only. The setting is applied on configure.
+       * \param spin_iterations number of busy-wait iterations
+       * \param yield_iterations number of yield iterations
+       */
+      virtual void set_wait_strategy(int spin_iterations, int yield_iterations) = 0;
+
+      /*!
+       * \brief Reserves application buffers for data around triggers.
+       *
+       * If the work thread falls behind, buffers are lost once the pool is exhausted, no matter
+       * what they hold. With a reserve the last nr_buffers free buffers (out of the maximum pool,
+       * see set_buffer_memory_budget) are handed out only for buffers holding a trigger of the
+       * trigger source (see set_aichan_trigger and set_di_trigger) or some of its pre- or
+       * post-trigger samples. Other buffers are shed first, i.e. triggered acquisitions survive
+       * transient overloads. Pre-trigger samples are protected if the driver delivered them
+       * within the same callback as the trigger. Shed buffers count as lost (see get_metrics).
+       *
+       * The reserve is not used with trigger conditions or without a trigger, nor by drivers not
+       * classifying their buffers. Zero (default) disables the reserve.
+       *
+       * Applicable in streaming mode only. The setting is applied on configure, the reserve must
+       * be smaller than the (maximum) number of buffers.
+       * \param nr_buffers number of buffers reserved
+       */
+      virtual void set_trigger_reserve(int nr_buffers) = 0;
+
+      /*!
+       * \brief Sets number of worker threads used to convert raw samples of enabled channels in
+       * parallel.
+       *
+       * By default (zero) all the channels are converted by the poll thread. With many enabled
+       * channels the conversion time might delay the next poll request and cause driver buffer
+       * overruns. Note, the poll thread still waits for the conversion to complete. Drivers not
+       * supporting parallel conversion ignore the setting.
+       *
+       * Applicable in streaming mode only. The setting is applied on configure.
+       * \param nr_threads number of worker threads
+       */
+      virtual void set_conversion_threads(int nr_threads) = 0;
+
+      /*!
+       * \brief Configures memory backing the application buffer (streaming mode).
+       *
+       * All data chunks are carved out of a single contiguous memory region. If huge_pages is set
+       * the region is backed by huge pages where possible (explicit huge pages first, transparent
+       * huge pages otherwise). If numa_node is not negative the region is bound to the given
+       * NUMA node, typically the one the USB host controller and the consuming threads are
+       * attached to. Both settings are best-effort, a warning is logged if they can't be applied.
+       *
+       * The setting is applied on configure.
+       * \param huge_pages back the application buffer with huge pages
+       * \param numa_node NUMA node the application buffer is bound to, -1 for no binding
+       */
+      virtual void set_buffer_memory_policy(bool huge_pages, int numa_node) = 0;
+
+      /*!
+       * \brief Real-time memory mode, the buffers of the acquisition path are prefaulted and
+       * locked into RAM (mlock) as they are allocated, i.e. the first acquisitions after arm do
+       * not stall on page faults.
+       *
+       * Covers the application buffer (grown chunks included) and the rapid block readout
+       * buffer, the driver buffers, the scratch and pre-trigger window buffers (on arm) and the
+       * output buffers of this block (on start). Locking is best-effort (see RLIMIT_MEMLOCK), a
+       * warning is logged if it fails, the pages are prefaulted regardless where the kernel
+       * supports it.
+       *
+       * The setting is applied on configure.
+       * \param enabled lock the buffers
+       */
+      virtual void set_realtime_memory(bool enabled) = 0;
+
+      /*!
+       * \brief Number of bytes currently locked into RAM, see set_realtime_memory.
+       */
+      virtual size_t get_locked_memory() = 0;
+
+      /*!
+       * \brief Pins the poller thread to the given CPUs and optionally requests real-time
+       * (SCHED_FIFO) scheduling.
+       *
+       * If the settings can't be applied (e.g. insufficient privileges) an error is reported via
+       * get_errors and the CHANNEL_STATUS_THREAD_SCHEDULING_FAILED status flag is set in the
+       * acq_info tags. Acquisition continues with default scheduling.
+       *
+       * Applicable in streaming mode only. The setting is applied when the poller is started.
+       * \param cpus CPUs the thread is allowed to run on, empty for no affinity
+       * \param rt_priority SCHED_FIFO priority, 0 to keep the default scheduling policy
+       */
+      virtual void set_poller_scheduling(const std::vector<int> &cpus, int rt_priority) = 0;
+
+      /*!
+       * \brief Pins the GR thread executing the work method of this block to the given CPUs and
+       * optionally requests real-time (SCHED_FIFO) scheduling.
+       *
+       * The settings are applied on the first call to the work method. Error reporting is the same
+       * as for set_poller_scheduling.
+       * \param cpus CPUs the thread is allowed to run on, empty for no affinity
+       * \param rt_priority SCHED_FIFO priority, 0 to keep the default scheduling policy
+       */
+      virtual void set_work_thread_scheduling(const std::vector<int> &cpus, int rt_priority) = 0;
+
+      /*!
+       * \brief Sets the bounds of the low-latency interlock of the given analog channel.
+       *
+       * Contrary to interlock_generation_ff the bounds are evaluated by the poll thread right
+       * after the raw samples are converted, i.e. the interlock latency does not include the
+       * application buffer and any of the downstream GR buffers. An interlock is issued if the
+       * value is greater or equal to max or less or equal to min, the next one only after the
+       * value is back within the bounds.
+       *
+       * Applicable in streaming mode only. Settings are expected to be made before arming.
+       * \param id channel id
+       * \param min lower bound, -inf disables lower bound checking
+       * \param max upper bound, inf disables upper bound checking
+       */
+      virtual void set_fast_interlock(const std::string &id, double min, double max) = 0;
+
+      /*!
+       * \brief Register a callable, called by the poll thread for each low-latency interlock.
+       * The timestamp passed is the modeled timestamp (UTC nanoseconds) of the first sample out
+       * of bounds. The callable should return quickly, it delays the acquisition.
+       *
+       * \param callback user callback
+       * \param ptr a void pointer that is passed back to the callback
+       */
+      virtual void set_fast_interlock_callback(interlock_cb_t callback, void *ptr) = 0;
+
+      /*!
+       * \brief Sets the latency budget of the low-latency interlocks in samples, i.e. the max
+       * number of samples converted before the interlocks are evaluated. Smaller values lower
+       * the latency at the cost of more, smaller conversions. Zero (default) evaluates the
+       * interlocks once per driver callback (or application buffer).
+       *
+       * \param samples max number of samples per evaluation
+       */
+      virtual void set_fast_interlock_latency_budget(int samples) = 0;
+
       /*!
        * \brief If auto arm is set then this block will automatically arm or rearm
        * the device, that is initially on start and afterwards whenever a desired
@@ -174,13 +522,93 @@ namespace gr {
        * \param nr_waveforms
        */
       virtual void set_rapid_block(int nr_waveforms) = 0;
+
+      /*!
+       * \brief Enables or disables bulk readout in rapid block mode.
+       *
+       * If enabled all the captured waveforms are transferred from the device in a single driver
+       * call into a pre-allocated multi-segment buffer, instead of issuing a transfer per
+       * waveform. This reduces the dead time between bursts for large number of captures at the
+       * cost of the driver buffer being large enough to hold all of them. Drivers not supporting
+       * bulk readout fall back to reading waveforms one by one.
+       *
+       * The setting is applied on arming the device.
+       * \param enabled true to enable bulk readout
+       */
+      virtual void set_bulk_readout(bool enabled) = 0;
+
+      /*!
+       * \brief Enables or disables overlapped readout and re-arm in rapid block mode.
+       *
+       * If enabled the device memory is split into two halves, each holding all the captures
+       * of a single acquisition. As soon as captures are complete the device is re-armed into
+       * the other half while the captured waveforms are being read out, instead of re-arming
+       * only after the readout. This way the repetition rate is not bounded by the readout
+       * time. Effective only in combination with auto arm and if trigger once is not set.
+       *
+       * The setting is applied on configure.
+       * \param enabled true to enable overlapped readout
+       */
+      virtual void set_overlapped_readout(bool enabled) = 0;
+
+      /*!
+       * \brief Enables or disables asynchronous readout in rapid block mode.
+       *
+       * If enabled the waveforms are read out from the device (and the device is re-armed) by a
+       * dedicated readout thread, one waveform per pooled segment buffer, instead of by the
+       * work function. The work function only copies out the segments read out already, i.e.
+       * device readout latency doesn't block the flowgraph. The pool holds the waveforms of two
+       * acquisitions, if all the segments are in use the readout waits for the work function.
+       *
+       * The setting is applied on start.
+       * \param enabled true to enable asynchronous readout
+       */
+      virtual void set_async_readout(bool enabled) = 0;
       
       /*!
        * \brief Set streaming mode.
        *
-       * \param poll_rate
+       * The driver is polled on absolute deadlines, i.e. the time spent polling doesn't add up
+       * to the poll period. With adaptive polling the poll period is derived from the sample
+       * rate and the driver buffer size (see set_driver_buffer_size): it is adjusted to the
+       * number of samples received per poll in order to poll about when a quarter of the driver
+       * buffer is filled, shorter if the driver delivers more at once and longer if it has
+       * nothing to hand over. The poll rate is the initial period in that case. Not applicable
+       * to devices polled by a device group (see set_device_group).
+       *
+       * Drivers able to tell when data is available (e.g. the paced streams of the simulation
+       * and replay sources) are event-driven instead, the poll rate doesn't apply to them.
+       *
+       * \param poll_rate poll period in seconds
+       * \param adaptive adapt the poll period to the driver buffer fill level
+       */
+      virtual void set_streaming(double poll_rate=0.001, bool adaptive=false) = 0;
+
+      /*!
+       * \brief Makes the device part of a device group (within the same process).
+       *
+       * Devices using the same group name are polled by a single poll thread in staggered slots
+       * instead of a poll thread per device, and their data is timestamped from a common group
+       * clock (monotonic clock with a common UTC epoch) rather than from the wall clock. The
+       * timestamp offset is added to the timestamps of this device, e.g. to compensate for known
+       * trigger or cable delays between the devices.
+       *
+       * Applicable in streaming mode only. The setting is applied when the poller is started.
+       * The poller scheduling settings of the device starting the group poll thread apply to
+       * the whole group.
+       * \param group group name, empty string for a dedicated poll thread (default)
+       * \param timestamp_offset timestamp offset in seconds
+       */
+      virtual void set_device_group(const std::string &group, double timestamp_offset=0.0) = 0;
+
+      /*!
+       * \brief Set the payload encoding of the acq_info and trigger tags.
+       *
+       * The binary encoding (default) needs a single allocation per tag, the tuple encoding is
+       * kept for consumers decoding the tag values as PMT tuples. Decoders provided by this
+       * module (see tags.h) accept both the encodings.
        */
-      virtual void set_streaming(double poll_rate=0.001) = 0;
+      virtual void set_tag_encoding(tag_encoding_t encoding) = 0;
 
       /*!
        * \brief Set downsampling mode and downsampling factor.
@@ -193,6 +621,107 @@ namespace gr {
        */
       virtual void set_downsampling(downsampling_mode_t mode, int downsample_factor=0) = 0;
 
+      /*!
+       * \brief Get the downsampling mode, see set_downsampling.
+       */
+      virtual downsampling_mode_t get_downsampling_mode() = 0;
+
+      /*!
+       * \brief Get the downsampling factor, one if downsampling is disabled.
+       *
+       * Outputs are delivered at get_samp_rate() / get_downsampling_factor() samples per second,
+       * see cascade_sink::hardware_levels for aggregating such outputs.
+       */
+      virtual int get_downsampling_factor() = 0;
+
+      /*!
+       * \brief Enables a second, aggregated stream delivered by a separate source block next to
+       * the regular outputs (streaming mode only).
+       *
+       * The regular outputs keep the full rate, e.g. for triggered raw windows, while the
+       * aggregated_source returned by get_aggregated_source delivers the same channels
+       * aggregated over factor samples, e.g. for slow monitoring. Note the aggregation is done
+       * on the host from the converted chunks since the devices deliver a single downsampling
+       * mode at a time. Not available in raw output mode. The source block is replaced on each
+       * call, i.e. the setting must be applied before the flowgraph is connected.
+       *
+       * \param mode MIN_MAX_AGG, AVERAGE or DECIMATE, NONE disables the aggregated stream
+       * \param factor number of samples per aggregated item, at least 2
+       */
+      virtual void set_aggregated_output(downsampling_mode_t mode, int factor) = 0;
+
+      /*!
+       * \brief Returns the aggregated stream source, null if disabled (see set_aggregated_output).
+       */
+      virtual boost::shared_ptr<aggregated_source> get_aggregated_source() = 0;
+
+      /*!
+       * \brief Replaces the per-channel outputs by a single output delivering multi-channel
+       * frames (streaming mode only).
+       *
+       * Each output item is a frame of frame_samples samples of all the channels and ports, see
+       * frame_layout_t, i.e. the scheduler handles a single buffer instead of one per channel,
+       * error estimate and port. Tags are attached once per frame stream:
+       *  - a single acq_info tag per chunk, the status is the union of the channel statuses
+       *    and the calibration isn't reported (the values are calibrated already)
+       *  - trigger tags on the frame holding the trigger, trigger_offset is increased by the
+       *    time from the first sample of the frame to the trigger sample
+       *  - timebase_info and trace tags as usual, constant_error tags aren't published
+       *
+       * The frame_splitter restores the per-channel streams. The buffer size needs to be a
+       * multiple of frame_samples. Not available in raw output mode. The output signature is
+       * replaced, i.e. the setting must be applied before the flowgraph is connected.
+       *
+       * \param frame_samples samples per frame, zero restores the per-channel outputs
+       */
+      virtual void set_frame_output(int frame_samples) = 0;
+
+      /*!
+       * \brief Returns the layout of the output frames, zero samples if the per-channel outputs
+       * are used (see set_frame_output).
+       */
+      virtual frame_layout_t get_frame_layout() = 0;
+
+      /*!
+       * \brief Delivers the pre- and post-trigger windows around the software triggers only
+       * (streaming mode only).
+       *
+       * The windows are cut out of the acquired chunks before they reach the output buffers,
+       * i.e. the downstream load scales with the trigger rate instead of the sample rate and
+       * no demux is needed. Each window holds the pre and post samples (see set_samples) of
+       * all the outputs and carries the acq_info tag of the chunk holding the trigger on its
+       * first sample and the trigger tag on the trigger sample. Windows may span chunks and
+       * overlap, overlapping windows repeat the shared samples. Triggers closer than the pre
+       * samples to the start of the acquisition are dropped. Trace tags aren't published.
+       *
+       * Not available in raw output mode and together with the frame output.
+       *
+       * \param enabled true to deliver the windows only, false for the continuous stream
+       */
+      virtual void set_triggered_windows(bool enabled) = 0;
+
+      /*!
+       * \brief Replaces the per-port outputs by a single output delivering all the digital
+       * ports packed into one word per sample (streaming mode only).
+       *
+       * Bit 8 * port + pin of the word holds the given pin, disabled ports read zero. The word
+       * is a uint16_t on devices with up to two ports and a uint32_t on devices with up to four
+       * ports (see get_packed_port_size). The tags of the ports go to the packed output and the
+       * digital trigger (see set_di_trigger) is searched across the packed words.
+       *
+       * Not available together with the frame output or triggered windows. The output signature
+       * is replaced, i.e. the setting must be applied before the flowgraph is connected.
+       *
+       * \param enabled true for a single packed output, false restores the per-port outputs
+       */
+      virtual void set_packed_ports(bool enabled) = 0;
+
+      /*!
+       * \brief Returns the size of the packed port words in bytes, zero if the per-port outputs
+       * are used (see set_packed_ports).
+       */
+      virtual size_t get_packed_port_size() = 0;
+
       /*! 
        * \brief Set the sample rate.
        * \param rate a new rate in Sps
@@ -241,6 +770,22 @@ namespace gr {
        */
       virtual void set_aichan_range(const std::string &id, double range, double range_offset = 0) = 0;
 
+      /*!
+       * \brief Configure the calibration of an AI channel, applied by the driver while converting
+       * raw samples, i.e. at no extra cost:
+       *   value = voltage * scale - offset
+       *   error = error * scale
+       *
+       * Same as a block_scaling_offset directly behind the channel output. The calibration is
+       * reported via the acq_info tag and included in the raw_scaling tag. Software trigger
+       * thresholds and fast interlock limits refer to the calibrated values.
+       *
+       * \param id Channel name e.g. "A", "B", "C", "D", ...
+       * \param scale calibration scale, must be positive
+       * \param offset calibration offset, in calibrated units
+       */
+      virtual void set_aichan_calibration(const std::string &id, double scale, double offset = 0) = 0;
+
       /*!
        * \brief Configure an AI channel trigger
        * \param id Channel name e.g. "A", "B", "C", "D", ...
@@ -277,6 +822,64 @@ namespace gr {
        */
       virtual void disable_triggers() = 0;
 
+      /*!
+       * \brief Adds an AI channel condition to the software trigger (streaming mode only).
+       *
+       * If any conditions are added they take precedence over the trigger configured via
+       * set_aichan_trigger or set_di_trigger. Conditions are combined as specified by
+       * set_trigger_logic and a trigger is generated once the combined condition becomes true,
+       * or once it has been true for the minimum pulse width if set. Note, the channel has to
+       * be enabled.
+       *
+       * \param id Channel name e.g. "A", "B", "C", "D", ...
+       * \param condition the condition
+       * \param lower lower threshold in Volts, the only one used in case of above and below
+       * \param upper upper threshold in Volts, used by window (inside and outside) conditions
+       */
+      virtual void add_aichan_trigger_condition(const std::string &id, trigger_condition_t condition,
+              double lower, double upper = 0.0) = 0;
+
+      /*!
+       * \brief Removes all the trigger conditions.
+       */
+      virtual void clear_trigger_conditions() = 0;
+
+      /*!
+       * \brief Sets how trigger conditions are combined, default is AND.
+       */
+      virtual void set_trigger_logic(trigger_logic_t logic) = 0;
+
+      /*!
+       * \brief Sets minimum pulse width. The combined trigger condition needs to hold for at
+       * least the given time, trigger is generated when this time elapses. Zero (default)
+       * triggers right away.
+       *
+       * \param min_width minimum pulse width in seconds
+       */
+      virtual void set_trigger_pulse_width(double min_width) = 0;
+
+      /*!
+       * \brief Starts a configuration transaction.
+       *
+       * Device settings changed until commit_config (channels, ports, trigger, samples, sample
+       * rate, buffer sizes, ...) are applied together by a single reconfiguration, i.e. with a
+       * single pass over the driver. Until then the device keeps running with the settings
+       * applied before, re-arming (e.g. the next rapid block acquisition) waits for the commit.
+       * Keep the transactions short.
+       *
+       * Note start (and configure) applies the settings regardless of the transaction.
+       */
+      virtual void begin_config() = 0;
+
+      /*!
+       * \brief Commits the configuration transaction. If running and any device settings have
+       * changed, the device is reconfigured by the work thread.
+       *
+       * Only the settings which differ from the ones applied to the device are passed to the
+       * driver (e.g. a single channel is set up again if only its range changed).
+       */
+      virtual void commit_config() = 0;
+
       /*!
        * \brief explicitly initialize connection to the device
        */
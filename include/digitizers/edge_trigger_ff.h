@@ -10,10 +10,26 @@
 
 #include <digitizers/api.h>
 #include <gnuradio/block.h>
+#include <string>
+#include <vector>
 
 namespace gr {
   namespace digitizers {
 
+    /*!
+     * \brief UDP send statistics of a single receiver, see edge_trigger_ff::get_udp_receiver_stats.
+     */
+    struct DIGITIZERS_API udp_receiver_stats_t
+    {
+      std::string host_and_port;
+      uint64_t sent;             // datagrams accepted by the kernel
+      uint64_t dropped;          // datagrams not accepted, e.g. socket buffer full
+      int64_t last_latency_ns;   // time from queuing the datagram until it was sent
+      int64_t max_latency_ns;
+      int64_t last_tx_latency_ns;   // time from queuing the datagram until its transmit timestamp
+      int64_t max_tx_latency_ns;
+    };
+
     /*!
      * \brief Edge detector with UDP notifications
      *
@@ -34,8 +50,11 @@ namespace gr {
      *            |______________|
      *
      * In addition, whenever a FIRST rising or falling edge is detected following a trigger event
-     * (determined based on the trigger tag), an UDP datagram is send to all receiving host. The
-     * format of the datagram is shown below:
+     * (determined based on the trigger tag), an UDP datagram is send to all receiving host. By
+     * default the fixed-layout binary format is used, see gr::digitizers::encode_edge_detect_batch.
+     * Edges detected within the batch window are sent with a single datagram, the datagram is sent
+     * once the window has passed (or immediately if the window is zero). The legacy xml format
+     * (one edge per datagram) is shown below:
      *
      * \code
      * <edgeDetect
@@ -72,6 +91,14 @@ namespace gr {
      * This is needed because the timestamp of the timing event does not contain a component (user delay)
      * foreseen to be used to compensate for cable delays and similar.
      *
+     * The host list might contain IP multicast groups (e.g. "239.255.10.1:2025"), in which case
+     * the datagram is sent once per group regardless of the number of subscribers. Receivers can
+     * filter the edges by the timing event id (see edge_trigger_receiver_f).
+     *
+     * Datagrams are sent asynchronously by a dedicated I/O thread, i.e. a slow or unreachable
+     * receiver never delays the sample path. Datagrams are dropped instead, if the outbound queue
+     * or the socket buffer is full. See get_udp_receiver_stats and get_udp_queue_drops.
+     *
      * Pre-trigger samples are ignored because this block cannot work with negative delays.
      *
      * This block generates the following tag:
@@ -99,6 +126,11 @@ namespace gr {
        * \param host_list comma separated list of hosts/ports, e.g. "127.0.0.1:33433, 10.5.2.33:55800"
        * \param send_udp_on_raising_edge send datagram on rising or on falling edge
        * \param timeout timeout in seconds, amount of time to wait to receive WR event or edge trigger
+       * \param batch_window edges within this time window (in seconds) are sent with a single datagram
+       * \param binary_protocol true to use the binary datagram format, false for the xml format
+       * \param multicast_ttl TTL of datagrams sent to multicast groups (i.e. the max number of hops)
+       * \param search_window edges are searched for up to this time (in seconds) following a
+       * trigger, zero to consider all edges
        * \return shared ptr
        */
       static sptr make(float sampling,
@@ -107,9 +139,25 @@ namespace gr {
               bool send_udp=true,
               std::string host_list="localhost:2025",
               bool send_udp_on_raising_edge=true,
-              float timeout=0.01f);
+              float timeout=0.01f,
+              float batch_window=0.0f,
+              bool binary_protocol=true,
+              int multicast_ttl=1,
+              float search_window=0.0f);
 
       virtual void set_send_udp(bool send_state) = 0;
+
+      /*!
+       * \brief Returns per-receiver send statistics. Safe to be called from any thread.
+       */
+      virtual std::vector<udp_receiver_stats_t> get_udp_receiver_stats() const = 0;
+
+      /*!
+       * \brief Returns the number of datagrams dropped because the outbound queue was full.
+       */
+      virtual uint64_t get_udp_queue_drops() const = 0;
+
+      virtual void reset_udp_stats() = 0;
     };
 
   } // namespace digitizers
@@ -11,9 +11,26 @@
 #include <digitizers/api.h>
 #include <gnuradio/sync_block.h>
 
+#include <string>
+#include <vector>
+
 namespace gr {
   namespace digitizers {
 
+    /*!
+     * \brief UDP receive statistics of a single source, see
+     * edge_trigger_receiver_f::get_udp_source_stats.
+     */
+    struct DIGITIZERS_API udp_source_stats_t
+    {
+      std::string host_and_port;
+      uint64_t received;   // datagrams received from the source
+      uint64_t lost;       // datagrams never received, from the gaps in the sequence numbers
+      uint64_t dropped;    // datagrams received but dropped, the receive ring was full
+      int64_t last_latency_ns;   // time from the sender creating the datagram until it was received
+      int64_t max_latency_ns;
+    };
+
     /*!
      * \brief Listens for UDP packets. when it receives one, it sends a predetermined number of zeroes,
      * with a tag. User can then do everything else. The format of the datagram is shown below:
@@ -29,7 +46,28 @@ namespace gr {
      * \endcode
      *
      * The stream is composed of only zeroes. It is up to the user to throttle the block.
-     * When a datagram with this content arrives, the block attaches a tag to the stream.
+     * When a datagram with this content arrives, the block attaches a tag to the stream. Binary
+     * datagrams (see encode_edge_detect_batch) might hold multiple edges, a tag is attached for
+     * each of them.
+     *
+     * If the address is an IP multicast group the block subscribes to it, any number of
+     * receivers might subscribe to the same group (also on the same host). Edges can be filtered
+     * by the timing event id, only edges of the listed events are tagged in that case. Note, the
+     * event id is only sent with the binary datagrams (version 2 and later), other edges are
+     * rejected when filtering.
+     *
+     * Datagrams are received by a dedicated thread, which drains the socket in batches (on Linux
+     * with a single recvmmsg system call) into a preallocated ring. The work function decodes all
+     * the datagrams received meanwhile and tags the edges at once. Datagrams are accounted per
+     * source, lost datagrams are detected by the sequence numbers of binary datagrams (version 3
+     * and later).
+     *
+     * Datagrams are timestamped on reception by the kernel (on Linux with SO_TIMESTAMPING), or by
+     * the NIC if the interface is configured for hardware timestamping. For binary datagrams
+     * carrying the send timestamp (version 4 and later) the latency from the sender creating the
+     * datagram until it was received is attached as an edge_detect_latency tag (int64_t
+     * nanoseconds, at the offset of the edges), and accounted per source. The clocks of the
+     * sender and the receiver are assumed to be synchronized (e.g. White Rabbit or PTP).
      * \ingroup digitizers
      *
      */
@@ -45,8 +83,23 @@ namespace gr {
        * constructor is in a private implementation
        * class. digitizers::edge_trigger_receiver_f::make is the public interface for
        * creating new instances.
+       *
+       * \param addr address to listen on, or the multicast group to subscribe to
+       * \param port UDP port
+       * \param event_filter comma separated list of timing event ids, empty to accept all edges
+       */
+      static sptr make(std::string addr, int port, std::string event_filter="");
+
+      /*!
+       * \brief Returns per-source receive statistics, in the order the sources were first seen.
+       * Safe to be called from any thread.
+       */
+      virtual std::vector<udp_source_stats_t> get_udp_source_stats() const = 0;
+
+      /*!
+       * \brief Resets the receive statistics.
        */
-      static sptr make(std::string addr, int port);
+      virtual void reset_udp_stats() = 0;
     };
 
   } // namespace digitizers
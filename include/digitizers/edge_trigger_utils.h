@@ -12,12 +12,41 @@
 #include <digitizers/api.h>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/xml_parser.hpp>
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
 #include <string>
+#include <vector>
 
 namespace gr {
   namespace digitizers {
 
     char const * const edge_detect_tag_name = "edge_detect";
+
+    /*!
+     * \brief Interned edge_detect tag key, see tags.h.
+     */
+    inline const pmt::pmt_t &
+    edge_detect_tag_key()
+    {
+      static const pmt::pmt_t key = pmt::intern(edge_detect_tag_name);
+      return key;
+    }
+
+    char const * const edge_detect_latency_tag_name = "edge_detect_latency";
+
+    /*!
+     * \brief Interned edge_detect_latency tag key. The value is the time (int64_t nanoseconds)
+     * from the sender creating the datagram until it was received, see edge_trigger_receiver_f.
+     */
+    inline const pmt::pmt_t &
+    edge_detect_latency_tag_key()
+    {
+      static const pmt::pmt_t key = pmt::intern(edge_detect_latency_tag_name);
+      return key;
+    }
+
     /*!
      * \brief Convenience structure for encoding/decoding the edge detect datagram.
      *
@@ -36,6 +65,8 @@ namespace gr {
 
       uint64_t offset;       // tag offset
 
+      uint64_t event_id;     // hashed timing event id (see ::edge_detect_event_id), zero if unknown
+
       bool is_raising_edge;
     };
 
@@ -119,11 +150,226 @@ namespace gr {
       return true;
     };
 
+    /**********************************************************************
+     * Binary edge detect datagram
+     *********************************************************************/
+
+    static const uint16_t EDGE_DETECT_MAGIC = 0x4445;          // "ED" on the wire
+    static const uint8_t EDGE_DETECT_PROTOCOL_VERSION = 4;
+    static const size_t EDGE_DETECT_HEADER_SIZE = 16;
+    static const size_t EDGE_DETECT_HEADER_SIZE_V3 = 8;        // version 3, without the send timestamp
+    static const size_t EDGE_DETECT_HEADER_SIZE_V2 = 4;        // versions 1 and 2, without the sequence
+    static const size_t EDGE_DETECT_RECORD_SIZE = 48;
+    static const size_t EDGE_DETECT_RECORD_SIZE_V1 = 40;       // version 1, without the event id
+    static const size_t EDGE_DETECT_MAX_BATCH = 28;            // fits a 1500 byte MTU
+
+    /*!
+     * \brief Hashes the timing event id (see wr_event_t) into the event id field of the
+     * edge detect datagram (64-bit FNV-1a). Zero is reserved for unknown events.
+     */
+    inline uint64_t
+    edge_detect_event_id(const std::string &event_id)
+    {
+      uint64_t hash = 14695981039346656037ULL;
+      for (auto c : event_id) {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 1099511628211ULL;
+      }
+      return hash ? hash : 1;
+    }
+
+    namespace edge_detect_detail {
+
+      inline void
+      put_le(std::string &payload, size_t pos, uint64_t value, size_t nbytes)
+      {
+        for (size_t i = 0; i < nbytes; i++) {
+          payload[pos + i] = static_cast<char>((value >> (8 * i)) & 0xff);
+        }
+      }
+
+      inline uint64_t
+      get_le(const char *payload, size_t pos, size_t nbytes)
+      {
+        uint64_t value = 0;
+        for (size_t i = 0; i < nbytes; i++) {
+          value |= static_cast<uint64_t>(static_cast<uint8_t>(payload[pos + i])) << (8 * i);
+        }
+        return value;
+      }
+
+      inline uint64_t
+      get_le(const std::string &payload, size_t pos, size_t nbytes)
+      {
+        return get_le(payload.data(), pos, nbytes);
+      }
+
+      inline size_t
+      header_size(uint64_t version)
+      {
+        return version >= 4 ? EDGE_DETECT_HEADER_SIZE
+                : version == 3 ? EDGE_DETECT_HEADER_SIZE_V3 : EDGE_DETECT_HEADER_SIZE_V2;
+      }
+
+    } // namespace edge_detect_detail
+
+    /*!
+     * \brief Encodes up to EDGE_DETECT_MAX_BATCH edges into a fixed-layout binary datagram.
+     *
+     * All the fields are little endian:
+     *
+     * \code
+     * offset  size  field
+     * 0       2     magic (0x4445)
+     * 2       1     protocol version
+     * 3       1     number of edges (N)
+     * 4       4     sequence number (uint32_t), since version 3
+     * 8       8     send timestamp (int64_t, UTC nanoseconds), since version 4
+     * 16 + 48 * i   edge i:
+     *   +0    8     timingEventTimeStamp (int64_t, UTC nanoseconds)
+     *   +8    8     retriggerEventTimeStamp (int64_t, UTC nanoseconds)
+     *   +16   8     delaySinceLastTimingEvent (int64_t, nanoseconds)
+     *   +24   8     samplesSinceLastTimingEvent (int64_t)
+     *   +32   4     val (IEEE 754 float)
+     *   +36   1     flags, bit 0 set for a rising edge
+     *   +37   3     reserved, zero
+     *   +40   8     event id (uint64_t, see edge_detect_event_id), since version 2
+     * \endcode
+     *
+     * The sequence number is incremented by the sender for each datagram, it allows the receivers
+     * to account for the lost datagrams (see edge_trigger_receiver_f::get_udp_source_stats).
+     * The send timestamp is taken by the sender when the datagram is created, it allows the
+     * receivers to measure the latency.
+     *
+     * The payload is overwritten, i.e. the same buffer can be reused without reallocating.
+     */
+    inline void
+    encode_edge_detect_batch(const edge_detect_t *edges, size_t count, std::string &payload,
+            uint32_t sequence = 0, int64_t send_timestamp = 0)
+    {
+      using edge_detect_detail::put_le;
+
+      if (count == 0 || count > EDGE_DETECT_MAX_BATCH) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid number of edges: " << count;
+        throw std::invalid_argument(message.str());
+      }
+
+      payload.assign(EDGE_DETECT_HEADER_SIZE + count * EDGE_DETECT_RECORD_SIZE, '\0');
+      put_le(payload, 0, EDGE_DETECT_MAGIC, 2);
+      put_le(payload, 2, EDGE_DETECT_PROTOCOL_VERSION, 1);
+      put_le(payload, 3, count, 1);
+      put_le(payload, 4, sequence, 4);
+      put_le(payload, 8, static_cast<uint64_t>(send_timestamp), 8);
+
+      for (size_t i = 0; i < count; i++) {
+        const auto &edge = edges[i];
+        const auto pos = EDGE_DETECT_HEADER_SIZE + i * EDGE_DETECT_RECORD_SIZE;
+
+        uint32_t value;
+        memcpy(&value, &edge.value, sizeof(value));
+
+        put_le(payload, pos, static_cast<uint64_t>(edge.timing_event_timestamp), 8);
+        put_le(payload, pos + 8, static_cast<uint64_t>(edge.retrigger_event_timestamp), 8);
+        put_le(payload, pos + 16, static_cast<uint64_t>(edge.delay_since_last_timing_event), 8);
+        put_le(payload, pos + 24, static_cast<uint64_t>(edge.samples_since_last_timing_event), 8);
+        put_le(payload, pos + 32, value, 4);
+        put_le(payload, pos + 36, edge.is_raising_edge ? 1 : 0, 1);
+        put_le(payload, pos + 40, edge.event_id, 8);
+      }
+    }
+
+    /*!
+     * \brief Returns true if the payload starts with the binary edge detect header.
+     */
+    inline bool
+    is_binary_edge_detect(const std::string &payload)
+    {
+      return payload.size() >= EDGE_DETECT_HEADER_SIZE
+              && edge_detect_detail::get_le(payload, 0, 2) == EDGE_DETECT_MAGIC;
+    }
+
+    /*!
+     * \brief Reads the sequence number and the send timestamp of a binary datagram. Returns false
+     * if there is no sequence number (xml datagrams and versions before 3), the send timestamp is
+     * zero (unknown) before version 4.
+     */
+    inline bool
+    get_edge_detect_header(const char *payload, size_t size, uint32_t &sequence, int64_t &send_timestamp)
+    {
+      using edge_detect_detail::get_le;
+
+      if (size < EDGE_DETECT_HEADER_SIZE_V3 || get_le(payload, 0, 2) != EDGE_DETECT_MAGIC) {
+        return false;
+      }
+
+      const auto version = get_le(payload, 2, 1);
+      if (version < 3 || size < edge_detect_detail::header_size(version)) {
+        return false;
+      }
+
+      sequence = static_cast<uint32_t>(get_le(payload, 4, 4));
+      send_timestamp = version >= 4 ? static_cast<int64_t>(get_le(payload, 8, 8)) : 0;
+      return true;
+    }
+
+    /*!
+     * \brief Decodes an edge detect datagram, either binary (see encode_edge_detect_batch) or
+     * xml (see encode_edge_detect). Decoded edges are appended. The event id of xml and
+     * version 1 datagrams is zero (unknown).
+     *
+     * \param payload string holding a payload
+     * \param edges decoded edges
+     * \return true if successfully decoded else it returns false (no edge is appended)
+     */
+    inline bool
+    decode_edge_detect_batch(const std::string &payload, std::vector<edge_detect_t> &edges)
+    {
+      using edge_detect_detail::get_le;
+
+      if (!is_binary_edge_detect(payload)) {
+        edge_detect_t edge {};
+        if (!decode_edge_detect(payload, edge)) {
+          return false;
+        }
+        edges.push_back(edge);
+        return true;
+      }
+
+      const auto version = get_le(payload, 2, 1);
+      const auto count = get_le(payload, 3, 1);
+      const auto header_size = edge_detect_detail::header_size(version);
+      const auto record_size = version == 1 ? EDGE_DETECT_RECORD_SIZE_V1 : EDGE_DETECT_RECORD_SIZE;
+      if (version < 1 || version > EDGE_DETECT_PROTOCOL_VERSION || count == 0
+              || payload.size() != header_size + count * record_size) {
+        return false;
+      }
+
+      for (size_t i = 0; i < count; i++) {
+        const auto pos = header_size + i * record_size;
+
+        edge_detect_t edge {};
+        edge.timing_event_timestamp = static_cast<int64_t>(get_le(payload, pos, 8));
+        edge.retrigger_event_timestamp = static_cast<int64_t>(get_le(payload, pos + 8, 8));
+        edge.delay_since_last_timing_event = static_cast<int64_t>(get_le(payload, pos + 16, 8));
+        edge.samples_since_last_timing_event = static_cast<int64_t>(get_le(payload, pos + 24, 8));
+
+        const auto value = static_cast<uint32_t>(get_le(payload, pos + 32, 4));
+        memcpy(&edge.value, &value, sizeof(value));
+
+        edge.is_raising_edge = get_le(payload, pos + 36, 1) & 0x1;
+        edge.event_id = version >= 2 ? get_le(payload, pos + 40, 8) : 0;
+        edges.push_back(edge);
+      }
+
+      return true;
+    }
+
     inline tag_t
     make_edge_detect_tag(edge_detect_t &edge_detect)
     {
       tag_t edge_tag;
-      edge_tag.key = pmt::mp(edge_detect_tag_name);
+      edge_tag.key = edge_detect_tag_key();
       edge_tag.offset = edge_detect.offset;
       edge_tag.value = pmt::make_tuple(
           pmt::from_bool(edge_detect.is_raising_edge),
@@ -138,7 +384,7 @@ namespace gr {
     inline edge_detect_t
     decode_edge_detect_tag(const tag_t &tag)
     {
-      assert(pmt::symbol_to_string(tag.key) == edge_detect_tag_name);
+      assert(tag.key == edge_detect_tag_key());
 
       if (!pmt::is_tuple(tag.value) || pmt::length(tag.value) != 5)
       {
@@ -0,0 +1,85 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_FRAME_LAYOUT_H
+#define INCLUDED_DIGITIZERS_FRAME_LAYOUT_H
+
+#include <digitizers/api.h>
+#include <cstddef>
+#include <cstdint>
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Memory layout of a multi-channel frame, see digitizer_block::set_frame_output.
+     *
+     * A frame holds the same number of consecutive samples of all the channels and ports of a
+     * digitizer, enabled or not (disabled ones are zero), one region after the other:
+     *
+     *  values ch0 | errors ch0 | values ch1 | errors ch1 | ... | port0 | port1 | ...
+     *
+     * Analog regions hold floats, port regions bytes. Consumers reading the frames directly use
+     * the accessors below instead of splitting them into streams (see frame_splitter).
+     *
+     * \ingroup digitizers
+     */
+    struct DIGITIZERS_API frame_layout_t
+    {
+      int ai_channels;
+      int ports;
+      int samples;       // samples per channel (or port) and frame
+
+      frame_layout_t(int ai_channels=0, int ports=0, int samples=0)
+        : ai_channels(ai_channels),
+          ports(ports),
+          samples(samples)
+      {
+      }
+
+      /*!
+       * \brief Size of a frame in bytes.
+       */
+      size_t frame_size() const
+      {
+        return static_cast<size_t>(samples) * (2 * ai_channels * sizeof(float) + ports);
+      }
+
+      size_t values_offset(int channel) const
+      {
+        return static_cast<size_t>(2 * channel) * samples * sizeof(float);
+      }
+
+      size_t errors_offset(int channel) const
+      {
+        return values_offset(channel) + samples * sizeof(float);
+      }
+
+      size_t port_offset(int port_idx) const
+      {
+        return values_offset(ai_channels) + static_cast<size_t>(port_idx) * samples;
+      }
+
+      const float *values(const void *frame, int channel) const
+      {
+        return reinterpret_cast<const float *>(static_cast<const uint8_t *>(frame) + values_offset(channel));
+      }
+
+      const float *errors(const void *frame, int channel) const
+      {
+        return reinterpret_cast<const float *>(static_cast<const uint8_t *>(frame) + errors_offset(channel));
+      }
+
+      const uint8_t *port(const void *frame, int port_idx) const
+      {
+        return static_cast<const uint8_t *>(frame) + port_offset(port_idx);
+      }
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_FRAME_LAYOUT_H */
@@ -0,0 +1,54 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_FRAME_SPLITTER_H
+#define INCLUDED_DIGITIZERS_FRAME_SPLITTER_H
+
+#include <digitizers/api.h>
+#include <digitizers/frame_layout.h>
+#include <gnuradio/sync_interpolator.h>
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Splits the multi-channel frames of a digitizer (see
+     * digitizer_block::set_frame_output) into per-channel streams.
+     *
+     * Outputs are the same as the per-channel outputs of the digitizer: values and errors of
+     * each analog channel (ports 2c and 2c+1), followed by a byte stream per digital port.
+     * Trailing outputs might be left unconnected.
+     *
+     * Tags of a frame are attached to all the outputs at the first sample of the frame, except
+     * trigger tags which go to the trigger sample (trigger_offset is reduced accordingly, the
+     * sample distance is taken from the acq_info or timebase_info tags).
+     *
+     * Consumers needing a few channels only are better off reading the frames directly, see
+     * frame_layout_t.
+     *
+     * \ingroup digitizers
+     */
+    class DIGITIZERS_API frame_splitter : virtual public gr::sync_interpolator
+    {
+     public:
+      typedef boost::shared_ptr<frame_splitter> sptr;
+
+      /*!
+       * \brief Return a shared_ptr to a new instance of digitizers::frame_splitter.
+       *
+       * \param ai_channels number of analog channels of the digitizer
+       * \param ports number of digital ports of the digitizer
+       * \param frame_samples samples per frame
+       */
+      static sptr make(int ai_channels, int ports, int frame_samples);
+
+      virtual frame_layout_t get_frame_layout() const = 0;
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_FRAME_SPLITTER_H */
@@ -27,6 +27,14 @@ namespace gr {
      *
      * IMPORTANT:
      * The specified window must be much smaller than the number of samples in one cycle of the signal!
+     *
+     * If the optional second input is connected it is taken as the quadrature component of the
+     * signal (e.g. the imaginary part of an analytic signal), and the frequency is estimated from
+     * the phase increments instead: the lag-one products z[n] conj(z[n-1]) are averaged over the
+     * last averager_window_size samples and the frequency is the phase of the average. This is
+     * more robust for noisy signals, the signal averager isn't used.
+     *
+     * One output is produced per decim input samples.
      * \ingroup digitizers
      *
      */
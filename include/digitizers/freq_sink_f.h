@@ -9,6 +9,7 @@
 #define INCLUDED_DIGITIZERS_FREQ_SINK_F_H
 
 #include <digitizers/sink_common.h>
+#include <digitizers/notification_hub.h>
 
 #include <digitizers/api.h>
 #include <gnuradio/sync_block.h>
@@ -40,6 +41,29 @@ namespace gr {
       uint32_t lost_count;           // number of measurements lost
     };
 
+    /*!
+     * \brief Spectrum frame accessed in place, see freq_sink_f::read_frame.
+     *
+     * Magnitude and phase arrays are 64 byte aligned. The frequency axis is shared among all
+     * the frames with the same axis, it is not copied per frame.
+     *
+     * \ingroup digitizers
+     */
+    struct DIGITIZERS_API spectrum_frame_t
+    {
+      uint64_t sequence;
+      spectra_measurement_t metadata;
+      const float *frequency;        // number_of_bins values
+      const float *magnitude;        // number_of_bins values
+      const float *phase;            // number_of_bins values
+    };
+
+    /*!
+     * \brief Invoked with a frame that is only valid for the duration of the call.
+     * \ingroup digitizers
+     */
+    typedef void (*frame_visitor_t)(const spectrum_frame_t *frame, void *ptr);
+
     /*!
      * \brief Frequency sink mode
      * \ingroup digitizers
@@ -50,10 +74,24 @@ namespace gr {
       FREQ_SINK_MODE_STREAMING     = 1
     };
 
+    /*!
+     * \brief Reduction of consecutive spectra, see freq_sink_f::set_reduction
+     * \ingroup digitizers
+     */
+    enum DIGITIZERS_API freq_sink_reduction_t
+    {
+      FREQ_SINK_REDUCTION_NONE     = 0,
+      FREQ_SINK_REDUCTION_AVERAGE  = 1,   // mean of the count spectra
+      FREQ_SINK_REDUCTION_EXP_AVERAGE = 2, // exponential average, weight 1/count
+      FREQ_SINK_REDUCTION_MAX_HOLD = 3    // per bin maximum of the count spectra
+    };
+
     /*!
      * \brief <+description of block+>
      * \ingroup digitizers
      *
+     * In trace mode (see digitizer_block::set_trace_interval) the hop-by-hop latency breakdown of
+     * each trace tag received is published on the "trace" message port.
      */
     class DIGITIZERS_API freq_sink_f : virtual public gr::sync_block
     {
@@ -63,8 +101,13 @@ namespace gr {
       /*!
        * \brief Return a shared_ptr to a new instance of digitizers::freq_sink_f.
        *
-       * At object construction nbuffers is allocated, each holding n measurements. Clients are
-       * supposed to retrieve/read a complete buffer at once else the data is lost.
+       * At object construction a ring of (at least) nbuffers * nmeasurements spectrum frames is
+       * allocated. Clients are supposed to retrieve/read a complete buffer of nmeasurements at
+       * once else the data is lost. The writer never waits for the clients, the oldest frames
+       * are overwritten instead.
+       *
+       * The frequency input is optional. If it is not connected the frequency axis is taken
+       * from the freq_axis tags (see tags.h) attached to the magnitude input.
        *
        * \param name Signal name
        * \param samp_rate Expected measurement sample rate in Hz (number of measurements per second)
@@ -119,6 +162,94 @@ namespace gr {
        */
       virtual void set_callback(data_available_cb_t callback, void *ptr) = 0;
 
+      /*!
+       * \brief Posts the data available notifications to the hub, in addition to the callback.
+       *
+       * Meant for clients reading many sinks (e.g. all the frequency sinks of the cascades of a
+       * digitizer): the hub delivers the notifications of all the sinks attached to it in
+       * batches, identified by signal id (the signal name is registered here). Must be set
+       * before the flowgraph is started.
+       *
+       * \param hub notification hub, nullptr to detach
+       */
+      virtual void set_notification_hub(notification_hub::sptr hub) = 0;
+
+      /*!
+       * \brief Exports the frames to a shared memory ring for consumers in other processes.
+       *
+       * Each frame is published to a slot as nbins frequencies followed by nbins magnitudes and
+       * nbins phases, see shm_export_header_t for the layout and the protocol. The object is
+       * created with the given name, replacing an existing one, and removed when the sink is
+       * destroyed or the export is disabled. Must be set before the flowgraph is started, throws
+       * std::runtime_error if the object can't be created.
+       *
+       * \param name shared memory object name, e.g. "/digitizer_spectrum1", empty to disable
+       * \param nslots number of frames held
+       */
+      virtual void set_shm_export(const std::string &name, size_t nslots=16) = 0;
+
+      /*!
+       * \brief Reduces each count consecutive spectra to a single frame, i.e. frames (and
+       * notifications) are produced at 1/count of the input rate.
+       *
+       * Spectra are accumulated in place into the frame being written:
+       *  - FREQ_SINK_REDUCTION_AVERAGE: mean of the magnitudes and of the phases.
+       *  - FREQ_SINK_REDUCTION_EXP_AVERAGE: y += (x - y) / count for each spectrum, the
+       *    average is carried over from frame to frame and published every count spectra.
+       *  - FREQ_SINK_REDUCTION_MAX_HOLD: per bin maximum magnitude, with the phase of the
+       *    spectrum holding the maximum.
+       *
+       * The frame metadata is the one of the first spectrum, with the timebase multiplied by
+       * count and the status of all the spectra or-ed. Spectra of different frequency axes are
+       * not combined, the accumulation restarts if the axis changes. Must be set before the
+       * flowgraph is started, throws std::invalid_argument if count is zero.
+       *
+       * \param reduction reduction mode, none by default
+       * \param count number of spectra per frame
+       */
+      virtual void set_reduction(freq_sink_reduction_t reduction, size_t count) = 0;
+
+      /*!
+       * \brief Sequence number of the next frame to be written. Frames are numbered from zero,
+       * the last get_frame_capacity frames before this one might be available.
+       */
+      virtual uint64_t get_frame_sequence() = 0;
+
+      /*!
+       * \brief Number of frames held by the ring.
+       */
+      virtual size_t get_frame_capacity() = 0;
+
+      /*!
+       * \brief Zero-copy access to a single frame by sequence number.
+       *
+       * The visitor is invoked with the frame held in the ring. Any number of clients can read
+       * frames concurrently, independent from get_measurements. Returns false if the frame is not
+       * available or if it was overwritten while being visited, in the latter case the visitor
+       * has seen inconsistent data and its results must be discarded.
+       *
+       * \param sequence frame sequence number
+       * \param visitor function invoked with the frame
+       * \param ptr a void pointer that is passed to the visitor
+       */
+      virtual bool read_frame(uint64_t sequence, frame_visitor_t visitor, void *ptr) = 0;
+
+      /*!
+       * \brief Invokes the callback from a dedicated dispatch thread instead of the work function.
+       *
+       * Must be set before the flowgraph is started. Note, measurements themselves are buffered
+       * anyway (see nbuffers), only the notifications are queued.
+       *
+       * \param policy dispatch policy, synchronous by default
+       * \param queue_size maximum number of queued notifications
+       */
+      virtual void set_async_dispatch(dispatch_policy_t policy, size_t queue_size=16) = 0;
+
+      /*!
+       * \brief Number of notifications dropped by the dispatcher because the queue was full.
+       */
+      virtual uint64_t get_dropped_count() = 0;
+
       /*!
        * \brief Number of bins of spectra measurement.
        */
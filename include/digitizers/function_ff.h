@@ -19,16 +19,18 @@ namespace gr {
      * \ingroup digitizers
      *
      * The only purpose of the 'timing' input port is to provided precise timing information to this
-     * block. This is done by scanning for acq_info tags, holding three pieces of information required
-     * for the correct signal generation:
-     *  - timestamp
-     *  - last beam-in timestamp
+     * block. This is done by scanning for acq_info tags, holding the information required for the
+     * correct signal generation:
+     *  - timestamp, no timing is available if -1
      *  - timebase
      *
      * The three functions (reference, min and max) are specified by using four separate vectors. One
-     * vector is used to provide relative timing information w.r.t. BEAM_IN event and other three to
+     * vector is used to provide relative timing information w.r.t. the sample the last acq_info tag
+     * is attached to (i.e. the functions restart with each acq_info tag) and other three to
      * specify function value for a given time point. Values are calculated by using a direct
-     * linear interpolation.
+     * linear interpolation. Without timing the first value of each function is used.
+     *
+     * The functions can be replaced while running, set_function never blocks the work method.
      *
      * Note the time points of the functions should be monotonically increasing.
      */
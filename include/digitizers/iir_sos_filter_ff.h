@@ -0,0 +1,59 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_IIR_SOS_FILTER_FF_H
+#define INCLUDED_DIGITIZERS_IIR_SOS_FILTER_FF_H
+
+#include <digitizers/api.h>
+#include <gnuradio/sync_block.h>
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief IIR filter applying the same design to a number of channels, input i is filtered
+     * to output i.
+     *
+     * The transfer function taps are converted into a cascade of second-order sections, i.e.
+     * high-order designs stay stable in single precision unlike the direct form. The channels
+     * are filtered in one pass, in SIMD lanes.
+     *
+     * \ingroup digitizers
+     */
+    class DIGITIZERS_API iir_sos_filter_ff : virtual public gr::sync_block
+    {
+     public:
+      typedef boost::shared_ptr<iir_sos_filter_ff> sptr;
+
+      /*!
+       * \brief Create an IIR filter.
+       *
+       * \param nchannels number of channels, i.e. inputs and outputs
+       * \param fw_taps feed forward taps
+       * \param fb_taps feed backward taps, same convention as gr::filter::iir_filter_ffd with
+       *                oldstyle set to false
+       */
+      static sptr make(int nchannels,
+          const std::vector<double> &fw_taps,
+          const std::vector<double> &fb_taps);
+
+      /*!
+       * \brief Sets a new design. The filter state is kept if the number of sections does not
+       * change.
+       */
+      virtual void set_taps(const std::vector<double> &fw_taps,
+          const std::vector<double> &fb_taps) = 0;
+
+      /*!
+       * \brief Number of second-order sections of the current design.
+       */
+      virtual int nsections() = 0;
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_IIR_SOS_FILTER_FF_H */
@@ -0,0 +1,70 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+
+#ifndef INCLUDED_DIGITIZERS_INTERLOCK_MATRIX_FF_H
+#define INCLUDED_DIGITIZERS_INTERLOCK_MATRIX_FF_H
+
+#include <digitizers/api.h>
+#include <gnuradio/sync_block.h>
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * Callback specifier of the interlock_matrix_ff block, called once per aggregated interlock.
+     *
+     * \param timestamp UTC nanoseconds of the sample, -1 if unknown
+     * \param channel_mask bit c is set if channel c is in interlock at that sample
+     * \param userdata pointer passed to set_callback
+     */
+    typedef void (*interlock_matrix_cb_t)(int64_t timestamp, uint64_t channel_mask, void *userdata);
+
+    /*!
+     * \brief Issues interlocks for up to 64 channels, each channel compared against its own min
+     * and max reference signals as by interlock_generation_ff.
+     *
+     * Channel c uses the inputs 3c (signal), 3c+1 (min) and 3c+2 (max), i.e. the ports of one
+     * interlock_generation_ff block per channel. All the inputs should have the same sampling
+     * rate. The limits of all the channels are evaluated in a single pass, and the output holds
+     * one (any channel in interlock) or zero for each sample.
+     *
+     * An interlock is issued each time a channel enters the interlock state. The channels
+     * entering the interlock at the same sample are aggregated into a single interlock, passed to
+     * the callback together with the mask of all the channels in interlock at that sample and its
+     * timestamp, extrapolated from the last acq_info tag of the first signal input.
+     *
+     * \ingroup digitizers
+     */
+    class DIGITIZERS_API interlock_matrix_ff : virtual public gr::sync_block
+    {
+     public:
+      typedef boost::shared_ptr<interlock_matrix_ff> sptr;
+
+      static const int MAX_CHANNELS = 64;
+
+      /*!
+       * \brief Return a shared_ptr to a new instance of digitizers::interlock_matrix_ff.
+       *
+       * \param nchannels number of channels, 1 to 64
+       * \param max_min lower bound of the min interlock boundary (see interlock_generation_ff)
+       * \param max_max upper bound of the max interlock boundary
+       */
+      static sptr make(int nchannels, float max_min, float max_max);
+
+      /*!
+       * \brief Register a callable, called for each aggregated interlock.
+       *
+       * \param callback user callback
+       * \param ptr a void pointer that is passed back to the callback
+       */
+      virtual void set_callback(interlock_matrix_cb_t callback, void *ptr) = 0;
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_INTERLOCK_MATRIX_FF_H */
@@ -0,0 +1,74 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_LOSSY_CODEC_H
+#define INCLUDED_DIGITIZERS_LOSSY_CODEC_H
+
+#include <digitizers/api.h>
+#include <cstddef>
+#include <cstdint>
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Number of samples per block of the lossy codec.
+     */
+    const size_t LOSSY_CODEC_BLOCK_SIZE = 128;
+
+    /*!
+     * \brief Returns the max number of bytes the given number of samples encodes to.
+     */
+    DIGITIZERS_API size_t lossy_encode_bound(size_t nsamples);
+
+    /*!
+     * \brief Error-bounded lossy encoding of float samples, e.g. of aggregated values which only
+     * need to be accurate to a fraction of their error estimate.
+     *
+     * The samples are quantized with a step of quantization times the smallest bound of the
+     * block, i.e. each reconstructed sample is within half a step of the original one, at most
+     * quantization / 2 of its bound. The quantized samples are delta coded, the deltas zigzag
+     * mapped and bit-packed like raw_encode does (see raw_codec.h), a block of
+     * LOSSY_CODEC_BLOCK_SIZE samples at a time. An encoded block consists of:
+     *  - the quantization step (float)
+     *  - the first quantized sample (int64_t)
+     *  - one byte holding the bit width w of the largest mapped delta of the block
+     *  - w bit planes of 16 bytes each, see raw_encode
+     *
+     * Blocks not worth quantizing (zero or non-finite bounds, non-finite samples, or more bits
+     * than the floats themselves) are stored verbatim, flagged by a zero step. Fields and
+     * samples are in the byte order of the writing host.
+     *
+     * With the errors as bounds and a quantization of 1/8, noisy signals take 5 to 7 bits per
+     * sample instead of 32. The errors themselves are encoded with the errors as bounds.
+     *
+     * \param samples samples to encode
+     * \param bounds per sample bound, e.g. the error estimates
+     * \param nsamples number of samples
+     * \param quantization step relative to the bounds, greater than zero
+     * \param data output, at least lossy_encode_bound(nsamples) bytes
+     * \returns number of bytes written
+     */
+    DIGITIZERS_API size_t lossy_encode(const float *samples, const float *bounds, size_t nsamples,
+            float quantization, uint8_t *data);
+
+    /*!
+     * \brief Decodes samples encoded by lossy_encode. Throws std::invalid_argument if the data is
+     * truncated or corrupt.
+     *
+     * \param data encoded data
+     * \param size number of encoded bytes available
+     * \param samples output, nsamples samples
+     * \param nsamples number of samples encoded
+     * \returns number of bytes consumed
+     */
+    DIGITIZERS_API size_t lossy_decode(const uint8_t *data, size_t size, float *samples,
+            size_t nsamples);
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_LOSSY_CODEC_H */
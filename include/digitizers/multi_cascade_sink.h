@@ -0,0 +1,96 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_MULTI_CASCADE_SINK_H
+#define INCLUDED_DIGITIZERS_MULTI_CASCADE_SINK_H
+
+#include <digitizers/api.h>
+#include <digitizers/cascade_sink.h>
+#include <gnuradio/hier_block2.h>
+#include <digitizers/time_domain_sink.h>
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Streaming part of cascade_sink for several channels sharing the same aggregation
+     * settings.
+     *
+     * Instead of one cascade_sink (and one aggregation block per level) per channel, each level
+     * is a single block processing all the channels, with the channels interleaved in SIMD lanes
+     * for the FIR algorithms and the average. The other algorithms fall back to one
+     * block_aggregation per channel and level. Every channel gets its own streaming sinks, named
+     * signal_names[c]@level.
+     *
+     * Channel c uses the input ports 2c (values) and 2c+1 (errors). Triggered, frequency-domain,
+     * post-mortem and interlock sinks are not provided, use a cascade_sink for those channels.
+     *
+     * \ingroup digitizers
+     */
+    class DIGITIZERS_API multi_cascade_sink : virtual public gr::hier_block2
+    {
+     public:
+      typedef boost::shared_ptr<multi_cascade_sink> sptr;
+
+      /*!
+       * \brief Return a shared_ptr to a new instance of digitizers::multi_cascade_sink.
+       *
+       * \param alg_id Chosen algorithm of the circuit that later maps to an enum(valid:0-9, see algorithm_id_t).
+       * \param delay The delay of the samples on output.
+       * \param fir_taps user defined FIR-filter taps.
+       * \param low_freq lower frequency boundary.
+       * \param up_freq upper frequency boundary.
+       * \param tr_width transition width for frequency boundaries.
+       * \param fb_user_taps feed backward user taps.
+       * \param fw_user_taps feed forward user taps.
+       * \param samp_rate Sampling rate of the whole circuit.
+       * \param signal_names signal name of each channel, defines the number of channels
+       * \param unit_name signal unit, shared by all the channels
+       * \param levels aggregation levels, see cascade_sink::default_levels
+       */
+      static sptr make(int alg_id,
+          int delay,
+          const std::vector<float> &fir_taps,
+          double low_freq,
+          double up_freq,
+          double tr_width,
+          const std::vector<double> &fb_user_taps,
+          const std::vector<double> &fw_user_taps,
+          double samp_rate,
+          const std::vector<std::string> &signal_names,
+          std::string unit_name,
+          const std::vector<cascade_level_t> &levels);
+
+      virtual int nchannels() const = 0;
+
+      /*!
+       * \brief Returns the instantiated levels, parents precede their children.
+       */
+      virtual std::vector<cascade_level_t> get_levels() = 0;
+
+      /*!
+       * \brief Returns the streaming sinks of the given channel, slowest first.
+       */
+      virtual std::vector<time_domain_sink::sptr> get_time_domain_sinks(int channel) = 0;
+
+      /*!
+       * \brief Returns the streaming sinks of all the channels, ordered by channel.
+       */
+      virtual std::vector<time_domain_sink::sptr> get_time_domain_sinks() = 0;
+
+      /*!
+       * \brief Moves the aggregation of all the levels to the GPU (true) or back to the CPU.
+       * Returns true if all the levels are aggregated on the GPU. Only the fused algorithms
+       * (see fused_aggregation_ff::is_supported) are supported, further it requires OpenCL and
+       * a device, see README.md. Call before the flowgraph is started.
+       */
+      virtual bool set_gpu_offload(bool enable) = 0;
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_MULTI_CASCADE_SINK_H */
@@ -0,0 +1,123 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+
+#ifndef INCLUDED_DIGITIZERS_MULTI_TIME_DOMAIN_SINK_H
+#define INCLUDED_DIGITIZERS_MULTI_TIME_DOMAIN_SINK_H
+
+#include <digitizers/api.h>
+#include <digitizers/sink_common.h>
+#include <digitizers/time_domain_sink.h>
+#include <gnuradio/sync_block.h>
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Time sink delivering the packages of several channels of a device at once.
+     *
+     * Instead of one time_domain_sink and thus one callback per channel and package, the
+     * channels are delivered by a single callback per package, along with a single measurement
+     * info decoded from the acq_info and trigger tags of all the channels (see
+     * set_measurement_callback).
+     *
+     * Channel c uses the input ports 2c (values) and 2c+1 (errors). The channels are consumed in
+     * lockstep, i.e. the package p of each channel holds the samples [p * N, (p + 1) * N) of the
+     * channel. This matches the channels of a digitizer (and the blocks following it) as long as
+     * each channel is processed by the same chain of blocks.
+     *
+     * The timing of the measurement info is the one of the first channel with an acq_info tag,
+     * the status combines the status of all the channels. The trigger is expected at the same
+     * offset in each channel; packages where this is not the case (a channel lacks the trigger
+     * or has it elsewhere) are delivered with the trigger of the first channel having one and
+     * counted, see get_misaligned_count.
+     *
+     * \ingroup digitizers
+     */
+    class DIGITIZERS_API multi_time_domain_sink : virtual public gr::sync_block
+    {
+     public:
+      typedef boost::shared_ptr<multi_time_domain_sink> sptr;
+
+      /*!
+       * \brief Return a shared_ptr to a new instance of digitizers::multi_time_domain_sink.
+       *
+       * For streaming mode, see time_domain_sink::make.
+       *
+       * \param signal_names signal name of each channel, defines the number of channels
+       * \param unit signal unit, shared by all the channels
+       * \param samp_rate expected sample rate in Hz
+       * \param mode time sink mode which is mostly used by FESA to determine how to handle the sink
+       * \param output_package_size output_package_size
+       */
+      static sptr make(const std::vector<std::string> &signal_names, std::string unit, float samp_rate,
+              time_sink_mode_t mode, size_t output_package_size);
+
+      /*!
+       * \brief Return a shared_ptr to a new instance of digitizers::multi_time_domain_sink.
+       *
+       * For triggered mode, see time_domain_sink::make.
+       *
+       * \param signal_names signal name of each channel, defines the number of channels
+       * \param unit signal unit, shared by all the channels
+       * \param samp_rate expected sample rate in Hz
+       * \param mode time sink mode which is mostly used by FESA to determine how to handle the sink
+       * \param pre_samples pre trigger samples
+       * \param post_samples post trigger samples
+       */
+      static sptr make(const std::vector<std::string> &signal_names, std::string unit, float samp_rate,
+              time_sink_mode_t mode, int pre_samples, int post_samples);
+
+      virtual int nchannels() const = 0;
+
+      /*!
+       * \brief Get signal metadata of each channel.
+       */
+      virtual std::vector<signal_metadata_t> get_metadata() = 0;
+
+      /*!
+       * \brief Registers a callback receiving the packages of all the channels, by reference.
+       *
+       * See time_domain_sink::set_measurement_callback, except that the package holds the
+       * values and the errors of each channel.
+       *
+       * \param cb_measurement callback receiving the measurements, nullptr to disable
+       * \param pool_size number of released measurements kept for reuse
+       */
+      virtual void set_measurement_callback(cb_multi_measurement_t cb_measurement, void* userdata,
+              size_t pool_size=16) = 0;
+
+      /*!
+       * \brief Invokes the callback from a dedicated dispatch thread, see
+       * time_domain_sink::set_async_dispatch.
+       */
+      virtual void set_async_dispatch(dispatch_policy_t policy, size_t queue_size=16) = 0;
+
+      /*!
+       * \brief Number of packages dropped by the dispatcher.
+       */
+      virtual uint64_t get_dropped_count() = 0;
+
+      /*!
+       * \brief Number of packages delivered with triggers not aligned over the channels.
+       */
+      virtual uint64_t get_misaligned_count() = 0;
+
+      virtual size_t get_output_package_size() = 0;
+
+      virtual float get_sample_rate() = 0;
+
+      virtual time_sink_mode_t get_sink_mode() = 0;
+
+      virtual uint32_t get_pre_samples() = 0;
+
+      virtual uint32_t get_post_samples() = 0;
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_MULTI_TIME_DOMAIN_SINK_H */
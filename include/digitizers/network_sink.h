@@ -0,0 +1,149 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_NETWORK_SINK_H
+#define INCLUDED_DIGITIZERS_NETWORK_SINK_H
+
+#include <digitizers/api.h>
+#include <digitizers/sink_common.h>
+#include <digitizers/tags.h>
+#include <gnuradio/sync_block.h>
+
+namespace gr {
+  namespace digitizers {
+
+    const uint32_t NETWORK_FRAME_MAGIC = 0x5a444746;    // "FGDZ" on the wire
+    const uint16_t NETWORK_FRAME_VERSION = 1;
+
+    enum network_frame_flags_t
+    {
+      NETWORK_FRAME_HAS_ERRORS = 1,
+      NETWORK_FRAME_RAW_COMPRESSED = 2,
+      NETWORK_FRAME_HAS_TAGS = 4,
+      NETWORK_FRAME_LOSSY_COMPRESSED = 8
+    };
+
+    /*!
+     * \brief Header of a network sink frame.
+     *
+     * A frame consists of the header followed by payload_size bytes, that is nsamples values and,
+     * if flagged, nsamples errors, all the fields and samples in the byte order of the sending
+     * host (little-endian on the supported platforms). Frames of a raw input sink carry the raw
+     * ADC counts encoded by raw_encode (see raw_codec.h) instead, scaling describes their
+     * conversion into volts.
+     *
+     * Lossy compressed frames (see network_sink::make) carry the values encoded by lossy_encode
+     * (see lossy_codec.h) with the errors as bounds, followed by the errors encoded with
+     * themselves as bounds. Quantization is the step relative to the errors, i.e. the values are
+     * accurate to quantization / 2 of their errors.
+     *
+     * If flagged (see network_sink::set_tag_forwarding), the samples are followed by the tags
+     * of the frame: the number of tags (uint32_t), then per tag its offset relative to the first
+     * sample of the frame (uint32_t, after decimation), the size of the serialized tag
+     * (uint32_t) and the tag key and value serialized as a pair (pmt::serialize_str of
+     * pmt::cons(key, value)).
+     *
+     * The sequence number is counted per sink, gaps indicate frames skipped for the subscriber
+     * (rate limit or slow subscriber), samples_lost of the measurement info accumulates the
+     * samples of the skipped frames. Trigger fields are set if a trigger tag is within the frame,
+     * trigger_timestamp is -1 otherwise.
+     *
+     * \ingroup digitizers
+     */
+    struct DIGITIZERS_API network_frame_header_t
+    {
+      uint32_t magic;                // NETWORK_FRAME_MAGIC
+      uint16_t version;              // NETWORK_FRAME_VERSION
+      uint16_t flags;                // see network_frame_flags_t
+      uint32_t header_size;          // size of this header, samples follow
+      uint32_t nsamples;             // number of samples per array
+      uint64_t sequence;             // frame counter since start
+      uint64_t offset;               // offset of the first sample within the decimated stream
+      measurement_info_t info;
+      uint32_t payload_size;         // number of bytes following the header
+      float quantization;            // lossy compressed only, see lossy_encode
+      raw_scaling_t scaling;         // raw input only, latest raw_scaling tag
+    };
+
+    /*!
+     * \brief Streams data to remote subscribers over TCP.
+     *
+     * The sink listens on the given port, each accepted connection is a subscriber. The input is
+     * cut into frames of package_size (decimated) samples, each frame is sent to all the
+     * subscribers with a single scatter-gather write, i.e. without decimation the samples are sent
+     * straight out of the input buffers. See network_frame_header_t for the frame format.
+     *
+     * The flowgraph is never blocked by the subscribers. A frame is skipped for a subscriber if
+     * the subscriber didn't consume the remainder of the previous frame yet (the remainder of a
+     * partially sent frame is copied aside) or if its frame rate limit is exceeded. Closed
+     * connections are dropped. Connections pending when the flowgraph is started are accepted
+     * before the first frame is sent.
+     *
+     * Values are expected on the first input, errors on the optional second one. Measurement
+     * info is taken from the acq_info and trigger tags (see tags.h).
+     *
+     * With raw input the sink takes the raw ADC counts of a digitizer in raw output mode (a single
+     * int16_t input) and sends them losslessly compressed, for typical signals a fraction of the
+     * bandwidth of the float values. Each frame is encoded once, regardless of the number of
+     * subscribers.
+     *
+     * With a quantization given the values are quantized to that fraction of their errors and
+     * compressed (see lossy_codec.h), for aggregated data typically five to twenty times less
+     * bandwidth than the floats. Each frame is encoded once, frames without errors are sent
+     * uncompressed.
+     *
+     * \ingroup digitizers
+     */
+    class DIGITIZERS_API network_sink : virtual public gr::sync_block
+    {
+     public:
+      typedef boost::shared_ptr<network_sink> sptr;
+
+      /*!
+       * \brief Return a shared_ptr to a new instance of digitizers::network_sink.
+       *
+       * \param port TCP port to listen on, zero for an ephemeral port (see get_port)
+       * \param package_size number of samples per frame, after decimation
+       * \param decimation every decimation-th sample is sent
+       * \param max_frame_rate max number of frames per second sent to a subscriber, zero for no
+       * limit
+       * \param max_subscribers further connections are refused
+       * \param raw_input raw ADC counts are expected, sent compressed
+       * \param quantization quantization step relative to the errors, zero to send the values
+       * losslessly (default), not applicable to raw input
+       */
+      static sptr make(int port, int package_size, int decimation=1, double max_frame_rate=0.0,
+          int max_subscribers=8, bool raw_input=false, float quantization=0.0f);
+
+      /*!
+       * \brief Returns the port the sink is listening on.
+       */
+      virtual int get_port() const = 0;
+
+      virtual size_t get_nr_subscribers() const = 0;
+
+      /*!
+       * \brief Returns the number of frames sent, summed over the subscribers, since start.
+       */
+      virtual uint64_t get_sent_frames() const = 0;
+
+      /*!
+       * \brief Returns the number of frames skipped, summed over the subscribers, since start.
+       */
+      virtual uint64_t get_skipped_frames() const = 0;
+
+      /*!
+       * \brief Forwards all the tags of the input along with the samples, e.g. for processing
+       * on another host (see network_source). By default only the measurement info is sent.
+       * Must be set before the flowgraph is started.
+       */
+      virtual void set_tag_forwarding(bool enabled) = 0;
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_NETWORK_SINK_H */
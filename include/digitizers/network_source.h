@@ -0,0 +1,71 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_NETWORK_SOURCE_H
+#define INCLUDED_DIGITIZERS_NETWORK_SOURCE_H
+
+#include <digitizers/api.h>
+#include <gnuradio/sync_block.h>
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Receives the frames of a network_sink, e.g. in order to run the cascade_sink of a
+     * channel on a compute node instead of the acquisition host.
+     *
+     * The acquisition host runs the digitizer and a network_sink per channel, preferably in
+     * raw output mode with raw input sinks (compressed raw samples) and tag forwarding enabled
+     * (see network_sink::set_tag_forwarding). Each compute node subscribes to the channels it
+     * processes, i.e. the channels are balanced over the nodes by the choice of the sinks they
+     * connect to.
+     *
+     * Values are delivered on the first output, errors on the second one. Raw frames are
+     * converted into volts using the scaling of the frame, the errors are the error estimate of
+     * the scaling. Frames without errors have zero errors.
+     *
+     * Forwarded tags are attached to the values output at the same (decimated) offsets. Frames
+     * without tags get an acq_info tag at the first sample and, if a trigger is within the frame,
+     * a trigger tag, both derived from the measurement info. An acq_info tag derived from the
+     * measurement info is added as well to the first frame received and after frames were
+     * skipped by the sink, i.e. timestamps stay exact even if the acq_info tags are forwarded
+     * only on changes. The samples of the skipped frames are not replaced (see
+     * get_samples_lost).
+     *
+     * The connection is established when the flowgraph is started, the stream ends once the
+     * sink closes it.
+     *
+     * \ingroup digitizers
+     */
+    class DIGITIZERS_API network_source : virtual public gr::sync_block
+    {
+     public:
+      typedef boost::shared_ptr<network_source> sptr;
+
+      /*!
+       * \brief Return a shared_ptr to a new instance of digitizers::network_source.
+       *
+       * \param host host name or address of the network sink
+       * \param port TCP port of the network sink
+       */
+      static sptr make(std::string host, int port);
+
+      /*!
+       * \brief Number of frames received since start.
+       */
+      virtual uint64_t get_received_frames() const = 0;
+
+      /*!
+       * \brief Samples of the frames skipped by the sink since start, see
+       * network_frame_header_t.
+       */
+      virtual uint64_t get_samples_lost() const = 0;
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_NETWORK_SOURCE_H */
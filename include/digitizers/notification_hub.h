@@ -0,0 +1,109 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_NOTIFICATION_HUB_H
+#define INCLUDED_DIGITIZERS_NOTIFICATION_HUB_H
+
+#include <digitizers/api.h>
+#include <boost/shared_ptr.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Data available notification, the batched counterpart of data_available_event_t.
+     *
+     * \ingroup digitizers
+     */
+    struct DIGITIZERS_API notification_t
+    {
+      uint32_t signal_id;          // see notification_hub::register_signal
+      int64_t trigger_timestamp;   // trigger timestamp (without any realignment or user delay)
+    };
+
+    /*!
+     * \brief Batch callback declaration, notifications are in the order they were posted.
+     */
+    typedef void (*notification_batch_cb_t)(const notification_t *notifications, size_t count,
+            void *userdata);
+
+    /*!
+     * \brief Collects the data available notifications of many sinks and delivers them in batches.
+     *
+     * Instead of one callback per sink and event, the notifications posted by all the sinks
+     * attached to the hub (see freq_sink_f::set_notification_hub) within a short window are
+     * delivered by a single callback invocation. The window starts with the first notification
+     * after a delivery, i.e. the callback rate follows the trigger rate rather than the number
+     * of sinks. Signals are identified by integer ids instead of names.
+     *
+     * The callback is invoked from a dedicated thread owned by the hub. Posting never blocks
+     * the sinks: if the number of pending notifications reaches the capacity, further ones are
+     * dropped (see get_dropped_count) until the next delivery.
+     *
+     * \ingroup digitizers
+     */
+    class DIGITIZERS_API notification_hub
+    {
+     public:
+      typedef boost::shared_ptr<notification_hub> sptr;
+
+      virtual ~notification_hub() {}
+
+      /*!
+       * \brief Return a shared_ptr to a new instance of digitizers::notification_hub.
+       *
+       * \param window coalescing window in seconds
+       * \param capacity max number of pending notifications
+       */
+      static sptr make(double window=0.001, size_t capacity=4096);
+
+      /*!
+       * \brief Returns the id of the signal, ids are assigned on first registration starting
+       * from zero. Registering the same name again returns the same id.
+       */
+      virtual uint32_t register_signal(const std::string &name) = 0;
+
+      /*!
+       * \brief Returns the name of a registered signal. Throws std::invalid_argument if the id
+       * is unknown.
+       */
+      virtual std::string get_signal_name(uint32_t signal_id) = 0;
+
+      /*!
+       * \brief Number of registered signals.
+       */
+      virtual size_t get_signal_count() = 0;
+
+      /*!
+       * \brief Registers the batch callback, nullptr to disable. Notifications posted while no
+       * callback is registered are discarded.
+       */
+      virtual void set_callback(notification_batch_cb_t callback, void *userdata) = 0;
+
+      /*!
+       * \brief Posts a notification, called by the sinks.
+       */
+      virtual void notify(uint32_t signal_id, int64_t trigger_timestamp) = 0;
+
+      /*!
+       * \brief Number of notifications dropped because the capacity was reached.
+       */
+      virtual uint64_t get_dropped_count() = 0;
+
+      /*!
+       * \brief Number of batches delivered.
+       */
+      virtual uint64_t get_batch_count() = 0;
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_NOTIFICATION_HUB_H */
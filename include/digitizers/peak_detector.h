@@ -24,6 +24,16 @@ namespace gr {
      * median filtered signal is time-complex and the information on the
      * upper half of the spectrum is redundant.
      *
+     * Several peaks can be detected per vector, each within its own frequency range. In that
+     * case the frequency range inputs and the outputs are vectors of npeaks items, item k
+     * being the range, respectively the peak, k (e.g. the harmonics of a signal). All the
+     * peaks of a spectrum are detected within a single work call.
+     *
+     * In tracking mode (see set_tracking) the peak position is predicted from the previous
+     * spectra by an alpha-beta filter and only a small window around the prediction is
+     * searched. The full frequency range is searched again (re-acquisition) when the peak is
+     * lost, i.e. when the filtered maximum is found at the window edge.
+     *
      * \ingroup digitizers
      *
      */
@@ -38,8 +48,22 @@ namespace gr {
        * \param samp_rate The sample rate of the signal acquisition.
        * \param vec_len size of the input vector(actual input). The size of filtered input is (vec_len/2) for efficiency reasons.
        * \param proximity the proximity window for actual peak detection.
+       * \param npeaks number of peaks (frequency ranges) per vector.
+       */
+      static sptr make(double samp_rate, int vec_len, int proximity, int npeaks=1);
+
+      /*!
+       * \brief Enables tracking mode, the peaks are searched within +-window bins of their
+       * predicted position. Resets the trackers, i.e. the next spectrum is searched over the
+       * full frequency ranges.
+       *
+       * The outputs are the peaks measured, the tracker only selects the bins searched.
+       *
+       * \param window search half-width in bins, 0 disables tracking (default)
+       * \param alpha position gain of the alpha-beta filter, 0 < alpha <= 1
+       * \param beta velocity gain of the alpha-beta filter, 0 <= beta < 4 - 2 * alpha
        */
-      static sptr make(double samp_rate, int vec_len, int proximity);
+      virtual void set_tracking(int window, float alpha=0.5, float beta=0.1) = 0;
     };
 
   } // namespace digitizers
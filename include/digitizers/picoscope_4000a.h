@@ -33,8 +33,23 @@ namespace gr {
        * constructor is in a private implementation
        * class. digitizers::picoscope_4000a::make is the public interface for
        * creating new instances.
+       *
+       * If raw_output is set, a single int16_t output carrying raw ADC counts is provided per
+       * channel instead of the value and error outputs. The conversion into voltages is described
+       * by the raw_scaling tag (see tags.h). Raw output is supported in streaming mode only.
+       */
+      static sptr make(std::string serial_number, bool auto_arm=true, bool raw_output=false);
+
+      /*!
+       * \brief Starts opening of the given units in the background, meant to be called at
+       * process start by applications owning several units.
+       *
+       * Opening a unit can take seconds. Blocks created with one of the given serial numbers
+       * take over the opened unit on initialize instead of opening it themselves, i.e. the
+       * opening overlaps with the rest of the startup. Units never taken over are closed on
+       * process exit.
        */
-      static sptr make(std::string serial_number, bool auto_arm=true);
+      static void open_units(const std::vector<std::string> &serial_numbers);
     };
 
   } // namespace digitizers
@@ -35,6 +35,17 @@ namespace gr {
        * creating new instances.
        */
       static sptr make(std::string serial_number, bool auto_arm=true);
+
+      /*!
+       * \brief Starts opening of the given units in the background, meant to be called at
+       * process start by applications owning several units.
+       *
+       * Opening a unit can take seconds. Blocks created with one of the given serial numbers
+       * take over the opened unit on initialize instead of opening it themselves, i.e. the
+       * opening overlaps with the rest of the startup. Units never taken over are closed on
+       * process exit.
+       */
+      static void open_units(const std::vector<std::string> &serial_numbers);
     };
 
   } // namespace digitizers
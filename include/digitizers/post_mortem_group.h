@@ -0,0 +1,88 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_POST_MORTEM_GROUP_H
+#define INCLUDED_DIGITIZERS_POST_MORTEM_GROUP_H
+
+#include <digitizers/api.h>
+#include <digitizers/post_mortem_sink.h>
+#include <boost/shared_ptr.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Freezes the post-mortem buffers of many sinks at the same acquisition timestamp.
+     *
+     * Calling post_mortem_sink::freeze_buffer on each sink freezes every buffer at a different
+     * sample, depending on when the call gets through. A group freeze instead publishes the
+     * timestamp of the last sample to keep along with a new epoch, the cost doesn't depend on
+     * the number of members. The work function of each member picks the request up and ends
+     * its snapshot at the sample with that timestamp, using the acq_info tags of its stream,
+     * i.e. the channels line up regardless of their sample rate and scheduling.
+     *
+     * The snapshot is protected by the work function until it is read out, the next read of
+     * each member (post_mortem_sink::get_items, get_range, get_view or get_pyramid_items, or
+     * freeze_buffer) returns it. Pyramid levels are cut at the same timestamp but are only
+     * protected from the read on. A freeze not read out yet is replaced by the next one. Members
+     * without timestamps (no acq_info tag yet) freeze at the sample being processed when they
+     * pick the request up.
+     *
+     * \ingroup digitizers
+     */
+    class DIGITIZERS_API post_mortem_group
+    {
+     public:
+      typedef boost::shared_ptr<post_mortem_group> sptr;
+
+      virtual ~post_mortem_group() {}
+
+      /*!
+       * \brief Return a shared_ptr to a new instance of digitizers::post_mortem_group.
+       */
+      static sptr make();
+
+      /*!
+       * \brief Adds a sink to the group, must be called before the flowgraph is started.
+       * Throws std::invalid_argument if the sink is a member of a group already.
+       */
+      virtual void add_sink(post_mortem_sink::sptr sink) = 0;
+
+      virtual std::vector<post_mortem_sink::sptr> get_sinks() = 0;
+
+      /*!
+       * \brief Freezes all the members at the given timestamp.
+       *
+       * Members which processed the sample with the given timestamp already freeze on their
+       * next work call, the others once they reach it.
+       *
+       * \param timestamp of the last sample to keep, nanoseconds UTC
+       * \returns epoch of the freeze
+       */
+      virtual uint64_t freeze_at(int64_t timestamp) = 0;
+
+      /*!
+       * \brief Freezes all the members at the current time (UTC).
+       * \returns epoch of the freeze
+       */
+      virtual uint64_t freeze() = 0;
+
+      /*!
+       * \brief Waits until all the members captured the last freeze.
+       *
+       * \param timeout in seconds
+       * \returns false on timeout
+       */
+      virtual bool wait_frozen(double timeout) = 0;
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_POST_MORTEM_GROUP_H */
@@ -15,6 +15,112 @@
 namespace gr {
   namespace digitizers {
 
+    /*!
+     * \brief Header of a file backed post-mortem buffer (see post_mortem_sink::set_backing_file).
+     *
+     * The file starts with this header followed by the values and errors ring buffers, each
+     * holding capacity samples (native float). Sample with the ring index i is stored at
+     * index i % capacity. The snapshot fields are valid while frozen is non-zero, i.e. an
+     * external tool can read the frozen samples [snapshot_end - snapshot_nitems, snapshot_end)
+     * directly from the file. Changes of frozen are signalled by a FUTEX_WAKE on that field,
+     * i.e. tools can block on it with FUTEX_WAIT (non-private futex).
+     *
+     * The write fields are updated by the writer after each chunk of samples, they describe
+     * the history as of the last update and are valid while write_sequence is even. A restarted
+     * process resumes from them, see post_mortem_sink::set_backing_file.
+     *
+     * \ingroup digitizers
+     */
+    struct DIGITIZERS_API post_mortem_file_header_t
+    {
+      char     magic[8];          // "DIGIPMB", zero terminated
+      uint32_t version;           // POST_MORTEM_FILE_VERSION
+      uint32_t header_size;       // sizeof(post_mortem_file_header_t)
+      uint64_t capacity;          // ring buffer capacity in samples
+      uint64_t values_offset;     // offset of the values ring buffer in bytes
+      uint64_t errors_offset;     // offset of the errors ring buffer in bytes
+      double   samp_rate;         // expected sample rate in Hz
+
+      uint32_t frozen;            // non-zero if the snapshot is valid
+      uint32_t status;            // refer to gr::digitizers::channel_status_t
+      uint64_t snapshot_end;      // ring index one past the last frozen sample
+      uint64_t snapshot_nitems;   // number of frozen samples
+      int64_t  timestamp;         // of the first frozen sample, nanoseconds UTC or -1 if unknown
+      double   timebase;          // in seconds
+      double   user_delay;        // in seconds
+      double   actual_delay;      // in seconds
+
+      uint32_t write_sequence;    // odd while the write fields are updated
+      uint32_t write_status;      // of the last acquisition info
+      uint64_t write_ring_count;  // ring index one past the last sample written
+      uint64_t write_history_start; // samples are contiguous from this ring index on
+      uint64_t write_stream_count;  // stream offset matching write_ring_count
+      uint64_t write_acq_offset;  // stream offset of the last acquisition info
+      int64_t  write_timestamp;   // of the last acquisition info, nanoseconds UTC or -1 if unknown
+      double   write_timebase;    // in seconds
+      double   write_user_delay;  // in seconds
+      double   write_actual_delay; // in seconds
+    };
+
+    static const uint32_t POST_MORTEM_FILE_VERSION = 2;
+
+    /*!
+     * \brief Number of decimated pyramid levels, level k (1 based) decimates by 10^k.
+     */
+    static const int POST_MORTEM_PYRAMID_LEVELS = 3;
+
+    /*!
+     * \brief Zero-copy view onto the frozen post-mortem buffer, see post_mortem_sink::get_view.
+     *
+     * The view is a lifetime handle: the buffer stays frozen (and the sink alive) until the view
+     * is released, either explicitly or by dropping the last reference to it.
+     *
+     * \ingroup digitizers
+     */
+    class DIGITIZERS_API post_mortem_view
+    {
+     public:
+      typedef boost::shared_ptr<post_mortem_view> sptr;
+
+      virtual ~post_mortem_view() {}
+
+      /*!
+       * \brief Number of samples in the view.
+       */
+      virtual size_t size() const = 0;
+
+      /*!
+       * \brief Contiguous values, valid until released.
+       */
+      virtual const float *values() const = 0;
+
+      /*!
+       * \brief Contiguous error estimates, valid until released.
+       */
+      virtual const float *errors() const = 0;
+
+      /*!
+       * \brief Address of the values, for bindings (e.g. NumPy arrays in Python).
+       */
+      size_t values_address() const { return reinterpret_cast<size_t>(values()); }
+
+      /*!
+       * \brief Address of the error estimates, for bindings.
+       */
+      size_t errors_address() const { return reinterpret_cast<size_t>(errors()); }
+
+      /*!
+       * \brief Timestamp of the first sample, timebase and status.
+       */
+      virtual measurement_info_t get_info() const = 0;
+
+      /*!
+       * \brief Releases the view before it is destroyed, the samples must not be accessed
+       * anymore. Calling it more than once is harmless.
+       */
+      virtual void release() = 0;
+    };
+
     /*!
      * \brief Post-mortem sink
      *
@@ -34,7 +140,10 @@ namespace gr {
      * it is assumed that items are evenly spaced between each other (important for
      * calculating timestamps).
      *
-     * Incoming samples are passed trough while the buffer is frozen.
+     * Incoming samples are passed trough while the buffer is frozen. The acquisition continues
+     * into a spare buffer meanwhile, i.e. the frozen samples can be read out at leisure without
+     * blocking the stream. Samples are dropped from the history only if the readout takes
+     * longer than it takes to fill the spare buffer (buffer_size samples).
      *
      * \ingroup digitizers
      */
@@ -92,6 +201,147 @@ namespace gr {
        */
       virtual size_t get_items(size_t nr_items_to_read, float *values, float *errors, measurement_info_t *info) = 0;
 
+      /*!
+       * \brief Read the samples within a time range from a post-mortem buffer.
+       *
+       * Only the samples with timestamps in [start_timestamp, end_timestamp] are copied, the
+       * range is located by binary search over a timestamp index built from the acq_info tags,
+       * i.e. a small window can be read out of a large buffer cheaply. Samples preceding the
+       * first acq_info tag have no timestamp and are never returned. If the range holds more
+       * than nr_items_to_read samples, the first nr_items_to_read are returned.
+       *
+       * The buffer is frozen for the duration of the call if not frozen already. A buffer
+       * frozen by freeze_buffer stays frozen, meaning several ranges can be read from the same
+       * snapshot (get_items unfreezes it).
+       *
+       * Note the returned samples are not evenly spaced if the stream was interrupted within
+       * the range (e.g. history restarted after a late readout or timestamps jumped).
+       *
+       * \param start_timestamp start of the range, nanoseconds UTC
+       * \param end_timestamp end of the range, nanoseconds UTC
+       * \param nr_items_to_read max number of items to read
+       * \param values values
+       * \param errors error estimates
+       * \param info timestamp of the first sample returned, timebase and status
+       * \returns number of actual items read
+       */
+      virtual size_t get_range(int64_t start_timestamp, int64_t end_timestamp, size_t nr_items_to_read,
+              float *values, float *errors, measurement_info_t *info) = 0;
+
+      /*!
+       * \brief Zero-copy access to the last samples of a post-mortem buffer.
+       *
+       * Same as get_items except the samples are not copied, the view points into the buffer
+       * instead. The buffer is frozen if needed and stays frozen as long as any view is held,
+       * i.e. get_items and get_range don't unfreeze it meanwhile. The buffer is unfrozen once
+       * the last view is released.
+       *
+       * Meant for large captures, e.g. Python clients wrap the view into NumPy arrays without
+       * copying (see digitizers.post_mortem_arrays).
+       *
+       * \param nr_items_to_read max number of items in the view
+       * \returns view onto the frozen samples
+       */
+      virtual post_mortem_view::sptr get_view(size_t nr_items_to_read) = 0;
+
+      /*!
+       * \brief Backs the circular buffer by a memory mapped file instead of memory.
+       *
+       * Allows history much larger than the available memory, e.g. on local NVMe. The file is
+       * created or resized as needed, buffers are 2 MiB aligned within the file (see
+       * post_mortem_file_header_t). On freeze only the header is updated, i.e. external tools
+       * can read the frozen data from the file without any copy. A file in /dev/shm serves as
+       * a shared memory export of the post-mortem history to other processes.
+       *
+       * Must be called before the flowgraph is started, the buffer content is discarded unless
+       * resumed. With resume the history of a previous run kept in the file (same buffer size
+       * and sample rate) is restored, e.g. after a process restart. The sink starts frozen on
+       * that history, i.e. the first read (get_items, get_view, ...) returns the samples up to
+       * the restart, while the acquisition continues in the spare half of the ring.
+       *
+       * Throws std::runtime_error if the file can't be mapped, views are held or samples are
+       * stored in half precision (see set_half_precision).
+       *
+       * \param path file path, empty string for an in-memory buffer (default)
+       * \param resume restore the history of a previous run
+       */
+      virtual void set_backing_file(const std::string &path, bool resume=false) = 0;
+
+      /*!
+       * \brief Maintains a min/max/mean pyramid next to the raw samples.
+       *
+       * Levels 1, 2 and 3 hold min, max and mean over 10, 100 and 1000 raw samples, computed
+       * incrementally by the work function. Each level is sized to hold the given duration,
+       * i.e. a single freeze yields the same time span at every resolution (assuming the buffer
+       * size, i.e. the raw level, covers the same duration). Partially accumulated entries are
+       * not part of the snapshot.
+       *
+       * Must be called before the flowgraph is started, the pyramid content is discarded.
+       * Throws std::runtime_error if views are held.
+       *
+       * \param duration history length of each level in seconds, zero disables the pyramid
+       */
+      virtual void set_pyramid(double duration) = 0;
+
+      /*!
+       * \brief Read from a pyramid level of the frozen buffer.
+       *
+       * The buffer is frozen if needed. Unlike get_items this method doesn't unfreeze the
+       * buffer, meaning all the levels can be read from the same snapshot. The raw samples
+       * are read last with get_items which unfreezes the buffer.
+       *
+       * \param level pyramid level, 1 to POST_MORTEM_PYRAMID_LEVELS
+       * \param nr_items_to_read number of items to read
+       * \param min minimum values
+       * \param max maximum values
+       * \param mean mean values
+       * \param info timestamp of the first entry, timebase of the level and status
+       * \returns number of actual items read
+       */
+      virtual size_t get_pyramid_items(int level, size_t nr_items_to_read, float *min, float *max,
+              float *mean, measurement_info_t *info) = 0;
+
+      /*!
+       * \brief Stores the samples in half precision (IEEE 754 binary16) instead of float.
+       *
+       * Half precision holds about three significant digits, enough for error estimates but
+       * usually not for the values. A ring stored in half precision takes half the memory, i.e.
+       * with both rings in half precision twice the buffer size fits the same memory. Samples
+       * are converted back to float when read.
+       *
+       * Must be called before the flowgraph is started, the buffer content is discarded. The
+       * views need float samples, get_view throws std::runtime_error for a buffer stored in half
+       * precision. Throws std::runtime_error if the buffer is file backed or views are held.
+       *
+       * \param values store the values in half precision
+       * \param errors store the error estimates in half precision
+       */
+      virtual void set_half_precision(bool values, bool errors) = 0;
+
+      /*!
+       * \brief Backs the circular buffer by huge pages (2 MiB) instead of regular pages.
+       *
+       * Meant for raw-rate sinks, where the buffer spans many megabytes and each sample touches
+       * a different page sooner or later, i.e. TLB misses add up. Explicit huge pages are tried
+       * first (needs pages reserved in /proc/sys/vm/nr_hugepages), transparent huge pages
+       * otherwise (effective if enabled for shared memory, see
+       * /sys/kernel/mm/transparent_hugepage/shmem_enabled). The buffer is rounded up to whole
+       * huge pages, i.e. small buffers take more memory.
+       *
+       * Must be called before the flowgraph is started, the buffer content is discarded. Takes
+       * effect for in-memory buffers only, a file backed buffer is mapped as the file is (see
+       * set_backing_file). Throws std::runtime_error if views are held.
+       *
+       * \param enabled try to back the buffer with huge pages
+       */
+      virtual void set_huge_pages(bool enabled) = 0;
+
+      /*!
+       * \brief Returns true if the buffer is backed by huge pages, explicit ones or transparent
+       * ones as far as the kernel accepted the advice.
+       */
+      virtual bool is_huge_page_backed() = 0;
+
     };
 
   } // namespace digitizers
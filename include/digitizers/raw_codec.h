@@ -0,0 +1,63 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_RAW_CODEC_H
+#define INCLUDED_DIGITIZERS_RAW_CODEC_H
+
+#include <digitizers/api.h>
+#include <cstddef>
+#include <cstdint>
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Number of samples per block of the raw codec.
+     */
+    const size_t RAW_CODEC_BLOCK_SIZE = 128;
+
+    /*!
+     * \brief Returns the max number of bytes the given number of raw samples encodes to.
+     */
+    DIGITIZERS_API size_t raw_encode_bound(size_t nsamples);
+
+    /*!
+     * \brief Losslessly encodes raw ADC samples (raw output mode, see digitizer_block).
+     *
+     * The samples are delta coded, the deltas zigzag mapped and bit-packed, a block of
+     * RAW_CODEC_BLOCK_SIZE samples at a time. An encoded block consists of:
+     *  - one byte holding the bit width w (0 to 17) of the largest mapped delta of the block
+     *  - w bit planes of 16 bytes each, plane b holds bit b of the mapped deltas of all the block
+     *    samples (sample i at bit i % 8 of byte i / 8), i.e. the layout used by bit shuffling
+     *
+     * The last block is padded with zeros. The first delta is relative to zero, that is the
+     * encoded data is self-contained. Slowly varying or noisy low-amplitude signals take a few
+     * bits per sample, a constant signal takes a byte per block.
+     *
+     * \param samples samples to encode
+     * \param nsamples number of samples
+     * \param data output, at least raw_encode_bound(nsamples) bytes
+     * \returns number of bytes written
+     */
+    DIGITIZERS_API size_t raw_encode(const int16_t *samples, size_t nsamples, uint8_t *data);
+
+    /*!
+     * \brief Decodes samples encoded by raw_encode. Throws std::invalid_argument if the data is
+     * truncated or corrupt.
+     *
+     * \param data encoded data
+     * \param size number of encoded bytes available
+     * \param samples output, nsamples samples
+     * \param nsamples number of samples encoded
+     * \returns number of bytes consumed
+     */
+    DIGITIZERS_API size_t raw_decode(const uint8_t *data, size_t size, int16_t *samples,
+            size_t nsamples);
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_RAW_CODEC_H */
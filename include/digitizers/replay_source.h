@@ -0,0 +1,88 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+
+#ifndef INCLUDED_DIGITIZERS_REPLAY_SOURCE_H
+#define INCLUDED_DIGITIZERS_REPLAY_SOURCE_H
+
+#include <digitizers/api.h>
+#include <digitizers/digitizer_block.h>
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Replays recorded captures as if they were acquired by a two channel device with one
+     * digital port, i.e. it has the same outputs as the simulation source.
+     *
+     * Each channel is read from its own file:
+     *  - files ending in .csv contain one value per line, voltage for analog channels (e.g. the
+     *    examples/SAT/test_waveform_*.csv files) and the port value for the digital port. The
+     *    voltages are quantized to 16-bit raw samples on arm, using the channel range.
+     *  - any other file contains raw samples in native byte order, int16 for analog channels
+     *    (full scale of +-32767 corresponds to the channel range) and uint8 for the port. These
+     *    files are memory mapped, i.e. recordings larger than the memory can be replayed.
+     *
+     * An empty file name stands for a channel with all samples zero. The length of the recording
+     * is given by the shortest file.
+     *
+     * In streaming mode the raw samples are delivered via a driver-like streaming callback,
+     * converted and assembled into application buffer chunks the same way as the PicoScope
+     * drivers do, paced to the sample rate or as fast as possible (see set_replay_pacing). The
+     * whole tagging and trigger logic is the same as with a real device. In rapid block mode
+     * each block is read from consecutive samples of the recording.
+     *
+     * Notes:
+     *  - Error estimate is hardcoded to 0.005
+     *
+     * \ingroup digitizers
+     */
+    class DIGITIZERS_API replay_source : virtual public digitizer_block
+    {
+     public:
+      typedef boost::shared_ptr<replay_source> sptr;
+
+      /*!
+       * \brief Opens the recording, an exception is thrown if a file can't be read.
+       *
+       * \param ch_a_file Recording of channel A
+       * \param ch_b_file Recording of channel B
+       * \param port_file Recording of the digital port
+       * \param loop Start from the beginning once the end of the recording is reached, otherwise
+       * the replay stops
+       */
+      static sptr make(const std::string &ch_a_file, const std::string &ch_b_file="",
+          const std::string &port_file="", bool loop=true);
+
+      /*!
+       * \brief Sets the rate the samples are delivered at, relative to the sample rate.
+       *
+       * \param rate_factor 1.0 for real time, zero to deliver as fast as possible
+       */
+      virtual void set_replay_pacing(float rate_factor) = 0;
+
+      /*!
+       * \brief Returns number of samples per channel in the recording.
+       */
+      virtual uint64_t get_recording_length() const = 0;
+
+      /*!
+       * \brief Returns number of samples per channel replayed since arm, including samples
+       * lost because the application buffer was full.
+       */
+      virtual uint64_t get_replayed_samples() const = 0;
+
+      /*!
+       * \brief Returns true if the end of the recording was reached and loop is disabled.
+       */
+      virtual bool is_replay_finished() const = 0;
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_REPLAY_SOURCE_H */
+
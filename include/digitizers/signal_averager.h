@@ -24,6 +24,12 @@ namespace gr {
      * tags falls into the same output offset then the tags get merged.
      *
      * It supports multiple input signals. Does the same on each input port.
+     *
+     * With raw input the block takes the raw ADC counts of a digitizer in raw output mode
+     * (int16_t) and sums them in integer arithmetic, the scaling of the raw_scaling tag is
+     * applied once per output sample. The output is in volts, hence the raw_scaling tags are
+     * replaced by constant_error tags carrying the error estimate. Outputs preceding the first
+     * raw_scaling tag are in ADC counts.
      * \ingroup digitizers
      *
      */
@@ -38,8 +44,9 @@ namespace gr {
        * \param num_inputs Number of input signals
        * \param window_size The decimation factor.
        * \param samp_rate sample rate on input
+       * \param raw_input raw ADC counts (int16_t) are expected on the inputs
        */
-      static sptr make(int num_inputs, int window_size, float samp_rate);
+      static sptr make(int num_inputs, int window_size, float samp_rate, bool raw_input=false);
     };
 
   } // namespace digitizers
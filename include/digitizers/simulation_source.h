@@ -14,6 +14,20 @@
 namespace gr {
   namespace digitizers {
 
+    /*!
+     * \brief Waveform generated by the simulation source in streaming mode, see
+     * simulation_source::set_stream_generator.
+     * \ingroup digitizers
+     */
+    enum DIGITIZERS_API simulation_waveform_t
+    {
+      SIMULATION_WAVEFORM_DATA,     // vectors provided via set_data are played back
+      SIMULATION_WAVEFORM_SINE,
+      SIMULATION_WAVEFORM_SQUARE,
+      SIMULATION_WAVEFORM_SAWTOOTH,
+      SIMULATION_WAVEFORM_NOISE
+    };
+
     /*!
      * \brief Simulates a device similar to a PicoScope oscilloscope. User needs to set the data
      * similar to the GNU Radio's vector source.
@@ -22,6 +36,13 @@ namespace gr {
      * simulation source behaves similarly, that is it keeps outputting the provided data buffer
      * again and again.
      *
+     * In streaming mode a waveform can be generated instead (see set_stream_generator). Raw
+     * 16-bit samples are then generated and delivered via a driver-like streaming callback,
+     * i.e. converted and assembled into application buffer chunks the same way as the
+     * PicoScope drivers do. Delivery is paced to the sample rate or as fast as possible, and
+     * jitter and overruns can be injected. This allows benchmarking the whole streaming stack
+     * without hardware.
+     *
      * Notes:
      *  - Error estimate is hardcoded to 0.005
      *  - This source sleeps 1 second in between rapid blocks
@@ -50,6 +71,37 @@ namespace gr {
       virtual void set_data(const std::vector<float> &ch_a_vec,
           const std::vector<float> &ch_b_vec,
           const std::vector<uint8_t> &port_vec) = 0;
+
+      /*!
+       * \brief Sets the waveform generated in streaming mode. Channel B is shifted by a quarter
+       * of a period, port bit 0 follows the sign of channel A.
+       *
+       * \param waveform SIMULATION_WAVEFORM_DATA to play back the set_data vectors
+       * \param amplitude peak amplitude in volts, clipped to the channel range
+       * \param frequency in Hz
+       */
+      virtual void set_stream_generator(simulation_waveform_t waveform, float amplitude,
+          float frequency) = 0;
+
+      /*!
+       * \brief Sets the rate generated samples are delivered at, relative to the sample rate.
+       *
+       * \param rate_factor 1.0 for real time, zero to deliver as fast as possible
+       */
+      virtual void set_stream_pacing(float rate_factor) = 0;
+
+      /*!
+       * \brief Injects faults into the generated stream.
+       *
+       * \param jitter relative variation of the number of samples delivered per callback, [0, 1]
+       * \param overrun_probability probability a callback reports a driver buffer overrun
+       */
+      virtual void set_stream_faults(float jitter, float overrun_probability) = 0;
+
+      /*!
+       * \brief Returns number of callbacks that reported an overrun since arm.
+       */
+      virtual uint64_t get_injected_overruns() const = 0;
     };
 
   } // namespace digitizers
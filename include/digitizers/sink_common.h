@@ -10,8 +10,10 @@
 
 #include <digitizers/api.h>
 #include <gnuradio/tags.h>
+#include <boost/shared_ptr.hpp>
 #include <cstdint>
 #include <string>
+#include <vector>
 
 namespace gr {
 namespace digitizers {
@@ -70,6 +72,27 @@ namespace digitizers {
       std::string signal_name;   // signal name
     };
 
+    /*!
+     * \brief Defines how sink callbacks are invoked.
+     *
+     * The synchronous policy invokes the callback from within the work function. With the other
+     * policies the data is queued and the callback is invoked from a dedicated dispatch thread,
+     * the policy determines what happens when the queue is full.
+     *
+     * \ingroup digitizers
+     */
+    enum DIGITIZERS_API dispatch_policy_t
+    {
+      DISPATCH_SYNCHRONOUS = 0,
+      DISPATCH_DROP_OLDEST = 1,   // oldest queued data is dropped
+      DISPATCH_DROP_NEWEST = 2,   // incoming data is dropped
+      DISPATCH_BLOCK = 3,         // the work function waits, i.e. back-pressure on the flowgraph
+      DISPATCH_ADAPTIVE = 4       // only every n-th item is queued, n adapts to the consumer
+    };
+
+    // Upper bound of the delivery decimation of the adaptive dispatch policy
+    static const uint32_t DISPATCH_MAX_DECIMATION = 64;
+
     /*!
      * \brief Callback deceleration
      */
@@ -81,6 +104,156 @@ namespace digitizers {
                                    std::vector<gr::tag_t>& tags,
                                    void                   *userdata);
 
+    /*!
+     * \brief Package within a batch (see time_domain_sink::set_batch_callback). The memory is
+     * owned by the sink and valid for the duration of the callback only.
+     *
+     * \ingroup digitizers
+     */
+    struct DIGITIZERS_API package_descriptor_t
+    {
+      const float *values;
+      std::size_t values_size;
+      const float *errors;             // nullptr if no errors are available
+      std::size_t errors_size;
+      const gr::tag_t *tags;           // tags within the package, absolute offsets
+      std::size_t tags_size;
+      uint64_t offset;                 // absolute offset of the first sample
+    };
+
+    typedef void (*cb_batch_t)(const package_descriptor_t *packages, std::size_t npackages, void *userdata);
+
+    /*!
+     * \brief Data package delivered by reference (see time_domain_sink::set_package_callback).
+     *
+     * Packages are immutable and reference counted. Memory is taken from a pool owned by the sink
+     * and returned to the pool once the last reference is released, from any thread and at any
+     * time (also after the sink is destroyed).
+     *
+     * \ingroup digitizers
+     */
+    struct DIGITIZERS_API sink_package_t
+    {
+      std::vector<float> values;
+      std::vector<float> errors;       // empty if no errors are available
+      std::vector<gr::tag_t> tags;     // tags within the package, absolute offsets
+      uint64_t offset;                 // absolute offset of the first sample
+    };
+
+    typedef boost::shared_ptr<const sink_package_t> sink_package_sptr;
+
+    typedef void (*cb_package_t)(const sink_package_sptr &package, void *userdata);
+
+    /*!
+     * \brief Measurement delivered by reference (see time_domain_sink::set_measurement_callback).
+     *
+     * Same memory handling as sink_package_t, except the tags are decoded by the sink already.
+     *
+     * \ingroup digitizers
+     */
+    struct DIGITIZERS_API measurement_package_t
+    {
+      std::vector<float> values;
+      std::vector<float> errors;       // empty if no errors are available
+      measurement_info_t info;
+      uint64_t offset;                 // absolute offset of the first sample
+    };
+
+    typedef boost::shared_ptr<const measurement_package_t> measurement_package_sptr;
+
+    typedef void (*cb_measurement_t)(const measurement_package_sptr &package, void *userdata);
+
+    /*!
+     * \brief Measurement of several channels sharing the timing, delivered by reference (see
+     * multi_time_domain_sink::set_measurement_callback).
+     *
+     * Same memory handling as sink_package_t. The values and errors are indexed by channel.
+     *
+     * \ingroup digitizers
+     */
+    struct DIGITIZERS_API multi_measurement_package_t
+    {
+      std::vector<std::vector<float>> values;
+      std::vector<std::vector<float>> errors;
+      measurement_info_t info;         // shared by all the channels
+      uint64_t offset;                 // absolute offset of the first sample
+    };
+
+    typedef boost::shared_ptr<const multi_measurement_package_t> multi_measurement_package_sptr;
+
+    typedef void (*cb_multi_measurement_t)(const multi_measurement_package_sptr &package, void *userdata);
+
+    static const uint32_t SHM_EXPORT_VERSION = 1;
+
+    /*!
+     * \brief Content of a shared memory export.
+     *
+     * \ingroup digitizers
+     */
+    enum DIGITIZERS_API shm_export_kind_t
+    {
+      SHM_EXPORT_TIME_DOMAIN = 0,   // values and errors of a package
+      SHM_EXPORT_FREQUENCY = 1      // frequency, magnitude and phase (nbins each) of a spectrum
+    };
+
+    /*!
+     * \brief Header of a shared memory export, see time_domain_sink::set_shm_export and
+     * freq_sink_f::set_shm_export.
+     *
+     * The POSIX shared memory object (shm_open, e.g. /dev/shm/<name>) starts with this header
+     * followed by nslots slots of slot_size bytes each, the first one at slots_offset. Each slot
+     * starts with a shm_export_slot_t, its values and errors are stored at values_offset and
+     * errors_offset relative to the slot. Data written with sequence number n is stored in slot
+     * n % nslots. Fields are in the byte order of the writing host.
+     *
+     * Consumers map the object read-only (except for the waiters field, see below) and read the
+     * data in place:
+     *  1. load write_sequence (acquire), slots [write_sequence - nslots, write_sequence) hold
+     *     valid data unless overwritten meanwhile
+     *  2. load the sequence of the slot (acquire), skip the slot if it doesn't match
+     *  3. read (or copy) the data
+     *  4. load the sequence of the slot once again, the data read is valid only if unchanged
+     *
+     * The writer never waits for the consumers, slots not read in time are overwritten. To wait
+     * for data, consumers increment waiters (atomically), futex wait (FUTEX_WAIT, not private) on
+     * the futex word as long as it equals the value seen before reading, and decrement waiters.
+     * The writer increments the futex word on each publish and wakes the waiters if there are any.
+     *
+     * \ingroup digitizers
+     */
+    struct DIGITIZERS_API shm_export_header_t
+    {
+      char     magic[8];          // "DIGISHM", zero terminated
+      uint32_t version;           // SHM_EXPORT_VERSION
+      uint32_t header_size;       // sizeof(shm_export_header_t)
+      uint32_t kind;              // see shm_export_kind_t
+      uint32_t nslots;
+      uint64_t slot_size;         // in bytes
+      uint64_t slots_offset;      // offset of the first slot in bytes
+      uint32_t values_offset;     // offset of the values within a slot in bytes
+      uint32_t errors_offset;     // offset of the errors within a slot in bytes
+      uint32_t max_values;        // capacity of a slot, floats
+      uint32_t max_errors;        // capacity of a slot, floats
+      char     name[64];          // signal name, zero terminated (possibly truncated)
+
+      uint64_t write_sequence;    // number of slots published
+      uint32_t futex;             // incremented on each publish
+      uint32_t waiters;           // number of consumers waiting on the futex
+    };
+
+    /*!
+     * \brief Header of a shared memory export slot, see shm_export_header_t.
+     *
+     * \ingroup digitizers
+     */
+    struct DIGITIZERS_API shm_export_slot_t
+    {
+      uint64_t sequence;          // sequence number of the data, all ones while being written
+      uint32_t nvalues;
+      uint32_t nerrors;           // zero if no errors are available
+      measurement_info_t info;
+    };
+
   }
 } // namespace gr
 
@@ -0,0 +1,118 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+
+#ifndef INCLUDED_DIGITIZERS_STATISTICS_SINK_F_H
+#define INCLUDED_DIGITIZERS_STATISTICS_SINK_F_H
+
+#include <digitizers/sink_common.h>
+
+#include <digitizers/api.h>
+#include <gnuradio/sync_block.h>
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Statistics of a single window, see statistics_sink_f.
+     *
+     * The info holds the timing of the first sample of the window, timebase is the window length
+     * (i.e. the distance between two records of the same window length), status the merged
+     * status of the window and post_trigger_samples the number of samples.
+     *
+     * \ingroup digitizers
+     */
+    struct DIGITIZERS_API statistics_record_t
+    {
+      uint32_t window;               // index of the window length, see get_window_lengths
+      float mean;
+      float rms;
+      float stddev;                  // sample standard deviation
+      float min;
+      float max;
+      measurement_info_t info;
+    };
+
+    /*!
+     * \brief Callback specifier of the statistics_sink_f block, called once per record from
+     * within the work function.
+     */
+    typedef void (*statistics_cb_t)(const statistics_record_t *record, void *userdata);
+
+    /*!
+     * \brief Running statistics (mean, RMS, standard deviation, min and max) of a signal over
+     * several window lengths at once, e.g. for monitoring without a cascade_sink.
+     *
+     * The windows are consecutive (not overlapping) and aligned to the first sample. Each
+     * window length has to be a multiple of the previous one: the samples are visited only
+     * once, for the shortest window, the moments of the longer windows are merged from the
+     * shorter ones (as by Welford's parallel algorithm).
+     *
+     * The timing is extrapolated from the acq_info tags, the status of all the acq_info tags
+     * within a window is merged. At most nrecords records are kept per window length, the
+     * oldest ones are dropped if not read in time (see measurement_info_t::samples_lost).
+     *
+     * \ingroup digitizers
+     */
+    class DIGITIZERS_API statistics_sink_f : virtual public gr::sync_block
+    {
+     public:
+      typedef boost::shared_ptr<statistics_sink_f> sptr;
+
+      /*!
+       * \brief Return a shared_ptr to a new instance of digitizers::statistics_sink_f.
+       *
+       * \param name Signal name
+       * \param unit Unit of the signal
+       * \param samp_rate Sample rate of the input in Hz
+       * \param window_lengths Window lengths in seconds, ascending, each a multiple of the
+       * previous one (after rounding to samples), e.g. 0.1, 1 and 10
+       * \param nrecords Number of records kept per window length
+       */
+      static sptr make(std::string name, std::string unit, float samp_rate,
+              const std::vector<double> &window_lengths, size_t nrecords=16);
+
+      /*!
+       * \brief Get signal metadata.
+       */
+      virtual signal_metadata_t get_metadata() = 0;
+
+      /*!
+       * \brief Returns the sample rate of the input.
+       */
+      virtual float get_sample_rate() = 0;
+
+      /*!
+       * \brief Window lengths in seconds, rounded to whole samples.
+       */
+      virtual std::vector<double> get_window_lengths() = 0;
+
+      /*!
+       * \brief Reads (and removes) the oldest records of the given window length.
+       *
+       * The samples_lost of the first record returned counts the samples of the records dropped
+       * since the last readout.
+       *
+       * \param window index of the window length
+       * \param records output, at least max_records
+       * \param max_records maximum number of records to read
+       * \returns number of records read
+       */
+      virtual size_t get_records(size_t window, statistics_record_t *records, size_t max_records) = 0;
+
+      /*!
+       * \brief Register a callable, called for each record of any window length.
+       *
+       * \param callback user callback
+       * \param ptr a void pointer that is passed back to the callback
+       */
+      virtual void set_callback(statistics_cb_t callback, void *ptr) = 0;
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_STATISTICS_SINK_F_H */
@@ -0,0 +1,133 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_STATS_PUBLISHER_H
+#define INCLUDED_DIGITIZERS_STATS_PUBLISHER_H
+
+#include <digitizers/api.h>
+#include <gnuradio/block.h>
+
+#include <cstdint>
+#include <string>
+
+namespace gr {
+  namespace digitizers {
+
+    static const uint32_t TELEMETRY_VERSION = 1;
+
+    /*!
+     * \brief Header of the telemetry export of a stats_publisher, read by tools attaching to a
+     * running flowgraph (e.g. digitizers_top).
+     *
+     * The POSIX shared memory object (shm_open, e.g. /dev/shm/<name>) starts with this header,
+     * followed by max_blocks telemetry_block_t records at blocks_offset and max_threads
+     * telemetry_thread_t records at threads_offset, nblocks and nthreads of them valid. Fields
+     * are in the byte order of the writing host, there is no padding.
+     *
+     * The whole snapshot is replaced every interval. Readers copy the header and the records
+     * and retry if sequence was odd or changed meanwhile.
+     *
+     * \ingroup digitizers
+     */
+    struct DIGITIZERS_API telemetry_header_t
+    {
+      char     magic[8];            // "DIGITEL", zero terminated
+      uint32_t version;             // TELEMETRY_VERSION
+      uint32_t header_size;         // sizeof(telemetry_header_t)
+      uint32_t block_record_size;   // sizeof(telemetry_block_t)
+      uint32_t thread_record_size;  // sizeof(telemetry_thread_t)
+      uint32_t max_blocks;
+      uint32_t max_threads;
+      uint64_t blocks_offset;       // in bytes
+      uint64_t threads_offset;      // in bytes
+      uint64_t sequence;            // odd while being written, accessed atomically
+      int64_t  timestamp;           // of the snapshot, nanoseconds UTC
+      uint32_t nblocks;
+      uint32_t nthreads;
+      int32_t  pid;                 // of the writing process
+      float    interval;            // in seconds
+    };
+
+    /*!
+     * \brief Block record of the telemetry export, see block_stats_t.
+     *
+     * \ingroup digitizers
+     */
+    struct DIGITIZERS_API telemetry_block_t
+    {
+      char     name[64];            // zero terminated, truncated
+      uint64_t work_calls;
+      uint64_t work_time_ns;
+      uint64_t items;
+      uint64_t tags;
+      uint64_t lost;
+      uint64_t allocations;
+      uint64_t allocating_calls;
+      int64_t  data_age_ns;
+      int64_t  max_data_age_ns;
+      double   avg_data_age_ns;
+      double   items_per_second;
+      double   load;
+      double   buffer_occupancy;
+      double   max_buffer_occupancy;
+    };
+
+    /*!
+     * \brief Thread record of the telemetry export, see thread_stats_t.
+     *
+     * \ingroup digitizers
+     */
+    struct DIGITIZERS_API telemetry_thread_t
+    {
+      char     name[64];            // zero terminated, truncated
+      int32_t  tid;
+      int32_t  cpu;
+      int32_t  rt_priority;
+      uint32_t scheduling_failed;
+      uint64_t cpu_time_ns;
+      uint64_t voluntary_switches;
+      uint64_t involuntary_switches;
+    };
+
+    /*!
+     * \brief Periodically publishes the performance counters of all the blocks of this module
+     * (see block_stats.h) on the 'stats' message port.
+     *
+     * One message is published per block and interval, a dictionary with the keys name,
+     * work_calls, work_time_ns, items, tags, items_per_second, load, data_age_ns,
+     * max_data_age_ns, avg_data_age_ns, allocations, allocating_calls, buffer_occupancy,
+     * max_buffer_occupancy and lost. Collection of the counters is enabled while the flowgraph
+     * containing this block runs.
+     *
+     * The internal threads (see thread_stats.h) are published on the 'threads' port, one
+     * dictionary per thread with the keys name, tid, cpu, cpu_time_ns, voluntary_switches,
+     * involuntary_switches and scheduling_failed.
+     *
+     * If a shared memory name is given the same counters are exported to a shared memory object
+     * each interval (see telemetry_header_t), for tools attaching to the running flowgraph
+     * without a message connection, e.g. digitizers_top.
+     *
+     * \ingroup digitizers
+     */
+    class DIGITIZERS_API stats_publisher : virtual public gr::block
+    {
+     public:
+      typedef boost::shared_ptr<stats_publisher> sptr;
+
+      /*!
+       * \brief Create a stats publisher.
+       *
+       * \param interval publishing interval in seconds
+       * \param shm_name shared memory object of the telemetry export (e.g. "/digitizers_telemetry"),
+       * empty to publish the messages only
+       */
+      static sptr make(double interval=1.0, const std::string &shm_name="");
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_STATS_PUBLISHER_H */
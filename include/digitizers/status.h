@@ -28,7 +28,11 @@ namespace digitizers {
        // Insufficient buffer size to extract all samples
        CHANNEL_STATUS_NOT_ALL_DATA_EXTRACTED = 0x04,
 
-       CHANNEL_STATUS_TIMEOUT_WAITING_WR_OR_REALIGNMENT_EVENT = 0x08
+       CHANNEL_STATUS_TIMEOUT_WAITING_WR_OR_REALIGNMENT_EVENT = 0x08,
+
+       // Requested CPU affinity or real-time priority could not be applied to the poller or
+       // the work thread (see digitizer_block::set_poller_scheduling).
+       CHANNEL_STATUS_THREAD_SCHEDULING_FAILED = 0x10
     };
 
     enum DIGITIZERS_API algorithm_id_t
@@ -40,7 +44,22 @@ namespace digitizers {
       IIR_LP,
       IIR_HP,
       IIR_CUSTOM,
-      AVERAGE
+      AVERAGE,
+      FIR_AUTO,     // FIR_CUSTOM taps, or the FIR_LP design if none, direct form or FFT picked per design
+      CIC           // CIC response with a short compensation FIR, for large decimation factors
+    };
+
+    /*!
+     * \brief Encoding of the acq_info and trigger tag values (see tags.h).
+     *
+     * The tuple encoding stores each field as a boxed PMT (a tuple of PMT scalars). The binary
+     * encoding stores a fixed size POD struct in a single PMT blob, i.e. a single allocation to
+     * encode and no allocation to decode. Decoders accept both the encodings.
+     */
+    enum DIGITIZERS_API tag_encoding_t
+    {
+      TAG_ENCODING_TUPLE = 0,
+      TAG_ENCODING_BINARY = 1
     };
 
   }
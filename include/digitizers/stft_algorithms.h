@@ -24,12 +24,35 @@ namespace gr {
       {
         FFT          = 0,
         GOERTZEL     = 1,
-		DFT          = 2
+		DFT          = 2,
+        AUTO         = 3
       };
 
     /*!
      * \brief Calculate the stft of the signal. This is a hier block
      * wired as it was described in the proposed wiring diagram.
+     *
+     * Outputs magnitude, phase and (optionally) the frequency of each bin. The frequency axis
+     * is also attached to the spectra as freq_axis tag, i.e. the frequency output doesn't need
+     * to be connected to a freq_sink_f.
+     *
+     * If the windows overlap by 75% or more (delta_t * samp_rate <= window_size / 4) the
+     * Goertzel and DFT algorithms update the bins recursively for each hop (sliding DFT)
+     * instead of evaluating each window from scratch. The results are the same.
+     *
+     * AUTO outputs the same as GOERTZEL (nbins bins in [fq_low, fq_hi], rectangular window)
+     * but evaluates the bins either by the Goertzel recurrence or by an FFT, whichever a cost
+     * model calibrated on the machine estimates cheaper for the window size, number of bins
+     * and frequency range. The choice is re-evaluated by set_freqs and set_samp_rate, while
+     * running. Few bins favour Goertzel, many bins the FFT. The sliding DFT is not used.
+     *
+     * For narrow bands far from DC a digital down-converter can be put in front (decimation
+     * > 1, GOERTZEL, FFT or AUTO): the signal is mixed down by center_freq, low pass filtered
+     * and decimated, and the bins are evaluated on the baseband with a window of window_size /
+     * decimation samples, i.e. the same time span and resolution at a fraction of the cost.
+     * The output is the same as for GOERTZEL (rectangular window, up to the filter ripple),
+     * frequencies and timing tags refer to the original signal. The phase is relative to the
+     * down-converter. All the bins must be within 0.3 * samp_rate / decimation of center_freq.
      * \ingroup digitizers
      *
      */
@@ -45,12 +68,15 @@ namespace gr {
        * \param delta_t The time in seconds between each signal analysis
        * \param window_size size of the stft window
        * \param wintype window type to remove noise in the freq. response.
-       * \param alg_id (fft = 0, goertzel = 1, dft = 2)
+       * \param alg_id (fft = 0, goertzel = 1, dft = 2, auto = 3)
        * \param fq_low lower frequency for the goertzel based f-response
        * \param fq_hi upper frequency for the goertzel based f-response
        * \param nbins number of bins for the goertzel basded f-response
+       * \param center_freq down-converter frequency, used if decimation > 1
+       * \param decimation of the down-converter, must divide window_size, 1 for none
        */
-      static sptr make(double samp_rate, double delta_t, int window_size, int wintype, stft_algorithm_id_t alg_id, double fq_low, double fq_hi, int nbins);
+      static sptr make(double samp_rate, double delta_t, int window_size, int wintype, stft_algorithm_id_t alg_id, double fq_low, double fq_hi, int nbins,
+              double center_freq = 0.0, int decimation = 1);
 
       /**
        * \brief Set a new sample rate.
@@ -80,6 +106,12 @@ namespace gr {
        * \param fq_hi The upper frequency of the desired window.
        */
       virtual void set_freqs(double fq_low, double fq_hi) = 0;
+
+      /**
+       * \brief Returns the algorithm evaluating the bins, for AUTO the one currently selected
+       * (FFT or GOERTZEL).
+       */
+      virtual stft_algorithm_id_t get_algorithm() = 0;
     };
 
   } // namespace digitizers
@@ -24,6 +24,10 @@ namespace gr {
      * ie. (fMin+fMax)/2. The block returns magnitudes, phase shifts, and frequencies of the
      * analysis, all of length nbins.
      *
+     * Many bins (compared to the window size) are computed by the chirp-z transform instead of
+     * one Goertzel filter per bin, i.e. in O(winsize log winsize) instead of O(nbins winsize).
+     * The bins are the same, the magnitudes agree within single precision FFT accuracy.
+     *
      * ^
      * |          < - - - - - - - >
      * |          |       |       |
@@ -9,6 +9,7 @@
 #define INCLUDED_DIGITIZERS_STREAM_TO_VECTOR_OVERLAY_FF_H
 
 #include <digitizers/api.h>
+#include <digitizers/tags.h>
 #include <gnuradio/block.h>
 
 namespace gr {
@@ -71,6 +72,12 @@ namespace gr {
        * \param delta_t the time in seconds between each acquisition.
        */
       static sptr make(int vec_size, double samp_rate, double delta_t);
+
+      /*!
+       * \brief Attaches a freq_axis tag (see tags.h) to the next output vector and to the first
+       * vector after each start, e.g. for spectra computed from the vectors.
+       */
+      virtual void set_freq_axis(const freq_axis_t &axis) = 0;
     };
 
   } // namespace digitizers
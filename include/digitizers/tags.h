@@ -9,12 +9,62 @@
 #define INCLUDED_DIGITIZERS_TAGS_H
 
 #include <digitizers/api.h>
+#include <digitizers/status.h>
 #include <gnuradio/tags.h>
+#include <algorithm>
 #include <cassert>
+#include <cstddef>
+#include <cstring>
 
 namespace gr {
   namespace digitizers {
 
+  // ################################################################################################################
+  // ################################################################################################################
+
+    /*!
+     * \brief Schema version of the binary encoded tags.
+     *
+     * Fields are stored in host byte order. Later versions may only append fields, the size
+     * field allows decoders to skip fields unknown to them.
+     */
+    static const uint16_t TAG_BLOB_VERSION = 1;
+
+    /*!
+     * \brief Encodes a POD blob struct, the version and size fields are filled in.
+     */
+    template <typename Blob>
+    inline pmt::pmt_t
+    encode_tag_blob(Blob &blob)
+    {
+      blob.version = TAG_BLOB_VERSION;
+      blob.size = static_cast<uint16_t>(sizeof(Blob));
+      return pmt::make_blob(&blob, sizeof(Blob));
+    }
+
+    /*!
+     * \brief Decodes a POD blob struct, returns false if the value is not a valid blob.
+     *
+     * Blobs written by older versions may be shorter than Blob but not shorter than min_size,
+     * the fields missing in those keep the values blob had on input.
+     */
+    template <typename Blob>
+    inline bool
+    decode_tag_blob(const pmt::pmt_t &value, Blob &blob, size_t min_size = sizeof(Blob))
+    {
+      if (!pmt::is_blob(value)) {
+        return false;
+      }
+
+      const auto length = pmt::blob_length(value);
+      if (length < min_size) {
+        return false;
+      }
+
+      memcpy(&blob, pmt::blob_data(value), std::min(length, sizeof(Blob)));
+      return blob.version >= 1 && blob.size >= min_size && blob.size <= length;
+    }
+
   // ################################################################################################################
   // ################################################################################################################
 
@@ -55,6 +105,17 @@ namespace gr {
      */
 
     char const * const acq_info_tag_name = "acq_info";
+
+    /*!
+     * \brief Interned acq_info tag key, see get_tag_kind.
+     */
+    inline const pmt::pmt_t &
+    acq_info_tag_key()
+    {
+      static const pmt::pmt_t key = pmt::intern(acq_info_tag_name);
+      return key;
+    }
+
     struct DIGITIZERS_API acq_info_t
     {
       int64_t timestamp;         // timestamp (UTC nanoseconds), used as fallback if no trigger is available
@@ -62,20 +123,69 @@ namespace gr {
       double user_delay;         // see description above
       double actual_delay;       // see description above
       uint32_t status;           // acquisition status
+      double scale = 1.0;        // calibration applied by the digitizer, value = voltage * scale - offset
+      double offset = 0.0;       // see scale
+      uint32_t config_version = 0; // digitizer configuration snapshot used, 0 if unknown
     };
 
+    /*!
+     * \brief Binary encoding of the acq_info tag (see TAG_BLOB_VERSION).
+     */
+    struct acq_info_blob_t
+    {
+      uint16_t version;
+      uint16_t size;
+      uint32_t status;
+      int64_t timestamp;
+      double timebase;
+      double user_delay;
+      double actual_delay;
+      // appended, missing in blobs written before the calibration was added
+      double scale;
+      double offset;
+      // appended, missing in blobs written before the configuration version was added
+      uint32_t config_version;
+    };
+
+    // Size of the acq_info blobs written before the calibration was added
+    static const size_t ACQ_INFO_BLOB_MIN_SIZE = offsetof(acq_info_blob_t, scale);
+
+    inline pmt::pmt_t
+    encode_acq_info_blob(const acq_info_t &acq_info)
+    {
+      acq_info_blob_t blob{};   // zeroes the tail padding as well
+      blob.status = acq_info.status;
+      blob.timestamp = acq_info.timestamp;
+      blob.timebase = acq_info.timebase;
+      blob.user_delay = acq_info.user_delay;
+      blob.actual_delay = acq_info.actual_delay;
+      blob.scale = acq_info.scale;
+      blob.offset = acq_info.offset;
+      blob.config_version = acq_info.config_version;
+      return encode_tag_blob(blob);
+    }
+
     inline gr::tag_t
-    make_acq_info_tag(const acq_info_t &acq_info, uint64_t offset)
+    make_acq_info_tag(const acq_info_t &acq_info, uint64_t offset,
+            tag_encoding_t encoding=TAG_ENCODING_TUPLE)
     {
       gr::tag_t tag;
-      tag.key = pmt::intern(acq_info_tag_name);
-      tag.value =  pmt::make_tuple(
-              pmt::from_uint64(static_cast<uint64_t>(acq_info.timestamp)),
-              pmt::from_double(acq_info.timebase),
-              pmt::from_double(acq_info.user_delay),
-              pmt::from_double(acq_info.actual_delay),
-              pmt::from_long(static_cast<long>(acq_info.status))
-              );
+      tag.key = acq_info_tag_key();
+      if (encoding == TAG_ENCODING_BINARY) {
+        tag.value = encode_acq_info_blob(acq_info);
+      }
+      else {
+        tag.value =  pmt::make_tuple(
+                pmt::from_uint64(static_cast<uint64_t>(acq_info.timestamp)),
+                pmt::from_double(acq_info.timebase),
+                pmt::from_double(acq_info.user_delay),
+                pmt::from_double(acq_info.actual_delay),
+                pmt::from_long(static_cast<long>(acq_info.status)),
+                pmt::from_double(acq_info.scale),
+                pmt::from_double(acq_info.offset),
+                pmt::from_long(static_cast<long>(acq_info.config_version))
+                );
+      }
       tag.offset = offset;
       return tag;
     }
@@ -83,9 +193,32 @@ namespace gr {
     inline acq_info_t
     decode_acq_info_tag(const gr::tag_t &tag)
     {
-      assert(pmt::symbol_to_string(tag.key) == acq_info_tag_name);
+      assert(tag.key == acq_info_tag_key());
+
+      acq_info_blob_t blob;
+      blob.scale = 1.0;
+      blob.offset = 0.0;
+      blob.config_version = 0;
+      if (decode_tag_blob(tag.value, blob, ACQ_INFO_BLOB_MIN_SIZE)) {
+        acq_info_t acq_info;
+        acq_info.timestamp = blob.timestamp;
+        acq_info.timebase = blob.timebase;
+        acq_info.user_delay = blob.user_delay;
+        acq_info.actual_delay = blob.actual_delay;
+        acq_info.status = blob.status;
+        if (blob.size >= offsetof(acq_info_blob_t, config_version)) {
+          acq_info.scale = blob.scale;
+          acq_info.offset = blob.offset;
+        }
+        if (blob.size >= offsetof(acq_info_blob_t, config_version) + sizeof(uint32_t)) {
+          acq_info.config_version = blob.config_version;
+        }
+        return acq_info;
+      }
 
-      if (!pmt::is_tuple(tag.value) || pmt::length(tag.value) != 5)
+      // Tuples written before the calibration (configuration version) was added have 5 (7) elements
+      const auto length = pmt::is_tuple(tag.value) ? pmt::length(tag.value) : 0;
+      if (length != 5 && length != 7 && length != 8)
       {
           std::ostringstream message;
           message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid acq_info tag format";
@@ -99,6 +232,13 @@ namespace gr {
       acq_info.user_delay = pmt::to_double(tuple_ref(tag_tuple, 2));
       acq_info.actual_delay = pmt::to_double(tuple_ref(tag_tuple, 3));
       acq_info.status = static_cast<uint32_t>(pmt::to_long(tuple_ref(tag_tuple, 4)));
+      if (length >= 7) {
+        acq_info.scale = pmt::to_double(tuple_ref(tag_tuple, 5));
+        acq_info.offset = pmt::to_double(tuple_ref(tag_tuple, 6));
+      }
+      if (length == 8) {
+        acq_info.config_version = static_cast<uint32_t>(pmt::to_long(tuple_ref(tag_tuple, 7)));
+      }
       return acq_info;
     }
 
@@ -106,39 +246,82 @@ namespace gr {
     // ################################################################################################################
 
     char const * const trigger_tag_name = "trigger";
+
+    /*!
+     * \brief Interned trigger tag key, see get_tag_kind.
+     */
+    inline const pmt::pmt_t &
+    trigger_tag_key()
+    {
+      static const pmt::pmt_t key = pmt::intern(trigger_tag_name);
+      return key;
+    }
+
     struct DIGITIZERS_API trigger_t
     {
       uint32_t downsampling_factor;
       int64_t timestamp;
       uint32_t status;
+      double trigger_offset = 0.0; // hardware trigger time offset relative to the trigger sample (seconds), zero if not available
     };
 
+    /*!
+     * \brief Binary encoding of the trigger tag (see TAG_BLOB_VERSION).
+     */
+    struct trigger_blob_t
+    {
+      uint16_t version;
+      uint16_t size;
+      uint32_t downsampling_factor;
+      int64_t timestamp;
+      uint32_t status;
+      uint32_t reserved;
+      double trigger_offset;
+    };
+
+    // Size of the trigger blobs written before the trigger time offset was added
+    static const size_t TRIGGER_BLOB_MIN_SIZE = offsetof(trigger_blob_t, trigger_offset);
+
+    inline pmt::pmt_t
+    encode_trigger_blob(uint32_t downsampling_factor, int64_t timestamp, uint32_t status,
+            double trigger_offset = 0.0)
+    {
+      trigger_blob_t blob;
+      blob.downsampling_factor = downsampling_factor;
+      blob.timestamp = timestamp;
+      blob.status = status;
+      blob.reserved = 0;
+      blob.trigger_offset = trigger_offset;
+      return encode_tag_blob(blob);
+    }
+
     inline gr::tag_t
-    make_trigger_tag(trigger_t &trigger_tag_data, uint64_t offset)
+    make_trigger_tag(uint32_t downsampling_factor, int64_t timestamp, uint64_t offset, uint32_t status,
+            tag_encoding_t encoding=TAG_ENCODING_TUPLE, double trigger_offset = 0.0)
     {
         gr::tag_t tag;
-        tag.key = pmt::intern(trigger_tag_name);
-        tag.value =  pmt::make_tuple(
-                pmt::from_long(static_cast<long>(trigger_tag_data.downsampling_factor)),
-                pmt::from_uint64(static_cast<uint64_t>(trigger_tag_data.timestamp)),
-                pmt::from_long(static_cast<long>(trigger_tag_data.status))
-                );
+        tag.key = trigger_tag_key();
+        if (encoding == TAG_ENCODING_BINARY) {
+          tag.value = encode_trigger_blob(downsampling_factor, timestamp, status, trigger_offset);
+        }
+        else {
+          tag.value =  pmt::make_tuple(
+                  pmt::from_long(static_cast<long>(downsampling_factor)),
+                  pmt::from_uint64(static_cast<uint64_t>(timestamp)),
+                  pmt::from_long(static_cast<long>(status)),
+                  pmt::from_double(trigger_offset)
+                  );
+        }
         tag.offset = offset;
         return tag;
     }
 
     inline gr::tag_t
-    make_trigger_tag(uint32_t downsampling_factor, int64_t timestamp, uint64_t offset, uint32_t status)
+    make_trigger_tag(trigger_t &trigger_tag_data, uint64_t offset,
+            tag_encoding_t encoding=TAG_ENCODING_TUPLE)
     {
-        gr::tag_t tag;
-        tag.key = pmt::intern(trigger_tag_name);
-        tag.value =  pmt::make_tuple(
-                pmt::from_long(static_cast<long>(downsampling_factor)),
-                pmt::from_uint64(static_cast<uint64_t>(timestamp)),
-                pmt::from_long(static_cast<long>(status))
-                );
-        tag.offset = offset;
-        return tag;
+        return make_trigger_tag(trigger_tag_data.downsampling_factor, trigger_tag_data.timestamp,
+                offset, trigger_tag_data.status, encoding, trigger_tag_data.trigger_offset);
     }
 
     // e.g. used for streaming
@@ -146,11 +329,12 @@ namespace gr {
     make_trigger_tag(uint64_t offset)
     {
         gr::tag_t tag;
-        tag.key = pmt::intern(trigger_tag_name);
+        tag.key = trigger_tag_key();
         tag.value =  pmt::make_tuple(
                 pmt::from_long(static_cast<long>(0)),
                 pmt::from_uint64(static_cast<uint64_t>(0)),
-                pmt::from_long(static_cast<long>(0))
+                pmt::from_long(static_cast<long>(0)),
+                pmt::from_double(0.0)
                 );
         tag.offset = offset;
         return tag;
@@ -159,9 +343,24 @@ namespace gr {
     inline trigger_t
     decode_trigger_tag(const gr::tag_t &tag)
     {
-      assert(pmt::symbol_to_string(tag.key) == trigger_tag_name);
+      assert(tag.key == trigger_tag_key());
+
+      trigger_blob_t blob;
+      blob.trigger_offset = 0.0;
+      if (decode_tag_blob(tag.value, blob, TRIGGER_BLOB_MIN_SIZE)) {
+        trigger_t trigger_tag;
+        trigger_tag.downsampling_factor = blob.downsampling_factor;
+        trigger_tag.timestamp = blob.timestamp;
+        trigger_tag.status = blob.status;
+        if (blob.size >= sizeof(trigger_blob_t)) {
+          trigger_tag.trigger_offset = blob.trigger_offset;
+        }
+        return trigger_tag;
+      }
 
-      if (!pmt::is_tuple(tag.value) || pmt::length(tag.value) != 3)
+      // Tuples written before the trigger time offset was added have 3 elements
+      const auto length = pmt::is_tuple(tag.value) ? pmt::length(tag.value) : 0;
+      if (length != 3 && length != 4)
       {
           std::ostringstream message;
           message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid trigger tag format";
@@ -173,6 +372,9 @@ namespace gr {
       trigger_tag.downsampling_factor = static_cast<uint32_t>(pmt::to_long(tuple_ref(tag_tuple, 0)));
       trigger_tag.timestamp = static_cast<int64_t>(pmt::to_uint64(tuple_ref(tag_tuple, 1)));
       trigger_tag.status = static_cast<uint32_t>(pmt::to_long(tuple_ref(tag_tuple, 2)));
+      if (length == 4) {
+        trigger_tag.trigger_offset = pmt::to_double(tuple_ref(tag_tuple, 3));
+      }
 
       return trigger_tag;
     }
@@ -182,6 +384,17 @@ namespace gr {
 
     char const * const timebase_info_tag_name = "timebase_info";
 
+    /*!
+     * \brief Interned timebase_info tag key, see get_tag_kind.
+     */
+    inline const pmt::pmt_t &
+    timebase_info_tag_key()
+    {
+      static const pmt::pmt_t key = pmt::intern(timebase_info_tag_name);
+      return key;
+    }
+
+
     /*!
      * \brief Factory function for creating timebase_info tags.
      */
@@ -189,7 +402,7 @@ namespace gr {
     make_timebase_info_tag(double timebase)
     {
       gr::tag_t tag;
-      tag.key = pmt::intern(timebase_info_tag_name);
+      tag.key = timebase_info_tag_key();
       tag.value = pmt::from_double(timebase);
       return tag;
     }
@@ -200,7 +413,7 @@ namespace gr {
     inline double
     decode_timebase_info_tag(const gr::tag_t &tag)
     {
-      assert(pmt::symbol_to_string(tag.key) == timebase_info_tag_name);
+      assert(tag.key == timebase_info_tag_key());
       return pmt::to_double(tag.value);
     }
 
@@ -212,6 +425,17 @@ namespace gr {
      */
     char const * const wr_event_tag_name = "wr_event";
 
+    /*!
+     * \brief Interned wr_event tag key, see get_tag_kind.
+     */
+    inline const pmt::pmt_t &
+    wr_event_tag_key()
+    {
+      static const pmt::pmt_t key = pmt::intern(wr_event_tag_name);
+      return key;
+    }
+
+
     /*!
      * \brief A convenience structure holding information about the WR timing event.
      * \ingroup digitizers
@@ -231,7 +455,7 @@ namespace gr {
     make_wr_event_tag(const wr_event_t &event, uint64_t offset)
     {
       gr::tag_t tag;
-      tag.key = pmt::intern(wr_event_tag_name);
+      tag.key = wr_event_tag_key();
       tag.value =  pmt::make_tuple(
               pmt::string_to_symbol(event.event_id),
               pmt::from_uint64(static_cast<uint64_t>(event.wr_trigger_stamp)),
@@ -247,7 +471,7 @@ namespace gr {
     inline wr_event_t
     decode_wr_event_tag(const gr::tag_t &tag)
     {
-      assert(pmt::symbol_to_string(tag.key) == wr_event_tag_name);
+      assert(tag.key == wr_event_tag_key());
 
       if (!pmt::is_tuple(tag.value) || pmt::length(tag.value) != 3)
       {
@@ -269,6 +493,465 @@ namespace gr {
     // ################################################################################################################
     // ################################################################################################################
 
+    /*!
+     * \brief Name of the constant error tag.
+     */
+    char const * const constant_error_tag_name = "constant_error";
+
+    /*!
+     * \brief Interned constant_error tag key, see get_tag_kind.
+     */
+    inline const pmt::pmt_t &
+    constant_error_tag_key()
+    {
+      static const pmt::pmt_t key = pmt::intern(constant_error_tag_name);
+      return key;
+    }
+
+
+    /*!
+     * \brief Factory function for creating constant error tags. The tag is attached to the values
+     * stream and states that the error estimate of all the samples starting at the given offset
+     * (until the next constant error tag) equals the given value.
+     */
+    inline gr::tag_t
+    make_constant_error_tag(float error, uint64_t offset)
+    {
+      gr::tag_t tag;
+      tag.key = constant_error_tag_key();
+      tag.value = pmt::from_double(error);
+      tag.offset = offset;
+      return tag;
+    }
+
+    /*!
+     * \brief Returns error estimate stored within the constant error tag.
+     */
+    inline float
+    decode_constant_error_tag(const gr::tag_t &tag)
+    {
+      assert(tag.key == constant_error_tag_key());
+      return static_cast<float>(pmt::to_double(tag.value));
+    }
+
+    // ################################################################################################################
+    // ################################################################################################################
+
+    /*!
+     * \brief Name of the raw scaling tag.
+     */
+    char const * const raw_scaling_tag_name = "raw_scaling";
+
+    /*!
+     * \brief Interned raw_scaling tag key, see get_tag_kind.
+     */
+    inline const pmt::pmt_t &
+    raw_scaling_tag_key()
+    {
+      static const pmt::pmt_t key = pmt::intern(raw_scaling_tag_name);
+      return key;
+    }
+
+
+    /*!
+     * \brief Describes how raw ADC counts (raw output mode) are converted into voltages, that is:
+     *   value = raw * scale + offset
+     * \ingroup digitizers
+     */
+    struct DIGITIZERS_API raw_scaling_t
+    {
+      double scale;     // volts per ADC count
+      double offset;    // volts
+      double error;     // error estimate in volts, the same for all the samples
+    };
+
+    /*!
+     * \brief Factory function for creating raw scaling tags.
+     */
+    inline gr::tag_t
+    make_raw_scaling_tag(const raw_scaling_t &scaling, uint64_t offset)
+    {
+      gr::tag_t tag;
+      tag.key = raw_scaling_tag_key();
+      tag.value =  pmt::make_tuple(
+              pmt::from_double(scaling.scale),
+              pmt::from_double(scaling.offset),
+              pmt::from_double(scaling.error)
+              );
+      tag.offset = offset;
+      return tag;
+    }
+
+    /*!
+     * \brief Converts raw scaling tag into raw_scaling_t struct.
+     */
+    inline raw_scaling_t
+    decode_raw_scaling_tag(const gr::tag_t &tag)
+    {
+      assert(tag.key == raw_scaling_tag_key());
+
+      if (!pmt::is_tuple(tag.value) || pmt::length(tag.value) != 3)
+      {
+          std::ostringstream message;
+          message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid raw_scaling tag format";
+          throw std::runtime_error(message.str());
+      }
+
+      raw_scaling_t scaling;
+
+      auto tag_tuple = pmt::to_tuple(tag.value);
+      scaling.scale = pmt::to_double(tuple_ref(tag_tuple, 0));
+      scaling.offset = pmt::to_double(tuple_ref(tag_tuple, 1));
+      scaling.error = pmt::to_double(tuple_ref(tag_tuple, 2));
+
+      return scaling;
+    }
+
+    // ################################################################################################################
+    // ################################################################################################################
+
+    /*!
+     * \brief Name of the frequency axis tag.
+     */
+    char const * const freq_axis_tag_name = "freq_axis";
+
+    /*!
+     * \brief Interned freq_axis tag key, see get_tag_kind.
+     */
+    inline const pmt::pmt_t &
+    freq_axis_tag_key()
+    {
+      static const pmt::pmt_t key = pmt::intern(freq_axis_tag_name);
+      return key;
+    }
+
+    /*!
+     * \brief Descriptor of a linear frequency axis, bin i is at fq_low + i * fq_step.
+     *
+     * Spectra carry the axis as a tag attached to the first spectrum and whenever the axis
+     * changes, instead of a per-bin frequency stream. The version is incremented by the
+     * producer on each change, i.e. consumers rebuild the axis only if the version differs.
+     */
+    struct DIGITIZERS_API freq_axis_t
+    {
+      uint32_t version;
+      uint32_t nbins;
+      double fq_low;    // Hz
+      double fq_step;   // Hz
+    };
+
+    /*!
+     * \brief Writes nbins frequencies of the axis.
+     */
+    inline void
+    fill_freq_axis(const freq_axis_t &axis, float *freqs)
+    {
+      for (uint32_t i = 0; i < axis.nbins; i++) {
+        freqs[i] = static_cast<float>(axis.fq_low + i * axis.fq_step);
+      }
+    }
+
+    /*!
+     * \brief Factory function for creating freq_axis tags.
+     */
+    inline gr::tag_t
+    make_freq_axis_tag(const freq_axis_t &axis, uint64_t offset)
+    {
+      gr::tag_t tag;
+      tag.key = freq_axis_tag_key();
+      tag.value =  pmt::make_tuple(
+              pmt::from_uint64(axis.version),
+              pmt::from_uint64(axis.nbins),
+              pmt::from_double(axis.fq_low),
+              pmt::from_double(axis.fq_step)
+              );
+      tag.offset = offset;
+      return tag;
+    }
+
+    /*!
+     * \brief Converts freq_axis tag into freq_axis_t struct.
+     */
+    inline freq_axis_t
+    decode_freq_axis_tag(const gr::tag_t &tag)
+    {
+      assert(tag.key == freq_axis_tag_key());
+
+      if (!pmt::is_tuple(tag.value) || pmt::length(tag.value) != 4)
+      {
+          std::ostringstream message;
+          message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid freq_axis tag format";
+          throw std::runtime_error(message.str());
+      }
+
+      freq_axis_t axis;
+
+      auto tag_tuple = pmt::to_tuple(tag.value);
+      axis.version = static_cast<uint32_t>(pmt::to_uint64(tuple_ref(tag_tuple, 0)));
+      axis.nbins = static_cast<uint32_t>(pmt::to_uint64(tuple_ref(tag_tuple, 1)));
+      axis.fq_low = pmt::to_double(tuple_ref(tag_tuple, 2));
+      axis.fq_step = pmt::to_double(tuple_ref(tag_tuple, 3));
+
+      return axis;
+    }
+
+    // ################################################################################################################
+    // ################################################################################################################
+
+    /*!
+     * \brief Name of the realignment tag.
+     *
+     * Emitted by time_realignment_ff in streaming mode (or by the digitizer itself, see
+     * digitizer_block::set_timing_realignment) once the WR stamp of an already forwarded
+     * trigger is known. Consumers apply the correction to the trigger at trigger_offset.
+     */
+    char const * const realignment_tag_name = "realignment";
+
+    /*!
+     * \brief Interned realignment tag key, see get_tag_kind.
+     */
+    inline const pmt::pmt_t &
+    realignment_tag_key()
+    {
+      static const pmt::pmt_t key = pmt::intern(realignment_tag_name);
+      return key;
+    }
+
+    struct DIGITIZERS_API realignment_t
+    {
+      uint64_t trigger_offset;   // offset of the corrected trigger tag
+      int64_t timestamp;         // corrected trigger timestamp (TAI nanoseconds)
+      uint32_t status;           // status bits to be added to the trigger status
+    };
+
+    inline gr::tag_t
+    make_realignment_tag(const realignment_t &realignment, uint64_t offset)
+    {
+      gr::tag_t tag;
+      tag.key = realignment_tag_key();
+      tag.value =  pmt::make_tuple(
+              pmt::from_uint64(realignment.trigger_offset),
+              pmt::from_uint64(static_cast<uint64_t>(realignment.timestamp)),
+              pmt::from_long(static_cast<long>(realignment.status))
+              );
+      tag.offset = offset;
+      return tag;
+    }
+
+    inline realignment_t
+    decode_realignment_tag(const gr::tag_t &tag)
+    {
+      assert(tag.key == realignment_tag_key());
+
+      if (!pmt::is_tuple(tag.value) || pmt::length(tag.value) != 3)
+      {
+          std::ostringstream message;
+          message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid realignment tag format";
+          throw std::runtime_error(message.str());
+      }
+
+      realignment_t realignment;
+
+      auto tag_tuple = pmt::to_tuple(tag.value);
+      realignment.trigger_offset = pmt::to_uint64(tuple_ref(tag_tuple, 0));
+      realignment.timestamp = static_cast<int64_t>(pmt::to_uint64(tuple_ref(tag_tuple, 1)));
+      realignment.status = static_cast<uint32_t>(pmt::to_long(tuple_ref(tag_tuple, 2)));
+
+      return realignment;
+    }
+
+    // ################################################################################################################
+    // ################################################################################################################
+
+    /*!
+     * \brief Name of the channel delay tag.
+     *
+     * Emitted by delay_estimator_ff on each of its outputs whenever a new estimate of the delay
+     * of the channel relative to the reference channel (input 0) is available. Consumers (e.g.
+     * time_realignment_ff) subtract the delay from the timestamps of the channel, i.e. apply it
+     * like a negative user delay.
+     */
+    char const * const channel_delay_tag_name = "channel_delay";
+
+    /*!
+     * \brief Interned channel_delay tag key, see get_tag_kind.
+     */
+    inline const pmt::pmt_t &
+    channel_delay_tag_key()
+    {
+      static const pmt::pmt_t key = pmt::intern(channel_delay_tag_name);
+      return key;
+    }
+
+    struct DIGITIZERS_API channel_delay_t
+    {
+      double delay;              // seconds the channel lags the reference, negative if it leads
+      float correlation;         // normalized cross-correlation peak, 1 for the reference itself
+    };
+
+    inline gr::tag_t
+    make_channel_delay_tag(const channel_delay_t &channel_delay, uint64_t offset)
+    {
+      gr::tag_t tag;
+      tag.key = channel_delay_tag_key();
+      tag.value =  pmt::make_tuple(
+              pmt::from_double(channel_delay.delay),
+              pmt::from_double(static_cast<double>(channel_delay.correlation))
+              );
+      tag.offset = offset;
+      return tag;
+    }
+
+    inline channel_delay_t
+    decode_channel_delay_tag(const gr::tag_t &tag)
+    {
+      assert(tag.key == channel_delay_tag_key());
+
+      if (!pmt::is_tuple(tag.value) || pmt::length(tag.value) != 2)
+      {
+          std::ostringstream message;
+          message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid channel_delay tag format";
+          throw std::runtime_error(message.str());
+      }
+
+      channel_delay_t channel_delay;
+
+      auto tag_tuple = pmt::to_tuple(tag.value);
+      channel_delay.delay = pmt::to_double(tuple_ref(tag_tuple, 0));
+      channel_delay.correlation = static_cast<float>(pmt::to_double(tuple_ref(tag_tuple, 1)));
+
+      return channel_delay;
+    }
+
+    // ################################################################################################################
+    // ################################################################################################################
+
+    /*!
+     * \brief Name of the trace tag.
+     *
+     * Injected by the digitizer block every N chunks in trace mode (see
+     * digitizer_block::set_trace_interval) and forwarded by all the blocks of this module. Each
+     * block the tag passes records a hop (see trace.h), the sinks publish the hop-by-hop latency
+     * breakdown.
+     */
+    char const * const trace_tag_name = "trace";
+
+    /*!
+     * \brief Interned trace tag key, see get_tag_kind.
+     */
+    inline const pmt::pmt_t &
+    trace_tag_key()
+    {
+      static const pmt::pmt_t key = pmt::intern(trace_tag_name);
+      return key;
+    }
+
+    struct DIGITIZERS_API trace_t
+    {
+      uint64_t id;               // trace identifier, see get_trace
+      int64_t timestamp;         // callback timestamp of the traced chunk (UTC nanoseconds)
+    };
+
+    inline gr::tag_t
+    make_trace_tag(const trace_t &trace, uint64_t offset)
+    {
+      gr::tag_t tag;
+      tag.key = trace_tag_key();
+      tag.value = pmt::cons(
+              pmt::from_uint64(trace.id),
+              pmt::from_uint64(static_cast<uint64_t>(trace.timestamp)));
+      tag.offset = offset;
+      return tag;
+    }
+
+    inline trace_t
+    decode_trace_tag(const gr::tag_t &tag)
+    {
+      assert(tag.key == trace_tag_key());
+
+      if (!pmt::is_pair(tag.value))
+      {
+          std::ostringstream message;
+          message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid trace tag format";
+          throw std::runtime_error(message.str());
+      }
+
+      trace_t trace;
+      trace.id = pmt::to_uint64(pmt::car(tag.value));
+      trace.timestamp = static_cast<int64_t>(pmt::to_uint64(pmt::cdr(tag.value)));
+      return trace;
+    }
+
+    // ################################################################################################################
+    // ################################################################################################################
+
+    enum tag_kind_t
+    {
+      TAG_KIND_UNKNOWN = 0,
+      TAG_KIND_ACQ_INFO,
+      TAG_KIND_TRIGGER,
+      TAG_KIND_TIMEBASE_INFO,
+      TAG_KIND_WR_EVENT,
+      TAG_KIND_CONSTANT_ERROR,
+      TAG_KIND_RAW_SCALING,
+      TAG_KIND_FREQ_AXIS,
+      TAG_KIND_REALIGNMENT,
+      TAG_KIND_TRACE,
+      TAG_KIND_CHANNEL_DELAY
+    };
+
+    /*!
+     * \brief Returns the kind of the tag.
+     *
+     * Keys are interned once (see *_tag_key), symbols are unique, hence the key is identified
+     * by pointer comparison instead of hashing the tag name for every tag.
+     */
+    inline tag_kind_t
+    get_tag_kind(const pmt::pmt_t &key)
+    {
+      if (key == acq_info_tag_key()) {
+        return TAG_KIND_ACQ_INFO;
+      }
+      else if (key == trigger_tag_key()) {
+        return TAG_KIND_TRIGGER;
+      }
+      else if (key == timebase_info_tag_key()) {
+        return TAG_KIND_TIMEBASE_INFO;
+      }
+      else if (key == wr_event_tag_key()) {
+        return TAG_KIND_WR_EVENT;
+      }
+      else if (key == constant_error_tag_key()) {
+        return TAG_KIND_CONSTANT_ERROR;
+      }
+      else if (key == raw_scaling_tag_key()) {
+        return TAG_KIND_RAW_SCALING;
+      }
+      else if (key == freq_axis_tag_key()) {
+        return TAG_KIND_FREQ_AXIS;
+      }
+      else if (key == realignment_tag_key()) {
+        return TAG_KIND_REALIGNMENT;
+      }
+      else if (key == trace_tag_key()) {
+        return TAG_KIND_TRACE;
+      }
+      else if (key == channel_delay_tag_key()) {
+        return TAG_KIND_CHANNEL_DELAY;
+      }
+
+      return TAG_KIND_UNKNOWN;
+    }
+
+    inline tag_kind_t
+    get_tag_kind(const gr::tag_t &tag)
+    {
+      return get_tag_kind(tag.key);
+    }
+
+    // ################################################################################################################
+    // ################################################################################################################
+
   } // namespace digitizers
 } // namespace gr
 
@@ -0,0 +1,87 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_THREAD_STATS_H
+#define INCLUDED_DIGITIZERS_THREAD_STATS_H
+
+#include <digitizers/api.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Scheduling of internal threads, see set_thread_config.
+     *
+     * \ingroup digitizers
+     */
+    struct DIGITIZERS_API thread_config_t
+    {
+      std::vector<int> cpus;      // CPU affinity, empty to keep the inherited one
+      int rt_priority;            // SCHED_FIFO priority, 0 to keep the default scheduling policy
+    };
+
+    /*!
+     * \brief An internal thread of this module (GNU Radio's block threads are not included).
+     *
+     * Threads are named owner:role, where the owner is the block alias if set (else e.g.
+     * digitizer_block(3)) and the role one of poller, readout, convert, fit, dispatch,
+     * archive-writer, accept, udp-send, udp-receive, rapid-block or publish. The poll thread of a
+     * device group is owned by the group (group-poller), the notification hub thread is
+     * notification_hub:delivery and the threads of cascade_sink::make_many are
+     * cascade_sink:design. The kernel name (as shown by top -H) is truncated to 15 characters,
+     * shortening the owner first.
+     *
+     * \ingroup digitizers
+     */
+    struct DIGITIZERS_API thread_stats_t
+    {
+      std::string name;           // owner:role
+      std::string owner;
+      std::string role;
+      int tid;                    // kernel thread id
+      int cpu;                    // CPU the thread last ran on, -1 if unknown
+      std::vector<int> cpus;      // configured affinity, empty if not configured
+      int rt_priority;            // configured SCHED_FIFO priority, 0 if not configured
+      bool scheduling_failed;     // the configured affinity or priority couldn't be applied
+      uint64_t cpu_time_ns;       // since the thread started
+      uint64_t voluntary_switches;
+      uint64_t involuntary_switches;
+    };
+
+    /*!
+     * \brief Configures the scheduling of the internal threads matching the key, either a
+     * thread name (owner:role) or a role applying to the threads of all the blocks. A name takes
+     * precedence over a role.
+     *
+     * The configuration applies to running threads and to threads started later, e.g. when the
+     * flowgraph is restarted. Block specific settings like digitizer_block::set_poller_scheduling
+     * are applied after and take precedence.
+     *
+     * \ingroup digitizers
+     */
+    DIGITIZERS_API void set_thread_config(const std::string &key, const thread_config_t &config);
+
+    /*!
+     * \brief Removes the configuration of the given key. Running threads keep their scheduling.
+     *
+     * \ingroup digitizers
+     */
+    DIGITIZERS_API void clear_thread_config(const std::string &key);
+
+    /*!
+     * \brief Returns the running internal threads, in the order they were started.
+     *
+     * \ingroup digitizers
+     */
+    DIGITIZERS_API std::vector<thread_stats_t> get_thread_stats();
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_THREAD_STATS_H */
@@ -33,6 +33,15 @@ namespace gr {
      *
      * On each incoming data package a callback is called which alows the host application to copy the data to its internal buffers
      *
+     * In trace mode (see digitizer_block::set_trace_interval) the hop-by-hop latency breakdown of
+     * each trace tag received is published on the "trace" message port, see trace.h.
+     *
+     * With raw input the sink takes the raw ADC counts of a digitizer in raw output mode
+     * (int16_t) directly, i.e. without a conversion block. The packages are converted to volts
+     * as delivered, using the raw_scaling tags. The errors input isn't available, the error
+     * estimate of the raw_scaling tags is used as constant error instead (see
+     * set_constant_error_expansion).
+     *
      * \ingroup digitizers
      */
     class DIGITIZERS_API time_domain_sink : virtual public gr::sync_block
@@ -53,10 +62,12 @@ namespace gr {
        * \param samp_rate expected sample rate in Hz
        * \param mode time sink mode which is mostly used by FESA to determine how to handle the sink
        * \param output_package_size output_package_size
+       * \param raw_input raw ADC counts (int16_t) are expected on the input
        *
        * \returns shared_ptr to a new instance
        */
-      static sptr make(std::string name, std::string unit, float samp_rate, time_sink_mode_t mode, size_t output_package_size);
+      static sptr make(std::string name, std::string unit, float samp_rate, time_sink_mode_t mode, size_t output_package_size,
+              bool raw_input=false);
 
       /*!
        * \brief Return a shared_ptr to a new instance of digitizers::time_domain_sink.
@@ -69,10 +80,12 @@ namespace gr {
        * \param mode time sink mode which is mostly used by FESA to determine how to handle the sink
        * \param pre_samples pre trigger samples
        * \param post_samples pre trigger samples
+       * \param raw_input raw ADC counts (int16_t) are expected on the input
        *
        * \returns shared_ptr to a new instance
        */
-      static sptr make(std::string name, std::string unit, float samp_rate, time_sink_mode_t mode, int pre_samples, int post_samples);
+      static sptr make(std::string name, std::string unit, float samp_rate, time_sink_mode_t mode, int pre_samples, int post_samples,
+              bool raw_input=false);
 
       /*!
        * \brief Get signal metadata, such as signal name, timebase and unit.
@@ -87,6 +100,168 @@ namespace gr {
        */
       virtual void set_callback(cb_copy_data_t cb_copy_data, void* userdata) = 0;
 
+      /*!
+       * \brief Registers a callback receiving several consecutive packages at once.
+       *
+       * Same data as passed to set_callback, but the packages processed by a work call are
+       * coalesced into batches of up to max_packages packages, each described by a
+       * package_descriptor_t, i.e. the per-callback overhead is amortised in case of short
+       * packages. A batch is delivered once it is full, at the end of the work call and, if
+       * max_latency is nonzero, as soon as the first package of the batch waited for max_latency
+       * seconds. Packages are therefore never held back for more data to arrive.
+       *
+       * The callback is invoked from the work function, also if the other callbacks are
+       * dispatched asynchronously (see set_async_dispatch).
+       *
+       * \param cb_batch callback receiving the batches, nullptr to disable
+       * \param max_packages maximum number of packages per batch, zero for all the packages of
+       * a work call
+       * \param max_latency maximum time in seconds a package waits for its batch to be
+       * delivered, zero for no limit other than the work call
+       */
+      virtual void set_batch_callback(cb_batch_t cb_batch, void* userdata, size_t max_packages=0,
+              double max_latency=0.0) = 0;
+
+      /*!
+       * \brief Registers a callback receiving the data packages by reference.
+       *
+       * Unlike with set_callback the data doesn't need to be copied before the callback returns.
+       * The callback receives a reference counted, immutable package the host application can
+       * keep for as long as needed and release from any thread. Package memory is pooled, hence
+       * there are no allocations in steady state as long as the packages are released.
+       *
+       * Both the callbacks can be registered at the same time.
+       *
+       * \param cb_package callback receiving the packages, nullptr to disable
+       * \param pool_size number of released packages kept for reuse
+       */
+      virtual void set_package_callback(cb_package_t cb_package, void* userdata, size_t pool_size=16) = 0;
+
+      /*!
+       * \brief Registers a callback receiving the packages as measurements, by reference.
+       *
+       * Same as set_package_callback except the tags are decoded by the sink: the package holds
+       * the values, the errors and the measurement info (timestamp of the first sample, trigger
+       * timestamp, status, delays and, in triggered mode, the pre- and post-trigger samples).
+       * No tags are copied and the client doesn't need to parse any. The samples lost are the
+       * samples of the packages dropped by the dispatcher since the previous measurement, see
+       * set_async_dispatch.
+       *
+       * \param cb_measurement callback receiving the measurements, nullptr to disable
+       * \param pool_size number of released measurements kept for reuse
+       */
+      virtual void set_measurement_callback(cb_measurement_t cb_measurement, void* userdata,
+              size_t pool_size=16) = 0;
+
+      /*!
+       * \brief Exports the packages to a shared memory ring for consumers in other processes.
+       *
+       * Each package is published to a slot, along with the decoded measurement info, directly
+       * from the work function. Consumers map the object and read the data in place, see
+       * shm_export_header_t for the layout and the protocol (futex notification). The object is
+       * created with the given name (see shm_open), replacing an existing one, and removed when
+       * the sink is destroyed or the export is disabled. Must be set before the flowgraph is
+       * started, throws std::runtime_error if the object can't be created.
+       *
+       * \param name shared memory object name, e.g. "/digitizer_ch1", empty to disable
+       * \param nslots number of packages held
+       */
+      virtual void set_shm_export(const std::string &name, size_t nslots=16) = 0;
+
+      /*!
+       * \brief Invokes the callbacks from a dedicated dispatch thread instead of the work function.
+       *
+       * Packages are queued (see set_package_callback for the memory handling), a slow callback
+       * therefore doesn't throttle the flowgraph unless the blocking policy is used. Must be
+       * set before the flowgraph is started.
+       *
+       * With the adaptive policy the sink degrades gracefully under sustained back-pressure: it
+       * delivers only every n-th package, n growing while the queue stays filled up and shrinking
+       * once the consumer catches up (see get_delivery_decimation). The packages skipped are
+       * counted as dropped and reported as samples_lost of the next measurement, the flowgraph
+       * and therefore the digitizer never lose data because of a slow consumer.
+       *
+       * \param policy dispatch policy, synchronous by default
+       * \param queue_size maximum number of queued packages
+       */
+      virtual void set_async_dispatch(dispatch_policy_t policy, size_t queue_size=16) = 0;
+
+      /*!
+       * \brief Number of packages dropped by the dispatcher because the queue was full or, with
+       * the adaptive policy, skipped.
+       */
+      virtual uint64_t get_dropped_count() = 0;
+
+      /*!
+       * \brief Current delivery decimation of the adaptive dispatch policy, 1 if every package
+       * is delivered.
+       */
+      virtual uint32_t get_delivery_decimation() = 0;
+
+      /*!
+       * \brief Enables expansion of constant errors.
+       *
+       * The errors input is optional. If it is not connected, the error estimate can be described
+       * by constant_error tags attached to the values stream (see tags.h). By default no errors are
+       * passed to the callback in that case (errors_size is 0). If expansion is enabled, per-sample
+       * errors are materialized from the last seen constant_error tag right before the callback is
+       * invoked. Packages starting before the first constant_error tag have no errors.
+       */
+      virtual void set_constant_error_expansion(bool enabled) = 0;
+
+      /*!
+       * \brief Reduces the packages delivered to the callbacks to min-max envelopes for display.
+       *
+       * Each package is split into buckets of get_display_bucket_size() consecutive samples (the
+       * last one might be shorter) and each bucket is delivered as four values: the first sample,
+       * the minimum, the maximum and the last sample (M4). The errors are the ones of the same
+       * samples. Drawn at one pixel column per bucket, the envelope renders the same line as the
+       * full package does.
+       *
+       * The offset, the tags and the measurement info still refer to the samples of the full
+       * package, e.g. the trigger is within bucket pre_trigger_samples / bucket size. The shm
+       * export is not reduced. Must be set before the flowgraph is started.
+       *
+       * \param max_points maximum number of values per package, 0 for the full packages (as
+       * well if buckets of more than four samples aren't needed)
+       */
+      virtual void set_display_reduction(size_t max_points) = 0;
+
+      /*!
+       * \brief Number of samples reduced to four values by the display reduction, 1 if the
+       * packages are delivered in full.
+       */
+      virtual size_t get_display_bucket_size() = 0;
+
+      /*!
+       * \brief Keeps the last triggered windows in memory for clients connecting late.
+       *
+       * Each window is kept in full (regardless of set_display_reduction) along with its
+       * measurement info, the buffers are pooled and reused once a window drops out of the
+       * history. Windows are kept whether or not a callback is registered, i.e. a client
+       * connecting or reconnecting can fetch the last windows or the ones it missed right away
+       * (see get_trigger_window and get_trigger_windows_since). Can be changed at any time, the
+       * newest windows are kept if the history shrinks. Throws std::invalid_argument if the
+       * sink is not in triggered mode.
+       *
+       * \param nwindows number of windows kept, zero disables the history (default)
+       */
+      virtual void set_trigger_history(size_t nwindows) = 0;
+
+      /*!
+       * \brief Returns the window of the given trigger, null if it isn't in the history.
+       *
+       * \param trigger_timestamp trigger timestamp of the window, see measurement_info_t
+       */
+      virtual measurement_package_sptr get_trigger_window(int64_t trigger_timestamp) = 0;
+
+      /*!
+       * \brief Returns the windows triggered after the given timestamp, oldest first.
+       *
+       * E.g. the windows missed since the last one received, -1 returns the whole history.
+       */
+      virtual std::vector<measurement_package_sptr> get_trigger_windows_since(int64_t trigger_timestamp) = 0;
+
       /*!
        * \brief Gets output package size
        * \returns output package size in samples
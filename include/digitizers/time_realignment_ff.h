@@ -20,6 +20,15 @@ namespace gr {
      * If there is no WR-Event to process, an error will be flagged in the status of the Trigger-Tag
      * If the time difference between trigger and WR-event is to big, an error will be flagged in the status of the Trigger-Tag
      *
+     * In streaming mode samples and trigger tags are forwarded immediately, i.e. latency doesn't
+     * depend on the timing system. Once the WR-Event of a forwarded trigger is received (or
+     * max_buffer_time expires) a realignment tag referencing the trigger offset is emitted on
+     * the values output, see realignment_t.
+     *
+     * In streaming mode channel_delay tags on the values input (see delay_estimator_ff) update
+     * the delay of the channel, it is subtracted from the timestamps of the realignment tags
+     * emitted afterwards.
+     *
      * \ingroup digitizers
      */
     class DIGITIZERS_API time_realignment_ff : virtual public gr::block
@@ -31,8 +40,10 @@ namespace gr {
        * \brief Return a shared_ptr to a new instance of digitizers::time_realignment_ff.
        *
        * \param user_delay user defined delay in seconds
+       * \param streaming forward samples immediately and emit realignment tags afterwards
        */
-      static sptr make(const std::string id, float user_delay=0.0f, float triggerstamp_matching_tolerance=0.03f, float max_buffer_time=0.3f);
+      static sptr make(const std::string id, float user_delay=0.0f, float triggerstamp_matching_tolerance=0.03f, float max_buffer_time=0.3f,
+              bool streaming=false);
 
       /*!
        * \brief Sets user delay.
@@ -49,6 +60,12 @@ namespace gr {
        */
       virtual float get_user_delay() = 0;
 
+      /*!
+       * \brief Gets the delay of the channel of the latest channel_delay tag (in seconds), zero
+       * if none was received.
+       */
+      virtual double get_channel_delay() = 0;
+
       /*!
        * \brief Sets maximum triggerstamp_matching_tolerance between WR-Tag(converted to UTC) and incoming Trigger Stamp at the scope (UTC)
        */
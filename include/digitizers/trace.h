@@ -0,0 +1,64 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_TRACE_H
+#define INCLUDED_DIGITIZERS_TRACE_H
+
+#include <digitizers/api.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief A block passed by a trace tag (see trace_tag_name).
+     *
+     * \ingroup digitizers
+     */
+    struct DIGITIZERS_API trace_hop_t
+    {
+      std::string block;         // block alias if set, else e.g. demux_ff(42)
+      int64_t timestamp;         // end of the work call processing the traced samples (UTC nanoseconds)
+    };
+
+    /*!
+     * \brief Hops of a trace, in the order they were recorded. If the flowgraph branches the
+     * hops of all the branches are recorded.
+     *
+     * The sinks publish traces as PMT dictionaries with the keys id, timestamp, latency_ns (of
+     * the last hop) and hops, a vector of dictionaries with the keys block, timestamp,
+     * latency_ns (since the chunk callback) and delta_ns (since the previous hop).
+     *
+     * \ingroup digitizers
+     */
+    struct DIGITIZERS_API trace_record_t
+    {
+      uint64_t id;
+      int64_t timestamp;         // callback timestamp of the traced chunk (UTC nanoseconds)
+      std::vector<trace_hop_t> hops;
+    };
+
+    /*!
+     * \brief Returns the hops recorded so far for the given trace. Only the most recent traces
+     * are kept, false is returned for unknown or expired traces.
+     *
+     * \ingroup digitizers
+     */
+    DIGITIZERS_API bool get_trace(uint64_t id, trace_record_t &record);
+
+    /*!
+     * \brief Returns the most recent traces, oldest first.
+     *
+     * \ingroup digitizers
+     */
+    DIGITIZERS_API std::vector<trace_record_t> get_recent_traces();
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_TRACE_H */
@@ -0,0 +1,64 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+
+#ifndef INCLUDED_DIGITIZERS_TRIGGER_AVERAGER_FF_H
+#define INCLUDED_DIGITIZERS_TRIGGER_AVERAGER_FF_H
+
+#include <digitizers/api.h>
+#include <gnuradio/block.h>
+
+namespace gr {
+  namespace digitizers {
+
+   /*!
+    * \brief Averages the data windows around the triggers (trigger-synchronous averaging).
+    *
+    * The windows are cut out as by demux_ff ([ pre-trigger window | post-trigger window ]) but
+    * accumulated sample by sample instead of being forwarded, i.e. the output carries a single
+    * averaged window per nr_windows triggers:
+    *  - alpha = 0: the plain mean of nr_windows windows is output, the accumulator is then
+    *    cleared
+    *  - alpha > 0: the exponentially weighted mean is output on every trigger, each window
+    *    having the weight alpha (the first window initializes the mean)
+    *
+    * The second output (optional) carries the standard deviation of the windows at each sample,
+    * for the plain mean the sample standard deviation (zero for a single window).
+    *
+    * Each averaged window carries the trigger tag of its last trigger on the trigger sample and
+    * an acq_info tag on its first sample, the acq_info of the last trigger with the status of
+    * all the averaged windows merged. Triggers without enough pre-trigger samples or exceeding
+    * the max number of pending windows are skipped, see get_skipped_triggers.
+    *
+    * \ingroup digitizers
+    */
+    class DIGITIZERS_API trigger_averager_ff : virtual public gr::block
+    {
+     public:
+      typedef boost::shared_ptr<trigger_averager_ff> sptr;
+
+      /*!
+       * \brief Return a shared_ptr to a new instance of digitizers::trigger_averager_ff.
+       *
+       * \param post_trigger_window Post-trigger samples, including the trigger sample
+       * \param pre_trigger_window Pre-trigger samples
+       * \param nr_windows Number of windows per output window, plain mean only
+       * \param alpha Weight of each window for the exponentially weighted mean, zero for the
+       * plain mean
+       */
+      static sptr make(unsigned post_trigger_window, unsigned pre_trigger_window=0,
+              int nr_windows=16, double alpha=0.0);
+
+      /*!
+       * \brief Returns the number of skipped triggers since start.
+       */
+      virtual uint64_t get_skipped_triggers() const = 0;
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_TRIGGER_AVERAGER_FF_H */
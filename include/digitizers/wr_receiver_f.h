@@ -19,6 +19,16 @@ namespace gr {
      * information about the timing event and adds the tag to output stream. Otherwise it behaves
      * exactly as a null source.
      *
+     * Events are handed over from the timing receiver thread through a bounded lock-free queue,
+     * i.e. add_timing_event never blocks. Events are also published on the "events" message port
+     * as (wr_event . value) pairs, value being encoded as in the wr_event tag. Events added while
+     * the flowgraph is not running are processed once it is started, the ones left when it stops
+     * are discarded.
+     *
+     * If event_stream is true the block doesn't behave as a null source, instead exactly one
+     * (zero) sample is produced for each event, tagged with the event. No samples are produced
+     * while there are no events.
+     *
      * \ingroup digitizers
      *
      */
@@ -34,8 +44,12 @@ namespace gr {
        * constructor is in a private implementation
        * class. digitizers::wr_receiver_f::make is the public interface for
        * creating new instances.
+       *
+       * \param event_stream produce one sample per event instead of a continuous zero stream
+       * \param queue_size max number of events waiting to be processed, further events are dropped,
+       * 1 to 65534 (std::invalid_argument is thrown otherwise)
        */
-      static sptr make();
+      static sptr make(bool event_stream=false, int queue_size=1024);
 
       /*!
        * \brief Add information about the timing event.
@@ -45,6 +59,17 @@ namespace gr {
        * \param wr_trigger_stamp_utc event timestamp UTC
        */
       virtual bool add_timing_event(const std::string &event_id, int64_t wr_trigger_stamp, int64_t wr_trigger_stamp_utc) = 0;
+
+      /*!
+       * \brief Number of events dropped because the queue was full.
+       */
+      virtual uint64_t get_dropped_events() const = 0;
+
+      /*!
+       * \brief Max number of events waiting in the queue (high watermark), measured as events
+       * are added. Reaching queue_size means events might have been dropped.
+       */
+      virtual uint64_t get_max_queued_events() const = 0;
     };
 
   } // namespace digitizers
@@ -0,0 +1,276 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gnuradio/io_signature.h>
+#include "aggregated_source_impl.h"
+#include "utils.h"
+#include <digitizers/tags.h>
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
+namespace gr {
+  namespace digitizers {
+
+    aggregated_source::sptr
+    aggregated_source::make(int nchannels, downsampling_mode_t mode, int factor, int max_queued_items)
+    {
+      return gnuradio::get_initial_sptr
+        (new aggregated_source_impl(nchannels, mode, factor, max_queued_items));
+    }
+
+    /*
+     * The private constructor
+     */
+    aggregated_source_impl::aggregated_source_impl(int nchannels, downsampling_mode_t mode,
+            int factor, int max_queued_items)
+      : gr::sync_block("aggregated_source",
+              gr::io_signature::make(0, 0, 0),
+              gr::io_signature::make(2 * nchannels, 2 * nchannels, sizeof(float))),
+        d_nchannels(nchannels),
+        d_mode(mode),
+        d_factor(factor),
+        d_max_queued_items(max_queued_items),
+        d_windows(nchannels),
+        d_window_fill(0),
+        d_window_start(0),
+        d_window_start_valid(false),
+        d_values(nchannels),
+        d_errors(nchannels),
+        d_tags(nchannels),
+        d_next_output(0),
+        d_dropped(0),
+        d_timebase(0.0),
+        d_timebase_published(false),
+        d_finished(false)
+    {
+      if (nchannels < 1 || factor < 2 || max_queued_items < 1
+              || mode == downsampling_mode_t::DOWNSAMPLING_MODE_NONE) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid number of channels ("
+                << nchannels << "), aggregation mode (" << mode << "), factor (" << factor
+                << ") or queue size (" << max_queued_items << ")";
+        throw std::invalid_argument(message.str());
+      }
+    }
+
+    aggregated_source_impl::~aggregated_source_impl()
+    {
+    }
+
+    uint64_t
+    aggregated_source_impl::get_dropped_items() const
+    {
+      boost::mutex::scoped_lock lock(d_mutex);
+      return d_dropped;
+    }
+
+    void
+    aggregated_source_impl::reset(double timebase)
+    {
+      boost::mutex::scoped_lock lock(d_mutex);
+      d_window_fill = 0;
+      d_window_start_valid = false;
+      d_timebase = timebase * d_factor;
+      d_timebase_published = false;
+    }
+
+    void
+    aggregated_source_impl::finish()
+    {
+      {
+        boost::mutex::scoped_lock lock(d_mutex);
+        d_finished = true;
+      }
+      d_cv.notify_one();
+    }
+
+    bool
+    aggregated_source_impl::start()
+    {
+      boost::mutex::scoped_lock lock(d_mutex);
+
+      for (int c = 0; c < d_nchannels; c++) {
+        d_values[c].clear();
+        d_errors[c].clear();
+        d_tags[c].clear();
+      }
+
+      d_next_output = 0;
+      d_dropped = 0;
+      d_timebase_published = false;
+      d_finished = false;
+
+      return true;
+    }
+
+    void
+    aggregated_source_impl::aggregate(int channel, const float *values, const float *errors,
+            int nsamples, std::vector<float> &out_values, std::vector<float> &out_errors)
+    {
+      auto &window = d_windows[channel];
+      int fill = d_window_fill;
+
+      for (int i = 0; i < nsamples; i++) {
+        const float value = values[i];
+        const float error = errors[i];
+
+        if (fill == 0) {
+          window.min = window.max = window.first_value = value;
+          window.first_error = error;
+          window.sum = value;
+          window.error_sum = error;
+        }
+        else {
+          window.min = std::min(window.min, value);
+          window.max = std::max(window.max, value);
+          window.sum += value;
+          window.error_sum += error;
+        }
+
+        if (++fill < d_factor) {
+          continue;
+        }
+
+        // Same as the devices, see picoscope_impl::convert_channel
+        if (d_mode == downsampling_mode_t::DOWNSAMPLING_MODE_MIN_MAX_AGG) {
+          out_values.push_back((window.max + window.min) / 2.0f);
+          out_errors.push_back((window.max - window.min) / 4.0f);
+        }
+        else if (d_mode == downsampling_mode_t::DOWNSAMPLING_MODE_AVERAGE) {
+          out_values.push_back(static_cast<float>(window.sum / d_factor));
+          out_errors.push_back(static_cast<float>(window.error_sum / d_factor / std::sqrt(static_cast<double>(d_factor))));
+        }
+        else {
+          out_values.push_back(window.first_value);
+          out_errors.push_back(window.first_error);
+        }
+
+        fill = 0;
+      }
+    }
+
+    void
+    aggregated_source_impl::push(const std::vector<float *> &values, const std::vector<float *> &errors,
+            int nsamples, uint64_t first_sample, std::vector<std::vector<gr::tag_t>> &tags)
+    {
+      {
+        boost::mutex::scoped_lock lock(d_mutex);
+
+        if (!d_window_start_valid) {
+          d_window_start = first_sample;
+          d_window_start_valid = true;
+        }
+
+        const int completed = (d_window_fill + nsamples) / d_factor;
+        const bool drop = d_values[0].size() + completed > d_max_queued_items;
+
+        for (int c = 0; c < d_nchannels; c++) {
+          d_tmp_values.clear();
+          d_tmp_errors.clear();
+
+          if (values[c] != nullptr) {
+            aggregate(c, values[c], errors[c], nsamples, d_tmp_values, d_tmp_errors);
+          }
+          else {
+            d_tmp_values.assign(completed, 0.0f);
+            d_tmp_errors.assign(completed, 0.0f);
+          }
+
+          if (!drop) {
+            d_values[c].insert(d_values[c].end(), d_tmp_values.begin(), d_tmp_values.end());
+            d_errors[c].insert(d_errors[c].end(), d_tmp_errors.begin(), d_tmp_errors.end());
+          }
+
+          // Tags of the dropped items go along with the next queued item
+          decimate_tags(tags[c], d_window_start, d_next_output, d_factor,
+                  [this, c, drop](const gr::tag_t &tag) {
+            const auto offset = drop ? d_next_output : tag.offset;
+            const auto kind = get_tag_kind(tag);
+            if (kind == TAG_KIND_ACQ_INFO) {
+              auto acq_info = decode_acq_info_tag(tag);
+              acq_info.timebase = d_timebase;
+              d_tags[c].push_back(make_acq_info_tag(acq_info, offset));
+            }
+            else if (kind == TAG_KIND_TRIGGER) {
+              auto trigger = decode_trigger_tag(tag);
+              trigger.downsampling_factor *= d_factor;
+              d_tags[c].push_back(make_trigger_tag(trigger, offset));
+            }
+            else {
+              d_tags[c].push_back(tag);
+              d_tags[c].back().offset = offset;
+            }
+          });
+        }
+
+        d_window_start += static_cast<uint64_t>(completed) * d_factor;
+        d_window_fill = (d_window_fill + nsamples) % d_factor;
+
+        if (drop) {
+          d_dropped += completed;
+        }
+        else {
+          d_next_output += completed;
+        }
+      }
+
+      d_cv.notify_one();
+    }
+
+    int
+    aggregated_source_impl::work(int noutput_items,
+        gr_vector_const_void_star &input_items,
+        gr_vector_void_star &output_items)
+    {
+      block_stats_scope_t stats(d_stats);
+
+      // boost wait is an interruption point, allowing the GR scheduler to stop the thread
+      boost::unique_lock<boost::mutex> lock(d_mutex);
+      d_cv.wait(lock, [this] { return !d_values[0].empty() || d_finished; });
+
+      if (d_values[0].empty()) {
+        return -1; // stop
+      }
+
+      const int n = std::min(static_cast<size_t>(noutput_items), d_values[0].size());
+      const auto offset = nitems_written(0);
+
+      for (int c = 0; c < d_nchannels; c++) {
+        std::copy(d_values[c].begin(), d_values[c].begin() + n, static_cast<float *>(output_items[2 * c]));
+        std::copy(d_errors[c].begin(), d_errors[c].begin() + n, static_cast<float *>(output_items[2 * c + 1]));
+        d_values[c].erase(d_values[c].begin(), d_values[c].begin() + n);
+        d_errors[c].erase(d_errors[c].begin(), d_errors[c].begin() + n);
+
+        auto &tags = d_tags[c];
+        auto end = std::find_if(tags.begin(), tags.end(),
+                [offset, n](const gr::tag_t &tag) { return tag.offset >= offset + n; });
+        for (auto it = tags.begin(); it != end; ++it) {
+          add_item_tag(2 * c, *it);
+        }
+        tags.erase(tags.begin(), end);
+      }
+
+      if (!d_timebase_published && d_timebase > 0.0) {
+        auto timebase_tag = make_timebase_info_tag(d_timebase);
+        timebase_tag.offset = offset;
+        for (gr_vector_void_star::size_type i = 0; i < output_items.size(); i++) {
+          add_item_tag(i, timebase_tag);
+        }
+        d_timebase_published = true;
+      }
+
+      return n;
+    }
+
+  } /* namespace digitizers */
+} /* namespace gr */
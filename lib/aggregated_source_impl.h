@@ -0,0 +1,110 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_AGGREGATED_SOURCE_IMPL_H
+#define INCLUDED_DIGITIZERS_AGGREGATED_SOURCE_IMPL_H
+
+#include <digitizers/aggregated_source.h>
+#include "block_stats_impl.h"
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <vector>
+
+namespace gr {
+  namespace digitizers {
+
+    class aggregated_source_impl : public aggregated_source
+    {
+     public:
+      aggregated_source_impl(int nchannels, downsampling_mode_t mode, int factor, int max_queued_items);
+
+      ~aggregated_source_impl();
+
+      int nchannels() const override { return d_nchannels; }
+
+      downsampling_mode_t get_mode() const override { return d_mode; }
+
+      int get_factor() const override { return d_factor; }
+
+      uint64_t get_dropped_items() const override;
+
+      /*!
+       * \brief Restarts the aggregation windows, called by the digitizer on arm. Timebase is the
+       * distance between the pushed samples in seconds.
+       */
+      void reset(double timebase);
+
+      /*!
+       * \brief Aggregates nsamples samples of each channel and queues the completed items, the
+       * last window is completed by the next push. Null pointers stand for disabled channels.
+       *
+       * \param first_sample digitizer output offset of the first sample
+       * \param tags acq_info and trigger tags of each channel, digitizer output offsets
+       */
+      void push(const std::vector<float *> &values, const std::vector<float *> &errors,
+              int nsamples, uint64_t first_sample, std::vector<std::vector<gr::tag_t>> &tags);
+
+      /*!
+       * \brief Work returns WORK_DONE once the queued items are delivered, called by the digitizer
+       * when it stops.
+       */
+      void finish();
+
+      bool start() override;
+
+      int work(int noutput_items,
+          gr_vector_const_void_star &input_items,
+          gr_vector_void_star &output_items) override;
+
+     private:
+      // Partial aggregation window of a channel
+      struct window_t
+      {
+        float min;
+        float max;
+        double sum;
+        double error_sum;
+        float first_value;
+        float first_error;
+      };
+
+      void aggregate(int channel, const float *values, const float *errors, int nsamples,
+              std::vector<float> &out_values, std::vector<float> &out_errors);
+
+      const int d_nchannels;
+      const downsampling_mode_t d_mode;
+      const int d_factor;
+      const size_t d_max_queued_items;
+
+      mutable boost::mutex d_mutex;
+      boost::condition_variable d_cv;
+
+      // Aggregation state, used by the pushing (digitizer work) thread only
+      std::vector<window_t> d_windows;
+      int d_window_fill;             // samples in the current window, same for all the channels
+      uint64_t d_window_start;       // digitizer offset of the first sample of the current window
+      bool d_window_start_valid;
+      std::vector<float> d_tmp_values;
+      std::vector<float> d_tmp_errors;
+
+      // Queued items and tags per channel, tag offsets in output items
+      std::vector<std::vector<float>> d_values;
+      std::vector<std::vector<float>> d_errors;
+      std::vector<std::vector<gr::tag_t>> d_tags;
+      uint64_t d_next_output;        // output offset of the next queued item
+      uint64_t d_dropped;
+      double d_timebase;
+      bool d_timebase_published;
+      bool d_finished;
+
+      block_stats_recorder_t d_stats {this};
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_AGGREGATED_SOURCE_IMPL_H */
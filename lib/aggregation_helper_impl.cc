@@ -58,6 +58,7 @@ namespace gr {
         gr_vector_const_void_star &input_items,
         gr_vector_void_star &output_items)
     {
+      block_stats_scope_t stats(d_stats);
       const float *a = (const float *) input_items[0];
       const float *b = (const float *) input_items[1];
       const float *c = (const float *) input_items[2];
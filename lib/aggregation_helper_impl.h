@@ -8,6 +8,7 @@
 #define INCLUDED_DIGITIZERS_AGGREGATION_HELPER_IMPL_H
 
 #include <digitizers/aggregation_helper.h>
+#include "block_stats_impl.h"
 
 namespace gr {
   namespace digitizers {
@@ -19,6 +20,8 @@ namespace gr {
       int d_count;
       int d_decimation;
 
+      block_stats_recorder_t d_stats {this};
+
      public:
       aggregation_helper_impl(int decim, float sigma_mult);
       ~aggregation_helper_impl();
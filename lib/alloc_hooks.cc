@@ -0,0 +1,88 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+/*
+ * Replaces the global operator new of the executable linking this file (the test and benchmark
+ * binaries, not the module) in order to count the heap allocations per thread, see
+ * thread_allocation_count. The replacement applies to the module and GNU Radio as well, i.e. the
+ * allocations of the pmt library, boost and the standard containers are all counted. Direct
+ * calls to malloc (e.g. volk_malloc) are not.
+ */
+
+#include <digitizers/block_stats.h>
+
+#include <cstdlib>
+#include <new>
+
+void *
+operator new(std::size_t size)
+{
+  gr::digitizers::thread_allocation_count()++;
+
+  if (size == 0) {
+    size = 1;
+  }
+
+  for (;;) {
+    void *ptr = std::malloc(size);
+    if (ptr) {
+      return ptr;
+    }
+
+    auto handler = std::get_new_handler();
+    if (!handler) {
+      throw std::bad_alloc();
+    }
+    handler();
+  }
+}
+
+void *
+operator new[](std::size_t size)
+{
+  return ::operator new(size);
+}
+
+void *
+operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+  try {
+    return ::operator new(size);
+  }
+  catch (const std::bad_alloc &) {
+    return nullptr;
+  }
+}
+
+void *
+operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+  return ::operator new(size, std::nothrow);
+}
+
+void
+operator delete(void *ptr) noexcept
+{
+  std::free(ptr);
+}
+
+void
+operator delete[](void *ptr) noexcept
+{
+  std::free(ptr);
+}
+
+void
+operator delete(void *ptr, const std::nothrow_t &) noexcept
+{
+  std::free(ptr);
+}
+
+void
+operator delete[](void *ptr, const std::nothrow_t &) noexcept
+{
+  std::free(ptr);
+}
@@ -36,6 +36,7 @@ namespace gr {
         gr_vector_const_void_star &input_items,
         gr_vector_void_star &output_items)
     {
+      block_stats_scope_t stats(d_stats);
       const gr_complex *inSig = (const gr_complex *) input_items[0];
       const gr_complex *inRef = (const gr_complex *) input_items[1];
       gr_complex *out = (gr_complex *) output_items[0];
@@ -8,6 +8,7 @@
 #define INCLUDED_DIGITIZERS_AMPLITUDE_AND_PHASE_HELPER_IMPL_H
 
 #include <digitizers/amplitude_and_phase_helper.h>
+#include "block_stats_impl.h"
 
 namespace gr {
   namespace digitizers {
@@ -18,6 +19,8 @@ namespace gr {
      */
     class amplitude_and_phase_helper_impl : public amplitude_and_phase_helper
     {
+      block_stats_recorder_t d_stats {this};
+
      public:
       amplitude_and_phase_helper_impl();
       ~amplitude_and_phase_helper_impl();
@@ -42,18 +42,23 @@ namespace gr {
         gr_vector_const_void_star &input_items,
         gr_vector_void_star &output_items)
     {
+      block_stats_scope_t stats(d_stats);
       const float *am_i = (const float *) input_items[0];
       const float *ph_i = (const float *) input_items[1];
       const float *fq_ref = (const float *) input_items[2];
       float *am_o = (float *) output_items[0];
       float *ph_o = (float *) output_items[1];
+      const float ampl = d_ampl;
+      const float phi = d_phi;
+      const float phi_fq_factor = d_phi_fq_factor;
+
       for(int i = 0; i < noutput_items; i++) {
-        am_o[i] = am_i[i] * d_ampl;
-        double new_phase = (ph_i[i]- (d_phi + d_phi_fq_factor * fq_ref[i]));
+        am_o[i] = am_i[i] * ampl;
+        float new_phase = ph_i[i] - (phi + phi_fq_factor * fq_ref[i]);
 
         //fix from -180 -> 180 deg.
-        if(new_phase<-180.0) { new_phase = 360.0 + new_phase;}
-        else if(new_phase > 180.0) { new_phase = -360.0 - new_phase; }
+        new_phase = new_phase < -180.0f ? new_phase + 360.0f : new_phase;
+        new_phase = new_phase > 180.0f ? new_phase - 360.0f : new_phase;
         ph_o[i] = new_phase;
       }
 
@@ -8,6 +8,7 @@
 #define INCLUDED_DIGITIZERS_AMPLITUDE_PHASE_ADJUSTER_IMPL_H
 
 #include <digitizers/amplitude_phase_adjuster.h>
+#include "block_stats_impl.h"
 
 namespace gr {
   namespace digitizers {
@@ -19,6 +20,8 @@ namespace gr {
       double d_phi;
       double d_phi_fq_factor;
 
+      block_stats_recorder_t d_stats {this};
+
      public:
       amplitude_phase_adjuster_impl(double ampl_usr, double phi_usr, double phi_fq_usr);
       ~amplitude_phase_adjuster_impl();
@@ -8,11 +8,18 @@
 #define INCLUDED_DIGITIZERS_APP_BUFFER_H
 
 #include <boost/thread/mutex.hpp>
-#include <boost/smart_ptr/shared_ptr.hpp>
-#include <boost/smart_ptr/make_shared.hpp>
 #include <boost/lockfree/spsc_queue.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/thread.hpp>
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
 #include <system_error>
 
+#include "chunk_memory.h"
+#include "probes.h"
+
 namespace gr {
   namespace digitizers {
 
@@ -20,26 +27,52 @@ namespace gr {
      * \brief A helper class holding application buffer. An application buffer consists of a number
      * of small buffers (data chunks). This class takes care of managing the free data chunk poll.
      *
+     * Full chunks go to the work thread and, if any are registered, to side consumers (see
+     * add_consumer) which read the same memory in place. A chunk returns to the free pool once
+     * the last of them releases it.
+     *
      * Details are given in the form of inline comments below.
      */
     class app_buffer_t
     {
      public:
 
-      static const unsigned MAX_NR_BUFFERS = 8192;
-
       app_buffer_t()
-        : d_free_data_chunks(MAX_NR_BUFFERS),
-          d_data_chunks(MAX_NR_BUFFERS),
+        : d_segments(),
+          d_chunks(),
+          d_spare_chunks(),
+          d_huge_pages(false),
+          d_numa_node(-1),
+          d_lock_memory(false),
+          d_locked_bytes(0),
+          d_free_data_chunks(),
+          d_data_chunks(),
           d_nr_channels(0),
           d_nr_ports(0),
           d_chunk_size_bytes(0),
+          d_channel_sample_size(0),
           d_chunk_size(0),
           d_nr_chunks(0),
+          d_max_nr_chunks(0),
+          d_growth_step(0),
+          d_nr_allocated_chunks(0),
+          d_nr_chunks_in_use(0),
+          d_nr_full_chunks(0),
+          d_high_water_mark(0),
+          d_min_free_chunks(0),
+          d_priority_reserve(0),
+          d_nr_shed_chunks(0),
+          d_spin_iterations(0),
+          d_yield_iterations(0),
+          d_consumer_parked(false),
+          d_data_rdy_errc_set(false),
           d_data_rdy_errc()
       {
       }
 
+      // Each data chunk starts on a cache line boundary
+      static const size_t CHUNK_ALIGNMENT = 64;
+
       /*!
        * \brief A data structure holding data of all ENABLED (and only enabled) analog & digital
        * channels/ports.
@@ -52,103 +85,495 @@ namespace gr {
        *  <port 1 values>
        *  <port 2 values>
        *  ...
+       *
+       * Note, the size of the analog channel regions depends on the channel sample size passed to
+       * the initialize method. By default values and errors are floats, but drivers are free to
+       * store e.g. raw ADC counts and convert them later on (see zero-copy mode).
        */
       struct data_chunk_t {
         data_chunk_t() = delete;
 
-        data_chunk_t(size_t mem_size_bytes)
-            : d_data(mem_size_bytes),
+        data_chunk_t(uint8_t *data, size_t mem_size_bytes)
+            : d_data(data),
+              d_size(mem_size_bytes),
               d_status(),
               d_local_timestamp(0),
-              d_lost_count(0)
+              d_trigger_offset(0.0),
+              d_lost_count(0),
+              d_refs(0)
         { }
 
-        std::vector<uint8_t> d_data;
+        uint8_t *d_data;                 // points into the application buffer memory slab
+        size_t d_size;                   // size of the data chunk in bytes
         std::vector<uint32_t> d_status;  // see channel_status_t enum definition
         uint64_t d_local_timestamp;       // UTC nanoseconds
+        double d_trigger_offset;         // hardware trigger time offset (rapid block readout only)
         int d_lost_count;                // number of buffers lost
+        std::atomic<int> d_refs;         // work thread plus side consumers yet to release it
       };
 
      private:
 
-      using data_chunk_sptr = boost::shared_ptr<data_chunk_t>;
+      // Data chunks are carved out of contiguous memory regions (segments). Initially there is
+      // only one segment, additional segments are added if the pool grows.
+      std::vector<std::unique_ptr<chunk_memory_t>> d_segments;
+      std::deque<data_chunk_t> d_chunks;   // deque, pointers must remain valid on growth
+
+      // Chunks of a newly allocated segment, owned by the producer until handed out
+      std::vector<data_chunk_t *> d_spare_chunks;
+
+      // Memory policy applied on initialize
+      bool d_huge_pages;
+      int d_numa_node;
+      bool d_lock_memory;
+      std::atomic<size_t> d_locked_bytes;   // of all the segments, grown ones included
+
+      // For simplify we use circular buffers for managing free pool of data chunks. The queues
+      // are sized for the maximum number of chunks.
+      using chunk_queue_t = boost::lockfree::spsc_queue<data_chunk_t *>;
+      std::unique_ptr<chunk_queue_t> d_free_data_chunks;
+      std::unique_ptr<chunk_queue_t> d_data_chunks;
+
+      // Side consumers, each one has its own queue of full chunks. A queue holds at most
+      // max_lag chunks, chunks not fitting are skipped for that consumer.
+      struct consumer_t
+      {
+        size_t max_lag;
+        std::unique_ptr<chunk_queue_t> queue;
+        std::atomic<uint64_t> skipped;
+      };
 
-      // To avoid manual memory management
-      std::vector<data_chunk_sptr> d_chunks;
+      std::vector<std::unique_ptr<consumer_t>> d_consumers;
 
-      // For simplify we use circular buffers for managing free pool of data chunks
-      boost::lockfree::spsc_queue<data_chunk_t *> d_free_data_chunks;
-      boost::lockfree::spsc_queue<data_chunk_t *> d_data_chunks;
+      // With side consumers chunks are returned to the free pool by any of the consumer threads,
+      // the lock serializes the pushes into the single-producer queue
+      boost::mutex d_free_mutex;
 
       // Static buffer configuration
       int d_nr_channels;       // number of enabled analog channels
       int d_nr_ports;          // number of enabled digital ports
       int d_chunk_size_bytes;   // size of data chunk in bytes
+      size_t d_channel_sample_size; // bytes per sample of an analog channel (values & errors)
 
       size_t d_chunk_size;     // number of samples per data chunk (or buffer)
-      size_t d_nr_chunks;      // number of data chunks the application buffer support
+      size_t d_nr_chunks;      // initial number of data chunks
+      size_t d_max_nr_chunks;  // the pool is allowed to grow up to this number of data chunks
+      size_t d_growth_step;    // number of chunks added at once
+
+      // Statistics, safe to be read from any thread
+      std::atomic<size_t> d_nr_allocated_chunks;
+      std::atomic<size_t> d_nr_chunks_in_use;   // held by the producer or waiting for the consumer
+      std::atomic<size_t> d_nr_full_chunks;     // waiting for the consumer
+      std::atomic<size_t> d_high_water_mark;    // max number of chunks in use
+      std::atomic<size_t> d_min_free_chunks;    // min number of free chunks since last reset
+
+      // Chunks (out of the maximum) left to priority requests, see set_priority_reserve
+      size_t d_priority_reserve;
+      std::atomic<uint64_t> d_nr_shed_chunks;   // requests refused since initialize
+
+      // Wait strategy, number of busy-wait and yield iterations before the consumer is parked
+      int d_spin_iterations;
+      int d_yield_iterations;
 
       // Mutex is used only in combination with the conditional variable
       boost::mutex d_mutex;
       boost::condition_variable d_data_rdy_cv;
 
-      // For communicating errors to worker function
+      // The producer notifies the conditional variable only if the consumer is parked
+      std::atomic<bool> d_consumer_parked;
+
+      // For communicating errors to worker function, the flag allows the consumer to check for
+      // errors without taking the mutex
+      std::atomic<bool> d_data_rdy_errc_set;
       std::error_code d_data_rdy_errc;
 
-     public:
+      static inline void cpu_relax()
+      {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+      }
+
+      std::error_code get_data_rdy_errc()
+      {
+        if (!d_data_rdy_errc_set.load(std::memory_order_acquire)) {
+          return std::error_code {};
+        }
+
+        boost::mutex::scoped_lock guard(d_mutex);
+        return d_data_rdy_errc;
+      }
 
       /*!
-       * \brief Initialize application buffer.
+       * \brief Allocates a new memory segment holding the given number of chunks. Chunks are
+       * placed into the spare list.
        */
-      void initialize(int nr_enabled_channels, int nr_enabled_ports, size_t chunk_size, size_t nr_chunks)
+      void allocate_segment(size_t nr_chunks)
       {
-        // in order to use lock-free containers we need to use static-sized data structures
-        if (nr_chunks > MAX_NR_BUFFERS) {
-          nr_chunks = MAX_NR_BUFFERS;
+        if (nr_chunks == 0) {
+          return;
         }
 
+        // Each chunk starts on a cache line boundary
+        const auto chunk_stride = chunk_memory_t::round_up(d_chunk_size_bytes, CHUNK_ALIGNMENT);
+
+        std::unique_ptr<chunk_memory_t> segment(new chunk_memory_t());
+        segment->allocate(chunk_stride * nr_chunks, d_huge_pages, d_numa_node, d_lock_memory);
+        if (segment->is_locked()) {
+          d_locked_bytes.fetch_add(segment->size(), std::memory_order_relaxed);
+        }
+
+        for (size_t i = 0; i < nr_chunks; i++) {
+          d_chunks.emplace_back(segment->data() + i * chunk_stride, d_chunk_size_bytes);
+          d_spare_chunks.push_back(&d_chunks.back());
+        }
+
+        d_segments.push_back(std::move(segment));
+        d_nr_allocated_chunks += nr_chunks;
+      }
+
+     public:
+
+      /*!
+       * \brief Initialize application buffer.
+       *
+       * \param channel_sample_size number of bytes a single analog sample occupies, that is value
+       * and error estimate (or whatever the driver decides to store in the channel region).
+       * \param max_nr_chunks the pool grows on demand (if no free chunk is available) up to this
+       * number of chunks. Zero or a value below nr_chunks disables growth.
+       */
+      void initialize(int nr_enabled_channels, int nr_enabled_ports, size_t chunk_size, size_t nr_chunks,
+              size_t channel_sample_size = 2 * sizeof(float), size_t max_nr_chunks = 0)
+      {
         boost::mutex::scoped_lock lock(d_mutex);
 
         d_nr_channels = nr_enabled_channels;
         d_nr_ports = nr_enabled_ports;
         d_chunk_size = chunk_size;
         d_nr_chunks = nr_chunks;
+        d_max_nr_chunks = std::max(nr_chunks, max_nr_chunks);
+        d_growth_step = std::max(size_t(1), nr_chunks / 4);
+        d_channel_sample_size = channel_sample_size;
 
-        d_chunk_size_bytes = (d_nr_ports * d_chunk_size)              // digital data
-                + (d_nr_channels * d_chunk_size * sizeof(float) * 2); // analog data
+        d_chunk_size_bytes = (d_nr_ports * d_chunk_size)                   // digital data
+                + (d_nr_channels * d_chunk_size * d_channel_sample_size);  // analog data
 
         // To support re-initialization, delete all data chunks
         d_chunks.clear();
-        d_data_chunks.reset();
-        d_free_data_chunks.reset();
+        d_spare_chunks.clear();
+        d_segments.clear();
+        d_locked_bytes = 0;
+
+        // Lock-free containers are static-sized, so they are sized for the maximum
+        d_free_data_chunks.reset(new chunk_queue_t(d_max_nr_chunks));
+        d_data_chunks.reset(new chunk_queue_t(d_max_nr_chunks));
+
+        d_nr_allocated_chunks = 0;
+        d_nr_chunks_in_use = 0;
+        d_nr_full_chunks = 0;
+        d_high_water_mark = 0;
+        d_nr_shed_chunks = 0;
+
+        // Chunks still queued for side consumers are dropped along with the memory
+        for (auto &consumer : d_consumers) {
+          consumer->queue.reset(new chunk_queue_t(consumer->max_lag ? consumer->max_lag : d_max_nr_chunks));
+          consumer->skipped = 0;
+        }
 
-        // Make individual chunks (or buffers)
-        for (size_t i = 0; i < d_nr_chunks; i++) {
-          auto sptr = boost::make_shared<data_chunk_t>(d_chunk_size_bytes);
-          d_chunks.push_back(sptr);
-          d_free_data_chunks.push(sptr.get());
+        allocate_segment(d_nr_chunks);
+        d_min_free_chunks = d_nr_chunks;
+
+        for (auto chunk : d_spare_chunks) {
+          d_free_data_chunks->push(chunk);
         }
+        d_spare_chunks.clear();
 
         // Reset error code...
         d_data_rdy_errc = std::error_code {};
+        d_data_rdy_errc_set.store(false, std::memory_order_release);
+      }
+
+      /*!
+       * \brief Number of data chunks currently allocated (initial plus grown).
+       */
+      size_t get_nr_allocated_chunks() const
+      {
+        return d_nr_allocated_chunks.load(std::memory_order_relaxed);
+      }
+
+      /*!
+       * \brief The maximum number of chunks being in use (held by the producer or waiting for the
+       * consumer) since initialize.
+       */
+      size_t get_high_water_mark() const
+      {
+        return d_high_water_mark.load(std::memory_order_relaxed);
+      }
+
+      size_t get_nr_free_chunks() const
+      {
+        return d_nr_allocated_chunks.load(std::memory_order_relaxed)
+                - d_nr_chunks_in_use.load(std::memory_order_relaxed);
+      }
+
+      size_t get_nr_full_chunks() const
+      {
+        return d_nr_full_chunks.load(std::memory_order_relaxed);
+      }
+
+      /*!
+       * \brief Returns the minimum number of free chunks observed since the last call (or
+       * initialize) and starts a new observation window.
+       */
+      size_t take_min_free_chunks()
+      {
+        return d_min_free_chunks.exchange(get_nr_free_chunks(), std::memory_order_relaxed);
+      }
+
+      size_t get_chunk_size_bytes() const
+      {
+        return d_chunk_size_bytes;
+      }
+
+      /*!
+       * \brief Reserves the last nr_chunks of the pool (out of the maximum number of chunks, i.e.
+       * counting the growth headroom) for priority data, e.g. chunks holding a trigger. Once no
+       * more than nr_chunks are left, get_free_data_chunk serves priority requests only. Under
+       * overload the other chunks are therefore shed first (see get_nr_shed_chunks) while chunks
+       * holding triggers survive transient overloads. Zero (default) disables the reserve.
+       *
+       * This method is meant to be called by the producer or before it is started.
+       */
+      void set_priority_reserve(size_t nr_chunks)
+      {
+        d_priority_reserve = nr_chunks;
+      }
+
+      size_t get_priority_reserve() const
+      {
+        return d_priority_reserve;
+      }
+
+      /*!
+       * \brief Number of non-priority requests refused due to the priority reserve since
+       * initialize.
+       */
+      uint64_t get_nr_shed_chunks() const
+      {
+        return d_nr_shed_chunks.load(std::memory_order_relaxed);
+      }
+
+      /*!
+       * \brief Configures memory backing the data chunks. If huge_pages is set the memory is backed
+       * by huge pages if possible, and if numa_node is non-negative the memory is bound to the
+       * given NUMA node. If lock is set the memory is prefaulted and locked into RAM as it is
+       * allocated, grown segments included. All are best-effort. The policy is applied on
+       * initialize.
+       */
+      void set_memory_policy(bool huge_pages, int numa_node, bool lock=false)
+      {
+        d_huge_pages = huge_pages;
+        d_numa_node = numa_node;
+        d_lock_memory = lock;
+      }
+
+      bool is_huge_page_backed() const
+      {
+        return !d_segments.empty() && d_segments.front()->is_huge_page_backed();
+      }
+
+      bool is_explicit_huge_page_backed() const
+      {
+        return !d_segments.empty() && d_segments.front()->is_explicit_huge_page_backed();
+      }
+
+      bool is_numa_bound() const
+      {
+        return !d_segments.empty() && d_segments.front()->is_numa_bound();
+      }
+
+      /*!
+       * \brief Bytes of the data chunk memory locked into RAM, see set_memory_policy.
+       */
+      size_t get_locked_bytes() const
+      {
+        return d_locked_bytes.load(std::memory_order_relaxed);
+      }
+
+      /*!
+       * \brief Configures how the consumer (i.e. work thread) waits for data. The consumer first
+       * busy-waits for spin_iterations, then yields the CPU for yield_iterations and only then the
+       * thread is parked on the conditional variable. Parking and waking up a thread requires a
+       * syscall, therefore for small chunk sizes spinning for a while might pay off.
+       *
+       * Per default (zero iterations) the consumer is parked right away.
+       */
+      void set_wait_strategy(int spin_iterations, int yield_iterations)
+      {
+        d_spin_iterations = std::max(0, spin_iterations);
+        d_yield_iterations = std::max(0, yield_iterations);
+      }
+
+      /*!
+       * \brief Returns true while the consumer is parked on the conditional variable, i.e. done
+       * spinning and yielding (see set_wait_strategy).
+       */
+      bool is_consumer_parked() const
+      {
+        return d_consumer_parked.load(std::memory_order_relaxed);
+      }
+
+      /*!
+       * \brief Registers a side consumer of the full chunks, e.g. an interlock evaluator or an
+       * archiver, and returns its index. The consumer reads the chunks in place at its own pace
+       * (see pop_consumer_chunk), the chunks return to the free pool once the work thread and all
+       * the side consumers released them.
+       *
+       * Chunks held by a slow consumer are not available to the producer. If max_lag is nonzero
+       * at most max_lag chunks are queued for the consumer, further chunks are skipped for it
+       * (see get_consumer_skipped) instead of draining the pool.
+       *
+       * Consumers must be registered before initialize and must have released their chunks by
+       * the time the buffer is initialized again.
+       */
+      int add_consumer(size_t max_lag = 0)
+      {
+        boost::mutex::scoped_lock lock(d_mutex);
+
+        std::unique_ptr<consumer_t> consumer(new consumer_t());
+        consumer->max_lag = max_lag;
+        consumer->skipped = 0;
+        d_consumers.push_back(std::move(consumer));
+
+        return static_cast<int>(d_consumers.size()) - 1;
+      }
+
+      size_t get_nr_consumers() const
+      {
+        return d_consumers.size();
+      }
+
+      /*!
+       * \brief Returns the oldest full chunk queued for the side consumer, nullptr if none. The
+       * chunk must be handed back via release_consumer_chunk.
+       *
+       * Each side consumer is meant to be served by a single thread.
+       */
+      const data_chunk_t *pop_consumer_chunk(int consumer)
+      {
+        data_chunk_t *ptr = nullptr;
+        auto &queue = d_consumers.at(consumer)->queue;
+        if (!queue || !queue->pop(ptr)) {
+          return nullptr;
+        }
+        return ptr;
+      }
+
+      /*!
+       * \brief Releases a chunk obtained via pop_consumer_chunk.
+       */
+      void release_consumer_chunk(const data_chunk_t *data_chunk)
+      {
+        release_ref(const_cast<data_chunk_t *>(data_chunk));
+      }
+
+      /*!
+       * \brief Number of chunks skipped for the side consumer since initialize, see add_consumer.
+       */
+      uint64_t get_consumer_skipped(int consumer) const
+      {
+        return d_consumers.at(consumer)->skipped.load(std::memory_order_relaxed);
       }
 
+     private:
+
+      /*!
+       * \brief Drops a reference of the chunk, the last one returns it to the free pool.
+       */
+      void release_ref(data_chunk_t *data_chunk)
+      {
+        if (!d_consumers.empty()) {
+          if (data_chunk->d_refs.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+            return;
+          }
+
+          boost::mutex::scoped_lock guard(d_free_mutex);
+          d_nr_chunks_in_use.fetch_sub(1, std::memory_order_relaxed);
+          d_free_data_chunks->push(data_chunk);
+          return;
+        }
+
+        d_nr_chunks_in_use.fetch_sub(1, std::memory_order_relaxed);
+        d_free_data_chunks->push(data_chunk);
+      }
+
+     public:
+
       /*!
        * \brief Adds/inserts data into the application buffer (or data chunk). Driver implementors
        * must make sure to organize memory as expected by the data_chunk_t structure.
        */
       void add_full_data_chunk(data_chunk_t *data_chunk)
       {
-        d_data_chunks.push(data_chunk);
+        // The references are set before the chunk is visible to any of the consumers. Consumers
+        // skipping the chunk drop their reference right away, which never frees the chunk since
+        // the work thread holds its reference until the chunk is pushed below.
+        if (!d_consumers.empty()) {
+          data_chunk->d_refs.store(1 + static_cast<int>(d_consumers.size()), std::memory_order_relaxed);
+          for (auto &consumer : d_consumers) {
+            if (!consumer->queue->push(data_chunk)) {
+              consumer->skipped.fetch_add(1, std::memory_order_relaxed);
+              data_chunk->d_refs.fetch_sub(1, std::memory_order_relaxed);
+            }
+          }
+        }
 
-        // notify clients (i.e. work thread) about new data chunk
-        d_data_rdy_cv.notify_one();
+        const auto nr_full_chunks = d_nr_full_chunks.fetch_add(1, std::memory_order_relaxed) + 1;
+        d_data_chunks->push(data_chunk);
+        DIGITIZERS_PROBE2(app_buffer_push, data_chunk, nr_full_chunks);
+
+        // Make sure the push is visible before checking if the consumer is parked. The consumer
+        // does the opposite (marks itself as parked and then checks the queue), therefore at least
+        // one of the two sides is guaranteed to see the other one's update.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        // notify clients (i.e. work thread) about new data chunk, note this is needed only if the
+        // consumer is parked. The mutex makes sure the notification is not lost in between the
+        // consumer checking the predicate and going to sleep.
+        if (d_consumer_parked.load(std::memory_order_relaxed)) {
+          boost::mutex::scoped_lock guard(d_mutex);
+          d_data_rdy_cv.notify_one();
+        }
       }
 
       std::error_code wait_data_ready()
       {
+        // Spin, then yield...
+        const auto iterations = d_spin_iterations + d_yield_iterations;
+
+        for (auto i = 0; i < iterations; i++) {
+          if (!d_data_chunks->empty() || d_data_rdy_errc_set.load(std::memory_order_acquire)) {
+            return get_data_rdy_errc();
+          }
+
+          if (i < d_spin_iterations) {
+            cpu_relax();
+          }
+          else {
+            // yield is an interruption point, allowing the GR scheduler to stop the thread
+            boost::this_thread::interruption_point();
+            boost::this_thread::yield();
+          }
+        }
+
+        // ...and park
         boost::unique_lock<boost::mutex> lock(d_mutex);
-        d_data_rdy_cv.wait(lock, [this] { return !d_data_chunks.empty() || d_data_rdy_errc; });
+        d_consumer_parked.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        d_data_rdy_cv.wait(lock, [this] { return !d_data_chunks->empty() || d_data_rdy_errc; });
+
+        d_consumer_parked.store(false, std::memory_order_relaxed);
         return d_data_rdy_errc;
       }
 
@@ -161,50 +586,68 @@ namespace gr {
        */
       void notify_data_ready(std::error_code ec)
       {
-        {
-          boost::mutex::scoped_lock guard(d_mutex);
-          d_data_rdy_errc = ec;
-        }
+        boost::mutex::scoped_lock guard(d_mutex);
+        d_data_rdy_errc = ec;
+        d_data_rdy_errc_set.store(static_cast<bool>(ec), std::memory_order_release);
 
         d_data_rdy_cv.notify_one();
       }
 
       /*!
-       * \brief This method follows the GR's work method signature/approach, that is the pointers
-       * to the GR output buffers should be passed in.
+       * \brief Returns the oldest full data chunk without removing it from the application buffer.
+       * This allows the work thread to consume the data in place, i.e. without copying it into an
+       * intermediate buffer first. Once done the chunk must be handed back via release_data_chunk.
        *
        * NOTE, clients MUST call wait_data_ready before attempting to invoke this method.
-       *
-       * Returns number of data chunks lost from the last call.
        */
-      int get_data_chunk(
-              std::vector<float *> &ai_buffers,
-              std::vector<float *> &ai_error_buffers,
-              std::vector<uint8_t *> &port_buffers,
-              std::vector<uint32_t> &status,
-              int64_t &local_timestamp)
+      const data_chunk_t *front_data_chunk()
       {
-        if (d_data_rdy_errc || d_data_chunks.empty()) {
+        if (d_data_rdy_errc_set.load(std::memory_order_acquire) || d_data_chunks->empty()) {
           // by the contract the work method must wait data being ready before calling this method
           std::ostringstream message;
           message << "Exception in " << __FILE__ << ":" << __LINE__ << ":  Use wait_data_ready!!!";
           throw std::runtime_error(message.str());
         }
 
-        // get the oldest data chunk
-        data_chunk_t *data_chunk = nullptr;
-        d_data_chunks.pop(data_chunk);
-        assert(data_chunk != nullptr);
+        return d_data_chunks->front();
+      }
 
-        auto retval = data_chunk->d_lost_count;
+      /*!
+       * \brief Removes the oldest full data chunk (see front_data_chunk) and returns it to the
+       * free pool.
+       */
+      void release_data_chunk(const data_chunk_t *data_chunk)
+      {
+        data_chunk_t *ptr = nullptr;
+        d_data_chunks->pop(ptr);
+        assert(ptr == data_chunk);
 
+        const auto nr_full_chunks = d_nr_full_chunks.fetch_sub(1, std::memory_order_relaxed) - 1;
+        DIGITIZERS_PROBE2(app_buffer_pop, ptr, nr_full_chunks);
+
+        // This data chunk/buffer is free to be used again, unless a side consumer still reads it
+        release_ref(ptr);
+      }
+
+      /*!
+       * \brief Copy values, errors and port data of the given chunk into the provided buffers.
+       * The memory organization described by the data_chunk_t structure with float values and
+       * errors is assumed.
+       */
+      void copy_data_chunk(
+              const data_chunk_t *data_chunk,
+              std::vector<float *> &ai_buffers,
+              std::vector<float *> &ai_error_buffers,
+              std::vector<uint8_t *> &port_buffers) const
+      {
         // check invariants/arguments
+        assert(d_channel_sample_size == 2 * sizeof(float));
         assert(ai_buffers.size() == static_cast<size_t>(d_nr_channels));
         assert(ai_error_buffers.size() == static_cast<size_t>(d_nr_channels));
         assert(port_buffers.size() == static_cast<size_t>(d_nr_ports));
 
         // copy over the data chunk
-        float *read_ptr = reinterpret_cast<float *>(&data_chunk->d_data[0]);
+        const float *read_ptr = reinterpret_cast<const float *>(&data_chunk->d_data[0]);
 
         for (size_t chan_idx = 0; chan_idx < ai_buffers.size(); chan_idx++) {
           memcpy(ai_buffers[chan_idx], read_ptr, d_chunk_size * sizeof(float));
@@ -213,34 +656,121 @@ namespace gr {
           read_ptr += d_chunk_size;
         }
 
-        uint8_t *di_read_ptr = reinterpret_cast<uint8_t *>(read_ptr);
+        const uint8_t *di_read_ptr = reinterpret_cast<const uint8_t *>(read_ptr);
+
+        for (size_t port_idx = 0; port_idx < port_buffers.size(); port_idx++) {
+          memcpy(port_buffers[port_idx], di_read_ptr, d_chunk_size * sizeof(uint8_t));
+          di_read_ptr += d_chunk_size;
+        }
+      }
+
+      /*!
+       * \brief Copies raw ADC counts into the output buffers. The data chunk is expected to hold
+       * raw samples, i.e. 2 * sizeof(int16_t) per channel sample (only the first half of each
+       * channel region is copied).
+       */
+      void copy_raw_data_chunk(
+              const data_chunk_t *data_chunk,
+              std::vector<int16_t *> &raw_buffers,
+              std::vector<uint8_t *> &port_buffers) const
+      {
+        // check invariants/arguments
+        assert(d_channel_sample_size == 2 * sizeof(int16_t));
+        assert(raw_buffers.size() == static_cast<size_t>(d_nr_channels));
+        assert(port_buffers.size() == static_cast<size_t>(d_nr_ports));
+
+        const int16_t *read_ptr = reinterpret_cast<const int16_t *>(&data_chunk->d_data[0]);
+
+        for (size_t chan_idx = 0; chan_idx < raw_buffers.size(); chan_idx++) {
+          memcpy(raw_buffers[chan_idx], read_ptr, d_chunk_size * sizeof(int16_t));
+          read_ptr += 2 * d_chunk_size;
+        }
+
+        const uint8_t *di_read_ptr = reinterpret_cast<const uint8_t *>(read_ptr);
 
         for (size_t port_idx = 0; port_idx < port_buffers.size(); port_idx++) {
           memcpy(port_buffers[port_idx], di_read_ptr, d_chunk_size * sizeof(uint8_t));
           di_read_ptr += d_chunk_size;
         }
+      }
+
+      /*!
+       * \brief This method follows the GR's work method signature/approach, that is the pointers
+       * to the GR output buffers should be passed in.
+       *
+       * NOTE, clients MUST call wait_data_ready before attempting to invoke this method.
+       *
+       * Returns number of data chunks lost from the last call.
+       */
+      int get_data_chunk(
+              std::vector<float *> &ai_buffers,
+              std::vector<float *> &ai_error_buffers,
+              std::vector<uint8_t *> &port_buffers,
+              std::vector<uint32_t> &status,
+              int64_t &local_timestamp)
+      {
+        // get the oldest data chunk
+        auto data_chunk = front_data_chunk();
+        assert(data_chunk != nullptr);
+
+        auto retval = data_chunk->d_lost_count;
+
+        copy_data_chunk(data_chunk, ai_buffers, ai_error_buffers, port_buffers);
 
         // copy status & timestamp
         local_timestamp = data_chunk->d_local_timestamp;
         status = data_chunk->d_status;
 
-        // This data chunk/buffer is free to be used again
-        d_free_data_chunks.push(data_chunk);
+        release_data_chunk(data_chunk);
 
         return retval;
       }
 
       /*!
-       * \brief Get free application buffer. If none available it returns nullptr.
+       * \brief Get free application buffer. If none is available the pool grows, unless the
+       * maximum number of chunks is already allocated in which case nullptr is returned.
+       *
+       * Requests not flagged as priority get nullptr as well once the free chunks are down to
+       * the priority reserve, see set_priority_reserve.
+       *
+       * This method is meant to be called by the producer only.
        */
-      data_chunk_t *get_free_data_chunk()
+      data_chunk_t *get_free_data_chunk(bool priority = true)
       {
-        if (d_free_data_chunks.empty()) {
+        data_chunk_t *ptr = nullptr;
+
+        if (!priority && d_priority_reserve
+                && d_max_nr_chunks - d_nr_chunks_in_use.load(std::memory_order_relaxed) <= d_priority_reserve) {
+          d_nr_shed_chunks.fetch_add(1, std::memory_order_relaxed);
           return nullptr;
         }
 
-        data_chunk_t *ptr = nullptr;
-        d_free_data_chunks.pop(ptr);
+        if (!d_free_data_chunks->pop(ptr)) {
+          if (d_spare_chunks.empty()) {
+            const auto allocated = d_nr_allocated_chunks.load(std::memory_order_relaxed);
+            allocate_segment(std::min(d_growth_step, d_max_nr_chunks - allocated));
+          }
+
+          if (d_spare_chunks.empty()) {
+            return nullptr;
+          }
+
+          ptr = d_spare_chunks.back();
+          d_spare_chunks.pop_back();
+        }
+
+        const auto in_use = d_nr_chunks_in_use.fetch_add(1, std::memory_order_relaxed) + 1;
+        if (in_use > d_high_water_mark.load(std::memory_order_relaxed)) {
+          d_high_water_mark.store(in_use, std::memory_order_relaxed);
+        }
+
+        // Note, the observation window might be reset concurrently by the reader, in the worst
+        // case a single update is lost
+        const auto free = d_nr_allocated_chunks.load(std::memory_order_relaxed) - in_use;
+        if (free < d_min_free_chunks.load(std::memory_order_relaxed)) {
+          d_min_free_chunks.store(free, std::memory_order_relaxed);
+        }
+
         return ptr;
       }
 
@@ -0,0 +1,503 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gnuradio/io_signature.h>
+#include <digitizers/raw_codec.h>
+#include <digitizers/lossy_codec.h>
+#include "archive_sink_impl.h"
+#include "thread_registry.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace gr {
+  namespace digitizers {
+
+    static const uint32_t ARCHIVE_COLUMN_ALIGNMENT = 64;
+
+    static uint32_t
+    align_column(size_t offset)
+    {
+      return static_cast<uint32_t>(chunk_memory_t::round_up(offset, ARCHIVE_COLUMN_ALIGNMENT));
+    }
+
+    archive_sink::sptr
+    archive_sink::make(const std::string &path, int package_size, int packages_per_chunk,
+            int max_pending_chunks, bool direct_io, bool raw_input, float quantization)
+    {
+      return gnuradio::get_initial_sptr
+        (new archive_sink_impl(path, package_size, packages_per_chunk, max_pending_chunks, direct_io,
+                raw_input, quantization));
+    }
+
+    std::vector<archive_index_entry_t>
+    archive_sink::find_chunks(const std::string &path, int64_t from_timestamp, int64_t to_timestamp)
+    {
+      std::ifstream index(path + ".idx", std::ios::binary);
+      if (!index) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": failed to open index of "
+                << path;
+        throw std::runtime_error(message.str());
+      }
+
+      std::vector<archive_index_entry_t> entries;
+      archive_index_entry_t entry;
+      while (index.read(reinterpret_cast<char *>(&entry), sizeof(entry))) {
+        if (entry.first_timestamp >= 0) {
+          entries.push_back(entry);
+        }
+      }
+
+      // Entries are sorted by time, the first candidate is found with a binary search
+      auto first = std::lower_bound(entries.begin(), entries.end(), from_timestamp,
+              [](const archive_index_entry_t &e, int64_t timestamp) {
+        return e.last_timestamp < timestamp;
+      });
+      auto last = std::find_if(first, entries.end(), [to_timestamp](const archive_index_entry_t &e) {
+        return e.first_timestamp > to_timestamp;
+      });
+
+      return std::vector<archive_index_entry_t>(first, last);
+    }
+
+    /*
+     * The private constructor
+     */
+    archive_sink_impl::archive_sink_impl(const std::string &path, int package_size,
+            int packages_per_chunk, int max_pending_chunks, bool direct_io, bool raw_input,
+            float quantization)
+      : gr::sync_block("archive_sink",
+              raw_input ? gr::io_signature::make(1, 1, sizeof(int16_t))
+                        : gr::io_signature::make(1, 2, sizeof(float)),
+              gr::io_signature::make(0, 0, 0)),
+        d_path(path),
+        d_package_size(package_size),
+        d_packages_per_chunk(packages_per_chunk),
+        d_direct_io(direct_io),
+        d_raw_input(raw_input),
+        d_quantization(quantization),
+        d_data_fd(-1),
+        d_index_fd(-1),
+        d_direct_io_active(false),
+        d_file_offset(0),
+        d_stop(false),
+        d_current(nullptr),
+        d_dropped_since_chunk(0),
+        d_acq_info(),
+        d_acq_info_offset(0),
+        d_acq_info_valid(false),
+        d_raw_scaling(),
+        d_written_chunks(0),
+        d_dropped_packages(0),
+        d_write_errors(0)
+    {
+      if (path.empty() || package_size < 1 || packages_per_chunk < 1 || max_pending_chunks < 1) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid path (" << path
+                << "), package size (" << package_size << "), packages per chunk ("
+                << packages_per_chunk << ") or number of pending chunks (" << max_pending_chunks
+                << ")";
+        throw std::invalid_argument(message.str());
+      }
+
+      if (quantization < 0.0f || (quantization > 0.0f && raw_input)) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid quantization ("
+                << quantization << "), not applicable to raw input";
+        throw std::invalid_argument(message.str());
+      }
+
+      // Errors go last, the column is not written if the errors input is not connected. Raw
+      // samples are stored in the values column until encoded.
+      const size_t values_size = static_cast<size_t>(package_size) * packages_per_chunk * sizeof(float);
+      d_values_offset = align_column(sizeof(archive_chunk_header_t));
+      d_timestamps_offset = align_column(d_values_offset + values_size);
+      d_status_offset = align_column(d_timestamps_offset + packages_per_chunk * sizeof(int64_t));
+      d_errors_offset = align_column(d_status_offset + packages_per_chunk * sizeof(uint32_t));
+
+      const size_t capacity = chunk_memory_t::round_up(d_errors_offset + values_size, ARCHIVE_BLOCK_SIZE);
+      if (capacity > UINT32_MAX) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": chunk size " << capacity
+                << " exceeds the maximum, reduce the number of packages per chunk";
+        throw std::invalid_argument(message.str());
+      }
+      d_chunk_capacity = static_cast<uint32_t>(capacity);
+
+      if (raw_input) {
+        const size_t nsamples = static_cast<size_t>(package_size) * packages_per_chunk;
+        const size_t encoded_size = align_column(align_column(d_values_offset + raw_encode_bound(nsamples))
+                + packages_per_chunk * sizeof(int64_t)) + packages_per_chunk * sizeof(uint32_t);
+        d_encoded.allocate(chunk_memory_t::round_up(encoded_size, ARCHIVE_BLOCK_SIZE), false, -1);
+      }
+      else if (quantization > 0.0f) {
+        const size_t nsamples = static_cast<size_t>(package_size) * packages_per_chunk;
+        const size_t encoded_size = align_column(align_column(align_column(d_values_offset
+                + lossy_encode_bound(nsamples)) + packages_per_chunk * sizeof(int64_t))
+                + packages_per_chunk * sizeof(uint32_t)) + lossy_encode_bound(nsamples);
+        d_encoded.allocate(chunk_memory_t::round_up(encoded_size, ARCHIVE_BLOCK_SIZE), false, -1);
+      }
+
+      for (int i = 0; i < max_pending_chunks; i++) {
+        d_chunks.emplace_back(new chunk_t());
+        d_chunks.back()->memory.allocate(d_chunk_capacity, false, -1);
+      }
+
+      // Packages are copied as a whole
+      set_output_multiple(package_size);
+    }
+
+    archive_sink_impl::~archive_sink_impl()
+    {
+      stop();
+    }
+
+    bool
+    archive_sink_impl::start()
+    {
+      // Direct I/O is not supported by all the file systems (e.g. tmpfs)
+      int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+      d_data_fd = d_direct_io ? open(d_path.c_str(), flags | O_DIRECT, 0644) : -1;
+      d_direct_io_active = d_data_fd >= 0;
+      if (d_data_fd < 0) {
+        d_data_fd = open(d_path.c_str(), flags, 0644);
+      }
+
+      d_index_fd = open((d_path + ".idx").c_str(), flags | O_APPEND, 0644);
+
+      if (d_data_fd < 0 || d_index_fd < 0) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": failed to open archive "
+                << d_path << ": " << std::strerror(errno);
+        close_files();
+        throw std::runtime_error(message.str());
+      }
+
+      d_free_chunks.clear();
+      for (auto &chunk : d_chunks) {
+        d_free_chunks.push_back(chunk.get());
+      }
+      d_pending_chunks.clear();
+      d_current = nullptr;
+      d_dropped_since_chunk = 0;
+      d_file_offset = 0;
+      d_acq_info_valid = false;
+      d_raw_scaling = raw_scaling_t();
+      d_written_chunks = 0;
+      d_dropped_packages = 0;
+      d_write_errors = 0;
+
+      d_stop = false;
+      d_writer_thread = boost::thread(&archive_sink_impl::writer_work_function, this);
+      return true;
+    }
+
+    bool
+    archive_sink_impl::stop()
+    {
+      if (!d_writer_thread.joinable()) {
+        return true;
+      }
+
+      if (d_current != nullptr && d_current->npackages > 0) {
+        submit_chunk(d_current);
+      }
+      d_current = nullptr;
+
+      // Writer drains the pending chunks before it exits
+      {
+        boost::mutex::scoped_lock lock(d_mutex);
+        d_stop = true;
+      }
+      d_cv.notify_all();
+      d_writer_thread.join();
+
+      close_files();
+      return true;
+    }
+
+    void
+    archive_sink_impl::close_files()
+    {
+      if (d_data_fd >= 0) {
+        close(d_data_fd);
+      }
+      if (d_index_fd >= 0) {
+        close(d_index_fd);
+      }
+      d_data_fd = -1;
+      d_index_fd = -1;
+    }
+
+    archive_sink_impl::chunk_t *
+    archive_sink_impl::acquire_chunk()
+    {
+      boost::mutex::scoped_lock lock(d_mutex);
+
+      if (d_free_chunks.empty()) {
+        return nullptr;
+      }
+
+      auto chunk = d_free_chunks.back();
+      d_free_chunks.pop_back();
+      return chunk;
+    }
+
+    void
+    archive_sink_impl::submit_chunk(chunk_t *chunk)
+    {
+      {
+        boost::mutex::scoped_lock lock(d_mutex);
+        d_pending_chunks.push_back(chunk);
+      }
+      d_cv.notify_all();
+    }
+
+    void
+    archive_sink_impl::writer_work_function()
+    {
+      thread_scope_t thread(get_block_name(this), "archive-writer");
+
+      boost::mutex::scoped_lock lock(d_mutex);
+
+      while (true) {
+        while (d_pending_chunks.empty() && !d_stop) {
+          d_cv.wait(lock);
+        }
+        if (d_pending_chunks.empty()) {
+          return;
+        }
+
+        auto chunk = d_pending_chunks.front();
+        d_pending_chunks.pop_front();
+
+        lock.unlock();
+        write_chunk(*chunk);
+        lock.lock();
+
+        d_free_chunks.push_back(chunk);
+      }
+    }
+
+    void
+    archive_sink_impl::write_chunk(chunk_t &chunk)
+    {
+      const auto timestamps = reinterpret_cast<const int64_t *>(chunk.memory.data() + d_timestamps_offset);
+      const size_t nsamples = static_cast<size_t>(chunk.npackages) * d_package_size;
+
+      archive_chunk_header_t header;
+      std::memset(&header, 0, sizeof(header));
+      header.magic = ARCHIVE_CHUNK_MAGIC;
+      header.version = ARCHIVE_VERSION;
+      header.header_size = sizeof(header);
+      header.package_size = d_package_size;
+      header.npackages = chunk.npackages;
+      header.offset = chunk.offset;
+      header.packages_dropped = chunk.packages_dropped;
+      header.timebase = chunk.timebase;
+      header.values_offset = d_values_offset;
+
+      uint8_t *data;
+      size_t used;
+
+      if (d_raw_input) {
+        // Encoded into a separate buffer, the columns following the values move up
+        data = d_encoded.data();
+        header.flags = ARCHIVE_CHUNK_RAW_COMPRESSED;
+        header.values_size = raw_encode(reinterpret_cast<const int16_t *>(chunk.memory.data() + d_values_offset),
+                nsamples, data + d_values_offset);
+        header.timestamps_offset = align_column(d_values_offset + header.values_size);
+        header.status_offset = align_column(header.timestamps_offset + chunk.npackages * sizeof(int64_t));
+        header.scaling = chunk.scaling;
+
+        std::memcpy(data + header.timestamps_offset, timestamps, chunk.npackages * sizeof(int64_t));
+        std::memcpy(data + header.status_offset, chunk.memory.data() + d_status_offset,
+                chunk.npackages * sizeof(uint32_t));
+        used = header.status_offset + chunk.npackages * sizeof(uint32_t);
+      }
+      else if (d_quantization > 0.0f && chunk.has_errors) {
+        // Same as above, the errors are the bounds of the values and of themselves
+        const auto values = reinterpret_cast<const float *>(chunk.memory.data() + d_values_offset);
+        const auto errors = reinterpret_cast<const float *>(chunk.memory.data() + d_errors_offset);
+
+        data = d_encoded.data();
+        header.flags = ARCHIVE_CHUNK_HAS_ERRORS | ARCHIVE_CHUNK_LOSSY_COMPRESSED;
+        header.quantization = d_quantization;
+        header.values_size = lossy_encode(values, errors, nsamples, d_quantization, data + d_values_offset);
+        header.timestamps_offset = align_column(d_values_offset + header.values_size);
+        header.status_offset = align_column(header.timestamps_offset + chunk.npackages * sizeof(int64_t));
+        header.errors_offset = align_column(header.status_offset + chunk.npackages * sizeof(uint32_t));
+
+        std::memcpy(data + header.timestamps_offset, timestamps, chunk.npackages * sizeof(int64_t));
+        std::memcpy(data + header.status_offset, chunk.memory.data() + d_status_offset,
+                chunk.npackages * sizeof(uint32_t));
+        used = header.errors_offset + lossy_encode(errors, errors, nsamples, d_quantization,
+                data + header.errors_offset);
+      }
+      else {
+        data = chunk.memory.data();
+        header.flags = chunk.has_errors ? ARCHIVE_CHUNK_HAS_ERRORS : 0;
+        header.values_size = nsamples * sizeof(float);
+        header.timestamps_offset = d_timestamps_offset;
+        header.status_offset = d_status_offset;
+        header.errors_offset = chunk.has_errors ? d_errors_offset : 0;
+        used = chunk.has_errors ? d_errors_offset + nsamples * sizeof(float)
+                : d_status_offset + chunk.npackages * sizeof(uint32_t);
+      }
+
+      const size_t chunk_size = chunk_memory_t::round_up(used, ARCHIVE_BLOCK_SIZE);
+      std::memset(data + used, 0, chunk_size - used);
+
+      header.chunk_size = chunk_size;
+      std::memcpy(data, &header, sizeof(header));
+
+      // A single large write per chunk, block aligned in size, position and memory
+      size_t written = 0;
+      while (written < chunk_size) {
+        auto n = pwrite(d_data_fd, data + written, chunk_size - written, d_file_offset + written);
+        if (n < 0 && errno == EINTR) {
+          continue;
+        }
+        if (n <= 0) {
+          // The next chunk overwrites what was written of this one
+          d_write_errors++;
+          return;
+        }
+        written += n;
+      }
+
+      archive_index_entry_t entry;
+      std::memset(&entry, 0, sizeof(entry));
+      entry.first_timestamp = timestamps[0];
+      entry.last_timestamp = timestamps[chunk.npackages - 1];
+      entry.file_offset = d_file_offset;
+      entry.offset = chunk.offset;
+      entry.chunk_size = chunk_size;
+      entry.npackages = chunk.npackages;
+
+      if (write(d_index_fd, &entry, sizeof(entry)) != sizeof(entry)) {
+        d_write_errors++;
+      }
+
+      d_file_offset += chunk_size;
+      d_written_chunks++;
+    }
+
+    int64_t
+    archive_sink_impl::update_package_info(uint64_t offset, uint32_t &status)
+    {
+      d_tags.clear();
+      get_tags_in_range(d_tags, 0, offset, offset + d_package_size);
+
+      status = 0;
+
+      for (const auto &tag : d_tags) {
+        const auto kind = get_tag_kind(tag);
+        if (kind == TAG_KIND_ACQ_INFO) {
+          d_acq_info = decode_acq_info_tag(tag);
+          d_acq_info_offset = tag.offset;
+          d_acq_info_valid = true;
+        }
+        else if (kind == TAG_KIND_TRIGGER) {
+          status |= decode_trigger_tag(tag).status;
+        }
+        else if (kind == TAG_KIND_RAW_SCALING) {
+          d_raw_scaling = decode_raw_scaling_tag(tag);
+        }
+      }
+
+      if (!d_acq_info_valid || d_acq_info.timestamp < 0) {
+        return -1;
+      }
+
+      status |= d_acq_info.status;
+
+      // Timestamp of the first sample, the acq_info tag might be within the package
+      const double distance = static_cast<double>(offset) - static_cast<double>(d_acq_info_offset);
+      return d_acq_info.timestamp + static_cast<int64_t>(distance * d_acq_info.timebase * 1000000000.0);
+    }
+
+    int
+    archive_sink_impl::work(int noutput_items,
+        gr_vector_const_void_star &input_items,
+        gr_vector_void_star &output_items)
+    {
+      block_stats_scope_t stats(d_stats);
+
+      const float *in_values = static_cast<const float *>(input_items[0]);
+      const float *in_errors = input_items.size() > 1 ? static_cast<const float *>(input_items[1]) : nullptr;
+
+      const int npackages = noutput_items / d_package_size;
+      const auto samp0_count = nitems_read(0);
+      const size_t package_bytes = d_package_size * sizeof(float);
+
+      for (int p = 0; p < npackages; p++) {
+        const auto offset = samp0_count + static_cast<uint64_t>(p) * d_package_size;
+
+        uint32_t status;
+        const auto timestamp = update_package_info(offset, status);
+
+        if (d_current == nullptr) {
+          d_current = acquire_chunk();
+
+          // Disk is lagging, all the chunks are pending
+          if (d_current == nullptr) {
+            d_dropped_since_chunk++;
+            d_dropped_packages++;
+            continue;
+          }
+
+          d_current->npackages = 0;
+          d_current->has_errors = in_errors != nullptr;
+          d_current->offset = offset;
+          d_current->packages_dropped = d_dropped_since_chunk;
+          d_current->timebase = d_acq_info_valid ? d_acq_info.timebase : 0.0;
+          d_current->scaling = d_raw_scaling;
+          d_dropped_since_chunk = 0;
+        }
+
+        auto data = d_current->memory.data();
+        const auto n = d_current->npackages;
+
+        if (d_raw_input) {
+          const auto in_raw = static_cast<const int16_t *>(input_items[0]);
+          std::memcpy(data + d_values_offset + n * d_package_size * sizeof(int16_t),
+                  in_raw + p * d_package_size, d_package_size * sizeof(int16_t));
+        }
+        else {
+          std::memcpy(data + d_values_offset + n * package_bytes, in_values + p * d_package_size,
+                  package_bytes);
+        }
+        if (in_errors != nullptr) {
+          std::memcpy(data + d_errors_offset + n * package_bytes, in_errors + p * d_package_size,
+                  package_bytes);
+        }
+        reinterpret_cast<int64_t *>(data + d_timestamps_offset)[n] = timestamp;
+        reinterpret_cast<uint32_t *>(data + d_status_offset)[n] = status;
+
+        if (++d_current->npackages == static_cast<uint32_t>(d_packages_per_chunk)) {
+          submit_chunk(d_current);
+          d_current = nullptr;
+        }
+      }
+
+      return npackages * d_package_size;
+    }
+
+  } /* namespace digitizers */
+} /* namespace gr */
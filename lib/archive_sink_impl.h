@@ -0,0 +1,129 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_ARCHIVE_SINK_IMPL_H
+#define INCLUDED_DIGITIZERS_ARCHIVE_SINK_IMPL_H
+
+#include <digitizers/archive_sink.h>
+#include <digitizers/tags.h>
+#include "block_stats_impl.h"
+#include "chunk_memory.h"
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <vector>
+
+namespace gr {
+  namespace digitizers {
+
+    class archive_sink_impl : public archive_sink
+    {
+     public:
+      archive_sink_impl(const std::string &path, int package_size, int packages_per_chunk,
+              int max_pending_chunks, bool direct_io, bool raw_input, float quantization);
+
+      ~archive_sink_impl();
+
+      uint64_t get_written_chunks() const override { return d_written_chunks; }
+
+      uint64_t get_dropped_packages() const override { return d_dropped_packages; }
+
+      uint64_t get_write_errors() const override { return d_write_errors; }
+
+      bool is_direct_io() const override { return d_direct_io_active; }
+
+      bool start() override;
+
+      bool stop() override;
+
+      int work(int noutput_items,
+          gr_vector_const_void_star &input_items,
+          gr_vector_void_star &output_items) override;
+
+     private:
+      struct chunk_t
+      {
+        chunk_memory_t memory;       // page aligned, as required for direct I/O
+        uint32_t npackages;
+        bool has_errors;
+        uint64_t offset;
+        uint64_t packages_dropped;
+        double timebase;
+        raw_scaling_t scaling;
+      };
+
+      // Returns a free chunk or nullptr if all the chunks are pending
+      chunk_t *acquire_chunk();
+
+      // Hands the chunk over to the writer
+      void submit_chunk(chunk_t *chunk);
+
+      void write_chunk(chunk_t &chunk);
+
+      void writer_work_function();
+
+      void close_files();
+
+      // Returns the timestamp of the first sample of the package and its status bits
+      int64_t update_package_info(uint64_t offset, uint32_t &status);
+
+      const std::string d_path;
+      const int d_package_size;
+      const int d_packages_per_chunk;
+      const bool d_direct_io;
+      const bool d_raw_input;
+      const float d_quantization;
+
+      // Chunk layout, see archive_chunk_header_t
+      uint32_t d_values_offset;
+      uint32_t d_timestamps_offset;
+      uint32_t d_status_offset;
+      uint32_t d_errors_offset;
+      uint32_t d_chunk_capacity;
+
+      // Raw input or lossy compression, chunks are encoded into this buffer by the writer
+      chunk_memory_t d_encoded;
+
+      int d_data_fd;
+      int d_index_fd;
+      bool d_direct_io_active;
+      uint64_t d_file_offset;        // accessed by the writer only
+
+      std::vector<std::unique_ptr<chunk_t>> d_chunks;
+
+      boost::mutex d_mutex;
+      boost::condition_variable d_cv;
+      std::vector<chunk_t *> d_free_chunks;
+      std::deque<chunk_t *> d_pending_chunks;
+      bool d_stop;
+      boost::thread d_writer_thread;
+
+      // Chunk being filled by the work function, nullptr while dropping
+      chunk_t *d_current;
+      uint64_t d_dropped_since_chunk;
+
+      // Latest acq_info tag
+      acq_info_t d_acq_info;
+      uint64_t d_acq_info_offset;
+      bool d_acq_info_valid;
+      raw_scaling_t d_raw_scaling;
+      std::vector<gr::tag_t> d_tags;
+
+      std::atomic<uint64_t> d_written_chunks;
+      std::atomic<uint64_t> d_dropped_packages;
+      std::atomic<uint64_t> d_write_errors;
+
+      block_stats_recorder_t d_stats {this};
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_ARCHIVE_SINK_IMPL_H */
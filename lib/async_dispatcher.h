@@ -0,0 +1,227 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_ASYNC_DISPATCHER_H
+#define INCLUDED_DIGITIZERS_ASYNC_DISPATCHER_H
+
+#include <digitizers/sink_common.h>
+#include "thread_registry.h"
+
+#include <boost/circular_buffer.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <string>
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Hands items over from the work thread to a dispatch thread invoking the handler.
+     *
+     * The queue is bounded, see dispatch_policy_t for what happens if it is full. The lock is
+     * held only for moving the item in or out of the queue, the handler is invoked without it.
+     *
+     * With the adaptive policy only every n-th item pushed is queued, the others are dropped.
+     * The decimation n is doubled whenever an item is queued while the queue is at least three
+     * quarters full, and halved whenever the queue is found empty, up to DISPATCH_MAX_DECIMATION.
+     * A slow consumer therefore receives a thinned out stream rather than a stale one, and the
+     * producer never waits.
+     *
+     * Usage: configure, start (e.g. in block::start), push from the work thread, stop (e.g. in
+     * block::stop). Items queued when stop is called are still delivered.
+     */
+    template <typename T>
+    class async_dispatcher_t : boost::noncopyable
+    {
+    public:
+
+      typedef std::function<void(T &)> handler_t;
+
+      async_dispatcher_t()
+        : d_policy(DISPATCH_SYNCHRONOUS),
+          d_queue(1),
+          d_stop(false),
+          d_pushed(0),
+          d_dropped(0),
+          d_decimation(1)
+      {
+      }
+
+      ~async_dispatcher_t()
+      {
+        stop();
+      }
+
+      /*!
+       * \brief Has no effect on a running dispatcher.
+       */
+      void configure(dispatch_policy_t policy, size_t queue_size)
+      {
+        boost::mutex::scoped_lock lock(d_mutex);
+        if (d_thread.joinable()) {
+          return;
+        }
+
+        d_policy = policy;
+        d_queue.set_capacity(std::max(queue_size, size_t{1}));
+        d_pushed = 0;
+        d_decimation = 1;
+      }
+
+      bool is_async() const
+      {
+        return d_policy != DISPATCH_SYNCHRONOUS;
+      }
+
+      void start(handler_t handler, const std::string &owner, const std::string &role)
+      {
+        stop();
+
+        if (!is_async()) {
+          return;
+        }
+
+        d_handler = handler;
+        d_owner = owner;
+        d_role = role;
+        d_stop = false;
+        d_thread = boost::thread(&async_dispatcher_t::dispatch_function, this);
+      }
+
+      void stop()
+      {
+        {
+          boost::mutex::scoped_lock lock(d_mutex);
+          d_stop = true;
+        }
+
+        d_cv.notify_all();
+
+        if (d_thread.joinable()) {
+          d_thread.join();
+        }
+      }
+
+      /*!
+       * \brief Queues the item, returns false if the item (or the oldest queued one) was dropped.
+       */
+      bool push(T &&item)
+      {
+        boost::mutex::scoped_lock lock(d_mutex);
+
+        bool dropped = false;
+
+        if (d_policy == DISPATCH_ADAPTIVE) {
+          if (d_pushed++ % d_decimation != 0) {
+            d_dropped++;
+            return false;
+          }
+
+          if (d_queue.empty()) {
+            d_decimation = std::max(d_decimation / 2, uint32_t{1});
+          }
+          else if (d_queue.size() * 4 >= d_queue.capacity() * 3) {
+            d_decimation = std::min(d_decimation * 2, DISPATCH_MAX_DECIMATION);
+          }
+        }
+
+        if (d_queue.full()) {
+          if (d_policy == DISPATCH_BLOCK) {
+            while (!d_stop && d_queue.full()) {
+              d_cv.wait(lock);
+            }
+          }
+          else if (d_policy == DISPATCH_DROP_NEWEST) {
+            d_dropped++;
+            return false;
+          }
+
+          // drop oldest, circular buffer overwrites the front element
+          if (d_queue.full()) {
+            d_dropped++;
+            dropped = true;
+          }
+        }
+
+        d_queue.push_back(std::move(item));
+        lock.unlock();
+        d_cv.notify_all();
+
+        return !dropped;
+      }
+
+      /*!
+       * \brief Number of items dropped since the dispatcher was created.
+       */
+      uint64_t get_dropped_count() const
+      {
+        return d_dropped;
+      }
+
+      /*!
+       * \brief Current decimation of the adaptive policy, 1 otherwise.
+       */
+      uint32_t get_decimation() const
+      {
+        return d_decimation;
+      }
+
+    private:
+
+      void dispatch_function()
+      {
+        thread_scope_t thread(d_owner, d_role);
+
+        while (true) {
+          T item;
+
+          {
+            boost::mutex::scoped_lock lock(d_mutex);
+            while (!d_stop && d_queue.empty()) {
+              d_cv.wait(lock);
+            }
+
+            if (d_queue.empty()) {
+              return;
+            }
+
+            item = std::move(d_queue.front());
+            d_queue.pop_front();
+          }
+
+          // wake up the producer in case of the blocking policy
+          d_cv.notify_all();
+
+          d_handler(item);
+        }
+      }
+
+      dispatch_policy_t d_policy;
+      handler_t d_handler;
+      std::string d_owner;
+      std::string d_role;
+
+      boost::mutex d_mutex;
+      boost::condition_variable d_cv;
+      boost::circular_buffer<T> d_queue;
+      boost::thread d_thread;
+      bool d_stop;
+
+      uint64_t d_pushed;
+      std::atomic<uint64_t> d_dropped;
+      std::atomic<uint32_t> d_decimation;
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_ASYNC_DISPATCHER_H */
@@ -0,0 +1,83 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gnuradio/io_signature.h>
+#include "batched_fft_impl.h"
+
+#include <sstream>
+#include <stdexcept>
+
+namespace gr {
+  namespace digitizers {
+
+    batched_fft_vfc::sptr
+    batched_fft_vfc::make(int fft_size, int nbins, const std::vector<float> &window)
+    {
+      return gnuradio::get_initial_sptr
+        (new batched_fft_vfc(fft_size, nbins, window));
+    }
+
+    batched_fft_vfc::batched_fft_vfc(int fft_size, int nbins, const std::vector<float> &window)
+      : gr::sync_block("batched_fft_vfc",
+              gr::io_signature::make(1, 1, sizeof(float) * fft_size),
+              gr::io_signature::make(1, 1, sizeof(gr_complex) * nbins)),
+        d_fft_size(fft_size),
+        d_nbins(nbins),
+        d_engine(fft_engine_t::get(fft_size))
+    {
+      if (nbins < 1 || nbins > fft_size / 2 + 1) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid number of bins: " << nbins;
+        throw std::invalid_argument(message.str());
+      }
+
+      set_window(window);
+    }
+
+    batched_fft_vfc::~batched_fft_vfc()
+    {
+    }
+
+    void
+    batched_fft_vfc::set_window(const std::vector<float> &window)
+    {
+      gr::thread::scoped_lock lock(d_setlock);
+
+      // same as fft_vfc, an empty window means no window
+      if (window.empty()) {
+        d_window.assign(d_fft_size, 1.0f);
+      }
+      else if (static_cast<int>(window.size()) == d_fft_size) {
+        d_window = window;
+      }
+      else {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": window size " << window.size()
+                << " does not match the FFT size " << d_fft_size;
+        throw std::invalid_argument(message.str());
+      }
+    }
+
+    int
+    batched_fft_vfc::work(int noutput_items,
+        gr_vector_const_void_star &input_items,
+        gr_vector_void_star &output_items)
+    {
+      block_stats_scope_t stats(d_stats);
+      const float *in = (const float *) input_items[0];
+      gr_complex *out = (gr_complex *) output_items[0];
+
+      d_engine->execute(in, noutput_items, &d_window[0], d_nbins, out);
+
+      return noutput_items;
+    }
+
+  } /* namespace digitizers */
+} /* namespace gr */
@@ -0,0 +1,55 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_BATCHED_FFT_IMPL_H
+#define INCLUDED_DIGITIZERS_BATCHED_FFT_IMPL_H
+
+#include <gnuradio/sync_block.h>
+#include "fft_engine.h"
+
+#include <vector>
+#include "block_stats_impl.h"
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Windowed forward FFT of real vectors, outputs the first nbins bins of each.
+     *
+     * Equivalent to fft_vfc followed by keeping the first nbins bins, however the FFT is
+     * executed by the process-wide fft_engine_t, i.e. plans are shared by all STFT instances
+     * using the same size, and all the vectors of a work call are transformed in one batch.
+     */
+    class batched_fft_vfc : public gr::sync_block
+    {
+     public:
+      typedef boost::shared_ptr<batched_fft_vfc> sptr;
+
+      static sptr make(int fft_size, int nbins, const std::vector<float> &window);
+
+      batched_fft_vfc(int fft_size, int nbins, const std::vector<float> &window);
+
+      ~batched_fft_vfc();
+
+      void set_window(const std::vector<float> &window);
+
+      int work(int noutput_items,
+          gr_vector_const_void_star &input_items,
+          gr_vector_void_star &output_items) override;
+
+     private:
+      const int d_fft_size;
+      const int d_nbins;
+      std::vector<float> d_window;
+      fft_engine_t::sptr d_engine;
+
+      block_stats_recorder_t d_stats {this};
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_BATCHED_FFT_IMPL_H */
@@ -0,0 +1,1519 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+/*
+ * Microbenchmarks of the block work functions. Each block is run in a minimal flowgraph
+ * (repeating vector source, head, block, null sinks) and the wall time per input sample is
+ * reported together with the work time of the block itself if GNU Radio performance counters
+ * are enabled. The copy_baseline benchmark measures the flowgraph overhead alone.
+ *
+ * With --cascade the end-to-end benchmark is run instead: simulation sources in generated
+ * streaming mode, paced to the sample rate, feed a cascade_sink per channel with all the sink
+ * families enabled. For 1..N channels the input rate is stepped up until samples are lost. The
+ * highest lossless rate is reported together with the delivery latency percentiles per sink
+ * family (acquisition timestamp to callback) and the CPU time per channel at that rate.
+ *
+ * With --reference the spectral algorithms (stft_algorithms FFT and Goertzel, stft_goertzl_dynamic,
+ * block_spectral_peaks and freq_estimator) are compared on reference waveforms: a 10 kHz 800 mV
+ * sine at 1 MS/s (low noise, 20 dB SNR and with a second tone) and a recorded waveform (--waveform,
+ * CSV, by default the SAT test waveform of examples/SAT). The time per window of 1024 samples is
+ * reported together with the accuracy: the magnitude error against a double precision DFT of the
+ * same samples (spectra normalized to their maximum), the error of the interpolated peak against
+ * the peak of that reference spectrum (Gaussian interpolation as in the reference implementation,
+ * examples/SAT/reference) and the error against the frequency of the synthetic waveforms.
+ *
+ * The kernel_* benchmarks call the vectorized kernels directly, once per instruction set
+ * variant supported by the CPU (see cpu_dispatch.h).
+ *
+ * The median_filter_* benchmarks feed samples through median_filter (see utils.h) for a range of
+ * window sizes. The queue_* benchmarks pass integers from a producer thread to the consumer
+ * through the queues of utils.h, the time is per item.
+ *
+ * The custom_filter_direct_* and custom_filter_fft_* benchmarks run both the FIR engines for
+ * a range of tap counts, the constants of the FIR_AUTO cost model (see fir_cost_model.h) are
+ * fitted to those.
+ *
+ * With --allocations the heap allocations within the work function of the benchmarked block are
+ * counted (see block_stats.h, the allocation hooks are linked into this binary) and reported as
+ * allocations per work call. The times then include the overhead of the block counters.
+ *
+ * Results are optionally written as JSON (--json), using the same layout as Google Benchmark,
+ * such that baselines of different releases can be compared.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+// Default of --waveform, set by the build
+#ifndef DIGITIZERS_REFERENCE_WAVEFORM
+#define DIGITIZERS_REFERENCE_WAVEFORM ""
+#endif
+
+#include <gnuradio/top_block.h>
+#include <gnuradio/high_res_timer.h>
+#include <gnuradio/blocks/vector_source_f.h>
+#include <gnuradio/blocks/head.h>
+#include <gnuradio/blocks/null_sink.h>
+#include <gnuradio/blocks/vector_sink_f.h>
+#include <gnuradio/fft/window.h>
+#include <gnuradio/filter/firdes.h>
+#include <boost/program_options.hpp>
+
+#include <digitizers/tags.h>
+#include <digitizers/status.h>
+#include <digitizers/block_stats.h>
+#include <digitizers/signal_averager.h>
+#include <digitizers/block_aggregation.h>
+#include <digitizers/block_custom_filter.h>
+#include <digitizers/iir_sos_filter_ff.h>
+#include <digitizers/median_and_average.h>
+#include <digitizers/stft_goertzl_dynamic.h>
+#include <digitizers/stft_algorithms.h>
+#include <digitizers/block_spectral_peaks.h>
+#include <digitizers/freq_estimator.h>
+#include <digitizers/demux_ff.h>
+#include <digitizers/time_domain_sink.h>
+#include <digitizers/post_mortem_sink.h>
+#include <digitizers/freq_sink_f.h>
+#include <digitizers/chi_square_fit.h>
+#include <digitizers/simulation_source.h>
+#include <digitizers/cascade_sink.h>
+#include <digitizers/sink_common.h>
+
+#include "app_buffer.h"
+#include "conversion_kernel.h"
+#include "hysteresis_kernel.h"
+#include "interlock_kernel.h"
+#include "sos_kernel.h"
+#include "multi_fused_aggregation_impl.h"
+#include "utils.h"
+
+#include <sys/resource.h>
+#include <time.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <initializer_list>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace po = boost::program_options;
+
+namespace gr {
+  namespace digitizers {
+
+    struct bench_result_t
+    {
+      std::string name;
+      uint64_t items;
+      double wall_ns;   // whole flowgraph
+      double work_ns;   // work function of the benchmarked block, zero if not available
+      std::vector<std::pair<std::string, double>> counters;  // additional results
+    };
+
+    typedef std::function<bench_result_t(uint64_t nitems)> bench_fn_t;
+
+    // Samples in the repeated source vector
+    static const size_t BENCH_SOURCE_SIZE = 1 << 16;
+
+    static std::vector<float>
+    make_bench_signal(size_t size)
+    {
+      std::vector<float> data(size);
+      for (size_t i = 0; i < size; i++) {
+        data[i] = std::sin(0.01f * i) + 0.1f * std::sin(0.37f * i);
+      }
+      return data;
+    }
+
+    /*!
+     * \brief Repeating source of nitems samples (of vlen floats each).
+     */
+    static gr::basic_block_sptr
+    connect_source(gr::top_block_sptr top, uint64_t nitems, int vlen=1,
+            const std::vector<gr::tag_t> &tags=std::vector<gr::tag_t>())
+    {
+      const auto nvectors = std::max(BENCH_SOURCE_SIZE / vlen, size_t {16});
+      auto source = gr::blocks::vector_source_f::make(make_bench_signal(nvectors * vlen), true, vlen, tags);
+      auto head = gr::blocks::head::make(sizeof(float) * vlen, nitems);
+      top->connect(source, 0, head, 0);
+      return head;
+    }
+
+    static void
+    connect_null_sinks(gr::top_block_sptr top, gr::basic_block_sptr block)
+    {
+      auto signature = block->output_signature();
+      for (int i = 0; i < signature->max_streams() && signature->max_streams() > 0; i++) {
+        auto sink = gr::blocks::null_sink::make(signature->sizeof_stream_item(i));
+        top->connect(block, i, sink, 0);
+      }
+    }
+
+    static bench_result_t
+    run_bench(const std::string &name, gr::top_block_sptr top, gr::basic_block_sptr block, uint64_t nitems)
+    {
+      auto start = std::chrono::steady_clock::now();
+      top->run();
+      auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start);
+
+      double work_ns = 0.0;
+      auto work_block = boost::dynamic_pointer_cast<gr::block>(block);
+      if (work_block) {
+        work_ns = work_block->pc_work_time_total() * 1e9 / gr::high_res_timer_tps();
+      }
+
+      bench_result_t result {name, nitems, elapsed.count(), work_ns};
+
+      if (work_block && get_block_stats_enabled()) {
+        for (const auto &stats : get_block_stats()) {
+          if (stats.name == work_block->identifier() && stats.work_calls) {
+            result.counters.emplace_back("allocations_per_call",
+                    static_cast<double>(stats.allocations) / stats.work_calls);
+            result.counters.emplace_back("allocating_calls", stats.allocating_calls);
+          }
+        }
+      }
+
+      return result;
+    }
+
+    static bench_result_t
+    bench_copy_baseline(uint64_t nitems)
+    {
+      auto top = gr::make_top_block("bench");
+      auto source = connect_source(top, nitems);
+      auto sink = gr::blocks::null_sink::make(sizeof(float));
+      top->connect(source, 0, sink, 0);
+      return run_bench("copy_baseline", top, nullptr, nitems);
+    }
+
+    static bench_result_t
+    bench_signal_averager(uint64_t nitems)
+    {
+      auto top = gr::make_top_block("bench");
+      auto block = signal_averager::make(1, 10, 1e6);
+      top->connect(connect_source(top, nitems), 0, block, 0);
+      connect_null_sinks(top, block);
+      return run_bench("signal_averager", top, block, nitems);
+    }
+
+    static bench_result_t
+    bench_block_aggregation(uint64_t nitems)
+    {
+      std::vector<float> taps({1.0, -3.9692103976755453, 5.9090978836797685, -3.9105406695954064, 0.9706534726794167});
+      std::vector<double> taps_d(taps.begin(), taps.end());
+
+      auto top = gr::make_top_block("bench");
+      auto block = block_aggregation::make(FIR_LP, 10, 0, taps, 1000, 40000, 4000, taps_d, taps_d, 1e6);
+      top->connect(connect_source(top, nitems), 0, block, 0);
+      top->connect(connect_source(top, nitems), 0, block, 1);
+      connect_null_sinks(top, block);
+      return run_bench("block_aggregation", top, block, nitems);
+    }
+
+    // Channels of the multi-channel aggregation benchmarks
+    static const int BENCH_AGGREGATION_CHANNELS = 8;
+
+    static bench_result_t
+    bench_block_aggregation_channels(uint64_t nitems)
+    {
+      // one block_aggregation per channel, i.e. the per-channel cascade_sink setup
+      const int nchannels = BENCH_AGGREGATION_CHANNELS;
+      std::vector<double> no_taps;
+
+      auto top = gr::make_top_block("bench");
+      for (int c = 0; c < nchannels; c++) {
+        auto block = block_aggregation::make(FIR_LP, 10, 0, {}, 1000, 40000, 4000, no_taps, no_taps, 1e6);
+        top->connect(connect_source(top, nitems / nchannels), 0, block, 0);
+        top->connect(connect_source(top, nitems / nchannels), 0, block, 1);
+        connect_null_sinks(top, block);
+      }
+      return run_bench("block_aggregation_x8", top, nullptr, nitems / nchannels * nchannels);
+    }
+
+    static bench_result_t
+    bench_multi_fused_aggregation(uint64_t nitems)
+    {
+      // the same channels in SIMD lanes of a single block, see multi_cascade_sink
+      const int nchannels = BENCH_AGGREGATION_CHANNELS;
+
+      auto top = gr::make_top_block("bench");
+      auto block = multi_fused_aggregation_ff::make(nchannels, FIR_LP, 10, 0, {}, 1000, 40000, 4000, 1e6);
+      for (int c = 0; c < nchannels; c++) {
+        top->connect(connect_source(top, nitems / nchannels), 0, block, 2 * c);
+        top->connect(connect_source(top, nitems / nchannels), 0, block, 2 * c + 1);
+      }
+      connect_null_sinks(top, block);
+      return run_bench("multi_fused_aggregation_x8", top, block, nitems / nchannels * nchannels);
+    }
+
+    static bench_result_t
+    bench_iir_sos_filter_ff(uint64_t nitems)
+    {
+      // fourth order low pass (Butterworth, 0.1 * fs) on 8 channels
+      std::vector<double> b {0.0048243433, 0.0192973731, 0.0289460597, 0.0192973731, 0.0048243433};
+      std::vector<double> a {1.0, -2.3695130072, 2.3139884144, -1.0546654059, 0.1873794924};
+      const int nchannels = 8;
+
+      auto top = gr::make_top_block("bench");
+      auto block = iir_sos_filter_ff::make(nchannels, b, a);
+      for (int i = 0; i < nchannels; i++) {
+        top->connect(connect_source(top, nitems / nchannels), 0, block, i);
+      }
+      connect_null_sinks(top, block);
+      return run_bench("iir_sos_filter_ff", top, block, nitems / nchannels * nchannels);
+    }
+
+    static bench_result_t
+    bench_median_and_average(uint64_t nitems)
+    {
+      const int vec_len = 1024;
+
+      auto top = gr::make_top_block("bench");
+      auto block = median_and_average::make(vec_len, 5, 3);
+      top->connect(connect_source(top, nitems / vec_len, vec_len), 0, block, 0);
+      connect_null_sinks(top, block);
+      return run_bench("median_and_average", top, block, nitems / vec_len * vec_len);
+    }
+
+    static bench_result_t
+    bench_stft_goertzl_dynamic(uint64_t nitems)
+    {
+      const int winsize = 1024, nbins = 256;
+      const auto nwindows = nitems / winsize;
+
+      auto top = gr::make_top_block("bench");
+      auto block = stft_goertzl_dynamic::make(1e6, winsize, nbins);
+      auto min_freq = gr::blocks::vector_source_f::make(std::vector<float> {1000.0f}, true);
+      auto max_freq = gr::blocks::vector_source_f::make(std::vector<float> {100000.0f}, true);
+      top->connect(connect_source(top, nwindows, winsize), 0, block, 0);
+      top->connect(min_freq, 0, block, 1);
+      top->connect(max_freq, 0, block, 2);
+      connect_null_sinks(top, block);
+      return run_bench("stft_goertzl_dynamic", top, block, nwindows * winsize);
+    }
+
+    static bench_result_t
+    bench_demux_ff(uint64_t nitems)
+    {
+      // a trigger every 10000 samples
+      std::vector<gr::tag_t> tags;
+      for (size_t offset = 5000; offset < BENCH_SOURCE_SIZE; offset += 10000) {
+        tags.push_back(make_trigger_tag(offset));
+      }
+
+      auto top = gr::make_top_block("bench");
+      auto block = demux_ff::make(1000, 100);
+      top->connect(connect_source(top, nitems, 1, tags), 0, block, 0);
+      top->connect(connect_source(top, nitems), 0, block, 1);
+      connect_null_sinks(top, block);
+      return run_bench("demux_ff", top, block, nitems);
+    }
+
+    static bench_result_t
+    bench_time_domain_sink(uint64_t nitems)
+    {
+      auto top = gr::make_top_block("bench");
+      auto block = time_domain_sink::make("bench", "V", 1e6, TIME_SINK_MODE_STREAMING, 8192);
+      top->connect(connect_source(top, nitems), 0, block, 0);
+      top->connect(connect_source(top, nitems), 0, block, 1);
+      return run_bench("time_domain_sink", top, block, nitems);
+    }
+
+    static bench_result_t
+    bench_post_mortem_sink(uint64_t nitems)
+    {
+      auto top = gr::make_top_block("bench");
+      auto block = post_mortem_sink::make("bench", "V", 1e6, 1 << 20);
+      top->connect(connect_source(top, nitems), 0, block, 0);
+      top->connect(connect_source(top, nitems), 0, block, 1);
+      connect_null_sinks(top, block);
+      return run_bench("post_mortem_sink", top, block, nitems);
+    }
+
+    static bench_result_t
+    bench_freq_sink_f(uint64_t nitems)
+    {
+      const int nbins = 1024;
+      const auto nvectors = nitems / nbins;
+
+      auto top = gr::make_top_block("bench");
+      auto block = freq_sink_f::make("bench", 1e6, nbins, 1, 100, FREQ_SINK_MODE_STREAMING);
+      for (int i = 0; i < 3; i++) {
+        top->connect(connect_source(top, nvectors, nbins), 0, block, i);
+      }
+      return run_bench("freq_sink_f", top, block, nvectors * nbins);
+    }
+
+    static bench_result_t
+    bench_chi_square_fit(uint64_t nitems)
+    {
+      // the fit is expensive, a vector is fitted per 100k samples
+      const int signal_len = 30;
+      const auto nvectors = std::max(nitems / 100000, uint64_t {1});
+
+      auto top = gr::make_top_block("bench");
+      auto block = chi_square_fit::make(signal_len, "x*[0] + 1.0*[1] ", signal_len, 1.0, 2, "gradient, offset",
+              std::vector<double> {1.0, 0.0}, std::vector<double> {0.0, 16.0}, std::vector<int> {1, 1},
+              std::vector<double> {2.0, 2.0}, std::vector<double> {-2.0, -2.0}, 0.001);
+      top->connect(connect_source(top, nvectors, signal_len), 0, block, 0);
+      connect_null_sinks(top, block);
+      return run_bench("chi_square_fit", top, block, nvectors * signal_len);
+    }
+
+    static bench_result_t
+    bench_app_buffer(uint64_t nitems)
+    {
+      // Driver thread hands over chunks of two channels and a port, the work thread copies
+      // them out as digitizer_block does
+      const size_t chunk_size = 8192;
+      const auto nchunks = std::max(nitems / chunk_size, uint64_t {1});
+
+      app_buffer_t buffer;
+      buffer.initialize(2, 1, chunk_size, 64);
+
+      std::vector<float> values(2 * chunk_size), errors(2 * chunk_size);
+      std::vector<uint8_t> port(chunk_size);
+      std::vector<float *> ai_buffers {&values[0], &values[chunk_size]};
+      std::vector<float *> ai_error_buffers {&errors[0], &errors[chunk_size]};
+      std::vector<uint8_t *> port_buffers {&port[0]};
+
+      auto start = std::chrono::steady_clock::now();
+
+      std::thread producer([&buffer, nchunks] {
+        for (uint64_t i = 0; i < nchunks; i++) {
+          app_buffer_t::data_chunk_t *chunk;
+          while ((chunk = buffer.get_free_data_chunk()) == nullptr) {
+            std::this_thread::yield();
+          }
+          chunk->d_status = std::vector<uint32_t> {0, 0};
+          buffer.add_full_data_chunk(chunk);
+        }
+      });
+
+      for (uint64_t i = 0; i < nchunks; i++) {
+        buffer.wait_data_ready();
+        auto chunk = buffer.front_data_chunk();
+        buffer.copy_data_chunk(chunk, ai_buffers, ai_error_buffers, port_buffers);
+        buffer.release_data_chunk(chunk);
+      }
+      producer.join();
+
+      auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start);
+      return bench_result_t {"app_buffer", nchunks * chunk_size, elapsed.count(), 0.0};
+    }
+
+    /**********************************************************************
+     * Kernel benchmarks
+     **********************************************************************/
+
+    // Samples per kernel call, i.e. a typical work call
+    static const int KERNEL_BENCH_BLOCK = 8192;
+
+    template <typename F>
+    static bench_result_t
+    run_kernel_bench(const std::string &name, uint64_t nitems, F call)
+    {
+      const uint64_t ncalls = std::max(nitems / KERNEL_BENCH_BLOCK, uint64_t {1});
+
+      auto start = std::chrono::steady_clock::now();
+      for (uint64_t i = 0; i < ncalls; i++) {
+        call();
+      }
+      auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start);
+
+      return bench_result_t {name, ncalls * KERNEL_BENCH_BLOCK, elapsed.count(), 0.0};
+    }
+
+    static std::vector<std::pair<std::string, bench_fn_t>>
+    kernel_benchmarks()
+    {
+      std::vector<std::pair<std::string, bench_fn_t>> kernels;
+
+      for (int i = KERNEL_ISA_GENERIC; i <= get_kernel_isa(); i++) {
+        const auto isa = static_cast<kernel_isa_t>(i);
+        const std::string suffix = std::string("_") + kernel_isa_name(isa);
+
+        kernels.emplace_back("kernel_min_max_agg" + suffix, [isa, suffix](uint64_t nitems) {
+          std::vector<int16_t> raw_max(KERNEL_BENCH_BLOCK, 1000), raw_min(KERNEL_BENCH_BLOCK, -1000);
+          std::vector<float> values(KERNEL_BENCH_BLOCK), errors(KERNEL_BENCH_BLOCK);
+          auto kernel = conversion_detail::min_max_agg_kernel(isa);
+          return run_kernel_bench("kernel_min_max_agg" + suffix, nitems, [&] {
+            kernel(raw_max.data(), raw_min.data(), 0.001f, 1.0f, 0.0f, values.data(), errors.data(),
+                    KERNEL_BENCH_BLOCK);
+          });
+        });
+
+        kernels.emplace_back("kernel_raw_convert" + suffix, [isa, suffix](uint64_t nitems) {
+          std::vector<int16_t> raw(KERNEL_BENCH_BLOCK, 1000);
+          std::vector<float> values(KERNEL_BENCH_BLOCK);
+          auto kernel = conversion_detail::raw_convert_kernel(isa);
+          return run_kernel_bench("kernel_raw_convert" + suffix, nitems, [&] {
+            kernel(raw.data(), 0.001f, 0.5f, values.data(), KERNEL_BENCH_BLOCK);
+          });
+        });
+
+        kernels.emplace_back("kernel_sos_cascade" + suffix, [isa, suffix](uint64_t nitems) {
+          // 8 channels, 4 sections
+          const int nchannels = 8, nsamples = KERNEL_BENCH_BLOCK / nchannels;
+          const std::vector<sos_section_t> sections(4, sos_section_t {0.2f, 0.4f, 0.2f, -0.6f, 0.2f});
+          auto samples = make_bench_signal(KERNEL_BENCH_BLOCK);
+          std::vector<float> out(KERNEL_BENCH_BLOCK), state(2 * sections.size() * nchannels, 0.0f);
+          auto kernel = sos_detail::sos_cascade_kernel(isa);
+          return run_kernel_bench("kernel_sos_cascade" + suffix, nitems, [&] {
+            kernel(sections.data(), sections.size(), state.data(), samples.data(), out.data(),
+                    nchannels, nchannels, nsamples);
+          });
+        });
+
+        kernels.emplace_back("kernel_threshold_masks" + suffix, [isa, suffix](uint64_t nitems) {
+          auto samples = make_bench_signal(KERNEL_BENCH_BLOCK);
+          std::vector<uint32_t> above(hysteresis_words(KERNEL_BENCH_BLOCK)), below(above.size());
+          auto kernel = hysteresis_detail::threshold_masks_kernel(isa);
+          return run_kernel_bench("kernel_threshold_masks" + suffix, nitems, [&] {
+            kernel(samples.data(), KERNEL_BENCH_BLOCK, -0.5f, 0.5f, above.data(), below.data());
+          });
+        });
+
+        kernels.emplace_back("kernel_interlocks" + suffix, [isa, suffix](uint64_t nitems) {
+          auto samples = make_bench_signal(KERNEL_BENCH_BLOCK);
+          std::vector<float> min(KERNEL_BENCH_BLOCK, -0.9f), max(KERNEL_BENCH_BLOCK, 0.9f), out(KERNEL_BENCH_BLOCK);
+          std::vector<uint32_t> words(interlock_words(KERNEL_BENCH_BLOCK));
+          auto kernel = interlock_detail::evaluate_interlocks_kernel(isa);
+          return run_kernel_bench("kernel_interlocks" + suffix, nitems, [&] {
+            kernel(samples.data(), min.data(), max.data(), KERNEL_BENCH_BLOCK, -10.0f, 10.0f,
+                    out.data(), words.data());
+          });
+        });
+      }
+
+      return kernels;
+    }
+
+    static std::vector<std::pair<std::string, bench_fn_t>>
+    median_filter_benchmarks()
+    {
+      std::vector<std::pair<std::string, bench_fn_t>> filters;
+
+      for (int window : {15, 255, 4095}) {
+        const std::string name = "median_filter_" + std::to_string(window);
+
+        filters.emplace_back(name, [window, name](uint64_t nitems) {
+          auto samples = make_bench_signal(BENCH_SOURCE_SIZE);
+          median_filter<float> filter(window);
+
+          volatile float sink = 0.0f;
+          auto start = std::chrono::steady_clock::now();
+          for (uint64_t i = 0; i < nitems; i++) {
+            sink = filter.add(samples[i % BENCH_SOURCE_SIZE]);
+          }
+          auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start);
+
+          (void) sink;
+          return bench_result_t {name, nitems, elapsed.count(), 0.0};
+        });
+      }
+
+      return filters;
+    }
+
+    template <typename Queue>
+    static bench_result_t
+    run_queue_bench(const std::string &name, Queue &queue, uint64_t nitems)
+    {
+      auto start = std::chrono::steady_clock::now();
+
+      std::thread producer([&queue, nitems] {
+        for (uint64_t i = 0; i < nitems; i++) {
+          while (!queue.push(static_cast<int>(i))) {
+            std::this_thread::yield();
+          }
+        }
+      });
+
+      int64_t sum = 0;
+      int value;
+      for (uint64_t i = 0; i < nitems; i++) {
+        while (!queue.pop(value)) {
+          std::this_thread::yield();
+        }
+        sum += value;
+      }
+      producer.join();
+
+      auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start);
+
+      // items are neither lost nor duplicated
+      int64_t expected = 0;
+      for (uint64_t i = 0; i < nitems; i++) {
+        expected += static_cast<int>(i);
+      }
+      if (sum != expected) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": " << name << " lost or duplicated items";
+        throw std::runtime_error(message.str());
+      }
+
+      return bench_result_t {name, nitems, elapsed.count(), 0.0};
+    }
+
+    // concurrent_queue::push never fails
+    struct concurrent_queue_adapter_t
+    {
+      concurrent_queue<int> queue;
+      bool push(int value) { queue.push(value); return true; }
+      bool pop(int &value) { return queue.pop(value); }
+    };
+
+    static std::vector<std::pair<std::string, bench_fn_t>>
+    queue_benchmarks()
+    {
+      const size_t capacity = 4096;
+
+      return {
+        {"queue_concurrent_queue", [](uint64_t nitems) {
+          concurrent_queue_adapter_t queue;
+          return run_queue_bench("queue_concurrent_queue", queue, nitems);
+        }},
+        {"queue_spsc_ring", [capacity](uint64_t nitems) {
+          spsc_ring<int> queue(capacity);
+          return run_queue_bench("queue_spsc_ring", queue, nitems);
+        }},
+        {"queue_bounded_mpsc_queue", [capacity](uint64_t nitems) {
+          bounded_mpsc_queue<int> queue(capacity);
+          return run_queue_bench("queue_bounded_mpsc_queue", queue, nitems);
+        }},
+        {"queue_blocking_spsc_ring", [capacity](uint64_t nitems) {
+          blocking_queue<spsc_ring<int>> queue(capacity);
+          return run_queue_bench("queue_blocking_spsc_ring", queue, nitems);
+        }}
+      };
+    }
+
+    static std::vector<std::pair<std::string, bench_fn_t>>
+    custom_filter_benchmarks()
+    {
+      std::vector<std::pair<std::string, bench_fn_t>> filters;
+
+      for (int ntaps : {16, 32, 64, 128, 256, 512, 2048}) {
+        for (auto alg_id : {FIR_CUSTOM, FIR_CUSTOM_FFT}) {
+          const std::string name = std::string(alg_id == FIR_CUSTOM ? "custom_filter_direct_"
+                  : "custom_filter_fft_") + std::to_string(ntaps);
+
+          filters.emplace_back(name, [alg_id, ntaps, name](uint64_t nitems) {
+            std::vector<float> taps(ntaps, 1.0f / ntaps);
+            std::vector<double> no_taps;
+
+            auto top = gr::make_top_block("bench");
+            auto block = block_custom_filter::make(alg_id, 1, taps, 0, 0, 0, no_taps, no_taps, 1e6);
+            top->connect(connect_source(top, nitems), 0, block, 0);
+            connect_null_sinks(top, block);
+            return run_bench(name, top, block, nitems);
+          });
+        }
+      }
+
+      return filters;
+    }
+
+    static const std::vector<std::pair<std::string, bench_fn_t>> benchmarks = {
+      {"copy_baseline", bench_copy_baseline},
+      {"signal_averager", bench_signal_averager},
+      {"block_aggregation", bench_block_aggregation},
+      {"block_aggregation_x8", bench_block_aggregation_channels},
+      {"multi_fused_aggregation_x8", bench_multi_fused_aggregation},
+      {"iir_sos_filter_ff", bench_iir_sos_filter_ff},
+      {"median_and_average", bench_median_and_average},
+      {"stft_goertzl_dynamic", bench_stft_goertzl_dynamic},
+      {"demux_ff", bench_demux_ff},
+      {"time_domain_sink", bench_time_domain_sink},
+      {"post_mortem_sink", bench_post_mortem_sink},
+      {"freq_sink_f", bench_freq_sink_f},
+      {"chi_square_fit", bench_chi_square_fit},
+      {"app_buffer", bench_app_buffer}
+    };
+
+    /**********************************************************************
+     * End-to-end cascade benchmark
+     **********************************************************************/
+
+    enum cascade_family_t
+    {
+      CASCADE_FAMILY_STREAMING,
+      CASCADE_FAMILY_TRIGGERED,
+      CASCADE_FAMILY_FREQUENCY,
+      CASCADE_FAMILY_COUNT
+    };
+
+    static const char *cascade_family_names[CASCADE_FAMILY_COUNT] = {"streaming", "triggered", "frequency"};
+
+    static const std::vector<double> cascade_percentiles = {0.5, 0.9, 0.99, 1.0};
+
+    struct latency_recorder_t
+    {
+      std::mutex mutex;
+      std::vector<double> latencies_ms;
+      std::atomic<bool> enabled {false};
+
+      void
+      add(int64_t timestamp_ns)
+      {
+        if (!enabled.load(std::memory_order_relaxed) || timestamp_ns <= 0) {
+          return;
+        }
+
+        timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        const auto latency_ns = (static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec) - timestamp_ns;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        latencies_ms.push_back(latency_ns * 1e-6);
+      }
+    };
+
+    // Latency of the newest acquisition in the package
+    static void
+    record_package_latency(const sink_package_sptr &package, void *userdata)
+    {
+      for (auto it = package->tags.rbegin(); it != package->tags.rend(); ++it) {
+        if (pmt::eq(it->key, acq_info_tag_key())) {
+          static_cast<latency_recorder_t *>(userdata)->add(decode_acq_info_tag(*it).timestamp);
+          return;
+        }
+      }
+    }
+
+    static void
+    record_spectrum_latency(const data_available_event_t *event, void *userdata)
+    {
+      static_cast<latency_recorder_t *>(userdata)->add(event->trigger_timestamp);
+    }
+
+    static double
+    percentile(std::vector<double> &values, double p)
+    {
+      if (values.empty()) {
+        return 0.0;
+      }
+
+      auto nth = values.begin() + static_cast<size_t>(p * (values.size() - 1));
+      std::nth_element(values.begin(), nth, values.end());
+      return *nth;
+    }
+
+    static double
+    cpu_seconds()
+    {
+      rusage usage;
+      getrusage(RUSAGE_SELF, &usage);
+      return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec
+              + 1e-6 * (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec);
+    }
+
+    struct cascade_run_t
+    {
+      uint64_t lost_buffers;
+      double cpu_per_channel;   // fraction of a core, including the simulated driver
+      std::array<std::vector<double>, CASCADE_FAMILY_COUNT> latencies_ms;
+    };
+
+    static cascade_run_t
+    run_cascade(int nchannels, double samp_rate, double duration)
+    {
+      auto top = gr::make_top_block("bench_cascade");
+      std::array<latency_recorder_t, CASCADE_FAMILY_COUNT> recorders;
+      std::vector<simulation_source::sptr> sources;
+
+      // 10 ms chunks
+      const int buffer_size = std::max(static_cast<int>(samp_rate / 100), 1000);
+
+      // A simulation source provides two channels
+      for (int channel = 0; channel < nchannels; channel += 2) {
+        auto source = simulation_source::make();
+        source->set_samp_rate(samp_rate);
+        source->set_auto_arm(true);
+        source->set_buffer_size(buffer_size);
+        source->set_nr_buffers(64);
+        source->set_driver_buffer_size(4 * buffer_size);
+        source->set_streaming(0.001);
+        source->set_stream_generator(SIMULATION_WAVEFORM_SINE, 1.0, 10.0);
+        source->set_stream_pacing(1.0);
+        source->set_aichan_trigger("A", TRIGGER_DIRECTION_RISING, 0.0);
+        sources.push_back(source);
+
+        for (int i = 0; i < 2; i++) {
+          if (channel + i >= nchannels) {
+            top->connect(source, 2 * i, gr::blocks::null_sink::make(sizeof(float)), 0);
+            top->connect(source, 2 * i + 1, gr::blocks::null_sink::make(sizeof(float)), 0);
+            continue;
+          }
+
+          auto cascade = cascade_sink::make(AVERAGE, 0, {}, 10.0, 100.0, 10.0, {}, {}, samp_rate, 1.0,
+                  "ch" + std::to_string(channel + i), "V", true, true, true, true, true, 1000, 1000);
+          top->connect(source, 2 * i, cascade, 0);
+          top->connect(source, 2 * i + 1, cascade, 1);
+
+          for (const auto &sink : cascade->get_time_domain_sinks()) {
+            auto family = sink->get_metadata().name.find("Triggered") != std::string::npos
+                    ? CASCADE_FAMILY_TRIGGERED : CASCADE_FAMILY_STREAMING;
+            sink->set_package_callback(record_package_latency, &recorders[family]);
+          }
+          for (const auto &sink : cascade->get_frequency_domain_sinks()) {
+            sink->set_callback(record_spectrum_latency, &recorders[CASCADE_FAMILY_FREQUENCY]);
+          }
+        }
+
+        top->connect(source, 4, gr::blocks::null_sink::make(sizeof(uint8_t)), 0);
+      }
+
+      auto lost_buffers = [&sources] {
+        uint64_t lost = 0;
+        for (const auto &source : sources) {
+          lost += source->get_metrics().lost_buffers;
+        }
+        return lost;
+      };
+
+      top->start();
+
+      // warm up, i.e. let the buffers fill and the pools settle
+      std::this_thread::sleep_for(std::chrono::seconds(1));
+
+      const auto lost_start = lost_buffers();
+      const auto cpu_start = cpu_seconds();
+      for (auto &recorder : recorders) {
+        recorder.enabled = true;
+      }
+
+      std::this_thread::sleep_for(std::chrono::duration<double>(duration));
+
+      for (auto &recorder : recorders) {
+        recorder.enabled = false;
+      }
+
+      cascade_run_t run;
+      run.cpu_per_channel = (cpu_seconds() - cpu_start) / duration / nchannels;
+      run.lost_buffers = lost_buffers() - lost_start;
+
+      top->stop();
+      top->wait();
+
+      for (int family = 0; family < CASCADE_FAMILY_COUNT; family++) {
+        std::lock_guard<std::mutex> lock(recorders[family].mutex);
+        run.latencies_ms[family] = recorders[family].latencies_ms;
+      }
+
+      return run;
+    }
+
+    static std::vector<bench_result_t>
+    bench_cascade(int max_channels, const std::vector<double> &rates, double duration)
+    {
+      std::vector<bench_result_t> results;
+
+      std::cout << std::left << std::setw(10) << "channels" << std::right << std::setw(14) << "rate [S/s]"
+                << std::setw(8) << "lost" << std::setw(10) << "cpu/ch";
+      for (auto name : cascade_family_names) {
+        std::cout << std::setw(24) << std::string(name) + " p50/p99 [ms]";
+      }
+      std::cout << std::endl;
+
+      for (int nchannels = 1; nchannels <= max_channels; nchannels++) {
+        double best_rate = 0.0;
+        cascade_run_t best {};
+
+        for (auto rate : rates) {
+          auto run = run_cascade(nchannels, rate, duration);
+
+          std::cout << std::left << std::setw(10) << nchannels << std::right << std::fixed << std::setprecision(3)
+                    << std::setw(14) << std::setprecision(0) << rate
+                    << std::setw(8) << run.lost_buffers
+                    << std::setw(10) << std::setprecision(3) << run.cpu_per_channel;
+          for (auto &latencies : run.latencies_ms) {
+            std::ostringstream column;
+            column << std::fixed << std::setprecision(1)
+                   << percentile(latencies, 0.5) << "/" << percentile(latencies, 0.99);
+            std::cout << std::setw(24) << column.str();
+          }
+          std::cout << std::endl;
+
+          if (run.lost_buffers) {
+            break;
+          }
+          best_rate = rate;
+          best = std::move(run);
+        }
+
+        // items are the samples per channel at the highest lossless rate
+        bench_result_t result {"cascade/channels:" + std::to_string(nchannels),
+          static_cast<uint64_t>(best_rate * duration), duration * 1e9, 0.0};
+        result.counters.emplace_back("channels", nchannels);
+        result.counters.emplace_back("cpu_per_channel", best.cpu_per_channel);
+        for (int family = 0; family < CASCADE_FAMILY_COUNT; family++) {
+          for (auto p : cascade_percentiles) {
+            std::ostringstream name;
+            name << "latency_ms_" << cascade_family_names[family] << "_p" << static_cast<int>(p * 100);
+            result.counters.emplace_back(name.str(), percentile(best.latencies_ms[family], p));
+          }
+        }
+        results.push_back(result);
+      }
+
+      return results;
+    }
+
+    /**********************************************************************
+     * Reference waveform benchmarks
+     **********************************************************************/
+
+    struct reference_waveform_t
+    {
+      std::string name;
+      double samp_rate;
+      double frequency;     // of the fundamental, NaN if unknown
+      double band_low;      // range of the spectra and of the peak search
+      double band_high;
+      std::vector<float> samples;
+    };
+
+    static const int REFERENCE_WINDOW = 1024;
+    static const int REFERENCE_NBINS = 101;
+    static const size_t REFERENCE_MAX_WINDOWS = 32;   // windows checked against the reference
+    static const double REFERENCE_SAMP_RATE = 1e6;
+    static const double NOT_AVAILABLE = std::numeric_limits<double>::quiet_NaN();
+
+    /*!
+     * \brief Synthetic waveform of the given tones (frequency, amplitude) with white noise, 2^16
+     * samples at 1 MS/s. The noise is seeded, i.e. the waveform is the same for every run.
+     */
+    static reference_waveform_t
+    make_reference_tones(const std::string &name, const std::vector<std::pair<double, double>> &tones,
+            double noise_rms)
+    {
+      reference_waveform_t waveform {name, REFERENCE_SAMP_RATE, tones.front().first,
+        0.5 * tones.front().first, 1.5 * tones.front().first, std::vector<float>(1 << 16)};
+
+      std::mt19937 generator(42);
+      std::normal_distribution<double> noise(0.0, noise_rms);
+      for (size_t i = 0; i < waveform.samples.size(); i++) {
+        double value = noise(generator);
+        for (const auto &tone : tones) {
+          value += tone.second * std::sin(2.0 * M_PI * tone.first * i / waveform.samp_rate);
+        }
+        waveform.samples[i] = static_cast<float>(value);
+      }
+
+      return waveform;
+    }
+
+    /*!
+     * \brief Waveform of a CSV file, one sample per line. The fundamental is unknown, the peak
+     * is searched below a twentieth of the sample rate. Throws std::runtime_error on failure.
+     */
+    static reference_waveform_t
+    load_reference_csv(const std::string &path, double samp_rate)
+    {
+      reference_waveform_t waveform {"csv_" + path.substr(path.find_last_of('/') + 1), samp_rate,
+        NOT_AVAILABLE, 0.0, samp_rate / 20.0, {}};
+      waveform.name = waveform.name.substr(0, waveform.name.rfind(".csv"));
+
+      std::ifstream in(path);
+      double value;
+      while (in >> value) {
+        waveform.samples.push_back(static_cast<float>(value));
+      }
+
+      if (waveform.samples.size() < 2 * REFERENCE_WINDOW) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": cannot read " << path
+                << " or less than " << 2 * REFERENCE_WINDOW << " samples";
+        throw std::runtime_error(message.str());
+      }
+
+      return waveform;
+    }
+
+    /*!
+     * \brief Peak frequency of a magnitude spectrum within [low, high], refined by a Gaussian
+     * through the largest bin and its neighbours as done by the reference implementation
+     * (SpectrumPeakFitter::gaussPeakPositionEstimate). Bin i is at f0 + i * df.
+     */
+    static double
+    reference_peak(const float *magnitude, int nbins, double f0, double df, double low, double high)
+    {
+      int imax = -1;
+      for (int i = 0; i < nbins; i++) {
+        const double freq = f0 + i * df;
+        if (freq >= low && freq <= high && (imax < 0 || magnitude[i] > magnitude[imax])) {
+          imax = i;
+        }
+      }
+
+      if (imax < 0) {
+        return NOT_AVAILABLE;
+      }
+      if (imax == 0 || imax == nbins - 1) {
+        return f0 + imax * df;
+      }
+
+      const double left = magnitude[imax - 1], center = magnitude[imax], right = magnitude[imax + 1];
+      const double curvature = std::log(center * center / (left * right));
+      if (!(left > 0.0 && right > 0.0 && curvature > 0.0)) {
+        return f0 + imax * df;
+      }
+
+      return f0 + (imax + 0.5 * std::log(right / left) / curvature) * df;
+    }
+
+    /*!
+     * \brief Accuracy of an algorithm, accumulated over the spectra (or estimates) it produced.
+     */
+    struct reference_accuracy_t
+    {
+      double max_rel_error;   // of the magnitudes, each spectrum normalized to its maximum
+      double peak_error_hz;   // peak of the output vs the peak of the reference spectrum
+      double freq_error_hz;   // vs the fundamental of the waveform
+
+      reference_accuracy_t()
+        : max_rel_error(NOT_AVAILABLE), peak_error_hz(NOT_AVAILABLE), freq_error_hz(NOT_AVAILABLE)
+      {
+      }
+
+      static void
+      update(double &max, double value)
+      {
+        if (!std::isnan(value) && (std::isnan(max) || value > max)) {
+          max = value;
+        }
+      }
+
+      // Bins at f0 + i * df, the reference spectrum in double precision
+      void
+      add_spectrum(const float *magnitude, const std::vector<double> &reference, double f0, double df,
+              const reference_waveform_t &waveform)
+      {
+        const int nbins = static_cast<int>(reference.size());
+        const double max_output = *std::max_element(magnitude, magnitude + nbins);
+        const double max_reference = *std::max_element(reference.begin(), reference.end());
+        if (max_output > 0.0 && max_reference > 0.0) {
+          for (int i = 0; i < nbins; i++) {
+            update(max_rel_error, std::abs(magnitude[i] / max_output - reference[i] / max_reference));
+          }
+        }
+
+        const std::vector<float> reference_f(reference.begin(), reference.end());
+        const auto peak = reference_peak(magnitude, nbins, f0, df, waveform.band_low, waveform.band_high);
+        const auto reference_peak_freq = reference_peak(reference_f.data(), nbins, f0, df,
+                waveform.band_low, waveform.band_high);
+        update(peak_error_hz, std::abs(peak - reference_peak_freq));
+        update(freq_error_hz, std::abs(peak - waveform.frequency));
+      }
+    };
+
+    // |sum_m x[m] w[m] exp(-j 2 pi f m / fs)| / norm, in double precision
+    static double
+    reference_dft(const float *x, const std::vector<double> &window, double freq, double samp_rate, double norm)
+    {
+      std::complex<double> sum = 0.0;
+      const double w = 2.0 * M_PI * freq / samp_rate;
+      for (size_t m = 0; m < window.size(); m++) {
+        sum += static_cast<double>(x[m]) * window[m] * std::polar(1.0, -w * m);
+      }
+      return std::abs(sum) / norm;
+    }
+
+    // Repeating source of the waveform in vectors of vlen samples, limited to nvectors
+    static gr::basic_block_sptr
+    connect_waveform_source(gr::top_block_sptr top, const std::vector<float> &samples, uint64_t nvectors,
+            int vlen=1)
+    {
+      std::vector<float> data(samples.begin(), samples.begin() + samples.size() / vlen * vlen);
+      auto source = gr::blocks::vector_source_f::make(data, true, vlen);
+      auto head = gr::blocks::head::make(sizeof(float) * vlen, nvectors);
+      top->connect(source, 0, head, 0);
+      return head;
+    }
+
+    static gr::basic_block_sptr
+    constant_source(float value)
+    {
+      return gr::blocks::vector_source_f::make(std::vector<float> {value}, true);
+    }
+
+    // One of the compared algorithms of a waveform: the speed run (nwindows windows) and the
+    // accuracy run (a single pass over the waveform)
+    struct reference_algorithm_t
+    {
+      std::string name;
+      std::function<bench_result_t(const std::string &name, uint64_t nwindows)> time;
+      std::function<reference_accuracy_t()> accuracy;
+    };
+
+    static reference_accuracy_t
+    stft_accuracy(const reference_waveform_t &waveform, stft_algorithm_id_t alg_id)
+    {
+      const int window = REFERENCE_WINDOW;
+      const double fs = waveform.samp_rate;
+      const bool fft = alg_id == FFT;
+      const int nbins = fft ? window : REFERENCE_NBINS;
+
+      auto top = gr::make_top_block("reference");
+      auto source = gr::blocks::vector_source_f::make(waveform.samples);
+      auto block = stft_algorithms::make(fs, window / fs, window, gr::filter::firdes::WIN_RECTANGULAR,
+              alg_id, waveform.band_low, waveform.band_high, nbins);
+      auto magnitude = gr::blocks::vector_sink_f::make(nbins);
+      top->connect(source, 0, block, 0);
+      top->connect(block, 0, magnitude, 0);
+      top->connect(block, 1, gr::blocks::null_sink::make(sizeof(float) * nbins), 0);
+      top->run();
+
+      // FFT: 2 * window samples per spectrum, bins up to the Nyquist frequency. Goertzel: window
+      // samples, nbins bins spanning the band. Spectra are window samples apart.
+      const int span = fft ? 2 * window : window;
+      const double f0 = fft ? 0.0 : waveform.band_low;
+      const double df = fft ? fs / span : (waveform.band_high - waveform.band_low) / (nbins - 1);
+      const std::vector<double> rectangular(span, 1.0);
+
+      const auto output = magnitude->data();
+      const size_t nspectra = std::min(output.size() / nbins,
+              std::min((waveform.samples.size() - span) / window + 1, REFERENCE_MAX_WINDOWS));
+
+      reference_accuracy_t accuracy;
+      std::vector<double> reference(nbins);
+      for (size_t k = 0; k < nspectra; k++) {
+        for (int i = 0; i < nbins; i++) {
+          reference[i] = reference_dft(&waveform.samples[k * window], rectangular, f0 + i * df, fs, 1.0);
+        }
+        accuracy.add_spectrum(&output[k * nbins], reference, f0, df, waveform);
+      }
+
+      return accuracy;
+    }
+
+    static reference_accuracy_t
+    goertzl_dynamic_accuracy(const reference_waveform_t &waveform)
+    {
+      const int window = REFERENCE_WINDOW, nbins = REFERENCE_NBINS;
+      const double fs = waveform.samp_rate;
+      const std::vector<float> data(waveform.samples.begin(),
+              waveform.samples.begin() + waveform.samples.size() / window * window);
+
+      auto top = gr::make_top_block("reference");
+      auto block = stft_goertzl_dynamic::make(fs, window, nbins);
+      auto magnitude = gr::blocks::vector_sink_f::make(nbins);
+      auto frequency = gr::blocks::vector_sink_f::make(nbins);
+      top->connect(gr::blocks::vector_source_f::make(data, false, window), 0, block, 0);
+      top->connect(gr::blocks::vector_source_f::make(std::vector<float>(data.size() / window, waveform.band_low)), 0, block, 1);
+      top->connect(gr::blocks::vector_source_f::make(std::vector<float>(data.size() / window, waveform.band_high)), 0, block, 2);
+      top->connect(block, 0, magnitude, 0);
+      top->connect(block, 1, gr::blocks::null_sink::make(sizeof(float) * nbins), 0);
+      top->connect(block, 2, frequency, 0);
+      top->run();
+
+      // Hann window, bins at the frequencies reported by the block
+      const auto taps = gr::fft::window::build(gr::fft::window::WIN_HANN, window, 1.0);
+      const std::vector<double> hann(taps.begin(), taps.end());
+
+      const auto output = magnitude->data();
+      const auto freqs = frequency->data();
+      const size_t nspectra = std::min(output.size() / nbins, REFERENCE_MAX_WINDOWS);
+
+      reference_accuracy_t accuracy;
+      std::vector<double> reference(nbins);
+      for (size_t k = 0; k < nspectra; k++) {
+        const double f0 = freqs[k * nbins];
+        const double df = (freqs[k * nbins + nbins - 1] - f0) / (nbins - 1);
+        for (int i = 0; i < nbins; i++) {
+          reference[i] = reference_dft(&data[k * window], hann, freqs[k * nbins + i], fs, 1.0);
+        }
+        accuracy.add_spectrum(&output[k * nbins], reference, f0, df, waveform);
+      }
+
+      return accuracy;
+    }
+
+    // Double precision magnitude spectra (FFT layout: window bins up to the Nyquist frequency,
+    // 2 * window samples each) of consecutive windows, the input of block_spectral_peaks
+    static std::vector<float>
+    reference_spectra(const reference_waveform_t &waveform, size_t nspectra)
+    {
+      const int window = REFERENCE_WINDOW, span = 2 * REFERENCE_WINDOW;
+      const std::vector<double> rectangular(span, 1.0);
+      std::vector<float> spectra;
+
+      for (size_t k = 0; k < nspectra; k++) {
+        for (int i = 0; i < window; i++) {
+          spectra.push_back(static_cast<float>(reference_dft(&waveform.samples[k * span], rectangular,
+                  i * waveform.samp_rate / span, waveform.samp_rate, 1.0)));
+        }
+      }
+
+      return spectra;
+    }
+
+    static reference_accuracy_t
+    spectral_peaks_accuracy(const reference_waveform_t &waveform, const std::vector<float> &spectra)
+    {
+      const int window = REFERENCE_WINDOW;
+      const size_t nspectra = spectra.size() / window;
+      const double df = waveform.samp_rate / (2 * window);
+
+      auto top = gr::make_top_block("reference");
+      auto block = block_spectral_peaks::make(waveform.samp_rate, window, 3, 3, 10);
+      auto peaks = gr::blocks::vector_sink_f::make(1);
+      top->connect(gr::blocks::vector_source_f::make(spectra, false, window), 0, block, 0);
+      top->connect(gr::blocks::vector_source_f::make(std::vector<float>(nspectra, waveform.band_low)), 0, block, 1);
+      top->connect(gr::blocks::vector_source_f::make(std::vector<float>(nspectra, waveform.band_high)), 0, block, 2);
+      top->connect(block, 0, gr::blocks::null_sink::make(sizeof(float) * window), 0);
+      top->connect(block, 1, peaks, 0);
+      top->connect(block, 2, gr::blocks::null_sink::make(sizeof(float)), 0);
+      top->run();
+
+      reference_accuracy_t accuracy;
+      const auto output = peaks->data();
+      for (size_t k = 0; k < std::min(output.size(), nspectra); k++) {
+        const auto peak = reference_peak(&spectra[k * window], window, 0.0, df, waveform.band_low, waveform.band_high);
+        reference_accuracy_t::update(accuracy.peak_error_hz, std::abs(output[k] - peak));
+        reference_accuracy_t::update(accuracy.freq_error_hz, std::abs(output[k] - waveform.frequency));
+      }
+
+      return accuracy;
+    }
+
+    static reference_accuracy_t
+    freq_estimator_accuracy(const reference_waveform_t &waveform)
+    {
+      auto top = gr::make_top_block("reference");
+      auto block = freq_estimator::make(waveform.samp_rate, 4, 10, 1);
+      auto estimates = gr::blocks::vector_sink_f::make(1);
+      top->connect(gr::blocks::vector_source_f::make(waveform.samples), 0, block, 0);
+      top->connect(block, 0, estimates, 0);
+      top->run();
+
+      // The first half lets the averagers settle
+      reference_accuracy_t accuracy;
+      const auto output = estimates->data();
+      for (size_t i = output.size() / 2; i < output.size(); i++) {
+        reference_accuracy_t::update(accuracy.freq_error_hz, std::abs(output[i] - waveform.frequency));
+      }
+
+      return accuracy;
+    }
+
+    static std::vector<reference_algorithm_t>
+    reference_algorithms(const reference_waveform_t &waveform)
+    {
+      std::vector<reference_algorithm_t> algorithms;
+
+      for (auto alg_id : {FFT, GOERTZEL}) {
+        algorithms.push_back({alg_id == FFT ? "stft_fft" : "stft_goertzel",
+          [&waveform, alg_id](const std::string &name, uint64_t nwindows) {
+            auto top = gr::make_top_block("bench");
+            auto block = stft_algorithms::make(waveform.samp_rate, REFERENCE_WINDOW / waveform.samp_rate,
+                    REFERENCE_WINDOW, gr::filter::firdes::WIN_RECTANGULAR, alg_id, waveform.band_low,
+                    waveform.band_high, REFERENCE_NBINS);
+            top->connect(connect_waveform_source(top, waveform.samples, nwindows * REFERENCE_WINDOW), 0, block, 0);
+            connect_null_sinks(top, block);
+            return run_bench(name, top, block, nwindows);
+          },
+          [&waveform, alg_id] { return stft_accuracy(waveform, alg_id); }});
+      }
+
+      algorithms.push_back({"stft_goertzl_dynamic",
+        [&waveform](const std::string &name, uint64_t nwindows) {
+          auto top = gr::make_top_block("bench");
+          auto block = stft_goertzl_dynamic::make(waveform.samp_rate, REFERENCE_WINDOW, REFERENCE_NBINS);
+          top->connect(connect_waveform_source(top, waveform.samples, nwindows, REFERENCE_WINDOW), 0, block, 0);
+          top->connect(constant_source(waveform.band_low), 0, block, 1);
+          top->connect(constant_source(waveform.band_high), 0, block, 2);
+          connect_null_sinks(top, block);
+          return run_bench(name, top, block, nwindows);
+        },
+        [&waveform] { return goertzl_dynamic_accuracy(waveform); }});
+
+      // The spectra are computed once, in double precision
+      const size_t nspectra = std::min(waveform.samples.size() / (2 * REFERENCE_WINDOW), REFERENCE_MAX_WINDOWS);
+      auto spectra = std::make_shared<std::vector<float>>(reference_spectra(waveform, nspectra));
+
+      algorithms.push_back({"block_spectral_peaks",
+        [&waveform, spectra](const std::string &name, uint64_t nwindows) {
+          auto top = gr::make_top_block("bench");
+          auto block = block_spectral_peaks::make(waveform.samp_rate, REFERENCE_WINDOW, 3, 3, 10);
+          top->connect(connect_waveform_source(top, *spectra, nwindows, REFERENCE_WINDOW), 0, block, 0);
+          top->connect(constant_source(waveform.band_low), 0, block, 1);
+          top->connect(constant_source(waveform.band_high), 0, block, 2);
+          connect_null_sinks(top, block);
+          return run_bench(name, top, block, nwindows);
+        },
+        [&waveform, spectra] { return spectral_peaks_accuracy(waveform, *spectra); }});
+
+      // An estimate per sample, the time is reported per window of samples alike
+      if (!std::isnan(waveform.frequency)) {
+        algorithms.push_back({"freq_estimator",
+          [&waveform](const std::string &name, uint64_t nwindows) {
+            auto top = gr::make_top_block("bench");
+            auto block = freq_estimator::make(waveform.samp_rate, 4, 10, 1);
+            top->connect(connect_waveform_source(top, waveform.samples, nwindows * REFERENCE_WINDOW), 0, block, 0);
+            connect_null_sinks(top, block);
+            return run_bench(name, top, block, nwindows);
+          },
+          [&waveform] { return freq_estimator_accuracy(waveform); }});
+      }
+
+      return algorithms;
+    }
+
+    static std::string
+    format_accuracy(double value, bool scientific)
+    {
+      if (std::isnan(value)) {
+        return "-";
+      }
+
+      std::ostringstream text;
+      if (scientific) {
+        text << std::scientific << std::setprecision(2) << value;
+      }
+      else {
+        text << std::fixed << std::setprecision(3) << value;
+      }
+      return text.str();
+    }
+
+    static std::vector<bench_result_t>
+    bench_reference(const std::vector<reference_waveform_t> &waveforms, const std::string &filter,
+            uint64_t nitems, int repetitions)
+    {
+      std::vector<bench_result_t> results;
+      const uint64_t nwindows = std::max(nitems / REFERENCE_WINDOW, uint64_t {16});
+
+      std::cout << std::left << std::setw(48) << "benchmark" << std::right
+                << std::setw(14) << "ns/window" << std::setw(14) << "rel error"
+                << std::setw(16) << "peak error [Hz]" << std::setw(16) << "freq error [Hz]" << std::endl;
+
+      for (const auto &waveform : waveforms) {
+        for (const auto &algorithm : reference_algorithms(waveform)) {
+          const auto name = waveform.name + "/" + algorithm.name;
+          if (name.find(filter) == std::string::npos) {
+            continue;
+          }
+
+          auto best = algorithm.time(name, nwindows);
+          for (int i = 1; i < repetitions; i++) {
+            auto result = algorithm.time(name, nwindows);
+            if (result.wall_ns / result.items < best.wall_ns / best.items) {
+              best = result;
+            }
+          }
+
+          const double ns_per_window = best.wall_ns / best.items;
+
+          // Accuracies not applicable are left out of the results
+          const auto accuracy = algorithm.accuracy();
+          for (const auto &counter : {std::make_pair("max_rel_error", accuracy.max_rel_error),
+                  std::make_pair("peak_error_hz", accuracy.peak_error_hz),
+                  std::make_pair("freq_error_hz", accuracy.freq_error_hz)}) {
+            if (!std::isnan(counter.second)) {
+              best.counters.emplace_back(counter.first, counter.second);
+            }
+          }
+          results.push_back(best);
+
+          std::cout << std::left << std::setw(48) << name << std::right << std::fixed << std::setprecision(1)
+                    << std::setw(14) << ns_per_window
+                    << std::setw(14) << format_accuracy(accuracy.max_rel_error, true)
+                    << std::setw(16) << format_accuracy(accuracy.peak_error_hz, false)
+                    << std::setw(16) << format_accuracy(accuracy.freq_error_hz, false) << std::endl;
+        }
+      }
+
+      return results;
+    }
+
+    static void
+    write_json(std::ostream &out, const std::vector<bench_result_t> &results)
+    {
+      char date[64];
+      auto now = std::time(nullptr);
+      std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+
+      out << "{\n"
+          << "  \"context\": {\n"
+          << "    \"date\": \"" << date << "\",\n"
+          << "    \"executable\": \"bench-digitizers\",\n"
+          << "    \"num_cpus\": " << std::thread::hardware_concurrency() << ",\n"
+          << "    \"kernel_isa\": \"" << kernel_isa_name(get_kernel_isa()) << "\"\n"
+          << "  },\n"
+          << "  \"benchmarks\": [\n";
+
+      for (size_t i = 0; i < results.size(); i++) {
+        const auto &r = results[i];
+        out << "    {\n"
+            << "      \"name\": \"" << r.name << "\",\n"
+            << "      \"iterations\": " << r.items << ",\n"
+            << "      \"real_time\": " << (r.items ? r.wall_ns / r.items : 0.0) << ",\n"
+            << "      \"cpu_time\": " << (r.items ? (r.work_ns > 0 ? r.work_ns : r.wall_ns) / r.items : 0.0) << ",\n"
+            << "      \"time_unit\": \"ns\",\n"
+            << "      \"items_per_second\": " << r.items / (r.wall_ns * 1e-9);
+        for (const auto &counter : r.counters) {
+          out << ",\n      \"" << counter.first << "\": " << counter.second;
+        }
+        out << "\n"
+            << "    }" << (i + 1 < results.size() ? "," : "") << "\n";
+      }
+
+      out << "  ]\n"
+          << "}\n";
+    }
+
+  } /* namespace digitizers */
+} /* namespace gr */
+
+int
+main (int argc, char **argv)
+{
+  using namespace gr::digitizers;
+
+  po::options_description desc("Allowed options");
+  desc.add_options()
+      ("help", "produce help message")
+      ("filter", po::value<std::string>()->default_value(""), "run benchmarks whose name contains this string")
+      ("items", po::value<uint64_t>()->default_value(10000000), "samples per benchmark run")
+      ("repetitions", po::value<int>()->default_value(3), "runs per benchmark, the fastest is reported")
+      ("json", po::value<std::string>(), "write results to this file")
+      ("allocations", "count the heap allocations within work of the benchmarked blocks")
+      ("cascade", "run the end-to-end cascade_sink benchmark instead")
+      ("channels", po::value<int>()->default_value(4), "cascade: maximum number of channels")
+      ("rates", po::value<std::string>()->default_value("100000,200000,500000,1000000,2000000,5000000,10000000"),
+              "cascade: input rates per channel to step through, comma separated")
+      ("duration", po::value<double>()->default_value(5.0), "cascade: measurement time per rate in seconds")
+      ("reference", "run the spectral algorithm comparison on reference waveforms instead")
+      ("waveform", po::value<std::string>()->default_value(DIGITIZERS_REFERENCE_WAVEFORM),
+              "reference: recorded waveform, CSV with a sample per line, empty for the synthetic ones only")
+      ("waveform-rate", po::value<double>()->default_value(1e6), "reference: sample rate of the recorded waveform")
+  ;
+
+  po::variables_map vm;
+  po::store(po::parse_command_line(argc, argv, desc), vm);
+  po::notify(vm);
+
+  if (vm.count("help")) {
+    std::cout << desc << "\n";
+    return 1;
+  }
+
+  const auto filter = vm["filter"].as<std::string>();
+  const auto nitems = vm["items"].as<uint64_t>();
+  const auto repetitions = std::max(vm["repetitions"].as<int>(), 1);
+
+  if (vm.count("allocations")) {
+    set_block_stats_enabled(true);
+  }
+
+  std::vector<bench_result_t> results;
+
+  if (vm.count("cascade")) {
+    std::vector<double> rates;
+    std::istringstream list(vm["rates"].as<std::string>());
+    std::string rate;
+    while (std::getline(list, rate, ',')) {
+      rates.push_back(std::stod(rate));
+    }
+    std::sort(rates.begin(), rates.end());
+
+    results = bench_cascade(vm["channels"].as<int>(), rates, vm["duration"].as<double>());
+  }
+  else if (vm.count("reference")) {
+    std::vector<reference_waveform_t> waveforms = {
+      make_reference_tones("sine_10kHz_800mV", {{10e3, 0.8}}, 1e-3),
+      make_reference_tones("sine_10kHz_800mV_snr20", {{10e3, 0.8}}, 0.8 / std::sqrt(2.0) / 10.0),
+      make_reference_tones("two_tone_10kHz_23kHz", {{10e3, 0.8}, {23.4e3, 0.2}}, 1e-3)
+    };
+
+    const auto path = vm["waveform"].as<std::string>();
+    if (!path.empty()) {
+      try {
+        waveforms.push_back(load_reference_csv(path, vm["waveform-rate"].as<double>()));
+      }
+      catch (const std::exception &e) {
+        std::cerr << e.what() << ", the recorded waveform is skipped" << std::endl;
+      }
+    }
+
+    results = bench_reference(waveforms, filter, nitems, repetitions);
+  }
+  else {
+    std::cout << std::left << std::setw(24) << "benchmark" << std::right
+              << std::setw(14) << "ns/sample" << std::setw(14) << "work ns/sample"
+              << std::setw(14) << "Msamples/s" << std::endl;
+
+    auto all_benchmarks = benchmarks;
+    for (const auto &kernel : kernel_benchmarks()) {
+      all_benchmarks.push_back(kernel);
+    }
+    for (const auto &custom_filter : custom_filter_benchmarks()) {
+      all_benchmarks.push_back(custom_filter);
+    }
+    for (const auto &median : median_filter_benchmarks()) {
+      all_benchmarks.push_back(median);
+    }
+    for (const auto &queue : queue_benchmarks()) {
+      all_benchmarks.push_back(queue);
+    }
+
+    for (const auto &benchmark : all_benchmarks) {
+      if (benchmark.first.find(filter) == std::string::npos) {
+        continue;
+      }
+
+      auto best = benchmark.second(nitems);
+      for (int i = 1; i < repetitions; i++) {
+        auto result = benchmark.second(nitems);
+        if (result.wall_ns / result.items < best.wall_ns / best.items) {
+          best = result;
+        }
+      }
+      results.push_back(best);
+
+      std::cout << std::left << std::setw(24) << best.name << std::right << std::fixed << std::setprecision(3)
+                << std::setw(14) << best.wall_ns / best.items
+                << std::setw(14) << best.work_ns / best.items
+                << std::setw(14) << best.items / (best.wall_ns * 1e-3);
+      for (const auto &counter : best.counters) {
+        std::cout << "  " << counter.first << "=" << counter.second;
+      }
+      std::cout << std::endl;
+    }
+  }
+
+  if (vm.count("json")) {
+    std::ofstream out(vm["json"].as<std::string>());
+    write_json(out, results);
+    if (!out) {
+      std::cerr << "cannot write " << vm["json"].as<std::string>() << std::endl;
+      return 1;
+    }
+  }
+
+  return 0;
+}
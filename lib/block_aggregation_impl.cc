@@ -10,6 +10,8 @@
 
 #include <gnuradio/io_signature.h>
 #include "block_aggregation_impl.h"
+#include "block_custom_filter_impl.h"
+#include "design_cache.h"
 #include "digitizers/status.h"
 
 namespace gr {
@@ -25,10 +27,11 @@ namespace gr {
         double tr_width,
         const std::vector<double> &fb_user_taps,
         const std::vector<double> &fw_user_taps,
-        double samp_rate)
+        double samp_rate,
+        bool compute_errors)
     {
       return gnuradio::get_initial_sptr
-        (new block_aggregation_impl(algorithm_id_t(alg_id), decim, delay, fir_taps, low_freq, up_freq, tr_width, fb_user_taps, fw_user_taps, samp_rate));
+        (new block_aggregation_impl(algorithm_id_t(alg_id), decim, delay, fir_taps, low_freq, up_freq, tr_width, fb_user_taps, fw_user_taps, samp_rate, true, compute_errors));
     }
 
     /*
@@ -43,28 +46,61 @@ namespace gr {
             double tr_width,
             const std::vector<double> &fb_user_taps,
             const std::vector<double> &fw_user_taps,
-            double samp_rate)
+            double samp_rate,
+            bool fused,
+            bool compute_errors)
       : gr::hier_block2("block_aggregation",
-              gr::io_signature::make(2, 2, sizeof(float)),
-              gr::io_signature::make(2, 2, sizeof(float))),
+              gr::io_signature::make(compute_errors ? 2 : 1, compute_errors ? 2 : 1, sizeof(float)),
+              gr::io_signature::make(compute_errors ? 2 : 1, compute_errors ? 2 : 1, sizeof(float))),
         d_samp_rate(samp_rate),
         d_averaging(false)
     {
+      const int nports = compute_errors ? 2 : 1;
+
       if(alg_id == algorithm_id_t::AVERAGE){
         d_averaging = true;
-        d_avg = signal_averager::make(2, decim, samp_rate);
-        connect(self(), 0, d_avg, 0);
-        connect(self(), 1, d_avg, 1);
+        d_avg = signal_averager::make(nports, decim, samp_rate);
+        for (int port = 0; port < nports; port++) {
+          connect(self(), port, d_avg, port);
+          connect(d_avg, port, self(), port);
+        }
+      }
+      else if(alg_id == algorithm_id_t::CIC){
+        // the error sums are skipped if the errors ports are not connected
+        d_cic = cic_aggregation_ff::make(decim, delay, low_freq, up_freq, samp_rate);
+        for (int port = 0; port < nports; port++) {
+          connect(self(), port, d_cic, port);
+          connect(d_cic, port, self(), port);
+        }
+      }
+      else if(fused && fused_aggregation_ff::is_supported(alg_id)){
+        d_fused = fused_aggregation_ff::make(alg_id, decim, delay, fir_taps, low_freq, up_freq, tr_width, samp_rate);
+        for (int port = 0; port < nports; port++) {
+          connect(self(), port, d_fused, port);
+          connect(d_fused, port, self(), port);
+        }
+      }
+      else if(!compute_errors){
+        // values only, i.e. the upper branch of the graph below
+        d_fil0 = block_custom_filter::make(alg_id, 1, fir_taps, low_freq, up_freq, tr_width, fb_user_taps, fw_user_taps, samp_rate);
+        d_keep_nth = gr::digitizers::decimate_and_adjust_timebase::make(decim, d_fil0->get_delay_approximation(), samp_rate);
+        d_del = gr::blocks::delay::make(sizeof(float), delay);
 
-        connect(d_avg, 0, self(), 0);
-        connect(d_avg, 1, self(), 1);
+        connect(self(), 0, d_fil0, 0);
+        connect(d_fil0, 0, d_del, 0);
+        connect(d_del, 0, d_keep_nth, 0);
+        connect(d_keep_nth, 0, self(), 0);
       }
       else{
-        d_helper = aggregation_helper::make(decim, (up_freq-low_freq)/samp_rate);
+        // Only the value filter needs to run at the input rate since its output
+        // is filtered again. The other filters decimate, i.e. FIR filters compute
+        // outputs only at the output instants (polyphase), and the helper circuit
+        // just combines the decimated streams.
+        d_helper = aggregation_helper::make(1, (up_freq-low_freq)/samp_rate);
         d_fil0 = block_custom_filter::make(alg_id, 1, fir_taps, low_freq, up_freq, tr_width, fb_user_taps, fw_user_taps, samp_rate);
-        d_fil1 = block_custom_filter::make(alg_id, 1, fir_taps, low_freq, up_freq, tr_width, fb_user_taps, fw_user_taps, samp_rate);
-        d_fil2 = block_custom_filter::make(alg_id, 1, fir_taps, low_freq, up_freq, tr_width, fb_user_taps, fw_user_taps, samp_rate);
-        d_fil3 = block_custom_filter::make(alg_id, 1, fir_taps, low_freq, up_freq, tr_width, fb_user_taps, fw_user_taps, samp_rate);
+        d_fil1 = block_custom_filter::make(alg_id, decim, fir_taps, low_freq, up_freq, tr_width, fb_user_taps, fw_user_taps, samp_rate);
+        d_fil2 = block_custom_filter::make(alg_id, decim, fir_taps, low_freq, up_freq, tr_width, fb_user_taps, fw_user_taps, samp_rate);
+        d_fil3 = block_custom_filter::make(alg_id, decim, fir_taps, low_freq, up_freq, tr_width, fb_user_taps, fw_user_taps, samp_rate);
         double delay_approx = d_fil0->get_delay_approximation();
 
         // Note, d_keep_nth is the only path where the tags are propagated
@@ -110,6 +146,36 @@ namespace gr {
     {
     }
 
+    void
+    block_aggregation_impl::set_demand(const demand_node_t::sptr &demand)
+    {
+      if (d_fused) {
+        d_fused->set_demand(demand);
+      }
+      if (d_cic) {
+        d_cic->set_demand(demand);
+      }
+    }
+
+    void
+    block_aggregation_impl::set_state_file(const state_file_t::sptr &file, const std::string &key)
+    {
+      if (d_fused) {
+        d_fused->set_state_file(file, key);
+      }
+      if (d_cic) {
+        d_cic->set_state_file(file, key);
+      }
+
+      // graph of filters, the filters are null if not instantiated
+      const block_custom_filter::sptr filters[] = {d_fil0, d_fil1, d_fil2, d_fil3};
+      for (int i = 0; i < 4; i++) {
+        if (auto filter = boost::dynamic_pointer_cast<persistent_filter_t>(filters[i])) {
+          filter->set_state_file(file, key + "/filter" + std::to_string(i));
+        }
+      }
+    }
+
 
     void
     block_aggregation_impl::update_design(int delay,
@@ -121,12 +187,20 @@ namespace gr {
         const std::vector<double> &fw_user_taps,
         double samp_rate)
     {
-      if(!d_averaging) {
-        d_helper->update_design((up_freq-low_freq)/samp_rate);
+      if(d_fused) {
+        d_fused->update_design(delay, fir_taps, low_freq, up_freq, tr_width, samp_rate);
+      }
+      else if(d_cic) {
+        d_cic->update_design(delay, low_freq, up_freq, samp_rate);
+      }
+      else if(!d_averaging) {
         d_fil0->update_design(fir_taps, low_freq, up_freq, tr_width, fb_user_taps, fw_user_taps, samp_rate);
-        d_fil1->update_design(fir_taps, low_freq, up_freq, tr_width, fb_user_taps, fw_user_taps, samp_rate);
-        d_fil2->update_design(fir_taps, low_freq, up_freq, tr_width, fb_user_taps, fw_user_taps, samp_rate);
-        d_fil3->update_design(fir_taps, low_freq, up_freq, tr_width, fb_user_taps, fw_user_taps, samp_rate);
+        if(d_helper) {
+          d_helper->update_design((up_freq-low_freq)/samp_rate);
+          d_fil1->update_design(fir_taps, low_freq, up_freq, tr_width, fb_user_taps, fw_user_taps, samp_rate);
+          d_fil2->update_design(fir_taps, low_freq, up_freq, tr_width, fb_user_taps, fw_user_taps, samp_rate);
+          d_fil3->update_design(fir_taps, low_freq, up_freq, tr_width, fb_user_taps, fw_user_taps, samp_rate);
+        }
         d_del->set_dly(delay);
       }
     }
@@ -142,15 +216,22 @@ namespace gr {
         gr::filter::firdes::win_type win_type,
         double beta = 6.76)
     {
-      if(!d_averaging) {
-        d_helper->update_design((high_cutoff_freq - low_cutoff_freq) / d_samp_rate);
-
-        auto fir_taps = gr::filter::firdes::low_pass(gain, d_samp_rate, high_cutoff_freq, transition_width, win_type, beta);
+      auto fir_taps = cached_low_pass(gain, d_samp_rate, high_cutoff_freq, transition_width, win_type, beta);
 
+      if(d_fused) {
+        d_fused->set_taps(static_cast<int>(d_samp_rate * delay), fir_taps, (high_cutoff_freq - low_cutoff_freq) / d_samp_rate);
+      }
+      else if(d_cic) {
+        d_cic->update_design(static_cast<int>(d_samp_rate * delay), low_cutoff_freq, high_cutoff_freq, d_samp_rate);
+      }
+      else if(!d_averaging) {
         d_fil0->update_design(fir_taps, low_cutoff_freq, high_cutoff_freq, transition_width, fb_user_taps, fw_user_taps, d_samp_rate);
-        d_fil1->update_design(fir_taps, low_cutoff_freq, high_cutoff_freq, transition_width, fb_user_taps, fw_user_taps, d_samp_rate);
-        d_fil2->update_design(fir_taps, low_cutoff_freq, high_cutoff_freq, transition_width, fb_user_taps, fw_user_taps, d_samp_rate);
-        d_fil3->update_design(fir_taps, low_cutoff_freq, high_cutoff_freq, transition_width, fb_user_taps, fw_user_taps, d_samp_rate);
+        if(d_helper) {
+          d_helper->update_design((high_cutoff_freq - low_cutoff_freq) / d_samp_rate);
+          d_fil1->update_design(fir_taps, low_cutoff_freq, high_cutoff_freq, transition_width, fb_user_taps, fw_user_taps, d_samp_rate);
+          d_fil2->update_design(fir_taps, low_cutoff_freq, high_cutoff_freq, transition_width, fb_user_taps, fw_user_taps, d_samp_rate);
+          d_fil3->update_design(fir_taps, low_cutoff_freq, high_cutoff_freq, transition_width, fb_user_taps, fw_user_taps, d_samp_rate);
+        }
         auto delay_samples = static_cast<int>(d_samp_rate * delay);
         d_del->set_dly(delay_samples);
       }
@@ -15,6 +15,8 @@
 #include <gnuradio/blocks/delay.h>
 #include <gnuradio/blocks/multiply_ff.h>
 #include "digitizers/status.h"
+#include "fused_aggregation_impl.h"
+#include "cic_aggregation_impl.h"
 
 namespace gr {
   namespace digitizers {
@@ -24,6 +26,14 @@ namespace gr {
    *
    * User can adjust the parameters in runtime, but the algorithmID has to be chosen
    * beforehand.
+   *
+   * FIR algorithms are by default implemented by a single fused_aggregation_ff block. The
+   * graph of filters and helper blocks is used for the other algorithms or if explicitly
+   * requested (reference implementation, e.g. for testing). The CIC algorithm is always
+   * implemented by a single cic_aggregation_ff block, the FIR taps are not used.
+   *
+   * Without errors only the value filter, the delay and the decimation are instantiated (the
+   * graph is cut down to a quarter of the filters), the fused blocks skip the error sums.
    */
     class block_aggregation_impl : public block_aggregation
     {
@@ -35,6 +45,8 @@ namespace gr {
       // the reason of using this helper block is to fix the timebase_info tag
       decimate_and_adjust_timebase::sptr d_keep_nth;
       signal_averager::sptr d_avg;
+      fused_aggregation_ff::sptr d_fused;
+      cic_aggregation_ff::sptr d_cic;
       double d_samp_rate;
       bool d_averaging;
      public:
@@ -48,7 +60,9 @@ namespace gr {
           double tr_width,
           const std::vector<double> &fb_user_taps,
           const std::vector<double> &fw_user_taps,
-          double samp_rate);
+          double samp_rate,
+          bool fused=true,
+          bool compute_errors=true);
 
       ~block_aggregation_impl();
 
@@ -72,6 +86,20 @@ namespace gr {
           double beta) override;
 
       void update_out_delay(int delay);
+
+      /*!
+       * \brief Pauses the aggregation while nobody reads its outputs, see
+       * fused_aggregation_ff::set_demand. Only the fused FIR and the CIC implementations pause,
+       * the others keep computing. Must be set before the flowgraph is started.
+       */
+      void set_demand(const demand_node_t::sptr &demand);
+
+      /*!
+       * \brief Persists the filter states under key, see state_file_t. Covers the fused FIR,
+       * the CIC and the IIR filters, the FIR filters of the graph and the averaging keep no
+       * state beyond their input window. Must be called before the flowgraph is started.
+       */
+      void set_state_file(const state_file_t::sptr &file, const std::string &key);
     };
 
   } // namespace digitizers
@@ -11,6 +11,7 @@
 #include <gnuradio/io_signature.h>
 #include "block_amplitude_and_phase_impl.h"
 #include <gnuradio/filter/firdes.h>
+#include "design_cache.h"
 
 namespace gr {
   namespace digitizers {
@@ -22,10 +23,15 @@ namespace gr {
       double gain,
       double up_freq,
       double tr_width,
-      int hilbert_window)
+      int hilbert_window,
+      bool decimate_products,
+      amplitude_phase_reference_t reference,
+      double ref_freq,
+      int freq_decim)
     {
       return gnuradio::get_initial_sptr
-        (new block_amplitude_and_phase_impl(samp_rate, delay, decim, gain, up_freq, tr_width, hilbert_window));
+        (new block_amplitude_and_phase_impl(samp_rate, delay, decim, gain, up_freq, tr_width,
+                hilbert_window, decimate_products, reference, ref_freq, freq_decim));
     }
 
     /*
@@ -37,26 +43,32 @@ namespace gr {
       double gain,
       double up_freq,
       double tr_width,
-      int hilbert_window)
+      int hilbert_window,
+      bool decimate_products,
+      amplitude_phase_reference_t reference,
+      double ref_freq,
+      int freq_decim)
       : gr::hier_block2("block_amplitude_and_phase",
-          gr::io_signature::make(2, 2, sizeof(float)),
+          gr::io_signature::make(reference == REFERENCE_NCO ? 1 : 2, reference == REFERENCE_NCO ? 1 : 2, sizeof(float)),
           gr::io_signature::make(1, 1, sizeof(gr_complex))),
-       d_samp_rate(samp_rate)
+       d_samp_rate(samp_rate),
+       d_low_pass_rate(decimate_products ? samp_rate / decim : samp_rate)
     {
-      d_hil_sig = filter::hilbert_fc::make(hilbert_window);
-      d_hil_ref = filter::hilbert_fc::make(hilbert_window);
-      d_help = amplitude_and_phase_helper::make();
-      d_low_pass = filter::fir_filter_ccf::make(decim, filter::firdes::low_pass(gain, samp_rate, up_freq, tr_width));
+      // hilbert transforms, amplitude_and_phase_helper and the low pass in a single block
+      d_fused = fused_amplitude_and_phase_fc::make(decim, hilbert_window,
+              cached_low_pass(gain, d_low_pass_rate, up_freq, tr_width), decimate_products,
+              reference, ref_freq, samp_rate);
       /*Connections*/
-      //signal
-      connect(self(), 0, d_hil_sig, 0);
-      connect(d_hil_sig, 0, d_help, 0);
-      //reference
-      connect(self(), 1, d_hil_ref, 0);
-      connect(d_hil_ref, 0, d_help , 1);
-      //low pass
-      connect(d_help, 0, d_low_pass, 0);
-      connect(d_low_pass, 0, self(), 0);
+      connect(self(), 0, d_fused, 0);
+      if (reference == REFERENCE_NCO_LOCKED && freq_decim > 1) {
+        d_freq_repeat = blocks::repeat::make(sizeof(float), freq_decim);
+        connect(self(), 1, d_freq_repeat, 0);
+        connect(d_freq_repeat, 0, d_fused, 1);
+      }
+      else if (reference != REFERENCE_NCO) {
+        connect(self(), 1, d_fused, 1);
+      }
+      connect(d_fused, 0, self(), 0);
     }
 
     /*
@@ -70,8 +82,14 @@ namespace gr {
     block_amplitude_and_phase_impl::update_design(double delay,
             double gain, double up_freq, double tr_width)
     {
-      d_low_pass->set_taps(filter::firdes::low_pass(gain, d_samp_rate, up_freq, tr_width));
-      d_del->set_dly(static_cast<int>(delay * d_samp_rate));
+      // the delay is not applied (there is no delay block in the circuit)
+      d_fused->set_taps(cached_low_pass(gain, d_low_pass_rate, up_freq, tr_width));
+    }
+
+    void
+    block_amplitude_and_phase_impl::set_reference_freq(double ref_freq)
+    {
+      d_fused->set_reference_freq(ref_freq);
     }
   } /* namespace digitizers */
 } /* namespace gr */
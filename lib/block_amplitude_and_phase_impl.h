@@ -9,12 +9,8 @@
 
 #include <digitizers/block_amplitude_and_phase.h>
 
-#include <gnuradio/blocks/complex_to_magphase.h>
-#include <gnuradio/blocks/delay.h>
-#include <gnuradio/filter/hilbert_fc.h>
-#include <gnuradio/filter/fir_filter_ccf.h>
-#include <gnuradio/blocks/multiply_const_ff.h>
-#include "digitizers/amplitude_and_phase_helper.h"
+#include <gnuradio/blocks/repeat.h>
+#include "fused_amplitude_and_phase_impl.h"
 
 namespace gr {
   namespace digitizers {
@@ -23,11 +19,9 @@ namespace gr {
     {
      private:
       double d_samp_rate;
-      blocks::delay::sptr d_del;
-      filter::hilbert_fc::sptr d_hil_sig;
-      filter::hilbert_fc::sptr  d_hil_ref;
-      amplitude_and_phase_helper::sptr  d_help;
-      filter::fir_filter_ccf::sptr  d_low_pass;
+      double d_low_pass_rate;   // sample rate of the low pass
+      fused_amplitude_and_phase_fc::sptr d_fused;
+      blocks::repeat::sptr d_freq_repeat;   // measured frequency to the input rate
      public:
       block_amplitude_and_phase_impl(double samp_rate,
         double delay,
@@ -35,7 +29,11 @@ namespace gr {
         double gain,
         double up_freq,
         double tr_width,
-        int hilbert_window);
+        int hilbert_window,
+        bool decimate_products,
+        amplitude_phase_reference_t reference,
+        double ref_freq,
+        int freq_decim);
 
       ~block_amplitude_and_phase_impl();
 
@@ -43,6 +41,8 @@ namespace gr {
         double gain,
         double up_freq,
         double tr_width);
+
+      void set_reference_freq(double ref_freq);
     };
 
   } // namespace digitizers
@@ -10,12 +10,117 @@
 
 #include <gnuradio/io_signature.h>
 #include "block_complex_to_mag_deg_impl.h"
+#include "cpu_dispatch.h"
 #include <volk/volk.h>
-#include <gnuradio/math.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
 namespace gr {
   namespace digitizers {
 
+    /**********************************************************************
+     * Phase in degrees
+     *********************************************************************/
+
+    // Minimax polynomial of atan(t) for 0 <= t <= 1, max. error 1.2e-5 rad (about 7e-4 deg)
+    static const float ATAN_C1 = 0.9998660f;
+    static const float ATAN_C3 = -0.3302995f;
+    static const float ATAN_C5 = 0.1801410f;
+    static const float ATAN_C7 = -0.0851330f;
+    static const float ATAN_C9 = 0.0208351f;
+    static const float HALF_PI = 1.57079637f;
+    static const float PI = 3.14159274f;
+    static const float RAD2DEG = 180.0 / M_PI;
+
+    static inline float
+    phase_deg(float x, float y)
+    {
+      const float ax = std::fabs(x);
+      const float ay = std::fabs(y);
+      const float mx = std::max(ax, ay);
+      const float mn = std::min(ax, ay);
+      const float t = mn / std::max(mx, std::numeric_limits<float>::min());
+      const float t2 = t * t;
+
+      float a = t * (ATAN_C1 + t2 * (ATAN_C3 + t2 * (ATAN_C5 + t2 * (ATAN_C7 + t2 * ATAN_C9))));
+      a = ay > ax ? HALF_PI - a : a;
+      a = x < 0.0f ? PI - a : a;
+      return RAD2DEG * std::copysign(a, y);
+    }
+
+    static void
+    phase_deg_generic(const gr_complex *in, float *degs, int n)
+    {
+      for (int i = 0; i < n; i++) {
+        degs[i] = phase_deg(in[i].real(), in[i].imag());
+      }
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    // Same operations in the same order as phase_deg, i.e. the results are identical
+    __attribute__((target("avx2")))
+    static void
+    phase_deg_avx2(const gr_complex *in, float *degs, int n)
+    {
+      const float *iq = (const float *) in;
+      const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+      const __m256 sign_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x80000000));
+      const __m256 tiny = _mm256_set1_ps(std::numeric_limits<float>::min());
+      const __m256 zero = _mm256_setzero_ps();
+
+      int i = 0;
+      for (; i + 8 <= n; i += 8) {
+        // x0 y0 x1 y1 x2 y2 x3 y3 | x4 y4 x5 y5 x6 y6 x7 y7 -> x0..x7, y0..y7
+        const __m256 lo = _mm256_loadu_ps(iq + 2 * i);
+        const __m256 hi = _mm256_loadu_ps(iq + 2 * i + 8);
+        const __m256 x = _mm256_castpd_ps(_mm256_permute4x64_pd(
+                _mm256_castps_pd(_mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0))), _MM_SHUFFLE(3, 1, 2, 0)));
+        const __m256 y = _mm256_castpd_ps(_mm256_permute4x64_pd(
+                _mm256_castps_pd(_mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1))), _MM_SHUFFLE(3, 1, 2, 0)));
+
+        const __m256 ax = _mm256_and_ps(x, abs_mask);
+        const __m256 ay = _mm256_and_ps(y, abs_mask);
+        const __m256 mx = _mm256_max_ps(ax, ay);
+        const __m256 mn = _mm256_min_ps(ax, ay);
+        const __m256 t = _mm256_div_ps(mn, _mm256_max_ps(mx, tiny));
+        const __m256 t2 = _mm256_mul_ps(t, t);
+
+        __m256 a = _mm256_add_ps(_mm256_set1_ps(ATAN_C7), _mm256_mul_ps(t2, _mm256_set1_ps(ATAN_C9)));
+        a = _mm256_add_ps(_mm256_set1_ps(ATAN_C5), _mm256_mul_ps(t2, a));
+        a = _mm256_add_ps(_mm256_set1_ps(ATAN_C3), _mm256_mul_ps(t2, a));
+        a = _mm256_add_ps(_mm256_set1_ps(ATAN_C1), _mm256_mul_ps(t2, a));
+        a = _mm256_mul_ps(t, a);
+
+        a = _mm256_blendv_ps(a, _mm256_sub_ps(_mm256_set1_ps(HALF_PI), a), _mm256_cmp_ps(ay, ax, _CMP_GT_OQ));
+        a = _mm256_blendv_ps(a, _mm256_sub_ps(_mm256_set1_ps(PI), a), _mm256_cmp_ps(x, zero, _CMP_LT_OQ));
+        a = _mm256_or_ps(a, _mm256_and_ps(y, sign_mask));
+
+        _mm256_storeu_ps(degs + i, _mm256_mul_ps(_mm256_set1_ps(RAD2DEG), a));
+      }
+
+      phase_deg_generic(in + i, degs + i, n - i);
+    }
+#endif
+
+    typedef void (*phase_deg_kernel_t)(const gr_complex *, float *, int);
+
+    static phase_deg_kernel_t
+    select_phase_deg_kernel()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+      if (get_kernel_isa() >= KERNEL_ISA_AVX2) {
+        return phase_deg_avx2;
+      }
+#endif
+      return phase_deg_generic;
+    }
+
     block_complex_to_mag_deg::sptr
     block_complex_to_mag_deg::make(int vec_len)
     {
@@ -45,17 +150,18 @@ namespace gr {
         gr_vector_const_void_star &input_items,
         gr_vector_void_star &output_items)
     {
+      block_stats_scope_t stats(d_stats);
       const gr_complex *in = (const gr_complex *) input_items[0];
       float *mags = (float *) output_items[0];
       float *degs = (float *) output_items[1];
 
-      double rad2deg = 180.0 / M_PI;
+      // kernel is selected once, on first use
+      static const phase_deg_kernel_t phase_kernel = select_phase_deg_kernel();
+
       int noi = noutput_items * d_vec_len;
 
       volk_32fc_magnitude_32f_u(mags, in, noi);
-      for(int i = 0; i < noi; i++) {
-        degs[i] = rad2deg * gr::fast_atan2f(in[i]);
-      }
+      phase_kernel(in, degs, noi);
 
       // Tell runtime system how many output items we produced.
       return noutput_items;
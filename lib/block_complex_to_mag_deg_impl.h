@@ -8,6 +8,7 @@
 #define INCLUDED_DIGITIZERS_BLOCK_COMPLEX_TO_MAG_DEG_IMPL_H
 
 #include <digitizers/block_complex_to_mag_deg.h>
+#include "block_stats_impl.h"
 
 namespace gr {
   namespace digitizers {
@@ -17,6 +18,8 @@ namespace gr {
      private:
       int d_vec_len;
 
+      block_stats_recorder_t d_stats {this};
+
      public:
       block_complex_to_mag_deg_impl(int vel_len);
       ~block_complex_to_mag_deg_impl();
@@ -10,6 +10,8 @@
 
 #include <gnuradio/io_signature.h>
 #include "block_custom_filter_impl.h"
+#include "design_cache.h"
+#include "sos_design.h"
 #include <math.h>
 namespace gr {
   namespace digitizers {
@@ -63,6 +65,11 @@ namespace gr {
           (new block_custom_filter_iir_custom(decimation, fir_taps, low_freq, up_freq,
              tr_width, fb_user_taps, fw_user_taps, samp_rate));
         break;
+      case FIR_AUTO:
+        return_ptr = gnuradio::get_initial_sptr
+          (new block_custom_filter_fir_auto(decimation, fir_taps, low_freq, up_freq,
+             tr_width, fb_user_taps, fw_user_taps, samp_rate));
+        break;
       default:
         std::ostringstream message;
         message << "Exception in " << __FILE__ << ":" << __LINE__ << ": No algorithm with specified ID: " << alg_id;
@@ -90,7 +97,7 @@ namespace gr {
           gr::io_signature::make(1, 1, sizeof(float))),
           d_samp_rate(samp_rate)
     {
-      auto filter_design = gr::filter::firdes::low_pass(1,
+      auto filter_design = cached_low_pass(1,
         samp_rate,up_freq, tr_width);
       d_fir_filter = gr::filter::fir_filter_fff::make(decimation, filter_design);
       connect(self(), 0, d_fir_filter, 0);
@@ -111,7 +118,7 @@ namespace gr {
      const std::vector<double> &fw_user_taps,
      double samp_rate)
     {
-      auto filter_design = gr::filter::firdes::low_pass(1, samp_rate,
+      auto filter_design = cached_low_pass(1, samp_rate,
         up_freq, tr_width, gr::filter::firdes::win_type::WIN_HAMMING);
       d_fir_filter->set_taps(filter_design);
     }
@@ -138,7 +145,7 @@ namespace gr {
           gr::io_signature::make(1, 1, sizeof(float))),
           d_samp_rate(samp_rate)
     {
-      auto filter_design = gr::filter::firdes::band_pass(1,
+      auto filter_design = cached_band_pass(1,
         samp_rate, low_freq, up_freq, tr_width );
       d_fir_filter = gr::filter::fir_filter_fff::make(decimation, filter_design);
       connect(self(), 0, d_fir_filter, 0);
@@ -159,7 +166,7 @@ namespace gr {
       const std::vector<double> &fw_user_taps,
       double samp_rate)
     {
-      auto filter_design = gr::filter::firdes::band_pass(1,
+      auto filter_design = cached_band_pass(1,
         samp_rate, low_freq, up_freq, tr_width);
       d_fir_filter->set_taps(filter_design);
     }
@@ -274,12 +281,10 @@ namespace gr {
           gr::io_signature::make(1, 1, sizeof(float))),
           d_up_freq(up_freq)
     {
-      d_iir_filter1 = gr::filter::single_pole_iir_filter_ff::make(calculate_alpha(samp_rate, d_up_freq), 1);
-      d_iir_filter2 = gr::filter::single_pole_iir_filter_ff::make(calculate_alpha(samp_rate, d_up_freq), 1);
+      d_iir_filter = gnuradio::get_initial_sptr(new iir_sos_filter_ff_impl(1, make_sections(samp_rate, d_up_freq)));
       d_keep_one = gr::blocks::keep_one_in_n::make(sizeof(float), decimation);
-      connect(self(), 0, d_iir_filter1, 0);
-      connect(d_iir_filter1, 0, d_iir_filter2, 0);
-      connect(d_iir_filter2, 0, d_keep_one, 0);
+      connect(self(), 0, d_iir_filter, 0);
+      connect(d_iir_filter, 0, d_keep_one, 0);
       connect(d_keep_one, 0, self(), 0);
     }
 
@@ -287,6 +292,12 @@ namespace gr {
     {
     }
 
+    void
+    block_custom_filter_iir_lp::set_state_file(const state_file_t::sptr &file, const std::string &key)
+    {
+      d_iir_filter->set_state_file(file, key);
+    }
+
     double
     block_custom_filter_iir_lp::calculate_alpha(double sample_rate, double upper_frequency)
     {
@@ -295,6 +306,15 @@ namespace gr {
       return (2.0 * M_PI * ts * freq_max_corr) / ((2.0 * M_PI * ts * freq_max_corr) + 1.0);
     }
 
+    std::vector<sos_section_t>
+    block_custom_filter_iir_lp::make_sections(double sample_rate, double upper_frequency)
+    {
+      // two cascaded single pole low pass filters: y = alpha * x + (1 - alpha) * y[n-1]
+      const float alpha = calculate_alpha(sample_rate, upper_frequency);
+      const sos_section_t single_pole {alpha, 0.0f, 0.0f, -(1.0f - alpha), 0.0f};
+      return std::vector<sos_section_t> {single_pole, single_pole};
+    }
+
     void
     block_custom_filter_iir_lp::update_design(
       const std::vector<float> &fir_taps,
@@ -306,8 +326,7 @@ namespace gr {
       double samp_rate)
     {
       d_up_freq = up_freq;
-      d_iir_filter1->set_taps(calculate_alpha(samp_rate, d_up_freq));
-      d_iir_filter2->set_taps(calculate_alpha(samp_rate, d_up_freq));
+      d_iir_filter->set_sections(make_sections(samp_rate, d_up_freq));
     }
 
     double
@@ -332,16 +351,7 @@ namespace gr {
           d_low_freq(low_freq),
           d_samp_rate(samp_rate)
     {
-      double alphaHp = calc_alphaHP(samp_rate, d_low_freq);
-      std::vector<double> fw_user_taps_double;
-      std::vector<double> fb_user_taps_double;
-      fw_user_taps_double.push_back(0.0);
-      fw_user_taps_double.push_back(alphaHp);
-      fw_user_taps_double.push_back(-alphaHp);
-      fb_user_taps_double.push_back(1.0);
-      fb_user_taps_double.push_back(alphaHp);
-
-      d_iir_filter = gr::filter::iir_filter_ffd::make(fw_user_taps_double, fb_user_taps_double, true);
+      d_iir_filter = gnuradio::get_initial_sptr(new iir_sos_filter_ff_impl(1, make_sections(samp_rate, d_low_freq)));
       d_keep_one = gr::blocks::keep_one_in_n::make(sizeof(float), decimation);
       connect(self(), 0, d_iir_filter, 0);
       connect(d_iir_filter, 0, d_keep_one, 0);
@@ -355,10 +365,24 @@ namespace gr {
       return 1.0 / ((2.0 * M_PI * ts * lower_frequency) + 1.0);
     }
 
+    std::vector<sos_section_t>
+    block_custom_filter_iir_hp::make_sections(double sample_rate, double lower_frequency)
+    {
+      // y = alpha * (x[n-1] - x[n-2]) + alpha * y[n-1]
+      const float alpha = calc_alphaHP(sample_rate, lower_frequency);
+      return std::vector<sos_section_t> {sos_section_t {0.0f, alpha, -alpha, -alpha, 0.0f}};
+    }
+
     block_custom_filter_iir_hp::~block_custom_filter_iir_hp()
     {
     }
 
+    void
+    block_custom_filter_iir_hp::set_state_file(const state_file_t::sptr &file, const std::string &key)
+    {
+      d_iir_filter->set_state_file(file, key);
+    }
+
     void
     block_custom_filter_iir_hp::update_design(
       const std::vector<float> &fir_taps,
@@ -371,15 +395,7 @@ namespace gr {
     {
       d_samp_rate = samp_rate;
       d_low_freq = low_freq;
-      double alphaHp = calc_alphaHP(samp_rate, low_freq);
-      std::vector<double> fw_user_taps_double;
-      std::vector<double> fb_user_taps_double;
-      fw_user_taps_double.push_back(0.0);
-      fw_user_taps_double.push_back(alphaHp);
-      fw_user_taps_double.push_back(-alphaHp);
-      fb_user_taps_double.push_back(1.0);
-      fb_user_taps_double.push_back(alphaHp);
-      d_iir_filter->set_taps(fw_user_taps_double, fb_user_taps_double);
+      d_iir_filter->set_sections(make_sections(samp_rate, low_freq));
     }
 
     double
@@ -404,7 +420,7 @@ namespace gr {
         d_low_freq(low_freq),
         d_samp_rate(samp_rate)
     {
-      d_iir_filter = gr::filter::iir_filter_ffd::make(fw_user_taps, fb_user_taps, false);
+      d_iir_filter = gnuradio::get_initial_sptr(new iir_sos_filter_ff_impl(1, tf_to_sos(fw_user_taps, fb_user_taps)));
       d_keep_one = gr::blocks::keep_one_in_n::make(sizeof(float), decimation);
       connect(self(), 0, d_iir_filter, 0);
       connect(d_iir_filter, 0, d_keep_one, 0);
@@ -415,6 +431,12 @@ namespace gr {
     {
     }
 
+    void
+    block_custom_filter_iir_custom::set_state_file(const state_file_t::sptr &file, const std::string &key)
+    {
+      d_iir_filter->set_state_file(file, key);
+    }
+
     void
     block_custom_filter_iir_custom::update_design(
       const std::vector<float> &fir_taps,
@@ -434,6 +456,114 @@ namespace gr {
       return 0.0;
     }
 
+    // ALGORITHM 8 (FIR AUTO)
+    block_custom_filter_fir_auto::block_custom_filter_fir_auto(int decimation,
+      const std::vector<float> &fir_taps,
+      double low_freq,
+      double up_freq,
+      double tr_width,
+      const std::vector<double> &fb_user_taps,
+      const std::vector<double> &fw_user_taps,
+      double samp_rate)
+      : gr::hier_block2("block_custom_filter",
+          gr::io_signature::make(1, 1, sizeof(float)),
+          gr::io_signature::make(1, 1, sizeof(float))),
+          d_decimation(decimation),
+          d_samp_rate(samp_rate)
+    {
+      auto taps = design_taps(fir_taps, up_freq, tr_width, samp_rate);
+      make_engine(fir_cost_model_t::instance().select(taps.size(), d_decimation), taps);
+      connect(self(), 0, engine_block(), 0);
+      connect(engine_block(), 0, self(), 0);
+    }
+
+    block_custom_filter_fir_auto::~block_custom_filter_fir_auto()
+    {
+    }
+
+    std::vector<float>
+    block_custom_filter_fir_auto::design_taps(const std::vector<float> &fir_taps,
+      double up_freq, double tr_width, double samp_rate) const
+    {
+      if (!fir_taps.empty()) {
+        return fir_taps;
+      }
+
+      return cached_low_pass(1, samp_rate, up_freq, tr_width, gr::filter::firdes::win_type::WIN_HAMMING);
+    }
+
+    gr::basic_block_sptr
+    block_custom_filter_fir_auto::engine_block() const
+    {
+      if (d_engine == FIR_ENGINE_FFT) {
+        return d_fft_filter;
+      }
+      return d_fir_filter;
+    }
+
+    void
+    block_custom_filter_fir_auto::make_engine(fir_engine_t engine, const std::vector<float> &taps)
+    {
+      d_fir_filter.reset();
+      d_fft_filter.reset();
+
+      if (engine == FIR_ENGINE_FFT) {
+        d_fft_filter = gr::filter::fft_filter_fff::make(d_decimation, taps);
+      }
+      else {
+        d_fir_filter = gr::filter::fir_filter_fff::make(d_decimation, taps);
+      }
+
+      d_engine = engine;
+    }
+
+    void
+    block_custom_filter_fir_auto::update_design(
+      const std::vector<float> &fir_taps,
+      double low_freq,
+      double up_freq,
+      double tr_width,
+      const std::vector<double> &fb_user_taps,
+      const std::vector<double> &fw_user_taps,
+      double samp_rate)
+    {
+      d_samp_rate = samp_rate;
+      auto taps = design_taps(fir_taps, up_freq, tr_width, samp_rate);
+      auto engine = fir_cost_model_t::instance().select(taps.size(), d_decimation);
+
+      if (engine == d_engine) {
+        if (engine == FIR_ENGINE_FFT) {
+          d_fft_filter->set_taps(taps);
+        }
+        else {
+          d_fir_filter->set_taps(taps);
+        }
+        return;
+      }
+
+      lock();
+      try {
+        disconnect(self(), 0, engine_block(), 0);
+        disconnect(engine_block(), 0, self(), 0);
+        make_engine(engine, taps);
+        connect(self(), 0, engine_block(), 0);
+        connect(engine_block(), 0, self(), 0);
+      }
+      catch (...) {
+        unlock();
+        throw;
+      }
+      unlock();
+    }
+
+    double
+    block_custom_filter_fir_auto::get_delay_approximation()
+    {
+      double length = 1.0 * (d_engine == FIR_ENGINE_FFT ? d_fft_filter->taps().size()
+              : d_fir_filter->taps().size());
+      return length / (2.0 * d_samp_rate);
+    }
+
   } /* namespace digitizers */
 } /* namespace gr */
 
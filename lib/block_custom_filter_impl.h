@@ -11,12 +11,13 @@
 #include <boost/shared_ptr.hpp>
 #include <gnuradio/blocks/keep_one_in_n.h>
 #include <gnuradio/filter/firdes.h>
-#include <gnuradio/filter/single_pole_iir_filter_ff.h>
 #include <gnuradio/filter/fft_filter_fff.h>
 #include <gnuradio/filter/fir_filter_fff.h>
 #include <gnuradio/filter/fir_filter.h>
 #include <gnuradio/filter/fft_filter.h>
-#include <gnuradio/filter/iir_filter_ffd.h>
+#include "fir_cost_model.h"
+#include "iir_sos_filter_ff_impl.h"
+#include "state_file.h"
 
 namespace gr {
   namespace digitizers {
@@ -194,6 +195,21 @@ namespace gr {
       double get_delay_approximation();
     };
 
+  /**
+   * \brief Implementations whose filter state can be persisted, i.e. the IIR filters (the
+   * FIR filters of GNU Radio keep their history in the input buffer).
+   */
+  class persistent_filter_t
+  {
+   public:
+    virtual ~persistent_filter_t() {}
+
+    /**
+     * \brief See iir_sos_filter_ff_impl::set_state_file.
+     */
+    virtual void set_state_file(const state_file_t::sptr &file, const std::string &key) = 0;
+  };
+
   /**
    * \brief Infinite impulse repsonse low pass filtering implementation.
    *
@@ -207,16 +223,17 @@ namespace gr {
    * \param samp_rate Sampling rate
    * \param decimation Decimating factor
    */
-  class block_custom_filter_iir_lp : public block_custom_filter
+  class block_custom_filter_iir_lp : public block_custom_filter, public persistent_filter_t
   {
    private:
     // Nothing to declare in this block.
-    boost::shared_ptr<gr::filter::single_pole_iir_filter_ff> d_iir_filter1, d_iir_filter2;
+    boost::shared_ptr<iir_sos_filter_ff_impl> d_iir_filter;
     boost::shared_ptr<gr::blocks::keep_one_in_n> d_keep_one;
     double d_samp_rate;
     double d_up_freq;
 
     double calculate_alpha(double samp_rate, double upper_frequency);
+    std::vector<sos_section_t> make_sections(double samp_rate, double upper_frequency);
      public:
       block_custom_filter_iir_lp(int decimation,
           const std::vector<float> &fir_taps,
@@ -229,6 +246,8 @@ namespace gr {
 
       ~block_custom_filter_iir_lp();
 
+      void set_state_file(const state_file_t::sptr &file, const std::string &key) override;
+
      protected:
       void update_design(
           const std::vector<float> &fir_taps,
@@ -254,16 +273,17 @@ namespace gr {
    * \param low_freq Upper cutoff frequency
    * \param samp_rate Sampling rate
    */
-  class block_custom_filter_iir_hp : public block_custom_filter
+  class block_custom_filter_iir_hp : public block_custom_filter, public persistent_filter_t
     {
      private:
       // Nothing to declare in this block.
-      boost::shared_ptr<gr::filter::iir_filter_ffd> d_iir_filter;
+      boost::shared_ptr<iir_sos_filter_ff_impl> d_iir_filter;
       boost::shared_ptr<gr::blocks::keep_one_in_n> d_keep_one;
       double d_low_freq;
       double d_samp_rate;
 
       double calc_alphaHP(double sample_rate, double freq_min);
+      std::vector<sos_section_t> make_sections(double sample_rate, double freq_min);
      public:
       block_custom_filter_iir_hp(int decimation,
           const std::vector<float> &fir_taps,
@@ -276,6 +296,8 @@ namespace gr {
 
       ~block_custom_filter_iir_hp();
 
+      void set_state_file(const state_file_t::sptr &file, const std::string &key) override;
+
      protected:
       void update_design(
           const std::vector<float> &fir_taps,
@@ -294,6 +316,7 @@ namespace gr {
      *
      * Has all settings to be compatible with all the other path implementations,
      * yet the only parameters that affect it are fw_user_taps, fb_user_taps and decimation.
+     * The taps are converted into second-order sections, see iir_sos_filter_ff.
      *
      * Filter diagram(User defined):
      *   _/\__/--|_/-\____
@@ -302,11 +325,11 @@ namespace gr {
      * \param fb_user_taps Feed backward user defined taps
      * \param decimation Decimating factor
      */
-  class block_custom_filter_iir_custom : public block_custom_filter
+  class block_custom_filter_iir_custom : public block_custom_filter, public persistent_filter_t
     {
      private:
       // Nothing to declare in this block.
-    boost::shared_ptr<gr::filter::iir_filter_ffd> d_iir_filter;
+    boost::shared_ptr<iir_sos_filter_ff_impl> d_iir_filter;
     boost::shared_ptr<gr::blocks::keep_one_in_n> d_keep_one;
     double d_low_freq;
     double d_samp_rate;
@@ -322,6 +345,59 @@ namespace gr {
 
       ~block_custom_filter_iir_custom();
 
+      void set_state_file(const state_file_t::sptr &file, const std::string &key) override;
+
+     protected:
+      void update_design(
+          const std::vector<float> &fir_taps,
+          double low_freq,
+          double up_freq,
+          double tr_width,
+          const std::vector<double> &fb_user_taps,
+          const std::vector<double> &fw_user_taps,
+          double samp_rate);
+
+      double get_delay_approximation();
+    };
+
+  /**
+   * \brief FIR filtering implementation picking the engine per design.
+   *
+   * Uses fir_taps if not empty, the FIR_LP design (up_freq and tr_width) otherwise. The direct
+   * form (polyphase if decimating) or the FFT overlap-save engine is picked by the cost model
+   * (see fir_cost_model.h), again on each update_design. Switching the engine reconnects the
+   * filter under the flowgraph lock, i.e. the block must be part of a flowgraph by then.
+   */
+  class block_custom_filter_fir_auto : public block_custom_filter
+    {
+     private:
+      gr::filter::fir_filter_fff::sptr d_fir_filter;
+      gr::filter::fft_filter_fff::sptr d_fft_filter;
+      fir_engine_t d_engine;
+      int d_decimation;
+      double d_samp_rate;
+
+      std::vector<float> design_taps(const std::vector<float> &fir_taps,
+          double up_freq, double tr_width, double samp_rate) const;
+
+      gr::basic_block_sptr engine_block() const;
+
+      void make_engine(fir_engine_t engine, const std::vector<float> &taps);
+
+     public:
+      block_custom_filter_fir_auto(int decimation,
+          const std::vector<float> &fir_taps,
+          double low_freq,
+          double up_freq,
+          double tr_width,
+          const std::vector<double> &fb_user_taps,
+          const std::vector<double> &fw_user_taps,
+          double samp_rate);
+
+      ~block_custom_filter_fir_auto();
+
+      fir_engine_t get_engine() const { return d_engine; }
+
      protected:
       void update_design(
           const std::vector<float> &fir_taps,
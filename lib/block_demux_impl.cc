@@ -10,25 +10,113 @@
 
 #include <gnuradio/io_signature.h>
 #include "block_demux_impl.h"
+#include "cpu_dispatch.h"
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
 
 namespace gr {
   namespace digitizers {
 
+    /**********************************************************************
+     * Bit unpacking kernels
+     *********************************************************************/
+
+    // Samples per chunk, i.e. the input chunk stays in L1 while all the bits are extracted
+    static const int DEMUX_CHUNK = 4096;
+
+    template <typename T>
+    __attribute__((always_inline))
+    static inline void
+    unpack_bits(const uint8_t *in, int nitems, const uint8_t *bits, int nbits, T **out)
+    {
+      for (int c = 0; c < nitems; c += DEMUX_CHUNK) {
+        const int n = std::min(DEMUX_CHUNK, nitems - c);
+        for (int b = 0; b < nbits; b++) {
+          const int shift = bits[b];
+          T *o = out[b] + c;
+          for (int i = 0; i < n; i++) {
+            o[i] = static_cast<T>((in[c + i] >> shift) & 1);
+          }
+        }
+      }
+    }
+
+    template <typename T>
+    static void
+    unpack_bits_generic(const uint8_t *in, int nitems, const uint8_t *bits, int nbits, T **out)
+    {
+      unpack_bits(in, nitems, bits, nbits, out);
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    template <typename T>
+    __attribute__((target("avx2")))
+    static void
+    unpack_bits_avx2(const uint8_t *in, int nitems, const uint8_t *bits, int nbits, T **out)
+    {
+      unpack_bits(in, nitems, bits, nbits, out);
+    }
+#endif
+
+    template <typename T>
+    static void
+    demux(const uint8_t *in, int nitems, const uint8_t *bits, int nbits, T **out)
+    {
+      typedef void (*kernel_t)(const uint8_t *, int, const uint8_t *, int, T **);
+
+      // kernel is selected once, on first use
+      static const kernel_t kernel = []() -> kernel_t {
+#if defined(__x86_64__) || defined(__i386__)
+        if (get_kernel_isa() >= KERNEL_ISA_AVX2) {
+          return unpack_bits_avx2<T>;
+        }
+#endif
+        return unpack_bits_generic<T>;
+      }();
+
+      kernel(in, nitems, bits, nbits, out);
+    }
+
+    /**********************************************************************
+     * Block
+     *********************************************************************/
+
     block_demux::sptr
-    block_demux::make(int bit_to_keep)
+    block_demux::make(int bit_to_keep, int bit_mask, bool byte_output)
     {
+      if (bit_mask < 0 || bit_mask > 0xff) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid bit mask: " << bit_mask;
+        throw std::invalid_argument(message.str());
+      }
+
+      std::vector<uint8_t> bits;
+      if (bit_mask == 0) {
+        bits.push_back(bit_to_keep);
+      }
+      else {
+        for (int bit = 0; bit < 8; bit++) {
+          if (bit_mask & (1 << bit)) {
+            bits.push_back(bit);
+          }
+        }
+      }
+
       return gnuradio::get_initial_sptr
-        (new block_demux_impl(bit_to_keep));
+        (new block_demux_impl(bits, byte_output));
     }
 
     /*
      * The private constructor
      */
-    block_demux_impl::block_demux_impl(int bit_to_keep)
+    block_demux_impl::block_demux_impl(const std::vector<uint8_t> &bits, bool byte_output)
       : gr::sync_block("block_demux",
               gr::io_signature::make(1, 1, sizeof(char)),
-              gr::io_signature::make(1, 1, sizeof(float))),
-              d_bit(bit_to_keep)
+              gr::io_signature::make(bits.size(), bits.size(), byte_output ? sizeof(uint8_t) : sizeof(float))),
+              d_bits(bits),
+              d_byte_output(byte_output)
     {}
 
     /*
@@ -43,11 +131,14 @@ namespace gr {
         gr_vector_const_void_star &input_items,
         gr_vector_void_star &output_items)
     {
-      const char *in = (const char *) input_items[0];
-      float *out = (float *) output_items[0];
+      block_stats_scope_t stats(d_stats);
+      const uint8_t *in = (const uint8_t *) input_items[0];
 
-      for(int i = 0; i < noutput_items; i++) {
-        out[i] = ((in[i] >> d_bit) & 1);
+      if (d_byte_output) {
+        demux(in, noutput_items, d_bits.data(), d_bits.size(), (uint8_t **) &output_items[0]);
+      }
+      else {
+        demux(in, noutput_items, d_bits.data(), d_bits.size(), (float **) &output_items[0]);
       }
 
       return noutput_items;
@@ -55,4 +146,3 @@ namespace gr {
 
   } /* namespace digitizers */
 } /* namespace gr */
-
@@ -9,16 +9,22 @@
 
 #include <digitizers/block_demux.h>
 
+#include <vector>
+#include "block_stats_impl.h"
+
 namespace gr {
   namespace digitizers {
 
     class block_demux_impl : public block_demux
     {
      private:
-      uint8_t d_bit;
+      std::vector<uint8_t> d_bits;  // bit extracted by each output
+      bool d_byte_output;
+      block_stats_recorder_t d_stats {this};
+
      public:
 
-      block_demux_impl(int bit_to_keep);
+      block_demux_impl(const std::vector<uint8_t> &bits, bool byte_output);
 
       ~block_demux_impl();
 
@@ -31,4 +37,3 @@ namespace gr {
 } // namespace gr
 
 #endif /* INCLUDED_DIGITIZERS_BLOCK_DEMUX_IMPL_H */
-
@@ -41,6 +41,7 @@ namespace gr {
         gr_vector_const_void_star &input_items,
         gr_vector_void_star &output_items)
     {
+      block_stats_scope_t stats(d_stats);
       const float *in_sig = (const float *) input_items[0];
       const float *in_err = (const float *) input_items[1];
       float *out_sig = (float *) output_items[0];
@@ -8,6 +8,7 @@
 #define INCLUDED_DIGITIZERS_BLOCK_SCALING_OFFSET_IMPL_H
 
 #include <digitizers/block_scaling_offset.h>
+#include "block_stats_impl.h"
 
 namespace gr {
   namespace digitizers {
@@ -18,6 +19,8 @@ namespace gr {
       double d_scale;
       double d_offset;
 
+      block_stats_recorder_t d_stats {this};
+
      public:
       block_scaling_offset_impl(double scale, double offset);
       ~block_scaling_offset_impl();
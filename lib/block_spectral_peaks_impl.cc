@@ -10,7 +10,6 @@
 
 #include <gnuradio/io_signature.h>
 #include "block_spectral_peaks_impl.h"
-#include <gnuradio/filter/firdes.h>
 
 namespace gr {
   namespace digitizers {
@@ -20,19 +19,20 @@ namespace gr {
         int vec_len,
         int n_med,
         int n_avg,
-        int n_prox)
+        int n_prox,
+        int n_peaks)
     {
       std::vector<int> out_sig;
       out_sig.push_back(vec_len * sizeof(float));
-      out_sig.push_back(sizeof(float));
-      out_sig.push_back(sizeof(float));
+      out_sig.push_back(sizeof(float) * n_peaks);
+      out_sig.push_back(sizeof(float) * n_peaks);
       std::vector<int> in_sig = {
           static_cast<int>(sizeof(float) * vec_len),
-          static_cast<int>(sizeof(float)),
-          static_cast<int>(sizeof(float))
+          static_cast<int>(sizeof(float) * n_peaks),
+          static_cast<int>(sizeof(float) * n_peaks)
       };
       return gnuradio::get_initial_sptr
-        (new block_spectral_peaks_impl(samp_rate, vec_len, out_sig, in_sig, n_med, n_avg, n_prox));
+        (new block_spectral_peaks_impl(samp_rate, vec_len, out_sig, in_sig, n_med, n_avg, n_prox, n_peaks));
     }
 
     /*
@@ -44,21 +44,17 @@ namespace gr {
         std::vector<int> in_sig,
         int n_med,
         int n_avg,
-        int n_prox)
+        int n_prox,
+        int n_peaks)
       : gr::hier_block2("block_spectral_peaks",
               gr::io_signature::makev(3, 3, in_sig),
               gr::io_signature::makev(3, 3, out_sig))
     {
-      d_med_avg = digitizers::median_and_average::make(vec_len, n_med, n_avg);
-      d_peaks = digitizers::peak_detector::make(samp_rate, vec_len, n_prox);
-      connect(self(), 0, d_med_avg, 0);
-      connect(self(), 0, d_peaks, 0);
-      connect(self(), 1, d_peaks, 2);
-      connect(self(), 2, d_peaks, 3);
-      connect(d_med_avg, 0, d_peaks, 1);
-      connect(d_med_avg, 0, self(), 0);
-      connect(d_peaks, 0, self(), 1);
-      connect(d_peaks, 1, self(), 2);
+      d_peaks = fused_spectral_peaks_ff::make(samp_rate, vec_len, n_med, n_avg, n_prox, n_peaks);
+      for (int port = 0; port < 3; port++) {
+        connect(self(), port, d_peaks, port);
+        connect(d_peaks, port, self(), port);
+      }
     }
 
     block_spectral_peaks_impl::~block_spectral_peaks_impl()
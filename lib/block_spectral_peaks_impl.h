@@ -8,9 +8,7 @@
 #define INCLUDED_DIGITIZERS_BLOCK_SPECTRAL_PEAKS_IMPL_H
 
 #include <digitizers/block_spectral_peaks.h>
-#include <digitizers/median_and_average.h>
-#include <digitizers/peak_detector.h>
-#include <gnuradio/blocks/vector_to_stream.h>
+#include "fused_spectral_peaks_impl.h"
 
 namespace gr {
   namespace digitizers {
@@ -18,10 +16,7 @@ namespace gr {
     class block_spectral_peaks_impl : public block_spectral_peaks
     {
      private:
-      // Nothing to declare in this block.
-      median_and_average::sptr d_med_avg;
-      peak_detector::sptr d_peaks;
-      blocks::vector_to_stream::sptr d_vec2str;
+      fused_spectral_peaks_ff::sptr d_peaks;
      public:
       block_spectral_peaks_impl(double samp_rate,
           int vec_len,
@@ -29,7 +24,8 @@ namespace gr {
           std::vector<int> in_sig,
           int n_med,
           int n_avg,
-          int n_prox);
+          int n_prox,
+          int n_peaks);
 
       ~block_spectral_peaks_impl();
 
@@ -0,0 +1,372 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "block_stats_impl.h"
+#include <digitizers/tags.h>
+#include <gnuradio/block_detail.h>
+#include <gnuradio/buffer.h>
+
+#include <algorithm>
+
+namespace gr {
+  namespace digitizers {
+
+    namespace {
+
+      struct registry_t
+      {
+        std::mutex mutex;
+        std::vector<block_stats_recorder_t *> recorders;
+      };
+
+      registry_t &
+      registry()
+      {
+        static registry_t instance;
+        return instance;
+      }
+
+      int64_t
+      realtime_ns()
+      {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+      }
+
+    } // namespace
+
+    std::atomic<bool> &
+    block_stats_recorder_t::enabled_flag()
+    {
+      static std::atomic<bool> flag(false);
+      return flag;
+    }
+
+    block_stats_recorder_t::block_stats_recorder_t(gr::block *block)
+      : d_block(block),
+        d_loss_baseline(0),
+        d_work_start_allocations(0)
+    {
+      reset();
+
+      auto &reg = registry();
+      std::lock_guard<std::mutex> lock(reg.mutex);
+      reg.recorders.push_back(this);
+    }
+
+    block_stats_recorder_t::~block_stats_recorder_t()
+    {
+      auto &reg = registry();
+      std::lock_guard<std::mutex> lock(reg.mutex);
+      reg.recorders.erase(std::remove(reg.recorders.begin(), reg.recorders.end(), this),
+              reg.recorders.end());
+    }
+
+    void
+    block_stats_recorder_t::reset()
+    {
+      std::lock_guard<std::mutex> lock(d_mutex);
+
+      d_work_calls = 0;
+      d_work_time_ns = 0;
+      d_items = 0;
+      d_tags_count = 0;
+      d_data_age_ns = 0;
+      d_max_data_age_ns = 0;
+      d_sum_data_age_ns = 0.0;
+      d_data_age_count = 0;
+      d_allocations = 0;
+      d_allocating_calls = 0;
+      d_buffer_occupancy = 0.0;
+      d_max_buffer_occupancy = 0.0;
+      d_loss_baseline = d_loss_counter ? d_loss_counter() : 0;
+
+      d_started = false;
+      d_last_nitems = 0;
+      d_reset_time = std::chrono::steady_clock::now();
+      d_work_start = d_reset_time;
+
+      d_has_acq_info = false;
+      d_acq_info_offset = 0;
+      d_acq_info_timestamp = 0;
+      d_acq_info_timebase = 0.0;
+    }
+
+    void
+    block_stats_recorder_t::set_loss_counter(std::function<uint64_t()> counter)
+    {
+      std::lock_guard<std::mutex> lock(d_mutex);
+      d_loss_counter = counter;
+      d_loss_baseline = counter ? counter() : 0;
+    }
+
+    void
+    block_stats_recorder_t::update_acq_info(const gr::tag_t &tag)
+    {
+      try {
+        auto acq_info = decode_acq_info_tag(tag);
+        d_has_acq_info = true;
+        d_acq_info_offset = tag.offset;
+        d_acq_info_timestamp = acq_info.timestamp;
+        d_acq_info_timebase = acq_info.timebase;
+      }
+      catch (const std::exception &) {
+        // Malformed tags are reported by the blocks consuming them
+      }
+    }
+
+    uint64_t
+    block_stats_recorder_t::account()
+    {
+      const auto detail = d_block->detail();
+      const bool has_inputs = detail->ninputs() > 0;
+      const uint64_t nitems = has_inputs ? d_block->nitems_read(0) : d_block->nitems_written(0);
+
+      if (nitems <= d_last_nitems) {
+        return nitems;
+      }
+
+      d_items += nitems - d_last_nitems;
+
+      // The last acq_info tag consumed determines the timestamp of the next sample
+      d_tags.clear();
+      for (int i = 0; i < detail->ninputs(); i++) {
+        detail->get_tags_in_range(d_tags, i, d_last_nitems, nitems, d_block->unique_id());
+        d_tags_count += d_tags.size();
+
+        if (i == 0) {
+          for (const auto &tag : d_tags) {
+            if (tag.key == acq_info_tag_key()) {
+              update_acq_info(tag);
+            }
+          }
+        }
+      }
+
+      d_last_nitems = nitems;
+      return nitems;
+    }
+
+    double
+    block_stats_recorder_t::buffer_occupancy() const
+    {
+      const auto detail = d_block->detail();
+      double occupancy = 0.0;
+
+      for (int i = 0; i < detail->ninputs(); i++) {
+        const auto reader = detail->input(i);
+        const auto size = reader->buffer()->bufsize();
+        if (size > 0) {
+          occupancy = std::max(occupancy, static_cast<double>(reader->items_available()) / size);
+        }
+      }
+
+      if (detail->ninputs() == 0) {
+        for (int i = 0; i < detail->noutputs(); i++) {
+          const auto buffer = detail->output(i);
+          const auto size = buffer->bufsize();
+          if (size > 0) {
+            occupancy = std::max(occupancy, 1.0 - static_cast<double>(buffer->space_available()) / size);
+          }
+        }
+      }
+
+      return std::min(occupancy, 1.0);
+    }
+
+    void
+    block_stats_recorder_t::scan_traces()
+    {
+      const auto detail = d_block->detail();
+      d_traced_until.resize(detail->ninputs(), 0);
+
+      for (int i = 0; i < detail->ninputs(); i++) {
+        const auto begin = std::max(d_block->nitems_read(i), d_traced_until[i]);
+        const auto end = d_block->nitems_read(i) + detail->input(i)->items_available();
+        if (begin >= end) {
+          continue;
+        }
+
+        d_trace_tags.clear();
+        detail->get_tags_in_range(d_trace_tags, i, begin, end, trace_tag_key(), d_block->unique_id());
+        for (const auto &tag : d_trace_tags) {
+          d_trace_ids.push_back(decode_trace_tag(tag).id);
+        }
+
+        d_traced_until[i] = end;
+      }
+    }
+
+    void
+    block_stats_recorder_t::begin_work(bool stats, bool trace)
+    {
+      if (trace) {
+        scan_traces();
+      }
+
+      if (!stats) {
+        return;
+      }
+
+      std::lock_guard<std::mutex> lock(d_mutex);
+
+      if (!d_started) {
+        d_started = true;
+        d_last_nitems = d_block->detail()->ninputs() > 0 ? d_block->nitems_read(0) : d_block->nitems_written(0);
+      }
+
+      auto nitems = account();
+
+      d_buffer_occupancy = buffer_occupancy();
+      d_max_buffer_occupancy = std::max(d_max_buffer_occupancy, d_buffer_occupancy);
+
+      if (d_block->detail()->ninputs() > 0) {
+        d_tags.clear();
+        d_block->detail()->get_tags_in_range(d_tags, 0, nitems, nitems + 1, acq_info_tag_key(),
+                d_block->unique_id());
+        if (!d_tags.empty()) {
+          update_acq_info(d_tags.back());
+        }
+
+        if (d_has_acq_info && d_acq_info_timestamp > 0) {
+          auto first_sample_ns = d_acq_info_timestamp + static_cast<int64_t>(
+                  static_cast<double>(nitems - d_acq_info_offset) * d_acq_info_timebase * 1e9);
+          d_data_age_ns = realtime_ns() - first_sample_ns;
+          d_max_data_age_ns = std::max(d_max_data_age_ns, d_data_age_ns);
+          d_sum_data_age_ns += static_cast<double>(d_data_age_ns);
+          d_data_age_count++;
+        }
+      }
+
+      d_work_start = std::chrono::steady_clock::now();
+      d_work_start_allocations = thread_allocation_count();
+    }
+
+    void
+    block_stats_recorder_t::end_work(bool stats, bool trace)
+    {
+      const auto end_allocations = thread_allocation_count();
+      auto now = std::chrono::steady_clock::now();
+
+      if (trace && !d_trace_ids.empty()) {
+        auto &registry = trace_registry_t::instance();
+        const auto name = get_block_name(d_block);
+        const auto timestamp = realtime_ns();
+        for (auto id : d_trace_ids) {
+          registry.add_hop(id, name, timestamp);
+        }
+        d_trace_ids.clear();
+      }
+
+      if (!stats) {
+        return;
+      }
+
+      std::lock_guard<std::mutex> lock(d_mutex);
+      d_work_time_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+              now - d_work_start).count();
+      d_work_calls++;
+
+      if (end_allocations != d_work_start_allocations) {
+        d_allocations += end_allocations - d_work_start_allocations;
+        d_allocating_calls++;
+      }
+    }
+
+    block_stats_t
+    block_stats_recorder_t::get()
+    {
+      block_stats_t stats;
+      stats.name = get_block_name(d_block);
+
+      std::lock_guard<std::mutex> lock(d_mutex);
+
+      // Items consumed by the last work call, e.g. once the flowgraph is done
+      if (d_started && d_block->detail()) {
+        account();
+      }
+
+      auto elapsed_ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+              std::chrono::steady_clock::now() - d_reset_time).count());
+
+      stats.work_calls = d_work_calls;
+      stats.work_time_ns = d_work_time_ns;
+      stats.items = d_items;
+      stats.tags = d_tags_count;
+      stats.items_per_second = elapsed_ns > 0.0 ? static_cast<double>(d_items) * 1e9 / elapsed_ns : 0.0;
+      stats.load = elapsed_ns > 0.0 ? static_cast<double>(d_work_time_ns) / elapsed_ns : 0.0;
+      stats.data_age_ns = d_data_age_ns;
+      stats.max_data_age_ns = d_max_data_age_ns;
+      stats.avg_data_age_ns = d_data_age_count ? d_sum_data_age_ns / static_cast<double>(d_data_age_count) : 0.0;
+      stats.allocations = d_allocations;
+      stats.allocating_calls = d_allocating_calls;
+      stats.buffer_occupancy = d_buffer_occupancy;
+      stats.max_buffer_occupancy = d_max_buffer_occupancy;
+
+      stats.lost = 0;
+      if (d_loss_counter) {
+        const auto lost = d_loss_counter();
+        if (lost < d_loss_baseline) {
+          d_loss_baseline = 0;
+        }
+        stats.lost = lost - d_loss_baseline;
+      }
+
+      return stats;
+    }
+
+    void
+    set_block_stats_enabled(bool enabled)
+    {
+      if (enabled && !get_block_stats_enabled()) {
+        reset_block_stats();
+      }
+      block_stats_recorder_t::enabled_flag().store(enabled);
+    }
+
+    bool
+    get_block_stats_enabled()
+    {
+      return block_stats_recorder_t::enabled();
+    }
+
+    std::vector<block_stats_t>
+    get_block_stats()
+    {
+      std::vector<block_stats_t> stats;
+
+      auto &reg = registry();
+      std::lock_guard<std::mutex> lock(reg.mutex);
+      for (auto recorder : reg.recorders) {
+        stats.push_back(recorder->get());
+      }
+
+      return stats;
+    }
+
+    void
+    reset_block_stats()
+    {
+      auto &reg = registry();
+      std::lock_guard<std::mutex> lock(reg.mutex);
+      for (auto recorder : reg.recorders) {
+        recorder->reset();
+      }
+    }
+
+    uint64_t &
+    thread_allocation_count()
+    {
+      static thread_local uint64_t count = 0;
+      return count;
+    }
+
+  } // namespace digitizers
+} // namespace gr
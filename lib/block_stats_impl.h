@@ -0,0 +1,154 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_BLOCK_STATS_IMPL_H
+#define INCLUDED_DIGITIZERS_BLOCK_STATS_IMPL_H
+
+#include <digitizers/block_stats.h>
+#include "trace_registry.h"
+#include <gnuradio/block.h>
+#include <gnuradio/tags.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Performance counters of a block, registered for get_block_stats as long as it
+     * exists. Blocks hold it as a member and open a block_stats_scope_t in work.
+     *
+     * Consumed items and tags are accounted at the start of the next work call (or by get), i.e.
+     * once the scheduler has advanced the read pointers.
+     *
+     * If tracing is active (see trace_registry_t) the recorder also records a hop for each trace
+     * tag available to a work call, timestamped at the end of the call.
+     *
+     * Allocations are counted between the end of begin_work and the start of end_work, i.e. those
+     * of the recorder itself are not included.
+     */
+    class block_stats_recorder_t
+    {
+    public:
+      explicit block_stats_recorder_t(gr::block *block);
+      ~block_stats_recorder_t();
+
+      block_stats_recorder_t(const block_stats_recorder_t &) = delete;
+      block_stats_recorder_t &operator=(const block_stats_recorder_t &) = delete;
+
+      static bool
+      enabled()
+      {
+        return enabled_flag().load(std::memory_order_relaxed);
+      }
+
+      static std::atomic<bool> &enabled_flag();
+
+      void begin_work(bool stats, bool trace);
+
+      void end_work(bool stats, bool trace);
+
+      block_stats_t get();
+
+      void reset();
+
+      /*!
+       * \brief Sets the counter of the data lost by the block, e.g. of dropped packages. It is
+       * read by get only (i.e. not from work), losses are reported relative to the last reset. A
+       * counter going backwards (e.g. reset on configure) counts from zero.
+       */
+      void set_loss_counter(std::function<uint64_t()> counter);
+
+    private:
+      // Accounts the items and tags consumed since the last call, returns the current item count
+      uint64_t account();
+
+      // Fill level of the fullest input buffer, of the fullest output buffer for sources
+      double buffer_occupancy() const;
+
+      void update_acq_info(const gr::tag_t &tag);
+
+      // Collects the trace tags available on the inputs
+      void scan_traces();
+
+      gr::block *d_block;
+      std::mutex d_mutex;
+
+      uint64_t d_work_calls;
+      uint64_t d_work_time_ns;
+      uint64_t d_items;
+      uint64_t d_tags_count;
+      int64_t d_data_age_ns;
+      int64_t d_max_data_age_ns;
+      double d_sum_data_age_ns;
+      uint64_t d_data_age_count;
+      uint64_t d_allocations;
+      uint64_t d_allocating_calls;
+      double d_buffer_occupancy;
+      double d_max_buffer_occupancy;
+
+      std::function<uint64_t()> d_loss_counter;
+      uint64_t d_loss_baseline;
+
+      bool d_started;
+      uint64_t d_last_nitems;
+      std::chrono::steady_clock::time_point d_reset_time;
+      std::chrono::steady_clock::time_point d_work_start;
+      uint64_t d_work_start_allocations;   // see thread_allocation_count
+
+      // Last acq_info tag seen on input 0
+      bool d_has_acq_info;
+      uint64_t d_acq_info_offset;
+      int64_t d_acq_info_timestamp;
+      double d_acq_info_timebase;
+
+      std::vector<gr::tag_t> d_tags;
+
+      // Traces seen by the current work call and the offset up to which each input was scanned,
+      // accessed by the work thread only
+      std::vector<uint64_t> d_trace_ids;
+      std::vector<uint64_t> d_traced_until;
+      std::vector<gr::tag_t> d_trace_tags;
+    };
+
+    /*!
+     * \brief Accounts the enclosing work call, a no-op if neither collection nor tracing is
+     * enabled.
+     */
+    class block_stats_scope_t
+    {
+    public:
+      explicit block_stats_scope_t(block_stats_recorder_t &stats)
+        : d_stats(stats),
+          d_enabled(block_stats_recorder_t::enabled()),
+          d_trace(trace_registry_t::active())
+      {
+        if (d_enabled || d_trace) {
+          d_stats.begin_work(d_enabled, d_trace);
+        }
+      }
+
+      ~block_stats_scope_t()
+      {
+        if (d_enabled || d_trace) {
+          d_stats.end_work(d_enabled, d_trace);
+        }
+      }
+
+    private:
+      block_stats_recorder_t &d_stats;
+      const bool d_enabled;
+      const bool d_trace;
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_BLOCK_STATS_IMPL_H */
@@ -0,0 +1,187 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_BUFFER_TUNER_H
+#define INCLUDED_DIGITIZERS_BUFFER_TUNER_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Derives the driver buffer and chunk size from the observed polls.
+     *
+     * The tuner observes the polls over windows of fixed length: the longest gap between two
+     * polls and the largest number of samples received by a single poll. At the end of each
+     * window the worst case, i.e. the larger of the samples produced during the longest gap
+     * and the largest poll, is multiplied by the margin and rounded up to a multiple of
+     * granularity, giving the driver buffer size that doesn't overrun.
+     *
+     * The driver buffer is changed if it is too small, or if it is more than the shrink factor
+     * too large (hysteresis, conditions causing a rare long gap shouldn't toggle the size).
+     *
+     * The chunk size (application buffer size) is recommended from the latency target: a chunk
+     * is handed over once complete, and a sample waits at most for a poll gap in addition.
+     * If the poll gaps alone exceed the target the latter can't be met, the largest poll is
+     * recommended then.
+     *
+     * Used by the poll thread only, hence no locking.
+     */
+    class buffer_tuner_t
+    {
+    public:
+
+      static constexpr double MARGIN = 4.0;
+      static constexpr double SHRINK_FACTOR = 4.0;
+      static const uint32_t GRANULARITY = 1024;
+
+      buffer_tuner_t()
+        : d_enabled(false),
+          d_samp_rate(0.0),
+          d_latency_target(0.0),
+          d_window_ns(0),
+          d_driver_buffer_size(0),
+          d_chunk_size(0),
+          d_window_start_ns(0),
+          d_last_poll_ns(0),
+          d_last_samples(0),
+          d_max_gap_ns(0),
+          d_max_poll_samples(0),
+          d_last_max_gap_ns(0)
+      {
+      }
+
+      /*!
+       * \brief Restarts the observation, called on arm.
+       *
+       * \param latency_target max latency in seconds, zero disables the tuner
+       * \param samp_rate samples per second delivered by the driver
+       * \param driver_buffer_size driver buffer size in samples, as applied
+       * \param window_ns length of the observation window
+       * \param now_ns current (monotonic) time
+       */
+      void reset(double latency_target, double samp_rate, uint32_t driver_buffer_size,
+              uint64_t window_ns, uint64_t now_ns)
+      {
+        d_enabled = latency_target > 0.0 && samp_rate > 0.0;
+        d_samp_rate = samp_rate;
+        d_latency_target = latency_target;
+        d_window_ns = window_ns;
+        d_driver_buffer_size = driver_buffer_size;
+        d_chunk_size = 0;
+        d_last_max_gap_ns = 0;
+        d_last_poll_ns = 0;
+        d_last_samples = 0;
+        restart_window(now_ns);
+      }
+
+      /*!
+       * \brief Accounts for a poll.
+       *
+       * Returns true if the driver buffer size needs to be changed, see get_driver_buffer_size.
+       *
+       * \param samples samples received since reset
+       * \param now_ns current (monotonic) time, after the poll
+       */
+      bool update(uint64_t samples, uint64_t now_ns)
+      {
+        if (!d_enabled) {
+          return false;
+        }
+
+        if (d_last_poll_ns) {
+          d_max_gap_ns = std::max(d_max_gap_ns, now_ns - d_last_poll_ns);
+          d_max_poll_samples = std::max(d_max_poll_samples, samples - d_last_samples);
+        }
+        d_last_poll_ns = now_ns;
+        d_last_samples = samples;
+
+        if (now_ns - d_window_start_ns < d_window_ns) {
+          return false;
+        }
+
+        // End of the window
+        const double gap = d_max_gap_ns / 1e9;
+        const double worst = std::max(gap * d_samp_rate, static_cast<double>(d_max_poll_samples));
+        const auto wanted = round_up(MARGIN * worst);
+
+        const double chunk = (d_latency_target - gap) * d_samp_rate;
+        d_chunk_size = chunk >= 1.0 ? static_cast<uint32_t>(chunk)
+                : static_cast<uint32_t>(std::max<uint64_t>(d_max_poll_samples, 1));
+
+        d_last_max_gap_ns = d_max_gap_ns;
+        restart_window(now_ns);
+
+        if (wanted > d_driver_buffer_size || wanted * SHRINK_FACTOR < d_driver_buffer_size) {
+          d_driver_buffer_size = wanted;
+          return true;
+        }
+
+        return false;
+      }
+
+      /*!
+       * \brief Driver buffer size in samples, as tuned (or applied if not tuned yet).
+       */
+      uint32_t get_driver_buffer_size() const
+      {
+        return d_driver_buffer_size;
+      }
+
+      /*!
+       * \brief Recommended chunk size in samples, zero until the first window ends.
+       */
+      uint32_t get_chunk_size() const
+      {
+        return d_chunk_size;
+      }
+
+      /*!
+       * \brief Longest gap between two polls within the last complete window.
+       */
+      uint64_t get_max_gap_ns() const
+      {
+        return d_last_max_gap_ns;
+      }
+
+    private:
+
+      void restart_window(uint64_t now_ns)
+      {
+        d_window_start_ns = now_ns;
+        d_max_gap_ns = 0;
+        d_max_poll_samples = 0;
+      }
+
+      static uint32_t round_up(double samples)
+      {
+        const auto blocks = static_cast<uint64_t>(std::ceil(samples / GRANULARITY));
+        return static_cast<uint32_t>(std::max<uint64_t>(1, blocks) * GRANULARITY);
+      }
+
+      bool d_enabled;
+      double d_samp_rate;
+      double d_latency_target;
+      uint64_t d_window_ns;
+
+      uint32_t d_driver_buffer_size;
+      uint32_t d_chunk_size;
+
+      uint64_t d_window_start_ns;
+      uint64_t d_last_poll_ns;     // zero until the first poll
+      uint64_t d_last_samples;
+      uint64_t d_max_gap_ns;
+      uint64_t d_max_poll_samples;
+      uint64_t d_last_max_gap_ns;
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_BUFFER_TUNER_H */
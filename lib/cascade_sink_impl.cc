@@ -10,6 +10,19 @@
 
 #include <gnuradio/io_signature.h>
 #include "cascade_sink_impl.h"
+#include "block_aggregation_impl.h"
+#include "time_domain_sink_impl.h"
+#include "conversion_pool.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <map>
+#include <set>
+#include <sstream>
+#include <stdexcept>
 
 namespace gr {
   namespace digitizers {
@@ -48,7 +61,50 @@ namespace gr {
             pm_buffer,
             signal_name,
             unit_name,
-            streaming_sinks_enabled,
+            streaming_sinks_enabled ? default_levels(samp_rate) : std::vector<cascade_level_t>(),
+            triggered_sinks_enabled,
+            frequency_sinks_enabled,
+            postmortem_sinks_enabled,
+            interlocks_enabled,
+            pre_trigger_window_raw,
+            post_trigger_window_raw));
+    }
+
+    cascade_sink::sptr
+    cascade_sink::make(int alg_id,
+        int delay,
+        const std::vector<float> &fir_taps,
+        double low_freq,
+        double up_freq,
+        double tr_width,
+        const std::vector<double> &fb_user_taps,
+        const std::vector<double> &fw_user_taps,
+        double samp_rate,
+        float pm_buffer,
+        std::string signal_name,
+        std::string unit_name,
+        const std::vector<cascade_level_t> &levels,
+        bool triggered_sinks_enabled,
+        bool frequency_sinks_enabled,
+        bool postmortem_sinks_enabled,
+        bool interlocks_enabled,
+        unsigned pre_trigger_window_raw,
+        unsigned post_trigger_window_raw)
+    {
+      return gnuradio::get_initial_sptr
+        (new cascade_sink_impl(alg_id,
+            delay,
+            fir_taps,
+            low_freq,
+            up_freq,
+            tr_width,
+            fb_user_taps,
+            fw_user_taps,
+            samp_rate,
+            pm_buffer,
+            signal_name,
+            unit_name,
+            levels,
             triggered_sinks_enabled,
             frequency_sinks_enabled,
             postmortem_sinks_enabled,
@@ -57,6 +113,103 @@ namespace gr {
             post_trigger_window_raw));
     }
 
+    std::vector<cascade_level_t>
+    cascade_sink::default_levels(double samp_rate)
+    {
+      // FESA will see updates @10Hz at most.
+      //       name,    parent,  decimation,                               dataPackageSize
+      return {
+        {"10kHz",  "",      static_cast<int>(samp_rate / 10000.0),  400},
+        {"1kHz",   "10kHz", 10,                                      40},
+        {"100Hz",  "1kHz",  10,                                       4},
+        {"25Hz",   "100Hz",  4,                                       1},  // N.B. alternate continuous update rate @ 25 Hz
+        {"10Hz",   "100Hz", 10,                                       1},
+        {"1Hz",    "10Hz",  10,                                       1}   // primarily relevant for super-slow storage rings (e.g. HESR)
+      };
+    }
+
+    std::vector<cascade_sink::sptr>
+    cascade_sink::make_many(const std::vector<cascade_sink_config_t> &configs, int nthreads)
+    {
+      if (nthreads <= 0) {
+        nthreads = std::max(1, static_cast<int>(boost::thread::hardware_concurrency()));
+      }
+
+      // Designs first, the design cache computes each distinct design once and lets the
+      // threads requesting a design in progress wait for it
+      conversion_pool_t pool;
+      pool.start(std::min(nthreads, static_cast<int>(configs.size())) - 1, "cascade_sink", "design");
+
+      // The pool doesn't propagate exceptions, e.g. invalid levels are reported from here
+      std::vector<std::exception_ptr> errors(configs.size());
+      auto prefetch = [&configs, &errors](size_t i) {
+        try {
+          cascade_sink_impl::prefetch_designs(configs[i]);
+        }
+        catch (...) {
+          errors[i] = std::current_exception();
+        }
+      };
+      pool.run(configs.size(), prefetch);
+      pool.stop();
+
+      for (const auto &error : errors) {
+        if (error) {
+          std::rethrow_exception(error);
+        }
+      }
+
+      // Blocks are created sequentially, GNU Radio assigns block ids from an unprotected counter
+      std::vector<sptr> sinks;
+      sinks.reserve(configs.size());
+      for (const auto &config : configs) {
+        sinks.push_back(make(config.alg_id,
+            config.delay,
+            config.fir_taps,
+            config.low_freq,
+            config.up_freq,
+            config.tr_width,
+            config.fb_user_taps,
+            config.fw_user_taps,
+            config.samp_rate,
+            config.pm_buffer,
+            config.signal_name,
+            config.unit_name,
+            config.levels,
+            config.triggered_sinks_enabled,
+            config.frequency_sinks_enabled,
+            config.postmortem_sinks_enabled,
+            config.interlocks_enabled,
+            config.pre_trigger_window_raw,
+            config.post_trigger_window_raw));
+      }
+
+      return sinks;
+    }
+
+    std::vector<cascade_level_t>
+    cascade_sink::hardware_levels(const std::vector<cascade_level_t> &levels, int downsampling_factor)
+    {
+      auto adapted = levels;
+      for (auto &level : adapted) {
+        if (!level.parent.empty()) {
+          continue;
+        }
+
+        if (downsampling_factor < 1 || level.decimation % downsampling_factor != 0) {
+          std::ostringstream message;
+          message << "Exception in " << __FILE__ << ":" << __LINE__ << ": downsampling factor "
+                  << downsampling_factor << " does not divide the decimation of level " << level.name
+                  << " (" << level.decimation << ")";
+          throw std::invalid_argument(message.str());
+        }
+
+        level.decimation /= downsampling_factor;
+      }
+
+      return adapted;
+    }
+
     /*
      * The private constructor
      */
@@ -72,7 +225,7 @@ namespace gr {
         float pm_buffer,
         std::string signal_name,
         std::string unit_name,
-        bool streaming_sinks_enabled,
+        const std::vector<cascade_level_t> &levels,
         bool triggered_sinks_enabled,
         bool frequency_sinks_enabled,
         bool postmortem_sinks_enabled,
@@ -82,121 +235,43 @@ namespace gr {
       : gr::hier_block2("cascade_sink",
               gr::io_signature::make(2,2, sizeof(float)),
               gr::io_signature::make(0,0 , sizeof(float))),
-              d_streaming_sinks_enabled(streaming_sinks_enabled),
-              d_triggered_sinks_enabled(triggered_sinks_enabled),
+              d_alg_id(alg_id),
+              d_delay(delay),
+              d_fir_taps(fir_taps),
+              d_low_freq(low_freq),
+              d_up_freq(up_freq),
+              d_tr_width(tr_width),
+              d_fb_user_taps(fb_user_taps),
+              d_fw_user_taps(fw_user_taps),
+              d_samp_rate(samp_rate),
+              d_signal_name(signal_name),
+              d_unit_name(unit_name),
+              d_pre_trigger_window_raw(pre_trigger_window_raw),
+              d_post_trigger_window_raw(post_trigger_window_raw),
+              d_triggered_sinks_enabled(false),
               d_frequency_sinks_enabled(frequency_sinks_enabled),
               d_postmortem_sinks_enabled(postmortem_sinks_enabled),
-              d_interlocks_enabled(interlocks_enabled)
+              d_interlocks_enabled(interlocks_enabled),
+              d_buffer_budget(0),
+              d_buffer_latency(0.0),
+              d_cores(),
+              d_realtime_memory(false)
     {
-      //std::vector<int> allowed_cores = { 2,3,4 };
-      //set_processor_affinity(allowed_cores);
       int samp_rate_to_ten_kilo = static_cast<int>(samp_rate / 10000.0);
-      if(streaming_sinks_enabled)
-      {
-          if(samp_rate != (samp_rate_to_ten_kilo * 10000.0))
-            GR_LOG_ALERT(logger, "SAMPLE RATE NOT DIVISIBLE BY 1000! OUTPUTS NOT EXACT: 10k, 1k, 100, 10, 1 Hz!");
-
-          // create sinks -- FESA will see updates @10Hz at most.
-          //                                  signal-name,           unit name, sample rate, sink mode                ,dataPackageSize
-          d_snk10000 = time_domain_sink::make(signal_name+"@10kHz",  unit_name, 10000.0,     TIME_SINK_MODE_STREAMING,  400            );
-          d_snk1000  = time_domain_sink::make(signal_name+"@1kHz",   unit_name, 1000.0,      TIME_SINK_MODE_STREAMING,   40            );
-          d_snk100   = time_domain_sink::make(signal_name+"@100Hz",  unit_name, 100.0,       TIME_SINK_MODE_STREAMING,    4            );
-          d_snk25    = time_domain_sink::make(signal_name+"@25Hz",   unit_name, 25.0,        TIME_SINK_MODE_STREAMING,    1            );
-          d_snk10    = time_domain_sink::make(signal_name+"@10Hz",   unit_name, 10.0,        TIME_SINK_MODE_STREAMING,    1            );
-          d_snk1     = time_domain_sink::make(signal_name+"@1Hz",    unit_name, 1,           TIME_SINK_MODE_STREAMING,    1            );
-      }
-
-      //create aggregation blocks
-      double lf = low_freq; // lower frequency cut-off - decreases by a factor 10 per stage
-      double uf = up_freq;  // upper frequency cut-off - decreases by a factor 10 per stage
-      double tr = tr_width; // transition width (ie. bandwidth between 3dB and 20 dB point
-      // (should not be excessively small <-> relates to the FIR filter length)
-      // N.B. original design of hard-coding names... TODO: clean-up and replace by loops for better readability
-
-      // first stage n-MS/S to 10 kS/s
-      d_agg10000 = block_aggregation::make(alg_id, samp_rate_to_ten_kilo, delay, fir_taps, lf, uf, tr, fb_user_taps, fw_user_taps, samp_rate);
-      // input to first 10 kHz block
-      connect(self(), 0, d_agg10000, 0); // 0: values port
-      connect(self(), 1, d_agg10000, 1); // 1: errors
-
-      if(streaming_sinks_enabled)
-      {
-          // connect raw->10kHz aggregation to corresponding FESA time-domain sink
-          connect(d_agg10000, 0, d_snk10000, 0); // 0: values port
-          connect(d_agg10000, 1, d_snk10000, 1); // 1: errors
-      }
+      if(!levels.empty() && samp_rate != (samp_rate_to_ten_kilo * 10000.0))
+        GR_LOG_ALERT(logger, "SAMPLE RATE NOT DIVISIBLE BY 1000! OUTPUTS NOT EXACT: 10k, 1k, 100, 10, 1 Hz!");
 
-      if(streaming_sinks_enabled || postmortem_sinks_enabled || interlocks_enabled )
-      {
-          // second stage 10 kS/s to 1 kS/s
-          lf /= 10;
-          uf /= 10;
-          tr /= 10;
-          d_agg1000  = block_aggregation::make(alg_id, 10,                    delay, fir_taps, lf, uf, tr, fb_user_taps, fw_user_taps, 10000);
-          // first 10 kHz block to 1 kHz Block
-          connect(d_agg10000, 0, d_agg1000, 0);
-          connect(d_agg10000, 1, d_agg1000, 1);
-          // connect 1kHz stream to output
-          //connect(d_agg1000, 0, self(), 0);
-          //connect(d_agg1000, 1, self(), 1);
-      }
-
-      if(streaming_sinks_enabled)
+      auto cascade_levels = levels;
+      if(triggered_sinks_enabled)
       {
-          // connect 1kHz aggregation to corresponding FESA time-domain sink
-          connect(d_agg1000, 0, d_snk1000, 0);
-          connect(d_agg1000, 1, d_snk1000, 1);
-
-          // third stage 1 kS/s -> 100 S/s
-          lf /= 10;
-          uf /= 10;
-          tr /= 10;
-          d_agg100   = block_aggregation::make(alg_id, 10,                    delay, fir_taps, lf, uf, tr, fb_user_taps, fw_user_taps, 1000);
-          // 1 kHz block to 100 Hz Block
-          connect(d_agg1000, 0, d_agg100, 0);
-          connect(d_agg1000, 1, d_agg100, 1);
-
-          // connect 100 Hz aggregation to corresponding FESA time-domain sink
-          connect(d_agg100, 0, d_snk100, 0);
-          connect(d_agg100, 1, d_snk100, 1);
-
-          // fourth stage 100 S/s -> 25 S/s -> N.B. alternate continuous update rate @ 25 Hz
-          d_agg25    = block_aggregation::make(alg_id,  4,                   delay, fir_taps, lf/4, uf/4, tr/4, fb_user_taps, fw_user_taps, 100);
-          // 100 Hz block to 25 Hz Block
-          connect(d_agg100, 0, d_agg25, 0);
-          connect(d_agg100, 1, d_agg25, 1);
-
-          // connect 25 Hz aggregation to corresponding FESA time-domain sink
-          connect(d_agg25, 0, d_snk25, 0);
-          connect(d_agg25, 1, d_snk25, 1);
-
-          // fourth stage 100 S/s -> 10 S/s
-          lf /= 10;
-          uf /= 10;
-          tr /= 10;
-          d_agg10    = block_aggregation::make(alg_id, 10,                    delay, fir_taps, lf, uf, tr, fb_user_taps, fw_user_taps, 100);
-          // 100 Hz block to 10 Hz Block
-          connect(d_agg100, 0, d_agg10, 0);
-          connect(d_agg100, 1, d_agg10, 1);
-
-          // connect 10 Hz aggregation to corresponding FESA time-domain sink
-          connect(d_agg10, 0, d_snk10, 0);
-          connect(d_agg10, 1, d_snk10, 1);
-
-          // fifth stage 10 S/s -> 1 S/s (N.B. this slow speed is primarily relevant for super-slow storage rings (e.g. HESR)
-          lf /= 10;
-          uf /= 10;
-          tr /= 10;
-          d_agg1     = block_aggregation::make(alg_id, 10,                    delay, fir_taps, lf, uf, tr, fb_user_taps, fw_user_taps, 10);
-          // 10 Hz block to 1 Hz Block
-          connect(d_agg10, 0, d_agg1, 0);
-          connect(d_agg10, 1, d_agg1, 1);
-
-          // connect 1 Hz aggregation to corresponding FESA time-domain sink
-          connect(d_agg1, 0, d_snk1, 0);
-          connect(d_agg1, 1, d_snk1, 1);
+          // triggered 10 kHz sink is fed by the first stage n-MS/S to 10 kS/s, added if needed
+          d_trigger_level = "10kHz";
+          cascade_levels = add_trigger_level(levels, samp_rate);
       }
 
+      // lower and upper frequency cut-off as well as transition width decrease with the output rate
+      // of each stage, transition width should not be excessively small <-> relates to the FIR filter length
+      apply_levels(cascade_levels);
 
       // To prevent tag explosion we limit the output buffer size. For each output item the aggregation
       // block will generate only one acq_info tag. Therefore number 1024 seems to be reasonable... Note
@@ -229,33 +304,11 @@ namespace gr {
            */
       }
 
+      // triggered demux blocks (triggered time-domain acquisition), see set_triggered_sinks_enabled
       if(triggered_sinks_enabled)
       {
-          // triggered demux blocks (triggered time-domain acquisition)
-          d_snk_raw_triggered  = time_domain_sink::make(signal_name+":Triggered@Raw",  unit_name, samp_rate, TIME_SINK_MODE_TRIGGERED, pre_trigger_window_raw, post_trigger_window_raw);
-          d_demux_raw  = demux_ff::make(post_trigger_window_raw, pre_trigger_window_raw);
-          // input to first raw-data-rate demux
-          connect(self(), 0, d_demux_raw, 0); // 0: values port
-          connect(self(), 1, d_demux_raw, 1); // 1: errors
-          // connect raw-data-rate demux to triggered time-domain sink
-          connect(d_demux_raw, 0, d_snk_raw_triggered, 0); // 0: values port
-          connect(d_demux_raw, 1, d_snk_raw_triggered, 1); // 1: errors
-
-          double samp_rate_factor = 10000.0 / samp_rate; // to cover the same time interval, just with a lower resoltution
-          unsigned pre_trigger_window = samp_rate_factor * pre_trigger_window_raw;
-          unsigned post_trigger_window = samp_rate_factor * post_trigger_window_raw;
-          if (post_trigger_window_raw > 0 && post_trigger_window < 1)
-            GR_LOG_ALERT(logger, "Samp_rate to low or post_trigger_window to small ... less than 1 sample for :Triggered@10kHz Sink");
-          if (pre_trigger_window_raw > 0 && pre_trigger_window < 1)
-            GR_LOG_ALERT(logger, "Samp_rate to low or pre_trigger_window to small ... less than 1 sample for :Triggered@10kHz Sink");
-          d_snk10000_triggered = time_domain_sink::make(signal_name+":Triggered@10kHz",  unit_name, 10000.0, TIME_SINK_MODE_TRIGGERED, pre_trigger_window, post_trigger_window);
-          d_demux_10000 = demux_ff::make(post_trigger_window, pre_trigger_window);
-          // first 10 kHz block to 10 kHz demux
-          connect(d_agg10000, 0, d_demux_10000, 0);
-          connect(d_agg10000, 1, d_demux_10000, 1);
-          // connect 10 kHz demux to triggered time-domain sink
-          connect(d_demux_10000, 0, d_snk10000_triggered, 0); // 0: values port
-          connect(d_demux_10000, 1, d_snk10000_triggered, 1); // 1: errors
+          connect_triggered_sinks();
+          d_triggered_sinks_enabled = true;
       }
 
       if(interlocks_enabled)
@@ -317,7 +370,7 @@ namespace gr {
           // connect(d_demux_freq_raw, 1, stft_raw_triggered, 1); // 'err' input does not exist yet
           connect(stft_raw_triggered, 0, d_freq_snk_triggered, 0); // amplitude input
           connect(stft_raw_triggered, 1, d_freq_snk_triggered, 1); // phase input
-          connect(stft_raw_triggered, 2, d_freq_snk_triggered, 2); // frequency inputs
+          // frequency axis is passed to the sinks as freq_axis tag, see stream_to_vector_overlay_ff
 
           d_freq_snk10k_triggered = freq_sink_f::make(signal_name+":TriggeredSpectrum@10kHz", SAMPLE_RATE_TRIGGERED_FREQ_SINK, WINDOW_SIZE_FREQ_DOMAIN_SLOW, N_BUFFERS, 1, FREQ_SINK_MODE_TRIGGERED);
           d_demux_freq_10k = demux_ff::make(10000.0f, WINDOW_SIZE_FREQ_DOMAIN_SLOW, 0);
@@ -330,7 +383,6 @@ namespace gr {
           // connect(d_demux_freq_10k, 1, stft_10k_triggered, 1); // 'err' input does not exist yet
           connect(stft_10k_triggered, 0, d_freq_snk10k_triggered, 0); // amplitude input
           connect(stft_10k_triggered, 1, d_freq_snk10k_triggered, 1); // phase input
-          connect(stft_10k_triggered, 2, d_freq_snk10k_triggered, 2); // frequency inputs
           */
       }
 
@@ -350,7 +402,6 @@ namespace gr {
           connect(d_agg10000, 0, stft_1k, 0);
           connect(stft_1k, 0, d_freq_snk1000, 0); // amplitude input
           connect(stft_1k, 1, d_freq_snk1000, 1); // phase input
-          connect(stft_1k, 2, d_freq_snk1000, 2); // frequency inputs
 
           // Short-Term Fourier Transform with fs=10 kHz und 25 Hz update rate
           stft_algorithms::sptr stft_25 = stft_algorithms::make(10000.0f,  0.04, WINDOW_SIZE_FREQ_DOMAIN_SLOW, wintype, FFT, 0, samp_rate/2, WINDOW_SIZE_FREQ_DOMAIN_SLOW);
@@ -358,7 +409,6 @@ namespace gr {
           connect(d_agg10000, 0, stft_25, 0);
           connect(stft_25, 0, d_freq_snk25, 0); // amplitude input
           connect(stft_25, 1, d_freq_snk25, 1); // phase input
-          connect(stft_25, 2, d_freq_snk25, 2); // frequency inputs
 
           // Short-Term Fourier Transform with fs=10 kHz und 10 Hz update rate
           stft_algorithms::sptr stft_10 = stft_algorithms::make(10000.0f,  0.1, WINDOW_SIZE_FREQ_DOMAIN_SLOW, wintype, FFT, 0, samp_rate/2, WINDOW_SIZE_FREQ_DOMAIN_SLOW);
@@ -366,7 +416,6 @@ namespace gr {
           connect(d_agg10000, 0, stft_10, 0);
           connect(stft_10, 0, d_freq_snk10, 0); // amplitude input
           connect(stft_10, 1, d_freq_snk10, 1); // phase input
-          connect(stft_10, 2, d_freq_snk10, 2); // frequency inputs
           */
       }
     }
@@ -378,24 +427,22 @@ namespace gr {
     std::vector<time_domain_sink::sptr>
     cascade_sink_impl::get_time_domain_sinks()
     {
-        if(d_streaming_sinks_enabled && d_triggered_sinks_enabled)
-        {
-            return {d_snk1, d_snk10, d_snk25, d_snk100, d_snk1000, d_snk10000, d_snk_raw_triggered, d_snk10000_triggered};
-            //return {d_snk1, d_snk10, d_snk25, d_snk100, d_snk1000, d_snk10000, d_snk10000_triggered};
-        }
-        else if(d_streaming_sinks_enabled)
-        {
-            return {d_snk1, d_snk10, d_snk25, d_snk100, d_snk1000, d_snk10000};
-        }
-        else if(d_triggered_sinks_enabled)
-        {
-            return {d_snk_raw_triggered, d_snk10000_triggered};
-            //return {d_snk10000_triggered};
+        std::vector<time_domain_sink::sptr> sinks;
+
+        // streaming sinks, slowest first
+        for (auto it = d_levels.rbegin(); it != d_levels.rend(); ++it) {
+          if (it->sink) {
+            sinks.push_back(it->sink);
+          }
         }
-        else
+
+        if(d_triggered_sinks_enabled)
         {
-            return {};
+            sinks.push_back(d_snk_raw_triggered);
+            sinks.push_back(d_snk10000_triggered);
         }
+
+        return sinks;
     }
 
     std::vector<post_mortem_sink::sptr>
@@ -446,6 +493,676 @@ namespace gr {
         }
     }
 
+    void
+    cascade_sink_impl::set_levels(const std::vector<cascade_level_t> &levels)
+    {
+      // validate before touching the flowgraph
+      prune_levels(levels, d_trigger_level);
+
+      lock();
+      try {
+        apply_levels(levels);
+        update_buffer_plan();
+        apply_core_affinity();
+        apply_realtime_memory();
+      }
+      catch (...) {
+        unlock();
+        throw;
+      }
+      unlock();
+    }
+
+    std::vector<cascade_level_t>
+    cascade_sink_impl::get_levels()
+    {
+      std::vector<cascade_level_t> levels;
+      for (const auto &node : d_levels) {
+        levels.push_back(node.level);
+      }
+      return levels;
+    }
+
+    std::vector<std::string>
+    cascade_sink_impl::get_active_levels()
+    {
+      std::vector<std::string> names;
+      for (const auto &node : d_levels) {
+        if (node.demand->is_active()) {
+          names.push_back(node.level.name);
+        }
+      }
+      return names;
+    }
+
+    void
+    cascade_sink_impl::set_triggered_sinks_enabled(bool enabled)
+    {
+      if (enabled == d_triggered_sinks_enabled) {
+        return;
+      }
+
+      lock();
+      try {
+        if (enabled) {
+          d_trigger_level = "10kHz";
+          auto levels = add_trigger_level(get_levels(), d_samp_rate);
+          // the errors of a values-only level are needed now
+          apply_levels(levels);
+          connect_triggered_sinks();
+        }
+        else {
+          disconnect_triggered_sinks();
+          // drop the trigger level unless it feeds other sinks
+          d_trigger_level.clear();
+          d_triggered_sinks_enabled = false;
+          apply_levels(get_levels());
+        }
+      }
+      catch (...) {
+        unlock();
+        throw;
+      }
+      d_triggered_sinks_enabled = enabled;
+      update_buffer_plan();
+      apply_core_affinity();
+      apply_realtime_memory();
+      unlock();
+    }
+
+    buffer_plan_t
+    cascade_sink_impl::plan_buffers(uint64_t memory_budget, double latency)
+    {
+      if (!(latency > 0.0)) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid latency target: " << latency;
+        throw std::invalid_argument(message.str());
+      }
+
+      auto buffers = get_output_buffers();
+      auto plan = make_buffer_plan(buffers, memory_budget, latency);
+      if (plan.total_bytes > memory_budget) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": cascade " << d_signal_name
+                << " needs at least " << plan.total_bytes << " bytes, budget: " << memory_budget;
+        throw std::invalid_argument(message.str());
+      }
+
+      apply_buffer_plan(buffers);
+      d_buffer_budget = memory_budget;
+      d_buffer_latency = latency;
+      return plan;
+    }
+
+    void
+    cascade_sink_impl::update_buffer_plan()
+    {
+      if (d_buffer_latency > 0.0) {
+        auto buffers = get_output_buffers();
+        make_buffer_plan(buffers, d_buffer_budget, d_buffer_latency);
+        apply_buffer_plan(buffers);
+      }
+    }
+
+    void
+    cascade_sink_impl::set_core_affinity(const std::vector<int> &cores)
+    {
+      for (auto core : cores) {
+        if (core < 0) {
+          std::ostringstream message;
+          message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid core: " << core;
+          throw std::invalid_argument(message.str());
+        }
+      }
+
+      d_cores = cores;
+      apply_core_affinity();
+    }
+
+    std::vector<int>
+    cascade_sink_impl::get_core_affinity()
+    {
+      return d_cores;
+    }
+
+    void
+    cascade_sink_impl::set_state_file(const std::string &path, double period, double max_age)
+    {
+      d_state_file = path.empty() ? state_file_t::sptr() : state_file_t::sptr(new state_file_t(path, period, max_age));
+
+      for (const auto &node : d_levels) {
+        if (node.agg) {
+          boost::dynamic_pointer_cast<block_aggregation_impl>(node.agg)->set_state_file(d_state_file, node.level.name);
+        }
+      }
+
+      if (d_pm_raw) {
+        d_pm_raw->set_backing_file(path.empty() ? path : path + ".pm_raw", true);
+      }
+      if (d_pm_1000) {
+        d_pm_1000->set_backing_file(path.empty() ? path : path + ".pm_1000", true);
+      }
+    }
+
+    void
+    cascade_sink_impl::set_realtime_memory(bool enabled)
+    {
+      d_realtime_memory = enabled;
+      apply_realtime_memory();
+    }
+
+    size_t
+    cascade_sink_impl::get_locked_memory()
+    {
+      size_t locked = 0;
+      for (const auto &sink : get_time_domain_sinks()) {
+        locked += boost::dynamic_pointer_cast<time_domain_sink_impl>(sink)->get_locked_memory();
+      }
+      return locked;
+    }
+
+    void
+    cascade_sink_impl::apply_realtime_memory()
+    {
+      for (const auto &sink : get_time_domain_sinks()) {
+        boost::dynamic_pointer_cast<time_domain_sink_impl>(sink)->set_realtime_memory(d_realtime_memory);
+      }
+    }
+
+    void
+    cascade_sink_impl::apply_core_affinity()
+    {
+      // Aggregation levels are hierarchical, the affinity is passed on to their inner blocks
+      auto pin = [this](gr::basic_block_sptr block, int core) {
+        if (!block) {
+          return;
+        }
+        if (d_cores.empty()) {
+          block->unset_processor_affinity();
+        }
+        else {
+          block->set_processor_affinity(std::vector<int> {core});
+        }
+      };
+
+      size_t next_chain = 0;
+      auto next_core = [this, &next_chain]() {
+        return d_cores.empty() ? -1 : d_cores[next_chain++ % d_cores.size()];
+      };
+
+      // Parents precede their children, a level fed by the input starts a new chain
+      std::map<std::string, int> level_cores;
+      for (const auto &node : d_levels) {
+        const auto core = node.level.parent.empty() ? next_core() : level_cores[node.level.parent];
+        level_cores[node.level.name] = core;
+        pin(node.agg, core);
+        pin(node.sink, core);
+      }
+
+      if (d_triggered_sinks_enabled) {
+        const auto raw_core = next_core();
+        pin(d_demux_raw, raw_core);
+        pin(d_snk_raw_triggered, raw_core);
+
+        const auto trigger_core = level_cores[d_trigger_level];
+        pin(d_demux_10000, trigger_core);
+        pin(d_snk10000_triggered, trigger_core);
+      }
+    }
+
+    std::vector<cascade_sink_impl::output_buffer_t>
+    cascade_sink_impl::get_output_buffers()
+    {
+      std::vector<output_buffer_t> buffers;
+
+      // The consumer takes the given number of items at once, the producer needs room for twice
+      // as many in order to keep going meanwhile
+      auto require = [&](gr::basic_block_sptr producer, double samp_rate, long items) {
+        if (producer == self()) {
+          return;  // input of the cascade, sized by the upstream block
+        }
+
+        for (auto &buffer : buffers) {
+          if (buffer.block == producer) {
+            buffer.min_items = std::max(buffer.min_items, 2 * items);
+            return;
+          }
+        }
+        const int nports = std::min(2, producer->output_signature()->max_streams());
+        buffers.push_back(output_buffer_t{producer, samp_rate, 2 * items, 0, nports});
+      };
+
+      for (const auto &node : d_levels) {
+        if (node.agg) {
+          require(get_parent_output(node), node.samp_rate * node.level.decimation, node.level.decimation);
+          require(node.agg, node.samp_rate, 1);
+        }
+
+        if (node.sink) {
+          require(get_output(node), node.samp_rate, node.level.package_size);
+        }
+      }
+
+      if (d_triggered_sinks_enabled) {
+        auto trigger_node = find_level(d_trigger_level);
+        require(get_output(*trigger_node), trigger_node->samp_rate, d_demux_10000->output_multiple());
+        require(d_demux_10000, trigger_node->samp_rate, d_snk10000_triggered->output_multiple());
+        require(d_demux_raw, d_samp_rate, d_snk_raw_triggered->output_multiple());
+      }
+
+      return buffers;
+    }
+
+    buffer_plan_t
+    cascade_sink_impl::make_buffer_plan(std::vector<output_buffer_t> &buffers, uint64_t memory_budget,
+            double latency)
+    {
+      // Buffers are allocated in whole pages
+      const uint64_t page = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+      auto to_bytes = [page](double items) {
+        return static_cast<uint64_t>(std::ceil(items * sizeof(float) / page)) * page;
+      };
+
+      buffer_plan_t plan = {};
+      for (const auto &sink : get_post_mortem_sinks()) {
+        plan.sink_bytes += 2 * sink->get_buffer_size() * sizeof(float);
+      }
+      for (const auto &sink : get_frequency_domain_sinks()) {
+        plan.sink_bytes += 2 * sink->get_frame_capacity() * sink->get_nbins() * sizeof(float);
+      }
+
+      // Values and errors outputs are sized alike
+      std::vector<uint64_t> min_bytes, extra_bytes;
+      uint64_t min_total = plan.sink_bytes;
+      uint64_t extra_total = 0;
+      for (const auto &buffer : buffers) {
+        const auto minimum = to_bytes(buffer.min_items);
+        const auto target = std::max(minimum, to_bytes(latency * buffer.samp_rate));
+        min_bytes.push_back(minimum);
+        extra_bytes.push_back(target - minimum);
+        min_total += buffer.nports * minimum;
+        extra_total += buffer.nports * (target - minimum);
+      }
+
+      double scale = 1.0;
+      if (min_total + extra_total > memory_budget) {
+        scale = memory_budget > min_total
+                ? static_cast<double>(memory_budget - min_total) / extra_total
+                : 0.0;
+      }
+
+      for (size_t i = 0; i < buffers.size(); i++) {
+        const auto bytes = min_bytes[i] + static_cast<uint64_t>(extra_bytes[i] * scale) / page * page;
+        buffers[i].items = static_cast<long>(bytes / sizeof(float));
+        plan.stream_buffer_bytes += buffers[i].nports * bytes;
+        plan.nbuffers += buffers[i].nports;
+        plan.max_latency = std::max(plan.max_latency, buffers[i].items / buffers[i].samp_rate);
+      }
+
+      plan.total_bytes = plan.sink_bytes + plan.stream_buffer_bytes;
+      return plan;
+    }
+
+    void
+    cascade_sink_impl::apply_buffer_plan(const std::vector<output_buffer_t> &buffers)
+    {
+      // GR allocates 64 KiB per output by default and a maximum takes precedence over a minimum,
+      // smaller buffers are therefore set as maximum and larger ones as minimum
+      static const long default_items = 2 * 32768 / sizeof(float);
+
+      for (const auto &buffer : buffers) {
+        const long max_items = buffer.items < default_items ? buffer.items : 0;
+
+        // Aggregation levels are hierarchical, the sizes are passed on to their output blocks
+        auto hier = boost::dynamic_pointer_cast<gr::hier_block2>(buffer.block);
+        for (int port = 0; port < buffer.nports; port++) {
+          if (hier) {
+            hier->set_max_output_buffer(port, max_items);
+            hier->set_min_output_buffer(port, buffer.items);
+          }
+          else {
+            buffer.block->set_max_output_buffer(port, max_items);
+            buffer.block->set_min_output_buffer(port, buffer.items);
+          }
+        }
+      }
+    }
+
+    void
+    cascade_sink_impl::connect_triggered_sinks()
+    {
+      if (!d_demux_raw) {
+        d_snk_raw_triggered  = time_domain_sink::make(d_signal_name+":Triggered@Raw",  d_unit_name, d_samp_rate, TIME_SINK_MODE_TRIGGERED, d_pre_trigger_window_raw, d_post_trigger_window_raw);
+        d_demux_raw  = demux_ff::make(d_post_trigger_window_raw, d_pre_trigger_window_raw);
+
+        double samp_rate_factor = 10000.0 / d_samp_rate; // to cover the same time interval, just with a lower resoltution
+        unsigned pre_trigger_window = samp_rate_factor * d_pre_trigger_window_raw;
+        unsigned post_trigger_window = samp_rate_factor * d_post_trigger_window_raw;
+        if (d_post_trigger_window_raw > 0 && post_trigger_window < 1)
+          GR_LOG_ALERT(logger, "Samp_rate to low or post_trigger_window to small ... less than 1 sample for :Triggered@10kHz Sink");
+        if (d_pre_trigger_window_raw > 0 && pre_trigger_window < 1)
+          GR_LOG_ALERT(logger, "Samp_rate to low or pre_trigger_window to small ... less than 1 sample for :Triggered@10kHz Sink");
+        d_snk10000_triggered = time_domain_sink::make(d_signal_name+":Triggered@10kHz",  d_unit_name, 10000.0, TIME_SINK_MODE_TRIGGERED, pre_trigger_window, post_trigger_window);
+        d_demux_10000 = demux_ff::make(post_trigger_window, pre_trigger_window);
+
+        d_trigger_demand = demand_node_t::make();
+        boost::dynamic_pointer_cast<time_domain_sink_impl>(d_snk10000_triggered)->set_demand(d_trigger_demand);
+      }
+
+      // input to first raw-data-rate demux
+      connect(self(), 0, d_demux_raw, 0); // 0: values port
+      connect(self(), 1, d_demux_raw, 1); // 1: errors
+      // connect raw-data-rate demux to triggered time-domain sink
+      connect(d_demux_raw, 0, d_snk_raw_triggered, 0); // 0: values port
+      connect(d_demux_raw, 1, d_snk_raw_triggered, 1); // 1: errors
+
+      // first 10 kHz block to 10 kHz demux
+      auto trigger_node = find_level(d_trigger_level);
+      d_trigger_demand->set_parent(trigger_node->demand);
+      auto agg10000 = get_output(*trigger_node);
+      connect(agg10000, 0, d_demux_10000, 0);
+      connect(agg10000, 1, d_demux_10000, 1);
+      // connect 10 kHz demux to triggered time-domain sink
+      connect(d_demux_10000, 0, d_snk10000_triggered, 0); // 0: values port
+      connect(d_demux_10000, 1, d_snk10000_triggered, 1); // 1: errors
+    }
+
+    void
+    cascade_sink_impl::disconnect_triggered_sinks()
+    {
+      disconnect(self(), 0, d_demux_raw, 0);
+      disconnect(self(), 1, d_demux_raw, 1);
+      disconnect(d_demux_raw, 0, d_snk_raw_triggered, 0);
+      disconnect(d_demux_raw, 1, d_snk_raw_triggered, 1);
+
+      auto agg10000 = get_output(*find_level(d_trigger_level));
+      disconnect(agg10000, 0, d_demux_10000, 0);
+      disconnect(agg10000, 1, d_demux_10000, 1);
+      disconnect(d_demux_10000, 0, d_snk10000_triggered, 0);
+      disconnect(d_demux_10000, 1, d_snk10000_triggered, 1);
+      d_trigger_demand->set_parent(demand_node_t::sptr());
+    }
+
+    std::vector<cascade_level_t>
+    cascade_sink_impl::prune_levels(const std::vector<cascade_level_t> &levels,
+        const std::string &trigger_level)
+    {
+      std::set<std::string> names;
+      for (const auto &level : levels) {
+        std::string error;
+        if (level.name.empty()) {
+          error = "empty level name";
+        }
+        else if (names.count(level.name)) {
+          error = "duplicate level " + level.name;
+        }
+        else if (!level.parent.empty() && !names.count(level.parent)) {
+          error = "parent " + level.parent + " of level " + level.name + " not defined before";
+        }
+        else if (level.decimation < 1 || level.package_size < 0) {
+          error = "invalid decimation or package size of level " + level.name;
+        }
+
+        if (!error.empty()) {
+          std::ostringstream message;
+          message << "Exception in " << __FILE__ << ":" << __LINE__ << ": " << error;
+          throw std::invalid_argument(message.str());
+        }
+
+        names.insert(level.name);
+      }
+
+      if (!trigger_level.empty() && !names.count(trigger_level)) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": level " << trigger_level
+                << " feeding the triggered sinks is missing";
+        throw std::invalid_argument(message.str());
+      }
+
+      // Levels feeding a sink, children come after their parents
+      std::set<std::string> used;
+      for (auto it = levels.rbegin(); it != levels.rend(); ++it) {
+        if (it->package_size > 0 || it->name == trigger_level || used.count(it->name)) {
+          used.insert(it->name);
+          if (!it->parent.empty()) {
+            used.insert(it->parent);
+          }
+        }
+      }
+
+      std::vector<cascade_level_t> pruned;
+      for (const auto &level : levels) {
+        if (used.count(level.name)) {
+          pruned.push_back(level);
+        }
+      }
+
+      return pruned;
+    }
+
+    std::vector<cascade_level_t>
+    cascade_sink_impl::add_trigger_level(const std::vector<cascade_level_t> &levels, double samp_rate)
+    {
+      auto found = std::find_if(levels.begin(), levels.end(), [](const cascade_level_t &level) {
+        return level.name == "10kHz"; });
+      if (found != levels.end()) {
+        return levels;
+      }
+
+      auto extended = levels;
+      extended.insert(extended.begin(), cascade_level_t{"10kHz", "", static_cast<int>(samp_rate / 10000.0), 0});
+      return extended;
+    }
+
+    void
+    cascade_sink_impl::prefetch_designs(const cascade_sink_config_t &config)
+    {
+      const auto alg_id = algorithm_id_t(config.alg_id);
+      if (!fused_aggregation_ff::is_supported(alg_id)) {
+        // designed by the blocks themselves
+        return;
+      }
+
+      const auto levels = prune_levels(config.triggered_sinks_enabled
+              ? add_trigger_level(config.levels, config.samp_rate) : config.levels,
+              config.triggered_sinks_enabled ? "10kHz" : "");
+
+      // Same rates and cut-off frequencies as apply_levels
+      std::map<std::string, double> rates;
+      for (const auto &level : levels) {
+        const double input_rate = level.parent.empty() ? config.samp_rate : rates[level.parent];
+        const double samp_rate = input_rate / level.decimation;
+        rates[level.name] = samp_rate;
+
+        const double scale = samp_rate / 10000.0;
+        if (level.decimation > 1) {
+          fused_aggregation_ff::design_taps(alg_id, config.fir_taps, config.low_freq * scale,
+                  config.up_freq * scale, config.tr_width * scale, input_rate);
+        }
+      }
+    }
+
+    void
+    cascade_sink_impl::apply_levels(const std::vector<cascade_level_t> &new_levels)
+    {
+      const auto levels = prune_levels(new_levels, d_trigger_level);
+
+      // Errors are computed for the sinks publishing them, the triggered sinks and all their
+      // ancestors, children come after their parents
+      std::set<std::string> errors;
+      for (auto it = levels.rbegin(); it != levels.rend(); ++it) {
+        if (!it->values_only || it->name == d_trigger_level || errors.count(it->name)) {
+          errors.insert(it->name);
+          if (!it->parent.empty()) {
+            errors.insert(it->parent);
+          }
+        }
+      }
+
+      // Levels are kept if neither them nor any of their parents changed
+      std::set<std::string> kept;
+      for (const auto &level : levels) {
+        auto node = find_level(level.name);
+        if (node && node->level.parent == level.parent
+                && node->level.decimation == level.decimation
+                && node->level.package_size == level.package_size
+                && node->level.values_only == level.values_only
+                && node->errors == (errors.count(level.name) > 0)
+                && (level.parent.empty() || kept.count(level.parent))) {
+          kept.insert(level.name);
+        }
+      }
+
+      // Triggered sink follows its level
+      auto trigger_node = find_level(d_trigger_level);
+      const bool reconnect_trigger = d_triggered_sinks_enabled && !kept.count(d_trigger_level);
+      if (reconnect_trigger && trigger_node) {
+        auto output = get_output(*trigger_node);
+        disconnect(output, 0, d_demux_10000, 0);
+        disconnect(output, 1, d_demux_10000, 1);
+      }
+
+      // Children first
+      for (auto it = d_levels.rbegin(); it != d_levels.rend(); ++it) {
+        if (!kept.count(it->level.name)) {
+          disconnect_level(*it);
+          // sinks of the level might outlive it
+          it->demand->set_parent(demand_node_t::sptr());
+        }
+      }
+
+      std::vector<level_node_t> nodes;
+      std::vector<size_t> added;
+
+      for (const auto &level : levels) {
+        if (kept.count(level.name)) {
+          nodes.push_back(*find_level(level.name));
+          continue;
+        }
+
+        double input_rate = d_samp_rate;
+        demand_node_t::sptr parent_demand;
+        for (const auto &parent : nodes) {
+          if (parent.level.name == level.parent) {
+            input_rate = parent.samp_rate;
+            parent_demand = parent.demand;
+          }
+        }
+
+        level_node_t node;
+        node.level = level;
+        node.demand = demand_node_t::make(parent_demand);
+        node.samp_rate = input_rate / level.decimation;
+        node.errors = errors.count(level.name) > 0;
+
+        // cut-off frequencies were designed for the 10 kHz stage, scaled by 10 per stage
+        const double scale = node.samp_rate / 10000.0;
+        if (level.decimation > 1) {
+          node.agg = block_aggregation::make(d_alg_id, level.decimation, d_delay, d_fir_taps,
+                  d_low_freq * scale, d_up_freq * scale, d_tr_width * scale,
+                  d_fb_user_taps, d_fw_user_taps, input_rate, node.errors);
+          boost::dynamic_pointer_cast<block_aggregation_impl>(node.agg)->set_demand(node.demand);
+          if (d_state_file) {
+            boost::dynamic_pointer_cast<block_aggregation_impl>(node.agg)->set_state_file(d_state_file, level.name);
+          }
+        }
+
+        if (level.package_size > 0) {
+          node.sink = time_domain_sink::make(d_signal_name + "@" + level.name, d_unit_name,
+                  node.samp_rate, TIME_SINK_MODE_STREAMING, level.package_size);
+          boost::dynamic_pointer_cast<time_domain_sink_impl>(node.sink)->set_demand(node.demand);
+        }
+
+        added.push_back(nodes.size());
+        nodes.push_back(node);
+      }
+
+      d_levels = nodes;
+
+      for (auto index : added) {
+        connect_level(d_levels[index]);
+      }
+
+      trigger_node = find_level(d_trigger_level);
+      if (reconnect_trigger && trigger_node) {
+        auto output = get_output(*trigger_node);
+        connect(output, 0, d_demux_10000, 0);
+        connect(output, 1, d_demux_10000, 1);
+        d_trigger_demand->set_parent(trigger_node->demand);
+      }
+    }
+
+    const cascade_sink_impl::level_node_t *
+    cascade_sink_impl::find_level(const std::string &name) const
+    {
+      for (const auto &node : d_levels) {
+        if (node.level.name == name) {
+          return &node;
+        }
+      }
+      return nullptr;
+    }
+
+    gr::basic_block_sptr
+    cascade_sink_impl::get_output(const level_node_t &node)
+    {
+      if (!node.agg) {
+        return get_parent_output(node);
+      }
+
+      return node.agg;
+    }
+
+    gr::basic_block_sptr
+    cascade_sink_impl::get_parent_output(const level_node_t &node)
+    {
+      if (node.level.parent.empty()) {
+        return self();
+      }
+
+      return get_output(*find_level(node.level.parent));
+    }
+
+    void
+    cascade_sink_impl::connect_level(const level_node_t &node)
+    {
+      if (node.agg) {
+        auto input = get_parent_output(node);
+        connect(input, 0, node.agg, 0); // 0: values port
+        if (node.errors) {
+          connect(input, 1, node.agg, 1); // 1: errors
+        }
+      }
+
+      if (node.sink) {
+        auto output = get_output(node);
+        connect(output, 0, node.sink, 0);
+        if (!node.level.values_only) {
+          connect(output, 1, node.sink, 1);
+        }
+      }
+    }
+
+    void
+    cascade_sink_impl::disconnect_level(const level_node_t &node)
+    {
+      if (node.agg) {
+        auto input = get_parent_output(node);
+        disconnect(input, 0, node.agg, 0);
+        if (node.errors) {
+          disconnect(input, 1, node.agg, 1);
+        }
+      }
+
+      if (node.sink) {
+        auto output = get_output(node);
+        disconnect(output, 0, node.sink, 0);
+        if (!node.level.values_only) {
+          disconnect(output, 1, node.sink, 1);
+        }
+      }
+    }
+
   } /* namespace digitizers */
 } /* namespace gr */
 
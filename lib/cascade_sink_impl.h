@@ -16,6 +16,8 @@
 #include <digitizers/interlock_generation_ff.h>
 #include <digitizers/demux_ff.h>
 #include <digitizers/stft_algorithms.h>
+#include "demand.h"
+#include "state_file.h"
 
 #define WINDOW_SIZE_FREQ_DOMAIN_FAST 1024
 #define WINDOW_SIZE_FREQ_DOMAIN_SLOW 1024
@@ -28,19 +30,39 @@ namespace gr {
     class cascade_sink_impl : public cascade_sink
     {
      private:
-      block_aggregation::sptr d_agg10000;
-      block_aggregation::sptr d_agg1000;
-      block_aggregation::sptr d_agg100;
-      block_aggregation::sptr d_agg25;
-      block_aggregation::sptr d_agg10;
-      block_aggregation::sptr d_agg1;
-
-      time_domain_sink::sptr d_snk10000;
-      time_domain_sink::sptr d_snk1000;
-      time_domain_sink::sptr d_snk100;
-      time_domain_sink::sptr d_snk25;
-      time_domain_sink::sptr d_snk10;
-      time_domain_sink::sptr d_snk1;
+      /*!
+       * \brief Instantiated aggregation level.
+       */
+      struct level_node_t
+      {
+        cascade_level_t level;
+        double samp_rate;              // output sample rate
+        block_aggregation::sptr agg;   // null for a pass-through level (decimation of one)
+        time_domain_sink::sptr sink;   // null if the package size is zero
+        bool errors;                   // output carries the errors, see cascade_level_t
+        demand_node_t::sptr demand;    // consumers of the level and its children
+      };
+
+      // Aggregation ladder, parents precede their children
+      std::vector<level_node_t> d_levels;
+
+      // Parameters shared by all the levels
+      int d_alg_id;
+      int d_delay;
+      std::vector<float> d_fir_taps;
+      double d_low_freq;
+      double d_up_freq;
+      double d_tr_width;
+      std::vector<double> d_fb_user_taps;
+      std::vector<double> d_fw_user_taps;
+      double d_samp_rate;
+      std::string d_signal_name;
+      std::string d_unit_name;
+
+      // Level feeding the triggered 10 kHz sink, empty if not used
+      std::string d_trigger_level;
+      unsigned d_pre_trigger_window_raw;
+      unsigned d_post_trigger_window_raw;
 
       // demux blocks
       demux_ff::sptr		 d_demux_raw;
@@ -50,6 +72,7 @@ namespace gr {
 
       time_domain_sink::sptr d_snk_raw_triggered;
       time_domain_sink::sptr d_snk10000_triggered;
+      demand_node_t::sptr d_trigger_demand;   // of the triggered 10 kHz sink, a child of the trigger level
 
       freq_sink_f::sptr      d_freq_snk_triggered;
       freq_sink_f::sptr      d_freq_snk10k_triggered;
@@ -69,12 +92,37 @@ namespace gr {
       time_domain_sink::sptr d_snk_interlock_ref;
       time_domain_sink::sptr d_snk_interlock_max;
 
-      bool d_streaming_sinks_enabled;
       bool d_triggered_sinks_enabled;
       bool d_frequency_sinks_enabled;
       bool d_postmortem_sinks_enabled;
       bool d_interlocks_enabled;
 
+      // Buffer plan, reapplied whenever blocks are added, no plan if the latency is zero
+      uint64_t d_buffer_budget;
+      double d_buffer_latency;
+
+      // Cores the chains are distributed over, see set_core_affinity
+      std::vector<int> d_cores;
+
+      // Real-time memory mode, see set_realtime_memory
+      bool d_realtime_memory;
+
+      // Persisted filter states, null if disabled, see set_state_file
+      state_file_t::sptr d_state_file;
+
+      /*!
+       * \brief Output buffer of a block within the cascade (all the blocks have two outputs,
+       * values and errors).
+       */
+      struct output_buffer_t
+      {
+        gr::basic_block_sptr block;
+        double samp_rate;              // output sample rate
+        long min_items;                // required by the consumers
+        long items;                    // planned
+        int nports;                    // values only or values and errors
+      };
+
      public:
       cascade_sink_impl(int alg_id,
           int delay,
@@ -88,7 +136,7 @@ namespace gr {
           float pm_buffer,
           std::string signal_name,
           std::string unit_name,
-          bool streaming_sinks_enabled,
+          const std::vector<cascade_level_t> &levels,
           bool triggered_sinks_enabled,
           bool frequency_sinks_enabled,
           bool postmortem_sinks_enabled,
@@ -106,6 +154,91 @@ namespace gr {
 
       std::vector<function_ff::sptr> get_reference_function_blocks() override;
 
+      void set_levels(const std::vector<cascade_level_t> &levels) override;
+
+      std::vector<cascade_level_t> get_levels() override;
+
+      std::vector<std::string> get_active_levels() override;
+
+      void set_triggered_sinks_enabled(bool enabled) override;
+
+      buffer_plan_t plan_buffers(uint64_t memory_budget, double latency) override;
+
+      void set_core_affinity(const std::vector<int> &cores) override;
+
+      std::vector<int> get_core_affinity() override;
+
+      void set_state_file(const std::string &path, double period, double max_age) override;
+
+      void set_realtime_memory(bool enabled) override;
+
+      size_t get_locked_memory() override;
+
+      /*!
+       * \brief Validates the levels and drops the ones not feeding any sink, i.e. with a zero
+       * package size, not being the trigger level (if not empty) and without children. Throws
+       * std::invalid_argument if the levels are not valid.
+       */
+      static std::vector<cascade_level_t> prune_levels(const std::vector<cascade_level_t> &levels,
+              const std::string &trigger_level);
+
+      /*!
+       * \brief Adds the level feeding the triggered 10 kHz sink if missing.
+       */
+      static std::vector<cascade_level_t> add_trigger_level(const std::vector<cascade_level_t> &levels,
+              double samp_rate);
+
+      /*!
+       * \brief Computes the filter designs the aggregation blocks of the given cascade will
+       * use, i.e. puts them into the design cache.
+       */
+      static void prefetch_designs(const cascade_sink_config_t &config);
+
+     private:
+
+      /*!
+       * \brief Rebuilds new and changed levels, the flowgraph needs to be locked if running.
+       */
+      void apply_levels(const std::vector<cascade_level_t> &levels);
+
+      const level_node_t *find_level(const std::string &name) const;
+
+      // Output of the level, i.e. of the parent if the level does not aggregate
+      gr::basic_block_sptr get_output(const level_node_t &node);
+
+      // Output of the parent level, or the raw input
+      gr::basic_block_sptr get_parent_output(const level_node_t &node);
+
+      void connect_level(const level_node_t &node);
+
+      void disconnect_level(const level_node_t &node);
+
+      /*!
+       * \brief Creates the triggered demux blocks and sinks on first use and connects them, the
+       * trigger level must be instantiated.
+       */
+      void connect_triggered_sinks();
+
+      void disconnect_triggered_sinks();
+
+      // Output buffers of the instantiated blocks along with the minimum sizes
+      std::vector<output_buffer_t> get_output_buffers();
+
+      // Plans the items of each buffer, the plan exceeds the budget if the minimum does
+      buffer_plan_t make_buffer_plan(std::vector<output_buffer_t> &buffers, uint64_t memory_budget,
+              double latency);
+
+      void apply_buffer_plan(const std::vector<output_buffer_t> &buffers);
+
+      // Reapplies the current plan, if any
+      void update_buffer_plan();
+
+      // Pins the blocks according to d_cores, or unpins them if empty
+      void apply_core_affinity();
+
+      // Passes d_realtime_memory on to the time-domain sinks
+      void apply_realtime_memory();
+
     };
 
   } // namespace digitizers
@@ -11,12 +11,17 @@
 #include <gnuradio/io_signature.h>
 #include "chi_square_fit_impl.h"
 #include <boost/tokenizer.hpp>
-#include <boost/make_shared.hpp>
+#include <algorithm>
 #include <stdexcept>
 
 namespace gr {
   namespace digitizers {
 
+    // Full resolution iterations after the coarse fit, and half width of the region of
+    // interest in sigmas (Gaussian)
+    static const int FINE_ITERATIONS = 10;
+    static const double COARSE_ROI_WIDTHS = 8.0;
+
     std::vector<std::string> parse_names(std::string str)
     {
       std::vector<std::string> names;
@@ -34,6 +39,39 @@ namespace gr {
       return names;
     }
 
+    chi_square_fit_impl::fit_slot_t::fit_slot_t(const root_fitter_t &prototype)
+      : root(prototype.clone()),
+        coarse_decim(1),
+        chi_square(0.0),
+        ndf(0),
+        converged(false)
+    {
+    }
+
+    chi_square_fit_impl::fit_slot_t::fit_slot_t(const fit_model_t &model, const std::vector<float> &xvals,
+            int coarse_decim)
+      : lm(new lm_fitter_t(model, xvals)),
+        coarse_decim(coarse_decim),
+        chi_square(0.0),
+        ndf(0),
+        converged(false)
+    {
+      // x of the averaged samples, the remainder is left out
+      const size_t ncoarse = coarse_decim > 1 ? xvals.size() / coarse_decim : 0;
+      if (ncoarse > static_cast<size_t>(model.nparams)) {
+        std::vector<float> coarse_xvals(ncoarse);
+        for (size_t i = 0; i < ncoarse; i++) {
+          double sum = 0.0;
+          for (int k = 0; k < coarse_decim; k++) {
+            sum += xvals[i * coarse_decim + k];
+          }
+          coarse_xvals[i] = static_cast<float>(sum / coarse_decim);
+        }
+        coarse.reset(new lm_fitter_t(model, coarse_xvals));
+        coarse_data.resize(ncoarse);
+      }
+    }
+
     chi_square_fit::sptr
     chi_square_fit::make(int in_vec_size,
         const std::string &func,
@@ -94,7 +132,13 @@ namespace gr {
                     sizeof(char)}))),
        d_vec_len(in_vec_size),
        d_n_params(n_params),
-       d_par_names(par_name)
+       d_par_names(par_name),
+       d_native(false),
+       d_root_single_threaded(false),
+       d_nthreads(1),
+       d_coarse_decim(1),
+       d_coarse_decim_active(1),
+       d_warm_start(false)
     {
       d_xvals.reserve(d_vec_len);
 
@@ -113,6 +157,55 @@ namespace gr {
     {
     }
 
+    void
+    chi_square_fit_impl::set_nthreads(int nthreads)
+    {
+      if (nthreads < 1) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid number of threads: " << nthreads;
+        throw std::invalid_argument(message.str());
+      }
+
+      boost::mutex::scoped_lock lg(d_mutex);
+      d_nthreads = nthreads;
+    }
+
+    void
+    chi_square_fit_impl::set_warm_start(bool enable)
+    {
+      boost::mutex::scoped_lock lg(d_mutex);
+      d_warm_start = enable;
+    }
+
+    void
+    chi_square_fit_impl::set_coarse_fit(int decimation)
+    {
+      if (decimation < 1) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid decimation: " << decimation;
+        throw std::invalid_argument(message.str());
+      }
+
+      // the slots are rebuilt
+      boost::mutex::scoped_lock lg(d_mutex);
+      d_coarse_decim = decimation;
+      d_design_updated = true;
+    }
+
+    bool
+    chi_square_fit_impl::start()
+    {
+      d_warm_params.clear();
+      return true;
+    }
+
+    bool
+    chi_square_fit_impl::stop()
+    {
+      d_pool.stop();
+      return true;
+    }
+
     void
     chi_square_fit_impl::forecast(int noutput_items, gr_vector_int &ninput_items_required)
     {
@@ -141,6 +234,12 @@ namespace gr {
         throw std::invalid_argument(message.str());
       }
 
+      // Interpreted formulas need the ROOT module, it is loaded (or reported missing) right away
+      fit_model_t model;
+      if (!find_fit_model(func, d_n_params, model)) {
+        root_fit_module();
+      }
+
       boost::mutex::scoped_lock lg(d_mutex);
 
       // save provided parameters
@@ -161,12 +260,6 @@ namespace gr {
     {
       boost::mutex::scoped_lock lg(d_mutex);
 
-      d_func = TF1("func", d_function.c_str(), d_function_lower_limit, d_function_upper_limit);
-
-      for (int i = 0; i < d_n_params; i++) {
-        d_func.SetParName(i, d_par_names[i].c_str());
-      }
-
       double step = (d_function_upper_limit - d_function_lower_limit) / (1.0 * d_vec_len - 1.0);
       d_xvals.clear();
       for (int i = 0; i < d_vec_len; i++)
@@ -174,8 +267,19 @@ namespace gr {
         d_xvals.push_back(d_function_lower_limit + static_cast<double>(i) * step);
       }
 
+      // ROOT interprets the formula only if it is not one of the compiled models, i.e. the ROOT
+      // module is loaded by the first block fitting such a formula
+      d_native = find_fit_model(d_function, d_n_params, d_model);
+      d_root_prototype.reset();
+      if (!d_native) {
+        std::vector<std::string> names(d_par_names.begin(), d_par_names.begin() + d_n_params);
+        d_root_prototype = root_fit_module().make_fitter(d_function, d_function_lower_limit,
+                d_function_upper_limit, names, d_xvals);
+      }
+
       // take snapshot of certain parameters
       d_chi_error = d_max_chi_square_error;
+      d_coarse_decim_active = d_coarse_decim;
     }
 
     int
@@ -184,6 +288,7 @@ namespace gr {
       gr_vector_const_void_star &input_items,
       gr_vector_void_star &output_items)
     {
+      block_stats_scope_t stats(d_stats);
       //check if input items is less than the minimal number of samples for a chi square fit
       int in_items = *std::min_element(ninput_items.begin(), ninput_items.end());
       if(in_items == 0) {
@@ -193,15 +298,40 @@ namespace gr {
       if (d_design_updated) {
         do_update_design();
         d_design_updated = false;
+        d_slots.clear();
+        d_warm_params.clear();
       }
-      for (int i = 0; i < d_n_params; i++) {
-        d_func.SetParameter(i, d_par_initial_values[i]);
-        d_func.SetParLimits(i, d_par_lower_limit[i], d_par_upper_limit[i]);
 
-        // fix parameter, if the parameter range is zero or inverted
-        if (d_par_lower_limit[i] >= d_par_upper_limit[i] || !d_par_fittable[i]) {
-          d_func.FixParameter(i, d_par_initial_values[i]);
+      int nthreads;
+      bool warm_start;
+      {
+        boost::mutex::scoped_lock lg(d_mutex);
+        nthreads = d_nthreads;
+        warm_start = d_warm_start;
+      }
+
+      if (!warm_start) {
+        d_warm_params.clear();
+      }
+
+      // Concurrent ROOT fits need to be enabled once per process, before the first one
+      if (nthreads > 1 && !d_native && (d_root_single_threaded || !root_fit_module().enable_thread_safety())) {
+        if (!d_root_single_threaded) {
+          GR_LOG_WARN(d_logger, "multi-threaded fitting requires ROOT 6.06 or newer, using a single thread");
+          d_root_single_threaded = true;
         }
+        nthreads = 1;
+      }
+
+      if (d_pool.size() != nthreads - 1) {
+        d_pool.start(nthreads - 1, get_block_name(this), "fit");
+      }
+
+      // one vector per thread
+      const int nvectors = std::min({in_items, noutput_items, nthreads});
+      while (static_cast<int>(d_slots.size()) < nvectors) {
+        d_slots.emplace_back(d_native ? new fit_slot_t(d_model, d_xvals, d_coarse_decim_active)
+                : new fit_slot_t(*d_root_prototype));
       }
 
       const float *in = (const float *) input_items[0];
@@ -210,30 +340,147 @@ namespace gr {
       float *chi_sq = (float *) output_items[2];
       char *valid = (char *) output_items[3];
 
-      assert((int)d_xvals.size() == d_vec_len);
-      d_samps = boost::make_shared<TGraphErrors>(d_vec_len, d_xvals.data(), in);
+      auto task = [&](size_t i) {
+        fit_vector(*d_slots[i], in + i * d_vec_len, d_warm_params, params + i * d_n_params,
+                errs + i * d_n_params, chi_sq + i, valid + i);
+      };
+      d_pool.run(nvectors, task);
+
+      // seed for the next batch
+      if (warm_start) {
+        for (int i = nvectors - 1; i >= 0; i--) {
+          if (d_slots[i]->converged) {
+            d_warm_params = d_slots[i]->solution;
+            break;
+          }
+        }
+      }
 
-      // Note a copy of the function object is made
-      auto func = d_func;
+      consume_each(nvectors);
+      return nvectors;
+    }
 
-      const Char_t *fitterOptions = "0NEQR";
-      d_samps->Fit(&func, fitterOptions);
+    bool
+    chi_square_fit_impl::fit(fit_slot_t &slot, const std::vector<double> &start_values)
+    {
+      int status;
 
-      for(int i = 0; i < d_n_params; i++) {
-        params[i] = static_cast<float>(func.GetParameter(i));
-        errs[i] = static_cast<float>(func.GetParError(i));
+      // fix parameter, if the parameter range is zero or inverted
+      std::vector<bool> fixed(d_n_params);
+      std::vector<double> start = start_values;
+      for (int i = 0; i < d_n_params; i++) {
+        fixed[i] = d_par_lower_limit[i] >= d_par_upper_limit[i] || !d_par_fittable[i];
+        if (fixed[i]) {
+          start[i] = d_par_initial_values[i];
+        }
+      }
+
+      if (slot.lm) {
+        lm_result_t result;
+        if (slot.coarse) {
+          result = fit_coarse_to_fine(slot, start, fixed);
+        }
+        else {
+          slot.solution = start;
+          result = slot.lm->fit(slot.solution, fixed, d_par_lower_limit, d_par_upper_limit);
+        }
+        status = result.status;
+        slot.errors = slot.lm->errors();
+        slot.chi_square = result.chi_square;
+        slot.ndf = result.ndf;
+      }
+      else {
+        status = slot.root->fit(start, fixed, d_par_lower_limit, d_par_upper_limit,
+                slot.solution, slot.errors, slot.chi_square, slot.ndf);
       }
 
-      double chiSquare = func.GetChisquare();
-      int    NDF = func.GetNDF();
+      double chi_square = slot.chi_square / slot.ndf;
+      return status == 0 && std::abs(chi_square - 1.0) < d_chi_error;
+    }
 
-      chi_sq[0] = chiSquare / NDF;
-      valid[0] = std::abs(chi_sq[0] - 1.0) < d_chi_error ? 1 : 0;
+    lm_result_t
+    chi_square_fit_impl::fit_coarse_to_fine(fit_slot_t &slot, const std::vector<double> &start,
+            const std::vector<bool> &fixed)
+    {
+      // most of the iterations on the averaged samples
+      slot.solution = start;
+      auto coarse = slot.coarse->fit(slot.solution, fixed, d_par_lower_limit, d_par_upper_limit);
+      if (coarse.status != 0) {
+        slot.solution = start;
+      }
 
-      consume_each(1);
-      return 1;
+      // refinement, within the region of interest if the model has one
+      bool restricted = false;
+      double roi_lower, roi_upper;
+      if (fit_model_roi(d_model, slot.solution, COARSE_ROI_WIDTHS, roi_lower, roi_upper)) {
+        int first = d_vec_len, last = -1;
+        for (int i = 0; i < d_vec_len; i++) {
+          if (d_xvals[i] >= roi_lower && d_xvals[i] <= roi_upper) {
+            first = std::min(first, i);
+            last = i;
+          }
+        }
+        const int count = last - first + 1;
+        if (count > 4 * d_n_params && count < d_vec_len) {
+          slot.lm->set_range(first, count);
+          restricted = true;
+        }
+      }
+
+      auto result = slot.lm->fit(slot.solution, fixed, d_par_lower_limit, d_par_upper_limit, FINE_ITERATIONS);
+      slot.lm->reset_range();
+
+      if (result.status != 0) {
+        result = slot.lm->fit(slot.solution, fixed, d_par_lower_limit, d_par_upper_limit);
+      }
+      else if (restricted) {
+        result = slot.lm->evaluate(slot.solution, fixed, d_par_lower_limit, d_par_upper_limit);
+      }
+
+      return result;
+    }
+
+    void
+    chi_square_fit_impl::fit_vector(fit_slot_t &slot, const float *in, const std::vector<double> &seed,
+            float *params, float *errs, float *chi_sq, char *valid)
+    {
+      assert((int)d_xvals.size() == d_vec_len);
+      if (slot.lm) {
+        slot.lm->set_data(in);
+        if (slot.coarse) {
+          const int decim = slot.coarse_decim;
+          for (size_t i = 0; i < slot.coarse_data.size(); i++) {
+            float sum = 0.0f;
+            for (int k = 0; k < decim; k++) {
+              sum += in[i * decim + k];
+            }
+            slot.coarse_data[i] = sum / decim;
+          }
+          slot.coarse->set_data(&slot.coarse_data[0]);
+        }
+      }
+      else {
+        slot.root->set_data(in);
+      }
+
+      bool converged = false;
+      if (!seed.empty()) {
+        converged = fit(slot, seed);
+      }
+      if (!converged) {
+        // cold start, also if the warm started fit diverged
+        converged = fit(slot, d_par_initial_values);
+      }
+
+      for(int i = 0; i < d_n_params; i++) {
+        params[i] = static_cast<float>(slot.solution[i]);
+        errs[i] = static_cast<float>(slot.errors[i]);
+      }
+      slot.converged = converged;
+
+      chi_sq[0] = slot.chi_square / slot.ndf;
+      valid[0] = std::abs(chi_sq[0] - 1.0) < d_chi_error ? 1 : 0;
     }
 
   } /* namespace digitizers */
 } /* namespace gr */
-
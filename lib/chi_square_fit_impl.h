@@ -8,9 +8,13 @@
 #define INCLUDED_DIGITIZERS_CHI_SQUARE_FIT_IMPL_H
 
 #include <digitizers/chi_square_fit.h>
-#include <TF1.h>
-#include <TGraphErrors.h>
 #include <boost/thread/mutex.hpp>
+#include "conversion_pool.h"
+#include "lm_fitter.h"
+#include "root_fit_module.h"
+
+#include <memory>
+#include "block_stats_impl.h"
 
 namespace gr {
   namespace digitizers {
@@ -35,13 +39,51 @@ namespace gr {
       double d_max_chi_square_error;
 
       // used by the work function
-      TF1 d_func;
+      bool d_native;          // compiled model fitted by lm_fitter_t, ROOT module otherwise
+      fit_model_t d_model;
+      std::unique_ptr<root_fitter_t> d_root_prototype;  // not used for compiled models
+      bool d_root_single_threaded;
       double d_chi_error; // snapshot
-      boost::shared_ptr<TGraphErrors> d_samps;
       std::vector<float> d_xvals;
 
+      // Fitter objects and result of a fit, one per vector fitted concurrently
+      struct fit_slot_t
+      {
+        // ROOT backend
+        std::unique_ptr<root_fitter_t> root;
+
+        // native backend
+        std::unique_ptr<lm_fitter_t> lm;
+        std::unique_ptr<lm_fitter_t> coarse;      // averaged samples, null if disabled
+        int coarse_decim;
+        std::vector<float> coarse_data;
+
+        std::vector<double> solution;
+        std::vector<double> errors;
+        double chi_square;
+        int ndf;
+        bool converged;
+
+        fit_slot_t(const root_fitter_t &prototype);
+        fit_slot_t(const fit_model_t &model, const std::vector<float> &xvals, int coarse_decim);
+      };
+
+      std::vector<std::unique_ptr<fit_slot_t>> d_slots;
+      conversion_pool_t d_pool;   // the scheduler thread participates, i.e. nthreads - 1 workers
+
       boost::mutex d_mutex;
       bool d_design_updated;
+      int d_nthreads;
+
+      // coarse-to-fine fitting, decimation of the coarse fit (1 if disabled)
+      int d_coarse_decim;
+      int d_coarse_decim_active;  // snapshot
+
+      // warm start
+      bool d_warm_start;
+      std::vector<double> d_warm_params;  // empty if there is no converged solution
+
+      block_stats_recorder_t d_stats {this};
 
      public:
       chi_square_fit_impl(int in_vec_size,
@@ -70,6 +112,16 @@ namespace gr {
           const std::vector<double> &par_lim_dn,
           double chi_square_error) override;
 
+      void set_nthreads(int nthreads) override;
+
+      void set_warm_start(bool enable) override;
+
+      void set_coarse_fit(int decimation) override;
+
+      bool start() override;
+
+      bool stop() override;
+
       void forecast(int noutput_items, gr_vector_int &ninput_items_required);
 
       int general_work(int noutput_items,
@@ -80,6 +132,17 @@ namespace gr {
      private:
       // updates all the member variables used for fitting
       void do_update_design();
+
+      // returns true if the fit converged, the result is stored in the slot
+      bool fit(fit_slot_t &slot, const std::vector<double> &start_values);
+
+      // native fit of the averaged samples refined at full resolution, see set_coarse_fit
+      lm_result_t fit_coarse_to_fine(fit_slot_t &slot, const std::vector<double> &start,
+              const std::vector<bool> &fixed);
+
+      // seed is empty for a cold start
+      void fit_vector(fit_slot_t &slot, const float *in, const std::vector<double> &seed,
+              float *params, float *errs, float *chi_sq, char *valid);
     };
 
   } // namespace digitizers
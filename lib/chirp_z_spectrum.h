@@ -0,0 +1,213 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_CHIRP_Z_SPECTRUM_H
+#define INCLUDED_DIGITIZERS_CHIRP_Z_SPECTRUM_H
+
+#include <gnuradio/fft/fft.h>
+#include <gnuradio/gr_complex.h>
+#include <volk/volk.h>
+
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <vector>
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Magnitude spectrum of a window, bins equally spaced in [f_min, f_max], computed by
+     * the chirp-z transform (Bluestein). Drop-in replacement of goertzel_spectrum_t for many
+     * bins: O(L log L) per window, L >= winsize + nbins - 1 being a power of two, instead of
+     * O(nbins * winsize).
+     *
+     * The bins are expressed as a convolution of the chirped window with a chirp, evaluated by
+     * two FFTs of size L. The input chirp and the transformed convolution chirp depend on the
+     * frequency bounds only and are kept in a small LRU cache, keyed on the bounds quantised
+     * as by goertzel_spectrum_t (i.e. the bin frequencies are the same).
+     *
+     * The FFTs are single precision, the magnitudes deviate from the Goertzel ones by about
+     * 1e-6 of the largest magnitude. Phases are zero, as by goertzel_spectrum_t.
+     */
+    class chirp_z_spectrum_t
+    {
+    public:
+
+      static const int FREQ_QUANTA_PER_BIN = 1000;
+      static const size_t CHIRP_CACHE_SIZE = 8;
+
+      // Minimum number of bins per FFT stage (log2 L) for the chirp-z transform to pay off
+      static const int MIN_BINS_PER_STAGE = 16;
+
+      /*!
+       * \brief Returns true if the chirp-z transform is cheaper than the Goertzel recurrence.
+       */
+      static bool is_preferred(int winsize, int nbins)
+      {
+        const int fft_size = get_fft_size(winsize, nbins);
+        int stages = 0;
+        while ((1 << stages) < fft_size) {
+          stages++;
+        }
+        return nbins > 1 && nbins > MIN_BINS_PER_STAGE * stages;
+      }
+
+      chirp_z_spectrum_t(double samp_rate, int winsize, int nbins, const std::vector<float> &window)
+        : d_samp_length(1.0 / samp_rate),
+          d_winsize(winsize),
+          d_nbins(nbins),
+          d_fft_size(get_fft_size(winsize, nbins)),
+          d_window_function(window),
+          d_windowed(winsize),
+          d_fft(new gr::fft::fft_complex(d_fft_size))
+      {
+      }
+
+      int winsize() const
+      {
+        return d_winsize;
+      }
+
+      int nbins() const
+      {
+        return d_nbins;
+      }
+
+      void set_samp_rate(double samp_rate)
+      {
+        d_samp_length = 1.0 / samp_rate;
+        d_chirp_tables.clear();
+      }
+
+      /*!
+       * \brief Computes the spectrum of winsize samples, outputs nbins magnitudes, phases
+       * (always zero) and bin frequencies.
+       */
+      void compute(const float *in, float f_min, float f_max, float *mag, float *phs, float *fqs)
+      {
+        const auto &table = get_chirp_table(f_min, f_max);
+
+        gr_complex *buffer = d_fft->get_inbuf();
+        const gr_complex *spectrum = d_fft->get_outbuf();
+
+        // chirped window, zero padded
+        volk_32f_x2_multiply_32f(&d_windowed[0], in, &d_window_function[0], d_winsize);
+        volk_32fc_32f_multiply_32fc(buffer, &table.chirp[0], &d_windowed[0], d_winsize);
+        memset(buffer + d_winsize, 0, (d_fft_size - d_winsize) * sizeof(gr_complex));
+        d_fft->execute();
+
+        // circular convolution with the chirp, the inverse FFT is taken by a forward one with
+        // reversed output indices (the magnitude is the same)
+        volk_32fc_x2_multiply_32fc(buffer, spectrum, &table.kernel[0], d_fft_size);
+        d_fft->execute();
+
+        // the output chirp has unit magnitude, it is not needed for the magnitudes
+        for (int i = 0; i < d_nbins; i++) {
+          mag[i] = std::abs(spectrum[(d_fft_size - i) % d_fft_size]) / d_winsize;
+          phs[i] = 0.0;
+        }
+
+        memcpy(fqs, &table.freqs[0], d_nbins * sizeof(float));
+      }
+
+    private:
+
+      static int get_fft_size(int winsize, int nbins)
+      {
+        int fft_size = 1;
+        while (fft_size < winsize + nbins - 1) {
+          fft_size <<= 1;
+        }
+        return fft_size;
+      }
+
+      // Chirps for a pair of quantised frequency bounds
+      struct chirp_table_t
+      {
+        int64_t lo;
+        int64_t hi;
+        std::vector<gr_complex> chirp;   // exp(-j (w0 n + dw n^2 / 2)), winsize elements
+        std::vector<gr_complex> kernel;  // FFT of exp(j dw m^2 / 2), scaled by 1 / L
+        std::vector<float> freqs;
+      };
+
+      const chirp_table_t &get_chirp_table(float f_min, float f_max)
+      {
+        const double quantum = 1.0 / (d_samp_length * d_winsize * FREQ_QUANTA_PER_BIN);
+        const int64_t lo = std::llround(f_min / quantum);
+        const int64_t hi = std::llround(f_max / quantum);
+
+        for (auto it = d_chirp_tables.begin(); it != d_chirp_tables.end(); ++it) {
+          if (it->lo == lo && it->hi == hi) {
+            // most recently used first
+            d_chirp_tables.splice(d_chirp_tables.begin(), d_chirp_tables, it);
+            return d_chirp_tables.front();
+          }
+        }
+
+        if (d_chirp_tables.size() >= CHIRP_CACHE_SIZE) {
+          d_chirp_tables.pop_back();
+        }
+
+        d_chirp_tables.emplace_front();
+        auto &table = d_chirp_tables.front();
+        table.lo = lo;
+        table.hi = hi;
+        table.chirp.resize(d_winsize);
+        table.kernel.resize(d_fft_size);
+        table.freqs.resize(d_nbins);
+
+        // the same bin frequencies as goertzel_spectrum_t
+        const double f_lo = lo * quantum;
+        const double f_range = hi * quantum - f_lo;
+        for (int i = 0; i < d_nbins; i++) {
+          double bin_f_range_factor = static_cast<double>(i) / static_cast<double>(d_nbins-1);
+          table.freqs[i] = f_lo + (bin_f_range_factor * f_range);
+        }
+
+        const double w0 = 2.0 * M_PI * f_lo * d_samp_length;
+        const double dw = 2.0 * M_PI * f_range / (d_nbins - 1) * d_samp_length;
+
+        // n^2 is exact in double precision, the phases are evaluated before rounding to float
+        for (int n = 0; n < d_winsize; n++) {
+          const double square = static_cast<double>(n) * n;
+          table.chirp[n] = std::polar(1.0, -(w0 * n + 0.5 * dw * square));
+        }
+
+        // chirp at the lags -(winsize - 1) .. nbins - 1, negative ones wrapped around
+        gr_complex *buffer = d_fft->get_inbuf();
+        memset(buffer, 0, d_fft_size * sizeof(gr_complex));
+        for (int m = -(d_winsize - 1); m < d_nbins; m++) {
+          const double square = static_cast<double>(m) * m;
+          buffer[(m + d_fft_size) % d_fft_size] = std::polar(1.0 / d_fft_size, 0.5 * dw * square);
+        }
+        d_fft->execute();
+        memcpy(&table.kernel[0], d_fft->get_outbuf(), d_fft_size * sizeof(gr_complex));
+
+        return table;
+      }
+
+      double d_samp_length;
+      int d_winsize;
+      int d_nbins;
+      int d_fft_size;
+      std::vector<float> d_window_function;
+      std::vector<float> d_windowed;
+
+      std::unique_ptr<gr::fft::fft_complex> d_fft;
+
+      // Least recently used table last, cleared if the sample rate changes
+      std::list<chirp_table_t> d_chirp_tables;
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_CHIRP_Z_SPECTRUM_H */
@@ -0,0 +1,246 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_CHUNK_MEMORY_H
+#define INCLUDED_DIGITIZERS_CHUNK_MEMORY_H
+
+#include <boost/noncopyable.hpp>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <string>
+
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <vector>
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Prefaults the pages of the region and locks them into RAM, i.e. touching the region
+     * later on never page faults. The content is kept.
+     *
+     * Locking is best-effort (see RLIMIT_MEMLOCK), if it fails the pages are still prefaulted
+     * where the kernel supports it (MADV_POPULATE_WRITE). Returns the number of bytes locked
+     * (whole pages), zero if not locked. The pages are unlocked when the memory is unmapped.
+     */
+    static inline size_t
+    lock_memory(const void *addr, size_t size)
+    {
+      if (addr == nullptr || size == 0) {
+        return 0;
+      }
+
+      const auto page = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+      const auto first = reinterpret_cast<uintptr_t>(addr) / page * page;
+      const auto last = (reinterpret_cast<uintptr_t>(addr) + size + page - 1) / page * page;
+
+      // mlock faults the pages in (writable private mappings are made writable)
+      if (mlock(reinterpret_cast<const void *>(first), last - first) == 0) {
+        return last - first;
+      }
+
+#ifdef MADV_POPULATE_WRITE
+      madvise(reinterpret_cast<void *>(first), last - first, MADV_POPULATE_WRITE);
+#endif
+      return 0;
+    }
+
+    /*!
+     * \brief A single contiguous memory region (slab) backing application buffer data chunks.
+     *
+     * The memory is obtained with mmap. If requested, explicit huge pages (MAP_HUGETLB) are tried
+     * first, falling back to transparent huge pages (MADV_HUGEPAGE). Optionally the region is bound
+     * to a NUMA node before the pages are touched, and prefaulted and locked into RAM (mlock)
+     * right away. All are best-effort, actual outcome can be checked via the is_huge_page_backed,
+     * is_explicit_huge_page_backed, is_numa_bound and is_locked methods.
+     *
+     * The region starts on a page boundary, on a huge page boundary if backed by explicit huge
+     * pages. A NUMA node the system doesn't have is not bound to (is_numa_bound returns false).
+     */
+    class chunk_memory_t : boost::noncopyable
+    {
+    public:
+
+      static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+      chunk_memory_t()
+        : d_addr(nullptr),
+          d_size(0),
+          d_huge_pages(false),
+          d_explicit_huge_pages(false),
+          d_numa_bound(false),
+          d_locked(false)
+      {
+      }
+
+      ~chunk_memory_t()
+      {
+        release();
+      }
+
+      /*!
+       * \brief Allocates the region, previously allocated memory is released. Throws std::bad_alloc
+       * if no memory is available.
+       *
+       * \param size_bytes size of the region in bytes
+       * \param huge_pages try to back the region with huge pages
+       * \param numa_node NUMA node to bind the memory to, negative value for no binding
+       * \param lock prefault the region and lock it into RAM
+       */
+      void allocate(size_t size_bytes, bool huge_pages, int numa_node, bool lock=false)
+      {
+        release();
+
+        if (size_bytes == 0) {
+          return;
+        }
+
+        void *addr = MAP_FAILED;
+        size_t size = size_bytes;
+
+#ifdef MAP_HUGETLB
+        if (huge_pages) {
+          auto huge_size = round_up(size_bytes, HUGE_PAGE_SIZE);
+          addr = mmap(nullptr, huge_size, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+          if (addr != MAP_FAILED) {
+            size = huge_size;
+            d_huge_pages = true;
+            d_explicit_huge_pages = true;
+          }
+        }
+#endif
+
+        if (addr == MAP_FAILED) {
+          addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+          if (addr == MAP_FAILED) {
+            throw std::bad_alloc();
+          }
+
+#ifdef MADV_HUGEPAGE
+          if (huge_pages) {
+            d_huge_pages = madvise(addr, size, MADV_HUGEPAGE) == 0;
+          }
+#endif
+        }
+
+        d_addr = static_cast<uint8_t *>(addr);
+        d_size = size;
+
+        if (numa_node >= 0) {
+          d_numa_bound = bind_to_numa_node(numa_node);
+        }
+
+        // after binding, i.e. the pages are faulted in on the right node
+        if (lock) {
+          d_locked = lock_memory(d_addr, d_size) > 0;
+        }
+      }
+
+      void release()
+      {
+        if (d_addr != nullptr) {
+          munmap(d_addr, d_size);
+        }
+
+        d_addr = nullptr;
+        d_size = 0;
+        d_huge_pages = false;
+        d_explicit_huge_pages = false;
+        d_numa_bound = false;
+        d_locked = false;
+      }
+
+      uint8_t *data() const
+      {
+        return d_addr;
+      }
+
+      size_t size() const
+      {
+        return d_size;
+      }
+
+      bool is_huge_page_backed() const
+      {
+        return d_huge_pages;
+      }
+
+      /*!
+       * \brief True if backed by explicit huge pages (MAP_HUGETLB), false if backed by
+       * transparent huge pages or not at all, e.g. no huge pages are reserved.
+       */
+      bool is_explicit_huge_page_backed() const
+      {
+        return d_explicit_huge_pages;
+      }
+
+      bool is_numa_bound() const
+      {
+        return d_numa_bound;
+      }
+
+      bool is_locked() const
+      {
+        return d_locked;
+      }
+
+      static size_t round_up(size_t value, size_t multiple)
+      {
+        return ((value + multiple - 1) / multiple) * multiple;
+      }
+
+      /*!
+       * \brief True if the system has the given NUMA node.
+       */
+      static bool numa_node_exists(int numa_node)
+      {
+        return numa_node >= 0
+                && access(("/sys/devices/system/node/node" + std::to_string(numa_node)).c_str(), F_OK) == 0;
+      }
+
+    private:
+
+      bool bind_to_numa_node(int numa_node)
+      {
+        // also bounds the node mask below
+        if (!numa_node_exists(numa_node)) {
+          return false;
+        }
+
+#ifdef SYS_mbind
+        // Avoid dependency on libnuma, MPOL_BIND equals 2 in linux/mempolicy.h
+        const int mpol_bind = 2;
+        const size_t bits_per_word = 8 * sizeof(unsigned long);
+
+        std::vector<unsigned long> nodemask(numa_node / bits_per_word + 1, 0);
+        nodemask[numa_node / bits_per_word] |= 1ul << (numa_node % bits_per_word);
+
+        auto ret = syscall(SYS_mbind, d_addr, d_size, mpol_bind, nodemask.data(),
+                nodemask.size() * bits_per_word + 1, 0);
+        return ret == 0;
+#else
+        return false;
+#endif
+      }
+
+      uint8_t *d_addr;
+      size_t d_size;
+      bool d_huge_pages;
+      bool d_explicit_huge_pages;
+      bool d_numa_bound;
+      bool d_locked;
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_CHUNK_MEMORY_H */
@@ -0,0 +1,378 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gnuradio/io_signature.h>
+#include "cic_aggregation_impl.h"
+#include <digitizers/tags.h>
+#include "utils.h"
+#include <volk/volk.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+namespace gr {
+  namespace digitizers {
+
+    // Passband of the compensation FIR in cycles per output sample, and its design grid
+    static const double COMPENSATION_PASSBAND = 0.25;
+    static const int COMPENSATION_GRID = 64;
+
+    // Resizes the history at the beginning of the buffer, the most recent samples are kept
+    static void
+    resize_history(std::vector<float> &buffer, size_t old_size, size_t new_size)
+    {
+      std::vector<float> history(new_size, 0.0f);
+      const size_t keep = std::min(old_size, new_size);
+      if (keep) {
+        std::copy(buffer.begin() + (old_size - keep), buffer.begin() + old_size, history.end() - keep);
+      }
+      buffer.swap(history);
+    }
+
+    cic_aggregation_ff::sptr
+    cic_aggregation_ff::make(int decim,
+        int delay,
+        double low_freq,
+        double up_freq,
+        double samp_rate)
+    {
+      return gnuradio::get_initial_sptr
+        (new cic_aggregation_ff(decim, delay, low_freq, up_freq, samp_rate));
+    }
+
+    cic_aggregation_ff::cic_aggregation_ff(int decim,
+        int delay,
+        double low_freq,
+        double up_freq,
+        double samp_rate)
+      : gr::sync_decimator("cic_aggregation_ff",
+              gr::io_signature::make(1, 2, sizeof(float)),
+              gr::io_signature::make(1, 2, sizeof(float)), decim),
+        d_samp_rate(samp_rate),
+        d_delay(0),
+        d_sigma_mult(0.0),
+        d_history(0)
+    {
+      if (decim < 1) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid decimation: " << decim;
+        throw std::invalid_argument(message.str());
+      }
+
+      // Boxcar of decim samples convolved CIC_STAGES times, by running sums
+      std::vector<double> response {1.0};
+      for (int stage = 0; stage < CIC_STAGES; stage++) {
+        std::vector<double> next(response.size() + decim - 1, 0.0);
+        double sum = 0.0;
+        for (size_t k = 0; k < next.size(); k++) {
+          if (k < response.size()) {
+            sum += response[k];
+          }
+          if (k >= static_cast<size_t>(decim)) {
+            sum -= response[k - decim];
+          }
+          next[k] = sum / decim;
+        }
+        response.swap(next);
+      }
+      d_response.assign(response.begin(), response.end());
+
+      d_compensation.assign(1, 1.0f);
+
+      set_tag_propagation_policy(TPP_CUSTOM);
+
+      update_design(delay, low_freq, up_freq, samp_rate);
+    }
+
+    cic_aggregation_ff::~cic_aggregation_ff()
+    {
+    }
+
+    bool
+    cic_aggregation_ff::check_topology(int ninputs, int noutputs)
+    {
+      // errors either in and out or not at all
+      return ninputs == noutputs;
+    }
+
+    std::vector<float>
+    cic_aggregation_ff::design_compensation(int decim)
+    {
+      const int nsides = COMPENSATION_TAPS / 2;
+      const int nunknowns = nsides + 1;
+
+      // Least squares fit of c0 + 2 sum_k c_k cos(2 pi k f) to the inverse CIC response, the
+      // normal equations are solved by Gaussian elimination
+      std::vector<double> a(nunknowns * nunknowns, 0.0);
+      std::vector<double> b(nunknowns, 0.0);
+      std::vector<double> basis(nunknowns);
+
+      for (int g = 0; g <= COMPENSATION_GRID; g++) {
+        const double f = COMPENSATION_PASSBAND * g / COMPENSATION_GRID;
+        const double cic = f == 0.0 ? 1.0
+                : std::pow(std::sin(M_PI * f) / (decim * std::sin(M_PI * f / decim)), CIC_STAGES);
+
+        for (int k = 0; k < nunknowns; k++) {
+          basis[k] = cic * (k == 0 ? 1.0 : 2.0 * std::cos(2.0 * M_PI * k * f));
+        }
+        for (int r = 0; r < nunknowns; r++) {
+          for (int c = 0; c < nunknowns; c++) {
+            a[r * nunknowns + c] += basis[r] * basis[c];
+          }
+          b[r] += basis[r];
+        }
+      }
+
+      for (int col = 0; col < nunknowns; col++) {
+        int pivot = col;
+        for (int r = col + 1; r < nunknowns; r++) {
+          if (std::fabs(a[r * nunknowns + col]) > std::fabs(a[pivot * nunknowns + col])) {
+            pivot = r;
+          }
+        }
+        for (int c = 0; c < nunknowns; c++) {
+          std::swap(a[col * nunknowns + c], a[pivot * nunknowns + c]);
+        }
+        std::swap(b[col], b[pivot]);
+
+        for (int r = col + 1; r < nunknowns; r++) {
+          const double factor = a[r * nunknowns + col] / a[col * nunknowns + col];
+          for (int c = col; c < nunknowns; c++) {
+            a[r * nunknowns + c] -= factor * a[col * nunknowns + c];
+          }
+          b[r] -= factor * b[col];
+        }
+      }
+
+      std::vector<double> coeffs(nunknowns);
+      for (int r = nunknowns - 1; r >= 0; r--) {
+        double sum = b[r];
+        for (int c = r + 1; c < nunknowns; c++) {
+          sum -= a[r * nunknowns + c] * coeffs[c];
+        }
+        coeffs[r] = sum / a[r * nunknowns + r];
+      }
+
+      // symmetric taps, unit gain at DC
+      double dc = coeffs[0];
+      for (int k = 1; k < nunknowns; k++) {
+        dc += 2.0 * coeffs[k];
+      }
+
+      std::vector<float> taps(COMPENSATION_TAPS);
+      for (int k = 0; k < nunknowns; k++) {
+        taps[nsides - k] = taps[nsides + k] = static_cast<float>(coeffs[k] / dc);
+      }
+      return taps;
+    }
+
+    void
+    cic_aggregation_ff::update_design(int delay,
+        double low_freq,
+        double up_freq,
+        double samp_rate)
+    {
+      if (delay < 0) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid delay: " << delay;
+        throw std::invalid_argument(message.str());
+      }
+
+      const auto taps = design_compensation(decimation());
+
+      std::unique_ptr<cic_design_t> next(new cic_design_t);
+      next->compensation.assign(taps.rbegin(), taps.rend());
+      next->delay = delay;
+      next->sigma_mult = static_cast<float>((up_freq - low_freq) / samp_rate);
+
+      d_design_swap.publish(std::move(next));
+    }
+
+    void
+    cic_aggregation_ff::apply_design(cic_design_t &next)
+    {
+      const size_t history = d_response.size() - 1 + next.delay;
+
+      resize_history(d_values, d_history, history);
+      resize_history(d_squares, d_history, history);
+      resize_history(d_errors, d_history, history);
+      resize_history(d_cic, d_compensation.size() - 1, next.compensation.size() - 1);
+
+      d_history = history;
+      d_compensation.swap(next.compensation);
+      d_delay = next.delay;
+      d_sigma_mult = next.sigma_mult;
+    }
+
+    double
+    cic_aggregation_ff::get_delay_approximation() const
+    {
+      return d_response.size() / (2.0 * d_samp_rate);
+    }
+
+    void
+    cic_aggregation_ff::set_demand(const demand_node_t::sptr &demand)
+    {
+      d_gate.set_demand(demand);
+    }
+
+    void
+    cic_aggregation_ff::set_state_file(const state_file_t::sptr &file, const std::string &key)
+    {
+      d_state_slot.attach(file, key);
+    }
+
+    bool
+    cic_aggregation_ff::stop()
+    {
+      // the work function is done, i.e. the last histories are saved
+      if (d_state_slot.is_attached()) {
+        save_state();
+      }
+      return true;
+    }
+
+    void
+    cic_aggregation_ff::restore_state()
+    {
+      const size_t hc = d_compensation.size() - 1;
+      const uint64_t layout = (static_cast<uint64_t>(d_history) << 32) | hc;
+      d_state_slot.restore(layout, {{d_values.data(), d_history}, {d_squares.data(), d_history},
+              {d_errors.data(), d_history}, {d_cic.data(), hc}});
+    }
+
+    void
+    cic_aggregation_ff::save_state()
+    {
+      const size_t hc = d_compensation.size() - 1;
+      const uint64_t layout = (static_cast<uint64_t>(d_history) << 32) | hc;
+      d_state_slot.save(layout, {{d_values.data(), d_history}, {d_squares.data(), d_history},
+              {d_errors.data(), d_history}, {d_cic.data(), hc}});
+    }
+
+    void
+    cic_aggregation_ff::reset_state()
+    {
+      std::fill(d_values.begin(), d_values.begin() + d_history, 0.0f);
+      std::fill(d_squares.begin(), d_squares.begin() + d_history, 0.0f);
+      std::fill(d_errors.begin(), d_errors.begin() + d_history, 0.0f);
+      std::fill(d_cic.begin(), d_cic.begin() + (d_compensation.size() - 1), 0.0f);
+    }
+
+    int
+    cic_aggregation_ff::work(int noutput_items,
+        gr_vector_const_void_star &input_items,
+        gr_vector_void_star &output_items)
+    {
+      block_stats_scope_t stats(d_stats);
+
+      // New parameters take effect at the first sample of this call
+      if (auto next = d_design_swap.take()) {
+        apply_design(*next);
+        d_design_swap.retire(std::move(next));
+      }
+
+      // Nobody reads the outputs
+      if (!d_gate.poll([this]() { reset_state(); })) {
+        for (auto output : output_items) {
+          memset(output, 0, noutput_items * sizeof(float));
+        }
+        propagate_tags(noutput_items);
+        return noutput_items;
+      }
+
+      if (d_state_slot.is_attached()) {
+        restore_state();
+      }
+
+      const float *in = (const float *) input_items[0];
+      float *out = (float *) output_items[0];
+      const bool errors = output_items.size() > 1;
+
+      const int decim = decimation();
+      const size_t ninput = noutput_items * decim;
+      const size_t nresponse = d_response.size();
+      const size_t ncompensation = d_compensation.size();
+      const size_t hx = d_history;
+      const size_t hc = ncompensation - 1;
+      const float *response = &d_response[0];
+
+      d_values.resize(hx + ninput);
+      memcpy(&d_values[hx], in, ninput * sizeof(float));
+
+      d_cic.resize(hc + noutput_items);
+
+      // CIC outputs only at the output instants, the response ends at the first input sample
+      // of the output (as by fused_aggregation_ff)
+      for (int i = 0; i < noutput_items; i++) {
+        const size_t first = hx + i * decim - (nresponse - 1);
+        volk_32f_x2_dot_prod_32f(&d_cic[hc + i], &d_values[first - d_delay], response, nresponse);
+      }
+
+      // skipped without the errors ports
+      if (errors) {
+        const float *err = (const float *) input_items[1];
+        float *sigma = (float *) output_items[1];
+
+        d_squares.resize(hx + ninput);
+        d_errors.resize(hx + ninput);
+        memcpy(&d_errors[hx], err, ninput * sizeof(float));
+        volk_32f_x2_multiply_32f(&d_squares[hx], in, in, ninput);
+
+        for (int i = 0; i < noutput_items; i++) {
+          const size_t first = hx + i * decim - (nresponse - 1);
+
+          float mean, mean_of_squares, error;
+          volk_32f_x2_dot_prod_32f(&mean, &d_values[first], response, nresponse);
+          volk_32f_x2_dot_prod_32f(&mean_of_squares, &d_squares[first], response, nresponse);
+          volk_32f_x2_dot_prod_32f(&error, &d_errors[first], response, nresponse);
+
+          sigma[i] = std::sqrt(std::fabs(mean_of_squares - mean * mean) + (d_sigma_mult * error * error));
+        }
+
+        std::copy(d_squares.end() - hx, d_squares.end(), d_squares.begin());
+        std::copy(d_errors.end() - hx, d_errors.end(), d_errors.begin());
+      }
+
+      // droop compensation at the output rate
+      for (int i = 0; i < noutput_items; i++) {
+        volk_32f_x2_dot_prod_32f(&out[i], &d_cic[i], &d_compensation[0], ncompensation);
+      }
+
+      // keep histories for the next call
+      std::copy(d_values.end() - hx, d_values.end(), d_values.begin());
+      std::copy(d_cic.end() - hc, d_cic.end(), d_cic.begin());
+
+      if (d_state_slot.is_due()) {
+        save_state();
+      }
+
+      propagate_tags(noutput_items);
+
+      return noutput_items;
+    }
+
+    void
+    cic_aggregation_ff::propagate_tags(int noutput_items)
+    {
+      // Same as decimate_and_adjust_timebase, tags of the error input are not propagated
+      const auto decim = decimation();
+
+      std::vector<gr::tag_t> tags;
+      get_tags_in_range(tags, 0, nitems_read(0), nitems_read(0) + noutput_items * decim);
+      decimate_tags(tags, nitems_read(0), nitems_written(0), decim,
+              [this](const gr::tag_t &tag) { add_item_tag(0, tag); });
+    }
+
+  } /* namespace digitizers */
+} /* namespace gr */
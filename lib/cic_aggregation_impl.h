@@ -0,0 +1,157 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_CIC_AGGREGATION_IMPL_H
+#define INCLUDED_DIGITIZERS_CIC_AGGREGATION_IMPL_H
+
+#include <gnuradio/sync_decimator.h>
+
+#include <vector>
+#include "block_stats_impl.h"
+#include "demand.h"
+#include "hot_swap.h"
+#include "state_file.h"
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Parameters of cic_aggregation_ff applied by the work function.
+     */
+    struct cic_design_t
+    {
+      std::vector<float> compensation;  // reversed, i.e. dot product with the oldest output first
+      int delay;
+      float sigma_mult;
+    };
+
+    /*!
+     * \brief Aggregation for large decimation factors (algorithm CIC of block_aggregation).
+     *
+     * The values are filtered by the response of a CIC_STAGES stage CIC decimator (i.e. the
+     * boxcar of decim samples convolved CIC_STAGES times, unit gain) and a short FIR at the
+     * output rate compensating the CIC passband droop:
+     *
+     *   value[i] = sum_k c[k] * (h*x)[(i-k)*D - delay]
+     *   sigma[i] = sqrt(|(h*x^2)[i*D] - (h*x)[i*D]^2| + sigma_mult * (h*e)[i*D]^2)
+     *
+     * where h is the CIC response, c the compensation FIR and D the decimation. The error is
+     * the weighted spread of the input within the CIC window plus the filtered input error,
+     * i.e. the aggregation_helper formula with the spread taken from the input itself rather
+     * than from the value filter output.
+     *
+     * Single precision integrators would drift, the CIC response is therefore evaluated in its
+     * non-recursive form, only at the output instants: CIC_STAGES multiply-adds per input
+     * sample for each of the four sums, independent of the decimation. The errors input and
+     * output are optional (both or none), the three error sums are skipped without them.
+     *
+     * The compensation FIR is designed for the passband up to a quarter of the output rate
+     * (least squares). New parameters are swapped in at the start of the next work call (see
+     * hot_swap_t).
+     */
+    class cic_aggregation_ff : public gr::sync_decimator
+    {
+     public:
+      typedef boost::shared_ptr<cic_aggregation_ff> sptr;
+
+      static const int CIC_STAGES = 3;
+      static const int COMPENSATION_TAPS = 7;
+
+      static sptr make(int decim,
+          int delay,
+          double low_freq,
+          double up_freq,
+          double samp_rate);
+
+      /*!
+       * \brief Compensation FIR for a CIC_STAGES stage CIC decimating by decim.
+       */
+      static std::vector<float> design_compensation(int decim);
+
+      cic_aggregation_ff(int decim,
+          int delay,
+          double low_freq,
+          double up_freq,
+          double samp_rate);
+
+      ~cic_aggregation_ff();
+
+      /*!
+       * \brief Applies the parameters at the start of the next work call.
+       */
+      void update_design(int delay,
+          double low_freq,
+          double up_freq,
+          double samp_rate);
+
+      /*!
+       * \brief Filter delay in seconds, half the CIC response.
+       */
+      double get_delay_approximation() const;
+
+      /*!
+       * \brief Pauses the block while the demand is inactive, see fused_aggregation_ff.
+       */
+      void set_demand(const demand_node_t::sptr &demand);
+
+      /*!
+       * \brief Persists the histories, see fused_aggregation_ff::set_state_file.
+       */
+      void set_state_file(const state_file_t::sptr &file, const std::string &key);
+
+      bool check_topology(int ninputs, int noutputs) override;
+
+      bool stop() override;
+
+      int work(int noutput_items,
+          gr_vector_const_void_star &input_items,
+          gr_vector_void_star &output_items) override;
+
+     private:
+
+      void apply_design(cic_design_t &next);
+
+      void propagate_tags(int noutput_items);
+
+      // Clears the histories, i.e. restarts from zero input
+      void reset_state();
+
+      // Histories from and to d_state_slot
+      void restore_state();
+      void save_state();
+
+      double d_samp_rate;
+
+      // CIC response, symmetric
+      std::vector<float> d_response;
+
+      hot_swap_t<cic_design_t> d_design_swap;
+
+      // Current parameters, used by the work function only
+      std::vector<float> d_compensation;
+      int d_delay;
+      float d_sigma_mult;
+
+      // Input, squared input and error samples, the first d_history are from previous calls
+      size_t d_history;
+      std::vector<float> d_values;
+      std::vector<float> d_squares;
+      std::vector<float> d_errors;
+
+      // CIC outputs of the value path, the first COMPENSATION_TAPS - 1 from previous calls
+      std::vector<float> d_cic;
+
+      demand_gate_t d_gate;
+
+      state_slot_t d_state_slot;
+
+      block_stats_recorder_t d_stats {this};
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_CIC_AGGREGATION_IMPL_H */
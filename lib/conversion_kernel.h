@@ -0,0 +1,231 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_CONVERSION_KERNEL_H
+#define INCLUDED_DIGITIZERS_CONVERSION_KERNEL_H
+
+#include "cpu_dispatch.h"
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace gr {
+  namespace digitizers {
+
+    /**********************************************************************
+     * Raw sample conversion kernels
+     *********************************************************************/
+
+    namespace conversion_detail {
+
+      static inline void
+      raw_convert_generic(const int16_t *raw, float multiplier, float offset, float *values,
+              uint32_t nsamples)
+      {
+        for (uint32_t i = 0; i < nsamples; i++) {
+          values[i] = static_cast<float>(raw[i]) * multiplier - offset;
+        }
+      }
+
+      static inline void
+      min_max_agg_convert_generic(const int16_t *raw_max, const int16_t *raw_min,
+              float voltage_multiplier, float scale, float offset, float *values, float *errors,
+              uint32_t nsamples)
+      {
+        const float values_multiplier = voltage_multiplier * scale / 2.0f;
+        const float errors_multiplier = voltage_multiplier * scale / 4.0f;
+
+        for (uint32_t i = 0; i < nsamples; i++) {
+          const int32_t max = raw_max[i];
+          const int32_t min = raw_min[i];
+
+          values[i] = static_cast<float>(max + min) * values_multiplier - offset;
+          errors[i] = static_cast<float>(max - min) * errors_multiplier;
+        }
+      }
+
+#if defined(__x86_64__) || defined(__i386__)
+      __attribute__((target("avx2")))
+      static inline void
+      raw_convert_avx2(const int16_t *raw, float multiplier, float offset, float *values,
+              uint32_t nsamples)
+      {
+        const __m256 multiplier_v = _mm256_set1_ps(multiplier);
+        const __m256 offset_v = _mm256_set1_ps(offset);
+
+        uint32_t i = 0;
+
+        for (; i + 8 <= nsamples; i += 8) {
+          const __m256 raw_v = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(
+                  _mm_loadu_si128(reinterpret_cast<const __m128i *>(raw + i))));
+          _mm256_storeu_ps(values + i, _mm256_sub_ps(_mm256_mul_ps(raw_v, multiplier_v), offset_v));
+        }
+
+        // remainder
+        raw_convert_generic(raw + i, multiplier, offset, values + i, nsamples - i);
+      }
+
+      __attribute__((target("avx2")))
+      static inline void
+      min_max_agg_convert_avx2(const int16_t *raw_max, const int16_t *raw_min,
+              float voltage_multiplier, float scale, float offset, float *values, float *errors,
+              uint32_t nsamples)
+      {
+        const __m256 values_multiplier = _mm256_set1_ps(voltage_multiplier * scale / 2.0f);
+        const __m256 errors_multiplier = _mm256_set1_ps(voltage_multiplier * scale / 4.0f);
+        const __m256 offset_v = _mm256_set1_ps(offset);
+
+        uint32_t i = 0;
+
+        for (; i + 8 <= nsamples; i += 8) {
+          const __m256i max = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(raw_max + i)));
+          const __m256i min = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(raw_min + i)));
+
+          const __m256 sum = _mm256_cvtepi32_ps(_mm256_add_epi32(max, min));
+          const __m256 diff = _mm256_cvtepi32_ps(_mm256_sub_epi32(max, min));
+
+          _mm256_storeu_ps(values + i, _mm256_sub_ps(_mm256_mul_ps(sum, values_multiplier), offset_v));
+          _mm256_storeu_ps(errors + i, _mm256_mul_ps(diff, errors_multiplier));
+        }
+
+        // remainder
+        min_max_agg_convert_generic(raw_max + i, raw_min + i, voltage_multiplier, scale, offset,
+                values + i, errors + i, nsamples - i);
+      }
+
+      __attribute__((target("avx512f")))
+      static inline void
+      raw_convert_avx512(const int16_t *raw, float multiplier, float offset, float *values,
+              uint32_t nsamples)
+      {
+        const __m512 multiplier_v = _mm512_set1_ps(multiplier);
+        const __m512 offset_v = _mm512_set1_ps(offset);
+
+        uint32_t i = 0;
+
+        for (; i + 16 <= nsamples; i += 16) {
+          const __m512 raw_v = _mm512_cvtepi32_ps(_mm512_cvtepi16_epi32(
+                  _mm256_loadu_si256(reinterpret_cast<const __m256i *>(raw + i))));
+          _mm512_storeu_ps(values + i, _mm512_sub_ps(_mm512_mul_ps(raw_v, multiplier_v), offset_v));
+        }
+
+        // remainder
+        raw_convert_generic(raw + i, multiplier, offset, values + i, nsamples - i);
+      }
+
+      __attribute__((target("avx512f")))
+      static inline void
+      min_max_agg_convert_avx512(const int16_t *raw_max, const int16_t *raw_min,
+              float voltage_multiplier, float scale, float offset, float *values, float *errors,
+              uint32_t nsamples)
+      {
+        const __m512 values_multiplier = _mm512_set1_ps(voltage_multiplier * scale / 2.0f);
+        const __m512 errors_multiplier = _mm512_set1_ps(voltage_multiplier * scale / 4.0f);
+        const __m512 offset_v = _mm512_set1_ps(offset);
+
+        uint32_t i = 0;
+
+        for (; i + 16 <= nsamples; i += 16) {
+          const __m512i max = _mm512_cvtepi16_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(raw_max + i)));
+          const __m512i min = _mm512_cvtepi16_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(raw_min + i)));
+
+          const __m512 sum = _mm512_cvtepi32_ps(_mm512_add_epi32(max, min));
+          const __m512 diff = _mm512_cvtepi32_ps(_mm512_sub_epi32(max, min));
+
+          _mm512_storeu_ps(values + i, _mm512_sub_ps(_mm512_mul_ps(sum, values_multiplier), offset_v));
+          _mm512_storeu_ps(errors + i, _mm512_mul_ps(diff, errors_multiplier));
+        }
+
+        // remainder
+        min_max_agg_convert_generic(raw_max + i, raw_min + i, voltage_multiplier, scale, offset,
+                values + i, errors + i, nsamples - i);
+      }
+#endif
+
+      typedef void (*raw_convert_kernel_t)(const int16_t *raw, float multiplier, float offset,
+              float *values, uint32_t nsamples);
+
+      // Best variant available for the given instruction set
+      static inline raw_convert_kernel_t
+      raw_convert_kernel(kernel_isa_t isa)
+      {
+#if defined(__x86_64__) || defined(__i386__)
+        if (isa >= KERNEL_ISA_AVX512) {
+          return raw_convert_avx512;
+        }
+        if (isa >= KERNEL_ISA_AVX2) {
+          return raw_convert_avx2;
+        }
+#endif
+        return raw_convert_generic;
+      }
+
+      typedef void (*min_max_agg_kernel_t)(const int16_t *raw_max, const int16_t *raw_min,
+              float voltage_multiplier, float scale, float offset, float *values, float *errors,
+              uint32_t nsamples);
+
+      // Best variant available for the given instruction set
+      static inline min_max_agg_kernel_t
+      min_max_agg_kernel(kernel_isa_t isa)
+      {
+#if defined(__x86_64__) || defined(__i386__)
+        if (isa >= KERNEL_ISA_AVX512) {
+          return min_max_agg_convert_avx512;
+        }
+        if (isa >= KERNEL_ISA_AVX2) {
+          return min_max_agg_convert_avx2;
+        }
+#endif
+        return min_max_agg_convert_generic;
+      }
+
+    } // namespace conversion_detail
+
+    /*!
+     * \brief Raw sample conversion including the channel calibration:
+     *   values = raw * multiplier - offset
+     *
+     * The multiplier combines the voltage multiplier with the calibration scale, i.e. the
+     * calibration costs a single subtract per sample.
+     */
+    static inline void
+    raw_convert(const int16_t *raw, float multiplier, float offset, float *values,
+            uint32_t nsamples)
+    {
+      // kernel is selected once, on first use
+      static const conversion_detail::raw_convert_kernel_t kernel =
+              conversion_detail::raw_convert_kernel(get_kernel_isa());
+
+      kernel(raw, multiplier, offset, values, nsamples);
+    }
+
+    /*!
+     * \brief Fused min/max aggregation conversion including the channel calibration:
+     *   values = (max + min) / 2.0 * voltage_multiplier * scale - offset
+     *   errors = (max - min) / 4.0 * voltage_multiplier * scale
+     *
+     * Sum and difference are calculated in integer domain (no overflow possible with int32_t),
+     * therefore only a single conversion and a single multiply is needed per output. The scale
+     * must be positive.
+     */
+    static inline void
+    min_max_agg_convert(const int16_t *raw_max, const int16_t *raw_min,
+            float voltage_multiplier, float scale, float offset, float *values, float *errors,
+            uint32_t nsamples)
+    {
+      // kernel is selected once, on first use
+      static const conversion_detail::min_max_agg_kernel_t kernel =
+              conversion_detail::min_max_agg_kernel(get_kernel_isa());
+
+      kernel(raw_max, raw_min, voltage_multiplier, scale, offset, values, errors, nsamples);
+    }
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_CONVERSION_KERNEL_H */
@@ -0,0 +1,206 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_CONVERSION_POOL_H
+#define INCLUDED_DIGITIZERS_CONVERSION_POOL_H
+
+#include "thread_registry.h"
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief A small fork-join pool used by drivers to convert raw samples of multiple channels
+     * in parallel.
+     *
+     * The calling thread (the poll thread) participates in the execution and the run method
+     * returns only after all tasks are done. That is important because driver buffers might get
+     * overwritten as soon as the streaming callback returns.
+     *
+     * If the pool has no worker threads all the tasks are executed in the calling thread.
+     */
+    class conversion_pool_t : boost::noncopyable
+    {
+    public:
+
+      conversion_pool_t()
+        : d_stop(false),
+          d_generation(0),
+          d_ntasks(0),
+          d_next_task(0),
+          d_pending(0),
+          d_context(nullptr),
+          d_invoke(nullptr)
+      {
+      }
+
+      ~conversion_pool_t()
+      {
+        stop();
+      }
+
+      /*!
+       * \brief Starts the given number of worker threads. Previously started workers are stopped
+       * first. The workers are registered as owner:role (see thread_registry_t).
+       */
+      void start(int nr_threads, const std::string &owner, const std::string &role)
+      {
+        stop();
+
+        d_stop = false;
+
+        for (int i = 0; i < nr_threads; i++) {
+          d_workers.emplace_back(new boost::thread([this, owner, role] {
+            thread_scope_t thread(owner, role);
+            worker_function();
+          }));
+        }
+      }
+
+      /*!
+       * \brief Stops and joins all the worker threads.
+       */
+      void stop()
+      {
+        {
+          boost::mutex::scoped_lock lock(d_mutex);
+          d_stop = true;
+        }
+
+        d_work_cv.notify_all();
+
+        for (auto &worker : d_workers) {
+          worker->join();
+        }
+
+        d_workers.clear();
+      }
+
+      int size() const
+      {
+        return static_cast<int>(d_workers.size());
+      }
+
+      /*!
+       * \brief Executes task(i) for i in [0, ntasks) and waits for all of them to complete.
+       *
+       * The task is invoked by reference, no copies or allocations are made.
+       */
+      template <typename Task>
+      void run(size_t ntasks, Task &task)
+      {
+        if (d_workers.empty() || ntasks < 2) {
+          for (size_t i = 0; i < ntasks; i++) {
+            task(i);
+          }
+          return;
+        }
+
+        {
+          boost::mutex::scoped_lock lock(d_mutex);
+          d_context = &task;
+          d_invoke = &invoke<Task>;
+          d_ntasks = ntasks;
+          d_next_task = 0;
+          d_pending = ntasks;
+          d_generation++;
+        }
+
+        d_work_cv.notify_all();
+
+        // help out
+        execute_tasks();
+
+        boost::mutex::scoped_lock lock(d_mutex);
+        while (d_pending != 0) {
+          d_done_cv.wait(lock);
+        }
+      }
+
+    private:
+
+      template <typename Task>
+      static void invoke(void *context, size_t idx)
+      {
+        (*static_cast<Task *>(context))(idx);
+      }
+
+      void execute_tasks()
+      {
+        while (true) {
+          size_t idx;
+
+          {
+            boost::mutex::scoped_lock lock(d_mutex);
+            if (d_next_task >= d_ntasks) {
+              return;
+            }
+            idx = d_next_task++;
+          }
+
+          d_invoke(d_context, idx);
+
+          {
+            boost::mutex::scoped_lock lock(d_mutex);
+            if (--d_pending == 0) {
+              d_done_cv.notify_all();
+            }
+          }
+        }
+      }
+
+      void worker_function()
+      {
+        uint64_t seen_generation = 0;
+
+        while (true) {
+          {
+            boost::mutex::scoped_lock lock(d_mutex);
+            while (!d_stop && d_generation == seen_generation) {
+              d_work_cv.wait(lock);
+            }
+
+            if (d_stop) {
+              return;
+            }
+
+            seen_generation = d_generation;
+          }
+
+          execute_tasks();
+        }
+      }
+
+      std::vector<std::unique_ptr<boost::thread>> d_workers;
+
+      boost::mutex d_mutex;
+      boost::condition_variable d_work_cv;
+      boost::condition_variable d_done_cv;
+
+      bool d_stop;
+      uint64_t d_generation;
+      size_t d_ntasks;
+      size_t d_next_task;
+      size_t d_pending;
+
+      void *d_context;
+      void (*d_invoke)(void *, size_t);
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_CONVERSION_POOL_H */
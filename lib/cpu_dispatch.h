@@ -0,0 +1,91 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_CPU_DISPATCH_H
+#define INCLUDED_DIGITIZERS_CPU_DISPATCH_H
+
+#include <cstdlib>
+#include <cstring>
+
+namespace gr {
+  namespace digitizers {
+
+    /**********************************************************************
+     * Runtime kernel dispatch. The library is compiled for the baseline ISA, kernels with
+     * variants for wider instruction sets select one per call site, once, based on
+     * get_kernel_isa. On other architectures (e.g. NEON on ARM) the generic variants are
+     * vectorized by the compiler.
+     *********************************************************************/
+
+    enum kernel_isa_t
+    {
+      KERNEL_ISA_GENERIC = 0,
+      KERNEL_ISA_AVX2,
+      KERNEL_ISA_AVX512,
+      KERNEL_ISA_COUNT
+    };
+
+    static inline const char *
+    kernel_isa_name(kernel_isa_t isa)
+    {
+      switch (isa) {
+        case KERNEL_ISA_AVX2:
+          return "avx2";
+        case KERNEL_ISA_AVX512:
+          return "avx512";
+        default:
+          return "generic";
+      }
+    }
+
+    /*!
+     * \brief Highest instruction set supported by the CPU.
+     */
+    static inline kernel_isa_t
+    get_cpu_isa()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+      if (__builtin_cpu_supports("avx512f")) {
+        return KERNEL_ISA_AVX512;
+      }
+      if (__builtin_cpu_supports("avx2")) {
+        return KERNEL_ISA_AVX2;
+      }
+#endif
+      return KERNEL_ISA_GENERIC;
+    }
+
+    /*!
+     * \brief Instruction set the kernels are selected for, i.e. the one supported by the CPU
+     * unless limited by the DIGITIZERS_KERNEL_ISA environment variable (generic, avx2 or
+     * avx512). Determined on first use, the environment has to be set before the library is
+     * loaded.
+     */
+    inline kernel_isa_t
+    get_kernel_isa()
+    {
+      static const kernel_isa_t isa = []() {
+        auto isa = get_cpu_isa();
+
+        const char *limit = std::getenv("DIGITIZERS_KERNEL_ISA");
+        if (limit) {
+          for (int i = KERNEL_ISA_GENERIC; i < KERNEL_ISA_COUNT; i++) {
+            if (std::strcmp(limit, kernel_isa_name(static_cast<kernel_isa_t>(i))) == 0 && i < isa) {
+              isa = static_cast<kernel_isa_t>(i);
+            }
+          }
+        }
+
+        return isa;
+      }();
+
+      return isa;
+    }
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_CPU_DISPATCH_H */
@@ -0,0 +1,141 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_CROSS_CORRELATOR_H
+#define INCLUDED_DIGITIZERS_CROSS_CORRELATOR_H
+
+#include <gnuradio/fft/fft.h>
+#include <gnuradio/gr_complex.h>
+
+#include <boost/noncopyable.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Lag between a signal and a reference window found by FFT cross-correlation.
+     *
+     * Both windows (window_size samples, mean removed) are zero padded to twice their size, i.e.
+     * the circular correlation equals the linear one for all lags searched:
+     *
+     *   r[m] = sum_n x[n + m] ref[n]
+     *
+     * The peak of |m| <= max_lag is refined by a parabola through r[m - 1], r[m] and r[m + 1],
+     * i.e. the lag has sub-sample resolution. The correlation returned is r at the peak
+     * normalized by the energies of the windows, it is reduced by the non-overlapping part of
+     * the windows, (window_size - |lag|) / window_size.
+     *
+     * The spectrum of the reference is kept, i.e. a number of signals is compared to the same
+     * reference at the cost of two transforms each.
+     */
+    class cross_correlator_t : boost::noncopyable
+    {
+    public:
+      explicit cross_correlator_t(int window_size)
+        : d_window_size(window_size),
+          d_fft_size(2 * window_size),
+          d_fwd(2 * window_size),
+          d_rev(2 * window_size),
+          d_reference(window_size + 1),
+          d_reference_energy(0.0)
+      {
+      }
+
+      int window_size() const
+      {
+        return d_window_size;
+      }
+
+      void set_reference(const float *ref)
+      {
+        d_reference_energy = transform(ref);
+        memcpy(&d_reference[0], d_fwd.get_outbuf(), d_reference.size() * sizeof(gr_complex));
+      }
+
+      /*!
+       * \brief Estimates the lag of x relative to the reference, positive if x is late (in
+       * samples). Returns false if either of the windows is constant.
+       */
+      bool estimate(const float *x, int max_lag, double &lag, float &correlation)
+      {
+        const double energy = transform(x);
+        if (!(energy > 0.0) || !(d_reference_energy > 0.0)) {
+          return false;
+        }
+
+        const gr_complex *spectrum = d_fwd.get_outbuf();
+        gr_complex *cross = d_rev.get_inbuf();
+        for (int k = 0; k <= d_window_size; k++) {
+          cross[k] = spectrum[k] * std::conj(d_reference[k]);
+        }
+        d_rev.execute();
+
+        // negative lags are wrapped to the end
+        const float *r = d_rev.get_outbuf();
+        auto at = [&](int m) { return r[m < 0 ? m + d_fft_size : m]; };
+
+        max_lag = std::max(0, std::min(max_lag, d_window_size - 2));
+        int peak = 0;
+        for (int m = -max_lag; m <= max_lag; m++) {
+          if (at(m) > at(peak)) {
+            peak = m;
+          }
+        }
+
+        const double left = at(peak - 1), center = at(peak), right = at(peak + 1);
+        const double curvature = left - 2.0 * center + right;
+        double delta = 0.0;
+        if (curvature < 0.0) {
+          delta = std::max(-0.5, std::min(0.5, 0.5 * (left - right) / curvature));
+        }
+
+        lag = peak + delta;
+        correlation = static_cast<float>(center / (d_fft_size * std::sqrt(energy * d_reference_energy)));
+        return true;
+      }
+
+    private:
+
+      // Forward transform of the zero padded window, returns its energy
+      double transform(const float *x)
+      {
+        double mean = 0.0;
+        for (int n = 0; n < d_window_size; n++) {
+          mean += x[n];
+        }
+        mean /= d_window_size;
+
+        float *in = d_fwd.get_inbuf();
+        double energy = 0.0;
+        for (int n = 0; n < d_window_size; n++) {
+          in[n] = static_cast<float>(x[n] - mean);
+          energy += static_cast<double>(in[n]) * in[n];
+        }
+        std::fill(in + d_window_size, in + d_fft_size, 0.0f);
+
+        d_fwd.execute();
+        return energy;
+      }
+
+      const int d_window_size;
+      const int d_fft_size;
+
+      gr::fft::fft_real_fwd d_fwd;
+      gr::fft::fft_real_rev d_rev;
+
+      std::vector<gr_complex> d_reference;
+      double d_reference_energy;
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_CROSS_CORRELATOR_H */
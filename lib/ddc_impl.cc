@@ -0,0 +1,163 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gnuradio/io_signature.h>
+#include "ddc_impl.h"
+#include "design_cache.h"
+#include "utils.h"
+#include <volk/volk.h>
+
+#include <cmath>
+#include <complex>
+#include <sstream>
+#include <stdexcept>
+
+namespace gr {
+  namespace digitizers {
+
+    constexpr double ddc_fc::CUTOFF;
+    constexpr double ddc_fc::PASSBAND;
+
+    ddc_fc::sptr
+    ddc_fc::make(int decim, double samp_rate, double center_freq)
+    {
+      return gnuradio::get_initial_sptr
+        (new ddc_fc(decim, samp_rate, center_freq));
+    }
+
+    std::vector<float>
+    ddc_fc::design_low_pass(int decim)
+    {
+      const int ntaps = 2 * HALF_LENGTH * decim + 1;
+      const int center = HALF_LENGTH * decim;
+      const double cutoff = CUTOFF / decim;     // cycles per input sample
+
+      const auto window = cached_firdes_window(gr::filter::firdes::WIN_HAMMING, ntaps, 6.76);
+
+      std::vector<double> taps(ntaps);
+      double gain = 0.0;
+      for (int k = 0; k < ntaps; k++) {
+        const double x = 2.0 * M_PI * cutoff * (k - center);
+        taps[k] = (k == center ? 1.0 : std::sin(x) / x) * window[k];
+        gain += taps[k];
+      }
+
+      std::vector<float> normalized(ntaps);
+      for (int k = 0; k < ntaps; k++) {
+        normalized[k] = static_cast<float>(taps[k] / gain);
+      }
+      return normalized;
+    }
+
+    ddc_fc::ddc_fc(int decim, double samp_rate, double center_freq)
+      : gr::sync_decimator("ddc_fc",
+              gr::io_signature::make(1, 1, sizeof(float)),
+              gr::io_signature::make(1, 1, sizeof(gr_complex)), decim),
+        d_low_pass(design_low_pass(decim < 1 ? 1 : decim)),
+        d_samp_rate(samp_rate),
+        d_center_freq(center_freq),
+        d_taps(d_low_pass.size()),
+        d_phase(0.0),
+        d_phase_step(0.0)
+    {
+      if (decim < 1 || samp_rate <= 0.0) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid decimation or sample rate";
+        throw std::invalid_argument(message.str());
+      }
+
+      set_history(d_low_pass.size());
+      set_tag_propagation_policy(TPP_DONT);
+
+      update();
+    }
+
+    ddc_fc::~ddc_fc()
+    {
+    }
+
+    void
+    ddc_fc::set_samp_rate(double samp_rate)
+    {
+      gr::thread::scoped_lock lock(d_setlock);
+      d_samp_rate = samp_rate;
+      update();
+    }
+
+    void
+    ddc_fc::set_center_freq(double center_freq)
+    {
+      gr::thread::scoped_lock lock(d_setlock);
+      d_center_freq = center_freq;
+      update();
+    }
+
+    void
+    ddc_fc::update()
+    {
+      const double w0 = 2.0 * M_PI * d_center_freq / d_samp_rate;
+      const int ntaps = static_cast<int>(d_low_pass.size());
+
+      // the oldest sample of the window is x[n D - (ntaps - 1)]
+      for (int k = 0; k < ntaps; k++) {
+        d_taps[ntaps - 1 - k] = gr_complex(std::polar(static_cast<double>(d_low_pass[k]), w0 * k));
+      }
+
+      d_phase_step = std::remainder(w0 * decimation(), 2.0 * M_PI);
+    }
+
+    int
+    ddc_fc::work(int noutput_items,
+        gr_vector_const_void_star &input_items,
+        gr_vector_void_star &output_items)
+    {
+      block_stats_scope_t stats(d_stats);
+      const float *in = (const float *) input_items[0];
+      gr_complex *out = (gr_complex *) output_items[0];
+
+      const int decim = decimation();
+      const unsigned ntaps = d_taps.size();
+
+      for (int i = 0; i < noutput_items; i++) {
+        gr_complex sum;
+        volk_32fc_32f_dot_prod_32fc(&sum, &d_taps[0], in + i * decim, ntaps);
+        out[i] = sum * gr_complex(std::polar(1.0, -d_phase));
+        d_phase = std::remainder(d_phase + d_phase_step, 2.0 * M_PI);
+      }
+
+      propagate_tags(noutput_items);
+
+      return noutput_items;
+    }
+
+    void
+    ddc_fc::propagate_tags(int noutput_items)
+    {
+      // Output n is centered at input n D - HALF_LENGTH D, i.e. tags are moved by the group
+      // delay before they are decimated
+      const uint64_t delay = static_cast<uint64_t>(HALF_LENGTH) * decimation();
+      const uint64_t first = nitems_read(0);
+      const uint64_t last = first + static_cast<uint64_t>(noutput_items) * decimation();
+      if (last <= delay) {
+        return;
+      }
+
+      std::vector<gr::tag_t> tags;
+      get_tags_in_range(tags, 0, first > delay ? first - delay : 0, last - delay);
+      for (auto &tag : tags) {
+        tag.offset += delay;
+      }
+
+      decimate_tags(tags, first, nitems_written(0), decimation(),
+              [this](const gr::tag_t &tag) { add_item_tag(0, tag); });
+    }
+
+  } /* namespace digitizers */
+} /* namespace gr */
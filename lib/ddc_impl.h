@@ -0,0 +1,85 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_DDC_IMPL_H
+#define INCLUDED_DIGITIZERS_DDC_IMPL_H
+
+#include <gnuradio/sync_decimator.h>
+#include <gnuradio/gr_complex.h>
+
+#include <vector>
+#include "block_stats_impl.h"
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Digital down-converter, shifts center_freq to DC and decimates the real input to a
+     * complex baseband at samp_rate / decim.
+     *
+     *   y[n] = sum_k h[k] x[n D - k] exp(-j w0 (n D - k))
+     *
+     * with w0 the NCO frequency in radians per sample and h a windowed sinc low pass (Hamming,
+     * cutoff CUTOFF output bandwidths) of 2 * HALF_LENGTH * D + 1 taps. The mixer is folded into
+     * the taps, exp(j w0 k) h[k], and the filter is evaluated only at the output instants, i.e.
+     * the cost is that of a polyphase decimator, 2 * HALF_LENGTH complex taps per input sample.
+     * The remaining exp(-j w0 n D) is applied at the output rate (double precision phase), the
+     * phase is relative to the NCO starting at the first input sample.
+     *
+     * The group delay of h is exactly HALF_LENGTH output samples, tags are placed on the output
+     * sample centered at them, i.e. output times refer to the input (original) time frame. The
+     * baseband is alias free within PASSBAND output bandwidths of DC.
+     */
+    class ddc_fc : public gr::sync_decimator
+    {
+     public:
+      typedef boost::shared_ptr<ddc_fc> sptr;
+
+      static const int HALF_LENGTH = 12;        // group delay in output samples
+      static constexpr double CUTOFF = 0.4;     // of the output sample rate
+      static constexpr double PASSBAND = 0.3;   // of the output sample rate, on either side of DC
+
+      static sptr make(int decim, double samp_rate, double center_freq);
+
+      /*!
+       * \brief Low pass taps for the decimation, unit gain at DC.
+       */
+      static std::vector<float> design_low_pass(int decim);
+
+      ddc_fc(int decim, double samp_rate, double center_freq);
+
+      ~ddc_fc();
+
+      void set_samp_rate(double samp_rate);
+
+      void set_center_freq(double center_freq);
+
+      int work(int noutput_items,
+          gr_vector_const_void_star &input_items,
+          gr_vector_void_star &output_items) override;
+
+     private:
+
+      // Mixes the low pass taps to the NCO frequency
+      void update();
+
+      void propagate_tags(int noutput_items);
+
+      const std::vector<float> d_low_pass;
+      double d_samp_rate;
+      double d_center_freq;
+
+      std::vector<gr_complex> d_taps;     // reversed, i.e. dot product with the oldest sample first
+      double d_phase;                     // of the NCO at the next output sample
+      double d_phase_step;                // per output sample
+
+      block_stats_recorder_t d_stats {this};
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_DDC_IMPL_H */
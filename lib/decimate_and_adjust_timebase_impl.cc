@@ -12,22 +12,28 @@
 #include "decimate_and_adjust_timebase_impl.h"
 #include <digitizers/tags.h>
 #include <boost/optional.hpp>
+#include "utils.h"
+
+#include <algorithm>
 
 namespace gr {
   namespace digitizers {
 
     decimate_and_adjust_timebase::sptr
-    decimate_and_adjust_timebase::make(int decimation, double delay, float samp_rate)
+    decimate_and_adjust_timebase::make(int decimation, double delay, float samp_rate, bool raw_input)
     {
       return gnuradio::get_initial_sptr
-        (new decimate_and_adjust_timebase_impl(decimation, delay, samp_rate));
+        (new decimate_and_adjust_timebase_impl(decimation, delay, samp_rate, raw_input));
     }
 
-    decimate_and_adjust_timebase_impl::decimate_and_adjust_timebase_impl(int decimation, double delay, float samp_rate)
+    decimate_and_adjust_timebase_impl::decimate_and_adjust_timebase_impl(int decimation, double delay,
+            float samp_rate, bool raw_input)
       : gr::sync_decimator("decimate_and_adjust_timebase",
-              gr::io_signature::make(1, 1, sizeof(float)),
+              gr::io_signature::make(1, 1, raw_input ? sizeof(int16_t) : sizeof(float)),
               gr::io_signature::make(1, 1, sizeof(float)), decimation),
-        d_delay(delay)
+        d_delay(delay),
+        d_raw_input(raw_input),
+        d_raw_scaling(default_raw_scaling())
 
     {
       set_relative_rate(1./decimation);
@@ -41,56 +47,62 @@ namespace gr {
     {
     }
 
+    bool
+    decimate_and_adjust_timebase_impl::start()
+    {
+      d_raw_scaling = default_raw_scaling();
+      return true;
+    }
+
     int
     decimate_and_adjust_timebase_impl::work(int noutput_items,
         gr_vector_const_void_star &input_items,
         gr_vector_void_star &output_items)
     {
+      block_stats_scope_t stats(d_stats);
       const auto decim = decimation();
 
       float *out = (float *) output_items[0];
-      const float *in = (const float *) input_items[0];
 
-      int i_in = 0, i_out = 0;
-      for(; i_out < noutput_items; i_out++)
-      {
+      // tags of the whole work window are fetched and walked once
+      auto &tags = d_tags;
+      tags.clear();
+      get_tags_in_range(tags, 0, nitems_read(0), nitems_read(0) + noutput_items * decim);
+
+      if (d_raw_input) {
+        const int16_t *in = (const int16_t *) input_items[0];
+
+        // Only the samples kept are converted
+        std::stable_sort(tags.begin(), tags.end(), gr::tag_t::offset_compare);
+        apply_raw_scaling(tags, nitems_read(0), decim, noutput_items, d_raw_scaling,
+                [decim, in, out](int first, int nitems, const raw_scaling_t &scaling) {
+          const auto scale = static_cast<float>(scaling.scale);
+          const auto offset = static_cast<float>(scaling.offset);
+          for (int i_out = first; i_out < first + nitems; i_out++) {
+            out[i_out] = in[static_cast<size_t>(i_out) * decim] * scale + offset;
+          }
+        });
+      }
+      else {
+        const float *in = (const float *) input_items[0];
+
         // Keep one in N functionality
-        out[i_out] = in[i_in];
-
-        std::vector<gr::tag_t> tags;
-        get_tags_in_range(tags, 0, nitems_read(0) + i_in, nitems_read(0) + i_in + decim );
-        // required to merge acq_infotags due to this bug: https://github.com/gnuradio/gnuradio/issues/2364
-        // otherwise we will eat to much memory
-        // TODO: Fix bug in gnuradio (https://gitlab.com/al.schwinn/gr-digitizers/issues/33)
-        acq_info_t merged_acq_info;
-        merged_acq_info.status = 0;
-        bool found_acq_info = false;
-        for(auto tag : tags)
+        for(int i_out = 0; i_out < noutput_items; i_out++)
         {
-            //std::cout << "tag found: " << tag.key << std::endl;
-            if(tag.key == pmt::string_to_symbol(trigger_tag_name))
-            {
-                trigger_t trigger_tag_data = decode_trigger_tag(tag);
-                add_item_tag(0, make_trigger_tag(trigger_tag_data, nitems_written(0) + i_out));
-                //std::cout << "trigger tag added" << std::endl;
-            }
-            else if(tag.key == pmt::string_to_symbol(acq_info_tag_name))
-            {
-                found_acq_info = true;
-                merged_acq_info.status |= decode_acq_info_tag(tag).status;
-            }
-            else
-            {
-                tag.offset = nitems_written(0) + i_out;
-                add_item_tag(0, tag);
-            }
+          out[i_out] = in[i_out * decim];
         }
-        if(found_acq_info)
-            add_item_tag(0, make_acq_info_tag(merged_acq_info, nitems_written(0) + i_out));
-
-        i_in += decim;
       }
 
+      decimate_tags(tags, nitems_read(0), nitems_written(0), decim,
+              [this](const gr::tag_t &tag) {
+        // the output is in volts, the error estimate is what remains of the scaling
+        if (d_raw_input && get_tag_kind(tag) == TAG_KIND_RAW_SCALING) {
+          add_item_tag(0, make_constant_error_tag(decode_raw_scaling_tag(tag).error, tag.offset));
+        }
+        else {
+          add_item_tag(0, tag);
+        }
+      });
 
       return noutput_items;
     }
@@ -8,6 +8,10 @@
 #define INCLUDED_DIGITIZERS_DECIMATE_AND_ADJUST_TIMEBASE_IMPL_H
 
 #include <digitizers/decimate_and_adjust_timebase.h>
+#include <digitizers/tags.h>
+#include "block_stats_impl.h"
+
+#include <vector>
 
 namespace gr {
   namespace digitizers {
@@ -18,10 +22,20 @@ namespace gr {
       double d_delay;
       int64_t d_sample_sample_distance_input_ns; // sample to sample distance on input ports in nanoseconds
 
+      bool d_raw_input;
+      raw_scaling_t d_raw_scaling;  // raw input only
+
+      // Reused in order to avoid allocations per work call
+      std::vector<gr::tag_t> d_tags;
+
+      block_stats_recorder_t d_stats {this};
+
      public:
-      decimate_and_adjust_timebase_impl(int decimation, double delay, float samp_rate);
+      decimate_and_adjust_timebase_impl(int decimation, double delay, float samp_rate, bool raw_input);
       ~decimate_and_adjust_timebase_impl();
 
+      bool start() override;
+
       int work(int noutput_items,
          gr_vector_const_void_star &input_items,
          gr_vector_void_star &output_items);
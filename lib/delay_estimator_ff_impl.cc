@@ -0,0 +1,312 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gnuradio/io_signature.h>
+#include <digitizers/tags.h>
+#include "delay_estimator_ff_impl.h"
+#include "cross_correlator.h"
+#include "thread_registry.h"
+#include "trace_registry.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+namespace gr {
+  namespace digitizers {
+
+    delay_estimator_ff::sptr
+    delay_estimator_ff::make(int nchannels, double samp_rate, int decim, int window_size,
+            double max_delay, double update_interval, float min_correlation)
+    {
+      return gnuradio::get_initial_sptr
+        (new delay_estimator_ff_impl(nchannels, samp_rate, decim, window_size, max_delay,
+                update_interval, min_correlation));
+    }
+
+    /*
+     * The private constructor
+     */
+    delay_estimator_ff_impl::delay_estimator_ff_impl(int nchannels, double samp_rate, int decim,
+            int window_size, double max_delay, double update_interval, float min_correlation)
+      : gr::sync_block("delay_estimator_ff",
+              gr::io_signature::make(std::max(nchannels, 2), std::max(nchannels, 2), sizeof(float)),
+              gr::io_signature::make(std::max(nchannels, 2), std::max(nchannels, 2), sizeof(float))),
+        d_nchannels(nchannels),
+        d_samp_rate(samp_rate),
+        d_decim(decim),
+        d_window_size(window_size),
+        d_max_lag(samp_rate > 0.0 && decim > 0 ? static_cast<int>(std::ceil(max_delay * samp_rate / decim)) : 0),
+        d_min_correlation(min_correlation),
+        d_update_interval_us(0),
+        d_phase(0),
+        d_filled(0),
+        d_collecting(false),
+        d_published(0),
+        d_pending(false),
+        d_stop(false),
+        d_estimates(0)
+    {
+      if (nchannels < 2 || !(samp_rate > 0.0) || decim < 1) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid number of channels, sample rate or decimation, channels: "
+                << nchannels << ", sample rate: " << samp_rate << ", decimation: " << decim;
+        throw std::invalid_argument(message.str());
+      }
+
+      // the windows overlap by at least half of their size for all the delays searched
+      if (window_size < 16 || !(max_delay >= 0.0) || d_max_lag > window_size / 2) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": window of " << window_size
+                << " decimated samples too short for a max delay of " << max_delay << " s";
+        throw std::invalid_argument(message.str());
+      }
+
+      if (!(min_correlation >= 0.0f) || min_correlation > 1.0f) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid min correlation: " << min_correlation;
+        throw std::invalid_argument(message.str());
+      }
+
+      set_update_interval(update_interval);
+      set_tag_propagation_policy(TPP_ONE_TO_ONE);
+
+      d_windows.assign(d_nchannels, std::vector<float>(d_window_size));
+      d_pending_windows.assign(d_nchannels, std::vector<float>(d_window_size));
+      d_sums.assign(d_nchannels, 0.0f);
+      d_delays.assign(d_nchannels, 0.0);
+      d_correlations.assign(d_nchannels, 0.0f);
+      d_accepted.assign(d_nchannels, 0);
+    }
+
+    delay_estimator_ff_impl::~delay_estimator_ff_impl()
+    {
+      stop();
+    }
+
+    std::vector<double>
+    delay_estimator_ff_impl::get_delays()
+    {
+      boost::mutex::scoped_lock lock(d_mutex);
+      return d_delays;
+    }
+
+    std::vector<float>
+    delay_estimator_ff_impl::get_correlations()
+    {
+      boost::mutex::scoped_lock lock(d_mutex);
+      return d_correlations;
+    }
+
+    uint64_t
+    delay_estimator_ff_impl::get_nr_estimates()
+    {
+      return d_estimates;
+    }
+
+    void
+    delay_estimator_ff_impl::set_update_interval(double update_interval)
+    {
+      if (!(update_interval >= 0.0)) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid update interval: " << update_interval;
+        throw std::invalid_argument(message.str());
+      }
+
+      d_update_interval_us = static_cast<int64_t>(update_interval * 1e6);
+    }
+
+    double
+    delay_estimator_ff_impl::get_update_interval()
+    {
+      return d_update_interval_us * 1e-6;
+    }
+
+    bool
+    delay_estimator_ff_impl::start()
+    {
+      d_collecting = false;
+      d_next_window = std::chrono::steady_clock::now();
+      d_published = d_estimates;
+
+      d_stop = false;
+      d_estimator_thread = boost::thread(&delay_estimator_ff_impl::estimator_work_function, this);
+      return true;
+    }
+
+    bool
+    delay_estimator_ff_impl::stop()
+    {
+      if (!d_estimator_thread.joinable()) {
+        return true;
+      }
+
+      // The pending windows are estimated before the thread exits
+      {
+        boost::mutex::scoped_lock lock(d_mutex);
+        d_stop = true;
+      }
+      d_cv.notify_all();
+      d_estimator_thread.join();
+      return true;
+    }
+
+    int
+    delay_estimator_ff_impl::work(int noutput_items,
+        gr_vector_const_void_star &input_items,
+        gr_vector_void_star &output_items)
+    {
+      block_stats_scope_t stats(d_stats);
+
+      for (int ch = 0; ch < d_nchannels; ch++) {
+        if (output_items[ch] != input_items[ch]) {
+          memcpy(output_items[ch], input_items[ch], noutput_items * sizeof(float));
+        }
+      }
+
+      publish_estimate();
+      collect(noutput_items, input_items);
+
+      return noutput_items;
+    }
+
+    void
+    delay_estimator_ff_impl::publish_estimate()
+    {
+      if (d_published == d_estimates) {
+        return;
+      }
+
+      boost::mutex::scoped_lock lock(d_mutex);
+      d_published = d_estimates;
+
+      for (int ch = 0; ch < d_nchannels; ch++) {
+        if (d_accepted[ch]) {
+          channel_delay_t channel_delay;
+          channel_delay.delay = d_delays[ch];
+          channel_delay.correlation = d_correlations[ch];
+          add_item_tag(ch, make_channel_delay_tag(channel_delay, nitems_written(ch)));
+        }
+      }
+    }
+
+    void
+    delay_estimator_ff_impl::collect(int noutput_items, const gr_vector_const_void_star &input_items)
+    {
+      if (!d_collecting) {
+        if (std::chrono::steady_clock::now() < d_next_window) {
+          return;
+        }
+
+        boost::mutex::scoped_lock lock(d_mutex);
+        if (d_pending) {
+          return;
+        }
+
+        d_collecting = true;
+        d_phase = 0;
+        d_filled = 0;
+        std::fill(d_sums.begin(), d_sums.end(), 0.0f);
+      }
+
+      // Samples following a complete window are skipped
+      const int nsamples = std::min(noutput_items, (d_window_size - d_filled) * d_decim - d_phase);
+      const float scale = 1.0f / d_decim;
+
+      int phase = 0, filled = 0;
+      for (int ch = 0; ch < d_nchannels; ch++) {
+        const float *in = static_cast<const float *>(input_items[ch]);
+        float *window = d_windows[ch].data();
+        float sum = d_sums[ch];
+        phase = d_phase;
+        filled = d_filled;
+
+        for (int i = 0; i < nsamples; i++) {
+          sum += in[i];
+          if (++phase == d_decim) {
+            window[filled++] = sum * scale;
+            sum = 0.0f;
+            phase = 0;
+          }
+        }
+        d_sums[ch] = sum;
+      }
+      d_phase = phase;
+      d_filled = filled;
+
+      if (d_filled < d_window_size) {
+        return;
+      }
+
+      {
+        boost::mutex::scoped_lock lock(d_mutex);
+        d_windows.swap(d_pending_windows);
+        d_pending = true;
+      }
+      d_cv.notify_all();
+
+      d_collecting = false;
+      d_next_window = std::chrono::steady_clock::now() + std::chrono::microseconds(d_update_interval_us.load());
+    }
+
+    void
+    delay_estimator_ff_impl::estimator_work_function()
+    {
+      thread_scope_t thread(get_block_name(this), "delay-estimator");
+
+      // plans are created by the thread using them
+      cross_correlator_t correlator(d_window_size);
+      std::vector<double> delays(d_nchannels, 0.0);
+      std::vector<float> correlations(d_nchannels, 0.0f);
+
+      boost::mutex::scoped_lock lock(d_mutex);
+
+      while (true) {
+        while (!d_pending && !d_stop) {
+          d_cv.wait(lock);
+        }
+        if (!d_pending) {
+          return;
+        }
+
+        // the work function doesn't touch the pending windows until d_pending is reset
+        lock.unlock();
+
+        correlator.set_reference(d_pending_windows[0].data());
+        correlations[0] = 1.0f;
+        for (int ch = 1; ch < d_nchannels; ch++) {
+          double lag = 0.0;
+          float correlation = 0.0f;
+          if (!correlator.estimate(d_pending_windows[ch].data(), d_max_lag, lag, correlation)) {
+            correlation = 0.0f;
+          }
+          delays[ch] = lag * d_decim / d_samp_rate;
+          correlations[ch] = correlation;
+        }
+
+        lock.lock();
+
+        for (int ch = 0; ch < d_nchannels; ch++) {
+          d_accepted[ch] = correlations[ch] >= d_min_correlation;
+          if (d_accepted[ch]) {
+            d_delays[ch] = delays[ch];
+          }
+          d_correlations[ch] = correlations[ch];
+        }
+
+        d_pending = false;
+        d_estimates++;
+      }
+    }
+
+  } /* namespace digitizers */
+} /* namespace gr */
@@ -0,0 +1,101 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_DELAY_ESTIMATOR_FF_IMPL_H
+#define INCLUDED_DIGITIZERS_DELAY_ESTIMATOR_FF_IMPL_H
+
+#include <digitizers/delay_estimator_ff.h>
+#include "block_stats_impl.h"
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * The work function fills the decimated windows, complete windows are swapped with the
+     * ones of the estimator thread. Results are published under the mutex and tagged by the
+     * next work call.
+     */
+    class delay_estimator_ff_impl : public delay_estimator_ff
+    {
+     private:
+      const int d_nchannels;
+      const double d_samp_rate;
+      const int d_decim;
+      const int d_window_size;
+      const int d_max_lag;            // decimated samples
+      const float d_min_correlation;
+      std::atomic<int64_t> d_update_interval_us;
+
+      // Used by the work function only
+      std::vector<std::vector<float>> d_windows;
+      std::vector<float> d_sums;
+      int d_phase;                    // samples averaged into d_sums
+      int d_filled;                   // decimated samples in d_windows
+      bool d_collecting;
+      std::chrono::steady_clock::time_point d_next_window;
+      uint64_t d_published;
+
+      // Shared with the estimator thread
+      boost::mutex d_mutex;
+      boost::condition_variable d_cv;
+      std::vector<std::vector<float>> d_pending_windows;
+      bool d_pending;                 // set until the estimate of the pending windows is done
+      bool d_stop;
+      std::vector<double> d_delays;
+      std::vector<float> d_correlations;
+      std::vector<char> d_accepted;   // of the latest estimate
+      std::atomic<uint64_t> d_estimates;
+
+      boost::thread d_estimator_thread;
+
+      block_stats_recorder_t d_stats {this};
+
+     public:
+      delay_estimator_ff_impl(int nchannels, double samp_rate, int decim, int window_size,
+              double max_delay, double update_interval, float min_correlation);
+
+      ~delay_estimator_ff_impl();
+
+      std::vector<double> get_delays() override;
+
+      std::vector<float> get_correlations() override;
+
+      uint64_t get_nr_estimates() override;
+
+      void set_update_interval(double update_interval) override;
+
+      double get_update_interval() override;
+
+      bool start() override;
+
+      bool stop() override;
+
+      int work(int noutput_items,
+        gr_vector_const_void_star &input_items,
+        gr_vector_void_star &output_items) override;
+
+     private:
+
+      // Adds channel_delay tags if a new estimate is available
+      void publish_estimate();
+
+      // Averages the samples into the windows, hands complete windows over
+      void collect(int noutput_items, const gr_vector_const_void_star &input_items);
+
+      void estimator_work_function();
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_DELAY_ESTIMATOR_FF_IMPL_H */
@@ -0,0 +1,155 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_DEMAND_H
+#define INCLUDED_DIGITIZERS_DEMAND_H
+
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <atomic>
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Demand of a branch of a processing tree, e.g. of a cascade level and everything
+     * derived from it.
+     *
+     * A node is active as long as it has a consumer itself (e.g. a sink with a callback
+     * registered) or any of its children is active. Changes are propagated up to the root
+     * right away, the work functions only poll is_active (lock-free).
+     */
+    class demand_node_t : boost::noncopyable
+    {
+    public:
+
+      typedef boost::shared_ptr<demand_node_t> sptr;
+
+      static sptr make(const sptr &parent = sptr())
+      {
+        sptr node(new demand_node_t());
+        node->set_parent(parent);
+        return node;
+      }
+
+      ~demand_node_t()
+      {
+        set_parent(sptr());
+      }
+
+      /*!
+       * \brief Moves the node to another parent, the demand of the node moves along.
+       */
+      void set_parent(const sptr &parent)
+      {
+        boost::mutex::scoped_lock lock(mutex());
+        if (d_active) {
+          propagate(d_parent.get(), -1);
+          propagate(parent.get(), +1);
+        }
+        d_parent = parent;
+      }
+
+      void set_consumer(bool consumer)
+      {
+        boost::mutex::scoped_lock lock(mutex());
+        if (consumer != d_consumer) {
+          d_consumer = consumer;
+          propagate(this, consumer ? +1 : -1);
+        }
+      }
+
+      bool is_active() const
+      {
+        return d_active.load(std::memory_order_relaxed);
+      }
+
+    private:
+
+      demand_node_t()
+        : d_count(0),
+          d_consumer(false),
+          d_active(false)
+      {
+      }
+
+      // Demands of all the trees are rare to change, they share a lock
+      static boost::mutex &mutex()
+      {
+        static boost::mutex m;
+        return m;
+      }
+
+      // Adds to the count of the node, transitions are passed on to the parent
+      static void propagate(demand_node_t *node, int delta)
+      {
+        while (node) {
+          const bool was_active = node->d_count > 0;
+          node->d_count += delta;
+          const bool active = node->d_count > 0;
+          if (active == was_active) {
+            return;
+          }
+          node->d_active = active;
+          node = node->d_parent.get();
+        }
+      }
+
+      sptr d_parent;
+      int d_count;          // own consumer plus active children
+      bool d_consumer;
+      std::atomic<bool> d_active;
+    };
+
+    /*!
+     * \brief Work function side of a demand: tells whether the outputs are read and whether
+     * the processing resumes after a pause, i.e. the state needs to be reset.
+     */
+    class demand_gate_t
+    {
+    public:
+
+      demand_gate_t()
+        : d_paused(false)
+      {
+      }
+
+      void set_demand(const demand_node_t::sptr &demand)
+      {
+        d_demand = demand;
+      }
+
+      /*!
+       * \brief Returns false while the demand is inactive. The reset function is called if the
+       * demand became active since the previous call.
+       */
+      template <typename Reset>
+      bool poll(Reset reset)
+      {
+        auto demand = d_demand;
+        if (demand && !demand->is_active()) {
+          d_paused = true;
+          return false;
+        }
+
+        if (d_paused) {
+          d_paused = false;
+          reset();
+        }
+        return true;
+      }
+
+    private:
+      demand_node_t::sptr d_demand;
+      bool d_paused;
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_DEMAND_H */
@@ -12,9 +12,19 @@
 #include <digitizers/status.h>
 #include "demux_ff_impl.h"
 
+#include <algorithm>
+#include <cstring>
+
 namespace gr {
   namespace digitizers {
 
+    // Upper bound for the number of windows waiting for samples or output space
+    static const size_t MAX_PENDING_WINDOWS = 4096;
+
+    // Minimum size of the sample rings, i.e. the number of samples consumed per work call
+    // while a large window is pending
+    static const uint64_t MIN_RING_SIZE = 8192;
+
     demux_ff::sptr
     demux_ff::make(unsigned post_trigger_window, unsigned pre_trigger_window)
     {
@@ -29,16 +39,21 @@ namespace gr {
       : gr::block("demux_ff",
               gr::io_signature::make(1, 2, sizeof(float)),
               gr::io_signature::make(1, 2, sizeof(float))),
-      d_my_history(pre_trigger_window + post_trigger_window),
       d_pre_trigger_window(pre_trigger_window),
       d_post_trigger_window(post_trigger_window),
-      d_state(extractor_state::WaitTrigger),
-      d_last_trigger_offset(0),
-      d_trigger_start_range(0),
-      d_trigger_end_range(0)
+      d_pending(),
+      d_acq_info_tags(),
+      d_scanned_until(0),
+      d_skipped_triggers(0)
     {
-      // actual history size is in fact N - 1
-      set_history(d_my_history + 1);
+      // The windows are sliced from the rings, i.e. no history is needed and the size of the
+      // upstream buffers does not depend on the window size. The rings can hold a complete
+      // window, in addition to the samples consumed while the window is being filled.
+      uint64_t ring_size = MIN_RING_SIZE;
+      while (ring_size < 2 * static_cast<uint64_t>(pre_trigger_window + post_trigger_window)) {
+        ring_size <<= 1;
+      }
+      d_ring_mask = ring_size - 1;
 
       // allows us to send a complete data chunk down the stream
       set_output_multiple(pre_trigger_window + post_trigger_window);
@@ -56,122 +71,192 @@ namespace gr {
     bool
     demux_ff_impl::start()
     {
-      d_state = extractor_state::WaitTrigger;
+      d_pending.clear();
+      d_acq_info_tags.clear();
+      d_scanned_until = 0;
+      d_skipped_triggers = 0;
+      for (auto &ring : d_rings) {
+        ring.assign(d_ring_mask + 1, 0.0f);
+      }
       return true;
     }
 
-//    void
-//    demux_ff_impl::forecast(int noutput_items, gr_vector_int &ninput_items_required)
-//    {
-//      for (auto & required : ninput_items_required) {
-//        required = noutput_items + history() - 1;
-//      }
-//    }
+    void
+    demux_ff_impl::forecast(int noutput_items, gr_vector_int &ninput_items_required)
+    {
+      // At least one new sample, none if the oldest pending window is complete already (i.e.
+      // waiting for output space only). Windows are filled over multiple calls, requiring the
+      // whole window at once could exceed the size of the upstream buffer.
+      int required = 1;
+      if (!d_pending.empty()
+              && d_pending.front().trigger_offset + d_post_trigger_window <= nitems_read(0)) {
+        required = 0;
+      }
 
-    int
-    demux_ff_impl::general_work(int noutput_items,
-                               gr_vector_int &ninput_items,
-                               gr_vector_const_void_star &input_items,
-                               gr_vector_void_star &output_items)
+      for (auto &items : ninput_items_required) {
+        items = required;
+      }
+    }
+
+    uint64_t
+    demux_ff_impl::get_skipped_triggers() const
     {
-      int retval = 0;
-      const auto samp0_count = nitems_read(0);
+      return d_skipped_triggers;
+    }
+
+    void
+    demux_ff_impl::skip_trigger(uint64_t trigger_offset, const char *reason)
+    {
+      d_skipped_triggers++;
+      GR_LOG_WARN(d_logger, "trigger at offset " + std::to_string(trigger_offset) + " skipped, " + reason);
+    }
+
+    void
+    demux_ff_impl::scan_tags(uint64_t end)
+    {
+      const auto begin = std::max(d_scanned_until, nitems_read(0));
+      if (begin >= end) {
+        return;
+      }
 
-      // Consume samples until a trigger tag is detected
-      if (d_state == extractor_state::WaitTrigger)
-      {
-        std::vector<gr::tag_t> trigger_tags;
-        get_tags_in_range(trigger_tags, 0, samp0_count, samp0_count + noutput_items, pmt::string_to_symbol(trigger_tag_name));
-
-        for (const auto &trigger_tag : trigger_tags)
-        {
-          if (trigger_tag.offset > d_pre_trigger_window)
-          {
-            d_last_trigger_offset = trigger_tag.offset;
-            d_trigger_tag_data = decode_trigger_tag(trigger_tag);
-            d_state = extractor_state::CalcOutputRange;
-            //GR_LOG_DEBUG(d_logger, "demux detected trigger at offset: " + std::to_string(d_last_trigger_offset));
-
-            // store as well aqc info tags for that trigger
-            std::vector<gr::tag_t> info_tags;
-            get_tags_in_range(info_tags, 0, trigger_tag.offset - d_pre_trigger_window, trigger_tag.offset + d_post_trigger_window, pmt::string_to_symbol(acq_info_tag_name));
-            for (const auto &info_tag : info_tags)
-            {
-              int64_t rel_offset = info_tag.offset - trigger_tag.offset;
-              d_acq_info_tags.push_back(std::make_pair(decode_acq_info_tag(info_tag), rel_offset ));
-            }
-            break; // found a trigger
-            //TODO: Instead of breaking here, we should make to report a warning/error if a trigger got skipped (e.g. if triggers are too tight together)
-          }
+      d_tags.clear();
+      get_tags_in_range(d_tags, 0, begin, end, acq_info_tag_key());
+      for (const auto &tag : d_tags) {
+        d_acq_info_tags.push_back(std::make_pair(decode_acq_info_tag(tag), tag.offset));
+      }
+
+      d_tags.clear();
+      get_tags_in_range(d_tags, 0, begin, end, trigger_tag_key());
+      for (const auto &tag : d_tags) {
+        if (tag.offset < d_pre_trigger_window) {
+          skip_trigger(tag.offset, "not enough pre-trigger samples");
+        }
+        else if (d_pending.size() >= MAX_PENDING_WINDOWS) {
+          skip_trigger(tag.offset, "too many pending windows");
+        }
+        else {
+          d_pending.push_back(pending_window_t {decode_trigger_tag(tag), tag.offset});
         }
       }
 
-      if (d_state == extractor_state::CalcOutputRange) {
+      if (trace_registry_t::active()) {
+        d_tags.clear();
+        get_tags_in_range(d_tags, 0, begin, end, trace_tag_key());
+        d_trace_tags.insert(d_trace_tags.end(), d_tags.begin(), d_tags.end());
+      }
 
-        // relative offset of the first sample based on count0
-        int relative_trigger_offset =
-                - static_cast<int>(samp0_count - d_last_trigger_offset)
-                - d_pre_trigger_window;
+      d_scanned_until = end;
+    }
 
-        if (relative_trigger_offset < (-static_cast<int>(d_my_history))) {
-          GR_LOG_ERROR(d_logger, "Can't extract data, not enough history available");
+    uint64_t
+    demux_ff_impl::retain_from() const
+    {
+      // the pending windows start at or after the first one, new triggers are after d_scanned_until
+      if (!d_pending.empty()) {
+        return d_pending.front().trigger_offset - d_pre_trigger_window;
+      }
+      return d_scanned_until > d_pre_trigger_window ? d_scanned_until - d_pre_trigger_window : 0;
+    }
 
-          d_state = extractor_state::WaitTrigger;
+    void
+    demux_ff_impl::append_to_ring(std::vector<float> &ring, const float *in, uint64_t offset, uint64_t nitems)
+    {
+      const auto index = offset & d_ring_mask;
+      const auto first = std::min(nitems, d_ring_mask + 1 - index);
+      memcpy(&ring[index], in, first * sizeof(float));
+      memcpy(&ring[0], in + first, (nitems - first) * sizeof(float));
+    }
 
-          consume_each(noutput_items);
-          return 0;
-        }
+    void
+    demux_ff_impl::copy_from_ring(const std::vector<float> &ring, uint64_t offset, uint64_t nitems, float *out)
+    {
+      const auto index = offset & d_ring_mask;
+      const auto first = std::min(nitems, d_ring_mask + 1 - index);
+      memcpy(out, &ring[index], first * sizeof(float));
+      memcpy(out + first, &ring[0], (nitems - first) * sizeof(float));
+    }
 
-        d_trigger_start_range = nitems_read(0) + relative_trigger_offset;
-        d_trigger_end_range = d_trigger_start_range + (d_pre_trigger_window + d_post_trigger_window);
+    void
+    demux_ff_impl::output_window(const pending_window_t &window, int out_idx, gr_vector_void_star &output_items)
+    {
+      const auto samples_2_copy = d_pre_trigger_window + d_post_trigger_window;
+      const auto window_start = window.trigger_offset - d_pre_trigger_window;
+      const auto window_end = window.trigger_offset + d_post_trigger_window;
 
-        d_state = extractor_state::WaitAllData;
+      for (size_t i = 0; i < output_items.size() && i < 2; i++) {
+        copy_from_ring(d_rings[i], window_start, samples_2_copy, (float *)output_items.at(i) + out_idx);
       }
 
-      if (d_state == extractor_state::WaitAllData) {
-        if (samp0_count < d_trigger_end_range) {
-          noutput_items = std::min(static_cast<int>(d_trigger_end_range - samp0_count), noutput_items);
-        }
-        else {
-          noutput_items = 0; // Don't consume anything in this iteration, output triggered data first
-          d_state = extractor_state::OutputData;
+      // add trigger tag and the acq_info tags within the window
+      const auto out_trigger_offset = nitems_written(0) + out_idx + d_pre_trigger_window;
+      auto trigger = window.trigger;
+      add_item_tag(0, make_trigger_tag(trigger, out_trigger_offset));
+
+      for (const auto &info_tag : d_acq_info_tags) {
+        if (info_tag.second >= window_start && info_tag.second < window_end) {
+          add_item_tag(0, make_acq_info_tag(info_tag.first,
+                  out_trigger_offset + info_tag.second - window.trigger_offset));
         }
       }
 
-      if (d_state == extractor_state::OutputData) {
-
-        assert (samp0_count >= d_trigger_end_range);
-        auto samples_2_copy = d_pre_trigger_window + d_post_trigger_window;
-        assert(d_my_history > (samp0_count - d_trigger_end_range));
-        auto start_index = d_my_history - (samp0_count - d_trigger_end_range) - samples_2_copy;
-        assert(start_index >= 0 && start_index < (d_my_history + noutput_items));
-        memcpy((char *)output_items.at(0),
-               (char *)input_items.at(0) + start_index * sizeof(float),
-               samples_2_copy * sizeof(float));
-        if (input_items.size() > 1 && output_items.size() > 1) {
-          memcpy((char *)output_items.at(1),
-                 (char *)input_items.at(1) + start_index * sizeof(float),
-                 samples_2_copy * sizeof(float));
+      for (auto tag : d_trace_tags) {
+        if (tag.offset >= window_start && tag.offset < window_end) {
+          tag.offset = out_trigger_offset + tag.offset - window.trigger_offset;
+          add_item_tag(0, tag);
         }
+      }
+    }
 
-        retval = samples_2_copy;
+    int
+    demux_ff_impl::general_work(int noutput_items,
+                               gr_vector_int &ninput_items,
+                               gr_vector_const_void_star &input_items,
+                               gr_vector_void_star &output_items)
+    {
+      block_stats_scope_t stats(d_stats);
+      const auto samp0_count = nitems_read(0);
+      const auto window_size = d_pre_trigger_window + d_post_trigger_window;
 
-        // add trigger tag
-        add_item_tag(0, make_trigger_tag(d_trigger_tag_data, nitems_written(0) + d_pre_trigger_window ));
-        for (auto &info_tag : d_acq_info_tags)
-        {
-            int64_t rel_offset = info_tag.second;
-            add_item_tag(0, make_acq_info_tag(info_tag.first, nitems_written(0) + d_pre_trigger_window + rel_offset ));
-        }
-        d_acq_info_tags.clear();
+      int navailable = ninput_items[0];
+      if (input_items.size() > 1) {
+        navailable = std::min(navailable, ninput_items[1]);
+      }
+
+      // New samples must not overwrite the samples still needed by the pending windows. The
+      // rings always have space for the window of the oldest pending trigger.
+      const auto ring_space = d_ring_mask + 1 - (samp0_count - retain_from());
+      const auto nappend = std::min(static_cast<uint64_t>(navailable), ring_space);
+      const auto end_offset = samp0_count + nappend;
+
+      scan_tags(end_offset);
 
-        d_state = extractor_state::WaitTrigger;
+      // The second ring is only needed if the second output is connected
+      for (size_t i = 0; i < input_items.size() && i < output_items.size() && i < 2; i++) {
+        append_to_ring(d_rings[i], (const float *)input_items.at(i), samp0_count, nappend);
       }
 
-      consume_each(noutput_items);
+      // Output all the complete windows, as long as there is output space
+      int retval = 0;
+      while (!d_pending.empty()
+              && d_pending.front().trigger_offset + d_post_trigger_window <= end_offset
+              && retval + static_cast<int>(window_size) <= noutput_items) {
+        output_window(d_pending.front(), retval, output_items);
+        retval += window_size;
+        d_pending.pop_front();
+      }
+
+      // Drop acq_info and trace tags preceding all the pending and the future windows
+      const auto keep_from = retain_from();
+      while (!d_acq_info_tags.empty() && d_acq_info_tags.front().second < keep_from) {
+        d_acq_info_tags.pop_front();
+      }
+      while (!d_trace_tags.empty() && d_trace_tags.front().offset < keep_from) {
+        d_trace_tags.pop_front();
+      }
+
+      consume_each(static_cast<int>(nappend));
       return retval;
     }
 
   } /* namespace digitizers */
 } /* namespace gr */
-
@@ -10,40 +10,67 @@
 #include <digitizers/demux_ff.h>
 #include <digitizers/tags.h>
 #include <digitizers/edge_trigger_utils.h>
-#include <boost/circular_buffer.hpp>
-#include <boost/optional.hpp>
+
+#include <deque>
+#include <vector>
 
 #include "utils.h"
+#include "block_stats_impl.h"
 
 namespace gr {
   namespace digitizers {
 
-    enum class extractor_state
-    {
-      WaitTrigger,
-      CalcOutputRange,
-      WaitAllData,
-      OutputData
-    };
-
     class demux_ff_impl : public demux_ff
     {
      private:
-      unsigned d_my_history;
+
+      // Trigger waiting for the post-trigger samples
+      struct pending_window_t
+      {
+        trigger_t trigger;
+        uint64_t trigger_offset;
+      };
+
       unsigned d_pre_trigger_window;
       unsigned d_post_trigger_window;
 
-      // <tag, offset-relative-to-trigger-tag>
-      std::vector<std::pair<acq_info_t, int64_t> > d_acq_info_tags;
+      // Pending windows (ordered by trigger offset) and acq_info tags which might be part of a
+      // pending or a future window, <tag, absolute offset>
+      std::deque<pending_window_t> d_pending;
+      std::deque<std::pair<acq_info_t, uint64_t>> d_acq_info_tags;
+
+      // Trace tags which might be part of a pending or a future window, only if tracing is active
+      std::deque<gr::tag_t> d_trace_tags;
+
+      // Tags are scanned only once, up to this offset (exclusive)
+      uint64_t d_scanned_until;
 
-      extractor_state d_state;
+      uint64_t d_skipped_triggers;
 
-      // absolute sample count where the last timing event appeared
-      trigger_t d_trigger_tag_data;
-      uint64_t d_last_trigger_offset;
+      std::vector<gr::tag_t> d_tags;
 
-      uint64_t d_trigger_start_range;
-      uint64_t d_trigger_end_range;
+      // Recent samples of each input, sample at offset o is stored at index o & d_ring_mask.
+      // The rings hold the consumed samples [nitems_read(0) - d_ring_mask - 1, nitems_read(0)).
+      std::vector<float> d_rings[2];
+      uint64_t d_ring_mask;
+
+      void scan_tags(uint64_t end);
+
+      void skip_trigger(uint64_t trigger_offset, const char *reason);
+
+      // Offset of the oldest sample needed by the pending or the future windows
+      uint64_t retain_from() const;
+
+      // Appends nitems samples, starting at offset
+      void append_to_ring(std::vector<float> &ring, const float *in, uint64_t offset, uint64_t nitems);
+
+      // Copies nitems samples, starting at offset
+      void copy_from_ring(const std::vector<float> &ring, uint64_t offset, uint64_t nitems, float *out);
+
+      // Copies the window of the given trigger to the outputs at index out_idx
+      void output_window(const pending_window_t &window, int out_idx, gr_vector_void_star &output_items);
+
+      block_stats_recorder_t d_stats {this};
 
      public:
       demux_ff_impl(unsigned post_trigger_window, unsigned pre_trigger_window);
@@ -51,7 +78,9 @@ namespace gr {
 
       bool start() override;
 
-//      void forecast(int noutput_items, gr_vector_int &ninput_items_required) override;
+      void forecast(int noutput_items, gr_vector_int &ninput_items_required) override;
+
+      uint64_t get_skipped_triggers() const override;
 
       int general_work(int noutput_items,
            gr_vector_int &ninput_items,
@@ -0,0 +1,377 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "design_cache.h"
+
+#include <boost/filesystem.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <initializer_list>
+
+namespace gr {
+  namespace digitizers {
+
+    namespace {
+
+      const char DESIGN_FILE_MAGIC[4] = {'G', 'R', 'D', 'D'};
+      const uint32_t DESIGN_FILE_VERSION = 1;
+
+      // Parameters are formatted exactly, i.e. designs differing in the last bit don't collide
+      std::string
+      format_param(double value)
+      {
+        char buf[64];
+        std::snprintf(buf, sizeof(buf), "%a", value);
+        return buf;
+      }
+
+      std::string
+      make_key(const std::string &name, std::initializer_list<double> params)
+      {
+        std::string key = name + "(";
+        bool first = true;
+        for (auto param : params) {
+          if (!first) {
+            key += ",";
+          }
+          key += format_param(param);
+          first = false;
+        }
+        return key + ")";
+      }
+
+      // FNV-1a, stable across builds unlike std::hash
+      uint64_t
+      hash_key(const std::string &key)
+      {
+        uint64_t hash = 14695981039346656037ull;
+        for (unsigned char c : key) {
+          hash ^= c;
+          hash *= 1099511628211ull;
+        }
+        return hash;
+      }
+
+      std::string
+      default_directory()
+      {
+        const char *directory = std::getenv("DIGITIZERS_DESIGN_CACHE");
+        if (directory) {
+          return directory;
+        }
+
+        const char *home = std::getenv("HOME");
+        if (!home || !*home) {
+          return "";
+        }
+        return std::string(home) + "/.gr_digitizers_designs";
+      }
+
+    } // namespace
+
+    design_cache_t &
+    design_cache_t::instance()
+    {
+      static design_cache_t cache;
+      return cache;
+    }
+
+    design_cache_t::design_cache_t()
+      : d_directory(default_directory()),
+        d_hits(0),
+        d_disk_hits(0),
+        d_misses(0)
+    {
+    }
+
+    std::vector<float>
+    design_cache_t::get(const std::string &key, const design_fn_t &design)
+    {
+      return *get_shared(key, design);
+    }
+
+    design_cache_t::taps_ptr_t
+    design_cache_t::get_shared(const std::string &key, const design_fn_t &design)
+    {
+      std::promise<taps_ptr_t> promise;
+      std::string directory;
+      {
+        boost::mutex::scoped_lock lock(d_mutex);
+
+        auto it = d_designs.find(key);
+        if (it != d_designs.end()) {
+          d_hits++;
+          auto pending = it->second;
+          lock.unlock();
+          return pending.get();
+        }
+
+        // Concurrent requests of the same design wait for this thread
+        d_designs[key] = promise.get_future().share();
+        directory = d_directory;
+      }
+
+      // Loaded or designed without the lock, i.e. different designs are computed concurrently
+      std::vector<float> taps;
+      bool loaded = false;
+      try {
+        loaded = load(directory, key, taps);
+        if (!loaded) {
+          taps = design();
+          store(directory, key, taps);
+        }
+      }
+      catch (...) {
+        {
+          boost::mutex::scoped_lock lock(d_mutex);
+          d_designs.erase(key);
+        }
+        promise.set_exception(std::current_exception());
+        throw;
+      }
+
+      auto shared = std::make_shared<const std::vector<float>>(std::move(taps));
+      {
+        boost::mutex::scoped_lock lock(d_mutex);
+        if (loaded) {
+          d_disk_hits++;
+        }
+        else {
+          d_misses++;
+        }
+      }
+      promise.set_value(shared);
+
+      return shared;
+    }
+
+    design_cache_t::taps_ptr_t
+    design_cache_t::intern(const std::vector<float> &taps)
+    {
+      uint64_t hash = 14695981039346656037ull;
+      for (auto tap : taps) {
+        uint32_t bits;
+        std::memcpy(&bits, &tap, sizeof(bits));
+        hash ^= bits;
+        hash *= 1099511628211ull;
+      }
+
+      boost::mutex::scoped_lock lock(d_mutex);
+
+      auto range = d_interned.equal_range(hash);
+      for (auto it = range.first; it != range.second; ) {
+        auto existing = it->second.lock();
+        if (!existing) {
+          it = d_interned.erase(it);
+          continue;
+        }
+        if (*existing == taps) {
+          return existing;
+        }
+        ++it;
+      }
+
+      auto shared = std::make_shared<const std::vector<float>>(taps);
+      d_interned.emplace(hash, shared);
+      return shared;
+    }
+
+    void
+    design_cache_t::set_directory(const std::string &directory)
+    {
+      boost::mutex::scoped_lock lock(d_mutex);
+      d_directory = directory;
+    }
+
+    std::string
+    design_cache_t::directory()
+    {
+      boost::mutex::scoped_lock lock(d_mutex);
+      return d_directory;
+    }
+
+    void
+    design_cache_t::clear_memory()
+    {
+      boost::mutex::scoped_lock lock(d_mutex);
+      d_designs.clear();
+    }
+
+    uint64_t
+    design_cache_t::hits()
+    {
+      boost::mutex::scoped_lock lock(d_mutex);
+      return d_hits;
+    }
+
+    uint64_t
+    design_cache_t::disk_hits()
+    {
+      boost::mutex::scoped_lock lock(d_mutex);
+      return d_disk_hits;
+    }
+
+    uint64_t
+    design_cache_t::misses()
+    {
+      boost::mutex::scoped_lock lock(d_mutex);
+      return d_misses;
+    }
+
+    std::string
+    design_cache_t::path(const std::string &directory, const std::string &key)
+    {
+      char name[32];
+      std::snprintf(name, sizeof(name), "%016llx.taps", static_cast<unsigned long long>(hash_key(key)));
+      return directory + "/" + name;
+    }
+
+    bool
+    design_cache_t::load(const std::string &directory, const std::string &key, std::vector<float> &taps)
+    {
+      if (directory.empty()) {
+        return false;
+      }
+
+      std::ifstream in(path(directory, key), std::ios::binary);
+      if (!in) {
+        return false;
+      }
+
+      char magic[4];
+      uint32_t version = 0, key_size = 0;
+      uint64_t ntaps = 0;
+
+      in.read(magic, sizeof(magic));
+      in.read(reinterpret_cast<char *>(&version), sizeof(version));
+      in.read(reinterpret_cast<char *>(&key_size), sizeof(key_size));
+      if (!in || std::memcmp(magic, DESIGN_FILE_MAGIC, sizeof(magic)) != 0
+              || version != DESIGN_FILE_VERSION || key_size != key.size()) {
+        return false;
+      }
+
+      std::string stored_key(key_size, '\0');
+      in.read(&stored_key[0], key_size);
+      in.read(reinterpret_cast<char *>(&ntaps), sizeof(ntaps));
+      if (!in || stored_key != key || ntaps > (1u << 24)) {
+        return false;
+      }
+
+      taps.resize(ntaps);
+      in.read(reinterpret_cast<char *>(taps.data()), ntaps * sizeof(float));
+      if (!in || in.peek() != std::char_traits<char>::eof()) {
+        taps.clear();
+        return false;
+      }
+
+      return true;
+    }
+
+    void
+    design_cache_t::store(const std::string &directory, const std::string &key, const std::vector<float> &taps)
+    {
+      if (directory.empty()) {
+        return;
+      }
+
+      // Persisting is best effort, the design is still used if it fails
+      try {
+        boost::filesystem::create_directories(directory);
+
+        // Written to a temporary file and renamed, i.e. concurrent processes (and threads) never
+        // see a partial file
+        const auto target = path(directory, key);
+        const auto temp = boost::filesystem::unique_path(target + ".%%%%%%%%").string();
+        {
+          std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+          const uint32_t key_size = key.size();
+          const uint64_t ntaps = taps.size();
+
+          out.write(DESIGN_FILE_MAGIC, sizeof(DESIGN_FILE_MAGIC));
+          out.write(reinterpret_cast<const char *>(&DESIGN_FILE_VERSION), sizeof(DESIGN_FILE_VERSION));
+          out.write(reinterpret_cast<const char *>(&key_size), sizeof(key_size));
+          out.write(key.data(), key.size());
+          out.write(reinterpret_cast<const char *>(&ntaps), sizeof(ntaps));
+          out.write(reinterpret_cast<const char *>(taps.data()), ntaps * sizeof(float));
+
+          if (!out) {
+            out.close();
+            boost::filesystem::remove(temp);
+            return;
+          }
+        }
+
+        boost::filesystem::rename(temp, target);
+      }
+      catch (const boost::filesystem::filesystem_error &) {
+      }
+    }
+
+    std::vector<float>
+    cached_low_pass(double gain, double samp_rate, double cutoff_freq, double transition_width,
+            gr::filter::firdes::win_type window, double beta)
+    {
+      return design_cache_t::instance().get(
+              make_key("low_pass", {gain, samp_rate, cutoff_freq, transition_width,
+                      static_cast<double>(window), beta}),
+              [=] {
+                return gr::filter::firdes::low_pass(gain, samp_rate, cutoff_freq, transition_width,
+                        window, beta);
+              });
+    }
+
+    std::vector<float>
+    cached_band_pass(double gain, double samp_rate, double low_cutoff_freq, double high_cutoff_freq,
+            double transition_width, gr::filter::firdes::win_type window, double beta)
+    {
+      return design_cache_t::instance().get(
+              make_key("band_pass", {gain, samp_rate, low_cutoff_freq, high_cutoff_freq,
+                      transition_width, static_cast<double>(window), beta}),
+              [=] {
+                return gr::filter::firdes::band_pass(gain, samp_rate, low_cutoff_freq,
+                        high_cutoff_freq, transition_width, window, beta);
+              });
+    }
+
+    std::vector<float>
+    cached_hilbert(unsigned int ntaps, gr::filter::firdes::win_type window, double beta)
+    {
+      return design_cache_t::instance().get(
+              make_key("hilbert", {static_cast<double>(ntaps), static_cast<double>(window), beta}),
+              [=] {
+                return gr::filter::firdes::hilbert(ntaps, window, beta);
+              });
+    }
+
+    std::vector<float>
+    cached_firdes_window(gr::filter::firdes::win_type window, int ntaps, double beta)
+    {
+      return design_cache_t::instance().get(
+              make_key("firdes_window", {static_cast<double>(window), static_cast<double>(ntaps), beta}),
+              [=] {
+                return gr::filter::firdes::window(window, ntaps, beta);
+              });
+    }
+
+    std::vector<float>
+    cached_fft_window(gr::fft::window::win_type window, int ntaps, double beta)
+    {
+      return design_cache_t::instance().get(
+              make_key("fft_window", {static_cast<double>(window), static_cast<double>(ntaps), beta}),
+              [=] {
+                return gr::fft::window::build(window, ntaps, beta);
+              });
+    }
+
+  } // namespace digitizers
+} // namespace gr
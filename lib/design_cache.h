@@ -0,0 +1,139 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_DESIGN_CACHE_H
+#define INCLUDED_DIGITIZERS_DESIGN_CACHE_H
+
+#include <gnuradio/filter/firdes.h>
+#include <gnuradio/fft/window.h>
+
+#include <boost/thread/mutex.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Process-wide cache of filter taps and windows, keyed by the design parameters.
+     *
+     * Designs are kept in memory and, unless disabled, persisted in a directory such that
+     * restarts of large flowgraphs (e.g. many cascade sinks) don't redesign the same filters.
+     * The directory is $HOME/.gr_digitizers_designs, the DIGITIZERS_DESIGN_CACHE environment
+     * variable overrides it, an empty value disables persistence. Each design is stored in its
+     * own file together with its key, corrupt or colliding files are ignored and rewritten.
+     *
+     * Different designs are computed concurrently, a design requested by several threads at
+     * once is computed by the first one while the others wait for it (see cascade_sink::make_many).
+     *
+     * FFTW plans are not cached here, gr::fft persists its wisdom in ~/.gr_fftw_wisdom.
+     */
+    class design_cache_t
+    {
+    public:
+
+      typedef std::function<std::vector<float>()> design_fn_t;
+      typedef std::shared_ptr<const std::vector<float>> taps_ptr_t;
+
+      static design_cache_t &instance();
+
+      /*!
+       * \brief Returns the cached design for key, calling design on a miss.
+       */
+      std::vector<float> get(const std::string &key, const design_fn_t &design);
+
+      /*!
+       * \brief Same as above, without copying the design.
+       */
+      taps_ptr_t get_shared(const std::string &key, const design_fn_t &design);
+
+      /*!
+       * \brief Returns a shared instance equal to taps, i.e. blocks holding the same
+       * coefficients (e.g. the reversed taps of identical cascades) share one copy. Instances
+       * are released with their last user.
+       */
+      taps_ptr_t intern(const std::vector<float> &taps);
+
+      /*!
+       * \brief Sets the persistence directory, empty disables persistence.
+       */
+      void set_directory(const std::string &directory);
+
+      std::string directory();
+
+      /*!
+       * \brief Drops the designs held in memory, persisted designs are kept.
+       */
+      void clear_memory();
+
+      uint64_t hits();
+      uint64_t disk_hits();
+      uint64_t misses();
+
+    private:
+
+      design_cache_t();
+
+      // Called without the lock, with the directory read under the lock
+      static bool load(const std::string &directory, const std::string &key, std::vector<float> &taps);
+      static void store(const std::string &directory, const std::string &key, const std::vector<float> &taps);
+      static std::string path(const std::string &directory, const std::string &key);
+
+      boost::mutex d_mutex;
+      std::map<std::string, std::shared_future<taps_ptr_t>> d_designs;  // pending while designed
+      std::unordered_multimap<uint64_t, std::weak_ptr<const std::vector<float>>> d_interned;
+      std::string d_directory;
+
+      uint64_t d_hits;
+      uint64_t d_disk_hits;
+      uint64_t d_misses;
+    };
+
+    /*!
+     * \brief Cached gr::filter::firdes::low_pass.
+     */
+    std::vector<float> cached_low_pass(double gain, double samp_rate, double cutoff_freq,
+            double transition_width,
+            gr::filter::firdes::win_type window = gr::filter::firdes::WIN_HAMMING,
+            double beta = 6.76);
+
+    /*!
+     * \brief Cached gr::filter::firdes::band_pass.
+     */
+    std::vector<float> cached_band_pass(double gain, double samp_rate, double low_cutoff_freq,
+            double high_cutoff_freq, double transition_width,
+            gr::filter::firdes::win_type window = gr::filter::firdes::WIN_HAMMING,
+            double beta = 6.76);
+
+    /*!
+     * \brief Cached gr::filter::firdes::hilbert.
+     */
+    std::vector<float> cached_hilbert(unsigned int ntaps,
+            gr::filter::firdes::win_type window = gr::filter::firdes::WIN_RECTANGULAR,
+            double beta = 6.76);
+
+    /*!
+     * \brief Cached gr::filter::firdes::window.
+     */
+    std::vector<float> cached_firdes_window(gr::filter::firdes::win_type window, int ntaps,
+            double beta);
+
+    /*!
+     * \brief Cached gr::fft::window::build.
+     */
+    std::vector<float> cached_fft_window(gr::fft::window::win_type window, int ntaps, double beta);
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_DESIGN_CACHE_H */
@@ -0,0 +1,257 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_DEVICE_GROUP_H
+#define INCLUDED_DIGITIZERS_DEVICE_GROUP_H
+
+#include "thread_registry.h"
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/chrono.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <time.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Interface implemented by devices polled by a device group.
+     */
+    class device_group_member_t
+    {
+    public:
+
+      virtual ~device_group_member_t() {}
+
+      /*!
+       * \brief Executes a single poll iteration, returns false if the member doesn't need to be
+       * polled anymore.
+       */
+      virtual bool group_poll() = 0;
+
+      /*!
+       * \brief Desired poll period in seconds.
+       */
+      virtual double group_poll_period() const = 0;
+
+      /*!
+       * \brief Called from the group poll thread after it has been started, e.g. to apply the
+       * thread scheduling settings.
+       */
+      virtual void group_thread_started() = 0;
+    };
+
+    /*!
+     * \brief Coordinates acquisition of multiple devices within the same process.
+     *
+     * All the members of the group are polled by a single thread. Within each poll period the
+     * members get staggered slots, i.e. member k is polled period * k / N after the start of the
+     * period, spreading the driver calls (and the resulting conversion work) evenly.
+     *
+     * The group also provides a common time base. The group clock is CLOCK_MONOTONIC shifted by
+     * the UTC epoch sampled once when the group is created, meaning all the members stamp their
+     * data from the same clock which is not affected by NTP steps during the acquisition.
+     *
+     * Groups are identified by name and are created on first use, see get.
+     */
+    class device_group_t : boost::noncopyable
+    {
+    public:
+
+      /*!
+       * \brief Returns the group with the given name, the group is created if needed. Groups
+       * are destroyed once the last reference is released.
+       */
+      static std::shared_ptr<device_group_t> get(const std::string &name)
+      {
+        static boost::mutex registry_mutex;
+        static std::map<std::string, std::weak_ptr<device_group_t>> registry;
+
+        boost::mutex::scoped_lock lock(registry_mutex);
+
+        auto group = registry[name].lock();
+        if (!group) {
+          group.reset(new device_group_t(name));
+          registry[name] = group;
+        }
+
+        return group;
+      }
+
+      ~device_group_t()
+      {
+        stop_thread();
+      }
+
+      const std::string &name() const
+      {
+        return d_name;
+      }
+
+      /*!
+       * \brief Adds a member, the poll thread is started on first use.
+       */
+      void add(device_group_member_t *member)
+      {
+        boost::mutex::scoped_lock lock(d_mutex);
+
+        if (std::find(d_members.begin(), d_members.end(), member) == d_members.end()) {
+          d_members.push_back(member);
+        }
+
+        if (!d_thread.joinable()) {
+          d_thread = boost::thread(&device_group_t::poll_function, this);
+        }
+
+        d_cv.notify_all();
+      }
+
+      /*!
+       * \brief Removes a member. Once this method returns the member is not polled anymore.
+       *
+       * The poll thread waits for new members while the group is empty and is stopped when the
+       * group is destroyed.
+       */
+      void remove(device_group_member_t *member)
+      {
+        boost::mutex::scoped_lock lock(d_mutex);
+        d_members.erase(std::remove(d_members.begin(), d_members.end(), member), d_members.end());
+      }
+
+      size_t size() const
+      {
+        boost::mutex::scoped_lock lock(d_mutex);
+        return d_members.size();
+      }
+
+      /*!
+       * \brief Current time of the group clock in UTC nanoseconds.
+       */
+      uint64_t now_ns() const
+      {
+        return static_cast<uint64_t>(d_epoch_ns + get_monotonic_ns());
+      }
+
+    private:
+
+      explicit device_group_t(const std::string &name)
+        : d_name(name),
+          d_epoch_ns(0),
+          d_stop(false),
+          d_thread_started(false)
+      {
+        timespec utc;
+        clock_gettime(CLOCK_REALTIME, &utc);
+        d_epoch_ns = static_cast<int64_t>(utc.tv_sec) * 1000000000 + utc.tv_nsec - get_monotonic_ns();
+      }
+
+      static int64_t get_monotonic_ns()
+      {
+        timespec mono;
+        clock_gettime(CLOCK_MONOTONIC, &mono);
+        return static_cast<int64_t>(mono.tv_sec) * 1000000000 + mono.tv_nsec;
+      }
+
+      void stop_thread()
+      {
+        {
+          boost::mutex::scoped_lock lock(d_mutex);
+          d_stop = true;
+        }
+
+        d_cv.notify_all();
+
+        if (d_thread.joinable()) {
+          d_thread.join();
+        }
+      }
+
+      void poll_function()
+      {
+        typedef boost::chrono::steady_clock clock_t;
+
+        // Members not polling (e.g. idle) are checked at least this often
+        const auto min_period = boost::chrono::microseconds(100);
+
+        thread_scope_t thread(d_name, "group-poller");
+
+        std::vector<device_group_member_t *> members;
+
+        while (true) {
+          double period_s = 0.0;
+
+          {
+            boost::mutex::scoped_lock lock(d_mutex);
+            while (!d_stop && d_members.empty()) {
+              d_cv.wait(lock);
+            }
+
+            if (d_stop) {
+              return;
+            }
+
+            // Scheduling settings of the member starting the thread apply to the whole group
+            if (!d_thread_started) {
+              d_members.front()->group_thread_started();
+              d_thread_started = true;
+            }
+
+            members = d_members;
+            for (size_t i = 0; i < members.size(); i++) {
+              auto member_period = members[i]->group_poll_period();
+              period_s = i == 0 ? member_period : std::min(period_s, member_period);
+            }
+          }
+
+          auto period_start = clock_t::now();
+          auto period = std::max(boost::chrono::duration_cast<clock_t::duration>(
+                  boost::chrono::duration<double>(period_s)), clock_t::duration(min_period));
+
+          for (size_t k = 0; k < members.size(); k++) {
+            boost::this_thread::sleep_until(period_start + (period * k) / members.size());
+
+            // The member might have been removed meanwhile, the lock is held while polling
+            // in order to make remove synchronous
+            boost::mutex::scoped_lock lock(d_mutex);
+            if (d_stop) {
+              return;
+            }
+
+            auto it = std::find(d_members.begin(), d_members.end(), members[k]);
+            if (it != d_members.end() && !(*it)->group_poll()) {
+              d_members.erase(it);
+            }
+          }
+
+          boost::this_thread::sleep_until(period_start + period);
+        }
+      }
+
+      const std::string d_name;
+      int64_t d_epoch_ns;
+
+      mutable boost::mutex d_mutex;
+      boost::condition_variable d_cv;
+      std::vector<device_group_member_t *> d_members;
+      boost::thread d_thread;
+      bool d_stop;
+      bool d_thread_started;
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_DEVICE_GROUP_H */
@@ -10,15 +10,30 @@
 
 #include "digitizer_block_impl.h"
 #include "utils.h"
+#include "interlock_kernel.h"
+#include "probes.h"
+#include "memory_lock.h"
 #include <thread>
 #include <chrono>
 #include <boost/lexical_cast.hpp>
 #include <digitizers/tags.h>
-#include <gnuradio/thread/thread.h> // set_name
+#include <gnuradio/thread/thread.h> // thread_bind_to_processor
+#include <gnuradio/io_signature.h>
+#include <digitizers/status.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <cerrno>
+#include <cstring>
+#include <cmath>
+#include <limits>
+#include <algorithm>
 
 namespace gr {
   namespace digitizers {
 
+   // WR events kept for the realignment, see set_timing_realignment
+   static const size_t TIMING_EVENT_CAPACITY = 1024;
 
    /**********************************************************************
     * Error codes
@@ -44,6 +59,15 @@ namespace gr {
        case digitizer_block_errc::Interrupted:
         return "Wit interrupted";
 
+       case digitizer_block_errc::SchedulingFailed:
+        return "Thread scheduling failed";
+
+       case digitizer_block_errc::Retune:
+        return "Driver buffer size retuned";
+
+       case digitizer_block_errc::Reconfigure:
+        return "Configuration committed";
+
        default:
         return "(unrecognized error)";
       }
@@ -66,20 +90,63 @@ namespace gr {
    // The rate in which this block is called is given by the number of free slots on its output buffer. So we choose a big value via set_min_output_buffer
    uint64_t last_call_utc = 0;
 
-   static const int AVERAGE_HISTORY_LENGTH = 100000;
+   // Monotonic time used by the watchdog
+   static uint64_t
+   watchdog_now_ns()
+   {
+     return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch()).count();
+   }
 
-   digitizer_block_impl::digitizer_block_impl(int ai_channels, int di_ports, bool auto_arm) :
+   digitizer_block_impl::digitizer_block_impl(int ai_channels, int di_ports, bool auto_arm, bool raw_output) :
        d_samp_rate(10000),
        d_actual_samp_rate(d_samp_rate),
        d_time_per_sample_ns(1000000000. / d_samp_rate),
        d_pre_samples(1000),
        d_post_samples(9000),
        d_nr_captures(1),
+       d_bulk_readout(false),
+       d_overlapped_readout(false),
+       d_capture_segment(0),
+       d_rearmed(false),
+       d_async_readout(false),
+       d_readout_thread(),
+       d_readout_buffer(),
+       d_readout_samples(0),
+       d_readout_nr_segments(0),
+       d_readout_segment(nullptr),
+       d_readout_offset(0),
+       d_readout_waveforms(0),
        d_buffer_size(8192),
        d_nr_buffers(100),
        d_driver_buffer_size(100000),
+       d_buffer_memory_budget(0),
+       d_zero_copy(false),
+       d_raw_output(raw_output),
+       d_spin_iterations(0),
+       d_yield_iterations(0),
+       d_trigger_reserve(0),
+       d_conversion_threads(0),
+       d_conversion_pool(),
+       d_fast_interlock_callback(nullptr),
+       d_fast_interlock_user_data(nullptr),
+       d_fast_interlock_budget(0),
+       d_fast_interlock_issued(),
+       d_fast_interlock_words(),
+       d_buffer_huge_pages(false),
+       d_buffer_numa_node(-1),
+       d_realtime_memory(false),
+       d_scratch_locked_bytes(0),
+       d_output_locked_bytes(0),
+       d_poller_cpus(),
+       d_poller_rt_priority(0),
+       d_work_thread_cpus(),
+       d_work_thread_rt_priority(0),
+       d_work_thread_scheduling_applied(false),
+       d_scheduling_failed(false),
        d_acquisition_mode(acquisition_mode_t::STREAMING),
        d_poll_rate(0.001),
+       d_adaptive_polling(false),
        d_downsampling_mode(downsampling_mode_t::DOWNSAMPLING_MODE_NONE),
        d_downsampling_factor(1),
        d_ai_channels(ai_channels),
@@ -87,10 +154,17 @@ namespace gr {
        d_channel_settings(),
        d_port_settings(),
        d_trigger_settings(),
+       d_trigger_conditions(),
+       d_trigger_logic(TRIGGER_LOGIC_AND),
+       d_trigger_pulse_width(0.0),
        d_status(ai_channels),
        d_app_buffer(),
-       d_was_last_callback_timestamp_taken(false),
-       d_estimated_sample_rate(AVERAGE_HISTORY_LENGTH),
+       d_watchdog(),
+       d_sample_clock(),
+       d_samples_received(0),
+       d_priority_tracker(),
+       d_priority_channel(-1),
+       d_priority_port(-1),
        d_initialized(false),
        d_closed(false),
        d_armed(false),
@@ -98,30 +172,91 @@ namespace gr {
        d_trigger_once(false),
        d_was_triggered_once(false),
        d_timebase_published(false),
+       d_raw_scaling_published(false),
+       d_constant_error_published(false),
        ai_buffers(ai_channels),
        ai_error_buffers(ai_channels),
+       raw_buffers(ai_channels),
        port_buffers(di_ports),
        d_data_rdy(false),
        d_trigger_state(0),
-       d_read_idx(0),
-       d_buffer_samples(0),
-       d_errors(128),
-       d_poller_state(poller_state_t::IDLE)
+       d_events(1024, 128),
+       d_tag_builder(),
+       d_poller_state(poller_state_t::IDLE),
+       d_buffer_latency_target(0.0),
+       d_buffer_tuner(),
+       d_tuned_driver_buffer_size(0),
+       d_device_group_name(),
+       d_device_group_offset_ns(0),
+       d_device_group(),
+       d_device_group_registered(false),
+       d_applied_config(),
+       d_config_snapshot(),
+       d_config_mutex(),
+       d_config_version(0),
+       d_config_transaction(false),
+       d_config_applying(false),
+       d_config_cv(),
+       d_driver_config(),
+       d_metrics_lost_buffers(0),
+       d_metrics_conversion_ns(0),
+       d_metrics_conversion_samples(0),
+       d_metrics_estimated_samp_rate(0.0),
+       d_metrics_clock_samp_rate(0.0),
+       d_metrics_timestamp_error_ns(0.0),
+       d_metrics_fast_interlocks(0),
+       d_metrics_fast_interlock_latency_ns(0),
+       d_metrics_max_fast_interlock_latency_ns(0),
+       d_metrics_driver_buffer_size(0),
+       d_metrics_recommended_buffer_size(0),
+       d_metrics_max_poll_gap_ns(0),
+       d_metrics_interval(0.0),
+       d_metrics_last_published_ns(0),
+       d_trace_interval(0),
+       d_trace_chunk_count(0),
+       d_acq_info_anchor_interval(0),
+       d_acq_info_chunk_count(0),
+       d_timing_realignment(false),
+       d_realigner(TIMING_EVENT_CAPACITY),
+       d_aggregated_source(),
+       d_aggregated_tags(ai_channels),
+       d_aggregated_values(ai_channels),
+       d_aggregated_errors(ai_channels),
+       d_triggered_windows(false),
+       d_window_acquired(0),
+       d_packed_port_size(0)
    {
-     d_ai_buffers = std::vector<std::vector<float>>(d_ai_channels);
-     d_ai_error_buffers = std::vector<std::vector<float>>(d_ai_channels);
-
-     if (di_ports) {
-       d_port_buffers = std::vector<std::vector<uint8_t>>(di_ports);
-     }
-
      assert(d_ai_channels < MAX_SUPPORTED_AI_CHANNELS);
      assert(d_ports < MAX_SUPPORTED_PORTS);
 
+     reset_metrics();
+     publish_config();
+
+     d_events.set_logger([this](const event_record_t &record, uint64_t suppressed) {
+       log_event(record, suppressed);
+     });
+
+     d_stats.set_loss_counter([this] {
+       return d_metrics_lost_buffers.load(std::memory_order_relaxed);
+     });
+
+     message_port_register_out(pmt::mp("metrics"));
    }
 
    digitizer_block_impl::~digitizer_block_impl()
    {
+     // Flush the suppressed events while the logger is still usable
+     d_events.stop();
+     d_events.set_logger(nullptr);
+
+     // Normally done on stop, never leave a dangling member behind
+     if (d_device_group_registered) {
+       d_device_group->remove(this);
+     }
+
+     if (d_trace_interval > 0) {
+       trace_registry_t::sources().fetch_sub(1);
+     }
    }
 
    /**********************************************************************
@@ -156,6 +291,49 @@ namespace gr {
        return get_pre_trigger_samples_with_downsampling() + get_post_trigger_samples_with_downsampling();
    }
 
+   device_config_t
+   digitizer_block_impl::get_device_config() const
+   {
+     device_config_t config;
+     config.channels.assign(d_channel_settings.begin(), d_channel_settings.begin() + d_ai_channels);
+     config.ports.assign(d_port_settings.begin(), d_port_settings.begin() + d_ports);
+     config.trigger = d_trigger_settings;
+     config.acquisition_mode = d_acquisition_mode;
+     config.samp_rate = d_samp_rate;
+     config.pre_samples = d_pre_samples;
+     config.post_samples = d_post_samples;
+     config.nr_captures = d_nr_captures;
+     config.overlapped_readout = d_overlapped_readout;
+     config.buffer_size = d_buffer_size;
+     config.nr_buffers = d_nr_buffers;
+     config.driver_buffer_size = d_driver_buffer_size;
+     config.downsampling_mode = d_downsampling_mode;
+     config.downsampling_factor = d_downsampling_factor;
+     return config;
+   }
+
+   void
+   digitizer_block_impl::publish_config()
+   {
+     boost::mutex::scoped_lock lock(d_config_mutex);
+
+     std::unique_ptr<config_snapshot_t> snapshot(new config_snapshot_t);
+
+     // Not configured yet, nothing is applied
+     snapshot->config = d_applied_config.channels.empty() ? get_device_config() : d_applied_config;
+
+     for (size_t i = 0; i < snapshot->config.channels.size(); i++) {
+       auto &channel = snapshot->config.channels[i];
+       channel.interlock_min = d_channel_settings[i].interlock_min;
+       channel.interlock_max = d_channel_settings[i].interlock_max;
+       channel.calibration_scale = d_channel_settings[i].calibration_scale;
+       channel.calibration_offset = d_channel_settings[i].calibration_offset;
+     }
+     snapshot->version = ++d_config_version;
+
+     d_config_snapshot.publish(std::move(snapshot));
+   }
+
    double
    digitizer_block_impl::get_timebase_with_downsampling() const
    {
@@ -170,7 +348,153 @@ namespace gr {
    void
    digitizer_block_impl::add_error_code(std::error_code ec)
    {
-     d_errors.push(ec);
+     d_events.push(ec);
+   }
+
+   void
+   digitizer_block_impl::add_event(event_kind_t kind, std::error_code ec, uint64_t count)
+   {
+     d_events.push(kind, ec, count);
+   }
+
+   void
+   digitizer_block_impl::log_event(const event_record_t &record, uint64_t suppressed)
+   {
+     std::string message;
+
+     switch (record.kind) {
+       case EVENT_DRIVER_OVERRUN:
+         message = "Buffer overrun detected, continue...";
+         break;
+       case EVENT_BUFFERS_LOST:
+         message = std::to_string(record.count) + " digitizer data buffers lost. Usually the cause of this error is, that the work method of the Digitizer block is called with low frequency because of a 'traffic jam' in the flowgraph. (One of the next blocks cannot process incoming data in time)";
+         break;
+       case EVENT_POLL_FAILED:
+         message = "poll failed with: " + to_string(record.error_code());
+         break;
+       case EVENT_WAIT_FAILED:
+         message = "error occurred while waiting for data: " + to_string(record.error_code());
+         break;
+       case EVENT_WATCHDOG:
+         message = "Watchdog: estimated sample rate " + std::to_string(record.count)
+              + "Hz, expected: " + std::to_string(d_actual_samp_rate) + "Hz";
+         break;
+       case EVENT_WATCHDOG_STALL:
+         message = "Watchdog: stream stalled after " + std::to_string(record.count) + " samples";
+         break;
+       case EVENT_WATCHDOG_REARM:
+         message = "Watchdog triggered, rearming device...";
+         break;
+       case EVENT_REALIGNMENT_TIMEOUT:
+         message = std::to_string(record.count) + " triggers not realigned, no WR event within max_buffer_time";
+         break;
+       default:
+         return;
+     }
+
+     if (suppressed) {
+       message += " (" + std::to_string(suppressed) + " more since last reported)";
+     }
+
+     GR_LOG_ERROR(d_logger, message);
+   }
+
+   void
+   digitizer_block_impl::record_conversion_time(uint64_t duration_ns, uint64_t nr_samples)
+   {
+     d_metrics_conversion_ns.fetch_add(duration_ns, std::memory_order_relaxed);
+     d_metrics_conversion_samples.fetch_add(nr_samples, std::memory_order_relaxed);
+   }
+
+   void
+   digitizer_block_impl::reset_metrics()
+   {
+     d_metrics_lost_buffers = 0;
+     for (auto &bucket : d_metrics_latency_histogram) {
+       bucket = 0;
+     }
+     d_metrics_conversion_ns = 0;
+     d_metrics_conversion_samples = 0;
+     d_metrics_estimated_samp_rate = 0.0;
+     d_metrics_clock_samp_rate = 0.0;
+     d_metrics_timestamp_error_ns = 0.0;
+     d_metrics_fast_interlocks = 0;
+     d_metrics_fast_interlock_latency_ns = 0;
+     d_metrics_max_fast_interlock_latency_ns = 0;
+     d_metrics_recommended_buffer_size = 0;
+     d_metrics_max_poll_gap_ns = 0;
+   }
+
+   void
+   digitizer_block_impl::publish_metrics()
+   {
+     auto metrics = get_metrics();
+
+     auto histogram = pmt::make_vector(metrics.latency_histogram.size(), pmt::from_uint64(0));
+     for (size_t i = 0; i < metrics.latency_histogram.size(); i++) {
+       pmt::vector_set(histogram, i, pmt::from_uint64(metrics.latency_histogram[i]));
+     }
+
+     auto dict = pmt::make_dict();
+     dict = pmt::dict_add(dict, pmt::mp("free_buffers"), pmt::from_long(metrics.free_buffers));
+     dict = pmt::dict_add(dict, pmt::mp("full_buffers"), pmt::from_long(metrics.full_buffers));
+     dict = pmt::dict_add(dict, pmt::mp("min_free_buffers"), pmt::from_long(metrics.min_free_buffers));
+     dict = pmt::dict_add(dict, pmt::mp("lost_buffers"), pmt::from_uint64(metrics.lost_buffers));
+     dict = pmt::dict_add(dict, pmt::mp("shed_buffers"), pmt::from_uint64(metrics.shed_buffers));
+     dict = pmt::dict_add(dict, pmt::mp("latency_histogram"), histogram);
+     dict = pmt::dict_add(dict, pmt::mp("conversion_ns_per_sample"), pmt::from_double(metrics.conversion_ns_per_sample));
+     dict = pmt::dict_add(dict, pmt::mp("estimated_samp_rate"), pmt::from_double(metrics.estimated_samp_rate));
+     dict = pmt::dict_add(dict, pmt::mp("samp_rate"), pmt::from_double(metrics.samp_rate));
+     dict = pmt::dict_add(dict, pmt::mp("clock_samp_rate"), pmt::from_double(metrics.clock_samp_rate));
+     dict = pmt::dict_add(dict, pmt::mp("timestamp_error_ns"), pmt::from_double(metrics.timestamp_error_ns));
+     dict = pmt::dict_add(dict, pmt::mp("fast_interlocks"), pmt::from_uint64(metrics.fast_interlocks));
+     dict = pmt::dict_add(dict, pmt::mp("fast_interlock_latency_ns"), pmt::from_double(metrics.fast_interlock_latency_ns));
+     dict = pmt::dict_add(dict, pmt::mp("max_fast_interlock_latency_ns"), pmt::from_double(metrics.max_fast_interlock_latency_ns));
+     dict = pmt::dict_add(dict, pmt::mp("driver_buffer_size"), pmt::from_long(metrics.driver_buffer_size));
+     dict = pmt::dict_add(dict, pmt::mp("recommended_buffer_size"), pmt::from_long(metrics.recommended_buffer_size));
+     dict = pmt::dict_add(dict, pmt::mp("max_poll_gap_ns"), pmt::from_double(metrics.max_poll_gap_ns));
+
+     message_port_pub(pmt::mp("metrics"), dict);
+   }
+
+   void
+   digitizer_block_impl::apply_thread_scheduling(const std::vector<int> &cpus, int rt_priority,
+           const std::string &thread)
+   {
+     bool failed = false;
+
+     if (!cpus.empty()) {
+       try {
+         gr::thread::thread_bind_to_processor(cpus);
+       }
+       catch (const std::exception &ex) {
+         GR_LOG_WARN(d_logger, "failed to set CPU affinity of the " + thread + " thread: " + ex.what());
+         failed = true;
+       }
+     }
+
+     if (rt_priority > 0) {
+       sched_param param {};
+       param.sched_priority = rt_priority;
+
+       auto ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+       if (ret != 0) {
+         GR_LOG_WARN(d_logger, "failed to set SCHED_FIFO priority of the " + thread + " thread: "
+                 + std::string(strerror(ret)));
+         failed = true;
+       }
+     }
+
+     if (failed) {
+       add_error_code(digitizer_block_errc::SchedulingFailed);
+       d_scheduling_failed = true;
+     }
+   }
+
+   uint32_t
+   digitizer_block_impl::get_scheduling_status() const
+   {
+     return d_scheduling_failed ? CHANNEL_STATUS_THREAD_SCHEDULING_FAILED : 0;
    }
 
    std::vector<int>
@@ -187,75 +511,192 @@ namespace gr {
      assert(d_trigger_settings.is_analog());
 
      auto aichan = convert_to_aichan_idx(d_trigger_settings.source);
+     float band = d_channel_settings[aichan].range / 100.0;
 
      if (d_trigger_settings.direction == TRIGGER_DIRECTION_RISING
              || d_trigger_settings.direction == TRIGGER_DIRECTION_HIGH) {
+       d_analog_trigger_search.configure(d_trigger_settings.threshold,
+               static_cast<float>(d_trigger_settings.threshold - band), true);
+     }
+     else if (d_trigger_settings.direction == TRIGGER_DIRECTION_FALLING
+             || d_trigger_settings.direction == TRIGGER_DIRECTION_LOW) {
+       d_analog_trigger_search.configure(d_trigger_settings.threshold,
+               static_cast<float>(d_trigger_settings.threshold + band), false);
+     }
+     else {
+       return trigger_offsets;
+     }
 
-       float band = d_channel_settings[aichan].range / 100.0;
-       float lo = static_cast<float>(d_trigger_settings.threshold - band);
+     d_analog_trigger_search.search(samples, nsamples, d_trigger_state, trigger_offsets);
 
-       for(auto i = 0; i < nsamples; i++) {
-         if(!d_trigger_state && samples[i] >= d_trigger_settings.threshold) {
-           d_trigger_state = 1;
-           trigger_offsets.push_back(i);
-         }
-         else if(d_trigger_state && samples[i] <= lo) {
-           d_trigger_state = 0;
-         }
-       }
+     return trigger_offsets;
+   }
+
+   // Converts voltage into ADC counts, rounding towards the given direction (up or down)
+   static int16_t
+   voltage_to_raw(double voltage, const raw_scaling_t &scaling, bool round_up)
+   {
+     auto raw = (voltage - scaling.offset) / scaling.scale;
+     raw = round_up ? std::ceil(raw) : std::floor(raw);
+
+     raw = std::min(raw, static_cast<double>(std::numeric_limits<int16_t>::max()));
+     raw = std::max(raw, static_cast<double>(std::numeric_limits<int16_t>::min()));
+
+     return static_cast<int16_t>(raw);
+   }
+
+   std::vector<int>
+   digitizer_block_impl::find_analog_triggers(int16_t const * const samples, int nsamples,
+           const raw_scaling_t &scaling)
+   {
+     std::vector<int> trigger_offsets; // relative offset of detected triggers
+
+     assert(nsamples >= 0);
+
+     if (!d_trigger_settings.is_enabled() || nsamples == 0) {
+       return trigger_offsets;
+     }
+
+     assert(d_trigger_settings.is_analog());
+     assert(scaling.scale > 0.0);
+
+     auto aichan = convert_to_aichan_idx(d_trigger_settings.source);
+     float band = d_channel_settings[aichan].range / 100.0;
+
+     // Conditions on voltage (x >= threshold, x <= rearm) converted to conditions on raw samples
+     if (d_trigger_settings.direction == TRIGGER_DIRECTION_RISING
+             || d_trigger_settings.direction == TRIGGER_DIRECTION_HIGH) {
+       d_raw_trigger_search.configure(
+               voltage_to_raw(d_trigger_settings.threshold, scaling, true),
+               voltage_to_raw(d_trigger_settings.threshold - band, scaling, false), true);
      }
      else if (d_trigger_settings.direction == TRIGGER_DIRECTION_FALLING
              || d_trigger_settings.direction == TRIGGER_DIRECTION_LOW) {
+       d_raw_trigger_search.configure(
+               voltage_to_raw(d_trigger_settings.threshold, scaling, false),
+               voltage_to_raw(d_trigger_settings.threshold + band, scaling, true), false);
+     }
+     else {
+       return trigger_offsets;
+     }
 
-       float band = d_channel_settings[aichan].range / 100.0;
-       float hi = static_cast<float>(d_trigger_settings.threshold + band);
+     d_raw_trigger_search.search(samples, nsamples, d_trigger_state, trigger_offsets);
 
-       for(auto i = 0; i < nsamples; i++) {
-         if(d_trigger_state && samples[i] <= d_trigger_settings.threshold) {
-           d_trigger_state = 0;
-           trigger_offsets.push_back(i);
-         }
-         else if(!d_trigger_state && samples[i] >= hi) {
-           d_trigger_state = 1;
+     return trigger_offsets;
+   }
+
+   // Samples are scanned in blocks, the OR and AND over a block (vectorized by the compiler)
+   // tell whether the pin stays at the current state, only blocks holding an edge are walked
+   template <typename T>
+   static void
+   search_digital_edges(T const * const samples, int nsamples, T mask, bool rising,
+           int &state, std::vector<int> &trigger_offsets)
+   {
+     const int block_size = 64;
+
+     for (auto begin = 0; begin < nsamples; begin += block_size) {
+       const auto end = std::min(begin + block_size, nsamples);
+
+       T any = 0;
+       T all = mask;
+       for (auto i = begin; i < end; i++) {
+         any |= samples[i];
+         all &= samples[i];
+       }
+
+       if (state ? (all & mask) != 0 : (any & mask) == 0) {
+         continue;
+       }
+
+       for (auto i = begin; i < end; i++) {
+         const int high = (samples[i] & mask) ? 1 : 0;
+         if (high != state) {
+           state = high;
+           if (high == static_cast<int>(rising)) {
+             trigger_offsets.push_back(i);
+           }
          }
        }
      }
+   }
+
+   template <typename T>
+   static std::vector<int>
+   find_digital_edges(T const * const samples, int nsamples, T mask, trigger_direction_t direction,
+           int &state)
+   {
+     std::vector<int> trigger_offsets;
+
+     if (direction == TRIGGER_DIRECTION_RISING || direction == TRIGGER_DIRECTION_HIGH) {
+       search_digital_edges(samples, nsamples, mask, true, state, trigger_offsets);
+     }
+     else if (direction == TRIGGER_DIRECTION_FALLING || direction == TRIGGER_DIRECTION_LOW) {
+       search_digital_edges(samples, nsamples, mask, false, state, trigger_offsets);
+     }
 
      return trigger_offsets;
    }
 
    std::vector<int>
    digitizer_block_impl::find_digital_triggers(uint8_t const * const samples, int nsamples, uint8_t mask)
+   {
+     return find_digital_edges(samples, nsamples, mask, d_trigger_settings.direction, d_trigger_state);
+   }
+
+   std::vector<int>
+   digitizer_block_impl::find_digital_triggers(uint16_t const * const samples, int nsamples, uint16_t mask)
+   {
+     return find_digital_edges(samples, nsamples, mask, d_trigger_settings.direction, d_trigger_state);
+   }
+
+   std::vector<int>
+   digitizer_block_impl::find_digital_triggers(uint32_t const * const samples, int nsamples, uint32_t mask)
+   {
+     return find_digital_edges(samples, nsamples, mask, d_trigger_settings.direction, d_trigger_state);
+   }
+
+   std::vector<int>
+   digitizer_block_impl::find_condition_triggers(gr_vector_void_star &output_items, int nsamples)
    {
      std::vector<int> trigger_offsets;
 
-     if (d_trigger_settings.direction == TRIGGER_DIRECTION_RISING
-            || d_trigger_settings.direction == TRIGGER_DIRECTION_HIGH) {
+     // Minimum pulse width in (downsampled) samples
+     auto min_width = static_cast<uint32_t>(std::round(d_trigger_pulse_width
+             * d_actual_samp_rate / d_downsampling_factor));
 
-       for(auto i = 0; i < nsamples; i++) {
-         if(!d_trigger_state && (samples[i] & mask)) {
-           d_trigger_state = 1;
-           trigger_offsets.push_back(i);
-         }
-         else if(d_trigger_state && !(samples[i] & mask)) {
-           d_trigger_state = 0;
+     d_condition_trigger_search.configure(d_trigger_logic == TRIGGER_LOGIC_AND, min_width);
+     d_condition_trigger_search.begin(nsamples);
+
+     for (const auto &c : d_trigger_conditions) {
+       // output index of the channel values, note the channel is verified to be enabled
+       auto output_idx = 0;
+       for (int i = 0; i < c.aichan; i++) {
+         if (d_channel_settings[i].enabled) {
+           output_idx += get_outputs_per_channel();
          }
        }
-     }
-     else if (d_trigger_settings.direction == TRIGGER_DIRECTION_FALLING
-             || d_trigger_settings.direction == TRIGGER_DIRECTION_LOW) {
 
-       for(auto i = 0; i < nsamples; i++) {
-         if(d_trigger_state && !(samples[i] & mask)) {
-           d_trigger_state = 0;
-           trigger_offsets.push_back(i);
-         }
-         else if(!d_trigger_state && (samples[i] & mask)) {
-           d_trigger_state = 1;
-         }
+       auto condition = static_cast<condition_trigger_search_t::condition_t>(c.condition);
+
+       if (d_raw_output) {
+         // Thresholds converted into ADC counts such that the conditions on raw samples are
+         // equivalent to the ones on voltages, only the below condition needs rounding down
+         const auto scaling = driver_get_raw_scaling(c.aichan);
+         const bool lower_up = c.condition != TRIGGER_CONDITION_BELOW;
+
+         auto raw = static_cast<int16_t const *>(output_items[output_idx]);
+         d_condition_trigger_search.add_condition(raw, condition,
+                 voltage_to_raw(c.lower, scaling, lower_up),
+                 voltage_to_raw(c.upper, scaling, false));
+       }
+       else {
+         auto values = static_cast<float const *>(output_items[output_idx]);
+         d_condition_trigger_search.add_condition(values, condition, c.lower, c.upper);
        }
      }
 
+     d_condition_trigger_search.search(trigger_offsets);
+
      return trigger_offsets;
    }
 
@@ -289,6 +730,8 @@ namespace gr {
      d_post_samples = static_cast<uint32_t>(post_samples);
      d_pre_samples = static_cast<uint32_t>(pre_samples);
      d_buffer_size = d_post_samples + d_pre_samples;
+
+     update_output_multiple();
    }
 
    void
@@ -323,7 +766,22 @@ namespace gr {
 
      d_buffer_size = static_cast<uint32_t>(buffer_size);
 
-     set_output_multiple(buffer_size);
+     update_output_multiple();
+   }
+
+   void
+   digitizer_block_impl::update_output_multiple()
+   {
+     if (d_frame_layout.samples) {
+       set_output_multiple(std::max<int>(1, d_buffer_size / d_frame_layout.samples));
+     }
+     else if (d_triggered_windows) {
+       // whole windows are delivered
+       set_output_multiple(std::max<uint32_t>(1, get_block_size_with_downsampling()));
+     }
+     else {
+       set_output_multiple(d_buffer_size);
+     }
    }
 
    void
@@ -340,130 +798,663 @@ namespace gr {
    }
 
    void
-   digitizer_block_impl::set_driver_buffer_size(int driver_buffer_size)
+   digitizer_block_impl::set_buffer_memory_budget(size_t max_bytes)
    {
-     if (driver_buffer_size < 1)
-     {
-       std::ostringstream message;
-       message << "Exception in " << __FILE__ << ":" << __LINE__ << ": driver buffer size can't be a negative number:" << driver_buffer_size;
-       throw std::invalid_argument(message.str());
-     }
+     d_buffer_memory_budget = max_bytes;
+   }
 
-     d_driver_buffer_size = static_cast<uint32_t>(driver_buffer_size);
+   size_t
+   digitizer_block_impl::get_nr_allocated_buffers()
+   {
+     return d_app_buffer.get_nr_allocated_chunks();
    }
 
-   void
-   digitizer_block_impl::set_auto_arm(bool auto_arm)
+   size_t
+   digitizer_block_impl::get_buffers_high_water_mark()
    {
-     d_auto_arm = auto_arm;
+     return d_app_buffer.get_high_water_mark();
    }
 
-   void
-   digitizer_block_impl::set_trigger_once(bool once)
+   app_buffer_t &
+   digitizer_block_impl::get_app_buffer()
    {
-     d_trigger_once = once;
+     return d_app_buffer;
+   }
+
+   digitizer_metrics_t
+   digitizer_block_impl::get_metrics()
+   {
+     digitizer_metrics_t metrics{};
+
+     metrics.free_buffers = static_cast<uint32_t>(d_app_buffer.get_nr_free_chunks());
+     metrics.full_buffers = static_cast<uint32_t>(d_app_buffer.get_nr_full_chunks());
+     metrics.min_free_buffers = static_cast<uint32_t>(d_app_buffer.take_min_free_chunks());
+     metrics.lost_buffers = d_metrics_lost_buffers.load(std::memory_order_relaxed);
+     metrics.shed_buffers = d_app_buffer.get_nr_shed_chunks();
+
+     metrics.latency_histogram.reserve(d_metrics_latency_histogram.size());
+     for (const auto &bucket : d_metrics_latency_histogram) {
+       metrics.latency_histogram.push_back(bucket.load(std::memory_order_relaxed));
+     }
+
+     // Note, the two counters are not read atomically, good enough for an average
+     auto conversion_ns = d_metrics_conversion_ns.exchange(0, std::memory_order_relaxed);
+     auto conversion_samples = d_metrics_conversion_samples.exchange(0, std::memory_order_relaxed);
+     metrics.conversion_ns_per_sample = conversion_samples
+             ? static_cast<double>(conversion_ns) / conversion_samples : 0.0;
+
+     metrics.estimated_samp_rate = d_metrics_estimated_samp_rate.load(std::memory_order_relaxed);
+     metrics.samp_rate = get_samp_rate();
+     metrics.clock_samp_rate = d_metrics_clock_samp_rate.load(std::memory_order_relaxed);
+     metrics.timestamp_error_ns = d_metrics_timestamp_error_ns.load(std::memory_order_relaxed);
+     metrics.fast_interlocks = d_metrics_fast_interlocks.load(std::memory_order_relaxed);
+     metrics.fast_interlock_latency_ns = d_metrics_fast_interlock_latency_ns.load(std::memory_order_relaxed);
+     metrics.max_fast_interlock_latency_ns = d_metrics_max_fast_interlock_latency_ns.load(std::memory_order_relaxed);
+     metrics.driver_buffer_size = d_metrics_driver_buffer_size.load(std::memory_order_relaxed);
+     metrics.recommended_buffer_size = d_metrics_recommended_buffer_size.load(std::memory_order_relaxed);
+     metrics.max_poll_gap_ns = d_metrics_max_poll_gap_ns.load(std::memory_order_relaxed);
+
+     return metrics;
    }
 
-   // Poll rate is in seconds
    void
-   digitizer_block_impl::set_streaming(double poll_rate)
+   digitizer_block_impl::set_metrics_interval(double interval)
    {
-     if (poll_rate < 0.0)
+     if (interval < 0.0)
      {
        std::ostringstream message;
-       message << "Exception in " << __FILE__ << ":" << __LINE__ << ": poll rate can't be negative:" << poll_rate;
+       message << "Exception in " << __FILE__ << ":" << __LINE__ << ": metrics interval can't be a negative number:" << interval;
        throw std::invalid_argument(message.str());
      }
 
-     d_acquisition_mode = acquisition_mode_t::STREAMING;
-     d_poll_rate = poll_rate;
-
-     // just in case
-     d_nr_captures = 1;
+     d_metrics_interval = interval;
    }
 
    void
-   digitizer_block_impl::set_rapid_block(int nr_captures)
+   digitizer_block_impl::set_trace_interval(int chunks)
    {
-     if (nr_captures < 1)
+     if (chunks < 0)
      {
        std::ostringstream message;
-       message << "Exception in " << __FILE__ << ":" << __LINE__ << ": nr waveforms should be at least one" << nr_captures;
+       message << "Exception in " << __FILE__ << ":" << __LINE__ << ": trace interval can't be a negative number:" << chunks;
        throw std::invalid_argument(message.str());
      }
 
-     d_acquisition_mode = acquisition_mode_t::RAPID_BLOCK;
-     d_nr_captures = static_cast<uint32_t>(nr_captures);
+     // Blocks look for trace tags as long as there is a tracing digitizer
+     if (d_trace_interval == 0 && chunks > 0) {
+       trace_registry_t::sources().fetch_add(1);
+     }
+     else if (d_trace_interval > 0 && chunks == 0) {
+       trace_registry_t::sources().fetch_sub(1);
+     }
+
+     d_trace_interval = chunks;
+     d_trace_chunk_count = 0;
    }
 
    void
-   digitizer_block_impl::set_downsampling(downsampling_mode_t mode, int downsample_factor)
+   digitizer_block_impl::set_acq_info_anchor_interval(int chunks)
    {
-     if (mode == downsampling_mode_t::DOWNSAMPLING_MODE_NONE) {
-         downsample_factor = 1;
-     }
-     else if (downsample_factor < 2)
+     if (chunks < 0)
      {
        std::ostringstream message;
-       message << "Exception in " << __FILE__ << ":" << __LINE__ << ": downsampling factor should be at least 2: " << downsample_factor;
+       message << "Exception in " << __FILE__ << ":" << __LINE__ << ": acq_info anchor interval can't be a negative number:" << chunks;
        throw std::invalid_argument(message.str());
      }
 
-     d_downsampling_mode = mode;
-     d_downsampling_factor = static_cast<uint32_t>(downsample_factor);
+     d_acq_info_anchor_interval = chunks;
+     d_acq_info_chunk_count = 0;
    }
 
-   int
-   digitizer_block_impl::convert_to_aichan_idx(const std::string &id) const
+   void
+   digitizer_block_impl::set_timing_realignment(bool enabled, float triggerstamp_matching_tolerance,
+           float max_buffer_time)
    {
-     if (id.length() != 1)
+     if (triggerstamp_matching_tolerance < 0.0f || max_buffer_time < 0.0f)
      {
        std::ostringstream message;
-       message << "Exception in " << __FILE__ << ":" << __LINE__ << ": aichan id should be a single character: " << id;
+       message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid realignment tolerance or buffer time: "
+               << triggerstamp_matching_tolerance << ", " << max_buffer_time;
        throw std::invalid_argument(message.str());
      }
 
-     int idx = std::toupper(id[0]) - 'A';
-     if (idx < 0 || idx > MAX_SUPPORTED_AI_CHANNELS)
+     d_realigner.set_tolerance(static_cast<int64_t>(triggerstamp_matching_tolerance * 1000000000.0));
+     d_realigner.set_max_buffer_time(static_cast<int64_t>(max_buffer_time * 1000000000.0));
+     d_timing_realignment = enabled;
+   }
+
+   bool
+   digitizer_block_impl::add_timing_event(const std::string &event_id, int64_t wr_trigger_stamp,
+           int64_t wr_trigger_stamp_utc)
+   {
+     wr_event_t event;
+     event.event_id = event_id;
+     event.wr_trigger_stamp = wr_trigger_stamp;
+     event.wr_trigger_stamp_utc = wr_trigger_stamp_utc;
+     return d_realigner.add_event(event);
+   }
+
+   void
+   digitizer_block_impl::set_driver_buffer_size(int driver_buffer_size)
+   {
+     if (driver_buffer_size < 1)
      {
        std::ostringstream message;
-       message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid aichan id: " << id;
+       message << "Exception in " << __FILE__ << ":" << __LINE__ << ": driver buffer size can't be a negative number:" << driver_buffer_size;
        throw std::invalid_argument(message.str());
      }
 
-     return idx;
+     d_driver_buffer_size = static_cast<uint32_t>(driver_buffer_size);
    }
 
    void
-   digitizer_block_impl::set_aichan(const std::string &id, bool enabled, double range, coupling_t coupling, double range_offset)
+   digitizer_block_impl::set_auto_buffer_tuning(double latency_target)
    {
-     auto idx = convert_to_aichan_idx(id);
-     d_channel_settings[idx].range = range;
-     d_channel_settings[idx].offset = range_offset;
-     d_channel_settings[idx].enabled = enabled;
-     d_channel_settings[idx].coupling = coupling;
+     if (latency_target < 0.0)
+     {
+       std::ostringstream message;
+       message << "Exception in " << __FILE__ << ":" << __LINE__ << ": latency target can't be negative:" << latency_target;
+       throw std::invalid_argument(message.str());
+     }
+
+     d_buffer_latency_target = latency_target;
    }
 
-   int
-   digitizer_block_impl::get_enabled_aichan_count() const
+   void
+   digitizer_block_impl::set_zero_copy(bool enabled)
    {
-     auto count = 0;
-     for (const auto &c : d_channel_settings) {
-       count += c.enabled;
-     }
-     return count;
+     d_zero_copy = enabled;
    }
 
    void
-   digitizer_block_impl::set_aichan_range(const std::string &id, double range, double range_offset)
+   digitizer_block_impl::set_wait_strategy(int spin_iterations, int yield_iterations)
    {
-     auto idx = convert_to_aichan_idx(id);
-     d_channel_settings[idx].range = range;
-     d_channel_settings[idx].offset = range_offset;
+     if (spin_iterations < 0 || yield_iterations < 0)
+     {
+       std::ostringstream message;
+       message << "Exception in " << __FILE__ << ":" << __LINE__ << ": number of wait iterations can't be negative: "
+               << spin_iterations << ", " << yield_iterations;
+       throw std::invalid_argument(message.str());
+     }
+
+     d_spin_iterations = spin_iterations;
+     d_yield_iterations = yield_iterations;
    }
 
    void
-   digitizer_block_impl::set_aichan_trigger(const std::string &id, trigger_direction_t direction, double threshold)
+   digitizer_block_impl::set_trigger_reserve(int nr_buffers)
+   {
+     if (nr_buffers < 0)
+     {
+       std::ostringstream message;
+       message << "Exception in " << __FILE__ << ":" << __LINE__ << ": trigger reserve can't be negative: "
+               << nr_buffers;
+       throw std::invalid_argument(message.str());
+     }
+
+     d_trigger_reserve = static_cast<uint32_t>(nr_buffers);
+   }
+
+   void
+   digitizer_block_impl::set_conversion_threads(int nr_threads)
+   {
+     if (nr_threads < 0)
+     {
+       std::ostringstream message;
+       message << "Exception in " << __FILE__ << ":" << __LINE__ << ": number of conversion threads can't be negative: "
+               << nr_threads;
+       throw std::invalid_argument(message.str());
+     }
+
+     d_conversion_threads = nr_threads;
+   }
+
+   void
+   digitizer_block_impl::set_buffer_memory_policy(bool huge_pages, int numa_node)
+   {
+     if (numa_node < -1)
+     {
+       std::ostringstream message;
+       message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid NUMA node: " << numa_node;
+       throw std::invalid_argument(message.str());
+     }
+
+     d_buffer_huge_pages = huge_pages;
+     d_buffer_numa_node = numa_node;
+   }
+
+   void
+   digitizer_block_impl::set_realtime_memory(bool enabled)
+   {
+     d_realtime_memory = enabled;
+   }
+
+   size_t
+   digitizer_block_impl::get_locked_memory()
+   {
+     return d_app_buffer.get_locked_bytes() + d_readout_buffer.get_locked_bytes() + driver_locked_memory()
+             + d_scratch_locked_bytes.load() + d_output_locked_bytes.load();
+   }
+
+   static void
+   validate_thread_scheduling(const std::vector<int> &cpus, int rt_priority)
+   {
+     for (auto cpu : cpus) {
+       if (cpu < 0) {
+         std::ostringstream message;
+         message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid CPU index: " << cpu;
+         throw std::invalid_argument(message.str());
+       }
+     }
+
+     if (rt_priority < 0 || rt_priority > sched_get_priority_max(SCHED_FIFO))
+     {
+       std::ostringstream message;
+       message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid real-time priority: " << rt_priority;
+       throw std::invalid_argument(message.str());
+     }
+   }
+
+   void
+   digitizer_block_impl::set_poller_scheduling(const std::vector<int> &cpus, int rt_priority)
+   {
+     validate_thread_scheduling(cpus, rt_priority);
+
+     d_poller_cpus = cpus;
+     d_poller_rt_priority = rt_priority;
+   }
+
+   void
+   digitizer_block_impl::set_work_thread_scheduling(const std::vector<int> &cpus, int rt_priority)
+   {
+     validate_thread_scheduling(cpus, rt_priority);
+
+     d_work_thread_cpus = cpus;
+     d_work_thread_rt_priority = rt_priority;
+     d_work_thread_scheduling_applied = false;
+   }
+
+   void
+   digitizer_block_impl::set_fast_interlock(const std::string &id, double min, double max)
+   {
+     if (std::isnan(min) || std::isnan(max) || min >= max)
+     {
+       std::ostringstream message;
+       message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid interlock bounds: "
+               << min << ", " << max;
+       throw std::invalid_argument(message.str());
+     }
+
+     auto idx = convert_to_aichan_idx(id);
+     d_channel_settings[idx].interlock_min = static_cast<float>(min);
+     d_channel_settings[idx].interlock_max = static_cast<float>(max);
+     publish_config();
+   }
+
+   void
+   digitizer_block_impl::set_fast_interlock_callback(interlock_cb_t callback, void *ptr)
+   {
+     d_fast_interlock_callback = callback;
+     d_fast_interlock_user_data = ptr;
+   }
+
+   void
+   digitizer_block_impl::set_fast_interlock_latency_budget(int samples)
+   {
+     if (samples < 0)
+     {
+       std::ostringstream message;
+       message << "Exception in " << __FILE__ << ":" << __LINE__ << ": latency budget can't be a negative number: "
+               << samples;
+       throw std::invalid_argument(message.str());
+     }
+
+     d_fast_interlock_budget = static_cast<uint32_t>(samples);
+   }
+
+   void
+   digitizer_block_impl::set_auto_arm(bool auto_arm)
+   {
+     d_auto_arm = auto_arm;
+   }
+
+   void
+   digitizer_block_impl::set_trigger_once(bool once)
+   {
+     d_trigger_once = once;
+   }
+
+   // Poll rate is in seconds
+   void
+   digitizer_block_impl::set_streaming(double poll_rate, bool adaptive)
+   {
+     if (poll_rate < 0.0)
+     {
+       std::ostringstream message;
+       message << "Exception in " << __FILE__ << ":" << __LINE__ << ": poll rate can't be negative:" << poll_rate;
+       throw std::invalid_argument(message.str());
+     }
+
+     d_acquisition_mode = acquisition_mode_t::STREAMING;
+     d_poll_rate = poll_rate;
+     d_adaptive_polling = adaptive;
+
+     // just in case
+     d_nr_captures = 1;
+   }
+
+   void
+   digitizer_block_impl::set_device_group(const std::string &group, double timestamp_offset)
+   {
+     d_device_group_name = group;
+     d_device_group_offset_ns = static_cast<int64_t>(timestamp_offset * 1000000000.0);
+   }
+
+   void
+   digitizer_block_impl::set_tag_encoding(tag_encoding_t encoding)
+   {
+     d_tag_builder.set_encoding(encoding);
+   }
+
+   void
+   digitizer_block_impl::set_rapid_block(int nr_captures)
+   {
+     if (nr_captures < 1)
+     {
+       std::ostringstream message;
+       message << "Exception in " << __FILE__ << ":" << __LINE__ << ": nr waveforms should be at least one" << nr_captures;
+       throw std::invalid_argument(message.str());
+     }
+
+     d_acquisition_mode = acquisition_mode_t::RAPID_BLOCK;
+     d_nr_captures = static_cast<uint32_t>(nr_captures);
+   }
+
+   void
+   digitizer_block_impl::set_bulk_readout(bool enabled)
+   {
+     d_bulk_readout = enabled;
+   }
+
+   void
+   digitizer_block_impl::set_overlapped_readout(bool enabled)
+   {
+     d_overlapped_readout = enabled;
+   }
+
+   void
+   digitizer_block_impl::set_async_readout(bool enabled)
+   {
+     d_async_readout = enabled;
+   }
+
+   uint32_t
+   digitizer_block_impl::get_nr_memory_segments() const
+   {
+     if (d_overlapped_readout && d_acquisition_mode == acquisition_mode_t::RAPID_BLOCK) {
+       return 2 * d_nr_captures;
+     }
+
+     return d_nr_captures;
+   }
+
+   uint32_t
+   digitizer_block_impl::get_capture_segment() const
+   {
+     return d_capture_segment;
+   }
+
+   void
+   digitizer_block_impl::set_downsampling(downsampling_mode_t mode, int downsample_factor)
+   {
+     if (mode == downsampling_mode_t::DOWNSAMPLING_MODE_NONE) {
+         downsample_factor = 1;
+     }
+     else if (downsample_factor < 2)
+     {
+       std::ostringstream message;
+       message << "Exception in " << __FILE__ << ":" << __LINE__ << ": downsampling factor should be at least 2: " << downsample_factor;
+       throw std::invalid_argument(message.str());
+     }
+
+     d_downsampling_mode = mode;
+     d_downsampling_factor = static_cast<uint32_t>(downsample_factor);
+   }
+
+   downsampling_mode_t
+   digitizer_block_impl::get_downsampling_mode()
+   {
+     return d_downsampling_mode;
+   }
+
+   int
+   digitizer_block_impl::get_downsampling_factor()
+   {
+     return static_cast<int>(d_downsampling_factor);
+   }
+
+   void
+   digitizer_block_impl::set_aggregated_output(downsampling_mode_t mode, int factor)
+   {
+     if (mode == downsampling_mode_t::DOWNSAMPLING_MODE_NONE) {
+       d_aggregated_source.reset();
+       return;
+     }
+
+     if (d_raw_output) {
+       std::ostringstream message;
+       message << "Exception in " << __FILE__ << ":" << __LINE__ << ": aggregated output not available in raw output mode";
+       throw std::invalid_argument(message.str());
+     }
+
+     d_aggregated_source = gnuradio::get_initial_sptr(
+             new aggregated_source_impl(d_ai_channels, mode, factor, 65536));
+   }
+
+   aggregated_source::sptr
+   digitizer_block_impl::get_aggregated_source()
+   {
+     return d_aggregated_source;
+   }
+
+   void
+   digitizer_block_impl::set_frame_output(int frame_samples)
+   {
+     if (frame_samples < 0)
+     {
+       std::ostringstream message;
+       message << "Exception in " << __FILE__ << ":" << __LINE__ << ": frame samples can't be negative: " << frame_samples;
+       throw std::invalid_argument(message.str());
+     }
+
+     if (frame_samples && d_raw_output) {
+       std::ostringstream message;
+       message << "Exception in " << __FILE__ << ":" << __LINE__ << ": frame output not available in raw output mode";
+       throw std::invalid_argument(message.str());
+     }
+
+     d_frame_layout = frame_layout_t(d_ai_channels, d_ports, frame_samples);
+     update_output_signature();
+   }
+
+   frame_layout_t
+   digitizer_block_impl::get_frame_layout()
+   {
+     return d_frame_layout;
+   }
+
+   void
+   digitizer_block_impl::set_triggered_windows(bool enabled)
+   {
+     if (enabled && d_raw_output) {
+       std::ostringstream message;
+       message << "Exception in " << __FILE__ << ":" << __LINE__ << ": triggered windows not available in raw output mode";
+       throw std::invalid_argument(message.str());
+     }
+
+     d_triggered_windows = enabled;
+
+     update_output_multiple();
+   }
+
+   void
+   digitizer_block_impl::set_packed_ports(bool enabled)
+   {
+     if (enabled && (d_ports < 1 || d_ports > 4)) {
+       std::ostringstream message;
+       message << "Exception in " << __FILE__ << ":" << __LINE__ << ": ports can't be packed on a device with "
+               << d_ports << " ports";
+       throw std::invalid_argument(message.str());
+     }
+
+     d_packed_port_size = !enabled ? 0 : d_ports <= 2 ? sizeof(uint16_t) : sizeof(uint32_t);
+     update_output_signature();
+   }
+
+   size_t
+   digitizer_block_impl::get_packed_port_size()
+   {
+     return d_packed_port_size;
+   }
+
+   void
+   digitizer_block_impl::update_output_signature()
+   {
+     // The per-channel signature is the one set up by the driver
+     if (!d_channel_output_signature) {
+       d_channel_output_signature = output_signature();
+     }
+
+     if (d_frame_layout.samples) {
+       set_output_signature(gr::io_signature::make(1, 1, d_frame_layout.frame_size()));
+     }
+     else if (d_packed_port_size) {
+       auto sizes = d_channel_output_signature->sizeof_stream_items();
+       sizes.resize(sizes.size() - d_ports);
+       sizes.push_back(static_cast<int>(d_packed_port_size));
+       const auto nr_outputs = static_cast<int>(sizes.size());
+       set_output_signature(gr::io_signature::makev(
+               std::min(d_channel_output_signature->min_streams(), nr_outputs), nr_outputs, sizes));
+     }
+     else {
+       set_output_signature(d_channel_output_signature);
+     }
+
+     update_output_multiple();
+   }
+
+   int
+   digitizer_block_impl::get_port_outputs() const
+   {
+     if (d_packed_port_size) {
+       return 1;
+     }
+
+     return static_cast<int>(std::count_if(d_port_settings.begin(), d_port_settings.begin() + d_ports,
+             [](const port_setting_t &port) { return port.enabled; }));
+   }
+
+   // Ports are OR-ed in one at a time, i.e. each pass is a plain loop over the samples
+   template <typename T>
+   static void
+   pack_port_words(const std::vector<uint8_t *> &ports, const std::vector<int> &shifts, T *output, int nsamples)
+   {
+     std::fill(output, output + nsamples, T(0));
+
+     for (size_t p = 0; p < ports.size(); p++) {
+       const uint8_t *port = ports[p];
+       const int shift = shifts[p];
+       for (auto i = 0; i < nsamples; i++) {
+         output[i] |= static_cast<T>(static_cast<T>(port[i]) << shift);
+       }
+     }
+   }
+
+   void
+   digitizer_block_impl::pack_ports(void *output, int nsamples)
+   {
+     if (d_packed_port_size == sizeof(uint16_t)) {
+       pack_port_words(d_packed_port_buffers, d_packed_port_shifts, static_cast<uint16_t *>(output), nsamples);
+     }
+     else {
+       pack_port_words(d_packed_port_buffers, d_packed_port_shifts, static_cast<uint32_t *>(output), nsamples);
+     }
+   }
+
+   int
+   digitizer_block_impl::get_outputs_per_channel() const
+   {
+     return d_raw_output ? 1 : 2;
+   }
+
+   int
+   digitizer_block_impl::convert_to_aichan_idx(const std::string &id) const
+   {
+     if (id.length() != 1)
+     {
+       std::ostringstream message;
+       message << "Exception in " << __FILE__ << ":" << __LINE__ << ": aichan id should be a single character: " << id;
+       throw std::invalid_argument(message.str());
+     }
+
+     int idx = std::toupper(id[0]) - 'A';
+     if (idx < 0 || idx > MAX_SUPPORTED_AI_CHANNELS)
+     {
+       std::ostringstream message;
+       message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid aichan id: " << id;
+       throw std::invalid_argument(message.str());
+     }
+
+     return idx;
+   }
+
+   void
+   digitizer_block_impl::set_aichan(const std::string &id, bool enabled, double range, coupling_t coupling, double range_offset)
+   {
+     auto idx = convert_to_aichan_idx(id);
+     d_channel_settings[idx].range = range;
+     d_channel_settings[idx].offset = range_offset;
+     d_channel_settings[idx].enabled = enabled;
+     d_channel_settings[idx].coupling = coupling;
+   }
+
+   int
+   digitizer_block_impl::get_enabled_aichan_count() const
+   {
+     auto count = 0;
+     for (const auto &c : d_channel_settings) {
+       count += c.enabled;
+     }
+     return count;
+   }
+
+   void
+   digitizer_block_impl::set_aichan_range(const std::string &id, double range, double range_offset)
+   {
+     auto idx = convert_to_aichan_idx(id);
+     d_channel_settings[idx].range = range;
+     d_channel_settings[idx].offset = range_offset;
+   }
+
+   void
+   digitizer_block_impl::set_aichan_calibration(const std::string &id, double scale, double offset)
+   {
+     if (!std::isfinite(scale) || scale <= 0.0 || !std::isfinite(offset))
+     {
+       std::ostringstream message;
+       message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid calibration: "
+               << scale << ", " << offset;
+       throw std::invalid_argument(message.str());
+     }
+
+     auto idx = convert_to_aichan_idx(id);
+     d_channel_settings[idx].calibration_scale = static_cast<float>(scale);
+     d_channel_settings[idx].calibration_offset = static_cast<float>(offset);
+     publish_config();
+   }
+
+   void
+   digitizer_block_impl::set_aichan_trigger(const std::string &id, trigger_direction_t direction, double threshold)
    {
      convert_to_aichan_idx(id); // Just to verify id
 
@@ -526,6 +1517,51 @@ namespace gr {
    digitizer_block_impl::disable_triggers()
    {
      d_trigger_settings.source = TRIGGER_NONE_SOURCE;
+     d_trigger_conditions.clear();
+   }
+
+   void
+   digitizer_block_impl::add_aichan_trigger_condition(const std::string &id,
+           trigger_condition_t condition, double lower, double upper)
+   {
+     auto aichan = convert_to_aichan_idx(id);
+
+     if ((condition == TRIGGER_CONDITION_INSIDE || condition == TRIGGER_CONDITION_OUTSIDE)
+             && upper < lower)
+     {
+       std::ostringstream message;
+       message << "Exception in " << __FILE__ << ":" << __LINE__ << ": upper threshold " << upper
+               << " is below lower threshold " << lower;
+       throw std::invalid_argument(message.str());
+     }
+
+     d_trigger_conditions.push_back(trigger_condition_setting_t{aichan, condition,
+             static_cast<float>(lower), static_cast<float>(upper)});
+   }
+
+   void
+   digitizer_block_impl::clear_trigger_conditions()
+   {
+     d_trigger_conditions.clear();
+   }
+
+   void
+   digitizer_block_impl::set_trigger_logic(trigger_logic_t logic)
+   {
+     d_trigger_logic = logic;
+   }
+
+   void
+   digitizer_block_impl::set_trigger_pulse_width(double min_width)
+   {
+     if (min_width < 0.0)
+     {
+       std::ostringstream message;
+       message << "Exception in " << __FILE__ << ":" << __LINE__ << ": pulse width can't be a negative number:" << min_width;
+       throw std::invalid_argument(message.str());
+     }
+
+     d_trigger_pulse_width = min_width;
    }
 
    void
@@ -563,29 +1599,262 @@ namespace gr {
        throw std::runtime_error(message.str());
      }
 
+     if (d_raw_output && d_acquisition_mode != acquisition_mode_t::STREAMING)
+     {
+       std::ostringstream message;
+       message << "Exception in " << __FILE__ << ":" << __LINE__ << ": raw output is supported in streaming mode only";
+       throw std::invalid_argument(message.str());
+     }
+
+     if (d_raw_output && d_downsampling_mode == downsampling_mode_t::DOWNSAMPLING_MODE_MIN_MAX_AGG)
+     {
+       std::ostringstream message;
+       message << "Exception in " << __FILE__ << ":" << __LINE__ << ": raw output is not supported in MIN_MAX_AGG downsampling mode";
+       throw std::invalid_argument(message.str());
+     }
+
+     if (d_frame_layout.samples && d_acquisition_mode != acquisition_mode_t::STREAMING)
+     {
+       std::ostringstream message;
+       message << "Exception in " << __FILE__ << ":" << __LINE__ << ": frame output is supported in streaming mode only";
+       throw std::invalid_argument(message.str());
+     }
+
+     if (d_triggered_windows && (d_acquisition_mode != acquisition_mode_t::STREAMING
+             || d_frame_layout.samples || d_raw_output))
+     {
+       std::ostringstream message;
+       message << "Exception in " << __FILE__ << ":" << __LINE__ << ": triggered windows are supported in streaming mode only, without frame or raw output";
+       throw std::invalid_argument(message.str());
+     }
+
+     if (d_packed_port_size && (d_acquisition_mode != acquisition_mode_t::STREAMING
+             || d_frame_layout.samples || d_triggered_windows))
+     {
+       std::ostringstream message;
+       message << "Exception in " << __FILE__ << ":" << __LINE__ << ": packed ports are supported in streaming mode only, without frame output or triggered windows";
+       throw std::invalid_argument(message.str());
+     }
+
+     if (d_frame_layout.samples && (d_buffer_size == 0 || d_buffer_size % d_frame_layout.samples))
+     {
+       std::ostringstream message;
+       message << "Exception in " << __FILE__ << ":" << __LINE__ << ": buffer size " << d_buffer_size
+               << " is not a multiple of the frame samples " << d_frame_layout.samples;
+       throw std::invalid_argument(message.str());
+     }
+
+     for (const auto &c : d_trigger_conditions) {
+       if (!d_channel_settings[c.aichan].enabled)
+       {
+         std::ostringstream message;
+         message << "Exception in " << __FILE__ << ":" << __LINE__ << ": trigger condition channel "
+                 << c.aichan << " is not enabled";
+         throw std::invalid_argument(message.str());
+       }
+     }
+
+     // first rapid block acquisition always goes to the beginning of the device memory
+     d_capture_segment = 0;
+     d_rearmed = false;
+
      auto ec = driver_configure();
+     // The device state is unknown if the driver failed half way
+     d_driver_config = ec ? device_config_t{} : get_device_config();
      if (ec) {
        add_error_code(ec);
        std::ostringstream message;
        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": configure failed. ErrorCode: " << ec;
        throw std::runtime_error(message.str());
      }
+     // size application buffer pool, either by count or by memory budget
+     size_t nr_buffers = d_nr_buffers;
+     size_t max_nr_buffers = 0;
+
+     if (d_buffer_memory_budget > 0) {
+       const size_t chunk_size_bytes = d_buffer_size * (get_enabled_diport_count()
+               + get_enabled_aichan_count() * driver_chunk_sample_size());
+
+       max_nr_buffers = chunk_size_bytes ? d_buffer_memory_budget / chunk_size_bytes : nr_buffers;
+       if (max_nr_buffers == 0)
+       {
+         std::ostringstream message;
+         message << "Exception in " << __FILE__ << ":" << __LINE__ << ": memory budget " << d_buffer_memory_budget
+                 << " is too small for a single buffer of " << chunk_size_bytes << " bytes";
+         throw std::invalid_argument(message.str());
+       }
+
+       nr_buffers = std::min(nr_buffers, max_nr_buffers);
+     }
+
+     if (d_trigger_reserve >= std::max(nr_buffers, max_nr_buffers))
+     {
+       std::ostringstream message;
+       message << "Exception in " << __FILE__ << ":" << __LINE__ << ": trigger reserve of " << d_trigger_reserve
+               << " buffers leaves no buffers of a pool of " << std::max(nr_buffers, max_nr_buffers);
+       throw std::invalid_argument(message.str());
+     }
+
      // initialize application buffer
+     d_app_buffer.set_memory_policy(d_buffer_huge_pages, d_buffer_numa_node, d_realtime_memory);
      d_app_buffer.initialize(get_enabled_aichan_count(),
-         get_enabled_diport_count(), d_buffer_size, d_nr_buffers);
+         get_enabled_diport_count(), d_buffer_size, nr_buffers, driver_chunk_sample_size(),
+         max_nr_buffers);
+     reset_metrics();
+
+     if (d_realtime_memory && d_app_buffer.get_locked_bytes() == 0) {
+       GR_LOG_WARN(d_logger, "failed to lock application buffer, see RLIMIT_MEMLOCK");
+     }
+
+     if (d_buffer_huge_pages && !d_app_buffer.is_huge_page_backed()) {
+       GR_LOG_WARN(d_logger, "application buffer is not backed by huge pages");
+     }
+     else if (d_buffer_huge_pages && !d_app_buffer.is_explicit_huge_page_backed()) {
+       GR_LOG_INFO(d_logger, "no explicit huge pages available, application buffer is backed by "
+               "transparent huge pages");
+     }
+
+     if (d_buffer_numa_node >= 0 && !d_app_buffer.is_numa_bound()) {
+       GR_LOG_WARN(d_logger, "failed to bind application buffer to NUMA node "
+               + std::to_string(d_buffer_numa_node)
+               + (chunk_memory_t::numa_node_exists(d_buffer_numa_node) ? "" : ", no such node"));
+     }
+     d_app_buffer.set_wait_strategy(d_spin_iterations, d_yield_iterations);
+     d_app_buffer.set_priority_reserve(d_trigger_reserve);
+
+     if (d_conversion_pool.size() != d_conversion_threads) {
+       d_conversion_pool.start(d_conversion_threads, get_block_name(this), "convert");
+     }
+
+     {
+       boost::mutex::scoped_lock lock(d_config_mutex);
+       d_applied_config = get_device_config();
+     }
+     publish_config();
+     d_metrics_driver_buffer_size.store(d_driver_buffer_size, std::memory_order_relaxed);
    }
 
    void
-   digitizer_block_impl::arm()
+   digitizer_block_impl::configure_priority_tracking()
    {
-     if (d_armed) {
+     d_priority_channel = -1;
+     d_priority_port = -1;
+
+     // Chunks are classified by the basic trigger only
+     if (d_trigger_reserve == 0 || d_acquisition_mode != acquisition_mode_t::STREAMING
+             || !d_trigger_conditions.empty() || !d_trigger_settings.is_enabled()) {
+       d_priority_tracker.disable();
+       return;
+     }
+
+     const auto pre_samples = get_pre_trigger_samples_with_downsampling();
+     const auto post_samples = get_post_trigger_samples_with_downsampling();
+     const bool rising = d_trigger_settings.direction == TRIGGER_DIRECTION_RISING
+             || d_trigger_settings.direction == TRIGGER_DIRECTION_HIGH;
+
+     if (d_trigger_settings.is_digital()) {
+       d_priority_port = d_trigger_settings.pin_number / 8;
+       d_priority_tracker.configure_digital(static_cast<int16_t>(1 << (d_trigger_settings.pin_number % 8)),
+               rising, pre_samples, post_samples);
+       return;
+     }
+
+     // Same thresholds as used by the work thread, see find_analog_triggers
+     const auto aichan = convert_to_aichan_idx(d_trigger_settings.source);
+     const auto scaling = driver_get_raw_scaling(aichan);
+     if (!(scaling.scale > 0.0)) {
+       d_priority_tracker.disable();
        return;
      }
 
-     // set estimated sample rate to expected
-     float expected = static_cast<float>(get_samp_rate());
-     for (auto i=0; i < AVERAGE_HISTORY_LENGTH; i++) {
-       d_estimated_sample_rate.add(expected);
+     const double threshold = d_trigger_settings.threshold;
+     const double band = d_channel_settings[aichan].range / 100.0;
+
+     d_priority_channel = aichan;
+     d_priority_tracker.configure_analog(voltage_to_raw(threshold, scaling, rising),
+             voltage_to_raw(rising ? threshold - band : threshold + band, scaling, !rising),
+             rising, pre_samples, post_samples);
+   }
+
+   bool
+   digitizer_block_impl::is_aichan_applied(int aichan) const
+   {
+     return static_cast<size_t>(aichan) < d_driver_config.channels.size()
+             && d_driver_config.channels[aichan].same_device_settings(d_channel_settings[aichan]);
+   }
+
+   bool
+   digitizer_block_impl::is_diport_applied(int port) const
+   {
+     return static_cast<size_t>(port) < d_driver_config.ports.size()
+             && d_driver_config.ports[port].same_device_settings(d_port_settings[port]);
+   }
+
+   bool
+   digitizer_block_impl::is_trigger_applied() const
+   {
+     if (d_driver_config.channels.empty()
+             || !d_driver_config.trigger.same_device_settings(d_trigger_settings)
+             || d_driver_config.acquisition_mode != d_acquisition_mode) {
+       return false;
+     }
+
+     for (auto i = 0; i < d_ai_channels; i++) {
+       if (!is_aichan_applied(i)) {
+         return false;
+       }
+     }
+
+     return true;
+   }
+
+   void
+   digitizer_block_impl::begin_config()
+   {
+     boost::unique_lock<boost::mutex> lock(d_config_mutex);
+
+     if (d_config_transaction)
+     {
+       std::ostringstream message;
+       message << "Exception in " << __FILE__ << ":" << __LINE__ << ": configuration transaction already started";
+       throw std::runtime_error(message.str());
+     }
+
+     // A reconfiguration in progress completes with the settings it started with
+     d_config_cv.wait(lock, [this] { return !d_config_applying; });
+     d_config_transaction = true;
+   }
+
+   void
+   digitizer_block_impl::commit_config()
+   {
+     bool changed;
+     {
+       boost::mutex::scoped_lock lock(d_config_mutex);
+
+       if (!d_config_transaction)
+       {
+         std::ostringstream message;
+         message << "Exception in " << __FILE__ << ":" << __LINE__ << ": no configuration transaction started";
+         throw std::runtime_error(message.str());
+       }
+
+       d_config_transaction = false;
+       changed = !d_applied_config.same_device_settings(get_device_config());
+     }
+     d_config_cv.notify_all();
+
+     // Rapid block re-arms (and reconfigures) for each acquisition, streaming needs to be told
+     if (changed && d_armed && d_acquisition_mode == acquisition_mode_t::STREAMING) {
+       d_app_buffer.notify_data_ready(digitizer_block_errc::Reconfigure);
+     }
+   }
+
+   void
+   digitizer_block_impl::arm()
+   {
+     if (d_armed) {
+       return;
      }
 
      // arm the driver
@@ -599,7 +1868,31 @@ namespace gr {
 
      d_armed = true;
      d_timebase_published = false;
-     d_was_last_callback_timestamp_taken = false;
+     if (d_aggregated_source) {
+       d_aggregated_source->reset(get_timebase_with_downsampling());
+     }
+     d_raw_scaling_published = false;
+     d_constant_error_published = false;
+     d_condition_trigger_search.reset();
+
+     // Callbacks are executed by the poll thread, polling starts below
+     d_sample_clock.reset(d_time_per_sample_ns * d_downsampling_factor);
+     d_samples_received = 0;
+     configure_priority_tracking();
+
+     // Samples are counted after downsampling, the watchdog is checked after each poll
+     d_poll_scheduler.reset(static_cast<uint64_t>(d_poll_rate * 1e9), get_samp_rate() / d_downsampling_factor,
+             d_driver_buffer_size, d_adaptive_polling, POLL_TARGET_FILL,
+             static_cast<uint64_t>(POLL_MIN_INTERVAL * 1e9), static_cast<uint64_t>(POLL_MAX_INTERVAL * 1e9));
+     const double poll_period = d_poll_scheduler.get_max_interval_ns() / 1e9;
+     const double buffer_period = d_buffer_size * get_timebase_with_downsampling();
+     const double stall_timeout = std::max(WATCHDOG_STALL_POLLS * poll_period, WATCHDOG_STALL_BUFFERS * buffer_period);
+     d_watchdog.reset(watchdog_now_ns(), get_samp_rate() / d_downsampling_factor, WATCHDOG_SAMPLE_RATE_THRESHOLD,
+             static_cast<uint64_t>(stall_timeout * 1e9), static_cast<uint64_t>(WATCHDOG_RATE_WINDOW * stall_timeout * 1e9));
+     d_buffer_tuner.reset(d_acquisition_mode == acquisition_mode_t::STREAMING ? d_buffer_latency_target : 0.0,
+             get_samp_rate() / d_downsampling_factor, d_driver_buffer_size,
+             static_cast<uint64_t>(BUFFER_TUNING_WINDOW * 1e9), watchdog_now_ns());
+     d_fast_interlock_issued.fill(false);
 
      // clear error condition in the application buffer
      d_app_buffer.notify_data_ready(std::error_code {});
@@ -624,7 +1917,83 @@ namespace gr {
      }
      ai_buffers.resize(num_enabled_ai_channels);
      ai_error_buffers.resize(num_enabled_ai_channels);
+     raw_buffers.resize(num_enabled_ai_channels);
      port_buffers.resize(num_enabled_di_ports);
+
+     // Enabled ports are read into the scratch buffer in case of packed ports
+     d_packed_port_buffers.clear();
+     d_packed_port_shifts.clear();
+     if (d_packed_port_size) {
+       d_packed_port_scratch.allocate(num_enabled_di_ports * d_buffer_size, false, -1, d_realtime_memory);
+       for (auto i = 0; i < d_ports; i++) {
+         if (d_port_settings[i].enabled) {
+           d_packed_port_buffers.push_back(d_packed_port_scratch.data()
+                   + d_packed_port_buffers.size() * d_buffer_size);
+           d_packed_port_shifts.push_back(8 * i);
+         }
+       }
+     }
+     else {
+       d_packed_port_scratch.release();
+     }
+
+     // Chunks are read into the scratch buffer in case of frame output, regions of disabled
+     // channels and ports stay zero
+     if (d_frame_layout.samples) {
+       const frame_layout_t chunk_layout(d_ai_channels, d_ports, d_buffer_size);
+       d_frame_scratch.allocate(chunk_layout.frame_size(), false, -1, d_realtime_memory);
+
+       auto scratch = d_frame_scratch.data();
+       d_frame_items.clear();
+       for (auto i = 0; i < d_ai_channels; i++) {
+         d_frame_items.push_back(scratch + chunk_layout.values_offset(i));
+         d_frame_items.push_back(scratch + chunk_layout.errors_offset(i));
+       }
+       for (auto i = 0; i < d_ports; i++) {
+         d_frame_items.push_back(scratch + chunk_layout.port_offset(i));
+       }
+     }
+     else {
+       d_frame_scratch.release();
+     }
+
+     // Chunks are read behind the window history in case of triggered windows, the history
+     // holds pre + post samples, i.e. a window still awaiting its post samples stays within it
+     d_pending_windows.clear();
+     d_window_acquired = 0;
+     if (d_triggered_windows) {
+       const size_t history = get_block_size_with_downsampling();
+
+       d_window_item_sizes.assign(2 * d_ai_channels, sizeof(float));
+       d_window_item_sizes.resize(2 * d_ai_channels + d_ports, sizeof(uint8_t));
+
+       size_t size = 0;
+       for (auto item_size : d_window_item_sizes) {
+         size += (history + d_buffer_size) * item_size;
+       }
+       d_window_memory.allocate(size, false, -1, d_realtime_memory);
+
+       d_window_history.clear();
+       d_window_items.clear();
+       auto buffer = d_window_memory.data();
+       for (auto item_size : d_window_item_sizes) {
+         d_window_history.push_back(buffer);
+         d_window_items.push_back(buffer + history * item_size);
+         buffer += (history + d_buffer_size) * item_size;
+       }
+     }
+     else {
+       d_window_memory.release();
+       d_window_history.clear();
+     }
+
+     // The scratch buffers are written by the work thread right after arm, they are locked
+     // (and zero) when allocated
+     size_t scratch_locked = 0;
+     for (const auto *scratch : {&d_packed_port_scratch, &d_frame_scratch, &d_window_memory}) {
+       scratch_locked += scratch->is_locked() ? scratch->size() : 0;
+     }
+     d_scratch_locked_bytes = scratch_locked;
    }
 
    bool
@@ -653,6 +2022,42 @@ namespace gr {
      d_armed = false;
    }
 
+   void
+   digitizer_block_impl::rearm()
+   {
+     {
+       boost::unique_lock<boost::mutex> lock(d_config_mutex);
+       d_config_cv.wait(lock, [this] { return !d_config_transaction; });
+       d_config_applying = true;
+     }
+
+     try {
+       disarm();
+
+       if (!d_applied_config.same_device_settings(get_device_config())) {
+         configure();
+       }
+
+       arm();
+     }
+     catch (...) {
+       end_config_applying();
+       throw;
+     }
+
+     end_config_applying();
+   }
+
+   void
+   digitizer_block_impl::end_config_applying()
+   {
+     {
+       boost::mutex::scoped_lock lock(d_config_mutex);
+       d_config_applying = false;
+     }
+     d_config_cv.notify_all();
+   }
+
    void
    digitizer_block_impl::close()
    {
@@ -663,12 +2068,14 @@ namespace gr {
      }
      d_closed = true;
      d_initialized = false;
+     // Settings are lost once the device is closed
+     d_driver_config = device_config_t{};
    }
 
    std::vector<error_info_t>
    digitizer_block_impl::get_errors()
    {
-     return d_errors.get();
+     return d_events.get_errors();
    }
 
    std::string
@@ -680,6 +2087,8 @@ namespace gr {
    bool
    digitizer_block_impl::start()
    {
+     d_events.start();
+
      try {
        initialize();
        configure();
@@ -689,13 +2098,32 @@ namespace gr {
        d_data_rdy_errc = std::error_code {};
        d_data_rdy = false;
 
+       // GR creates a new work thread on each start
+       d_work_thread_scheduling_applied = false;
+       d_scheduling_failed = false;
+
+       // The first chunk anchors the acq_info tags
+       d_acq_info_chunk_count = 0;
+       d_realigner.clear_pending();
+       d_config_snapshot.set_online(CONFIG_READER_WORK, true);
+
+       // The output buffers are allocated before the blocks are started
+       d_output_locked_bytes = d_realtime_memory ? lock_output_buffers(*this) : 0;
+
        if (d_acquisition_mode == acquisition_mode_t::STREAMING) {
          start_poll_thread();
        }
+       else if (d_async_readout) {
+         start_readout_thread();
+       }
 
        if(d_auto_arm && d_acquisition_mode == acquisition_mode_t::STREAMING) {
          arm();
        }
+
+       if (d_realtime_memory) {
+         GR_LOG_INFO(d_logger, "locked " + std::to_string(get_locked_memory()) + " bytes into RAM");
+       }
      } catch (const std::exception& ex) {
        d_configure_exception_message = ex.what();
        return false;
@@ -711,9 +2139,13 @@ namespace gr {
    digitizer_block_impl::stop()
    {
      if (!d_initialized) {
+       d_events.stop();
        return true;
      }
 
+     // Re-arms the device otherwise
+     stop_readout_thread();
+
      if (d_armed) {
        // Interrupt waiting function (workaround). From the scheduler point of view this is not
        // needed because it makes sure that the worker thread gets interrupted before the stop
@@ -727,8 +2159,17 @@ namespace gr {
        stop_poll_thread();
      }
 
+     if (d_aggregated_source) {
+       d_aggregated_source->finish();
+     }
+
      d_configure_exception_message = "";
 
+     // The work thread has been stopped by now
+     d_config_snapshot.set_online(CONFIG_READER_WORK, false);
+
+     d_events.stop();
+
      return true;
    }
 
@@ -761,6 +2202,74 @@ namespace gr {
      return d_data_rdy_errc;
    }
 
+   std::error_code
+   digitizer_block_impl::driver_wait_ready(uint64_t timeout_ns)
+   {
+     return std::make_error_code(std::errc::operation_not_supported);
+   }
+
+   std::error_code
+   digitizer_block_impl::driver_prefetch_blocks(size_t length, size_t first_block, size_t nr_blocks)
+   {
+     return std::make_error_code(std::errc::operation_not_supported);
+   }
+
+   std::error_code
+   digitizer_block_impl::driver_get_trigger_offsets(size_t first_segment, size_t nr_segments,
+           std::vector<double> &offsets)
+   {
+     return std::make_error_code(std::errc::operation_not_supported);
+   }
+
+   size_t
+   digitizer_block_impl::driver_locked_memory() const
+   {
+     return 0;
+   }
+
+   size_t
+   digitizer_block_impl::driver_chunk_sample_size() const
+   {
+     if (d_raw_output) {
+       return 2 * sizeof(int16_t); // raw samples
+     }
+
+     return 2 * sizeof(float); // value & error
+   }
+
+   bool
+   digitizer_block_impl::driver_stream_ended() const
+   {
+     return false;
+   }
+
+   void
+   digitizer_block_impl::driver_read_data_chunk(const app_buffer_t::data_chunk_t *chunk,
+           std::vector<float *> &ai_buffers, std::vector<float *> &ai_error_buffers,
+           std::vector<uint8_t *> &port_buffers)
+   {
+     d_app_buffer.copy_data_chunk(chunk, ai_buffers, ai_error_buffers, port_buffers);
+   }
+
+   void
+   digitizer_block_impl::driver_read_raw_data_chunk(const app_buffer_t::data_chunk_t *chunk,
+           std::vector<int16_t *> &raw_buffers, std::vector<uint8_t *> &port_buffers)
+   {
+     d_app_buffer.copy_raw_data_chunk(chunk, raw_buffers, port_buffers);
+   }
+
+   raw_scaling_t
+   digitizer_block_impl::driver_get_raw_scaling(int channel_idx) const
+   {
+     return raw_scaling_t {1.0, 0.0, 0.0};
+   }
+
+   bool
+   digitizer_block_impl::driver_get_constant_error(int channel_idx, float &error) const
+   {
+     return false;
+   }
+
    void digitizer_block_impl::clear_data_ready()
    {
      boost::mutex::scoped_lock lock(d_mutex);
@@ -775,43 +2284,151 @@ namespace gr {
     **********************************************************************/
 
    int
-   digitizer_block_impl::work_rapid_block(int noutput_items, gr_vector_void_star &output_items)
+   digitizer_block_impl::acquire_rapid_block(int &first_segment, bool &prefetched)
    {
-     if (d_bstate.state == rapid_block_state_t::WAITING) {
+     // In case of overlapped readout the device might already be re-armed
+     if (d_auto_arm && !d_rearmed) {
+       try {
+         rearm();
+       }
+       catch (...) {
+         return -1;
+       }
+     }
 
-       if (d_trigger_once &&  d_was_triggered_once) {
+     d_rearmed = false;
+
+     // Wait conditional variable, when waken clear it
+     auto ec = wait_data_ready();
+     clear_data_ready();
+
+     // Stop requested
+     if (ec == digitizer_block_errc::Stopped) {
+       GR_LOG_INFO(d_logger, "stop requested");
+       return -1;
+     }
+     else if (ec) {
+       add_event(EVENT_WAIT_FAILED, ec);
+       return 0;
+     }
+
+     // Waveforms of this acquisition start at the capture segment
+     first_segment = d_capture_segment;
+
+     // Re-arm into the other half of the device memory before reading out
+     if (d_overlapped_readout && d_auto_arm && !d_trigger_once) {
+       d_capture_segment = (d_capture_segment == 0) ? d_nr_captures : 0;
+
+       disarm();
+       try {
+         arm();
+         d_rearmed = true;
+       }
+       catch (...) {
+         // will be retried once the readout is done
+         GR_LOG_WARN(d_logger, "overlapped re-arm failed");
+       }
+     }
+
+     // Trigger time offsets of all the waveforms at once, they are optional
+     ec = driver_get_trigger_offsets(first_segment, d_nr_captures, d_trigger_offsets);
+     if (ec) {
+       if (ec != std::errc::operation_not_supported) {
+         GR_LOG_WARN(d_logger, "failed to get trigger time offsets: " + ec.message());
+       }
+       d_trigger_offsets.clear();
+     }
+
+     // we assume all the blocks are ready, fetch them at once if requested
+     prefetched = false;
+
+     if (d_bulk_readout) {
+       ec = driver_prefetch_blocks(get_block_size(), first_segment, d_nr_captures);
+       if (!ec) {
+         prefetched = true;
+       }
+       else if (ec != std::errc::operation_not_supported) {
+         add_error_code(ec);
          return -1;
        }
+     }
 
-       if (d_auto_arm) {
-         disarm();
-         while(true) {
-           try {
-             arm();
-             break;
-           }
-           catch (...) {
-             return -1;
-           }
-         }
+     return 1;
+   }
+
+   double
+   digitizer_block_impl::get_trigger_offset(size_t waveform) const
+   {
+     return waveform < d_trigger_offsets.size() ? d_trigger_offsets[waveform] : 0.0;
+   }
+
+   void
+   digitizer_block_impl::add_rapid_block_trigger_tags(uint64_t timestamp_now_ns_utc,
+           const std::vector<uint32_t> &status, double trigger_offset, int noutputs)
+   {
+     // Attach trigger info to value outputs and to all ports
+     auto vec_idx = 0;
+     uint32_t pre_trigger_samples_with_downsampling = get_pre_trigger_samples_with_downsampling();
+     double time_per_sample_with_downsampling_ns = d_time_per_sample_ns * d_downsampling_factor;
+
+     const auto trigger_timestamp = timestamp_now_ns_utc
+             + (pre_trigger_samples_with_downsampling * time_per_sample_with_downsampling_ns);
+     const auto tag_offset = nitems_written(0) + pre_trigger_samples_with_downsampling;
+     const auto scheduling_status = get_scheduling_status();
+
+     // Outputs with the same status share the tag (usually all of them)
+     auto trigger_tag = d_tag_builder.make_trigger_tag(d_downsampling_factor,
+             trigger_timestamp, tag_offset, scheduling_status, trigger_offset);
+     auto trigger_tag_status = scheduling_status;
+     DIGITIZERS_PROBE2(trigger_found, tag_offset, trigger_timestamp);
+
+     for (auto i = 0; i < d_ai_channels && vec_idx < noutputs; i++, vec_idx+=2)
+     {
+       if (!d_channel_settings[i].enabled)
+       {
+         continue;
        }
 
-       // Wait conditional variable, when waken clear it
-       auto ec = wait_data_ready();
-       clear_data_ready();
+       auto channel_status = status[i] | scheduling_status;
+       if (channel_status != trigger_tag_status) {
+         trigger_tag = d_tag_builder.make_trigger_tag(d_downsampling_factor,
+                 trigger_timestamp, tag_offset, channel_status, trigger_offset);
+         trigger_tag_status = channel_status;
+       }
 
-       // Stop requested
-       if (ec == digitizer_block_errc::Stopped) {
-         GR_LOG_INFO(d_logger, "stop requested");
+       add_item_tag(vec_idx, trigger_tag);
+     }
+
+     if (trigger_tag_status != scheduling_status) {
+       trigger_tag = d_tag_builder.make_trigger_tag(d_downsampling_factor,
+               trigger_timestamp, tag_offset, scheduling_status, trigger_offset);
+     }
+
+     // Add tags to digital port
+     for (auto i = 0; i < d_ports  && vec_idx < noutputs; i++, vec_idx++)
+     {
+       if (d_port_settings[i].enabled)
+          add_item_tag(vec_idx, trigger_tag);
+     }
+   }
+
+   int
+   digitizer_block_impl::work_rapid_block(int noutput_items, gr_vector_void_star &output_items)
+   {
+     if (d_bstate.state == rapid_block_state_t::WAITING) {
+
+       if (d_trigger_once &&  d_was_triggered_once) {
          return -1;
        }
-       else if (ec) {
-         GR_LOG_ERROR(d_logger, "error occurred while waiting for data: " + to_string(ec));
-         return 0;
+
+       int first_segment = 0;
+       bool prefetched = false;
+       auto ready = acquire_rapid_block(first_segment, prefetched);
+       if (ready <= 0) {
+         return ready;
        }
 
-       // we assume all the blocks are ready
-       d_bstate.initialize(d_nr_captures);
+       d_bstate.initialize(d_nr_captures, prefetched, first_segment);
      }
 
      if (d_bstate.state == rapid_block_state_t::READING_PART1) {
@@ -823,11 +2440,14 @@ namespace gr {
        auto samples_to_fetch = get_block_size();
        auto downsampled_samples = get_block_size_with_downsampling();
 
-       // Instruct the driver to prefetch samples. Drivers might choose to ignore this call
-       auto ec = driver_prefetch_block(samples_to_fetch, d_bstate.waveform_idx);
-       if (ec) {
-         add_error_code(ec);
-         return -1;
+       // Instruct the driver to prefetch samples unless already done in bulk. Drivers might
+       // choose to ignore this call
+       if (!d_bstate.prefetched) {
+         auto ec = driver_prefetch_block(samples_to_fetch, d_bstate.segment());
+         if (ec) {
+           add_error_code(ec);
+           return -1;
+         }
        }
 
        // Initiate state machine for the current waveform. Note state machine track
@@ -840,46 +2460,15 @@ namespace gr {
        // We are good to read first batch of samples
        noutput_items = std::min(noutput_items, d_bstate.samples_left);
 
-       ec = driver_get_rapid_block_data(d_bstate.offset,
-               noutput_items, d_bstate.waveform_idx, output_items, d_status);
+       auto ec = driver_get_rapid_block_data(d_bstate.offset,
+               noutput_items, d_bstate.segment(), output_items, d_status);
        if (ec) {
          add_error_code(ec);
          return -1;
        }
 
-       // Attach trigger info to value outputs and to all ports
-       auto vec_idx = 0;
-       uint32_t pre_trigger_samples_with_downsampling = get_pre_trigger_samples_with_downsampling();
-       double time_per_sample_with_downsampling_ns = d_time_per_sample_ns * d_downsampling_factor;
-
-       for (auto i = 0; i < d_ai_channels && vec_idx < (int)output_items.size(); i++, vec_idx+=2)
-       {
-         if (!d_channel_settings[i].enabled)
-         {
-           continue;
-         }
-
-         auto trigger_tag = make_trigger_tag(
-                 d_downsampling_factor,
-                 timestamp_now_ns_utc + (pre_trigger_samples_with_downsampling * time_per_sample_with_downsampling_ns),
-                 nitems_written(0) + pre_trigger_samples_with_downsampling,
-                 d_status[i]);
-
-         add_item_tag(vec_idx, trigger_tag);
-       }
-
-       auto trigger_tag = make_trigger_tag(
-             d_downsampling_factor,
-             timestamp_now_ns_utc + (pre_trigger_samples_with_downsampling * time_per_sample_with_downsampling_ns),
-             nitems_written(0) + pre_trigger_samples_with_downsampling,
-             0 ); //status
-
-       // Add tags to digital port
-       for (auto i = 0; i < d_ports  && vec_idx < (int)output_items.size(); i++, vec_idx++)
-       {
-         if (d_port_settings[i].enabled)
-            add_item_tag(vec_idx, trigger_tag);
-       }
+       add_rapid_block_trigger_tags(timestamp_now_ns_utc, d_status,
+               get_trigger_offset(d_bstate.waveform_idx), output_items.size());
 
        // update state
        d_bstate.update_state(noutput_items);
@@ -891,7 +2480,7 @@ namespace gr {
        noutput_items = std::min(noutput_items, d_bstate.samples_left);
 
        auto ec = driver_get_rapid_block_data(d_bstate.offset, noutput_items,
-               d_bstate.waveform_idx, output_items, d_status);
+               d_bstate.segment(), output_items, d_status);
        if (ec) {
          add_error_code(ec);
          return -1;
@@ -906,106 +2495,403 @@ namespace gr {
      return -1;
    }
 
+   int
+   digitizer_block_impl::work_rapid_block_async(int noutput_items, gr_vector_void_star &output_items)
+   {
+     if (!d_readout_segment) {
+       if (d_trigger_once && d_readout_waveforms >= d_nr_captures) {
+         return -1;
+       }
+
+       // The readout thread reports stop (or failure) only, see readout_work_function
+       auto ec = d_readout_buffer.wait_data_ready();
+       if (ec) {
+         GR_LOG_INFO(d_logger, "stop requested");
+         return -1;
+       }
+
+       d_readout_segment = d_readout_buffer.front_data_chunk();
+       d_readout_offset = 0;
+     }
+
+     // Segment layout as per app_buffer_t, analog regions hold values & errors
+     const size_t analog_regions = 2 * d_ai_channels;
+     const size_t samples = d_readout_segment->d_size / (analog_regions * sizeof(float) + d_ports);
+     const uint8_t *ports = d_readout_segment->d_data + analog_regions * samples * sizeof(float);
+
+     noutput_items = std::min(noutput_items, static_cast<int>(samples - d_readout_offset));
+
+     for (size_t i = 0; i < output_items.size() && i < analog_regions + d_ports; i++) {
+       if (i < analog_regions) {
+         if (d_channel_settings[i / 2].enabled) {
+           const auto region = reinterpret_cast<const float *>(d_readout_segment->d_data) + i * samples;
+           memcpy(output_items[i], region + d_readout_offset, noutput_items * sizeof(float));
+         }
+       }
+       else if (d_port_settings[i - analog_regions].enabled) {
+         const auto region = ports + (i - analog_regions) * samples;
+         memcpy(output_items[i], region + d_readout_offset, noutput_items);
+       }
+     }
+
+     if (d_readout_offset == 0) {
+       add_rapid_block_trigger_tags(d_readout_segment->d_local_timestamp, d_readout_segment->d_status,
+               d_readout_segment->d_trigger_offset, output_items.size());
+     }
+
+     d_readout_offset += noutput_items;
+     if (d_readout_offset == samples) {
+       d_readout_buffer.release_data_chunk(d_readout_segment);
+       d_readout_segment = nullptr;
+       d_readout_waveforms++;
+     }
+
+     return noutput_items;
+   }
+
    void
-   digitizer_block_impl::poll_work_function()
+   digitizer_block_impl::readout_work_function()
+   {
+     thread_scope_t thread(get_block_name(this), "readout");
+
+     // Output pointers into the segment being read out, same order as the block outputs
+     gr_vector_void_star items(2 * d_ai_channels + d_ports);
+     bool triggered_once = false;
+
+     try {
+       while (true) {
+         d_config_snapshot.quiescent(CONFIG_READER_READOUT);
+
+         int first_segment = 0;
+         bool prefetched = false;
+         const auto ready = acquire_rapid_block(first_segment, prefetched);
+         if (ready < 0) {
+           break;
+         }
+         else if (ready == 0) {
+           continue;
+         }
+
+         // Segments still queued have the previous layout, the pool is re-initialized once
+         // they are copied out
+         const size_t samples = get_block_size_with_downsampling();
+         const size_t nr_segments = 2 * d_nr_captures;
+         if (samples != d_readout_samples || nr_segments != d_readout_nr_segments) {
+           while (d_readout_buffer.get_nr_free_chunks() != d_readout_buffer.get_nr_allocated_chunks()) {
+             boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
+           }
+           d_readout_buffer.initialize(d_ai_channels, d_ports, samples, nr_segments);
+           d_readout_samples = samples;
+           d_readout_nr_segments = nr_segments;
+         }
+
+         bool failed = false;
+         for (uint32_t waveform = 0; waveform < d_nr_captures && !failed; waveform++) {
+           const auto segment = first_segment + waveform;
+
+           std::error_code ec;
+           if (!prefetched) {
+             ec = driver_prefetch_block(get_block_size(), segment);
+           }
+
+           // Back-pressure, all the segments are waiting for the work function
+           app_buffer_t::data_chunk_t *chunk = nullptr;
+           while (!ec && (chunk = d_readout_buffer.get_free_data_chunk()) == nullptr) {
+             boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
+           }
+
+           if (!ec) {
+             float *analog = reinterpret_cast<float *>(chunk->d_data);
+             for (size_t i = 0; i < 2 * static_cast<size_t>(d_ai_channels); i++) {
+               items[i] = analog + i * samples;
+             }
+             uint8_t *ports = chunk->d_data + 2 * d_ai_channels * samples * sizeof(float);
+             for (auto port = 0; port < d_ports; port++) {
+               items[2 * d_ai_channels + port] = ports + port * samples;
+             }
+
+             chunk->d_status.resize(d_ai_channels);
+             ec = driver_get_rapid_block_data(0, samples, segment, items, chunk->d_status);
+             chunk->d_local_timestamp = get_timestamp_nano_utc();
+             chunk->d_trigger_offset = get_trigger_offset(waveform);
+           }
+
+           if (ec) {
+             add_error_code(ec);
+             failed = true;
+           }
+           else {
+             d_readout_buffer.add_full_data_chunk(chunk);
+           }
+         }
+
+         if (failed) {
+           break;
+         }
+         else if (d_trigger_once) {
+           triggered_once = true;
+           break;
+         }
+       }
+     }
+     catch (const boost::thread_interrupted &) {
+     }
+
+     // With trigger once the work function stops after copying out the waveforms, it needs
+     // to be told otherwise
+     if (!triggered_once) {
+       d_readout_buffer.notify_data_ready(digitizer_block_errc::Stopped);
+     }
+   }
+
+   void
+   digitizer_block_impl::start_readout_thread()
+   {
+     if (d_readout_thread.joinable()) {
+       return;
+     }
+
+     d_readout_buffer.set_memory_policy(d_buffer_huge_pages, d_buffer_numa_node, d_realtime_memory);
+     d_readout_samples = 0;
+     d_readout_nr_segments = 0;
+     d_readout_segment = nullptr;
+     d_readout_waveforms = 0;
+
+     d_config_snapshot.set_online(CONFIG_READER_READOUT, true);
+     d_readout_thread = boost::thread(&digitizer_block_impl::readout_work_function, this);
+   }
+
+   void
+   digitizer_block_impl::stop_readout_thread()
    {
-     boost::unique_lock<boost::mutex> lock(d_poller_mutex, boost::defer_lock);
-     auto poll_rate = boost::chrono::microseconds((long)(d_poll_rate * 1000000));
+     if (!d_readout_thread.joinable()) {
+       return;
+     }
+
+     // Waiting for an acquisition or free segments, both are interruption points
+     d_readout_thread.interrupt();
+     d_readout_thread.join();
+     d_config_snapshot.set_online(CONFIG_READER_READOUT, false);
+   }
 
-     gr::thread::set_thread_name(pthread_self(), "poller");
+   void
+   digitizer_block_impl::poll_work_function()
+   {
+     thread_scope_t thread(get_block_name(this), "poller");
 
-     //relax cpu with less lock calls.
-     unsigned int check_every_n_times = 10;
-     unsigned int poller_state_check_counter = check_every_n_times;
-     poller_state_t state = poller_state_t::IDLE;
+     if (!d_poller_cpus.empty() || d_poller_rt_priority > 0) {
+       apply_thread_scheduling(d_poller_cpus, d_poller_rt_priority, "poller");
+     }
 
      while (true) {
+       if (!poll_iteration()) {
+         return;
+       }
+
+       if (d_poller_state.load(std::memory_order_acquire) == poller_state_t::RUNNING) {
+         // Event-driven drivers wake the thread exactly when data is available
+         auto ec = driver_wait_ready(static_cast<uint64_t>(POLL_MAX_INTERVAL * 1e9));
+         if (ec != std::errc::operation_not_supported) {
+           continue;
+         }
+
+         // Absolute deadlines on the monotonic clock (see watchdog_now_ns), no drift
+         const auto deadline = d_poll_scheduler.next(d_samples_received, watchdog_now_ns());
+         struct timespec ts;
+         ts.tv_sec = static_cast<time_t>(deadline / 1000000000);
+         ts.tv_nsec = static_cast<long>(deadline % 1000000000);
+         while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {
+         }
+       }
+       else {
+         // Relax CPU
+         boost::this_thread::sleep_for(boost::chrono::microseconds(100));
+       }
+     }
+   }
+
+   bool
+   digitizer_block_impl::poll_iteration()
+   {
+     // Transitions are requested under the mutex (see transit_poll_thread_to_idle), reading the
+     // state doesn't need it
+     const auto state = d_poller_state.load(std::memory_order_acquire);
+
+     // Configuration snapshots read by the previous iteration are released
+     d_config_snapshot.quiescent(CONFIG_READER_POLL);
+
+     if (state == poller_state_t::RUNNING) {
+       DIGITIZERS_PROBE(driver_poll_start);
+       auto ec = driver_poll();
+       DIGITIZERS_PROBE1(driver_poll_end, ec.value());
+       if (ec) {
+         // Only report the error, logged rate limited
+         add_event(EVENT_POLL_FAILED, ec);
+         // Notify work method about the error... Work method will re-arm the driver if required.
+         d_app_buffer.notify_data_ready(ec);
+
+         // Prevent error-flood on close
+         if(d_closed)
+             return false;
+       }
+
+       // Sample counter is updated by the streaming callback called from this thread. The
+       // watchdog reports once per arm, the device is re-armed by the work thread.
+       if (!driver_stream_ended()) {
+         auto verdict = d_watchdog.check(d_samples_received, watchdog_now_ns());
+         d_metrics_estimated_samp_rate.store(d_watchdog.get_rate(), std::memory_order_relaxed);
+
+         if (verdict != stream_watchdog_t::WATCHDOG_OK) {
+           if (verdict == stream_watchdog_t::WATCHDOG_STALLED) {
+             add_event(EVENT_WATCHDOG_STALL, std::error_code{}, d_samples_received);
+           }
+           else {
+             add_event(EVENT_WATCHDOG, std::error_code{}, static_cast<uint64_t>(d_watchdog.get_rate()));
+           }
+
+           // This will wake up the worker thread (see work_stream), and that thread will
+           // then rearm the device...
+           d_app_buffer.notify_data_ready(digitizer_block_errc::Watchdog);
+         }
 
-       poller_state_check_counter++;
-       if(poller_state_check_counter >= check_every_n_times) {
-         lock.lock();
-         state = d_poller_state;
-         lock.unlock();
-         poller_state_check_counter = 0;
+         // Same for a new driver buffer size, the rearm reconfigures the device
+         if (d_buffer_tuner.update(d_samples_received, watchdog_now_ns())) {
+           d_tuned_driver_buffer_size.store(d_buffer_tuner.get_driver_buffer_size(), std::memory_order_relaxed);
+           d_app_buffer.notify_data_ready(digitizer_block_errc::Retune);
+         }
+         d_metrics_recommended_buffer_size.store(d_buffer_tuner.get_chunk_size(), std::memory_order_relaxed);
+         d_metrics_max_poll_gap_ns.store(d_buffer_tuner.get_max_gap_ns(), std::memory_order_relaxed);
+       }
+     }
+     else if (state == poller_state_t::PEND_IDLE) {
+       {
+         boost::mutex::scoped_lock lock(d_poller_mutex);
+         d_poller_state = poller_state_t::IDLE;
+       }
+
+       d_poller_cv.notify_all();
+     }
+     else if (state == poller_state_t::PEND_EXIT) {
+       {
+         boost::mutex::scoped_lock lock(d_poller_mutex);
+         d_poller_state = poller_state_t::EXIT;
        }
 
+       d_poller_cv.notify_all();
+       return false;
+     }
+
+     return true;
+   }
+
+   bool
+   digitizer_block_impl::group_poll()
+   {
+     return poll_iteration();
+   }
+
+   double
+   digitizer_block_impl::group_poll_period() const
+   {
+     return d_poll_rate;
+   }
+
+   void
+   digitizer_block_impl::group_thread_started()
+   {
+     if (!d_poller_cpus.empty() || d_poller_rt_priority > 0) {
+       apply_thread_scheduling(d_poller_cpus, d_poller_rt_priority, "group-poller");
+     }
+   }
+
+   void
+   digitizer_block_impl::update_sample_clock(uint64_t sample_count, uint64_t host_time_ns)
+   {
+     d_sample_clock.update(sample_count, host_time_ns);
+
+     auto interval = d_sample_clock.get_interval_ns() * d_downsampling_factor;
+     d_metrics_clock_samp_rate.store(interval > 0.0 ? 1000000000.0 / interval : 0.0, std::memory_order_relaxed);
+     d_metrics_timestamp_error_ns.store(d_sample_clock.get_error_ns(), std::memory_order_relaxed);
+   }
+
+   uint64_t
+   digitizer_block_impl::get_sample_timestamp_ns(uint64_t sample) const
+   {
+     return d_sample_clock.get_timestamp(sample);
+   }
 
-       if (state == poller_state_t::RUNNING) {
-         // Start watchdog a new
-         auto poll_start = boost::chrono::high_resolution_clock::now();
-         auto ec = driver_poll();
-         if (ec) {
-           // Only print out an error message
-           GR_LOG_ERROR(d_logger, "poll failed with: " + to_string(ec));
-           // Notify work method about the error... Work method will re-arm the driver if required.
-           d_app_buffer.notify_data_ready(ec);
-
-           // Prevent error-flood on close
-           if(d_closed)
-               return;
-         }
+   void
+   digitizer_block_impl::evaluate_fast_interlock(int channel_idx, const float *values, uint32_t nsamples,
+           uint64_t first_sample)
+   {
+     const auto &settings = get_config_snapshot().config.channels[channel_idx];
 
-         // Watchdog is "turned on" only some time after the acquisition start for two reasons:
-         // - to avoid false positives
-         // - to avoid fast rearm attempts
-         float estimated_samp_rate = 0.0;
-         {
-           // Note, mutex is not needed in case of PicoScope implementations but in order to make
-           // the base class relatively generic we use mutex (streaming callback is called from this
-           //  thread).
-           boost::mutex::scoped_lock watchdog_guard(d_watchdog_mutex);
-           estimated_samp_rate = d_estimated_sample_rate.get_avg_value();
-         }
+     d_fast_interlock_words.resize(interlock_words(nsamples));
+     evaluate_interlock_limits(values, nsamples, settings.interlock_min, settings.interlock_max,
+             &d_fast_interlock_words[0]);
 
-         if (estimated_samp_rate < (get_samp_rate() * WATCHDOG_SAMPLE_RATE_THRESHOLD)) {
-           // This will wake up the worker thread (see do_work method), and that thread will
-           // then rearm the device...
-           GR_LOG_ERROR(d_logger, "Watchdog: estimated sample rate " + std::to_string(estimated_samp_rate)
-                + "Hz, expected: " + std::to_string(get_samp_rate()) + "Hz");
-           d_app_buffer.notify_data_ready(digitizer_block_errc::Watchdog);
+     for_each_interlock(&d_fast_interlock_words[0], nsamples, d_fast_interlock_issued[channel_idx], [&](int i) {
+       const auto timestamp = get_sample_timestamp_ns(first_sample + i);
 
-         }
-         boost::chrono::duration<float> poll_duration = boost::chrono::high_resolution_clock::now() - poll_start;
+       // Latency up to the callback invocation, the modeled timestamp might be ahead of the clock
+       const auto now = get_chunk_timestamp_ns();
+       const uint64_t latency = now > timestamp ? now - timestamp : 0;
 
-         boost::this_thread::sleep_for(poll_rate - poll_duration);
+       if (d_fast_interlock_callback) {
+         d_fast_interlock_callback(static_cast<int64_t>(timestamp), d_fast_interlock_user_data);
        }
-       else {
-         if (state == poller_state_t::PEND_IDLE) {
-           lock.lock();
-           d_poller_state = state = poller_state_t::IDLE;
-           lock.unlock();
-
-           d_poller_cv.notify_all();
-         }
-         else if (state == poller_state_t::PEND_EXIT) {
-           lock.lock();
-           d_poller_state = state = poller_state_t::EXIT;
-           lock.unlock();
-
-           d_poller_cv.notify_all();
-           return;
-         }
 
-         // Relax CPU
-         boost::this_thread::sleep_for(boost::chrono::microseconds(100));
+       // Updated by the poll thread only
+       d_metrics_fast_interlocks.fetch_add(1, std::memory_order_relaxed);
+       d_metrics_fast_interlock_latency_ns.store(latency, std::memory_order_relaxed);
+       if (latency > d_metrics_max_fast_interlock_latency_ns.load(std::memory_order_relaxed)) {
+         d_metrics_max_fast_interlock_latency_ns.store(latency, std::memory_order_relaxed);
        }
+     });
+   }
+
+   uint64_t
+   digitizer_block_impl::get_chunk_timestamp_ns() const
+   {
+     if (d_device_group) {
+       return d_device_group->now_ns() + d_device_group_offset_ns;
      }
+
+     return get_timestamp_nano_utc();
    }
 
    void
    digitizer_block_impl::start_poll_thread()
    {
-     if (!d_poller.joinable()) {
+     if (d_poller.joinable() || d_device_group_registered) {
+       return;
+     }
+
+     {
        boost::mutex::scoped_lock guard(d_poller_mutex);
        d_poller_state = poller_state_t::IDLE;
+     }
+
+     d_config_snapshot.set_online(CONFIG_READER_POLL, true);
+
+     // The previous group (if any) is kept until now because the work thread might still
+     // have been timestamping
+     d_device_group.reset();
+
+     if (d_device_group_name.empty()) {
        d_poller = boost::thread(&digitizer_block_impl::poll_work_function, this);
      }
+     else {
+       d_device_group = device_group_t::get(d_device_group_name);
+       d_device_group->add(this);
+       d_device_group_registered = true;
+     }
    }
 
    void
    digitizer_block_impl::stop_poll_thread()
    {
-     if (!d_poller.joinable()) {
+     if (!d_poller.joinable() && !d_device_group_registered) {
        return;
      }
 
@@ -1015,7 +2901,15 @@ namespace gr {
              [this] { return d_poller_state == poller_state_t::EXIT;});
      lock.unlock();
 
-     d_poller.join();
+     if (d_device_group_registered) {
+       d_device_group->remove(this);
+       d_device_group_registered = false;
+     }
+     else {
+       d_poller.join();
+     }
+
+     d_config_snapshot.set_online(CONFIG_READER_POLL, false);
    }
 
    void
@@ -1055,21 +2949,40 @@ namespace gr {
      // wait data on application buffer
      auto ec = d_app_buffer.wait_data_ready();
 
+     if (ec == digitizer_block_errc::Retune) {
+       d_driver_buffer_size = d_tuned_driver_buffer_size.load(std::memory_order_relaxed);
+       GR_LOG_INFO(d_logger, "driver buffer size tuned to " + std::to_string(d_driver_buffer_size)
+               + " samples, rearming device...");
+       rearm();
+       return 0; // work will be called again
+     }
+
+     if (ec == digitizer_block_errc::Reconfigure) {
+       GR_LOG_INFO(d_logger, "configuration committed, rearming device...");
+       rearm();
+       return 0; // work will be called again
+     }
+
      if (ec) { add_error_code(ec); }
 
      if (ec == digitizer_block_errc::Stopped) {
        GR_LOG_INFO(d_logger, "stop requested");
+       if (d_aggregated_source) {
+         d_aggregated_source->finish();
+       }
        return -1; // stop
      }
      else if (ec == digitizer_block_errc::Watchdog) {
-       GR_LOG_ERROR(d_logger, "Watchdog triggered, rearming device...");
+       add_event(EVENT_WATCHDOG_REARM);
        // Rearm device
-       disarm();
-       arm();
+       rearm();
        return 0; // work will be called again
      }
      if (ec) {
        GR_LOG_ERROR(d_logger, "Error reading stream data: " + to_string(ec));
+       if (d_aggregated_source) {
+         d_aggregated_source->finish();
+       }
        return -1;  // stop
      }
 
@@ -1078,7 +2991,12 @@ namespace gr {
      int port_idx = 0;
 
      for (auto i = 0; i < d_ai_channels; i++) {
-       if (d_channel_settings[i].enabled) {
+       if (d_channel_settings[i].enabled && d_raw_output) {
+         raw_buffers[buff_idx] = static_cast<int16_t *>(output_items[output_items_idx]);
+         output_items_idx++;
+         buff_idx++;
+       }
+       else if (d_channel_settings[i].enabled) {
          ai_buffers[buff_idx] = static_cast<float *>(output_items[output_items_idx]);
          output_items_idx++;
          ai_error_buffers[buff_idx] = static_cast<float *>(output_items[output_items_idx]);
@@ -1086,72 +3004,172 @@ namespace gr {
          buff_idx++;
        }
        else {
-         output_items_idx += 2; // Skip disabled channels
+         output_items_idx += get_outputs_per_channel(); // Skip disabled channels
        }
      }
 
-     for (auto i = 0; i < d_ports; i++) {
-       if (d_port_settings[i].enabled) {
-         port_buffers[port_idx] = static_cast<uint8_t *>(output_items[output_items_idx]);
-         output_items_idx++;
-         port_idx++;
-       }
-       else {
-         output_items_idx++;
+     if (d_packed_port_size) {
+       port_buffers = d_packed_port_buffers;
+     }
+     else {
+       for (auto i = 0; i < d_ports; i++) {
+         if (d_port_settings[i].enabled) {
+           port_buffers[port_idx] = static_cast<uint8_t *>(output_items[output_items_idx]);
+           output_items_idx++;
+           port_idx++;
+         }
+         else {
+           output_items_idx++;
+         }
        }
      }
 
-     // This will write samples directly into GR output buffers
-     std::vector<uint32_t> channel_status;
+     // The data chunk is consumed in place, the driver writes (or converts) samples directly into
+     // GR output buffers. Afterwards the chunk is handed back to the free pool.
+     auto chunk = d_app_buffer.front_data_chunk();
+
+     // Callback-to-work latency, bucket index is floor(log2(latency in us))
+     auto work_timestamp = get_chunk_timestamp_ns();
+     uint64_t latency_us = work_timestamp > chunk->d_local_timestamp
+             ? (work_timestamp - chunk->d_local_timestamp) / 1000 : 0;
+     int bucket = 0;
+     while (latency_us > 1 && bucket < digitizer_metrics_t::LATENCY_HISTOGRAM_SIZE - 1) {
+       latency_us >>= 1;
+       bucket++;
+     }
+     d_metrics_latency_histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+
+     if (d_raw_output) {
+       driver_read_raw_data_chunk(chunk, raw_buffers, port_buffers);
+     }
+     else {
+       driver_read_data_chunk(chunk, ai_buffers, ai_error_buffers, port_buffers);
+     }
+
+     if (d_packed_port_size) {
+       pack_ports(output_items[output_items_idx], d_buffer_size);
+     }
+
+     std::vector<uint32_t> channel_status = chunk->d_status;
+     int64_t timestamp_now_ns_utc = chunk->d_local_timestamp;
+     auto lost_count = chunk->d_lost_count;
 
-     int64_t timestamp_now_ns_utc;
-     auto lost_count = d_app_buffer.get_data_chunk(ai_buffers, ai_error_buffers, port_buffers, channel_status, timestamp_now_ns_utc);
+     d_app_buffer.release_data_chunk(chunk);
      //std::cout << "timestamp_now_ns_utc: " << int64_t(timestamp_now_ns_utc) << std::endl;
 
      if (lost_count) {
-       GR_LOG_ERROR(d_logger, std::to_string(lost_count) + " digitizer data buffers lost. Usually the cause of this error is, that the work method of the Digitizer block is called with low frequency because of a 'traffic jam' in the flowgraph. (One of the next blocks cannot process incoming data in time)");
+       d_metrics_lost_buffers.fetch_add(lost_count, std::memory_order_relaxed);
+       add_event(EVENT_BUFFERS_LOST, std::error_code{}, lost_count);
      }
 
+     // Calibration as of this chunk, consistent across the channels
+     const auto &config = get_config_snapshot();
+
      // Compile acquisition info tag
      acq_info_t tag_info{};
 
      tag_info.timestamp = timestamp_now_ns_utc;
+     tag_info.config_version = config.version;
      tag_info.timebase = get_timebase_with_downsampling();
      tag_info.user_delay = 0.0;
      tag_info.actual_delay = 0.0;
 
+     // Frames are tagged once the chunk is read, samples are counted in this case. Windows
+     // are cut out once the chunk is read, acquired samples are counted then.
+     auto offset = d_frame_layout.samples ? nitems_written(0) * d_frame_layout.samples
+             : nitems_written(0);
+     if (d_triggered_windows) {
+       offset = d_window_acquired;
+     }
+     const auto scheduling_status = get_scheduling_status();
+
+     // A single tag is built per chunk and shared by all the outputs, a new one is needed only
+     // for channels reporting a different status (e.g. overflow)
+     tag_info.status = scheduling_status;
+     tag_info.scale = 1.0;
+     tag_info.offset = 0.0;
+     auto tag = d_tag_builder.make_acq_info_tag(tag_info, offset);
+
+     // Every d_trace_interval-th chunk is traced, the trace tag goes along with the acq_info tag
+     trace_t trace_info{};
+     gr::tag_t trace_tag;
+     const bool traced = d_trace_interval > 0 && d_trace_chunk_count++ % d_trace_interval == 0
+             && !d_triggered_windows;
+     if (traced) {
+       trace_info.id = trace_registry_t::instance().begin_trace(timestamp_now_ns_utc);
+       trace_info.timestamp = timestamp_now_ns_utc;
+       trace_tag = make_trace_tag(trace_info, offset);
+     }
+
+     // With delta emission the acq_info tag is attached on anchor chunks and on changes only
+     const bool delta = d_acq_info_anchor_interval > 0 && !d_frame_layout.samples && !d_triggered_windows;
+     const bool anchor = !delta || d_acq_info_chunk_count++ % d_acq_info_anchor_interval == 0;
+
      // Attach tags to the channel values...
      int output_idx = 0;
 
      for (auto i = 0; i < d_ai_channels; i++)
      {
        if (d_channel_settings[i].enabled) {
-         // add channel specific status
-         tag_info.status = channel_status.at(i);
+         // add channel specific status and calibration
+         auto status = channel_status.at(i) | scheduling_status;
+         const double scale = config.config.channels[i].calibration_scale;
+         const double calibration_offset = config.config.channels[i].calibration_offset;
+
+         if (status != tag_info.status || scale != tag_info.scale
+                 || calibration_offset != tag_info.offset) {
+           tag_info.status = status;
+           tag_info.scale = scale;
+           tag_info.offset = calibration_offset;
+           tag = d_tag_builder.make_acq_info_tag(tag_info, offset);
+         }
 
-         auto tag = make_acq_info_tag(tag_info, nitems_written(0));
-         add_item_tag(output_idx, tag);
+         if (!delta || acq_info_due(output_idx, tag_info, anchor)) {
+           add_stream_tag(output_idx, tag);
+         }
+         if (traced) {
+           add_stream_tag(output_idx, trace_tag);
+         }
+         if (d_aggregated_source) {
+           d_aggregated_tags[i].push_back(tag);
+         }
 
-         output_idx += 2;
+         output_idx += get_outputs_per_channel();
        }
      }
 
      // ...and to all digital ports
-     tag_info.status = 0;
-     auto tag = make_acq_info_tag(tag_info, nitems_written(0));
+     if (tag_info.status != scheduling_status || tag_info.scale != 1.0 || tag_info.offset != 0.0) {
+       tag_info.status = scheduling_status;
+       tag_info.scale = 1.0;
+       tag_info.offset = 0.0;
+       tag = d_tag_builder.make_acq_info_tag(tag_info, offset);
+     }
 
-     for (auto i = 0; i < d_ports; i++)
+     const auto port_outputs = get_port_outputs();
+     for (auto i = 0; i < port_outputs; i++)
      {
-       if (d_port_settings[i].enabled) {
-           add_item_tag(output_idx, tag);
-           output_idx ++;
+       if (!delta || acq_info_due(output_idx, tag_info, anchor)) {
+         add_stream_tag(output_idx, tag);
        }
+       if (traced) {
+         add_stream_tag(output_idx, trace_tag);
+       }
+       output_idx ++;
+     }
+
+     if (traced) {
+       trace_registry_t::instance().add_hop(trace_info.id, get_block_name(this),
+               static_cast<int64_t>(get_timestamp_nano_utc()));
      }
 
      // Software-based trigger detection
      std::vector<int> trigger_offsets;
 
-     if (d_trigger_settings.is_analog()) {
+     if (!d_trigger_conditions.empty()) {
+       trigger_offsets = find_condition_triggers(output_items, d_buffer_size);
+     }
+     else if (d_trigger_settings.is_analog()) {
 
        // TODO: improve, check selected trigger on arm
        const auto aichan = convert_to_aichan_idx(d_trigger_settings.source);
@@ -1159,12 +3177,28 @@ namespace gr {
 
        for (int i = 0; i < aichan; i++) {
          if (d_channel_settings[i].enabled) {
-           output_idx += 2;
+           output_idx += get_outputs_per_channel();
          }
        }
 
-       auto buffer = static_cast<float const * const>(output_items[output_idx]);
-       trigger_offsets = find_analog_triggers(buffer, d_buffer_size);
+       if (d_raw_output) {
+         auto raw = static_cast<int16_t const * const>(output_items[output_idx]);
+         trigger_offsets = find_analog_triggers(raw, d_buffer_size, driver_get_raw_scaling(aichan));
+       }
+       else {
+         auto buffer = static_cast<float const * const>(output_items[output_idx]);
+         trigger_offsets = find_analog_triggers(buffer, d_buffer_size);
+       }
+     }
+     else if (d_trigger_settings.is_digital() && d_packed_port_size == sizeof(uint16_t)) {
+         auto buffer = static_cast<uint16_t const * const>(output_items.back());
+         trigger_offsets = find_digital_triggers(buffer, d_buffer_size,
+                 static_cast<uint16_t>(1u << d_trigger_settings.pin_number));
+     }
+     else if (d_trigger_settings.is_digital() && d_packed_port_size == sizeof(uint32_t)) {
+         auto buffer = static_cast<uint32_t const * const>(output_items.back());
+         trigger_offsets = find_digital_triggers(buffer, d_buffer_size,
+                 static_cast<uint32_t>(1u << d_trigger_settings.pin_number));
      }
      else if (d_trigger_settings.is_digital()) {
          auto port = d_trigger_settings.pin_number / 8;
@@ -1177,6 +3211,9 @@ namespace gr {
 
      double time_per_sample_with_downsampling_ns = d_time_per_sample_ns * d_downsampling_factor;
 
+     // Realignment tags refer to sample offsets of the plain stream
+     const bool realign = d_timing_realignment && !d_frame_layout.samples && !d_triggered_windows;
+
      // Attach trigger tags
      for (auto trigger_offset : trigger_offsets)
      {
@@ -1189,30 +3226,341 @@ namespace gr {
 //       std::cout << "diff[ns]             : " << uint64_t((noutput_items - trigger_offset ) * time_per_sample_with_downsampling_ns )<<std::endl;
 //       std::cout << "stamp added           : " << uint64_t(timestamp_now_ns_utc - (( noutput_items - trigger_offset ) * time_per_sample_with_downsampling_ns )) <<std::endl;
 //       std::cout << "tag offset: " << nitems_written(0) + trigger_offset <<std::endl;
-       auto trigger_tag = make_trigger_tag(
+       const int64_t trigger_timestamp = timestamp_now_ns_utc
+             - uint64_t(( noutput_items - trigger_offset ) * time_per_sample_with_downsampling_ns );
+       auto trigger_tag = d_tag_builder.make_trigger_tag(
              d_downsampling_factor,
-             timestamp_now_ns_utc - uint64_t(( noutput_items - trigger_offset ) * time_per_sample_with_downsampling_ns ),
-             nitems_written(0) + trigger_offset,
+             trigger_timestamp,
+             offset + trigger_offset,
              0 ); //status
+       DIGITIZERS_PROBE2(trigger_found, offset + trigger_offset, trigger_timestamp);
+
+       if (realign) {
+         trigger_t trigger{};
+         trigger.downsampling_factor = d_downsampling_factor;
+         trigger.timestamp = trigger_timestamp;
+         d_realigner.add_trigger(offset + trigger_offset, trigger, static_cast<int64_t>(get_timestamp_nano_utc()));
+       }
 
        int output_idx = 0;
 
        for (auto i = 0; i < d_ai_channels; i++) {
          if (d_channel_settings[i].enabled) {
-           add_item_tag(output_idx, trigger_tag);
-           output_idx += 2;
+           add_stream_tag(output_idx, trigger_tag);
+           if (d_aggregated_source) {
+             d_aggregated_tags[i].push_back(trigger_tag);
+           }
+           output_idx += get_outputs_per_channel();
+         }
+       }
+
+       for (auto i = 0; i < port_outputs; i++) {
+         add_stream_tag(output_idx, trigger_tag);
+         output_idx++;
+       }
+     }
+
+     if (realign && d_realigner.pending()) {
+       realign_triggers(offset, offset + noutput_items);
+     }
+
+     if (d_aggregated_source) {
+       push_aggregated(noutput_items, offset);
+     }
+
+     return noutput_items;
+   }
+
+   void
+   digitizer_block_impl::realign_triggers(uint64_t first_offset, uint64_t end_offset)
+   {
+     uint64_t timed_out_count = 0;
+
+     d_realigner.realign(static_cast<int64_t>(get_timestamp_nano_utc()),
+             [&](const realignment_t &realignment, bool timed_out) {
+       if (timed_out) {
+         timed_out_count++;
+       }
+
+       // Placed on the trigger itself if it is still within the output range
+       const auto offset = std::min(std::max(realignment.trigger_offset, first_offset), end_offset - 1);
+       const auto tag = make_realignment_tag(realignment, offset);
+
+       int output_idx = 0;
+       for (auto i = 0; i < d_ai_channels; i++) {
+         if (d_channel_settings[i].enabled) {
+           add_item_tag(output_idx, tag);
+           output_idx += get_outputs_per_channel();
          }
        }
 
+       const auto port_outputs = get_port_outputs();
+       for (auto i = 0; i < port_outputs; i++) {
+         add_item_tag(output_idx, tag);
+         output_idx++;
+       }
+     });
+
+     if (timed_out_count) {
+       add_event(EVENT_REALIGNMENT_TIMEOUT, std::error_code{}, timed_out_count);
+     }
+   }
+
+   int
+   digitizer_block_impl::work_stream_frames(int noutput_items, gr_vector_void_star &output_items)
+   {
+     d_frame_tags.clear();
+
+     auto nsamples = work_stream(d_buffer_size, d_frame_items);
+     if (nsamples <= 0) {
+       return nsamples;
+     }
+
+     // Chunks are a multiple of frames, see configure
+     const auto nframes = nsamples / d_frame_layout.samples;
+     assert(noutput_items >= nframes);
+
+     const frame_layout_t chunk_layout(d_ai_channels, d_ports, d_buffer_size);
+     const uint8_t *scratch = d_frame_scratch.data();
+     const auto frame_size = d_frame_layout.frame_size();
+     const size_t values_size = d_frame_layout.samples * sizeof(float);
+     const size_t port_size = d_frame_layout.samples;
+     auto out = static_cast<uint8_t *>(output_items[0]);
+
+     for (int f = 0; f < nframes; f++, out += frame_size) {
+       for (auto i = 0; i < d_ai_channels; i++) {
+         memcpy(out + d_frame_layout.values_offset(i),
+                 scratch + chunk_layout.values_offset(i) + f * values_size, values_size);
+         memcpy(out + d_frame_layout.errors_offset(i),
+                 scratch + chunk_layout.errors_offset(i) + f * values_size, values_size);
+       }
        for (auto i = 0; i < d_ports; i++) {
-         if (d_port_settings[i].enabled) {
-           add_item_tag(output_idx, trigger_tag);
-           output_idx++;
+         memcpy(out + d_frame_layout.port_offset(i),
+                 scratch + chunk_layout.port_offset(i) + f * port_size, port_size);
+       }
+     }
+
+     attach_frame_tags();
+
+     return nframes;
+   }
+
+   bool
+   digitizer_block_impl::acq_info_due(int output_idx, const acq_info_t &info, bool anchor)
+   {
+     if (d_acq_info_attached.size() <= static_cast<size_t>(output_idx)) {
+       d_acq_info_attached.resize(output_idx + 1);
+     }
+
+     auto &attached = d_acq_info_attached[output_idx];
+     const bool changed = info.timebase != attached.timebase
+             || info.user_delay != attached.user_delay
+             || info.actual_delay != attached.actual_delay
+             || info.status != attached.status
+             || info.scale != attached.scale
+             || info.offset != attached.offset
+             || info.config_version != attached.config_version;
+
+     if (!anchor && !changed) {
+       return false;
+     }
+
+     attached = info;
+     return true;
+   }
+
+   void
+   digitizer_block_impl::add_stream_tag(int output_idx, const gr::tag_t &tag)
+   {
+     if (d_frame_layout.samples) {
+       d_frame_tags.push_back(tag);
+     }
+     else if (d_triggered_windows) {
+       d_window_tags.emplace_back(output_idx, tag);
+     }
+     else {
+       add_item_tag(output_idx, tag);
+     }
+   }
+
+   void
+   digitizer_block_impl::attach_frame_tags()
+   {
+     const auto samples = static_cast<uint64_t>(d_frame_layout.samples);
+     const double timebase = get_timebase_with_downsampling();
+
+     // Outputs share the tag objects, each one is attached once. The acq_info tags of the
+     // channels are merged into the first one, it goes first.
+     std::vector<pmt::pmt_t> attached;
+     std::vector<gr::tag_t> frame_tags;
+     bool have_acq_info = false;
+     acq_info_t acq_info{};
+     uint64_t acq_info_offset = 0;
+
+     for (const auto &tag : d_frame_tags) {
+       if (std::find(attached.begin(), attached.end(), tag.value) != attached.end()) {
+         continue;
+       }
+       attached.push_back(tag.value);
+
+       const auto kind = get_tag_kind(tag.key);
+       if (kind == TAG_KIND_ACQ_INFO) {
+         const auto channel_info = decode_acq_info_tag(tag);
+         if (!have_acq_info) {
+           acq_info = channel_info;
+           acq_info.scale = 1.0;
+           acq_info.offset = 0.0;
+           acq_info_offset = tag.offset;
+           have_acq_info = true;
          }
+         acq_info.status |= channel_info.status;
+         continue;
+       }
+
+       // Triggers within a frame are delivered with the frame, the distance to the trigger
+       // sample is added to the trigger time offset
+       auto frame_tag = tag;
+       frame_tag.offset = tag.offset / samples;
+
+       const auto sample = tag.offset % samples;
+       if (sample && kind == TAG_KIND_TRIGGER) {
+         const auto trigger = decode_trigger_tag(tag);
+         frame_tag = d_tag_builder.make_trigger_tag(trigger.downsampling_factor, trigger.timestamp,
+                 frame_tag.offset, trigger.status, trigger.trigger_offset + sample * timebase);
        }
+
+       frame_tags.push_back(frame_tag);
      }
 
-     return noutput_items;
+     if (have_acq_info) {
+       add_item_tag(0, d_tag_builder.make_acq_info_tag(acq_info, acq_info_offset / samples));
+     }
+
+     for (const auto &tag : frame_tags) {
+       add_item_tag(0, tag);
+     }
+   }
+
+   int
+   digitizer_block_impl::work_stream_windows(int noutput_items, gr_vector_void_star &output_items)
+   {
+     // The history can't move while a complete window is waiting for output space
+     auto nitems = emit_windows(noutput_items, output_items);
+     if (nitems) {
+       return nitems;
+     }
+
+     const size_t history = get_block_size_with_downsampling();
+     for (size_t o = 0; o < d_window_history.size(); o++) {
+       const size_t item_size = d_window_item_sizes[o];
+       memmove(d_window_history[o], d_window_history[o] + d_buffer_size * item_size, history * item_size);
+     }
+
+     d_window_tags.clear();
+
+     auto nsamples = work_stream(d_buffer_size, d_window_items);
+     if (nsamples <= 0) {
+       return nsamples;
+     }
+
+     // acq_info tags of the chunk go along with each window triggered within it
+     std::vector<std::pair<int, gr::tag_t>> acq_info_tags;
+     for (const auto &tag : d_window_tags) {
+       if (get_tag_kind(tag.second.key) == TAG_KIND_ACQ_INFO) {
+         acq_info_tags.push_back(tag);
+       }
+     }
+
+     // The trigger tags are the same for all the outputs
+     const auto pre_samples = get_pre_trigger_samples_with_downsampling();
+     uint64_t last_trigger = std::numeric_limits<uint64_t>::max();
+
+     for (const auto &tag : d_window_tags) {
+       if (get_tag_kind(tag.second.key) != TAG_KIND_TRIGGER || tag.second.offset == last_trigger) {
+         continue;
+       }
+       last_trigger = tag.second.offset;
+
+       if (tag.second.offset < pre_samples) {
+         continue;
+       }
+
+       d_pending_windows.push_back(trigger_window_t {tag.second.offset, tag.second, acq_info_tags});
+     }
+
+     d_window_acquired += nsamples;
+
+     return emit_windows(noutput_items, output_items);
+   }
+
+   int
+   digitizer_block_impl::emit_windows(int noutput_items, gr_vector_void_star &output_items)
+   {
+     const auto pre_samples = get_pre_trigger_samples_with_downsampling();
+     const auto window_size = get_block_size_with_downsampling();
+     const size_t history = window_size;
+
+     // Acquired sample at the beginning of the history, negative until enough are acquired
+     const int64_t first_sample = static_cast<int64_t>(d_window_acquired) - d_buffer_size - history;
+
+     int nitems = 0;
+
+     while (!d_pending_windows.empty() && nitems + static_cast<int>(window_size) <= noutput_items) {
+       const auto &window = d_pending_windows.front();
+       const uint64_t start = window.trigger - pre_samples;
+
+       if (start + window_size > d_window_acquired) {
+         break; // post samples not acquired yet
+       }
+
+       for (size_t o = 0; o < d_window_history.size(); o++) {
+         const size_t item_size = d_window_item_sizes[o];
+         memcpy(static_cast<uint8_t *>(output_items[o]) + nitems * item_size,
+                 d_window_history[o] + (static_cast<int64_t>(start) - first_sample) * item_size, window_size * item_size);
+       }
+
+       const uint64_t out_offset = nitems_written(0) + nitems;
+
+       for (const auto &tag : window.acq_info_tags) {
+         auto acq_info_tag = tag.second;
+         acq_info_tag.offset = out_offset;
+         add_item_tag(tag.first, acq_info_tag);
+
+         auto trigger_tag = window.trigger_tag;
+         trigger_tag.offset = out_offset + pre_samples;
+         add_item_tag(tag.first, trigger_tag);
+       }
+
+       nitems += window_size;
+       d_pending_windows.pop_front();
+     }
+
+     return nitems;
+   }
+
+   void
+   digitizer_block_impl::push_aggregated(int nsamples, uint64_t offset)
+   {
+     int buff_idx = 0;
+
+     for (auto i = 0; i < d_ai_channels; i++) {
+       if (d_channel_settings[i].enabled) {
+         d_aggregated_values[i] = ai_buffers[buff_idx];
+         d_aggregated_errors[i] = ai_error_buffers[buff_idx];
+         buff_idx++;
+       }
+       else {
+         d_aggregated_values[i] = nullptr;
+         d_aggregated_errors[i] = nullptr;
+       }
+     }
+
+     d_aggregated_source->push(d_aggregated_values, d_aggregated_errors, nsamples, offset,
+             d_aggregated_tags);
+
+     for (auto &tags : d_aggregated_tags) {
+       tags.clear();
+     }
    }
 
    int
@@ -1220,13 +3568,33 @@ namespace gr {
        gr_vector_const_void_star &input_items,
        gr_vector_void_star &output_items)
    {
+     block_stats_scope_t stats(d_stats);
      int retval = -1;
 
+     if (!d_work_thread_scheduling_applied) {
+       if (!d_work_thread_cpus.empty() || d_work_thread_rt_priority > 0) {
+         apply_thread_scheduling(d_work_thread_cpus, d_work_thread_rt_priority, "work");
+       }
+       d_work_thread_scheduling_applied = true;
+     }
+
+     // Configuration snapshots read by the previous call are released
+     d_config_snapshot.quiescent(CONFIG_READER_WORK);
+
      if(d_acquisition_mode == acquisition_mode_t::STREAMING) {
-       retval = work_stream(noutput_items, output_items);
+       if (d_frame_layout.samples) {
+         retval = work_stream_frames(noutput_items, output_items);
+       }
+       else if (d_triggered_windows) {
+         retval = work_stream_windows(noutput_items, output_items);
+       }
+       else {
+         retval = work_stream(noutput_items, output_items);
+       }
      }
      else if(d_acquisition_mode == acquisition_mode_t::RAPID_BLOCK) {
-       retval = work_rapid_block(noutput_items, output_items);
+       retval = d_readout_thread.joinable() ? work_rapid_block_async(noutput_items, output_items)
+               : work_rapid_block(noutput_items, output_items);
      }
 
      if ((retval > 0) && !d_timebase_published) {
@@ -1240,6 +3608,45 @@ namespace gr {
        d_timebase_published = true;
      }
 
+     if ((retval > 0) && d_raw_output && !d_raw_scaling_published) {
+       int output_idx = 0;
+
+       for (auto i = 0; i < d_ai_channels; i++) {
+         if (d_channel_settings[i].enabled) {
+           auto scaling_tag = make_raw_scaling_tag(driver_get_raw_scaling(i), nitems_written(0));
+           add_item_tag(output_idx, scaling_tag);
+           output_idx++;
+         }
+       }
+
+       d_raw_scaling_published = true;
+     }
+
+     // Error estimates are part of the frames
+     if ((retval > 0) && !d_constant_error_published && !d_frame_layout.samples) {
+       int output_idx = 0;
+
+       for (auto i = 0; i < d_ai_channels; i++) {
+         if (d_channel_settings[i].enabled) {
+           float error;
+           if (driver_get_constant_error(i, error)) {
+             add_item_tag(output_idx, make_constant_error_tag(error, nitems_written(0)));
+           }
+           output_idx += get_outputs_per_channel();
+         }
+       }
+
+       d_constant_error_published = true;
+     }
+
+     if (d_metrics_interval > 0.0) {
+       auto now_ns = get_timestamp_nano_utc();
+       if (now_ns - d_metrics_last_published_ns >= static_cast<uint64_t>(d_metrics_interval * 1e9)) {
+         publish_metrics();
+         d_metrics_last_published_ns = now_ns;
+       }
+     }
+
      return retval;
    }
 
@@ -8,13 +8,30 @@
 #define INCLUDED_DIGITIZERS_DIGITIZER_BLOCK_IMPL_H
 
 #include <digitizers/digitizer_block.h>
+#include <digitizers/tags.h>
 #include "utils.h"
 #include "error.h"
 #include "app_buffer.h"
+#include "conversion_pool.h"
+#include "trigger_search.h"
+#include "device_group.h"
+#include "sample_clock_model.h"
+#include "stream_watchdog.h"
+#include "poll_scheduler.h"
+#include "buffer_tuner.h"
+#include "rcu_snapshot.h"
+#include "event_log.h"
+#include "aggregated_source_impl.h"
+#include "trigger_realigner.h"
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/condition_variable.hpp>
 #include <boost/chrono.hpp>
 #include <system_error>
+#include <atomic>
+#include <deque>
+#include <cmath>
+#include <limits>
+#include "block_stats_impl.h"
 
 
 namespace gr {
@@ -25,6 +42,9 @@ namespace gr {
       Stopped = 1,
       Interrupted = 10,   // did not respond in time,
       Watchdog = 11,      // no or too little samples received in time
+      SchedulingFailed = 12, // requested thread affinity or priority could not be applied
+      Retune = 13,        // driver buffer size changed by the automatic tuning
+      Reconfigure = 14,   // device settings changed by a configuration transaction
     };
 
     std::error_code make_error_code(digitizer_block_errc e);
@@ -47,9 +67,27 @@ namespace gr {
    * Hardcoded values
    **********************************************************************/
 
-  // Watchdog is triggered if estimated sample rate falls below 75%
+  // Watchdog is triggered if the sample rate measured over a rate window falls below 75%...
   static const float WATCHDOG_SAMPLE_RATE_THRESHOLD = 0.75;
 
+  // ...or if no samples are received for the given number of poll periods (or application
+  // buffer periods, whichever is longer)
+  static const unsigned WATCHDOG_STALL_POLLS = 20;
+  static const unsigned WATCHDOG_STALL_BUFFERS = 2;
+
+  // Rate window in stall timeouts
+  static const unsigned WATCHDOG_RATE_WINDOW = 4;
+
+  // Adaptive polling targets a quarter of the driver buffer per poll, the period is kept
+  // between 50 us and 100 ms (state changes are noticed within the latter). The latter also
+  // bounds the wait of event-driven drivers, see driver_wait_ready.
+  static const double POLL_TARGET_FILL = 0.25;
+  static const double POLL_MIN_INTERVAL = 0.00005;
+  static const double POLL_MAX_INTERVAL = 0.1;
+
+  // Observation window of the automatic driver buffer sizing, in seconds
+  static const double BUFFER_TUNING_WINDOW = 2.0;
+
   /**********************************************************************
    * Helpers and struct definitions
    **********************************************************************/
@@ -67,7 +105,9 @@ namespace gr {
           waveform_count(0),
           waveform_idx(0),
           offset(0),
-          samples_left(0)
+          samples_left(0),
+          prefetched(false),
+          segment_offset(0)
       {}
 
       State state;
@@ -76,17 +116,27 @@ namespace gr {
       int waveform_idx;    // index of the waveform we are currently reading
       int offset;          // reading offset
       int samples_left;
+      bool prefetched;     // all the waveforms are already fetched from the driver (bulk readout)
+      int segment_offset;  // device memory segment holding the first waveform
 
       void to_wait()
       {
         state = rapid_block_state_t::WAITING;
       }
 
-      void initialize(int nr_waveforms)
+      void initialize(int nr_waveforms, bool all_prefetched=false, int first_segment=0)
       {
         state = rapid_block_state_t::READING_PART1;
         waveform_idx = 0;
         waveform_count = nr_waveforms;
+        prefetched = all_prefetched;
+        segment_offset = first_segment;
+      }
+
+      // device memory segment of the waveform we are currently reading
+      int segment() const
+      {
+        return segment_offset + waveform_idx;
       }
 
       void set_waveform_params(uint32_t offset_samps, uint32_t samples_to_read)
@@ -125,13 +175,32 @@ namespace gr {
         : range(2.0),
           offset(0.0),
           enabled(false),
-          coupling(AC_1M)
+          coupling(AC_1M),
+          interlock_min(-std::numeric_limits<float>::infinity()),
+          interlock_max(std::numeric_limits<float>::infinity()),
+          calibration_scale(1.0),
+          calibration_offset(0.0)
       {}
 
       float range;
       float offset;
       bool enabled;
       coupling_t coupling;
+
+      // low-latency interlock bounds, infinite if disabled
+      float interlock_min;
+      float interlock_max;
+
+      // value = voltage * calibration_scale - calibration_offset, applied by the driver
+      float calibration_scale;
+      float calibration_offset;
+
+      // Compares the settings applied to the device, calibration and interlocks are host-side
+      bool same_device_settings(const channel_setting_t &other) const
+      {
+        return range == other.range && offset == other.offset && enabled == other.enabled
+                && coupling == other.coupling;
+      }
     };
 
     struct port_setting_t
@@ -143,6 +212,11 @@ namespace gr {
 
       float logic_level;
       bool enabled;
+
+      bool same_device_settings(const port_setting_t &other) const
+      {
+        return logic_level == other.logic_level && enabled == other.enabled;
+      }
     };
 
     static const std::string TRIGGER_NONE_SOURCE    = "NONE";
@@ -180,47 +254,217 @@ namespace gr {
       float threshold;   // AI only
       trigger_direction_t direction;
       int pin_number;    // DI only
+
+      bool same_device_settings(const trigger_setting_t &other) const
+      {
+        return source == other.source && threshold == other.threshold
+                && direction == other.direction && pin_number == other.pin_number;
+      }
+    };
+
+    /*!
+     * \brief Configuration applied by configure (i.e. driver_configure and the application
+     * buffer setup), used to skip the reconfiguration on re-arm if nothing changed.
+     */
+    struct device_config_t
+    {
+      std::vector<channel_setting_t> channels;
+      std::vector<port_setting_t> ports;
+      trigger_setting_t trigger;
+      acquisition_mode_t acquisition_mode;
+      double samp_rate;
+      uint32_t pre_samples;
+      uint32_t post_samples;
+      uint32_t nr_captures;
+      bool overlapped_readout;
+      uint32_t buffer_size;
+      uint32_t nr_buffers;
+      uint32_t driver_buffer_size;
+      downsampling_mode_t downsampling_mode;
+      uint32_t downsampling_factor;
+
+      bool same_device_settings(const device_config_t &other) const
+      {
+        if (channels.size() != other.channels.size() || ports.size() != other.ports.size()) {
+          return false;
+        }
+        for (size_t i = 0; i < channels.size(); i++) {
+          if (!channels[i].same_device_settings(other.channels[i])) {
+            return false;
+          }
+        }
+        for (size_t i = 0; i < ports.size(); i++) {
+          if (!ports[i].same_device_settings(other.ports[i])) {
+            return false;
+          }
+        }
+        return trigger.same_device_settings(other.trigger)
+                && acquisition_mode == other.acquisition_mode && samp_rate == other.samp_rate
+                && pre_samples == other.pre_samples && post_samples == other.post_samples
+                && nr_captures == other.nr_captures && overlapped_readout == other.overlapped_readout
+                && buffer_size == other.buffer_size && nr_buffers == other.nr_buffers
+                && driver_buffer_size == other.driver_buffer_size
+                && downsampling_mode == other.downsampling_mode
+                && downsampling_factor == other.downsampling_factor;
+      }
+    };
+
+    /*!
+     * \brief Configuration as seen by the acquisition threads (the poll and the work thread).
+     *
+     * Device settings are the ones applied by the last configure, host-side settings
+     * (calibration and interlocks) the ones set last. Snapshots are immutable, a new one is
+     * published on configure and by the host-side setters, see get_config_snapshot.
+     */
+    struct config_snapshot_t
+    {
+      device_config_t config;
+      uint32_t version;     // incremented with each snapshot published, see acq_info_t
+    };
+
+    // Readers of the configuration snapshot
+    enum config_reader_t
+    {
+      CONFIG_READER_POLL = 0, // poll thread or device group, quiescent after each poll
+      CONFIG_READER_WORK,     // work thread, quiescent between work calls
+      CONFIG_READER_READOUT,  // rapid block readout thread, quiescent between acquisitions
+      CONFIG_READER_COUNT
+    };
+
+    /*!
+     * \brief Software trigger condition (streaming mode).
+     */
+    struct trigger_condition_setting_t
+    {
+      int aichan;
+      trigger_condition_t condition;
+      float lower;
+      float upper;
     };
 
     /*!
-     * \brief A simple circular buffer for keeping last N errors.
+     * \brief Single entry PMT cache, the PMT object is reused as long as the value is unchanged.
      */
-    class error_buffer_t
+    template <typename T>
+    class cached_pmt_t
     {
-      boost::circular_buffer<error_info_t> cb;
-      boost::mutex access;
+    public:
+
+      cached_pmt_t() :
+        d_valid(false),
+        d_value()
+      {
+      }
+
+      const pmt::pmt_t &get(T value)
+      {
+        if (!d_valid || value != d_value) {
+          d_value = value;
+          d_pmt = to_pmt(value);
+          d_valid = true;
+        }
+        return d_pmt;
+      }
+
+    private:
 
+      static pmt::pmt_t to_pmt(double value) { return pmt::from_double(value); }
+      static pmt::pmt_t to_pmt(uint32_t value) { return pmt::from_long(static_cast<long>(value)); }
+
+      bool d_valid;
+      T d_value;
+      pmt::pmt_t d_pmt;
+    };
+
+    /*!
+     * \brief Builds the acq_info and trigger tags attached by the work method.
+     *
+     * Same as make_acq_info_tag and make_trigger_tag (see tags.h) except that the PMT objects of
+     * fields which usually don't change between chunks (timebase, delays, status, calibration,
+     * configuration version, downsampling factor) are reused. Note PMTs are immutable, therefore
+     * a tag can be attached to any number of outputs.
+     *
+     * In case of the binary encoding the whole payload is a single blob, see tag_encoding_t.
+     */
+    class tag_builder_t
+    {
     public:
 
-      error_buffer_t(int n):
-        cb(n), access()
+      tag_builder_t() :
+        d_encoding(TAG_ENCODING_BINARY)
       {
       }
 
-      ~error_buffer_t()
+      void set_encoding(tag_encoding_t encoding)
       {
+        d_encoding = encoding;
       }
 
-      void push(error_info_t err)
+      tag_encoding_t get_encoding() const
       {
-        boost::mutex::scoped_lock lg(access);
-        cb.push_back(err);
+        return d_encoding;
       }
 
-      void push(std::error_code ec)
+      gr::tag_t make_acq_info_tag(const acq_info_t &acq_info, uint64_t offset)
       {
-        push(error_info_t{get_timestamp_nano_utc(), ec});
+        if (d_encoding == TAG_ENCODING_BINARY) {
+          gr::tag_t tag;
+          tag.key = acq_info_tag_key();
+          tag.value = encode_acq_info_blob(acq_info);
+          tag.offset = offset;
+          return tag;
+        }
+
+        gr::tag_t tag;
+        tag.key = acq_info_tag_key();
+        tag.value = pmt::make_tuple(
+                pmt::from_uint64(static_cast<uint64_t>(acq_info.timestamp)),
+                d_timebase.get(acq_info.timebase),
+                d_user_delay.get(acq_info.user_delay),
+                d_actual_delay.get(acq_info.actual_delay),
+                d_acq_status.get(acq_info.status),
+                d_scale.get(acq_info.scale),
+                d_offset.get(acq_info.offset),
+                d_config_version.get(acq_info.config_version));
+        tag.offset = offset;
+        return tag;
       }
 
-      // Note circular buffer is cleared at get
-      std::vector<error_info_t> get()
+      gr::tag_t make_trigger_tag(uint32_t downsampling_factor, int64_t timestamp, uint64_t offset, uint32_t status,
+              double trigger_offset = 0.0)
       {
-        boost::mutex::scoped_lock lg(access);
-        std::vector<error_info_t> ret;
-        ret.insert(ret.begin(), cb.begin(), cb.end());
-        cb.clear();
-        return ret;
+        if (d_encoding == TAG_ENCODING_BINARY) {
+          gr::tag_t tag;
+          tag.key = trigger_tag_key();
+          tag.value = encode_trigger_blob(downsampling_factor, timestamp, status, trigger_offset);
+          tag.offset = offset;
+          return tag;
+        }
+
+        gr::tag_t tag;
+        tag.key = trigger_tag_key();
+        tag.value = pmt::make_tuple(
+                d_downsampling_factor.get(downsampling_factor),
+                pmt::from_uint64(static_cast<uint64_t>(timestamp)),
+                d_trigger_status.get(status),
+                d_trigger_offset.get(trigger_offset));
+        tag.offset = offset;
+        return tag;
       }
+
+    private:
+
+      tag_encoding_t d_encoding;
+      cached_pmt_t<double> d_timebase;
+      cached_pmt_t<double> d_user_delay;
+      cached_pmt_t<double> d_actual_delay;
+      cached_pmt_t<uint32_t> d_acq_status;
+      cached_pmt_t<double> d_scale;
+      cached_pmt_t<double> d_offset;
+      cached_pmt_t<uint32_t> d_config_version;
+      cached_pmt_t<uint32_t> d_downsampling_factor;
+      cached_pmt_t<uint32_t> d_trigger_status;
+      cached_pmt_t<double> d_trigger_offset;
     };
 
     /*!
@@ -235,7 +479,7 @@ namespace gr {
     };
 
     // GNU Radio block implementation header
-    class digitizer_block_impl : virtual public digitizer_block
+    class digitizer_block_impl : virtual public digitizer_block, public device_group_member_t
     {
 
     /**********************************************************************
@@ -259,18 +503,99 @@ namespace gr {
 
       void set_nr_buffers(int buffer_size) override;
 
+      void set_buffer_memory_budget(size_t max_bytes) override;
+
+      size_t get_nr_allocated_buffers() override;
+
+      size_t get_buffers_high_water_mark() override;
+
+      /*!
+       * \brief Application buffer of the streaming chunks. In-process side consumers (e.g. an
+       * interlock evaluator or an archiver) register with it before start and read the chunks in
+       * place next to the work function, see app_buffer_t::add_consumer.
+       */
+      app_buffer_t &get_app_buffer();
+
+      digitizer_metrics_t get_metrics() override;
+
+      void set_metrics_interval(double interval) override;
+
+      void set_trace_interval(int chunks) override;
+
+      void set_acq_info_anchor_interval(int chunks) override;
+
+      void set_timing_realignment(bool enabled, float triggerstamp_matching_tolerance,
+              float max_buffer_time) override;
+
+      bool add_timing_event(const std::string &event_id, int64_t wr_trigger_stamp,
+              int64_t wr_trigger_stamp_utc) override;
+
       void set_driver_buffer_size(int driver_buffer_size) override;
 
+      void set_auto_buffer_tuning(double latency_target) override;
+
+      void set_zero_copy(bool enabled) override;
+
+      void set_wait_strategy(int spin_iterations, int yield_iterations) override;
+
+      void set_trigger_reserve(int nr_buffers) override;
+
+      void set_conversion_threads(int nr_threads) override;
+
+      void set_buffer_memory_policy(bool huge_pages, int numa_node) override;
+
+      void set_realtime_memory(bool enabled) override;
+
+      size_t get_locked_memory() override;
+
+      void set_poller_scheduling(const std::vector<int> &cpus, int rt_priority) override;
+
+      void set_work_thread_scheduling(const std::vector<int> &cpus, int rt_priority) override;
+
+      void set_fast_interlock(const std::string &id, double min, double max) override;
+
+      void set_fast_interlock_callback(interlock_cb_t callback, void *ptr) override;
+
+      void set_fast_interlock_latency_budget(int samples) override;
+
       void set_auto_arm(bool auto_arm) override;
 
       void set_trigger_once(bool auto_arm) override;
 
       void set_rapid_block(int nr_captures) override;
 
-      void set_streaming(double poll_rate=0.001) override;
+      void set_bulk_readout(bool enabled) override;
+
+      void set_overlapped_readout(bool enabled) override;
+
+      void set_async_readout(bool enabled) override;
+
+      void set_streaming(double poll_rate=0.001, bool adaptive=false) override;
+
+      void set_device_group(const std::string &group, double timestamp_offset=0.0) override;
+
+      void set_tag_encoding(tag_encoding_t encoding) override;
 
       void set_downsampling(downsampling_mode_t mode, int downsample_factor) override;
 
+      downsampling_mode_t get_downsampling_mode() override;
+
+      int get_downsampling_factor() override;
+
+      void set_aggregated_output(downsampling_mode_t mode, int factor) override;
+
+      aggregated_source::sptr get_aggregated_source() override;
+
+      void set_frame_output(int frame_samples) override;
+
+      frame_layout_t get_frame_layout() override;
+
+      void set_triggered_windows(bool enabled) override;
+
+      void set_packed_ports(bool enabled) override;
+
+      size_t get_packed_port_size() override;
+
       void set_aichan(const std::string &id, bool enabled, double range, coupling_t coupling, double range_offset = 0) override;
 
       /*!
@@ -280,6 +605,8 @@ namespace gr {
 
       void set_aichan_range(const std::string &id, double range, double range_offset = 0) override;
 
+      void set_aichan_calibration(const std::string &id, double scale, double offset = 0) override;
+
       void set_aichan_trigger(const std::string &id, trigger_direction_t direction, double threshold) override;
 
       void set_diport(const std::string &id, bool enabled, double thresh_voltage) override;
@@ -293,6 +620,19 @@ namespace gr {
 
       void disable_triggers() override;
 
+      void add_aichan_trigger_condition(const std::string &id, trigger_condition_t condition,
+              double lower, double upper) override;
+
+      void clear_trigger_conditions() override;
+
+      void set_trigger_logic(trigger_logic_t logic) override;
+
+      void set_trigger_pulse_width(double min_width) override;
+
+      void begin_config() override;
+
+      void commit_config() override;
+
       void initialize() override;
 
       void configure() override;
@@ -303,6 +643,20 @@ namespace gr {
 
       void disarm() override;
 
+      /*!
+       * \brief Disarms and arms the device again. The device is reconfigured only if the
+       * configuration changed since the last configure (see device_config_t), otherwise the
+       * driver is re-armed right away.
+       *
+       * Waits for the configuration transaction to be committed, if any (see begin_config).
+       */
+      void rearm();
+
+      /*!
+       * \brief Lets configuration transactions start again, see rearm.
+       */
+      void end_config_applying();
+
       void close() override;
 
       std::vector<error_info_t> get_errors();
@@ -324,7 +678,7 @@ namespace gr {
 
      protected:
 
-      digitizer_block_impl(int ai_channels, int di_ports=0, bool auto_arm=true);
+      digitizer_block_impl(int ai_channels, int di_ports=0, bool auto_arm=true, bool raw_output=false);
 
      /**********************************************************************
       * Driver interface and handlers
@@ -332,6 +686,11 @@ namespace gr {
 
       virtual std::error_code driver_initialize() = 0;
 
+      /*!
+       * \brief Applies the settings to the device. Settings already applied by the previous
+       * driver_configure may be skipped, see is_aichan_applied, is_diport_applied and
+       * is_trigger_applied.
+       */
       virtual std::error_code driver_configure() = 0;
 
       virtual std::error_code driver_arm() = 0;
@@ -342,6 +701,19 @@ namespace gr {
 
       virtual std::error_code driver_poll() = 0;
 
+      /*!
+       * \brief Blocks the poll thread until the driver has data to hand over, driver_poll is
+       * called right after. Returns after timeout_ns at the latest, such that the watchdog and
+       * state changes are still serviced if no data arrives.
+       *
+       * Drivers knowing when data is available (e.g. notified by the vendor library, or
+       * generating the data themselves) implement this instead of being polled at the
+       * configured rate. The default implementation returns std::errc::operation_not_supported,
+       * in which case the poll thread sleeps according to the poll schedule (see
+       * set_streaming). Not used for members of a device group, the group polls them.
+       */
+      virtual std::error_code driver_wait_ready(uint64_t timeout_ns);
+
       /*!
        * This function should be called when data is ready (rapid block only).
        */
@@ -356,16 +728,184 @@ namespace gr {
        */
       virtual std::error_code driver_prefetch_block(size_t length, size_t block_number) = 0;
 
+      /*!
+       * \brief Fetches all the captured blocks in a single transfer (bulk readout). Data is
+       * later on obtained via driver_get_rapid_block_data without further prefetch calls.
+       *
+       * Note length is in non-decimated samples. The default implementation returns
+       * std::errc::operation_not_supported, in which case blocks are prefetched one by one.
+       */
+      virtual std::error_code driver_prefetch_blocks(size_t length, size_t first_block, size_t nr_blocks);
+
+      /*!
+       * \brief Fetches the hardware trigger time offsets (seconds, relative to the trigger
+       * sample) of the given device memory segments in a single call, see trigger_t.
+       *
+       * Called once per rapid block acquisition, after the capture is complete. The default
+       * implementation returns std::errc::operation_not_supported, the offsets are zero then.
+       */
+      virtual std::error_code driver_get_trigger_offsets(size_t first_segment, size_t nr_segments,
+              std::vector<double> &offsets);
+
+      /*!
+       * \brief Number of device memory segments drivers should configure in rapid block mode.
+       * Twice the number of captures in case of overlapped readout.
+       */
+      uint32_t get_nr_memory_segments() const;
+
+      /*!
+       * \brief Device memory segment the next rapid block acquisition should start with.
+       */
+      uint32_t get_capture_segment() const;
+
       /*!
        * By offset and length we mean decimated samples, and offset is offset within the subparts of data.
        */
       virtual std::error_code driver_get_rapid_block_data(size_t offset, size_t length, size_t waveform,
               gr_vector_void_star &arrays, std::vector<uint32_t> &status) = 0;
 
+      /*!
+       * \brief Number of bytes a single sample of an enabled analog channel occupies within the
+       * application buffer data chunk (values and errors).
+       */
+      virtual size_t driver_chunk_sample_size() const;
+
+      /*!
+       * \brief Number of bytes of the driver buffers locked into RAM. Drivers owning buffers
+       * lock them if d_realtime_memory is set, see set_realtime_memory.
+       */
+      virtual size_t driver_locked_memory() const;
+
+      /*!
+       * \brief Transfers the data chunk into the GR output buffers (streaming mode only). The
+       * default implementation expects the memory organization described by the data_chunk_t
+       * structure, i.e. float values and errors. Drivers storing something else in the channel
+       * regions (e.g. raw ADC counts) are expected to do the conversion here.
+       */
+      virtual void driver_read_data_chunk(const app_buffer_t::data_chunk_t *chunk,
+              std::vector<float *> &ai_buffers, std::vector<float *> &ai_error_buffers,
+              std::vector<uint8_t *> &port_buffers);
+
+      /*!
+       * \brief Transfers the data chunk into the GR output buffers in raw output mode, i.e. raw
+       * ADC counts are passed through. The default implementation expects raw samples in the
+       * channel regions (see app_buffer_t::copy_raw_data_chunk).
+       */
+      virtual void driver_read_raw_data_chunk(const app_buffer_t::data_chunk_t *chunk,
+              std::vector<int16_t *> &raw_buffers, std::vector<uint8_t *> &port_buffers);
+
+      /*!
+       * \brief Returns the conversion from raw ADC counts into voltages for the given channel
+       * based on the current configuration. Used in raw output mode only.
+       */
+      virtual raw_scaling_t driver_get_raw_scaling(int channel_idx) const;
+
+      /*!
+       * \brief Returns true if the error estimate of the given channel is the same for all the
+       * samples given the current configuration. In that case the error estimate is published
+       * via the constant_error tag. The default implementation returns false.
+       */
+      virtual bool driver_get_constant_error(int channel_idx, float &error) const;
+
+      /*!
+       * \brief Returns true if no more samples are to be expected in streaming mode by design
+       * (e.g. end of a recording), the watchdog is suspended then. The default implementation
+       * returns false.
+       */
+      virtual bool driver_stream_ended() const;
+
       int work_rapid_block(int noutput_items, gr_vector_void_star &output_items);
 
+      /*!
+       * \brief Rapid block work function in case of asynchronous readout, copies out the
+       * segments read out by the readout thread.
+       */
+      int work_rapid_block_async(int noutput_items, gr_vector_void_star &output_items);
+
+      /*!
+       * \brief Waits for the next rapid block acquisition, re-arming the device first if
+       * needed. Returns 1 if the waveforms are ready, 0 if the wait failed (try again) or -1 if
+       * stop is requested or the device failed.
+       *
+       * \param first_segment device memory segment holding the first waveform
+       * \param prefetched true if all the waveforms are already fetched in bulk
+       */
+      int acquire_rapid_block(int &first_segment, bool &prefetched);
+
+      /*!
+       * \brief Hardware trigger time offset of the given waveform of the last acquisition, zero
+       * if not available.
+       */
+      double get_trigger_offset(size_t waveform) const;
+
+      /*!
+       * \brief Attaches the trigger tags of a rapid block waveform, read out at the given time,
+       * to the enabled outputs.
+       */
+      void add_rapid_block_trigger_tags(uint64_t timestamp_now_ns_utc,
+              const std::vector<uint32_t> &status, double trigger_offset, int noutputs);
+
       int work_stream(int noutput_items, gr_vector_void_star &output_items);
 
+      /*!
+       * \brief Hands the chunk just read into the output buffers (and its tags) over to the
+       * aggregated source, see set_aggregated_output.
+       */
+      void push_aggregated(int nsamples, uint64_t offset);
+
+      /*!
+       * \brief Streaming work function in case of frame output, see set_frame_output. The chunk
+       * is read into the frame scratch buffer by work_stream and copied out frame by frame.
+       */
+      int work_stream_frames(int noutput_items, gr_vector_void_star &output_items);
+
+      /*!
+       * \brief Attaches the tag to the given output, or collects it for the frame output (see
+       * attach_frame_tags). Offset is in samples.
+       */
+      void add_stream_tag(int output_idx, const gr::tag_t &tag);
+
+      /*!
+       * \brief Merges the tags collected by add_stream_tag into a single tag set and attaches it
+       * to the frame output.
+       */
+      void attach_frame_tags();
+
+      /*!
+       * \brief Streaming work function in case of triggered windows, see set_triggered_windows.
+       * The chunk is read by work_stream behind the window history, the complete windows are
+       * then copied out. A new chunk is read only once all the complete windows are delivered.
+       */
+      int work_stream_windows(int noutput_items, gr_vector_void_star &output_items);
+
+      /*!
+       * \brief Copies the complete windows out while they fit, returns the number of items.
+       */
+      int emit_windows(int noutput_items, gr_vector_void_star &output_items);
+
+      /*!
+       * \brief Output multiple in items, i.e. chunks of d_buffer_size samples (or the frames
+       * thereof).
+       */
+      void update_output_multiple();
+
+      /*!
+       * \brief Selects the output signature, i.e. the per-channel outputs, the frame output or
+       * the per-channel outputs with the ports packed into one output.
+       */
+      void update_output_signature();
+
+      /*!
+       * \brief Number of outputs of the digital ports, that is one per enabled port or the single
+       * packed output.
+       */
+      int get_port_outputs() const;
+
+      /*!
+       * \brief Packs the enabled ports read into d_packed_port_buffers into the packed output.
+       */
+      void pack_ports(void *output, int nsamples);
+
      /**********************************************************************
       * Helpers
       **********************************************************************/
@@ -381,6 +921,57 @@ namespace gr {
 
       uint32_t get_block_size_with_downsampling() const;
 
+      /*!
+       * \brief Returns the current configuration, see device_config_t.
+       */
+      device_config_t get_device_config() const;
+
+      /*!
+       * \brief Returns the configuration snapshot, to be used by the poll and the work thread
+       * (including the conversion tasks run by the poll thread) instead of the settings members.
+       *
+       * Read lock-free, the snapshot remains valid until the end of the current poll or work
+       * call. Don't keep it beyond.
+       */
+      const config_snapshot_t &get_config_snapshot() const
+      {
+        return *d_config_snapshot.read();
+      }
+
+      /*!
+       * \brief Returns true if the device settings of the given channel are known to be applied
+       * to the device already, i.e. driver_configure doesn't need to set the channel up again.
+       */
+      bool is_aichan_applied(int aichan) const;
+
+      /*!
+       * \brief Same as is_aichan_applied, for the given digital port.
+       */
+      bool is_diport_applied(int port) const;
+
+      /*!
+       * \brief Same as is_aichan_applied, for the trigger. Trigger thresholds might depend on
+       * the channel ranges, therefore the channels need to be unchanged as well.
+       */
+      bool is_trigger_applied() const;
+
+      /*!
+       * \brief Publishes a new configuration snapshot, see config_snapshot_t.
+       */
+      void publish_config();
+
+      /*!
+       * \brief Sets up the classification of streaming chunks for the trigger reserve, called on
+       * arm.
+       */
+      void configure_priority_tracking();
+
+      /*!
+       * \brief Number of output ports per analog channel, that is values and errors or a single
+       * raw output in raw output mode.
+       */
+      int get_outputs_per_channel() const;
+
       int convert_to_aichan_idx(const std::string &id) const;
 
       int convert_to_port_idx(const std::string &id) const;
@@ -398,14 +989,64 @@ namespace gr {
        */
       std::vector<int> find_analog_triggers(float const * const samples, int nsamples);
 
+      /*!
+       * \brief Same as above but for raw ADC samples (raw output mode), the trigger threshold
+       * is converted into ADC counts instead of converting samples into voltages.
+       */
+      std::vector<int> find_analog_triggers(int16_t const * const samples, int nsamples,
+              const raw_scaling_t &scaling);
+
       std::vector<int> find_digital_triggers(uint8_t const * const samples, int nsamples, uint8_t pin_mask);
 
+      /*!
+       * \brief Same as above but for packed ports (see set_packed_ports), the mask selects the
+       * pin within the packed words.
+       */
+      std::vector<int> find_digital_triggers(uint16_t const * const samples, int nsamples, uint16_t pin_mask);
+
+      std::vector<int> find_digital_triggers(uint32_t const * const samples, int nsamples, uint32_t pin_mask);
+
+      /*!
+       * \brief Evaluates trigger conditions over the streaming output buffers. It returns
+       * relative offsets of all detected triggers.
+       */
+      std::vector<int> find_condition_triggers(gr_vector_void_star &output_items, int nsamples);
+
       /*!
        * \brief Poll worker function. The thread exits if stop is requested or call to driver_poll
        * returns with error.
        */
       void poll_work_function();
 
+      /*!
+       * \brief Single iteration of the poller state machine, executed either by the dedicated
+       * poll thread or by the device group. Returns false if polling should stop.
+       */
+      bool poll_iteration();
+
+      // Device group member interface (see device_group.h)
+      bool group_poll() override;
+
+      double group_poll_period() const override;
+
+      void group_thread_started() override;
+
+      /*!
+       * \brief Readout worker function (asynchronous rapid block readout). The thread exits if
+       * stop is requested or the device fails, the work function is notified about it.
+       */
+      void readout_work_function();
+
+      /*!
+       * \brief Starts the readout thread if it isn't running yet.
+       */
+      void start_readout_thread();
+
+      /*!
+       * \brief Interrupts & joins the readout thread.
+       */
+      void stop_readout_thread();
+
       /*!
        * \brief Start the poller thread if it isn't running yet.
        */
@@ -428,16 +1069,131 @@ namespace gr {
       void transit_poll_thread_to_running();
 
       /*!
-       * \brief Add error code to the circular buffer. Clients are able to read last N error
+       * \brief Add error code to the event log. Clients are able to read last N error
        * codes together with timestamps by using the get_errors method.
        *
        * This method is meant to be used by the digitizer class-level code and all the driver
        * implementations.
        *
-       * This method is thread safe.
+       * This method is thread safe and wait-free.
        */
       void add_error_code(std::error_code ec);
 
+      /*!
+       * \brief Records a diagnostic event, logged rate limited by a background thread. Use
+       * this instead of GR_LOG_* on the acquisition path (poll thread, streaming callback).
+       *
+       * This method is thread safe and wait-free.
+       */
+      void add_event(event_kind_t kind, std::error_code ec = std::error_code{}, uint64_t count = 1);
+
+      /*!
+       * \brief Applies CPU affinity and real-time priority to the calling thread. On failure the
+       * error is recorded and the scheduling status flag is raised.
+       */
+      void apply_thread_scheduling(const std::vector<int> &cpus, int rt_priority, const std::string &thread);
+
+      /*!
+       * \brief Returns CHANNEL_STATUS_THREAD_SCHEDULING_FAILED if any of the scheduling requests
+       * failed, zero otherwise.
+       */
+      uint32_t get_scheduling_status() const;
+
+      /*!
+       * \brief Accounts the time spent converting raw samples, see get_metrics.
+       *
+       * This method is meant to be called by the driver implementations from the poll thread.
+       */
+      void record_conversion_time(uint64_t duration_ns, uint64_t nr_samples);
+
+      /*!
+       * \brief Returns timestamp (UTC nanoseconds) to be assigned to a data chunk. The group
+       * clock plus the device offset is used if the device is part of a device group.
+       */
+      uint64_t get_chunk_timestamp_ns() const;
+
+      /*!
+       * \brief Feeds the sample clock model, sample_count samples were received (since arm) by
+       * host_time_ns. Meant to be called by the drivers from the poll thread.
+       */
+      void update_sample_clock(uint64_t sample_count, uint64_t host_time_ns);
+
+      /*!
+       * \brief Returns modeled timestamp (UTC nanoseconds) of the given sample (since arm).
+       */
+      uint64_t get_sample_timestamp_ns(uint64_t sample) const;
+
+      /*!
+       * \brief Returns true if a low-latency interlock is set for the given channel.
+       */
+      bool has_fast_interlock(int channel_idx) const
+      {
+        const auto &settings = get_config_snapshot().config.channels[channel_idx];
+        return !std::isinf(settings.interlock_min) || !std::isinf(settings.interlock_max);
+      }
+
+      /*!
+       * \brief Returns the max number of samples to convert before the low-latency interlocks
+       * are evaluated, zero if not limited.
+       */
+      uint32_t get_fast_interlock_budget() const
+      {
+        return d_fast_interlock_budget;
+      }
+
+      /*!
+       * \brief Evaluates the low-latency interlock of the given channel on freshly converted
+       * values, first_sample is the index (since arm) of the first value. The interlock state is
+       * kept between calls.
+       *
+       * This method is meant to be called by the driver implementations from the poll thread.
+       */
+      void evaluate_fast_interlock(int channel_idx, const float *values, uint32_t nsamples,
+              uint64_t first_sample);
+
+      /*!
+       * \brief Returns true if the streaming chunks are to be classified for the trigger reserve
+       * (see set_trigger_reserve). The raw samples of the trigger source are those of the analog
+       * channel get_priority_channel() or, if negative, of the digital port get_priority_port()
+       * with the pins in the low byte.
+       */
+      bool is_priority_tracking() const
+      {
+        return d_priority_tracker.is_enabled();
+      }
+
+      int get_priority_channel() const
+      {
+        return d_priority_channel;
+      }
+
+      int get_priority_port() const
+      {
+        return d_priority_port;
+      }
+
+      /*!
+       * \brief Searches the raw samples of the trigger source for triggers, first_sample is the
+       * index (since arm) of the first sample. To be called with the samples of a callback before
+       * its chunks are classified, see is_priority_chunk.
+       *
+       * This method is meant to be called by the driver implementations from the poll thread.
+       */
+      void scan_priority_samples(const int16_t *raw, uint32_t nsamples, uint64_t first_sample)
+      {
+        d_priority_tracker.scan(raw, nsamples, first_sample);
+      }
+
+      /*!
+       * \brief Returns true if the chunk starting with the given sample (since arm) is to be
+       * taken from the trigger reserve, see app_buffer_t::get_free_data_chunk. All chunks are
+       * priority chunks unless tracking.
+       */
+      bool is_priority_chunk(uint64_t first_sample)
+      {
+        return !d_priority_tracker.is_enabled() || d_priority_tracker.is_priority(first_sample, d_buffer_size);
+      }
+
     /**********************************************************************
      * Members
      *********************************************************************/
@@ -456,6 +1212,29 @@ namespace gr {
 
       // Number of captures in rapid block mode
       uint32_t d_nr_captures;
+      bool d_bulk_readout;
+
+      // Hardware trigger time offsets of the waveforms of the last acquisition (seconds), empty
+      // if the driver doesn't provide them. Used by the thread reading the waveforms out.
+      std::vector<double> d_trigger_offsets;
+
+      // Overlapped rapid block readout, captures alternate between two halves of the device
+      // memory. Capture segment is the first segment of the half used by the next acquisition.
+      bool d_overlapped_readout;
+      uint32_t d_capture_segment;
+      bool d_rearmed;
+
+      // Asynchronous rapid block readout. The readout thread fills the segment buffers, one
+      // waveform each with regions for all the channels and ports (enabled or not), and the
+      // work function copies them out.
+      bool d_async_readout;
+      boost::thread d_readout_thread;
+      app_buffer_t d_readout_buffer;
+      size_t d_readout_samples;     // samples per segment, used by the readout thread only
+      size_t d_readout_nr_segments;
+      const app_buffer_t::data_chunk_t *d_readout_segment;  // being copied out, work thread only
+      size_t d_readout_offset;
+      uint32_t d_readout_waveforms; // copied out since start
 
       // Buffer size and number of buffers in streaming mode
       uint32_t d_buffer_size;
@@ -463,8 +1242,56 @@ namespace gr {
 
       uint32_t d_driver_buffer_size;
 
+      // Application buffer memory budget in bytes, zero for a fixed-size pool
+      size_t d_buffer_memory_budget;
+
+      // Raw samples are converted in the work thread directly into the GR output buffers
+      bool d_zero_copy;
+
+      // Raw ADC counts (int16_t) are passed through instead of values and errors
+      bool d_raw_output;
+
+      // Wait strategy of the work thread (see app_buffer_t::set_wait_strategy)
+      int d_spin_iterations;
+      int d_yield_iterations;
+
+      // Application buffers reserved for chunks around triggers, see set_trigger_reserve
+      uint32_t d_trigger_reserve;
+
+      // Workers used by drivers to convert raw samples of multiple channels in parallel
+      int d_conversion_threads;
+      conversion_pool_t d_conversion_pool;
+
+      // Low-latency interlocks evaluated by the poll thread, the bounds are part of the channel
+      // settings
+      interlock_cb_t d_fast_interlock_callback;
+      void *d_fast_interlock_user_data;
+      uint32_t d_fast_interlock_budget;
+      std::array<bool, MAX_SUPPORTED_AI_CHANNELS> d_fast_interlock_issued;
+      std::vector<uint32_t> d_fast_interlock_words;
+
+      // Application buffer memory policy
+      bool d_buffer_huge_pages;
+      int d_buffer_numa_node;
+
+      // Real-time memory mode (see set_realtime_memory), bytes locked on arm and start. The
+      // scratch buffers below are mapped regions of their own, i.e. locking them doesn't lock
+      // heap pages of others and unmapping them on the next arm unlocks them.
+      bool d_realtime_memory;
+      std::atomic<size_t> d_scratch_locked_bytes;
+      std::atomic<size_t> d_output_locked_bytes;
+
+      // Thread scheduling (affinity and SCHED_FIFO priority)
+      std::vector<int> d_poller_cpus;
+      int d_poller_rt_priority;
+      std::vector<int> d_work_thread_cpus;
+      int d_work_thread_rt_priority;
+      bool d_work_thread_scheduling_applied;
+      std::atomic<bool> d_scheduling_failed;
+
       acquisition_mode_t d_acquisition_mode;
       double d_poll_rate;
+      bool d_adaptive_polling;
       downsampling_mode_t d_downsampling_mode;
       uint32_t d_downsampling_factor;
 
@@ -477,20 +1304,29 @@ namespace gr {
       std::array<port_setting_t, MAX_SUPPORTED_PORTS> d_port_settings;
       trigger_setting_t d_trigger_settings;
 
+      // Software trigger conditions, take precedence over trigger settings if not empty
+      std::vector<trigger_condition_setting_t> d_trigger_conditions;
+      trigger_logic_t d_trigger_logic;
+      double d_trigger_pulse_width;
+
       std::vector<uint32_t> d_status;
 
       // application buffer
       app_buffer_t d_app_buffer;
 
-      // watchdog
-      using hr_time_point = boost::chrono::high_resolution_clock::time_point;
+      // Watchdog, driven by d_samples_received and checked by the poll thread
+      stream_watchdog_t d_watchdog;
 
-      // For samp_rate estimation
-      hr_time_point d_last_callback_timestamp;
-      bool d_was_last_callback_timestamp_taken;
+      // Streaming chunk timestamps are derived from the sample counter, see update_sample_clock.
+      // Drivers count the samples received since arm.
+      sample_clock_model_t d_sample_clock;
+      uint64_t d_samples_received;
 
-      average_filter<float> d_estimated_sample_rate;
-      boost::mutex d_watchdog_mutex;
+      // Classification of the streaming chunks, configured on arm and used by the poll thread,
+      // see is_priority_chunk
+      chunk_priority_tracker_t d_priority_tracker;
+      int d_priority_channel;
+      int d_priority_port;
 
       // Flags
       bool d_initialized;
@@ -500,15 +1336,20 @@ namespace gr {
       bool d_trigger_once;
       bool d_was_triggered_once;
       bool d_timebase_published;
+      bool d_raw_scaling_published;
+      bool d_constant_error_published;
 
 
       // copy analog channel data array addresses to local application reference for enabled channels
       std::vector<float *> ai_buffers;
       std::vector<float *> ai_error_buffers;
+      std::vector<int16_t *> raw_buffers;
 
       // copy digital channel data array addresses to local application reference for enabled ports
       std::vector<uint8_t *> port_buffers;
 
+      block_stats_recorder_t d_stats {this};
+
      private:
 
       // Acquisition, note boost constructs are used in order for the GR
@@ -523,26 +1364,156 @@ namespace gr {
 
       int d_trigger_state;
 
-      std::vector<std::vector<float>> d_ai_buffers;
-      std::vector<std::vector<float>> d_ai_error_buffers;
-      std::vector<std::vector<uint8_t>> d_port_buffers;
+      // Software-based analog trigger detection
+      hysteresis_trigger_search_t<float> d_analog_trigger_search;
+      hysteresis_trigger_search_t<int16_t> d_raw_trigger_search;
+      condition_trigger_search_t d_condition_trigger_search;
 
-      // A vector holding status information for pre-trigger number of samples located in
-      // the buffer
-      std::vector<uint32_t> d_status_pre;
+      // Errors (see get_errors) and rate limited diagnostics
+      event_log_t d_events;
 
-      int d_read_idx;
-      uint32_t d_buffer_samples;
+      // Formats the drained events, called by the event log consumer
+      void log_event(const event_record_t &record, uint64_t suppressed);
 
-      error_buffer_t d_errors;
+      // Used by the work thread only
+      tag_builder_t d_tag_builder;
 
       // Poller
       boost::thread d_poller;
-      poller_state_t d_poller_state;
+      std::atomic<poller_state_t> d_poller_state;
       boost::mutex d_poller_mutex;
       boost::condition_variable d_poller_cv;
 
+      // Poll deadlines, reset on arm and used by the poll thread only
+      poll_scheduler_t d_poll_scheduler;
+
+      // Automatic driver buffer sizing, the tuner is reset on arm and used by the poll thread
+      // only. The tuned size is handed over to the work thread, see Retune.
+      double d_buffer_latency_target;
+      buffer_tuner_t d_buffer_tuner;
+      std::atomic<uint32_t> d_tuned_driver_buffer_size;
+
+      // Device group, the group is replaced only when the poller is (re)started
+      std::string d_device_group_name;
+      int64_t d_device_group_offset_ns;
+      std::shared_ptr<device_group_t> d_device_group;
+      bool d_device_group_registered;
+
       std::string d_configure_exception_message;
+
+      // Configuration applied by the last configure, see rearm
+      device_config_t d_applied_config;
+
+      // Configuration snapshot read by the acquisition threads, publishers are serialized by
+      // the mutex (configure runs on the work thread on re-arm)
+      rcu_snapshot_t<config_snapshot_t, CONFIG_READER_COUNT> d_config_snapshot;
+      boost::mutex d_config_mutex;
+      uint32_t d_config_version;
+
+      // Configuration transaction, see begin_config. Flags are guarded by d_config_mutex, the
+      // condition variable signals changes of either.
+      bool d_config_transaction;
+      bool d_config_applying;       // rearm in progress, transactions start once it's done
+      boost::condition_variable d_config_cv;
+
+      // Settings known to be applied to the device by the last driver_configure, empty if
+      // unknown (e.g. the device has just been opened or the last configure failed)
+      device_config_t d_driver_config;
+
+      // Metrics, updated lock-free by the poll and the work thread
+      std::atomic<uint64_t> d_metrics_lost_buffers;
+      std::array<std::atomic<uint64_t>, digitizer_metrics_t::LATENCY_HISTOGRAM_SIZE> d_metrics_latency_histogram;
+      std::atomic<uint64_t> d_metrics_conversion_ns;
+      std::atomic<uint64_t> d_metrics_conversion_samples;
+      std::atomic<float> d_metrics_estimated_samp_rate;
+      std::atomic<double> d_metrics_clock_samp_rate;
+      std::atomic<double> d_metrics_timestamp_error_ns;
+      std::atomic<uint64_t> d_metrics_fast_interlocks;
+      std::atomic<uint64_t> d_metrics_fast_interlock_latency_ns;
+      std::atomic<uint64_t> d_metrics_max_fast_interlock_latency_ns;
+      std::atomic<uint32_t> d_metrics_driver_buffer_size;
+      std::atomic<uint32_t> d_metrics_recommended_buffer_size;
+      std::atomic<uint64_t> d_metrics_max_poll_gap_ns;
+
+      // Metrics message port publishing interval, zero disables publishing
+      double d_metrics_interval;
+      uint64_t d_metrics_last_published_ns;
+
+      void reset_metrics();
+
+      void publish_metrics();
+
+      // Trace tag injection, zero disables tracing
+      int d_trace_interval;
+      uint64_t d_trace_chunk_count;
+
+      // Delta emission of the acq_info tags, zero disables it. The content last attached is
+      // kept per output.
+      int d_acq_info_anchor_interval;
+      uint64_t d_acq_info_chunk_count;
+      std::vector<acq_info_t> d_acq_info_attached;
+
+      /*!
+       * \brief Returns true if the acq_info tag needs to be attached to the output, i.e. on
+       * anchor chunks or if the content changed.
+       */
+      bool acq_info_due(int output_idx, const acq_info_t &info, bool anchor);
+
+      // Realignment of the trigger tags to WR events (see set_timing_realignment), the
+      // triggers forwarded are pending in the realigner
+      bool d_timing_realignment;
+      trigger_realigner_t d_realigner;
+
+      /*!
+       * \brief Attaches the realignment tags of the triggers resolved so far to the outputs
+       * carrying triggers, within the given output range.
+       */
+      void realign_triggers(uint64_t first_offset, uint64_t end_offset);
+
+      // Aggregated stream (see set_aggregated_output), acq_info and trigger tags of the current
+      // chunk are collected per channel
+      boost::shared_ptr<aggregated_source_impl> d_aggregated_source;
+      std::vector<std::vector<gr::tag_t>> d_aggregated_tags;
+      std::vector<float *> d_aggregated_values;
+      std::vector<float *> d_aggregated_errors;
+
+      // Frame output (see set_frame_output), zero samples if disabled. A chunk is read into the
+      // scratch buffer, laid out as a single frame of d_buffer_size samples, the items point at
+      // its regions in the order of the per-channel outputs. Tags of the chunk are collected and
+      // merged, see attach_frame_tags.
+      frame_layout_t d_frame_layout;
+      gr::io_signature::sptr d_channel_output_signature;
+      chunk_memory_t d_frame_scratch;
+      gr_vector_void_star d_frame_items;
+      std::vector<gr::tag_t> d_frame_tags;
+
+      // Window awaiting its post-trigger samples or output space, the trigger is counted in
+      // acquired samples. The acq_info tags are those of the chunk holding the trigger.
+      struct trigger_window_t
+      {
+        uint64_t trigger;
+        gr::tag_t trigger_tag;
+        std::vector<std::pair<int, gr::tag_t>> acq_info_tags;
+      };
+
+      // Triggered windows (see set_triggered_windows). Each output has a history of pre + post
+      // samples followed by the chunk, the items point at the chunk regions. Tags of the chunk
+      // are collected along with their output index.
+      bool d_triggered_windows;
+      uint64_t d_window_acquired;
+      chunk_memory_t d_window_memory;
+      std::vector<uint8_t *> d_window_history;    // per output, within d_window_memory
+      std::vector<size_t> d_window_item_sizes;
+      gr_vector_void_star d_window_items;
+      std::vector<std::pair<int, gr::tag_t>> d_window_tags;
+      std::deque<trigger_window_t> d_pending_windows;
+
+      // Packed ports (see set_packed_ports), zero if disabled. The enabled ports are read into
+      // the scratch buffer and packed into the single port output afterwards.
+      size_t d_packed_port_size;
+      chunk_memory_t d_packed_port_scratch;
+      std::vector<uint8_t *> d_packed_port_buffers;
+      std::vector<int> d_packed_port_shifts;
     };
 
   } // namespace digitizers
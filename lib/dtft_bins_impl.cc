@@ -0,0 +1,518 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gnuradio/io_signature.h>
+#include "dtft_bins_impl.h"
+#include "goertzel_kernel.h"
+
+#include <volk/volk.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstring>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+namespace gr {
+  namespace digitizers {
+
+    namespace {
+
+      // Shortest of a few runs, i.e. without the outliers caused by interrupts and the like
+      template<typename Function>
+      double
+      min_time_ns(Function function, int runs)
+      {
+        double best = std::numeric_limits<double>::max();
+        for (int i = 0; i < runs; i++) {
+          auto start = std::chrono::steady_clock::now();
+          function();
+          auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start);
+          best = std::min(best, elapsed.count());
+        }
+        return best;
+      }
+
+      dtft_cost_model_t
+      calibrate()
+      {
+        const int nsamples = 1024;
+        const int nbins = 64;
+        const int fft_size = 4096;
+        const int runs = 16;
+
+        dtft_cost_model_t model;
+
+        std::vector<float> samples(nsamples);
+        for (int i = 0; i < nsamples; i++) {
+          samples[i] = std::sin(0.1 * i);
+        }
+        std::vector<float> window(nsamples, 1.0f);
+        std::vector<double> coeffs(goertzel_padded_bins(nbins), 1.0);
+        std::vector<double> d1(goertzel_padded_bins(nbins));
+        std::vector<double> d2(goertzel_padded_bins(nbins));
+        model.goertzel_ns = min_time_ns([&]() {
+          goertzel_bins(&samples[0], &window[0], nsamples, &coeffs[0], nbins, &d1[0], &d2[0]);
+        }, runs) / (static_cast<double>(nsamples) * goertzel_padded_bins(nbins));
+
+        gr::fft::fft_complex fft(fft_size, true);
+        std::fill(fft.get_inbuf(), fft.get_inbuf() + fft_size, gr_complex(0.5f, -0.5f));
+        model.fft_ns = min_time_ns([&]() {
+          fft.execute();
+        }, runs) / (fft_size * std::log2(fft_size));
+
+        std::vector<gr_complex> a(fft_size, gr_complex(0.5f, 0.5f));
+        std::vector<gr_complex> b(fft_size, gr_complex(0.5f, -0.5f));
+        std::vector<gr_complex> c(fft_size);
+        model.multiply_ns = min_time_ns([&]() {
+          volk_32fc_x2_multiply_32fc(&c[0], &a[0], &b[0], fft_size);
+        }, runs) / fft_size;
+
+        return model;
+      }
+
+      int
+      next_power_of_two(int n)
+      {
+        int size = 1;
+        while (size < n) {
+          size <<= 1;
+        }
+        return size;
+      }
+
+    } // namespace
+
+    const dtft_cost_model_t &
+    dtft_cost_model_t::get()
+    {
+      static const dtft_cost_model_t model = calibrate();
+      return model;
+    }
+
+    double
+    dtft_cost_model_t::goertzel_cost(int window_size, int nbins) const
+    {
+      return goertzel_ns * window_size * goertzel_padded_bins(nbins);
+    }
+
+    double
+    dtft_cost_model_t::grid_fft_cost(int window_size, int grid_size, int nbins) const
+    {
+      // a real FFT costs about half of a complex one, the window is copied and multiplied
+      return 0.5 * fft_ns * grid_size * std::log2(grid_size)
+          + multiply_ns * (0.5 * grid_size + window_size + nbins);
+    }
+
+    double
+    dtft_cost_model_t::chirp_z_cost(int window_size, int nbins) const
+    {
+      const int size = next_power_of_two(window_size + nbins - 1);
+      return 2.0 * fft_ns * size * std::log2(size) + multiply_ns * (window_size + size + nbins);
+    }
+
+    int
+    dtft_bins_t::grid_fft_size(int window_size, double samp_rate, double fq_low, double fq_step, int nbins)
+    {
+      if (fq_step <= 0.0 || fq_low < 0.0) {
+        return 0;
+      }
+
+      // the bins are a subset of the bins of a size points FFT, size a multiple of period
+      const double period = samp_rate / fq_step;
+      const double first = fq_low / fq_step;
+      if (std::abs(period - std::round(period)) > 1e-9 * period
+              || std::abs(first - std::round(first)) > 1e-6 || period > MAX_GRID_FFT_SIZE) {
+        return 0;
+      }
+
+      const int64_t step = static_cast<int64_t>(std::round(period));
+      const int64_t size = (window_size + step - 1) / step * step;
+      const int64_t last = (static_cast<int64_t>(std::round(first)) + nbins - 1) * (size / step);
+      if (size > MAX_GRID_FFT_SIZE || last > size / 2) {
+        return 0;
+      }
+
+      return static_cast<int>(size);
+    }
+
+    dtft_bins_t::dtft_bins_t(int window_size, double samp_rate, double fq_low, double fq_step, int nbins,
+            stft_algorithm_id_t algorithm, bool complex_input)
+      : d_window_size(window_size),
+        d_nbins(nbins),
+        d_complex_input(complex_input),
+        d_samp_rate(samp_rate),
+        d_fq_low(fq_low),
+        d_fq_step(fq_step),
+        d_requested(algorithm),
+        d_active(GOERTZEL),
+        d_ones(window_size, 1.0f),
+        d_coeffs(goertzel_padded_bins(nbins)),
+        d_sines(nbins),
+        d_d1(goertzel_padded_bins(nbins)),
+        d_d2(goertzel_padded_bins(nbins)),
+        d_grid_size(0),
+        d_grid_first(0),
+        d_grid_stride(1),
+        d_chirp_size(next_power_of_two(window_size + nbins - 1)),
+        d_post(nbins)
+    {
+      if (window_size < 1 || nbins < 1 || samp_rate <= 0.0) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid window size, sample rate or number of bins";
+        throw std::invalid_argument(message.str());
+      }
+      if (algorithm != FFT && algorithm != GOERTZEL && algorithm != AUTO) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": algorithm must be FFT, GOERTZEL or AUTO, is: " << algorithm;
+        throw std::invalid_argument(message.str());
+      }
+
+      if (complex_input) {
+        d_real.resize(window_size);
+        d_imag.resize(window_size);
+        d_imag_bins.resize(nbins);
+      }
+
+      update();
+    }
+
+    void
+    dtft_bins_t::set_samp_rate(double samp_rate)
+    {
+      d_samp_rate = samp_rate;
+      update();
+    }
+
+    void
+    dtft_bins_t::set_freqs(double fq_low, double fq_step)
+    {
+      d_fq_low = fq_low;
+      d_fq_step = fq_step;
+      update();
+    }
+
+    void
+    dtft_bins_t::set_algorithm(stft_algorithm_id_t algorithm)
+    {
+      if (algorithm != FFT && algorithm != GOERTZEL && algorithm != AUTO) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": algorithm must be FFT, GOERTZEL or AUTO, is: " << algorithm;
+        throw std::invalid_argument(message.str());
+      }
+
+      d_requested = algorithm;
+      update();
+    }
+
+    void
+    dtft_bins_t::update()
+    {
+      // bin frequencies in radians per sample
+      const double w0 = 2.0 * M_PI * d_fq_low / d_samp_rate;
+      const double dw = 2.0 * M_PI * d_fq_step / d_samp_rate;
+
+      for (int i = 0; i < d_nbins; i++) {
+        const double w = w0 + i * dw;
+        d_coeffs[i] = 2.0 * std::cos(w);
+        d_sines[i] = std::sin(w);
+      }
+
+      // the real FFT has no negative bins
+      d_grid_size = d_complex_input ? 0 : grid_fft_size(d_window_size, d_samp_rate, d_fq_low, d_fq_step, d_nbins);
+
+      if (d_requested == AUTO) {
+        const auto &model = dtft_cost_model_t::get();
+        const double fft_cost = d_grid_size
+            ? model.grid_fft_cost(d_window_size, d_grid_size, d_nbins)
+            : model.chirp_z_cost(d_window_size, d_nbins);
+        const double goertzel_cost = (d_complex_input ? 2.0 : 1.0) * model.goertzel_cost(d_window_size, d_nbins);
+        d_active = fft_cost < goertzel_cost ? FFT : GOERTZEL;
+      }
+      else {
+        d_active = d_requested;
+      }
+
+      if (d_active == FFT) {
+        if (d_grid_size) {
+          prepare_grid_fft();
+        }
+        else {
+          prepare_chirp_z(w0, dw);
+        }
+      }
+    }
+
+    void
+    dtft_bins_t::prepare_grid_fft()
+    {
+      if (!d_engine || d_engine->fft_size() != d_grid_size) {
+        d_engine = fft_engine_t::get(d_grid_size);
+        d_frame.assign(d_grid_size, 0.0f);
+        d_grid_window.assign(d_grid_size, 1.0f);
+      }
+
+      d_grid_stride = static_cast<int>(std::round(d_grid_size * d_fq_step / d_samp_rate));
+      d_grid_first = static_cast<int>(std::round(d_grid_size * d_fq_low / d_samp_rate));
+      d_spectrum.resize(d_grid_first + (d_nbins - 1) * d_grid_stride + 1);
+
+      // exp(j w N) / N, with w the frequency of the grid bin
+      for (int i = 0; i < d_nbins; i++) {
+        const double w = 2.0 * M_PI * (d_grid_first + i * d_grid_stride) / d_grid_size;
+        d_post[i] = gr_complex(std::polar(1.0 / d_window_size, w * d_window_size));
+      }
+    }
+
+    void
+    dtft_bins_t::prepare_chirp_z(double w0, double dw)
+    {
+      // X[k] = sum_n x[n] exp(-j (w0 + k dw) n), with n k = (n^2 + k^2 - (k - n)^2) / 2
+      //      = exp(-j dw k^2 / 2) * sum_n (x[n] exp(-j (w0 n + dw n^2 / 2))) exp(j dw (k - n)^2 / 2)
+      // i.e. a convolution with a chirp, done by FFTs of size L >= N + nbins - 1
+      const int size = d_chirp_size;
+      if (!d_chirp_fwd) {
+        d_chirp_fwd.reset(new gr::fft::fft_complex(size, true));
+        d_chirp_inv.reset(new gr::fft::fft_complex(size, false));
+        d_chirp_pre.resize(d_window_size);
+        d_chirp_kernel.resize(size);
+      }
+
+      for (int n = 0; n < d_window_size; n++) {
+        d_chirp_pre[n] = gr_complex(std::polar(1.0, -(w0 * n + 0.5 * dw * n * static_cast<double>(n))));
+      }
+
+      // chirp for the lags -(N - 1) ... nbins - 1, negative ones wrapped around
+      gr_complex *kernel = d_chirp_fwd->get_inbuf();
+      std::fill(kernel, kernel + size, gr_complex(0.0f, 0.0f));
+      for (int m = 0; m < d_nbins; m++) {
+        kernel[m] = gr_complex(std::polar(1.0, 0.5 * dw * m * static_cast<double>(m)));
+      }
+      for (int m = 1; m < d_window_size; m++) {
+        kernel[size - m] = gr_complex(std::polar(1.0, 0.5 * dw * m * static_cast<double>(m)));
+      }
+      d_chirp_fwd->execute();
+      memcpy(&d_chirp_kernel[0], d_chirp_fwd->get_outbuf(), size * sizeof(gr_complex));
+
+      // exp(-j dw k^2 / 2) of the chirp-z transform, exp(j w N) / N of goertzel_fc and 1 / L
+      // of the inverse FFT
+      for (int k = 0; k < d_nbins; k++) {
+        const double w = w0 + k * dw;
+        d_post[k] = gr_complex(std::polar(1.0 / (static_cast<double>(d_window_size) * size),
+                w * d_window_size - 0.5 * dw * k * static_cast<double>(k)));
+      }
+    }
+
+    void
+    dtft_bins_t::goertzel(const float *in, gr_complex *out)
+    {
+      // exp(j w) * y[N-1] - y[N-2] equals the sum over the window
+      goertzel_bins(in, &d_ones[0], d_window_size, &d_coeffs[0], d_nbins, &d_d1[0], &d_d2[0]);
+
+      const double scale = 1.0 / d_window_size;
+      for (int i = 0; i < d_nbins; i++) {
+        out[i] = gr_complex((0.5 * d_coeffs[i] * d_d1[i] - d_d2[i]) * scale, d_sines[i] * d_d1[i] * scale);
+      }
+    }
+
+    void
+    dtft_bins_t::grid_fft(const float *in, gr_complex *out)
+    {
+      // the padding stays zero
+      memcpy(&d_frame[0], in, d_window_size * sizeof(float));
+      d_engine->execute(&d_frame[0], 1, &d_grid_window[0], static_cast<int>(d_spectrum.size()), &d_spectrum[0]);
+
+      for (int i = 0; i < d_nbins; i++) {
+        out[i] = d_spectrum[d_grid_first + i * d_grid_stride] * d_post[i];
+      }
+    }
+
+    void
+    dtft_bins_t::chirp_z(gr_complex *out)
+    {
+      const int size = d_chirp_size;
+
+      gr_complex *chirped = d_chirp_fwd->get_inbuf();
+      std::fill(chirped + d_window_size, chirped + size, gr_complex(0.0f, 0.0f));
+      d_chirp_fwd->execute();
+
+      volk_32fc_x2_multiply_32fc(d_chirp_inv->get_inbuf(), d_chirp_fwd->get_outbuf(), &d_chirp_kernel[0], size);
+      d_chirp_inv->execute();
+
+      volk_32fc_x2_multiply_32fc(out, d_chirp_inv->get_outbuf(), &d_post[0], d_nbins);
+    }
+
+    void
+    dtft_bins_t::compute(const float *in, gr_complex *out)
+    {
+      if (d_active == GOERTZEL) {
+        goertzel(in, out);
+      }
+      else if (d_grid_size) {
+        grid_fft(in, out);
+      }
+      else {
+        volk_32fc_32f_multiply_32fc(d_chirp_fwd->get_inbuf(), &d_chirp_pre[0], in, d_window_size);
+        chirp_z(out);
+      }
+    }
+
+    void
+    dtft_bins_t::compute(const gr_complex *in, gr_complex *out)
+    {
+      if (d_active == GOERTZEL) {
+        // linear in the input, i.e. the bins of the real part plus j times those of the imaginary one
+        volk_32fc_deinterleave_32f_x2(&d_real[0], &d_imag[0], in, d_window_size);
+        goertzel(&d_real[0], out);
+        goertzel(&d_imag[0], &d_imag_bins[0]);
+        for (int i = 0; i < d_nbins; i++) {
+          out[i] += gr_complex(-d_imag_bins[i].imag(), d_imag_bins[i].real());
+        }
+      }
+      else {
+        volk_32fc_x2_multiply_32fc(d_chirp_fwd->get_inbuf(), &d_chirp_pre[0], in, d_window_size);
+        chirp_z(out);
+      }
+    }
+
+    dtft_bins_vfc::sptr
+    dtft_bins_vfc::make(int window_size, double samp_rate, double fq_low, double fq_step, int nbins,
+            stft_algorithm_id_t algorithm)
+    {
+      return gnuradio::get_initial_sptr
+        (new dtft_bins_vfc(window_size, samp_rate, fq_low, fq_step, nbins, algorithm));
+    }
+
+    dtft_bins_vfc::dtft_bins_vfc(int window_size, double samp_rate, double fq_low, double fq_step, int nbins,
+            stft_algorithm_id_t algorithm)
+      : gr::sync_block("dtft_bins_vfc",
+              gr::io_signature::make(1, 1, sizeof(float) * window_size),
+              gr::io_signature::make(1, 1, sizeof(gr_complex) * nbins)),
+        d_bins(window_size, samp_rate, fq_low, fq_step, nbins, algorithm, false)
+    {
+    }
+
+    dtft_bins_vfc::~dtft_bins_vfc()
+    {
+    }
+
+    void
+    dtft_bins_vfc::set_samp_rate(double samp_rate)
+    {
+      gr::thread::scoped_lock lock(d_setlock);
+      d_bins.set_samp_rate(samp_rate);
+    }
+
+    void
+    dtft_bins_vfc::set_freqs(double fq_low, double fq_step)
+    {
+      gr::thread::scoped_lock lock(d_setlock);
+      d_bins.set_freqs(fq_low, fq_step);
+    }
+
+    void
+    dtft_bins_vfc::set_algorithm(stft_algorithm_id_t algorithm)
+    {
+      gr::thread::scoped_lock lock(d_setlock);
+      d_bins.set_algorithm(algorithm);
+    }
+
+    stft_algorithm_id_t
+    dtft_bins_vfc::active_algorithm()
+    {
+      gr::thread::scoped_lock lock(d_setlock);
+      return d_bins.active_algorithm();
+    }
+
+    int
+    dtft_bins_vfc::work(int noutput_items,
+        gr_vector_const_void_star &input_items,
+        gr_vector_void_star &output_items)
+    {
+      block_stats_scope_t stats(d_stats);
+      const float *in = (const float *) input_items[0];
+      gr_complex *out = (gr_complex *) output_items[0];
+
+      for (int k = 0; k < noutput_items; k++) {
+        d_bins.compute(in + k * d_bins.window_size(), out + k * d_bins.nbins());
+      }
+
+      return noutput_items;
+    }
+
+    dtft_bins_vcc::sptr
+    dtft_bins_vcc::make(int window_size, double samp_rate, double fq_low, double fq_step, int nbins,
+            stft_algorithm_id_t algorithm)
+    {
+      return gnuradio::get_initial_sptr
+        (new dtft_bins_vcc(window_size, samp_rate, fq_low, fq_step, nbins, algorithm));
+    }
+
+    dtft_bins_vcc::dtft_bins_vcc(int window_size, double samp_rate, double fq_low, double fq_step, int nbins,
+            stft_algorithm_id_t algorithm)
+      : gr::sync_block("dtft_bins_vcc",
+              gr::io_signature::make(1, 1, sizeof(gr_complex) * window_size),
+              gr::io_signature::make(1, 1, sizeof(gr_complex) * nbins)),
+        d_bins(window_size, samp_rate, fq_low, fq_step, nbins, algorithm, true)
+    {
+    }
+
+    dtft_bins_vcc::~dtft_bins_vcc()
+    {
+    }
+
+    void
+    dtft_bins_vcc::set_samp_rate(double samp_rate)
+    {
+      gr::thread::scoped_lock lock(d_setlock);
+      d_bins.set_samp_rate(samp_rate);
+    }
+
+    void
+    dtft_bins_vcc::set_freqs(double fq_low, double fq_step)
+    {
+      gr::thread::scoped_lock lock(d_setlock);
+      d_bins.set_freqs(fq_low, fq_step);
+    }
+
+    void
+    dtft_bins_vcc::set_algorithm(stft_algorithm_id_t algorithm)
+    {
+      gr::thread::scoped_lock lock(d_setlock);
+      d_bins.set_algorithm(algorithm);
+    }
+
+    stft_algorithm_id_t
+    dtft_bins_vcc::active_algorithm()
+    {
+      gr::thread::scoped_lock lock(d_setlock);
+      return d_bins.active_algorithm();
+    }
+
+    int
+    dtft_bins_vcc::work(int noutput_items,
+        gr_vector_const_void_star &input_items,
+        gr_vector_void_star &output_items)
+    {
+      block_stats_scope_t stats(d_stats);
+      const gr_complex *in = (const gr_complex *) input_items[0];
+      gr_complex *out = (gr_complex *) output_items[0];
+
+      for (int k = 0; k < noutput_items; k++) {
+        d_bins.compute(in + k * d_bins.window_size(), out + k * d_bins.nbins());
+      }
+
+      return noutput_items;
+    }
+
+  } /* namespace digitizers */
+} /* namespace gr */
@@ -0,0 +1,237 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_DTFT_BINS_IMPL_H
+#define INCLUDED_DIGITIZERS_DTFT_BINS_IMPL_H
+
+#include <digitizers/stft_algorithms.h>
+#include <gnuradio/sync_block.h>
+#include <gnuradio/gr_complex.h>
+#include <gnuradio/fft/fft.h>
+#include "fft_engine.h"
+
+#include <memory>
+#include <vector>
+#include "block_stats_impl.h"
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Cost model used by dtft_bins_t to choose the algorithm, in ns per window.
+     *
+     * The constants are calibrated once per process, on first use, by timing the Goertzel
+     * kernel, a complex FFT and a complex multiply on this machine (a few ms).
+     */
+    struct dtft_cost_model_t
+    {
+      double goertzel_ns;     // per sample and bin (padded to the goertzel lanes)
+      double fft_ns;          // per L * log2(L) of a complex FFT of size L
+      double multiply_ns;     // per complex multiply
+
+      static const dtft_cost_model_t &get();
+
+      double goertzel_cost(int window_size, int nbins) const;
+
+      // Real FFT of grid_size samples, see dtft_bins_t::grid_fft_size
+      double grid_fft_cost(int window_size, int grid_size, int nbins) const;
+
+      double chirp_z_cost(int window_size, int nbins) const;
+    };
+
+    /*!
+     * \brief Bins equally spaced in frequency of a window, computed as a bank of goertzel_fc
+     * blocks does, i.e. for each bin frequency w
+     *
+     *   out = 1/N * sum_{m=0}^{N-1} x[m] exp(j w (N - m))
+     *
+     * Either by the Goertzel recurrence (cost proportional to N * nbins), or by an FFT (cost
+     * proportional to L log L). If the bins fall on the grid of a real FFT of at least N
+     * points (fq_step divides samp_rate, fq_low a multiple of fq_step) the window is zero
+     * padded and transformed by the shared fft_engine_t, otherwise the bins are evaluated by
+     * the chirp-z transform (Bluestein, two complex FFTs of L >= N + nbins - 1 points). Both
+     * give the same results, up to rounding.
+     *
+     * Complex windows (e.g. a baseband from ddc_fc) are supported as well, bin frequencies may
+     * be negative then. Goertzel runs over the real and imaginary parts, the FFT is always the
+     * chirp-z transform.
+     *
+     * With AUTO the cheaper one according to dtft_cost_model_t is used, the choice is
+     * re-evaluated whenever the frequencies or the sample rate change. The output is the same.
+     * Not thread safe, see dtft_bins_vfc.
+     */
+    class dtft_bins_t
+    {
+     public:
+
+      // Largest zero padded FFT considered, beyond that the chirp-z transform is used
+      static const int MAX_GRID_FFT_SIZE = 1 << 22;
+
+      /*!
+       * \param algorithm FFT, GOERTZEL or AUTO
+       */
+      dtft_bins_t(int window_size, double samp_rate, double fq_low, double fq_step, int nbins,
+              stft_algorithm_id_t algorithm, bool complex_input);
+
+      /*!
+       * \brief Size of the real FFT whose bins include the given ones, 0 if there is none.
+       */
+      static int grid_fft_size(int window_size, double samp_rate, double fq_low, double fq_step, int nbins);
+
+      int window_size() const
+      {
+        return d_window_size;
+      }
+
+      int nbins() const
+      {
+        return d_nbins;
+      }
+
+      void set_samp_rate(double samp_rate);
+
+      void set_freqs(double fq_low, double fq_step);
+
+      void set_algorithm(stft_algorithm_id_t algorithm);
+
+      /*!
+       * \brief Returns the algorithm in use, FFT or GOERTZEL.
+       */
+      stft_algorithm_id_t active_algorithm() const
+      {
+        return d_active;
+      }
+
+      void compute(const float *in, gr_complex *out);
+
+      void compute(const gr_complex *in, gr_complex *out);
+
+     private:
+
+      // Recomputes the coefficients and selects the algorithm
+      void update();
+
+      void prepare_grid_fft();
+
+      void prepare_chirp_z(double w0, double dw);
+
+      void goertzel(const float *in, gr_complex *out);
+
+      void grid_fft(const float *in, gr_complex *out);
+
+      // Transforms the chirped window in the input buffer of d_chirp_fwd
+      void chirp_z(gr_complex *out);
+
+      const int d_window_size;
+      const int d_nbins;
+      const bool d_complex_input;
+      double d_samp_rate;
+      double d_fq_low;
+      double d_fq_step;
+      stft_algorithm_id_t d_requested;
+      stft_algorithm_id_t d_active;
+
+      // Goertzel, arrays padded to a whole number of goertzel lanes
+      std::vector<float> d_ones;
+      std::vector<double> d_coeffs;
+      std::vector<double> d_sines;
+      std::vector<double> d_d1;
+      std::vector<double> d_d2;
+      std::vector<float> d_real;                // parts of a complex window
+      std::vector<float> d_imag;
+      std::vector<gr_complex> d_imag_bins;
+
+      // FFT, d_post rotates and scales the bins to the output of goertzel_fc
+      int d_grid_size;                          // zero if the chirp-z transform is used
+      int d_grid_first;                         // grid index of the first bin
+      int d_grid_stride;                        // grid bins per bin
+      fft_engine_t::sptr d_engine;
+      std::vector<float> d_frame;               // zero padded window
+      std::vector<float> d_grid_window;         // rectangular
+      std::vector<gr_complex> d_spectrum;
+
+      int d_chirp_size;
+      std::unique_ptr<gr::fft::fft_complex> d_chirp_fwd;
+      std::unique_ptr<gr::fft::fft_complex> d_chirp_inv;
+      std::vector<gr_complex> d_chirp_pre;
+      std::vector<gr_complex> d_chirp_kernel;   // spectrum of the chirp filter
+
+      std::vector<gr_complex> d_post;
+    };
+
+    /*!
+     * \brief dtft_bins_t over vectors of window_size real samples, setters may be called while
+     * running (the implementation switches without a flowgraph restart).
+     */
+    class dtft_bins_vfc : public gr::sync_block
+    {
+     public:
+      typedef boost::shared_ptr<dtft_bins_vfc> sptr;
+
+      static sptr make(int window_size, double samp_rate, double fq_low, double fq_step, int nbins,
+              stft_algorithm_id_t algorithm);
+
+      dtft_bins_vfc(int window_size, double samp_rate, double fq_low, double fq_step, int nbins,
+              stft_algorithm_id_t algorithm);
+
+      ~dtft_bins_vfc();
+
+      void set_samp_rate(double samp_rate);
+
+      void set_freqs(double fq_low, double fq_step);
+
+      void set_algorithm(stft_algorithm_id_t algorithm);
+
+      stft_algorithm_id_t active_algorithm();
+
+      int work(int noutput_items,
+          gr_vector_const_void_star &input_items,
+          gr_vector_void_star &output_items) override;
+
+     private:
+      dtft_bins_t d_bins;
+
+      block_stats_recorder_t d_stats {this};
+    };
+
+    /*!
+     * \brief dtft_bins_t over vectors of window_size complex samples, see dtft_bins_vfc.
+     */
+    class dtft_bins_vcc : public gr::sync_block
+    {
+     public:
+      typedef boost::shared_ptr<dtft_bins_vcc> sptr;
+
+      static sptr make(int window_size, double samp_rate, double fq_low, double fq_step, int nbins,
+              stft_algorithm_id_t algorithm);
+
+      dtft_bins_vcc(int window_size, double samp_rate, double fq_low, double fq_step, int nbins,
+              stft_algorithm_id_t algorithm);
+
+      ~dtft_bins_vcc();
+
+      void set_samp_rate(double samp_rate);
+
+      void set_freqs(double fq_low, double fq_step);
+
+      void set_algorithm(stft_algorithm_id_t algorithm);
+
+      stft_algorithm_id_t active_algorithm();
+
+      int work(int noutput_items,
+          gr_vector_const_void_star &input_items,
+          gr_vector_void_star &output_items) override;
+
+     private:
+      dtft_bins_t d_bins;
+
+      block_stats_recorder_t d_stats {this};
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_DTFT_BINS_IMPL_H */
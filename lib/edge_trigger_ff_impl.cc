@@ -10,6 +10,7 @@
 
 #include <gnuradio/io_signature.h>
 #include "edge_trigger_ff_impl.h"
+#include "hysteresis_kernel.h"
 #include <boost/algorithm/string/split.hpp>
 #include <boost/smart_ptr/shared_ptr.hpp>
 #include <boost/smart_ptr/make_shared.hpp>
@@ -22,11 +23,13 @@ namespace gr {
 
     edge_trigger_ff::sptr
     edge_trigger_ff::make(float sampling, float lo, float hi, float initial_state,
-            bool send_udp, const std::string host_list, bool send_udp_on_raising_edge, float timeout)
+            bool send_udp, const std::string host_list, bool send_udp_on_raising_edge, float timeout,
+            float batch_window, bool binary_protocol, int multicast_ttl, float search_window)
     {
       return gnuradio::get_initial_sptr
         (new edge_trigger_ff_impl(sampling, lo, hi, initial_state, send_udp, host_list,
-                send_udp_on_raising_edge, timeout));
+                send_udp_on_raising_edge, timeout, batch_window, binary_protocol, multicast_ttl,
+                search_window));
     }
 
     // To be on the safe side allocate big circular buffers
@@ -38,7 +41,8 @@ namespace gr {
      */
     edge_trigger_ff_impl::edge_trigger_ff_impl(float sampling, float lo, float hi,
             float initial_state, bool send_udp, const std::string host_list,
-            bool send_udp_on_raising_edge, float timeout)
+            bool send_udp_on_raising_edge, float timeout, float batch_window, bool binary_protocol,
+            int multicast_ttl, float search_window)
       : gr::block("edge_trigger_ff",
               gr::io_signature::make(1, 1, sizeof(float)),
               gr::io_signature::make(1, 1, sizeof(float))),
@@ -47,12 +51,43 @@ namespace gr {
         d_hi_threshold(hi),
         d_actual_state(initial_state < hi ? false : true),
         d_timeout_samples(timeout * sampling),
+        d_acq_info(),
+        d_sender(d_io_service),
         d_wr_events(CIRC_BUFFER_SIZE),
         d_triggers(CIRC_BUFFER_SIZE),
         d_detected_edges(EDGE_CIRC_BUFFER_SIZE),
         d_send_udp_packet(send_udp),
-        d_send_udp_on_raising_edge(send_udp_on_raising_edge)
+        d_send_udp_on_raising_edge(send_udp_on_raising_edge),
+        d_binary_protocol(binary_protocol),
+        d_batch_window_samples(0),
+        d_batch(),
+        d_batch_first_edge(0),
+        d_sequence(0),
+        d_search_window_samples(0),
+        d_search_until(0)
     {
+      if (batch_window < 0) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid batch window: " << batch_window;
+        throw std::invalid_argument(message.str());
+      }
+      d_batch_window_samples = static_cast<uint64_t>(batch_window * sampling);
+      d_batch.reserve(EDGE_DETECT_MAX_BATCH);
+
+      if (multicast_ttl < 0 || multicast_ttl > 255) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid multicast TTL: " << multicast_ttl;
+        throw std::invalid_argument(message.str());
+      }
+      d_sender.set_multicast_ttl(multicast_ttl);
+
+      if (search_window < 0) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid search window: " << search_window;
+        throw std::invalid_argument(message.str());
+      }
+      d_search_window_samples = static_cast<uint64_t>(search_window * sampling);
+
       // parse receiving host names and ports
       std::vector<std::string> hosts;
       boost::tokenizer<boost::char_separator<char>> tokens(host_list, boost::char_separator<char>(", "));
@@ -66,10 +101,9 @@ namespace gr {
         std::vector<std::string> parts;
         boost::algorithm::split(parts, host, [] (char c) { return c == ':'; });
 
-        auto new_client = boost::make_shared<udp_sender>(d_io_service, parts.at(0), parts.at(1));
-        d_receivers.push_back(new_client);
+        auto host_and_port = d_sender.add_receiver(parts.at(0), parts.at(1));
 
-        GR_LOG_DEBUG(d_logger, "edge_trigger_ff::registered host: '" + new_client->host_and_port() + "'");
+        GR_LOG_DEBUG(d_logger, "edge_trigger_ff::registered host: '" + host_and_port + "'");
       }
 
       set_tag_propagation_policy(tag_propagation_policy_t::TPP_DONT);
@@ -88,6 +122,24 @@ namespace gr {
       d_send_udp_packet = send_state;
     }
 
+    std::vector<udp_receiver_stats_t>
+    edge_trigger_ff_impl::get_udp_receiver_stats() const
+    {
+      return d_sender.get_stats();
+    }
+
+    uint64_t
+    edge_trigger_ff_impl::get_udp_queue_drops() const
+    {
+      return d_sender.get_queue_drops();
+    }
+
+    void
+    edge_trigger_ff_impl::reset_udp_stats()
+    {
+      d_sender.reset_stats();
+    }
+
     void
     edge_trigger_ff_impl::forecast(int noutput_items, gr_vector_int &ninput_items_required)
     {
@@ -106,7 +158,8 @@ namespace gr {
                 : wr_event.wr_trigger_stamp + trigger_delay;
 
       // prepare UDP packet
-      edge_detect_t ed;
+      edge_detect_t ed {};
+      ed.event_id = edge_detect_event_id(wr_event.event_id);
       ed.is_raising_edge = d_send_udp_on_raising_edge;
       ed.value = d_send_udp_on_raising_edge;
       ed.delay_since_last_timing_event = trigger_delay;
@@ -114,11 +167,23 @@ namespace gr {
       ed.samples_since_last_timing_event = (detected_edge - trigger);
       ed.timing_event_timestamp = trigger_event_time_stamp;
 
-      if (d_send_udp_packet && !d_receivers.empty()) {
-        auto message = encode_edge_detect(ed);
+      if (d_send_udp_packet && !d_sender.empty()) {
+        if (!d_binary_protocol) {
+          d_sender.send(encode_edge_detect(ed));
+        }
+        else {
+          // edges further apart than the batch window are not delayed
+          if (!d_batch.empty() && detected_edge - d_batch_first_edge >= d_batch_window_samples) {
+            flush_batch();
+          }
+          if (d_batch.empty()) {
+            d_batch_first_edge = detected_edge;
+          }
+          d_batch.push_back(ed);
 
-        for (auto &receiver : d_receivers) {
-          receiver->send(message);
+          if (d_batch.size() >= EDGE_DETECT_MAX_BATCH || d_batch_window_samples == 0) {
+            flush_batch();
+          }
         }
       }
 
@@ -131,43 +196,67 @@ namespace gr {
       }
     }
 
+    void
+    edge_trigger_ff_impl::flush_batch()
+    {
+      if (d_batch.empty()) {
+        return;
+      }
+
+      // the send timestamp lets the receivers measure the latency
+      const auto send_timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+              std::chrono::system_clock::now().time_since_epoch()).count();
+
+      encode_edge_detect_batch(d_batch.data(), d_batch.size(), d_payload, d_sequence++, send_timestamp);
+      d_batch.clear();
+      d_sender.send(d_payload);
+    }
+
     bool edge_trigger_ff_impl::start()
     {
+      d_sender.set_thread_owner(get_block_name(this));
       d_wr_events.clear();
       d_triggers.clear();
       d_detected_edges.clear();
+      d_batch.clear();
+      d_search_until = 0;
+      d_acq_info = acq_info_t();
 
       return true;
     }
 
+    bool edge_trigger_ff_impl::stop()
+    {
+      flush_batch();
+      return true;
+    }
+
     int
     edge_trigger_ff_impl::general_work(int noutput_items, gr_vector_int &ninput_items,
           gr_vector_const_void_star &input_items, gr_vector_void_star &output_items)
     {
+      block_stats_scope_t stats(d_stats);
       const float *in = (const float *)input_items.at(0);
 
       auto count0 = nitems_read(0);
 
-      // Consume all the WR events
-      std::vector<tag_t> tags;
+      // Single pass over all the tags. WR events and triggers are consumed, acq info tags are
+      // only needed to get info about the user delay.
+      d_tags.clear();
+      get_tags_in_range(d_tags, 0, count0, count0 + noutput_items);
 
-      get_tags_in_range(tags, 0, count0, count0 + noutput_items, pmt::mp(wr_event_tag_name));
-      for (const auto &tag : tags) {
-        d_wr_events.push_back(decode_wr_event_tag(tag));
-      }
-
-      // Detect all triggers
-      tags.clear();
-      get_tags_in_range(tags, 0, count0, count0 + noutput_items, pmt::mp(trigger_tag_name));
-      for (const auto &tag : tags) {
-        d_triggers.push_back(tag.offset);
-      }
-
-      // Acq info tags are only needed to get info about the user delay
-      tags.clear();
-      get_tags_in_range(tags, 0, count0, count0 + noutput_items, pmt::mp(acq_info_tag_name));
-      if (!tags.empty()) {
-        d_acq_info = decode_acq_info_tag(tags.back());
+      d_new_triggers.clear();
+      for (const auto &tag : d_tags) {
+        if (pmt::eq(tag.key, wr_event_tag_key())) {
+          d_wr_events.push_back(decode_wr_event_tag(tag));
+        }
+        else if (pmt::eq(tag.key, trigger_tag_key())) {
+          d_triggers.push_back(tag.offset);
+          d_new_triggers.push_back(tag.offset);
+        }
+        else if (pmt::eq(tag.key, acq_info_tag_key())) {
+          d_acq_info = decode_acq_info_tag(tag);
+        }
       }
 
       const bool outputing = !output_items.empty();
@@ -178,32 +267,46 @@ namespace gr {
         out = static_cast<float *>(output_items.at(0));
       }
 
-      for(int i = 0; i < noutput_items; i++) {
+      const auto nwords = hysteresis_words(noutput_items);
+      d_above.resize(nwords);
+      d_below.resize(nwords);
+      threshold_masks(in, noutput_items, d_lo_threshold, d_hi_threshold, d_above.data(), d_below.data());
+
+      // Only the state transitions are visited, the output is filled with runs of constant state
+      size_t next_trigger = 0;
+      int run_start = 0;
+      for_each_transition(d_above.data(), d_below.data(), noutput_items, d_actual_state,
+              [&](int i, bool state) {
+        if (outputing) {
+          std::fill(out + run_start, out + i, static_cast<float>(!state));
+          run_start = i;
+        }
 
-        bool edge_detected = false;
+        if (state != d_send_udp_on_raising_edge) {
+          return;
+        }
 
-        if (d_actual_state == false) {
-          // actual_state is '0'
-          if (in[i] > d_hi_threshold) {
-            edge_detected = d_send_udp_on_raising_edge;
-            d_actual_state = true;
+        // Edges are only of interest within the search window following a trigger
+        const auto edge = count0 + i;
+        if (d_search_window_samples) {
+          for (; next_trigger < d_new_triggers.size() && d_new_triggers[next_trigger] <= edge; next_trigger++) {
+            d_search_until = std::max(d_search_until, d_new_triggers[next_trigger] + d_search_window_samples);
           }
-        }
-        else {
-          // actual_state is '1'
-          if (in[i] < d_lo_threshold) {
-            edge_detected = !d_send_udp_on_raising_edge;
-            d_actual_state = false;
+          if (edge >= d_search_until) {
+            return;
           }
         }
 
-        if (outputing) {
-          out[i] = static_cast<float>(d_actual_state);
-        }
+        d_detected_edges.push_back(edge);
+      });
 
-        if (edge_detected) {
-          d_detected_edges.push_back((count0 + i));
-        }
+      if (outputing) {
+        std::fill(out + run_start, out + noutput_items, static_cast<float>(d_actual_state));
+      }
+
+      // Triggers without an edge in this call extend the search window as well
+      for (; next_trigger < d_new_triggers.size(); next_trigger++) {
+        d_search_until = std::max(d_search_until, d_new_triggers[next_trigger] + d_search_window_samples);
       }
 
       // Trigger detection logic
@@ -227,45 +330,47 @@ namespace gr {
           break; // wait another work iteration to receive WR event
         }
 
-       // const auto &wr_event = d_wr_events.front();
-
-        // Edge detection is done only for events that require realignment
-     //   if (!wr_event.realignment_required) {
-          d_wr_events.pop_front();
-          triggers_consumed++;
-     //   }
-//        else {
-//          // find first relevant detected edge
-//          bool detected = false;
-//          uint64_t detected_edge = 0;
-//
-//          while (!d_detected_edges.empty()) {
-//            detected_edge = d_detected_edges.front();
-//            d_detected_edges.pop_front();
-//
-//            if (detected_edge >= trigger) {
-//              detected = true;
-//              break;
-//            }
-//          }
-
-//          if (detected) {
-//            send_edge_detect_info(trigger, detected_edge, wr_event, !output_items.empty());
-//            d_wr_events.pop_front();
-//            triggers_consumed++;
-//          }
-//          else if (samples_since_trigger > d_timeout_samples) {
-//            GR_LOG_ERROR(d_logger, "Timeout detecting edge for trigger at offset: "
-//                    + std::to_string(trigger));
-//            triggers_consumed++;
-//          }
-//        }
+        const auto &wr_event = d_wr_events.front();
+
+        // find first relevant detected edge
+        bool detected = false;
+        uint64_t detected_edge = 0;
+
+        while (!d_detected_edges.empty()) {
+          detected_edge = d_detected_edges.front();
+          d_detected_edges.pop_front();
+
+          if (detected_edge >= trigger) {
+            detected = true;
+            break;
+          }
+        }
+
+        if (detected) {
+          send_edge_detect_info(trigger, detected_edge, wr_event, outputing);
+        }
+        else if (samples_since_trigger > d_timeout_samples) {
+          GR_LOG_ERROR(d_logger, "Timeout detecting edge for trigger at offset: "
+                  + std::to_string(trigger));
+        }
+        else {
+          break; // wait another work iteration to detect the edge
+        }
+
+        // the WR event belongs to this trigger in either case
+        d_wr_events.pop_front();
+        triggers_consumed++;
       }
 
       for (size_t i = 0; i < triggers_consumed; i++) {
         d_triggers.pop_front();
       }
 
+      // Send the batch once its window has passed
+      if (!d_batch.empty() && count0 + noutput_items - d_batch_first_edge >= d_batch_window_samples) {
+        flush_batch();
+      }
+
       // Tell runtime system how many input items we consumed on
       // each input stream.
       consume_each(noutput_items);
@@ -21,49 +21,423 @@
 #include <boost/array.hpp>
 #include <boost/asio.hpp>
 #include <boost/noncopyable.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/lockfree/spsc_queue.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+
+#ifdef __linux__
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#include <cerrno>
+#endif
 
 #include "utils.h"
+#include "block_stats_impl.h"
+#include "thread_registry.h"
 
 using boost::asio::ip::udp;
 
 namespace gr {
   namespace digitizers {
 
+    /*!
+     * \brief Sends the same datagram to all the receivers, using a single socket and (on Linux)
+     * a single sendmmsg system call.
+     *
+     * Datagrams are queued by the work thread and sent by a dedicated I/O thread running the
+     * io_service, i.e. the work thread never waits on the network. The queue is bounded and
+     * lock-free, datagrams are dropped if it is full. The socket is non-blocking, datagrams not
+     * accepted by the kernel (e.g. socket buffer full) are dropped and accounted per receiver.
+     *
+     * A receiver might be a multicast group, in which case a single datagram reaches all the
+     * subscribers of the group.
+     *
+     * On Linux the datagrams are timestamped by the kernel when transmitted (SO_TIMESTAMPING),
+     * and by the NIC if the interface is configured for hardware timestamping (the NIC clock is
+     * then assumed to be synchronized to UTC). The timestamps are read from the socket error
+     * queue after each send, i.e. the hardware ones usually with the next datagram, and the time
+     * from queuing until transmitting is accounted per receiver.
+     */
     class udp_sender : private boost::noncopyable
     {
      private:
+      static const size_t QUEUE_SIZE = 256;
+      static const size_t MAX_DATAGRAM_SIZE = 1500;
+      static const size_t TX_RECORDS = 1024;
+
+      struct datagram_t
+      {
+        std::string payload;
+        int64_t queued_ns;       // steady clock
+        int64_t queued_utc_ns;   // realtime clock, for the transmit timestamps
+      };
+
+      struct receiver_t
+      {
+        udp::endpoint endpoint;
+        std::string host_and_port;
+        std::atomic<uint64_t> sent;
+        std::atomic<uint64_t> dropped;
+        std::atomic<int64_t> last_latency_ns;
+        std::atomic<int64_t> max_latency_ns;
+        std::atomic<int64_t> last_tx_latency_ns;
+        std::atomic<int64_t> max_tx_latency_ns;
+      };
+
+      // Datagram sent to a receiver, by the timestamp id (the socket counts the datagrams sent)
+      struct tx_record_t
+      {
+        uint32_t id;
+        bool valid;
+        size_t receiver;
+        int64_t queued_utc_ns;
+      };
+
+      using datagram_queue_t = boost::lockfree::spsc_queue<datagram_t *,
+              boost::lockfree::capacity<QUEUE_SIZE>>;
+
       boost::asio::io_service& d_io_service;
       udp::socket d_socket;
-      udp::endpoint d_endpoint;
-      std::string d_host;
-      std::string d_port;
+      std::deque<receiver_t> d_receivers;   // deque, elements are not movable
+
+      // Datagrams are owned by the work thread while in the free queue, else by the I/O thread
+      std::vector<datagram_t> d_datagrams;
+      datagram_queue_t d_free_datagrams;
+      datagram_queue_t d_pending_datagrams;
+      std::atomic<bool> d_drain_scheduled;
+      std::atomic<uint64_t> d_queue_drops;
+      std::string d_thread_owner;
+
+      boost::scoped_ptr<boost::asio::io_service::work> d_work;
+      boost::scoped_ptr<boost::thread> d_thread;
+
+#ifdef __linux__
+      std::vector<struct mmsghdr> d_headers;
+      struct iovec d_iov;
+
+      bool d_tx_timestamps;
+      uint32_t d_tx_next_id;
+      std::vector<tx_record_t> d_tx_records;
+#endif
+
+      static int64_t now_ns()
+      {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+      }
+
+      static int64_t now_utc_ns()
+      {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+      }
+
+      static void update_latency(std::atomic<int64_t> &last, std::atomic<int64_t> &max, int64_t latency)
+      {
+        last.store(latency, std::memory_order_relaxed);
+        if (latency > max.load(std::memory_order_relaxed)) {
+          max.store(latency, std::memory_order_relaxed);
+        }
+      }
+
+      void sent_to(receiver_t &receiver, int64_t queued_ns)
+      {
+        receiver.sent.fetch_add(1, std::memory_order_relaxed);
+        update_latency(receiver.last_latency_ns, receiver.max_latency_ns, now_ns() - queued_ns);
+      }
+
+#ifdef __linux__
+      // Executed by the I/O thread, the datagram sent to the receiver gets the next timestamp id
+      void record_tx(size_t receiver, int64_t queued_utc_ns)
+      {
+        if (d_tx_timestamps) {
+          auto &record = d_tx_records[d_tx_next_id % TX_RECORDS];
+          record.id = d_tx_next_id++;
+          record.valid = true;
+          record.receiver = receiver;
+          record.queued_utc_ns = queued_utc_ns;
+        }
+      }
+
+      // Executed by the I/O thread, reads the transmit timestamps reported meanwhile
+      void read_tx_timestamps()
+      {
+        if (!d_tx_timestamps) {
+          return;
+        }
+
+        char control[512];
+        struct iovec iov {nullptr, 0};   // the payload isn't looped back (OPT_TSONLY)
+
+        while (true) {
+          struct msghdr msg {};
+          msg.msg_iov = &iov;
+          msg.msg_iovlen = 1;
+          msg.msg_control = control;
+          msg.msg_controllen = sizeof(control);
+
+          if (::recvmsg(d_socket.native_handle(), &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+            return;
+          }
+
+          const struct scm_timestamping *timestamps = nullptr;
+          const struct sock_extended_err *error = nullptr;
+          for (auto cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPING) {
+              timestamps = reinterpret_cast<const struct scm_timestamping *>(CMSG_DATA(cmsg));
+            }
+            else if (cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) {
+              error = reinterpret_cast<const struct sock_extended_err *>(CMSG_DATA(cmsg));
+            }
+          }
+
+          if (!timestamps || !error || error->ee_origin != SO_EE_ORIGIN_TIMESTAMPING) {
+            continue;
+          }
+
+          const auto &record = d_tx_records[error->ee_data % TX_RECORDS];
+          if (!record.valid || record.id != error->ee_data) {
+            continue;
+          }
+
+          // hardware timestamp if any, it is taken after the software one
+          const auto &ts = timestamps->ts[2].tv_sec || timestamps->ts[2].tv_nsec
+                  ? timestamps->ts[2] : timestamps->ts[0];
+          const auto tx_ns = static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+
+          auto &receiver = d_receivers[record.receiver];
+          update_latency(receiver.last_tx_latency_ns, receiver.max_tx_latency_ns,
+                  tx_ns - record.queued_utc_ns);
+        }
+      }
+#endif
+
+      // Executed by the I/O thread
+      void send_to_all(const datagram_t &datagram)
+      {
+#ifdef __linux__
+        d_iov.iov_base = const_cast<char *>(datagram.payload.data());
+        d_iov.iov_len = datagram.payload.size();
+
+        size_t sent = 0;
+        while (sent < d_headers.size()) {
+          auto retval = ::sendmmsg(d_socket.native_handle(), &d_headers[sent],
+                  d_headers.size() - sent, MSG_DONTWAIT);
+          if (retval < 0) {
+            if (errno == EINTR) {
+              continue;
+            }
+            // the datagram for the first remaining receiver was not accepted, skip it
+            d_receivers[sent].dropped.fetch_add(1, std::memory_order_relaxed);
+            sent++;
+            continue;
+          }
+          for (int i = 0; i < retval; i++) {
+            sent_to(d_receivers[sent + i], datagram.queued_ns);
+            record_tx(sent + i, datagram.queued_utc_ns);
+          }
+          sent += retval;
+        }
+
+        read_tx_timestamps();
+#else
+        for (auto &receiver : d_receivers) {
+          boost::system::error_code ec;
+          d_socket.send_to(boost::asio::buffer(datagram.payload), receiver.endpoint, 0, ec);
+          if (ec) {
+            receiver.dropped.fetch_add(1, std::memory_order_relaxed);
+          }
+          else {
+            sent_to(receiver, datagram.queued_ns);
+          }
+        }
+#endif
+      }
+
+      // Executed by the I/O thread
+      void drain()
+      {
+        // cleared before draining, a datagram queued meanwhile schedules another drain
+        d_drain_scheduled.store(false, std::memory_order_seq_cst);
+
+        datagram_t *datagram;
+        while (d_pending_datagrams.pop(datagram)) {
+          send_to_all(*datagram);
+          d_free_datagrams.push(datagram);
+        }
+      }
 
      public:
-      udp_sender(boost::asio::io_service& io_service,
-          const std::string& host, const std::string& port)
+      explicit udp_sender(boost::asio::io_service& io_service)
          : d_io_service(io_service),
            d_socket(io_service, udp::endpoint(udp::v4(), 0)),
-           d_host(host),
-           d_port(port)
+           d_datagrams(QUEUE_SIZE),
+           d_drain_scheduled(false),
+           d_queue_drops(0)
+#ifdef __linux__
+           ,
+           d_tx_timestamps(false),
+           d_tx_next_id(0),
+           d_tx_records(TX_RECORDS, tx_record_t {})
+#endif
+      {
+        d_socket.non_blocking(true);
+
+#ifdef __linux__
+        // transmit timestamps are reported on the error queue, with the id of the datagram
+        // and without the payload
+        int flags = SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_TX_HARDWARE
+                | SOF_TIMESTAMPING_SOFTWARE | SOF_TIMESTAMPING_RAW_HARDWARE
+                | SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY;
+        d_tx_timestamps = ::setsockopt(d_socket.native_handle(), SOL_SOCKET, SO_TIMESTAMPING,
+                &flags, sizeof(flags)) == 0;
+#endif
+
+        for (auto &datagram : d_datagrams) {
+          datagram.payload.reserve(MAX_DATAGRAM_SIZE);
+          d_free_datagrams.push(&datagram);
+        }
+      }
+
+      ~udp_sender()
+      {
+        if (d_thread) {
+          // pending datagrams are sent before the thread exits
+          d_work.reset();
+          d_thread->join();
+        }
+        d_socket.close();
+      }
+
+      /*!
+       * \brief Sets the TTL of the datagrams sent to multicast groups. Loopback is enabled, i.e.
+       * subscribers on the local host receive the datagrams as well.
+       */
+      void set_multicast_ttl(int ttl)
+      {
+        d_socket.set_option(boost::asio::ip::multicast::hops(ttl));
+        d_socket.set_option(boost::asio::ip::multicast::enable_loopback(true));
+      }
+
+      /*!
+       * \brief Resolves and adds a receiver (unicast host or multicast group), returns host
+       * and port. Receivers are to be added before the first datagram is sent.
+       */
+      std::string add_receiver(const std::string& host, const std::string& port)
       {
         udp::resolver resolver(d_io_service);
-        udp::resolver::query query(udp::v4(), d_host, d_port);
+        udp::resolver::query query(udp::v4(), host, port);
         udp::resolver::iterator iter = resolver.resolve(query);
-        d_endpoint = *iter;
+
+        d_receivers.emplace_back();
+        auto &receiver = d_receivers.back();
+        receiver.endpoint = *iter;
+        receiver.host_and_port = host + ":" + port;
+        reset_stats(receiver);
+
+        return receiver.host_and_port;
       }
 
-      ~udp_sender()
+      bool empty() const
       {
-          d_socket.close();
+        return d_receivers.empty();
       }
 
-      std::string host_and_port()
+      /*!
+       * \brief Queues the datagram, returns false if it is dropped because the queue is full.
+       * Called by a single (work) thread.
+       */
+      bool send(const std::string& msg)
       {
-        return d_host + ":" + d_port;
+        if (!d_thread) {
+#ifdef __linux__
+          d_headers.assign(d_receivers.size(), mmsghdr {});
+          for (size_t i = 0; i < d_receivers.size(); i++) {
+            d_headers[i].msg_hdr.msg_name = d_receivers[i].endpoint.data();
+            d_headers[i].msg_hdr.msg_namelen = d_receivers[i].endpoint.size();
+            d_headers[i].msg_hdr.msg_iov = &d_iov;
+            d_headers[i].msg_hdr.msg_iovlen = 1;
+          }
+#endif
+          d_work.reset(new boost::asio::io_service::work(d_io_service));
+          d_thread.reset(new boost::thread([this] {
+            thread_scope_t thread(d_thread_owner, "udp-send");
+            d_io_service.run();
+          }));
+        }
+
+        datagram_t *datagram;
+        if (!d_free_datagrams.pop(datagram)) {
+          d_queue_drops.fetch_add(1, std::memory_order_relaxed);
+          return false;
+        }
+
+        datagram->payload.assign(msg);
+        datagram->queued_ns = now_ns();
+        datagram->queued_utc_ns = now_utc_ns();
+        d_pending_datagrams.push(datagram);
+
+        if (!d_drain_scheduled.exchange(true, std::memory_order_seq_cst)) {
+          d_io_service.post(boost::bind(&udp_sender::drain, this));
+        }
+
+        return true;
       }
 
-      void send(const std::string& msg) {
-        d_socket.send_to(boost::asio::buffer(msg, msg.size()), d_endpoint);
+      /*!
+       * \brief Owner of the send thread (see thread_registry_t), set before the first send.
+       */
+      void set_thread_owner(const std::string &owner)
+      {
+        d_thread_owner = owner;
+      }
+
+      uint64_t get_queue_drops() const
+      {
+        return d_queue_drops.load(std::memory_order_relaxed);
+      }
+
+      std::vector<udp_receiver_stats_t> get_stats() const
+      {
+        std::vector<udp_receiver_stats_t> stats;
+        for (const auto &receiver : d_receivers) {
+          udp_receiver_stats_t s;
+          s.host_and_port = receiver.host_and_port;
+          s.sent = receiver.sent.load(std::memory_order_relaxed);
+          s.dropped = receiver.dropped.load(std::memory_order_relaxed);
+          s.last_latency_ns = receiver.last_latency_ns.load(std::memory_order_relaxed);
+          s.max_latency_ns = receiver.max_latency_ns.load(std::memory_order_relaxed);
+          s.last_tx_latency_ns = receiver.last_tx_latency_ns.load(std::memory_order_relaxed);
+          s.max_tx_latency_ns = receiver.max_tx_latency_ns.load(std::memory_order_relaxed);
+          stats.push_back(s);
+        }
+        return stats;
+      }
+
+      void reset_stats()
+      {
+        d_queue_drops.store(0, std::memory_order_relaxed);
+        for (auto &receiver : d_receivers) {
+          reset_stats(receiver);
+        }
+      }
+
+     private:
+      static void reset_stats(receiver_t &receiver)
+      {
+        receiver.sent.store(0, std::memory_order_relaxed);
+        receiver.dropped.store(0, std::memory_order_relaxed);
+        receiver.last_latency_ns.store(0, std::memory_order_relaxed);
+        receiver.max_latency_ns.store(0, std::memory_order_relaxed);
+        receiver.last_tx_latency_ns.store(0, std::memory_order_relaxed);
+        receiver.max_tx_latency_ns.store(0, std::memory_order_relaxed);
       }
     };
 
@@ -80,7 +454,7 @@ namespace gr {
       acq_info_t d_acq_info;
 
       boost::asio::io_service d_io_service;
-      std::vector<boost::shared_ptr<udp_sender>> d_receivers;
+      udp_sender d_sender;
 
       boost::circular_buffer<wr_event_t> d_wr_events;
       boost::circular_buffer<uint64_t> d_triggers;       // offsets
@@ -89,10 +463,33 @@ namespace gr {
       bool d_send_udp_packet;
       bool d_send_udp_on_raising_edge;
 
+      // Edges detected within the batch window are sent with a single datagram (binary
+      // protocol only)
+      bool d_binary_protocol;
+      uint64_t d_batch_window_samples;
+      std::vector<edge_detect_t> d_batch;
+      uint64_t d_batch_first_edge;
+      uint32_t d_sequence;   // of the binary datagrams
+      std::string d_payload;
+
+      // Edges are only recorded up to d_search_window_samples following a trigger, i.e.
+      // before d_search_until (zero window to record all edges)
+      uint64_t d_search_window_samples;
+      uint64_t d_search_until;
+
+      // Work buffers
+      std::vector<gr::tag_t> d_tags;
+      std::vector<uint64_t> d_new_triggers;
+      std::vector<uint32_t> d_above;
+      std::vector<uint32_t> d_below;
+
+      block_stats_recorder_t d_stats {this};
+
      public:
       edge_trigger_ff_impl(float sampling, float lo, float hi,
               float initial_state, bool send_udp, std::string host_list,
-              bool send_udp_on_raising_edge, float timeout);
+              bool send_udp_on_raising_edge, float timeout, float batch_window,
+              bool binary_protocol, int multicast_ttl, float search_window);
 
       ~edge_trigger_ff_impl();
 
@@ -105,14 +502,25 @@ namespace gr {
 
       void set_send_udp(bool send_state) override;
 
+      std::vector<udp_receiver_stats_t> get_udp_receiver_stats() const override;
+
+      uint64_t get_udp_queue_drops() const override;
+
+      void reset_udp_stats() override;
+
       bool start () override;
 
+      bool stop () override;
+
      private:
       /*!
        * This method will try to send UPD datagram but that is only if edge has been detected and
        * WR event/tag received.
        */
       void send_edge_detect_info(uint64_t trigger, uint64_t detected_edge, const wr_event_t &wr_event, bool make_tags);
+
+      // Sends all the batched edges
+      void flush_batch();
     };
 
   } // namespace digitizers
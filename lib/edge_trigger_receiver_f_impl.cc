@@ -12,29 +12,39 @@
 #include <gnuradio/io_signature.h>
 #include <boost/smart_ptr/shared_ptr.hpp>
 #include <boost/smart_ptr/make_shared.hpp>
+#include <boost/tokenizer.hpp>
 #include "edge_trigger_receiver_f_impl.h"
 
+#include <algorithm>
+
 namespace gr {
   namespace digitizers {
 
     edge_trigger_receiver_f::sptr
-    edge_trigger_receiver_f::make(std::string addr, int port)
+    edge_trigger_receiver_f::make(std::string addr, int port, std::string event_filter)
     {
       edge_trigger_receiver_f::sptr largo = gnuradio::get_initial_sptr
-          (new edge_trigger_receiver_f_impl(addr, port));
+          (new edge_trigger_receiver_f_impl(addr, port, event_filter));
       return largo;
     }
 
-    edge_trigger_receiver_f_impl::edge_trigger_receiver_f_impl(std::string addr, int port)
+    edge_trigger_receiver_f_impl::edge_trigger_receiver_f_impl(std::string addr, int port,
+            std::string event_filter)
       : gr::sync_block("edge_trigger_receiver_f",
               gr::io_signature::make(0, 0, 0),
               gr::io_signature::make(1, 1, sizeof(float)))
     {
+      boost::tokenizer<boost::char_separator<char>> tokens(event_filter, boost::char_separator<char>(", "));
+      for (const auto &event_id : tokens) {
+        d_event_filter.push_back(edge_detect_event_id(event_id));
+      }
+      std::sort(d_event_filter.begin(), d_event_filter.end());
+
       udp::resolver resolver(d_io_service);
       udp::resolver::query query(udp::v4(), addr, std::to_string(port));
       udp::resolver::iterator iter = resolver.resolve(query);
       udp::endpoint endpoint = *iter;
-      d_udp_receive = new udp_receiver(d_io_service, endpoint);
+      d_udp_receive = new udp_receiver(d_io_service, endpoint, get_block_name(this));
     }
 
     edge_trigger_receiver_f_impl::~edge_trigger_receiver_f_impl()
@@ -42,21 +52,72 @@ namespace gr {
       delete d_udp_receive;
     }
 
+    bool
+    edge_trigger_receiver_f_impl::is_accepted(const edge_detect_t &edge) const
+    {
+      // edges of unknown events (xml and version 1 datagrams) are rejected if filtering
+      return d_event_filter.empty()
+              || std::binary_search(d_event_filter.begin(), d_event_filter.end(), edge.event_id);
+    }
+
+    std::vector<udp_source_stats_t>
+    edge_trigger_receiver_f_impl::get_udp_source_stats() const
+    {
+      return d_udp_receive->get_stats();
+    }
+
+    void
+    edge_trigger_receiver_f_impl::reset_udp_stats()
+    {
+      d_udp_receive->reset_stats();
+    }
+
     int
     edge_trigger_receiver_f_impl::work(int noutput_items,
         gr_vector_const_void_star &input_items,
         gr_vector_void_star &output_items)
     {
-      std::string message = d_udp_receive->get_msg();
-      if (message != "") {
-        edge_detect_t edge;
-        if(decode_edge_detect(message, edge)) {
+      block_stats_scope_t stats(d_stats);
+
+      // All the datagrams received meanwhile (bounded, the receive thread keeps filling the ring),
+      // the edges are tagged at once
+      const auto offset = nitems_written(0);
+      udp_receiver::datagram_t *datagram;
+      for (size_t i = 0; i < udp_receiver::RING_SIZE && d_udp_receive->pop(datagram); i++) {
+        d_message.assign(datagram->data.data(), datagram->length);
+        const bool has_latency = datagram->has_latency;
+        const int64_t latency = datagram->latency_ns;
+        d_udp_receive->release(datagram);
+
+        if (d_message.empty()) {
+          continue;
+        }
+
+        // binary datagrams might hold multiple edges, xml datagrams a single one
+        d_edges.clear();
+        if (!decode_edge_detect_batch(d_message, d_edges)) {
+          if (is_binary_edge_detect(d_message)) {
+            GR_LOG_ERROR(d_logger, "Decoding binary UDP datagram failed, size: " + std::to_string(d_message.size()));
+          }
+          else {
+            GR_LOG_ERROR(d_logger, "Decoding UDP datagram failed:" + d_message);
+          }
+          continue;
+        }
+
+        bool tagged = false;
+        for (auto &edge : d_edges) {
+          if (!is_accepted(edge)) {
+            continue;
+          }
           tag_t edge_tag = make_edge_detect_tag(edge);
-          edge_tag.offset = nitems_written(0);
+          edge_tag.offset = offset;
           add_item_tag(0, edge_tag);
+          tagged = true;
         }
-        else {
-          GR_LOG_ERROR(d_logger, "Decoding UDP datagram failed:" + message);
+
+        if (tagged && has_latency) {
+          add_item_tag(0, offset, edge_detect_latency_tag_key(), pmt::from_long(latency));
         }
       }
 
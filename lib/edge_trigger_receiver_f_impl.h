@@ -11,78 +11,380 @@
 #include <digitizers/edge_trigger_receiver_f.h>
 #include <boost/asio.hpp>
 #include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/thread.hpp>
 #include <boost/asio/ip/address_v4.hpp>
 #include <boost/algorithm/string/split.hpp>
+#include <boost/lockfree/spsc_queue.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
 #include <digitizers/edge_trigger_utils.h>
 #include <utils.h>
+#include "block_stats_impl.h"
+#include "thread_registry.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+
+#include <poll.h>
+
+#ifdef __linux__
+#include <sys/socket.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#include <cerrno>
+#endif
 
 using boost::asio::ip::udp;
 
 namespace gr {
   namespace digitizers {
 
-    void handle_receive_redicator(const boost::system::error_code& ec, std::size_t length, void* recv);
-
+    /*!
+     * \brief Receives datagrams on a dedicated thread into a preallocated ring.
+     *
+     * The thread waits for the socket to become readable and drains it in batches, on Linux with
+     * a single recvmmsg system call per batch, i.e. the socket buffer is emptied quickly also
+     * under bursts from many producers. Received datagrams are passed to the work thread through
+     * a lock-free queue, and returned once decoded. Datagrams are dropped if the ring is full.
+     *
+     * Datagrams are accounted per source. Sources sending binary datagrams with sequence numbers
+     * (see encode_edge_detect_batch) are also accounted for the datagrams lost on the way, those
+     * with send timestamps for the latency (against the kernel or NIC receive timestamp, else the
+     * time the datagram was read).
+     */
     class udp_receiver : private boost::noncopyable
     {
+     public:
+      static const size_t MAX_LENGTH = 4096;
+      static const size_t RING_SIZE = 1024;
+      static const size_t BATCH_SIZE = 64;
+      static const int POLL_TIMEOUT_MS = 100;
+      static const size_t CONTROL_SIZE = 256;
+
+      // Datagrams arriving up to that many sequence numbers late are taken as reordered, not as
+      // a restart of the sender
+      static const uint32_t REORDER_WINDOW = 1024;
+
+      struct datagram_t
+      {
+        std::vector<char> data;
+        size_t length;
+        bool has_latency;
+        int64_t latency_ns;
+      };
+
      private:
-      const int MAX_LENGTH = 4096;
-      boost::asio::io_service& d_io_service;
+      struct source_t
+      {
+        std::string host_and_port;
+        uint64_t received;
+        uint64_t lost;
+        uint64_t dropped;
+        int64_t last_latency_ns;
+        int64_t max_latency_ns;
+        bool has_sequence;
+        uint32_t next_sequence;
+      };
+
+      using datagram_queue_t = boost::lockfree::spsc_queue<datagram_t *,
+              boost::lockfree::capacity<RING_SIZE>>;
+
       udp::socket d_socket;
+
+      // Datagrams are owned by the receive thread while in the free queue or in the batch, else
+      // by the work thread
+      std::vector<datagram_t> d_datagrams;
+      datagram_queue_t d_free_datagrams;
+      datagram_queue_t d_received_datagrams;
+
+      // Receive thread buffers, a batch slot is null if the ring was full, the datagram is then
+      // received into the spare buffer and dropped
+      std::vector<datagram_t *> d_batch;
+      std::vector<std::vector<char>> d_spare;
+      std::vector<udp::endpoint> d_senders;
+      std::vector<size_t> d_lengths;
+      std::vector<int64_t> d_received_ns;   // UTC
+#ifdef __linux__
+      std::vector<struct mmsghdr> d_headers;
+      std::vector<struct iovec> d_iovs;
+      std::vector<char> d_controls;
+#endif
+
+      mutable boost::mutex d_sources_mutex;
+      std::map<udp::endpoint, size_t> d_source_index;
+      std::vector<source_t> d_sources;
+
+      std::atomic<bool> d_stop;
       boost::scoped_ptr<boost::thread> d_thread;
 
-      std::vector<char> d_data;
-      boost::system::error_code d_ec;
-      int d_length;
-      concurrent_queue<std::string> d_messages;
+      static int64_t now_utc_ns()
+      {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+      }
+
+#ifdef __linux__
+      // Receive timestamp of a datagram, hardware if any, zero if there is none
+      static int64_t get_rx_timestamp(const struct msghdr &msg)
+      {
+        for (auto cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(const_cast<struct msghdr *>(&msg), cmsg)) {
+          if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_TIMESTAMPING) {
+            continue;
+          }
+          const auto timestamps = reinterpret_cast<const struct scm_timestamping *>(CMSG_DATA(cmsg));
+          const auto &ts = timestamps->ts[2].tv_sec || timestamps->ts[2].tv_nsec
+                  ? timestamps->ts[2] : timestamps->ts[0];
+          return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+        }
+        return 0;
+      }
+#endif
+
+      char *buffer(size_t i)
+      {
+        return d_batch[i] ? d_batch[i]->data.data() : d_spare[i].data();
+      }
+
+      // Executed by the receive thread, with the sources locked
+      source_t &get_source(const udp::endpoint &endpoint)
+      {
+        auto it = d_source_index.find(endpoint);
+        if (it == d_source_index.end()) {
+          it = d_source_index.emplace(endpoint, d_sources.size()).first;
+          d_sources.push_back(source_t {});
+          d_sources.back().host_and_port = endpoint.address().to_string() + ":"
+                  + std::to_string(endpoint.port());
+        }
+        return d_sources[it->second];
+      }
+
+      // Executed by the receive thread, with the sources locked
+      static void account_sequence(source_t &source, uint32_t sequence)
+      {
+        if (!source.has_sequence) {
+          source.has_sequence = true;
+          source.next_sequence = sequence + 1;
+          return;
+        }
+
+        const uint32_t late = source.next_sequence - 1 - sequence;
+        if (late < REORDER_WINDOW) {
+          // reordered (or duplicated), counted as lost when skipped
+          if (late > 0 && source.lost > 0) {
+            source.lost--;
+          }
+          return;
+        }
+
+        const uint32_t gap = sequence - source.next_sequence;
+        if (gap < 0x80000000u) {
+          source.lost += gap;
+        }
+        // else the sender restarted
+        source.next_sequence = sequence + 1;
+      }
+
+      // Executed by the receive thread, receives up to BATCH_SIZE datagrams, returns their number
+      size_t receive_batch()
+      {
+        for (size_t i = 0; i < BATCH_SIZE; i++) {
+          if (!d_batch[i] && !d_free_datagrams.pop(d_batch[i])) {
+            d_batch[i] = nullptr;
+          }
+        }
+
+#ifdef __linux__
+        for (size_t i = 0; i < BATCH_SIZE; i++) {
+          d_iovs[i].iov_base = buffer(i);
+          d_iovs[i].iov_len = MAX_LENGTH;
+          d_headers[i].msg_hdr.msg_namelen = d_senders[i].capacity();
+          d_headers[i].msg_hdr.msg_controllen = CONTROL_SIZE;
+        }
+
+        int retval;
+        do {
+          retval = ::recvmmsg(d_socket.native_handle(), d_headers.data(), BATCH_SIZE, MSG_DONTWAIT, nullptr);
+        } while (retval < 0 && errno == EINTR);
+
+        const size_t count = retval > 0 ? retval : 0;
+        const int64_t read_ns = count ? now_utc_ns() : 0;
+        for (size_t i = 0; i < count; i++) {
+          d_senders[i].resize(d_headers[i].msg_hdr.msg_namelen);
+          d_lengths[i] = d_headers[i].msg_len;
+
+          const auto rx_ns = get_rx_timestamp(d_headers[i].msg_hdr);
+          d_received_ns[i] = rx_ns ? rx_ns : read_ns;
+        }
+#else
+        size_t count = 0;
+        for (; count < BATCH_SIZE; count++) {
+          boost::system::error_code ec;
+          d_lengths[count] = d_socket.receive_from(boost::asio::buffer(buffer(count), MAX_LENGTH),
+                  d_senders[count], 0, ec);
+          if (ec) {
+            break;
+          }
+          d_received_ns[count] = now_utc_ns();
+        }
+#endif
+
+        boost::mutex::scoped_lock lock(d_sources_mutex);
+
+        for (size_t i = 0; i < count; i++) {
+          auto &source = get_source(d_senders[i]);
+          source.received++;
+
+          uint32_t sequence;
+          int64_t send_timestamp;
+          bool has_latency = false;
+          int64_t latency = 0;
+          if (get_edge_detect_header(buffer(i), d_lengths[i], sequence, send_timestamp)) {
+            account_sequence(source, sequence);
+
+            if (send_timestamp) {
+              has_latency = true;
+              latency = d_received_ns[i] - send_timestamp;
+              source.last_latency_ns = latency;
+              source.max_latency_ns = std::max(source.max_latency_ns, latency);
+            }
+          }
+
+          if (!d_batch[i]) {
+            source.dropped++;
+            continue;
+          }
+
+          d_batch[i]->length = d_lengths[i];
+          d_batch[i]->has_latency = has_latency;
+          d_batch[i]->latency_ns = latency;
+          d_received_datagrams.push(d_batch[i]);
+          d_batch[i] = nullptr;
+        }
+
+        return count;
+      }
+
+      // Executed by the receive thread
+      void run()
+      {
+        while (!d_stop.load(std::memory_order_relaxed)) {
+          struct pollfd fd {d_socket.native_handle(), POLLIN, 0};
+          if (::poll(&fd, 1, POLL_TIMEOUT_MS) <= 0) {
+            continue;
+          }
+
+          // drain the socket
+          while (receive_batch() == BATCH_SIZE && !d_stop.load(std::memory_order_relaxed)) {
+          }
+        }
+      }
 
      public:
 
-      udp_receiver(boost::asio::io_service& io_service, udp::endpoint endpoint)
-         : d_io_service(io_service),
-           d_socket(d_io_service, endpoint),
-           d_data(MAX_LENGTH),
-           d_ec(),
-           d_length(-1)
+      udp_receiver(boost::asio::io_service& io_service, udp::endpoint endpoint, const std::string &thread_owner)
+         : d_socket(io_service),
+           d_datagrams(RING_SIZE),
+           d_batch(BATCH_SIZE, nullptr),
+           d_spare(BATCH_SIZE, std::vector<char>(MAX_LENGTH)),
+           d_senders(BATCH_SIZE),
+           d_lengths(BATCH_SIZE),
+           d_received_ns(BATCH_SIZE),
+           d_stop(false)
       {
-        d_socket.async_receive(
-          boost::asio::buffer(d_data, MAX_LENGTH),
-          boost::bind(&udp_receiver::handle_receive_from, this,
-            boost::asio::placeholders::error,
-            boost::asio::placeholders::bytes_transferred));
-        d_thread.reset(new boost::thread(
-          boost::bind(&boost::asio::io_service::run, &d_io_service)));
+        d_socket.open(endpoint.protocol());
+        if (endpoint.address().is_multicast()) {
+          // multiple receivers on the same host might subscribe to the same group
+          d_socket.set_option(udp::socket::reuse_address(true));
+          d_socket.bind(udp::endpoint(udp::v4(), endpoint.port()));
+          d_socket.set_option(boost::asio::ip::multicast::join_group(endpoint.address()));
+        }
+        else {
+          d_socket.bind(endpoint);
+        }
+        d_socket.non_blocking(true);
+
+        for (auto &datagram : d_datagrams) {
+          datagram.data.resize(MAX_LENGTH);
+          d_free_datagrams.push(&datagram);
+        }
+
+#ifdef __linux__
+        // receive timestamps, the read time is taken if not supported
+        int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_RX_HARDWARE
+                | SOF_TIMESTAMPING_SOFTWARE | SOF_TIMESTAMPING_RAW_HARDWARE;
+        ::setsockopt(d_socket.native_handle(), SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags));
+
+        d_headers.assign(BATCH_SIZE, mmsghdr {});
+        d_iovs.resize(BATCH_SIZE);
+        d_controls.resize(BATCH_SIZE * CONTROL_SIZE);
+        for (size_t i = 0; i < BATCH_SIZE; i++) {
+          d_headers[i].msg_hdr.msg_name = d_senders[i].data();
+          d_headers[i].msg_hdr.msg_iov = &d_iovs[i];
+          d_headers[i].msg_hdr.msg_iovlen = 1;
+          d_headers[i].msg_hdr.msg_control = &d_controls[i * CONTROL_SIZE];
+        }
+#endif
+
+        d_thread.reset(new boost::thread([this, thread_owner] {
+          thread_scope_t thread(thread_owner, "udp-receive");
+          run();
+        }));
       }
 
       ~udp_receiver()
       {
-        d_socket.close();
-        d_io_service.stop();
+        d_stop.store(true);
         d_thread->join();
+        d_socket.close();
       }
 
-      void
-      handle_receive_from(const boost::system::error_code& error,
-            size_t bytes_recvd)
+      /*!
+       * \brief Pops a received datagram, returns false if there is none. The datagram is to be
+       * released once decoded. Called by a single (work) thread.
+       */
+      bool pop(datagram_t *&datagram)
       {
-        if (!error && bytes_recvd > 0) {
-          d_messages.push(std::string(d_data.data(), bytes_recvd));
-        }
-        d_socket.async_receive(
-          boost::asio::buffer(d_data, MAX_LENGTH),
-          boost::bind(&udp_receiver::handle_receive_from, this,
-            boost::asio::placeholders::error,
-            boost::asio::placeholders::bytes_transferred));
+        return d_received_datagrams.pop(datagram);
       }
 
-      std::string
-      get_msg()
+      void release(datagram_t *datagram)
       {
-        std::string message = "";
-        if(d_messages.size() > 0) {
-          d_messages.wait_and_pop(message, boost::chrono::milliseconds(0));
+        d_free_datagrams.push(datagram);
+      }
+
+      std::vector<udp_source_stats_t> get_stats() const
+      {
+        boost::mutex::scoped_lock lock(d_sources_mutex);
+
+        std::vector<udp_source_stats_t> stats;
+        for (const auto &source : d_sources) {
+          udp_source_stats_t s;
+          s.host_and_port = source.host_and_port;
+          s.received = source.received;
+          s.lost = source.lost;
+          s.dropped = source.dropped;
+          s.last_latency_ns = source.last_latency_ns;
+          s.max_latency_ns = source.max_latency_ns;
+          stats.push_back(s);
+        }
+        return stats;
+      }
+
+      void reset_stats()
+      {
+        boost::mutex::scoped_lock lock(d_sources_mutex);
+
+        // the sequence numbers are still tracked
+        for (auto &source : d_sources) {
+          source.received = 0;
+          source.lost = 0;
+          source.dropped = 0;
+          source.last_latency_ns = 0;
+          source.max_latency_ns = 0;
         }
-        return message;
       }
     };
 
@@ -95,16 +397,29 @@ namespace gr {
       udp_receiver * d_udp_receive;
 
       std::queue<std::string> d_queue;
+      std::vector<edge_detect_t> d_edges;
+      std::string d_message;
+
+      // Hashed event ids of the accepted edges (sorted), all edges are accepted if empty
+      std::vector<uint64_t> d_event_filter;
+
+      bool is_accepted(const edge_detect_t &edge) const;
+
+      block_stats_recorder_t d_stats {this};
 
      public:
 
-      edge_trigger_receiver_f_impl(std::string addr, int port);
+      edge_trigger_receiver_f_impl(std::string addr, int port, std::string event_filter);
 
       ~edge_trigger_receiver_f_impl();
 
       int work(int noutput_items,
          gr_vector_const_void_star &input_items,
          gr_vector_void_star &output_items);
+
+      std::vector<udp_source_stats_t> get_udp_source_stats() const override;
+
+      void reset_udp_stats() override;
     };
 
   } // namespace digitizers
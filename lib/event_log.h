@@ -0,0 +1,335 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_EVENT_LOG_H
+#define INCLUDED_DIGITIZERS_EVENT_LOG_H
+
+#include <digitizers/digitizer_block.h>
+#include "utils.h"
+#include <boost/circular_buffer.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+
+namespace gr {
+  namespace digitizers {
+
+    enum event_kind_t : uint16_t
+    {
+      EVENT_ERROR = 0,        // error code reported via get_errors, not logged
+      EVENT_DRIVER_OVERRUN,   // driver buffer overrun
+      EVENT_BUFFERS_LOST,     // count: number of application buffers lost
+      EVENT_POLL_FAILED,      // driver poll failed with the error code
+      EVENT_WAIT_FAILED,      // waiting for data failed with the error code (rapid block)
+      EVENT_WATCHDOG,         // count: measured sample rate [Hz]
+      EVENT_WATCHDOG_STALL,   // count: samples received since arm
+      EVENT_WATCHDOG_REARM,   // work re-arms the device because of the watchdog
+      EVENT_REALIGNMENT_TIMEOUT, // count: triggers not realigned, no WR event within max_buffer_time
+      EVENT_KIND_COUNT
+    };
+
+    /*!
+     * \brief Compact event record, see event_log_t.
+     */
+    struct event_record_t
+    {
+      uint64_t timestamp;
+      const std::error_category *category; // null if no error code is attached
+      int32_t code;
+      uint16_t kind;
+      uint64_t count;
+
+      std::error_code error_code() const
+      {
+        return category ? std::error_code(code, *category) : std::error_code{};
+      }
+    };
+
+    /*!
+     * \brief Structured event log of a digitizer.
+     *
+     * Producers (poll thread, streaming callback, work thread) write fixed size records into a
+     * ring and never block, allocate or format strings. Each slot carries a sequence number
+     * (odd while written) so the consumer can detect records being written or overwritten. If
+     * the ring wraps before being drained, the oldest records are lost and counted.
+     *
+     * The consumer side (drain, get_errors, the background thread) is serialized by a mutex.
+     * Drained EVENT_ERROR records are kept for get_errors, all the other kinds are passed to
+     * the logger rate limited per kind: the first event of a kind is logged right away, further
+     * events within the log interval are folded into a single line logged once the interval
+     * has elapsed, together with the number of events folded.
+     */
+    class event_log_t
+    {
+      static_assert(std::is_trivially_copyable<event_record_t>::value, "records must be trivially copyable");
+
+    public:
+
+      /*!
+       * \brief Called by the consumer. Suppressed is the number of further events of the same
+       * kind folded into this one.
+       */
+      typedef std::function<void(const event_record_t &record, uint64_t suppressed)> logger_t;
+
+      event_log_t(size_t capacity, size_t history, uint64_t log_interval_ns=1000000000)
+        : d_slots(round_up_pow2(capacity)),
+          d_mask(d_slots.size() - 1),
+          d_head(0),
+          d_tail(0),
+          d_lost(0),
+          d_history(history),
+          d_log_interval_ns(log_interval_ns)
+      {
+        // Sequence numbers below 2 * index + 2 mark the slot as not yet written
+        for (auto &slot : d_slots) {
+          slot.seq.store(0, std::memory_order_relaxed);
+        }
+
+        for (auto &state : d_kinds) {
+          state = kind_state_t{};
+        }
+      }
+
+      ~event_log_t()
+      {
+        stop();
+      }
+
+      event_log_t(const event_log_t &) = delete;
+      event_log_t &operator=(const event_log_t &) = delete;
+
+      void set_logger(logger_t logger)
+      {
+        boost::mutex::scoped_lock lock(d_consumer_mutex);
+        d_logger = std::move(logger);
+      }
+
+      /*!
+       * \brief Records an event. Wait-free, safe to call from any thread.
+       */
+      void push(event_kind_t kind, std::error_code ec = std::error_code{}, uint64_t count = 1)
+      {
+        event_record_t record;
+        record.timestamp = get_timestamp_nano_utc();
+        record.category = ec ? &ec.category() : nullptr;
+        record.code = ec.value();
+        record.kind = kind;
+        record.count = count;
+
+        auto index = d_head.fetch_add(1, std::memory_order_relaxed);
+        auto &slot = d_slots[index & d_mask];
+
+        slot.seq.store(2 * index + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(&slot.record, &record, sizeof(record));
+        slot.seq.store(2 * index + 2, std::memory_order_release);
+      }
+
+      void push(std::error_code ec)
+      {
+        push(EVENT_ERROR, ec);
+      }
+
+      /*!
+       * \brief Moves the pending records into the error history and the logger.
+       */
+      void drain()
+      {
+        boost::mutex::scoped_lock lock(d_consumer_mutex);
+        drain_locked(get_timestamp_nano_utc(), false);
+      }
+
+      /*!
+       * \brief Drains and logs all the events suppressed so far.
+       */
+      void flush()
+      {
+        boost::mutex::scoped_lock lock(d_consumer_mutex);
+        drain_locked(get_timestamp_nano_utc(), true);
+      }
+
+      /*!
+       * \brief Returns the errors recorded since the last call, at most the history size.
+       */
+      std::vector<error_info_t> get_errors()
+      {
+        boost::mutex::scoped_lock lock(d_consumer_mutex);
+        drain_locked(get_timestamp_nano_utc(), false);
+
+        std::vector<error_info_t> ret(d_history.begin(), d_history.end());
+        d_history.clear();
+        return ret;
+      }
+
+      /*!
+       * \brief Number of records overwritten before being drained.
+       */
+      uint64_t lost() const
+      {
+        return d_lost.load(std::memory_order_relaxed);
+      }
+
+      /*!
+       * \brief Starts the background thread draining the log every period_ms.
+       */
+      void start(int period_ms=100)
+      {
+        if (d_thread.joinable()) {
+          return;
+        }
+
+        d_thread = boost::thread([this, period_ms] {
+          try {
+            while (true) {
+              boost::this_thread::sleep_for(boost::chrono::milliseconds(period_ms));
+              drain();
+            }
+          }
+          catch (const boost::thread_interrupted &) { }
+        });
+      }
+
+      /*!
+       * \brief Stops the background thread and flushes the suppressed events.
+       */
+      void stop()
+      {
+        if (d_thread.joinable()) {
+          d_thread.interrupt();
+          d_thread.join();
+        }
+
+        flush();
+      }
+
+    private:
+
+      struct slot_t
+      {
+        std::atomic<uint64_t> seq;
+        event_record_t record;
+      };
+
+      struct kind_state_t
+      {
+        uint64_t last_logged;   // timestamp
+        uint64_t suppressed;    // events folded since then
+        event_record_t last;    // last event folded
+      };
+
+      static size_t round_up_pow2(size_t n)
+      {
+        size_t size = 1;
+        while (size < n) {
+          size <<= 1;
+        }
+        return size;
+      }
+
+      void drain_locked(uint64_t now, bool flush)
+      {
+        const uint64_t size = d_slots.size();
+        auto head = d_head.load(std::memory_order_acquire);
+
+        while (d_tail < head) {
+          if (head - d_tail > size) {
+            d_lost.fetch_add(head - size - d_tail, std::memory_order_relaxed);
+            d_tail = head - size;
+          }
+
+          auto &slot = d_slots[d_tail & d_mask];
+          auto expected = 2 * d_tail + 2;
+
+          auto seq = slot.seq.load(std::memory_order_acquire);
+          if (seq < expected) {
+            break;  // still being written, picked up by the next drain
+          }
+
+          event_record_t record;
+          std::memcpy(&record, &slot.record, sizeof(record));
+          std::atomic_thread_fence(std::memory_order_acquire);
+
+          if (seq != expected || slot.seq.load(std::memory_order_relaxed) != expected) {
+            // Overwritten by a producer that wrapped around
+            d_lost.fetch_add(1, std::memory_order_relaxed);
+            d_tail++;
+            continue;
+          }
+
+          d_tail++;
+          consume(record, now);
+        }
+
+        for (uint16_t kind = 0; kind < EVENT_KIND_COUNT; kind++) {
+          auto &state = d_kinds[kind];
+          if (state.suppressed && (flush || now - state.last_logged >= d_log_interval_ns)) {
+            log(state.last, state.suppressed - 1);
+            state.last_logged = now;
+            state.suppressed = 0;
+          }
+        }
+      }
+
+      void consume(const event_record_t &record, uint64_t now)
+      {
+        if (record.kind == EVENT_ERROR) {
+          d_history.push_back(error_info_t{record.timestamp, record.error_code()});
+          return;
+        }
+
+        if (record.kind >= EVENT_KIND_COUNT) {
+          return;
+        }
+
+        auto &state = d_kinds[record.kind];
+        if (!state.suppressed && now - state.last_logged >= d_log_interval_ns) {
+          log(record, 0);
+          state.last_logged = now;
+        }
+        else {
+          state.suppressed++;
+          state.last = record;
+        }
+      }
+
+      void log(const event_record_t &record, uint64_t suppressed)
+      {
+        if (d_logger) {
+          d_logger(record, suppressed);
+        }
+      }
+
+      // Producer side. The padding keeps d_head on a cache line of its own without alignas,
+      // i.e. the owning blocks stay allocatable by a plain new in C++11.
+      std::vector<slot_t> d_slots;
+      const uint64_t d_mask;
+      char d_producer_pad[64];
+      std::atomic<uint64_t> d_head;
+      char d_consumer_pad[64];
+
+      // Consumer side
+      boost::mutex d_consumer_mutex;
+      uint64_t d_tail;
+      std::atomic<uint64_t> d_lost;
+      boost::circular_buffer<error_info_t> d_history;
+      std::array<kind_state_t, EVENT_KIND_COUNT> d_kinds;
+      const uint64_t d_log_interval_ns;
+      logger_t d_logger;
+
+      boost::thread d_thread;
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_EVENT_LOG_H */
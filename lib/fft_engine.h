@@ -0,0 +1,123 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_FFT_ENGINE_H
+#define INCLUDED_DIGITIZERS_FFT_ENGINE_H
+
+#include <gnuradio/fft/fft.h>
+#include <gnuradio/gr_complex.h>
+#include <volk/volk.h>
+
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/weak_ptr.hpp>
+
+#include <cstring>
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Process-wide real forward FFT engine for a given size.
+     *
+     * Plans are expensive to create (FFTW measures them, see gr::fft::planner), therefore all
+     * the blocks using the same FFT size share one engine. Each engine keeps a pool of plans,
+     * one per thread executing concurrently, i.e. blocks never wait on each other. Frames are
+     * transformed in batches, one batch per work call.
+     *
+     * Use get to obtain the engine, it is released once the last user drops it.
+     */
+    class fft_engine_t : boost::noncopyable
+    {
+    public:
+
+      typedef boost::shared_ptr<fft_engine_t> sptr;
+
+      static sptr get(int fft_size)
+      {
+        static boost::mutex registry_mutex;
+        static std::map<int, boost::weak_ptr<fft_engine_t>> registry;
+
+        boost::mutex::scoped_lock lock(registry_mutex);
+
+        auto engine = registry[fft_size].lock();
+        if (!engine) {
+          engine.reset(new fft_engine_t(fft_size));
+          registry[fft_size] = engine;
+        }
+        return engine;
+      }
+
+      int fft_size() const
+      {
+        return d_fft_size;
+      }
+
+      /*!
+       * \brief Transforms nframes consecutive frames of fft_size samples, each multiplied by
+       * the window. For each frame the first nbins bins are written to out (nbins <= fft_size / 2 + 1).
+       */
+      void execute(const float *frames, int nframes, const float *window, int nbins, gr_complex *out)
+      {
+        auto plan = acquire();
+
+        float *inbuf = plan->get_inbuf();
+        const gr_complex *outbuf = plan->get_outbuf();
+
+        for (int k = 0; k < nframes; k++) {
+          volk_32f_x2_multiply_32f(inbuf, frames + k * d_fft_size, window, d_fft_size);
+          plan->execute();
+          memcpy(out + k * nbins, outbuf, nbins * sizeof(gr_complex));
+        }
+
+        release(std::move(plan));
+      }
+
+    private:
+
+      typedef std::unique_ptr<gr::fft::fft_real_fwd> plan_t;
+
+      explicit fft_engine_t(int fft_size)
+        : d_fft_size(fft_size)
+      {
+        // one plan is always needed, create it upfront
+        d_plans.emplace_back(new gr::fft::fft_real_fwd(fft_size));
+      }
+
+      plan_t acquire()
+      {
+        {
+          boost::mutex::scoped_lock lock(d_mutex);
+          if (!d_plans.empty()) {
+            plan_t plan = std::move(d_plans.back());
+            d_plans.pop_back();
+            return plan;
+          }
+        }
+
+        // all plans are in use, planning is serialized by gr::fft::planner
+        return plan_t(new gr::fft::fft_real_fwd(d_fft_size));
+      }
+
+      void release(plan_t plan)
+      {
+        boost::mutex::scoped_lock lock(d_mutex);
+        d_plans.push_back(std::move(plan));
+      }
+
+      const int d_fft_size;
+      boost::mutex d_mutex;
+      std::vector<plan_t> d_plans;
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_FFT_ENGINE_H */
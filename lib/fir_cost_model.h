@@ -0,0 +1,101 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_FIR_COST_MODEL_H
+#define INCLUDED_DIGITIZERS_FIR_COST_MODEL_H
+
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+
+namespace gr {
+  namespace digitizers {
+
+    enum fir_engine_t
+    {
+      FIR_ENGINE_DIRECT = 0,  // fir_filter_fff, with decimation only the kept outputs are computed (polyphase)
+      FIR_ENGINE_FFT          // fft_filter_fff, overlap-save, all outputs are computed
+    };
+
+    static inline const char *
+    fir_engine_name(fir_engine_t engine)
+    {
+      return engine == FIR_ENGINE_FFT ? "fft" : "direct";
+    }
+
+    /*!
+     * \brief Cost model of the FIR filter engines, in nanoseconds per input sample.
+     *
+     *   direct = ntaps * mac_ns / decimation
+     *   fft    = (2 * fft_ns * N * log2(N) + bin_ns * (N / 2 + 1)) / (N - ntaps + 1)
+     *
+     * where N is the FFT size chosen by gr::filter::kernel::fft_filter_fff, i.e. twice the tap
+     * count rounded up to a power of two. The FFT engine filters every input sample regardless
+     * of the decimation.
+     *
+     * The defaults are estimates for a current x86 core with AVX2 (crossover at about 100 taps
+     * without decimation). The custom_filter_* benchmarks of bench_digitizers measure both the
+     * engines for a range of tap counts, the constants fitted to those on the target machine
+     * can be set via the DIGITIZERS_FIR_COST_MODEL environment variable ("mac_ns,fft_ns,bin_ns").
+     */
+    struct fir_cost_model_t
+    {
+      double mac_ns;   // per multiply-accumulate of the direct form
+      double fft_ns;   // per N * log2(N) of a real FFT, forward or inverse
+      double bin_ns;   // per frequency bin (complex multiply and bookkeeping)
+
+      static size_t fft_size(size_t ntaps)
+      {
+        size_t size = 1;
+        while (size < ntaps) {
+          size <<= 1;
+        }
+        return 2 * size;
+      }
+
+      double direct_cost(size_t ntaps, int decimation) const
+      {
+        return ntaps * mac_ns / decimation;
+      }
+
+      double fft_cost(size_t ntaps) const
+      {
+        const double n = static_cast<double>(fft_size(ntaps));
+        return (2.0 * fft_ns * n * std::log2(n) + bin_ns * (n / 2.0 + 1.0)) / (n - ntaps + 1.0);
+      }
+
+      fir_engine_t select(size_t ntaps, int decimation) const
+      {
+        return fft_cost(ntaps) < direct_cost(ntaps, decimation) ? FIR_ENGINE_FFT : FIR_ENGINE_DIRECT;
+      }
+
+      /*!
+       * \brief Model used by the FIR_AUTO algorithm, determined on first use.
+       */
+      static const fir_cost_model_t &instance()
+      {
+        static const fir_cost_model_t model = []() {
+          fir_cost_model_t model {0.06, 0.12, 1.5};
+
+          const char *env = std::getenv("DIGITIZERS_FIR_COST_MODEL");
+          fir_cost_model_t parsed;
+          if (env && std::sscanf(env, "%lf,%lf,%lf", &parsed.mac_ns, &parsed.fft_ns, &parsed.bin_ns) == 3
+                  && parsed.mac_ns > 0 && parsed.fft_ns > 0 && parsed.bin_ns >= 0) {
+            model = parsed;
+          }
+
+          return model;
+        }();
+
+        return model;
+      }
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_FIR_COST_MODEL_H */
@@ -0,0 +1,133 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gnuradio/io_signature.h>
+#include <digitizers/tags.h>
+#include "frame_splitter_impl.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+namespace gr {
+  namespace digitizers {
+
+    static std::vector<int>
+    make_frame_splitter_output_signature(int ai_channels, int ports)
+    {
+      std::vector<int> signature(2 * ai_channels, sizeof(float));
+      signature.insert(signature.end(), ports, sizeof(uint8_t));
+      return signature;
+    }
+
+    frame_splitter::sptr
+    frame_splitter::make(int ai_channels, int ports, int frame_samples)
+    {
+      if (ai_channels < 0 || ports < 0 || ai_channels + ports == 0 || frame_samples < 1)
+      {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid frame layout, "
+                << ai_channels << " channels, " << ports << " ports, " << frame_samples << " samples";
+        throw std::invalid_argument(message.str());
+      }
+
+      return gnuradio::get_initial_sptr
+        (new frame_splitter_impl(ai_channels, ports, frame_samples));
+    }
+
+    /*
+     * The private constructor
+     */
+    frame_splitter_impl::frame_splitter_impl(int ai_channels, int ports, int frame_samples)
+      : gr::sync_interpolator("frame_splitter",
+              gr::io_signature::make(1, 1, frame_layout_t(ai_channels, ports, frame_samples).frame_size()),
+              gr::io_signature::makev(1, 2 * ai_channels + ports,
+                      make_frame_splitter_output_signature(ai_channels, ports)),
+              frame_samples),
+        d_layout(ai_channels, ports, frame_samples),
+        d_timebase(0.0)
+    {
+      set_tag_propagation_policy(TPP_DONT);
+    }
+
+    frame_splitter_impl::~frame_splitter_impl()
+    {
+    }
+
+    int
+    frame_splitter_impl::work(int noutput_items,
+        gr_vector_const_void_star &input_items,
+        gr_vector_void_star &output_items)
+    {
+      block_stats_scope_t stats(d_stats);
+
+      const auto in = static_cast<const uint8_t *>(input_items[0]);
+      const auto nframes = noutput_items / d_layout.samples;
+      const auto frame_size = d_layout.frame_size();
+      const int analog_outputs = 2 * d_layout.ai_channels;
+
+      for (int f = 0; f < nframes; f++) {
+        const auto frame = in + f * frame_size;
+
+        for (size_t i = 0; i < output_items.size(); i++) {
+          if (static_cast<int>(i) < analog_outputs) {
+            const auto channel = static_cast<int>(i) / 2;
+            const float *region = i % 2 ? d_layout.errors(frame, channel) : d_layout.values(frame, channel);
+            memcpy(static_cast<float *>(output_items[i]) + f * d_layout.samples, region,
+                    d_layout.samples * sizeof(float));
+          }
+          else {
+            memcpy(static_cast<uint8_t *>(output_items[i]) + f * d_layout.samples,
+                    d_layout.port(frame, static_cast<int>(i) - analog_outputs), d_layout.samples);
+          }
+        }
+      }
+
+      // Tags are attached to the first sample of the frame, triggers are moved to the trigger
+      // sample. The sample distance is known from the acq_info tag preceding the trigger.
+      d_tags.clear();
+      get_tags_in_range(d_tags, 0, nitems_read(0), nitems_read(0) + nframes);
+      std::stable_sort(d_tags.begin(), d_tags.end(),
+              [](const gr::tag_t &a, const gr::tag_t &b) { return a.offset < b.offset; });
+
+      for (const auto &tag : d_tags) {
+        auto out_tag = tag;
+        out_tag.offset = tag.offset * d_layout.samples;
+
+        const auto kind = get_tag_kind(tag.key);
+        if (kind == TAG_KIND_ACQ_INFO) {
+          d_timebase = decode_acq_info_tag(tag).timebase;
+        }
+        else if (kind == TAG_KIND_TIMEBASE_INFO) {
+          d_timebase = decode_timebase_info_tag(tag);
+        }
+        else if (kind == TAG_KIND_TRIGGER && d_timebase > 0.0) {
+          auto trigger = decode_trigger_tag(tag);
+          const auto sample = std::min<long>(d_layout.samples - 1,
+                  std::max<long>(0, std::lround(trigger.trigger_offset / d_timebase)));
+          if (sample) {
+            trigger.trigger_offset -= sample * d_timebase;
+            out_tag = make_trigger_tag(trigger, out_tag.offset + sample,
+                    pmt::is_blob(tag.value) ? TAG_ENCODING_BINARY : TAG_ENCODING_TUPLE);
+          }
+        }
+
+        for (size_t i = 0; i < output_items.size(); i++) {
+          add_item_tag(i, out_tag);
+        }
+      }
+
+      return nframes * d_layout.samples;
+    }
+
+  } /* namespace digitizers */
+} /* namespace gr */
@@ -0,0 +1,41 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_FRAME_SPLITTER_IMPL_H
+#define INCLUDED_DIGITIZERS_FRAME_SPLITTER_IMPL_H
+
+#include <digitizers/frame_splitter.h>
+#include "block_stats_impl.h"
+
+#include <vector>
+
+namespace gr {
+  namespace digitizers {
+
+    class frame_splitter_impl : public frame_splitter
+    {
+     private:
+      frame_layout_t d_layout;
+      double d_timebase;     // sample distance in seconds, zero until known
+      std::vector<gr::tag_t> d_tags;
+
+      block_stats_recorder_t d_stats {this};
+
+     public:
+      frame_splitter_impl(int ai_channels, int ports, int frame_samples);
+      ~frame_splitter_impl();
+
+      frame_layout_t get_frame_layout() const override { return d_layout; }
+
+      int work(int noutput_items,
+        gr_vector_const_void_star &input_items,
+        gr_vector_void_star &output_items) override;
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_FRAME_SPLITTER_IMPL_H */
@@ -11,6 +11,12 @@
 #include <gnuradio/io_signature.h>
 #include "freq_estimator_impl.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
 namespace gr {
   namespace digitizers {
 
@@ -23,17 +29,28 @@ namespace gr {
 
     freq_estimator_impl::freq_estimator_impl(float samp_rate, int signal_window_size, int averager_window_size, int decim)
       : gr::block("freq_estimator",
-              gr::io_signature::make(1, 1, sizeof(float)),
+              gr::io_signature::make(1, 2, sizeof(float)),
               gr::io_signature::make(1, 1, sizeof(float))),
-              d_sig_avg(signal_window_size),
+              d_sig_window(signal_window_size),
+              d_freq_window(averager_window_size),
               d_freq_avg(averager_window_size),
               d_samp_rate(samp_rate),
               d_avg_freq(0.0),
               d_prev_zero_dist(0.0),
               d_old_sig_avg(0.0),
               d_decim(decim),
-              d_counter(decim)
-    {}
+              d_counter(decim),
+              d_samples(std::max(signal_window_size - 1, 0), 0.0),
+              d_last_iq(0.0, 0.0),
+              d_products(std::max(averager_window_size - 1, 0))
+    {
+      if (signal_window_size < 1 || averager_window_size < 1 || decim < 1) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid window sizes or decimation: "
+                << signal_window_size << ", " << averager_window_size << ", " << decim;
+        throw std::invalid_argument(message.str());
+      }
+    }
 
     freq_estimator_impl::~freq_estimator_impl()
     {
@@ -43,49 +60,152 @@ namespace gr {
     freq_estimator_impl::forecast(int noutput_items,
       gr_vector_int &ninput_items_required)
     {
-      ninput_items_required[0] = d_decim * noutput_items;
+      for (auto &required : ninput_items_required) {
+        required = d_decim * noutput_items;
+      }
     }
 
     int
-    freq_estimator_impl::general_work(int noutput_items,
-        gr_vector_int &ninput_items,
-        gr_vector_const_void_star &input_items,
-        gr_vector_void_star &output_items)
+    freq_estimator_impl::estimate_zero_crossings(const float *in, int n_in, float *out)
     {
-      int n_in = ninput_items[0];
-      int n_out = 0;
-      const float *in = (const float *) input_items[0];
-      float *out = (float *) output_items[0];
-      float new_sig_avg;
-      for(int i = 0; i < n_in; i++) {
-        //average the signal to get rid of noise
-        new_sig_avg = d_sig_avg.add(in[i]);
+      const int history = d_sig_window - 1;
+
+      // Running average of the signal, as differences of prefix sums. The sums restart every
+      // call, i.e. the rounding error doesn't accumulate.
+      d_samples.resize(history + n_in);
+      memcpy(&d_samples[history], in, n_in * sizeof(float));
+
+      d_prefix.resize(history + n_in + 1);
+      d_prefix[0] = 0.0;
+      for (int k = 0; k < history + n_in; k++) {
+        d_prefix[k + 1] = d_prefix[k] + d_samples[k];
+      }
 
-        d_prev_zero_dist += 1;
+      d_sig_avgs.resize(n_in);
+      for (int i = 0; i < n_in; i++) {
+        d_sig_avgs[i] = static_cast<float>((d_prefix[i + d_sig_window] - d_prefix[i]) / d_sig_window);
+      }
 
-        //previous running average is differently signed as this one -> signal went through zero
-        if(! ((new_sig_avg < 0.0 && d_old_sig_avg < 0.0) || (new_sig_avg >= 0.0 && d_old_sig_avg >= 0.0))){
+      // averaged signal changed its sign -> signal went through zero
+      d_crossings.resize(n_in);
+      d_crossings[0] = (d_sig_avgs[0] < 0.0f) != (d_old_sig_avg < 0.0f);
+      for (int i = 1; i < n_in; i++) {
+        d_crossings[i] = (d_sig_avgs[i] < 0.0f) != (d_sig_avgs[i - 1] < 0.0f);
+      }
 
-          //interpolate where the averaged signal passed through zero
-          double x = (-new_sig_avg) / (new_sig_avg - d_old_sig_avg);
+      // Crossings are sparse, they are searched for and the outputs in between are filled
+      // with the estimate of the last crossing
+      int n_out = 0;
+      int next_out = d_counter - 1;  // index of the sample the next output is taken at
+      int last_crossing = -1;
 
-          //estimate of the frequency is an inverse of the distances between zero values.
-          d_avg_freq = d_freq_avg.add(d_samp_rate / (2.0 * (d_prev_zero_dist + x)));
+      for (int pos = 0; ; ) {
+        const void *found = memchr(&d_crossings[pos], 1, n_in - pos);
+        const int crossing = found ? static_cast<int>(static_cast<const uint8_t *>(found) - &d_crossings[0]) : n_in;
 
-          //starter offset for next estimate.
-          d_prev_zero_dist = -x;
+        for (; next_out < crossing; next_out += d_decim) {
+          out[n_out++] = d_avg_freq;
         }
-        //for the next iteration
-        d_old_sig_avg = new_sig_avg;
-
-        //decimate and post
-        d_counter--;
-        if(d_counter <= 0) {
-          d_counter = d_decim;
-          out[n_out] = d_avg_freq;
-          n_out++;
+
+        if (crossing == n_in) {
+          break;
         }
+
+        const float new_sig_avg = d_sig_avgs[crossing];
+        const float old_sig_avg = crossing ? d_sig_avgs[crossing - 1] : d_old_sig_avg;
+
+        //interpolate where the averaged signal passed through zero
+        double x = (-new_sig_avg) / (new_sig_avg - old_sig_avg);
+
+        d_prev_zero_dist += crossing - last_crossing;
+        last_crossing = crossing;
+        pos = crossing + 1;
+
+        // An average touching zero (e.g. -, 0, -) changes the sign twice at the same point,
+        // the second change is not a crossing (the interval would be zero)
+        if (d_prev_zero_dist + x <= 0.0) {
+          continue;
+        }
+
+        //estimate of the frequency is an inverse of the distances between zero values.
+        d_avg_freq = d_freq_avg.add(d_samp_rate / (2.0 * (d_prev_zero_dist + x)));
+
+        //starter offset for next estimate.
+        d_prev_zero_dist = -x;
+      }
+
+      // for the next call
+      d_prev_zero_dist += n_in - 1 - last_crossing;
+      d_old_sig_avg = d_sig_avgs[n_in - 1];
+      d_counter = next_out - n_in + 1;
+      d_samples.erase(d_samples.begin(), d_samples.begin() + n_in);
+
+      return n_out;
+    }
+
+    int
+    freq_estimator_impl::estimate_phase_increments(const float *in_i, const float *in_q, int n_in, float *out)
+    {
+      const int history = d_freq_window - 1;
+
+      // Lag-one products z[n] conj(z[n-1]), their phase is the phase increment
+      d_products.resize(history + n_in);
+      std::complex<float> previous = d_last_iq;
+      for (int i = 0; i < n_in; i++) {
+        const std::complex<float> iq(in_i[i], in_q[i]);
+        d_products[history + i] = iq * std::conj(previous);
+        previous = iq;
+      }
+      d_last_iq = previous;
+
+      d_product_prefix.resize(history + n_in + 1);
+      d_product_prefix[0] = 0.0;
+      for (int k = 0; k < history + n_in; k++) {
+        d_product_prefix[k + 1] = d_product_prefix[k] + std::complex<double>(d_products[k]);
+      }
+
+      // The products are averaged over the last freq_window samples before taking the phase,
+      // noise averages out instead of biasing the zero crossings
+      int n_out = 0;
+      int next_out = d_counter - 1;
+      for (; next_out < n_in; next_out += d_decim) {
+        const auto sum = d_product_prefix[next_out + d_freq_window] - d_product_prefix[next_out];
+        d_avg_freq = static_cast<float>(std::arg(sum) * d_samp_rate / (2.0 * M_PI));
+        out[n_out++] = d_avg_freq;
+      }
+
+      d_counter = next_out - n_in + 1;
+      d_products.erase(d_products.begin(), d_products.begin() + n_in);
+
+      return n_out;
+    }
+
+    int
+    freq_estimator_impl::general_work(int noutput_items,
+        gr_vector_int &ninput_items,
+        gr_vector_const_void_star &input_items,
+        gr_vector_void_star &output_items)
+    {
+      block_stats_scope_t stats(d_stats);
+
+      // Not more samples than needed for noutput_items outputs
+      int n_in = std::min(*std::min_element(ninput_items.begin(), ninput_items.end()),
+              d_counter + (noutput_items - 1) * d_decim);
+      if (n_in <= 0) {
+        return 0;
       }
+
+      const float *in = (const float *) input_items[0];
+      float *out = (float *) output_items[0];
+
+      int n_out;
+      if (input_items.size() > 1) {
+        n_out = estimate_phase_increments(in, (const float *) input_items[1], n_in, out);
+      }
+      else {
+        n_out = estimate_zero_crossings(in, n_in, out);
+      }
+
       consume_each(n_in);
       return n_out;
     }
@@ -93,9 +213,10 @@ namespace gr {
     void
     freq_estimator_impl::update_design(int decim)
     {
+      gr::thread::scoped_lock lock(d_setlock);
       d_decim = decim;
+      d_counter = std::min(d_counter, decim);
     }
 
   } /* namespace digitizers */
 } /* namespace gr */
-
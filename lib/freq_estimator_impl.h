@@ -9,13 +9,26 @@
 
 #include <digitizers/freq_estimator.h>
 #include "utils.h"
+#include "block_stats_impl.h"
+
+#include <complex>
+#include <cstdint>
+#include <vector>
+
 namespace gr {
   namespace digitizers {
 
     class freq_estimator_impl : public freq_estimator
     {
      private:
-      average_filter<float> d_sig_avg;
+      // Zero crossing estimator, the signal is averaged block-wise by prefix sums
+      int estimate_zero_crossings(const float *in, int n_in, float *out);
+
+      // Phase increment estimator, used if the quadrature input is connected
+      int estimate_phase_increments(const float *in_i, const float *in_q, int n_in, float *out);
+
+      const int d_sig_window;
+      const int d_freq_window;
       average_filter<double> d_freq_avg;
       float d_samp_rate;
       float d_avg_freq;
@@ -23,6 +36,20 @@ namespace gr {
       float d_old_sig_avg;
       int d_decim;
       int d_counter;
+
+      // Last sig_window - 1 samples followed by the samples of the current call
+      std::vector<float> d_samples;
+      std::vector<double> d_prefix;
+      std::vector<float> d_sig_avgs;
+      std::vector<uint8_t> d_crossings;
+
+      // Last freq_window - 1 lag-one products followed by the products of the current call
+      std::complex<float> d_last_iq;
+      std::vector<std::complex<float>> d_products;
+      std::vector<std::complex<double>> d_product_prefix;
+
+      block_stats_recorder_t d_stats {this};
+
      public:
       freq_estimator_impl(float samp_rate, int signal_window_size, int averager_window_size, int decim);
       ~freq_estimator_impl();
@@ -44,4 +71,3 @@ namespace gr {
 } // namespace gr
 
 #endif /* INCLUDED_DIGITIZERS_FREQ_ESTIMATOR_IMPL_H */
-
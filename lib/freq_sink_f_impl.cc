@@ -10,8 +10,14 @@
 
 #include <gnuradio/io_signature.h>
 #include "freq_sink_f_impl.h"
+#include "probes.h"
 #include <boost/make_shared.hpp>
 
+#include <algorithm>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+
 namespace gr {
   namespace digitizers {
 
@@ -29,7 +35,7 @@ namespace gr {
     freq_sink_f_impl::freq_sink_f_impl(std::string name, float samp_rate, size_t nbins,
             size_t nmeasurements, size_t nbuffers, freq_sink_mode_t mode)
       : gr::sync_block("freq_sink_f",
-              gr::io_signature::makev(3, 3,
+              gr::io_signature::makev(2, 3,
                   std::vector<int>(
                   {
                     static_cast<int>(nbins * sizeof(float)),
@@ -42,20 +48,25 @@ namespace gr {
         d_samp_rate(samp_rate),
         d_callback(nullptr),
         d_user_data(nullptr),
+        d_signal_id(0),
         d_nbins(nbins),
         d_nmeasurements(nmeasurements),
         d_nbuffers(nbuffers),
-        d_measurement_buffer(nbuffers),
-        d_acq_info_tags(4096), // some small number of acq_info tags
-        d_lost_count(0)
-    {
-      // initialize buffers
-      for (unsigned i = 0; i < nbuffers; i++) {
-        auto ptr = boost::make_shared<freq_domain_buffer_t>(nmeasurements, nbins);
-        d_measurement_buffer.return_free_buffer(ptr);
-      }
+        d_reduction(FREQ_SINK_REDUCTION_NONE),
+        d_reduction_count(1),
+        d_reduced(0),
+        d_reduced_metadata(),
+        d_exp_valid(false),
+        d_freq_axis_version(0),
+        d_freq_axis_valid(false),
+        d_read_sequence(0),
+        d_acq_info_tags(4096) // some small number of acq_info tags
+    {
+      d_frames.allocate(nbuffers * nmeasurements, nbins);
 
       set_output_multiple(nmeasurements);
+
+      message_port_register_out(pmt::mp("trace"));
     }
 
     /*
@@ -65,14 +76,38 @@ namespace gr {
     {
     }
 
+    bool
+    freq_sink_f_impl::start()
+    {
+      d_dispatcher.start([this](data_available_event_t &args) {
+        DIGITIZERS_PROBE1(sink_callback_start, d_metadata.name.c_str());
+        d_callback(&args, d_user_data);
+        DIGITIZERS_PROBE1(sink_callback_end, d_metadata.name.c_str());
+      }, get_block_name(this), "dispatch");
+
+      d_reduced = 0;
+      d_exp_valid = false;
+
+      return true;
+    }
+
+    bool
+    freq_sink_f_impl::stop()
+    {
+      d_dispatcher.stop();
+      return true;
+    }
+
     int
     freq_sink_f_impl::work(int noutput_items,
         gr_vector_const_void_star &input_items,
         gr_vector_void_star &output_items)
     {
+      block_stats_scope_t stats(d_stats);
       const float *magnitude = (const float *) input_items[0];
       const float *phase = (const float *) input_items[1];
-      const float *freqs = (const float *) input_items[2];
+      // The frequency axis is either streamed or received as freq_axis tags
+      const float *freqs = input_items.size() > 2 ? (const float *) input_items[2] : nullptr;
 
       assert(noutput_items % d_nmeasurements == 0);
 
@@ -81,63 +116,209 @@ namespace gr {
       // consume all acq_info tags
       std::vector<gr::tag_t> tags;
       get_tags_in_range(tags, 0, samp0_count, samp0_count + noutput_items,
-              pmt::string_to_symbol(acq_info_tag_name));
+              acq_info_tag_key());
       for (const auto &tag : tags) {
         d_acq_info_tags.push_back(decode_acq_info_tag(tag));
       }
 
-      const auto floats_per_buffer = d_nmeasurements * d_nbins;
+      if (trace_registry_t::active()) {
+        tags.clear();
+        get_tags_in_range(tags, 0, samp0_count, samp0_count + noutput_items, trace_tag_key());
+        publish_traces(this, tags, pmt::mp("trace"));
+      }
 
-      // consume buffer by buffer
-      auto iterations = noutput_items / d_nmeasurements;
-      for (size_t iteration = 0; iteration < iterations; iteration++)
-      {
-        auto measurement = d_measurement_buffer.get_free_buffer();
-        if (!measurement) {
-          d_lost_count++;
-          continue;
+      if (!freqs) {
+        get_tags_in_range(d_freq_axis_tags, 0, samp0_count, samp0_count + noutput_items,
+                freq_axis_tag_key());
+      }
+      auto axis_tag = d_freq_axis_tags.cbegin();
+
+      const auto bytes_per_frame = d_nbins * sizeof(float);
+
+      for (int i = 0; i < noutput_items; i++) {
+        const auto sequence = d_frames.begin_write();
+        bool axis_changed = false;
+
+        if (freqs) {
+          // The frequency axis is normally constant, a copy is made only if it changes
+          const auto frame_freqs = &freqs[i * d_nbins];
+          if (d_axes.empty() || memcmp(&(*d_axes.back().freq)[0], frame_freqs, bytes_per_frame) != 0) {
+            add_frequency_axis(sequence,
+                    boost::make_shared<const std::vector<float>>(frame_freqs, frame_freqs + d_nbins));
+            axis_changed = true;
+          }
+        }
+        else {
+          // Newest descriptor attached to this or any previous frame
+          bool changed = false;
+          for (; axis_tag != d_freq_axis_tags.cend() && axis_tag->offset <= samp0_count + i; ++axis_tag) {
+            auto descriptor = decode_freq_axis_tag(*axis_tag);
+            changed |= !d_freq_axis_valid || descriptor.version != d_freq_axis_version;
+            d_freq_axis = descriptor;
+            d_freq_axis_version = descriptor.version;
+            d_freq_axis_valid = true;
+          }
+
+          if (changed || d_axes.empty()) {
+            auto axis = boost::make_shared<std::vector<float>>(d_nbins, 0.0f);
+            if (d_freq_axis_valid) {
+              auto descriptor = d_freq_axis;
+              descriptor.nbins = std::min(descriptor.nbins, static_cast<uint32_t>(d_nbins));
+              fill_freq_axis(descriptor, &(*axis)[0]);
+            }
+            add_frequency_axis(sequence, axis);
+            axis_changed = true;
+          }
         }
 
-        assert(measurement->freq.size() == floats_per_buffer);
-        assert(measurement->phase.size() == floats_per_buffer);
-        assert(measurement->magnitude.size() == floats_per_buffer);
+        // Spectra of different axes are not combined
+        if (axis_changed) {
+          d_reduced = 0;
+          d_exp_valid = false;
+        }
 
-        // copy over the data
-        memcpy(&measurement->freq[0], &freqs[iteration * floats_per_buffer], floats_per_buffer * sizeof(float));
-        memcpy(&measurement->magnitude[0], &magnitude[iteration * floats_per_buffer], floats_per_buffer * sizeof(float));
-        memcpy(&measurement->phase[0], &phase[iteration * floats_per_buffer], floats_per_buffer * sizeof(float));
+        auto acq_info = calculate_acq_info_for_vector(samp0_count + static_cast<uint64_t>(i));
 
-        // measurement metadata
-        for (unsigned i = 0; i < d_nmeasurements; i++) {
-          auto offset = samp0_count + static_cast<uint64_t>(iteration * d_nmeasurements + i);
-          auto acq_info = calculate_acq_info_for_vector(offset);
+        if (d_reduced == 0) {
+          d_reduced_metadata.timebase = d_reduction_count / d_samp_rate;
+          d_reduced_metadata.timestamp = acq_info.timestamp;
+          d_reduced_metadata.trigger_timestamp = 0;
+          d_reduced_metadata.status = 0;
+          d_reduced_metadata.number_of_bins = d_nbins;
+          d_reduced_metadata.lost_count = 0;  // accounted for by the reader
+        }
+        d_reduced_metadata.status |= acq_info.status;
 
-          measurement->metadata[i].timebase = 1.0f / d_samp_rate;
-          measurement->metadata[i].timestamp = acq_info.timestamp;
-          measurement->metadata[i].trigger_timestamp = 0;
-          measurement->metadata[i].status = acq_info.status;
-          measurement->metadata[i].number_of_bins = d_nbins;
+        accumulate(&magnitude[i * d_nbins], &phase[i * d_nbins],
+                d_frames.magnitude(sequence), d_frames.phase(sequence));
 
-          measurement->metadata[i].lost_count = d_lost_count * d_nmeasurements;
-          d_lost_count = 0;
+        if (++d_reduced < d_reduction_count) {
+          continue;
+        }
+        d_reduced = 0;
+
+        auto &metadata = d_frames.metadata(sequence);
+        metadata = d_reduced_metadata;
+
+        d_frames.publish();
+
+        if (d_shm_export.is_open()) {
+          measurement_info_t info = {};
+          info.timebase = metadata.timebase;
+          info.timestamp = metadata.timestamp;
+          info.trigger_timestamp = metadata.trigger_timestamp;
+          info.status = metadata.status;
+
+          auto slot = d_shm_export.begin_write();
+          auto values = d_shm_export.values(slot);
+          memcpy(values, &(*d_axes.back().freq)[0], bytes_per_frame);
+          memcpy(values + d_nbins, d_frames.magnitude(sequence), bytes_per_frame);
+          memcpy(values + 2 * d_nbins, d_frames.phase(sequence), bytes_per_frame);
+          d_shm_export.commit(slot, info, 3 * d_nbins, 0);
         }
 
-        d_measurement_buffer.add_measurement(measurement);
+        // Notify once a whole buffer of measurements is available
+        const bool available = (sequence + 1) % d_nmeasurements == 0;
+        const auto trigger_timestamp = metadata.trigger_timestamp != -1
+                ? metadata.trigger_timestamp
+                : metadata.timestamp;
+
+        if (d_hub && available) {
+          d_hub->notify(d_signal_id, trigger_timestamp);
+        }
 
-        if (d_callback != nullptr) {
+        if (d_callback != nullptr && available) {
           data_available_event_t args;
-          args.trigger_timestamp = measurement->metadata[0].trigger_timestamp != -1
-                  ? measurement->metadata[0].trigger_timestamp
-                  : measurement->metadata[0].timestamp;
+          args.trigger_timestamp = trigger_timestamp;
           args.signal_name = d_metadata.name;
-          d_callback(&args, d_user_data);
-        }
 
-      } // for each iteration (or buffer)
+          if (d_dispatcher.is_async()) {
+            d_dispatcher.push(std::move(args));
+          }
+          else {
+            DIGITIZERS_PROBE1(sink_callback_start, d_metadata.name.c_str());
+            d_callback(&args, d_user_data);
+            DIGITIZERS_PROBE1(sink_callback_end, d_metadata.name.c_str());
+          }
+        }
+      }
 
       return noutput_items;
     }
 
+    void
+    freq_sink_f_impl::accumulate(const float *magnitude, const float *phase,
+            float *frame_magnitude, float *frame_phase)
+    {
+      const auto bytes_per_frame = d_nbins * sizeof(float);
+      const bool first = d_reduced == 0;
+
+      switch (d_reduction) {
+        case FREQ_SINK_REDUCTION_AVERAGE:
+        {
+          if (first) {
+            memcpy(frame_magnitude, magnitude, bytes_per_frame);
+            memcpy(frame_phase, phase, bytes_per_frame);
+          }
+          else {
+            for (size_t b = 0; b < d_nbins; b++) {
+              frame_magnitude[b] += magnitude[b];
+              frame_phase[b] += phase[b];
+            }
+          }
+
+          if (d_reduced + 1 == d_reduction_count && d_reduction_count > 1) {
+            const float scale = 1.0f / d_reduction_count;
+            for (size_t b = 0; b < d_nbins; b++) {
+              frame_magnitude[b] *= scale;
+              frame_phase[b] *= scale;
+            }
+          }
+          break;
+        }
+        case FREQ_SINK_REDUCTION_EXP_AVERAGE:
+        {
+          if (!d_exp_valid) {
+            d_exp_magnitude.assign(magnitude, magnitude + d_nbins);
+            d_exp_phase.assign(phase, phase + d_nbins);
+            d_exp_valid = true;
+          }
+          else {
+            const float alpha = 1.0f / d_reduction_count;
+            for (size_t b = 0; b < d_nbins; b++) {
+              d_exp_magnitude[b] += (magnitude[b] - d_exp_magnitude[b]) * alpha;
+              d_exp_phase[b] += (phase[b] - d_exp_phase[b]) * alpha;
+            }
+          }
+
+          if (d_reduced + 1 == d_reduction_count) {
+            memcpy(frame_magnitude, &d_exp_magnitude[0], bytes_per_frame);
+            memcpy(frame_phase, &d_exp_phase[0], bytes_per_frame);
+          }
+          break;
+        }
+        case FREQ_SINK_REDUCTION_MAX_HOLD:
+        {
+          if (first) {
+            memcpy(frame_magnitude, magnitude, bytes_per_frame);
+            memcpy(frame_phase, phase, bytes_per_frame);
+          }
+          else {
+            for (size_t b = 0; b < d_nbins; b++) {
+              if (magnitude[b] > frame_magnitude[b]) {
+                frame_magnitude[b] = magnitude[b];
+                frame_phase[b] = phase[b];
+              }
+            }
+          }
+          break;
+        }
+        default:
+          memcpy(frame_magnitude, magnitude, bytes_per_frame);
+          memcpy(frame_phase, phase, bytes_per_frame);
+      }
+    }
+
     signal_metadata_t
     freq_sink_f_impl::get_metadata()
     {
@@ -148,34 +329,123 @@ namespace gr {
     freq_sink_f_impl::get_measurements(size_t nr_measurements,
             spectra_measurement_t *metadata, float *frequency, float *magnitude, float *phase)
     {
-      auto buffer = d_measurement_buffer.get_measurement();
-      if (!buffer) {
-        return 0;
-      }
+      boost::mutex::scoped_lock lock(d_read_mutex);
 
-      // We were instructed to drop the data
-      if (metadata == nullptr || frequency == nullptr
-              || magnitude == nullptr || phase == nullptr)
-      {
-        d_measurement_buffer.return_free_buffer(buffer);
-        return 0;
-      }
+      const auto nmeasurements = static_cast<uint64_t>(d_nmeasurements);
+      const auto capacity = static_cast<uint64_t>(d_frames.capacity());
+      const auto bytes_per_frame = d_nbins * sizeof(float);
 
       if (nr_measurements > d_nmeasurements) {
         nr_measurements = d_nmeasurements;
       }
 
-      const auto data_size = nr_measurements * d_nbins * sizeof(float);
-      memcpy(frequency, &buffer->freq[0],      data_size);
-      memcpy(magnitude, &buffer->magnitude[0], data_size);
-      memcpy(phase,     &buffer->phase[0],     data_size);
+      uint32_t lost_count = 0;
+
+      while (true) {
+        const auto published = d_frames.published();
+
+        // Buffers overwritten meanwhile are lost, continue with the oldest complete one
+        if (published > capacity && d_read_sequence < published - capacity) {
+          auto oldest = (published - capacity + nmeasurements - 1) / nmeasurements * nmeasurements;
+          lost_count += static_cast<uint32_t>(oldest - d_read_sequence);
+          d_read_sequence = oldest;
+        }
+
+        if (published < d_read_sequence + nmeasurements) {
+          return 0;
+        }
+
+        // We were instructed to drop the data
+        if (metadata == nullptr || frequency == nullptr
+                || magnitude == nullptr || phase == nullptr)
+        {
+          d_read_sequence += nmeasurements;
+          return 0;
+        }
+
+        bool complete = true;
+        for (size_t i = 0; i < nr_measurements && complete; i++) {
+          const auto sequence = d_read_sequence + i;
+          auto axis = get_frequency_axis(sequence);
+
+          complete = axis && d_frames.read(sequence, [&](const spectra_measurement_t &frame_metadata,
+                  const float *frame_magnitude, const float *frame_phase) {
+            metadata[i] = frame_metadata;
+            memcpy(&frequency[i * d_nbins], &(*axis)[0], bytes_per_frame);
+            memcpy(&magnitude[i * d_nbins], frame_magnitude, bytes_per_frame);
+            memcpy(&phase[i * d_nbins], frame_phase, bytes_per_frame);
+          });
+        }
+
+        d_read_sequence += nmeasurements;
+
+        if (complete) {
+          metadata[0].lost_count = lost_count;
+          return nr_measurements;
+        }
+
+        // Overwritten while being copied
+        lost_count += static_cast<uint32_t>(nmeasurements);
+      }
+    }
+
+    uint64_t
+    freq_sink_f_impl::get_frame_sequence()
+    {
+      return d_frames.published();
+    }
+
+    size_t
+    freq_sink_f_impl::get_frame_capacity()
+    {
+      return d_frames.capacity();
+    }
+
+    bool
+    freq_sink_f_impl::read_frame(uint64_t sequence, frame_visitor_t visitor, void *ptr)
+    {
+      auto axis = get_frequency_axis(sequence);
+      if (!axis) {
+        return false;
+      }
+
+      return d_frames.read(sequence, [&](const spectra_measurement_t &metadata,
+              const float *magnitude, const float *phase) {
+        spectrum_frame_t frame;
+        frame.sequence = sequence;
+        frame.metadata = metadata;
+        frame.frequency = &(*axis)[0];
+        frame.magnitude = magnitude;
+        frame.phase = phase;
+        visitor(&frame, ptr);
+      });
+    }
+
+    void
+    freq_sink_f_impl::add_frequency_axis(uint64_t sequence, const boost::shared_ptr<const std::vector<float>> &axis)
+    {
+      boost::mutex::scoped_lock lock(d_axes_mutex);
+      d_axes.push_back({sequence, axis});
+
+      // Drop axes not referenced by any frame still held in the ring
+      while (d_axes.size() > 1 && d_axes[1].first_sequence + d_frames.capacity() <= sequence + 1) {
+        d_axes.pop_front();
+      }
+    }
 
-      const auto metadata_size = nr_measurements * sizeof(spectra_measurement_t);
-      memcpy(metadata, &buffer->metadata[0], metadata_size);
+    boost::shared_ptr<const std::vector<float>>
+    freq_sink_f_impl::get_frequency_axis(uint64_t sequence)
+    {
+      boost::mutex::scoped_lock lock(d_axes_mutex);
 
-      d_measurement_buffer.return_free_buffer(buffer);
+      // The last axis starting at or before the frame
+      auto it = std::upper_bound(d_axes.begin(), d_axes.end(), sequence,
+              [](uint64_t seq, const frequency_axis_t &axis) { return seq < axis.first_sequence; });
+      if (it == d_axes.begin()) {
+        return nullptr;
+      }
 
-      return nr_measurements;
+      return std::prev(it)->freq;
     }
 
     void
@@ -185,6 +455,55 @@ namespace gr {
       d_user_data = ptr;
     }
 
+    void
+    freq_sink_f_impl::set_notification_hub(notification_hub::sptr hub)
+    {
+      if (hub) {
+        d_signal_id = hub->register_signal(d_metadata.name);
+      }
+      d_hub = hub;
+    }
+
+    void
+    freq_sink_f_impl::set_shm_export(const std::string &name, size_t nslots)
+    {
+      if (name.empty()) {
+        d_shm_export.close();
+        return;
+      }
+
+      d_shm_export.open(name, SHM_EXPORT_FREQUENCY, d_metadata.name, nslots, 3 * d_nbins, 0);
+    }
+
+    void
+    freq_sink_f_impl::set_reduction(freq_sink_reduction_t reduction, size_t count)
+    {
+      if (count == 0) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid reduction count: " << count;
+        throw std::invalid_argument(message.str());
+      }
+
+      d_reduction = reduction;
+      d_reduction_count = reduction == FREQ_SINK_REDUCTION_NONE ? 1 : count;
+      d_reduced = 0;
+      d_exp_valid = false;
+      d_exp_magnitude.reserve(d_nbins);
+      d_exp_phase.reserve(d_nbins);
+    }
+
+    void
+    freq_sink_f_impl::set_async_dispatch(dispatch_policy_t policy, size_t queue_size)
+    {
+      d_dispatcher.configure(policy, queue_size);
+    }
+
+    uint64_t
+    freq_sink_f_impl::get_dropped_count()
+    {
+      return d_dispatcher.get_dropped_count();
+    }
+
     size_t
     freq_sink_f_impl::get_nbins()
     {
@@ -11,8 +11,13 @@
 #include <digitizers/tags.h>
 
 #include <boost/thread/mutex.hpp>
+#include <deque>
 #include <vector>
 #include "utils.h"
+#include "async_dispatcher.h"
+#include "spectrum_frame_ring.h"
+#include "block_stats_impl.h"
+#include "shm_export.h"
 
 namespace gr {
   namespace digitizers {
@@ -27,36 +32,60 @@ namespace gr {
       // callback stuff
       data_available_cb_t d_callback;
       void *d_user_data;
+      async_dispatcher_t<data_available_event_t> d_dispatcher;
+
+      // Batched notifications
+      notification_hub::sptr d_hub;
+      uint32_t d_signal_id;
+
+      // Frames exported as [frequency | magnitude | phase]
+      shm_export_t d_shm_export;
 
       // sizing
       size_t d_nbins;
       size_t d_nmeasurements;
       size_t d_nbuffers;
 
-      // Simple helper structure holding measurement data & metadata
-      struct freq_domain_buffer_t
+      // Frames, the frequency axis is kept separately
+      spectrum_frame_ring_t d_frames;
+
+      // Reduction, d_reduced spectra are accumulated in the frame being written
+      freq_sink_reduction_t d_reduction;
+      size_t d_reduction_count;
+      size_t d_reduced;
+      spectra_measurement_t d_reduced_metadata;
+
+      // Exponential average, carried over from frame to frame
+      std::vector<float> d_exp_magnitude;
+      std::vector<float> d_exp_phase;
+      bool d_exp_valid;
+
+      /*!
+       * \brief Frequency axis used by the frames starting at first_sequence.
+       */
+      struct frequency_axis_t
       {
-        freq_domain_buffer_t(unsigned nmeasurements, unsigned nbins)
-          : metadata(nmeasurements),
-            freq(nmeasurements * nbins),
-            magnitude(nmeasurements * nbins),
-            phase(nmeasurements * nbins),
-            nmeasurements(0)
-        { }
-
-        std::vector<spectra_measurement_t> metadata;
-        std::vector<float> freq;
-        std::vector<float> magnitude;
-        std::vector<float> phase;
-
-        // number of measurements stored in the buffer
-        unsigned nmeasurements;
+        uint64_t first_sequence;
+        boost::shared_ptr<const std::vector<float>> freq;
       };
 
-      measurement_buffer_t<freq_domain_buffer_t> d_measurement_buffer;
+      // Axes referenced by the frames in the ring, modified by the work function only
+      std::deque<frequency_axis_t> d_axes;
+      boost::mutex d_axes_mutex;
+
+      // Last freq_axis descriptor, used if the frequency input is not connected
+      std::vector<gr::tag_t> d_freq_axis_tags;
+      freq_axis_t d_freq_axis;
+      uint32_t d_freq_axis_version;
+      bool d_freq_axis_valid;
+
+      // get_measurements state, sequence number of the next buffer to read
+      uint64_t d_read_sequence;
+      boost::mutex d_read_mutex;
+
       boost::circular_buffer<acq_info_t> d_acq_info_tags;
-      unsigned d_lost_count;
 
+      block_stats_recorder_t d_stats {this};
 
      public:
       freq_sink_f_impl(std::string name, float samp_rate, size_t nbins,
@@ -64,6 +93,10 @@ namespace gr {
 
       ~freq_sink_f_impl();
 
+      bool start() override;
+
+      bool stop() override;
+
       // Where all the action really happens
       int work(int noutput_items,
          gr_vector_const_void_star &input_items,
@@ -76,6 +109,22 @@ namespace gr {
 
       void set_callback(data_available_cb_t callback, void *ptr) override;
 
+      void set_notification_hub(notification_hub::sptr hub) override;
+
+      void set_shm_export(const std::string &name, size_t nslots) override;
+
+      void set_reduction(freq_sink_reduction_t reduction, size_t count) override;
+
+      uint64_t get_frame_sequence() override;
+
+      size_t get_frame_capacity() override;
+
+      bool read_frame(uint64_t sequence, frame_visitor_t visitor, void *ptr) override;
+
+      void set_async_dispatch(dispatch_policy_t policy, size_t queue_size) override;
+
+      uint64_t get_dropped_count() override;
+
       size_t get_nbins() override;
 
       size_t get_nmeasurements() override;
@@ -86,6 +135,15 @@ namespace gr {
 
      private:
 
+      // Accumulates a spectrum into the frame, according to the reduction mode
+      void accumulate(const float *magnitude, const float *phase, float *frame_magnitude,
+              float *frame_phase);
+
+      void add_frequency_axis(uint64_t sequence, const boost::shared_ptr<const std::vector<float>> &axis);
+
+      // Returns the axis (null if not available anymore) of the given frame
+      boost::shared_ptr<const std::vector<float>> get_frequency_axis(uint64_t sequence);
+
       /*!
        * \brief In fact there is nothing much we can do here. The acq_info tags (and other tags
        * as well) are attached to a vector and not to the individual item in the vector therefore
@@ -10,10 +10,23 @@
 
 #include <gnuradio/io_signature.h>
 #include "function_ff_impl.h"
+#include <boost/thread/thread.hpp>
+
+#include <algorithm>
+#include <cmath>
 
 namespace gr {
   namespace digitizers {
 
+    // Plain loops, vectorized by the compiler
+    static inline void
+    fill_affine(float *out, int n, float base, float increment)
+    {
+      for (int j = 0; j < n; j++) {
+        out[j] = base + increment * static_cast<float>(j);
+      }
+    }
+
     function_ff::sptr
     function_ff::make(int decimation)
     {
@@ -29,14 +42,25 @@ namespace gr {
               gr::io_signature::make(1, 1, sizeof(float)),
               gr::io_signature::make(3, 3, sizeof(float)), decimation),
         d_acq_info(),
-        d_ref{0.0},
-        d_min{0.0},
-        d_max{0.0}
+        d_acq_info_offset(0),
+        d_tables(),
+        d_active_table(0),
+        d_reading_table(-1),
+        d_segment(-1),
+        d_segment_generation(0)
     {
      if(decimation <= 0) {
     	 GR_LOG_ALERT(logger, "function_ff_impl::function_ff_impl(int decimation) -decimation must not be <=0");
       }
       set_tag_propagation_policy(TPP_DONT);
+
+      d_tables[0].ref = {0.0};
+      d_tables[0].min = {0.0};
+      d_tables[0].max = {0.0};
+      d_tables[0].generation = 0;
+      d_tables[1].generation = 0;
+
+      d_acq_info.timestamp = -1;
     }
 
     bool
@@ -44,6 +68,7 @@ namespace gr {
     {
       // reset state
       d_acq_info.timestamp = -1;
+      d_segment = -1;
 
       return true;
     }
@@ -62,123 +87,173 @@ namespace gr {
 
       boost::mutex::scoped_lock lock(d_mutex);
 
-      d_ref = ref;
-      d_min = min;
-      d_max = max;
+      const int target = 1 - d_active_table.load();
+
+      // wait for the work thread to finish with the inactive table (swapped by the previous call)
+      while (d_reading_table.load() == target) {
+        boost::this_thread::yield();
+      }
+
+      // breakpoints without a time point (or value) are not used
+      const size_t npoints = ref.size() == 1 ? 1 : std::min(ref.size(), timing.size());
+
+      auto &table = d_tables[target];
+      table.ref.assign(ref.begin(), ref.begin() + npoints);
+      table.min.assign(min.begin(), min.begin() + npoints);
+      table.max.assign(max.begin(), max.begin() + npoints);
 
       // convert seconds to nanoseconds
-      d_timing.clear();
-      for (const auto t : timing) {
-        d_timing.push_back(static_cast<int64_t>(t * 1000000000.0));
+      table.timing.clear();
+      for (size_t i = 0; i < npoints && i < timing.size(); i++) {
+        table.timing.push_back(static_cast<int64_t>(timing[i] * 1000000000.0));
       }
+
+      table.generation = d_tables[1 - target].generation + 1;
+
+      d_active_table.store(target);
     }
 
     function_ff_impl::~function_ff_impl()
     {
     }
 
-    int
-    function_ff_impl::work(int noutput_items,
-        gr_vector_const_void_star &input_items,
-        gr_vector_void_star &output_items)
+    const function_ff_impl::function_table_t &
+    function_ff_impl::acquire_table()
     {
-      float *out_ref = (float *) output_items[0];
-      float *out_min = (float *) output_items[1];
-      float *out_max = (float *) output_items[2];
-
-      boost::mutex::scoped_lock lock(d_mutex);
-
-      if (d_ref.size() == 1) {
-        for (int i = 0; i < noutput_items; i++) {
-          out_ref[i] = d_ref[0];
-          out_min[i] = d_min[0];
-          out_max[i] = d_max[0];
+      // retry if the tables got swapped in between
+      for (;;) {
+        const int idx = d_active_table.load();
+        d_reading_table.store(idx);
+        if (d_active_table.load() == idx) {
+          return d_tables[idx];
         }
       }
-      else {
-
-        const uint64_t samp0_count = nitems_read(0);
+    }
 
-        for (int i = 0; i < noutput_items; i++) {
+    void
+    function_ff_impl::release_table()
+    {
+      d_reading_table.store(-1);
+    }
 
-          auto input_idx = i * decimation();
+    void
+    function_ff_impl::generate(const function_table_t &table, uint64_t first_sample, int count,
+            float *out_ref, float *out_min, float *out_max)
+    {
+      // no timing
+      if (table.ref.size() == 1 || d_acq_info.timestamp == -1) {
+        std::fill(out_ref, out_ref + count, table.ref[0]);
+        std::fill(out_min, out_min + count, table.min[0]);
+        std::fill(out_max, out_max + count, table.max[0]);
+        return;
+      }
 
-          // Get acq_info tags in range
-          std::vector<gr::tag_t> tags;
-          get_tags_in_range(tags, 0, samp0_count + input_idx,
-                  samp0_count + input_idx + decimation(),
-                  pmt::string_to_symbol(acq_info_tag_name));
+      const auto &timing = table.timing;
+      const int npoints = timing.size();
 
-          auto acq_info = d_acq_info;
+      // time of the first sample relative to the acq_info tag, step between outputs
+      const double timebase_ns = d_acq_info.timebase * 1000000000.0;
+      const double step = timebase_ns * decimation();
+      const double t0 = static_cast<double>(first_sample - d_acq_info_offset) * timebase_ns;
 
-          if (!tags.empty()) {
-            // use the first tag, save the last one
-            if (tags.at(0).offset == (samp0_count + input_idx)) {
-                acq_info = decode_acq_info_tag(tags.at(0));
-            }
+      if (d_segment < 0 || d_segment_generation != table.generation) {
+        d_segment = static_cast<int>(std::distance(timing.begin(),
+                std::lower_bound(timing.begin(), timing.end(), t0,
+                        [](int64_t t, double value) { return t < value; })));
+        d_segment_generation = table.generation;
+      }
 
-            d_acq_info = decode_acq_info_tag(tags.back());
+      int i = 0;
+      while (i < count) {
+        const double t = t0 + i * step;
+        const int s = d_segment;
+
+        // outputs with t <= timing[s] belong to segment s, i.e. timing[s - 1] < t <= timing[s]
+        int n = count - i;
+        bool segment_done = false;
+        if (s < npoints) {
+          const double remaining = (static_cast<double>(timing[s]) - t) / step;
+          if (remaining < n) {
+            n = remaining < 0.0 ? 0 : static_cast<int>(std::floor(remaining)) + 1;
+            segment_done = true;
           }
+        }
 
-          // no timing
-          if (acq_info.timestamp == -1)
-          {
-            out_ref[i] = d_ref[0];
-            out_min[i] = d_min[0];
-            out_max[i] = d_max[0];
+        if (n > 0) {
+          if (s == 0 || s == npoints) {
+            const int idx = s == 0 ? 0 : npoints - 1;
+            std::fill(out_ref + i, out_ref + i + n, table.ref[idx]);
+            std::fill(out_min + i, out_min + i + n, table.min[idx]);
+            std::fill(out_max + i, out_max + i + n, table.max[idx]);
           }
-          else
-          {
-            GR_LOG_ERROR(d_logger, "function_ff_impl needs to be re-implemented, there is no 'last_beam_in_timestamp' any more in acq_info");
-
-            /*
-            // timestamp of the first sample in working range
-            auto timestamp = acq_info.timestamp + static_cast<int64_t>(((samp0_count + input_idx) - tags.at(0).offset) * acq_info.timebase * 1000000000.0);
-
-            if (timestamp < acq_info.last_beam_in_timestamp)
-            {
-              out_ref[i] = d_ref[0];
-              out_min[i] = d_min[0];
-              out_max[i] = d_max[0];
-            }
-            else
-            {
-              auto distance_from_beam_in = timestamp - acq_info.last_beam_in_timestamp;
-
-              // find left and right index
-              auto it = std::find_if(d_timing.begin(), d_timing.end(),
-                  [distance_from_beam_in] (const int64_t t)
-              {
-                  return t >= distance_from_beam_in;
-              });
-
-              auto idx_r = static_cast<int>(std::distance(d_timing.begin(), it));
-
-              if (idx_r == static_cast<int>(d_timing.size())) {
-                out_ref[i] = d_ref[idx_r - 1];
-                out_min[i] = d_min[idx_r - 1];
-                out_max[i] = d_max[idx_r - 1];
-              }
-              else if (idx_r == 0) {
-                out_ref[i] = d_ref[0];
-                out_min[i] = d_min[0];
-                out_max[i] = d_max[0];
-              }
-              else {
-                auto idx_l = idx_r - 1;
-
-                // perform linear interpolation
-                auto k = static_cast<float>(distance_from_beam_in - d_timing[idx_l])
-                          / static_cast<float>(d_timing[idx_r] - d_timing[idx_l]);
-
-                out_ref[i] = d_ref[idx_l] + (d_ref[idx_r] - d_ref[idx_l]) * k;
-                out_min[i] = d_min[idx_l] + (d_min[idx_r] - d_min[idx_l]) * k;
-                out_max[i] = d_max[idx_l] + (d_max[idx_r] - d_max[idx_l]) * k;
-              }
-            }*/
+          else {
+            // perform linear interpolation
+            const double dt = static_cast<double>(timing[s] - timing[s - 1]);
+            const double k0 = dt > 0.0 ? (t - timing[s - 1]) / dt : 1.0;
+            const double dk = dt > 0.0 ? step / dt : 0.0;
+
+            const float dref = table.ref[s] - table.ref[s - 1];
+            const float dmin = table.min[s] - table.min[s - 1];
+            const float dmax = table.max[s] - table.max[s - 1];
+
+            fill_affine(out_ref + i, n, table.ref[s - 1] + dref * k0, dref * dk);
+            fill_affine(out_min + i, n, table.min[s - 1] + dmin * k0, dmin * dk);
+            fill_affine(out_max + i, n, table.max[s - 1] + dmax * k0, dmax * dk);
           }
+          i += n;
+        }
+
+        if (segment_done) {
+          d_segment++;
         }
       }
+    }
+
+    int
+    function_ff_impl::work(int noutput_items,
+        gr_vector_const_void_star &input_items,
+        gr_vector_void_star &output_items)
+    {
+      block_stats_scope_t stats(d_stats);
+      float *out_ref = (float *) output_items[0];
+      float *out_min = (float *) output_items[1];
+      float *out_max = (float *) output_items[2];
+
+      const auto &table = acquire_table();
+
+      const uint64_t samp0_count = nitems_read(0);
+      const int decim = decimation();
+
+      // Single scan per call, tags are ordered by offset. The key is filtered here, GNU Radio
+      // filters into a temporary vector.
+      d_tags.clear();
+      get_tags_in_range(d_tags, 0, samp0_count, samp0_count + noutput_items * decim);
+      d_tags.erase(std::remove_if(d_tags.begin(), d_tags.end(), [](const gr::tag_t &tag) {
+        return tag.key != acq_info_tag_key(); }), d_tags.end());
+      auto tag = d_tags.cbegin();
+
+      int i = 0;
+      while (i < noutput_items) {
+        // acq_info tag in effect is the last one at or before the output sample, the function
+        // time restarts with each tag
+        while (tag != d_tags.cend() && tag->offset <= samp0_count + i * decim) {
+          d_acq_info = decode_acq_info_tag(*tag);
+          d_acq_info_offset = tag->offset;
+          d_segment = -1;
+          ++tag;
+        }
+
+        // outputs up to the next tag
+        int end = noutput_items;
+        if (tag != d_tags.cend()) {
+          end = static_cast<int>((tag->offset - samp0_count + decim - 1) / decim);
+        }
+
+        generate(table, samp0_count + i * decim, end - i, out_ref + i, out_min + i, out_max + i);
+        i = end;
+      }
+
+      release_table();
 
       // Tell runtime system how many output items we produced.
       return noutput_items;
@@ -186,4 +261,3 @@ namespace gr {
 
   } /* namespace digitizers */
 } /* namespace gr */
-
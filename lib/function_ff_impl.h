@@ -11,18 +11,54 @@
 #include <digitizers/tags.h>
 #include <boost/thread/mutex.hpp>
 
+#include <array>
+#include <atomic>
+#include <vector>
+#include "block_stats_impl.h"
+
 namespace gr {
   namespace digitizers {
 
     class function_ff_impl : public function_ff
     {
      private:
+
+      /*!
+       * Reference, min and max function values at the breakpoints, timing in nanoseconds.
+       */
+      struct function_table_t
+      {
+        std::vector<float> ref, min, max;
+        std::vector<int64_t> timing;
+        uint64_t generation;   // incremented on each update
+      };
+
       acq_info_t d_acq_info;
+      uint64_t d_acq_info_offset;   // offset of the acq_info tag in effect
+
+      // Double-buffered function table. The work thread never blocks, set_function writes the
+      // inactive table (waiting while the work thread still reads it) and swaps the tables.
+      std::array<function_table_t, 2> d_tables;
+      std::atomic<int> d_active_table;
+      std::atomic<int> d_reading_table;   // table used by the work thread, -1 if none
+      boost::mutex d_mutex;               // serializes set_function calls
+
+      // Segment cursor, index of the first breakpoint at or after the time of the next output,
+      // -1 if it needs to be searched for
+      int d_segment;
+      uint64_t d_segment_generation;
+
+      std::vector<gr::tag_t> d_tags;
+
+      const function_table_t &acquire_table();
+
+      void release_table();
 
-      std::vector<float> d_ref, d_min, d_max;
-      std::vector<int64_t> d_timing;
+      // Generates count outputs, the first corresponding to input sample first_sample
+      void generate(const function_table_t &table, uint64_t first_sample, int count,
+              float *out_ref, float *out_min, float *out_max);
 
-      boost::mutex d_mutex;
+      block_stats_recorder_t d_stats {this};
 
      public:
       function_ff_impl(int decimation);
@@ -0,0 +1,325 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gnuradio/io_signature.h>
+#include <gnuradio/filter/firdes.h>
+#include "fused_aggregation_impl.h"
+#include "design_cache.h"
+#include <digitizers/tags.h>
+#include "utils.h"
+#include <volk/volk.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+namespace gr {
+  namespace digitizers {
+
+    fused_aggregation_ff::sptr
+    fused_aggregation_ff::make(algorithm_id_t alg_id,
+        int decim,
+        int delay,
+        const std::vector<float> &fir_taps,
+        double low_freq,
+        double up_freq,
+        double tr_width,
+        double samp_rate)
+    {
+      return gnuradio::get_initial_sptr
+        (new fused_aggregation_ff(alg_id, decim, delay, fir_taps, low_freq, up_freq, tr_width, samp_rate));
+    }
+
+    bool
+    fused_aggregation_ff::is_supported(algorithm_id_t alg_id)
+    {
+      return alg_id == FIR_LP || alg_id == FIR_BP || alg_id == FIR_CUSTOM || alg_id == FIR_CUSTOM_FFT;
+    }
+
+    fused_aggregation_ff::fused_aggregation_ff(algorithm_id_t alg_id,
+        int decim,
+        int delay,
+        const std::vector<float> &fir_taps,
+        double low_freq,
+        double up_freq,
+        double tr_width,
+        double samp_rate)
+      : gr::sync_decimator("fused_aggregation_ff",
+              gr::io_signature::make(1, 2, sizeof(float)),
+              gr::io_signature::make(1, 2, sizeof(float)), decim),
+        d_alg_id(alg_id),
+        d_samp_rate(samp_rate),
+        d_ntaps(0),
+        d_delay(0),
+        d_sigma_mult(0.0),
+        d_input_history(0),
+        d_filtered_history(0)
+    {
+      if (!is_supported(alg_id)) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": algorithm not supported: " << alg_id;
+        throw std::invalid_argument(message.str());
+      }
+
+      set_tag_propagation_policy(TPP_CUSTOM);
+
+      set_taps(delay, design_taps(d_alg_id, fir_taps, low_freq, up_freq, tr_width, samp_rate),
+              (up_freq - low_freq) / samp_rate);
+    }
+
+    fused_aggregation_ff::~fused_aggregation_ff()
+    {
+    }
+
+    bool
+    fused_aggregation_ff::check_topology(int ninputs, int noutputs)
+    {
+      // errors either in and out or not at all
+      return ninputs == noutputs;
+    }
+
+    std::vector<float>
+    fused_aggregation_ff::design_taps(algorithm_id_t alg_id,
+        const std::vector<float> &fir_taps,
+        double low_freq,
+        double up_freq,
+        double tr_width,
+        double samp_rate)
+    {
+      // the same designs as used by block_custom_filter
+      switch (alg_id) {
+        case FIR_LP:
+          return cached_low_pass(1, samp_rate, up_freq, tr_width, gr::filter::firdes::win_type::WIN_HAMMING);
+        case FIR_BP:
+          return cached_band_pass(1, samp_rate, low_freq, up_freq, tr_width);
+        default:
+          return fir_taps;
+      }
+    }
+
+    void
+    fused_aggregation_ff::update_design(int delay,
+        const std::vector<float> &fir_taps,
+        double low_freq,
+        double up_freq,
+        double tr_width,
+        double samp_rate)
+    {
+      set_taps(delay, design_taps(d_alg_id, fir_taps, low_freq, up_freq, tr_width, samp_rate),
+              (up_freq - low_freq) / samp_rate);
+    }
+
+    void
+    fused_aggregation_ff::set_taps(int delay, const std::vector<float> &taps, double sigma_mult)
+    {
+      if (taps.empty() || delay < 0) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid taps or delay";
+        throw std::invalid_argument(message.str());
+      }
+
+      std::unique_ptr<aggregation_taps_t> next(new aggregation_taps_t);
+      next->taps = design_cache_t::instance().intern(std::vector<float>(taps.rbegin(), taps.rend()));
+      next->delay = delay;
+      next->sigma_mult = static_cast<float>(sigma_mult);
+
+      d_ntaps = taps.size();
+      d_tap_swap.publish(std::move(next));
+    }
+
+    void
+    fused_aggregation_ff::apply_taps(aggregation_taps_t &next)
+    {
+      const size_t input_history = next.taps->size() - 1;
+      const size_t filtered_history = std::max(input_history, static_cast<size_t>(next.delay));
+
+      resize_history(d_values, d_input_history, input_history);
+      resize_history(d_errors, d_input_history, input_history);
+      resize_history(d_filtered, d_filtered_history, filtered_history);
+      resize_history(d_squares, d_filtered_history, filtered_history);
+
+      d_input_history = input_history;
+      d_filtered_history = filtered_history;
+
+      d_taps.swap(next.taps);
+      d_delay = next.delay;
+      d_sigma_mult = next.sigma_mult;
+    }
+
+    void
+    fused_aggregation_ff::resize_history(std::vector<float> &buffer, size_t old_size, size_t new_size)
+    {
+      std::vector<float> history(new_size, 0.0f);
+      const size_t keep = std::min(old_size, new_size);
+      if (keep) {
+        std::copy(buffer.begin() + (old_size - keep), buffer.begin() + old_size, history.end() - keep);
+      }
+      buffer.swap(history);
+    }
+
+    double
+    fused_aggregation_ff::get_delay_approximation() const
+    {
+      return d_ntaps / (2.0 * d_samp_rate);
+    }
+
+    void
+    fused_aggregation_ff::set_demand(const demand_node_t::sptr &demand)
+    {
+      d_gate.set_demand(demand);
+    }
+
+    void
+    fused_aggregation_ff::set_state_file(const state_file_t::sptr &file, const std::string &key)
+    {
+      d_state_slot.attach(file, key);
+    }
+
+    bool
+    fused_aggregation_ff::stop()
+    {
+      // the work function is done, i.e. the last histories are saved
+      if (d_state_slot.is_attached()) {
+        save_state();
+      }
+      return true;
+    }
+
+    void
+    fused_aggregation_ff::restore_state()
+    {
+      const uint64_t layout = (static_cast<uint64_t>(d_input_history) << 32) | d_filtered_history;
+      d_state_slot.restore(layout, {{d_values.data(), d_input_history}, {d_errors.data(), d_input_history},
+              {d_filtered.data(), d_filtered_history}, {d_squares.data(), d_filtered_history}});
+    }
+
+    void
+    fused_aggregation_ff::save_state()
+    {
+      const uint64_t layout = (static_cast<uint64_t>(d_input_history) << 32) | d_filtered_history;
+      d_state_slot.save(layout, {{d_values.data(), d_input_history}, {d_errors.data(), d_input_history},
+              {d_filtered.data(), d_filtered_history}, {d_squares.data(), d_filtered_history}});
+    }
+
+    void
+    fused_aggregation_ff::reset_state()
+    {
+      std::fill(d_values.begin(), d_values.begin() + d_input_history, 0.0f);
+      std::fill(d_errors.begin(), d_errors.begin() + d_input_history, 0.0f);
+      std::fill(d_filtered.begin(), d_filtered.begin() + d_filtered_history, 0.0f);
+      std::fill(d_squares.begin(), d_squares.begin() + d_filtered_history, 0.0f);
+    }
+
+    int
+    fused_aggregation_ff::work(int noutput_items,
+        gr_vector_const_void_star &input_items,
+        gr_vector_void_star &output_items)
+    {
+      block_stats_scope_t stats(d_stats);
+
+      // New coefficients take effect at the first sample of this call
+      if (auto next = d_tap_swap.take()) {
+        apply_taps(*next);
+        d_tap_swap.retire(std::move(next));
+      }
+
+      // Nobody reads the outputs
+      if (!d_gate.poll([this]() { reset_state(); })) {
+        for (auto output : output_items) {
+          memset(output, 0, noutput_items * sizeof(float));
+        }
+        propagate_tags(noutput_items);
+        return noutput_items;
+      }
+
+      if (d_state_slot.is_attached()) {
+        restore_state();
+      }
+
+      const float *in = (const float *) input_items[0];
+      float *out = (float *) output_items[0];
+      const bool errors = output_items.size() > 1;
+
+      const int decim = decimation();
+      const size_t ninput = noutput_items * decim;
+      const size_t ntaps = d_taps->size();
+      const size_t hx = d_input_history;
+      const size_t hf = d_filtered_history;
+      const float *taps = d_taps->data();
+
+      d_values.resize(hx + ninput);
+      memcpy(&d_values[hx], in, ninput * sizeof(float));
+
+      d_filtered.resize(hf + ninput);
+
+      // value filter at the input rate, window for sample j starts at index j
+      for (size_t j = 0; j < ninput; j++) {
+        volk_32f_x2_dot_prod_32f(&d_filtered[hf + j], &d_values[j], taps, ntaps);
+      }
+
+      for (int i = 0; i < noutput_items; i++) {
+        out[i] = d_filtered[hf + i * decim - d_delay];
+      }
+
+      // everything else only at the output instants, skipped without the errors ports
+      if (errors) {
+        const float *err = (const float *) input_items[1];
+        float *sigma = (float *) output_items[1];
+
+        d_errors.resize(hx + ninput);
+        memcpy(&d_errors[hx], err, ninput * sizeof(float));
+
+        d_squares.resize(hf + ninput);
+        volk_32f_x2_multiply_32f(&d_squares[hf], &d_filtered[hf], &d_filtered[hf], ninput);
+
+        for (int i = 0; i < noutput_items; i++) {
+          const size_t n = i * decim;
+
+          float mean, mean_of_squares, error;
+          volk_32f_x2_dot_prod_32f(&mean, &d_filtered[hf + n - hx], taps, ntaps);
+          volk_32f_x2_dot_prod_32f(&mean_of_squares, &d_squares[hf + n - hx], taps, ntaps);
+          volk_32f_x2_dot_prod_32f(&error, &d_errors[n], taps, ntaps);
+
+          sigma[i] = std::sqrt(std::fabs(mean_of_squares - mean * mean) + (d_sigma_mult * error * error));
+        }
+
+        std::copy(d_errors.end() - hx, d_errors.end(), d_errors.begin());
+        std::copy(d_squares.end() - hf, d_squares.end(), d_squares.begin());
+      }
+
+      // keep histories for the next call
+      std::copy(d_values.end() - hx, d_values.end(), d_values.begin());
+      std::copy(d_filtered.end() - hf, d_filtered.end(), d_filtered.begin());
+
+      if (d_state_slot.is_due()) {
+        save_state();
+      }
+
+      propagate_tags(noutput_items);
+
+      return noutput_items;
+    }
+
+    void
+    fused_aggregation_ff::propagate_tags(int noutput_items)
+    {
+      // Same as decimate_and_adjust_timebase, tags of the error input are not propagated
+      const auto decim = decimation();
+
+      std::vector<gr::tag_t> tags;
+      get_tags_in_range(tags, 0, nitems_read(0), nitems_read(0) + noutput_items * decim);
+      decimate_tags(tags, nitems_read(0), nitems_written(0), decim,
+              [this](const gr::tag_t &tag) { add_item_tag(0, tag); });
+    }
+
+  } /* namespace digitizers */
+} /* namespace gr */
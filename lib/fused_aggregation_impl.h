@@ -0,0 +1,188 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_FUSED_AGGREGATION_IMPL_H
+#define INCLUDED_DIGITIZERS_FUSED_AGGREGATION_IMPL_H
+
+#include <gnuradio/sync_decimator.h>
+#include "digitizers/status.h"
+
+#include <atomic>
+#include <vector>
+#include "block_stats_impl.h"
+#include "demand.h"
+#include "design_cache.h"
+#include "hot_swap.h"
+#include "state_file.h"
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Coefficient set of the fused aggregation blocks, prepared off the work thread.
+     */
+    struct aggregation_taps_t
+    {
+      // reversed, i.e. dot product with the oldest sample first, shared by blocks with equal taps
+      design_cache_t::taps_ptr_t taps;
+      int delay;
+      float sigma_mult;
+    };
+
+    /*!
+     * \brief Single block implementation of the FIR aggregation circuit of block_aggregation.
+     *
+     * Computes the same as the hier graph (value filter, delay, square, mean and mean-of-squares
+     * filters, error filter and the aggregation_helper formula) within a single work call:
+     *
+     *   value[i] = f[i*D - delay]
+     *   sigma[i] = sqrt(|h*(f^2)[i*D] - (h*f)[i*D]^2| + sigma_mult * (h*e)[i*D]^2)
+     *
+     * where f = h*x is the filtered input and D the decimation. The value filter is evaluated
+     * for every input sample, the other filters only at the output instants. Intermediate
+     * results are kept in small per-block buffers, histories are carried between work calls.
+     * The errors input and output are optional (both or none), without them only the value
+     * filter is evaluated.
+     *
+     * Only FIR algorithms are supported (FIR_LP, FIR_BP, FIR_CUSTOM and FIR_CUSTOM_FFT, the
+     * latter is evaluated in direct form).
+     *
+     * New taps are designed by the calling thread and swapped in at the start of the next work
+     * call (see hot_swap_t), neither side waits for the other. The histories are carried over,
+     * i.e. the new taps are applied to the samples already seen and there is no transient
+     * other than the one of the response itself.
+     */
+    class fused_aggregation_ff : public gr::sync_decimator
+    {
+     public:
+      typedef boost::shared_ptr<fused_aggregation_ff> sptr;
+
+      static sptr make(algorithm_id_t alg_id,
+          int decim,
+          int delay,
+          const std::vector<float> &fir_taps,
+          double low_freq,
+          double up_freq,
+          double tr_width,
+          double samp_rate);
+
+      /*!
+       * \brief Returns true if the algorithm can be handled by this block.
+       */
+      static bool is_supported(algorithm_id_t alg_id);
+
+      /*!
+       * \brief Taps of the given algorithm, the same designs as used by block_custom_filter.
+       */
+      static std::vector<float> design_taps(algorithm_id_t alg_id,
+          const std::vector<float> &fir_taps,
+          double low_freq,
+          double up_freq,
+          double tr_width,
+          double samp_rate);
+
+      fused_aggregation_ff(algorithm_id_t alg_id,
+          int decim,
+          int delay,
+          const std::vector<float> &fir_taps,
+          double low_freq,
+          double up_freq,
+          double tr_width,
+          double samp_rate);
+
+      ~fused_aggregation_ff();
+
+      /*!
+       * \brief Redesigns the filter for the given algorithm parameters, see block_custom_filter.
+       */
+      void update_design(int delay,
+          const std::vector<float> &fir_taps,
+          double low_freq,
+          double up_freq,
+          double tr_width,
+          double samp_rate);
+
+      /*!
+       * \brief Sets the taps directly, applied at the start of the next work call.
+       */
+      void set_taps(int delay, const std::vector<float> &taps, double sigma_mult);
+
+      /*!
+       * \brief Filter delay in seconds, see block_custom_filter::get_delay_approximation.
+       */
+      double get_delay_approximation() const;
+
+      /*!
+       * \brief Pauses the block while the demand is inactive, the inputs are discarded and the
+       * outputs are zero (tags are still propagated). The histories are cleared on resume. Must
+       * be set before the flowgraph is started.
+       */
+      void set_demand(const demand_node_t::sptr &demand);
+
+      /*!
+       * \brief Persists the histories in the given record of the file, restored on start if
+       * their lengths match. Must be called before the flowgraph is started.
+       */
+      void set_state_file(const state_file_t::sptr &file, const std::string &key);
+
+      bool check_topology(int ninputs, int noutputs) override;
+
+      bool stop() override;
+
+      int work(int noutput_items,
+          gr_vector_const_void_star &input_items,
+          gr_vector_void_star &output_items) override;
+
+     private:
+
+      // Switches to the coefficient set taken from d_tap_swap, the replaced taps are moved into it
+      void apply_taps(aggregation_taps_t &next);
+
+      // Resizes the histories, the most recent samples are kept
+      void resize_history(std::vector<float> &buffer, size_t old_size, size_t new_size);
+
+      void propagate_tags(int noutput_items);
+
+      // Clears the histories, i.e. restarts from zero input
+      void reset_state();
+
+      // Histories from and to d_state_slot
+      void restore_state();
+      void save_state();
+
+      const algorithm_id_t d_alg_id;
+      double d_samp_rate;
+
+      // Published by set_taps, the number of taps is kept for get_delay_approximation
+      hot_swap_t<aggregation_taps_t> d_tap_swap;
+      std::atomic<size_t> d_ntaps;
+
+      // Current coefficient set, used by the work function only
+      design_cache_t::taps_ptr_t d_taps;  // reversed, i.e. dot product with the oldest sample first
+      int d_delay;
+      float d_sigma_mult;
+
+      // Input and error samples, the first d_input_history samples are from previous calls
+      size_t d_input_history;
+      std::vector<float> d_values;
+      std::vector<float> d_errors;
+
+      // Filtered values and their squares, the first d_filtered_history are from previous calls
+      size_t d_filtered_history;
+      std::vector<float> d_filtered;
+      std::vector<float> d_squares;
+
+      demand_gate_t d_gate;
+
+      state_slot_t d_state_slot;
+
+      block_stats_recorder_t d_stats {this};
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_FUSED_AGGREGATION_IMPL_H */
@@ -0,0 +1,261 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gnuradio/io_signature.h>
+#include <gnuradio/filter/firdes.h>
+#include "fused_amplitude_and_phase_impl.h"
+#include "design_cache.h"
+#include <volk/volk.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+namespace gr {
+  namespace digitizers {
+
+    fused_amplitude_and_phase_fc::sptr
+    fused_amplitude_and_phase_fc::make(int decim, int hilbert_window, const std::vector<float> &low_pass_taps,
+            bool decimate_products, amplitude_phase_reference_t reference, double ref_freq, double samp_rate)
+    {
+      return gnuradio::get_initial_sptr
+        (new fused_amplitude_and_phase_fc(decim, hilbert_window, low_pass_taps, decimate_products,
+                reference, ref_freq, samp_rate));
+    }
+
+    fused_amplitude_and_phase_fc::fused_amplitude_and_phase_fc(int decim, int hilbert_window,
+            const std::vector<float> &low_pass_taps, bool decimate_products,
+            amplitude_phase_reference_t reference, double ref_freq, double samp_rate)
+      : gr::sync_decimator("fused_amplitude_and_phase_fc",
+              gr::io_signature::make(reference == REFERENCE_NCO ? 1 : 2, 2, sizeof(float)),
+              gr::io_signature::make(1, 1, sizeof(gr_complex)), decim),
+        d_decimate_products(decimate_products),
+        d_reference(reference),
+        d_samp_rate(samp_rate),
+        d_nco_freq(ref_freq),
+        d_product_history(0)
+    {
+      if (hilbert_window < 0) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid hilbert window: " << hilbert_window;
+        throw std::invalid_argument(message.str());
+      }
+      if (reference != REFERENCE_INPUT && reference != REFERENCE_NCO && reference != REFERENCE_NCO_LOCKED) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid reference: " << reference;
+        throw std::invalid_argument(message.str());
+      }
+      if (samp_rate <= 0.0) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid sample rate: " << samp_rate;
+        throw std::invalid_argument(message.str());
+      }
+
+      // same as hilbert_fc, the number of taps is made odd
+      const int ntaps = hilbert_window | 0x1;
+      const auto taps = cached_hilbert(ntaps, gr::filter::firdes::WIN_RECTANGULAR, 6.76);
+
+      // taps reversed, i.e. H(x)[i] = sum taps[ntaps - 1 - j] * x[i + j], non-zero for (h - j) odd
+      d_half = (ntaps - 1) / 2;
+      d_phase = (d_half + 1) & 1;
+      for (int j = d_phase; j < ntaps; j += 2) {
+        d_hilbert_taps.push_back(taps[ntaps - 1 - j]);
+      }
+      if (d_hilbert_taps.empty()) {
+        d_hilbert_taps.push_back(0.0f);
+      }
+
+      d_sig.assign(2 * d_half, 0.0f);
+      d_ref.assign(2 * d_half, 0.0f);
+
+      // the first product is centered at sample -h
+      d_nco = std::polar(1.0, -2.0 * M_PI * ref_freq / samp_rate * d_half);
+
+      set_taps(low_pass_taps);
+    }
+
+    fused_amplitude_and_phase_fc::~fused_amplitude_and_phase_fc()
+    {
+    }
+
+    void
+    fused_amplitude_and_phase_fc::set_taps(const std::vector<float> &taps)
+    {
+      if (taps.empty()) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid taps";
+        throw std::invalid_argument(message.str());
+      }
+
+      gr::thread::scoped_lock lock(d_setlock);
+
+      const size_t product_history = taps.size() - 1;
+      resize_history(d_products, d_product_history, product_history);
+      d_product_history = product_history;
+
+      d_taps.assign(taps.rbegin(), taps.rend());
+    }
+
+    void
+    fused_amplitude_and_phase_fc::set_reference_freq(double ref_freq)
+    {
+      gr::thread::scoped_lock lock(d_setlock);
+      d_nco_freq = ref_freq;
+    }
+
+    bool
+    fused_amplitude_and_phase_fc::check_topology(int ninputs, int noutputs)
+    {
+      // the reference or the frequency, except for a free running NCO
+      return ninputs == (d_reference == REFERENCE_NCO ? 1 : 2);
+    }
+
+    template <typename T>
+    void
+    fused_amplitude_and_phase_fc::resize_history(std::vector<T> &buffer, size_t old_size, size_t new_size)
+    {
+      std::vector<T> history(new_size, T(0));
+      const size_t keep = std::min(old_size, new_size);
+      if (keep) {
+        std::copy(buffer.begin() + (old_size - keep), buffer.begin() + old_size, history.end() - keep);
+      }
+      buffer.swap(history);
+    }
+
+    static inline void
+    deinterleave(const std::vector<float> &in, std::vector<float> &even, std::vector<float> &odd)
+    {
+      const size_t n = in.size();
+      even.resize((n + 1) / 2);
+      odd.resize(n / 2);
+      for (size_t k = 0; k < n / 2; k++) {
+        even[k] = in[2 * k];
+        odd[k] = in[2 * k + 1];
+      }
+      if (n & 1) {
+        even[n / 2] = in[n - 1];
+      }
+    }
+
+    void
+    fused_amplitude_and_phase_fc::generate_reference(const float *freq, size_t ninput, size_t nproducts,
+            size_t product_step)
+    {
+      d_nco_ref.resize(nproducts);
+
+      if (d_reference == REFERENCE_NCO) {
+        const auto rotation = std::polar(1.0, 2.0 * M_PI * d_nco_freq / d_samp_rate * product_step);
+        for (size_t k = 0; k < nproducts; k++) {
+          d_nco_ref[k] = gr_complex(d_nco);
+          d_nco *= rotation;
+        }
+      }
+      else {
+        // the frequency changes rarely (e.g. once per freq_estimator output), so does the rotation
+        auto rotation = std::polar(1.0, 2.0 * M_PI * d_nco_freq / d_samp_rate);
+        for (size_t i = 0; i < ninput; i++) {
+          if (i % product_step == 0) {
+            d_nco_ref[i / product_step] = gr_complex(d_nco);
+          }
+          if (freq[i] > 0.0f && freq[i] != d_nco_freq) {
+            d_nco_freq = freq[i];
+            rotation = std::polar(1.0, 2.0 * M_PI * d_nco_freq / d_samp_rate);
+          }
+          d_nco *= rotation;
+        }
+      }
+
+      // the rounding errors of the rotations would accumulate otherwise
+      d_nco /= std::abs(d_nco);
+    }
+
+    int
+    fused_amplitude_and_phase_fc::work(int noutput_items,
+        gr_vector_const_void_star &input_items,
+        gr_vector_void_star &output_items)
+    {
+      block_stats_scope_t stats(d_stats);
+      const float *sig = (const float *) input_items[0];
+      // the reference, the frequency of the NCO or none
+      const float *ref = input_items.size() > 1 ? (const float *) input_items[1] : nullptr;
+      gr_complex *out = (gr_complex *) output_items[0];
+
+      const int decim = decimation();
+      const size_t ninput = noutput_items * decim;
+      const size_t hx = 2 * d_half;
+      const size_t hp = d_product_history;
+      const int nhilbert = d_hilbert_taps.size();
+      const float *hilbert = &d_hilbert_taps[0];
+
+      // product of the analytic signals for every input sample, or only at the output instants
+      const size_t nproducts = d_decimate_products ? noutput_items : ninput;
+      const size_t product_step = d_decimate_products ? decim : 1;
+
+      d_sig.resize(hx + ninput);
+      memcpy(&d_sig[hx], sig, ninput * sizeof(float));
+      deinterleave(d_sig, d_sig_even, d_sig_odd);
+
+      d_products.resize(hp + nproducts);
+
+      if (d_reference != REFERENCE_INPUT) {
+        generate_reference(ref, ninput, nproducts, product_step);
+
+        for (size_t k = 0; k < nproducts; k++) {
+          const size_t q = k * product_step + d_phase;
+          const float *s = (q & 1) ? &d_sig_odd[q / 2] : &d_sig_even[q / 2];
+
+          float hs;
+          volk_32f_x2_dot_prod_32f(&hs, s, hilbert, nhilbert);
+
+          d_products[hp + k] = gr_complex(hs * d_nco_ref[k].imag(), hs * d_nco_ref[k].real());
+        }
+      }
+      else {
+        d_ref.resize(hx + ninput);
+        memcpy(&d_ref[hx], ref, ninput * sizeof(float));
+        deinterleave(d_ref, d_ref_even, d_ref_odd);
+
+        for (size_t k = 0; k < nproducts; k++) {
+          const size_t i = k * product_step;
+          const size_t q = i + d_phase;
+          const float *s = (q & 1) ? &d_sig_odd[q / 2] : &d_sig_even[q / 2];
+          const float *r = (q & 1) ? &d_ref_odd[q / 2] : &d_ref_even[q / 2];
+
+          float hs, hr;
+          volk_32f_x2_dot_prod_32f(&hs, s, hilbert, nhilbert);
+          volk_32f_x2_dot_prod_32f(&hr, r, hilbert, nhilbert);
+
+          d_products[hp + k] = gr_complex(hs * hr, hs * d_ref[i + d_half]);
+        }
+
+        std::copy(d_ref.end() - hx, d_ref.end(), d_ref.begin());
+        d_ref.resize(hx);
+      }
+
+      // low pass only at the output instants
+      const size_t ntaps = d_taps.size();
+      const size_t output_step = d_decimate_products ? 1 : decim;
+      for (int m = 0; m < noutput_items; m++) {
+        volk_32fc_32f_dot_prod_32fc(&out[m], &d_products[m * output_step], &d_taps[0], ntaps);
+      }
+
+      // keep histories for the next call
+      std::copy(d_sig.end() - hx, d_sig.end(), d_sig.begin());
+      std::copy(d_products.end() - hp, d_products.end(), d_products.begin());
+      d_sig.resize(hx);
+      d_products.resize(hp);
+
+      return noutput_items;
+    }
+
+  } /* namespace digitizers */
+} /* namespace gr */
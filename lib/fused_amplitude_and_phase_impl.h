@@ -0,0 +1,127 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_FUSED_AMPLITUDE_AND_PHASE_IMPL_H
+#define INCLUDED_DIGITIZERS_FUSED_AMPLITUDE_AND_PHASE_IMPL_H
+
+#include <gnuradio/sync_decimator.h>
+#include <digitizers/block_amplitude_and_phase.h>
+
+#include <complex>
+#include <vector>
+#include "block_stats_impl.h"
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Single block implementation of the block_amplitude_and_phase circuit.
+     *
+     * Computes the same as the hier graph (hilbert_fc of the signal and of the reference,
+     * amplitude_and_phase_helper and the decimating fir_filter_ccf low pass) within a single
+     * work call:
+     *
+     *   p[n] = H(s)[n] * (H(r)[n] + j * r[n - h])
+     *   out[m] = (lp * p)[m * D]
+     *
+     * where H is the Hilbert filter with 2h + 1 taps, r the reference and D the decimation.
+     *
+     * Every other tap of the Hilbert filter is zero, i.e. the filter is evaluated in
+     * polyphase form on the even and odd input samples using only the non-zero taps. The
+     * products are evaluated for every input sample, the low pass only at the output instants.
+     * Histories are carried between work calls.
+     *
+     * If the products are decimated (decimate_products), the Hilbert transforms and products
+     * are evaluated only at the output instants and the low pass runs at the output rate,
+     * i.e. its taps need to be designed for the decimated sample rate:
+     *
+     *   out[m] = (lp * p_D)[m], p_D[m] = p[m * D]
+     *
+     * This requires the products (i.e. twice the signal frequency) not to alias at the
+     * decimated sample rate. Output m is aligned with input m * D in both cases, i.e. tags are
+     * propagated the same way.
+     *
+     * With an NCO reference (see amplitude_phase_reference_t) the analytic reference H(r)[n] +
+     * j * r[n - h] is replaced by sin(theta[n - h]) + j * cos(theta[n - h]), theta advancing by
+     * 2 pi f / samp_rate per sample. The phase is kept as a unit phasor in double precision and
+     * rotated per sample (or per output instant for a fixed frequency and decimated products),
+     * i.e. the cost is a few multiplies instead of the Hilbert filter of the reference. For
+     * REFERENCE_NCO_LOCKED f is read from the second input (Hz, non-positive values are
+     * ignored).
+     */
+    class fused_amplitude_and_phase_fc : public gr::sync_decimator
+    {
+     public:
+      typedef boost::shared_ptr<fused_amplitude_and_phase_fc> sptr;
+
+      static sptr make(int decim, int hilbert_window, const std::vector<float> &low_pass_taps,
+              bool decimate_products=false, amplitude_phase_reference_t reference=REFERENCE_INPUT,
+              double ref_freq=0.0, double samp_rate=1.0);
+
+      fused_amplitude_and_phase_fc(int decim, int hilbert_window, const std::vector<float> &low_pass_taps,
+              bool decimate_products, amplitude_phase_reference_t reference, double ref_freq,
+              double samp_rate);
+
+      ~fused_amplitude_and_phase_fc();
+
+      /*!
+       * \brief Sets the low pass taps.
+       */
+      void set_taps(const std::vector<float> &taps);
+
+      /*!
+       * \brief Sets the NCO frequency, see block_amplitude_and_phase::set_reference_freq.
+       */
+      void set_reference_freq(double ref_freq);
+
+      bool check_topology(int ninputs, int noutputs) override;
+
+      int work(int noutput_items,
+          gr_vector_const_void_star &input_items,
+          gr_vector_void_star &output_items) override;
+
+     private:
+
+      // Resizes the history, the most recent samples are kept
+      template <typename T>
+      void resize_history(std::vector<T> &buffer, size_t old_size, size_t new_size);
+
+      // Reference phasors (cos, sin) at the product instants, NCO advanced to the next call
+      void generate_reference(const float *freq, size_t ninput, size_t nproducts, size_t product_step);
+
+      const bool d_decimate_products;
+      const amplitude_phase_reference_t d_reference;
+      const double d_samp_rate;
+
+      // Hilbert filter, input history of 2h samples
+      int d_half;                             // h
+      int d_phase;                            // index of the first non-zero (reversed) tap
+      std::vector<float> d_hilbert_taps;      // non-zero taps only, reversed
+      std::vector<float> d_sig;
+      std::vector<float> d_ref;
+
+      // polyphase components of the signal and reference (including the history)
+      std::vector<float> d_sig_even, d_sig_odd;
+      std::vector<float> d_ref_even, d_ref_odd;
+
+      // NCO reference, phasor at the next product instant
+      std::complex<double> d_nco;
+      double d_nco_freq;                      // Hz
+      std::vector<gr_complex> d_nco_ref;
+
+      // Low pass, the first d_product_history products are from previous calls (at the output
+      // rate if the products are decimated)
+      std::vector<float> d_taps;              // reversed
+      size_t d_product_history;
+      std::vector<gr_complex> d_products;
+
+      block_stats_recorder_t d_stats {this};
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_FUSED_AMPLITUDE_AND_PHASE_IMPL_H */
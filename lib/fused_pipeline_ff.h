@@ -0,0 +1,81 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_FUSED_PIPELINE_FF_H
+#define INCLUDED_DIGITIZERS_FUSED_PIPELINE_FF_H
+
+#include <gnuradio/io_signature.h>
+#include <gnuradio/sync_decimator.h>
+
+#include "block_stats_impl.h"
+#include "pipeline_kernel.h"
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Runs a fused pipeline (see fused_pipeline_t) as a single block, e.g. instead of a
+     * hier graph of filter, delay and decimation blocks:
+     *
+     *   auto block = fused_pipeline_ff<fir_decimator_stage_t, delay_stage_t, keep_nth_stage_t>::make(
+     *           "values", fir_decimator_stage_t(taps, 1), delay_stage_t(delay), keep_nth_stage_t(decim));
+     *
+     * The decimation of the block is the one of the whole pipeline. Tags are propagated by the
+     * scheduler according to the decimation, i.e. output m carries the tags of inputs
+     * [m * D, (m + 1) * D), the same as with the hier graph ending with a decimating block.
+     */
+    template <typename... Stages>
+    class fused_pipeline_ff : public gr::sync_decimator
+    {
+     public:
+      typedef boost::shared_ptr<fused_pipeline_ff> sptr;
+
+      static sptr
+      make(const std::string &name, Stages... stages)
+      {
+        return gnuradio::get_initial_sptr
+          (new fused_pipeline_ff(name, std::move(stages)...));
+      }
+
+      fused_pipeline_ff(const std::string &name, Stages... stages)
+        : gr::sync_decimator(name,
+                gr::io_signature::make(1, 1, sizeof(float)),
+                gr::io_signature::make(1, 1, sizeof(float)), 1),
+          d_pipeline(std::move(stages)...)
+      {
+        set_decimation(d_pipeline.decimation());
+      }
+
+      /*!
+       * \brief Access to a stage, e.g. in order to update its parameters. The flowgraph must be
+       * locked or stopped.
+       */
+      template <size_t I>
+      typename std::tuple_element<I, std::tuple<Stages...>>::type &
+      stage() { return d_pipeline.template stage<I>(); }
+
+      int
+      work(int noutput_items,
+          gr_vector_const_void_star &input_items,
+          gr_vector_void_star &output_items) override
+      {
+        block_stats_scope_t stats(d_stats);
+
+        d_pipeline.process(static_cast<const float *>(input_items[0]),
+                static_cast<float *>(output_items[0]), noutput_items);
+        return noutput_items;
+      }
+
+     private:
+      fused_pipeline_t<Stages...> d_pipeline;
+
+      block_stats_recorder_t d_stats {this};
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_FUSED_PIPELINE_FF_H */
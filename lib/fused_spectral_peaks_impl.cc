@@ -0,0 +1,150 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gnuradio/io_signature.h>
+#include "fused_spectral_peaks_impl.h"
+#include "peak_detector_impl.h"
+#include "spectral_smoothing.h"
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+namespace gr {
+  namespace digitizers {
+
+    fused_spectral_peaks_ff::sptr
+    fused_spectral_peaks_ff::make(double samp_rate, int vec_len, int n_med, int n_avg,
+            int proximity, int npeaks)
+    {
+      return gnuradio::get_initial_sptr
+        (new fused_spectral_peaks_ff(samp_rate, vec_len, n_med, n_avg, proximity, npeaks));
+    }
+
+    fused_spectral_peaks_ff::fused_spectral_peaks_ff(double samp_rate,
+        int vec_len,
+        int n_med,
+        int n_avg,
+        int proximity,
+        int npeaks)
+      : gr::sync_block("fused_spectral_peaks_ff",
+              gr::io_signature::makev(3, 3, std::vector<int> {
+                    static_cast<int>(sizeof(float) * vec_len),
+                    static_cast<int>(sizeof(float) * npeaks),
+                    static_cast<int>(sizeof(float) * npeaks)
+              }),
+              gr::io_signature::makev(3, 3, std::vector<int> {
+                    static_cast<int>(sizeof(float) * vec_len),
+                    static_cast<int>(sizeof(float) * npeaks),
+                    static_cast<int>(sizeof(float) * npeaks)
+              })),
+        d_samp_rate(samp_rate),
+        d_vec_len(vec_len),
+        d_median(n_med),
+        d_average(n_avg),
+        d_prox(proximity),
+        d_npeaks(npeaks),
+        d_median_buffer(vec_len)
+    {
+      if (npeaks < 1) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid number of peaks: " << npeaks;
+        throw std::invalid_argument(message.str());
+      }
+
+      set_tag_propagation_policy(TPP_CUSTOM);
+    }
+
+    fused_spectral_peaks_ff::~fused_spectral_peaks_ff()
+    {
+    }
+
+    int
+    fused_spectral_peaks_ff::smooth(const float *in, int first, int last, float *out)
+    {
+      const int n = d_vec_len;
+
+      if (d_median == 0 && d_average == 0) {
+        std::copy(in + first, in + last + 1, out + first);
+        return static_cast<int>(std::max_element(out + first, out + last + 1) - out);
+      }
+      else if (d_median == 0) {
+        return average_filter(in, n, d_average, first, last, out);
+      }
+      else if (d_average == 0) {
+        return median_filter(in, n, d_median, first, last, out, d_window);
+      }
+
+      // The average reads the median bins within its margin
+      median_filter(in, n, d_median, std::max(first - d_average, 0),
+              std::min(last + d_average, n - 1), &d_median_buffer[0], d_window);
+      return average_filter(&d_median_buffer[0], n, d_average, first, last, out);
+    }
+
+    int
+    fused_spectral_peaks_ff::work(int noutput_items,
+        gr_vector_const_void_star &input_items,
+        gr_vector_void_star &output_items)
+    {
+      block_stats_scope_t stats(d_stats);
+
+      const float *actual = (const float *) input_items[0];
+      const float *low_freq =  (const float *) input_items[1];
+      const float *up_freq = (const float *) input_items[2];
+
+      float *filtered = (float *) output_items[0];
+      float *max_sig = (float *) output_items[1];
+      float *width_sig = (float *) output_items[2];
+
+      for (int v = 0; v < noutput_items; v++) {
+        const float *vin = actual + v * d_vec_len;
+        float *vout = filtered + v * d_vec_len;
+
+        // Bins outside the frequency ranges are passed through
+        memcpy(vout, vin, d_vec_len * sizeof(float));
+
+        for (int k = 0; k < d_npeaks; k++) {
+          const int peak = v * d_npeaks + k;
+
+          int start_bin, end_bin;
+          peak_search_bins(d_samp_rate, d_vec_len, low_freq[peak], up_freq[peak], start_bin, end_bin);
+
+          // Overlapping ranges smooth the same bins again, from the input hence to the same values
+          const int max_fil_i = smooth(vin, start_bin, end_bin, vout);
+
+          locate_peak(vin, d_vec_len, d_samp_rate, d_prox, max_fil_i, vout[max_fil_i],
+                  max_sig + peak, width_sig + peak);
+        }
+      }
+
+      propagate_tags(noutput_items);
+
+      return noutput_items;
+    }
+
+    void
+    fused_spectral_peaks_ff::propagate_tags(int noutput_items)
+    {
+      // As by the hier graph, the filtered spectrum carries no tags and the tags of all the
+      // inputs are forwarded to the peak outputs
+      std::vector<gr::tag_t> tags;
+
+      for (unsigned input = 0; input < 3; input++) {
+        get_tags_in_range(tags, input, nitems_read(input), nitems_read(input) + noutput_items);
+        for (const auto &tag : tags) {
+          add_item_tag(1, tag);
+          add_item_tag(2, tag);
+        }
+      }
+    }
+
+  } /* namespace digitizers */
+} /* namespace gr */
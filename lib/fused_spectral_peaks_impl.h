@@ -0,0 +1,82 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_FUSED_SPECTRAL_PEAKS_IMPL_H
+#define INCLUDED_DIGITIZERS_FUSED_SPECTRAL_PEAKS_IMPL_H
+
+#include <gnuradio/sync_block.h>
+
+#include <vector>
+#include "block_stats_impl.h"
+#include "utils.h"
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Single block implementation of block_spectral_peaks.
+     *
+     * Computes the same peaks as the median_and_average and peak_detector pair, but smooths
+     * only the bins searched: for each frequency range the median and the average filters are
+     * evaluated over the range bins (plus the filter margins), the first maximum is tracked
+     * while averaging, and the actual peak and its FWHM are then located as by peak_detector.
+     * The spectrum is read once per range and the smoothed spectrum isn't re-read.
+     *
+     * The filtered output holds the smoothed bins within the frequency ranges, the others are
+     * passed through as received.
+     *
+     * Inputs: spectrum (vec_len), f_min and f_max (npeaks). Outputs: filtered spectrum
+     * (vec_len), peak frequency and stdev (npeaks). Tags are propagated to the peak outputs.
+     */
+    class fused_spectral_peaks_ff : public gr::sync_block
+    {
+     public:
+      typedef boost::shared_ptr<fused_spectral_peaks_ff> sptr;
+
+      static sptr make(double samp_rate,
+          int vec_len,
+          int n_med,
+          int n_avg,
+          int proximity,
+          int npeaks);
+
+      fused_spectral_peaks_ff(double samp_rate,
+          int vec_len,
+          int n_med,
+          int n_avg,
+          int proximity,
+          int npeaks);
+
+      ~fused_spectral_peaks_ff();
+
+      int work(int noutput_items,
+          gr_vector_const_void_star &input_items,
+          gr_vector_void_star &output_items) override;
+
+     private:
+
+      // Smooths the bins [first, last] into out, returns the bin of the first maximum
+      int smooth(const float *in, int first, int last, float *out);
+
+      void propagate_tags(int noutput_items);
+
+      const double d_samp_rate;
+      const int d_vec_len;
+      const int d_median;
+      const int d_average;
+      const int d_prox;
+      const int d_npeaks;
+
+      std::vector<float> d_median_buffer;   // median output, input to the average
+      sliding_median<float> d_window;
+
+      block_stats_recorder_t d_stats {this};
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_FUSED_SPECTRAL_PEAKS_IMPL_H */
@@ -0,0 +1,131 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_GOERTZEL_KERNEL_H
+#define INCLUDED_DIGITIZERS_GOERTZEL_KERNEL_H
+
+#include "cpu_dispatch.h"
+#include <cstddef>
+
+namespace gr {
+  namespace digitizers {
+
+    /**********************************************************************
+     * Goertzel recurrence over many bins, in a single pass over the samples
+     *********************************************************************/
+
+    namespace goertzel_detail {
+
+      // Number of bins evaluated in parallel, i.e. two AVX registers of doubles
+      static const int LANES = 8;
+
+      /*!
+       * The lanes are independent recurrences, i.e. the inner loop is vectorized by the
+       * compiler without reordering any floating point operation (the results are identical
+       * to the scalar recurrence). Inlined into each of the kernels below so that it is
+       * compiled for their target.
+       */
+      __attribute__((always_inline))
+      static inline void
+      goertzel_lanes(const float *samples, const float *window, int nsamples, const double *coeffs,
+              double *d1, double *d2)
+      {
+        double s1[LANES], s2[LANES], c[LANES];
+        for (int l = 0; l < LANES; l++) {
+          s1[l] = 0.0;
+          s2[l] = 0.0;
+          c[l] = coeffs[l];
+        }
+
+        for (int j = 0; j < nsamples; j++) {
+          const double x = samples[j] * window[j];
+          for (int l = 0; l < LANES; l++) {
+            const double y = x + c[l] * s1[l] - s2[l];
+            s2[l] = s1[l];
+            s1[l] = y;
+          }
+        }
+
+        for (int l = 0; l < LANES; l++) {
+          d1[l] = s1[l];
+          d2[l] = s2[l];
+        }
+      }
+
+      static inline void
+      goertzel_generic(const float *samples, const float *window, int nsamples, const double *coeffs,
+              int nbins, double *d1, double *d2)
+      {
+        for (int b = 0; b < nbins; b += LANES) {
+          goertzel_lanes(samples, window, nsamples, coeffs + b, d1 + b, d2 + b);
+        }
+      }
+
+#if defined(__x86_64__) || defined(__i386__)
+      // FMA is not enabled on purpose, it would change the rounding
+      __attribute__((target("avx2")))
+      static inline void
+      goertzel_avx2(const float *samples, const float *window, int nsamples, const double *coeffs,
+              int nbins, double *d1, double *d2)
+      {
+        for (int b = 0; b < nbins; b += LANES) {
+          goertzel_lanes(samples, window, nsamples, coeffs + b, d1 + b, d2 + b);
+        }
+      }
+#endif
+
+      typedef void (*goertzel_kernel_t)(const float *, const float *, int, const double *, int,
+              double *, double *);
+
+      // Best variant available for the given instruction set
+      static inline goertzel_kernel_t
+      select_kernel(kernel_isa_t isa)
+      {
+#if defined(__x86_64__) || defined(__i386__)
+        if (isa >= KERNEL_ISA_AVX2) {
+          return goertzel_avx2;
+        }
+#endif
+        return goertzel_generic;
+      }
+
+    } // namespace goertzel_detail
+
+    /*!
+     * \brief Number of bins to allocate coefficient and state arrays for, i.e. nbins
+     * rounded up to a whole number of lanes.
+     */
+    static inline int
+    goertzel_padded_bins(int nbins)
+    {
+      const int lanes = goertzel_detail::LANES;
+      return (nbins + lanes - 1) / lanes * lanes;
+    }
+
+    /*!
+     * \brief Runs the Goertzel recurrence y[j] = x[j] * w[j] + coeff * y[j-1] - y[j-2] for all
+     * the bins, evaluating goertzel_detail::LANES bins per pass over the samples. The window
+     * is applied while loading the samples, i.e. no separate pass is needed.
+     *
+     * \param samples input samples
+     * \param window window function, nsamples elements
+     * \param coeffs recurrence coefficients (2 cos(w)), goertzel_padded_bins(nbins) elements
+     * \param d1 last state y[n-1] of each bin, goertzel_padded_bins(nbins) elements
+     * \param d2 state y[n-2] of each bin, goertzel_padded_bins(nbins) elements
+     */
+    static inline void
+    goertzel_bins(const float *samples, const float *window, int nsamples, const double *coeffs,
+            int nbins, double *d1, double *d2)
+    {
+      // kernel is selected once, on first use
+      static const goertzel_detail::goertzel_kernel_t kernel = goertzel_detail::select_kernel(get_kernel_isa());
+      kernel(samples, window, nsamples, coeffs, goertzel_padded_bins(nbins), d1, d2);
+    }
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_GOERTZEL_KERNEL_H */
@@ -0,0 +1,157 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_GOERTZEL_SPECTRUM_H
+#define INCLUDED_DIGITIZERS_GOERTZEL_SPECTRUM_H
+
+#include "goertzel_kernel.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <vector>
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Magnitude spectrum of a window, bins equally spaced in [f_min, f_max], as
+     * computed by stft_goertzl_dynamic.
+     *
+     * Per-bin coefficients are kept in a small LRU cache keyed on the frequency bounds,
+     * the bounds are rounded to 1/FREQ_QUANTA_PER_BIN of the frequency resolution of the
+     * window (samp_rate / winsize).
+     */
+    class goertzel_spectrum_t
+    {
+    public:
+
+      static const int FREQ_QUANTA_PER_BIN = 1000;
+      static const size_t COEFF_CACHE_SIZE = 8;
+
+      goertzel_spectrum_t(double samp_rate, int winsize, int nbins, const std::vector<float> &window)
+        : d_samp_length(1.0 / samp_rate),
+          d_winsize(winsize),
+          d_nbins(nbins),
+          d_window_function(window),
+          d_state1(goertzel_padded_bins(nbins)),
+          d_state2(goertzel_padded_bins(nbins))
+      {
+      }
+
+      int winsize() const
+      {
+        return d_winsize;
+      }
+
+      int nbins() const
+      {
+        return d_nbins;
+      }
+
+      void set_samp_rate(double samp_rate)
+      {
+        d_samp_length = 1.0 / samp_rate;
+        d_coeff_tables.clear();
+      }
+
+      /*!
+       * \brief Computes the spectrum of winsize samples, outputs nbins magnitudes, phases
+       * (always zero) and bin frequencies.
+       */
+      void compute(const float *in, float f_min, float f_max, float *mag, float *phs, float *fqs)
+      {
+        const auto &table = get_coeff_table(f_min, f_max);
+
+        // goertzel magic, LANES bins per pass over the window
+        goertzel_bins(in, &d_window_function[0], d_winsize, &table.coeffs[0], d_nbins,
+                &d_state1[0], &d_state2[0]);
+
+        for (int i = 0; i < d_nbins; i++) {
+          double d1 = d_state1[i];
+          double d2 = d_state2[i];
+          double re = (0.5 * table.coeffs[i] * d1 - d2) / d_winsize;
+          double im = (table.sines[i] * d1) / d_winsize;
+
+          //transform from carthesian to polar components
+          mag[i] = std::hypotf(re,im); // faster and over-/under-flow  protected
+          phs[i] = 0.0;
+        }
+
+        memcpy(fqs, &table.freqs[0], d_nbins * sizeof(float));
+      }
+
+    private:
+
+      // Coefficients of all the bins for a pair of quantised frequency bounds
+      struct coeff_table_t
+      {
+        int64_t lo;
+        int64_t hi;
+        std::vector<double> coeffs;  // 2 cos(w), padded to a whole number of lanes
+        std::vector<double> sines;
+        std::vector<float> freqs;
+      };
+
+      const coeff_table_t &get_coeff_table(float f_min, float f_max)
+      {
+        const double quantum = 1.0 / (d_samp_length * d_winsize * FREQ_QUANTA_PER_BIN);
+        const int64_t lo = std::llround(f_min / quantum);
+        const int64_t hi = std::llround(f_max / quantum);
+
+        for (auto it = d_coeff_tables.begin(); it != d_coeff_tables.end(); ++it) {
+          if (it->lo == lo && it->hi == hi) {
+            // most recently used first
+            d_coeff_tables.splice(d_coeff_tables.begin(), d_coeff_tables, it);
+            return d_coeff_tables.front();
+          }
+        }
+
+        if (d_coeff_tables.size() >= COEFF_CACHE_SIZE) {
+          d_coeff_tables.pop_back();
+        }
+
+        d_coeff_tables.emplace_front();
+        auto &table = d_coeff_tables.front();
+        table.lo = lo;
+        table.hi = hi;
+        table.coeffs.assign(goertzel_padded_bins(d_nbins), 0.0);
+        table.sines.resize(d_nbins);
+        table.freqs.resize(d_nbins);
+
+        double f_lo = lo * quantum;
+        double f_range = hi * quantum - f_lo;
+
+        for (int i = 0; i < d_nbins; i++) {
+          double bin_f_range_factor = static_cast<double>(i) / static_cast<double>(d_nbins-1);
+          double freq = f_lo + (bin_f_range_factor * f_range);
+          float w = 2.0 * M_PI * freq * d_samp_length;
+          table.coeffs[i] = 2.0 * std::cos(w);
+          table.sines[i] = std::sin(w);
+          table.freqs[i] = freq;
+        }
+
+        return table;
+      }
+
+      double d_samp_length;
+      int d_winsize;
+      int d_nbins;
+      std::vector<float> d_window_function;
+
+      // Least recently used table last, cleared if the sample rate changes
+      std::list<coeff_table_t> d_coeff_tables;
+
+      // Goertzel state, padded to a whole number of lanes
+      std::vector<double> d_state1;
+      std::vector<double> d_state2;
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_GOERTZEL_SPECTRUM_H */
@@ -0,0 +1,480 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gpu_aggregation.h"
+
+#ifdef DIGITIZERS_HAVE_OPENCL
+#define CL_TARGET_OPENCL_VERSION 120
+#include <CL/cl.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <sstream>
+#include <stdexcept>
+#endif
+
+namespace gr {
+  namespace digitizers {
+
+#ifdef DIGITIZERS_HAVE_OPENCL
+
+    namespace {
+
+      // One work item per sample (output) and channel, channels are adjacent in memory, i.e.
+      // neighbouring work items read neighbouring floats
+      const char *kernel_source = R"(
+        __kernel void filter(__global const float *values, __global const float *taps, int ntaps,
+                int hf, int n, __global float *filtered, __global float *squares)
+        {
+          const int j = get_global_id(0);
+          const int c = get_global_id(1);
+
+          float acc = 0.0f;
+          for (int k = 0; k < ntaps; k++) {
+            acc += taps[k] * values[(j + k) * n + c];
+          }
+
+          filtered[(hf + j) * n + c] = acc;
+          squares[(hf + j) * n + c] = acc * acc;
+        }
+
+        __kernel void aggregate(__global const float *filtered, __global const float *squares,
+                __global const float *errors, __global const float *taps, int ntaps, int hx, int hf,
+                int delay, int decim, float sigma_mult, int n, __global float *out, __global float *sigma)
+        {
+          const int i = get_global_id(0);
+          const int c = get_global_id(1);
+          const int row = i * decim;
+
+          float mean = 0.0f, mean_of_squares = 0.0f, error = 0.0f;
+          for (int k = 0; k < ntaps; k++) {
+            const int f = (hf + row - hx + k) * n + c;
+            mean += taps[k] * filtered[f];
+            mean_of_squares += taps[k] * squares[f];
+            error += taps[k] * errors[(row + k) * n + c];
+          }
+
+          out[i * n + c] = filtered[(hf + row - delay) * n + c];
+          sigma[i * n + c] = sqrt(fabs(mean_of_squares - mean * mean) + sigma_mult * error * error);
+        }
+      )";
+
+      void
+      check(cl_int status, const char *call, int line)
+      {
+        if (status != CL_SUCCESS) {
+          std::ostringstream message;
+          message << "Exception in " << __FILE__ << ":" << line << ": " << call << " failed: " << status;
+          throw std::runtime_error(message.str());
+        }
+      }
+
+      /*!
+       * \brief Context and program shared by all the instances, set up on first use.
+       */
+      class opencl_device_t
+      {
+      public:
+
+        static opencl_device_t &instance()
+        {
+          static opencl_device_t device;
+          return device;
+        }
+
+        ~opencl_device_t()
+        {
+          if (program) {
+            clReleaseProgram(program);
+          }
+          if (context) {
+            clReleaseContext(context);
+          }
+        }
+
+        cl_context context;
+        cl_device_id device;
+        cl_program program;
+        std::string status;     // device name, or why there is none
+
+      private:
+
+        opencl_device_t()
+          : context(nullptr),
+            device(nullptr),
+            program(nullptr)
+        {
+          std::vector<cl_device_id> devices;
+
+          cl_uint nplatforms = 0;
+          if (clGetPlatformIDs(0, nullptr, &nplatforms) != CL_SUCCESS || nplatforms == 0) {
+            status = "no OpenCL platform";
+            return;
+          }
+
+          std::vector<cl_platform_id> platforms(nplatforms);
+          clGetPlatformIDs(nplatforms, platforms.data(), nullptr);
+          for (auto platform : platforms) {
+            cl_uint ndevices = 0;
+            if (clGetDeviceIDs(platform, CL_DEVICE_TYPE_ALL, 0, nullptr, &ndevices) != CL_SUCCESS) {
+              continue;
+            }
+            std::vector<cl_device_id> found(ndevices);
+            clGetDeviceIDs(platform, CL_DEVICE_TYPE_ALL, ndevices, found.data(), nullptr);
+            devices.insert(devices.end(), found.begin(), found.end());
+          }
+
+          // CPU devices are not used unless selected, the SIMD code path is faster there
+          const char *selected = std::getenv("DIGITIZERS_OPENCL_DEVICE");
+          if (selected) {
+            const size_t index = std::strtoul(selected, nullptr, 10);
+            if (index < devices.size()) {
+              device = devices[index];
+            }
+          }
+          else {
+            for (auto candidate : devices) {
+              cl_device_type type = 0;
+              clGetDeviceInfo(candidate, CL_DEVICE_TYPE, sizeof(type), &type, nullptr);
+              if (type & CL_DEVICE_TYPE_GPU) {
+                device = candidate;
+                break;
+              }
+            }
+          }
+
+          if (!device) {
+            status = selected ? "no OpenCL device " + std::string(selected) : "no OpenCL GPU";
+            return;
+          }
+
+          char name[256] = {0};
+          clGetDeviceInfo(device, CL_DEVICE_NAME, sizeof(name) - 1, name, nullptr);
+
+          cl_int error;
+          context = clCreateContext(nullptr, 1, &device, nullptr, nullptr, &error);
+          if (error != CL_SUCCESS) {
+            context = nullptr;
+            status = "failed to create an OpenCL context on " + std::string(name);
+            return;
+          }
+
+          program = clCreateProgramWithSource(context, 1, &kernel_source, nullptr, &error);
+          if (error != CL_SUCCESS) {
+            program = nullptr;
+            status = "failed to create the OpenCL program on " + std::string(name);
+            return;
+          }
+
+          if (clBuildProgram(program, 1, &device, "", nullptr, nullptr) != CL_SUCCESS) {
+            size_t size = 0;
+            clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, 0, nullptr, &size);
+            std::string log(size, '\0');
+            clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, size, &log[0], nullptr);
+            clReleaseProgram(program);
+            program = nullptr;
+            status = "failed to build the kernels for " + std::string(name) + ": " + log;
+            return;
+          }
+
+          status = name;
+        }
+      };
+
+      class opencl_aggregation_t : public gpu_aggregation_t
+      {
+      public:
+
+        explicit opencl_aggregation_t(int nchannels)
+          : d_n(nchannels),
+            d_device(opencl_device_t::instance()),
+            d_hx(0),
+            d_hf(0),
+            d_ntaps(0),
+            d_delay(0),
+            d_sigma_mult(0.0f),
+            d_capacity(0)
+        {
+          cl_int error;
+          d_queue = clCreateCommandQueue(d_device.context, d_device.device, 0, &error);
+          check(error, "clCreateCommandQueue", __LINE__);
+          d_filter = clCreateKernel(d_device.program, "filter", &error);
+          check(error, "clCreateKernel", __LINE__);
+          d_aggregate = clCreateKernel(d_device.program, "aggregate", &error);
+          check(error, "clCreateKernel", __LINE__);
+        }
+
+        ~opencl_aggregation_t()
+        {
+          clFinish(d_queue);
+          release_pinned();
+          for (auto buffer : {d_values, d_errors, d_filtered, d_squares, d_taps, d_scratch, d_out, d_sigma}) {
+            if (buffer) {
+              clReleaseMemObject(buffer);
+            }
+          }
+          clReleaseKernel(d_filter);
+          clReleaseKernel(d_aggregate);
+          clReleaseCommandQueue(d_queue);
+        }
+
+        void
+        set_taps(const std::vector<float> &taps, int delay, float sigma_mult) override
+        {
+          const size_t hx = taps.size() - 1;
+          const size_t hf = std::max(hx, static_cast<size_t>(delay));
+
+          d_values = resize(d_values, d_hx, hx);
+          d_errors = resize(d_errors, d_hx, hx);
+          d_filtered = resize(d_filtered, d_hf, hf);
+          d_squares = resize(d_squares, d_hf, hf);
+          d_hx = hx;
+          d_hf = hf;
+
+          replace(d_taps, create(taps.size() * sizeof(float), CL_MEM_READ_ONLY));
+          check(clEnqueueWriteBuffer(d_queue, d_taps, CL_TRUE, 0, taps.size() * sizeof(float), taps.data(),
+                  0, nullptr, nullptr), "clEnqueueWriteBuffer", __LINE__);
+          replace(d_scratch, create(std::max<size_t>(std::max(hx, hf) * d_n, 1) * sizeof(float)));
+
+          d_ntaps = taps.size();
+          d_delay = delay;
+          d_sigma_mult = sigma_mult;
+        }
+
+        void
+        reserve(size_t ninput, float **values, float **errors) override
+        {
+          if (ninput > d_capacity) {
+            clFinish(d_queue);
+            release_pinned();
+
+            d_capacity = ninput;
+            d_values = resize(d_values, d_hx, d_hx);
+            d_errors = resize(d_errors, d_hx, d_hx);
+            d_filtered = resize(d_filtered, d_hf, d_hf);
+            d_squares = resize(d_squares, d_hf, d_hf);
+
+            // at most one output per input sample
+            const size_t size = d_capacity * d_n * sizeof(float);
+            replace(d_out, create(size, CL_MEM_WRITE_ONLY));
+            replace(d_sigma, create(size, CL_MEM_WRITE_ONLY));
+
+            // page-locked staging buffers, mapped for the lifetime of the buffers
+            for (int i = 0; i < 4; i++) {
+              d_pinned[i] = create(size, CL_MEM_ALLOC_HOST_PTR);
+              cl_int error;
+              d_mapped[i] = static_cast<float *>(clEnqueueMapBuffer(d_queue, d_pinned[i], CL_TRUE,
+                      i < 2 ? CL_MAP_WRITE : CL_MAP_READ, 0, size, 0, nullptr, nullptr, &error));
+              check(error, "clEnqueueMapBuffer", __LINE__);
+            }
+          }
+
+          *values = d_mapped[0];
+          *errors = d_mapped[1];
+        }
+
+        void
+        process(size_t ninput, int decim, const float **values, const float **sigma) override
+        {
+          const size_t noutput = ninput / decim;
+          const size_t n = d_n;
+
+          *values = d_mapped[2];
+          *sigma = d_mapped[3];
+
+          if (ninput == 0) {
+            return;
+          }
+
+          check(clEnqueueWriteBuffer(d_queue, d_values, CL_FALSE, d_hx * n * sizeof(float), ninput * n * sizeof(float),
+                  d_mapped[0], 0, nullptr, nullptr), "clEnqueueWriteBuffer", __LINE__);
+          check(clEnqueueWriteBuffer(d_queue, d_errors, CL_FALSE, d_hx * n * sizeof(float), ninput * n * sizeof(float),
+                  d_mapped[1], 0, nullptr, nullptr), "clEnqueueWriteBuffer", __LINE__);
+
+          const cl_int ntaps = d_ntaps, hx = d_hx, hf = d_hf, delay = d_delay, cl_decim = decim, cl_n = d_n;
+
+          set_args(d_filter, d_values, d_taps, ntaps, hf, cl_n, d_filtered, d_squares);
+          const size_t filter_size[2] = {ninput, n};
+          check(clEnqueueNDRangeKernel(d_queue, d_filter, 2, nullptr, filter_size, nullptr, 0, nullptr, nullptr),
+                  "clEnqueueNDRangeKernel", __LINE__);
+
+          if (noutput) {
+            set_args(d_aggregate, d_filtered, d_squares, d_errors, d_taps, ntaps, hx, hf, delay, cl_decim,
+                    d_sigma_mult, cl_n, d_out, d_sigma);
+            const size_t aggregate_size[2] = {noutput, n};
+            check(clEnqueueNDRangeKernel(d_queue, d_aggregate, 2, nullptr, aggregate_size, nullptr, 0, nullptr,
+                    nullptr), "clEnqueueNDRangeKernel", __LINE__);
+
+            check(clEnqueueReadBuffer(d_queue, d_out, CL_FALSE, 0, noutput * n * sizeof(float), d_mapped[2],
+                    0, nullptr, nullptr), "clEnqueueReadBuffer", __LINE__);
+            check(clEnqueueReadBuffer(d_queue, d_sigma, CL_FALSE, 0, noutput * n * sizeof(float), d_mapped[3],
+                    0, nullptr, nullptr), "clEnqueueReadBuffer", __LINE__);
+          }
+
+          // keep histories for the next call, on the device
+          keep_history(d_values, d_hx, ninput);
+          keep_history(d_errors, d_hx, ninput);
+          keep_history(d_filtered, d_hf, ninput);
+          keep_history(d_squares, d_hf, ninput);
+
+          check(clFinish(d_queue), "clFinish", __LINE__);
+        }
+
+      private:
+
+        cl_mem
+        create(size_t size, cl_mem_flags flags = CL_MEM_READ_WRITE)
+        {
+          cl_int error;
+          cl_mem buffer = clCreateBuffer(d_device.context, flags, size, nullptr, &error);
+          check(error, "clCreateBuffer", __LINE__);
+          return buffer;
+        }
+
+        void
+        replace(cl_mem &buffer, cl_mem next)
+        {
+          // released once the enqueued commands using it are done
+          if (buffer) {
+            clReleaseMemObject(buffer);
+          }
+          buffer = next;
+        }
+
+        // Returns a buffer for new_history + d_capacity interleaved samples, the most recent
+        // samples of the old history are kept, see multi_fused_aggregation_ff::resize_history
+        cl_mem
+        resize(cl_mem old, size_t old_history, size_t new_history)
+        {
+          const size_t row = d_n * sizeof(float);
+          cl_mem buffer = create(std::max<size_t>(new_history + d_capacity, 1) * row);
+
+          if (new_history) {
+            const std::vector<float> zeros(new_history * d_n, 0.0f);
+            check(clEnqueueWriteBuffer(d_queue, buffer, CL_TRUE, 0, new_history * row, zeros.data(),
+                    0, nullptr, nullptr), "clEnqueueWriteBuffer", __LINE__);
+          }
+
+          const size_t keep = old ? std::min(old_history, new_history) : 0;
+          if (keep) {
+            check(clEnqueueCopyBuffer(d_queue, old, buffer, (old_history - keep) * row, (new_history - keep) * row,
+                    keep * row, 0, nullptr, nullptr), "clEnqueueCopyBuffer", __LINE__);
+          }
+
+          if (old) {
+            clReleaseMemObject(old);
+          }
+          return buffer;
+        }
+
+        // Moves the last history samples to the front, through the scratch buffer because
+        // the regions might overlap
+        void
+        keep_history(cl_mem buffer, size_t history, size_t ninput)
+        {
+          if (!history) {
+            return;
+          }
+
+          const size_t row = d_n * sizeof(float);
+          check(clEnqueueCopyBuffer(d_queue, buffer, d_scratch, ninput * row, 0, history * row, 0, nullptr, nullptr),
+                  "clEnqueueCopyBuffer", __LINE__);
+          check(clEnqueueCopyBuffer(d_queue, d_scratch, buffer, 0, 0, history * row, 0, nullptr, nullptr),
+                  "clEnqueueCopyBuffer", __LINE__);
+        }
+
+        void
+        release_pinned()
+        {
+          for (int i = 0; i < 4; i++) {
+            if (d_pinned[i]) {
+              clEnqueueUnmapMemObject(d_queue, d_pinned[i], d_mapped[i], 0, nullptr, nullptr);
+              clReleaseMemObject(d_pinned[i]);
+              d_pinned[i] = nullptr;
+              d_mapped[i] = nullptr;
+            }
+          }
+        }
+
+        template <typename... Args>
+        void
+        set_args(cl_kernel kernel, const Args &... args)
+        {
+          cl_uint index = 0;
+          // expands into one clSetKernelArg per argument, in order
+          int expand[] = {(check(clSetKernelArg(kernel, index++, sizeof(Args), &args), "clSetKernelArg", __LINE__), 0)...};
+          (void) expand;
+        }
+
+        const int d_n;
+        opencl_device_t &d_device;
+
+        cl_command_queue d_queue;
+        cl_kernel d_filter;
+        cl_kernel d_aggregate;
+
+        // device buffers, histories first as in multi_fused_aggregation_ff
+        cl_mem d_values = nullptr;
+        cl_mem d_errors = nullptr;
+        cl_mem d_filtered = nullptr;
+        cl_mem d_squares = nullptr;
+        cl_mem d_taps = nullptr;
+        cl_mem d_scratch = nullptr;
+        cl_mem d_out = nullptr;
+        cl_mem d_sigma = nullptr;
+
+        // pinned staging buffers: values, errors, out and sigma
+        cl_mem d_pinned[4] = {nullptr, nullptr, nullptr, nullptr};
+        float *d_mapped[4] = {nullptr, nullptr, nullptr, nullptr};
+
+        size_t d_hx;
+        size_t d_hf;
+        size_t d_ntaps;
+        int d_delay;
+        float d_sigma_mult;
+        size_t d_capacity;
+      };
+
+    } // namespace
+
+    std::unique_ptr<gpu_aggregation_t>
+    gpu_aggregation_t::make(int nchannels)
+    {
+      if (!opencl_device_t::instance().program || nchannels < 1) {
+        return nullptr;
+      }
+
+      return std::unique_ptr<gpu_aggregation_t>(new opencl_aggregation_t(nchannels));
+    }
+
+    std::string
+    gpu_aggregation_t::status()
+    {
+      return opencl_device_t::instance().status;
+    }
+
+#else
+
+    std::unique_ptr<gpu_aggregation_t>
+    gpu_aggregation_t::make(int)
+    {
+      return nullptr;
+    }
+
+    std::string
+    gpu_aggregation_t::status()
+    {
+      return "built without OpenCL";
+    }
+
+#endif
+
+  } // namespace digitizers
+} // namespace gr
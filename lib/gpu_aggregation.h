@@ -0,0 +1,72 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_GPU_AGGREGATION_H
+#define INCLUDED_DIGITIZERS_GPU_AGGREGATION_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief FIR aggregation circuit of multi_fused_aggregation_ff executed on a GPU (OpenCL).
+     *
+     * Samples are interleaved as in multi_fused_aggregation_ff, sample j of channel c at
+     * [j * nchannels + c]. The input and output staging buffers are pinned (page-locked) host
+     * memory, i.e. transfers are DMA without an intermediate copy. All the histories stay on
+     * the device, per call only the new input samples are uploaded and the decimated outputs
+     * downloaded.
+     *
+     * Only available if the library was built with OpenCL (DIGITIZERS_HAVE_OPENCL), the device
+     * is the first GPU found, the DIGITIZERS_OPENCL_DEVICE environment variable selects
+     * another one by index (over all the platforms). Each instance is used by a single thread
+     * at a time, instances share the OpenCL context and program.
+     */
+    class gpu_aggregation_t
+    {
+    public:
+
+      virtual ~gpu_aggregation_t() {}
+
+      /*!
+       * \brief Returns a new instance for the given number of channels, or nullptr if built
+       * without OpenCL or no device is available.
+       */
+      static std::unique_ptr<gpu_aggregation_t> make(int nchannels);
+
+      /*!
+       * \brief Returns the name of the device used by all the instances, or why none is
+       * available.
+       */
+      static std::string status();
+
+      /*!
+       * \brief Sets the reversed taps (see multi_fused_aggregation_ff), the most recent samples
+       * of the histories are kept.
+       */
+      virtual void set_taps(const std::vector<float> &taps, int delay, float sigma_mult) = 0;
+
+      /*!
+       * \brief Returns the pinned input staging buffers of at least ninput samples per channel.
+       * Pointers are valid until the next call to reserve.
+       */
+      virtual void reserve(size_t ninput, float **values, float **errors) = 0;
+
+      /*!
+       * \brief Processes ninput samples staged in the input buffers, i.e. ninput / decim
+       * outputs per channel. Returns the pinned output buffers (values and sigma), valid until
+       * the next call.
+       */
+      virtual void process(size_t ninput, int decim, const float **values, const float **sigma) = 0;
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_GPU_AGGREGATION_H */
@@ -0,0 +1,216 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_HALF_KERNEL_H
+#define INCLUDED_DIGITIZERS_HALF_KERNEL_H
+
+#include "cpu_dispatch.h"
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace gr {
+  namespace digitizers {
+
+    /**********************************************************************
+     * Half precision (IEEE 754 binary16) storage kernels. Conversions round to nearest even,
+     * values beyond the half range become infinite, NaNs stay NaNs.
+     *********************************************************************/
+
+    namespace half_detail {
+
+      static inline uint16_t
+      float_to_half_scalar(float value)
+      {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+
+        const uint32_t sign = (bits >> 16) & 0x8000;
+        uint32_t abs = bits & 0x7fffffff;
+
+        // Inf and NaN, NaNs are quieted
+        if (abs >= 0x7f800000) {
+          return static_cast<uint16_t>(sign | 0x7c00 | (abs > 0x7f800000 ? 0x200 | ((abs >> 13) & 0x3ff) : 0));
+        }
+
+        // Rounds to infinity (65520 and above)
+        if (abs >= 0x477ff000) {
+          return static_cast<uint16_t>(sign | 0x7c00);
+        }
+
+        // Subnormal half, adding 0.5 lets the FPU round to the half subnormal step (2^-24)
+        if (abs < 0x38800000) {
+          float shifted;
+          memcpy(&shifted, &abs, sizeof(shifted));
+          shifted += 0.5f;
+          uint32_t shifted_bits;
+          memcpy(&shifted_bits, &shifted, sizeof(shifted_bits));
+          return static_cast<uint16_t>(sign | (shifted_bits - 0x3f000000));
+        }
+
+        // Normal, rebias the exponent and round the mantissa to nearest even
+        const uint32_t odd = (abs >> 13) & 1;
+        abs += 0xc8000fff + odd;
+        return static_cast<uint16_t>(sign | (abs >> 13));
+      }
+
+      static inline float
+      half_to_float_scalar(uint16_t half)
+      {
+        const uint32_t sign = static_cast<uint32_t>(half & 0x8000) << 16;
+        const uint32_t exponent = (half >> 10) & 0x1f;
+        const uint32_t mantissa = half & 0x3ff;
+
+        uint32_t bits;
+        if (exponent == 0x1f) {
+          // NaNs are quieted (as by F16C)
+          bits = sign | 0x7f800000 | (mantissa ? 0x400000 | (mantissa << 13) : 0);
+        }
+        else if (exponent) {
+          bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+        }
+        else {
+          // Zero or subnormal, exact in single precision
+          const float value = static_cast<float>(mantissa) * (1.0f / 16777216.0f);
+          memcpy(&bits, &value, sizeof(bits));
+          bits |= sign;
+        }
+
+        float value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+      }
+
+      static inline void
+      float_to_half_generic(const float *in, uint16_t *out, uint32_t nsamples)
+      {
+#if defined(__ARM_FP16_FORMAT_IEEE)
+        // Vectorized by the compiler (NEON FCVTN)
+        for (uint32_t i = 0; i < nsamples; i++) {
+          const __fp16 half = static_cast<__fp16>(in[i]);
+          memcpy(&out[i], &half, sizeof(uint16_t));
+        }
+#else
+        for (uint32_t i = 0; i < nsamples; i++) {
+          out[i] = float_to_half_scalar(in[i]);
+        }
+#endif
+      }
+
+      static inline void
+      half_to_float_generic(const uint16_t *in, float *out, uint32_t nsamples)
+      {
+#if defined(__ARM_FP16_FORMAT_IEEE)
+        for (uint32_t i = 0; i < nsamples; i++) {
+          __fp16 half;
+          memcpy(&half, &in[i], sizeof(uint16_t));
+          out[i] = static_cast<float>(half);
+        }
+#else
+        for (uint32_t i = 0; i < nsamples; i++) {
+          out[i] = half_to_float_scalar(in[i]);
+        }
+#endif
+      }
+
+#if defined(__x86_64__) || defined(__i386__)
+      // F16C ships with every AVX2 CPU, i.e. the AVX2 level implies it
+      __attribute__((target("avx2,f16c")))
+      static inline void
+      float_to_half_f16c(const float *in, uint16_t *out, uint32_t nsamples)
+      {
+        uint32_t i = 0;
+
+        for (; i + 8 <= nsamples; i += 8) {
+          const __m128i half = _mm256_cvtps_ph(_mm256_loadu_ps(in + i), _MM_FROUND_TO_NEAREST_INT);
+          _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), half);
+        }
+
+        // remainder
+        float_to_half_generic(in + i, out + i, nsamples - i);
+      }
+
+      __attribute__((target("avx2,f16c")))
+      static inline void
+      half_to_float_f16c(const uint16_t *in, float *out, uint32_t nsamples)
+      {
+        uint32_t i = 0;
+
+        for (; i + 8 <= nsamples; i += 8) {
+          const __m128i half = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+          _mm256_storeu_ps(out + i, _mm256_cvtph_ps(half));
+        }
+
+        // remainder
+        half_to_float_generic(in + i, out + i, nsamples - i);
+      }
+#endif
+
+      typedef void (*float_to_half_kernel_t)(const float *in, uint16_t *out, uint32_t nsamples);
+
+      // Best variant available for the given instruction set
+      static inline float_to_half_kernel_t
+      float_to_half_kernel(kernel_isa_t isa)
+      {
+#if defined(__x86_64__) || defined(__i386__)
+        if (isa >= KERNEL_ISA_AVX2) {
+          return float_to_half_f16c;
+        }
+#endif
+        return float_to_half_generic;
+      }
+
+      typedef void (*half_to_float_kernel_t)(const uint16_t *in, float *out, uint32_t nsamples);
+
+      // Best variant available for the given instruction set
+      static inline half_to_float_kernel_t
+      half_to_float_kernel(kernel_isa_t isa)
+      {
+#if defined(__x86_64__) || defined(__i386__)
+        if (isa >= KERNEL_ISA_AVX2) {
+          return half_to_float_f16c;
+        }
+#endif
+        return half_to_float_generic;
+      }
+
+    } // namespace half_detail
+
+    /*!
+     * \brief Converts samples to half precision for storage. Half precision holds about three
+     * significant digits and a range of +-65504, enough for error estimates but not for all the
+     * values.
+     */
+    static inline void
+    float_to_half(const float *in, uint16_t *out, uint32_t nsamples)
+    {
+      // kernel is selected once, on first use
+      static const half_detail::float_to_half_kernel_t kernel =
+              half_detail::float_to_half_kernel(get_kernel_isa());
+
+      kernel(in, out, nsamples);
+    }
+
+    /*!
+     * \brief Converts stored half precision samples back to single precision (exact).
+     */
+    static inline void
+    half_to_float(const uint16_t *in, float *out, uint32_t nsamples)
+    {
+      // kernel is selected once, on first use
+      static const half_detail::half_to_float_kernel_t kernel =
+              half_detail::half_to_float_kernel(get_kernel_isa());
+
+      kernel(in, out, nsamples);
+    }
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_HALF_KERNEL_H */
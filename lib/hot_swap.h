@@ -0,0 +1,81 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_HOT_SWAP_H
+#define INCLUDED_DIGITIZERS_HOT_SWAP_H
+
+#include <atomic>
+#include <memory>
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Hands over values (e.g. filter coefficient sets) to a running work function.
+     *
+     * Any thread prepares the value and publishes it, the work function takes it at a sample
+     * boundary, typically at the start of a work call. Values published in between replace each
+     * other, i.e. only the latest one is taken. Both sides exchange a single pointer, nobody
+     * waits for the other.
+     *
+     * The work function doesn't free memory either: the value replaced is retired and freed by
+     * the next publish (or the destructor).
+     */
+    template<typename T>
+    class hot_swap_t
+    {
+    public:
+
+      hot_swap_t()
+        : d_pending(nullptr),
+          d_retired(nullptr)
+      {
+      }
+
+      ~hot_swap_t()
+      {
+        delete d_pending.exchange(nullptr);
+        delete d_retired.exchange(nullptr);
+      }
+
+      hot_swap_t(const hot_swap_t &) = delete;
+      hot_swap_t &operator=(const hot_swap_t &) = delete;
+
+      /*!
+       * \brief Publishes the value, the one not taken yet (if any) is dropped.
+       */
+      void publish(std::unique_ptr<T> value)
+      {
+        delete d_retired.exchange(nullptr);
+        delete d_pending.exchange(value.release());
+      }
+
+      /*!
+       * \brief Takes the latest value published, nullptr if there is none. Work function only.
+       */
+      std::unique_ptr<T> take()
+      {
+        return std::unique_ptr<T>(d_pending.exchange(nullptr));
+      }
+
+      /*!
+       * \brief Hands the replaced value back, it's freed by the next publish. Work function only.
+       */
+      void retire(std::unique_ptr<T> value)
+      {
+        // Retired twice without a publish in between, rare enough to free it here
+        delete d_retired.exchange(value.release());
+      }
+
+    private:
+      std::atomic<T *> d_pending;
+      std::atomic<T *> d_retired;
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_HOT_SWAP_H */
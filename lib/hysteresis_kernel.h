@@ -0,0 +1,193 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_HYSTERESIS_KERNEL_H
+#define INCLUDED_DIGITIZERS_HYSTERESIS_KERNEL_H
+
+#include "cpu_dispatch.h"
+#include <algorithm>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace gr {
+  namespace digitizers {
+
+    /**********************************************************************
+     * Dual-threshold (hysteresis) crossing finder. Threshold crossings are packed into two
+     * bitmasks, bit k of word w corresponds to sample 32 * w + k
+     *********************************************************************/
+
+    static const int HYSTERESIS_WORD_BITS = 32;
+
+    namespace hysteresis_detail {
+
+      static inline void
+      threshold_masks_generic(const float *in, int nitems, float lo, float hi,
+              uint32_t *above, uint32_t *below)
+      {
+        for (int w = 0; w * HYSTERESIS_WORD_BITS < nitems; w++) {
+          const int first = w * HYSTERESIS_WORD_BITS;
+          const int n = std::min(HYSTERESIS_WORD_BITS, nitems - first);
+
+          uint32_t above_word = 0, below_word = 0;
+          for (int k = 0; k < n; k++) {
+            const float x = in[first + k];
+            above_word |= static_cast<uint32_t>(x > hi) << k;
+            below_word |= static_cast<uint32_t>(x < lo) << k;
+          }
+          above[w] = above_word;
+          below[w] = below_word;
+        }
+      }
+
+#if defined(__x86_64__) || defined(__i386__)
+      __attribute__((target("avx2")))
+      static inline void
+      threshold_masks_avx2(const float *in, int nitems, float lo, float hi,
+              uint32_t *above, uint32_t *below)
+      {
+        const __m256 lower = _mm256_set1_ps(lo);
+        const __m256 upper = _mm256_set1_ps(hi);
+
+        int w = 0;
+        for (; (w + 1) * HYSTERESIS_WORD_BITS <= nitems; w++) {
+          uint32_t above_word = 0, below_word = 0;
+          for (int k = 0; k < HYSTERESIS_WORD_BITS; k += 8) {
+            const __m256 x = _mm256_loadu_ps(in + w * HYSTERESIS_WORD_BITS + k);
+            above_word |= static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(x, upper, _CMP_GT_OQ))) << k;
+            below_word |= static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(x, lower, _CMP_LT_OQ))) << k;
+          }
+          above[w] = above_word;
+          below[w] = below_word;
+        }
+
+        const int first = w * HYSTERESIS_WORD_BITS;
+        if (first < nitems) {
+          threshold_masks_generic(in + first, nitems - first, lo, hi, above + w, below + w);
+        }
+      }
+
+      __attribute__((target("avx512f")))
+      static inline void
+      threshold_masks_avx512(const float *in, int nitems, float lo, float hi,
+              uint32_t *above, uint32_t *below)
+      {
+        const __m512 lower = _mm512_set1_ps(lo);
+        const __m512 upper = _mm512_set1_ps(hi);
+
+        int w = 0;
+        for (; (w + 1) * HYSTERESIS_WORD_BITS <= nitems; w++) {
+          const __m512 x0 = _mm512_loadu_ps(in + w * HYSTERESIS_WORD_BITS);
+          const __m512 x1 = _mm512_loadu_ps(in + w * HYSTERESIS_WORD_BITS + 16);
+          above[w] = static_cast<uint32_t>(_mm512_cmp_ps_mask(x0, upper, _CMP_GT_OQ))
+                  | static_cast<uint32_t>(_mm512_cmp_ps_mask(x1, upper, _CMP_GT_OQ)) << 16;
+          below[w] = static_cast<uint32_t>(_mm512_cmp_ps_mask(x0, lower, _CMP_LT_OQ))
+                  | static_cast<uint32_t>(_mm512_cmp_ps_mask(x1, lower, _CMP_LT_OQ)) << 16;
+        }
+
+        const int first = w * HYSTERESIS_WORD_BITS;
+        if (first < nitems) {
+          threshold_masks_generic(in + first, nitems - first, lo, hi, above + w, below + w);
+        }
+      }
+#endif
+
+      typedef void (*threshold_masks_kernel_t)(const float *, int, float, float, uint32_t *, uint32_t *);
+
+      // Best variant available for the given instruction set
+      static inline threshold_masks_kernel_t
+      threshold_masks_kernel(kernel_isa_t isa)
+      {
+#if defined(__x86_64__) || defined(__i386__)
+        if (isa >= KERNEL_ISA_AVX512) {
+          return threshold_masks_avx512;
+        }
+        if (isa >= KERNEL_ISA_AVX2) {
+          return threshold_masks_avx2;
+        }
+#endif
+        return threshold_masks_generic;
+      }
+
+      // Index of the first set bit at or after sample pos, nitems if none
+      static inline int
+      find_next(const uint32_t *words, int nitems, int pos)
+      {
+        const int nwords = (nitems + HYSTERESIS_WORD_BITS - 1) / HYSTERESIS_WORD_BITS;
+
+        int w = pos / HYSTERESIS_WORD_BITS;
+        if (w >= nwords) {
+          return nitems;
+        }
+
+        uint32_t word = words[w] & (~uint32_t(0) << (pos % HYSTERESIS_WORD_BITS));
+        while (!word) {
+          if (++w >= nwords) {
+            return nitems;
+          }
+          word = words[w];
+        }
+        return w * HYSTERESIS_WORD_BITS + __builtin_ctz(word);
+      }
+
+    } // namespace hysteresis_detail
+
+    /*!
+     * \brief Number of bitmask words needed for nitems samples.
+     */
+    static inline int
+    hysteresis_words(int nitems)
+    {
+      return (nitems + HYSTERESIS_WORD_BITS - 1) / HYSTERESIS_WORD_BITS;
+    }
+
+    /*!
+     * \brief Marks the samples above hi (x > hi) and below lo (x < lo), NaNs are neither.
+     * hysteresis_words(nitems) words are written to each of the masks.
+     */
+    static inline void
+    threshold_masks(const float *in, int nitems, float lo, float hi, uint32_t *above, uint32_t *below)
+    {
+      // kernel is selected once, on first use
+      static const hysteresis_detail::threshold_masks_kernel_t kernel =
+              hysteresis_detail::threshold_masks_kernel(get_kernel_isa());
+
+      kernel(in, nitems, lo, hi, above, below);
+    }
+
+    /*!
+     * \brief Calls f(i, state) for each sample i where the hysteresis state changes, i.e. the
+     * first sample above hi while low and the first sample below lo while high. Whole words
+     * without a relevant crossing are skipped.
+     *
+     * \param above samples above the high threshold, see threshold_masks
+     * \param below samples below the low threshold, see threshold_masks
+     * \param state state preceding the first sample (true if high), updated to the state of
+     * the last sample
+     */
+    template <typename F>
+    static inline void
+    for_each_transition(const uint32_t *above, const uint32_t *below, int nitems, bool &state, F f)
+    {
+      int pos = 0;
+      while (pos < nitems) {
+        const int i = hysteresis_detail::find_next(state ? below : above, nitems, pos);
+        if (i >= nitems) {
+          break;
+        }
+        state = !state;
+        f(i, state);
+        pos = i + 1;
+      }
+    }
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_HYSTERESIS_KERNEL_H */
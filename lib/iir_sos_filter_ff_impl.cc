@@ -0,0 +1,162 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gnuradio/io_signature.h>
+#include "iir_sos_filter_ff_impl.h"
+#include "sos_design.h"
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+namespace gr {
+  namespace digitizers {
+
+    // Samples per channel interleaved at once, i.e. the scratch buffers stay in cache
+    static const int SOS_CHUNK_SIZE = 2048;
+
+    iir_sos_filter_ff::sptr
+    iir_sos_filter_ff::make(int nchannels,
+        const std::vector<double> &fw_taps,
+        const std::vector<double> &fb_taps)
+    {
+      return gnuradio::get_initial_sptr
+        (new iir_sos_filter_ff_impl(nchannels, tf_to_sos(fw_taps, fb_taps)));
+    }
+
+    /*
+     * The private constructor
+     */
+    iir_sos_filter_ff_impl::iir_sos_filter_ff_impl(int nchannels,
+        const std::vector<sos_section_t> &sections)
+      : gr::sync_block("iir_sos_filter_ff",
+              gr::io_signature::make(std::max(nchannels, 1), std::max(nchannels, 1), sizeof(float)),
+              gr::io_signature::make(std::max(nchannels, 1), std::max(nchannels, 1), sizeof(float))),
+        d_nchannels(nchannels),
+        d_nsections(0),
+        d_state_layout(0)
+    {
+      if (nchannels < 1) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": at least one channel required, got: " << nchannels;
+        throw std::invalid_argument(message.str());
+      }
+
+      set_sections(sections);
+      set_tag_propagation_policy(TPP_ONE_TO_ONE);
+
+      if (d_nchannels > 1) {
+        d_in.resize(SOS_CHUNK_SIZE * d_nchannels);
+        d_out.resize(SOS_CHUNK_SIZE * d_nchannels);
+      }
+    }
+
+    iir_sos_filter_ff_impl::~iir_sos_filter_ff_impl()
+    {
+    }
+
+    void
+    iir_sos_filter_ff_impl::set_taps(const std::vector<double> &fw_taps,
+        const std::vector<double> &fb_taps)
+    {
+      set_sections(tf_to_sos(fw_taps, fb_taps));
+    }
+
+    void
+    iir_sos_filter_ff_impl::set_sections(const std::vector<sos_section_t> &sections)
+    {
+      d_nsections = sections.size();
+      d_section_swap.publish(std::unique_ptr<std::vector<sos_section_t>>(
+              new std::vector<sos_section_t>(sections)));
+    }
+
+    int
+    iir_sos_filter_ff_impl::nsections()
+    {
+      return d_nsections;
+    }
+
+    void
+    iir_sos_filter_ff_impl::set_state_file(const state_file_t::sptr &file, const std::string &key)
+    {
+      d_state_slot.attach(file, key);
+    }
+
+    bool
+    iir_sos_filter_ff_impl::stop()
+    {
+      // the work function is done, i.e. the last state is saved
+      if (d_state_slot.is_attached()) {
+        d_state_slot.save(d_state_layout, {{d_state.data(), d_state.size()}});
+      }
+      return true;
+    }
+
+    int
+    iir_sos_filter_ff_impl::work(int noutput_items,
+        gr_vector_const_void_star &input_items,
+        gr_vector_void_star &output_items)
+    {
+      block_stats_scope_t stats(d_stats);
+
+      // New sections take effect at the first sample of this call
+      if (auto next = d_section_swap.take()) {
+        if (next->size() != d_sections.size()) {
+          d_state.assign(2 * next->size() * d_nchannels, 0.0f);
+        }
+        d_sections.swap(*next);
+        d_section_swap.retire(std::move(next));
+        d_state_layout = state_layout_hash(d_sections.data(), d_sections.size() * sizeof(sos_section_t),
+                static_cast<uint64_t>(d_nchannels));
+      }
+
+      const int nsections = d_sections.size();
+
+      if (d_state_slot.is_attached()) {
+        d_state_slot.restore(d_state_layout, {{d_state.data(), d_state.size()}});
+      }
+
+      if (d_nchannels == 1) {
+        sos_cascade(d_sections.data(), nsections, d_state.data(),
+                static_cast<const float *>(input_items[0]), static_cast<float *>(output_items[0]),
+                1, noutput_items);
+      }
+      else {
+        for (int first = 0; first < noutput_items; first += SOS_CHUNK_SIZE) {
+          const int n = std::min(SOS_CHUNK_SIZE, noutput_items - first);
+
+          for (int ch = 0; ch < d_nchannels; ch++) {
+            const float *in = static_cast<const float *>(input_items[ch]) + first;
+            for (int i = 0; i < n; i++) {
+              d_in[i * d_nchannels + ch] = in[i];
+            }
+          }
+
+          sos_cascade(d_sections.data(), nsections, d_state.data(), d_in.data(), d_out.data(),
+                  d_nchannels, n);
+
+          for (int ch = 0; ch < d_nchannels; ch++) {
+            float *out = static_cast<float *>(output_items[ch]) + first;
+            for (int i = 0; i < n; i++) {
+              out[i] = d_out[i * d_nchannels + ch];
+            }
+          }
+        }
+      }
+
+      if (d_state_slot.is_due()) {
+        d_state_slot.save(d_state_layout, {{d_state.data(), d_state.size()}});
+      }
+
+      return noutput_items;
+    }
+
+  } /* namespace digitizers */
+} /* namespace gr */
@@ -0,0 +1,80 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_IIR_SOS_FILTER_FF_IMPL_H
+#define INCLUDED_DIGITIZERS_IIR_SOS_FILTER_FF_IMPL_H
+
+#include <digitizers/iir_sos_filter_ff.h>
+#include "block_stats_impl.h"
+#include "sos_kernel.h"
+#include "hot_swap.h"
+#include "state_file.h"
+
+#include <atomic>
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * New sections are swapped in at the start of the next work call (see hot_swap_t), neither
+     * side waits for the other. The state is carried over unless the number of sections changes.
+     */
+    class iir_sos_filter_ff_impl : public iir_sos_filter_ff
+    {
+     private:
+      int d_nchannels;
+
+      // Published by set_sections
+      hot_swap_t<std::vector<sos_section_t>> d_section_swap;
+      std::atomic<int> d_nsections;
+
+      // Used by the work function only
+      std::vector<sos_section_t> d_sections;
+      std::vector<float> d_state;
+
+      // Persisted state, restored into the same sections only
+      state_slot_t d_state_slot;
+      uint64_t d_state_layout;
+
+      // interleaved samples, only used with more than one channel
+      std::vector<float> d_in;
+      std::vector<float> d_out;
+
+      block_stats_recorder_t d_stats {this};
+
+     public:
+      iir_sos_filter_ff_impl(int nchannels,
+          const std::vector<sos_section_t> &sections);
+      ~iir_sos_filter_ff_impl();
+
+      int work(int noutput_items,
+        gr_vector_const_void_star &input_items,
+        gr_vector_void_star &output_items);
+
+      void set_taps(const std::vector<double> &fw_taps,
+          const std::vector<double> &fb_taps) override;
+
+      /*!
+       * \brief Sets the sections directly, e.g. designs given as first-order sections. Applied
+       * at the start of the next work call.
+       */
+      void set_sections(const std::vector<sos_section_t> &sections);
+
+      int nsections() override;
+
+      /*!
+       * \brief Persists the filter state in the given record of the file, restored on start
+       * if the design matches. Must be called before the flowgraph is started.
+       */
+      void set_state_file(const state_file_t::sptr &file, const std::string &key);
+
+      bool stop() override;
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_IIR_SOS_FILTER_FF_IMPL_H */
@@ -10,6 +10,9 @@
 
 #include <gnuradio/io_signature.h>
 #include "interlock_generation_ff_impl.h"
+#include "interlock_kernel.h"
+
+#include <algorithm>
 
 namespace gr {
   namespace digitizers {
@@ -52,57 +55,57 @@ namespace gr {
         gr_vector_const_void_star &input_items,
         gr_vector_void_star &output_items)
     {
+      block_stats_scope_t stats(d_stats);
       const float *in = (const float *) input_items[0];
       const float *min = (const float *) input_items[1];
       const float *max = (const float *) input_items[2];
 
       float *out = (float *) output_items[0];
 
-      for (auto i = 0; i < noutput_items; i++) {
-
-        // Get acq_info tags in range
-        std::vector<gr::tag_t> tags;
-        get_tags_in_window(tags, 0, i, i + 1, pmt::string_to_symbol(acq_info_tag_name));
-
-        bool interlock = false;
-
-        if (max[i] < d_max_max) {
-          if (in[i] >= max[i]) {
-            interlock = true;
-          }
+      d_words.resize(interlock_words(noutput_items));
+      evaluate_interlocks(in, min, max, noutput_items, d_max_min, d_max_max, out, &d_words[0]);
+
+      // Only the samples where the interlock state changes from released to issued are
+      // visited, the issued flag always equals the state of the previous sample
+      const uint64_t first_offset = nitems_read(0);
+      bool tags_fetched = false;
+      size_t tag_idx = 0;
+
+      for_each_interlock(&d_words[0], noutput_items, d_interlock_issued, [&](int i) {
+        // tags are fetched once per call and only if an interlock is issued
+        if (!tags_fetched) {
+          // the key is filtered here, GNU Radio filters into a temporary vector
+          d_tags.clear();
+          get_tags_in_range(d_tags, 0, first_offset, first_offset + noutput_items);
+          d_tags.erase(std::remove_if(d_tags.begin(), d_tags.end(), [](const gr::tag_t &tag) {
+            return tag.key != acq_info_tag_key(); }), d_tags.end());
+          tags_fetched = true;
         }
 
-        if (min[i] > d_max_min) {
-          if (in[i] <= min[i]) {
-            interlock = true;
+        // the last acq_info tag attached to the sample, tags are ordered by offset
+        const uint64_t offset = first_offset + i;
+        const gr::tag_t *tag = nullptr;
+        for (; tag_idx < d_tags.size() && d_tags[tag_idx].offset <= offset; tag_idx++) {
+          if (d_tags[tag_idx].offset == offset) {
+            tag = &d_tags[tag_idx];
           }
         }
 
-        out[i] = interlock;
+        // calculate timestamp
+        int64_t timestamp = -1;
 
-        if (d_interlock_issued && !interlock) {
-          d_interlock_issued = false;
-        }
-        else if (!d_interlock_issued && interlock) {
-          // calculate timestamp
-          int64_t timestamp = -1;
-
-          if (!tags.empty())
+        if (tag)
+        {
+          d_acq_info = decode_acq_info_tag(*tag);
+          if (d_acq_info.timestamp != -1)
           {
-            d_acq_info = decode_acq_info_tag(tags.back());
-            if (d_acq_info.timestamp != -1)
-            {
-              timestamp = d_acq_info.timestamp + static_cast<int64_t> (((nitems_read(0) + static_cast<uint64_t>(i)) - tags.back().offset) * d_acq_info.timebase * 1000000000.0 );
-            }
-          }
-
-          if (d_callback) {
-            d_callback(timestamp, d_user_data);
           }
+        }
 
-          d_interlock_issued = true;
+        if (d_callback) {
+          d_callback(timestamp, d_user_data);
         }
-      }
+      });
 
       return noutput_items;
     }
@@ -10,6 +10,9 @@
 #include <digitizers/interlock_generation_ff.h>
 #include <digitizers/tags.h>
 
+#include <vector>
+#include "block_stats_impl.h"
+
 namespace gr {
   namespace digitizers {
 
@@ -27,6 +30,12 @@ namespace gr {
       // timing
       acq_info_t d_acq_info;
 
+      // interlock state bitmask of the current work call and acq_info tags
+      std::vector<uint32_t> d_words;
+      std::vector<gr::tag_t> d_tags;
+
+      block_stats_recorder_t d_stats {this};
+
      public:
       interlock_generation_ff_impl(float max_min, float max_max);
 
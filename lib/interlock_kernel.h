@@ -0,0 +1,307 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_INTERLOCK_KERNEL_H
+#define INCLUDED_DIGITIZERS_INTERLOCK_KERNEL_H
+
+#include "cpu_dispatch.h"
+#include <algorithm>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace gr {
+  namespace digitizers {
+
+    /**********************************************************************
+     * Interlock evaluation kernels, the interlock state of each sample is packed into a
+     * bitmask, bit k of word w corresponds to sample 32 * w + k
+     *********************************************************************/
+
+    static const int INTERLOCK_WORD_BITS = 32;
+
+    namespace interlock_detail {
+
+      // Branch-free evaluation of a single sample, NaNs do not issue an interlock
+      static inline bool
+      is_interlock(float in, float min, float max, float max_min, float max_max)
+      {
+        return ((max < max_max) & (in >= max)) | ((min > max_min) & (in <= min));
+      }
+
+      static inline void
+      evaluate_interlocks_generic(const float *in, const float *min, const float *max, int nitems,
+              float max_min, float max_max, float *out, uint32_t *words)
+      {
+        for (int w = 0; w * INTERLOCK_WORD_BITS < nitems; w++) {
+          const int first = w * INTERLOCK_WORD_BITS;
+          const int n = std::min(INTERLOCK_WORD_BITS, nitems - first);
+
+          uint32_t word = 0;
+          for (int k = 0; k < n; k++) {
+            const bool interlock = is_interlock(in[first + k], min[first + k], max[first + k], max_min, max_max);
+            out[first + k] = interlock;
+            word |= static_cast<uint32_t>(interlock) << k;
+          }
+          words[w] = word;
+        }
+      }
+
+#if defined(__x86_64__) || defined(__i386__)
+      __attribute__((target("avx2")))
+      static inline void
+      evaluate_interlocks_avx2(const float *in, const float *min, const float *max, int nitems,
+              float max_min, float max_max, float *out, uint32_t *words)
+      {
+        const __m256 upper_limit = _mm256_set1_ps(max_max);
+        const __m256 lower_limit = _mm256_set1_ps(max_min);
+        const __m256 one = _mm256_set1_ps(1.0f);
+
+        int w = 0;
+        for (; (w + 1) * INTERLOCK_WORD_BITS <= nitems; w++) {
+          uint32_t word = 0;
+          for (int k = 0; k < INTERLOCK_WORD_BITS; k += 8) {
+            const int i = w * INTERLOCK_WORD_BITS + k;
+            const __m256 x = _mm256_loadu_ps(in + i);
+            const __m256 lo = _mm256_loadu_ps(min + i);
+            const __m256 hi = _mm256_loadu_ps(max + i);
+
+            const __m256 above = _mm256_and_ps(_mm256_cmp_ps(hi, upper_limit, _CMP_LT_OQ),
+                    _mm256_cmp_ps(x, hi, _CMP_GE_OQ));
+            const __m256 below = _mm256_and_ps(_mm256_cmp_ps(lo, lower_limit, _CMP_GT_OQ),
+                    _mm256_cmp_ps(x, lo, _CMP_LE_OQ));
+            const __m256 mask = _mm256_or_ps(above, below);
+
+            _mm256_storeu_ps(out + i, _mm256_and_ps(mask, one));
+            word |= static_cast<uint32_t>(_mm256_movemask_ps(mask)) << k;
+          }
+          words[w] = word;
+        }
+
+        const int first = w * INTERLOCK_WORD_BITS;
+        if (first < nitems) {
+          evaluate_interlocks_generic(in + first, min + first, max + first, nitems - first,
+                  max_min, max_max, out + first, words + w);
+        }
+      }
+
+      __attribute__((target("avx512f")))
+      static inline void
+      evaluate_interlocks_avx512(const float *in, const float *min, const float *max, int nitems,
+              float max_min, float max_max, float *out, uint32_t *words)
+      {
+        const __m512 upper_limit = _mm512_set1_ps(max_max);
+        const __m512 lower_limit = _mm512_set1_ps(max_min);
+        const __m512 one = _mm512_set1_ps(1.0f);
+
+        int w = 0;
+        for (; (w + 1) * INTERLOCK_WORD_BITS <= nitems; w++) {
+          uint32_t word = 0;
+          for (int k = 0; k < INTERLOCK_WORD_BITS; k += 16) {
+            const int i = w * INTERLOCK_WORD_BITS + k;
+            const __m512 x = _mm512_loadu_ps(in + i);
+            const __m512 lo = _mm512_loadu_ps(min + i);
+            const __m512 hi = _mm512_loadu_ps(max + i);
+
+            const __mmask16 above = _mm512_cmp_ps_mask(hi, upper_limit, _CMP_LT_OQ)
+                    & _mm512_cmp_ps_mask(x, hi, _CMP_GE_OQ);
+            const __mmask16 below = _mm512_cmp_ps_mask(lo, lower_limit, _CMP_GT_OQ)
+                    & _mm512_cmp_ps_mask(x, lo, _CMP_LE_OQ);
+            const __mmask16 mask = above | below;
+
+            _mm512_storeu_ps(out + i, _mm512_maskz_mov_ps(mask, one));
+            word |= static_cast<uint32_t>(mask) << k;
+          }
+          words[w] = word;
+        }
+
+        const int first = w * INTERLOCK_WORD_BITS;
+        if (first < nitems) {
+          evaluate_interlocks_generic(in + first, min + first, max + first, nitems - first,
+                  max_min, max_max, out + first, words + w);
+        }
+      }
+#endif
+
+      typedef void (*evaluate_interlocks_kernel_t)(const float *, const float *, const float *, int,
+              float, float, float *, uint32_t *);
+
+      // Best variant available for the given instruction set
+      static inline evaluate_interlocks_kernel_t
+      evaluate_interlocks_kernel(kernel_isa_t isa)
+      {
+#if defined(__x86_64__) || defined(__i386__)
+        if (isa >= KERNEL_ISA_AVX512) {
+          return evaluate_interlocks_avx512;
+        }
+        if (isa >= KERNEL_ISA_AVX2) {
+          return evaluate_interlocks_avx2;
+        }
+#endif
+        return evaluate_interlocks_generic;
+      }
+
+      static inline void
+      evaluate_interlock_limits_generic(const float *values, int nitems, float min, float max, uint32_t *words)
+      {
+        for (int w = 0; w * INTERLOCK_WORD_BITS < nitems; w++) {
+          const int first = w * INTERLOCK_WORD_BITS;
+          const int n = std::min(INTERLOCK_WORD_BITS, nitems - first);
+
+          uint32_t word = 0;
+          for (int k = 0; k < n; k++) {
+            const float v = values[first + k];
+            word |= static_cast<uint32_t>((v >= max) | (v <= min)) << k;
+          }
+          words[w] = word;
+        }
+      }
+
+#if defined(__x86_64__) || defined(__i386__)
+      __attribute__((target("avx2")))
+      static inline void
+      evaluate_interlock_limits_avx2(const float *values, int nitems, float min, float max, uint32_t *words)
+      {
+        const __m256 lower = _mm256_set1_ps(min);
+        const __m256 upper = _mm256_set1_ps(max);
+
+        int w = 0;
+        for (; (w + 1) * INTERLOCK_WORD_BITS <= nitems; w++) {
+          uint32_t word = 0;
+          for (int k = 0; k < INTERLOCK_WORD_BITS; k += 8) {
+            const __m256 v = _mm256_loadu_ps(values + w * INTERLOCK_WORD_BITS + k);
+            const __m256 mask = _mm256_or_ps(_mm256_cmp_ps(v, upper, _CMP_GE_OQ), _mm256_cmp_ps(v, lower, _CMP_LE_OQ));
+            word |= static_cast<uint32_t>(_mm256_movemask_ps(mask)) << k;
+          }
+          words[w] = word;
+        }
+
+        const int first = w * INTERLOCK_WORD_BITS;
+        if (first < nitems) {
+          evaluate_interlock_limits_generic(values + first, nitems - first, min, max, words + w);
+        }
+      }
+
+      __attribute__((target("avx512f")))
+      static inline void
+      evaluate_interlock_limits_avx512(const float *values, int nitems, float min, float max, uint32_t *words)
+      {
+        const __m512 lower = _mm512_set1_ps(min);
+        const __m512 upper = _mm512_set1_ps(max);
+
+        int w = 0;
+        for (; (w + 1) * INTERLOCK_WORD_BITS <= nitems; w++) {
+          uint32_t word = 0;
+          for (int k = 0; k < INTERLOCK_WORD_BITS; k += 16) {
+            const __m512 v = _mm512_loadu_ps(values + w * INTERLOCK_WORD_BITS + k);
+            const __mmask16 mask = _mm512_cmp_ps_mask(v, upper, _CMP_GE_OQ) | _mm512_cmp_ps_mask(v, lower, _CMP_LE_OQ);
+            word |= static_cast<uint32_t>(mask) << k;
+          }
+          words[w] = word;
+        }
+
+        const int first = w * INTERLOCK_WORD_BITS;
+        if (first < nitems) {
+          evaluate_interlock_limits_generic(values + first, nitems - first, min, max, words + w);
+        }
+      }
+#endif
+
+      typedef void (*evaluate_interlock_limits_kernel_t)(const float *, int, float, float, uint32_t *);
+
+      // Best variant available for the given instruction set
+      static inline evaluate_interlock_limits_kernel_t
+      evaluate_interlock_limits_kernel(kernel_isa_t isa)
+      {
+#if defined(__x86_64__) || defined(__i386__)
+        if (isa >= KERNEL_ISA_AVX512) {
+          return evaluate_interlock_limits_avx512;
+        }
+        if (isa >= KERNEL_ISA_AVX2) {
+          return evaluate_interlock_limits_avx2;
+        }
+#endif
+        return evaluate_interlock_limits_generic;
+      }
+
+    } // namespace interlock_detail
+
+    /*!
+     * \brief Number of bitmask words needed for nitems samples.
+     */
+    static inline int
+    interlock_words(int nitems)
+    {
+      return (nitems + INTERLOCK_WORD_BITS - 1) / INTERLOCK_WORD_BITS;
+    }
+
+    /*!
+     * \brief Evaluates interlocks against the min and max reference signals, see
+     * interlock_generation_ff. Writes the interlock state (0 or 1) of each sample to out and
+     * packs the same states into words, interlock_words(nitems) words are written.
+     */
+    static inline void
+    evaluate_interlocks(const float *in, const float *min, const float *max, int nitems,
+            float max_min, float max_max, float *out, uint32_t *words)
+    {
+      // kernel is selected once, on first use
+      static const interlock_detail::evaluate_interlocks_kernel_t kernel =
+              interlock_detail::evaluate_interlocks_kernel(get_kernel_isa());
+
+      kernel(in, min, max, nitems, max_min, max_max, out, words);
+    }
+
+    /*!
+     * \brief Evaluates constant interlock limits, i.e. an interlock is issued for samples
+     * greater or equal to max or less or equal to min. Infinite limits disable the respective
+     * check, NaNs do not issue an interlock. interlock_words(nitems) words are written.
+     */
+    static inline void
+    evaluate_interlock_limits(const float *values, int nitems, float min, float max, uint32_t *words)
+    {
+      // kernel is selected once, on first use
+      static const interlock_detail::evaluate_interlock_limits_kernel_t kernel =
+              interlock_detail::evaluate_interlock_limits_kernel(get_kernel_isa());
+
+      kernel(values, nitems, min, max, words);
+    }
+
+    /*!
+     * \brief Calls f(i) for each sample i where the interlock state changes from released to
+     * issued, only the set bits of the bitmask are visited.
+     *
+     * \param words interlock bitmask, interlock_words(nitems) words
+     * \param issued state of the sample preceding the first one, updated to the state of the
+     * last sample
+     */
+    template <typename F>
+    static inline void
+    for_each_interlock(const uint32_t *words, int nitems, bool &issued, F f)
+    {
+      const int nwords = interlock_words(nitems);
+
+      for (int w = 0; w < nwords; w++) {
+        const uint32_t word = words[w];
+        uint32_t rising = word & ~((word << 1) | static_cast<uint32_t>(issued));
+
+        // last valid sample of the word
+        const int last = std::min(INTERLOCK_WORD_BITS, nitems - w * INTERLOCK_WORD_BITS) - 1;
+        issued = (word >> last) & 1;
+
+        while (rising) {
+          const int i = w * INTERLOCK_WORD_BITS + __builtin_ctz(rising);
+          rising &= rising - 1;
+          f(i);
+        }
+      }
+    }
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_INTERLOCK_KERNEL_H */
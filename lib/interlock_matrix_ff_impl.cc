@@ -0,0 +1,166 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gnuradio/io_signature.h>
+#include "interlock_matrix_ff_impl.h"
+#include "interlock_kernel.h"
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+namespace gr {
+  namespace digitizers {
+
+    interlock_matrix_ff::sptr
+    interlock_matrix_ff::make(int nchannels, float max_min, float max_max)
+    {
+      return gnuradio::get_initial_sptr
+        (new interlock_matrix_ff_impl(nchannels, max_min, max_max));
+    }
+
+    interlock_matrix_ff_impl::interlock_matrix_ff_impl(int nchannels, float max_min, float max_max)
+      : gr::sync_block("interlock_matrix_ff",
+              gr::io_signature::make(3 * std::max(nchannels, 1), 3 * std::max(nchannels, 1), sizeof(float)),
+              gr::io_signature::make(1, 1, sizeof(float))),
+        d_nchannels(nchannels),
+        d_max_max(max_max),
+        d_max_min(max_min),
+        d_issued(0),
+        d_callback(nullptr),
+        d_user_data(nullptr),
+        d_acq_info(),
+        d_acq_info_offset(0)
+    {
+      if (nchannels < 1 || nchannels > MAX_CHANNELS) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid number of channels: " << nchannels;
+        throw std::invalid_argument(message.str());
+      }
+
+      d_acq_info.timestamp = -1;
+    }
+
+    interlock_matrix_ff_impl::~interlock_matrix_ff_impl()
+    {
+    }
+
+    bool
+    interlock_matrix_ff_impl::start()
+    {
+      d_acq_info = acq_info_t {};
+      d_acq_info.timestamp = -1;
+      d_acq_info_offset = 0;
+      return true;
+    }
+
+    int64_t
+    interlock_matrix_ff_impl::get_timestamp(uint64_t offset) const
+    {
+      if (d_acq_info.timestamp == -1) {
+        return -1;
+      }
+
+      const auto distance = static_cast<double>(offset - d_acq_info_offset);
+      return d_acq_info.timestamp + static_cast<int64_t>(distance * d_acq_info.timebase * 1000000000.0);
+    }
+
+    int
+    interlock_matrix_ff_impl::work(int noutput_items,
+        gr_vector_const_void_star &input_items,
+        gr_vector_void_star &output_items)
+    {
+      block_stats_scope_t stats(d_stats);
+
+      float *out = (float *) output_items[0];
+
+      const int nwords = interlock_words(noutput_items);
+      d_words.resize(d_nchannels * nwords);
+      d_states.resize(noutput_items);
+      d_any.assign(nwords, 0);
+      d_rising.assign(nwords, 0);
+
+      for (int c = 0; c < d_nchannels; c++) {
+        const float *in = (const float *) input_items[3 * c];
+        const float *min = (const float *) input_items[3 * c + 1];
+        const float *max = (const float *) input_items[3 * c + 2];
+        uint32_t *words = &d_words[c * nwords];
+
+        evaluate_interlocks(in, min, max, noutput_items, d_max_min, d_max_max, &d_states[0], words);
+
+        // union of the channels, a channel enters the interlock if the preceding sample (of
+        // the previous word or work call) was released
+        uint32_t previous = (d_issued >> c) & 1;
+        for (int w = 0; w < nwords; w++) {
+          const uint32_t word = words[w];
+          d_any[w] |= word;
+          d_rising[w] |= word & ~((word << 1) | previous);
+
+          const int last = std::min(INTERLOCK_WORD_BITS, noutput_items - w * INTERLOCK_WORD_BITS) - 1;
+          previous = (word >> last) & 1;
+        }
+
+        d_issued = (d_issued & ~(uint64_t {1} << c)) | (static_cast<uint64_t>(previous) << c);
+      }
+
+      for (int i = 0; i < noutput_items; i++) {
+        out[i] = (d_any[i / INTERLOCK_WORD_BITS] >> (i % INTERLOCK_WORD_BITS)) & 1;
+      }
+
+      // acq_info tags of the first signal, for the timestamps
+      const uint64_t first_offset = nitems_read(0);
+      d_tags.clear();
+      get_tags_in_range(d_tags, 0, first_offset, first_offset + noutput_items, acq_info_tag_key());
+      size_t tag_idx = 0;
+
+      // Only the samples where at least one channel enters the interlock are visited
+      for (int w = 0; w < nwords; w++) {
+        uint32_t rising = d_rising[w];
+
+        while (rising) {
+          const int k = __builtin_ctz(rising);
+          rising &= rising - 1;
+
+          const uint64_t offset = first_offset + w * INTERLOCK_WORD_BITS + k;
+          for (; tag_idx < d_tags.size() && d_tags[tag_idx].offset <= offset; tag_idx++) {
+            d_acq_info = decode_acq_info_tag(d_tags[tag_idx]);
+            d_acq_info_offset = d_tags[tag_idx].offset;
+          }
+
+          uint64_t channel_mask = 0;
+          for (int c = 0; c < d_nchannels; c++) {
+            channel_mask |= static_cast<uint64_t>((d_words[c * nwords + w] >> k) & 1) << c;
+          }
+
+          if (d_callback) {
+            d_callback(get_timestamp(offset), channel_mask, d_user_data);
+          }
+        }
+      }
+
+      // the remaining tags, for the following calls
+      if (!d_tags.empty()) {
+        d_acq_info = decode_acq_info_tag(d_tags.back());
+        d_acq_info_offset = d_tags.back().offset;
+      }
+
+      return noutput_items;
+    }
+
+    void
+    interlock_matrix_ff_impl::set_callback(interlock_matrix_cb_t callback, void *ptr)
+    {
+      d_callback = callback;
+      d_user_data = ptr;
+      d_issued = 0;
+    }
+
+  } /* namespace digitizers */
+} /* namespace gr */
@@ -0,0 +1,64 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_INTERLOCK_MATRIX_FF_IMPL_H
+#define INCLUDED_DIGITIZERS_INTERLOCK_MATRIX_FF_IMPL_H
+
+#include <digitizers/interlock_matrix_ff.h>
+#include <digitizers/tags.h>
+
+#include <vector>
+#include "block_stats_impl.h"
+
+namespace gr {
+  namespace digitizers {
+
+    class interlock_matrix_ff_impl : public interlock_matrix_ff
+    {
+     private:
+      const int d_nchannels;
+      float d_max_max; // max value to be used for upper bounds evaluation
+      float d_max_min;
+
+      //callback stuff
+      uint64_t d_issued;   // channels in interlock at the last sample
+      interlock_matrix_cb_t d_callback;
+      void *d_user_data;
+
+      // timing, the last acq_info tag of the first signal
+      acq_info_t d_acq_info;
+      uint64_t d_acq_info_offset;
+
+      // Interlock bitmasks of the current work call, channel c at c * nwords, and the union of
+      // all the channels (state and rising edges)
+      std::vector<uint32_t> d_words;
+      std::vector<uint32_t> d_any;
+      std::vector<uint32_t> d_rising;
+      std::vector<float> d_states;
+      std::vector<gr::tag_t> d_tags;
+
+      block_stats_recorder_t d_stats {this};
+
+      int64_t get_timestamp(uint64_t offset) const;
+
+     public:
+      interlock_matrix_ff_impl(int nchannels, float max_min, float max_max);
+
+      ~interlock_matrix_ff_impl();
+
+      bool start() override;
+
+      int work(int noutput_items,
+         gr_vector_const_void_star &input_items,
+         gr_vector_void_star &output_items) override;
+
+      void set_callback(interlock_matrix_cb_t callback, void *ptr) override;
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_INTERLOCK_MATRIX_FF_IMPL_H */
@@ -0,0 +1,122 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_LANE_FIR_KERNEL_H
+#define INCLUDED_DIGITIZERS_LANE_FIR_KERNEL_H
+
+#include "cpu_dispatch.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace gr {
+  namespace digitizers {
+
+    /**********************************************************************
+     * FIR dot product over interleaved channels, i.e. the same taps applied to several
+     * channels in SIMD lanes. Sample k of lane l is at [k * stride + l]:
+     *
+     *   out[l] = sum_k taps[k] * in[k * stride + l]
+     *
+     * Unlike a dot product along the samples every tap is a broadcast and every lane an
+     * independent accumulator, there is no horizontal reduction.
+     *********************************************************************/
+
+    namespace lane_fir_detail {
+
+      static inline void
+      lane_dot_prod_generic(const float *taps, int ntaps, const float *in, float *out,
+              int stride, int nlanes)
+      {
+        for (int l = 0; l < nlanes; l++) {
+          float acc = 0.0f;
+          for (int k = 0; k < ntaps; k++) {
+            acc += taps[k] * in[k * stride + l];
+          }
+          out[l] = acc;
+        }
+      }
+
+#if defined(__x86_64__) || defined(__i386__)
+      __attribute__((target("avx2")))
+      static inline void
+      lane_dot_prod_avx2(const float *taps, int ntaps, const float *in, float *out,
+              int stride, int nlanes)
+      {
+        int l = 0;
+        for (; l + 8 <= nlanes; l += 8) {
+          __m256 acc = _mm256_setzero_ps();
+          for (int k = 0; k < ntaps; k++) {
+            acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_set1_ps(taps[k]), _mm256_loadu_ps(in + k * stride + l)));
+          }
+          _mm256_storeu_ps(out + l, acc);
+        }
+
+        // remainder
+        if (l < nlanes) {
+          lane_dot_prod_generic(taps, ntaps, in + l, out + l, stride, nlanes - l);
+        }
+      }
+
+      __attribute__((target("avx512f")))
+      static inline void
+      lane_dot_prod_avx512(const float *taps, int ntaps, const float *in, float *out,
+              int stride, int nlanes)
+      {
+        int l = 0;
+        for (; l + 16 <= nlanes; l += 16) {
+          __m512 acc = _mm512_setzero_ps();
+          for (int k = 0; k < ntaps; k++) {
+            acc = _mm512_add_ps(acc, _mm512_mul_ps(_mm512_set1_ps(taps[k]), _mm512_loadu_ps(in + k * stride + l)));
+          }
+          _mm512_storeu_ps(out + l, acc);
+        }
+
+        // remainder, e.g. 8 channels
+        if (l < nlanes) {
+          lane_dot_prod_avx2(taps, ntaps, in + l, out + l, stride, nlanes - l);
+        }
+      }
+#endif
+
+      typedef void (*lane_dot_prod_kernel_t)(const float *taps, int ntaps, const float *in,
+              float *out, int stride, int nlanes);
+
+      // Best variant available for the given instruction set
+      static inline lane_dot_prod_kernel_t
+      lane_dot_prod_kernel(kernel_isa_t isa)
+      {
+#if defined(__x86_64__) || defined(__i386__)
+        if (isa >= KERNEL_ISA_AVX512) {
+          return lane_dot_prod_avx512;
+        }
+        if (isa >= KERNEL_ISA_AVX2) {
+          return lane_dot_prod_avx2;
+        }
+#endif
+        return lane_dot_prod_generic;
+      }
+
+    } // namespace lane_fir_detail
+
+    /*!
+     * \brief Dot product of the taps with each of nlanes interleaved channels.
+     */
+    static inline void
+    lane_dot_prod(const float *taps, int ntaps, const float *in, float *out, int nlanes)
+    {
+      // kernel is selected once, on first use
+      static const lane_fir_detail::lane_dot_prod_kernel_t kernel =
+              lane_fir_detail::lane_dot_prod_kernel(get_kernel_isa());
+
+      kernel(taps, ntaps, in, out, nlanes, nlanes);
+    }
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_LANE_FIR_KERNEL_H */
@@ -0,0 +1,594 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_LM_FITTER_H
+#define INCLUDED_DIGITIZERS_LM_FITTER_H
+
+#include "cpu_dispatch.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <string>
+#include <vector>
+
+namespace gr {
+  namespace digitizers {
+
+    /**********************************************************************
+     * Compiled fit models
+     *********************************************************************/
+
+    enum fit_model_id_t
+    {
+      FIT_MODEL_GAUSSIAN = 0,           // [0]*exp(-0.5*((x-[1])/[2])^2), same as ROOT's gaus
+      FIT_MODEL_LORENTZIAN,             // [0]*[2]^2/((x-[1])^2+[2]^2)
+      FIT_MODEL_STEP_RESPONSE,          // [1]*(0.5+0.5*erf((x-[0])/[2])), see SAT B6 examples
+      FIT_MODEL_EXP_STEP_RESPONSE,      // [1]*(1-exp(-(x-[0])/[2])) for x >= [0], 0 otherwise
+      FIT_MODEL_LINEAR,                 // [0]*x + [1], see SAT B6 examples
+      FIT_MODEL_POLYNOMIAL              // [0] + [1]*x + ... + [N]*x^N, same as ROOT's polN
+    };
+
+    struct fit_model_t
+    {
+      fit_model_id_t id;
+      int nparams;
+    };
+
+    /*!
+     * \brief Looks up the compiled model for the formula. Returns false if the formula is not
+     * one of the compiled models or if the number of parameters does not match, i.e. if the
+     * formula needs to be interpreted by ROOT.
+     *
+     * Recognized are the keywords gaus, lorentzian, step_response, exp_step_response and polN,
+     * and the formulas of the SAT B6 examples (whitespace is ignored).
+     */
+    static inline bool
+    find_fit_model(const std::string &formula, int nparams, fit_model_t &model)
+    {
+      std::string f;
+      for (auto c : formula) {
+        if (!std::isspace(static_cast<unsigned char>(c))) {
+          f.push_back(c);
+        }
+      }
+
+      if (f == "gaus") {
+        model = {FIT_MODEL_GAUSSIAN, 3};
+      }
+      else if (f == "lorentzian") {
+        model = {FIT_MODEL_LORENTZIAN, 3};
+      }
+      else if (f == "step_response" || f == "[1]*(0.5+0.5*TMath::Erf((x-[0])/[2]))") {
+        model = {FIT_MODEL_STEP_RESPONSE, 3};
+      }
+      else if (f == "exp_step_response") {
+        model = {FIT_MODEL_EXP_STEP_RESPONSE, 3};
+      }
+      else if (f == "[0]*x+1.0*[1]" || f == "x*[0]+1.0*[1]" || f == "[0]*x+[1]" || f == "x*[0]+[1]") {
+        model = {FIT_MODEL_LINEAR, 2};
+      }
+      else if (f.size() > 3 && f.compare(0, 3, "pol") == 0
+              && std::all_of(f.begin() + 3, f.end(), [](char c) { return std::isdigit(static_cast<unsigned char>(c)); })
+              && f.size() < 6) {
+        model = {FIT_MODEL_POLYNOMIAL, std::stoi(f.substr(3)) + 1};
+      }
+      else {
+        return false;
+      }
+
+      return model.nparams == nparams;
+    }
+
+    /*!
+     * \brief Region of the x axis where the model differs from its background, for the models
+     * whose parameters away from it are not determined by the data (only the Gaussian, the
+     * Lorentzian tails are too heavy). Returns false if there is none, i.e. the whole range
+     * matters.
+     *
+     * \param widths half width of the region, in standard deviations
+     */
+    static inline bool
+    fit_model_roi(const fit_model_t &model, const std::vector<double> &params, double widths,
+            double &lower, double &upper)
+    {
+      if (model.id != FIT_MODEL_GAUSSIAN || !std::isfinite(params[1]) || !std::isfinite(params[2])) {
+        return false;
+      }
+
+      lower = params[1] - widths * std::abs(params[2]);
+      upper = params[1] + widths * std::abs(params[2]);
+      return true;
+    }
+
+    namespace lm_detail {
+
+      static const int LANES = 4;
+
+      /*!
+       * Evaluates the model and, if jac is not null, its Jacobian jac[k * n + i] = df(x[i])/dp[k].
+       * The loops are branch free so that they are vectorized (except for the calls into libm).
+       */
+      __attribute__((always_inline))
+      static inline void
+      evaluate_model(const fit_model_t &model, const double *x, int n, const double *p,
+              double *y, double *jac)
+      {
+        switch (model.id) {
+          case FIT_MODEL_GAUSSIAN: {
+            const double a = p[0], mu = p[1], s = p[2];
+            for (int i = 0; i < n; i++) {
+              const double u = (x[i] - mu) / s;
+              const double e = std::exp(-0.5 * u * u);
+              y[i] = a * e;
+              if (jac) {
+                jac[i] = e;
+                jac[n + i] = a * e * u / s;
+                jac[2 * n + i] = a * e * u * u / s;
+              }
+            }
+            break;
+          }
+          case FIT_MODEL_LORENTZIAN: {
+            const double a = p[0], x0 = p[1], g = p[2];
+            for (int i = 0; i < n; i++) {
+              const double dx = x[i] - x0;
+              const double d = 1.0 / (dx * dx + g * g);
+              const double l = g * g * d;
+              y[i] = a * l;
+              if (jac) {
+                jac[i] = l;
+                jac[n + i] = 2.0 * a * l * dx * d;
+                jac[2 * n + i] = 2.0 * a * g * dx * dx * d * d;
+              }
+            }
+            break;
+          }
+          case FIT_MODEL_STEP_RESPONSE: {
+            const double t0 = p[0], a = p[1], w = p[2];
+            const double two_over_sqrt_pi = 1.1283791670955126;
+            for (int i = 0; i < n; i++) {
+              const double u = (x[i] - t0) / w;
+              const double s = 0.5 + 0.5 * std::erf(u);
+              y[i] = a * s;
+              if (jac) {
+                const double ds = 0.5 * two_over_sqrt_pi * std::exp(-u * u);
+                jac[i] = -a * ds / w;
+                jac[n + i] = s;
+                jac[2 * n + i] = -a * ds * u / w;
+              }
+            }
+            break;
+          }
+          case FIT_MODEL_EXP_STEP_RESPONSE: {
+            const double t0 = p[0], a = p[1], tau = p[2];
+            for (int i = 0; i < n; i++) {
+              const double m = x[i] >= t0 ? 1.0 : 0.0;
+              const double dt = std::max(x[i] - t0, 0.0);
+              const double e = std::exp(-dt / tau);
+              y[i] = a * (1.0 - e);
+              if (jac) {
+                jac[i] = -m * a * e / tau;
+                jac[n + i] = 1.0 - e;
+                jac[2 * n + i] = -a * e * dt / (tau * tau);
+              }
+            }
+            break;
+          }
+          case FIT_MODEL_LINEAR: {
+            for (int i = 0; i < n; i++) {
+              y[i] = p[0] * x[i] + p[1];
+              if (jac) {
+                jac[i] = x[i];
+                jac[n + i] = 1.0;
+              }
+            }
+            break;
+          }
+          case FIT_MODEL_POLYNOMIAL: {
+            const int np = model.nparams;
+            for (int i = 0; i < n; i++) {
+              double v = p[np - 1];
+              for (int k = np - 2; k >= 0; k--) {
+                v = v * x[i] + p[k];
+              }
+              y[i] = v;
+            }
+            if (jac) {
+              for (int i = 0; i < n; i++) {
+                jac[i] = 1.0;
+              }
+              for (int k = 1; k < np; k++) {
+                for (int i = 0; i < n; i++) {
+                  jac[k * n + i] = jac[(k - 1) * n + i] * x[i];
+                }
+              }
+            }
+            break;
+          }
+        }
+      }
+
+      // Partial sums in independent lanes, i.e. vectorized without -ffast-math
+      __attribute__((always_inline))
+      static inline double
+      dot(const double *a, const double *b, int n)
+      {
+        double acc[LANES] = {0.0, 0.0, 0.0, 0.0};
+        int i = 0;
+        for (; i + LANES <= n; i += LANES) {
+          for (int l = 0; l < LANES; l++) {
+            acc[l] += a[i + l] * b[i + l];
+          }
+        }
+        for (; i < n; i++) {
+          acc[0] += a[i] * b[i];
+        }
+        return (acc[0] + acc[1]) + (acc[2] + acc[3]);
+      }
+
+      /*!
+       * Evaluates the model at p and returns the chi square. If normal is not null, the
+       * normal equations of the free parameters are set up as well, i.e. normal = J^T J
+       * (nfree x nfree) and gradient = J^T r.
+       */
+      __attribute__((always_inline))
+      static inline double
+      linearize(const fit_model_t &model, const double *x, const double *data, int n,
+              const double *p, const int *free_params, int nfree, double *y, double *jac,
+              double *normal, double *gradient)
+      {
+        evaluate_model(model, x, n, p, y, normal ? jac : nullptr);
+
+        for (int i = 0; i < n; i++) {
+          y[i] = data[i] - y[i];
+        }
+        const double chi_square = dot(y, y, n);
+
+        if (normal) {
+          for (int j = 0; j < nfree; j++) {
+            const double *jj = jac + free_params[j] * n;
+            gradient[j] = dot(jj, y, n);
+            for (int k = 0; k <= j; k++) {
+              normal[j * nfree + k] = normal[k * nfree + j] = dot(jj, jac + free_params[k] * n, n);
+            }
+          }
+        }
+
+        return chi_square;
+      }
+
+      static inline double
+      linearize_generic(const fit_model_t &model, const double *x, const double *data, int n,
+              const double *p, const int *free_params, int nfree, double *y, double *jac,
+              double *normal, double *gradient)
+      {
+        return linearize(model, x, data, n, p, free_params, nfree, y, jac, normal, gradient);
+      }
+
+#if defined(__x86_64__) || defined(__i386__)
+      __attribute__((target("avx2")))
+      static inline double
+      linearize_avx2(const fit_model_t &model, const double *x, const double *data, int n,
+              const double *p, const int *free_params, int nfree, double *y, double *jac,
+              double *normal, double *gradient)
+      {
+        return linearize(model, x, data, n, p, free_params, nfree, y, jac, normal, gradient);
+      }
+#endif
+
+      typedef double (*linearize_kernel_t)(const fit_model_t &, const double *, const double *, int,
+              const double *, const int *, int, double *, double *, double *, double *);
+
+      static inline linearize_kernel_t
+      select_kernel(kernel_isa_t isa)
+      {
+#if defined(__x86_64__) || defined(__i386__)
+        if (isa >= KERNEL_ISA_AVX2) {
+          return linearize_avx2;
+        }
+#endif
+        return linearize_generic;
+      }
+
+      /*!
+       * In-place Cholesky decomposition of the symmetric n x n matrix a, the lower triangle is
+       * replaced by L. Returns false if the matrix is not positive definite.
+       */
+      static inline bool
+      cholesky(double *a, int n)
+      {
+        for (int j = 0; j < n; j++) {
+          double d = a[j * n + j];
+          for (int k = 0; k < j; k++) {
+            d -= a[j * n + k] * a[j * n + k];
+          }
+          if (!(d > 0.0)) {
+            return false;
+          }
+          d = std::sqrt(d);
+          a[j * n + j] = d;
+          for (int i = j + 1; i < n; i++) {
+            double s = a[i * n + j];
+            for (int k = 0; k < j; k++) {
+              s -= a[i * n + k] * a[j * n + k];
+            }
+            a[i * n + j] = s / d;
+          }
+        }
+        return true;
+      }
+
+      // Solves L L^T x = b in place
+      static inline void
+      cholesky_solve(const double *l, int n, double *b)
+      {
+        for (int i = 0; i < n; i++) {
+          for (int k = 0; k < i; k++) {
+            b[i] -= l[i * n + k] * b[k];
+          }
+          b[i] /= l[i * n + i];
+        }
+        for (int i = n - 1; i >= 0; i--) {
+          for (int k = i + 1; k < n; k++) {
+            b[i] -= l[k * n + i] * b[k];
+          }
+          b[i] /= l[i * n + i];
+        }
+      }
+
+    } // namespace lm_detail
+
+    /**********************************************************************
+     * Levenberg-Marquardt solver
+     *********************************************************************/
+
+    struct lm_result_t
+    {
+      int status;         // 0 if converged, see TGraph::Fit
+      double chi_square;
+      int ndf;
+    };
+
+    /*!
+     * \brief Levenberg-Marquardt least squares fit of a compiled model, all samples having the
+     * same (unit) weight, i.e. the same as fitting a TGraphErrors without errors.
+     *
+     * Parameters are kept within their limits by projecting each step onto the limits. The
+     * parameter errors are derived from the covariance matrix (J^T J)^-1 scaled by chi2/NDF,
+     * the same as ROOT does for data without errors.
+     *
+     * The object keeps the work buffers and is meant to be reused, one instance per thread.
+     */
+    class lm_fitter_t
+    {
+    public:
+
+      static const int MAX_ITERATIONS = 200;
+
+      lm_fitter_t(const fit_model_t &model, const std::vector<float> &xvals)
+        : d_model(model),
+          d_x(xvals.begin(), xvals.end()),
+          d_data(xvals.size()),
+          d_y(xvals.size()),
+          d_jac(xvals.size() * model.nparams),
+          d_errors(model.nparams, 0.0),
+          d_first(0),
+          d_count(static_cast<int>(xvals.size()))
+      {
+      }
+
+      /*!
+       * \brief Restricts the fit to count samples starting at first, all of them by default.
+       */
+      void set_range(int first, int count)
+      {
+        d_first = first;
+        d_count = count;
+      }
+
+      void reset_range()
+      {
+        set_range(0, static_cast<int>(d_x.size()));
+      }
+
+      void set_data(const float *data)
+      {
+        std::copy(data, data + d_data.size(), d_data.begin());
+      }
+
+      /*!
+       * \brief Parameter errors of the last fit.
+       */
+      const std::vector<double> &errors() const
+      {
+        return d_errors;
+      }
+
+      /*!
+       * \brief Fits the data.
+       *
+       * \param params start values on input, solution on output
+       * \param fixed parameters not to be fitted
+       * \param lower lower parameter limits, ignored for fixed parameters
+       * \param upper upper parameter limits, ignored for fixed parameters
+       * \param max_iterations status is 1 if not converged within
+       */
+      lm_result_t fit(std::vector<double> &params, const std::vector<bool> &fixed,
+              const std::vector<double> &lower, const std::vector<double> &upper,
+              int max_iterations = MAX_ITERATIONS)
+      {
+        const int n = d_count;
+        const double *x = &d_x[d_first];
+        const double *data = &d_data[d_first];
+        const int nfree = select_free(params, fixed, lower, upper);
+
+        lm_result_t result;
+        result.ndf = n - nfree;
+        result.status = 1;
+        result.chi_square = linearize(d_model, x, data, n, &params[0], d_free.data(),
+                nfree, &d_y[0], &d_jac[0], d_normal.data(), d_gradient.data());
+
+        double lambda = 1e-3;
+        for (int iter = 0; iter < max_iterations && nfree > 0; iter++) {
+          // damped normal equations
+          d_system = d_normal;
+          for (int j = 0; j < nfree; j++) {
+            d_system[j * nfree + j] *= 1.0 + lambda;
+            if (d_system[j * nfree + j] == 0.0) {
+              d_system[j * nfree + j] = lambda;
+            }
+          }
+
+          if (!lm_detail::cholesky(d_system.data(), nfree)) {
+            lambda *= 10.0;
+            if (lambda > 1e16) {
+              break;
+            }
+            continue;
+          }
+
+          d_step = d_gradient;
+          lm_detail::cholesky_solve(d_system.data(), nfree, d_step.data());
+
+          d_trial = params;
+          bool moved = false;
+          for (int j = 0; j < nfree; j++) {
+            const int k = d_free[j];
+            d_trial[k] = std::min(std::max(params[k] + d_step[j], lower[k]), upper[k]);
+            moved |= std::abs(d_trial[k] - params[k]) > 1e-12 * (std::abs(params[k]) + 1e-12);
+          }
+
+          const double chi_square = linearize(d_model, x, data, n, &d_trial[0],
+                  d_free.data(), nfree, &d_y[0], &d_jac[0], nullptr, nullptr);
+
+          if (std::isfinite(chi_square) && chi_square <= result.chi_square) {
+            const double decrease = result.chi_square - chi_square;
+            params = d_trial;
+            result.chi_square = linearize(d_model, x, data, n, &params[0], d_free.data(),
+                    nfree, &d_y[0], &d_jac[0], d_normal.data(), d_gradient.data());
+            lambda = std::max(lambda * 0.1, 1e-12);
+
+            if (!moved || decrease <= 1e-12 * result.chi_square + 1e-300) {
+              result.status = 0;
+              break;
+            }
+          }
+          else {
+            lambda *= 10.0;
+            if (lambda > 1e16) {
+              // no further decrease possible, i.e. at the minimum within rounding
+              result.status = 0;
+              break;
+            }
+          }
+        }
+
+        if (nfree == 0) {
+          result.status = 0;
+        }
+
+        compute_errors(result, nfree);
+        return result;
+      }
+
+      /*!
+       * \brief Chi square and parameter errors at params without fitting, status is 0.
+       */
+      lm_result_t evaluate(std::vector<double> &params, const std::vector<bool> &fixed,
+              const std::vector<double> &lower, const std::vector<double> &upper)
+      {
+        const int nfree = select_free(params, fixed, lower, upper);
+
+        lm_result_t result;
+        result.status = 0;
+        result.ndf = d_count - nfree;
+        result.chi_square = linearize(d_model, &d_x[d_first], &d_data[d_first], d_count, &params[0],
+                d_free.data(), nfree, &d_y[0], &d_jac[0], d_normal.data(), d_gradient.data());
+
+        compute_errors(result, nfree);
+        return result;
+      }
+
+    private:
+
+      static lm_detail::linearize_kernel_t linearize_kernel()
+      {
+        static const lm_detail::linearize_kernel_t kernel = lm_detail::select_kernel(get_kernel_isa());
+        return kernel;
+      }
+
+      double linearize(const fit_model_t &model, const double *x, const double *data, int n,
+              const double *p, const int *free_params, int nfree, double *y, double *jac,
+              double *normal, double *gradient)
+      {
+        return linearize_kernel()(model, x, data, n, p, free_params, nfree, y, jac, normal, gradient);
+      }
+
+      // Clamps the free parameters to their limits, sizes the work buffers
+      int select_free(std::vector<double> &params, const std::vector<bool> &fixed,
+              const std::vector<double> &lower, const std::vector<double> &upper)
+      {
+        const int np = d_model.nparams;
+
+        d_free.clear();
+        for (int k = 0; k < np; k++) {
+          if (!fixed[k]) {
+            params[k] = std::min(std::max(params[k], lower[k]), upper[k]);
+            d_free.push_back(k);
+          }
+        }
+        const int nfree = static_cast<int>(d_free.size());
+
+        d_normal.resize(nfree * nfree);
+        d_gradient.resize(nfree);
+        d_system.resize(nfree * nfree);
+        d_step.resize(nfree);
+        d_trial.resize(np);
+        return nfree;
+      }
+
+      void compute_errors(const lm_result_t &result, int nfree)
+      {
+        std::fill(d_errors.begin(), d_errors.end(), 0.0);
+
+        d_system = d_normal;
+        if (result.ndf <= 0 || !lm_detail::cholesky(d_system.data(), nfree)) {
+          return;
+        }
+
+        const double scale = result.chi_square / result.ndf;
+        for (int j = 0; j < nfree; j++) {
+          // diagonal element of the inverse, column j of (J^T J)^-1
+          std::fill(d_step.begin(), d_step.end(), 0.0);
+          d_step[j] = 1.0;
+          lm_detail::cholesky_solve(d_system.data(), nfree, d_step.data());
+          d_errors[d_free[j]] = std::sqrt(std::max(d_step[j], 0.0) * scale);
+        }
+      }
+
+      const fit_model_t d_model;
+      const std::vector<double> d_x;
+      std::vector<double> d_data;
+
+      // work buffers
+      std::vector<double> d_y;        // residuals
+      std::vector<double> d_jac;      // column per parameter
+      std::vector<int> d_free;
+      std::vector<double> d_normal;
+      std::vector<double> d_gradient;
+      std::vector<double> d_system;
+      std::vector<double> d_step;
+      std::vector<double> d_trial;
+      std::vector<double> d_errors;
+
+      int d_first;
+      int d_count;
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_LM_FITTER_H */
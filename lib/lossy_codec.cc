@@ -0,0 +1,198 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <digitizers/lossy_codec.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+namespace gr {
+  namespace digitizers {
+
+    static const size_t LOSSY_CODEC_PLANE_SIZE = LOSSY_CODEC_BLOCK_SIZE / 8;
+    static const size_t LOSSY_CODEC_BLOCK_HEADER = sizeof(float) + sizeof(int64_t) + 1;
+    static const size_t LOSSY_CODEC_VERBATIM_SIZE = LOSSY_CODEC_BLOCK_SIZE * sizeof(float);
+
+    // Quantized samples are kept well within the exact range of doubles
+    static const double LOSSY_CODEC_MAX_QUANTIZED = 4503599627370496.0;    // 2^52
+
+    size_t
+    lossy_encode_bound(size_t nsamples)
+    {
+      const size_t nblocks = (nsamples + LOSSY_CODEC_BLOCK_SIZE - 1) / LOSSY_CODEC_BLOCK_SIZE;
+      return nblocks * (sizeof(float) + LOSSY_CODEC_VERBATIM_SIZE);
+    }
+
+    // Quantizes the block, returns the step or zero if it is to be stored verbatim
+    static float
+    quantize_block(const float *samples, const float *bounds, size_t n, float quantization,
+            int64_t *quantized)
+    {
+      const float step = quantization * *std::min_element(bounds, bounds + n);
+      if (!(step > 0.0f) || !std::isfinite(step)) {
+        return 0.0f;
+      }
+
+      for (size_t i = 0; i < n; i++) {
+        const double q = std::nearbyint(static_cast<double>(samples[i]) / step);
+        if (!(std::fabs(q) < LOSSY_CODEC_MAX_QUANTIZED)) {
+          return 0.0f;
+        }
+        quantized[i] = static_cast<int64_t>(q);
+      }
+
+      return step;
+    }
+
+    size_t
+    lossy_encode(const float *samples, const float *bounds, size_t nsamples, float quantization,
+            uint8_t *data)
+    {
+      if (!(quantization > 0.0f)) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid quantization: "
+                << quantization;
+        throw std::invalid_argument(message.str());
+      }
+
+      int64_t quantized[LOSSY_CODEC_BLOCK_SIZE];
+      uint64_t mapped[LOSSY_CODEC_BLOCK_SIZE];
+      uint8_t *out = data;
+
+      for (size_t start = 0; start < nsamples; start += LOSSY_CODEC_BLOCK_SIZE) {
+        const size_t n = std::min(LOSSY_CODEC_BLOCK_SIZE, nsamples - start);
+
+        float step = quantize_block(samples + start, bounds + start, n, quantization, quantized);
+
+        // Delta and zigzag mapping, the first delta is zero (the sample is stored aside) as is
+        // the padding
+        unsigned width = 0;
+        if (step > 0.0f) {
+          uint64_t all = 0;
+          mapped[0] = 0;
+          for (size_t i = 1; i < n; i++) {
+            const int64_t delta = quantized[i] - quantized[i - 1];
+            mapped[i] = (static_cast<uint64_t>(delta) << 1) ^ static_cast<uint64_t>(delta >> 63);
+            all |= mapped[i];
+          }
+          std::fill(mapped + n, mapped + LOSSY_CODEC_BLOCK_SIZE, 0);
+
+          while (width < 64 && (all >> width)) {
+            width++;
+          }
+
+          // Stored verbatim if quantizing does not pay off
+          if (LOSSY_CODEC_BLOCK_HEADER + width * LOSSY_CODEC_PLANE_SIZE > LOSSY_CODEC_VERBATIM_SIZE) {
+            step = 0.0f;
+          }
+        }
+
+        std::memcpy(out, &step, sizeof(step));
+        out += sizeof(step);
+
+        if (step == 0.0f) {
+          std::memcpy(out, samples + start, n * sizeof(float));
+          std::memset(out + n * sizeof(float), 0, (LOSSY_CODEC_BLOCK_SIZE - n) * sizeof(float));
+          out += LOSSY_CODEC_VERBATIM_SIZE;
+          continue;
+        }
+
+        std::memcpy(out, &quantized[0], sizeof(int64_t));
+        out += sizeof(int64_t);
+        *out++ = static_cast<uint8_t>(width);
+
+        // Bit planes, collected in 64-bit words (sample i at bit i % 64)
+        for (unsigned b = 0; b < width; b++) {
+          for (size_t w = 0; w < LOSSY_CODEC_BLOCK_SIZE; w += 64) {
+            uint64_t plane = 0;
+            for (size_t i = 0; i < 64; i++) {
+              plane |= ((mapped[w + i] >> b) & 1) << i;
+            }
+            for (size_t k = 0; k < 8; k++) {
+              *out++ = static_cast<uint8_t>(plane >> (8 * k));
+            }
+          }
+        }
+      }
+
+      return out - data;
+    }
+
+    size_t
+    lossy_decode(const uint8_t *data, size_t size, float *samples, size_t nsamples)
+    {
+      uint64_t mapped[LOSSY_CODEC_BLOCK_SIZE];
+      const uint8_t *in = data;
+      const uint8_t *end = data + size;
+
+      auto corrupt = [&]() {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": corrupt lossy data at byte "
+                << (in - data) << " of " << size;
+        throw std::invalid_argument(message.str());
+      };
+
+      for (size_t start = 0; start < nsamples; start += LOSSY_CODEC_BLOCK_SIZE) {
+        const size_t n = std::min(LOSSY_CODEC_BLOCK_SIZE, nsamples - start);
+
+        float step;
+        if (static_cast<size_t>(end - in) < sizeof(step)) {
+          corrupt();
+        }
+        std::memcpy(&step, in, sizeof(step));
+
+        if (step == 0.0f) {
+          if (static_cast<size_t>(end - in) < sizeof(step) + LOSSY_CODEC_VERBATIM_SIZE) {
+            corrupt();
+          }
+          in += sizeof(step);
+          std::memcpy(samples + start, in, n * sizeof(float));
+          in += LOSSY_CODEC_VERBATIM_SIZE;
+          continue;
+        }
+
+        if (!(step > 0.0f) || !std::isfinite(step) || static_cast<size_t>(end - in) < LOSSY_CODEC_BLOCK_HEADER) {
+          corrupt();
+        }
+        int64_t quantized;
+        std::memcpy(&quantized, in + sizeof(step), sizeof(quantized));
+        const unsigned width = in[sizeof(step) + sizeof(quantized)];
+        if (width > 64 || static_cast<size_t>(end - in) < LOSSY_CODEC_BLOCK_HEADER + width * LOSSY_CODEC_PLANE_SIZE) {
+          corrupt();
+        }
+        in += LOSSY_CODEC_BLOCK_HEADER;
+
+        std::fill(mapped, mapped + LOSSY_CODEC_BLOCK_SIZE, 0);
+        for (unsigned b = 0; b < width; b++) {
+          for (size_t w = 0; w < LOSSY_CODEC_BLOCK_SIZE; w += 64) {
+            uint64_t plane = 0;
+            for (size_t k = 0; k < 8; k++) {
+              plane |= static_cast<uint64_t>(*in++) << (8 * k);
+            }
+            for (size_t i = 0; i < 64; i++) {
+              mapped[w + i] |= ((plane >> i) & 1) << b;
+            }
+          }
+        }
+
+        for (size_t i = 0; i < n; i++) {
+          quantized += static_cast<int64_t>(mapped[i] >> 1) ^ -static_cast<int64_t>(mapped[i] & 1);
+          samples[start + i] = static_cast<float>(static_cast<double>(quantized) * step);
+        }
+      }
+
+      return in - data;
+    }
+
+  } /* namespace digitizers */
+} /* namespace gr */
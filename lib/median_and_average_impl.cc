@@ -10,6 +10,7 @@
 
 #include <gnuradio/io_signature.h>
 #include "median_and_average_impl.h"
+#include "spectral_smoothing.h"
 
 namespace gr {
   namespace digitizers {
@@ -28,7 +29,8 @@ namespace gr {
       : gr::block("median_and_average",
         gr::io_signature::make(1, 1, sizeof(float) * vec_len),
         gr::io_signature::make(1, 1, sizeof(float) * vec_len)),
-        d_median(n_med), d_average(n_lp), d_vec_len(vec_len)
+        d_median(n_med), d_average(n_lp), d_vec_len(vec_len),
+        d_median_buffer(vec_len)
     {
       set_tag_propagation_policy(TPP_DONT);
     }
@@ -45,45 +47,6 @@ namespace gr {
     {
       ninput_items_required[0] = noutput_items;
     }
-    
-    
-    
-    int compare_floats(const void* a, const void* b)
-    {
-    float arg1 = *(const float*)a;
-    float arg2 = *(const float*)b;
- 
-    if (arg1 < arg2) return -1;
-    if (arg1 > arg2) return 1;
-    return 0;
- 
-    // return (arg1 > arg2) - (arg1 < arg2); // possible shortcut
-    }
-    
-    float median(float *buffer, int size) {
-       if (size<=0) return 0;
-       if (size<=1) return buffer[0];
-       
-       qsort(buffer, size, sizeof(float), compare_floats);   
-       if (size%2==0) {
-            return 0.5*(buffer[size/2] + buffer[size/2-1]);
-       } else {
-           return buffer[size/2];
-       }       
-    }
-    
-     
-    float average(const float *buffer, int size) {
-       if (size<=0) return 0;
-       if (size<=1) return buffer[0];
-       
-       float sum = 0.0;    
-       for (int i=0; i < size; i++) {
-           sum += buffer[i];
-       }
-       
-       return sum/(float)size;
-    }
 
     int
     median_and_average_impl::general_work (int noutput_items,
@@ -91,67 +54,38 @@ namespace gr {
       gr_vector_const_void_star &input_items,
       gr_vector_void_star &output_items)
     {
+      block_stats_scope_t stats(d_stats);
       const float *in = (const float *) input_items[0];
       float *out = (float *) output_items[0];
 
-      if(ninput_items[0] <= 0 || noutput_items <= 0){
+      const int nvectors = std::min(ninput_items[0], noutput_items);
+      if(nvectors <= 0){
         return 0;
       }
-      
-      const int med_len =d_median;
-      const int avg_len = d_average;
-      float buffer[2*med_len+1];
-      float temp_buffer[d_vec_len];
-      //calculate median of samples and average it.
-      for(int i = 0; i < d_vec_len; i++) {
-        if (med_len == 0) {
-          temp_buffer[i] = in[i];
-          //out[i] = in[i];
-          continue;
+
+      for (int v = 0; v < nvectors; v++) {
+        const float *vin = in + v * d_vec_len;
+        float *vout = out + v * d_vec_len;
+        const int last = d_vec_len - 1;
+
+        if (d_median == 0 && d_average == 0) {
+          std::copy(vin, vin + d_vec_len, vout);
         }
-        int count = 0;
-        for (int j=0; j < (2*med_len+1); j++) {
-          int k = i - med_len + j;
-          if (k<0) {
-            k = 0;
-          }
-          else if (k>=d_vec_len) {
-            k = d_vec_len-1;
-          }
-          if (k != i) {
-            buffer[count] = in[k];
-            count++;
-          }
+        else if (d_median == 0) {
+          average_filter(vin, d_vec_len, d_average, 0, last, vout);
         }
-        temp_buffer[i] = median(buffer, count);
-      }
-
-      float buffer2[2*avg_len+1];
-      for(int i = 0; i < d_vec_len; i++) {
-        if (avg_len == 0) {
-          out[i] = temp_buffer[i];
-          continue;
+        else if (d_average == 0) {
+          median_filter(vin, d_vec_len, d_median, 0, last, vout, d_window);
         }
-        int count = 0;
-        for (int j=0; j < (2*avg_len+1); j++) {
-          int k = i - avg_len + j;
-          if (k<0) {
-            k = 0;
-          }
-          else if (k>=d_vec_len) {
-            k = d_vec_len-1;
-          }
-          buffer2[count] = temp_buffer[k];
-          count++;
+        else {
+          median_filter(vin, d_vec_len, d_median, 0, last, &d_median_buffer[0], d_window);
+          average_filter(&d_median_buffer[0], d_vec_len, d_average, 0, last, vout);
         }
-
-        out[i] = average(buffer2, count);
       }
 
-
-      consume_each (1);
-      return 1;
-      }
+      consume_each (nvectors);
+      return nvectors;
+    }
 
   } /* namespace digitizers */
 } /* namespace gr */
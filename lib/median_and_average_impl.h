@@ -10,6 +10,7 @@
 #include <digitizers/median_and_average.h>
 #include <algorithm>
 #include "utils.h"
+#include "block_stats_impl.h"
 namespace gr {
   namespace digitizers {
 
@@ -20,6 +21,12 @@ namespace gr {
       int d_median;
       int d_average;
       int d_vec_len;
+
+      std::vector<float> d_median_buffer;   // median output, input to the average
+      sliding_median<float> d_window;
+
+      block_stats_recorder_t d_stats {this};
+
      public:
       median_and_average_impl(int vec_len, int n_med, int n_lp);
       ~median_and_average_impl();
@@ -0,0 +1,66 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_MEMORY_LOCK_H
+#define INCLUDED_DIGITIZERS_MEMORY_LOCK_H
+
+#include <gnuradio/block.h>
+#include <gnuradio/block_detail.h>
+#include <gnuradio/buffer.h>
+
+#include "chunk_memory.h"
+
+#include <cstddef>
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Locks the output buffers of the block, see lock_memory. The buffers are allocated
+     * once the flowgraph is started, i.e. meant to be called from the block's start method.
+     */
+    static inline size_t
+    lock_output_buffers(gr::block &block)
+    {
+      auto detail = block.detail();
+      if (!detail) {
+        return 0;
+      }
+
+      size_t locked = 0;
+      for (int i = 0; i < detail->noutputs(); i++) {
+        auto buffer = detail->output(i);
+        locked += lock_memory(buffer->base(), static_cast<size_t>(buffer->bufsize())
+                * block.output_signature()->sizeof_stream_item(i));
+      }
+      return locked;
+    }
+
+    /*!
+     * \brief Locks the buffers the block reads, i.e. the output buffers of its producers, see
+     * lock_output_buffers.
+     */
+    static inline size_t
+    lock_input_buffers(gr::block &block)
+    {
+      auto detail = block.detail();
+      if (!detail) {
+        return 0;
+      }
+
+      size_t locked = 0;
+      for (int i = 0; i < detail->ninputs(); i++) {
+        auto buffer = detail->input(i)->buffer();
+        locked += lock_memory(buffer->base(), static_cast<size_t>(buffer->bufsize())
+                * block.input_signature()->sizeof_stream_item(i));
+      }
+      return locked;
+    }
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_MEMORY_LOCK_H */
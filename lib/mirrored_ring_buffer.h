@@ -0,0 +1,330 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_MIRRORED_RING_BUFFER_H
+#define INCLUDED_DIGITIZERS_MIRRORED_RING_BUFFER_H
+
+#include <boost/noncopyable.hpp>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <new>
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief A power-of-two ring buffer whose memory is mapped twice, back to back.
+     *
+     * Thanks to the double mapping any window of up to capacity() items is contiguous in memory,
+     * meaning the most recent items (e.g. a pre-trigger window) can be accessed by pointer without
+     * handling the wrap-around and without copying.
+     *
+     * The mapping relies on memfd_create. If that is not available the buffer falls back to plain
+     * memory of twice the size where each item is written twice, i.e. views remain contiguous at
+     * the cost of an additional copy on write. See is_mirrored.
+     *
+     * Alternatively the buffer can be backed by a region of a file (see allocate_file), e.g. to
+     * keep a history larger than the available memory or to share it with other processes.
+     *
+     * Large buffers written at high rates can be backed by huge pages, explicit huge pages
+     * (MFD_HUGETLB) are tried first, falling back to transparent huge pages (MADV_HUGEPAGE, takes
+     * effect if enabled for shared memory). Both are best-effort, see is_huge_page_backed.
+     */
+    template <typename T>
+    class mirrored_ring_buffer_t : boost::noncopyable
+    {
+      static_assert((sizeof(T) & (sizeof(T) - 1)) == 0, "item size must be a power of two");
+
+    public:
+
+      static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+      mirrored_ring_buffer_t()
+        : d_addr(nullptr),
+          d_capacity(0),
+          d_mask(0),
+          d_count(0),
+          d_mirrored(false),
+          d_huge_pages(false)
+      {
+      }
+
+      ~mirrored_ring_buffer_t()
+      {
+        release();
+      }
+
+      /*!
+       * \brief Allocates the buffer, previously allocated memory is released. Throws std::bad_alloc
+       * if no memory is available.
+       *
+       * \param min_items minimum capacity, rounded up to a power of two and a whole number of pages
+       * \param huge_pages try to back the buffer with huge pages, the capacity is rounded up to
+       * whole huge pages
+       */
+      void allocate(size_t min_items, bool huge_pages=false)
+      {
+        release();
+
+        if (min_items == 0) {
+          return;
+        }
+
+        const size_t capacity = get_capacity(min_items, huge_pages ? HUGE_PAGE_SIZE : 0);
+        const size_t bytes = capacity * sizeof(T);
+
+        if (huge_pages) {
+          d_addr = static_cast<T *>(map_mirrored(bytes, true));
+          d_huge_pages = d_addr != nullptr;
+        }
+
+        if (d_addr == nullptr) {
+          d_addr = static_cast<T *>(map_mirrored(bytes, false));
+        }
+        d_mirrored = d_addr != nullptr;
+
+        if (d_addr == nullptr) {
+          void *addr = mmap(nullptr, 2 * bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+          if (addr == MAP_FAILED) {
+            throw std::bad_alloc();
+          }
+          d_addr = static_cast<T *>(addr);
+        }
+
+#ifdef MADV_HUGEPAGE
+        if (huge_pages && !d_huge_pages) {
+          d_huge_pages = madvise(d_addr, 2 * bytes, MADV_HUGEPAGE) == 0;
+        }
+#endif
+
+        d_capacity = capacity;
+        d_mask = capacity - 1;
+        d_count = 0;
+      }
+
+      /*!
+       * \brief Maps the buffer onto a region of the file, the file needs to be large enough.
+       * Returns false on failure. The file descriptor can be closed once this method returns.
+       *
+       * \param capacity capacity, see get_capacity
+       * \param fd file descriptor opened for reading and writing
+       * \param offset offset of the region within the file, a multiple of the page size
+       */
+      bool allocate_file(size_t capacity, int fd, off_t offset)
+      {
+        release();
+
+        auto addr = map_file(fd, offset, capacity * sizeof(T));
+        if (addr == nullptr) {
+          return false;
+        }
+
+        // Existing file content is kept, push starts at its beginning
+        d_addr = static_cast<T *>(addr);
+        d_capacity = capacity;
+        d_mask = capacity - 1;
+        d_count = 0;
+        d_mirrored = true;
+        return true;
+      }
+
+      /*!
+       * \brief Capacity allocated for the given minimum number of items, a power of two and a
+       * whole number of pages.
+       *
+       * \param alignment minimum size of the buffer in bytes, power of two
+       */
+      static size_t get_capacity(size_t min_items, size_t alignment=0)
+      {
+        const size_t page_bytes = std::max(static_cast<size_t>(sysconf(_SC_PAGESIZE)), alignment);
+        const size_t page_items = std::max(size_t{1}, page_bytes / sizeof(T));
+        size_t capacity = 1;
+        while (capacity < std::max(min_items, page_items)) {
+          capacity <<= 1;
+        }
+        return capacity;
+      }
+
+      void release()
+      {
+        if (d_addr != nullptr) {
+          munmap(d_addr, 2 * d_capacity * sizeof(T));
+        }
+
+        d_addr = nullptr;
+        d_capacity = 0;
+        d_mask = 0;
+        d_count = 0;
+        d_mirrored = false;
+        d_huge_pages = false;
+      }
+
+      /*!
+       * \brief Appends items, if more than capacity items are given only the last ones are kept.
+       */
+      void push(const T *items, size_t nitems)
+      {
+        if (nitems > d_capacity) {
+          d_count += nitems - d_capacity;
+          items += nitems - d_capacity;
+          nitems = d_capacity;
+        }
+
+        const size_t pos = d_count & d_mask;
+
+        if (d_mirrored) {
+          memcpy(d_addr + pos, items, nitems * sizeof(T));
+        }
+        else {
+          const size_t first = std::min(nitems, d_capacity - pos);
+          memcpy(d_addr + pos, items, first * sizeof(T));
+          memcpy(d_addr + pos + d_capacity, items, first * sizeof(T));
+          memcpy(d_addr, items + first, (nitems - first) * sizeof(T));
+          memcpy(d_addr + d_capacity, items + first, (nitems - first) * sizeof(T));
+        }
+
+        d_count += nitems;
+      }
+
+      /*!
+       * \brief Returns a contiguous view on items starting at the absolute index (counting all
+       * the items ever pushed). The view is valid for up to capacity() items, the caller needs
+       * to make sure the items were not overwritten yet, see available_from.
+       */
+      const T *view(uint64_t index) const
+      {
+        return d_addr + (index & d_mask);
+      }
+
+      /*!
+       * \brief Returns a contiguous view on the last nitems items (nitems <= capacity).
+       */
+      const T *tail(size_t nitems) const
+      {
+        return view(d_count - nitems);
+      }
+
+      /*!
+       * \brief Absolute index of the oldest item still held in the buffer.
+       */
+      uint64_t available_from() const
+      {
+        return d_count > d_capacity ? d_count - d_capacity : 0;
+      }
+
+      /*!
+       * \brief Continues at the given absolute index, e.g. a file backed buffer holding the
+       * items of a previous run.
+       */
+      void set_count(uint64_t count)
+      {
+        d_count = count;
+      }
+
+      /*!
+       * \brief Total number of items pushed since allocation.
+       */
+      uint64_t count() const
+      {
+        return d_count;
+      }
+
+      size_t capacity() const
+      {
+        return d_capacity;
+      }
+
+      bool is_mirrored() const
+      {
+        return d_mirrored;
+      }
+
+      bool is_huge_page_backed() const
+      {
+        return d_huge_pages;
+      }
+
+    private:
+
+      // Returns nullptr on failure, 2 * bytes of address space are reserved on success. Explicit
+      // huge pages need the size to be a multiple of HUGE_PAGE_SIZE.
+      static void *map_mirrored(size_t bytes, bool huge_pages)
+      {
+#ifdef SYS_memfd_create
+        // glibc wrapper is not available on older systems, MFD_HUGETLB equals 4 in linux/memfd.h
+        const unsigned int mfd_hugetlb = 4;
+        int fd = static_cast<int>(syscall(SYS_memfd_create, "digitizers_ring", huge_pages ? mfd_hugetlb : 0));
+        if (fd < 0) {
+          return nullptr;
+        }
+
+        if (ftruncate(fd, static_cast<off_t>(bytes)) != 0) {
+          close(fd);
+          return nullptr;
+        }
+
+        auto base = map_file(fd, 0, bytes, huge_pages ? HUGE_PAGE_SIZE : 0);
+
+        // mappings keep the file alive
+        close(fd);
+
+        return base;
+#else
+        return nullptr;
+#endif
+      }
+
+      // Maps the file region twice, back to back, at an address aligned as given (power of two)
+      static void *map_file(int fd, off_t offset, size_t bytes, size_t alignment=0)
+      {
+        auto reserved = static_cast<uint8_t *>(mmap(nullptr, 2 * bytes + alignment, PROT_NONE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+        if (reserved == MAP_FAILED) {
+          return nullptr;
+        }
+
+        // Slack of the reservation is returned
+        auto base = reserved;
+        if (alignment) {
+          base = reinterpret_cast<uint8_t *>((reinterpret_cast<uintptr_t>(reserved) + alignment - 1)
+                  & ~static_cast<uintptr_t>(alignment - 1));
+          if (base > reserved) {
+            munmap(reserved, base - reserved);
+          }
+          if (base < reserved + alignment) {
+            munmap(base + 2 * bytes, reserved + alignment - base);
+          }
+        }
+
+        auto lower = mmap(base, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, offset);
+        auto upper = mmap(base + bytes, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, offset);
+
+        if (lower == MAP_FAILED || upper == MAP_FAILED) {
+          munmap(base, 2 * bytes);
+          return nullptr;
+        }
+
+        return base;
+      }
+
+      T *d_addr;
+      size_t d_capacity;
+      size_t d_mask;
+      uint64_t d_count;
+      bool d_mirrored;
+      bool d_huge_pages;
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_MIRRORED_RING_BUFFER_H */
@@ -0,0 +1,216 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gnuradio/io_signature.h>
+#include "multi_cascade_sink_impl.h"
+#include "cascade_sink_impl.h"
+#include "fused_aggregation_impl.h"
+#include "multi_fused_aggregation_impl.h"
+#include <digitizers/block_aggregation.h>
+#include <digitizers/signal_averager.h>
+#include <digitizers/status.h>
+
+#include <sstream>
+#include <stdexcept>
+
+namespace gr {
+  namespace digitizers {
+
+    multi_cascade_sink::sptr
+    multi_cascade_sink::make(int alg_id,
+        int delay,
+        const std::vector<float> &fir_taps,
+        double low_freq,
+        double up_freq,
+        double tr_width,
+        const std::vector<double> &fb_user_taps,
+        const std::vector<double> &fw_user_taps,
+        double samp_rate,
+        const std::vector<std::string> &signal_names,
+        std::string unit_name,
+        const std::vector<cascade_level_t> &levels)
+    {
+      return gnuradio::get_initial_sptr
+        (new multi_cascade_sink_impl(alg_id, delay, fir_taps, low_freq, up_freq, tr_width,
+                fb_user_taps, fw_user_taps, samp_rate, signal_names, unit_name, levels));
+    }
+
+    /*
+     * The private constructor
+     */
+    multi_cascade_sink_impl::multi_cascade_sink_impl(int alg_id,
+        int delay,
+        const std::vector<float> &fir_taps,
+        double low_freq,
+        double up_freq,
+        double tr_width,
+        const std::vector<double> &fb_user_taps,
+        const std::vector<double> &fw_user_taps,
+        double samp_rate,
+        const std::vector<std::string> &signal_names,
+        std::string unit_name,
+        const std::vector<cascade_level_t> &levels)
+      : gr::hier_block2("multi_cascade_sink",
+              gr::io_signature::make(2 * signal_names.size(), 2 * signal_names.size(), sizeof(float)),
+              gr::io_signature::make(0, 0, sizeof(float))),
+        d_nchannels(signal_names.size())
+    {
+      if (signal_names.empty()) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": at least one channel required";
+        throw std::invalid_argument(message.str());
+      }
+
+      const auto algorithm = algorithm_id_t(alg_id);
+
+      for (const auto &level : cascade_sink_impl::prune_levels(levels, "")) {
+        double input_rate = samp_rate;
+        for (const auto &parent : d_levels) {
+          if (parent.level.name == level.parent) {
+            input_rate = parent.samp_rate;
+          }
+        }
+
+        level_node_t node;
+        node.level = level;
+        node.samp_rate = input_rate / level.decimation;
+
+        // cut-off frequencies were designed for the 10 kHz stage, see cascade_sink
+        const double scale = node.samp_rate / 10000.0;
+        if (level.decimation == 1) {
+          // pass-through, see cascade_level_t
+        }
+        else if (algorithm == AVERAGE) {
+          node.aggs.push_back(signal_averager::make(2 * d_nchannels, level.decimation, input_rate));
+        }
+        else if (fused_aggregation_ff::is_supported(algorithm)) {
+          node.aggs.push_back(multi_fused_aggregation_ff::make(d_nchannels, algorithm, level.decimation,
+                  delay, fir_taps, low_freq * scale, up_freq * scale, tr_width * scale, input_rate));
+        }
+        else {
+          for (int c = 0; c < d_nchannels; c++) {
+            node.aggs.push_back(block_aggregation::make(alg_id, level.decimation, delay, fir_taps,
+                    low_freq * scale, up_freq * scale, tr_width * scale, fb_user_taps, fw_user_taps,
+                    input_rate));
+          }
+        }
+
+        if (level.package_size > 0) {
+          for (const auto &signal_name : signal_names) {
+            node.sinks.push_back(time_domain_sink::make(signal_name + "@" + level.name, unit_name,
+                    node.samp_rate, TIME_SINK_MODE_STREAMING, level.package_size));
+          }
+        }
+
+        d_levels.push_back(node);
+
+        for (int c = 0; c < d_nchannels; c++) {
+          auto input = get_parent_output(d_levels.back(), c);
+          auto output = get_output(d_levels.back(), c);
+          if (!node.aggs.empty()) {
+            connect(input.first, input.second, output.first, output.second);             // values
+            connect(input.first, input.second + 1, output.first, output.second + 1);     // errors
+          }
+
+          if (!node.sinks.empty()) {
+            connect(output.first, output.second, node.sinks[c], 0);
+            connect(output.first, output.second + 1, node.sinks[c], 1);
+          }
+        }
+      }
+    }
+
+    multi_cascade_sink_impl::~multi_cascade_sink_impl()
+    {
+    }
+
+    std::vector<cascade_level_t>
+    multi_cascade_sink_impl::get_levels()
+    {
+      std::vector<cascade_level_t> levels;
+      for (const auto &node : d_levels) {
+        levels.push_back(node.level);
+      }
+      return levels;
+    }
+
+    std::vector<time_domain_sink::sptr>
+    multi_cascade_sink_impl::get_time_domain_sinks(int channel)
+    {
+      if (channel < 0 || channel >= d_nchannels) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid channel: " << channel;
+        throw std::invalid_argument(message.str());
+      }
+
+      // slowest first
+      std::vector<time_domain_sink::sptr> sinks;
+      for (auto it = d_levels.rbegin(); it != d_levels.rend(); ++it) {
+        if (!it->sinks.empty()) {
+          sinks.push_back(it->sinks[channel]);
+        }
+      }
+
+      return sinks;
+    }
+
+    std::vector<time_domain_sink::sptr>
+    multi_cascade_sink_impl::get_time_domain_sinks()
+    {
+      std::vector<time_domain_sink::sptr> sinks;
+      for (int c = 0; c < d_nchannels; c++) {
+        auto channel_sinks = get_time_domain_sinks(c);
+        sinks.insert(sinks.end(), channel_sinks.begin(), channel_sinks.end());
+      }
+      return sinks;
+    }
+
+    bool
+    multi_cascade_sink_impl::set_gpu_offload(bool enable)
+    {
+      bool offloaded = enable;
+      for (const auto &node : d_levels) {
+        for (const auto &agg : node.aggs) {
+          auto fused = boost::dynamic_pointer_cast<multi_fused_aggregation_ff>(agg);
+          if (!fused || !fused->set_gpu_offload(enable)) {
+            offloaded = false;
+          }
+        }
+      }
+      return offloaded;
+    }
+
+    std::pair<gr::basic_block_sptr, int>
+    multi_cascade_sink_impl::get_output(const level_node_t &node, int channel)
+    {
+      if (node.aggs.empty()) {
+        return get_parent_output(node, channel);
+      }
+      if (node.aggs.size() == 1) {
+        return std::make_pair(node.aggs[0], 2 * channel);
+      }
+
+      return std::make_pair(node.aggs[channel], 0);
+    }
+
+    std::pair<gr::basic_block_sptr, int>
+    multi_cascade_sink_impl::get_parent_output(const level_node_t &node, int channel)
+    {
+      for (const auto &parent : d_levels) {
+        if (parent.level.name == node.level.parent) {
+          return get_output(parent, channel);
+        }
+      }
+
+      return std::make_pair(self(), 2 * channel);
+    }
+
+  } /* namespace digitizers */
+} /* namespace gr */
@@ -0,0 +1,76 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_MULTI_CASCADE_SINK_IMPL_H
+#define INCLUDED_DIGITIZERS_MULTI_CASCADE_SINK_IMPL_H
+
+#include <digitizers/multi_cascade_sink.h>
+#include <digitizers/time_domain_sink.h>
+
+namespace gr {
+  namespace digitizers {
+
+    class multi_cascade_sink_impl : public multi_cascade_sink
+    {
+     private:
+      /*!
+       * \brief Instantiated aggregation level.
+       *
+       * Either a single block for all the channels, channel c at the ports 2c and 2c+1, one
+       * block_aggregation per channel or none for a pass-through level.
+       */
+      struct level_node_t
+      {
+        cascade_level_t level;
+        double samp_rate;                             // output sample rate
+        std::vector<gr::basic_block_sptr> aggs;
+        std::vector<time_domain_sink::sptr> sinks;    // per channel, empty if the package size is zero
+      };
+
+      // Aggregation ladder, parents precede their children
+      std::vector<level_node_t> d_levels;
+
+      const int d_nchannels;
+
+     public:
+      multi_cascade_sink_impl(int alg_id,
+          int delay,
+          const std::vector<float> &fir_taps,
+          double low_freq,
+          double up_freq,
+          double tr_width,
+          const std::vector<double> &fb_user_taps,
+          const std::vector<double> &fw_user_taps,
+          double samp_rate,
+          const std::vector<std::string> &signal_names,
+          std::string unit_name,
+          const std::vector<cascade_level_t> &levels);
+
+      ~multi_cascade_sink_impl();
+
+      int nchannels() const override { return d_nchannels; }
+
+      std::vector<cascade_level_t> get_levels() override;
+
+      std::vector<time_domain_sink::sptr> get_time_domain_sinks(int channel) override;
+
+      std::vector<time_domain_sink::sptr> get_time_domain_sinks() override;
+
+      bool set_gpu_offload(bool enable) override;
+
+     private:
+
+      // Block and first port (values, errors follow) of the given channel
+      std::pair<gr::basic_block_sptr, int> get_output(const level_node_t &node, int channel);
+
+      // Output of the parent level, or the raw input
+      std::pair<gr::basic_block_sptr, int> get_parent_output(const level_node_t &node, int channel);
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_MULTI_CASCADE_SINK_IMPL_H */
@@ -0,0 +1,343 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gnuradio/io_signature.h>
+#include "multi_fused_aggregation_impl.h"
+#include "fused_aggregation_impl.h"
+#include "lane_fir_kernel.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
+namespace gr {
+  namespace digitizers {
+
+    multi_fused_aggregation_ff::sptr
+    multi_fused_aggregation_ff::make(int nchannels,
+        algorithm_id_t alg_id,
+        int decim,
+        int delay,
+        const std::vector<float> &fir_taps,
+        double low_freq,
+        double up_freq,
+        double tr_width,
+        double samp_rate)
+    {
+      return gnuradio::get_initial_sptr
+        (new multi_fused_aggregation_ff(nchannels, alg_id, decim, delay, fir_taps, low_freq, up_freq,
+                tr_width, samp_rate));
+    }
+
+    multi_fused_aggregation_ff::multi_fused_aggregation_ff(int nchannels,
+        algorithm_id_t alg_id,
+        int decim,
+        int delay,
+        const std::vector<float> &fir_taps,
+        double low_freq,
+        double up_freq,
+        double tr_width,
+        double samp_rate)
+      : gr::sync_decimator("multi_fused_aggregation_ff",
+              gr::io_signature::make(2 * nchannels, 2 * nchannels, sizeof(float)),
+              gr::io_signature::make(2 * nchannels, 2 * nchannels, sizeof(float)), decim),
+        d_nchannels(nchannels),
+        d_alg_id(alg_id),
+        d_delay(0),
+        d_sigma_mult(0.0),
+        d_input_history(0),
+        d_filtered_history(0),
+        d_mean(nchannels),
+        d_mean_of_squares(nchannels),
+        d_error(nchannels),
+        d_gpu_enabled(false)
+    {
+      if (nchannels < 1 || !fused_aggregation_ff::is_supported(alg_id)) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid number of channels ("
+                << nchannels << ") or algorithm not supported: " << alg_id;
+        throw std::invalid_argument(message.str());
+      }
+
+      set_tag_propagation_policy(TPP_CUSTOM);
+
+      update_design(delay, fir_taps, low_freq, up_freq, tr_width, samp_rate);
+    }
+
+    multi_fused_aggregation_ff::~multi_fused_aggregation_ff()
+    {
+    }
+
+    void
+    multi_fused_aggregation_ff::update_design(int delay,
+        const std::vector<float> &fir_taps,
+        double low_freq,
+        double up_freq,
+        double tr_width,
+        double samp_rate)
+    {
+      set_taps(delay, fused_aggregation_ff::design_taps(d_alg_id, fir_taps, low_freq, up_freq, tr_width, samp_rate),
+              (up_freq - low_freq) / samp_rate);
+    }
+
+    void
+    multi_fused_aggregation_ff::set_taps(int delay, const std::vector<float> &taps, double sigma_mult)
+    {
+      if (taps.empty() || delay < 0) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid taps or delay";
+        throw std::invalid_argument(message.str());
+      }
+
+      std::unique_ptr<aggregation_taps_t> next(new aggregation_taps_t);
+      next->taps = design_cache_t::instance().intern(std::vector<float>(taps.rbegin(), taps.rend()));
+      next->delay = delay;
+      next->sigma_mult = static_cast<float>(sigma_mult);
+
+      d_tap_swap.publish(std::move(next));
+    }
+
+    void
+    multi_fused_aggregation_ff::apply_taps(aggregation_taps_t &next)
+    {
+      const size_t input_history = next.taps->size() - 1;
+      const size_t filtered_history = std::max(input_history, static_cast<size_t>(next.delay));
+
+      resize_history(d_values, d_input_history, input_history);
+      resize_history(d_errors, d_input_history, input_history);
+      resize_history(d_filtered, d_filtered_history, filtered_history);
+      resize_history(d_squares, d_filtered_history, filtered_history);
+
+      d_input_history = input_history;
+      d_filtered_history = filtered_history;
+
+      d_taps.swap(next.taps);
+      d_delay = next.delay;
+      d_sigma_mult = next.sigma_mult;
+
+      if (d_gpu) {
+        d_gpu->set_taps(*d_taps, d_delay, d_sigma_mult);
+      }
+    }
+
+    bool
+    multi_fused_aggregation_ff::set_gpu_offload(bool enable)
+    {
+      boost::mutex::scoped_lock lock(d_control_mutex);
+
+      if (enable == d_gpu_enabled) {
+        return d_gpu_enabled;
+      }
+
+      std::unique_ptr<gpu_aggregation_t> gpu;
+      if (enable) {
+        gpu = gpu_aggregation_t::make(d_nchannels);
+        if (!gpu) {
+          GR_LOG_WARN(d_logger, "GPU offload not available, " + gpu_aggregation_t::status());
+          return false;
+        }
+      }
+
+      publish_backend(std::move(gpu));
+      return enable;
+    }
+
+    void
+    multi_fused_aggregation_ff::set_gpu_backend(std::unique_ptr<gpu_aggregation_t> gpu)
+    {
+      boost::mutex::scoped_lock lock(d_control_mutex);
+      publish_backend(std::move(gpu));
+    }
+
+    void
+    multi_fused_aggregation_ff::publish_backend(std::unique_ptr<gpu_aggregation_t> gpu)
+    {
+      d_gpu_enabled = gpu != nullptr;
+
+      std::unique_ptr<backend_t> next(new backend_t);
+      next->gpu = std::move(gpu);
+      d_backend_swap.publish(std::move(next));
+    }
+
+    void
+    multi_fused_aggregation_ff::apply_backend(backend_t &next)
+    {
+      d_gpu.swap(next.gpu);
+
+      if (d_gpu) {
+        // the device histories start from zero
+        if (d_taps) {
+          d_gpu->set_taps(*d_taps, d_delay, d_sigma_mult);
+        }
+      }
+      else {
+        // the host histories are stale since the switch to the GPU
+        std::fill(d_values.begin(), d_values.end(), 0.0f);
+        std::fill(d_errors.begin(), d_errors.end(), 0.0f);
+        std::fill(d_filtered.begin(), d_filtered.end(), 0.0f);
+        std::fill(d_squares.begin(), d_squares.end(), 0.0f);
+      }
+    }
+
+    void
+    multi_fused_aggregation_ff::resize_history(std::vector<float> &buffer, size_t old_size, size_t new_size)
+    {
+      // whole interleaved rows, i.e. all the channels of a sample
+      const size_t n = d_nchannels;
+      std::vector<float> history(new_size * n, 0.0f);
+      const size_t keep = std::min(old_size, new_size) * n;
+      if (keep) {
+        std::copy(buffer.begin() + (old_size * n - keep), buffer.begin() + old_size * n, history.end() - keep);
+      }
+      buffer.swap(history);
+    }
+
+    int
+    multi_fused_aggregation_ff::work(int noutput_items,
+        gr_vector_const_void_star &input_items,
+        gr_vector_void_star &output_items)
+    {
+      block_stats_scope_t stats(d_stats);
+
+      // The GPU replaced is freed by the next backend published (or the destructor)
+      if (auto next = d_backend_swap.take()) {
+        apply_backend(*next);
+        d_backend_swap.retire(std::move(next));
+      }
+
+      // New coefficients take effect at the first sample of this call
+      if (auto next = d_tap_swap.take()) {
+        apply_taps(*next);
+        d_tap_swap.retire(std::move(next));
+      }
+
+      if (d_gpu) {
+        work_gpu(noutput_items, input_items, output_items);
+        propagate_tags(noutput_items);
+        return noutput_items;
+      }
+
+      const int n = d_nchannels;
+      const int decim = decimation();
+      const size_t ninput = noutput_items * decim;
+      const int ntaps = d_taps->size();
+      const size_t hx = d_input_history;
+      const size_t hf = d_filtered_history;
+      const float *taps = d_taps->data();
+
+      d_values.resize((hx + ninput) * n);
+      d_errors.resize((hx + ninput) * n);
+      d_filtered.resize((hf + ninput) * n);
+      d_squares.resize((hf + ninput) * n);
+
+      // interleave the channels
+      for (int c = 0; c < n; c++) {
+        const float *in = (const float *) input_items[2 * c];
+        const float *err = (const float *) input_items[2 * c + 1];
+        float *values = &d_values[hx * n + c];
+        float *errors = &d_errors[hx * n + c];
+        for (size_t j = 0; j < ninput; j++) {
+          values[j * n] = in[j];
+          errors[j * n] = err[j];
+        }
+      }
+
+      // value filter at the input rate, window for sample j starts at row j
+      for (size_t j = 0; j < ninput; j++) {
+        float *filtered = &d_filtered[(hf + j) * n];
+        float *squares = &d_squares[(hf + j) * n];
+        lane_dot_prod(taps, ntaps, &d_values[j * n], filtered, n);
+        for (int c = 0; c < n; c++) {
+          squares[c] = filtered[c] * filtered[c];
+        }
+      }
+
+      // everything else only at the output instants
+      for (int i = 0; i < noutput_items; i++) {
+        const size_t row = i * decim;
+
+        lane_dot_prod(taps, ntaps, &d_filtered[(hf + row - hx) * n], &d_mean[0], n);
+        lane_dot_prod(taps, ntaps, &d_squares[(hf + row - hx) * n], &d_mean_of_squares[0], n);
+        lane_dot_prod(taps, ntaps, &d_errors[row * n], &d_error[0], n);
+
+        const float *delayed = &d_filtered[(hf + row - d_delay) * n];
+        for (int c = 0; c < n; c++) {
+          float *out = (float *) output_items[2 * c];
+          float *sigma = (float *) output_items[2 * c + 1];
+          out[i] = delayed[c];
+          sigma[i] = std::sqrt(std::fabs(d_mean_of_squares[c] - d_mean[c] * d_mean[c])
+                  + (d_sigma_mult * d_error[c] * d_error[c]));
+        }
+      }
+
+      // keep histories for the next call
+      std::copy(d_values.end() - hx * n, d_values.end(), d_values.begin());
+      std::copy(d_errors.end() - hx * n, d_errors.end(), d_errors.begin());
+      std::copy(d_filtered.end() - hf * n, d_filtered.end(), d_filtered.begin());
+      std::copy(d_squares.end() - hf * n, d_squares.end(), d_squares.begin());
+
+      propagate_tags(noutput_items);
+
+      return noutput_items;
+    }
+
+    void
+    multi_fused_aggregation_ff::work_gpu(int noutput_items,
+        gr_vector_const_void_star &input_items,
+        gr_vector_void_star &output_items)
+    {
+      const int n = d_nchannels;
+      const int decim = decimation();
+      const size_t ninput = noutput_items * decim;
+
+      // interleave into the pinned staging buffers
+      float *values, *errors;
+      d_gpu->reserve(ninput, &values, &errors);
+      for (int c = 0; c < n; c++) {
+        const float *in = (const float *) input_items[2 * c];
+        const float *err = (const float *) input_items[2 * c + 1];
+        for (size_t j = 0; j < ninput; j++) {
+          values[j * n + c] = in[j];
+          errors[j * n + c] = err[j];
+        }
+      }
+
+      const float *filtered, *sigmas;
+      d_gpu->process(ninput, decim, &filtered, &sigmas);
+
+      for (int c = 0; c < n; c++) {
+        float *out = (float *) output_items[2 * c];
+        float *sigma = (float *) output_items[2 * c + 1];
+        for (int i = 0; i < noutput_items; i++) {
+          out[i] = filtered[i * n + c];
+          sigma[i] = sigmas[i * n + c];
+        }
+      }
+    }
+
+    void
+    multi_fused_aggregation_ff::propagate_tags(int noutput_items)
+    {
+      // Same as fused_aggregation_ff per channel, tags of the error inputs are not propagated
+      const auto decim = decimation();
+
+      for (int c = 0; c < d_nchannels; c++) {
+        const int port = 2 * c;
+        std::vector<gr::tag_t> tags;
+        get_tags_in_range(tags, port, nitems_read(port), nitems_read(port) + noutput_items * decim);
+        decimate_tags(tags, nitems_read(port), nitems_written(port), decim,
+                [this, port](const gr::tag_t &tag) { add_item_tag(port, tag); });
+      }
+    }
+
+  } /* namespace digitizers */
+} /* namespace gr */
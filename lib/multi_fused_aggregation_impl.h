@@ -0,0 +1,173 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_MULTI_FUSED_AGGREGATION_IMPL_H
+#define INCLUDED_DIGITIZERS_MULTI_FUSED_AGGREGATION_IMPL_H
+
+#include <gnuradio/sync_decimator.h>
+#include "digitizers/status.h"
+
+#include <boost/thread/mutex.hpp>
+
+#include <memory>
+#include <vector>
+#include "block_stats_impl.h"
+#include "fused_aggregation_impl.h"
+#include "gpu_aggregation.h"
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Multi-channel variant of fused_aggregation_ff, the same FIR aggregation circuit
+     * applied to nchannels channels within a single work call.
+     *
+     * Channel c uses the input ports 2c (values) and 2c+1 (errors) and the output ports 2c
+     * (values) and 2c+1 (sigma). The channels are interleaved into lanes and filtered with
+     * lane_dot_prod, i.e. SIMD across the channels (8 per AVX2 and 16 per AVX-512 register)
+     * instead of along the samples. Results are identical to nchannels fused_aggregation_ff
+     * blocks up to rounding.
+     *
+     * New taps are swapped in at the start of the next work call, see fused_aggregation_ff.
+     *
+     * With set_gpu_offload the filtering runs on a GPU instead (see gpu_aggregation_t), for
+     * installations with more channels than the CPUs can filter. Tags are still propagated here.
+     */
+    class multi_fused_aggregation_ff : public gr::sync_decimator
+    {
+     public:
+      typedef boost::shared_ptr<multi_fused_aggregation_ff> sptr;
+
+      static sptr make(int nchannels,
+          algorithm_id_t alg_id,
+          int decim,
+          int delay,
+          const std::vector<float> &fir_taps,
+          double low_freq,
+          double up_freq,
+          double tr_width,
+          double samp_rate);
+
+      multi_fused_aggregation_ff(int nchannels,
+          algorithm_id_t alg_id,
+          int decim,
+          int delay,
+          const std::vector<float> &fir_taps,
+          double low_freq,
+          double up_freq,
+          double tr_width,
+          double samp_rate);
+
+      ~multi_fused_aggregation_ff();
+
+      /*!
+       * \brief Redesigns the filter of all the channels, see fused_aggregation_ff::update_design.
+       */
+      void update_design(int delay,
+          const std::vector<float> &fir_taps,
+          double low_freq,
+          double up_freq,
+          double tr_width,
+          double samp_rate);
+
+      /*!
+       * \brief Sets the taps of all the channels directly, applied at the start of the next
+       * work call.
+       */
+      void set_taps(int delay, const std::vector<float> &taps, double sigma_mult);
+
+      /*!
+       * \brief Moves the filtering to the GPU (true) or back to the CPU, returns whether the
+       * GPU is used. Returns false if built without OpenCL or no device is available.
+       *
+       * The backend is switched at the start of the next work call. Meant to be called before
+       * the flowgraph is started, when switching while running the histories of the new backend
+       * start from zero, i.e. the outputs show a transient of the filter length.
+       */
+      bool set_gpu_offload(bool enable);
+
+      /*!
+       * \brief Uses the given backend instead of the one created by set_gpu_offload, e.g. a
+       * host implementation in the tests. nullptr switches back to the CPU.
+       */
+      void set_gpu_backend(std::unique_ptr<gpu_aggregation_t> gpu);
+
+      int nchannels() const { return d_nchannels; }
+
+      int work(int noutput_items,
+          gr_vector_const_void_star &input_items,
+          gr_vector_void_star &output_items) override;
+
+     private:
+
+      // Backend published by set_gpu_offload, no gpu for the CPU
+      struct backend_t
+      {
+        std::unique_ptr<gpu_aggregation_t> gpu;
+      };
+
+      // Switches to the coefficient set taken from d_tap_swap, the replaced taps are moved into it
+      void apply_taps(aggregation_taps_t &next);
+
+      // Resizes the interleaved histories, the most recent samples are kept
+      void resize_history(std::vector<float> &buffer, size_t old_size, size_t new_size);
+
+      void propagate_tags(int noutput_items);
+
+      // Publishes the backend, the control mutex is held
+      void publish_backend(std::unique_ptr<gpu_aggregation_t> gpu);
+
+      // Switches to the backend taken from d_backend_swap, the replaced one is moved into it
+      void apply_backend(backend_t &next);
+
+      // Work function of the GPU backend, histories are kept on the device
+      void work_gpu(int noutput_items,
+          gr_vector_const_void_star &input_items,
+          gr_vector_void_star &output_items);
+
+      const int d_nchannels;
+      const algorithm_id_t d_alg_id;
+
+      // Published by set_taps
+      hot_swap_t<aggregation_taps_t> d_tap_swap;
+
+      // Current coefficient set, used by the work function only
+      design_cache_t::taps_ptr_t d_taps;  // reversed, i.e. dot product with the oldest sample first
+      int d_delay;
+      float d_sigma_mult;
+
+      // Interleaved samples, sample j of channel c at [j * nchannels + c]. The first
+      // d_input_history (d_filtered_history) samples of each channel are from previous calls.
+      size_t d_input_history;
+      std::vector<float> d_values;
+      std::vector<float> d_errors;
+
+      size_t d_filtered_history;
+      std::vector<float> d_filtered;
+      std::vector<float> d_squares;
+
+      // One value per channel
+      std::vector<float> d_mean;
+      std::vector<float> d_mean_of_squares;
+      std::vector<float> d_error;
+
+      // Published by set_gpu_offload
+      hot_swap_t<backend_t> d_backend_swap;
+
+      // Serializes set_gpu_offload, never taken by the work function
+      boost::mutex d_control_mutex;
+      bool d_gpu_enabled;
+
+      // Current backend, used by the work function only
+      std::unique_ptr<gpu_aggregation_t> d_gpu;
+
+      block_stats_recorder_t d_stats {this};
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_MULTI_FUSED_AGGREGATION_IMPL_H */
@@ -0,0 +1,370 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gnuradio/io_signature.h>
+#include "multi_time_domain_sink_impl.h"
+#include "probes.h"
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+namespace gr {
+  namespace digitizers {
+
+    static int
+    nr_input_ports(const std::vector<std::string> &signal_names)
+    {
+      if (signal_names.empty()) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": at least one channel is required";
+        throw std::invalid_argument(message.str());
+      }
+
+      return 2 * static_cast<int>(signal_names.size());
+    }
+
+    multi_time_domain_sink::sptr
+    multi_time_domain_sink::make(const std::vector<std::string> &signal_names, std::string unit, float samp_rate,
+            time_sink_mode_t mode, size_t output_package_size)
+    {
+      return gnuradio::get_initial_sptr(new multi_time_domain_sink_impl(signal_names, unit, samp_rate, mode,
+              output_package_size));
+    }
+
+    multi_time_domain_sink::sptr
+    multi_time_domain_sink::make(const std::vector<std::string> &signal_names, std::string unit, float samp_rate,
+            time_sink_mode_t mode, int pre_samples, int post_samples)
+    {
+      return gnuradio::get_initial_sptr(new multi_time_domain_sink_impl(signal_names, unit, samp_rate, mode,
+              pre_samples, post_samples));
+    }
+
+    multi_time_domain_sink_impl::multi_time_domain_sink_impl(const std::vector<std::string> &signal_names,
+            std::string unit, float samp_rate, time_sink_mode_t mode, size_t output_package_size)
+      : gr::sync_block("multi_time_domain_sink",
+              gr::io_signature::make(nr_input_ports(signal_names), nr_input_ports(signal_names), sizeof(float)),
+              gr::io_signature::make(0, 0, 0)),
+        d_samp_rate(samp_rate),
+        d_sink_mode(mode),
+        d_output_package_size(output_package_size),
+        d_pre_samples(0),
+        d_post_samples(0),
+        d_cb_measurement(nullptr),
+        d_measurement_userdata(nullptr),
+        d_measurement_pool(object_pool_t<multi_measurement_package_t>::make(16)),
+        d_misaligned(0),
+        d_next_offset(0)
+    {
+      init(signal_names, unit);
+    }
+
+    multi_time_domain_sink_impl::multi_time_domain_sink_impl(const std::vector<std::string> &signal_names,
+            std::string unit, float samp_rate, time_sink_mode_t mode, int pre_samples, int post_samples)
+      : gr::sync_block("multi_time_domain_sink",
+              gr::io_signature::make(nr_input_ports(signal_names), nr_input_ports(signal_names), sizeof(float)),
+              gr::io_signature::make(0, 0, 0)),
+        d_samp_rate(samp_rate),
+        d_sink_mode(mode),
+        d_output_package_size(pre_samples + post_samples),
+        d_pre_samples(pre_samples),
+        d_post_samples(post_samples),
+        d_cb_measurement(nullptr),
+        d_measurement_userdata(nullptr),
+        d_measurement_pool(object_pool_t<multi_measurement_package_t>::make(16)),
+        d_misaligned(0),
+        d_next_offset(0)
+    {
+      init(signal_names, unit);
+    }
+
+    multi_time_domain_sink_impl::~multi_time_domain_sink_impl()
+    {
+    }
+
+    void
+    multi_time_domain_sink_impl::init(const std::vector<std::string> &signal_names, const std::string &unit)
+    {
+      if (d_output_package_size == 0) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid package size";
+        throw std::invalid_argument(message.str());
+      }
+
+      for (const auto &name : signal_names) {
+        signal_metadata_t metadata;
+        metadata.name = name;
+        metadata.unit = unit;
+        d_metadata.push_back(metadata);
+      }
+
+      d_channels.resize(signal_names.size());
+
+      // To simplify data copy in chunks
+      set_output_multiple(d_output_package_size);
+
+      // This is a sink
+      set_tag_propagation_policy(tag_propagation_policy_t::TPP_DONT);
+    }
+
+    bool
+    multi_time_domain_sink_impl::start()
+    {
+      for (auto &channel : d_channels) {
+        channel.acq_info_valid = false;
+      }
+      d_misaligned = 0;
+      d_next_offset = 0;
+
+      d_dispatcher.start([this](queued_measurement_t &item) {
+        dispatch_measurement(item);
+      }, get_block_name(this), "dispatch");
+
+      return true;
+    }
+
+    bool
+    multi_time_domain_sink_impl::stop()
+    {
+      // delivers the queued measurements
+      d_dispatcher.stop();
+      return true;
+    }
+
+    int
+    multi_time_domain_sink_impl::work(int ninput_items, gr_vector_const_void_star &input_items,
+            gr_vector_void_star &output_items)
+    {
+      block_stats_scope_t stats(d_stats);
+      assert(ninput_items % d_output_package_size == 0);
+
+      if (d_cb_measurement == nullptr) {
+        return ninput_items;
+      }
+
+      auto package_offset = nitems_read(0);
+
+      // Tags of the whole window are read at once and partitioned into packages, the tags are
+      // attached to the values
+      for (size_t c = 0; c < d_channels.size(); c++) {
+        auto &channel = d_channels[c];
+        channel.work_tags.clear();
+        get_tags_in_range(channel.work_tags, 2 * c, package_offset, package_offset + ninput_items);
+        channel.next_tag = channel.work_tags.cbegin();
+      }
+
+      for (int i = 0; i < ninput_items; i += d_output_package_size) {
+        auto measurement = d_measurement_pool->acquire();
+        decode_measurement_info(package_offset, measurement->info);
+        measurement->offset = package_offset;
+
+        // Note, assign reuses the capacity of pooled measurements
+        measurement->values.resize(d_channels.size());
+        measurement->errors.resize(d_channels.size());
+        for (size_t c = 0; c < d_channels.size(); c++) {
+          const float *values = static_cast<const float *>(input_items[2 * c]) + i;
+          const float *errors = static_cast<const float *>(input_items[2 * c + 1]) + i;
+          measurement->values[c].assign(values, values + d_output_package_size);
+          measurement->errors[c].assign(errors, errors + d_output_package_size);
+        }
+
+        package_offset += d_output_package_size;
+
+        if (d_dispatcher.is_async()) {
+          queued_measurement_t item;
+          item.measurement = measurement;
+          d_dispatcher.push(std::move(item));
+          continue;
+        }
+
+        DIGITIZERS_PROBE1(sink_callback_start, d_metadata[0].name.c_str());
+        d_cb_measurement(measurement, d_measurement_userdata);
+        DIGITIZERS_PROBE1(sink_callback_end, d_metadata[0].name.c_str());
+      }
+
+      return ninput_items;
+    }
+
+    void
+    multi_time_domain_sink_impl::decode_measurement_info(uint64_t package_offset, measurement_info_t &info)
+    {
+      const auto package_end = package_offset + d_output_package_size;
+
+      info.trigger_timestamp = -1;
+      info.status = 0;
+      info.pre_trigger_samples = d_pre_samples;
+      info.post_trigger_samples = d_sink_mode == TIME_SINK_MODE_TRIGGERED ? d_post_samples
+              : static_cast<uint32_t>(d_output_package_size);
+      info.samples_lost = 0;
+
+      bool trigger_found = false;
+      uint64_t trigger_offset = 0;
+      size_t ntriggered = 0;
+      bool misaligned = false;
+      const channel_t *timing = nullptr;
+
+      for (auto &channel : d_channels) {
+        auto end = std::find_if(channel.next_tag, channel.work_tags.cend(), [package_end](const gr::tag_t &tag) {
+          return tag.offset >= package_end; });
+
+        bool channel_triggered = false;
+        for (auto tag = channel.next_tag; tag != end; ++tag) {
+          const auto kind = get_tag_kind(*tag);
+          if (kind == TAG_KIND_ACQ_INFO) {
+            channel.acq_info = decode_acq_info_tag(*tag);
+            channel.acq_info_offset = tag->offset;
+            channel.acq_info_valid = true;
+          }
+          else if (kind == TAG_KIND_TRIGGER && !channel_triggered) {
+            channel_triggered = true;
+            auto trigger = decode_trigger_tag(*tag);
+            info.status |= trigger.status;
+
+            if (!trigger_found) {
+              trigger_found = true;
+              trigger_offset = tag->offset;
+              info.trigger_timestamp = trigger.timestamp;
+              info.pre_trigger_samples = static_cast<uint32_t>(tag->offset - package_offset);
+              info.post_trigger_samples = static_cast<uint32_t>(d_output_package_size) - info.pre_trigger_samples;
+            }
+            else if (tag->offset != trigger_offset) {
+              misaligned = true;
+            }
+          }
+        }
+        channel.next_tag = end;
+
+        if (channel_triggered) {
+          ntriggered++;
+        }
+
+        if (channel.acq_info_valid) {
+          info.status |= channel.acq_info.status;
+          if (timing == nullptr) {
+            timing = &channel;
+          }
+        }
+      }
+
+      if (misaligned || (trigger_found && ntriggered != d_channels.size())) {
+        d_misaligned++;
+      }
+
+      if (timing == nullptr) {
+        info.timebase = 0.0;
+        info.user_delay = 0.0;
+        info.actual_delay = 0.0;
+        info.timestamp = -1;
+        return;
+      }
+
+      const auto &acq_info = timing->acq_info;
+      info.timebase = acq_info.timebase;
+      info.user_delay = acq_info.user_delay;
+      info.actual_delay = acq_info.actual_delay;
+
+      // Timestamp of the first sample, the acq_info tag might be within the package
+      const double distance = static_cast<double>(package_offset) - static_cast<double>(timing->acq_info_offset);
+      info.timestamp = acq_info.timestamp < 0 ? -1
+              : acq_info.timestamp + static_cast<int64_t>(distance * acq_info.timebase * 1000000000.0);
+    }
+
+    void
+    multi_time_domain_sink_impl::dispatch_measurement(queued_measurement_t &item)
+    {
+      if (!d_cb_measurement) {
+        return;
+      }
+
+      // Packages dropped since the previous measurement (queue full, decimated or evicted),
+      // i.e. the gap to the previous measurement delivered
+      const auto offset = item.measurement->offset;
+      if (offset > d_next_offset) {
+        item.measurement->info.samples_lost = offset - d_next_offset;
+      }
+      d_next_offset = offset + d_output_package_size;
+
+      DIGITIZERS_PROBE1(sink_callback_start, d_metadata[0].name.c_str());
+      d_cb_measurement(item.measurement, d_measurement_userdata);
+      DIGITIZERS_PROBE1(sink_callback_end, d_metadata[0].name.c_str());
+    }
+
+    int
+    multi_time_domain_sink_impl::nchannels() const
+    {
+      return static_cast<int>(d_channels.size());
+    }
+
+    std::vector<signal_metadata_t>
+    multi_time_domain_sink_impl::get_metadata()
+    {
+      return d_metadata;
+    }
+
+    void
+    multi_time_domain_sink_impl::set_measurement_callback(cb_multi_measurement_t cb_measurement, void* userdata,
+            size_t pool_size)
+    {
+      // Measurements still held by the host application are not affected
+      d_measurement_pool = object_pool_t<multi_measurement_package_t>::make(pool_size);
+      d_cb_measurement = cb_measurement;
+      d_measurement_userdata = userdata;
+    }
+
+    void
+    multi_time_domain_sink_impl::set_async_dispatch(dispatch_policy_t policy, size_t queue_size)
+    {
+      d_dispatcher.configure(policy, queue_size);
+    }
+
+    uint64_t
+    multi_time_domain_sink_impl::get_dropped_count()
+    {
+      return d_dispatcher.get_dropped_count();
+    }
+
+    uint64_t
+    multi_time_domain_sink_impl::get_misaligned_count()
+    {
+      return d_misaligned;
+    }
+
+    size_t
+    multi_time_domain_sink_impl::get_output_package_size()
+    {
+      return d_output_package_size;
+    }
+
+    float
+    multi_time_domain_sink_impl::get_sample_rate()
+    {
+      return d_samp_rate;
+    }
+
+    time_sink_mode_t
+    multi_time_domain_sink_impl::get_sink_mode()
+    {
+      return d_sink_mode;
+    }
+
+    uint32_t
+    multi_time_domain_sink_impl::get_pre_samples()
+    {
+      return d_pre_samples;
+    }
+
+    uint32_t
+    multi_time_domain_sink_impl::get_post_samples()
+    {
+      return d_post_samples;
+    }
+
+  } /* namespace digitizers */
+} /* namespace gr */
@@ -0,0 +1,115 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_MULTI_TIME_DOMAIN_SINK_IMPL_H
+#define INCLUDED_DIGITIZERS_MULTI_TIME_DOMAIN_SINK_IMPL_H
+
+#include <digitizers/multi_time_domain_sink.h>
+#include <digitizers/tags.h>
+#include "package_pool.h"
+#include "async_dispatcher.h"
+#include "block_stats_impl.h"
+
+namespace gr {
+  namespace digitizers {
+
+    class multi_time_domain_sink_impl : public multi_time_domain_sink
+    {
+     private:
+      float d_samp_rate;
+      time_sink_mode_t d_sink_mode;
+      std::vector<signal_metadata_t> d_metadata;
+      std::size_t d_output_package_size;
+
+      // only used for triggered mode
+      uint32_t d_pre_samples;
+      uint32_t d_post_samples;
+
+      cb_multi_measurement_t d_cb_measurement;
+      void* d_measurement_userdata;
+      object_pool_t<multi_measurement_package_t>::sptr d_measurement_pool;
+
+      // Tag state of a channel
+      struct channel_t
+      {
+        acq_info_t acq_info;
+        uint64_t acq_info_offset;
+        bool acq_info_valid;
+
+        // Reused in order to avoid allocations per package
+        std::vector<gr::tag_t> work_tags;
+        std::vector<gr::tag_t>::const_iterator next_tag;
+      };
+
+      std::vector<channel_t> d_channels;
+
+      uint64_t d_misaligned;
+
+      struct queued_measurement_t
+      {
+        boost::shared_ptr<multi_measurement_package_t> measurement;
+      };
+
+      async_dispatcher_t<queued_measurement_t> d_dispatcher;
+
+      // Offset following the last measurement delivered, dispatch thread only
+      uint64_t d_next_offset;
+
+      void init(const std::vector<std::string> &signal_names, const std::string &unit);
+
+      /*!
+       * \brief Decodes the tags of the package of all the channels into the measurement info,
+       * the package ends at package_offset + d_output_package_size.
+       */
+      void decode_measurement_info(uint64_t package_offset, measurement_info_t &info);
+
+      void dispatch_measurement(queued_measurement_t &item);
+
+      block_stats_recorder_t d_stats {this};
+
+     public:
+
+      multi_time_domain_sink_impl(const std::vector<std::string> &signal_names, std::string unit,
+              float samp_rate, time_sink_mode_t mode, size_t output_package_size);
+
+      multi_time_domain_sink_impl(const std::vector<std::string> &signal_names, std::string unit,
+              float samp_rate, time_sink_mode_t mode, int pre_samples, int post_samples);
+
+      ~multi_time_domain_sink_impl();
+
+      bool start() override;
+
+      bool stop() override;
+
+      int work(int noutput_items, gr_vector_const_void_star &input_items, gr_vector_void_star &output_items) override;
+
+      int nchannels() const override;
+
+      std::vector<signal_metadata_t> get_metadata() override;
+
+      void set_measurement_callback(cb_multi_measurement_t cb_measurement, void* userdata, size_t pool_size) override;
+
+      void set_async_dispatch(dispatch_policy_t policy, size_t queue_size) override;
+
+      uint64_t get_dropped_count() override;
+
+      uint64_t get_misaligned_count() override;
+
+      size_t get_output_package_size() override;
+
+      float get_sample_rate() override;
+
+      time_sink_mode_t get_sink_mode() override;
+
+      uint32_t get_pre_samples() override;
+
+      uint32_t get_post_samples() override;
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_MULTI_TIME_DOMAIN_SINK_IMPL_H */
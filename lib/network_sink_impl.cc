@@ -0,0 +1,491 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gnuradio/io_signature.h>
+#include <digitizers/raw_codec.h>
+#include <digitizers/lossy_codec.h>
+#include "network_sink_impl.h"
+#include "thread_registry.h"
+#include "utils.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+namespace gr {
+  namespace digitizers {
+
+    static int64_t
+    network_now_ns()
+    {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(
+              std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    network_sink::sptr
+    network_sink::make(int port, int package_size, int decimation, double max_frame_rate,
+            int max_subscribers, bool raw_input, float quantization)
+    {
+      return gnuradio::get_initial_sptr
+        (new network_sink_impl(port, package_size, decimation, max_frame_rate, max_subscribers,
+                raw_input, quantization));
+    }
+
+    /*
+     * The private constructor
+     */
+    network_sink_impl::network_sink_impl(int port, int package_size, int decimation,
+            double max_frame_rate, int max_subscribers, bool raw_input, float quantization)
+      : gr::sync_block("network_sink",
+              raw_input ? gr::io_signature::make(1, 1, sizeof(int16_t))
+                        : gr::io_signature::make(1, 2, sizeof(float)),
+              gr::io_signature::make(0, 0, 0)),
+        d_package_size(package_size),
+        d_decimation(decimation),
+        d_max_frame_rate(max_frame_rate),
+        d_max_subscribers(max_subscribers),
+        d_raw_input(raw_input),
+        d_quantization(quantization),
+        d_listen_fd(-1),
+        d_port(port),
+        d_raw_scaling(),
+        d_tag_forwarding(false),
+        d_acq_info(),
+        d_acq_info_offset(0),
+        d_acq_info_valid(false),
+        d_sequence(0),
+        d_sent_frames(0),
+        d_skipped_frames(0)
+    {
+      if (port < 0 || port > 65535 || package_size < 1 || decimation < 1 || max_frame_rate < 0.0
+              || max_subscribers < 1) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid port (" << port
+                << "), package size (" << package_size << "), decimation (" << decimation
+                << "), frame rate (" << max_frame_rate << ") or number of subscribers ("
+                << max_subscribers << ")";
+        throw std::invalid_argument(message.str());
+      }
+
+      if (quantization < 0.0f || (quantization > 0.0f && raw_input)) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid quantization ("
+                << quantization << "), not applicable to raw input";
+        throw std::invalid_argument(message.str());
+      }
+
+      d_listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+      int reuse = 1;
+      sockaddr_in addr;
+      std::memset(&addr, 0, sizeof(addr));
+      addr.sin_family = AF_INET;
+      addr.sin_addr.s_addr = htonl(INADDR_ANY);
+      addr.sin_port = htons(static_cast<uint16_t>(port));
+      socklen_t addr_len = sizeof(addr);
+
+      if (d_listen_fd < 0
+              || setsockopt(d_listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) != 0
+              || bind(d_listen_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0
+              || listen(d_listen_fd, max_subscribers) != 0
+              || getsockname(d_listen_fd, reinterpret_cast<sockaddr *>(&addr), &addr_len) != 0) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": failed to listen on port "
+                << port << ": " << std::strerror(errno);
+        if (d_listen_fd >= 0) {
+          close(d_listen_fd);
+        }
+        throw std::runtime_error(message.str());
+      }
+
+      d_port = ntohs(addr.sin_port);
+
+      // Whole frames are sent, decimated samples of a frame come from the same work call
+      set_output_multiple(package_size * decimation);
+
+      d_stats.set_loss_counter([this] { return d_skipped_frames.load(); });
+    }
+
+    network_sink_impl::~network_sink_impl()
+    {
+      d_accept_thread.interrupt();
+      d_accept_thread.join();
+
+      close_subscribers();
+      close(d_listen_fd);
+    }
+
+    size_t
+    network_sink_impl::get_nr_subscribers() const
+    {
+      boost::mutex::scoped_lock lock(d_mutex);
+      return d_subscribers.size();
+    }
+
+    bool
+    network_sink_impl::start()
+    {
+      {
+        boost::mutex::scoped_lock lock(d_mutex);
+        accept_pending();
+      }
+
+      d_acq_info_valid = false;
+      d_raw_scaling = raw_scaling_t();
+      d_sequence = 0;
+      d_sent_frames = 0;
+      d_skipped_frames = 0;
+
+      d_accept_thread = boost::thread(&network_sink_impl::accept_work_function, this);
+      return true;
+    }
+
+    bool
+    network_sink_impl::stop()
+    {
+      d_accept_thread.interrupt();
+      d_accept_thread.join();
+
+      close_subscribers();
+      return true;
+    }
+
+    void
+    network_sink_impl::accept_pending()
+    {
+      while (true) {
+        int fd = accept4(d_listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+          return;
+        }
+
+        if (d_subscribers.size() >= static_cast<size_t>(d_max_subscribers)) {
+          close(fd);
+          continue;
+        }
+
+        // Frames are written in one go, no need to wait for more data
+        int nodelay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+        d_subscribers.push_back(subscriber_t {fd, 0, 0, {}});
+      }
+    }
+
+    void
+    network_sink_impl::accept_work_function()
+    {
+      thread_scope_t thread(get_block_name(this), "accept");
+
+      try {
+        while (true) {
+          pollfd pfd {d_listen_fd, POLLIN, 0};
+          if (poll(&pfd, 1, 100) > 0) {
+            boost::mutex::scoped_lock lock(d_mutex);
+            accept_pending();
+          }
+
+          boost::this_thread::interruption_point();
+        }
+      }
+      catch (const boost::thread_interrupted &) {
+        // stopped
+      }
+    }
+
+    void
+    network_sink_impl::close_subscribers()
+    {
+      boost::mutex::scoped_lock lock(d_mutex);
+
+      for (auto &subscriber : d_subscribers) {
+        close(subscriber.fd);
+      }
+      d_subscribers.clear();
+    }
+
+    void
+    network_sink_impl::update_measurement_info(uint64_t offset, int nsamples_in, measurement_info_t &info)
+    {
+      std::vector<gr::tag_t> tags;
+      get_tags_in_range(tags, 0, offset, offset + nsamples_in);
+
+      info.trigger_timestamp = -1;
+      info.status = 0;
+      info.pre_trigger_samples = 0;
+      info.post_trigger_samples = d_package_size;
+
+      for (const auto &tag : tags) {
+        const auto kind = get_tag_kind(tag);
+        if (kind == TAG_KIND_ACQ_INFO) {
+          d_acq_info = decode_acq_info_tag(tag);
+          d_acq_info_offset = tag.offset;
+          d_acq_info_valid = true;
+        }
+        else if (kind == TAG_KIND_TRIGGER && info.trigger_timestamp < 0) {
+          auto trigger = decode_trigger_tag(tag);
+          info.trigger_timestamp = trigger.timestamp;
+          info.pre_trigger_samples = (tag.offset - offset) / d_decimation;
+          info.post_trigger_samples = d_package_size - info.pre_trigger_samples;
+          info.status |= trigger.status;
+        }
+        else if (kind == TAG_KIND_RAW_SCALING) {
+          d_raw_scaling = decode_raw_scaling_tag(tag);
+        }
+      }
+
+      if (!d_acq_info_valid) {
+        info.timebase = 0.0;
+        info.user_delay = 0.0;
+        info.actual_delay = 0.0;
+        info.timestamp = -1;
+        return;
+      }
+
+      info.timebase = d_acq_info.timebase * d_decimation;
+      info.user_delay = d_acq_info.user_delay;
+      info.actual_delay = d_acq_info.actual_delay;
+      info.status |= d_acq_info.status;
+
+      // Timestamp of the first sample, the acq_info tag might be within the frame
+      const double distance = static_cast<double>(offset) - static_cast<double>(d_acq_info_offset);
+      info.timestamp = d_acq_info.timestamp < 0 ? -1
+              : d_acq_info.timestamp + static_cast<int64_t>(distance * d_acq_info.timebase * 1000000000.0);
+    }
+
+    void
+    network_sink_impl::serialize_tags(uint64_t offset, int nsamples_in)
+    {
+      std::vector<gr::tag_t> tags;
+      get_tags_in_range(tags, 0, offset, offset + nsamples_in);
+
+      auto append = [this](uint32_t value) {
+        const auto bytes = reinterpret_cast<const uint8_t *>(&value);
+        d_tag_data.insert(d_tag_data.end(), bytes, bytes + sizeof(value));
+      };
+
+      d_tag_data.clear();
+      append(static_cast<uint32_t>(tags.size()));
+
+      for (const auto &tag : tags) {
+        const auto serialized = pmt::serialize_str(pmt::cons(tag.key, tag.value));
+        append(static_cast<uint32_t>((tag.offset - offset) / d_decimation));
+        append(static_cast<uint32_t>(serialized.size()));
+        d_tag_data.insert(d_tag_data.end(), serialized.begin(), serialized.end());
+      }
+    }
+
+    bool
+    network_sink_impl::send_frame(subscriber_t &subscriber, network_frame_header_t header,
+            const iovec *payload, int npayload, int64_t now_ns)
+    {
+      const int flags = MSG_DONTWAIT | MSG_NOSIGNAL;
+
+      auto would_block = [] {
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+      };
+
+      auto skip = [this, &subscriber, &header] {
+        subscriber.samples_lost += header.nsamples;
+        d_skipped_frames++;
+        return true;
+      };
+
+      // Remainder of the previous frame goes first
+      if (!subscriber.backlog.empty()) {
+        auto n = send(subscriber.fd, subscriber.backlog.data(), subscriber.backlog.size(), flags);
+        if (n < 0 && !would_block()) {
+          return false;
+        }
+        if (n > 0) {
+          subscriber.backlog.erase(subscriber.backlog.begin(), subscriber.backlog.begin() + n);
+        }
+        if (!subscriber.backlog.empty()) {
+          return skip();
+        }
+      }
+
+      if (d_max_frame_rate > 0.0 && now_ns < subscriber.next_frame_ns) {
+        return skip();
+      }
+
+      header.info.samples_lost = subscriber.samples_lost;
+
+      iovec iov[4] = {{&header, sizeof(header)}};
+      for (int i = 0; i < npayload; i++) {
+        iov[i + 1] = payload[i];
+      }
+
+      msghdr msg;
+      std::memset(&msg, 0, sizeof(msg));
+      msg.msg_iov = iov;
+      msg.msg_iovlen = npayload + 1;
+
+      auto n = sendmsg(subscriber.fd, &msg, flags);
+      if (n < 0) {
+        return would_block() ? skip() : false;
+      }
+
+      // Partially sent, the remainder is copied aside and completed before the next frame
+      size_t sent = n;
+      for (size_t i = 0; i < msg.msg_iovlen; i++) {
+        const auto base = static_cast<const char *>(iov[i].iov_base);
+        if (sent >= iov[i].iov_len) {
+          sent -= iov[i].iov_len;
+          continue;
+        }
+        subscriber.backlog.insert(subscriber.backlog.end(), base + sent, base + iov[i].iov_len);
+        sent = 0;
+      }
+
+      subscriber.samples_lost = 0;
+      if (d_max_frame_rate > 0.0) {
+        subscriber.next_frame_ns = now_ns + static_cast<int64_t>(1000000000.0 / d_max_frame_rate);
+      }
+
+      d_sent_frames++;
+      return true;
+    }
+
+    int
+    network_sink_impl::work(int noutput_items,
+        gr_vector_const_void_star &input_items,
+        gr_vector_void_star &output_items)
+    {
+      block_stats_scope_t stats(d_stats);
+
+      const float *in_values = static_cast<const float *>(input_items[0]);
+      const float *in_errors = input_items.size() > 1 ? static_cast<const float *>(input_items[1]) : nullptr;
+
+      const int frame_items = d_package_size * d_decimation;
+      const int nframes = noutput_items / frame_items;
+      const auto samp0_count = nitems_read(0);
+      const auto now_ns = network_now_ns();
+
+      boost::mutex::scoped_lock lock(d_mutex);
+
+      for (int f = 0; f < nframes; f++) {
+        const auto offset = samp0_count + static_cast<uint64_t>(f) * frame_items;
+
+        network_frame_header_t header;
+        std::memset(&header, 0, sizeof(header));
+        header.magic = NETWORK_FRAME_MAGIC;
+        header.version = NETWORK_FRAME_VERSION;
+        const bool lossy = d_quantization > 0.0f && in_errors != nullptr;
+        header.flags = d_raw_input ? NETWORK_FRAME_RAW_COMPRESSED
+                : in_errors != nullptr ? NETWORK_FRAME_HAS_ERRORS : 0;
+        if (lossy) {
+          header.flags |= NETWORK_FRAME_LOSSY_COMPRESSED;
+          header.quantization = d_quantization;
+        }
+        if (d_tag_forwarding) {
+          header.flags |= NETWORK_FRAME_HAS_TAGS;
+        }
+        header.header_size = sizeof(header);
+        header.nsamples = d_package_size;
+        header.sequence = d_sequence++;
+        header.offset = offset / d_decimation;
+        update_measurement_info(offset, frame_items, header.info);
+        header.scaling = d_raw_scaling;
+
+        if (d_subscribers.empty()) {
+          continue;
+        }
+
+        iovec payload[3];
+        int npayload = 1;
+
+        if (d_raw_input) {
+          const int16_t *raw = static_cast<const int16_t *>(input_items[0]) + f * frame_items;
+          if (d_decimation > 1) {
+            d_raw_samples.resize(d_package_size);
+            for (int i = 0; i < d_package_size; i++) {
+              d_raw_samples[i] = raw[i * d_decimation];
+            }
+            raw = d_raw_samples.data();
+          }
+
+          // Encoded once for all the subscribers
+          d_encoded.resize(raw_encode_bound(d_package_size));
+          payload[0] = {d_encoded.data(), raw_encode(raw, d_package_size, d_encoded.data())};
+        }
+        else {
+          const float *values = in_values + f * frame_items;
+          const float *errors = in_errors != nullptr ? in_errors + f * frame_items : nullptr;
+
+          // Decimated samples need to be gathered, otherwise sent straight out of the input
+          if (d_decimation > 1) {
+            d_values.resize(d_package_size);
+            d_errors.resize(d_package_size);
+            for (int i = 0; i < d_package_size; i++) {
+              d_values[i] = values[i * d_decimation];
+            }
+            if (errors != nullptr) {
+              for (int i = 0; i < d_package_size; i++) {
+                d_errors[i] = errors[i * d_decimation];
+              }
+              errors = d_errors.data();
+            }
+            values = d_values.data();
+          }
+
+          if (lossy) {
+            // Encoded once for all the subscribers, the errors are the bounds of both
+            d_encoded.resize(2 * lossy_encode_bound(d_package_size));
+            auto size = lossy_encode(values, errors, d_package_size, d_quantization, d_encoded.data());
+            size += lossy_encode(errors, errors, d_package_size, d_quantization, d_encoded.data() + size);
+            payload[0] = {d_encoded.data(), size};
+          }
+          else {
+            const size_t array_size = d_package_size * sizeof(float);
+            payload[0] = {const_cast<float *>(values), array_size};
+            payload[1] = {const_cast<float *>(errors), array_size};
+            npayload = errors != nullptr ? 2 : 1;
+          }
+        }
+
+        // Serialized once for all the subscribers
+        if (d_tag_forwarding) {
+          serialize_tags(offset, frame_items);
+          payload[npayload++] = {d_tag_data.data(), d_tag_data.size()};
+        }
+
+        header.payload_size = 0;
+        for (int i = 0; i < npayload; i++) {
+          header.payload_size += payload[i].iov_len;
+        }
+
+        for (auto it = d_subscribers.begin(); it != d_subscribers.end(); ) {
+          if (send_frame(*it, header, payload, npayload, now_ns)) {
+            ++it;
+          }
+          else {
+            close(it->fd);
+            it = d_subscribers.erase(it);
+          }
+        }
+      }
+
+      return nframes * frame_items;
+    }
+
+  } /* namespace digitizers */
+} /* namespace gr */
@@ -0,0 +1,119 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_NETWORK_SINK_IMPL_H
+#define INCLUDED_DIGITIZERS_NETWORK_SINK_IMPL_H
+
+#include <digitizers/network_sink.h>
+#include <digitizers/tags.h>
+#include "block_stats_impl.h"
+
+#include <sys/uio.h>
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <atomic>
+#include <vector>
+
+namespace gr {
+  namespace digitizers {
+
+    class network_sink_impl : public network_sink
+    {
+     public:
+      network_sink_impl(int port, int package_size, int decimation, double max_frame_rate,
+              int max_subscribers, bool raw_input, float quantization);
+
+      ~network_sink_impl();
+
+      int get_port() const override { return d_port; }
+
+      size_t get_nr_subscribers() const override;
+
+      uint64_t get_sent_frames() const override { return d_sent_frames; }
+
+      uint64_t get_skipped_frames() const override { return d_skipped_frames; }
+
+      void set_tag_forwarding(bool enabled) override { d_tag_forwarding = enabled; }
+
+      bool start() override;
+
+      bool stop() override;
+
+      int work(int noutput_items,
+          gr_vector_const_void_star &input_items,
+          gr_vector_void_star &output_items) override;
+
+     private:
+      struct subscriber_t
+      {
+        int fd;
+        int64_t next_frame_ns;         // rate limit, earliest time of the next frame
+        uint64_t samples_lost;         // samples of the frames skipped since the last frame sent
+        std::vector<char> backlog;     // unsent remainder of the last frame
+      };
+
+      // Accepts pending connections, called with the subscriber mutex held
+      void accept_pending();
+
+      void accept_work_function();
+
+      void close_subscribers();
+
+      // Fills the measurement info of the frame starting at the given input offset
+      void update_measurement_info(uint64_t offset, int nsamples_in, measurement_info_t &info);
+
+      // Serializes the tags of the frame starting at the given input offset into d_tag_data
+      void serialize_tags(uint64_t offset, int nsamples_in);
+
+      // Sends the frame (header followed by up to three payload arrays), returns false if the
+      // subscriber is gone
+      bool send_frame(subscriber_t &subscriber, network_frame_header_t header,
+              const iovec *payload, int npayload, int64_t now_ns);
+
+      const int d_package_size;
+      const int d_decimation;
+      const double d_max_frame_rate;
+      const int d_max_subscribers;
+      const bool d_raw_input;
+      const float d_quantization;
+
+      int d_listen_fd;
+      int d_port;
+
+      mutable boost::mutex d_mutex;
+      std::vector<subscriber_t> d_subscribers;
+      boost::thread d_accept_thread;
+
+      // Decimated samples of the current frame
+      std::vector<float> d_values;
+      std::vector<float> d_errors;
+
+      // Raw input, decimated samples and the encoded frame payload (lossy compression too)
+      std::vector<int16_t> d_raw_samples;
+      std::vector<uint8_t> d_encoded;
+      raw_scaling_t d_raw_scaling;
+
+      // Forwarded tags of the current frame, see network_frame_header_t
+      bool d_tag_forwarding;
+      std::vector<uint8_t> d_tag_data;
+
+      // Latest acq_info tag
+      acq_info_t d_acq_info;
+      uint64_t d_acq_info_offset;
+      bool d_acq_info_valid;
+
+      uint64_t d_sequence;
+      std::atomic<uint64_t> d_sent_frames;
+      std::atomic<uint64_t> d_skipped_frames;
+
+      block_stats_recorder_t d_stats {this};
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_NETWORK_SINK_IMPL_H */
@@ -0,0 +1,345 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gnuradio/io_signature.h>
+#include <digitizers/raw_codec.h>
+#include <digitizers/lossy_codec.h>
+#include "network_source_impl.h"
+
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+namespace gr {
+  namespace digitizers {
+
+    network_source::sptr
+    network_source::make(std::string host, int port)
+    {
+      return gnuradio::get_initial_sptr
+        (new network_source_impl(host, port));
+    }
+
+    /*
+     * The private constructor
+     */
+    network_source_impl::network_source_impl(std::string host, int port)
+      : gr::sync_block("network_source",
+              gr::io_signature::make(0, 0, 0),
+              gr::io_signature::make(1, 2, sizeof(float))),
+        d_host(host),
+        d_port(port),
+        d_fd(-1),
+        d_closed(true),
+        d_position(0),
+        d_next_sequence(0),
+        d_received_frames(0),
+        d_samples_lost(0)
+    {
+      if (host.empty() || port < 1 || port > 65535) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid host (" << host
+                << ") or port (" << port << ")";
+        throw std::invalid_argument(message.str());
+      }
+    }
+
+    network_source_impl::~network_source_impl()
+    {
+      close_connection();
+    }
+
+    bool
+    network_source_impl::start()
+    {
+      close_connection();
+
+      addrinfo hints;
+      std::memset(&hints, 0, sizeof(hints));
+      hints.ai_family = AF_UNSPEC;
+      hints.ai_socktype = SOCK_STREAM;
+
+      addrinfo *addresses = nullptr;
+      const auto service = std::to_string(d_port);
+      const int rc = getaddrinfo(d_host.c_str(), service.c_str(), &hints, &addresses);
+      if (rc != 0) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": failed to resolve "
+                << d_host << ": " << gai_strerror(rc);
+        throw std::runtime_error(message.str());
+      }
+
+      for (auto address = addresses; address != nullptr && d_fd < 0; address = address->ai_next) {
+        d_fd = socket(address->ai_family, address->ai_socktype | SOCK_CLOEXEC, address->ai_protocol);
+        if (d_fd >= 0 && connect(d_fd, address->ai_addr, address->ai_addrlen) != 0) {
+          close(d_fd);
+          d_fd = -1;
+        }
+      }
+      freeaddrinfo(addresses);
+
+      if (d_fd < 0) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": failed to connect to "
+                << d_host << ":" << d_port << ": " << std::strerror(errno);
+        throw std::runtime_error(message.str());
+      }
+
+      d_closed = false;
+      d_values.clear();
+      d_errors.clear();
+      d_tags.clear();
+      d_position = 0;
+      d_next_sequence = 0;
+      d_received_frames = 0;
+      d_samples_lost = 0;
+      return true;
+    }
+
+    bool
+    network_source_impl::stop()
+    {
+      close_connection();
+      return true;
+    }
+
+    void
+    network_source_impl::close_connection()
+    {
+      if (d_fd >= 0) {
+        close(d_fd);
+        d_fd = -1;
+      }
+      d_closed = true;
+    }
+
+    bool
+    network_source_impl::receive(void *data, size_t size)
+    {
+      auto bytes = static_cast<char *>(data);
+
+      while (size > 0) {
+        auto n = recv(d_fd, bytes, size, MSG_WAITALL);
+        if (n < 0 && errno == EINTR) {
+          continue;
+        }
+        if (n <= 0) {
+          return false;
+        }
+        bytes += n;
+        size -= n;
+      }
+
+      return true;
+    }
+
+    void
+    network_source_impl::parse_tags(const uint8_t *data, size_t size)
+    {
+      const uint8_t *end = data + size;
+
+      auto read = [&data, end](void *value, size_t n) {
+        if (static_cast<size_t>(end - data) < n) {
+          std::ostringstream message;
+          message << "Exception in " << __FILE__ << ":" << __LINE__ << ": truncated tags";
+          throw std::invalid_argument(message.str());
+        }
+        std::memcpy(value, data, n);
+        data += n;
+      };
+
+      uint32_t ntags = 0;
+      read(&ntags, sizeof(ntags));
+
+      for (uint32_t i = 0; i < ntags; i++) {
+        uint32_t offset = 0, tag_size = 0;
+        read(&offset, sizeof(offset));
+        read(&tag_size, sizeof(tag_size));
+
+        std::string serialized(tag_size, '\0');
+        read(&serialized[0], tag_size);
+
+        const auto pair = pmt::deserialize_str(serialized);
+        d_tags.push_back(frame_tag_t {offset, pmt::car(pair), pmt::cdr(pair)});
+      }
+    }
+
+    void
+    network_source_impl::add_info_tags(const network_frame_header_t &header, bool acq_info, bool trigger)
+    {
+      const auto &info = header.info;
+
+      // No acq_info was available to the sink
+      if (acq_info && info.timebase > 0.0) {
+        acq_info_t decoded {};
+        decoded.timestamp = info.timestamp;
+        decoded.timebase = info.timebase;
+        decoded.user_delay = info.user_delay;
+        decoded.actual_delay = info.actual_delay;
+        decoded.status = info.status;
+
+        const auto tag = make_acq_info_tag(decoded, 0);
+        d_tags.insert(d_tags.begin(), frame_tag_t {0, tag.key, tag.value});
+      }
+
+      if (trigger && info.trigger_timestamp >= 0) {
+        const auto tag = make_trigger_tag(1, info.trigger_timestamp, 0, info.status);
+        d_tags.push_back(frame_tag_t {info.pre_trigger_samples, tag.key, tag.value});
+      }
+    }
+
+    bool
+    network_source_impl::read_frame(int timeout_ms)
+    {
+      if (d_closed) {
+        return false;
+      }
+
+      pollfd pfd {d_fd, POLLIN, 0};
+      if (poll(&pfd, 1, timeout_ms) <= 0) {
+        return false;
+      }
+
+      network_frame_header_t header;
+      if (!receive(&header, sizeof(header))) {
+        close_connection();
+        return false;
+      }
+
+      try {
+        if (header.magic != NETWORK_FRAME_MAGIC || header.version != NETWORK_FRAME_VERSION
+                || header.header_size < sizeof(header)) {
+          std::ostringstream message;
+          message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid frame header";
+          throw std::invalid_argument(message.str());
+        }
+
+        // Fields appended to the header by later versions are skipped
+        d_payload.resize(header.header_size - sizeof(header) + header.payload_size);
+        if (!receive(d_payload.data(), d_payload.size())) {
+          close_connection();
+          return false;
+        }
+
+        const uint8_t *payload = d_payload.data() + header.header_size - sizeof(header);
+        const size_t nsamples = header.nsamples;
+        size_t consumed = 0;
+
+        d_values.resize(nsamples);
+        d_errors.resize(nsamples);
+
+        if (header.flags & NETWORK_FRAME_RAW_COMPRESSED) {
+          d_raw_samples.resize(nsamples);
+          consumed = raw_decode(payload, header.payload_size, d_raw_samples.data(), nsamples);
+
+          const auto scale = static_cast<float>(header.scaling.scale);
+          const auto offset = static_cast<float>(header.scaling.offset);
+          for (size_t i = 0; i < nsamples; i++) {
+            d_values[i] = d_raw_samples[i] * scale + offset;
+          }
+          std::fill(d_errors.begin(), d_errors.end(), static_cast<float>(header.scaling.error));
+        }
+        else if (header.flags & NETWORK_FRAME_LOSSY_COMPRESSED) {
+          consumed = lossy_decode(payload, header.payload_size, d_values.data(), nsamples);
+          consumed += lossy_decode(payload + consumed, header.payload_size - consumed, d_errors.data(), nsamples);
+        }
+        else {
+          const size_t array_size = nsamples * sizeof(float);
+          const bool has_errors = header.flags & NETWORK_FRAME_HAS_ERRORS;
+          consumed = has_errors ? 2 * array_size : array_size;
+          if (header.payload_size < consumed) {
+            std::ostringstream message;
+            message << "Exception in " << __FILE__ << ":" << __LINE__ << ": truncated frame";
+            throw std::invalid_argument(message.str());
+          }
+
+          std::memcpy(d_values.data(), payload, array_size);
+          if (has_errors) {
+            std::memcpy(d_errors.data(), payload + array_size, array_size);
+          }
+          else {
+            std::fill(d_errors.begin(), d_errors.end(), 0.0f);
+          }
+        }
+
+        d_tags.clear();
+        const bool has_tags = header.flags & NETWORK_FRAME_HAS_TAGS;
+        if (has_tags) {
+          parse_tags(payload + consumed, header.payload_size - consumed);
+        }
+
+        // The acq_info in effect is restated whenever the stream is not contiguous
+        const bool gap = d_received_frames == 0 || header.sequence != d_next_sequence
+                || header.info.samples_lost > 0;
+        add_info_tags(header, !has_tags || gap, !has_tags);
+
+        d_samples_lost += header.info.samples_lost;
+        d_next_sequence = header.sequence + 1;
+      }
+      catch (const std::invalid_argument &e) {
+        GR_LOG_ERROR(d_logger, std::string("corrupt frame, closing the connection: ") + e.what());
+        close_connection();
+        return false;
+      }
+
+      d_position = 0;
+      d_received_frames++;
+      return true;
+    }
+
+    int
+    network_source_impl::work(int noutput_items,
+        gr_vector_const_void_star &input_items,
+        gr_vector_void_star &output_items)
+    {
+      block_stats_scope_t stats(d_stats);
+
+      float *values = static_cast<float *>(output_items[0]);
+      float *errors = output_items.size() > 1 ? static_cast<float *>(output_items[1]) : nullptr;
+
+      int produced = 0;
+      while (produced < noutput_items) {
+        // Waits for data only if nothing was produced yet
+        if (d_position == d_values.size() && !read_frame(produced == 0 ? 100 : 0)) {
+          break;
+        }
+
+        const auto n = std::min(static_cast<size_t>(noutput_items - produced), d_values.size() - d_position);
+        std::copy(&d_values[d_position], &d_values[d_position] + n, values + produced);
+        if (errors != nullptr) {
+          std::copy(&d_errors[d_position], &d_errors[d_position] + n, errors + produced);
+        }
+
+        for (const auto &tag : d_tags) {
+          if (tag.offset >= d_position && tag.offset < d_position + n) {
+            add_item_tag(0, nitems_written(0) + produced + (tag.offset - d_position), tag.key, tag.value);
+          }
+        }
+
+        d_position += n;
+        produced += n;
+      }
+
+      if (produced == 0 && d_closed) {
+        return WORK_DONE;
+      }
+
+      return produced;
+    }
+
+  } /* namespace digitizers */
+} /* namespace gr */
@@ -0,0 +1,88 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_NETWORK_SOURCE_IMPL_H
+#define INCLUDED_DIGITIZERS_NETWORK_SOURCE_IMPL_H
+
+#include <digitizers/network_source.h>
+#include <digitizers/network_sink.h>
+#include <digitizers/tags.h>
+#include "block_stats_impl.h"
+
+#include <atomic>
+#include <vector>
+
+namespace gr {
+  namespace digitizers {
+
+    class network_source_impl : public network_source
+    {
+     public:
+      network_source_impl(std::string host, int port);
+
+      ~network_source_impl();
+
+      uint64_t get_received_frames() const override { return d_received_frames; }
+
+      uint64_t get_samples_lost() const override { return d_samples_lost; }
+
+      bool start() override;
+
+      bool stop() override;
+
+      int work(int noutput_items,
+          gr_vector_const_void_star &input_items,
+          gr_vector_void_star &output_items) override;
+
+     private:
+      // Tag of the current frame, offset relative to its first sample
+      struct frame_tag_t
+      {
+        uint32_t offset;
+        pmt::pmt_t key;
+        pmt::pmt_t value;
+      };
+
+      // Receives exactly size bytes, returns false if the connection was closed
+      bool receive(void *data, size_t size);
+
+      // Receives and decodes the next frame, waits for it at most timeout_ms. Returns false if
+      // none is available (yet), d_closed is set if the connection was closed.
+      bool read_frame(int timeout_ms);
+
+      // Adds the tags derived from the measurement info of the frame
+      void add_info_tags(const network_frame_header_t &header, bool acq_info, bool trigger);
+
+      void parse_tags(const uint8_t *data, size_t size);
+
+      void close_connection();
+
+      const std::string d_host;
+      const int d_port;
+
+      int d_fd;
+      bool d_closed;
+
+      // Current frame, d_position samples of it were delivered already
+      std::vector<float> d_values;
+      std::vector<float> d_errors;
+      std::vector<frame_tag_t> d_tags;
+      size_t d_position;
+
+      std::vector<uint8_t> d_payload;
+      std::vector<int16_t> d_raw_samples;
+
+      uint64_t d_next_sequence;
+      std::atomic<uint64_t> d_received_frames;
+      std::atomic<uint64_t> d_samples_lost;
+
+      block_stats_recorder_t d_stats {this};
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_NETWORK_SOURCE_IMPL_H */
@@ -0,0 +1,171 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "notification_hub_impl.h"
+#include "thread_registry.h"
+
+#include <boost/make_shared.hpp>
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
+namespace gr {
+  namespace digitizers {
+
+    notification_hub::sptr
+    notification_hub::make(double window, size_t capacity)
+    {
+      return boost::make_shared<notification_hub_impl>(window, capacity);
+    }
+
+    static boost::posix_time::time_duration
+    to_duration(double window)
+    {
+      if (!(window >= 0.0)) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid window: " << window;
+        throw std::invalid_argument(message.str());
+      }
+
+      return boost::posix_time::microseconds(static_cast<int64_t>(std::round(window * 1e6)));
+    }
+
+    notification_hub_impl::notification_hub_impl(double window, size_t capacity)
+      : d_window(to_duration(window)),
+        d_capacity(std::max(capacity, size_t{1})),
+        d_stop(false),
+        d_callback(nullptr),
+        d_userdata(nullptr),
+        d_dropped(0),
+        d_batches(0)
+    {
+      // No allocations in steady state, the buffers are swapped
+      d_pending.reserve(d_capacity);
+
+      d_thread = boost::thread(&notification_hub_impl::delivery_function, this);
+    }
+
+    notification_hub_impl::~notification_hub_impl()
+    {
+      {
+        boost::mutex::scoped_lock lock(d_mutex);
+        d_stop = true;
+      }
+      d_cv.notify_all();
+      d_thread.join();
+    }
+
+    uint32_t
+    notification_hub_impl::register_signal(const std::string &name)
+    {
+      boost::mutex::scoped_lock lock(d_signals_mutex);
+
+      auto it = d_signal_ids.find(name);
+      if (it != d_signal_ids.end()) {
+        return it->second;
+      }
+
+      const auto id = static_cast<uint32_t>(d_signal_names.size());
+      d_signal_names.push_back(name);
+      d_signal_ids[name] = id;
+      return id;
+    }
+
+    std::string
+    notification_hub_impl::get_signal_name(uint32_t signal_id)
+    {
+      boost::mutex::scoped_lock lock(d_signals_mutex);
+
+      if (signal_id >= d_signal_names.size()) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": unknown signal id: " << signal_id;
+        throw std::invalid_argument(message.str());
+      }
+
+      return d_signal_names[signal_id];
+    }
+
+    size_t
+    notification_hub_impl::get_signal_count()
+    {
+      boost::mutex::scoped_lock lock(d_signals_mutex);
+      return d_signal_names.size();
+    }
+
+    void
+    notification_hub_impl::set_callback(notification_batch_cb_t callback, void *userdata)
+    {
+      boost::mutex::scoped_lock lock(d_callback_mutex);
+      d_callback = callback;
+      d_userdata = userdata;
+    }
+
+    void
+    notification_hub_impl::notify(uint32_t signal_id, int64_t trigger_timestamp)
+    {
+      boost::mutex::scoped_lock lock(d_mutex);
+
+      if (d_pending.size() >= d_capacity) {
+        d_dropped++;
+        return;
+      }
+
+      d_pending.push_back(notification_t{signal_id, trigger_timestamp});
+
+      // The first notification opens the window, the others are collected silently
+      if (d_pending.size() == 1) {
+        lock.unlock();
+        d_cv.notify_all();
+      }
+    }
+
+    void
+    notification_hub_impl::delivery_function()
+    {
+      thread_scope_t thread("notification_hub", "delivery");
+
+      std::vector<notification_t> batch;
+      batch.reserve(d_capacity);
+
+      while (true) {
+        {
+          boost::mutex::scoped_lock lock(d_mutex);
+          while (!d_stop && d_pending.empty()) {
+            d_cv.wait(lock);
+          }
+
+          if (d_pending.empty()) {
+            return;
+          }
+
+          // Collect the notifications of the other sinks, pending ones are delivered right
+          // away on stop
+          const auto deadline = boost::get_system_time() + d_window;
+          while (!d_stop && d_cv.timed_wait(lock, deadline)) {
+          }
+
+          batch.swap(d_pending);
+        }
+
+        {
+          boost::mutex::scoped_lock lock(d_callback_mutex);
+          if (d_callback) {
+            d_callback(batch.data(), batch.size(), d_userdata);
+          }
+        }
+
+        d_batches++;
+        batch.clear();
+      }
+    }
+
+  } /* namespace digitizers */
+} /* namespace gr */
@@ -0,0 +1,74 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_NOTIFICATION_HUB_IMPL_H
+#define INCLUDED_DIGITIZERS_NOTIFICATION_HUB_IMPL_H
+
+#include <digitizers/notification_hub.h>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <atomic>
+#include <map>
+#include <vector>
+
+namespace gr {
+  namespace digitizers {
+
+    class notification_hub_impl : public notification_hub
+    {
+     public:
+      notification_hub_impl(double window, size_t capacity);
+
+      ~notification_hub_impl();
+
+      uint32_t register_signal(const std::string &name) override;
+
+      std::string get_signal_name(uint32_t signal_id) override;
+
+      size_t get_signal_count() override;
+
+      void set_callback(notification_batch_cb_t callback, void *userdata) override;
+
+      void notify(uint32_t signal_id, int64_t trigger_timestamp) override;
+
+      uint64_t get_dropped_count() override { return d_dropped; }
+
+      uint64_t get_batch_count() override { return d_batches; }
+
+     private:
+      void delivery_function();
+
+      const boost::posix_time::time_duration d_window;
+      const size_t d_capacity;
+
+      // Registry
+      boost::mutex d_signals_mutex;
+      std::vector<std::string> d_signal_names;
+      std::map<std::string, uint32_t> d_signal_ids;
+
+      // Pending notifications, swapped with the delivery buffer by the delivery thread
+      boost::mutex d_mutex;
+      boost::condition_variable d_cv;
+      std::vector<notification_t> d_pending;
+      bool d_stop;
+
+      // Callback, changed under d_callback_mutex, i.e. never while it is being invoked
+      boost::mutex d_callback_mutex;
+      notification_batch_cb_t d_callback;
+      void *d_userdata;
+
+      std::atomic<uint64_t> d_dropped;
+      std::atomic<uint64_t> d_batches;
+
+      boost::thread d_thread;
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_NOTIFICATION_HUB_IMPL_H */
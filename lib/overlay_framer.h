@@ -0,0 +1,130 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_OVERLAY_FRAMER_H
+#define INCLUDED_DIGITIZERS_OVERLAY_FRAMER_H
+
+#include <digitizers/tags.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Frame descriptor, i.e. a window of the input stream.
+     */
+    struct overlay_frame_t
+    {
+      int start;              // relative to the first input item of the work call
+      int length;
+      acq_info_t acq_info;    // see overlay_framer_t
+    };
+
+    /*!
+     * \brief Splits a stream into (overlapped) frames of vec_size samples, the starts of the
+     * frames are spaced apart for samp_rate * delta_t samples. See stream_to_vector_overlay_ff.
+     *
+     * Frames are not copied, blocks read them in place from their input buffer. The framer also
+     * keeps track of the acq_info tags, each frame gets the acq_info of the last tag found in
+     * the samples skipped before the frame or within the frame.
+     */
+    class overlay_framer_t
+    {
+    public:
+
+      overlay_framer_t(int vec_size, double samp_rate, double delta_t)
+        : d_vec_size(vec_size),
+          d_samp_rate(samp_rate),
+          d_delta_t(delta_t),
+          d_offset(0),
+          d_acq_info(),
+          d_tag_offset(0)
+      {
+        d_acq_info.timestamp = -1;
+      }
+
+      int vec_size() const
+      {
+        return d_vec_size;
+      }
+
+      void reset_acq_info()
+      {
+        d_acq_info.timestamp = -1;
+      }
+
+      /*!
+       * \brief Finds the frames within ninput samples, up to max_frames. For each region
+       * visited (samples skipped and frames) get_tags(start, count) is invoked, it returns the
+       * acq_info tags in that range. Returns the number of samples to consume.
+       *
+       * \param first_offset absolute offset of the first input sample, i.e. nitems_read
+       */
+      template <typename GetTags>
+      int next_frames(uint64_t first_offset, int ninput, int max_frames,
+              std::vector<overlay_frame_t> &frames, GetTags get_tags)
+      {
+        frames.clear();
+        int pos = 0;
+
+        while (static_cast<int>(frames.size()) < max_frames) {
+          if (d_offset >= 1.0) {
+            //move along until new samples arrive
+            int consumable_count = std::min(ninput - pos, static_cast<int>(d_offset));
+            if (consumable_count == 0) {
+              break;
+            }
+            save_tags(get_tags(pos, consumable_count));
+            d_offset -= consumable_count;
+            pos += consumable_count;
+          }
+          else if (pos + d_vec_size <= ninput) {
+            save_tags(get_tags(pos, d_vec_size));
+            frames.push_back(overlay_frame_t{pos, d_vec_size, frame_acq_info(first_offset + pos)});
+            d_offset += d_delta_t * d_samp_rate;
+          }
+          else {
+            break;
+          }
+        }
+
+        return pos;
+      }
+
+    private:
+
+      acq_info_t frame_acq_info(uint64_t frame_offset)
+      {
+        //fix offset.
+        if (d_acq_info.timestamp != -1) {
+          d_acq_info.timestamp += ((frame_offset - d_tag_offset) * d_samp_rate);
+        }
+        return d_acq_info;
+      }
+
+      void save_tags(const std::vector<gr::tag_t> &tags)
+      {
+        if(tags.size() != 0) {
+          d_acq_info = decode_acq_info_tag(tags.back());
+          d_tag_offset = tags.back().offset;
+        }
+      }
+
+      int d_vec_size;
+      double d_samp_rate;
+      double d_delta_t;
+      double d_offset;
+      acq_info_t d_acq_info;
+      uint64_t d_tag_offset;
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_OVERLAY_FRAMER_H */
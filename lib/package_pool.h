@@ -0,0 +1,136 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_PACKAGE_POOL_H
+#define INCLUDED_DIGITIZERS_PACKAGE_POOL_H
+
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/weak_ptr.hpp>
+
+#include <vector>
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Pool of reference counted objects.
+     *
+     * Objects handed out by acquire are returned to the pool when the last reference goes away,
+     * whichever thread that happens in. The objects are not reset, i.e. the reserved capacity
+     * of the contained vectors is reused.
+     *
+     * The pool never blocks nor fails, if all the objects are in use a new one is allocated.
+     * At most max_free released objects are kept for reuse, the rest is deleted. Objects
+     * released after the pool is destroyed are deleted as well.
+     */
+    template <typename T>
+    class object_pool_t : public boost::enable_shared_from_this<object_pool_t<T>>,
+                          boost::noncopyable
+    {
+    public:
+
+      typedef boost::shared_ptr<object_pool_t<T>> sptr;
+
+      static sptr make(size_t max_free)
+      {
+        return sptr(new object_pool_t<T>(max_free));
+      }
+
+      ~object_pool_t()
+      {
+        for (auto obj : d_free) {
+          delete obj;
+        }
+      }
+
+      boost::shared_ptr<T> acquire()
+      {
+        T *obj = nullptr;
+
+        {
+          boost::mutex::scoped_lock lock(d_mutex);
+          if (!d_free.empty()) {
+            obj = d_free.back();
+            d_free.pop_back();
+          }
+          else {
+            d_allocated++;
+          }
+        }
+
+        if (obj == nullptr) {
+          obj = new T();
+        }
+
+        return boost::shared_ptr<T>(obj, releaser_t(this->shared_from_this()));
+      }
+
+      /*!
+       * \brief Number of objects ready for reuse.
+       */
+      size_t free_count() const
+      {
+        boost::mutex::scoped_lock lock(d_mutex);
+        return d_free.size();
+      }
+
+      /*!
+       * \brief Number of objects allocated by the pool since it was created.
+       */
+      size_t allocated_count() const
+      {
+        boost::mutex::scoped_lock lock(d_mutex);
+        return d_allocated;
+      }
+
+    private:
+
+      explicit object_pool_t(size_t max_free)
+        : d_max_free(max_free),
+          d_allocated(0)
+      {
+        d_free.reserve(max_free);
+      }
+
+      struct releaser_t
+      {
+        explicit releaser_t(const sptr &pool) : d_pool(pool) {}
+
+        void operator()(T *obj) const
+        {
+          auto pool = d_pool.lock();
+          if (!pool || !pool->release(obj)) {
+            delete obj;
+          }
+        }
+
+        boost::weak_ptr<object_pool_t<T>> d_pool;
+      };
+
+      bool release(T *obj)
+      {
+        boost::mutex::scoped_lock lock(d_mutex);
+        if (d_free.size() >= d_max_free) {
+          return false;
+        }
+        d_free.push_back(obj);
+        return true;
+      }
+
+      const size_t d_max_free;
+      size_t d_allocated;
+      std::vector<T *> d_free;
+      mutable boost::mutex d_mutex;
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_PACKAGE_POOL_H */
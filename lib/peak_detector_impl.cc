@@ -11,15 +11,21 @@
 #include <gnuradio/io_signature.h>
 #include "peak_detector_impl.h"
 #include "utils.h"
+#include <volk/volk.h>
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
 
 namespace gr {
   namespace digitizers {
 
     peak_detector::sptr
-    peak_detector::make(double samp_rate, int vec_len, int proximity)
+    peak_detector::make(double samp_rate, int vec_len, int proximity, int npeaks)
     {
       return gnuradio::get_initial_sptr
-        (new peak_detector_impl(samp_rate, vec_len, proximity));
+        (new peak_detector_impl(samp_rate, vec_len, proximity, npeaks));
     }
 
     /*
@@ -27,19 +33,30 @@ namespace gr {
      */
     peak_detector_impl::peak_detector_impl(double samp_rate,
         int vec_len,
-        int proximity)
+        int proximity,
+        int npeaks)
       : gr::block("peak_detector",
               gr::io_signature::makev(4, 4, std::vector<int> {
                     static_cast<int>(sizeof(float) * vec_len),
                     static_cast<int>(sizeof(float) * vec_len),
-                    static_cast<int>(sizeof(float)),
-                    static_cast<int>(sizeof(float))
+                    static_cast<int>(sizeof(float) * npeaks),
+                    static_cast<int>(sizeof(float) * npeaks)
               }),
-              gr::io_signature::make(2, 2, sizeof(float))),
+              gr::io_signature::make(2, 2, sizeof(float) * npeaks)),
         d_vec_len(vec_len),
         d_prox(proximity),
-        d_freq(samp_rate)
+        d_freq(samp_rate),
+        d_npeaks(npeaks),
+        d_track_window(0),
+        d_alpha(0.5),
+        d_beta(0.1),
+        d_tracks(std::max(npeaks, 0))
     {
+      if (npeaks < 1) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid number of peaks: " << npeaks;
+        throw std::invalid_argument(message.str());
+      }
     }
 
     /*
@@ -49,11 +66,30 @@ namespace gr {
     {
     }
 
+    void
+    peak_detector_impl::set_tracking(int window, float alpha, float beta)
+    {
+      if (window < 0 || !(alpha > 0.0f && alpha <= 1.0f) || !(beta >= 0.0f && beta < 4.0f - 2.0f * alpha)) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid tracking parameters, window: "
+                << window << ", alpha: " << alpha << ", beta: " << beta;
+        throw std::invalid_argument(message.str());
+      }
+
+      gr::thread::scoped_lock lock(d_setlock);
+
+      d_track_window = window;
+      d_alpha = alpha;
+      d_beta = beta;
+      std::fill(d_tracks.begin(), d_tracks.end(), peak_track_t());
+    }
+
     void
     peak_detector_impl::forecast (int noutput_items, gr_vector_int &ninput_items_required)
     {
-      //ninput_items_required[0] = 1;
-       ninput_items_required[0] = noutput_items;
+      for (auto &required : ninput_items_required) {
+        required = noutput_items;
+      }
     }
     
     /**
@@ -66,12 +102,12 @@ namespace gr {
      */
     float interpolateGaussian(const float* data, const int data_length, const int index) {
         if ((index > 0) && (index < (data_length - 1))) {
-            const float left = std::pow(data[index - 1], 1);
-            const float center = std::pow(data[index - 0], 1);
-            const float right = std::pow(data[index + 1], 1);
-            
+            const float left = data[index - 1];
+            const float center = data[index];
+            const float right = data[index + 1];
+
             float val = index;
-            val += 0.5 * std::log(right / left) / std::log(std::pow(center, 2) / (left * right));
+            val += 0.5 * std::log(right / left) / std::log(static_cast<double>(center) * center / (left * right));
             return val;
         } else {
             return ((float)index);
@@ -132,12 +168,110 @@ namespace gr {
     
 
 
+    void
+    peak_search_bins(double samp_rate, int vec_len, float low_freq, float up_freq,
+            int &start_bin, int &end_bin)
+    {
+      start_bin = 2.0 * low_freq / samp_rate * vec_len;
+      end_bin = 2.0 * up_freq  / samp_rate * vec_len;
+      start_bin = std::min(std::max(start_bin, 0), vec_len - 1);
+      end_bin = std::min(std::max(end_bin, start_bin), vec_len - 1);
+    }
+
+    void
+    locate_peak(const float *actual, int vec_len, double samp_rate, int proximity,
+            int max_fil_i, float max_fil, float *max_sig, float *width_sig)
+    {
+      //find actual maximum in the proximity of the averaged maximum, it has
+      //to be larger than the averaged maximum
+      int max_i = max_fil_i;
+      if (proximity > 0) {
+        uint32_t index;
+        const int prox_start = std::max(max_fil_i - proximity + 1, 0);
+        const int prox_end = std::min(max_fil_i + proximity - 1, vec_len - 1);
+        volk_32f_index_max_32u(&index, actual + prox_start, prox_end - prox_start + 1);
+        if (max_fil < actual[prox_start + index]) {
+          max_i = prox_start + static_cast<int>(index);
+        }
+      }
+
+      //find FWHM for stdev approx., fix width to half maximum from bin count to frequency window
+      double freq_whm = computeInterpolatedFWHM(actual, vec_len, max_i);
+      freq_whm *= samp_rate/(vec_len);
+
+      // see CAS Reference in Common Spec:
+      //
+      float maxInterpolated = interpolateGaussian(actual, vec_len, max_i);
+
+      max_sig[0] = (maxInterpolated * samp_rate) / (2.0 * vec_len);
+      width_sig[0] = freq_whm * whm2stdev;
+    }
+
+    void
+    peak_detector_impl::find_peak(const float *actual, const float *filtered, float low_freq,
+            float up_freq, peak_track_t &track, float *max_sig, float *width_sig)
+    {
+      int start_bin, end_bin;
+      peak_search_bins(d_freq, d_vec_len, low_freq, up_freq, start_bin, end_bin);
+
+      // When tracking, only the window around the predicted position is searched
+      const bool tracking = d_track_window > 0 && track.locked;
+      const double predicted = track.position + track.velocity;
+      int first = start_bin;
+      int last = end_bin;
+      if (tracking) {
+        const int center = static_cast<int>(std::lround(predicted));
+        first = std::max(center - d_track_window, start_bin);
+        last = std::min(center + d_track_window, end_bin);
+      }
+
+      //find filtered maximum, the first one if there are several
+      int max_fil_i = -1;
+      uint32_t index;
+      if (first <= last) {
+        volk_32f_index_max_32u(&index, filtered + first, last - first + 1);
+        max_fil_i = first + static_cast<int>(index);
+
+        // a maximum at the window edge is likely a slope of a peak beyond the window
+        if (tracking && ((max_fil_i == first && first > start_bin) || (max_fil_i == last && last < end_bin))) {
+          max_fil_i = -1;
+        }
+      }
+
+      // lost, re-acquire over the full range
+      if (max_fil_i < 0) {
+        track.locked = false;
+        volk_32f_index_max_32u(&index, filtered + start_bin, end_bin - start_bin + 1);
+        max_fil_i = start_bin + static_cast<int>(index);
+      }
+
+      locate_peak(actual, d_vec_len, d_freq, d_prox, max_fil_i, filtered[max_fil_i], max_sig, width_sig);
+
+      if (d_track_window > 0) {
+        const double measured = max_sig[0] * 2.0 * d_vec_len / d_freq;
+        if (!std::isfinite(measured)) {
+          track.locked = false;
+        }
+        else if (track.locked) {
+          const double residual = measured - predicted;
+          track.position = predicted + d_alpha * residual;
+          track.velocity += d_beta * residual;
+        }
+        else {
+          track.locked = true;
+          track.position = measured;
+          track.velocity = 0.0;
+        }
+      }
+    }
+
     int
     peak_detector_impl::general_work (int noutput_items,
                        gr_vector_int &ninput_items,
                        gr_vector_const_void_star &input_items,
                        gr_vector_void_star &output_items)
     {
+      block_stats_scope_t stats(d_stats);
       const float *actual = (const float *) input_items[0];
       const float *filtered = (const float *) input_items[1];
       const float *low_freq =  (const float *) input_items[2];
@@ -145,85 +279,24 @@ namespace gr {
 
       float *max_sig = (float *) output_items[0];
       float *width_sig = (float *) output_items[1];
-      if(ninput_items[0] <= 0 ||ninput_items[1] <= 0 || noutput_items < 1){
+
+      const int nvectors = std::min(*std::min_element(ninput_items.begin(), ninput_items.end()),
+              noutput_items);
+      if (nvectors <= 0) {
         return 0;
       }
 
-      // TODO: verify bounds
-      int d_start_bin = 2.0 * low_freq[0] / d_freq * d_vec_len;
-      int d_end_bin = 2.0 * up_freq[0]  / d_freq * d_vec_len;
-
-      //find filtered maximum
-      float max_fil = filtered[d_start_bin];
-      int max_fil_i = d_start_bin;
-      for(int i = d_start_bin + 1; i <= d_end_bin; i++) {
-        if(max_fil<filtered[i]) {
-          max_fil = filtered[i];
-          max_fil_i = i;
-        }
-      }
-      //find actual maximum in the proximity of the averaged maximum
-      //initialize to something smaller than actual max.
-      float max = max_fil;
-      int max_i = max_fil_i;
-      for(int i = 0; i< d_prox; i++) {
-        if(max_fil_i+i < d_vec_len &&
-            max<actual[max_fil_i + i]){
-          max = actual[max_fil_i + i];
-          max_i = max_fil_i + i;
-        }
-        if(max_fil_i-i >= 0 &&
-            max<actual[max_fil_i - i]){
-          max = actual[max_fil_i - i];
-          max_i = max_fil_i - i;
+      for (int v = 0; v < nvectors; v++) {
+        for (int k = 0; k < d_npeaks; k++) {
+          const int peak = v * d_npeaks + k;
+          find_peak(actual + v * d_vec_len, filtered + v * d_vec_len, low_freq[peak], up_freq[peak],
+                  d_tracks[k], max_sig + peak, width_sig + peak);
         }
       }
 
-      //find FWHM for stdev approx.
-      double hm=actual[max_i]/2.0;
-      int whm_i= max_i;
-      for(int i =0; i<d_vec_len && whm_i == max_i; i++){
-        if(max_i+i < d_vec_len &&
-            hm > actual[max_i+i]){ whm_i = max_i+i; }
-        if(max_i-i >= 0 &&
-            hm > actual[max_i-i]){ whm_i = max_i-i; }
-      }
-      double freq_whm = 0.0;
-      if(whm_i > max_i) {
-        double a = actual[whm_i]-actual[whm_i-1];
-        double b = actual[whm_i-1];
-        freq_whm= (b + (hm-b))/a;
-      }
-      if(whm_i < max_i) {
-        double a = actual[whm_i+1]-actual[whm_i];
-        double b = actual[whm_i];
-        freq_whm= (b + (hm-b))/a;
-      }
-      
-      // freq_whm = computeFWHM(actual, d_vec_len, max_i);
-      freq_whm = computeInterpolatedFWHM(actual, d_vec_len, max_i);      
-
-      //fix width to half maximum from bin count to frequency window
-      freq_whm *= d_freq/(d_vec_len);
-
-      
-      // see CAS Reference in Common Spec:
-      // 
-      float maxInterpolated = interpolateGaussian(actual, d_vec_len, max_i);
-      
-      max_sig[0] = (maxInterpolated * d_freq) / (2.0 * d_vec_len);
-      width_sig[0] = freq_whm * whm2stdev;
-      consume_each (noutput_items);
-      
-      /*
-      max_sig[0] = (max_i * d_freq) / (2.0 * d_vec_len);
-      width_sig[0] = freq_whm * whm2stdev;
-      consume_each (1);
-      */
-      // Tell runtime system how many output items we produced.
-      return 1;
+      consume_each(nvectors);
+      return nvectors;
     }
 
   } /* namespace digitizers */
 } /* namespace gr */
-
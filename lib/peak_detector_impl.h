@@ -8,23 +8,65 @@
 #define INCLUDED_DIGITIZERS_PEAK_DETECTOR_IMPL_H
 
 #include <digitizers/peak_detector.h>
+#include "block_stats_impl.h"
+
+#include <vector>
 
 namespace gr {
   namespace digitizers {
 
+    /*!
+     * \brief Bins [start_bin, end_bin] of the frequency range, clamped to the vector.
+     */
+    void peak_search_bins(double samp_rate, int vec_len, float low_freq, float up_freq,
+            int &start_bin, int &end_bin);
+
+    /*!
+     * \brief Finds the actual peak in the proximity of the filtered maximum (max_fil at bin
+     * max_fil_i) and returns its interpolated frequency and the stdev approximated by FWHM.
+     */
+    void locate_peak(const float *actual, int vec_len, double samp_rate, int proximity,
+            int max_fil_i, float max_fil, float *max_sig, float *width_sig);
+
+    /*!
+     * \brief Alpha-beta tracker state of a peak, positions in bins.
+     */
+    struct peak_track_t
+    {
+      bool locked = false;
+      double position = 0.0;
+      double velocity = 0.0;      // bins per spectrum
+    };
+
     class peak_detector_impl : public peak_detector
     {
      private:
       int d_vec_len;
       int d_prox;
       double d_freq;
+      int d_npeaks;
+
+      // tracking mode, see set_tracking
+      int d_track_window;
+      double d_alpha;
+      double d_beta;
+      std::vector<peak_track_t> d_tracks;
+
+      // detects a single peak within the given frequency range, updates its tracker
+      void find_peak(const float *actual, const float *filtered, float low_freq, float up_freq,
+              peak_track_t &track, float *max_sig, float *width_sig);
+
+      block_stats_recorder_t d_stats {this};
 
      public:
       peak_detector_impl(double samp_rate,
           int vec_len,
-          int proximity);
+          int proximity,
+          int npeaks);
       ~peak_detector_impl();
 
+      void set_tracking(int window, float alpha, float beta) override;
+
       // Where all the action really happens
       void forecast(int noutput_items, gr_vector_int &ninput_items_required);
 
@@ -38,4 +80,3 @@ namespace gr {
 } // namespace gr
 
 #endif /* INCLUDED_DIGITIZERS_PEAK_DETECTOR_IMPL_H */
-
@@ -12,6 +12,7 @@
 #include "picoscope_3000a_impl.h"
 #include "utils.h"
 #include "ps_3000a_defs.h"
+#include "unit_registry.h"
 #include <cstring>
 
 
@@ -266,6 +267,27 @@ namespace gr {
       }
     }
 
+    static double
+    convert_ps3000a_time_units_to_seconds(PS3000A_TIME_UNITS units)
+    {
+      switch(units)
+      {
+      case PS3000A_FS:
+        return 1e-15;
+      case PS3000A_PS:
+        return 1e-12;
+      case PS3000A_NS:
+        return 1e-9;
+      case PS3000A_US:
+        return 1e-6;
+      case PS3000A_MS:
+        return 1e-3;
+      case PS3000A_S:
+      default:
+        return 1.0;
+      }
+    }
+
     PS3000A_THRESHOLD_DIRECTION 
     convert_to_ps3000a_threshold_direction(trigger_direction_t direction)
     {
@@ -349,33 +371,111 @@ namespace gr {
      * Structors
      *********************************************************************/
 
+    /*!
+     * Opens the unit and queries the unit info, executed by the unit registry or by
+     * driver_initialize if the unit was not requested in advance.
+     */
+    static opened_unit_t
+    open_3000a_unit(const std::string &serial_number)
+    {
+      opened_unit_t unit;
+      PICO_STATUS status;
+
+      {
+        // Required to force sequence execution of open unit calls...
+        boost::mutex::scoped_lock init_guard(g_init_mutex);
+
+        // take any if serial number is not provided (usefull for testing purposes)
+        if (serial_number.empty()) {
+          status = ps3000aOpenUnit(&(unit.handle), NULL);
+        }
+        else {
+          status = ps3000aOpenUnit(&(unit.handle), (int8_t*)serial_number.c_str());
+        }
+
+        // ignore ext. power not connected error/warning
+        if (status == PICO_POWER_SUPPLY_NOT_CONNECTED
+                || status == PICO_USB3_0_DEVICE_NON_USB3_0_PORT) {
+          status = ps3000aChangePowerSource(unit.handle, status);
+          if (status == PICO_POWER_SUPPLY_NOT_CONNECTED
+                  || status == PICO_USB3_0_DEVICE_NON_USB3_0_PORT) {
+            status = ps3000aChangePowerSource(unit.handle, status);
+          }
+        }
+      }
+
+      if (status != PICO_OK) {
+        unit.status = status;
+        unit.failed_call = "open unit failed";
+        return unit;
+      }
+
+      // maximum value is used for conversion to volts
+      status = ps3000aMaximumValue(unit.handle, &unit.max_value);
+      if (status != PICO_OK) {
+        ps3000aCloseUnit(unit.handle);
+        unit.status = status;
+        unit.failed_call = "ps3000aMaximumValue";
+        return unit;
+      }
+
+      for (PICO_INFO info : {PICO_VARIANT_INFO, PICO_HARDWARE_VERSION, PICO_DRIVER_VERSION}) {
+        char line[40];
+        int16_t required_size;
+
+        status = ps3000aGetUnitInfo(unit.handle, reinterpret_cast<int8_t *>(line), sizeof(line),
+                &required_size, info);
+        if (status == PICO_OK) {
+          unit.info[info] = std::string(line, required_size);
+        }
+      }
+
+      return unit;
+    }
+
+    static unit_registry_t g_units(open_3000a_unit,
+            [](int16_t handle) { ps3000aCloseUnit(handle); });
+
+    void
+    picoscope_3000a::open_units(const std::vector<std::string> &serial_numbers)
+    {
+      g_units.open_units(serial_numbers);
+    }
+
     picoscope_3000a::sptr
-    picoscope_3000a::make(std::string serial_number, bool auto_arm)
+    picoscope_3000a::make(std::string serial_number, bool auto_arm, bool raw_output)
     {
       std::vector<int> out_signature;
 
       for(int i = 0; i < PS3000A_MAX_CHANNELS; i++) {
-        out_signature.push_back(sizeof(float));
-        out_signature.push_back(sizeof(float));
+        if (raw_output) {
+          out_signature.push_back(sizeof(int16_t));
+        }
+        else {
+          out_signature.push_back(sizeof(float));
+          out_signature.push_back(sizeof(float));
+        }
       }
 
       for(int i = 0; i < 2; i++)
         out_signature.push_back(sizeof(char));
 
       return gnuradio::get_initial_sptr
-        (new picoscope_3000a_impl(serial_number, out_signature, auto_arm));
+        (new picoscope_3000a_impl(serial_number, out_signature, auto_arm, raw_output));
     }
 
-    picoscope_3000a_impl::picoscope_3000a_impl(std::string serial_number, std::vector<int> out_signature, bool auto_arm)
+    picoscope_3000a_impl::picoscope_3000a_impl(std::string serial_number, std::vector<int> out_signature,
+            bool auto_arm, bool raw_output)
       : gr::sync_block("picoscope_3000a",
               gr::io_signature::make(0, 0, 0),
-              gr::io_signature::makev(10, 10, out_signature)),
+              gr::io_signature::makev(out_signature.size(), out_signature.size(), out_signature)),
         picoscope_impl(serial_number,
               PS3000A_MAX_CHANNELS,
               2,     // it seems no 3000 series device supports 4 ports
               auto_arm,
               255,   // max raw value
-              0.03), // vertical precision
+              0.03,  // vertical precision
+              raw_output),
         d_handle(-1),
         d_overflow(0)
     {
@@ -405,6 +505,11 @@ namespace gr {
     std::string
     picoscope_3000a_impl::get_unit_info_topic(PICO_INFO info)
     {
+      auto cached = d_unit_info.find(info);
+      if (cached != d_unit_info.end()) {
+        return cached->second;
+      }
+
       char line[40];
       int16_t required_size;
 
@@ -442,56 +547,33 @@ namespace gr {
     std::error_code
     picoscope_3000a_impl::driver_initialize()
     {
-      PICO_STATUS status;
-
-      // Required to force sequence execution of open unit calls...
-      boost::mutex::scoped_lock init_guard(g_init_mutex);
-
-      // take any if serial number is not provided (usefull for testing purposes)
-      if (d_serial_number.empty()) {
-        status = ps3000aOpenUnit(&(d_handle), NULL);
-      }
-      else {
-        status = ps3000aOpenUnit(&(d_handle), (int8_t*)d_serial_number.c_str());
+      opened_unit_t unit;
+      if (!g_units.take(d_serial_number, unit)) {
+        unit = open_3000a_unit(d_serial_number);
       }
 
-      // ignore ext. power not connected error/warning
-      if (status == PICO_POWER_SUPPLY_NOT_CONNECTED
-              || status == PICO_USB3_0_DEVICE_NON_USB3_0_PORT) {
-        status = ps3000aChangePowerSource(d_handle, status);
-        if (status == PICO_POWER_SUPPLY_NOT_CONNECTED
-                || status == PICO_USB3_0_DEVICE_NON_USB3_0_PORT) {
-          status = ps3000aChangePowerSource(d_handle, status);
-        }
-      }
-
-      if (status != PICO_OK) {
-        GR_LOG_ERROR(d_logger, "open unit failed: " + ps3000a_get_error_message(status));
-        return make_pico_3000a_error_code(status);
+      if (unit.status != PICO_OK) {
+        GR_LOG_ERROR(d_logger, unit.failed_call + ": " + ps3000a_get_error_message(unit.status));
+        return make_pico_3000a_error_code(unit.status);
       }
 
-      // maximum value is used for conversion to volts
-      status = ps3000aMaximumValue(d_handle, &d_max_value);
-      if (status != PICO_OK) {
-        ps3000aCloseUnit(d_handle);
-        GR_LOG_ERROR(d_logger, "ps3000aMaximumValue: " + ps3000a_get_error_message(status));
-        return make_pico_3000a_error_code(status);
-      }
-
-      char line[40];
-      int16_t required_size;
+      d_handle = unit.handle;
+      d_max_value = unit.max_value;
+      d_unit_info = unit.info;
 
       // It would be nicer if the number of channels is communicated to the base driver in the form
       // of function call or something similar.
-      status = ps3000aGetUnitInfo(d_handle, reinterpret_cast<int8_t *>(line), sizeof(line),
-              &required_size, PICO_VARIANT_INFO);
-      if (status != PICO_OK) {
+      auto variant = d_unit_info.find(PICO_VARIANT_INFO);
+      if (variant == d_unit_info.end()) {
         // this error is ignored
-        GR_LOG_WARN(d_logger, "ps3000aGetUnitInfo failed: " + ps3000a_get_error_message(status));
+        GR_LOG_WARN(d_logger, "ps3000aGetUnitInfo failed");
         GR_LOG_WARN(d_logger, "   assuming device with 4 analog channels, and 2 digital ports");
       }
       else {
-        if (line[1] == '4') {
+        const char *line = variant->second.c_str();
+        const auto length = variant->second.size();
+
+        if (length > 1 && line[1] == '4') {
           d_ai_channels = 4;
         }
         else {
@@ -499,7 +581,7 @@ namespace gr {
         }
 
         // Check if MSO device
-        if (strnlen(line, sizeof(line)) >= 7) {
+        if (strnlen(line, length) >= 7) {
           if(strncmp(line + 4, "MSO", 3) == 0 || strncmp(line + 5, "MSO", 3) == 0 ) {
            d_ports = 2;
           }
@@ -518,12 +600,15 @@ namespace gr {
       assert(d_ai_channels <= PS3000A_MAX_CHANNELS);
       assert(d_ports <= PS3000A_MAX_DIGITAL_PORTS);
 
+      // Configuration (e.g. ratio mode) is part of the buffer registrations
+      clear_registered_buffers();
+
       PICO_STATUS status;
 
       if (d_acquisition_mode == acquisition_mode_t::RAPID_BLOCK) {
 
         int32_t max_samples;
-        status = ps3000aMemorySegments(d_handle, d_nr_captures, &max_samples);
+        status = ps3000aMemorySegments(d_handle, get_nr_memory_segments(), &max_samples);
         if(status != PICO_OK) {
           GR_LOG_ERROR(d_logger, "ps3000aMemorySegments: " + ps3000a_get_error_message(status));
           return make_pico_3000a_error_code(status);
@@ -536,8 +621,12 @@ namespace gr {
         }
       }
 
-      // configure analog channels
+      // configure analog channels, the ones unchanged are skipped
       for (auto i = 0; i < d_ai_channels; i++) {
+        if (is_aichan_applied(i)) {
+          continue;
+        }
+
         auto enabled = d_channel_settings[i].enabled;
         auto coupling = convert_to_ps3000a_coupling(d_channel_settings[i].coupling);
         auto range = convert_to_ps3000a_range(d_channel_settings[i].range);
@@ -554,6 +643,10 @@ namespace gr {
 
       // and digital ports
       for (auto port = 0; port < d_ports; port++) {
+        if (is_diport_applied(port)) {
+          continue;
+        }
+
         status = ps3000aSetDigitalPort(
                   d_handle,
                   static_cast<PS3000A_DIGITAL_PORT>(PS3000A_DIGITAL_PORT0 + port),
@@ -566,67 +659,69 @@ namespace gr {
         }
       }
 
-      // apply trigger configuration
-      if (d_trigger_settings.is_analog()
-              && d_acquisition_mode == acquisition_mode_t::RAPID_BLOCK)
-      {
-        status = ps3000aSetSimpleTrigger(d_handle,
-              true,  // enable
-              convert_to_ps3000a_channel(d_trigger_settings.source),
-              convert_voltage_to_ps3000a_raw_logic_value(d_trigger_settings.threshold),
-              convert_to_ps3000a_threshold_direction(d_trigger_settings.direction),
-              0,     // delay
-             -1);    // auto trigger
-        if(status != PICO_OK) {
-          GR_LOG_ERROR(d_logger, "ps3000aSetSimpleTrigger: " + ps3000a_get_error_message(status));
-          return make_pico_3000a_error_code(status);
+      // apply trigger configuration, unless unchanged
+      if (!is_trigger_applied()) {
+        if (d_trigger_settings.is_analog()
+                && d_acquisition_mode == acquisition_mode_t::RAPID_BLOCK)
+        {
+          status = ps3000aSetSimpleTrigger(d_handle,
+                true,  // enable
+                convert_to_ps3000a_channel(d_trigger_settings.source),
+                convert_voltage_to_ps3000a_raw_logic_value(d_trigger_settings.threshold),
+                convert_to_ps3000a_threshold_direction(d_trigger_settings.direction),
+                0,     // delay
+               -1);    // auto trigger
+          if(status != PICO_OK) {
+            GR_LOG_ERROR(d_logger, "ps3000aSetSimpleTrigger: " + ps3000a_get_error_message(status));
+            return make_pico_3000a_error_code(status);
+          }
         }
-      }
-      else if (d_trigger_settings.is_digital()
-              && d_acquisition_mode == acquisition_mode_t::RAPID_BLOCK)
-      {
-        PS3000A_DIGITAL_CHANNEL_DIRECTIONS pinTrig;
-        pinTrig.channel = static_cast<PS3000A_DIGITAL_CHANNEL>(d_trigger_settings.pin_number);
-        pinTrig.direction = convert_to_ps3000a_digital_direction(d_trigger_settings.direction);
+        else if (d_trigger_settings.is_digital()
+                && d_acquisition_mode == acquisition_mode_t::RAPID_BLOCK)
+        {
+          PS3000A_DIGITAL_CHANNEL_DIRECTIONS pinTrig;
+          pinTrig.channel = static_cast<PS3000A_DIGITAL_CHANNEL>(d_trigger_settings.pin_number);
+          pinTrig.direction = convert_to_ps3000a_digital_direction(d_trigger_settings.direction);
 
-        status = ps3000aSetTriggerDigitalPortProperties(d_handle, &pinTrig, 1);
-        if(status != PICO_OK) {
-          GR_LOG_ERROR(d_logger, "ps3000aSetTriggerDigitalPortProperties: " + ps3000a_get_error_message(status));
-          return make_pico_3000a_error_code(status);
-        }
+          status = ps3000aSetTriggerDigitalPortProperties(d_handle, &pinTrig, 1);
+          if(status != PICO_OK) {
+            GR_LOG_ERROR(d_logger, "ps3000aSetTriggerDigitalPortProperties: " + ps3000a_get_error_message(status));
+            return make_pico_3000a_error_code(status);
+          }
 
-        PS3000A_TRIGGER_CONDITIONS_V2 conds = {
-              PS3000A_CONDITION_DONT_CARE,
-              PS3000A_CONDITION_DONT_CARE,
-              PS3000A_CONDITION_DONT_CARE,
-              PS3000A_CONDITION_DONT_CARE,
-              PS3000A_CONDITION_DONT_CARE,
-              PS3000A_CONDITION_DONT_CARE,
-              PS3000A_CONDITION_DONT_CARE,
-              PS3000A_CONDITION_TRUE
-        };
-        status = ps3000aSetTriggerChannelConditionsV2(d_handle, &conds, 1);
-        if(status != PICO_OK) {
+          PS3000A_TRIGGER_CONDITIONS_V2 conds = {
+                PS3000A_CONDITION_DONT_CARE,
+                PS3000A_CONDITION_DONT_CARE,
+                PS3000A_CONDITION_DONT_CARE,
+                PS3000A_CONDITION_DONT_CARE,
+                PS3000A_CONDITION_DONT_CARE,
+                PS3000A_CONDITION_DONT_CARE,
+                PS3000A_CONDITION_DONT_CARE,
+                PS3000A_CONDITION_TRUE
+          };
+          status = ps3000aSetTriggerChannelConditionsV2(d_handle, &conds, 1);
+          if(status != PICO_OK) {
+              GR_LOG_ERROR(d_logger, "ps3000aSetTriggerChannelConditionsV2: " + ps3000a_get_error_message(status));
+              return make_pico_3000a_error_code(status);
+          }
+        }
+        else {
+          // disable triggers...
+          PS3000A_TRIGGER_CONDITIONS_V2 conds = {
+                PS3000A_CONDITION_DONT_CARE,
+                PS3000A_CONDITION_DONT_CARE,
+                PS3000A_CONDITION_DONT_CARE,
+                PS3000A_CONDITION_DONT_CARE,
+                PS3000A_CONDITION_DONT_CARE,
+                PS3000A_CONDITION_DONT_CARE,
+                PS3000A_CONDITION_DONT_CARE,
+                PS3000A_CONDITION_DONT_CARE
+          };
+          status = ps3000aSetTriggerChannelConditionsV2(d_handle, &conds, 1);
+          if(status != PICO_OK) {
             GR_LOG_ERROR(d_logger, "ps3000aSetTriggerChannelConditionsV2: " + ps3000a_get_error_message(status));
             return make_pico_3000a_error_code(status);
-        }
-      }
-      else {
-        // disable triggers...
-        PS3000A_TRIGGER_CONDITIONS_V2 conds = {
-              PS3000A_CONDITION_DONT_CARE,
-              PS3000A_CONDITION_DONT_CARE,
-              PS3000A_CONDITION_DONT_CARE,
-              PS3000A_CONDITION_DONT_CARE,
-              PS3000A_CONDITION_DONT_CARE,
-              PS3000A_CONDITION_DONT_CARE,
-              PS3000A_CONDITION_DONT_CARE,
-              PS3000A_CONDITION_DONT_CARE
-        };
-        status = ps3000aSetTriggerChannelConditionsV2(d_handle, &conds, 1);
-        if(status != PICO_OK) {
-          GR_LOG_ERROR(d_logger, "ps3000aSetTriggerChannelConditionsV2: " + ps3000a_get_error_message(status));
-          return make_pico_3000a_error_code(status);
+          }
         }
       }
 
@@ -662,7 +757,7 @@ namespace gr {
                   timebase,        // timebase
                   0,               // oversample
                   NULL,            // time indispossed
-                  0,               // segment index
+                  get_capture_segment(), // first segment index
                   (ps3000aBlockReady)rapid_block_callback_redirector_3000a,
                   this);
           if(status != PICO_OK) {
@@ -719,12 +814,21 @@ namespace gr {
       }
 
       d_handle = -1;
+      d_unit_info.clear();
       return make_pico_3000a_error_code(status);
     }
 
     std::error_code
-    picoscope_3000a_impl::set_buffers(size_t samples, uint32_t block_number)
+    picoscope_3000a_impl::set_buffers(size_t samples, uint32_t block_number, size_t buffer_offset)
     {
+      // Driver buffers must not be reallocated once handed over to the driver
+      reserve_driver_buffers(buffer_offset + samples);
+
+      // Registrations are kept by the driver, e.g. re-arming in streaming mode doesn't need them
+      if (are_buffers_registered(block_number, samples, buffer_offset)) {
+        return std::error_code {};
+      }
+
       PICO_STATUS status;
 
       for(auto aichan = 0; aichan < d_ai_channels; aichan++)
@@ -733,23 +837,18 @@ namespace gr {
           continue;
 
         if(d_downsampling_mode == downsampling_mode_t::DOWNSAMPLING_MODE_MIN_MAX_AGG) {
-          d_buffers[aichan].reserve(samples);
-          d_buffers_min[aichan].reserve(samples);
-
           status = ps3000aSetDataBuffers(d_handle,
               static_cast<PS3000A_CHANNEL>(aichan),
-              &d_buffers[aichan][0],
-              &d_buffers_min[aichan][0],
+              &d_buffers[aichan][buffer_offset],
+              &d_buffers_min[aichan][buffer_offset],
               samples,
               block_number,
               convert_to_ps3000a_ratio_mode(d_downsampling_mode));
         }
         else {
-          d_buffers[aichan].reserve(samples);
-
           status = ps3000aSetDataBuffer(d_handle,
               static_cast<PS3000A_CHANNEL>(aichan),
-              &d_buffers[aichan][0],
+              &d_buffers[aichan][buffer_offset],
               samples,
               block_number,
               convert_to_ps3000a_ratio_mode(d_downsampling_mode));
@@ -767,11 +866,9 @@ namespace gr {
           continue;
         }
 
-        d_port_buffers[port].reserve(samples);
-
         status = ps3000aSetDataBuffer(d_handle,
               static_cast<PS3000A_CHANNEL>(PS3000A_DIGITAL_PORT0 + port),
-              &d_port_buffers[port][0],
+              &d_port_buffers[port][buffer_offset],
               samples,
               block_number,
               convert_to_ps3000a_ratio_mode(d_downsampling_mode));
@@ -782,12 +879,15 @@ namespace gr {
         }
       }
 
+      set_buffers_registered(block_number, samples, buffer_offset);
       return std::error_code {};
     }
 
     std::error_code
     picoscope_3000a_impl::driver_prefetch_block(size_t samples, size_t block_number)
     {
+      d_bulk_segment_stride = 0;
+
       auto erc = set_buffers(samples, block_number);
       if(erc){
         return erc;
@@ -808,18 +908,84 @@ namespace gr {
       return make_pico_3000a_error_code(status);
     }
 
+    std::error_code
+    picoscope_3000a_impl::driver_prefetch_blocks(size_t samples, size_t first_block, size_t nr_blocks)
+    {
+      d_bulk_segment_stride = 0;
+
+      // Driver buffers must not be reallocated once handed over to the driver
+      reserve_driver_buffers(samples * nr_blocks);
+
+      for (size_t block = 0; block < nr_blocks; block++) {
+        auto erc = set_buffers(samples, first_block + block, block * samples);
+        if(erc){
+          return erc;
+        }
+      }
+
+      d_bulk_overflow.assign(nr_blocks, 0);
+
+      uint32_t nr_samples = samples;
+      auto status = ps3000aGetValuesBulk(d_handle,
+          &nr_samples,
+          first_block,                  // from segment index
+          first_block + nr_blocks - 1,  // to segment index
+          d_downsampling_factor,
+          convert_to_ps3000a_ratio_mode(d_downsampling_mode),
+          &d_bulk_overflow[0]);
+      if(status != PICO_OK) {
+        GR_LOG_ERROR(d_logger, "ps3000aGetValuesBulk: " + ps3000a_get_error_message(status));
+        return make_pico_3000a_error_code(status);
+      }
+
+      d_bulk_segment_stride = samples;
+      d_bulk_first_segment = first_block;
+      return std::error_code {};
+    }
+
+    std::error_code
+    picoscope_3000a_impl::driver_get_trigger_offsets(size_t first_segment, size_t nr_segments,
+            std::vector<double> &offsets)
+    {
+      d_trigger_offset_times.resize(nr_segments);
+      d_trigger_offset_units.resize(nr_segments);
+
+      auto status = ps3000aGetValuesTriggerTimeOffsetBulk64(d_handle,
+          &d_trigger_offset_times[0],
+          &d_trigger_offset_units[0],
+          first_segment,                   // from segment index
+          first_segment + nr_segments - 1  // to segment index
+          );
+      if(status != PICO_OK) {
+        GR_LOG_ERROR(d_logger, "ps3000aGetValuesTriggerTimeOffsetBulk64: " + ps3000a_get_error_message(status));
+        return make_pico_3000a_error_code(status);
+      }
+
+      offsets.resize(nr_segments);
+      for (size_t i = 0; i < nr_segments; i++) {
+        offsets[i] = d_trigger_offset_times[i] * convert_ps3000a_time_units_to_seconds(d_trigger_offset_units[i]);
+      }
+
+      return std::error_code {};
+    }
+
     std::error_code
     picoscope_3000a_impl::driver_get_rapid_block_data(size_t offset, size_t length,
             size_t waveform, gr_vector_void_star &arrays, std::vector<uint32_t> &status)
     {
       int vec_index = 0;
 
+      // In case of bulk readout all the waveforms are held by the driver buffers, waveform is
+      // the device memory segment index
+      offset += get_segment_offset(waveform);
+      auto overflow = get_segment_overflow(waveform, d_overflow);
+
       for(auto chan_idx = 0; chan_idx < d_ai_channels; chan_idx++, vec_index +=2) {
         if(!d_channel_settings[chan_idx].enabled) {
           continue;
         }
 
-        if (d_overflow & (1 << chan_idx)) {
+        if (overflow & (1 << chan_idx)) {
           status[chan_idx] = channel_status_t::CHANNEL_STATUS_OVERFLOW;
         }
         else {
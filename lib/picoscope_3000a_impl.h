@@ -24,10 +24,14 @@ namespace gr {
      private:
       int16_t d_handle;    // PicoScope device handle
       int16_t d_overflow;  // status returned from getValues
+      // trigger time offsets per segment, see driver_get_trigger_offsets
+      std::vector<int64_t> d_trigger_offset_times;
+      std::vector<PS3000A_TIME_UNITS> d_trigger_offset_units;
 
      public:
 
-      picoscope_3000a_impl(std::string serial_number, std::vector<int> outSig, bool auto_arm);
+      picoscope_3000a_impl(std::string serial_number, std::vector<int> outSig, bool auto_arm,
+              bool raw_output);
 
       ~picoscope_3000a_impl();
 
@@ -47,6 +51,11 @@ namespace gr {
 
       std::error_code driver_prefetch_block(size_t length, size_t block_number) override;
 
+      std::error_code driver_prefetch_blocks(size_t length, size_t first_block, size_t nr_blocks) override;
+
+      std::error_code driver_get_trigger_offsets(size_t first_segment, size_t nr_segments,
+              std::vector<double> &offsets) override;
+
       std::error_code driver_get_rapid_block_data(size_t offset, size_t length, size_t waveform,
               gr_vector_void_star &arrays, std::vector<uint32_t> &status) override;
 
@@ -58,7 +67,11 @@ namespace gr {
 
       std::string get_unit_info_topic(PICO_INFO info);
 
-      std::error_code set_buffers(size_t samples, uint32_t block_number);
+      /*!
+       * \brief Hands over driver buffers for the given segment, buffer_offset is the offset
+       * of the segment within driver buffers in samples.
+       */
+      std::error_code set_buffers(size_t samples, uint32_t block_number, size_t buffer_offset=0);
 
       uint32_t convert_frequency_to_ps3000a_timebase(double desired_freq, double &actual_freq);
     };
@@ -12,6 +12,7 @@
 #include "picoscope_4000a_impl.h"
 #include "utils.h"
 #include "ps_4000a_defs.h"
+#include "unit_registry.h"
 #include <cstring>
 
 
@@ -266,6 +267,27 @@ namespace gr {
       }
     }
 
+    static double
+    convert_ps4000a_time_units_to_seconds(PS4000A_TIME_UNITS units)
+    {
+      switch(units)
+      {
+      case PS4000A_FS:
+        return 1e-15;
+      case PS4000A_PS:
+        return 1e-12;
+      case PS4000A_NS:
+        return 1e-9;
+      case PS4000A_US:
+        return 1e-6;
+      case PS4000A_MS:
+        return 1e-3;
+      case PS4000A_S:
+      default:
+        return 1.0;
+      }
+    }
+
     PS4000A_THRESHOLD_DIRECTION
     convert_to_ps4000a_threshold_direction(trigger_direction_t direction)
     {
@@ -342,20 +364,103 @@ namespace gr {
      * Structors
      *********************************************************************/
 
+    /*!
+     * Opens the unit and queries the unit info, executed by the unit registry or by
+     * driver_initialize if the unit was not requested in advance.
+     */
+    static opened_unit_t
+    open_4000a_unit(const std::string &serial_number)
+    {
+      opened_unit_t unit;
+      PICO_STATUS status;
+
+      {
+        // Required to force sequence execution of open unit calls...
+        boost::mutex::scoped_lock init_guard(g_init_mutex);
+
+        // take any if serial number is not provided (usefull for testing purposes)
+        if (serial_number.empty()) {
+          status = ps4000aOpenUnit(&(unit.handle), NULL);
+        }
+        else {
+          status = ps4000aOpenUnit(&(unit.handle), (int8_t*)serial_number.c_str());
+        }
+
+        // ignore ext. power not connected error/warning
+        if (status == PICO_POWER_SUPPLY_NOT_CONNECTED
+                || status == PICO_USB3_0_DEVICE_NON_USB3_0_PORT) {
+          status = ps4000aChangePowerSource(unit.handle, status);
+          if (status == PICO_POWER_SUPPLY_NOT_CONNECTED
+                  || status == PICO_USB3_0_DEVICE_NON_USB3_0_PORT) {
+            status = ps4000aChangePowerSource(unit.handle, status);
+          }
+        }
+      }
+
+      if (status != PICO_OK) {
+        unit.status = status;
+        unit.failed_call = "open unit failed";
+        return unit;
+      }
+
+      // maximum value is used for conversion to volts
+      status = ps4000aMaximumValue(unit.handle, &unit.max_value);
+      if (status != PICO_OK) {
+        ps4000aCloseUnit(unit.handle);
+        unit.status = status;
+        unit.failed_call = "ps4000aMaximumValue";
+        return unit;
+      }
+
+      for (PICO_INFO info : {PICO_HARDWARE_VERSION, PICO_DRIVER_VERSION}) {
+        char line[40];
+        int16_t required_size;
+
+        status = ps4000aGetUnitInfo(unit.handle, reinterpret_cast<int8_t *>(line), sizeof(line),
+                &required_size, info);
+        if (status == PICO_OK) {
+          unit.info[info] = std::string(line, required_size);
+        }
+      }
+
+      return unit;
+    }
+
+    static unit_registry_t g_units(open_4000a_unit,
+            [](int16_t handle) { ps4000aCloseUnit(handle); });
+
+    void
+    picoscope_4000a::open_units(const std::vector<std::string> &serial_numbers)
+    {
+      g_units.open_units(serial_numbers);
+    }
+
     picoscope_4000a::sptr
-    picoscope_4000a::make(std::string serial_number, bool auto_arm)
+    picoscope_4000a::make(std::string serial_number, bool auto_arm, bool raw_output)
     {
       return gnuradio::get_initial_sptr
-        (new picoscope_4000a_impl(serial_number, auto_arm));
+        (new picoscope_4000a_impl(serial_number, auto_arm, raw_output));
+    }
+
+    static gr::io_signature::sptr
+    make_output_signature(bool raw_output)
+    {
+      if (raw_output) {
+        return gr::io_signature::make(PS4000A_MAX_CHANNELS, PS4000A_MAX_CHANNELS, sizeof(int16_t));
+      }
+
+      return gr::io_signature::make(2 * PS4000A_MAX_CHANNELS, 2 * PS4000A_MAX_CHANNELS, sizeof(float));
     }
 
-    picoscope_4000a_impl::picoscope_4000a_impl(std::string serial_number,bool auto_arm)
+    picoscope_4000a_impl::picoscope_4000a_impl(std::string serial_number, bool auto_arm, bool raw_output)
       : gr::sync_block("picoscope_4000a",
               gr::io_signature::make(0, 0, 0),
-              gr::io_signature::make(16, 16, sizeof(float))),
-          picoscope_impl(serial_number, PS4000A_MAX_CHANNELS, 0, auto_arm, 255, 0.01),
+              make_output_signature(raw_output)),
+          picoscope_impl(serial_number, PS4000A_MAX_CHANNELS, 0, auto_arm, 255, 0.01, raw_output),
           d_handle(-1),
-          d_overflow(0)
+          d_overflow(0),
+          d_overlapped(),
+          d_overlapped_overflow()
     {
       d_ranges.push_back(range_t(0.01));
       d_ranges.push_back(range_t(0.02));
@@ -386,6 +491,11 @@ namespace gr {
     std::string
     picoscope_4000a_impl::get_unit_info_topic(PICO_INFO info)
     {
+      auto cached = d_unit_info.find(info);
+      if (cached != d_unit_info.end()) {
+        return cached->second;
+      }
+
       char line[40];
       int16_t required_size;
 
@@ -423,41 +533,19 @@ namespace gr {
     std::error_code
     picoscope_4000a_impl::driver_initialize()
     {
-      PICO_STATUS status;
-
-      // Required to force sequence execution of open unit calls...
-      boost::mutex::scoped_lock init_guard(g_init_mutex);
-
-      // take any if serial number is not provided (usefull for testing purposes)
-      if (d_serial_number.empty()) {
-        status = ps4000aOpenUnit(&(d_handle), NULL);
-      }
-      else {
-        status = ps4000aOpenUnit(&(d_handle), (int8_t*)d_serial_number.c_str());
-      }
-
-      // ignore ext. power not connected error/warning
-      if (status == PICO_POWER_SUPPLY_NOT_CONNECTED
-              || status == PICO_USB3_0_DEVICE_NON_USB3_0_PORT) {
-        status = ps4000aChangePowerSource(d_handle, status);
-        if (status == PICO_POWER_SUPPLY_NOT_CONNECTED
-                || status == PICO_USB3_0_DEVICE_NON_USB3_0_PORT) {
-          status = ps4000aChangePowerSource(d_handle, status);
-        }
+      opened_unit_t unit;
+      if (!g_units.take(d_serial_number, unit)) {
+        unit = open_4000a_unit(d_serial_number);
       }
 
-      if (status != PICO_OK) {
-        GR_LOG_ERROR(d_logger, "open unit failed: " + ps4000a_get_error_message(status));
-        return make_pico_4000a_error_code(status);
+      if (unit.status != PICO_OK) {
+        GR_LOG_ERROR(d_logger, unit.failed_call + ": " + ps4000a_get_error_message(unit.status));
+        return make_pico_4000a_error_code(unit.status);
       }
 
-      // maximum value is used for conversion to volts
-      status = ps4000aMaximumValue(d_handle, &d_max_value);
-      if (status != PICO_OK) {
-        ps4000aCloseUnit(d_handle);
-        GR_LOG_ERROR(d_logger, "ps4000aMaximumValue: " + ps4000a_get_error_message(status));
-        return make_pico_4000a_error_code(status);
-      }
+      d_handle = unit.handle;
+      d_max_value = unit.max_value;
+      d_unit_info = unit.info;
 
       return std::error_code{};
     }
@@ -467,8 +555,13 @@ namespace gr {
     {
       assert(d_ai_channels <= PS4000A_MAX_CHANNELS);
 
+      // Configuration (e.g. ratio mode) is part of the buffer registrations
+      clear_registered_buffers();
+      d_overlapped[0].armed = false;
+      d_overlapped[1].armed = false;
+
       int32_t max_samples;
-      PICO_STATUS status = ps4000aMemorySegments(d_handle, d_nr_captures, &max_samples);
+      PICO_STATUS status = ps4000aMemorySegments(d_handle, get_nr_memory_segments(), &max_samples);
       if(status != PICO_OK) {
         GR_LOG_ERROR(d_logger, "ps4000aMemorySegments: " + ps4000a_get_error_message(status));
         return make_pico_4000a_error_code(status);
@@ -482,8 +575,12 @@ namespace gr {
         }
       }
 
-      // configure analog channels
+      // configure analog channels, the ones unchanged are skipped
       for (auto i = 0; i < d_ai_channels; i++) {
+        if (is_aichan_applied(i)) {
+          continue;
+        }
+
         auto enabled = d_channel_settings[i].enabled;
         auto coupling = convert_to_ps4000a_coupling(d_channel_settings[i].coupling);
         auto range = convert_to_ps4000a_range(d_channel_settings[i].range);
@@ -498,34 +595,36 @@ namespace gr {
         }
       }
 
-      // apply trigger configuration
-      if (d_trigger_settings.is_analog()
-            && d_acquisition_mode == acquisition_mode_t::RAPID_BLOCK)
-      {
-        status = ps4000aSetSimpleTrigger(d_handle,
-              true,  // enable
-              convert_to_ps4000a_channel(d_trigger_settings.source),
-              convert_voltage_to_ps4000a_raw_logic_value(d_trigger_settings.threshold),
-              convert_to_ps4000a_threshold_direction(d_trigger_settings.direction),
-              0,     // delay
-             -1);    // auto trigger
-        if(status != PICO_OK) {
-          GR_LOG_ERROR(d_logger, "ps4000aSetSimpleTrigger: " + ps4000a_get_error_message(status));
-          return make_pico_4000a_error_code(status);
-        }
-      }
-      else {
-        // disable triggers...
-        for(int i = 0; i < PS4000A_MAX_CHANNELS; i++) {
-          PS4000A_CONDITION cond;
-          cond.source = static_cast<PS4000A_CHANNEL>(i);
-          cond.condition =PS4000A_CONDITION_DONT_CARE;
-          status = ps4000aSetTriggerChannelConditions(d_handle, &cond, 1, PS4000A_CLEAR);
+      // apply trigger configuration, unless unchanged
+      if (!is_trigger_applied()) {
+        if (d_trigger_settings.is_analog()
+              && d_acquisition_mode == acquisition_mode_t::RAPID_BLOCK)
+        {
+          status = ps4000aSetSimpleTrigger(d_handle,
+                true,  // enable
+                convert_to_ps4000a_channel(d_trigger_settings.source),
+                convert_voltage_to_ps4000a_raw_logic_value(d_trigger_settings.threshold),
+                convert_to_ps4000a_threshold_direction(d_trigger_settings.direction),
+                0,     // delay
+               -1);    // auto trigger
           if(status != PICO_OK) {
-            GR_LOG_ERROR(d_logger, "ps4000aSetTriggerChannelConditionsV2: " + ps4000a_get_error_message(status));
+            GR_LOG_ERROR(d_logger, "ps4000aSetSimpleTrigger: " + ps4000a_get_error_message(status));
             return make_pico_4000a_error_code(status);
           }
         }
+        else {
+          // disable triggers...
+          for(int i = 0; i < PS4000A_MAX_CHANNELS; i++) {
+            PS4000A_CONDITION cond;
+            cond.source = static_cast<PS4000A_CHANNEL>(i);
+            cond.condition =PS4000A_CONDITION_DONT_CARE;
+            status = ps4000aSetTriggerChannelConditions(d_handle, &cond, 1, PS4000A_CLEAR);
+            if(status != PICO_OK) {
+              GR_LOG_ERROR(d_logger, "ps4000aSetTriggerChannelConditionsV2: " + ps4000a_get_error_message(status));
+              return make_pico_4000a_error_code(status);
+            }
+          }
+        }
       }
 
       // In order to validate desired frequency before startup
@@ -552,6 +651,11 @@ namespace gr {
     picoscope_4000a_impl::driver_arm()
     {
       if(d_acquisition_mode == acquisition_mode_t::RAPID_BLOCK) {
+          auto erc = arm_overlapped_readout();
+          if (erc) {
+            return erc;
+          }
+
           uint32_t timebase =  convert_frequency_to_ps4000a_timebase(d_samp_rate, d_actual_samp_rate);
 
           auto status = ps4000aRunBlock(d_handle,
@@ -559,7 +663,7 @@ namespace gr {
                   d_post_samples,  // post-trigger samples
                   timebase,        // timebase
                   NULL,            // time indispossed
-                  0,               // segment index
+                  get_capture_segment(), // first segment index
                   (ps4000aBlockReady)rapid_block_callback_redirector_4000a,
                   this);
           if(status != PICO_OK) {
@@ -616,12 +720,21 @@ namespace gr {
       }
 
       d_handle = -1;
+      d_unit_info.clear();
       return make_pico_4000a_error_code(status);
     }
 
     std::error_code
-    picoscope_4000a_impl::set_buffers(size_t samples, uint32_t block_number)
+    picoscope_4000a_impl::set_buffers(size_t samples, uint32_t block_number, size_t buffer_offset)
     {
+      // Driver buffers must not be reallocated once handed over to the driver
+      reserve_driver_buffers(buffer_offset + samples);
+
+      // Registrations are kept by the driver, e.g. re-arming in streaming mode doesn't need them
+      if (are_buffers_registered(block_number, samples, buffer_offset)) {
+        return std::error_code {};
+      }
+
       PICO_STATUS status;
 
       for(auto aichan = 0; aichan < d_ai_channels; aichan++)
@@ -630,23 +743,18 @@ namespace gr {
           continue;
 
         if(d_downsampling_mode == downsampling_mode_t::DOWNSAMPLING_MODE_MIN_MAX_AGG) {
-          d_buffers[aichan].reserve(samples);
-          d_buffers_min[aichan].reserve(samples);
-
           status = ps4000aSetDataBuffers(d_handle,
               static_cast<PS4000A_CHANNEL>(aichan),
-              &d_buffers[aichan][0],
-              &d_buffers_min[aichan][0],
+              &d_buffers[aichan][buffer_offset],
+              &d_buffers_min[aichan][buffer_offset],
               samples,
               block_number,
               convert_to_ps4000a_ratio_mode(d_downsampling_mode));
         }
         else {
-          d_buffers[aichan].reserve(samples);
-
           status = ps4000aSetDataBuffer(d_handle,
               static_cast<PS4000A_CHANNEL>(aichan),
-              &d_buffers[aichan][0],
+              &d_buffers[aichan][buffer_offset],
               samples,
               block_number,
               convert_to_ps4000a_ratio_mode(d_downsampling_mode));
@@ -659,12 +767,79 @@ namespace gr {
         }
       }
 
+      set_buffers_registered(block_number, samples, buffer_offset);
       return std::error_code {};
     }
 
+    std::error_code
+    picoscope_4000a_impl::arm_overlapped_readout()
+    {
+      const auto samples = get_block_size();
+      const auto first_segment = get_capture_segment();
+      auto &overlapped = d_overlapped[first_segment == 0 ? 0 : 1];
+      overlapped.armed = false;
+
+      // Driver buffers hold all the memory segments, segment i starts at sample i * samples.
+      // Capacity is reserved up front, buffers of the other half might still be read out.
+      const auto nr_segments = get_nr_memory_segments();
+      reserve_driver_buffers(samples * nr_segments);
+      if (d_overlapped_overflow.size() != nr_segments) {
+        d_overlapped_overflow.assign(nr_segments, 0);
+      }
+
+      for (uint32_t segment = first_segment; segment < first_segment + d_nr_captures; segment++) {
+        auto erc = set_buffers(samples, segment, segment * samples);
+        if (erc) {
+          return erc;
+        }
+      }
+
+      overlapped.nr_samples = samples;
+      auto status = ps4000aGetValuesOverlappedBulk(d_handle,
+          0,    // offset
+          &overlapped.nr_samples,
+          d_downsampling_factor,
+          convert_to_ps4000a_ratio_mode(d_downsampling_mode),
+          first_segment,                    // from segment index
+          first_segment + d_nr_captures - 1, // to segment index
+          &d_overlapped_overflow[first_segment]);
+      if(status != PICO_OK) {
+        GR_LOG_ERROR(d_logger, "ps4000aGetValuesOverlappedBulk: " + ps4000a_get_error_message(status));
+        return make_pico_4000a_error_code(status);
+      }
+
+      overlapped.samples = samples;
+      overlapped.armed = true;
+      return std::error_code {};
+    }
+
+    bool
+    picoscope_4000a_impl::use_overlapped_readout(size_t samples, size_t first_block, size_t nr_blocks)
+    {
+      const auto first_segment = first_block < d_nr_captures ? 0 : d_nr_captures;
+      const auto &overlapped = d_overlapped[first_segment == 0 ? 0 : 1];
+
+      if (!overlapped.armed || overlapped.samples != samples
+              || first_block + nr_blocks > first_segment + d_nr_captures) {
+        return false;
+      }
+
+      d_bulk_segment_stride = samples;
+      d_bulk_first_segment = 0;
+      d_bulk_overflow = d_overlapped_overflow;
+      return true;
+    }
+
     std::error_code
     picoscope_4000a_impl::driver_prefetch_block(size_t samples, size_t block_number)
     {
+      // Transferred as part of the run already
+      if (use_overlapped_readout(samples, block_number, 1)) {
+        return std::error_code {};
+      }
+
+      d_bulk_segment_stride = 0;
+
       auto erc = set_buffers(samples, block_number);
       if(erc){
         return erc;
@@ -685,6 +860,72 @@ namespace gr {
       return make_pico_4000a_error_code(status);
     }
 
+    std::error_code
+    picoscope_4000a_impl::driver_prefetch_blocks(size_t samples, size_t first_block, size_t nr_blocks)
+    {
+      // Transferred as part of the run already
+      if (use_overlapped_readout(samples, first_block, nr_blocks)) {
+        return std::error_code {};
+      }
+
+      d_bulk_segment_stride = 0;
+
+      // Driver buffers must not be reallocated once handed over to the driver
+      reserve_driver_buffers(samples * nr_blocks);
+
+      for (size_t block = 0; block < nr_blocks; block++) {
+        auto erc = set_buffers(samples, first_block + block, block * samples);
+        if(erc){
+          return erc;
+        }
+      }
+
+      d_bulk_overflow.assign(nr_blocks, 0);
+
+      uint32_t nr_samples = samples;
+      auto status = ps4000aGetValuesBulk(d_handle,
+          &nr_samples,
+          first_block,                  // from segment index
+          first_block + nr_blocks - 1,  // to segment index
+          d_downsampling_factor,
+          convert_to_ps4000a_ratio_mode(d_downsampling_mode),
+          &d_bulk_overflow[0]);
+      if(status != PICO_OK) {
+        GR_LOG_ERROR(d_logger, "ps4000aGetValuesBulk: " + ps4000a_get_error_message(status));
+        return make_pico_4000a_error_code(status);
+      }
+
+      d_bulk_segment_stride = samples;
+      d_bulk_first_segment = first_block;
+      return std::error_code {};
+    }
+
+    std::error_code
+    picoscope_4000a_impl::driver_get_trigger_offsets(size_t first_segment, size_t nr_segments,
+            std::vector<double> &offsets)
+    {
+      d_trigger_offset_times.resize(nr_segments);
+      d_trigger_offset_units.resize(nr_segments);
+
+      auto status = ps4000aGetValuesTriggerTimeOffsetBulk64(d_handle,
+          &d_trigger_offset_times[0],
+          &d_trigger_offset_units[0],
+          first_segment,                   // from segment index
+          first_segment + nr_segments - 1  // to segment index
+          );
+      if(status != PICO_OK) {
+        GR_LOG_ERROR(d_logger, "ps4000aGetValuesTriggerTimeOffsetBulk64: " + ps4000a_get_error_message(status));
+        return make_pico_4000a_error_code(status);
+      }
+
+      offsets.resize(nr_segments);
+      for (size_t i = 0; i < nr_segments; i++) {
+        offsets[i] = d_trigger_offset_times[i] * convert_ps4000a_time_units_to_seconds(d_trigger_offset_units[i]);
+      }
+
+      return std::error_code {};
+    }
+
 
     std::error_code
     picoscope_4000a_impl::driver_get_rapid_block_data(size_t offset, size_t length,
@@ -692,12 +933,17 @@ namespace gr {
     {
       int vec_index = 0;
 
+      // In case of bulk readout all the waveforms are held by the driver buffers, waveform is
+      // the device memory segment index
+      offset += get_segment_offset(waveform);
+      auto overflow = get_segment_overflow(waveform, d_overflow);
+
       for(auto chan_idx = 0; chan_idx < d_ai_channels; chan_idx++, vec_index +=2) {
         if(!d_channel_settings[chan_idx].enabled) {
           continue;
         }
 
-        if (d_overflow & (1 << chan_idx)) {
+        if (overflow & (1 << chan_idx)) {
           status[chan_idx] = channel_status_t::CHANNEL_STATUS_OVERFLOW;
         }
         else {
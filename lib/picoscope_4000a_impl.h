@@ -23,10 +23,26 @@ namespace gr {
      private:
       int16_t d_handle;     // picoscope handle
       int16_t d_overflow;   // status returned from getValues
+      // trigger time offsets per segment, see driver_get_trigger_offsets
+      std::vector<int64_t> d_trigger_offset_times;
+      std::vector<PS4000A_TIME_UNITS> d_trigger_offset_units;
+
+      // Overlapped readout in rapid block mode, the data is transferred into the driver buffers
+      // as part of the run (see arm_overlapped_readout). Per half of the device memory (see
+      // get_capture_segment), overflow flags are per memory segment. The driver writes into
+      // these asynchronously, they must not move while armed.
+      struct overlapped_readout_t
+      {
+        bool armed;
+        size_t samples;
+        uint32_t nr_samples;
+      };
+      overlapped_readout_t d_overlapped[2];
+      std::vector<int16_t> d_overlapped_overflow;
 
      public:
      
-      picoscope_4000a_impl(std::string serial_number, bool auto_arm);
+      picoscope_4000a_impl(std::string serial_number, bool auto_arm, bool raw_output);
 
       ~picoscope_4000a_impl();
 
@@ -46,6 +62,11 @@ namespace gr {
 
       std::error_code driver_prefetch_block(size_t length, size_t block_number) override;
 
+      std::error_code driver_prefetch_blocks(size_t length, size_t first_block, size_t nr_blocks) override;
+
+      std::error_code driver_get_trigger_offsets(size_t first_segment, size_t nr_segments,
+              std::vector<double> &offsets) override;
+
       std::error_code driver_get_rapid_block_data(size_t offset, size_t length, size_t waveform,
               gr_vector_void_star &arrays, std::vector<uint32_t> &status) override;
 
@@ -57,7 +78,27 @@ namespace gr {
 
       std::string get_unit_info_topic(PICO_INFO info);
 
-      std::error_code set_buffers(size_t samples, uint32_t block_number);
+      /*!
+       * \brief Hands over driver buffers for the given segment, buffer_offset is the offset
+       * of the segment within driver buffers in samples.
+       */
+      std::error_code set_buffers(size_t samples, uint32_t block_number, size_t buffer_offset=0);
+
+      /*!
+       * \brief Registers the driver buffers of the segments captured by the next run and
+       * requests their transfer once captured (ps4000aGetValuesOverlappedBulk). Must be called
+       * before the run is started.
+       *
+       * Each segment gets its own part of the driver buffers, i.e. the other half of the device
+       * memory can still be read out while capturing (see set_overlapped_readout).
+       */
+      std::error_code arm_overlapped_readout();
+
+      /*!
+       * \brief Returns true if the given segments were transferred by the last run already
+       * and makes them available to driver_get_rapid_block_data.
+       */
+      bool use_overlapped_readout(size_t samples, size_t first_block, size_t nr_blocks);
 
       uint32_t convert_frequency_to_ps4000a_timebase(double desired_freq, double &actual_freq);
     };
@@ -12,7 +12,10 @@
 #include "picoscope_6000_impl.h"
 #include "utils.h"
 #include "ps_6000_defs.h"
+#include "unit_registry.h"
 #include <cstring>
+#include <map>
+#include <set>
 
 #define MAX_PICO_DEVICES 64
 
@@ -48,6 +51,11 @@ std::error_code make_pico_6000_error_code(PICO_STATUS e)
 namespace
 {
     boost::mutex g_init_mutex;
+
+    // Serial numbers requested by open_units and units found while looking for another unit
+    // which were requested too, both guarded by the init mutex
+    std::set<std::string> g_requested_serials;
+    std::map<std::string, int16_t> g_spare_handles;
 }
 
 namespace gr {
@@ -277,6 +285,27 @@ namespace gr {
       }
     }
 
+    static double
+    convert_ps6000_time_units_to_seconds(PS6000_TIME_UNITS units)
+    {
+      switch(units)
+      {
+      case PS6000_FS:
+        return 1e-15;
+      case PS6000_PS:
+        return 1e-12;
+      case PS6000_NS:
+        return 1e-9;
+      case PS6000_US:
+        return 1e-6;
+      case PS6000_MS:
+        return 1e-3;
+      case PS6000_S:
+      default:
+        return 1.0;
+      }
+    }
+
     PS6000_THRESHOLD_DIRECTION
     convert_to_ps6000_threshold_direction(trigger_direction_t direction)
     {
@@ -342,6 +371,110 @@ namespace gr {
      * Structors
      *********************************************************************/
 
+    /*!
+     * Opens the unit and queries the unit info, executed by the unit registry or by
+     * driver_initialize if the unit was not requested in advance.
+     *
+     * All the available units are opened and the one with the given serial number is kept.
+     * Other units requested by open_units are kept aside for their own open instead of being
+     * closed, i.e. the units are enumerated once.
+     */
+    static opened_unit_t
+    open_6000_unit(const std::string &serial_number)
+    {
+      opened_unit_t unit;
+      PICO_STATUS status = PICO_OK;
+      int16_t temp_handles[MAX_PICO_DEVICES];
+      uint16_t devCount = 0;
+
+      unit.status = PICO_NOT_FOUND;
+      unit.failed_call = "ps6000OpenUnit (no ps6000 device found)";
+
+      {
+        // Required to force sequence execution of open unit calls...
+        boost::mutex::scoped_lock init_guard(g_init_mutex);
+
+        auto spare = g_spare_handles.find(serial_number);
+        if (spare != g_spare_handles.end()) {
+          unit.handle = spare->second;
+          unit.status = PICO_OK;
+          unit.failed_call.clear();
+          g_spare_handles.erase(spare);
+        }
+        else {
+          while(status != PICO_NOT_FOUND && devCount < MAX_PICO_DEVICES)
+          {
+              status = ps6000OpenUnit(&(temp_handles[devCount]),NULL);
+              if(status == PICO_OK || status == PICO_USB3_0_DEVICE_NON_USB3_0_PORT)
+                  devCount++;
+          }
+        }
+
+        if (serial_number.empty() && devCount > 1)
+        {
+            unit.failed_call = "ps6000OpenUnit (there is more than one ps6000 connected, please enter a serial)";
+        }
+
+        for(uint16_t i = 0; i < devCount; i++)
+        {
+            int8_t serial[20] = {};
+            int16_t requiredSize;
+
+            ps6000GetUnitInfo(temp_handles[i], serial, sizeof (serial), &requiredSize, PICO_BATCH_AND_SERIAL);
+            auto found = std::string(reinterpret_cast<char *>(serial));
+
+            if(unit.status != PICO_OK && ((serial_number.empty() && devCount == 1) || found == serial_number))
+            {
+                unit.handle = temp_handles[i];
+                unit.status = PICO_OK;
+                unit.failed_call.clear();
+            }
+            else if (!found.empty() && g_requested_serials.count(found))
+            {
+                g_spare_handles[found] = temp_handles[i];
+            }
+            else
+            {
+                ps6000CloseUnit(temp_handles[i]);
+            }
+        }
+      }
+
+      if (unit.status != PICO_OK) {
+        return unit;
+      }
+
+      // maximum value is used for conversion to volts
+      unit.max_value = PS6000_MAX_VALUE;
+
+      for (PICO_INFO info : {PICO_HARDWARE_VERSION, PICO_DRIVER_VERSION}) {
+        char line[40];
+        int16_t required_size;
+
+        status = ps6000GetUnitInfo(unit.handle, reinterpret_cast<int8_t *>(line), sizeof(line),
+                &required_size, info);
+        if (status == PICO_OK) {
+          unit.info[info] = std::string(line, required_size);
+        }
+      }
+
+      return unit;
+    }
+
+    static unit_registry_t g_units(open_6000_unit,
+            [](int16_t handle) { ps6000CloseUnit(handle); });
+
+    void
+    picoscope_6000::open_units(const std::vector<std::string> &serial_numbers)
+    {
+      {
+        boost::mutex::scoped_lock init_guard(g_init_mutex);
+        g_requested_serials.insert(serial_numbers.begin(), serial_numbers.end());
+      }
+
+      g_units.open_units(serial_numbers);
+    }
+
     picoscope_6000::sptr
     picoscope_6000::make(std::string serial_number, bool auto_arm)
     {
@@ -399,6 +532,11 @@ namespace gr {
     std::string
     picoscope_6000_impl::get_unit_info_topic(PICO_INFO info)
     {
+      auto cached = d_unit_info.find(info);
+      if (cached != d_unit_info.end()) {
+        return cached->second;
+      }
+
       char line[40];
       int16_t required_size;
 
@@ -436,92 +574,20 @@ namespace gr {
     std::error_code
     picoscope_6000_impl::driver_initialize()
     {
-      //std::cout << "picoscope_6000_impl::driver_initialize start" << std::endl;
-      PICO_STATUS status = PICO_OK;
-      int16_t temp_handles[MAX_PICO_DEVICES];
-      uint16_t devCount = 0;
-
-      // Required to force sequence execution of open unit calls...
-      boost::mutex::scoped_lock init_guard(g_init_mutex);
-
-      while(status != PICO_NOT_FOUND)
-      {
-          status = ps6000OpenUnit(&(temp_handles[devCount]),NULL);
-          if(status == PICO_OK || status == PICO_USB3_0_DEVICE_NON_USB3_0_PORT)
-              devCount++;
+      opened_unit_t unit;
+      if (!g_units.take(d_serial_number, unit)) {
+        unit = open_6000_unit(d_serial_number);
       }
 
-      if (devCount == 0)
-      {
-          GR_LOG_ERROR(d_logger, "No ps6000 device found");
-          return make_pico_6000_error_code(12);
+      if (unit.status != PICO_OK) {
+        GR_LOG_ERROR(d_logger, unit.failed_call + ": " + ps6000_get_error_message(unit.status));
+        return make_pico_6000_error_code(unit.status);
       }
 
-      if( d_serial_number.empty() )
-      {
-          if( devCount != 1)
-          {
-              GR_LOG_ERROR(d_logger, "There is more than one ps6000 connected. Please enter a serial!");
-              for(uint16_t i = 0; i< devCount; i++)
-                  ps6000CloseUnit(temp_handles[i]);
-              return make_pico_6000_error_code(12);
-          }
-      }
-      else
-      {
-          for(uint16_t i = 0; i< devCount; i++)
-          {
-              int16_t requiredSize = 20;
-              int8_t serial[requiredSize];
-
-              ps6000GetUnitInfo(temp_handles[i], serial, sizeof (serial), &requiredSize, PICO_BATCH_AND_SERIAL);
-              std::cout << "serial: " << serial << std::endl;
-
-              std::ostringstream convert;
-              for (int a = 0; serial[a] != int8_t('\0'); a++) {
-                  convert << serial[a];
-              }
-              if( convert.str() == d_serial_number )
-              {
-                  std::cout << "Device Found: " << convert.str() << std::endl;
-                  d_handle = temp_handles[i];
-              }
-              else
-              {
-                  std::cout << "Device Skipped: " << convert.str() << std::endl;
-                  ps6000CloseUnit(temp_handles[i]);
-              }
-          }
-      }
-
-      //exit(1);
-      //std::cout << "picoscope_6000_impl::driver_initialize 1" << std::endl;
-      //std::cout << "d_serial_number: " << d_serial_number <<  std::endl;
-      // take any if serial number is not provided (useful for testing purposes)
-
-
-//      if (d_serial_number.empty()) {
-//        status = ps6000OpenUnit(&(d_handle), NULL);
-//      }
-//      else {
-////        int8_t serial[20];
-////        size_t index = 0;
-////        for(; index < d_serial_number.size(); index++ )
-////        {
-////            serial[index] = d_serial_number[index];
-////        }
-////        serial[index] = int8_t('\0');
-////        std::cout << "serial:" << serial << std::endl;
-//        status = ps6000OpenUnit(&(d_handle), (int8_t*)d_serial_number.c_str());
-//      }
-//      std::cout << "picoscope_6000_impl::driver_initialize 2" << std::endl;
-//      if (status != PICO_OK) {
-//        GR_LOG_ERROR(d_logger, "open unit failed: " + ps6000_get_error_message(status));
-//        return make_pico_6000_error_code(status);
-//      }
+      d_handle = unit.handle;
+      d_max_value = unit.max_value;
+      d_unit_info = unit.info;
 
-      // maximum value is used for conversion to volts
-      d_max_value = PS6000_MAX_VALUE;
       return std::error_code{};
     }
 
@@ -531,8 +597,11 @@ namespace gr {
     {
       assert(d_ai_channels <= PS6000_MAX_CHANNELS);
 
+      // Configuration (e.g. ratio mode) is part of the buffer registrations
+      clear_registered_buffers();
+
       uint32_t max_samples;
-      PICO_STATUS status = ps6000MemorySegments(d_handle, d_nr_captures, &max_samples);
+      PICO_STATUS status = ps6000MemorySegments(d_handle, get_nr_memory_segments(), &max_samples);
       if(status != PICO_OK) {
         GR_LOG_ERROR(d_logger, "ps6000MemorySegments: " + ps6000_get_error_message(status));
         return make_pico_6000_error_code(status);
@@ -544,8 +613,12 @@ namespace gr {
         return make_pico_6000_error_code(status);
       }
 
-      // configure analog channels
+      // configure analog channels, the ones unchanged are skipped
       for (auto i = 0; i < d_ai_channels; i++) {
+        if (is_aichan_applied(i)) {
+          continue;
+        }
+
         auto enabled = d_channel_settings[i].enabled;
         auto coupling = convert_to_ps6000_coupling(d_channel_settings[i].coupling, d_channel_settings[i].range);
         auto range = convert_to_ps6000_range(d_channel_settings[i].range);
@@ -560,38 +633,40 @@ namespace gr {
         }
       }
 
-      // apply trigger configuration
-      if (d_trigger_settings.is_enabled()
-             && d_acquisition_mode == acquisition_mode_t::RAPID_BLOCK)
-      {
-        status = ps6000SetSimpleTrigger(d_handle,
-              true,  // enable
-              convert_to_ps6000_channel(d_trigger_settings.source),
-              convert_voltage_to_ps6000_raw_logic_value(d_trigger_settings.threshold),
-              convert_to_ps6000_threshold_direction(d_trigger_settings.direction),
-              0,     // delay
-             -1);    // auto trigger
-        if(status != PICO_OK) {
-          GR_LOG_ERROR(d_logger, "ps6000SetSimpleTrigger: " + ps6000_get_error_message(status));
-          return make_pico_6000_error_code(status);
+      // apply trigger configuration, unless unchanged
+      if (!is_trigger_applied()) {
+        if (d_trigger_settings.is_enabled()
+               && d_acquisition_mode == acquisition_mode_t::RAPID_BLOCK)
+        {
+          status = ps6000SetSimpleTrigger(d_handle,
+                true,  // enable
+                convert_to_ps6000_channel(d_trigger_settings.source),
+                convert_voltage_to_ps6000_raw_logic_value(d_trigger_settings.threshold),
+                convert_to_ps6000_threshold_direction(d_trigger_settings.direction),
+                0,     // delay
+               -1);    // auto trigger
+          if(status != PICO_OK) {
+            GR_LOG_ERROR(d_logger, "ps6000SetSimpleTrigger: " + ps6000_get_error_message(status));
+            return make_pico_6000_error_code(status);
+          }
         }
-      }
-      else {
+        else {
 
-        // disable triggers...
-        PS6000_TRIGGER_CONDITIONS conds = {
-              PS6000_CONDITION_DONT_CARE,
-              PS6000_CONDITION_DONT_CARE,
-              PS6000_CONDITION_DONT_CARE,
-              PS6000_CONDITION_DONT_CARE,
-              PS6000_CONDITION_DONT_CARE,
-              PS6000_CONDITION_DONT_CARE,
-              PS6000_CONDITION_DONT_CARE
-        };
-        status = ps6000SetTriggerChannelConditions(d_handle, &conds, 1);
-        if(status != PICO_OK) {
-          GR_LOG_ERROR(d_logger, "ps6000SetTriggerChannelConditionsV2: " + ps6000_get_error_message(status));
-          return make_pico_6000_error_code(status);
+          // disable triggers...
+          PS6000_TRIGGER_CONDITIONS conds = {
+                PS6000_CONDITION_DONT_CARE,
+                PS6000_CONDITION_DONT_CARE,
+                PS6000_CONDITION_DONT_CARE,
+                PS6000_CONDITION_DONT_CARE,
+                PS6000_CONDITION_DONT_CARE,
+                PS6000_CONDITION_DONT_CARE,
+                PS6000_CONDITION_DONT_CARE
+          };
+          status = ps6000SetTriggerChannelConditions(d_handle, &conds, 1);
+          if(status != PICO_OK) {
+            GR_LOG_ERROR(d_logger, "ps6000SetTriggerChannelConditionsV2: " + ps6000_get_error_message(status));
+            return make_pico_6000_error_code(status);
+          }
         }
       }
 
@@ -627,7 +702,7 @@ namespace gr {
                   timebase,        // timebase
                   0,               // oversample
                   NULL,            // time indispossed
-                  0,               // segment index
+                  get_capture_segment(), // first segment index
                   (ps6000BlockReady)rapid_block_callback_redirector_6000,
                   this);
           if(status != PICO_OK) {
@@ -684,12 +759,21 @@ namespace gr {
       }
 
       d_handle = -1;
+      d_unit_info.clear();
       return make_pico_6000_error_code(status);
     }
 
     std::error_code
     picoscope_6000_impl::set_buffers(size_t samples, uint32_t block_number)
     {
+      // Driver buffers must not be reallocated once handed over to the driver
+      reserve_driver_buffers(samples);
+
+      // Non-bulk registrations don't depend on the segment, hence kept under segment zero
+      if (are_buffers_registered(0, samples, 0)) {
+        return std::error_code {};
+      }
+
       PICO_STATUS status;
 
       for(auto aichan = 0; aichan < d_ai_channels; aichan++)
@@ -698,9 +782,6 @@ namespace gr {
           continue;
 
         if(d_downsampling_mode == downsampling_mode_t::DOWNSAMPLING_MODE_MIN_MAX_AGG) {
-          d_buffers[aichan].reserve(samples);
-          d_buffers_min[aichan].reserve(samples);
-
           status = ps6000SetDataBuffers(d_handle,
               static_cast<PS6000_CHANNEL>(aichan),
               &d_buffers[aichan][0],
@@ -709,8 +790,6 @@ namespace gr {
               convert_to_ps6000_ratio_mode(d_downsampling_mode));
         }
         else {
-          d_buffers[aichan].reserve(samples);
-
           status = ps6000SetDataBuffer(d_handle,
               static_cast<PS6000_CHANNEL>(aichan),
               &d_buffers[aichan][0],
@@ -724,12 +803,56 @@ namespace gr {
           return make_pico_6000_error_code(status);
         }
       }
+
+      set_buffers_registered(0, samples, 0);
+      return std::error_code {};
+    }
+
+    std::error_code
+    picoscope_6000_impl::set_bulk_buffers(size_t samples, uint32_t block_number, size_t buffer_offset)
+    {
+      // Bulk registrations replace the non-bulk ones
+      clear_registered_buffers();
+
+      PICO_STATUS status;
+
+      for(auto aichan = 0; aichan < d_ai_channels; aichan++)
+      {
+        if(!d_channel_settings[aichan].enabled)
+          continue;
+
+        if(d_downsampling_mode == downsampling_mode_t::DOWNSAMPLING_MODE_MIN_MAX_AGG) {
+          status = ps6000SetDataBuffersBulk(d_handle,
+              static_cast<PS6000_CHANNEL>(aichan),
+              &d_buffers[aichan][buffer_offset],
+              &d_buffers_min[aichan][buffer_offset],
+              samples,
+              block_number,
+              convert_to_ps6000_ratio_mode(d_downsampling_mode));
+        }
+        else {
+          status = ps6000SetDataBufferBulk(d_handle,
+              static_cast<PS6000_CHANNEL>(aichan),
+              &d_buffers[aichan][buffer_offset],
+              samples,
+              block_number,
+              convert_to_ps6000_ratio_mode(d_downsampling_mode));
+        }
+
+        if(status != PICO_OK) {
+          GR_LOG_ERROR(d_logger, "ps6000SetDataBufferBulk (chan " + std::to_string(aichan)
+                + "): " + ps6000_get_error_message(status));
+          return make_pico_6000_error_code(status);
+        }
+      }
       return std::error_code {};
     }
 
     std::error_code
     picoscope_6000_impl::driver_prefetch_block(size_t samples, size_t block_number)
     {
+      d_bulk_segment_stride = 0;
+
       auto erc = set_buffers(samples, block_number);
       if(erc){
         return erc;
@@ -750,18 +873,84 @@ namespace gr {
       return make_pico_6000_error_code(status);
     }
 
+    std::error_code
+    picoscope_6000_impl::driver_prefetch_blocks(size_t samples, size_t first_block, size_t nr_blocks)
+    {
+      d_bulk_segment_stride = 0;
+
+      // Driver buffers must not be reallocated once handed over to the driver
+      reserve_driver_buffers(samples * nr_blocks);
+
+      for (size_t block = 0; block < nr_blocks; block++) {
+        auto erc = set_bulk_buffers(samples, first_block + block, block * samples);
+        if(erc){
+          return erc;
+        }
+      }
+
+      d_bulk_overflow.assign(nr_blocks, 0);
+
+      uint32_t nr_samples = samples;
+      auto status = ps6000GetValuesBulk(d_handle,
+          &nr_samples,
+          first_block,                  // from segment index
+          first_block + nr_blocks - 1,  // to segment index
+          d_downsampling_factor,
+          convert_to_ps6000_ratio_mode(d_downsampling_mode),
+          &d_bulk_overflow[0]);
+      if(status != PICO_OK) {
+        GR_LOG_ERROR(d_logger, "ps6000GetValuesBulk: " + ps6000_get_error_message(status));
+        return make_pico_6000_error_code(status);
+      }
+
+      d_bulk_segment_stride = samples;
+      d_bulk_first_segment = first_block;
+      return std::error_code {};
+    }
+
+    std::error_code
+    picoscope_6000_impl::driver_get_trigger_offsets(size_t first_segment, size_t nr_segments,
+            std::vector<double> &offsets)
+    {
+      d_trigger_offset_times.resize(nr_segments);
+      d_trigger_offset_units.resize(nr_segments);
+
+      auto status = ps6000GetValuesTriggerTimeOffsetBulk64(d_handle,
+          &d_trigger_offset_times[0],
+          &d_trigger_offset_units[0],
+          first_segment,                   // from segment index
+          first_segment + nr_segments - 1  // to segment index
+          );
+      if(status != PICO_OK) {
+        GR_LOG_ERROR(d_logger, "ps6000GetValuesTriggerTimeOffsetBulk64: " + ps6000_get_error_message(status));
+        return make_pico_6000_error_code(status);
+      }
+
+      offsets.resize(nr_segments);
+      for (size_t i = 0; i < nr_segments; i++) {
+        offsets[i] = d_trigger_offset_times[i] * convert_ps6000_time_units_to_seconds(d_trigger_offset_units[i]);
+      }
+
+      return std::error_code {};
+    }
+
     std::error_code
     picoscope_6000_impl::driver_get_rapid_block_data(size_t offset, size_t length,
             size_t waveform, gr_vector_void_star &arrays, std::vector<uint32_t> &status)
     {
       int vec_index = 0;
 
+      // In case of bulk readout all the waveforms are held by the driver buffers, waveform is
+      // the device memory segment index
+      offset += get_segment_offset(waveform);
+      auto overflow = get_segment_overflow(waveform, d_overflow);
+
       for(auto chan_idx = 0; chan_idx < d_ai_channels; chan_idx++, vec_index +=2) {
         if(!d_channel_settings[chan_idx].enabled) {
           continue;
         }
 
-        if (d_overflow & (1 << chan_idx)) {
+        if (overflow & (1 << chan_idx)) {
           status[chan_idx] = channel_status_t::CHANNEL_STATUS_OVERFLOW;
         }
         else {
@@ -23,6 +23,9 @@ namespace gr {
      private:
           int16_t d_handle;     // picoscope handle
           int16_t d_overflow;  // status returned from getValues
+          // trigger time offsets per segment, see driver_get_trigger_offsets
+          std::vector<int64_t> d_trigger_offset_times;
+          std::vector<PS6000_TIME_UNITS> d_trigger_offset_units;
 
      public:
       picoscope_6000_impl(std::string serial_number, bool auto_arm);
@@ -45,6 +48,11 @@ namespace gr {
 
       std::error_code driver_prefetch_block(size_t length, size_t block_number) override;
 
+      std::error_code driver_prefetch_blocks(size_t length, size_t first_block, size_t nr_blocks) override;
+
+      std::error_code driver_get_trigger_offsets(size_t first_segment, size_t nr_segments,
+              std::vector<double> &offsets) override;
+
       std::error_code driver_get_rapid_block_data(size_t offset, size_t length, size_t waveform,
               gr_vector_void_star &arrays, std::vector<uint32_t> &status) override;
 
@@ -58,6 +66,13 @@ namespace gr {
 
       std::error_code set_buffers(size_t samples, uint32_t block_number);
 
+      /*!
+       * \brief Hands over driver buffers for the given segment (bulk readout), buffer_offset is
+       * the offset of the segment within driver buffers in samples. Buffers need to be reserved
+       * beforehand.
+       */
+      std::error_code set_bulk_buffers(size_t samples, uint32_t block_number, size_t buffer_offset);
+
       uint32_t convert_frequency_to_ps6000_timebase(double desired_freq, double &actual_freq);
     };
 
@@ -10,7 +10,9 @@
 
 #include "picoscope_impl.h"
 #include <digitizers/status.h>
-#include <volk/volk.h>
+#include "conversion_kernel.h"
+#include "probes.h"
+#include <algorithm>
 
 namespace gr {
   namespace digitizers {
@@ -20,19 +22,24 @@ namespace gr {
      *********************************************************************/
 
     picoscope_impl::picoscope_impl(std::string serial_number, int max_ai_channels, int max_di_ports,
-            bool auto_arm, int16_t max_raw_analog_value, float vertical_precision)
-      : digitizer_block_impl(max_ai_channels, max_di_ports, auto_arm),
+            bool auto_arm, int16_t max_raw_analog_value, float vertical_precision, bool raw_output)
+      : digitizer_block_impl(max_ai_channels, max_di_ports, auto_arm, raw_output),
         d_serial_number(serial_number),
         d_max_value(max_raw_analog_value),
         d_vertical_precision(vertical_precision),
         d_ranges(),
         d_streaming_callback(boost::bind(&picoscope_impl::streaming_callback, this, _1, _2, _3)),
-        d_buffers(max_ai_channels),
-        d_buffers_min(max_ai_channels),
-        d_port_buffers(max_di_ports),
+        d_buffers(max_ai_channels, nullptr),
+        d_buffers_min(max_ai_channels, nullptr),
+        d_port_buffers(max_di_ports, nullptr),
+        d_bulk_segment_stride(0),
+        d_bulk_first_segment(0),
+        d_bulk_overflow(),
         d_tmp_buffer(nullptr),
         d_tmp_buffer_size(0),
-        d_lost_count(0)
+        d_lost_count(0),
+        d_convert_channels(&picoscope_impl::convert_channels<false, false>),
+        d_driver_buffer_capacity(0)
     {
       for (auto i = 0; i < max_ai_channels; i++) {
         d_channel_ids.emplace_back("" + static_cast<char>('A' + i));
@@ -48,6 +55,178 @@ namespace gr {
      * Driver implementation
      *********************************************************************/
 
+    void
+    picoscope_impl::reserve_driver_buffers(size_t samples)
+    {
+      const bool min_max = d_downsampling_mode == downsampling_mode_t::DOWNSAMPLING_MODE_MIN_MAX_AGG;
+
+      size_t nr_blocks = 0;
+      for (auto aichan = 0; aichan < d_ai_channels; aichan++) {
+        if (d_channel_settings[aichan].enabled) {
+          nr_blocks += min_max ? 2 : 1;
+        }
+      }
+      for (auto port = 0; port < d_ports; port++) {
+        if (d_port_settings[port].enabled) {
+          nr_blocks++;
+        }
+      }
+
+      d_driver_buffer_capacity = std::max(d_driver_buffer_capacity, samples);
+      const auto block_size_bytes = chunk_memory_t::round_up(d_driver_buffer_capacity * sizeof(int16_t),
+              DRIVER_BUFFER_ALIGNMENT);
+
+      if (nr_blocks * block_size_bytes > d_driver_memory.size()) {
+        d_driver_memory.allocate(nr_blocks * block_size_bytes, d_buffer_huge_pages, d_buffer_numa_node,
+                d_realtime_memory);
+      }
+
+      uint8_t *block = d_driver_memory.data();
+      auto next_block = [&block, block_size_bytes]() {
+        auto buffer = reinterpret_cast<int16_t *>(block);
+        block += block_size_bytes;
+        return buffer;
+      };
+
+      for (auto aichan = 0; aichan < d_ai_channels; aichan++) {
+        const bool enabled = d_channel_settings[aichan].enabled;
+        d_buffers[aichan] = enabled ? next_block() : nullptr;
+        d_buffers_min[aichan] = enabled && min_max ? next_block() : nullptr;
+      }
+
+      for (auto port = 0; port < d_ports; port++) {
+        d_port_buffers[port] = d_port_settings[port].enabled ? next_block() : nullptr;
+      }
+
+      build_conversion_plan();
+    }
+
+    void
+    picoscope_impl::build_conversion_plan()
+    {
+      const bool min_max = d_downsampling_mode == downsampling_mode_t::DOWNSAMPLING_MODE_MIN_MAX_AGG;
+      const bool raw = d_zero_copy || d_raw_output;
+
+      // Buffer organization:
+      //   <chan 1 values> <chan 1 errors> <chan 2 values> <chan 2 errors> ... <port 1> <port 2> ...
+      const auto channel_buffer_size_bytes = d_buffer_size * driver_chunk_sample_size();
+      const auto channel_half_size_bytes = channel_buffer_size_bytes / 2;
+
+      d_channel_plan.clear();
+      for (auto channel_idx = 0; channel_idx < d_ai_channels; channel_idx++) {
+        if (d_channel_settings[channel_idx].enabled) {
+          const auto region = d_channel_plan.size() * channel_buffer_size_bytes;
+          d_channel_plan.push_back(channel_conversion_t {channel_idx, d_buffers[channel_idx],
+                  d_buffers_min[channel_idx], region, region + channel_half_size_bytes});
+        }
+      }
+
+      d_port_plan.clear();
+      const auto first_port = d_channel_plan.size() * channel_buffer_size_bytes;
+      for (auto port_idx = 0; port_idx < d_ports; port_idx++) {
+        if (d_port_settings[port_idx].enabled) {
+          d_port_plan.push_back(port_conversion_t {d_port_buffers[port_idx],
+                  first_port + d_port_plan.size() * d_buffer_size * sizeof(uint8_t)});
+        }
+      }
+
+      if (min_max) {
+        d_convert_channels = raw ? &picoscope_impl::convert_channels<true, true>
+                : &picoscope_impl::convert_channels<true, false>;
+      }
+      else {
+        d_convert_channels = raw ? &picoscope_impl::convert_channels<false, true>
+                : &picoscope_impl::convert_channels<false, false>;
+      }
+    }
+
+    template <bool MinMax, bool Raw>
+    void
+    picoscope_impl::convert_channels(size_t first, size_t last, uint8_t *data, uint32_t start_index,
+            size_t chunk_index, uint32_t nsamples) const
+    {
+      const auto &channels = get_config_snapshot().config.channels;
+
+      for (size_t i = first; i < last; i++) {
+        const auto &plan = d_channel_plan[i];
+
+        if (Raw) {
+          // Raw samples are converted (or passed through) by the work thread, see
+          // driver_read_data_chunk
+          memcpy(reinterpret_cast<int16_t *>(data + plan.values_offset) + chunk_index,
+                  plan.raw + start_index, nsamples * sizeof(int16_t));
+          if (MinMax) {
+            memcpy(reinterpret_cast<int16_t *>(data + plan.errors_offset) + chunk_index,
+                    plan.raw_min + start_index, nsamples * sizeof(int16_t));
+          }
+          continue;
+        }
+
+        float *values = reinterpret_cast<float *>(data + plan.values_offset) + chunk_index;
+        float *errors = reinterpret_cast<float *>(data + plan.errors_offset) + chunk_index;
+
+        // Calibration is folded into the conversion, see set_aichan_calibration
+        const auto &settings = channels[plan.channel_idx];
+        const float voltage_multiplier = (float)settings.range / (float)d_max_value;
+
+        if (MinMax) {
+          min_max_agg_convert(plan.raw + start_index, plan.raw_min + start_index, voltage_multiplier,
+                  settings.calibration_scale, settings.calibration_offset, values, errors, nsamples);
+        }
+        else {
+          raw_convert(plan.raw + start_index, voltage_multiplier * settings.calibration_scale,
+                  settings.calibration_offset, values, nsamples);
+
+          float error_estimate = 0.0;
+          driver_get_constant_error(plan.channel_idx, error_estimate);
+          std::fill(errors, errors + nsamples, error_estimate);
+        }
+      }
+    }
+
+    uintptr_t
+    picoscope_impl::get_driver_buffer_addresses() const
+    {
+      uintptr_t addresses = 0;
+
+      for (auto aichan = 0; aichan < d_ai_channels; aichan++) {
+        if (d_channel_settings[aichan].enabled) {
+          addresses = addresses * 31 + reinterpret_cast<uintptr_t>(d_buffers[aichan]);
+          addresses = addresses * 31 + reinterpret_cast<uintptr_t>(d_buffers_min[aichan]);
+        }
+      }
+
+      for (auto port = 0; port < d_ports; port++) {
+        if (d_port_settings[port].enabled) {
+          addresses = addresses * 31 + reinterpret_cast<uintptr_t>(d_port_buffers[port]);
+        }
+      }
+
+      return addresses;
+    }
+
+    bool
+    picoscope_impl::are_buffers_registered(uint32_t segment, size_t samples, size_t offset) const
+    {
+      auto it = d_registered_buffers.find(segment);
+      return it != d_registered_buffers.end()
+              && it->second.samples == samples
+              && it->second.offset == offset
+              && it->second.addresses == get_driver_buffer_addresses();
+    }
+
+    void
+    picoscope_impl::set_buffers_registered(uint32_t segment, size_t samples, size_t offset)
+    {
+      d_registered_buffers[segment] = buffer_registration_t {samples, offset, get_driver_buffer_addresses()};
+    }
+
+    void
+    picoscope_impl::clear_registered_buffers()
+    {
+      d_registered_buffers.clear();
+    }
+
     std::vector<std::string>
     picoscope_impl::get_aichan_ids()
     {
@@ -63,47 +242,44 @@ namespace gr {
     void
     picoscope_impl::streaming_callback(int32_t nr_samples, uint32_t start_index, int16_t overflow)
     {
-      // trigger timestamp
-       uint64_t local_timestamp = get_timestamp_nano_utc();
+      DIGITIZERS_PROBE2(streaming_callback, nr_samples, start_index);
+
+      // Chunks are timestamped from the sample counter, the callback time only disciplines the
+      // clock model
+      uint64_t sample_index = d_samples_received;
+      d_samples_received += nr_samples;
+      update_sample_clock(d_samples_received, get_chunk_timestamp_ns());
 
       // According to well informed sources, the driver indicates the buffer overrun by setting
       // all the bits of the overflow argument to true.
       if (static_cast<uint16_t>(overflow) == 0xFFFF) {
-        GR_LOG_ERROR(d_logger, "Buffer overrun detected, continue...");
+        add_event(EVENT_DRIVER_OVERRUN);
       }
 
-      // monitor sampler rate (estimated used by the watchdog)
-      auto timestamp_now = boost::chrono::high_resolution_clock::now();
-
-      if (d_was_last_callback_timestamp_taken) {
-        boost::chrono::duration<float> time_diff = timestamp_now - d_last_callback_timestamp;
-        auto samp_rate = static_cast<float>(nr_samples) / time_diff.count();
-
-        {
-          // Mutex is not needed because this callback is called from the poll thread
-          // boost::mutex::scoped_lock watchdog_guard(d_watchdog_mutex);
-          d_estimated_sample_rate.add(samp_rate);
+      // Triggers are searched ahead of the conversion such that the chunks holding their
+      // pre-trigger samples are classified as well, see set_trigger_reserve
+      if (is_priority_tracking()) {
+        const auto port = static_cast<size_t>(get_priority_port());
+        const int16_t *source = get_priority_channel() >= 0 ? d_buffers[get_priority_channel()]
+                : port < d_port_buffers.size() ? d_port_buffers[port] : nullptr;
+        if (source) {
+          scan_priority_samples(source + start_index, static_cast<uint32_t>(nr_samples), sample_index);
         }
       }
-      else {
-        d_was_last_callback_timestamp_taken = true;
-      }
-
-      d_last_callback_timestamp = timestamp_now;
-
-      // Buffer size per channel in bytes
-      const auto channel_buffer_size_bytes = d_buffer_size * sizeof(float);
 
+      // Destinations within the data chunk are precomputed, see build_conversion_plan
       while (nr_samples > 0) {
 
         // Check if we need to retrieve new data chunk
         if (d_tmp_buffer_size == 0) {
           assert(d_tmp_buffer == nullptr);
-          d_tmp_buffer = d_app_buffer.get_free_data_chunk();
+          d_tmp_buffer = d_app_buffer.get_free_data_chunk(is_priority_chunk(sample_index));
 
           if (d_tmp_buffer == nullptr) {
             d_lost_count++;
+            DIGITIZERS_PROBE1(chunk_lost, d_lost_count);
             nr_samples -= d_buffer_size;
+            sample_index += d_buffer_size;
             continue;
           }
         }
@@ -111,98 +287,68 @@ namespace gr {
         // Figure out how many samples need to be converted before the temporary data buffer is full.
         // Also calculate how many iterations will be required.
         unsigned samples_to_convert = std::min((unsigned)nr_samples, (unsigned)(d_buffer_size - d_tmp_buffer_size));
+
+        // Low-latency interlocks are evaluated after each conversion, the budget limits the
+        // amount of samples converted in one go
+        if (get_fast_interlock_budget()) {
+          samples_to_convert = std::min(samples_to_convert, get_fast_interlock_budget());
+        }
         nr_samples -= samples_to_convert;
 
-        auto tmp_channel_idx = 0; // to iterate enabled channels only
+        uint8_t *data = &d_tmp_buffer->d_data[0];
+        const auto nr_enabled_channels = d_channel_plan.size();
 
-        for (auto channel_idx = 0; channel_idx < d_ai_channels; channel_idx++) {
+        // Channels are converted in parallel if conversion threads are configured, otherwise all
+        // of them in a single call of the planned kernel
+        auto conversion_start = boost::chrono::high_resolution_clock::now();
+        if (d_conversion_pool.size() == 0) {
+          (this->*d_convert_channels)(0, nr_enabled_channels, data, start_index, d_tmp_buffer_size,
+                  samples_to_convert);
+        }
+        else {
+          auto convert_channel_task = [&](size_t tmp_channel_idx) {
+            (this->*d_convert_channels)(tmp_channel_idx, tmp_channel_idx + 1, data, start_index,
+                    d_tmp_buffer_size, samples_to_convert);
+          };
+          d_conversion_pool.run(nr_enabled_channels, convert_channel_task);
+        }
+        auto conversion_duration = boost::chrono::high_resolution_clock::now() - conversion_start;
+        record_conversion_time(boost::chrono::duration_cast<boost::chrono::nanoseconds>(conversion_duration).count(),
+                samples_to_convert * nr_enabled_channels);
 
-          if(!d_channel_settings[channel_idx].enabled) {
+        for (const auto &plan : d_channel_plan) {
+          const auto channel_idx = plan.channel_idx;
+          if (!has_fast_interlock(channel_idx)) {
             continue;
           }
 
-          const float voltage_multiplier = (float)d_channel_settings[channel_idx].range / (float)d_max_value;
-
-          // Buffer organization:
-          //   <chan 1 values> <chan 1 errors> <chan 2 values> <chan 2 errors> ...
-          // Note here the address of the very first sample we are about to save is calculated,
-          // meaning number of samples already in the buffer are accounted for.
-          float *tmp_buffer_values = reinterpret_cast<float *>(&d_tmp_buffer->d_data[0] + (tmp_channel_idx * channel_buffer_size_bytes * 2)) + d_tmp_buffer_size;
-          float *tmp_buffer_errors = reinterpret_cast<float *>(&d_tmp_buffer->d_data[0] + (tmp_channel_idx * channel_buffer_size_bytes * 2) + channel_buffer_size_bytes) + d_tmp_buffer_size;
-
-          // Points to the first raw sample we are about to convert. NOTE, there is a dedicated driver
-          // buffer available per channels therefore we need to use variable channel_idx and not
-          // tmp_channel_idx!!!
-          int16_t *driver_buffer = &d_buffers[channel_idx][start_index];
-
-          if (d_downsampling_mode == downsampling_mode_t::DOWNSAMPLING_MODE_NONE
-                || d_downsampling_mode == downsampling_mode_t::DOWNSAMPLING_MODE_DECIMATE)  {
-
-            // void volk_16i_s32f_convert_32f(float* outputVector, const int16_t* inputVector, const float scalar, unsigned int num_points);
-            volk_16i_s32f_convert_32f(tmp_buffer_values, driver_buffer, 1.0f/voltage_multiplier, samples_to_convert);
-
-            //for (uint32_t i = 0; i < samples_to_convert; i++) {
-            //  tmp_buffer_values[i] = (voltage_multiplier * (float)driver_buffer[i]);
-            //}
-
-            // According to specs
-            const auto error_estimate = d_channel_settings[channel_idx].range * d_vertical_precision;
-            for (uint32_t i = 0; i < samples_to_convert; i++) {
-              tmp_buffer_errors[i] = error_estimate;
-            }
-          }
-          else if (d_downsampling_mode == downsampling_mode_t::DOWNSAMPLING_MODE_MIN_MAX_AGG) {
-            for (uint32_t i = 0; i < samples_to_convert; i++) {
-              int16_t *driver_buffer_min = &d_buffers_min[channel_idx][start_index];
-
-              auto max = (voltage_multiplier * (float)driver_buffer[i]);
-              auto min = (voltage_multiplier * (float)driver_buffer_min[i]);
+          const float *values;
+          if (d_zero_copy || d_raw_output) {
+            // Values are not available in the poll thread, only the channels with an interlock
+            // are converted
+            d_interlock_values.resize(samples_to_convert);
+            d_interlock_errors.resize(samples_to_convert);
 
-              tmp_buffer_values[i] = (max + min) / 2.0;
-              tmp_buffer_errors[i] = (max - min) / 4.0;
-            }
-          }
-          else if (d_downsampling_mode == downsampling_mode_t::DOWNSAMPLING_MODE_AVERAGE) {
-
-            volk_16i_s32f_convert_32f(tmp_buffer_values, driver_buffer, 1.0f/voltage_multiplier, samples_to_convert);
+            const int16_t *driver_buffer_min = plan.raw_min ? plan.raw_min + start_index : nullptr;
 
-            //for (uint32_t i = 0; i < samples_to_convert; i++) {
-            //  tmp_buffer_values[i] = voltage_multiplier * (float)driver_buffer[i];
-            //}
-
-            // According to specs
-            const auto error_estimate_single = d_channel_settings[channel_idx].range * d_vertical_precision;
-            const auto error_estimate = error_estimate_single / std::sqrt((float)d_downsampling_factor);
-            for (uint32_t i = 0; i < samples_to_convert; i++) {
-              tmp_buffer_errors[i] = error_estimate;
-            }
+            convert_channel(channel_idx, plan.raw + start_index, driver_buffer_min,
+                    &d_interlock_values[0], &d_interlock_errors[0], samples_to_convert);
+            values = &d_interlock_values[0];
           }
           else {
-            assert(false);
+            values = reinterpret_cast<const float *>(data + plan.values_offset) + d_tmp_buffer_size;
           }
 
-          // move to another channel slot
-          tmp_channel_idx++;
-        } // for each channel
-
-        auto tmp_port_idx = 0;
-        const auto port_buffer_size = d_buffer_size * sizeof(uint8_t);
-        uint8_t *first_port_sample = &d_tmp_buffer->d_data[0] + (tmp_channel_idx * channel_buffer_size_bytes * 2);
-
-        for (auto port_idx = 0; port_idx < d_ports; port_idx++) {
-
-          if (!d_port_settings[port_idx].enabled) {
-            continue;
-          }
+          evaluate_fast_interlock(channel_idx, values, samples_to_convert, sample_index);
+        }
 
-          uint8_t *port_values = first_port_sample + port_buffer_size * tmp_port_idx + d_tmp_buffer_size;
-          const int16_t *driver_buffer = &d_port_buffers[port_idx][start_index];
+        for (const auto &plan : d_port_plan) {
+          uint8_t *port_values = data + plan.offset + d_tmp_buffer_size;
+          const int16_t *driver_buffer = plan.raw + start_index;
 
           for (uint32_t i = 0; i < samples_to_convert; i++) {
             port_values[i] = static_cast<uint8_t>(0x00ff & driver_buffer[i]);
           }
-
-          tmp_port_idx++;
         }
 
         d_tmp_buffer_size += samples_to_convert;
@@ -210,10 +356,12 @@ namespace gr {
 
         // move
         start_index += samples_to_convert;
+        sample_index += samples_to_convert;
 
         // Temporary buffer is full, push data into application buffer
         if (d_tmp_buffer_size == d_buffer_size) {
-          d_tmp_buffer->d_local_timestamp = local_timestamp;
+          // Timestamp refers to the end of the chunk
+          d_tmp_buffer->d_local_timestamp = get_sample_timestamp_ns(sample_index);
 
           d_tmp_buffer->d_lost_count = d_lost_count;
           d_lost_count = 0;
@@ -238,5 +386,117 @@ namespace gr {
       } // iteration
     }
 
+    void
+    picoscope_impl::convert_channel(int channel_idx, const int16_t *raw, const int16_t *raw_min,
+            float *values, float *errors, uint32_t nsamples) const
+    {
+      const auto &settings = get_config_snapshot().config.channels[channel_idx];
+      const float voltage_multiplier = (float)settings.range / (float)d_max_value;
+
+      // Calibration is folded into the conversion, see set_aichan_calibration
+      if (d_downsampling_mode == downsampling_mode_t::DOWNSAMPLING_MODE_MIN_MAX_AGG) {
+        assert(raw_min != nullptr);
+
+        min_max_agg_convert(raw, raw_min, voltage_multiplier, settings.calibration_scale,
+                settings.calibration_offset, values, errors, nsamples);
+        return;
+      }
+
+      raw_convert(raw, voltage_multiplier * settings.calibration_scale, settings.calibration_offset,
+              values, nsamples);
+
+      float error_estimate = 0.0;
+      driver_get_constant_error(channel_idx, error_estimate);
+      std::fill(errors, errors + nsamples, error_estimate);
+    }
+
+    size_t
+    picoscope_impl::driver_chunk_sample_size() const
+    {
+      if (d_zero_copy) {
+        return 2 * sizeof(int16_t); // raw max & min samples
+      }
+
+      return digitizer_block_impl::driver_chunk_sample_size();
+    }
+
+    size_t
+    picoscope_impl::driver_locked_memory() const
+    {
+      return d_driver_memory.is_locked() ? d_driver_memory.size() : 0;
+    }
+
+    void
+    picoscope_impl::driver_read_data_chunk(const app_buffer_t::data_chunk_t *chunk,
+            std::vector<float *> &ai_buffers, std::vector<float *> &ai_error_buffers,
+            std::vector<uint8_t *> &port_buffers)
+    {
+      if (!d_zero_copy) {
+        digitizer_block_impl::driver_read_data_chunk(chunk, ai_buffers, ai_error_buffers, port_buffers);
+        return;
+      }
+
+      const auto channel_buffer_size_bytes = d_buffer_size * driver_chunk_sample_size();
+      const auto channel_half_size_bytes = channel_buffer_size_bytes / 2;
+      const uint8_t *read_ptr = &chunk->d_data[0];
+
+      // Convert raw samples straight into the GR output buffers
+      auto tmp_channel_idx = 0;
+
+      for (auto channel_idx = 0; channel_idx < d_ai_channels; channel_idx++) {
+        if (!d_channel_settings[channel_idx].enabled) {
+          continue;
+        }
+
+        const int16_t *raw = reinterpret_cast<const int16_t *>(read_ptr);
+        const int16_t *raw_min = reinterpret_cast<const int16_t *>(read_ptr + channel_half_size_bytes);
+
+        convert_channel(channel_idx, raw, raw_min, ai_buffers[tmp_channel_idx],
+                ai_error_buffers[tmp_channel_idx], d_buffer_size);
+
+        read_ptr += channel_buffer_size_bytes;
+        tmp_channel_idx++;
+      }
+
+      for (size_t port_idx = 0; port_idx < port_buffers.size(); port_idx++) {
+        memcpy(port_buffers[port_idx], read_ptr, d_buffer_size * sizeof(uint8_t));
+        read_ptr += d_buffer_size;
+      }
+    }
+
+    raw_scaling_t
+    picoscope_impl::driver_get_raw_scaling(int channel_idx) const
+    {
+      raw_scaling_t scaling;
+
+      const auto &settings = get_config_snapshot().config.channels[channel_idx];
+      scaling.scale = settings.range / static_cast<double>(d_max_value) * settings.calibration_scale;
+      scaling.offset = -settings.calibration_offset;
+
+      float error = 0.0;
+      driver_get_constant_error(channel_idx, error);
+      scaling.error = error;
+
+      return scaling;
+    }
+
+    bool
+    picoscope_impl::driver_get_constant_error(int channel_idx, float &error) const
+    {
+      // Error is derived from min and max values in MIN_MAX_AGG mode
+      if (d_downsampling_mode == downsampling_mode_t::DOWNSAMPLING_MODE_MIN_MAX_AGG) {
+        return false;
+      }
+
+      // According to specs
+      const auto &settings = get_config_snapshot().config.channels[channel_idx];
+      error = settings.range * d_vertical_precision * settings.calibration_scale;
+      if (d_downsampling_mode == downsampling_mode_t::DOWNSAMPLING_MODE_AVERAGE) {
+        error /= std::sqrt((float)d_downsampling_factor);
+      }
+
+      return true;
+    }
+
   } /* namespace digitizers */
 } /* namespace gr */
@@ -9,6 +9,8 @@
 
 #include "digitizer_block_impl.h"
 #include "digitizers/range.h"
+#include "chunk_memory.h"
+#include <map>
 
 namespace gr {
   namespace digitizers {
@@ -38,10 +40,18 @@ namespace gr {
 
       streaming_callback_function_t d_streaming_callback;
 
-      // Driver buffers
-      std::vector<std::vector<int16_t>> d_buffers;
-      std::vector<std::vector<int16_t>> d_buffers_min;
-      std::vector<std::vector<int16_t>> d_port_buffers;
+      // Driver buffers, pointers into the driver memory (see reserve_driver_buffers) or null if
+      // the channel or port is disabled
+      std::vector<int16_t *> d_buffers;
+      std::vector<int16_t *> d_buffers_min;
+      std::vector<int16_t *> d_port_buffers;
+
+      // Rapid block bulk readout, driver buffers hold all the segments (waveforms) one after
+      // another starting with the first segment. Segment stride is in samples, zero if a single
+      // segment is held.
+      size_t d_bulk_segment_stride;
+      size_t d_bulk_first_segment;
+      std::vector<int16_t> d_bulk_overflow;  // overflow flags per segment
 
       // Tmp buffer
       app_buffer_t::data_chunk_t *d_tmp_buffer;
@@ -49,10 +59,19 @@ namespace gr {
 
       int d_lost_count;
 
+      // Unit info by PICO_INFO, queried once when the unit is opened (see unit_registry_t)
+      std::map<uint32_t, std::string> d_unit_info;
+
+      // Values of channels with a low-latency interlock, used if the conversion is done by the
+      // work thread (zero-copy or raw output)
+      std::vector<float> d_interlock_values;
+      std::vector<float> d_interlock_errors;
+
      public:
 
       picoscope_impl(std::string serial_number, int max_ai_channels, int max_di_ports,
-              bool auto_arm, int16_t max_raw_analog_value, float vertical_precision);
+              bool auto_arm, int16_t max_raw_analog_value, float vertical_precision,
+              bool raw_output=false);
 
       ~picoscope_impl();
 
@@ -63,6 +82,131 @@ namespace gr {
      protected:
 
       void streaming_callback(int32_t no_of_samples, uint32_t start_index, int16_t overflow);
+
+      /*!
+       * \brief Converts raw ADC samples of the given channel into voltages and error estimates
+       * taking into account the downsampling mode. Buffer raw_min is used in MIN_MAX_AGG mode only.
+       */
+      void convert_channel(int channel_idx, const int16_t *raw, const int16_t *raw_min,
+              float *values, float *errors, uint32_t nsamples) const;
+
+      /*!
+       * \brief In zero-copy mode raw samples (max and min) are stored in the data chunk.
+       */
+      size_t driver_chunk_sample_size() const override;
+
+      size_t driver_locked_memory() const override;
+
+      void driver_read_data_chunk(const app_buffer_t::data_chunk_t *chunk,
+              std::vector<float *> &ai_buffers, std::vector<float *> &ai_error_buffers,
+              std::vector<uint8_t *> &port_buffers) override;
+
+      raw_scaling_t driver_get_raw_scaling(int channel_idx) const override;
+
+      bool driver_get_constant_error(int channel_idx, float &error) const override;
+
+      /*!
+       * \brief Returns offset of the given segment within driver buffers (rapid block mode).
+       * Zero unless bulk readout is used.
+       */
+      size_t get_segment_offset(size_t segment) const
+      {
+        return (segment - d_bulk_first_segment) * d_bulk_segment_stride;
+      }
+
+      /*!
+       * \brief Returns overflow flags of the given segment, overflow is the value reported by the
+       * last single-segment transfer.
+       */
+      int16_t get_segment_overflow(size_t segment, int16_t overflow) const
+      {
+        return d_bulk_segment_stride ? d_bulk_overflow.at(segment - d_bulk_first_segment) : overflow;
+      }
+
+      /*!
+       * \brief Reserves driver buffers of enabled channels and ports. Needs to be called before
+       * buffers are handed over to the driver, reallocation would invalidate them.
+       *
+       * All the driver buffers live in a single memory region, allocated according to the buffer
+       * memory policy. Each enabled buffer gets a block of the region starting at a cache line
+       * boundary, values and min values of a channel are adjacent. The conversion of a chunk
+       * therefore streams through consecutive memory. Capacity only grows, i.e. the buffers keep
+       * their addresses as long as the capacity and the enabled channels and ports don't change.
+       */
+      void reserve_driver_buffers(size_t samples);
+
+      /*!
+       * \brief Returns true if the driver buffers of enabled channels and ports are registered
+       * with the driver for the given segment, number of samples and offset already, i.e. the
+       * SetDataBuffer calls can be skipped on re-arm. Registrations are forgotten on configure
+       * and whenever a driver buffer was moved.
+       */
+      bool are_buffers_registered(uint32_t segment, size_t samples, size_t offset) const;
+
+      /*!
+       * \brief Records a successful registration, see are_buffers_registered.
+       */
+      void set_buffers_registered(uint32_t segment, size_t samples, size_t offset);
+
+      void clear_registered_buffers();
+
+     private:
+
+      // Conversion of an enabled channel within the streaming callback, offsets are in bytes from
+      // the start of the data chunk
+      struct channel_conversion_t
+      {
+        int channel_idx;
+        const int16_t *raw;
+        const int16_t *raw_min;     // null unless MIN_MAX_AGG
+        size_t values_offset;       // values or raw max samples
+        size_t errors_offset;       // errors or raw min samples
+      };
+
+      struct port_conversion_t
+      {
+        const int16_t *raw;
+        size_t offset;
+      };
+
+      typedef void (picoscope_impl::*convert_channels_t)(size_t first, size_t last, uint8_t *data,
+              uint32_t start_index, size_t chunk_index, uint32_t nsamples) const;
+
+      // Conversion plan of the streaming callback, rebuilt whenever the driver buffers are
+      // reserved, i.e. once the enabled channels, the downsampling mode and the buffer size are
+      // known. The kernel is specialised for the downsampling mode and the output format.
+      std::vector<channel_conversion_t> d_channel_plan;
+      std::vector<port_conversion_t> d_port_plan;
+      convert_channels_t d_convert_channels;
+
+      void build_conversion_plan();
+
+      /*!
+       * \brief Converts (or copies in zero-copy and raw output mode) samples [start_index, start_index +
+       * nsamples) of the planned channels [first, last) into the data chunk, starting at sample
+       * chunk_index.
+       */
+      template <bool MinMax, bool Raw>
+      void convert_channels(size_t first, size_t last, uint8_t *data, uint32_t start_index,
+              size_t chunk_index, uint32_t nsamples) const;
+
+      struct buffer_registration_t
+      {
+        size_t samples;
+        size_t offset;
+        uintptr_t addresses;  // see get_driver_buffer_addresses
+      };
+
+      // Registrations per memory segment
+      std::map<uint32_t, buffer_registration_t> d_registered_buffers;
+
+      // Combined addresses of the driver buffers of enabled channels and ports
+      uintptr_t get_driver_buffer_addresses() const;
+
+      static const size_t DRIVER_BUFFER_ALIGNMENT = 64;
+
+      chunk_memory_t d_driver_memory;
+      size_t d_driver_buffer_capacity;    // samples per driver buffer
     };
 
   } // namespace digitizers
@@ -0,0 +1,676 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "picosdk_mock.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+namespace gr {
+  namespace digitizers {
+
+    // Smallest full scale of the supported families, see ps*MaximumValue
+    static const double full_scale = 32512.0;
+
+    picosdk_mock_config_t::picosdk_mock_config_t()
+      : call_latency_us(0),
+        latency_jitter_us(0),
+        max_callback_samples(0),
+        overflow_probability(0.0),
+        stall_probability(0.0),
+        stall_us(0),
+        nr_units(1),
+        memory_samples(64 * 1024 * 1024),
+        signal_period(1000),
+        amplitude(0.5),
+        seed(1)
+    {
+    }
+
+    picosdk_mock_config_t
+    picosdk_mock_config_t::parse(const std::string &spec)
+    {
+      picosdk_mock_config_t config;
+
+      std::istringstream items(spec);
+      std::string item;
+      while (std::getline(items, item, ',')) {
+        if (item.empty()) {
+          continue;
+        }
+
+        const auto separator = item.find('=');
+        const auto key = item.substr(0, separator);
+        const auto value = separator == std::string::npos ? std::string() : item.substr(separator + 1);
+
+        try {
+          if (key == "call_latency_us") config.call_latency_us = std::stoul(value);
+          else if (key == "latency_jitter_us") config.latency_jitter_us = std::stoul(value);
+          else if (key == "max_callback_samples") config.max_callback_samples = std::stoul(value);
+          else if (key == "overflow_probability") config.overflow_probability = std::stod(value);
+          else if (key == "stall_probability") config.stall_probability = std::stod(value);
+          else if (key == "stall_us") config.stall_us = std::stoul(value);
+          else if (key == "nr_units") config.nr_units = std::stoi(value);
+          else if (key == "memory_samples") config.memory_samples = std::stoul(value);
+          else if (key == "signal_period") config.signal_period = std::stoul(value);
+          else if (key == "amplitude") config.amplitude = std::stod(value);
+          else if (key == "seed") config.seed = std::stoul(value);
+          else throw std::invalid_argument("unknown key");
+        }
+        catch (const std::exception &ex) {
+          std::ostringstream message;
+          message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid mock setting '" << item
+                  << "': " << ex.what();
+          throw std::invalid_argument(message.str());
+        }
+      }
+
+      return config;
+    }
+
+    picosdk_mock_t &
+    picosdk_mock_t::instance()
+    {
+      static picosdk_mock_t mock;
+      return mock;
+    }
+
+    const uint32_t picosdk_mock_t::any_segment;
+
+    picosdk_mock_t::picosdk_mock_t()
+      : d_stats(),
+        d_inject_overflow(false),
+        d_inject_stall_us(0)
+    {
+      const char *spec = std::getenv("DIGITIZERS_PICOSDK_MOCK");
+      configure(spec ? picosdk_mock_config_t::parse(spec) : picosdk_mock_config_t());
+    }
+
+    picosdk_mock_t::~picosdk_mock_t()
+    {
+      lock_t lock(d_mutex);
+      for (auto &unit : d_units) {
+        stop_block(*unit, lock);
+      }
+    }
+
+    void
+    picosdk_mock_t::configure(const picosdk_mock_config_t &config)
+    {
+      if (config.nr_units < 0 || config.signal_period == 0) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid number of units or signal period";
+        throw std::invalid_argument(message.str());
+      }
+
+      lock_t lock(d_mutex);
+      d_config = config;
+      d_random.seed(config.seed);
+
+      // units are kept, open ones must stay valid
+      while (d_units.size() < static_cast<size_t>(config.nr_units)) {
+        std::unique_ptr<unit_t> unit(new unit_t());
+        char serial[16];
+        std::snprintf(serial, sizeof(serial), "MOCK%04d", static_cast<int>(d_units.size() + 1));
+        unit->serial = serial;
+        d_units.push_back(std::move(unit));
+      }
+    }
+
+    picosdk_mock_config_t
+    picosdk_mock_t::config()
+    {
+      lock_t lock(d_mutex);
+      return d_config;
+    }
+
+    picosdk_mock_stats_t
+    picosdk_mock_t::stats()
+    {
+      lock_t lock(d_mutex);
+      return d_stats;
+    }
+
+    void
+    picosdk_mock_t::reset_stats()
+    {
+      lock_t lock(d_mutex);
+      d_stats = picosdk_mock_stats_t();
+    }
+
+    void
+    picosdk_mock_t::inject_overflow()
+    {
+      lock_t lock(d_mutex);
+      d_inject_overflow = true;
+    }
+
+    void
+    picosdk_mock_t::inject_stall(uint32_t us)
+    {
+      lock_t lock(d_mutex);
+      d_inject_stall_us = us;
+    }
+
+    void
+    picosdk_mock_t::enter()
+    {
+      uint32_t delay_us;
+
+      {
+        lock_t lock(d_mutex);
+        d_stats.calls++;
+
+        delay_us = d_config.call_latency_us;
+        if (d_config.latency_jitter_us) {
+          delay_us += std::uniform_int_distribution<uint32_t>(0, d_config.latency_jitter_us)(d_random);
+        }
+
+        if (d_inject_stall_us) {
+          delay_us += d_inject_stall_us;
+          d_inject_stall_us = 0;
+          d_stats.stalls++;
+        }
+        else if (d_config.stall_probability > 0.0
+                && std::bernoulli_distribution(d_config.stall_probability)(d_random)) {
+          delay_us += d_config.stall_us;
+          d_stats.stalls++;
+        }
+      }
+
+      if (delay_us) {
+        boost::this_thread::sleep_for(boost::chrono::microseconds(delay_us));
+      }
+    }
+
+    picosdk_mock_t::unit_t *
+    picosdk_mock_t::find(int16_t handle)
+    {
+      if (handle < 1 || static_cast<size_t>(handle) > d_units.size() || !d_units[handle - 1]->open) {
+        return nullptr;
+      }
+      return d_units[handle - 1].get();
+    }
+
+    PICO_STATUS
+    picosdk_mock_t::check_handle(int16_t handle)
+    {
+      lock_t lock(d_mutex);
+      return find(handle) ? PICO_OK : PICO_INVALID_HANDLE;
+    }
+
+    PICO_STATUS
+    picosdk_mock_t::open_unit(int16_t *handle, const int8_t *serial)
+    {
+      lock_t lock(d_mutex);
+      *handle = 0;
+
+      for (int i = 0; i < d_config.nr_units; i++) {
+        auto &unit = *d_units[i];
+        if (unit.open || (serial && unit.serial != reinterpret_cast<const char *>(serial))) {
+          continue;
+        }
+
+        unit.open = true;
+        unit.nsegments = 1;
+        unit.ncaptures = 1;
+        unit.streaming = false;
+        unit.abort_block = false;
+        unit.next_sample = 0;
+        *handle = i + 1;
+        return PICO_OK;
+      }
+
+      return PICO_NOT_FOUND;
+    }
+
+    PICO_STATUS
+    picosdk_mock_t::close_unit(int16_t handle)
+    {
+      lock_t lock(d_mutex);
+      auto unit = find(handle);
+      if (!unit) {
+        return PICO_INVALID_HANDLE;
+      }
+
+      stop_block(*unit, lock);
+      unit->open = false;
+      unit->streaming = false;
+      unit->buffers.clear();
+      unit->captures.clear();
+      unit->overlapped.reset();
+      return PICO_OK;
+    }
+
+    PICO_STATUS
+    picosdk_mock_t::unit_info(int16_t handle, const std::string &variant, int8_t *string, int16_t length,
+            int16_t *required_size, PICO_INFO info)
+    {
+      lock_t lock(d_mutex);
+      auto unit = find(handle);
+      if (!unit) {
+        return PICO_INVALID_HANDLE;
+      }
+
+      std::string value;
+      switch (info) {
+        case PICO_DRIVER_VERSION: value = "mock"; break;
+        case PICO_USB_VERSION: value = "3.0"; break;
+        case PICO_HARDWARE_VERSION: value = "1"; break;
+        case PICO_VARIANT_INFO: value = variant; break;
+        case PICO_BATCH_AND_SERIAL: value = unit->serial; break;
+        default: value = "NA"; break;
+      }
+
+      // the required size excludes the terminating null
+      if (required_size) {
+        *required_size = static_cast<int16_t>(value.size());
+      }
+      if (string && length > 0) {
+        const auto copied = std::min(value.size(), static_cast<size_t>(length - 1));
+        std::memcpy(string, value.data(), copied);
+        string[copied] = 0;
+      }
+
+      return PICO_OK;
+    }
+
+    PICO_STATUS
+    picosdk_mock_t::memory_segments(int16_t handle, uint32_t nsegments, uint32_t *max_samples)
+    {
+      lock_t lock(d_mutex);
+      auto unit = find(handle);
+      if (!unit) {
+        return PICO_INVALID_HANDLE;
+      }
+      if (nsegments == 0 || nsegments > d_config.memory_samples) {
+        return PICO_TOO_MANY_SEGMENTS;
+      }
+
+      unit->nsegments = nsegments;
+      unit->captures.clear();
+      if (max_samples) {
+        *max_samples = d_config.memory_samples / nsegments;
+      }
+      return PICO_OK;
+    }
+
+    PICO_STATUS
+    picosdk_mock_t::set_captures(int16_t handle, uint32_t ncaptures)
+    {
+      lock_t lock(d_mutex);
+      auto unit = find(handle);
+      if (!unit) {
+        return PICO_INVALID_HANDLE;
+      }
+      if (ncaptures == 0 || ncaptures > unit->nsegments) {
+        return PICO_TOO_MANY_SEGMENTS;
+      }
+
+      unit->ncaptures = ncaptures;
+      return PICO_OK;
+    }
+
+    PICO_STATUS
+    picosdk_mock_t::set_buffer(int16_t handle, int channel, uint32_t segment, int16_t *max, int16_t *min,
+            uint32_t length)
+    {
+      lock_t lock(d_mutex);
+      auto unit = find(handle);
+      if (!unit) {
+        return PICO_INVALID_HANDLE;
+      }
+
+      const auto key = std::make_pair(channel, segment);
+      if (!max) {
+        unit->buffers.erase(key);
+      }
+      else {
+        unit->buffers[key] = buffer_t {max, min, length};
+      }
+      return PICO_OK;
+    }
+
+    const picosdk_mock_t::buffer_t *
+    picosdk_mock_t::find_buffer(unit_t &unit, int channel, uint32_t segment)
+    {
+      auto it = unit.buffers.find(std::make_pair(channel, segment));
+      if (it == unit.buffers.end()) {
+        it = unit.buffers.find(std::make_pair(channel, any_segment));
+      }
+      return it == unit.buffers.end() ? nullptr : &it->second;
+    }
+
+    void
+    picosdk_mock_t::fill(const buffer_t &buffer, int channel, uint32_t offset, uint32_t samples,
+            uint64_t first_sample)
+    {
+      samples = std::min(samples, buffer.length > offset ? buffer.length - offset : 0);
+
+      const double amplitude = d_config.amplitude * full_scale;
+      const double omega = 2.0 * M_PI / d_config.signal_period;
+
+      for (uint32_t i = 0; i < samples; i++) {
+        int16_t value;
+        if (channel >= 0x80) {
+          // digital port, a counter
+          value = static_cast<int16_t>((first_sample + i) & 0xff);
+        }
+        else {
+          // channels are shifted by a quarter period
+          value = static_cast<int16_t>(amplitude * std::sin(omega * ((first_sample + i) % d_config.signal_period)
+                  + channel * M_PI / 2.0));
+        }
+
+        buffer.max[offset + i] = value;
+        if (buffer.min) {
+          buffer.min[offset + i] = value;
+        }
+      }
+    }
+
+    PICO_STATUS
+    picosdk_mock_t::run_block(int16_t handle, uint32_t samples, double interval, uint32_t segment,
+            std::function<void(PICO_STATUS)> ready)
+    {
+      lock_t lock(d_mutex);
+      auto unit = find(handle);
+      if (!unit) {
+        return PICO_INVALID_HANDLE;
+      }
+
+      stop_block(*unit, lock);
+
+      if (segment + unit->ncaptures > unit->nsegments) {
+        return PICO_SEGMENT_OUT_OF_RANGE;
+      }
+      if (samples == 0 || samples > d_config.memory_samples / unit->nsegments) {
+        return PICO_TOO_MANY_SAMPLES;
+      }
+
+      unit->block_thread.reset(new boost::thread([this, handle, samples, interval, segment, ready] {
+        block_function(handle, samples, interval, segment, ready);
+      }));
+      return PICO_OK;
+    }
+
+    void
+    picosdk_mock_t::block_function(int16_t handle, uint32_t samples, double interval, uint32_t segment,
+            std::function<void(PICO_STATUS)> ready)
+    {
+      lock_t lock(d_mutex);
+      auto unit = find(handle);
+      if (!unit) {
+        return;
+      }
+
+      // triggers fire immediately, i.e. the capture takes its duration
+      const auto duration = boost::chrono::duration<double>(samples * interval * unit->ncaptures);
+      const auto deadline = boost::chrono::steady_clock::now()
+              + boost::chrono::duration_cast<boost::chrono::nanoseconds>(duration);
+
+      while (!unit->abort_block) {
+        if (d_stop_cv.wait_until(lock, deadline) == boost::cv_status::timeout) {
+          break;
+        }
+      }
+
+      if (unit->abort_block) {
+        return;
+      }
+
+      for (uint32_t i = 0; i < unit->ncaptures; i++) {
+        unit->captures[segment + i] = capture_t {unit->next_sample, samples};
+        unit->next_sample += samples;
+      }
+      d_stats.blocks++;
+
+      // the overlapped read-out completes before the ready callback
+      if (unit->overlapped) {
+        const auto overlapped = *unit->overlapped;
+        unit->overlapped.reset();
+        read_segments(*unit, overlapped.start, overlapped.samples, overlapped.from, overlapped.to,
+                overlapped.overflow);
+      }
+
+      lock.unlock();
+      ready(PICO_OK);
+    }
+
+    void
+    picosdk_mock_t::stop_block(unit_t &unit, lock_t &lock)
+    {
+      if (!unit.block_thread) {
+        return;
+      }
+
+      std::unique_ptr<boost::thread> thread;
+      thread.swap(unit.block_thread);
+      unit.abort_block = true;
+      d_stop_cv.notify_all();
+
+      // e.g. re-armed from the ready callback
+      if (thread->get_id() == boost::this_thread::get_id()) {
+        thread->detach();
+      }
+      else {
+        lock.unlock();
+        thread->join();
+        lock.lock();
+      }
+
+      unit.abort_block = false;
+    }
+
+    PICO_STATUS
+    picosdk_mock_t::read_segments(unit_t &unit, uint32_t start, uint32_t *samples, uint32_t from, uint32_t to,
+            int16_t *overflow)
+    {
+      if (from > to || !samples) {
+        return PICO_INVALID_PARAMETER;
+      }
+
+      // all the channels with a registration
+      std::vector<int> channels;
+      for (const auto &buffer : unit.buffers) {
+        if (std::find(channels.begin(), channels.end(), buffer.first.first) == channels.end()) {
+          channels.push_back(buffer.first.first);
+        }
+      }
+
+      uint32_t read = *samples;
+      for (uint32_t segment = from; segment <= to; segment++) {
+        auto capture = unit.captures.find(segment);
+        if (capture == unit.captures.end()) {
+          return PICO_NO_SAMPLES_AVAILABLE;
+        }
+
+        const auto available = capture->second.samples > start ? capture->second.samples - start : 0;
+        read = std::min(read, available);
+
+        for (auto channel : channels) {
+          if (auto buffer = find_buffer(unit, channel, segment)) {
+            fill(*buffer, channel, 0, std::min(*samples, available), capture->second.first_sample + start);
+          }
+        }
+
+        if (overflow) {
+          overflow[segment - from] = 0;
+        }
+      }
+
+      *samples = read;
+      return PICO_OK;
+    }
+
+    PICO_STATUS
+    picosdk_mock_t::get_values(int16_t handle, uint32_t start, uint32_t *samples, uint32_t from, uint32_t to,
+            int16_t *overflow)
+    {
+      lock_t lock(d_mutex);
+      auto unit = find(handle);
+      if (!unit) {
+        return PICO_INVALID_HANDLE;
+      }
+      return read_segments(*unit, start, samples, from, to, overflow);
+    }
+
+    PICO_STATUS
+    picosdk_mock_t::get_values_overlapped(int16_t handle, uint32_t start, uint32_t *samples, uint32_t from,
+            uint32_t to, int16_t *overflow)
+    {
+      lock_t lock(d_mutex);
+      auto unit = find(handle);
+      if (!unit) {
+        return PICO_INVALID_HANDLE;
+      }
+      if (from > to || to >= unit->nsegments || !samples) {
+        return PICO_INVALID_PARAMETER;
+      }
+
+      unit->overlapped.reset(new overlapped_t {start, samples, from, to, overflow});
+      return PICO_OK;
+    }
+
+    PICO_STATUS
+    picosdk_mock_t::trigger_offsets(int16_t handle, int64_t *times, uint32_t from, uint32_t to)
+    {
+      lock_t lock(d_mutex);
+      if (!find(handle)) {
+        return PICO_INVALID_HANDLE;
+      }
+      if (from > to) {
+        return PICO_INVALID_PARAMETER;
+      }
+
+      // triggers fire on a sample
+      std::fill(times, times + (to - from + 1), 0);
+      return PICO_OK;
+    }
+
+    PICO_STATUS
+    picosdk_mock_t::run_streaming(int16_t handle, double interval, uint32_t downsampling)
+    {
+      lock_t lock(d_mutex);
+      auto unit = find(handle);
+      if (!unit) {
+        return PICO_INVALID_HANDLE;
+      }
+      if (interval <= 0.0) {
+        return PICO_INVALID_SAMPLE_INTERVAL;
+      }
+
+      stop_block(*unit, lock);
+
+      unit->streaming = true;
+      unit->streaming_rate = 1.0 / (interval * std::max(downsampling, 1u));
+      unit->streaming_start = boost::chrono::steady_clock::now();
+      unit->produced = 0;
+      unit->position = 0;
+      return PICO_OK;
+    }
+
+    PICO_STATUS
+    picosdk_mock_t::get_streaming_latest(int16_t handle, int32_t *samples, uint32_t *start_index, int16_t *overflow)
+    {
+      lock_t lock(d_mutex);
+      auto unit = find(handle);
+      if (!unit) {
+        return PICO_INVALID_HANDLE;
+      }
+      if (!unit->streaming) {
+        return PICO_BUSY;
+      }
+
+      // streaming buffers are registered for segment zero, the shortest one bounds
+      uint32_t length = 0;
+      for (const auto &buffer : unit->buffers) {
+        if (buffer.first.second == 0 || buffer.first.second == any_segment) {
+          length = length ? std::min(length, buffer.second.length) : buffer.second.length;
+        }
+      }
+      if (length == 0) {
+        return PICO_INVALID_BUFFER;
+      }
+
+      const auto elapsed = boost::chrono::duration<double>(boost::chrono::steady_clock::now() - unit->streaming_start);
+      uint64_t available = static_cast<uint64_t>(elapsed.count() * unit->streaming_rate) - unit->produced;
+
+      // samples not fetched in time are overwritten by the device
+      bool overflowed = false;
+      if (available > length) {
+        unit->produced += available - length;
+        available = length;
+        overflowed = true;
+      }
+
+      if (available == 0) {
+        return PICO_BUSY;
+      }
+
+      // the callback never wraps around the end of the buffers
+      uint32_t nr_samples = std::min<uint64_t>(available, length - unit->position);
+      if (d_config.max_callback_samples) {
+        nr_samples = std::min(nr_samples, d_config.max_callback_samples);
+      }
+
+      if (d_inject_overflow) {
+        d_inject_overflow = false;
+        overflowed = true;
+      }
+      else if (d_config.overflow_probability > 0.0
+              && std::bernoulli_distribution(d_config.overflow_probability)(d_random)) {
+        overflowed = true;
+      }
+
+      for (const auto &buffer : unit->buffers) {
+        if (buffer.first.second == 0 || buffer.first.second == any_segment) {
+          fill(buffer.second, buffer.first.first, unit->position, nr_samples, unit->next_sample + unit->produced);
+        }
+      }
+
+      *samples = nr_samples;
+      *start_index = unit->position;
+      *overflow = overflowed ? static_cast<int16_t>(0xffff) : 0;
+
+      unit->produced += nr_samples;
+      unit->position = (unit->position + nr_samples) % length;
+
+      d_stats.streaming_callbacks++;
+      d_stats.samples += nr_samples;
+      d_stats.overflows += overflowed;
+      return PICO_OK;
+    }
+
+    PICO_STATUS
+    picosdk_mock_t::stop(int16_t handle)
+    {
+      lock_t lock(d_mutex);
+      auto unit = find(handle);
+      if (!unit) {
+        return PICO_INVALID_HANDLE;
+      }
+
+      stop_block(*unit, lock);
+
+      if (unit->streaming) {
+        unit->streaming = false;
+        unit->next_sample += unit->produced;
+      }
+      return PICO_OK;
+    }
+
+  } // namespace digitizers
+} // namespace gr
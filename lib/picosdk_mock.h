@@ -0,0 +1,245 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_PICOSDK_MOCK_H
+#define INCLUDED_DIGITIZERS_PICOSDK_MOCK_H
+
+#include <PicoStatus.h>
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/chrono.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Timing model of the mock PicoSDK, see picosdk_mock_t.
+     */
+    struct picosdk_mock_config_t
+    {
+      uint32_t call_latency_us;         // added to every API call
+      uint32_t latency_jitter_us;       // uniformly distributed, on top of call_latency_us
+      uint32_t max_callback_samples;    // per streaming callback, 0 for all the available samples
+      double overflow_probability;      // per streaming callback
+      double stall_probability;         // per API call, a USB stall blocks the call for stall_us
+      uint32_t stall_us;
+      int nr_units;                     // units found by OpenUnit, serial numbers MOCK0001, ...
+      uint32_t memory_samples;          // device memory per channel, shared by the segments
+      uint32_t signal_period;           // samples per period of the generated sine
+      double amplitude;                 // of the sine, fraction of the full scale
+      uint32_t seed;
+
+      picosdk_mock_config_t();
+
+      /*!
+       * \brief Parses comma separated key=value pairs, e.g. "call_latency_us=50,stall_us=20000",
+       * keys are the member names. Throws std::invalid_argument on unknown keys or values.
+       */
+      static picosdk_mock_config_t parse(const std::string &spec);
+    };
+
+    struct picosdk_mock_stats_t
+    {
+      uint64_t calls;
+      uint64_t streaming_callbacks;
+      uint64_t samples;               // delivered by streaming callbacks
+      uint64_t overflows;             // reported to streaming callbacks
+      uint64_t stalls;
+      uint64_t blocks;                // completed block captures
+    };
+
+    /*!
+     * \brief Simulated PicoScope units behind the ps3000a, ps4000a and ps6000 APIs.
+     *
+     * Built as libpicosdk-mock with ENABLE_PICOSDK_MOCK, the library is then linked against it
+     * instead of the PicoSDK libraries (the SDK headers are still needed). The picosdk_mock_*.cc
+     * files implement the API functions used by the drivers on top of this class, the families
+     * only differ in their signatures and timebases.
+     *
+     * Streaming produces samples at the configured rate in real time, i.e. samples not fetched
+     * within the driver buffer length are dropped and reported as overflow, like the real
+     * driver does. Block captures complete after their duration and call the ready callback
+     * from a separate thread. All the channels carry a sine, digital ports a counter.
+     *
+     * The configuration is read from the DIGITIZERS_PICOSDK_MOCK environment variable (see
+     * picosdk_mock_config_t::parse) at first use, tests can change it with configure.
+     */
+    class picosdk_mock_t : boost::noncopyable
+    {
+    public:
+
+      static picosdk_mock_t &instance();
+
+      void configure(const picosdk_mock_config_t &config);
+
+      picosdk_mock_config_t config();
+
+      picosdk_mock_stats_t stats();
+
+      void reset_stats();
+
+      /*!
+       * \brief The next streaming callback reports an overflow.
+       */
+      void inject_overflow();
+
+      /*!
+       * \brief The next API call stalls for the given time.
+       */
+      void inject_stall(uint32_t us);
+
+      // The rest is used by the API functions, handles are checked by all of them
+
+      /*!
+       * \brief Accounts an API call and applies the latency model, without holding the lock.
+       */
+      void enter();
+
+      PICO_STATUS open_unit(int16_t *handle, const int8_t *serial);
+
+      PICO_STATUS close_unit(int16_t handle);
+
+      PICO_STATUS unit_info(int16_t handle, const std::string &variant, int8_t *string, int16_t length,
+              int16_t *required_size, PICO_INFO info);
+
+      PICO_STATUS memory_segments(int16_t handle, uint32_t nsegments, uint32_t *max_samples);
+
+      PICO_STATUS set_captures(int16_t handle, uint32_t ncaptures);
+
+      PICO_STATUS check_handle(int16_t handle);
+
+      /*!
+       * \brief Registers the buffers of a channel (or digital port, from 0x80) and segment,
+       * segment any_segment for the APIs without segment (ps6000 non-bulk), a null buffer
+       * removes the registration.
+       */
+      PICO_STATUS set_buffer(int16_t handle, int channel, uint32_t segment, int16_t *max, int16_t *min,
+              uint32_t length);
+
+      PICO_STATUS run_block(int16_t handle, uint32_t samples, double interval, uint32_t segment,
+              std::function<void(PICO_STATUS)> ready);
+
+      /*!
+       * \brief Reads the given segments of the last capture into the registered buffers.
+       */
+      PICO_STATUS get_values(int16_t handle, uint32_t start, uint32_t *samples, uint32_t from, uint32_t to,
+              int16_t *overflow);
+
+      /*!
+       * \brief Like get_values, deferred to the completion of the next capture (ps4000a).
+       */
+      PICO_STATUS get_values_overlapped(int16_t handle, uint32_t start, uint32_t *samples, uint32_t from,
+              uint32_t to, int16_t *overflow);
+
+      PICO_STATUS trigger_offsets(int16_t handle, int64_t *times, uint32_t from, uint32_t to);
+
+      PICO_STATUS run_streaming(int16_t handle, double interval, uint32_t downsampling);
+
+      /*!
+       * \brief Writes the samples produced since the last call into the streaming buffers,
+       * PICO_BUSY if there are none. The caller invokes the streaming callback.
+       */
+      PICO_STATUS get_streaming_latest(int16_t handle, int32_t *samples, uint32_t *start_index, int16_t *overflow);
+
+      PICO_STATUS stop(int16_t handle);
+
+      static const uint32_t any_segment = 0xFFFFFFFF;
+
+    private:
+
+      picosdk_mock_t();
+      ~picosdk_mock_t();
+
+      struct buffer_t
+      {
+        int16_t *max;
+        int16_t *min;
+        uint32_t length;
+      };
+
+      struct capture_t
+      {
+        uint64_t first_sample;
+        uint32_t samples;
+      };
+
+      struct overlapped_t
+      {
+        uint32_t start;
+        uint32_t *samples;
+        uint32_t from;
+        uint32_t to;
+        int16_t *overflow;
+      };
+
+      struct unit_t
+      {
+        std::string serial;
+        bool open;
+        uint32_t nsegments;
+        uint32_t ncaptures;
+        std::map<std::pair<int, uint32_t>, buffer_t> buffers;
+
+        // block mode
+        std::map<uint32_t, capture_t> captures;
+        std::unique_ptr<overlapped_t> overlapped;
+        std::unique_ptr<boost::thread> block_thread;
+        bool abort_block;
+
+        // streaming
+        bool streaming;
+        double streaming_rate;
+        boost::chrono::steady_clock::time_point streaming_start;
+        uint64_t produced;          // samples produced by the device, including dropped ones
+        uint32_t position;          // next write position in the streaming buffers
+
+        uint64_t next_sample;       // of the generated signal
+      };
+
+      typedef boost::mutex::scoped_lock lock_t;
+
+      // Returns the open unit of the handle, nullptr if invalid
+      unit_t *find(int16_t handle);
+
+      // Buffer registered for the channel and segment, or for any_segment
+      const buffer_t *find_buffer(unit_t &unit, int channel, uint32_t segment);
+
+      void fill(const buffer_t &buffer, int channel, uint32_t offset, uint32_t samples, uint64_t first_sample);
+
+      PICO_STATUS read_segments(unit_t &unit, uint32_t start, uint32_t *samples, uint32_t from, uint32_t to,
+              int16_t *overflow);
+
+      // Stops a running capture, the lock is released while joining
+      void stop_block(unit_t &unit, lock_t &lock);
+
+      void block_function(int16_t handle, uint32_t samples, double interval, uint32_t segment,
+              std::function<void(PICO_STATUS)> ready);
+
+      boost::mutex d_mutex;
+      boost::condition_variable d_stop_cv;
+      picosdk_mock_config_t d_config;
+      picosdk_mock_stats_t d_stats;
+      std::mt19937 d_random;
+      bool d_inject_overflow;
+      uint32_t d_inject_stall_us;
+      std::vector<std::unique_ptr<unit_t>> d_units;    // handle is the index plus one
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_PICOSDK_MOCK_H */
@@ -0,0 +1,229 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+/*
+ * ps3000a functions used by picoscope_3000a, implemented by the mock (see picosdk_mock.h).
+ * The timebases are the ones of the PicoScope 3000D series, digital ports are supported.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "picosdk_mock.h"
+#include <ps3000aApi.h>
+
+#include <algorithm>
+#include <cmath>
+
+using gr::digitizers::picosdk_mock_t;
+
+namespace {
+
+  picosdk_mock_t &
+  mock()
+  {
+    auto &mock = picosdk_mock_t::instance();
+    mock.enter();
+    return mock;
+  }
+
+  double
+  to_seconds(uint32_t interval, PS3000A_TIME_UNITS units)
+  {
+    return interval * std::pow(1000.0, static_cast<int>(units)) * 1e-15;
+  }
+
+  float
+  timebase_ns(uint32_t timebase)
+  {
+    return timebase < 3 ? (1 << timebase) : (timebase - 2) * 8.0f;
+  }
+
+} // namespace
+
+PICO_STATUS
+ps3000aOpenUnit(int16_t *handle, int8_t *serial)
+{
+  return mock().open_unit(handle, serial);
+}
+
+PICO_STATUS
+ps3000aChangePowerSource(int16_t handle, PICO_STATUS)
+{
+  return mock().check_handle(handle);
+}
+
+PICO_STATUS
+ps3000aCloseUnit(int16_t handle)
+{
+  return mock().close_unit(handle);
+}
+
+PICO_STATUS
+ps3000aMaximumValue(int16_t handle, int16_t *value)
+{
+  auto status = mock().check_handle(handle);
+  if (status == PICO_OK) {
+    *value = 32512;
+  }
+  return status;
+}
+
+PICO_STATUS
+ps3000aGetUnitInfo(int16_t handle, int8_t *string, int16_t stringLength, int16_t *requiredSize, PICO_INFO info)
+{
+  return mock().unit_info(handle, "3406D", string, stringLength, requiredSize, info);
+}
+
+PICO_STATUS
+ps3000aMemorySegments(int16_t handle, uint32_t nSegments, int32_t *nMaxSamples)
+{
+  uint32_t max_samples;
+  auto status = mock().memory_segments(handle, nSegments, &max_samples);
+  if (status == PICO_OK && nMaxSamples) {
+    *nMaxSamples = max_samples;
+  }
+  return status;
+}
+
+PICO_STATUS
+ps3000aSetNoOfCaptures(int16_t handle, uint32_t nCaptures)
+{
+  return mock().set_captures(handle, nCaptures);
+}
+
+PICO_STATUS
+ps3000aSetChannel(int16_t handle, PS3000A_CHANNEL, int16_t, PS3000A_COUPLING, PS3000A_RANGE, float)
+{
+  return mock().check_handle(handle);
+}
+
+PICO_STATUS
+ps3000aSetDigitalPort(int16_t handle, PS3000A_DIGITAL_PORT, int16_t, int16_t)
+{
+  return mock().check_handle(handle);
+}
+
+PICO_STATUS
+ps3000aSetSimpleTrigger(int16_t handle, int16_t, PS3000A_CHANNEL, int16_t, PS3000A_THRESHOLD_DIRECTION, uint32_t,
+        int16_t)
+{
+  return mock().check_handle(handle);
+}
+
+PICO_STATUS
+ps3000aSetTriggerDigitalPortProperties(int16_t handle, PS3000A_DIGITAL_CHANNEL_DIRECTIONS *, int16_t)
+{
+  return mock().check_handle(handle);
+}
+
+PICO_STATUS
+ps3000aSetTriggerChannelConditionsV2(int16_t handle, PS3000A_TRIGGER_CONDITIONS_V2 *, int16_t)
+{
+  return mock().check_handle(handle);
+}
+
+PICO_STATUS
+ps3000aGetTimebase2(int16_t handle, uint32_t timebase, int32_t, float *timeIntervalNanoseconds, int16_t,
+        int32_t *maxSamples, uint32_t)
+{
+  auto &m = mock();
+  auto status = m.check_handle(handle);
+  if (status == PICO_OK) {
+    if (timeIntervalNanoseconds) {
+      *timeIntervalNanoseconds = timebase_ns(timebase);
+    }
+    if (maxSamples) {
+      *maxSamples = m.config().memory_samples;
+    }
+  }
+  return status;
+}
+
+PICO_STATUS
+ps3000aRunBlock(int16_t handle, int32_t noOfPreTriggerSamples, int32_t noOfPostTriggerSamples, uint32_t timebase,
+        int16_t, int32_t *timeIndisposedMs, uint32_t segmentIndex, ps3000aBlockReady lpReady, void *pParameter)
+{
+  const double interval = timebase_ns(timebase) * 1e-9;
+  const uint32_t samples = noOfPreTriggerSamples + noOfPostTriggerSamples;
+  if (timeIndisposedMs) {
+    *timeIndisposedMs = static_cast<int32_t>(samples * interval * 1000.0);
+  }
+
+  return mock().run_block(handle, samples, interval, segmentIndex, [handle, lpReady, pParameter](PICO_STATUS status) {
+    if (lpReady) {
+      lpReady(handle, status, pParameter);
+    }
+  });
+}
+
+PICO_STATUS
+ps3000aRunStreaming(int16_t handle, uint32_t *sampleInterval, PS3000A_TIME_UNITS sampleIntervalTimeUnits, uint32_t,
+        uint32_t, int16_t, uint32_t downSampleRatio, PS3000A_RATIO_MODE downSampleRatioMode, uint32_t)
+{
+  return mock().run_streaming(handle, to_seconds(*sampleInterval, sampleIntervalTimeUnits),
+          downSampleRatioMode == PS3000A_RATIO_MODE_NONE ? 1 : downSampleRatio);
+}
+
+PICO_STATUS
+ps3000aStop(int16_t handle)
+{
+  return mock().stop(handle);
+}
+
+PICO_STATUS
+ps3000aSetDataBuffers(int16_t handle, PS3000A_CHANNEL channel, int16_t *bufferMax, int16_t *bufferMin,
+        int32_t bufferLth, uint32_t segmentIndex, PS3000A_RATIO_MODE)
+{
+  return mock().set_buffer(handle, channel, segmentIndex, bufferMax, bufferMin, bufferLth);
+}
+
+PICO_STATUS
+ps3000aSetDataBuffer(int16_t handle, PS3000A_CHANNEL channel, int16_t *buffer, int32_t bufferLth,
+        uint32_t segmentIndex, PS3000A_RATIO_MODE)
+{
+  return mock().set_buffer(handle, channel, segmentIndex, buffer, nullptr, bufferLth);
+}
+
+PICO_STATUS
+ps3000aGetValues(int16_t handle, uint32_t startIndex, uint32_t *noOfSamples, uint32_t, PS3000A_RATIO_MODE,
+        uint32_t segmentIndex, int16_t *overflow)
+{
+  return mock().get_values(handle, startIndex, noOfSamples, segmentIndex, segmentIndex, overflow);
+}
+
+PICO_STATUS
+ps3000aGetValuesBulk(int16_t handle, uint32_t *noOfSamples, uint32_t fromSegmentIndex, uint32_t toSegmentIndex,
+        uint32_t, PS3000A_RATIO_MODE, int16_t *overflow)
+{
+  return mock().get_values(handle, 0, noOfSamples, fromSegmentIndex, toSegmentIndex, overflow);
+}
+
+PICO_STATUS
+ps3000aGetValuesTriggerTimeOffsetBulk64(int16_t handle, int64_t *times, PS3000A_TIME_UNITS *timeUnits,
+        uint32_t fromSegmentIndex, uint32_t toSegmentIndex)
+{
+  auto status = mock().trigger_offsets(handle, times, fromSegmentIndex, toSegmentIndex);
+  if (status == PICO_OK) {
+    std::fill(timeUnits, timeUnits + (toSegmentIndex - fromSegmentIndex + 1), PS3000A_NS);
+  }
+  return status;
+}
+
+PICO_STATUS
+ps3000aGetStreamingLatestValues(int16_t handle, ps3000aStreamingReady lpPs3000aReady, void *pParameter)
+{
+  int32_t samples;
+  uint32_t start_index;
+  int16_t overflow;
+
+  auto status = mock().get_streaming_latest(handle, &samples, &start_index, &overflow);
+  if (status == PICO_OK && lpPs3000aReady) {
+    lpPs3000aReady(handle, samples, start_index, overflow, 0, 0, 0, pParameter);
+  }
+  return status;
+}
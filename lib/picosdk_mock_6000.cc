@@ -0,0 +1,214 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+/*
+ * ps6000 functions used by picoscope_6000, implemented by the mock (see picosdk_mock.h).
+ * The timebases are the ones of the PicoScope 6000 series, there is no ps6000MaximumValue
+ * (PS6000_MAX_VALUE) and no ps6000ChangePowerSource.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "picosdk_mock.h"
+#include <ps6000Api.h>
+
+#include <algorithm>
+#include <cmath>
+
+using gr::digitizers::picosdk_mock_t;
+
+namespace {
+
+  picosdk_mock_t &
+  mock()
+  {
+    auto &mock = picosdk_mock_t::instance();
+    mock.enter();
+    return mock;
+  }
+
+  double
+  to_seconds(uint32_t interval, PS6000_TIME_UNITS units)
+  {
+    return interval * std::pow(1000.0, static_cast<int>(units)) * 1e-15;
+  }
+
+  float
+  timebase_ns(uint32_t timebase)
+  {
+    return timebase < 5 ? (1 << timebase) * 0.2f : (timebase - 4) * 6.4f;
+  }
+
+} // namespace
+
+PICO_STATUS
+ps6000OpenUnit(int16_t *handle, int8_t *serial)
+{
+  return mock().open_unit(handle, serial);
+}
+
+PICO_STATUS
+ps6000CloseUnit(int16_t handle)
+{
+  return mock().close_unit(handle);
+}
+
+PICO_STATUS
+ps6000GetUnitInfo(int16_t handle, int8_t *string, int16_t stringLength, int16_t *requiredSize, PICO_INFO info)
+{
+  return mock().unit_info(handle, "6404D", string, stringLength, requiredSize, info);
+}
+
+PICO_STATUS
+ps6000MemorySegments(int16_t handle, uint32_t nSegments, uint32_t *nMaxSamples)
+{
+  return mock().memory_segments(handle, nSegments, nMaxSamples);
+}
+
+PICO_STATUS
+ps6000SetNoOfCaptures(int16_t handle, uint32_t nCaptures)
+{
+  return mock().set_captures(handle, nCaptures);
+}
+
+PICO_STATUS
+ps6000SetChannel(int16_t handle, PS6000_CHANNEL, int16_t, PS6000_COUPLING, PS6000_RANGE, float,
+        PS6000_BANDWIDTH_LIMITER)
+{
+  return mock().check_handle(handle);
+}
+
+PICO_STATUS
+ps6000SetSimpleTrigger(int16_t handle, int16_t, PS6000_CHANNEL, int16_t, PS6000_THRESHOLD_DIRECTION, uint32_t,
+        int16_t)
+{
+  return mock().check_handle(handle);
+}
+
+PICO_STATUS
+ps6000SetTriggerChannelConditions(int16_t handle, PS6000_TRIGGER_CONDITIONS *, int16_t)
+{
+  return mock().check_handle(handle);
+}
+
+PICO_STATUS
+ps6000GetTimebase2(int16_t handle, uint32_t timebase, uint32_t, float *timeIntervalNanoseconds, int16_t,
+        uint32_t *maxSamples, uint32_t)
+{
+  auto &m = mock();
+  auto status = m.check_handle(handle);
+  if (status == PICO_OK) {
+    if (timeIntervalNanoseconds) {
+      *timeIntervalNanoseconds = timebase_ns(timebase);
+    }
+    if (maxSamples) {
+      *maxSamples = m.config().memory_samples;
+    }
+  }
+  return status;
+}
+
+PICO_STATUS
+ps6000RunBlock(int16_t handle, uint32_t noOfPreTriggerSamples, uint32_t noOfPostTriggerSamples, uint32_t timebase,
+        int16_t, int32_t *timeIndisposedMs, uint32_t segmentIndex, ps6000BlockReady lpReady, void *pParameter)
+{
+  const double interval = timebase_ns(timebase) * 1e-9;
+  const uint32_t samples = noOfPreTriggerSamples + noOfPostTriggerSamples;
+  if (timeIndisposedMs) {
+    *timeIndisposedMs = static_cast<int32_t>(samples * interval * 1000.0);
+  }
+
+  return mock().run_block(handle, samples, interval, segmentIndex, [handle, lpReady, pParameter](PICO_STATUS status) {
+    if (lpReady) {
+      lpReady(handle, status, pParameter);
+    }
+  });
+}
+
+PICO_STATUS
+ps6000RunStreaming(int16_t handle, uint32_t *sampleInterval, PS6000_TIME_UNITS sampleIntervalTimeUnits, uint32_t,
+        uint32_t, int16_t, uint32_t downSampleRatio, PS6000_RATIO_MODE downSampleRatioMode, uint32_t)
+{
+  return mock().run_streaming(handle, to_seconds(*sampleInterval, sampleIntervalTimeUnits),
+          downSampleRatioMode == PS6000_RATIO_MODE_NONE ? 1 : downSampleRatio);
+}
+
+PICO_STATUS
+ps6000Stop(int16_t handle)
+{
+  return mock().stop(handle);
+}
+
+// Buffers without segment are used for any segment read with ps6000GetValues, bulk buffers
+// for their segment (waveform) only
+
+PICO_STATUS
+ps6000SetDataBuffers(int16_t handle, PS6000_CHANNEL channel, int16_t *bufferMax, int16_t *bufferMin,
+        uint32_t bufferLth, PS6000_RATIO_MODE)
+{
+  return mock().set_buffer(handle, channel, picosdk_mock_t::any_segment, bufferMax, bufferMin, bufferLth);
+}
+
+PICO_STATUS
+ps6000SetDataBuffer(int16_t handle, PS6000_CHANNEL channel, int16_t *buffer, uint32_t bufferLth, PS6000_RATIO_MODE)
+{
+  return mock().set_buffer(handle, channel, picosdk_mock_t::any_segment, buffer, nullptr, bufferLth);
+}
+
+PICO_STATUS
+ps6000SetDataBuffersBulk(int16_t handle, PS6000_CHANNEL channel, int16_t *bufferMax, int16_t *bufferMin,
+        uint32_t bufferLth, uint32_t waveform, PS6000_RATIO_MODE)
+{
+  return mock().set_buffer(handle, channel, waveform, bufferMax, bufferMin, bufferLth);
+}
+
+PICO_STATUS
+ps6000SetDataBufferBulk(int16_t handle, PS6000_CHANNEL channel, int16_t *buffer, uint32_t bufferLth,
+        uint32_t waveform, PS6000_RATIO_MODE)
+{
+  return mock().set_buffer(handle, channel, waveform, buffer, nullptr, bufferLth);
+}
+
+PICO_STATUS
+ps6000GetValues(int16_t handle, uint32_t startIndex, uint32_t *noOfSamples, uint32_t, PS6000_RATIO_MODE,
+        uint32_t segmentIndex, int16_t *overflow)
+{
+  return mock().get_values(handle, startIndex, noOfSamples, segmentIndex, segmentIndex, overflow);
+}
+
+PICO_STATUS
+ps6000GetValuesBulk(int16_t handle, uint32_t *noOfSamples, uint32_t fromSegmentIndex, uint32_t toSegmentIndex,
+        uint32_t, PS6000_RATIO_MODE, int16_t *overflow)
+{
+  return mock().get_values(handle, 0, noOfSamples, fromSegmentIndex, toSegmentIndex, overflow);
+}
+
+PICO_STATUS
+ps6000GetValuesTriggerTimeOffsetBulk64(int16_t handle, int64_t *times, PS6000_TIME_UNITS *timeUnits,
+        uint32_t fromSegmentIndex, uint32_t toSegmentIndex)
+{
+  auto status = mock().trigger_offsets(handle, times, fromSegmentIndex, toSegmentIndex);
+  if (status == PICO_OK) {
+    std::fill(timeUnits, timeUnits + (toSegmentIndex - fromSegmentIndex + 1), PS6000_NS);
+  }
+  return status;
+}
+
+PICO_STATUS
+ps6000GetStreamingLatestValues(int16_t handle, ps6000StreamingReady lpPs6000Ready, void *pParameter)
+{
+  int32_t samples;
+  uint32_t start_index;
+  int16_t overflow;
+
+  auto status = mock().get_streaming_latest(handle, &samples, &start_index, &overflow);
+  if (status == PICO_OK && lpPs6000Ready) {
+    lpPs6000Ready(handle, samples, start_index, overflow, 0, 0, 0, pParameter);
+  }
+  return status;
+}
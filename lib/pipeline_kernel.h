@@ -0,0 +1,259 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_PIPELINE_KERNEL_H
+#define INCLUDED_DIGITIZERS_PIPELINE_KERNEL_H
+
+#include "sos_kernel.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+namespace gr {
+  namespace digitizers {
+
+    /**********************************************************************
+     * Fused pipelines, i.e. chains of processing stages run within a single work call instead
+     * of a hier graph of tiny blocks. A stage is any class providing:
+     *
+     *   int decimation() const;
+     *   void process(const float *in, float *out, size_t noutputs);
+     *
+     * where process consumes noutputs * decimation() inputs and carries its state (histories)
+     * between the calls. Output m of a stage is aligned with its input m * decimation(), i.e.
+     * the same as decimate_and_adjust_timebase does.
+     *********************************************************************/
+
+    /*!
+     * \brief FIR filter evaluated at the output instants only (polyphase decimation):
+     *   out[m] = sum_k taps[k] * in[m * D - k]
+     */
+    class fir_decimator_stage_t
+    {
+    public:
+
+      fir_decimator_stage_t(const std::vector<float> &taps, int decim)
+        : d_decim(decim),
+          d_taps(taps.rbegin(), taps.rend()),
+          d_buffer(taps.size() - 1, 0.0f)
+      {
+      }
+
+      int decimation() const { return d_decim; }
+
+      void
+      process(const float *in, float *out, size_t noutputs)
+      {
+        const size_t history = d_taps.size() - 1;
+        const size_t ninputs = noutputs * d_decim;
+
+        d_buffer.resize(history + ninputs);
+        std::copy(in, in + ninputs, d_buffer.begin() + history);
+
+        const float *x = &d_buffer[0];
+        for (size_t m = 0; m < noutputs; m++, x += d_decim) {
+          float acc = 0.0f;
+          for (size_t k = 0; k < d_taps.size(); k++) {
+            acc += d_taps[k] * x[k];
+          }
+          out[m] = acc;
+        }
+
+        std::copy(d_buffer.end() - history, d_buffer.end(), d_buffer.begin());
+      }
+
+    private:
+      int d_decim;
+      std::vector<float> d_taps;    // reversed
+      std::vector<float> d_buffer;  // history of ntaps - 1 samples followed by the inputs
+    };
+
+    /*!
+     * \brief Biquad cascade, see sos_cascade.
+     */
+    class sos_stage_t
+    {
+    public:
+
+      explicit sos_stage_t(const std::vector<sos_section_t> &sections)
+        : d_sections(sections),
+          d_state(2 * sections.size(), 0.0f)
+      {
+      }
+
+      int decimation() const { return 1; }
+
+      void
+      process(const float *in, float *out, size_t noutputs)
+      {
+        sos_cascade(&d_sections[0], static_cast<int>(d_sections.size()), &d_state[0], in, out,
+                1, static_cast<int>(noutputs));
+      }
+
+    private:
+      std::vector<sos_section_t> d_sections;
+      std::vector<float> d_state;
+    };
+
+    /*!
+     * \brief Delays the samples, the first delay outputs are zero.
+     */
+    class delay_stage_t
+    {
+    public:
+
+      explicit delay_stage_t(size_t delay)
+        : d_history(delay, 0.0f)
+      {
+      }
+
+      int decimation() const { return 1; }
+
+      void
+      process(const float *in, float *out, size_t noutputs)
+      {
+        const size_t delay = d_history.size();
+        if (noutputs <= delay) {
+          std::copy(d_history.begin(), d_history.begin() + noutputs, out);
+          std::copy(d_history.begin() + noutputs, d_history.end(), d_history.begin());
+          std::copy(in, in + noutputs, d_history.end() - noutputs);
+          return;
+        }
+
+        std::copy(d_history.begin(), d_history.end(), out);
+        std::copy(in, in + noutputs - delay, out + delay);
+        std::copy(in + noutputs - delay, in + noutputs, d_history.begin());
+      }
+
+    private:
+      std::vector<float> d_history;
+    };
+
+    /*!
+     * \brief Keeps one in decim samples: out[m] = in[m * decim]
+     */
+    class keep_nth_stage_t
+    {
+    public:
+
+      explicit keep_nth_stage_t(int decim)
+        : d_decim(decim)
+      {
+      }
+
+      int decimation() const { return d_decim; }
+
+      void
+      process(const float *in, float *out, size_t noutputs)
+      {
+        for (size_t m = 0; m < noutputs; m++) {
+          out[m] = in[m * d_decim];
+        }
+      }
+
+    private:
+      int d_decim;
+    };
+
+    /*!
+     * \brief Chains the stages, the output of each stage is the input of the next one.
+     *
+     * The input is processed in strips of roughly STRIP_SAMPLES samples (a multiple of the
+     * overall decimation), each strip passes through all the stages before the next one is
+     * started. The intermediate results therefore stay in the cache, they alternate between
+     * two scratch buffers allocated once.
+     */
+    template <typename... Stages>
+    class fused_pipeline_t
+    {
+    public:
+
+      static const size_t STRIP_SAMPLES = 4096;
+
+      explicit fused_pipeline_t(Stages... stages)
+        : d_stages(std::move(stages)...),
+          d_decimation(1)
+      {
+        compute_decimation<0>();
+
+        d_strip = std::max<size_t>(1, STRIP_SAMPLES / d_decimation);
+        d_scratch[0].resize(d_strip * d_decimation);
+        d_scratch[1].resize(d_strip * d_decimation);
+      }
+
+      /*!
+       * \brief Inputs per output of the whole pipeline.
+       */
+      size_t decimation() const { return d_decimation; }
+
+      template <size_t I>
+      typename std::tuple_element<I, std::tuple<Stages...>>::type &
+      stage() { return std::get<I>(d_stages); }
+
+      /*!
+       * \brief Consumes noutputs * decimation() inputs.
+       */
+      void
+      process(const float *in, float *out, size_t noutputs)
+      {
+        while (noutputs > 0) {
+          const auto n = std::min(noutputs, d_strip);
+          run_stages<0>(in, n * d_decimation, out);
+
+          in += n * d_decimation;
+          out += n;
+          noutputs -= n;
+        }
+      }
+
+    private:
+
+      template <size_t I>
+      typename std::enable_if<(I < sizeof...(Stages))>::type
+      compute_decimation()
+      {
+        d_decimation *= std::get<I>(d_stages).decimation();
+        compute_decimation<I + 1>();
+      }
+
+      template <size_t I>
+      typename std::enable_if<(I == sizeof...(Stages))>::type
+      compute_decimation()
+      {
+      }
+
+      // Stage I reads the scratch buffer stage I - 1 wrote, the last one writes the output
+      template <size_t I>
+      typename std::enable_if<(I < sizeof...(Stages))>::type
+      run_stages(const float *in, size_t ninputs, float *out)
+      {
+        auto &stage = std::get<I>(d_stages);
+        const size_t noutputs = ninputs / stage.decimation();
+        float *dst = (I + 1 == sizeof...(Stages)) ? out : &d_scratch[I % 2][0];
+
+        stage.process(in, dst, noutputs);
+        run_stages<I + 1>(dst, noutputs, out);
+      }
+
+      template <size_t I>
+      typename std::enable_if<(I == sizeof...(Stages))>::type
+      run_stages(const float *in, size_t ninputs, float *out)
+      {
+      }
+
+      std::tuple<Stages...> d_stages;
+      size_t d_decimation;
+      size_t d_strip;                     // outputs per strip
+      std::vector<float> d_scratch[2];
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_PIPELINE_KERNEL_H */
@@ -0,0 +1,173 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_POLL_SCHEDULER_H
+#define INCLUDED_DIGITIZERS_POLL_SCHEDULER_H
+
+#include <algorithm>
+#include <cstdint>
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Schedules the polls of a streaming driver on absolute deadlines.
+     *
+     * Deadlines advance by the poll interval from the previous deadline rather than from the end
+     * of the poll, i.e. the time spent polling doesn't accumulate as drift. A poll running late
+     * moves the next deadline to now instead of catching up with a burst of polls.
+     *
+     * In adaptive mode the interval follows the driver buffer fill level, based on the samples
+     * received per poll (the callback sizes):
+     *  - more than the target fill: the interval is halved, overruns are imminent
+     *  - nothing received: the interval grows by a quarter, the driver has nothing to hand over
+     *  - otherwise it converges to the interval filling the target fraction of the buffer
+     *
+     * The interval is bounded by the interval filling the target fraction of the buffer at the
+     * nominal rate (and max_interval_ns) from above, and by half the period of the average
+     * callback size (and min_interval_ns) from below, polling faster than the driver delivers
+     * only burns CPU. The latter doesn't apply when halving the interval.
+     *
+     * Used by the poll thread only, hence no locking.
+     */
+    class poll_scheduler_t
+    {
+    public:
+
+      poll_scheduler_t()
+        : d_adaptive(false),
+          d_samp_rate(0.0),
+          d_buffer_size(0),
+          d_target_fill(0.0),
+          d_min_interval_ns(0),
+          d_max_interval_ns(0),
+          d_interval_ns(0),
+          d_deadline_ns(0),
+          d_last_samples(0),
+          d_chunk(0.0)
+      {
+      }
+
+      /*!
+       * \brief Restarts the schedule, called on arm. The first poll afterwards starts it.
+       *
+       * \param interval_ns configured poll interval, fixed unless adaptive
+       * \param samp_rate samples per second delivered by the driver
+       * \param buffer_size driver buffer size in samples
+       * \param adaptive derive the interval from the fill level
+       * \param target_fill fraction of the driver buffer filled between two polls
+       * \param min_interval_ns lower bound of the adaptive interval
+       * \param max_interval_ns upper bound of the adaptive interval
+       */
+      void reset(uint64_t interval_ns, double samp_rate, uint64_t buffer_size,
+              bool adaptive, double target_fill, uint64_t min_interval_ns, uint64_t max_interval_ns)
+      {
+        d_adaptive = adaptive && samp_rate > 0.0 && buffer_size > 0;
+        d_samp_rate = samp_rate;
+        d_buffer_size = buffer_size;
+        d_target_fill = target_fill;
+        d_min_interval_ns = min_interval_ns;
+        d_max_interval_ns = std::max(min_interval_ns, max_interval_ns);
+        d_interval_ns = d_adaptive ? clamp(interval_ns) : interval_ns;
+        d_deadline_ns = 0;
+        d_last_samples = 0;
+        d_chunk = 0.0;
+      }
+
+      /*!
+       * \brief Accounts for a poll and returns the deadline of the next one.
+       *
+       * \param samples samples received since reset
+       * \param now_ns current (monotonic) time, after the poll
+       */
+      uint64_t next(uint64_t samples, uint64_t now_ns)
+      {
+        if (d_adaptive) {
+          const double delivered = static_cast<double>(samples - d_last_samples);
+
+          if (delivered > 0.0) {
+            d_chunk += (delivered - d_chunk) / 8.0;
+          }
+
+          if (delivered > d_target_fill * d_buffer_size) {
+            // Overruns take precedence over the callback size
+            d_interval_ns = std::max(d_min_interval_ns, d_interval_ns / 2);
+          }
+          else {
+            if (delivered == 0.0) {
+              d_interval_ns += d_interval_ns / 4;
+            }
+            else {
+              const auto target = static_cast<int64_t>(get_fill_interval_ns());
+              d_interval_ns += (target - static_cast<int64_t>(d_interval_ns)) / 4;
+            }
+            d_interval_ns = clamp(d_interval_ns);
+          }
+        }
+        d_last_samples = samples;
+
+        if (d_deadline_ns == 0) {
+          d_deadline_ns = now_ns;
+        }
+        d_deadline_ns += d_interval_ns;
+        if (d_deadline_ns < now_ns) {
+          d_deadline_ns = now_ns;
+        }
+
+        return d_deadline_ns;
+      }
+
+      uint64_t get_interval_ns() const
+      {
+        return d_interval_ns;
+      }
+
+      /*!
+       * \brief Longest interval the schedule might use.
+       */
+      uint64_t get_max_interval_ns() const
+      {
+        return d_adaptive ? std::max(d_interval_ns, upper_bound()) : d_interval_ns;
+      }
+
+    private:
+
+      double get_fill_interval_ns() const
+      {
+        return d_target_fill * d_buffer_size / d_samp_rate * 1e9;
+      }
+
+      uint64_t upper_bound() const
+      {
+        return std::max(d_min_interval_ns,
+                std::min(d_max_interval_ns, static_cast<uint64_t>(get_fill_interval_ns())));
+      }
+
+      uint64_t clamp(uint64_t interval_ns) const
+      {
+        const auto chunk_interval = static_cast<uint64_t>(d_chunk / d_samp_rate * 1e9 / 2.0);
+        const auto upper = upper_bound();
+        const auto lower = std::min(upper, std::max(d_min_interval_ns, chunk_interval));
+        return std::min(upper, std::max(lower, interval_ns));
+      }
+
+      bool d_adaptive;
+      double d_samp_rate;
+      uint64_t d_buffer_size;
+      double d_target_fill;
+      uint64_t d_min_interval_ns;
+      uint64_t d_max_interval_ns;
+
+      uint64_t d_interval_ns;
+      uint64_t d_deadline_ns;
+      uint64_t d_last_samples;
+      double d_chunk;              // average number of samples received per poll
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_POLL_SCHEDULER_H */
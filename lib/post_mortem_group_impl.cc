@@ -0,0 +1,104 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "post_mortem_group_impl.h"
+#include "utils.h"
+
+#include <boost/make_shared.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/chrono.hpp>
+#include <sstream>
+#include <stdexcept>
+
+namespace gr {
+  namespace digitizers {
+
+    post_mortem_group::sptr
+    post_mortem_group::make()
+    {
+      return boost::make_shared<post_mortem_group_impl>();
+    }
+
+    post_mortem_group_impl::post_mortem_group_impl()
+      : d_request(boost::make_shared<seqlock_t<group_freeze_t>>()),
+        d_epoch(0)
+    {
+      d_request->store(group_freeze_t{0, -1});
+    }
+
+    post_mortem_group_impl::~post_mortem_group_impl()
+    {
+    }
+
+    void
+    post_mortem_group_impl::add_sink(post_mortem_sink::sptr sink)
+    {
+      auto sink_impl = boost::dynamic_pointer_cast<post_mortem_sink_impl>(sink);
+      if (!sink_impl) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid post-mortem sink";
+        throw std::invalid_argument(message.str());
+      }
+
+      boost::mutex::scoped_lock lock(d_mutex);
+      sink_impl->set_freeze_group(d_request);
+      d_sinks.push_back(sink_impl);
+    }
+
+    std::vector<post_mortem_sink::sptr>
+    post_mortem_group_impl::get_sinks()
+    {
+      boost::mutex::scoped_lock lock(d_mutex);
+      return std::vector<post_mortem_sink::sptr>(d_sinks.begin(), d_sinks.end());
+    }
+
+    uint64_t
+    post_mortem_group_impl::freeze_at(int64_t timestamp)
+    {
+      // The members poll the request, nothing is done per member
+      boost::mutex::scoped_lock lock(d_mutex);
+      d_request->store(group_freeze_t{++d_epoch, timestamp});
+      return d_epoch;
+    }
+
+    uint64_t
+    post_mortem_group_impl::freeze()
+    {
+      return freeze_at(static_cast<int64_t>(get_timestamp_nano_utc()));
+    }
+
+    bool
+    post_mortem_group_impl::wait_frozen(double timeout)
+    {
+      std::vector<boost::shared_ptr<post_mortem_sink_impl>> sinks;
+      uint64_t epoch;
+      {
+        boost::mutex::scoped_lock lock(d_mutex);
+        sinks = d_sinks;
+        epoch = d_epoch;
+      }
+
+      const auto deadline = boost::chrono::steady_clock::now()
+              + boost::chrono::microseconds(static_cast<int64_t>(timeout * 1e6));
+
+      for (const auto &sink : sinks) {
+        while (sink->get_group_epoch() < epoch) {
+          if (boost::chrono::steady_clock::now() >= deadline) {
+            return false;
+          }
+          boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
+        }
+      }
+
+      return true;
+    }
+
+  } /* namespace digitizers */
+} /* namespace gr */
@@ -0,0 +1,47 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_POST_MORTEM_GROUP_IMPL_H
+#define INCLUDED_DIGITIZERS_POST_MORTEM_GROUP_IMPL_H
+
+#include <digitizers/post_mortem_group.h>
+#include "post_mortem_sink_impl.h"
+
+#include <boost/thread/mutex.hpp>
+
+namespace gr {
+  namespace digitizers {
+
+    class post_mortem_group_impl : public post_mortem_group
+    {
+     public:
+      post_mortem_group_impl();
+
+      ~post_mortem_group_impl();
+
+      void add_sink(post_mortem_sink::sptr sink) override;
+
+      std::vector<post_mortem_sink::sptr> get_sinks() override;
+
+      uint64_t freeze_at(int64_t timestamp) override;
+
+      uint64_t freeze() override;
+
+      bool wait_frozen(double timeout) override;
+
+     private:
+      // Serializes the freezes, the request is written by a single thread at a time
+      boost::mutex d_mutex;
+      group_freeze_sptr d_request;
+      uint64_t d_epoch;
+
+      std::vector<boost::shared_ptr<post_mortem_sink_impl>> d_sinks;
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_POST_MORTEM_GROUP_IMPL_H */
@@ -10,13 +10,34 @@
 
 #include <gnuradio/io_signature.h>
 #include "post_mortem_sink_impl.h"
+#include "half_kernel.h"
+#include "probes.h"
 
+#include <boost/make_shared.hpp>
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
 #include <string>
 #include <algorithm>
+#include <cmath>
+#include <limits>
 
 namespace gr {
   namespace digitizers {
 
+    static const int PYRAMID_DECIMATION = 10;
+
+    // Max number of time index entries, i.e. acq_info tags within the history
+    static const size_t TIME_INDEX_SIZE = 4096;
+
     post_mortem_sink::sptr
     post_mortem_sink::make(std::string name, std::string unit, float samp_rate, size_t buffer_size)
     {
@@ -29,19 +50,37 @@ namespace gr {
               gr::io_signature::make(2, 2, sizeof(float)),
               gr::io_signature::make(2, 2, sizeof(float))),
         d_samp_rate(samp_rate),
-        d_buffer_values(buffer_size),
-        d_buffer_errors(buffer_size),
         d_buffer_size(buffer_size),
-        d_write_index(0),
-        d_acq_info(),
-        d_acq_info_offset(0),
+        d_half_values(false),
+        d_half_errors(false),
+        d_huge_pages(false),
+        d_state(),
+        d_write_reserved(0),
+        d_write_limit(std::numeric_limits<uint64_t>::max()),
+        d_frozen(false),
+        d_snapshot(),
+        d_snapshot_nitems(0),
+        d_time_index(TIME_INDEX_SIZE),
+        d_history_restarted(false),
+        d_pyramid_enabled(false),
+        d_pyramid_duration(0.0),
         d_metadata(),
-        d_frozen(false)
+        d_views(0),
+        d_group_epoch(0),
+        d_group_pending(false),
+        d_group_timestamp(-1),
+        d_group_limit(std::numeric_limits<uint64_t>::max()),
+        d_group_released(0),
+        d_group_consumed(0),
+        d_file_header(nullptr),
+        d_file_header_bytes(0)
     {
-        // This allows us to simply copy zero values to the client
-        memset(&d_buffer_errors[0], 0, buffer_size * sizeof(float));
+        // Freshly mapped memory is zeroed, this allows us to simply copy zero values
+        // to the client if errors are not connected
+        allocate_rings();
 
-        d_acq_info.timestamp = -1;
+        d_state.acq_info.timestamp = -1;
+        d_published_state.store(d_state);
 
         d_metadata.name = name;
         d_metadata.unit = unit;
@@ -49,6 +88,7 @@ namespace gr {
 
     post_mortem_sink_impl::~post_mortem_sink_impl()
     {
+      unmap_file_header();
     }
 
     int
@@ -56,50 +96,241 @@ namespace gr {
         gr_vector_const_void_star &input_items,
         gr_vector_void_star &output_items)
     {
-      boost::mutex::scoped_lock lock(d_mutex);
-
+      block_stats_scope_t stats(d_stats);
       auto reading_errors = input_items.size() > 1;
 
-      // Data is frozen, copy data to outputs and return
-      if (d_frozen) {
-          if (output_items.size() >= 1) {
-            memcpy(output_items[0], input_items[0], ninput_items * sizeof(float));
-          }
-          if (reading_errors && output_items.size() == 2) {
-            memcpy(output_items[1], input_items[1], ninput_items * sizeof(float));
-          }
-          return ninput_items;
+      if (output_items.size() >= 1) {
+        memcpy(output_items[0], input_items[0], ninput_items * sizeof(float));
+      }
+      if (reading_errors && output_items.size() == 2) {
+        memcpy(output_items[1], input_items[1], ninput_items * sizeof(float));
       }
 
-      // For simplicity perform only a single memcpy at once
-      assert(d_write_index < d_buffer_size);
-      ninput_items = std::min(ninput_items, static_cast<int>(d_buffer_size - d_write_index));
+      const auto count = d_state.ring_count;
+      const auto end = count + static_cast<uint64_t>(ninput_items);
 
-      memcpy(&d_buffer_values[d_write_index], input_items[0], ninput_items * sizeof(float));
-      if (output_items.size() >= 1) {
-        memcpy(output_items[0], input_items[0], ninput_items * sizeof(float));
+      // A captured group snapshot is protected by the writer until the readers took it over
+      if (d_group_limit != std::numeric_limits<uint64_t>::max()
+              && d_group_released.load() >= d_state.group_epoch) {
+        d_group_limit = std::numeric_limits<uint64_t>::max();
       }
-      if (reading_errors) {
-        memcpy(&d_buffer_errors[d_write_index], input_items[1], ninput_items * sizeof(float));
-        if (output_items.size() == 2) {
-          memcpy(output_items[1], input_items[1], ninput_items * sizeof(float));
-        }
+      const bool written = end <= d_group_limit
+              && reserve_write(d_write_reserved, d_write_limit, count, end);
+
+      if (written) {
+        push_samples(static_cast<const float *>(input_items[0]),
+                reading_errors ? static_cast<const float *>(input_items[1]) : nullptr, ninput_items);
+        d_state.ring_count = end;
+      }
+      else {
+        // Samples would overwrite the frozen snapshot, history restarts once unfrozen
+        d_state.history_start = count;
       }
 
-      // Update write index and wrap around if needed
-      d_write_index += ninput_items;
-      if (d_write_index == d_buffer_size) {
-        d_write_index = 0;
+      d_state.stream_count += static_cast<uint64_t>(ninput_items);
+
+      if (d_pyramid_enabled) {
+        update_pyramid(static_cast<const float *>(input_items[0]), ninput_items);
       }
 
       // Acq info tag
-      decode_tags(ninput_items);
+      decode_tags(ninput_items, count, written);
+
+      if (d_group) {
+        capture_group_freeze();
+      }
+
+      d_published_state.store(d_state);
+
+      if (d_file_header) {
+        publish_file_state();
+      }
 
       return ninput_items;
     }
 
     void
-    post_mortem_sink_impl::decode_tags(int ninput_items)
+    post_mortem_sink_impl::push_samples(const float *values, const float *errors, int nitems)
+    {
+      // The ring buffer takes care of the wrap-around
+      if (d_half_values) {
+        d_half_scratch.resize(std::max(d_half_scratch.size(), static_cast<size_t>(nitems)));
+        float_to_half(values, &d_half_scratch[0], nitems);
+        d_buffer_half_values.push(&d_half_scratch[0], nitems);
+      }
+      else {
+        d_buffer_values.push(values, nitems);
+      }
+
+      if (errors == nullptr) {
+        return;
+      }
+
+      if (d_half_errors) {
+        d_half_scratch.resize(std::max(d_half_scratch.size(), static_cast<size_t>(nitems)));
+        float_to_half(errors, &d_half_scratch[0], nitems);
+        d_buffer_half_errors.push(&d_half_scratch[0], nitems);
+      }
+      else {
+        d_buffer_errors.push(errors, nitems);
+      }
+    }
+
+    void
+    post_mortem_sink_impl::copy_samples(uint64_t from, size_t nitems, float *values, float *errors)
+    {
+      // Samples are contiguous in the mirrored buffers, the writer doesn't touch them until
+      // unfrozen
+      if (d_half_values) {
+        half_to_float(d_buffer_half_values.view(from), values, nitems);
+      }
+      else {
+        memcpy(values, d_buffer_values.view(from), nitems * sizeof(float));
+      }
+
+      if (d_half_errors) {
+        half_to_float(d_buffer_half_errors.view(from), errors, nitems);
+      }
+      else {
+        memcpy(errors, d_buffer_errors.view(from), nitems * sizeof(float));
+      }
+    }
+
+    void
+    post_mortem_sink_impl::allocate_rings()
+    {
+      // Rings not in use are released
+      if (d_half_values) {
+        d_buffer_values.release();
+        d_buffer_half_values.allocate(2 * d_buffer_size, d_huge_pages);
+      }
+      else {
+        d_buffer_half_values.release();
+        d_buffer_values.allocate(2 * d_buffer_size, d_huge_pages);
+      }
+
+      if (d_half_errors) {
+        d_buffer_errors.release();
+        d_buffer_half_errors.allocate(2 * d_buffer_size, d_huge_pages);
+      }
+      else {
+        d_buffer_half_errors.release();
+        d_buffer_errors.allocate(2 * d_buffer_size, d_huge_pages);
+      }
+    }
+
+    uint64_t
+    post_mortem_sink_impl::get_ring_capacity() const
+    {
+      // Capacities are rounded to whole pages, i.e. they may differ for rings of different
+      // precision. Both hold the smaller one at least.
+      const auto values = d_half_values ? d_buffer_half_values.capacity() : d_buffer_values.capacity();
+      const auto errors = d_half_errors ? d_buffer_half_errors.capacity() : d_buffer_errors.capacity();
+      return std::min(values, errors);
+    }
+
+    bool
+    post_mortem_sink_impl::reserve_write(std::atomic<uint64_t> &reserved, const std::atomic<uint64_t> &limit,
+            uint64_t count, uint64_t end)
+    {
+      // The reservation is checked against the limit once again in case the buffer was frozen
+      // meanwhile, see protect_snapshot
+      if (end <= limit.load(std::memory_order_acquire)) {
+        reserved.store(end);
+        if (end <= limit.load()) {
+          return true;
+        }
+      }
+
+      reserved.store(count);
+      return false;
+    }
+
+    uint64_t
+    post_mortem_sink_impl::protect_snapshot(std::atomic<uint64_t> &limit, const std::atomic<uint64_t> &reserved,
+            uint64_t count, uint64_t nitems, uint64_t capacity)
+    {
+      limit.store(count - nitems + capacity);
+
+      // A write started before the limit was set might reach beyond it, the items it
+      // overwrites are not part of the snapshot
+      const auto reserved_end = reserved.load();
+      if (reserved_end > count - nitems + capacity) {
+        nitems = reserved_end >= count + capacity ? 0 : count + capacity - reserved_end;
+      }
+
+      return nitems;
+    }
+
+    void
+    post_mortem_sink_impl::update_pyramid(const float *values, int nitems)
+    {
+      for (auto &level : d_levels) {
+        level.out_min.clear();
+        level.out_max.clear();
+        level.out_mean.clear();
+      }
+
+      for (int i = 0; i < nitems; i++) {
+        accumulate(0, values[i], values[i], values[i]);
+      }
+
+      uint64_t decimation = 1;
+      for (int k = 0; k < POST_MORTEM_PYRAMID_LEVELS; k++) {
+        auto &level = d_levels[k];
+        decimation *= PYRAMID_DECIMATION;
+
+        const auto n = level.out_mean.size();
+        if (n == 0) {
+          continue;
+        }
+
+        const auto count = d_state.level_ring_count[k];
+        if (reserve_write(level.write_reserved, level.write_limit, count, count + n)) {
+          level.min.push(&level.out_min[0], n);
+          level.max.push(&level.out_max[0], n);
+          level.mean.push(&level.out_mean[0], n);
+          d_state.level_ring_count[k] = count + n;
+        }
+        else {
+          d_state.level_history_start[k] = count;
+        }
+
+        d_state.level_stream_count[k] += n * decimation;
+      }
+    }
+
+    void
+    post_mortem_sink_impl::accumulate(int k, float min, float max, double mean)
+    {
+      auto &level = d_levels[k];
+
+      level.acc_min = std::min(level.acc_min, min);
+      level.acc_max = std::max(level.acc_max, max);
+      level.acc_sum += mean;
+
+      if (++level.acc_count < PYRAMID_DECIMATION) {
+        return;
+      }
+
+      // Entries of each level cover the same number of raw samples, hence the mean of means
+      const auto entry_mean = level.acc_sum / PYRAMID_DECIMATION;
+      level.out_min.push_back(level.acc_min);
+      level.out_max.push_back(level.acc_max);
+      level.out_mean.push_back(static_cast<float>(entry_mean));
+
+      level.acc_min = std::numeric_limits<float>::infinity();
+      level.acc_max = -std::numeric_limits<float>::infinity();
+      level.acc_sum = 0.0;
+      level.acc_count = 0;
+
+      if (k + 1 < POST_MORTEM_PYRAMID_LEVELS) {
+        accumulate(k + 1, level.out_min.back(), level.out_max.back(), entry_mean);
+      }
+    }
+
+    void
+    post_mortem_sink_impl::decode_tags(int ninput_items, uint64_t count, bool written)
     {
       // Sample zero index
       const uint64_t samp0_count = this->nitems_read(0);
@@ -107,12 +338,85 @@ namespace gr {
 
       // Acquisition info, store the last one
       get_tags_in_range(tags, 0, samp0_count,
-            samp0_count + ninput_items, pmt::string_to_symbol(acq_info_tag_name));
+            samp0_count + ninput_items, acq_info_tag_key());
+
+      if (!written) {
+        d_history_restarted = true;
+      }
+      else if (d_history_restarted) {
+        // Samples in between were skipped, the timestamps continue from the last tag
+        d_history_restarted = false;
+        if (d_state.acq_info.timestamp >= 0 && (tags.empty() || tags.front().offset != samp0_count)) {
+          auto acq_info = d_state.acq_info;
+          acq_info.timestamp = extrapolate_timestamp(d_state.acq_info, d_state.acq_info_offset, samp0_count);
+          add_time_index_entry(count, acq_info);
+        }
+      }
+
+      for (const auto &tag : tags) {
+        d_state.acq_info = decode_acq_info_tag(tag);
+        d_state.acq_info_offset = tag.offset;
+
+        if (written && d_state.acq_info.timestamp >= 0) {
+          add_time_index_entry(count + (tag.offset - samp0_count), d_state.acq_info);
+        }
+      }
+    }
+
+    void
+    post_mortem_sink_impl::capture_group_freeze()
+    {
+      const auto request = d_group->load();
+      if (request.epoch != d_group_epoch) {
+        d_group_epoch = request.epoch;
+        d_group_timestamp = request.timestamp;
+        d_group_pending = true;
+      }
+
+      if (!d_group_pending) {
+        return;
+      }
 
-      if(tags.size()) {
-        d_acq_info = decode_acq_info_tag(tags.at(tags.size() - 1));
-        d_acq_info_offset = tags.at(tags.size() - 1).offset;
+      // Stream offset one past the sample at the requested timestamp, the current offset if
+      // either timestamp is unknown
+      auto stream_end = d_state.stream_count;
+      const auto &acq_info = d_state.acq_info;
+      const double sample_ns = acq_info.timebase * 1000000000.0;
+      if (d_group_timestamp >= 0 && acq_info.timestamp >= 0 && sample_ns > 0.0) {
+        const double position = static_cast<double>(d_state.acq_info_offset)
+                + std::floor((d_group_timestamp - acq_info.timestamp) / sample_ns) + 1.0;
+        if (position > static_cast<double>(d_state.stream_count)) {
+          return; // not reached yet
+        }
+        stream_end = position > 0.0 ? static_cast<uint64_t>(position) : 0;
       }
+      d_group_pending = false;
+
+      // Stream offsets map to ring indices since the history (re)started only
+      const auto contiguous = d_state.ring_count - d_state.history_start;
+      const auto ring_end = d_state.ring_count - std::min(d_state.stream_count - stream_end, contiguous);
+
+      // Samples overwritten already are not part of the snapshot
+      const uint64_t capacity = get_ring_capacity();
+      const auto oldest = d_state.ring_count > capacity ? d_state.ring_count - capacity : 0;
+      auto nitems = std::min(static_cast<uint64_t>(d_buffer_size), ring_end - d_state.history_start);
+      nitems = std::min(nitems, ring_end - std::min(ring_end, oldest));
+
+      d_group_limit = ring_end - nitems + capacity;
+
+      d_state.group_epoch = d_group_epoch;
+      d_state.group_ring_end = ring_end;
+      d_state.group_stream_end = stream_end;
+      d_state.group_nitems = nitems;
+      d_state.group_acq_info = acq_info;
+      d_state.group_acq_info_offset = d_state.acq_info_offset;
+    }
+
+    void
+    post_mortem_sink_impl::add_time_index_entry(uint64_t ring_index, const acq_info_t &acq_info)
+    {
+      boost::mutex::scoped_lock lock(d_time_index_mutex);
+      d_time_index.push_back(time_index_entry_t{ring_index, acq_info});
     }
 
     float
@@ -138,7 +442,202 @@ namespace gr {
     post_mortem_sink_impl::freeze_buffer()
     {
       boost::mutex::scoped_lock lock(d_mutex);
+      freeze_locked();
+    }
+
+    void
+    post_mortem_sink_impl::freeze_locked()
+    {
+      if (d_frozen) {
+        return;
+      }
+
+      auto state = d_published_state.load();
+      const uint64_t capacity = get_ring_capacity();
+
+      uint64_t nitems;
+      if (state.group_epoch > d_group_consumed) {
+        // Snapshot captured by the writer for a group freeze, protected by the writer until
+        // the write limit is set
+        d_group_consumed = state.group_epoch;
+        nitems = protect_snapshot(d_write_limit, d_write_reserved, state.group_ring_end,
+                state.group_nitems, capacity);
+        d_group_released.store(state.group_epoch);
+
+        state.ring_count = state.group_ring_end;
+        state.stream_count = state.group_stream_end;
+        state.acq_info = state.group_acq_info;
+        state.acq_info_offset = state.group_acq_info_offset;
+      }
+      else {
+        nitems = std::min(static_cast<uint64_t>(d_buffer_size), state.ring_count - state.history_start);
+        nitems = protect_snapshot(d_write_limit, d_write_reserved, state.ring_count, nitems, capacity);
+      }
+
+      uint64_t decimation = 1;
+      for (int k = 0; k < POST_MORTEM_PYRAMID_LEVELS && d_pyramid_enabled; k++) {
+        auto &level = d_levels[k];
+        decimation *= PYRAMID_DECIMATION;
+
+        // Entries completed past the snapshot end are not part of it (group freeze only)
+        auto level_count = state.level_ring_count[k];
+        if (state.level_stream_count[k] > state.stream_count) {
+          const auto excess = std::min((state.level_stream_count[k] - state.stream_count + decimation - 1) / decimation,
+                  level_count - state.level_history_start[k]);
+          level_count -= excess;
+          state.level_ring_count[k] = level_count;
+          state.level_stream_count[k] -= excess * decimation;
+        }
+
+        const auto level_nitems = std::min(static_cast<uint64_t>(level.size),
+                level_count - state.level_history_start[k]);
+        level.snapshot_nitems = protect_snapshot(level.write_limit, level.write_reserved,
+                level_count, level_nitems, level.mean.capacity());
+      }
+
+      d_snapshot = state;
+      d_snapshot_nitems = nitems;
       d_frozen = true;
+      DIGITIZERS_PROBE2(post_mortem_freeze, d_metadata.name.c_str(), nitems);
+
+      if (d_file_header) {
+        publish_file_snapshot(state, nitems);
+      }
+    }
+
+    void
+    post_mortem_sink_impl::publish_file_snapshot(const state_t &state, uint64_t nitems)
+    {
+      // Samples are in the file already, the header is all it takes to persist the snapshot
+      d_file_header->status = state.acq_info.status;
+      d_file_header->snapshot_end = state.ring_count;
+      d_file_header->snapshot_nitems = nitems;
+      d_file_header->timestamp = get_snapshot_timestamp(state.stream_count - nitems);
+      d_file_header->timebase = state.acq_info.timebase;
+      d_file_header->user_delay = state.acq_info.user_delay;
+      d_file_header->actual_delay = state.acq_info.actual_delay;
+      std::atomic_thread_fence(std::memory_order_release);
+      d_file_header->frozen = 1;
+      wake_frozen_waiters();
+      msync(d_file_header, d_file_header_bytes, MS_ASYNC);
+    }
+
+    void
+    post_mortem_sink_impl::publish_file_state()
+    {
+      // A few stores into the mapped header, written back by the kernel
+      auto &sequence = d_file_header->write_sequence;
+      const auto seq = sequence;
+      sequence = seq | 1;
+      std::atomic_thread_fence(std::memory_order_release);
+
+      d_file_header->write_status = d_state.acq_info.status;
+      d_file_header->write_ring_count = d_state.ring_count;
+      d_file_header->write_history_start = d_state.history_start;
+      d_file_header->write_stream_count = d_state.stream_count;
+      d_file_header->write_acq_offset = d_state.acq_info_offset;
+      d_file_header->write_timestamp = d_state.acq_info.timestamp;
+      d_file_header->write_timebase = d_state.acq_info.timebase;
+      d_file_header->write_user_delay = d_state.acq_info.user_delay;
+      d_file_header->write_actual_delay = d_state.acq_info.actual_delay;
+
+      std::atomic_thread_fence(std::memory_order_release);
+      sequence = (seq | 1) + 1;
+    }
+
+    void
+    post_mortem_sink_impl::resume_locked(const post_mortem_file_header_t &previous)
+    {
+      const uint64_t ring_count = previous.write_ring_count;
+      const uint64_t capacity = get_ring_capacity();
+      const uint64_t oldest = ring_count > capacity ? ring_count - capacity : 0;
+
+      // The history as of the last update of the previous run, in its stream offsets
+      state_t snapshot = state_t();
+      snapshot.ring_count = ring_count;
+      snapshot.stream_count = previous.write_stream_count;
+      snapshot.history_start = std::max(previous.write_history_start, oldest);
+      snapshot.acq_info.timestamp = previous.write_timestamp;
+      snapshot.acq_info.timebase = previous.write_timebase;
+      snapshot.acq_info.user_delay = previous.write_user_delay;
+      snapshot.acq_info.actual_delay = previous.write_actual_delay;
+      snapshot.acq_info.status = previous.write_status;
+      snapshot.acq_info_offset = previous.write_acq_offset;
+
+      // Writing continues past it, the new samples are not contiguous with the previous ones
+      d_buffer_values.set_count(ring_count);
+      d_buffer_errors.set_count(ring_count);
+      d_state.ring_count = ring_count;
+      d_state.history_start = ring_count;
+      d_published_state.store(d_state);
+
+      const auto contiguous = ring_count - snapshot.history_start;
+      if (snapshot.acq_info.timestamp >= 0 && contiguous <= snapshot.stream_count) {
+        auto acq_info = snapshot.acq_info;
+        acq_info.timestamp = extrapolate_timestamp(snapshot.acq_info, snapshot.acq_info_offset,
+                snapshot.stream_count - contiguous);
+        add_time_index_entry(snapshot.history_start, acq_info);
+      }
+
+      // Same as a freeze of the previous run
+      auto nitems = std::min(static_cast<uint64_t>(d_buffer_size), contiguous);
+      nitems = protect_snapshot(d_write_limit, d_write_reserved, ring_count, nitems, capacity);
+      d_snapshot = snapshot;
+      d_snapshot_nitems = nitems;
+      d_frozen = true;
+
+      publish_file_snapshot(snapshot, nitems);
+    }
+
+    void
+    post_mortem_sink_impl::wake_frozen_waiters()
+    {
+      // Tools mapping the file wait for the snapshot with FUTEX_WAIT on the frozen field
+      syscall(SYS_futex, &d_file_header->frozen, FUTEX_WAKE, std::numeric_limits<int>::max(),
+              nullptr, nullptr, 0);
+    }
+
+    void
+    post_mortem_sink_impl::unfreeze_locked()
+    {
+      if (d_file_header) {
+        d_file_header->frozen = 0;
+        std::atomic_thread_fence(std::memory_order_release);
+        wake_frozen_waiters();
+      }
+
+      d_write_limit.store(std::numeric_limits<uint64_t>::max());
+      for (auto &level : d_levels) {
+        level.write_limit.store(std::numeric_limits<uint64_t>::max());
+        level.snapshot_nitems = 0;
+      }
+      d_frozen = false;
+    }
+
+    int64_t
+    post_mortem_sink_impl::get_snapshot_timestamp(uint64_t offset_first_sample) const
+    {
+      return extrapolate_timestamp(d_snapshot.acq_info, d_snapshot.acq_info_offset, offset_first_sample);
+    }
+
+    int64_t
+    post_mortem_sink_impl::extrapolate_timestamp(const acq_info_t &acq_info, uint64_t acq_info_offset,
+            uint64_t offset)
+    {
+      if (acq_info.timestamp < 0) {
+        return -1; // timestamp is invalid
+      }
+
+      if (offset >= acq_info_offset)
+      {
+        auto delta = acq_info.timebase * (offset - acq_info_offset) * 1000000000.0;
+        return acq_info.timestamp + static_cast<uint64_t>(delta);
+      }
+      else
+      {
+        auto delta = acq_info.timebase * (acq_info_offset - offset) * 1000000000.0;
+        return acq_info.timestamp - static_cast<uint64_t>(delta);
+      }
     }
 
     size_t
@@ -149,64 +648,501 @@ namespace gr {
 
       // If any pointer is null, we were instructed to drop the data
       if (values == nullptr || errors == nullptr || info == nullptr) {
-        d_frozen = false;
+        release_snapshot_locked();
         return 0;
       }
 
-      auto count = nitems_read(0);
-      if (count < uint64_t{d_buffer_size}) {
-        nr_items_to_read = std::min(nr_items_to_read, static_cast<size_t>(count));
+      // Not frozen, take a snapshot of the current content
+      freeze_locked();
+
+      nr_items_to_read = static_cast<size_t>(std::min(static_cast<uint64_t>(nr_items_to_read), d_snapshot_nitems));
+
+      // Last nr_items_to_read samples
+      auto from = d_snapshot.ring_count - nr_items_to_read;
+      copy_samples(from, nr_items_to_read, values, errors);
+
+      get_snapshot_info(nr_items_to_read, info);
+
+      release_snapshot_locked();
+
+      return nr_items_to_read;
+    }
+
+    void
+    post_mortem_sink_impl::get_snapshot_info(uint64_t nitems, measurement_info_t *info) const
+    {
+      // For now we simply copy over the last status
+      const auto &acq_info = d_snapshot.acq_info;
+      info->timebase = acq_info.timebase;
+      info->user_delay = acq_info.user_delay;
+      info->actual_delay = acq_info.actual_delay;
+      info->status = acq_info.status;
+
+      info->timestamp = get_snapshot_timestamp(d_snapshot.stream_count - nitems);
+    }
+
+    post_mortem_view::sptr
+    post_mortem_sink_impl::get_view(size_t nr_items_to_read)
+    {
+      boost::mutex::scoped_lock lock(d_mutex);
+
+      if (d_half_values || d_half_errors) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": views not available, "
+                << "samples are stored in half precision";
+        throw std::runtime_error(message.str());
       }
-      else {
-        nr_items_to_read = std::min(nr_items_to_read, d_buffer_size);
+
+      // Not frozen, take a snapshot of the current content
+      freeze_locked();
+
+      const auto nitems = std::min(static_cast<uint64_t>(nr_items_to_read), d_snapshot_nitems);
+      const auto from = d_snapshot.ring_count - nitems;
+
+      measurement_info_t info {};
+      get_snapshot_info(nitems, &info);
+
+      // The view keeps the sink alive
+      auto sink = boost::dynamic_pointer_cast<post_mortem_sink_impl>(shared_from_this());
+      auto view = boost::make_shared<post_mortem_view_impl>(sink, d_buffer_values.view(from),
+              d_buffer_errors.view(from), static_cast<size_t>(nitems), info);
+      d_views++;
+
+      return view;
+    }
+
+    void
+    post_mortem_sink_impl::release_view()
+    {
+      boost::mutex::scoped_lock lock(d_mutex);
+
+      if (--d_views == 0) {
+        unfreeze_locked();
       }
+    }
 
-      auto transfered = size_t{0};
-      auto index = static_cast<int64_t>(d_write_index) - static_cast<int64_t>(nr_items_to_read);
+    void
+    post_mortem_sink_impl::release_snapshot_locked()
+    {
+      if (d_views == 0) {
+        unfreeze_locked();
+      }
+    }
 
-      if (index < 0) {
-        auto from = static_cast<int64_t>(d_buffer_size) + index;
-        auto size = index * (-1);
-        memcpy(values, &d_buffer_values[from], (size) * sizeof(float));
-        memcpy(errors, &d_buffer_errors[from], (size) * sizeof(float));
-        transfered += size;
+    void
+    post_mortem_sink_impl::check_no_views_locked() const
+    {
+      if (d_views) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": buffer held by "
+                << d_views << " view(s)";
+        throw std::runtime_error(message.str());
       }
+    }
 
-      auto size = nr_items_to_read - transfered;
-      auto from = d_write_index - size;
-      memcpy(&values[transfered], &d_buffer_values[from], (size) * sizeof(float));
-      memcpy(&errors[transfered], &d_buffer_errors[from], (size) * sizeof(float));
+    post_mortem_view_impl::post_mortem_view_impl(boost::shared_ptr<post_mortem_sink_impl> sink,
+            const float *values, const float *errors, size_t size, const measurement_info_t &info)
+      : d_sink(sink),
+        d_values(values),
+        d_errors(errors),
+        d_size(size),
+        d_info(info)
+    {
+    }
 
-      // For now we simply copy over the last status
-      info->timebase = d_acq_info.timebase;
-      info->user_delay = d_acq_info.user_delay;
-      info->actual_delay = d_acq_info.actual_delay;
-      info->status = d_acq_info.status;
+    post_mortem_view_impl::~post_mortem_view_impl()
+    {
+      release();
+    }
 
-      // Calculate timestamp
-      if (d_acq_info.timestamp < 0) {
-        info->timestamp = -1; // timestamp is invalid
+    void
+    post_mortem_view_impl::release()
+    {
+      if (d_sink) {
+        d_sink->release_view();
+        d_sink.reset();
       }
-      else
+    }
+
+    uint64_t
+    post_mortem_sink_impl::find_ring_index(size_t i, int64_t timestamp, bool inclusive) const
+    {
+      const auto &entry = d_time_index[i];
+      const auto next = i + 1 < d_time_index.size() ? d_time_index[i + 1].ring_index
+              : std::numeric_limits<uint64_t>::max();
+      const double sample_ns = entry.acq_info.timebase * 1000000000.0;
+
+      if (timestamp < entry.acq_info.timestamp || !(sample_ns > 0.0)) {
+        return entry.ring_index;
+      }
+
+      const double position = (timestamp - entry.acq_info.timestamp) / sample_ns;
+      const double distance = inclusive ? std::ceil(position) : std::floor(position) + 1.0;
+
+      // Samples beyond the next entry belong to it
+      if (distance >= static_cast<double>(next - entry.ring_index)) {
+        return next;
+      }
+      return entry.ring_index + static_cast<uint64_t>(distance);
+    }
+
+    size_t
+    post_mortem_sink_impl::get_range(int64_t start_timestamp, int64_t end_timestamp, size_t nr_items_to_read,
+            float *values, float *errors, measurement_info_t *info)
+    {
+      boost::mutex::scoped_lock lock(d_mutex);
+
+      if (values == nullptr || errors == nullptr || info == nullptr || end_timestamp < start_timestamp) {
+        return 0;
+      }
+
+      // Not frozen, take a snapshot for this call only
+      const bool was_frozen = d_frozen;
+      freeze_locked();
+
+      const auto snapshot_end = d_snapshot.ring_count;
+      auto from = snapshot_end - d_snapshot_nitems;
+      auto to = from;
+      time_index_entry_t first {};
+
       {
-        auto offset_first_sample = nitems_read(0) - nr_items_to_read;
-        if (offset_first_sample >= d_acq_info_offset)
-        {
-          auto delta = d_acq_info.timebase * (offset_first_sample - d_acq_info_offset) * 1000000000.0;
-          info->timestamp = d_acq_info.timestamp + static_cast<uint64_t>(delta);
+        boost::mutex::scoped_lock index_lock(d_time_index_mutex);
+
+        auto by_timestamp = [](int64_t timestamp, const time_index_entry_t &entry) {
+          return timestamp < entry.acq_info.timestamp;
+        };
+        auto by_ring_index = [](uint64_t ring_index, const time_index_entry_t &entry) {
+          return ring_index < entry.ring_index;
+        };
+
+        if (!d_time_index.empty()) {
+          // Last entries at or before the range bounds
+          const auto begin = d_time_index.begin();
+          const auto start_it = std::upper_bound(begin, d_time_index.end(), start_timestamp, by_timestamp);
+          const auto end_it = std::upper_bound(begin, d_time_index.end(), end_timestamp, by_timestamp);
+
+          const auto range_from = start_it == begin ? d_time_index.front().ring_index
+                  : find_ring_index(start_it - begin - 1, start_timestamp, true);
+          const auto range_to = end_it == begin ? d_time_index.front().ring_index
+                  : find_ring_index(end_it - begin - 1, end_timestamp, false);
+
+          from = std::max(from, range_from);
+          to = std::max(from, std::min(snapshot_end, range_to));
+          to = std::min(to, from + static_cast<uint64_t>(nr_items_to_read));
+
+          // Timestamp of the first sample returned
+          const auto first_it = std::upper_bound(begin, d_time_index.end(), from, by_ring_index);
+          if (to > from && first_it != begin) {
+            first = *(first_it - 1);
+            first.acq_info.timestamp = extrapolate_timestamp(first.acq_info, first.ring_index, from);
+          }
         }
-        else
-        {
-          auto delta = d_acq_info.timebase * (d_acq_info_offset - offset_first_sample) * 1000000000.0;
-          info->timestamp = d_acq_info.timestamp - static_cast<uint64_t>(delta);
+      }
+
+      const auto nitems = static_cast<size_t>(to - from);
+      if (nitems) {
+        copy_samples(from, nitems, values, errors);
+
+        info->timebase = first.acq_info.timebase;
+        info->user_delay = first.acq_info.user_delay;
+        info->actual_delay = first.acq_info.actual_delay;
+        info->status = first.acq_info.status;
+        info->timestamp = first.acq_info.timestamp;
+      }
+
+      if (!was_frozen) {
+        release_snapshot_locked();
+      }
+
+      return nitems;
+    }
+
+    void
+    post_mortem_sink_impl::set_backing_file(const std::string &path, bool resume)
+    {
+      boost::mutex::scoped_lock lock(d_mutex);
+      check_no_views_locked();
+
+      // The file holds native floats, see post_mortem_file_header_t
+      if (!path.empty() && (d_half_values || d_half_errors)) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": samples stored in half "
+                << "precision can't be backed by a file";
+        throw std::runtime_error(message.str());
+      }
+
+      // Content is discarded
+      unmap_file_header();
+      discard_content_locked();
+
+      if (path.empty()) {
+        allocate_rings();
+        return;
+      }
+
+      // Buffers are aligned to huge pages
+      const size_t alignment = 2 * 1024 * 1024;
+      const auto capacity = mirrored_ring_buffer_t<float>::get_capacity(2 * d_buffer_size, alignment);
+      const auto ring_bytes = capacity * sizeof(float);
+      const auto values_offset = alignment;
+      const auto errors_offset = values_offset + ring_bytes;
+
+      int fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+      if (fd < 0) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": failed to open " << path
+                << ": " << strerror(errno);
+        throw std::runtime_error(message.str());
+      }
+
+      void *header = MAP_FAILED;
+      bool mapped = ftruncate(fd, static_cast<off_t>(errors_offset + ring_bytes)) == 0;
+      if (mapped) {
+        header = mmap(nullptr, sizeof(post_mortem_file_header_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        mapped = header != MAP_FAILED
+                && d_buffer_values.allocate_file(capacity, fd, static_cast<off_t>(values_offset))
+                && d_buffer_errors.allocate_file(capacity, fd, static_cast<off_t>(errors_offset));
+      }
+      auto error = errno;
+
+      // mappings keep the file open
+      close(fd);
+
+      if (!mapped) {
+        if (header != MAP_FAILED) {
+          munmap(header, sizeof(post_mortem_file_header_t));
         }
+        allocate_rings();
+
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": failed to map " << path
+                << ": " << strerror(error);
+        throw std::runtime_error(message.str());
       }
 
+      d_file_header = static_cast<post_mortem_file_header_t *>(header);
+      d_file_header_bytes = sizeof(post_mortem_file_header_t);
+
+      // The history of a previous run is restored if the rings are laid out the same
+      const post_mortem_file_header_t previous = *d_file_header;
+      resume = resume
+              && strncmp(previous.magic, "DIGIPMB", sizeof(previous.magic)) == 0
+              && previous.version == POST_MORTEM_FILE_VERSION
+              && previous.header_size == sizeof(post_mortem_file_header_t)
+              && previous.capacity == capacity
+              && previous.values_offset == values_offset
+              && previous.errors_offset == errors_offset
+              && previous.samp_rate == static_cast<double>(d_samp_rate)
+              && (previous.write_sequence & 1) == 0
+              && previous.write_history_start < previous.write_ring_count;
+
+      memset(d_file_header, 0, sizeof(post_mortem_file_header_t));
+      strncpy(d_file_header->magic, "DIGIPMB", sizeof(d_file_header->magic));
+      d_file_header->version = POST_MORTEM_FILE_VERSION;
+      d_file_header->header_size = sizeof(post_mortem_file_header_t);
+      d_file_header->capacity = capacity;
+      d_file_header->values_offset = values_offset;
+      d_file_header->errors_offset = errors_offset;
+      d_file_header->samp_rate = d_samp_rate;
+      d_file_header->timestamp = -1;
+      d_file_header->write_timestamp = -1;
+
+      if (resume) {
+        resume_locked(previous);
+      }
+    }
+
+    void
+    post_mortem_sink_impl::discard_content_locked()
+    {
+      d_state = state_t();
+      d_state.acq_info.timestamp = -1;
+      {
+        boost::mutex::scoped_lock index_lock(d_time_index_mutex);
+        d_time_index.clear();
+      }
+      d_history_restarted = false;
+      d_published_state.store(d_state);
+      d_write_reserved.store(0);
+      d_write_limit.store(std::numeric_limits<uint64_t>::max());
       d_frozen = false;
+      d_group_pending = false;
+      d_group_limit = std::numeric_limits<uint64_t>::max();
+      allocate_pyramid();
+    }
+
+    void
+    post_mortem_sink_impl::set_half_precision(bool values, bool errors)
+    {
+      boost::mutex::scoped_lock lock(d_mutex);
+      check_no_views_locked();
+
+      if (d_file_header) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": samples stored in half "
+                << "precision can't be backed by a file";
+        throw std::runtime_error(message.str());
+      }
+
+      // Content is discarded
+      d_half_values = values;
+      d_half_errors = errors;
+      discard_content_locked();
+      allocate_rings();
+    }
+
+    void
+    post_mortem_sink_impl::set_huge_pages(bool enabled)
+    {
+      boost::mutex::scoped_lock lock(d_mutex);
+      check_no_views_locked();
+
+      d_huge_pages = enabled;
+
+      // Applies once the buffer is back in memory
+      if (d_file_header) {
+        return;
+      }
+
+      // Content is discarded
+      discard_content_locked();
+      allocate_rings();
+    }
+
+    bool
+    post_mortem_sink_impl::is_huge_page_backed()
+    {
+      boost::mutex::scoped_lock lock(d_mutex);
+      const bool values = d_half_values ? d_buffer_half_values.is_huge_page_backed()
+              : d_buffer_values.is_huge_page_backed();
+      const bool errors = d_half_errors ? d_buffer_half_errors.is_huge_page_backed()
+              : d_buffer_errors.is_huge_page_backed();
+      return values && errors;
+    }
+
+    void
+    post_mortem_sink_impl::set_pyramid(double duration)
+    {
+      if (!(duration >= 0.0)) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid pyramid duration: " << duration;
+        throw std::invalid_argument(message.str());
+      }
+
+      boost::mutex::scoped_lock lock(d_mutex);
+      check_no_views_locked();
+
+      unfreeze_locked();
+      d_pyramid_duration = duration;
+      allocate_pyramid();
+      d_published_state.store(d_state);
+    }
+
+    void
+    post_mortem_sink_impl::set_freeze_group(const group_freeze_sptr &group)
+    {
+      boost::mutex::scoped_lock lock(d_mutex);
+
+      // Epochs are specific to a group
+      if (d_group) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": " << d_metadata.name
+                << " is a member of a post-mortem group already";
+        throw std::invalid_argument(message.str());
+      }
+
+      // Freezes requested before joining don't apply
+      d_group = group;
+      d_group_epoch = group->load().epoch;
+      d_group_pending = false;
+    }
+
+    uint64_t
+    post_mortem_sink_impl::get_group_epoch()
+    {
+      return d_published_state.load().group_epoch;
+    }
+
+    void
+    post_mortem_sink_impl::allocate_pyramid()
+    {
+      double decimation = 1.0;
+      for (int k = 0; k < POST_MORTEM_PYRAMID_LEVELS; k++) {
+        auto &level = d_levels[k];
+        decimation *= PYRAMID_DECIMATION;
+
+        level.size = static_cast<size_t>(std::ceil(d_pyramid_duration * d_samp_rate / decimation));
+        level.min.allocate(2 * level.size);
+        level.max.allocate(2 * level.size);
+        level.mean.allocate(2 * level.size);
+
+        level.write_reserved.store(0);
+        level.write_limit.store(std::numeric_limits<uint64_t>::max());
+        level.acc_min = std::numeric_limits<float>::infinity();
+        level.acc_max = -std::numeric_limits<float>::infinity();
+        level.acc_sum = 0.0;
+        level.acc_count = 0;
+        level.snapshot_nitems = 0;
+
+        d_state.level_ring_count[k] = 0;
+        d_state.level_history_start[k] = 0;
+        d_state.level_stream_count[k] = d_state.stream_count;
+      }
+
+      d_pyramid_enabled = d_pyramid_duration > 0.0;
+    }
+
+    size_t
+    post_mortem_sink_impl::get_pyramid_items(int level, size_t nr_items_to_read, float *min, float *max,
+            float *mean, measurement_info_t *info)
+    {
+      if (level < 1 || level > POST_MORTEM_PYRAMID_LEVELS) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid pyramid level: " << level;
+        throw std::invalid_argument(message.str());
+      }
+
+      boost::mutex::scoped_lock lock(d_mutex);
+
+      if (min == nullptr || max == nullptr || mean == nullptr || info == nullptr) {
+        return 0;
+      }
+
+      // Not frozen, take a snapshot of the current content
+      freeze_locked();
+
+      const auto &pyramid_level = d_levels[level - 1];
+      const uint64_t decimation = static_cast<uint64_t>(std::pow(PYRAMID_DECIMATION, level));
+
+      nr_items_to_read = static_cast<size_t>(std::min(static_cast<uint64_t>(nr_items_to_read),
+              pyramid_level.snapshot_nitems));
+
+      auto from = d_snapshot.level_ring_count[level - 1] - nr_items_to_read;
+      memcpy(min, pyramid_level.min.view(from), nr_items_to_read * sizeof(float));
+      memcpy(max, pyramid_level.max.view(from), nr_items_to_read * sizeof(float));
+      memcpy(mean, pyramid_level.mean.view(from), nr_items_to_read * sizeof(float));
+
+      const auto &acq_info = d_snapshot.acq_info;
+      info->timebase = acq_info.timebase * decimation;
+      info->user_delay = acq_info.user_delay;
+      info->actual_delay = acq_info.actual_delay;
+      info->status = acq_info.status;
+      info->timestamp = get_snapshot_timestamp(d_snapshot.level_stream_count[level - 1]
+              - nr_items_to_read * decimation);
 
       return nr_items_to_read;
     }
 
+    void
+    post_mortem_sink_impl::unmap_file_header()
+    {
+      if (d_file_header) {
+        munmap(d_file_header, d_file_header_bytes);
+        d_file_header = nullptr;
+        d_file_header_bytes = 0;
+      }
+    }
+
   } /* namespace digitizers */
 } /* namespace gr */
 
@@ -10,10 +10,57 @@
 #include <digitizers/post_mortem_sink.h>
 #include <digitizers/tags.h>
 #include <utils.h>
+#include "mirrored_ring_buffer.h"
+#include "seqlock.h"
+
+#include <boost/circular_buffer.hpp>
+#include <atomic>
+#include <limits>
+#include <vector>
+#include "block_stats_impl.h"
 
 namespace gr {
 	namespace digitizers {
 
+    class post_mortem_sink_impl;
+
+    /*!
+     * \brief Freeze request of a post-mortem group, see post_mortem_group.
+     */
+    struct group_freeze_t
+    {
+      uint64_t epoch;       // incremented by each freeze, zero if none requested
+      int64_t timestamp;    // of the last sample to freeze, nanoseconds UTC or -1 for any
+    };
+
+    typedef boost::shared_ptr<seqlock_t<group_freeze_t>> group_freeze_sptr;
+
+    class post_mortem_view_impl : public post_mortem_view
+    {
+     public:
+      post_mortem_view_impl(boost::shared_ptr<post_mortem_sink_impl> sink, const float *values,
+              const float *errors, size_t size, const measurement_info_t &info);
+
+      ~post_mortem_view_impl();
+
+      size_t size() const override { return d_size; }
+
+      const float *values() const override { return d_values; }
+
+      const float *errors() const override { return d_errors; }
+
+      measurement_info_t get_info() const override { return d_info; }
+
+      void release() override;
+
+     private:
+      boost::shared_ptr<post_mortem_sink_impl> d_sink;   // null once released
+      const float *d_values;
+      const float *d_errors;
+      size_t d_size;
+      measurement_info_t d_info;
+    };
+
     class post_mortem_sink_impl : public post_mortem_sink
     {
      private:
@@ -21,23 +68,159 @@ namespace gr {
 
       // Long term buffer used for the purpose of post-mortem and sequence
       // acquisition. Note we use two buffers for simplicity. Otherwise we
-      // would need to have some more advanced status tracking.
-      std::vector<float> d_buffer_values;
-      std::vector<float> d_buffer_errors;
+      // would need to have some more advanced status tracking. Both buffers
+      // have the same capacity, therefore the same absolute index is used
+      // to access values and errors.
+      //
+      // The capacity is (at least) twice the buffer size. When frozen, the
+      // snapshot is kept in one half while the acquisition continues into the
+      // other (spare) half, see d_write_limit.
+      mirrored_ring_buffer_t<float> d_buffer_values;
+      mirrored_ring_buffer_t<float> d_buffer_errors;
       size_t d_buffer_size;
-      size_t d_write_index;
 
-      // last acquisition info tag
-      acq_info_t d_acq_info;
-      uint64_t   d_acq_info_offset;
+      // Used instead of the above for the rings stored in half precision, the work function
+      // converts the samples in the scratch buffer first
+      bool d_half_values;
+      bool d_half_errors;
+      mirrored_ring_buffer_t<uint16_t> d_buffer_half_values;
+      mirrored_ring_buffer_t<uint16_t> d_buffer_half_errors;
+      std::vector<uint16_t> d_half_scratch;
+
+      // In-memory rings are backed by huge pages where possible
+      bool d_huge_pages;
+
+      /*!
+       * \brief State published by the work function after each call.
+       *
+       * Ring indices (absolute, see mirrored_ring_buffer_t) differ from the stream offsets
+       * in case the writer had to skip samples, i.e. the snapshot was not read out in time.
+       */
+      struct state_t
+      {
+        uint64_t ring_count;       // number of samples written to the ring
+        uint64_t stream_count;     // stream offset matching ring_count
+        uint64_t history_start;    // samples are contiguous from this ring index on
+        acq_info_t acq_info;       // last acquisition info tag
+        uint64_t acq_info_offset;
+
+        // Same for the pyramid levels, stream counts are in raw samples
+        uint64_t level_ring_count[POST_MORTEM_PYRAMID_LEVELS];
+        uint64_t level_stream_count[POST_MORTEM_PYRAMID_LEVELS];
+        uint64_t level_history_start[POST_MORTEM_PYRAMID_LEVELS];
+
+        // Last group freeze captured by the writer, the snapshot ends at the given indices
+        uint64_t group_epoch;
+        uint64_t group_ring_end;
+        uint64_t group_stream_end;
+        uint64_t group_nitems;
+        acq_info_t group_acq_info;
+        uint64_t group_acq_info_offset;
+      };
+
+      // Accessed by the work function only
+      state_t d_state;
+
+      // Writer to readers
+      seqlock_t<state_t> d_published_state;
+
+      // Ring index up to which the writer operates, see freeze_buffer
+      std::atomic<uint64_t> d_write_reserved;
+
+      // Ring index the writer is not allowed to reach, max if not frozen
+      std::atomic<uint64_t> d_write_limit;
+
+      // Snapshot of a frozen buffer, ring indices [d_snapshot_end - nitems, d_snapshot_end)
+      bool d_frozen;
+      state_t d_snapshot;
+      uint64_t d_snapshot_nitems;
+
+      /*!
+       * \brief Min/max/mean pyramid level, protected by its own write limit while frozen.
+       */
+      struct pyramid_level_t
+      {
+        pyramid_level_t()
+          : size(0),
+            write_reserved(0),
+            write_limit(std::numeric_limits<uint64_t>::max()),
+            acc_min(std::numeric_limits<float>::infinity()),
+            acc_max(-std::numeric_limits<float>::infinity()),
+            acc_sum(0.0),
+            acc_count(0),
+            snapshot_nitems(0)
+        {
+        }
+
+        mirrored_ring_buffer_t<float> min;
+        mirrored_ring_buffer_t<float> max;
+        mirrored_ring_buffer_t<float> mean;
+        size_t size;
+
+        std::atomic<uint64_t> write_reserved;
+        std::atomic<uint64_t> write_limit;
+
+        // Entry being accumulated and entries completed by the current work call
+        float acc_min;
+        float acc_max;
+        double acc_sum;
+        uint32_t acc_count;
+        std::vector<float> out_min;
+        std::vector<float> out_max;
+        std::vector<float> out_mean;
+
+        uint64_t snapshot_nitems;
+      };
+
+      /*!
+       * \brief Timestamp index entry, samples from ring_index on are evenly spaced (timebase)
+       * until the next entry. The timestamp refers to the sample at ring_index.
+       */
+      struct time_index_entry_t
+      {
+        uint64_t ring_index;
+        acq_info_t acq_info;
+      };
+
+      // One entry per acq_info tag plus one wherever the history restarts, ordered by ring
+      // index (and timestamp). Oldest entries are dropped once full. The index is shared with
+      // the readers, the work function takes the lock only when adding an entry.
+      boost::circular_buffer<time_index_entry_t> d_time_index;
+      boost::mutex d_time_index_mutex;
+      bool d_history_restarted;   // accessed by the work function only
+
+      bool d_pyramid_enabled;
+      double d_pyramid_duration;
+      pyramid_level_t d_levels[POST_MORTEM_PYRAMID_LEVELS];
 
       // metadata
       signal_metadata_t d_metadata;
 
-      // concurrency
+      // Serializes the clients, never taken by the work function
       boost::mutex d_mutex;
 
-      bool d_frozen;
+      // Number of views holding the buffer frozen
+      size_t d_views;
+
+      // Freeze requests of the group the sink is a member of, null if none
+      group_freeze_sptr d_group;
+
+      // Writer side of the group freeze, the captured snapshot is protected by d_group_limit
+      // until the readers take it over (d_group_released)
+      uint64_t d_group_epoch;
+      bool d_group_pending;
+      int64_t d_group_timestamp;
+      uint64_t d_group_limit;
+      std::atomic<uint64_t> d_group_released;
+
+      // Last group freeze taken over by the readers
+      uint64_t d_group_consumed;
+
+      // File backed buffers only, header mapping
+      post_mortem_file_header_t *d_file_header;
+      size_t d_file_header_bytes;
+
+      block_stats_recorder_t d_stats {this};
 
      public:
       
@@ -56,11 +239,125 @@ namespace gr {
 
       size_t get_items(size_t nr_items_to_read, float *values, float *errors, measurement_info_t *info) override;
 
+      size_t get_range(int64_t start_timestamp, int64_t end_timestamp, size_t nr_items_to_read,
+              float *values, float *errors, measurement_info_t *info) override;
+
+      post_mortem_view::sptr get_view(size_t nr_items_to_read) override;
+
+      // Called by the view
+      void release_view();
+
       float get_sample_rate() override;
 
+      void set_backing_file(const std::string &path, bool resume) override;
+
+      void set_pyramid(double duration) override;
+
+      size_t get_pyramid_items(int level, size_t nr_items_to_read, float *min, float *max,
+              float *mean, measurement_info_t *info) override;
+
+      void set_half_precision(bool values, bool errors) override;
+
+      void set_huge_pages(bool enabled) override;
+
+      bool is_huge_page_backed() override;
+
+      /*!
+       * \brief Makes the sink follow the freeze requests of a group, see post_mortem_group.
+       * Must be called before the flowgraph is started.
+       */
+      void set_freeze_group(const group_freeze_sptr &group);
+
+      /*!
+       * \brief Epoch of the last group freeze captured by the work function.
+       */
+      uint64_t get_group_epoch();
+
      private:
 
-      void decode_tags(int ninput_items);
+      // Allocates the rings in memory, in the precision configured, the content is discarded
+      void allocate_rings();
+
+      // Capacity common to the values and errors rings
+      uint64_t get_ring_capacity() const;
+
+      void push_samples(const float *values, const float *errors, int nitems);
+
+      // Copies the samples with the ring indices [from, from + nitems) out as floats
+      void copy_samples(uint64_t from, size_t nitems, float *values, float *errors);
+
+      // Discards the samples, the time index and the pyramid
+      void discard_content_locked();
+
+      // Ring index count refers to the first sample, written is false if the samples were
+      // skipped
+      void decode_tags(int ninput_items, uint64_t count, bool written);
+
+      // Captures a pending group freeze once the stream reached the requested timestamp
+      void capture_group_freeze();
+
+      void add_time_index_entry(uint64_t ring_index, const acq_info_t &acq_info);
+
+      // Ring index of the first sample with a timestamp past the given one (or at least as
+      // late as, if inclusive), based on the time index entry i. Requires the index lock.
+      uint64_t find_ring_index(size_t i, int64_t timestamp, bool inclusive) const;
+
+      void update_pyramid(const float *values, int nitems);
+
+      // Adds an entry to the level, completed entries propagate to the next level
+      void accumulate(int level, float min, float max, double mean);
+
+      // Allocates the pyramid for d_pyramid_duration, the content is discarded
+      void allocate_pyramid();
+
+      // Writer side of the freeze handshake, returns false if the items [count, end) would
+      // overwrite the snapshot
+      static bool reserve_write(std::atomic<uint64_t> &reserved, const std::atomic<uint64_t> &limit,
+              uint64_t count, uint64_t end);
+
+      // Freeze side, protects the last nitems items before count, returns the number of
+      // items still intact
+      static uint64_t protect_snapshot(std::atomic<uint64_t> &limit, const std::atomic<uint64_t> &reserved,
+              uint64_t count, uint64_t nitems, uint64_t capacity);
+
+      void freeze_locked();
+
+      void unfreeze_locked();
+
+      // Freezes the snapshot in the file header
+      void publish_file_snapshot(const state_t &state, uint64_t nitems);
+
+      // Updates the write fields of the file header, called by the work function
+      void publish_file_state();
+
+      // Restores the history described by the write fields of a previous run, frozen
+      void resume_locked(const post_mortem_file_header_t &previous);
+
+      // Wakes processes waiting on the frozen field of the file header
+      void wake_frozen_waiters();
+
+      // Unfreezes unless views are held, called once a read is complete
+      void release_snapshot_locked();
+
+      // Throws if the buffer is held by views
+      void check_no_views_locked() const;
+
+      // Fills in the info of the nitems snapshot samples preceding the snapshot end
+      void get_snapshot_info(uint64_t nitems, measurement_info_t *info) const;
+
+      /*!
+       * \brief Timestamp of the sample at the given stream offset, based on the snapshot.
+       */
+      int64_t get_snapshot_timestamp(uint64_t stream_offset) const;
+
+      /*!
+       * \brief Timestamp of the sample at the given offset, extrapolated from the acq_info tag
+       * at acq_info_offset.
+       */
+      static int64_t extrapolate_timestamp(const acq_info_t &acq_info, uint64_t acq_info_offset,
+              uint64_t offset);
+
+      void unmap_file_header();
 
     };
 
@@ -0,0 +1,53 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_PROBES_H
+#define INCLUDED_DIGITIZERS_PROBES_H
+
+/*
+ * Statically defined tracepoints (USDT) of the provider gr_digitizers. A probe compiles to a
+ * single nop plus an ELF note, tracers (bpftrace, perf, systemtap) patch it in while attached,
+ * e.g.:
+ *
+ *   bpftrace -e 'usdt:/usr/lib/libgnuradio-digitizers.so:gr_digitizers:chunk_lost { @[tid] = count(); }'
+ *   perf buildid-cache --add libgnuradio-digitizers.so && perf list sdt_gr_digitizers:*
+ *
+ * Probes are available if sys/sdt.h (systemtap-sdt-dev) is found at configure time, otherwise
+ * the macros expand to no code. Arguments are evaluated in the former case only, they must be
+ * cheap and free of side effects.
+ *
+ * Device side:
+ *   driver_poll_start()
+ *   driver_poll_end(error)                          error value of the poll, 0 on success
+ *   streaming_callback(nr_samples, start_index)     driver callback entry
+ *   app_buffer_push(chunk, nr_full_chunks)          chunk handed to the work thread
+ *   app_buffer_pop(chunk, nr_full_chunks)           chunk released by the work thread
+ *   chunk_lost(lost_count)                          no free chunk, lost since the last chunk
+ *
+ * Data path:
+ *   trigger_found(offset, timestamp)                trigger tag added by the digitizer
+ *   sink_callback_start(name), sink_callback_end(name)   delivery to the host application
+ *   post_mortem_freeze(name, nitems)                samples retained by a freeze
+ */
+
+#ifdef DIGITIZERS_HAVE_SDT
+
+#include <sys/sdt.h>
+
+#define DIGITIZERS_PROBE(name) DTRACE_PROBE(gr_digitizers, name)
+#define DIGITIZERS_PROBE1(name, a1) DTRACE_PROBE1(gr_digitizers, name, a1)
+#define DIGITIZERS_PROBE2(name, a1, a2) DTRACE_PROBE2(gr_digitizers, name, a1, a2)
+
+#else
+
+#define DIGITIZERS_PROBE(name) do {} while (0)
+// Arguments are referenced in unevaluated context only, i.e. no unused variable warnings
+#define DIGITIZERS_PROBE1(name, a1) do { (void)sizeof(a1); } while (0)
+#define DIGITIZERS_PROBE2(name, a1, a2) do { (void)sizeof(a1); (void)sizeof(a2); } while (0)
+
+#endif
+
+#endif /* INCLUDED_DIGITIZERS_PROBES_H */
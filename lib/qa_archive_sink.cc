@@ -0,0 +1,278 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#include <gnuradio/attributes.h>
+#include <cppunit/TestAssert.h>
+#include "qa_archive_sink.h"
+#include <digitizers/archive_sink.h>
+#include <digitizers/raw_codec.h>
+#include <digitizers/tags.h>
+#include <gnuradio/top_block.h>
+#include <gnuradio/blocks/vector_source_f.h>
+#include <gnuradio/blocks/vector_source_s.h>
+
+#include <unistd.h>
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+namespace gr {
+  namespace digitizers {
+
+    static std::string
+    make_archive_path()
+    {
+      char path[] = "/tmp/qa_archive_sink_XXXXXX";
+      int fd = mkstemp(path);
+      CPPUNIT_ASSERT(fd >= 0);
+      close(fd);
+      return path;
+    }
+
+    static std::vector<char>
+    read_file(const std::string &path)
+    {
+      std::ifstream file(path, std::ios::binary);
+      CPPUNIT_ASSERT(file);
+      return std::vector<char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+
+    // Returns the chunk headers, verifies the chunks are contiguous
+    static std::vector<archive_chunk_header_t>
+    read_headers(const std::vector<char> &data, std::vector<size_t> &positions)
+    {
+      std::vector<archive_chunk_header_t> headers;
+      size_t position = 0;
+
+      while (position < data.size()) {
+        archive_chunk_header_t header;
+        std::memcpy(&header, &data[position], sizeof(header));
+        CPPUNIT_ASSERT_EQUAL(ARCHIVE_CHUNK_MAGIC, header.magic);
+        CPPUNIT_ASSERT_EQUAL(ARCHIVE_VERSION, header.version);
+        CPPUNIT_ASSERT_EQUAL(uint32_t(sizeof(header)), header.header_size);
+        CPPUNIT_ASSERT_EQUAL(uint32_t(0), header.chunk_size % ARCHIVE_BLOCK_SIZE);
+
+        headers.push_back(header);
+        positions.push_back(position);
+        position += header.chunk_size;
+      }
+
+      CPPUNIT_ASSERT_EQUAL(data.size(), position);
+      return headers;
+    }
+
+    void
+    qa_archive_sink::chunks_and_index()
+    {
+      const int package_size = 50;
+      const int packages_per_chunk = 8;
+      const auto path = make_archive_path();
+
+      std::vector<float> values(1000), errors(1000);
+      for (size_t i = 0; i < values.size(); i++) {
+        values[i] = i;
+        errors[i] = i * 0.5f;
+      }
+
+      // Exactly representable timebase, timestamps of packages are multiples of 48828125 ns
+      acq_info_t acq_info {};
+      acq_info.timestamp = 1000000000;
+      acq_info.timebase = 1.0 / 1024.0;
+      acq_info.status = 0;
+
+      auto package_timestamp = [](int package) {
+        return int64_t(1000000000) + package * int64_t(48828125);
+      };
+
+      std::vector<gr::tag_t> tags {
+        make_acq_info_tag(acq_info, 0),
+        make_trigger_tag(1, 5000000000, 420, 4)
+      };
+
+      auto top = gr::make_top_block("archive_sink");
+      auto value_src = gr::blocks::vector_source_f::make(values, false, 1, tags);
+      auto error_src = gr::blocks::vector_source_f::make(errors);
+      auto sink = archive_sink::make(path, package_size, packages_per_chunk);
+
+      top->connect(value_src, 0, sink, 0);
+      top->connect(error_src, 0, sink, 1);
+      top->run();
+
+      // Last chunk is written partially filled on stop
+      CPPUNIT_ASSERT_EQUAL(uint64_t(3), sink->get_written_chunks());
+      CPPUNIT_ASSERT_EQUAL(uint64_t(0), sink->get_write_errors());
+
+      auto data = read_file(path);
+      std::vector<size_t> positions;
+      auto headers = read_headers(data, positions);
+      CPPUNIT_ASSERT_EQUAL(size_t(3), headers.size());
+
+      int package = 0;
+      for (size_t c = 0; c < headers.size(); c++) {
+        const auto &header = headers[c];
+        const char *chunk = &data[positions[c]];
+
+        CPPUNIT_ASSERT_EQUAL(uint16_t(ARCHIVE_CHUNK_HAS_ERRORS), header.flags);
+        CPPUNIT_ASSERT_EQUAL(uint32_t(package_size), header.package_size);
+        CPPUNIT_ASSERT_EQUAL(uint32_t(c < 2 ? 8 : 4), header.npackages);
+        CPPUNIT_ASSERT_EQUAL(uint64_t(package * package_size), header.offset);
+        CPPUNIT_ASSERT_EQUAL(uint64_t(0), header.packages_dropped);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(acq_info.timebase, header.timebase, 1e-12);
+
+        auto chunk_values = reinterpret_cast<const float *>(chunk + header.values_offset);
+        auto chunk_errors = reinterpret_cast<const float *>(chunk + header.errors_offset);
+        auto chunk_timestamps = reinterpret_cast<const int64_t *>(chunk + header.timestamps_offset);
+        auto chunk_status = reinterpret_cast<const uint32_t *>(chunk + header.status_offset);
+
+        for (uint32_t p = 0; p < header.npackages; p++, package++) {
+          CPPUNIT_ASSERT_EQUAL(package_timestamp(package), chunk_timestamps[p]);
+          CPPUNIT_ASSERT_EQUAL(uint32_t(package == 8 ? 4 : 0), chunk_status[p]);
+
+          for (int i = 0; i < package_size; i++) {
+            const int input = package * package_size + i;
+            CPPUNIT_ASSERT_DOUBLES_EQUAL(values[input], chunk_values[p * package_size + i], 1e-6);
+            CPPUNIT_ASSERT_DOUBLES_EQUAL(errors[input], chunk_errors[p * package_size + i], 1e-6);
+          }
+        }
+      }
+      CPPUNIT_ASSERT_EQUAL(20, package);
+
+      // Time range lookup
+      auto all = archive_sink::find_chunks(path, 0, package_timestamp(19));
+      CPPUNIT_ASSERT_EQUAL(size_t(3), all.size());
+      for (size_t c = 0; c < all.size(); c++) {
+        CPPUNIT_ASSERT_EQUAL(uint64_t(positions[c]), all[c].file_offset);
+        CPPUNIT_ASSERT_EQUAL(headers[c].chunk_size, all[c].chunk_size);
+        CPPUNIT_ASSERT_EQUAL(headers[c].npackages, all[c].npackages);
+        CPPUNIT_ASSERT_EQUAL(headers[c].offset, all[c].offset);
+      }
+      CPPUNIT_ASSERT_EQUAL(package_timestamp(8), all[1].first_timestamp);
+      CPPUNIT_ASSERT_EQUAL(package_timestamp(15), all[1].last_timestamp);
+
+      auto within = archive_sink::find_chunks(path, package_timestamp(9), package_timestamp(10));
+      CPPUNIT_ASSERT_EQUAL(size_t(1), within.size());
+      CPPUNIT_ASSERT_EQUAL(uint64_t(positions[1]), within[0].file_offset);
+
+      auto spanning = archive_sink::find_chunks(path, package_timestamp(15), package_timestamp(16));
+      CPPUNIT_ASSERT_EQUAL(size_t(2), spanning.size());
+      CPPUNIT_ASSERT_EQUAL(uint64_t(positions[2]), spanning[1].file_offset);
+
+      auto after = archive_sink::find_chunks(path, package_timestamp(19) + 1, package_timestamp(30));
+      CPPUNIT_ASSERT(after.empty());
+
+      std::remove(path.c_str());
+      std::remove((path + ".idx").c_str());
+    }
+
+    void
+    qa_archive_sink::without_errors()
+    {
+      const int package_size = 100;
+      const auto path = make_archive_path();
+
+      std::vector<float> values(300);
+      for (size_t i = 0; i < values.size(); i++) {
+        values[i] = i;
+      }
+
+      auto top = gr::make_top_block("archive_sink");
+      auto value_src = gr::blocks::vector_source_f::make(values);
+      auto sink = archive_sink::make(path, package_size, 2);
+      top->connect(value_src, 0, sink, 0);
+      top->run();
+
+      CPPUNIT_ASSERT_EQUAL(uint64_t(2), sink->get_written_chunks());
+      CPPUNIT_ASSERT_EQUAL(uint64_t(0), sink->get_dropped_packages());
+
+      auto data = read_file(path);
+      std::vector<size_t> positions;
+      auto headers = read_headers(data, positions);
+      CPPUNIT_ASSERT_EQUAL(size_t(2), headers.size());
+
+      for (size_t c = 0; c < headers.size(); c++) {
+        const auto &header = headers[c];
+        CPPUNIT_ASSERT_EQUAL(uint16_t(0), header.flags);
+        CPPUNIT_ASSERT_EQUAL(uint32_t(0), header.errors_offset);
+        CPPUNIT_ASSERT_EQUAL(uint32_t(c == 0 ? 2 : 1), header.npackages);
+
+        auto chunk_values = reinterpret_cast<const float *>(&data[positions[c]] + header.values_offset);
+        auto chunk_timestamps = reinterpret_cast<const int64_t *>(&data[positions[c]] + header.timestamps_offset);
+        for (uint32_t p = 0; p < header.npackages; p++) {
+          CPPUNIT_ASSERT_EQUAL(int64_t(-1), chunk_timestamps[p]);
+        }
+        for (uint32_t i = 0; i < header.npackages * package_size; i++) {
+          CPPUNIT_ASSERT_DOUBLES_EQUAL(values[header.offset + i], chunk_values[i], 1e-6);
+        }
+      }
+
+      // No timestamps, nothing to look up
+      CPPUNIT_ASSERT(archive_sink::find_chunks(path, 0, INT64_MAX).empty());
+
+      std::remove(path.c_str());
+      std::remove((path + ".idx").c_str());
+    }
+
+    void
+    qa_archive_sink::raw_input()
+    {
+      const int package_size = 100;
+      const auto path = make_archive_path();
+
+      std::vector<short> raw(1000);
+      for (size_t i = 0; i < raw.size(); i++) {
+        raw[i] = static_cast<short>(3000.0 * std::sin(i * 0.05) + i % 5);
+      }
+
+      raw_scaling_t scaling {0.001, 0.5, 0.002};
+      std::vector<gr::tag_t> tags {
+        make_raw_scaling_tag(scaling, 0)
+      };
+
+      auto top = gr::make_top_block("archive_sink");
+      auto raw_src = gr::blocks::vector_source_s::make(raw, false, 1, tags);
+      auto sink = archive_sink::make(path, package_size, 4, 4, false, true);
+      top->connect(raw_src, 0, sink, 0);
+      top->run();
+
+      CPPUNIT_ASSERT_EQUAL(uint64_t(3), sink->get_written_chunks());
+
+      auto data = read_file(path);
+      std::vector<size_t> positions;
+      auto headers = read_headers(data, positions);
+      CPPUNIT_ASSERT_EQUAL(size_t(3), headers.size());
+
+      for (size_t c = 0; c < headers.size(); c++) {
+        const auto &header = headers[c];
+        const auto nsamples = header.npackages * package_size;
+
+        CPPUNIT_ASSERT_EQUAL(uint16_t(ARCHIVE_CHUNK_RAW_COMPRESSED), header.flags);
+        CPPUNIT_ASSERT_EQUAL(uint32_t(0), header.errors_offset);
+        CPPUNIT_ASSERT(header.values_size < nsamples * sizeof(int16_t));
+        CPPUNIT_ASSERT(header.timestamps_offset >= header.values_offset + header.values_size);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(scaling.scale, header.scaling.scale, 1e-12);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(scaling.offset, header.scaling.offset, 1e-12);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(scaling.error, header.scaling.error, 1e-12);
+
+        std::vector<int16_t> decoded(nsamples);
+        auto values = reinterpret_cast<const uint8_t *>(&data[positions[c]] + header.values_offset);
+        CPPUNIT_ASSERT_EQUAL(size_t(header.values_size),
+                raw_decode(values, header.values_size, decoded.data(), decoded.size()));
+
+        for (uint32_t i = 0; i < nsamples; i++) {
+          CPPUNIT_ASSERT_EQUAL(int16_t(raw[header.offset + i]), decoded[i]);
+        }
+      }
+
+      std::remove(path.c_str());
+      std::remove((path + ".idx").c_str());
+    }
+
+  } /* namespace digitizers */
+} /* namespace gr */
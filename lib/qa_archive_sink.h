@@ -0,0 +1,35 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+
+#ifndef _QA_ARCHIVE_SINK_H_
+#define _QA_ARCHIVE_SINK_H_
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/TestCase.h>
+
+namespace gr {
+  namespace digitizers {
+
+    class qa_archive_sink : public CppUnit::TestCase
+    {
+    public:
+      CPPUNIT_TEST_SUITE(qa_archive_sink);
+      CPPUNIT_TEST(chunks_and_index);
+      CPPUNIT_TEST(without_errors);
+      CPPUNIT_TEST(raw_input);
+      CPPUNIT_TEST_SUITE_END();
+
+    private:
+      void chunks_and_index();
+      void without_errors();
+      void raw_input();
+    };
+
+  } /* namespace digitizers */
+} /* namespace gr */
+
+#endif /* _QA_ARCHIVE_SINK_H_ */
@@ -18,8 +18,15 @@
 #include <digitizers/block_aggregation.h>
 #include "digitizers/status.h"
 #include "qa_common.h"
+#include "block_aggregation_impl.h"
+#include "block_custom_filter_impl.h"
+#include "fused_aggregation_impl.h"
+#include "cic_aggregation_impl.h"
+#include "hot_swap.h"
 #include <utils.h>
 
+#include <cmath>
+
 namespace gr {
   namespace digitizers {
 
@@ -45,7 +52,8 @@ namespace gr {
                                   const std::vector<double> &fw_user_taps,
                                   double samp_rate,
                                   const std::vector<tag_t> &tags,
-                                  size_t data_size=33333)
+                                  size_t data_size=33333,
+                                  bool fused=true)
     {
       values = make_test_data(data_size);
       errors = make_test_data(data_size, 0.2);
@@ -53,7 +61,14 @@ namespace gr {
       top = gr::make_top_block("test");
       value_src = gr::blocks::vector_source_f::make(values, false, 1, tags);
       error_src = gr::blocks::vector_source_f::make(errors);
-      aggreagtion_block = gr::digitizers::block_aggregation::make(alg_id, decim, delay, fir_taps, low_freq, up_freq, tr_width, fb_user_taps, fw_user_taps, samp_rate);
+      if (fused) {
+        aggreagtion_block = gr::digitizers::block_aggregation::make(alg_id, decim, delay, fir_taps, low_freq, up_freq, tr_width, fb_user_taps, fw_user_taps, samp_rate);
+      }
+      else {
+        // reference implementation, graph of filter blocks
+        aggreagtion_block = gnuradio::get_initial_sptr(new block_aggregation_impl(algorithm_id_t(alg_id),
+                decim, delay, fir_taps, low_freq, up_freq, tr_width, fb_user_taps, fw_user_taps, samp_rate, false));
+      }
       value_sink = gr::blocks::vector_sink_f::make();
       error_sink = gr::blocks::vector_sink_f::make();
 
@@ -112,6 +127,272 @@ namespace gr {
     CPPUNIT_ASSERT(out_tags[1].offset <= 51 && out_tags[1].offset >= 49 );
   }
 
+  void
+  qa_block_aggregation::decimated_sigma()
+  {
+    // symmetric taps, i.e. convolution and correlation are the same
+    std::vector<float> taps({0.1, 0.2, 0.4, 0.2, 0.1});
+    std::vector<double> taps_d;
+    const int decim = 4;
+    const double low_freq = 0.0, up_freq = 100.0, samp_rate = 1000.0;
+
+    std::vector<gr::tag_t> tags;
+    aggregation_test_flowgraph_t flowgraph(FIR_CUSTOM, decim, 0, taps, low_freq, up_freq, 1.0,
+            taps_d, taps_d, samp_rate, tags, 1000);
+    flowgraph.run();
+
+    auto filter = [&taps](const std::vector<float> &x) {
+      std::vector<float> y(x.size(), 0.0);
+      for (size_t n = 0; n < x.size(); n++) {
+        for (size_t k = 0; k < taps.size() && k <= n; k++) {
+          y[n] += taps[k] * x[n - k];
+        }
+      }
+      return y;
+    };
+
+    auto f0 = filter(flowgraph.values);
+    auto f0_squared = f0;
+    for (auto &v : f0_squared) {
+      v *= v;
+    }
+    auto f1 = filter(f0_squared);
+    auto f2 = filter(f0);
+    auto f3 = filter(flowgraph.errors);
+    const float sigma_mult = (up_freq - low_freq) / samp_rate;
+
+    auto values = flowgraph.value_sink->data();
+    auto sigmas = flowgraph.error_sink->data();
+    CPPUNIT_ASSERT_EQUAL(flowgraph.values.size() / decim, values.size());
+    CPPUNIT_ASSERT_EQUAL(values.size(), sigmas.size());
+
+    // the same output instants on both outputs
+    for (size_t i = 0; i < sigmas.size(); i++) {
+      const size_t n = i * decim;
+      const float expected = std::sqrt(std::fabs(f1[n] - f2[n] * f2[n]) + sigma_mult * f3[n] * f3[n]);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(f0[n], values[i], 1e-4);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(expected, sigmas[i], 1e-4);
+    }
+  }
+
+  void
+  qa_block_aggregation::fused_matches_reference()
+  {
+    std::vector<float> taps;
+    std::vector<double> taps_d;
+    std::vector<tag_t> tags = { make_trigger_tag(10), make_trigger_tag(333), make_acq_info_tag(acq_info_t(), 500) };
+
+    for (auto alg_id : {FIR_LP, FIR_BP}) {
+      aggregation_test_flowgraph_t fused(alg_id, 10, 3, taps, 20, 200, 40, taps_d, taps_d, 1000, tags, 5000, true);
+      aggregation_test_flowgraph_t reference(alg_id, 10, 3, taps, 20, 200, 40, taps_d, taps_d, 1000, tags, 5000, false);
+      fused.run();
+      reference.run();
+
+      auto values = fused.value_sink->data();
+      auto expected_values = reference.value_sink->data();
+      auto sigmas = fused.error_sink->data();
+      auto expected_sigmas = reference.error_sink->data();
+
+      CPPUNIT_ASSERT_EQUAL(expected_values.size(), values.size());
+      CPPUNIT_ASSERT_EQUAL(expected_sigmas.size(), sigmas.size());
+      for (size_t i = 0; i < values.size(); i++) {
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(expected_values[i], values[i], 1e-4);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(expected_sigmas[i], sigmas[i], 1e-4);
+      }
+
+      auto fused_tags = fused.tags();
+      auto expected_tags = reference.tags();
+      CPPUNIT_ASSERT_EQUAL(expected_tags.size(), fused_tags.size());
+      for (size_t i = 0; i < fused_tags.size(); i++) {
+        CPPUNIT_ASSERT_EQUAL(expected_tags[i].offset, fused_tags[i].offset);
+        CPPUNIT_ASSERT(pmt::eqv(expected_tags[i].key, fused_tags[i].key));
+      }
+    }
+  }
+
+  void
+  qa_block_aggregation::fir_auto_engine()
+  {
+    fir_cost_model_t model {0.06, 0.12, 1.5};
+    CPPUNIT_ASSERT_EQUAL(FIR_ENGINE_DIRECT, model.select(8, 1));
+    CPPUNIT_ASSERT_EQUAL(FIR_ENGINE_FFT, model.select(1024, 1));
+    // the FFT engine filters all the samples, i.e. decimation favours the direct form
+    CPPUNIT_ASSERT_EQUAL(FIR_ENGINE_DIRECT, model.select(1024, 64));
+
+    const auto &cost_model = fir_cost_model_t::instance();
+    std::vector<float> short_taps(8, 1.0 / 8), long_taps(1024, 1.0 / 1024);
+    std::vector<double> taps_d;
+
+    std::vector<float> data;
+    for (int i = 0; i < 5000; i++) {
+      data.push_back(std::sin(0.01 * i) + 0.5 * std::sin(0.3 * i));
+    }
+
+    auto top = gr::make_top_block("test");
+    auto source = gr::blocks::vector_source_f::make(data);
+    auto filter = block_custom_filter::make(FIR_AUTO, 1, short_taps, 0, 0, 0, taps_d, taps_d, 1000);
+    auto sink = gr::blocks::vector_sink_f::make();
+    top->connect(source, 0, filter, 0);
+    top->connect(filter, 0, sink, 0);
+
+    auto filter_auto = boost::dynamic_pointer_cast<block_custom_filter_fir_auto>(filter);
+    CPPUNIT_ASSERT(filter_auto);
+    CPPUNIT_ASSERT_EQUAL(cost_model.select(short_taps.size(), 1), filter_auto->get_engine());
+
+    // engine is picked again for the new design
+    filter->update_design(long_taps, 0, 0, 0, taps_d, taps_d, 1000);
+    CPPUNIT_ASSERT_EQUAL(cost_model.select(long_taps.size(), 1), filter_auto->get_engine());
+
+    top->run();
+
+    auto values = sink->data();
+    CPPUNIT_ASSERT_EQUAL(data.size(), values.size());
+    for (size_t n = 0; n < values.size(); n++) {
+      double expected = 0.0;
+      for (size_t k = 0; k < long_taps.size() && k <= n; k++) {
+        expected += long_taps[k] * data[n - k];
+      }
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(expected, values[n], 1e-4);
+    }
+  }
+
+  void
+  qa_block_aggregation::coefficient_hot_swap()
+  {
+    // only the latest value published is taken
+    hot_swap_t<int> swap;
+    swap.publish(std::unique_ptr<int>(new int(1)));
+    swap.publish(std::unique_ptr<int>(new int(2)));
+    auto value = swap.take();
+    CPPUNIT_ASSERT(value);
+    CPPUNIT_ASSERT_EQUAL(2, *value);
+    CPPUNIT_ASSERT(!swap.take());
+    swap.retire(std::move(value));
+    swap.publish(std::unique_ptr<int>(new int(3)));
+    CPPUNIT_ASSERT_EQUAL(3, *swap.take());
+
+    // taps set after construction replace the initial ones before the first sample
+    const std::vector<float> data(1000, 1.0f), errors(1000, 0.0f);
+    const std::vector<float> initial_taps {1.0f, 1.0f}, taps {0.25f, 0.25f, 0.25f};
+
+    auto top = gr::make_top_block("test");
+    auto value_src = gr::blocks::vector_source_f::make(data);
+    auto error_src = gr::blocks::vector_source_f::make(errors);
+    auto fused = fused_aggregation_ff::make(FIR_CUSTOM, 1, 0, initial_taps, 0.0, 100.0, 1.0, 1000.0);
+    auto value_sink = gr::blocks::vector_sink_f::make();
+    auto error_sink = gr::blocks::vector_sink_f::make();
+    top->connect(value_src, 0, fused, 0);
+    top->connect(error_src, 0, fused, 1);
+    top->connect(fused, 0, value_sink, 0);
+    top->connect(fused, 1, error_sink, 0);
+
+    fused->set_taps(0, taps, 0.0);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(taps.size() / 2000.0, fused->get_delay_approximation(), 1e-9);
+
+    top->run();
+
+    auto values = value_sink->data();
+    CPPUNIT_ASSERT_EQUAL(data.size(), values.size());
+    for (size_t n = taps.size() - 1; n < values.size(); n++) {
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(0.75, values[n], 1e-6);
+    }
+  }
+
+  void
+  qa_block_aggregation::cic_aggregation()
+  {
+    // compensation of a single sample boxcar is the identity
+    auto identity = cic_aggregation_ff::design_compensation(1);
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(cic_aggregation_ff::COMPENSATION_TAPS), identity.size());
+    for (size_t i = 0; i < identity.size(); i++) {
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(i == identity.size() / 2 ? 1.0 : 0.0, identity[i], 1e-4);
+    }
+
+    // passband within a quarter of the output rate is flat
+    const int decim = 100;
+    auto compensation = cic_aggregation_ff::design_compensation(decim);
+    for (double f : {0.0, 0.05, 0.1, 0.15, 0.2, 0.25}) {
+      double gain = 0.0;
+      for (size_t k = 0; k < compensation.size(); k++) {
+        gain += compensation[k] * std::cos(2.0 * M_PI * f * (static_cast<double>(k) - compensation.size() / 2));
+      }
+      const double cic = f == 0.0 ? 1.0
+              : std::pow(std::sin(M_PI * f) / (decim * std::sin(M_PI * f / decim)), cic_aggregation_ff::CIC_STAGES);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(1.0, gain * cic, 1e-3);
+    }
+
+    // constant input, the spread is zero and the error is filtered with unit gain
+    const size_t size = 20000;
+    const float value = 2.0f, error = 0.5f;
+    const double samp_rate = 1000.0, low_freq = 0.0, up_freq = 100.0;
+
+    auto top = gr::make_top_block("test");
+    auto value_src = gr::blocks::vector_source_f::make(std::vector<float>(size, value));
+    auto error_src = gr::blocks::vector_source_f::make(std::vector<float>(size, error));
+    std::vector<float> taps;
+    std::vector<double> taps_d;
+    auto aggregation = block_aggregation::make(CIC, decim, 0, taps, low_freq, up_freq, 0, taps_d, taps_d, samp_rate);
+    auto value_sink = gr::blocks::vector_sink_f::make();
+    auto error_sink = gr::blocks::vector_sink_f::make();
+
+    top->connect(value_src, 0, aggregation, 0);
+    top->connect(error_src, 0, aggregation, 1);
+    top->connect(aggregation, 0, value_sink, 0);
+    top->connect(aggregation, 1, error_sink, 0);
+    top->run();
+
+    auto values = value_sink->data();
+    auto sigmas = error_sink->data();
+    CPPUNIT_ASSERT_EQUAL(size / decim, values.size());
+    CPPUNIT_ASSERT_EQUAL(size / decim, sigmas.size());
+
+    // skip the CIC response and the compensation FIR transients
+    const auto expected_sigma = std::sqrt((up_freq - low_freq) / samp_rate) * error;
+    for (size_t i = 10; i < values.size(); i++) {
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(value, values[i], 1e-3);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(expected_sigma, sigmas[i], 1e-3);
+    }
+  }
+
+  void
+  qa_block_aggregation::values_only()
+  {
+    std::vector<float> taps;
+    std::vector<double> taps_d;
+    std::vector<tag_t> tags = { make_trigger_tag(10), make_acq_info_tag(acq_info_t(), 500) };
+
+    for (auto alg_id : {FIR_LP, IIR_LP, AVERAGE, CIC}) {
+      for (bool fused : {true, false}) {
+        aggregation_test_flowgraph_t reference(alg_id, 10, 3, taps, 20, 200, 40, taps_d, taps_d, 1000, tags, 5000, fused);
+        reference.run();
+
+        auto top = gr::make_top_block("test");
+        auto value_src = gr::blocks::vector_source_f::make(reference.values, false, 1, tags);
+        auto aggregation = gnuradio::get_initial_sptr(new block_aggregation_impl(alg_id,
+                10, 3, taps, 20, 200, 40, taps_d, taps_d, 1000, fused, false));
+        auto value_sink = gr::blocks::vector_sink_f::make();
+
+        // a single port each
+        CPPUNIT_ASSERT_EQUAL(1, aggregation->input_signature()->max_streams());
+        CPPUNIT_ASSERT_EQUAL(1, aggregation->output_signature()->max_streams());
+
+        top->connect(value_src, 0, aggregation, 0);
+        top->connect(aggregation, 0, value_sink, 0);
+        top->run();
+
+        auto values = value_sink->data();
+        auto expected_values = reference.value_sink->data();
+        CPPUNIT_ASSERT_EQUAL(expected_values.size(), values.size());
+        for (size_t i = 0; i < values.size(); i++) {
+          CPPUNIT_ASSERT_DOUBLES_EQUAL(expected_values[i], values[i], 1e-5);
+        }
+
+        auto expected_tags = reference.tags();
+        CPPUNIT_ASSERT_EQUAL(expected_tags.size(), value_sink->tags().size());
+      }
+    }
+  }
+
   } /* namespace digitizers */
 } /* namespace gr */
 
@@ -20,11 +20,23 @@ namespace gr {
       CPPUNIT_TEST_SUITE(qa_block_aggregation);
       CPPUNIT_TEST(basic_connection);
       CPPUNIT_TEST(test_tags);
+      CPPUNIT_TEST(decimated_sigma);
+      CPPUNIT_TEST(fused_matches_reference);
+      CPPUNIT_TEST(fir_auto_engine);
+      CPPUNIT_TEST(coefficient_hot_swap);
+      CPPUNIT_TEST(cic_aggregation);
+      CPPUNIT_TEST(values_only);
       CPPUNIT_TEST_SUITE_END();
 
     private:
       void basic_connection();
       void test_tags();
+      void decimated_sigma();
+      void fused_matches_reference();
+      void fir_auto_engine();
+      void coefficient_hot_swap();
+      void cic_aggregation();
+      void values_only();
     };
 
   } /* namespace digitizers */
@@ -13,6 +13,13 @@
 #include <digitizers/block_complex_to_mag_deg.h>
 #include <gnuradio/blocks/vector_source_f.h>
 #include <gnuradio/blocks/vector_sink_f.h>
+#include <gnuradio/blocks/vector_sink_c.h>
+#include <gnuradio/filter/firdes.h>
+#include <gnuradio/filter/hilbert_fc.h>
+#include <gnuradio/filter/fir_filter_ccf.h>
+#include <gnuradio/blocks/keep_m_in_n.h>
+#include <digitizers/amplitude_and_phase_helper.h>
+#include "fused_amplitude_and_phase_impl.h"
 
 #include <math.h>
 
@@ -60,6 +67,215 @@ namespace gr {
       }
     }
 
+    void
+    qa_block_amplitude_and_phase::fused_matches_circuit()
+    {
+      // the original circuit: hilbert transforms, helper and the decimating low pass
+      int samp_rate = 200000;
+      int decim = 5;
+      int hilbert_window = 64;
+      auto taps = filter::firdes::low_pass(1.0, samp_rate, 1024, 50);
+
+      std::vector<float> sig;
+      std::vector<float> ref;
+      for(int i = 0; i < 100000; i++) {
+        sig.push_back(0.7 * sin(6000.0 * 2.0 * M_PI * i / samp_rate + 0.3) + 0.01 * sin(0.37 * i));
+        ref.push_back(cos(6000.0 * 2.0 * M_PI * i / samp_rate));
+      }
+
+      auto top = gr::make_top_block("fused_matches_circuit");
+      auto src = blocks::vector_source_f::make(sig);
+      auto src_ref = blocks::vector_source_f::make(ref);
+
+      auto hil_sig = filter::hilbert_fc::make(hilbert_window);
+      auto hil_ref = filter::hilbert_fc::make(hilbert_window);
+      auto help = amplitude_and_phase_helper::make();
+      auto low_pass = filter::fir_filter_ccf::make(decim, taps);
+      auto snk_circuit = blocks::vector_sink_c::make(1);
+
+      auto fused = fused_amplitude_and_phase_fc::make(decim, hilbert_window, taps);
+      auto snk_fused = blocks::vector_sink_c::make(1);
+
+      top->connect(src, 0, hil_sig, 0);
+      top->connect(src_ref, 0, hil_ref, 0);
+      top->connect(hil_sig, 0, help, 0);
+      top->connect(hil_ref, 0, help, 1);
+      top->connect(help, 0, low_pass, 0);
+      top->connect(low_pass, 0, snk_circuit, 0);
+
+      top->connect(src, 0, fused, 0);
+      top->connect(src_ref, 0, fused, 1);
+      top->connect(fused, 0, snk_fused, 0);
+
+      top->run();
+
+      auto expected = snk_circuit->data();
+      auto actual = snk_fused->data();
+      CPPUNIT_ASSERT_EQUAL(expected.size(), actual.size());
+      CPPUNIT_ASSERT(actual.size() != 0);
+      for (size_t i = 0; i < actual.size(); i++) {
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(expected[i].real(), actual[i].real(), 1e-4);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(expected[i].imag(), actual[i].imag(), 1e-4);
+      }
+    }
+
+    void
+    qa_block_amplitude_and_phase::decimated_products()
+    {
+      // products at the output instants only, i.e. the same as keeping every decim-th
+      // product and filtering at the output rate
+      int samp_rate = 200000;
+      int decim = 10;
+      int hilbert_window = 64;
+      auto taps = filter::firdes::low_pass(1.0, samp_rate / decim, 1024, 50);
+
+      std::vector<float> sig;
+      std::vector<float> ref;
+      for(int i = 0; i < 100000; i++) {
+        sig.push_back(0.7 * sin(6000.0 * 2.0 * M_PI * i / samp_rate + 0.3));
+        ref.push_back(cos(6000.0 * 2.0 * M_PI * i / samp_rate));
+      }
+
+      // tag on the output-aligned sample 5 * decim
+      gr::tag_t tag;
+      tag.offset = 5 * decim;
+      tag.key = pmt::intern("marker");
+      tag.value = pmt::PMT_T;
+
+      auto top = gr::make_top_block("decimated_products");
+      auto src = blocks::vector_source_f::make(sig, false, 1, std::vector<gr::tag_t>({tag}));
+      auto src_ref = blocks::vector_source_f::make(ref);
+
+      auto hil_sig = filter::hilbert_fc::make(hilbert_window);
+      auto hil_ref = filter::hilbert_fc::make(hilbert_window);
+      auto help = amplitude_and_phase_helper::make();
+      auto keep = blocks::keep_m_in_n::make(sizeof(gr_complex), 1, decim, 0);
+      auto low_pass = filter::fir_filter_ccf::make(1, taps);
+      auto snk_circuit = blocks::vector_sink_c::make(1);
+
+      auto fused = fused_amplitude_and_phase_fc::make(decim, hilbert_window, taps, true);
+      auto snk_fused = blocks::vector_sink_c::make(1);
+
+      top->connect(src, 0, hil_sig, 0);
+      top->connect(src_ref, 0, hil_ref, 0);
+      top->connect(hil_sig, 0, help, 0);
+      top->connect(hil_ref, 0, help, 1);
+      top->connect(help, 0, keep, 0);
+      top->connect(keep, 0, low_pass, 0);
+      top->connect(low_pass, 0, snk_circuit, 0);
+
+      top->connect(src, 0, fused, 0);
+      top->connect(src_ref, 0, fused, 1);
+      top->connect(fused, 0, snk_fused, 0);
+
+      top->run();
+
+      auto expected = snk_circuit->data();
+      auto actual = snk_fused->data();
+      CPPUNIT_ASSERT_EQUAL(expected.size(), actual.size());
+      CPPUNIT_ASSERT(actual.size() != 0);
+      for (size_t i = 0; i < actual.size(); i++) {
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(expected[i].real(), actual[i].real(), 1e-4);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(expected[i].imag(), actual[i].imag(), 1e-4);
+      }
+
+      auto tags = snk_fused->tags();
+      CPPUNIT_ASSERT_EQUAL(size_t(1), tags.size());
+      CPPUNIT_ASSERT_EQUAL(uint64_t(5), tags[0].offset);
+    }
+
+    void
+    qa_block_amplitude_and_phase::nco_reference()
+    {
+      // the NCO equals a reference input cos(2 pi f n / samp_rate), up to the ripple of the
+      // Hilbert filter of the reference (no longer needed)
+      int samp_rate = 200000;
+      double freq = 6000.0;
+      int decim = 5;
+      int hilbert_window = 1024;
+      int freq_decim = 100;
+      auto taps = filter::firdes::low_pass(1.0, samp_rate, 1024, 50);
+
+      std::vector<float> sig;
+      std::vector<float> ref;
+      std::vector<float> measured;
+      for(int i = 0; i < 200000; i++) {
+        sig.push_back(0.7 * sin(freq * 2.0 * M_PI * i / samp_rate + 0.3));
+        ref.push_back(cos(freq * 2.0 * M_PI * i / samp_rate));
+      }
+      // e.g. freq_estimator, nothing measured at first
+      for(int i = 0; i < 200000 / freq_decim; i++) {
+        measured.push_back(i < 10 ? 0.0f : freq);
+      }
+
+      auto top = gr::make_top_block("nco_reference");
+      auto src = blocks::vector_source_f::make(sig);
+      auto src_ref = blocks::vector_source_f::make(ref);
+      auto src_freq = blocks::vector_source_f::make(measured);
+
+      auto fused_input = fused_amplitude_and_phase_fc::make(decim, hilbert_window, taps);
+      auto fused_nco = fused_amplitude_and_phase_fc::make(decim, hilbert_window, taps, false,
+              REFERENCE_NCO, freq, samp_rate);
+      auto blk_nco = block_amplitude_and_phase::make(samp_rate, 0, decim, 1.0, 1024, 50, hilbert_window, true,
+              REFERENCE_NCO, freq);
+      auto blk_locked = block_amplitude_and_phase::make(samp_rate, 0, decim, 1.0, 1024, 50, hilbert_window, false,
+              REFERENCE_NCO_LOCKED, 5000.0, freq_decim);
+      auto snk_input = blocks::vector_sink_c::make(1);
+      auto snk_nco = blocks::vector_sink_c::make(1);
+      auto c2md = block_complex_to_mag_deg::make(1);
+      auto c2md_locked = block_complex_to_mag_deg::make(1);
+      auto snk_ampl = blocks::vector_sink_f::make(1);
+      auto snk_phase = blocks::vector_sink_f::make(1);
+      auto snk_locked_ampl = blocks::vector_sink_f::make(1);
+      auto snk_locked_phase = blocks::vector_sink_f::make(1);
+
+      top->connect(src, 0, fused_input, 0);
+      top->connect(src_ref, 0, fused_input, 1);
+      top->connect(fused_input, 0, snk_input, 0);
+      top->connect(src, 0, fused_nco, 0);
+      top->connect(fused_nco, 0, snk_nco, 0);
+
+      top->connect(src, 0, blk_nco, 0);
+      top->connect(src, 0, blk_locked, 0);
+      top->connect(src_freq, 0, blk_locked, 1);
+      top->connect(blk_nco, 0, c2md, 0);
+      top->connect(blk_locked, 0, c2md_locked, 0);
+      top->connect(c2md, 0, snk_ampl, 0);
+      top->connect(c2md, 1, snk_phase, 0);
+      top->connect(c2md_locked, 0, snk_locked_ampl, 0);
+      top->connect(c2md_locked, 1, snk_locked_phase, 0);
+
+      top->run();
+
+      auto expected = snk_input->data();
+      auto actual = snk_nco->data();
+      CPPUNIT_ASSERT_EQUAL(expected.size(), actual.size());
+      CPPUNIT_ASSERT(actual.size() > 2000);
+      for (size_t i = 2000; i < actual.size(); i++) {
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(expected[i].real(), actual[i].real(), 5e-3);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(expected[i].imag(), actual[i].imag(), 5e-3);
+      }
+
+      // 0.7 / 2 at 0.3 rad - 90 degree, with decimated products and locked to the measurement
+      auto ampl = snk_ampl->data();
+      auto phase = snk_phase->data();
+      auto locked_ampl = snk_locked_ampl->data();
+      auto locked_phase = snk_locked_phase->data();
+      CPPUNIT_ASSERT(ampl.size() > 2000);
+      CPPUNIT_ASSERT_EQUAL(ampl.size(), locked_ampl.size());
+      const double expected_phase = 0.3 * 180.0 / M_PI - 90.0;
+      for (size_t i = 2000; i < ampl.size(); i++) {
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(0.35, ampl[i], 0.01);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(expected_phase, phase[i], 0.1);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(0.35, locked_ampl[i], 0.01);
+      }
+
+      // the locked NCO ran at 5 kHz for a while, the phase offset is constant once locked
+      for (size_t i = 2001; i < locked_phase.size(); i++) {
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(locked_phase[i - 1], locked_phase[i], 0.05);
+      }
+    }
+
   } /* namespace digitizers */
 } /* namespace gr */
 
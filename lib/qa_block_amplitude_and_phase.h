@@ -19,10 +19,16 @@ namespace gr {
     public:
       CPPUNIT_TEST_SUITE(qa_block_amplitude_and_phase);
       CPPUNIT_TEST(find_ampl_phase);
+      CPPUNIT_TEST(fused_matches_circuit);
+      CPPUNIT_TEST(decimated_products);
+      CPPUNIT_TEST(nco_reference);
       CPPUNIT_TEST_SUITE_END();
 
     private:
       void find_ampl_phase();
+      void fused_matches_circuit();
+      void decimated_products();
+      void nco_reference();
     };
 
   } /* namespace digitizers */
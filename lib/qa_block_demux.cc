@@ -12,6 +12,7 @@
 #include <digitizers/block_demux.h>
 #include <gnuradio/blocks/vector_source_b.h>
 #include <gnuradio/blocks/vector_sink_f.h>
+#include <gnuradio/blocks/vector_sink_b.h>
 
 namespace gr {
   namespace digitizers {
@@ -41,6 +42,47 @@ namespace gr {
       }
     }
 
+    void
+    qa_block_demux::multiple_bits()
+    {
+      // more samples than a chunk, all byte values
+      std::vector<unsigned char> vals;
+      for (int i = 0; i < 10000; i++) {
+        vals.push_back(static_cast<unsigned char>(i * 7));
+      }
+      std::vector<int> bits({0, 3, 7});
+
+      auto top = gr::make_top_block("multiple_bits");
+      auto src = gr::blocks::vector_source_b::make(vals);
+      auto demux = digitizers::block_demux::make(0, 0x89);
+      auto demux_b = digitizers::block_demux::make(0, 0x89, true);
+      top->connect(src, 0, demux, 0);
+      top->connect(src, 0, demux_b, 0);
+
+      std::vector<gr::blocks::vector_sink_f::sptr> sinks;
+      std::vector<gr::blocks::vector_sink_b::sptr> sinks_b;
+      for (size_t b = 0; b < bits.size(); b++) {
+        sinks.push_back(gr::blocks::vector_sink_f::make(1));
+        sinks_b.push_back(gr::blocks::vector_sink_b::make(1));
+        top->connect(demux, b, sinks.back(), 0);
+        top->connect(demux_b, b, sinks_b.back(), 0);
+      }
+
+      top->run();
+
+      for (size_t b = 0; b < bits.size(); b++) {
+        auto data = sinks[b]->data();
+        auto data_b = sinks_b[b]->data();
+        CPPUNIT_ASSERT_EQUAL(vals.size(), data.size());
+        CPPUNIT_ASSERT_EQUAL(vals.size(), data_b.size());
+        for (size_t i = 0; i < vals.size(); i++) {
+          const int expected = (vals[i] >> bits[b]) & 1;
+          CPPUNIT_ASSERT_EQUAL(static_cast<float>(expected), data[i]);
+          CPPUNIT_ASSERT_EQUAL(expected, static_cast<int>(data_b[i]));
+        }
+      }
+    }
+
   } /* namespace digitizers */
 } /* namespace gr */
 
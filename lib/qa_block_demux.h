@@ -19,10 +19,12 @@ namespace gr {
     public:
       CPPUNIT_TEST_SUITE(qa_block_demux);
       //CPPUNIT_TEST(passes_only_desired); FIXME: Need to fix this block before usage
+      CPPUNIT_TEST(multiple_bits);
       CPPUNIT_TEST_SUITE_END();
 
     private:
       void passes_only_desired();
+      void multiple_bits();
     };
 
   } /* namespace digitizers */
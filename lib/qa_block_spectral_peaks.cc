@@ -12,10 +12,15 @@
 #include <cppunit/TestAssert.h>
 #include "qa_block_spectral_peaks.h"
 #include <digitizers/block_spectral_peaks.h>
+#include <digitizers/median_and_average.h>
+#include <digitizers/peak_detector.h>
 #include <gnuradio/blocks/vector_source_f.h>
 #include <gnuradio/blocks/vector_sink_f.h>
 #include "utils.h"
 
+#include <cmath>
+#include <random>
+
 namespace gr {
   namespace digitizers {
 
@@ -68,6 +73,93 @@ namespace gr {
 
     }
 
+    void
+    qa_block_spectral_peaks::fused_matches_graph()
+    {
+      const double samp_rate = 32000;
+      const int vec_len = 512;
+      const int n_med = 3;
+      const int n_avg = 4;
+      const int n_prox = 10;
+      const int n_peaks = 2;
+      const int nvectors = 5;
+
+      // two noisy peaks per vector, moving from vector to vector
+      std::mt19937 gen(7);
+      std::uniform_real_distribution<float> noise(0.0, 0.5);
+      std::vector<float> spectra;
+      for (int v = 0; v < nvectors; v++) {
+        for (int i = 0; i < vec_len; i++) {
+          const float first = 20.0 * std::exp(-std::pow((i - 100.0 - v) / 6.0, 2));
+          const float second = 8.0 * std::exp(-std::pow((i - 350.0 + 2 * v) / 4.0, 2));
+          spectra.push_back(1.0 + first + second + noise(gen));
+        }
+      }
+
+      std::vector<float> low_freq, up_freq;
+      for (int v = 0; v < nvectors; v++) {
+        low_freq.insert(low_freq.end(), {1000.0, 9000.0});
+        up_freq.insert(up_freq.end(), {5000.0, 13000.0});
+      }
+
+      auto top = gr::make_top_block("fused_matches_graph");
+
+      auto src = blocks::vector_source_f::make(spectra, false, vec_len);
+      auto flow = blocks::vector_source_f::make(low_freq, false, n_peaks);
+      auto fup = blocks::vector_source_f::make(up_freq, false, n_peaks);
+
+      // reference graph
+      auto med_avg = median_and_average::make(vec_len, n_med, n_avg);
+      auto detector = peak_detector::make(samp_rate, vec_len, n_prox, n_peaks);
+      auto ref_filtered = blocks::vector_sink_f::make(vec_len);
+      auto ref_max = blocks::vector_sink_f::make(n_peaks);
+      auto ref_stdev = blocks::vector_sink_f::make(n_peaks);
+
+      top->connect(src, 0, med_avg, 0);
+      top->connect(src, 0, detector, 0);
+      top->connect(med_avg, 0, detector, 1);
+      top->connect(flow, 0, detector, 2);
+      top->connect(fup, 0, detector, 3);
+      top->connect(med_avg, 0, ref_filtered, 0);
+      top->connect(detector, 0, ref_max, 0);
+      top->connect(detector, 1, ref_stdev, 0);
+
+      auto spec = block_spectral_peaks::make(samp_rate, vec_len, n_med, n_avg, n_prox, n_peaks);
+      auto filtered = blocks::vector_sink_f::make(vec_len);
+      auto max = blocks::vector_sink_f::make(n_peaks);
+      auto stdev = blocks::vector_sink_f::make(n_peaks);
+
+      top->connect(src, 0, spec, 0);
+      top->connect(flow, 0, spec, 1);
+      top->connect(fup, 0, spec, 2);
+      top->connect(spec, 0, filtered, 0);
+      top->connect(spec, 1, max, 0);
+      top->connect(spec, 2, stdev, 0);
+
+      top->run();
+
+      CPPUNIT_ASSERT_EQUAL(size_t(nvectors * n_peaks), max->data().size());
+      CPPUNIT_ASSERT_EQUAL(ref_max->data().size(), max->data().size());
+
+      for (size_t i = 0; i < max->data().size(); i++) {
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(ref_max->data()[i], max->data()[i], 1e-3);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(ref_stdev->data()[i], stdev->data()[i], 1e-3);
+      }
+
+      // smoothed within the searched bins, passed through elsewhere
+      const auto ref = ref_filtered->data();
+      const auto out = filtered->data();
+      CPPUNIT_ASSERT_EQUAL(spectra.size(), out.size());
+
+      for (int v = 0; v < nvectors; v++) {
+        for (int i = 0; i < vec_len; i++) {
+          const size_t k = v * vec_len + i;
+          const bool searched = (i >= 32 && i <= 160) || (i >= 288 && i <= 416);
+          CPPUNIT_ASSERT_DOUBLES_EQUAL(searched ? ref[k] : spectra[k], out[k], 1e-5);
+        }
+      }
+    }
+
   } /* namespace digitizers */
 } /* namespace gr */
 
@@ -19,10 +19,12 @@ namespace gr {
     public:
       CPPUNIT_TEST_SUITE(qa_block_spectral_peaks);
       CPPUNIT_TEST(test_spectral_peaks);
+      CPPUNIT_TEST(fused_matches_graph);
       CPPUNIT_TEST_SUITE_END();
 
     private:
       void test_spectral_peaks();
+      void fused_matches_graph();
     };
 
   } /* namespace digitizers */
@@ -0,0 +1,354 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#include <gnuradio/top_block.h>
+#include <gnuradio/attributes.h>
+#include <cppunit/TestAssert.h>
+#include "qa_block_stats.h"
+#include <digitizers/block_stats.h>
+#include <digitizers/block_scaling_offset.h>
+#include <digitizers/decimate_and_adjust_timebase.h>
+#include <digitizers/function_ff.h>
+#include <digitizers/interlock_generation_ff.h>
+#include <digitizers/signal_averager.h>
+#include <digitizers/thread_stats.h>
+#include <digitizers/trace.h>
+#include <digitizers/tags.h>
+#include <gnuradio/blocks/vector_source_f.h>
+#include <gnuradio/blocks/null_sink.h>
+#include <gnuradio/blocks/vector_sink_f.h>
+#include "telemetry_export.h"
+#include "thread_registry.h"
+#include "trace_registry.h"
+#include "utils.h"
+
+#include <boost/thread/thread.hpp>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+namespace gr {
+  namespace digitizers {
+
+    static bool
+    find_stats(const std::string &name, block_stats_t &stats)
+    {
+      for (const auto &s : get_block_stats()) {
+        if (s.name == name) {
+          stats = s;
+          return true;
+        }
+      }
+      return false;
+    }
+
+    static gr::top_block_sptr
+    make_flowgraph(int n, int64_t timestamp, const std::string &alias)
+    {
+      auto top = gr::make_top_block("block_stats");
+
+      acq_info_t acq_info{};
+      acq_info.timestamp = timestamp;
+      acq_info.timebase = 1e-6;
+      std::vector<gr::tag_t> tags = { make_acq_info_tag(acq_info, 0) };
+
+      std::vector<float> data(n, 1.0f);
+      auto src0 = blocks::vector_source_f::make(data, false, 1, tags);
+      auto src1 = blocks::vector_source_f::make(data);
+      auto bso = block_scaling_offset::make(1.0, 0.0);
+      bso->set_block_alias(alias);
+      auto snk0 = blocks::null_sink::make(sizeof(float));
+      auto snk1 = blocks::null_sink::make(sizeof(float));
+
+      top->connect(src0, 0, bso, 0);
+      top->connect(src1, 0, bso, 1);
+      top->connect(bso, 0, snk0, 0);
+      top->connect(bso, 1, snk1, 0);
+
+      return top;
+    }
+
+    void
+    qa_block_stats::counters_and_data_age()
+    {
+      int n = 10000;
+      auto now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+              std::chrono::system_clock::now().time_since_epoch()).count();
+      // Data acquired a second ago
+      auto top = make_flowgraph(n, now_ns - 1000000000, "stats_bso");
+
+      set_block_stats_enabled(true);
+      top->run();
+
+      block_stats_t stats;
+      CPPUNIT_ASSERT(find_stats("stats_bso", stats));
+      set_block_stats_enabled(false);
+
+      CPPUNIT_ASSERT_EQUAL(uint64_t(n), stats.items);
+      CPPUNIT_ASSERT_EQUAL(uint64_t(1), stats.tags);
+      CPPUNIT_ASSERT(stats.work_calls >= 1);
+      CPPUNIT_ASSERT(stats.items_per_second > 0.0);
+
+      // The first sample is a second old, later samples are younger by their offset (1 us/sample)
+      CPPUNIT_ASSERT(stats.max_data_age_ns >= 1000000000 - n * 1000);
+      CPPUNIT_ASSERT(stats.max_data_age_ns < 10000000000);
+      CPPUNIT_ASSERT(stats.avg_data_age_ns > 0.0);
+
+      // Nothing is dropped, the inputs never hold more than their buffers
+      CPPUNIT_ASSERT_EQUAL(uint64_t(0), stats.lost);
+      CPPUNIT_ASSERT(stats.buffer_occupancy >= 0.0 && stats.buffer_occupancy <= 1.0);
+      CPPUNIT_ASSERT(stats.max_buffer_occupancy > 0.0 && stats.max_buffer_occupancy <= 1.0);
+    }
+
+    void
+    qa_block_stats::disabled_by_default()
+    {
+      CPPUNIT_ASSERT(!get_block_stats_enabled());
+
+      auto top = make_flowgraph(1000, 1, "stats_bso_disabled");
+      top->run();
+
+      block_stats_t stats;
+      CPPUNIT_ASSERT(find_stats("stats_bso_disabled", stats));
+      CPPUNIT_ASSERT_EQUAL(uint64_t(0), stats.work_calls);
+      CPPUNIT_ASSERT_EQUAL(uint64_t(0), stats.items);
+      CPPUNIT_ASSERT_EQUAL(int64_t(0), stats.max_data_age_ns);
+    }
+
+    void
+    qa_block_stats::trace_hops()
+    {
+      // Acts as a tracing digitizer
+      trace_registry_t::sources().fetch_add(1);
+
+      const auto origin = static_cast<int64_t>(get_timestamp_nano_utc());
+      const auto id = trace_registry_t::instance().begin_trace(origin);
+
+      auto top = gr::make_top_block("trace_hops");
+
+      std::vector<float> data(1000, 1.0f);
+      std::vector<gr::tag_t> tags = { make_trace_tag(trace_t{id, origin}, 10) };
+      auto src0 = blocks::vector_source_f::make(data, false, 1, tags);
+      auto src1 = blocks::vector_source_f::make(data);
+      auto bso = block_scaling_offset::make(1.0, 0.0);
+      bso->set_block_alias("trace_bso");
+      auto decim = decimate_and_adjust_timebase::make(2, 0.0, 1000.0);
+      decim->set_block_alias("trace_decim");
+      auto snk0 = blocks::vector_sink_f::make(1);
+      auto snk1 = blocks::null_sink::make(sizeof(float));
+
+      top->connect(src0, 0, bso, 0);
+      top->connect(src1, 0, bso, 1);
+      top->connect(bso, 0, decim, 0);
+      top->connect(decim, 0, snk0, 0);
+      top->connect(bso, 1, snk1, 0);
+      top->run();
+
+      trace_registry_t::sources().fetch_sub(1);
+
+      // forwarded by the decimating block
+      auto out_tags = snk0->tags();
+      auto trace_tag = std::find_if(out_tags.begin(), out_tags.end(), [](const gr::tag_t &tag) {
+        return tag.key == trace_tag_key(); });
+      CPPUNIT_ASSERT(trace_tag != out_tags.end());
+      CPPUNIT_ASSERT_EQUAL(uint64_t(5), trace_tag->offset);
+      CPPUNIT_ASSERT_EQUAL(id, decode_trace_tag(*trace_tag).id);
+
+      trace_record_t record;
+      CPPUNIT_ASSERT(get_trace(id, record));
+      CPPUNIT_ASSERT_EQUAL(origin, record.timestamp);
+      CPPUNIT_ASSERT_EQUAL(size_t(2), record.hops.size());
+      CPPUNIT_ASSERT_EQUAL(std::string("trace_bso"), record.hops[0].block);
+      CPPUNIT_ASSERT_EQUAL(std::string("trace_decim"), record.hops[1].block);
+      CPPUNIT_ASSERT(record.hops[0].timestamp >= origin);
+      CPPUNIT_ASSERT(record.hops[1].timestamp >= record.hops[0].timestamp);
+    }
+
+    void
+    qa_block_stats::steady_state_allocations()
+    {
+      // The allocation hooks of the test binary are installed
+      auto before = thread_allocation_count();
+      auto probe = blocks::null_sink::make(sizeof(float));
+      CPPUNIT_ASSERT(thread_allocation_count() > before);
+
+      auto top = gr::make_top_block("steady_state_allocations");
+
+      // Sparse acq_info tags on the timing chain, the tags are repeated with the data
+      acq_info_t acq_info{};
+      acq_info.timestamp = 1000000;
+      acq_info.timebase = 1e-6;
+      std::vector<gr::tag_t> tags = { make_acq_info_tag(acq_info, 0) };
+      std::vector<float> data(100000, 1.0f);
+
+      auto src0 = blocks::vector_source_f::make(data, true, 1, tags);
+      auto function = function_ff::make(10);
+      function->set_block_alias("alloc_function");
+      auto interlock = interlock_generation_ff::make(-10.0, 10.0);
+      interlock->set_block_alias("alloc_interlock");
+      auto snk0 = blocks::null_sink::make(sizeof(float));
+
+      top->connect(src0, 0, function, 0);
+      top->connect(function, 0, interlock, 0);
+      top->connect(function, 1, interlock, 1);
+      top->connect(function, 2, interlock, 2);
+      top->connect(interlock, 0, snk0, 0);
+
+      auto src1 = blocks::vector_source_f::make(data, true);
+      auto decim = decimate_and_adjust_timebase::make(10, 0.0, 1e6);
+      decim->set_block_alias("alloc_decim");
+      auto averager = signal_averager::make(1, 10, 1e5);
+      averager->set_block_alias("alloc_averager");
+      auto snk1 = blocks::null_sink::make(sizeof(float));
+
+      top->connect(src1, 0, decim, 0);
+      top->connect(decim, 0, averager, 0);
+      top->connect(averager, 0, snk1, 0);
+
+      set_block_stats_enabled(true);
+      top->start();
+
+      // warm up, i.e. let the reused vectors reach their capacity
+      std::this_thread::sleep_for(std::chrono::milliseconds(200));
+      reset_block_stats();
+      std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+      std::vector<block_stats_t> stats;
+      for (auto name : {"alloc_function", "alloc_interlock", "alloc_decim", "alloc_averager"}) {
+        block_stats_t s;
+        CPPUNIT_ASSERT(find_stats(name, s));
+        stats.push_back(s);
+      }
+
+      top->stop();
+      top->wait();
+      set_block_stats_enabled(false);
+
+      for (const auto &s : stats) {
+        CPPUNIT_ASSERT_MESSAGE(s.name, s.work_calls > 0);
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(s.name, uint64_t(0), s.allocations);
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(s.name, uint64_t(0), s.allocating_calls);
+      }
+    }
+
+    void
+    qa_block_stats::thread_registry()
+    {
+      CPPUNIT_ASSERT_EQUAL(std::string("scope1:poller"), thread_registry_t::kernel_name("scope1", "poller"));
+      CPPUNIT_ASSERT_EQUAL(std::string("long_ali:poller"), thread_registry_t::kernel_name("long_alias", "poller"));
+
+      // Applies to threads started later
+      set_thread_config("qa-spin", thread_config_t {{0}, 0});
+
+      std::atomic<bool> registered(false);
+      std::atomic<bool> stop(false);
+      boost::thread worker([&] {
+        thread_scope_t thread("qa_owner", "qa-spin");
+        registered = true;
+
+        volatile double x = 0.0;
+        while (!stop) {
+          x = x + 1.0;
+        }
+      });
+
+      while (!registered) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+      auto stats = get_thread_stats();
+      auto thread = std::find_if(stats.begin(), stats.end(), [](const thread_stats_t &s) {
+        return s.name == "qa_owner:qa-spin"; });
+
+      CPPUNIT_ASSERT(thread != stats.end());
+      CPPUNIT_ASSERT_EQUAL(std::string("qa_owner"), thread->owner);
+      CPPUNIT_ASSERT(thread->tid > 0);
+      CPPUNIT_ASSERT_EQUAL(0, thread->cpu);
+      CPPUNIT_ASSERT_EQUAL(size_t(1), thread->cpus.size());
+      CPPUNIT_ASSERT(!thread->scheduling_failed);
+      CPPUNIT_ASSERT(thread->cpu_time_ns > 10000000);
+
+      stop = true;
+      worker.join();
+      clear_thread_config("qa-spin");
+
+      stats = get_thread_stats();
+      CPPUNIT_ASSERT(std::none_of(stats.begin(), stats.end(), [](const thread_stats_t &s) {
+        return s.name == "qa_owner:qa-spin"; }));
+    }
+
+    void
+    qa_block_stats::telemetry_export()
+    {
+      auto top = make_flowgraph(1000, 1, "stats_bso_telemetry");
+      set_block_stats_enabled(true);
+      top->run();
+
+      auto blocks = get_block_stats();
+      set_block_stats_enabled(false);
+
+      thread_stats_t thread {};
+      thread.name = "qa_owner:qa-export";
+      thread.tid = 42;
+      thread.cpu = 1;
+      thread.cpu_time_ns = 123456789;
+      std::vector<thread_stats_t> threads {thread};
+
+      const auto name = "/qa_digitizers_telemetry_" + std::to_string(getpid());
+      telemetry_export_t writer;
+      writer.open(name, 0.5);
+      writer.publish(blocks, threads);
+
+      // Read back as an external tool would
+      int fd = shm_open(name.c_str(), O_RDONLY, 0);
+      CPPUNIT_ASSERT(fd >= 0);
+      const size_t size = sizeof(telemetry_header_t)
+              + telemetry_export_t::MAX_BLOCKS * sizeof(telemetry_block_t)
+              + telemetry_export_t::MAX_THREADS * sizeof(telemetry_thread_t);
+      auto addr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+      close(fd);
+      CPPUNIT_ASSERT(addr != MAP_FAILED);
+
+      auto header = static_cast<const telemetry_header_t *>(addr);
+      CPPUNIT_ASSERT_EQUAL(std::string("DIGITEL"), std::string(header->magic));
+      CPPUNIT_ASSERT_EQUAL(TELEMETRY_VERSION, header->version);
+      CPPUNIT_ASSERT_EQUAL(uint64_t(2), header->sequence);
+      CPPUNIT_ASSERT_EQUAL(uint32_t(blocks.size()), header->nblocks);
+      CPPUNIT_ASSERT_EQUAL(uint32_t(1), header->nthreads);
+      CPPUNIT_ASSERT_EQUAL(int32_t(getpid()), header->pid);
+      CPPUNIT_ASSERT(header->timestamp > 0);
+
+      auto block_records = reinterpret_cast<const telemetry_block_t *>(
+              static_cast<const char *>(addr) + header->blocks_offset);
+      auto record = std::find_if(block_records, block_records + header->nblocks,
+              [](const telemetry_block_t &r) { return std::strcmp(r.name, "stats_bso_telemetry") == 0; });
+      CPPUNIT_ASSERT(record != block_records + header->nblocks);
+      CPPUNIT_ASSERT_EQUAL(uint64_t(1000), record->items);
+      CPPUNIT_ASSERT(record->work_calls > 0);
+
+      auto thread_record = reinterpret_cast<const telemetry_thread_t *>(
+              static_cast<const char *>(addr) + header->threads_offset);
+      CPPUNIT_ASSERT_EQUAL(std::string("qa_owner:qa-export"), std::string(thread_record->name));
+      CPPUNIT_ASSERT_EQUAL(int32_t(42), thread_record->tid);
+      CPPUNIT_ASSERT_EQUAL(uint64_t(123456789), thread_record->cpu_time_ns);
+
+      munmap(addr, size);
+
+      // Unlinked on close
+      writer.close();
+      CPPUNIT_ASSERT(shm_open(name.c_str(), O_RDONLY, 0) < 0);
+    }
+
+  } /* namespace digitizers */
+} /* namespace gr */
@@ -0,0 +1,41 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+
+#ifndef _QA_BLOCK_STATS_H_
+#define _QA_BLOCK_STATS_H_
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/TestCase.h>
+
+namespace gr {
+  namespace digitizers {
+
+    class qa_block_stats : public CppUnit::TestCase
+    {
+    public:
+      CPPUNIT_TEST_SUITE(qa_block_stats);
+      CPPUNIT_TEST(counters_and_data_age);
+      CPPUNIT_TEST(disabled_by_default);
+      CPPUNIT_TEST(trace_hops);
+      CPPUNIT_TEST(steady_state_allocations);
+      CPPUNIT_TEST(thread_registry);
+      CPPUNIT_TEST(telemetry_export);
+      CPPUNIT_TEST_SUITE_END();
+
+    private:
+      void counters_and_data_age();
+      void disabled_by_default();
+      void trace_hops();
+      void steady_state_allocations();
+      void thread_registry();
+      void telemetry_export();
+    };
+
+  } /* namespace digitizers */
+} /* namespace gr */
+
+#endif /* _QA_BLOCK_STATS_H_ */
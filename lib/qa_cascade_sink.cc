@@ -23,6 +23,12 @@
 #include <cppunit/TestAssert.h>
 #include "qa_cascade_sink.h"
 #include <digitizers/cascade_sink.h>
+#include <digitizers/status.h>
+#include <digitizers/time_domain_sink.h>
+#include <gnuradio/top_block.h>
+#include <gnuradio/blocks/vector_source_f.h>
+
+#include <stdexcept>
 
 namespace gr {
   namespace digitizers {
@@ -33,6 +39,332 @@ namespace gr {
       // Put test here
     }
 
+    void
+    qa_cascade_sink::custom_levels()
+    {
+      const double samp_rate = 100000.0;
+      std::vector<cascade_level_t> levels = {
+        {"10kHz", "",      10,  0},  // feeds other levels only
+        {"1kHz",  "10kHz", 10, 10},
+        {"500Hz", "10kHz", 20,  0},  // pruned, neither a sink nor a child
+        {"100Hz", "1kHz",  10,  1}
+      };
+
+      auto cascade = cascade_sink::make(AVERAGE, 0, {}, 10.0, 100.0, 10.0, {}, {}, samp_rate, 1.0,
+              "sig", "V", levels, false, false, false, false, 0, 0);
+
+      auto instantiated = cascade->get_levels();
+      CPPUNIT_ASSERT_EQUAL(size_t(3), instantiated.size());
+      CPPUNIT_ASSERT_EQUAL(std::string("10kHz"), instantiated[0].name);
+      CPPUNIT_ASSERT_EQUAL(std::string("1kHz"), instantiated[1].name);
+      CPPUNIT_ASSERT_EQUAL(std::string("100Hz"), instantiated[2].name);
+
+      // slowest first
+      auto sinks = cascade->get_time_domain_sinks();
+      CPPUNIT_ASSERT_EQUAL(size_t(2), sinks.size());
+      CPPUNIT_ASSERT_EQUAL(std::string("sig@100Hz"), sinks[0]->get_metadata().name);
+      CPPUNIT_ASSERT_EQUAL(std::string("sig@1kHz"), sinks[1]->get_metadata().name);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(100.0, sinks[0]->get_sample_rate(), 1e-6);
+      CPPUNIT_ASSERT_EQUAL(size_t(10), sinks[1]->get_output_package_size());
+
+      // Unknown parent is rejected
+      levels.push_back({"1Hz", "10Hz", 10, 1});
+      auto top = gr::make_top_block("test");
+      auto values = gr::blocks::vector_source_f::make(std::vector<float>(1000, 1.0));
+      auto errors = gr::blocks::vector_source_f::make(std::vector<float>(1000, 0.1));
+      top->connect(values, 0, cascade, 0);
+      top->connect(errors, 0, cascade, 1);
+      CPPUNIT_ASSERT_THROW(cascade->set_levels(levels), std::invalid_argument);
+      CPPUNIT_ASSERT_EQUAL(size_t(3), cascade->get_levels().size());
+
+      // Unchanged levels are kept, including their sinks
+      levels.back().parent = "100Hz";
+      cascade->set_levels(levels);
+      auto reconfigured = cascade->get_time_domain_sinks();
+      CPPUNIT_ASSERT_EQUAL(size_t(3), reconfigured.size());
+      CPPUNIT_ASSERT_EQUAL(std::string("sig@1Hz"), reconfigured[0]->get_metadata().name);
+      CPPUNIT_ASSERT(reconfigured[1] == sinks[0]);
+      CPPUNIT_ASSERT(reconfigured[2] == sinks[1]);
+
+      top->run();
+    }
+
+    void
+    qa_cascade_sink::lazy_triggered_sinks()
+    {
+      const double samp_rate = 100000.0;
+      std::vector<cascade_level_t> levels = {
+        {"1kHz",  "", 100, 10}
+      };
+
+      auto cascade = cascade_sink::make(AVERAGE, 0, {}, 10.0, 100.0, 10.0, {}, {}, samp_rate, 1.0,
+              "sig", "V", levels, false, false, false, false, 100, 900);
+      CPPUNIT_ASSERT_EQUAL(size_t(1), cascade->get_time_domain_sinks().size());
+      CPPUNIT_ASSERT_EQUAL(size_t(1), cascade->get_levels().size());
+
+      auto top = gr::make_top_block("test");
+      auto values = gr::blocks::vector_source_f::make(std::vector<float>(10000, 1.0));
+      auto errors = gr::blocks::vector_source_f::make(std::vector<float>(10000, 0.1));
+      top->connect(values, 0, cascade, 0);
+      top->connect(errors, 0, cascade, 1);
+
+      // Enabling adds the trigger level and both triggered sinks
+      cascade->set_triggered_sinks_enabled(true);
+      auto sinks = cascade->get_time_domain_sinks();
+      CPPUNIT_ASSERT_EQUAL(size_t(3), sinks.size());
+      CPPUNIT_ASSERT_EQUAL(std::string("sig:Triggered@Raw"), sinks[1]->get_metadata().name);
+      CPPUNIT_ASSERT_EQUAL(std::string("sig:Triggered@10kHz"), sinks[2]->get_metadata().name);
+      CPPUNIT_ASSERT_EQUAL(std::string("10kHz"), cascade->get_levels()[0].name);
+
+      // Disabling prunes the trigger level again
+      cascade->set_triggered_sinks_enabled(false);
+      CPPUNIT_ASSERT_EQUAL(size_t(1), cascade->get_time_domain_sinks().size());
+      CPPUNIT_ASSERT_EQUAL(size_t(1), cascade->get_levels().size());
+
+      // Re-enabling reuses the sinks
+      cascade->set_triggered_sinks_enabled(true);
+      auto reenabled = cascade->get_time_domain_sinks();
+      CPPUNIT_ASSERT_EQUAL(size_t(3), reenabled.size());
+      CPPUNIT_ASSERT(reenabled[1] == sinks[1]);
+      CPPUNIT_ASSERT(reenabled[2] == sinks[2]);
+
+      top->run();
+    }
+
+    void
+    qa_cascade_sink::hardware_downsampling()
+    {
+      // digitizer delivers 10 kHz out of 1 MS/s, the top level is taken over by the hardware
+      const double raw_rate = 1000000.0;
+      const int factor = 100;
+      auto levels = cascade_sink::hardware_levels(cascade_sink::default_levels(raw_rate), factor);
+      CPPUNIT_ASSERT_EQUAL(size_t(6), levels.size());
+      CPPUNIT_ASSERT_EQUAL(1, levels[0].decimation);
+      CPPUNIT_ASSERT_EQUAL(10, levels[1].decimation);
+
+      CPPUNIT_ASSERT_THROW(cascade_sink::hardware_levels(cascade_sink::default_levels(raw_rate), 30),
+              std::invalid_argument);
+      CPPUNIT_ASSERT_THROW(cascade_sink::hardware_levels(cascade_sink::default_levels(raw_rate), 0),
+              std::invalid_argument);
+
+      auto cascade = cascade_sink::make(AVERAGE, 0, {}, 10.0, 100.0, 10.0, {}, {}, raw_rate / factor, 1.0,
+              "sig", "V", levels, true, false, false, false, 100, 900);
+      CPPUNIT_ASSERT_EQUAL(size_t(6), cascade->get_levels().size());
+
+      // the pass-through level keeps its sink and the rate delivered by the digitizer
+      auto sinks = cascade->get_time_domain_sinks();
+      CPPUNIT_ASSERT_EQUAL(size_t(8), sinks.size());
+      CPPUNIT_ASSERT_EQUAL(std::string("sig@10kHz"), sinks[5]->get_metadata().name);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(10000.0, sinks[5]->get_sample_rate(), 1e-6);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(1.0, sinks[0]->get_sample_rate(), 1e-6);
+
+      auto top = gr::make_top_block("test");
+      auto values = gr::blocks::vector_source_f::make(std::vector<float>(20000, 1.0));
+      auto errors = gr::blocks::vector_source_f::make(std::vector<float>(20000, 0.1));
+      top->connect(values, 0, cascade, 0);
+      top->connect(errors, 0, cascade, 1);
+
+      // reconfiguring the levels below the pass-through level
+      levels[1].package_size = 20;
+      cascade->set_levels(levels);
+      CPPUNIT_ASSERT(cascade->get_time_domain_sinks()[5] == sinks[5]);
+
+      top->run();
+    }
+
+    void
+    qa_cascade_sink::buffer_plan()
+    {
+      const double samp_rate = 100000.0;
+      std::vector<cascade_level_t> levels = {
+        {"10kHz", "",      10, 1000},
+        {"1kHz",  "10kHz", 10,  100},
+        {"100Hz", "1kHz",  10,   10}
+      };
+
+      auto cascade = cascade_sink::make(AVERAGE, 0, {}, 10.0, 100.0, 10.0, {}, {}, samp_rate, 1.0,
+              "sig", "V", levels, false, false, false, false, 0, 0);
+
+      // The latency target fits, 1 s at 10 kHz is the largest buffer (the slower levels are
+      // rounded up to a page)
+      auto plan = cascade->plan_buffers(64 * 1024 * 1024, 1.0);
+      CPPUNIT_ASSERT_EQUAL(uint32_t(6), plan.nbuffers);
+      CPPUNIT_ASSERT_EQUAL(uint64_t(0), plan.sink_bytes);
+      CPPUNIT_ASSERT_EQUAL(plan.stream_buffer_bytes, plan.total_bytes);
+      CPPUNIT_ASSERT(plan.stream_buffer_bytes >= 2 * 10000 * sizeof(float));
+      CPPUNIT_ASSERT(plan.max_latency >= 1.0);
+
+      // Tighter budget, the buffers shrink but still hold two packages
+      auto tight = cascade->plan_buffers(plan.total_bytes / 2, 1.0);
+      CPPUNIT_ASSERT(tight.total_bytes <= plan.total_bytes / 2);
+      CPPUNIT_ASSERT(tight.stream_buffer_bytes >= 2 * 2 * 1000 * sizeof(float));
+      CPPUNIT_ASSERT(tight.stream_buffer_bytes < plan.stream_buffer_bytes);
+
+      // Not even the minimum fits
+      CPPUNIT_ASSERT_THROW(cascade->plan_buffers(1024, 1.0), std::invalid_argument);
+      CPPUNIT_ASSERT_THROW(cascade->plan_buffers(64 * 1024 * 1024, 0.0), std::invalid_argument);
+
+      // The plan is applied before the buffers are allocated
+      auto top = gr::make_top_block("test");
+      auto values = gr::blocks::vector_source_f::make(std::vector<float>(20000, 1.0));
+      auto errors = gr::blocks::vector_source_f::make(std::vector<float>(20000, 0.1));
+      top->connect(values, 0, cascade, 0);
+      top->connect(errors, 0, cascade, 1);
+      top->run();
+    }
+
+    void
+    qa_cascade_sink::values_only_levels()
+    {
+      const double samp_rate = 100000.0;
+      std::vector<cascade_level_t> levels = {
+        {"10kHz", "",      10, 1000, true},
+        {"1kHz",  "10kHz", 10,  100, true},
+        {"100Hz", "1kHz",  10,   10, true}
+      };
+
+      auto cascade = cascade_sink::make(FIR_LP, 0, {}, 10.0, 100.0, 10.0, {}, {}, samp_rate, 1.0,
+              "sig", "V", levels, false, false, false, false, 0, 0);
+
+      // no errors at all, a single output per level
+      auto plan = cascade->plan_buffers(64 * 1024 * 1024, 1.0);
+      CPPUNIT_ASSERT_EQUAL(uint32_t(3), plan.nbuffers);
+
+      // the errors published at 100 Hz are computed by all the levels
+      levels[2].values_only = false;
+      cascade->set_levels(levels);
+      plan = cascade->plan_buffers(64 * 1024 * 1024, 1.0);
+      CPPUNIT_ASSERT_EQUAL(uint32_t(6), plan.nbuffers);
+      CPPUNIT_ASSERT(cascade->get_levels()[0].values_only);
+
+      auto top = gr::make_top_block("test");
+      auto values = gr::blocks::vector_source_f::make(std::vector<float>(20000, 1.0));
+      auto errors = gr::blocks::vector_source_f::make(std::vector<float>(20000, 0.1));
+      top->connect(values, 0, cascade, 0);
+      top->connect(errors, 0, cascade, 1);
+      top->run();
+    }
+
+    void
+    qa_cascade_sink::core_affinity()
+    {
+      const double samp_rate = 100000.0;
+      std::vector<cascade_level_t> levels = {
+        {"10kHz", "",      10, 1000},
+        {"1kHz",  "10kHz", 10,  100},
+        {"2kHz",  "",      50,  200}
+      };
+
+      auto cascade = cascade_sink::make(AVERAGE, 0, {}, 10.0, 100.0, 10.0, {}, {}, samp_rate, 1.0,
+              "sig", "V", levels, false, false, false, false, 100, 900);
+      CPPUNIT_ASSERT_THROW(cascade->set_core_affinity({-1}), std::invalid_argument);
+
+      // Two chains, the 1 kHz level joins the 10 kHz one
+      cascade->set_core_affinity({2, 3});
+      auto sinks = cascade->get_time_domain_sinks();
+      CPPUNIT_ASSERT_EQUAL(size_t(3), sinks.size());
+      CPPUNIT_ASSERT_EQUAL(std::string("sig@2kHz"), sinks[0]->get_metadata().name);
+      CPPUNIT_ASSERT(sinks[0]->processor_affinity() == std::vector<int>({3}));
+      CPPUNIT_ASSERT(sinks[1]->processor_affinity() == std::vector<int>({2}));
+      CPPUNIT_ASSERT(sinks[2]->processor_affinity() == std::vector<int>({2}));
+
+      // Reapplied to the sinks added later, the raw chain wraps around
+      auto top = gr::make_top_block("test");
+      auto values = gr::blocks::vector_source_f::make(std::vector<float>(10000, 1.0));
+      auto errors = gr::blocks::vector_source_f::make(std::vector<float>(10000, 0.1));
+      top->connect(values, 0, cascade, 0);
+      top->connect(errors, 0, cascade, 1);
+      cascade->set_triggered_sinks_enabled(true);
+      sinks = cascade->get_time_domain_sinks();
+      CPPUNIT_ASSERT_EQUAL(std::string("sig:Triggered@Raw"), sinks[3]->get_metadata().name);
+      CPPUNIT_ASSERT(sinks[3]->processor_affinity() == std::vector<int>({2}));
+      CPPUNIT_ASSERT(sinks[4]->processor_affinity() == std::vector<int>({2}));
+
+      cascade->set_core_affinity({});
+      CPPUNIT_ASSERT(cascade->get_core_affinity().empty());
+      CPPUNIT_ASSERT(sinks[0]->processor_affinity().empty());
+    }
+
+    static void
+    ignore_data(const float *values, std::size_t values_size, const float *errors, std::size_t errors_size,
+            std::vector<gr::tag_t>& tags, void* userdata)
+    {
+    }
+
+    void
+    qa_cascade_sink::demand_tracking()
+    {
+      const double samp_rate = 100000.0;
+      std::vector<cascade_level_t> levels = {
+        {"10kHz", "",      10, 1000},
+        {"1kHz",  "10kHz", 10,  100},
+        {"2kHz",  "",      50,  200}
+      };
+
+      auto cascade = cascade_sink::make(AVERAGE, 0, {}, 10.0, 100.0, 10.0, {}, {}, samp_rate, 1.0,
+              "sig", "V", levels, false, false, false, false, 100, 900);
+      CPPUNIT_ASSERT(cascade->get_active_levels().empty());
+
+      // A consumer of the 1 kHz sink activates its parent as well
+      auto sinks = cascade->get_time_domain_sinks();
+      CPPUNIT_ASSERT_EQUAL(std::string("sig@1kHz"), sinks[1]->get_metadata().name);
+      sinks[1]->set_callback(&ignore_data, nullptr);
+      CPPUNIT_ASSERT(cascade->get_active_levels() == std::vector<std::string>({"10kHz", "1kHz"}));
+
+      sinks[0]->set_callback(&ignore_data, nullptr);
+      sinks[1]->set_callback(nullptr, nullptr);
+      CPPUNIT_ASSERT(cascade->get_active_levels() == std::vector<std::string>({"2kHz"}));
+
+      // The triggered 10 kHz sink demands the trigger level
+      auto top = gr::make_top_block("test");
+      auto values = gr::blocks::vector_source_f::make(std::vector<float>(10000, 1.0));
+      auto errors = gr::blocks::vector_source_f::make(std::vector<float>(10000, 0.1));
+      top->connect(values, 0, cascade, 0);
+      top->connect(errors, 0, cascade, 1);
+      cascade->set_triggered_sinks_enabled(true);
+      sinks = cascade->get_time_domain_sinks();
+      CPPUNIT_ASSERT_EQUAL(std::string("sig:Triggered@10kHz"), sinks[4]->get_metadata().name);
+      sinks[4]->set_callback(&ignore_data, nullptr);
+      CPPUNIT_ASSERT(cascade->get_active_levels() == std::vector<std::string>({"10kHz", "2kHz"}));
+
+      cascade->set_triggered_sinks_enabled(false);
+      CPPUNIT_ASSERT(cascade->get_active_levels() == std::vector<std::string>({"2kHz"}));
+    }
+
+    void
+    qa_cascade_sink::make_many()
+    {
+      const double samp_rate = 100000.0;
+      std::vector<cascade_level_t> levels = {
+        {"10kHz", "",      10, 100},
+        {"1kHz",  "10kHz", 10,  10}
+      };
+
+      std::vector<cascade_sink_config_t> configs;
+      for (int i = 0; i < 8; i++) {
+        // two groups of identical designs
+        const double rate = i % 2 ? samp_rate : 2 * samp_rate;
+        auto channel_levels = levels;
+        channel_levels[0].decimation = static_cast<int>(rate / 10000.0);
+        configs.push_back(cascade_sink_config_t {FIR_LP, 0, {}, 10.0, 100.0, 10.0, {}, {}, rate, 1.0,
+                "ch" + std::to_string(i), "V", channel_levels, i == 0, false, false, false, 100, 900});
+      }
+
+      auto cascades = cascade_sink::make_many(configs, 4);
+      CPPUNIT_ASSERT_EQUAL(configs.size(), cascades.size());
+
+      for (size_t i = 0; i < cascades.size(); i++) {
+        auto sinks = cascades[i]->get_time_domain_sinks();
+        CPPUNIT_ASSERT_EQUAL(size_t(i == 0 ? 4 : 2), sinks.size());
+        CPPUNIT_ASSERT_EQUAL(configs[i].signal_name + "@1kHz", sinks[0]->get_metadata().name);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(1000.0, sinks[0]->get_sample_rate(), 1e-6);
+      }
+
+      // Invalid levels are rejected before any block is made
+      configs[3].levels.push_back({"1Hz", "10Hz", 10, 1});
+      CPPUNIT_ASSERT_THROW(cascade_sink::make_many(configs, 4), std::invalid_argument);
+    }
+
   } /* namespace digitizers */
 } /* namespace gr */
 
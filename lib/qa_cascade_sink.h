@@ -33,10 +33,26 @@ namespace gr {
     public:
       CPPUNIT_TEST_SUITE(qa_cascade_sink);
       CPPUNIT_TEST(t1);
+      CPPUNIT_TEST(custom_levels);
+      CPPUNIT_TEST(lazy_triggered_sinks);
+      CPPUNIT_TEST(hardware_downsampling);
+      CPPUNIT_TEST(buffer_plan);
+      CPPUNIT_TEST(values_only_levels);
+      CPPUNIT_TEST(core_affinity);
+      CPPUNIT_TEST(demand_tracking);
+      CPPUNIT_TEST(make_many);
       CPPUNIT_TEST_SUITE_END();
 
     private:
       void t1();
+      void custom_levels();
+      void lazy_triggered_sinks();
+      void hardware_downsampling();
+      void buffer_plan();
+      void values_only_levels();
+      void core_affinity();
+      void demand_tracking();
+      void make_many();
     };
 
   } /* namespace digitizers */
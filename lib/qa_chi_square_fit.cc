@@ -15,6 +15,8 @@
 #include <gnuradio/blocks/vector_to_stream.h>
 #include <gnuradio/blocks/null_sink.h>
 
+#include <cmath>
+
 
 namespace gr {
   namespace digitizers {
@@ -86,6 +88,251 @@ namespace gr {
 
     }
 
+    void
+    qa_chi_square_fit::test_parallel_fitting_in_order()
+    {
+      // each vector has a different gradient, results are expected in input order
+      int signal_len = 30;
+      int nvectors = 24;
+      std::vector<float> signal;
+      for (int k = 0; k < nvectors; k++) {
+        for(int i = 1; i <= signal_len; i++) {
+          signal.push_back(i * (10.0f + k) + 5.0f);
+        }
+      }
+
+      auto top = gr::make_top_block("parallel_fitting");
+      auto vec_src = blocks::vector_source_f::make(signal, false, signal_len);
+      auto vec_snk0 = blocks::vector_sink_f::make(2);
+      auto null_snk0 = blocks::null_sink::make(sizeof(float) * 2);
+      auto null_snk1 = blocks::null_sink::make(sizeof(float));
+      auto null_snk2 = blocks::null_sink::make(sizeof(char));
+
+      auto fitter = digitizers::chi_square_fit::make(
+          signal_len,
+          "x*[0] + 1.0*[1] ",
+          signal_len,
+          1.0,
+          2,
+          "gradient, offset",
+          std::vector<double>({20.0, 0.0}),
+          std::vector<double>({0.0, 16.0}),
+          std::vector<int>({1, 1}),
+          std::vector<double>({100.0, 20.0}),
+          std::vector<double>({-100.0, -20.0}),
+          0.001);
+      fitter->set_nthreads(4);
+
+      top->connect(vec_src, 0, fitter, 0);
+      top->connect(fitter, 0, vec_snk0, 0);
+      top->connect(fitter, 1, null_snk0, 0);
+      top->connect(fitter, 2, null_snk1, 0);
+      top->connect(fitter, 3, null_snk2, 0);
+      top->run();
+
+      auto values = vec_snk0->data();
+      CPPUNIT_ASSERT_EQUAL(size_t(2 * nvectors), values.size());
+      for (int k = 0; k < nvectors; k++) {
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(10.0 + k, values.at(2 * k), 0.002);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(5.0, values.at(2 * k + 1), 0.002);
+      }
+    }
+
+    void
+    qa_chi_square_fit::test_warm_start()
+    {
+      // slowly changing gradient with a jump in the middle, the jump requires a cold start
+      int signal_len = 30;
+      std::vector<float> gradients;
+      for (int k = 0; k < 10; k++) {
+        gradients.push_back(40.0f + 0.5f * k);
+      }
+      gradients.push_back(-60.0f);
+      gradients.push_back(-59.5f);
+      gradients.push_back(41.0f);
+
+      std::vector<float> signal;
+      for (auto gradient : gradients) {
+        for(int i = 1; i <= signal_len; i++) {
+          signal.push_back(i * gradient + 5.0f);
+        }
+      }
+
+      auto top = gr::make_top_block("warm_start");
+      auto vec_src = blocks::vector_source_f::make(signal, false, signal_len);
+      auto vec_snk0 = blocks::vector_sink_f::make(2);
+      auto null_snk0 = blocks::null_sink::make(sizeof(float) * 2);
+      auto null_snk1 = blocks::null_sink::make(sizeof(float));
+      auto null_snk2 = blocks::null_sink::make(sizeof(char));
+
+      auto fitter = digitizers::chi_square_fit::make(
+          signal_len,
+          "x*[0] + 1.0*[1] ",
+          signal_len,
+          1.0,
+          2,
+          "gradient, offset",
+          std::vector<double>({0.0, 0.0}),
+          std::vector<double>({0.0, 16.0}),
+          std::vector<int>({1, 1}),
+          std::vector<double>({100.0, 20.0}),
+          std::vector<double>({-100.0, -20.0}),
+          0.001);
+      fitter->set_warm_start(true);
+
+      top->connect(vec_src, 0, fitter, 0);
+      top->connect(fitter, 0, vec_snk0, 0);
+      top->connect(fitter, 1, null_snk0, 0);
+      top->connect(fitter, 2, null_snk1, 0);
+      top->connect(fitter, 3, null_snk2, 0);
+      top->run();
+
+      auto values = vec_snk0->data();
+      CPPUNIT_ASSERT_EQUAL(2 * gradients.size(), values.size());
+      for (size_t k = 0; k < gradients.size(); k++) {
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(gradients[k], values.at(2 * k), 0.002);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(5.0, values.at(2 * k + 1), 0.002);
+      }
+    }
+
+    void
+    qa_chi_square_fit::test_compiled_models()
+    {
+      // noise free samples, but with a small deterministic ripple so that chi2 is not zero
+      int signal_len = 200;
+      std::vector<std::string> functions({"gaus", "lorentzian", "step_response", "pol2"});
+      std::vector<std::vector<double>> actual({{5.0, 80.0, 20.0}, {5.0, 80.0, 20.0},
+          {60.0, 4.0, 15.0}, {1.0, 0.05, -0.0002}});
+      std::vector<std::vector<double>> inits({{4.0, 90.0, 15.0}, {4.0, 90.0, 15.0},
+          {50.0, 3.0, 10.0}, {0.0, 0.0, 0.0}});
+
+      for (size_t m = 0; m < functions.size(); m++) {
+        const auto &p = actual[m];
+        std::vector<float> signal;
+        for (int i = 1; i <= signal_len; i++) {
+          double x = i, y;
+          if (m == 0) {
+            y = p[0] * std::exp(-0.5 * std::pow((x - p[1]) / p[2], 2));
+          }
+          else if (m == 1) {
+            y = p[0] * p[2] * p[2] / ((x - p[1]) * (x - p[1]) + p[2] * p[2]);
+          }
+          else if (m == 2) {
+            y = p[1] * (0.5 + 0.5 * std::erf((x - p[0]) / p[2]));
+          }
+          else {
+            y = p[0] + p[1] * x + p[2] * x * x;
+          }
+          signal.push_back(y + ((i % 2) ? 1e-3 : -1e-3));
+        }
+
+        auto top = gr::make_top_block("compiled_models");
+        auto vec_src = blocks::vector_source_f::make(signal, false, signal_len);
+        auto vec_snk0 = blocks::vector_sink_f::make(3);
+        auto vec_snk1 = blocks::vector_sink_f::make(3);
+        auto null_snk0 = blocks::null_sink::make(sizeof(float));
+        auto null_snk1 = blocks::null_sink::make(sizeof(char));
+
+        auto fitter = digitizers::chi_square_fit::make(
+            signal_len,
+            functions[m],
+            signal_len,
+            1.0,
+            3,
+            "a, b, c",
+            inits[m],
+            std::vector<double>({0.0, 0.0, 0.0}),
+            std::vector<int>({1, 1, 1}),
+            std::vector<double>({100.0, 100.0, 100.0}),
+            std::vector<double>({-100.0, -100.0, -100.0}),
+            0.001);
+
+        top->connect(vec_src, 0, fitter, 0);
+        top->connect(fitter, 0, vec_snk0, 0);
+        top->connect(fitter, 1, vec_snk1, 0);
+        top->connect(fitter, 2, null_snk0, 0);
+        top->connect(fitter, 3, null_snk1, 0);
+        top->run();
+
+        auto values = vec_snk0->data();
+        auto errors = vec_snk1->data();
+        CPPUNIT_ASSERT_EQUAL(size_t(3), values.size());
+        for (int k = 0; k < 3; k++) {
+          CPPUNIT_ASSERT_DOUBLES_EQUAL(p[k], values.at(k), 1e-3 * std::max(1.0, std::abs(p[k])));
+          CPPUNIT_ASSERT(errors.at(k) >= 0.0 && errors.at(k) < 0.01);
+        }
+      }
+    }
+
+    void
+    qa_chi_square_fit::test_coarse_fit()
+    {
+      // the coarse-to-fine fit must end at the solution of the full resolution fit
+      int signal_len = 8000;
+      std::vector<std::string> functions({"gaus", "step_response"});
+      std::vector<std::vector<double>> actual({{5.0, 3100.0, 60.0}, {4200.0, 4.0, 150.0}});
+      std::vector<std::vector<double>> inits({{4.0, 3300.0, 90.0}, {3900.0, 3.0, 100.0}});
+
+      for (size_t m = 0; m < functions.size(); m++) {
+        const auto &p = actual[m];
+        std::vector<float> signal;
+        for (int i = 1; i <= signal_len; i++) {
+          double x = i, y;
+          if (m == 0) {
+            y = p[0] * std::exp(-0.5 * std::pow((x - p[1]) / p[2], 2));
+          }
+          else {
+            y = p[1] * (0.5 + 0.5 * std::erf((x - p[0]) / p[2]));
+          }
+          signal.push_back(y + ((i % 3) ? 1e-2 : -2e-2));
+        }
+
+        std::vector<std::vector<float>> results;
+        for (int decimation : {1, 16}) {
+          auto top = gr::make_top_block("coarse_fit");
+          auto vec_src = blocks::vector_source_f::make(signal, false, signal_len);
+          auto vec_snk0 = blocks::vector_sink_f::make(3);
+          auto vec_snk1 = blocks::vector_sink_f::make(3);
+          auto null_snk0 = blocks::null_sink::make(sizeof(float));
+          auto null_snk1 = blocks::null_sink::make(sizeof(char));
+
+          auto fitter = digitizers::chi_square_fit::make(
+              signal_len,
+              functions[m],
+              signal_len,
+              1.0,
+              3,
+              "a, b, c",
+              inits[m],
+              std::vector<double>({0.0, 0.0, 0.0}),
+              std::vector<int>({1, 1, 1}),
+              std::vector<double>({10000.0, 10000.0, 10000.0}),
+              std::vector<double>({-10000.0, -10000.0, -10000.0}),
+              0.001);
+          fitter->set_coarse_fit(decimation);
+
+          top->connect(vec_src, 0, fitter, 0);
+          top->connect(fitter, 0, vec_snk0, 0);
+          top->connect(fitter, 1, vec_snk1, 0);
+          top->connect(fitter, 2, null_snk0, 0);
+          top->connect(fitter, 3, null_snk1, 0);
+          top->run();
+
+          auto values = vec_snk0->data();
+          auto errors = vec_snk1->data();
+          CPPUNIT_ASSERT_EQUAL(size_t(3), values.size());
+          values.insert(values.end(), errors.begin(), errors.end());
+          results.push_back(values);
+        }
+
+        for (int k = 0; k < 3; k++) {
+          CPPUNIT_ASSERT_DOUBLES_EQUAL(p[k], results[1].at(k), 1e-2 * std::abs(p[k]));
+          CPPUNIT_ASSERT_DOUBLES_EQUAL(results[0].at(k), results[1].at(k), 1e-4 * std::abs(p[k]));
+          CPPUNIT_ASSERT_DOUBLES_EQUAL(results[0].at(3 + k), results[1].at(3 + k), 1e-2 * results[0].at(3 + k));
+        }
+      }
+    }
+
   } /* namespace digitizers */
 } /* namespace gr */
 
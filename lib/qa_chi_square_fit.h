@@ -19,10 +19,18 @@ namespace gr {
     public:
       CPPUNIT_TEST_SUITE(qa_chi_square_fit);
       CPPUNIT_TEST(test_chi_square_simple_fitting);
+      CPPUNIT_TEST(test_parallel_fitting_in_order);
+      CPPUNIT_TEST(test_warm_start);
+      CPPUNIT_TEST(test_compiled_models);
+      CPPUNIT_TEST(test_coarse_fit);
       CPPUNIT_TEST_SUITE_END();
 
     private:
       void test_chi_square_simple_fitting();
+      void test_parallel_fitting_in_order();
+      void test_warm_start();
+      void test_compiled_models();
+      void test_coarse_fit();
     };
 
   } /* namespace digitizers */
@@ -0,0 +1,211 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#include <gnuradio/attributes.h>
+#include <cppunit/TestAssert.h>
+#include "qa_chunk_memory.h"
+#include "chunk_memory.h"
+#include "app_buffer.h"
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace gr {
+  namespace digitizers {
+
+    // Explicit huge pages reserved by the system (vm.nr_hugepages)
+    static long
+    nr_reserved_huge_pages()
+    {
+      std::ifstream file("/proc/sys/vm/nr_hugepages");
+      long pages = 0;
+      file >> pages;
+      return pages;
+    }
+
+    // Memory locked by the process (VmLck), in kB
+    static long
+    locked_kb()
+    {
+      std::ifstream file("/proc/self/status");
+      std::string line;
+      while (std::getline(file, line)) {
+        if (line.compare(0, 6, "VmLck:") == 0) {
+          return std::stol(line.substr(6));
+        }
+      }
+      return 0;
+    }
+
+    static bool
+    is_aligned(const void *addr, size_t alignment)
+    {
+      return reinterpret_cast<uintptr_t>(addr) % alignment == 0;
+    }
+
+    void
+    qa_chunk_memory::contiguous_slab()
+    {
+      const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+
+      chunk_memory_t memory;
+      CPPUNIT_ASSERT(memory.data() == nullptr);
+
+      memory.allocate(10 * page + 1, false, -1);
+      CPPUNIT_ASSERT(memory.data() != nullptr);
+      CPPUNIT_ASSERT(memory.size() >= 10 * page + 1);
+      CPPUNIT_ASSERT(!memory.is_huge_page_backed());
+      CPPUNIT_ASSERT(!memory.is_numa_bound());
+
+      // the whole region is writable
+      std::fill(memory.data(), memory.data() + memory.size(), uint8_t(0x5a));
+      CPPUNIT_ASSERT_EQUAL(uint8_t(0x5a), memory.data()[memory.size() - 1]);
+
+      // all the chunks of a buffer that doesn't grow are laid out back to back in one region
+      const size_t nr_chunks = 8;
+      app_buffer_t buffer;
+      buffer.initialize(2, 1, 1000, nr_chunks);
+
+      const auto stride = chunk_memory_t::round_up(buffer.get_chunk_size_bytes(), app_buffer_t::CHUNK_ALIGNMENT);
+
+      std::vector<app_buffer_t::data_chunk_t *> chunks;
+      for (size_t i = 0; i < nr_chunks; i++) {
+        chunks.push_back(buffer.get_free_data_chunk());
+        CPPUNIT_ASSERT(chunks.back() != nullptr);
+        CPPUNIT_ASSERT_EQUAL(buffer.get_chunk_size_bytes(), chunks.back()->d_size);
+      }
+      CPPUNIT_ASSERT_EQUAL(nr_chunks, buffer.get_nr_allocated_chunks());
+
+      std::vector<uint8_t *> addresses;
+      for (auto chunk : chunks) {
+        addresses.push_back(chunk->d_data);
+      }
+      std::sort(addresses.begin(), addresses.end());
+
+      for (size_t i = 1; i < nr_chunks; i++) {
+        CPPUNIT_ASSERT_EQUAL(stride, static_cast<size_t>(addresses[i] - addresses[i - 1]));
+      }
+
+      memory.release();
+      CPPUNIT_ASSERT(memory.data() == nullptr);
+      CPPUNIT_ASSERT_EQUAL(size_t(0), memory.size());
+    }
+
+    void
+    qa_chunk_memory::chunk_alignment()
+    {
+      const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+
+      chunk_memory_t memory;
+      memory.allocate(12345, false, -1);
+      CPPUNIT_ASSERT(is_aligned(memory.data(), page));
+
+      // chunk sizes which are not a multiple of the cache line, growth included
+      for (size_t chunk_size : {1, 3, 17, 1000}) {
+        app_buffer_t buffer;
+        buffer.initialize(1, 1, chunk_size, 4, 3, 12);
+        CPPUNIT_ASSERT(buffer.get_chunk_size_bytes() % app_buffer_t::CHUNK_ALIGNMENT != 0);
+
+        for (int i = 0; i < 12; i++) {
+          auto chunk = buffer.get_free_data_chunk();
+          CPPUNIT_ASSERT(chunk != nullptr);
+          CPPUNIT_ASSERT(is_aligned(chunk->d_data, app_buffer_t::CHUNK_ALIGNMENT));
+        }
+        CPPUNIT_ASSERT_EQUAL(size_t(12), buffer.get_nr_allocated_chunks());
+      }
+    }
+
+    void
+    qa_chunk_memory::huge_page_fallback()
+    {
+      const size_t size = chunk_memory_t::HUGE_PAGE_SIZE + 100;
+
+      chunk_memory_t memory;
+      memory.allocate(size, true, -1);
+      CPPUNIT_ASSERT(memory.data() != nullptr);
+
+      if (memory.is_explicit_huge_page_backed()) {
+        CPPUNIT_ASSERT(memory.is_huge_page_backed());
+        CPPUNIT_ASSERT(is_aligned(memory.data(), chunk_memory_t::HUGE_PAGE_SIZE));
+        CPPUNIT_ASSERT_EQUAL(2 * chunk_memory_t::HUGE_PAGE_SIZE, memory.size());
+      }
+      else {
+        // transparent huge pages, if any, and the size as requested
+        CPPUNIT_ASSERT_EQUAL(size, memory.size());
+      }
+
+      if (nr_reserved_huge_pages() == 0) {
+        CPPUNIT_ASSERT(!memory.is_explicit_huge_page_backed());
+      }
+
+      // the fallback is reported by the application buffer as well
+      app_buffer_t buffer;
+      buffer.set_memory_policy(true, -1);
+      buffer.initialize(1, 0, 1000, 4);
+      CPPUNIT_ASSERT(!buffer.is_explicit_huge_page_backed() || buffer.is_huge_page_backed());
+      if (nr_reserved_huge_pages() == 0) {
+        CPPUNIT_ASSERT(!buffer.is_explicit_huge_page_backed());
+      }
+
+      memory.allocate(size, false, -1);
+      CPPUNIT_ASSERT(!memory.is_huge_page_backed());
+      CPPUNIT_ASSERT(!memory.is_explicit_huge_page_backed());
+    }
+
+    void
+    qa_chunk_memory::invalid_numa_node()
+    {
+      CPPUNIT_ASSERT(!chunk_memory_t::numa_node_exists(-1));
+      CPPUNIT_ASSERT(!chunk_memory_t::numa_node_exists(1 << 20));
+
+      // memory is allocated, but not bound
+      chunk_memory_t memory;
+      memory.allocate(4096, false, 1 << 20);
+      CPPUNIT_ASSERT(memory.data() != nullptr);
+      CPPUNIT_ASSERT(!memory.is_numa_bound());
+
+      app_buffer_t buffer;
+      buffer.set_memory_policy(false, 1 << 20);
+      buffer.initialize(1, 0, 1000, 4);
+      CPPUNIT_ASSERT(!buffer.is_numa_bound());
+      CPPUNIT_ASSERT(buffer.get_free_data_chunk() != nullptr);
+
+      if (chunk_memory_t::numa_node_exists(0)) {
+        memory.allocate(4096, false, 0);
+        CPPUNIT_ASSERT(memory.is_numa_bound());
+      }
+    }
+
+    void
+    qa_chunk_memory::reallocation_unlocks()
+    {
+      const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+      const long before = locked_kb();
+
+      // e.g. the scratch buffers reallocated on every arm
+      chunk_memory_t memory;
+      for (int i = 0; i < 16; i++) {
+        memory.allocate(3 * page + 1, false, -1, true);
+        CPPUNIT_ASSERT(memory.data() != nullptr);
+        CPPUNIT_ASSERT(is_aligned(memory.data(), page));
+        CPPUNIT_ASSERT_EQUAL(uint8_t(0), memory.data()[3 * page]);
+
+        // locking is best-effort, it only succeeds if the limit allows for it
+        if (memory.is_locked()) {
+          CPPUNIT_ASSERT_EQUAL(before + static_cast<long>(4 * page / 1024), locked_kb());
+        }
+        memory.data()[3 * page] = 1;
+      }
+
+      memory.release();
+      CPPUNIT_ASSERT(!memory.is_locked());
+      CPPUNIT_ASSERT_EQUAL(before, locked_kb());
+    }
+
+  } /* namespace digitizers */
+} /* namespace gr */
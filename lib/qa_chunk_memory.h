@@ -0,0 +1,39 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+
+#ifndef _QA_CHUNK_MEMORY_H_
+#define _QA_CHUNK_MEMORY_H_
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/TestCase.h>
+
+namespace gr {
+  namespace digitizers {
+
+    class qa_chunk_memory : public CppUnit::TestCase
+    {
+    public:
+      CPPUNIT_TEST_SUITE(qa_chunk_memory);
+      CPPUNIT_TEST(contiguous_slab);
+      CPPUNIT_TEST(chunk_alignment);
+      CPPUNIT_TEST(huge_page_fallback);
+      CPPUNIT_TEST(invalid_numa_node);
+      CPPUNIT_TEST(reallocation_unlocks);
+      CPPUNIT_TEST_SUITE_END();
+
+    private:
+      void contiguous_slab();
+      void chunk_alignment();
+      void huge_page_fallback();
+      void invalid_numa_node();
+      void reallocation_unlocks();
+    };
+
+  } /* namespace digitizers */
+} /* namespace gr */
+
+#endif /* _QA_CHUNK_MEMORY_H_ */
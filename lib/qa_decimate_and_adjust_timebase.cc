@@ -10,6 +10,7 @@
 #include <gnuradio/attributes.h>
 #include <cppunit/TestAssert.h>
 #include <gnuradio/blocks/vector_source_f.h>
+#include <gnuradio/blocks/vector_source_s.h>
 #include <gnuradio/blocks/vector_sink_f.h>
 #include "qa_decimate_and_adjust_timebase.h"
 #include <digitizers/decimate_and_adjust_timebase.h>
@@ -105,6 +106,90 @@ namespace gr {
       CPPUNIT_ASSERT_EQUAL(data.size(),size_t(size/decim));
     }
 
+    void
+    qa_decimate_and_adjust_timebase::merge_many_windows()
+    {
+      const int decim = 4;
+      const size_t size = 400;
+      std::vector<float> samples(size, 1.0);
+
+      // an acq_info tag on every sample, each window sets all four status bits
+      std::vector<gr::tag_t> tags;
+      for (size_t i = 0; i < size; i++) {
+        acq_info_t acq_info = acq_info_t();
+        acq_info.status = 1 << (i % decim);
+        acq_info.timestamp = i;
+        tags.push_back(make_acq_info_tag(acq_info, i));
+      }
+
+      gr::tag_t custom;
+      custom.offset = 10;
+      custom.key = pmt::intern("custom");
+      custom.value = pmt::from_long(42);
+      tags.push_back(custom);
+
+      auto top = gr::make_top_block("merge_many_windows");
+      auto src = blocks::vector_source_f::make(samples, false, 1, tags);
+      auto dec = decimate_and_adjust_timebase::make(decim, 0.0, 1000.0);
+      auto snk = blocks::vector_sink_f::make(1);
+      top->connect(src, 0, dec, 0);
+      top->connect(dec, 0, snk, 0);
+      top->run();
+
+      auto tags_out = snk->tags();
+      CPPUNIT_ASSERT_EQUAL(size / decim + 1, tags_out.size());
+
+      size_t nacq_infos = 0;
+      for (const auto &tag : tags_out) {
+        if (get_tag_kind(tag) == TAG_KIND_ACQ_INFO) {
+          auto acq_info = decode_acq_info_tag(tag);
+          CPPUNIT_ASSERT_EQUAL(uint32_t(15), acq_info.status);
+          CPPUNIT_ASSERT_EQUAL(int64_t(tag.offset * decim), acq_info.timestamp); // first of the window
+          nacq_infos++;
+        }
+        else {
+          CPPUNIT_ASSERT(pmt::eqv(custom.key, tag.key));
+          CPPUNIT_ASSERT_EQUAL(uint64_t(10 / decim), tag.offset);
+        }
+      }
+      CPPUNIT_ASSERT_EQUAL(size / decim, nacq_infos);
+    }
+
+    void
+    qa_decimate_and_adjust_timebase::raw_input()
+    {
+      int decim = 5;
+      size_t size = 500;
+
+      std::vector<int16_t> samples(size);
+      for (size_t i = 0; i < size; i++) {
+        samples[i] = static_cast<int16_t>(i);
+      }
+
+      std::vector<gr::tag_t> tags = {
+        make_raw_scaling_tag(raw_scaling_t{0.5, 1.0, 0.1}, 0)
+      };
+
+      auto top = gr::make_top_block("raw_input");
+      auto src = blocks::vector_source_s::make(samples, false, 1, tags);
+      auto dec = decimate_and_adjust_timebase::make(decim, 0.0, 1000.0, true);
+      auto snk = blocks::vector_sink_f::make(1);
+      top->connect(src, 0, dec, 0);
+      top->connect(dec, 0, snk, 0);
+      top->run();
+
+      auto data = snk->data();
+      CPPUNIT_ASSERT_EQUAL(size / decim, data.size());
+      for (size_t i = 0; i < data.size(); i++) {
+        CPPUNIT_ASSERT_EQUAL(static_cast<float>(i * decim) * 0.5f + 1.0f, data[i]);
+      }
+
+      auto tags_out = snk->tags();
+      CPPUNIT_ASSERT_EQUAL(size_t(1), tags_out.size());
+      CPPUNIT_ASSERT_EQUAL(TAG_KIND_CONSTANT_ERROR, get_tag_kind(tags_out[0]));
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(0.1, decode_constant_error_tag(tags_out[0]), 1e-6);
+    }
+
   } /* namespace digitizers */
 } /* namespace gr */
 
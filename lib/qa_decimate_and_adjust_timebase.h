@@ -20,11 +20,15 @@ namespace gr {
       CPPUNIT_TEST_SUITE(qa_decimate_and_adjust_timebase);
       CPPUNIT_TEST(test_decimation);
       CPPUNIT_TEST(offset_trigger_tag_test);
+      CPPUNIT_TEST(merge_many_windows);
+      CPPUNIT_TEST(raw_input);
       CPPUNIT_TEST_SUITE_END();
 
     private:
       void test_decimation();
       void offset_trigger_tag_test();
+      void merge_many_windows();
+      void raw_input();
       void test_single_decim_factor(int n, int d);
     };
 
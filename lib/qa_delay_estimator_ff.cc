@@ -0,0 +1,178 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#include <gnuradio/attributes.h>
+#include <cppunit/TestAssert.h>
+#include "qa_delay_estimator_ff.h"
+#include "cross_correlator.h"
+#include <digitizers/delay_estimator_ff.h>
+#include <digitizers/tags.h>
+#include <gnuradio/top_block.h>
+#include <gnuradio/blocks/vector_source_f.h>
+#include <gnuradio/blocks/vector_sink_f.h>
+
+#include <cmath>
+#include <random>
+#include <stdexcept>
+
+namespace gr {
+  namespace digitizers {
+
+    // Sum of tones below max_freq (cycles per sample), delayed by delay samples
+    static std::vector<float>
+    make_tones(size_t size, double max_freq, double delay, unsigned seed=42)
+    {
+      std::mt19937 generator(seed);
+      std::uniform_real_distribution<double> phases(0.0, 2.0 * M_PI);
+
+      std::vector<float> data(size, 0.0f);
+      for (int k = 1; k <= 24; k++) {
+        const double freq = max_freq * k / 24.0;
+        const double phase = phases(generator);
+        for (size_t n = 0; n < size; n++) {
+          data[n] += static_cast<float>(std::cos(2.0 * M_PI * freq * (n - delay) + phase));
+        }
+      }
+      return data;
+    }
+
+    void
+    qa_delay_estimator_ff::cross_correlator()
+    {
+      const int window_size = 256;
+      const auto reference = make_tones(window_size, 0.4, 0.0);
+
+      cross_correlator_t correlator(window_size);
+      correlator.set_reference(reference.data());
+
+      for (double delay : {0.0, 0.3, 2.5, -6.0, 13.7}) {
+        const auto signal = make_tones(window_size, 0.4, delay);
+
+        double lag;
+        float correlation;
+        CPPUNIT_ASSERT(correlator.estimate(signal.data(), 20, lag, correlation));
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(delay, lag, 0.15);
+        CPPUNIT_ASSERT(correlation > 0.5f);
+      }
+
+      // outside of the lags searched
+      const auto signal = make_tones(window_size, 0.4, 30.0);
+      double lag;
+      float correlation;
+      CPPUNIT_ASSERT(correlator.estimate(signal.data(), 20, lag, correlation));
+      CPPUNIT_ASSERT(std::abs(lag) <= 20.5);
+
+      // constant windows have no lag
+      const std::vector<float> constant(window_size, 1.0f);
+      CPPUNIT_ASSERT(!correlator.estimate(constant.data(), 20, lag, correlation));
+    }
+
+    void
+    qa_delay_estimator_ff::uncorrelated_channels()
+    {
+      const int window_size = 1024;
+      std::mt19937 generator(7);
+      std::normal_distribution<float> noise;
+
+      std::vector<float> reference(window_size), signal(window_size);
+      for (int n = 0; n < window_size; n++) {
+        reference[n] = noise(generator);
+        signal[n] = noise(generator);
+      }
+
+      cross_correlator_t correlator(window_size);
+      correlator.set_reference(reference.data());
+
+      double lag;
+      float correlation;
+      CPPUNIT_ASSERT(correlator.estimate(signal.data(), 50, lag, correlation));
+      CPPUNIT_ASSERT(correlation < 0.3f);
+    }
+
+    void
+    qa_delay_estimator_ff::estimates_delays()
+    {
+      const double samp_rate = 1e6;
+      const size_t size = 200000;
+
+      // channel 1 is 2.5 samples late, channel 2 is 6 samples early, channel 3 is noise
+      std::mt19937 generator(3);
+      std::normal_distribution<float> noise;
+      std::vector<float> uncorrelated(size);
+      for (auto &value : uncorrelated) {
+        value = noise(generator);
+      }
+
+      std::vector<std::vector<float>> channels = {
+        make_tones(size, 0.1, 0.0),
+        make_tones(size, 0.1, 2.5),
+        make_tones(size, 0.1, -6.0),
+        uncorrelated
+      };
+
+      auto top = gr::make_top_block("delay_estimator");
+      auto estimator = delay_estimator_ff::make(channels.size(), samp_rate, 4, 1024, 20e-6, 0.0, 0.5f);
+
+      std::vector<gr::blocks::vector_sink_f::sptr> sinks;
+      for (size_t ch = 0; ch < channels.size(); ch++) {
+        auto source = gr::blocks::vector_source_f::make(channels[ch]);
+        sinks.push_back(gr::blocks::vector_sink_f::make());
+        top->connect(source, 0, estimator, ch);
+        top->connect(estimator, ch, sinks.back(), 0);
+      }
+
+      top->run();
+
+      // samples are forwarded as they are
+      for (size_t ch = 0; ch < channels.size(); ch++) {
+        CPPUNIT_ASSERT(channels[ch] == sinks[ch]->data());
+      }
+
+      CPPUNIT_ASSERT(estimator->get_nr_estimates() > 0);
+
+      const auto delays = estimator->get_delays();
+      const auto correlations = estimator->get_correlations();
+      CPPUNIT_ASSERT_EQUAL(size_t {4}, delays.size());
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(0.0, delays[0], 1e-12);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(2.5e-6, delays[1], 0.5e-6);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(-6e-6, delays[2], 0.5e-6);
+      CPPUNIT_ASSERT(correlations[1] > 0.5f);
+      CPPUNIT_ASSERT(correlations[2] > 0.5f);
+
+      // never accepted
+      CPPUNIT_ASSERT(correlations[3] < 0.5f);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(0.0, delays[3], 1e-12);
+
+      // estimates published while running, the uncorrelated channel is not tagged
+      for (size_t ch = 0; ch < channels.size(); ch++) {
+        for (const auto &tag : sinks[ch]->tags()) {
+          CPPUNIT_ASSERT(get_tag_kind(tag) == TAG_KIND_CHANNEL_DELAY);
+          CPPUNIT_ASSERT(ch != 3);
+          CPPUNIT_ASSERT_DOUBLES_EQUAL(ch == 0 ? 0.0 : delays[ch], decode_channel_delay_tag(tag).delay, 0.5e-6);
+        }
+      }
+    }
+
+    void
+    qa_delay_estimator_ff::invalid_arguments()
+    {
+      CPPUNIT_ASSERT_THROW(delay_estimator_ff::make(1, 1e6), std::invalid_argument);
+      CPPUNIT_ASSERT_THROW(delay_estimator_ff::make(2, 0.0), std::invalid_argument);
+      CPPUNIT_ASSERT_THROW(delay_estimator_ff::make(2, 1e6, 0), std::invalid_argument);
+
+      // max delay of 1000 decimated samples
+      CPPUNIT_ASSERT_THROW(delay_estimator_ff::make(2, 1e6, 1, 1024, 1e-3), std::invalid_argument);
+      CPPUNIT_ASSERT_THROW(delay_estimator_ff::make(2, 1e6, 8, 4096, 1e-6, -1.0), std::invalid_argument);
+      CPPUNIT_ASSERT_THROW(delay_estimator_ff::make(2, 1e6, 8, 4096, 1e-6, 1.0, 1.5f), std::invalid_argument);
+
+      auto estimator = delay_estimator_ff::make(2, 1e6);
+      estimator->set_update_interval(0.25);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(0.25, estimator->get_update_interval(), 1e-9);
+      CPPUNIT_ASSERT_THROW(estimator->set_update_interval(-1.0), std::invalid_argument);
+    }
+
+  } /* namespace digitizers */
+} /* namespace gr */
@@ -0,0 +1,37 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+
+#ifndef _QA_DELAY_ESTIMATOR_FF_H_
+#define _QA_DELAY_ESTIMATOR_FF_H_
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/TestCase.h>
+
+namespace gr {
+  namespace digitizers {
+
+    class qa_delay_estimator_ff : public CppUnit::TestCase
+    {
+    public:
+      CPPUNIT_TEST_SUITE(qa_delay_estimator_ff);
+      CPPUNIT_TEST(cross_correlator);
+      CPPUNIT_TEST(uncorrelated_channels);
+      CPPUNIT_TEST(estimates_delays);
+      CPPUNIT_TEST(invalid_arguments);
+      CPPUNIT_TEST_SUITE_END();
+
+    private:
+      void cross_correlator();
+      void uncorrelated_channels();
+      void estimates_delays();
+      void invalid_arguments();
+    };
+
+  } /* namespace digitizers */
+} /* namespace gr */
+
+#endif /* _QA_DELAY_ESTIMATOR_FF_H_ */
@@ -310,34 +310,153 @@ namespace gr {
       CPPUNIT_ASSERT_EQUAL(tags.size(), flowgraph.tags().size());
     }
 
-// TODO: No support for overlapping trigger-tags
-//       Though we should test if a warning for skipped triggers is displayed in that case
-//    void
-//    qa_demux_ff::test_triggers_lost2()
-//    {
-//      unsigned pre_trigger_samples = 1;
-//      unsigned post_trigger_samples = 2;
-//      unsigned trigger_samples = pre_trigger_samples + post_trigger_samples;
-//
-//      size_t data_size = 100;
-//      auto values = make_test_data(data_size);
-//      auto errors = make_test_data(data_size, 0.1);
-//
-//      std::vector<gr::tag_t> tags;
-//      for ( size_t offset = pre_trigger_samples; offset < data_size - post_trigger_samples ; offset+=1 )
-//          tags.push_back(make_trigger_tag(offset));
-//
-//      auto flowgraph = make_test_flowgraph(values, errors, pre_trigger_samples, post_trigger_samples, tags);
-//
-//      flowgraph.run();
-//
-//      CPPUNIT_ASSERT_EQUAL((uint32_t)tags.size() * trigger_samples, (uint32_t)flowgraph.actual_values().size());
-//      CPPUNIT_ASSERT_EQUAL((uint32_t)tags.size() * trigger_samples, (uint32_t)flowgraph.actual_errors().size());
-//
-//      auto out_tags = flowgraph.tags();
-//      CPPUNIT_ASSERT_EQUAL(tags.size(), out_tags.size());
-//
-//    }
+    void
+    qa_demux_ff::test_triggers_lost2()
+    {
+      unsigned pre_trigger_samples = 1;
+      unsigned post_trigger_samples = 2;
+      unsigned trigger_samples = pre_trigger_samples + post_trigger_samples;
+
+      size_t data_size = 100;
+      auto values = make_test_data(data_size);
+      auto errors = make_test_data(data_size, 0.1);
+
+      std::vector<gr::tag_t> tags;
+      for ( size_t offset = pre_trigger_samples; offset < data_size - post_trigger_samples ; offset+=1 )
+          tags.push_back(make_trigger_tag(offset));
+
+      auto flowgraph = make_test_flowgraph(values, errors, pre_trigger_samples, post_trigger_samples, tags);
+
+      flowgraph.run();
+
+      CPPUNIT_ASSERT_EQUAL((uint32_t)tags.size() * trigger_samples, (uint32_t)flowgraph.actual_values().size());
+      CPPUNIT_ASSERT_EQUAL((uint32_t)tags.size() * trigger_samples, (uint32_t)flowgraph.actual_errors().size());
+
+      auto out_tags = flowgraph.tags();
+      CPPUNIT_ASSERT_EQUAL(tags.size(), out_tags.size());
+
+    }
+
+    void
+    qa_demux_ff::test_window_overlap()
+    {
+      unsigned pre_trigger_samples = 30;
+      unsigned post_trigger_samples = 70;
+      unsigned trigger_samples = pre_trigger_samples + post_trigger_samples;
+
+      size_t data_size = 50000;
+      auto values = make_test_data(data_size);
+      auto errors = make_test_data(data_size, 0.1);
+
+      // windows overlapping each other, all of them within the same work call
+      std::vector<uint64_t> trigger_offsets;
+      for (uint64_t offset = 100; offset < 40000; offset += (trigger_offsets.size() % 2) ? 10 : 1500) {
+        trigger_offsets.push_back(offset);
+      }
+
+      acq_info_t acq_info {};
+      std::vector<gr::tag_t> tags;
+      for (auto offset : trigger_offsets) {
+        tags.push_back(make_trigger_tag(offset));
+      }
+      tags.push_back(make_acq_info_tag(acq_info, trigger_offsets[0] + 5));
+
+      auto flowgraph = make_test_flowgraph(values, errors, pre_trigger_samples, post_trigger_samples, tags);
+      flowgraph.run();
+
+      auto actual_values = flowgraph.actual_values();
+      auto actual_errors = flowgraph.actual_errors();
+
+      CPPUNIT_ASSERT_EQUAL(trigger_offsets.size() * trigger_samples, actual_values.size());
+      CPPUNIT_ASSERT_EQUAL(trigger_offsets.size() * trigger_samples, actual_errors.size());
+      CPPUNIT_ASSERT_EQUAL(uint64_t {0}, flowgraph.extractor->get_skipped_triggers());
+
+      for (size_t i = 0; i < trigger_offsets.size(); i++) {
+        ASSERT_VECTOR_EQUAL(values.begin() + trigger_offsets[i] - pre_trigger_samples,
+                            values.begin() + trigger_offsets[i] + post_trigger_samples,
+                            actual_values.begin() + i * trigger_samples);
+        ASSERT_VECTOR_EQUAL(errors.begin() + trigger_offsets[i] - pre_trigger_samples,
+                            errors.begin() + trigger_offsets[i] + post_trigger_samples,
+                            actual_errors.begin() + i * trigger_samples);
+      }
+
+      // the acq_info tag is part of the first two windows
+      auto out_tags = flowgraph.tags();
+      int acq_info_tags = 0;
+      for (const auto &tag : out_tags) {
+        if (tag.key == pmt::string_to_symbol(acq_info_tag_name)) {
+          CPPUNIT_ASSERT(tag.offset == pre_trigger_samples + 5 || tag.offset == trigger_samples + pre_trigger_samples - 5);
+          acq_info_tags++;
+        }
+      }
+      CPPUNIT_ASSERT_EQUAL(2, acq_info_tags);
+      CPPUNIT_ASSERT_EQUAL(trigger_offsets.size() + 2, out_tags.size());
+    }
+
+    void
+    qa_demux_ff::test_skipped_triggers()
+    {
+      unsigned pre_trigger_samples = 100;
+      unsigned post_trigger_samples = 100;
+      unsigned trigger_samples = pre_trigger_samples + post_trigger_samples;
+
+      size_t data_size = 1000;
+      auto values = make_test_data(data_size);
+      auto errors = make_test_data(data_size, 0.1);
+
+      // the first two triggers lack pre-trigger samples
+      std::vector<gr::tag_t> tags = {
+        make_trigger_tag(10),
+        make_trigger_tag(99),
+        make_trigger_tag(100),
+        make_trigger_tag(500)
+      };
+
+      auto flowgraph = make_test_flowgraph(values, errors, pre_trigger_samples, post_trigger_samples, tags);
+      flowgraph.run();
+
+      CPPUNIT_ASSERT_EQUAL(uint64_t {2}, flowgraph.extractor->get_skipped_triggers());
+      CPPUNIT_ASSERT_EQUAL(2 * trigger_samples, (uint32_t)flowgraph.actual_values().size());
+      ASSERT_VECTOR_EQUAL(values.begin(), values.begin() + trigger_samples, flowgraph.actual_values().begin());
+    }
+
+    void
+    qa_demux_ff::test_large_window()
+    {
+      // windows much larger than the default buffer size, filled over many work calls
+      unsigned pre_trigger_samples = 100000;
+      unsigned post_trigger_samples = 400000;
+      unsigned trigger_samples = pre_trigger_samples + post_trigger_samples;
+
+      size_t data_size = 2000000;
+      auto values = make_test_data(data_size);
+      auto errors = make_test_data(data_size, 0.1);
+
+      std::vector<uint64_t> trigger_offsets {150000, 300000, 1200000};
+
+      std::vector<gr::tag_t> tags;
+      for (auto offset : trigger_offsets) {
+        tags.push_back(make_trigger_tag(offset));
+      }
+
+      auto flowgraph = make_test_flowgraph(values, errors, pre_trigger_samples, post_trigger_samples, tags);
+      flowgraph.run();
+
+      auto actual_values = flowgraph.actual_values();
+      auto actual_errors = flowgraph.actual_errors();
+
+      CPPUNIT_ASSERT_EQUAL(trigger_offsets.size() * trigger_samples, actual_values.size());
+      CPPUNIT_ASSERT_EQUAL(trigger_offsets.size() * trigger_samples, actual_errors.size());
+
+      for (size_t i = 0; i < trigger_offsets.size(); i++) {
+        ASSERT_VECTOR_EQUAL(values.begin() + trigger_offsets[i] - pre_trigger_samples,
+                            values.begin() + trigger_offsets[i] + post_trigger_samples,
+                            actual_values.begin() + i * trigger_samples);
+        ASSERT_VECTOR_EQUAL(errors.begin() + trigger_offsets[i] - pre_trigger_samples,
+                            errors.begin() + trigger_offsets[i] + post_trigger_samples,
+                            actual_errors.begin() + i * trigger_samples);
+      }
+    }
 
     void
     qa_demux_ff::test_hangup()
@@ -23,7 +23,10 @@ namespace gr {
       CPPUNIT_TEST(test_multi_trigger);
       CPPUNIT_TEST(test_to_few_post_trigger_samples);
       CPPUNIT_TEST(test_triggers_lost1);
-//      CPPUNIT_TEST(test_triggers_lost2);
+      CPPUNIT_TEST(test_triggers_lost2);
+      CPPUNIT_TEST(test_window_overlap);
+      CPPUNIT_TEST(test_skipped_triggers);
+      CPPUNIT_TEST(test_large_window);
       CPPUNIT_TEST(test_hangup);
       CPPUNIT_TEST_SUITE_END();
 
@@ -34,10 +37,9 @@ namespace gr {
       void test_to_few_post_trigger_samples();
       void test_window_overlap();
       void test_triggers_lost1();
-
-    // TODO: No support for overlapping trigger-tags
-    //       Though we should test if a warning for skipped triggers is displayed in that case
-    //  void test_triggers_lost2();
+      void test_triggers_lost2();
+      void test_skipped_triggers();
+      void test_large_window();
       void test_hangup();
     };
 
@@ -0,0 +1,176 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#include <gnuradio/attributes.h>
+#include <cppunit/TestAssert.h>
+#include "qa_design_cache.h"
+#include "design_cache.h"
+
+#include <boost/chrono.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <atomic>
+#include <fstream>
+#include <stdexcept>
+
+namespace gr {
+  namespace digitizers {
+
+    namespace fs = boost::filesystem;
+
+    // Points the cache to an empty directory for the duration of a test
+    struct scoped_cache_directory_t
+    {
+      scoped_cache_directory_t()
+        : path(fs::temp_directory_path() / fs::unique_path("qa-design-cache-%%%%%%%%")),
+          previous(design_cache_t::instance().directory())
+      {
+        design_cache_t::instance().set_directory(path.string());
+        design_cache_t::instance().clear_memory();
+      }
+
+      ~scoped_cache_directory_t()
+      {
+        design_cache_t::instance().set_directory(previous);
+        design_cache_t::instance().clear_memory();
+        fs::remove_all(path);
+      }
+
+      fs::path path;
+      std::string previous;
+    };
+
+    void
+    qa_design_cache::memory_and_disk()
+    {
+      scoped_cache_directory_t directory;
+      auto &cache = design_cache_t::instance();
+
+      auto misses = cache.misses();
+      auto hits = cache.hits();
+      auto disk_hits = cache.disk_hits();
+
+      auto reference = gr::filter::firdes::low_pass(1.0, 1e6, 1e4, 1e3);
+
+      auto taps = cached_low_pass(1.0, 1e6, 1e4, 1e3);
+      CPPUNIT_ASSERT(reference == taps);
+      CPPUNIT_ASSERT_EQUAL(misses + 1, cache.misses());
+
+      taps = cached_low_pass(1.0, 1e6, 1e4, 1e3);
+      CPPUNIT_ASSERT(reference == taps);
+      CPPUNIT_ASSERT_EQUAL(hits + 1, cache.hits());
+
+      // a different design is not mixed up
+      auto other = cached_low_pass(1.0, 1e6, 1e4, 2e3);
+      CPPUNIT_ASSERT(gr::filter::firdes::low_pass(1.0, 1e6, 1e4, 2e3) == other);
+      CPPUNIT_ASSERT_EQUAL(misses + 2, cache.misses());
+
+      // restart, designs are read from disk
+      cache.clear_memory();
+      taps = cached_low_pass(1.0, 1e6, 1e4, 1e3);
+      CPPUNIT_ASSERT(reference == taps);
+      CPPUNIT_ASSERT_EQUAL(disk_hits + 1, cache.disk_hits());
+      CPPUNIT_ASSERT_EQUAL(misses + 2, cache.misses());
+    }
+
+    void
+    qa_design_cache::corrupt_file()
+    {
+      scoped_cache_directory_t directory;
+      auto &cache = design_cache_t::instance();
+
+      auto reference = cached_band_pass(1.0, 1e6, 1e3, 1e4, 1e3);
+
+      // truncate the persisted design
+      for (fs::directory_iterator it(directory.path), end; it != end; ++it) {
+        fs::resize_file(it->path(), fs::file_size(it->path()) - 4);
+      }
+
+      auto misses = cache.misses();
+      cache.clear_memory();
+      auto taps = cached_band_pass(1.0, 1e6, 1e3, 1e4, 1e3);
+      CPPUNIT_ASSERT(reference == taps);
+      CPPUNIT_ASSERT_EQUAL(misses + 1, cache.misses());
+
+      // and rewritten
+      cache.clear_memory();
+      auto disk_hits = cache.disk_hits();
+      taps = cached_band_pass(1.0, 1e6, 1e3, 1e4, 1e3);
+      CPPUNIT_ASSERT(reference == taps);
+      CPPUNIT_ASSERT_EQUAL(disk_hits + 1, cache.disk_hits());
+    }
+
+    void
+    qa_design_cache::concurrent_designs()
+    {
+      scoped_cache_directory_t directory;
+      auto &cache = design_cache_t::instance();
+
+      auto misses = cache.misses();
+      std::atomic<int> ndesigns(0);
+
+      // A slow design requested by all the threads at once is computed once, another design
+      // proceeds meanwhile
+      std::vector<design_cache_t::taps_ptr_t> results(4);
+      std::vector<boost::thread> threads;
+      for (size_t i = 0; i < results.size(); i++) {
+        threads.emplace_back([&, i] {
+          results[i] = cache.get_shared("qa_slow", [&ndesigns] {
+            ndesigns++;
+            boost::this_thread::sleep_for(boost::chrono::milliseconds(200));
+            return std::vector<float>(16, 1.0f);
+          });
+        });
+      }
+
+      boost::this_thread::sleep_for(boost::chrono::milliseconds(50));
+      const auto start = boost::chrono::steady_clock::now();
+      auto other = cache.get_shared("qa_fast", [] { return std::vector<float>(4, 2.0f); });
+      CPPUNIT_ASSERT(boost::chrono::steady_clock::now() - start < boost::chrono::milliseconds(100));
+      CPPUNIT_ASSERT_EQUAL(size_t(4), other->size());
+
+      for (auto &thread : threads) {
+        thread.join();
+      }
+
+      CPPUNIT_ASSERT_EQUAL(1, ndesigns.load());
+      CPPUNIT_ASSERT_EQUAL(misses + 2, cache.misses());
+      for (const auto &result : results) {
+        CPPUNIT_ASSERT(result == results[0]);
+      }
+
+      // A failing design is reported to the caller and not cached
+      CPPUNIT_ASSERT_THROW(cache.get_shared("qa_failing", []() -> std::vector<float> {
+        throw std::runtime_error("design failed"); }), std::runtime_error);
+      auto retried = cache.get_shared("qa_failing", [] { return std::vector<float>(1, 3.0f); });
+      CPPUNIT_ASSERT_EQUAL(3.0f, retried->at(0));
+    }
+
+    void
+    qa_design_cache::interned_taps()
+    {
+      auto &cache = design_cache_t::instance();
+
+      std::vector<float> taps = {0.25f, 0.5f, 0.25f};
+      auto first = cache.intern(taps);
+      auto second = cache.intern(std::vector<float>(taps));
+      CPPUNIT_ASSERT(first == second);
+      CPPUNIT_ASSERT(taps == *first);
+
+      taps[1] = 0.75f;
+      auto other = cache.intern(taps);
+      CPPUNIT_ASSERT(other != first);
+      CPPUNIT_ASSERT_EQUAL(0.75f, other->at(1));
+
+      // Released with the last user
+      std::weak_ptr<const std::vector<float>> released = other;
+      other.reset();
+      CPPUNIT_ASSERT(released.expired());
+    }
+
+  } /* namespace digitizers */
+} /* namespace gr */
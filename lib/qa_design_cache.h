@@ -0,0 +1,37 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+
+#ifndef _QA_DESIGN_CACHE_H_
+#define _QA_DESIGN_CACHE_H_
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/TestCase.h>
+
+namespace gr {
+  namespace digitizers {
+
+    class qa_design_cache : public CppUnit::TestCase
+    {
+    public:
+      CPPUNIT_TEST_SUITE(qa_design_cache);
+      CPPUNIT_TEST(memory_and_disk);
+      CPPUNIT_TEST(corrupt_file);
+      CPPUNIT_TEST(concurrent_designs);
+      CPPUNIT_TEST(interned_taps);
+      CPPUNIT_TEST_SUITE_END();
+
+    private:
+      void memory_and_disk();
+      void corrupt_file();
+      void concurrent_designs();
+      void interned_taps();
+    };
+
+  } /* namespace digitizers */
+} /* namespace gr */
+
+#endif /* _QA_DESIGN_CACHE_H_ */
@@ -11,13 +11,31 @@
 #include <gnuradio/top_block.h>
 #include <gnuradio/blocks/vector_sink_f.h>
 #include <gnuradio/blocks/vector_sink_b.h>
+#include <gnuradio/blocks/vector_sink_s.h>
 #include <gnuradio/blocks/throttle.h>
+#include <gnuradio/blocks/message_debug.h>
 #include <digitizers/simulation_source.h>
+#include <digitizers/replay_source.h>
+#include <digitizers/aggregated_source.h>
+#include <digitizers/frame_splitter.h>
+#include <digitizers/thread_stats.h>
 #include <thread>
 #include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <atomic>
+#include <limits>
+#include <sys/resource.h>
+#include <sched.h>
 
 #include "utils.h"
 #include "qa_common.h"
+#include "digitizer_block_impl.h"
+#include "trace_registry.h"
 
 namespace gr {
   namespace digitizers {
@@ -152,6 +170,111 @@ namespace gr {
       }
     }
 
+    void
+    qa_digitizer_block::rapid_block_bulk_readout()
+    {
+      int samples = 1000;
+      int presamples = 50;
+      int nr_captures = 3;
+      fill_data(samples, presamples);
+
+      auto fg = make_test_flowgraph();
+
+      fg.source->set_samples(presamples, samples);
+      fg.source->set_data(d_cha_vec, d_chb_vec, d_port_vec);
+      fg.source->set_rapid_block(nr_captures);
+      fg.source->set_bulk_readout(true);
+      fg.source->set_trigger_once(true);
+
+      fg.top->run();
+
+      auto dataa = fg.sink_sig_a->data();
+      CPPUNIT_ASSERT_EQUAL(nr_captures * (samples + presamples), (int)dataa.size());
+
+      for (int i = 0; i < nr_captures; i++) {
+        ASSERT_VECTOR_EQUAL(d_cha_vec.begin(), d_cha_vec.end(), dataa.begin() + i * (samples + presamples));
+      }
+
+      auto tags = fg.sink_sig_a->tags();
+      int trigger_tags = 0;
+      for (const auto &tag : tags) {
+        if (pmt::symbol_to_string(tag.key) == trigger_tag_name) {
+          trigger_tags++;
+        }
+      }
+      CPPUNIT_ASSERT_EQUAL(nr_captures, trigger_tags);
+    }
+
+    void
+    qa_digitizer_block::rapid_block_overlapped_readout()
+    {
+      int samples = 1000;
+      int presamples = 50;
+      int nr_captures = 2;
+      int block_size = samples + presamples;
+      fill_data(samples, presamples);
+
+      auto fg = make_test_flowgraph();
+
+      fg.source->set_samples(presamples, samples);
+      fg.source->set_data(d_cha_vec, d_chb_vec, d_port_vec);
+      fg.source->set_rapid_block(nr_captures);
+      fg.source->set_overlapped_readout(true);
+      fg.source->set_bulk_readout(true);
+
+      // simulated captures take one second
+      fg.top->start();
+      std::this_thread::sleep_for(std::chrono::milliseconds(2500));
+      fg.top->stop();
+      fg.top->wait();
+
+      auto dataa = fg.sink_sig_a->data();
+      CPPUNIT_ASSERT((int)dataa.size() >= nr_captures * block_size);
+
+      for (int i = 0; i < (int)dataa.size() / block_size; i++) {
+        ASSERT_VECTOR_EQUAL(d_cha_vec.begin(), d_cha_vec.end(), dataa.begin() + i * block_size);
+      }
+    }
+
+    void
+    qa_digitizer_block::rapid_block_async_readout()
+    {
+      int samples = 1000;
+      int presamples = 50;
+      int nr_captures = 3;
+      fill_data(samples, presamples);
+
+      auto fg = make_test_flowgraph();
+
+      fg.source->set_samples(presamples, samples);
+      fg.source->set_data(d_cha_vec, d_chb_vec, d_port_vec);
+      fg.source->set_rapid_block(nr_captures);
+      fg.source->set_async_readout(true);
+      fg.source->set_trigger_once(true);
+
+      fg.top->run();
+
+      auto dataa = fg.sink_sig_a->data();
+      auto datab = fg.sink_sig_b->data();
+      CPPUNIT_ASSERT_EQUAL(nr_captures * (samples + presamples), (int)dataa.size());
+      CPPUNIT_ASSERT_EQUAL(dataa.size(), datab.size());
+
+      for (int i = 0; i < nr_captures; i++) {
+        ASSERT_VECTOR_EQUAL(d_cha_vec.begin(), d_cha_vec.end(), dataa.begin() + i * (samples + presamples));
+        ASSERT_VECTOR_EQUAL(d_chb_vec.begin(), d_chb_vec.end(), datab.begin() + i * (samples + presamples));
+      }
+
+      // a trigger tag per waveform, at the trigger sample
+      int trigger_tags = 0;
+      for (const auto &tag : fg.sink_sig_a->tags()) {
+        if (pmt::symbol_to_string(tag.key) == trigger_tag_name) {
+          CPPUNIT_ASSERT_EQUAL(uint64_t(trigger_tags * (samples + presamples) + presamples), tag.offset);
+          trigger_tags++;
+        }
+      }
+      CPPUNIT_ASSERT_EQUAL(nr_captures, trigger_tags);
+    }
+
     void
     qa_digitizer_block::streaming_basics()
     {
@@ -227,5 +350,1897 @@ namespace gr {
         }
       }
     }
-  }
-}
+
+    void
+    qa_digitizer_block::streaming_shared_tags()
+    {
+      int samples = 2000;
+      int presamples = 200;
+      int buffer_size = samples + presamples;
+
+      fill_data(samples, presamples);
+
+      auto fg = make_test_flowgraph();
+
+      fg.source->set_buffer_size(buffer_size);
+      fg.source->set_data(d_cha_vec, d_chb_vec, d_port_vec);
+      fg.source->set_streaming(0.0001);
+
+      fg.top->start();
+      std::this_thread::sleep_for(std::chrono::milliseconds(2));
+      fg.top->stop();
+      fg.top->wait();
+
+      auto tags_a = fg.sink_sig_a->tags();
+      auto tags_b = fg.sink_sig_b->tags();
+      auto tags_port = fg.sink_port->tags();
+
+      // Outputs with the same status reference the very same acq_info payload
+      int nr_acq_info = 0;
+      for (const auto &tag_a : tags_a) {
+        if (pmt::symbol_to_string(tag_a.key) != acq_info_tag_name) {
+          continue;
+        }
+
+        for (const auto &tags : {tags_b, tags_port}) {
+          auto it = std::find_if(tags.begin(), tags.end(), [&tag_a](const gr::tag_t &tag) {
+                return tag.offset == tag_a.offset && pmt::eq(tag.key, tag_a.key); });
+          CPPUNIT_ASSERT(it != tags.end());
+          CPPUNIT_ASSERT(pmt::eq(tag_a.value, it->value));
+        }
+        nr_acq_info++;
+      }
+
+      CPPUNIT_ASSERT(nr_acq_info != 0);
+    }
+
+    void
+    qa_digitizer_block::streaming_tag_encoding()
+    {
+      int samples = 2000;
+      int presamples = 200;
+      int buffer_size = samples + presamples;
+
+      fill_data(samples, presamples);
+
+      for (auto encoding : {TAG_ENCODING_TUPLE, TAG_ENCODING_BINARY}) {
+        auto fg = make_test_flowgraph();
+
+        fg.source->set_buffer_size(buffer_size);
+        fg.source->set_data(d_cha_vec, d_chb_vec, d_port_vec);
+        fg.source->set_samp_rate(10000.0);
+        fg.source->set_streaming(0.0001);
+        fg.source->set_tag_encoding(encoding);
+
+        fg.top->start();
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        fg.top->stop();
+        fg.top->wait();
+
+        int nr_acq_info = 0;
+        for (const auto &tag : fg.sink_sig_a->tags()) {
+          if (pmt::symbol_to_string(tag.key) != acq_info_tag_name) {
+            continue;
+          }
+
+          CPPUNIT_ASSERT(get_tag_kind(tag) == TAG_KIND_ACQ_INFO);
+          CPPUNIT_ASSERT_EQUAL(encoding == TAG_ENCODING_BINARY, pmt::is_blob(tag.value));
+          CPPUNIT_ASSERT_EQUAL(encoding == TAG_ENCODING_TUPLE, pmt::is_tuple(tag.value));
+
+          auto acq_info = decode_acq_info_tag(tag);
+          CPPUNIT_ASSERT_DOUBLES_EQUAL(1.0 / 10000.0, acq_info.timebase, 1e-12);
+          CPPUNIT_ASSERT(acq_info.timestamp != 0);
+          nr_acq_info++;
+        }
+
+        CPPUNIT_ASSERT(nr_acq_info != 0);
+      }
+
+      // Encoders are interchangeable from the decoder's point of view
+      trigger_t trigger;
+      trigger.downsampling_factor = 4;
+      trigger.timestamp = 1234567890123456789;
+      trigger.status = CHANNEL_STATUS_OVERFLOW;
+      trigger.trigger_offset = -1.25e-10;
+
+      for (auto encoding : {TAG_ENCODING_TUPLE, TAG_ENCODING_BINARY}) {
+        auto tag = make_trigger_tag(trigger, 10, encoding);
+        CPPUNIT_ASSERT(get_tag_kind(tag) == TAG_KIND_TRIGGER);
+
+        auto decoded = decode_trigger_tag(tag);
+        CPPUNIT_ASSERT_EQUAL(trigger.downsampling_factor, decoded.downsampling_factor);
+        CPPUNIT_ASSERT_EQUAL(trigger.timestamp, decoded.timestamp);
+        CPPUNIT_ASSERT_EQUAL(trigger.status, decoded.status);
+        CPPUNIT_ASSERT_EQUAL(trigger.trigger_offset, decoded.trigger_offset);
+      }
+
+      // Tags written before the trigger time offset was added decode with a zero offset
+      gr::tag_t old_tag = make_trigger_tag(trigger, 10, TAG_ENCODING_TUPLE);
+      old_tag.value = pmt::make_tuple(pmt::tuple_ref(old_tag.value, 0), pmt::tuple_ref(old_tag.value, 1),
+              pmt::tuple_ref(old_tag.value, 2));
+      CPPUNIT_ASSERT_EQUAL(0.0, decode_trigger_tag(old_tag).trigger_offset);
+      CPPUNIT_ASSERT_EQUAL(trigger.status, decode_trigger_tag(old_tag).status);
+
+      auto blob_tag = make_trigger_tag(trigger, 10, TAG_ENCODING_BINARY);
+      std::vector<uint8_t> old_blob(static_cast<const uint8_t *>(pmt::blob_data(blob_tag.value)),
+              static_cast<const uint8_t *>(pmt::blob_data(blob_tag.value)) + TRIGGER_BLOB_MIN_SIZE);
+      uint16_t old_size = TRIGGER_BLOB_MIN_SIZE;
+      memcpy(&old_blob[offsetof(trigger_blob_t, size)], &old_size, sizeof(old_size));
+      old_tag.value = pmt::make_blob(old_blob.data(), old_blob.size());
+      CPPUNIT_ASSERT_EQUAL(0.0, decode_trigger_tag(old_tag).trigger_offset);
+      CPPUNIT_ASSERT_EQUAL(trigger.timestamp, decode_trigger_tag(old_tag).timestamp);
+    }
+
+    void
+    qa_digitizer_block::streaming_calibration()
+    {
+      int samples = 2000;
+      int presamples = 200;
+      int buffer_size = samples + presamples;
+
+      fill_data(samples, presamples);
+
+      for (auto encoding : {TAG_ENCODING_TUPLE, TAG_ENCODING_BINARY}) {
+        auto fg = make_test_flowgraph();
+
+        fg.source->set_buffer_size(buffer_size);
+        fg.source->set_data(d_cha_vec, d_chb_vec, d_port_vec);
+        fg.source->set_streaming(0.0001);
+        fg.source->set_tag_encoding(encoding);
+        fg.source->set_aichan_calibration("A", 2.0, 0.5);
+
+        fg.top->start();
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        fg.top->stop();
+        fg.top->wait();
+
+        // Same as a block_scaling_offset behind the output
+        auto dataa = fg.sink_sig_a->data();
+        auto erra = fg.sink_err_a->data();
+        CPPUNIT_ASSERT(dataa.size() != 0);
+        for (size_t i = 0; i < std::min(dataa.size(), d_cha_vec.size()); i++) {
+          CPPUNIT_ASSERT_DOUBLES_EQUAL(d_cha_vec[i] * 2.0 - 0.5, dataa[i], 1e-5);
+          CPPUNIT_ASSERT_DOUBLES_EQUAL(0.01, erra[i], 1e-6);
+        }
+
+        auto datab = fg.sink_sig_b->data();
+        auto size = std::min(datab.size(), d_chb_vec.size());
+        ASSERT_VECTOR_EQUAL(d_chb_vec.begin(), d_chb_vec.begin() + size, datab.begin());
+
+        // Calibration is reported per channel
+        int nr_acq_info = 0;
+        for (const auto &tag : fg.sink_sig_a->tags()) {
+          if (get_tag_kind(tag) == TAG_KIND_ACQ_INFO) {
+            auto acq_info = decode_acq_info_tag(tag);
+            CPPUNIT_ASSERT_DOUBLES_EQUAL(2.0, acq_info.scale, 1e-12);
+            CPPUNIT_ASSERT_DOUBLES_EQUAL(0.5, acq_info.offset, 1e-12);
+            nr_acq_info++;
+          }
+        }
+        for (const auto &tag : fg.sink_sig_b->tags()) {
+          if (get_tag_kind(tag) == TAG_KIND_ACQ_INFO) {
+            auto acq_info = decode_acq_info_tag(tag);
+            CPPUNIT_ASSERT_DOUBLES_EQUAL(1.0, acq_info.scale, 1e-12);
+            CPPUNIT_ASSERT_DOUBLES_EQUAL(0.0, acq_info.offset, 1e-12);
+            nr_acq_info++;
+          }
+        }
+        CPPUNIT_ASSERT(nr_acq_info != 0);
+      }
+
+      // Tags written before the calibration was added decode as uncalibrated
+      gr::tag_t legacy;
+      legacy.key = acq_info_tag_key();
+      legacy.value = pmt::make_tuple(pmt::from_uint64(1), pmt::from_double(0.001),
+              pmt::from_double(0.0), pmt::from_double(0.0), pmt::from_long(0));
+      auto decoded = decode_acq_info_tag(legacy);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(1.0, decoded.scale, 1e-12);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(0.0, decoded.offset, 1e-12);
+
+      auto fg = make_test_flowgraph();
+      CPPUNIT_ASSERT_THROW(fg.source->set_aichan_calibration("A", 0.0, 0.0), std::invalid_argument);
+    }
+
+    void
+    qa_digitizer_block::streaming_condition_triggers()
+    {
+      int samples = 2000;
+      int presamples = 200;
+      int buffer_size = samples + presamples;
+
+      fill_data(samples, presamples);
+
+      auto fg = make_test_flowgraph();
+
+      fg.source->set_buffer_size(buffer_size);
+      fg.source->set_data(d_cha_vec, d_chb_vec, d_port_vec);
+      fg.source->set_streaming(0.0001);
+
+      // Channel A steps into the window at presamples, channel B is above 0.3V from the sample
+      // 155 on. Qualified by 100 samples pulse width.
+      fg.source->add_aichan_trigger_condition("A", TRIGGER_CONDITION_INSIDE, 2.0, 10.0);
+      fg.source->add_aichan_trigger_condition("B", TRIGGER_CONDITION_ABOVE, 0.3);
+      fg.source->set_trigger_logic(TRIGGER_LOGIC_AND);
+      fg.source->set_trigger_pulse_width(100.0 / 100000.0);
+
+      CPPUNIT_ASSERT_THROW(fg.source->add_aichan_trigger_condition("A", TRIGGER_CONDITION_INSIDE, 1.0, 0.0),
+              std::invalid_argument);
+      CPPUNIT_ASSERT_THROW(fg.source->set_trigger_pulse_width(-1.0), std::invalid_argument);
+
+      fg.top->start();
+      std::this_thread::sleep_for(std::chrono::microseconds(2000));
+      fg.top->stop();
+      fg.top->wait();
+
+      auto dataa = fg.sink_sig_a->data();
+      CPPUNIT_ASSERT(dataa.size() != 0);
+
+      int trigger_count = 0;
+      for (auto &tag: fg.sink_sig_a->tags()) {
+        if (pmt::symbol_to_string(tag.key) == trigger_tag_name) {
+          CPPUNIT_ASSERT_EQUAL(presamples + 99, static_cast<int>(tag.offset) % buffer_size);
+          trigger_count++;
+        }
+      }
+
+      CPPUNIT_ASSERT_EQUAL(static_cast<int>(dataa.size()) / buffer_size, trigger_count);
+    }
+
+    void
+    qa_digitizer_block::streaming_wait_strategy()
+    {
+      // A consumer waiting for data is woken up by the producer, whether it is still spinning,
+      // yielding or already parked
+      struct strategy_t
+      {
+        int spin_iterations;
+        int yield_iterations;
+        bool parks;
+      };
+
+      const strategy_t strategies[] = {
+        {0, 0, true},                       // parked right away
+        {1 << 30, 0, false},                // spins for seconds
+        {0, 1 << 30, false},                // yields for seconds
+        {1000, 100, true}                   // spins and yields briefly, then parks
+      };
+
+      for (const auto &strategy : strategies) {
+        app_buffer_t buffer;
+        buffer.initialize(1, 0, 16, 4);
+        buffer.set_wait_strategy(strategy.spin_iterations, strategy.yield_iterations);
+
+        std::atomic<bool> done(false);
+        std::error_code ec;
+        std::thread consumer([&] {
+          ec = buffer.wait_data_ready();
+          done = true;
+        });
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        CPPUNIT_ASSERT(!done);
+        CPPUNIT_ASSERT_EQUAL(strategy.parks, buffer.is_consumer_parked());
+
+        auto chunk = buffer.get_free_data_chunk();
+        CPPUNIT_ASSERT(chunk != nullptr);
+        buffer.add_full_data_chunk(chunk);
+
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+        while (!done && std::chrono::steady_clock::now() < deadline) {
+          std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        CPPUNIT_ASSERT(done);
+        consumer.join();
+
+        CPPUNIT_ASSERT(!ec);
+        CPPUNIT_ASSERT(!buffer.is_consumer_parked());
+        CPPUNIT_ASSERT(buffer.front_data_chunk() == chunk);
+        buffer.release_data_chunk(chunk);
+      }
+
+      // Errors wake up a parked consumer as well
+      {
+        app_buffer_t buffer;
+        buffer.initialize(1, 0, 16, 4);
+
+        std::error_code ec;
+        std::thread consumer([&] { ec = buffer.wait_data_ready(); });
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        CPPUNIT_ASSERT(buffer.is_consumer_parked());
+        buffer.notify_data_ready(digitizer_block_errc::Interrupted);
+        consumer.join();
+
+        CPPUNIT_ASSERT(ec == digitizer_block_errc::Interrupted);
+      }
+
+      auto fg = make_test_flowgraph();
+      fg.source->set_wait_strategy(1000, 100);
+      CPPUNIT_ASSERT_THROW(fg.source->set_wait_strategy(-1, 0), std::invalid_argument);
+    }
+
+    void
+    qa_digitizer_block::streaming_thread_scheduling()
+    {
+      int samples = 2000;
+      int presamples = 200;
+      int buffer_size = samples + presamples;
+
+      fill_data(samples, presamples);
+
+      auto fg = make_test_flowgraph();
+
+      fg.source->set_buffer_size(buffer_size);
+      fg.source->set_data(d_cha_vec, d_chb_vec, d_port_vec);
+      fg.source->set_streaming(0.0001);
+      fg.source->set_poller_scheduling({0}, 0);
+      fg.source->set_work_thread_scheduling({0}, 0);
+
+      CPPUNIT_ASSERT_THROW(fg.source->set_poller_scheduling({-1}, 0), std::invalid_argument);
+      CPPUNIT_ASSERT_THROW(fg.source->set_work_thread_scheduling({}, -1), std::invalid_argument);
+
+      fg.top->start();
+
+      // the affinity the kernel reports for the running poller thread
+      const auto poller_name = get_block_name(fg.source.get()) + ":poller";
+      int poller_tid = 0;
+      for (int i = 0; i < 1000 && poller_tid == 0; i++) {
+        for (const auto &thread : get_thread_stats()) {
+          if (thread.name == poller_name) {
+            poller_tid = thread.tid;
+          }
+        }
+        if (poller_tid == 0) {
+          std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+      }
+
+      CPPUNIT_ASSERT(poller_tid > 0);
+
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      CPPUNIT_ASSERT_EQUAL(0, sched_getaffinity(poller_tid, sizeof(set), &set));
+      CPPUNIT_ASSERT_EQUAL(1, CPU_COUNT(&set));
+      CPPUNIT_ASSERT(CPU_ISSET(0, &set));
+
+      std::this_thread::sleep_for(std::chrono::microseconds(2000));
+      fg.top->stop();
+      fg.top->wait();
+
+      auto dataa = fg.sink_sig_a->data();
+      CPPUNIT_ASSERT(dataa.size() != 0);
+
+      // CPU 0 is always available, and no real-time priority is requested
+      for (const auto &error : fg.source->get_errors()) {
+        CPPUNIT_ASSERT(error.code != digitizer_block_errc::SchedulingFailed);
+      }
+    }
+
+    void
+    qa_digitizer_block::streaming_thread_scheduling_failed()
+    {
+      int samples = 2000;
+      int presamples = 200;
+      int buffer_size = samples + presamples;
+
+      fill_data(samples, presamples);
+
+      auto fg = make_test_flowgraph();
+
+      fg.source->set_buffer_size(buffer_size);
+      fg.source->set_data(d_cha_vec, d_chb_vec, d_port_vec);
+      fg.source->set_streaming(0.0001);
+
+      // a valid index, but no such CPU
+      fg.source->set_poller_scheduling({CPU_SETSIZE - 1}, 0);
+
+      fg.top->start();
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      fg.top->stop();
+      fg.top->wait();
+
+      // acquisition continues with the default scheduling
+      auto dataa = fg.sink_sig_a->data();
+      CPPUNIT_ASSERT(dataa.size() != 0);
+
+      auto errors = fg.source->get_errors();
+      CPPUNIT_ASSERT(std::any_of(errors.begin(), errors.end(), [](const error_info_t &error) {
+        return error.code == digitizer_block_errc::SchedulingFailed; }));
+
+      int nr_flagged = 0;
+      for (const auto &tag : fg.sink_sig_a->tags()) {
+        if (pmt::symbol_to_string(tag.key) == acq_info_tag_name
+                && (decode_acq_info_tag(tag).status & CHANNEL_STATUS_THREAD_SCHEDULING_FAILED)) {
+          nr_flagged++;
+        }
+      }
+
+      CPPUNIT_ASSERT(nr_flagged != 0);
+    }
+
+    void
+    qa_digitizer_block::streaming_buffer_memory_policy()
+    {
+      int samples = 2000;
+      int presamples = 200;
+      int buffer_size = samples + presamples;
+
+      fill_data(samples, presamples);
+
+      auto fg = make_test_flowgraph();
+
+      fg.source->set_buffer_size(buffer_size);
+      fg.source->set_data(d_cha_vec, d_chb_vec, d_port_vec);
+      fg.source->set_streaming(0.0001);
+      fg.source->set_buffer_memory_policy(true, 0);
+
+      CPPUNIT_ASSERT_THROW(fg.source->set_buffer_memory_policy(false, -2), std::invalid_argument);
+
+      fg.top->start();
+      std::this_thread::sleep_for(std::chrono::microseconds(2000));
+      fg.top->stop();
+      fg.top->wait();
+
+      auto dataa = fg.sink_sig_a->data();
+      CPPUNIT_ASSERT(dataa.size() != 0);
+
+      auto size = std::min(dataa.size(), d_cha_vec.size());
+      ASSERT_VECTOR_EQUAL(d_cha_vec.begin(), d_cha_vec.begin() + size, dataa.begin());
+    }
+
+    void
+    qa_digitizer_block::streaming_realtime_memory()
+    {
+      int samples = 2000;
+      int presamples = 200;
+      int buffer_size = samples + presamples;
+
+      fill_data(samples, presamples);
+
+      auto fg = make_test_flowgraph();
+
+      fg.source->set_buffer_size(buffer_size);
+      fg.source->set_data(d_cha_vec, d_chb_vec, d_port_vec);
+      fg.source->set_streaming(0.0001);
+      fg.source->set_realtime_memory(true);
+      CPPUNIT_ASSERT_EQUAL(size_t(0), fg.source->get_locked_memory());
+
+      fg.top->start();
+      std::this_thread::sleep_for(std::chrono::microseconds(2000));
+      const auto locked = fg.source->get_locked_memory();
+      fg.top->stop();
+      fg.top->wait();
+
+      // Locking is best-effort, it only succeeds if the limit allows for it
+      struct rlimit limit;
+      CPPUNIT_ASSERT_EQUAL(0, getrlimit(RLIMIT_MEMLOCK, &limit));
+      if (limit.rlim_cur == RLIM_INFINITY) {
+        const size_t chunk_size_bytes = buffer_size * (2 * 2 * sizeof(float) + 1);
+        CPPUNIT_ASSERT(locked >= chunk_size_bytes * fg.source->get_nr_allocated_buffers());
+      }
+
+      auto dataa = fg.sink_sig_a->data();
+      CPPUNIT_ASSERT(dataa.size() != 0);
+
+      auto size = std::min(dataa.size(), d_cha_vec.size());
+      ASSERT_VECTOR_EQUAL(d_cha_vec.begin(), d_cha_vec.begin() + size, dataa.begin());
+    }
+
+    void
+    qa_digitizer_block::streaming_buffer_growth()
+    {
+      // The pool grows by nr_chunks / 4 chunks while no chunk is returned, up to the max
+      {
+        const size_t nr_chunks = 8, max_nr_chunks = 19;
+
+        app_buffer_t buffer;
+        buffer.initialize(1, 0, 16, nr_chunks, 2 * sizeof(float), max_nr_chunks);
+        CPPUNIT_ASSERT_EQUAL(nr_chunks, buffer.get_nr_allocated_chunks());
+
+        std::vector<app_buffer_t::data_chunk_t *> taken;
+        for (size_t i = 0; i < max_nr_chunks; i++) {
+          auto chunk = buffer.get_free_data_chunk();
+          CPPUNIT_ASSERT(chunk != nullptr);
+          CPPUNIT_ASSERT(std::find(taken.begin(), taken.end(), chunk) == taken.end());
+          taken.push_back(chunk);
+
+          // one growth step at a time, the last one truncated to the max
+          const auto expected = i < nr_chunks ? nr_chunks : std::min(max_nr_chunks, nr_chunks + 2 * ((i - nr_chunks) / 2 + 1));
+          CPPUNIT_ASSERT_EQUAL(expected, buffer.get_nr_allocated_chunks());
+        }
+
+        CPPUNIT_ASSERT(buffer.get_free_data_chunk() == nullptr);
+        CPPUNIT_ASSERT(buffer.get_free_data_chunk() == nullptr);
+        CPPUNIT_ASSERT_EQUAL(max_nr_chunks, buffer.get_nr_allocated_chunks());
+        CPPUNIT_ASSERT_EQUAL(max_nr_chunks, buffer.get_high_water_mark());
+
+        // returned chunks are reused, nothing more is allocated
+        for (auto chunk : taken) {
+          buffer.add_full_data_chunk(chunk);
+        }
+        for (size_t i = 0; i < max_nr_chunks; i++) {
+          buffer.release_data_chunk(buffer.front_data_chunk());
+        }
+        for (size_t i = 0; i < max_nr_chunks; i++) {
+          CPPUNIT_ASSERT(buffer.get_free_data_chunk() != nullptr);
+        }
+        CPPUNIT_ASSERT(buffer.get_free_data_chunk() == nullptr);
+        CPPUNIT_ASSERT_EQUAL(max_nr_chunks, buffer.get_nr_allocated_chunks());
+      }
+
+      int samples = 2000;
+      int presamples = 200;
+      int buffer_size = samples + presamples;
+
+      fill_data(samples, presamples);
+
+      auto fg = make_test_flowgraph();
+
+      // two enabled channels (values & errors) and one port
+      const size_t chunk_size_bytes = buffer_size * (2 * 2 * sizeof(float) + 1);
+      const size_t max_buffers = 16;
+
+      fg.source->set_buffer_size(buffer_size);
+      fg.source->set_nr_buffers(2);
+      fg.source->set_buffer_memory_budget(max_buffers * chunk_size_bytes);
+      fg.source->set_data(d_cha_vec, d_chb_vec, d_port_vec);
+      fg.source->set_streaming(0.0001);
+
+      fg.top->start();
+      std::this_thread::sleep_for(std::chrono::microseconds(2000));
+      fg.top->stop();
+      fg.top->wait();
+
+      auto dataa = fg.sink_sig_a->data();
+      CPPUNIT_ASSERT(dataa.size() != 0);
+
+      CPPUNIT_ASSERT(fg.source->get_nr_allocated_buffers() >= 2);
+      CPPUNIT_ASSERT(fg.source->get_nr_allocated_buffers() <= max_buffers);
+      CPPUNIT_ASSERT(fg.source->get_buffers_high_water_mark() >= 1);
+      CPPUNIT_ASSERT(fg.source->get_buffers_high_water_mark() <= fg.source->get_nr_allocated_buffers());
+    }
+
+    void
+    qa_digitizer_block::streaming_chunk_consumers()
+    {
+      // Chunks return to the pool once the work thread and all side consumers released them,
+      // the lagging consumer skips chunks instead of holding the pool
+      {
+        app_buffer_t buffer;
+        auto side = buffer.add_consumer();
+        auto lagging = buffer.add_consumer(2);
+        buffer.initialize(1, 0, 16, 4);
+
+        for (int i = 0; i < 4; i++) {
+          auto chunk = buffer.get_free_data_chunk();
+          CPPUNIT_ASSERT(chunk != nullptr);
+          chunk->d_local_timestamp = i;
+          buffer.add_full_data_chunk(chunk);
+        }
+        CPPUNIT_ASSERT(buffer.get_free_data_chunk() == nullptr);
+        CPPUNIT_ASSERT_EQUAL(uint64_t(2), buffer.get_consumer_skipped(lagging));
+
+        for (int i = 0; i < 4; i++) {
+          CPPUNIT_ASSERT(!buffer.wait_data_ready());
+          buffer.release_data_chunk(buffer.front_data_chunk());
+        }
+        CPPUNIT_ASSERT_EQUAL(size_t(0), buffer.get_nr_free_chunks());
+
+        for (int i = 0; i < 4; i++) {
+          auto chunk = buffer.pop_consumer_chunk(side);
+          CPPUNIT_ASSERT(chunk != nullptr);
+          CPPUNIT_ASSERT_EQUAL(uint64_t(i), chunk->d_local_timestamp);
+          buffer.release_consumer_chunk(chunk);
+        }
+        CPPUNIT_ASSERT(buffer.pop_consumer_chunk(side) == nullptr);
+        CPPUNIT_ASSERT_EQUAL(size_t(2), buffer.get_nr_free_chunks());
+
+        for (int i = 0; i < 2; i++) {
+          auto chunk = buffer.pop_consumer_chunk(lagging);
+          CPPUNIT_ASSERT(chunk != nullptr);
+          CPPUNIT_ASSERT_EQUAL(uint64_t(i), chunk->d_local_timestamp);
+          buffer.release_consumer_chunk(chunk);
+        }
+        CPPUNIT_ASSERT_EQUAL(size_t(4), buffer.get_nr_free_chunks());
+      }
+
+      // A side consumer reading the chunks of a running acquisition in place
+      auto fg = make_test_flowgraph();
+      fg.source->set_buffer_size(1000);
+      fg.source->set_nr_buffers(16);
+      fg.source->set_streaming(0.0001);
+      fg.source->set_stream_generator(SIMULATION_WAVEFORM_SINE, 2.0, 1000.0);
+      fg.source->set_stream_pacing(1.0);
+
+      auto impl = boost::dynamic_pointer_cast<digitizer_block_impl>(fg.source);
+      CPPUNIT_ASSERT(impl);
+      auto &app_buffer = impl->get_app_buffer();
+      auto consumer = app_buffer.add_consumer();
+
+      std::atomic<bool> running(true);
+      std::atomic<size_t> nr_consumed(0);
+      std::thread side_thread([&] {
+        while (running) {
+          auto chunk = app_buffer.pop_consumer_chunk(consumer);
+          if (chunk == nullptr) {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+            continue;
+          }
+          nr_consumed++;
+          app_buffer.release_consumer_chunk(chunk);
+        }
+      });
+
+      fg.top->start();
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      fg.top->stop();
+      fg.top->wait();
+      running = false;
+      side_thread.join();
+
+      CPPUNIT_ASSERT(nr_consumed >= 5);
+      CPPUNIT_ASSERT_EQUAL(uint64_t(0), app_buffer.get_consumer_skipped(consumer));
+      CPPUNIT_ASSERT_EQUAL(uint64_t {0}, fg.source->get_metrics().lost_buffers);
+    }
+
+    void
+    qa_digitizer_block::streaming_trigger_reserve()
+    {
+      // The last two chunks are left to priority requests, the pool does not grow
+      {
+        app_buffer_t buffer;
+        buffer.initialize(1, 0, 16, 4);
+        buffer.set_priority_reserve(2);
+
+        CPPUNIT_ASSERT(buffer.get_free_data_chunk(false) != nullptr);
+        CPPUNIT_ASSERT(buffer.get_free_data_chunk(false) != nullptr);
+        CPPUNIT_ASSERT(buffer.get_free_data_chunk(false) == nullptr);
+        CPPUNIT_ASSERT_EQUAL(uint64_t(1), buffer.get_nr_shed_chunks());
+
+        CPPUNIT_ASSERT(buffer.get_free_data_chunk(true) != nullptr);
+        CPPUNIT_ASSERT(buffer.get_free_data_chunk(true) != nullptr);
+        CPPUNIT_ASSERT(buffer.get_free_data_chunk(true) == nullptr);
+        CPPUNIT_ASSERT_EQUAL(uint64_t(1), buffer.get_nr_shed_chunks());
+      }
+
+      // The reserve counts the growth headroom
+      {
+        app_buffer_t buffer;
+        buffer.initialize(1, 0, 16, 2, 2 * sizeof(float), 6);
+        buffer.set_priority_reserve(2);
+
+        for (int i = 0; i < 4; i++) {
+          CPPUNIT_ASSERT(buffer.get_free_data_chunk(false) != nullptr);
+        }
+        CPPUNIT_ASSERT(buffer.get_free_data_chunk(false) == nullptr);
+        CPPUNIT_ASSERT(buffer.get_free_data_chunk() != nullptr);
+        CPPUNIT_ASSERT_EQUAL(size_t(5), buffer.get_nr_allocated_chunks());
+      }
+
+      // Analog trigger at sample 250, chunks of 100 samples, 120 pre- and 30 post-trigger samples
+      {
+        chunk_priority_tracker_t tracker;
+        CPPUNIT_ASSERT(!tracker.is_enabled());
+        tracker.configure_analog(1000, 500, true, 120, 30);
+
+        std::vector<int16_t> raw(400, 0);
+        std::fill(raw.begin() + 250, raw.begin() + 260, 2000);
+        tracker.scan(&raw[0], 200, 0);
+        tracker.scan(&raw[200], 200, 200);
+
+        CPPUNIT_ASSERT(!tracker.is_priority(0, 100));
+        CPPUNIT_ASSERT(tracker.is_priority(100, 100));    // pre-trigger samples 130..199
+        CPPUNIT_ASSERT(tracker.is_priority(200, 100));    // the trigger
+        CPPUNIT_ASSERT(!tracker.is_priority(300, 100));   // post-trigger samples end with 280
+      }
+
+      // A trigger on every other sample filling the first search slice, rearmed at its end and
+      // triggered on the first sample of the next one
+      {
+        const uint32_t slice = 2 * chunk_priority_tracker_t::MAX_OFFSETS;
+
+        chunk_priority_tracker_t tracker;
+        tracker.configure_analog(1000, 500, true, 0, 1);
+
+        std::vector<int16_t> raw(3 * slice + 1000, 0);
+        for (uint32_t i = 1; i < slice - 2; i += 2) {
+          raw[i] = 2000;
+        }
+        raw[slice] = 2000;
+        raw[2 * slice + 500] = 2000;
+        tracker.scan(&raw[0], static_cast<uint32_t>(raw.size()), 0);
+
+        // the windows of the first slice are merged into [1, slice - 1)
+        CPPUNIT_ASSERT(!tracker.is_priority(0, 1));
+        CPPUNIT_ASSERT(tracker.is_priority(1, slice - 2));
+        CPPUNIT_ASSERT(!tracker.is_priority(slice - 1, 1));
+        CPPUNIT_ASSERT(tracker.is_priority(slice, 1));
+        CPPUNIT_ASSERT(!tracker.is_priority(slice + 2, slice + 498));
+        CPPUNIT_ASSERT(tracker.is_priority(2 * slice + 500, 1));
+        CPPUNIT_ASSERT(!tracker.is_priority(2 * slice + 502, 100));
+      }
+
+      // Digital falling edges of pin 2, the level at the first sample is no edge
+      {
+        chunk_priority_tracker_t tracker;
+        tracker.configure_digital(1 << 2, false, 0, 0);
+
+        std::vector<int16_t> raw(300, 0x04);
+        std::fill(raw.begin(), raw.begin() + 10, 0);
+        std::fill(raw.begin() + 210, raw.begin() + 220, 0x03);
+        tracker.scan(&raw[0], 300, 1000);
+
+        CPPUNIT_ASSERT(!tracker.is_priority(1000, 100));
+        CPPUNIT_ASSERT(!tracker.is_priority(1100, 100));
+        CPPUNIT_ASSERT(tracker.is_priority(1200, 100));
+
+        tracker.reset();
+        CPPUNIT_ASSERT(!tracker.is_priority(1200, 100));
+      }
+
+      auto fg = make_test_flowgraph();
+      CPPUNIT_ASSERT_THROW(fg.source->set_trigger_reserve(-1), std::invalid_argument);
+      fg.source->set_trigger_reserve(2);
+    }
+
+    void
+    qa_digitizer_block::streaming_metrics()
+    {
+      int samples = 2000;
+      int presamples = 200;
+      int buffer_size = samples + presamples;
+      int nr_buffers = 8;
+
+      fill_data(samples, presamples);
+
+      auto fg = make_test_flowgraph();
+
+      auto msg_debug = gr::blocks::message_debug::make();
+      fg.top->msg_connect(fg.source, "metrics", msg_debug, "store");
+
+      fg.source->set_buffer_size(buffer_size);
+      fg.source->set_nr_buffers(nr_buffers);
+      fg.source->set_metrics_interval(0.0001);
+      fg.source->set_data(d_cha_vec, d_chb_vec, d_port_vec);
+      fg.source->set_streaming(0.0001);
+
+      fg.top->start();
+      std::this_thread::sleep_for(std::chrono::microseconds(2000));
+      fg.top->stop();
+      fg.top->wait();
+
+      auto dataa = fg.sink_sig_a->data();
+      CPPUNIT_ASSERT(dataa.size() != 0);
+
+      auto metrics = fg.source->get_metrics();
+      CPPUNIT_ASSERT(metrics.free_buffers + metrics.full_buffers <= (uint32_t)nr_buffers);
+      CPPUNIT_ASSERT(metrics.min_free_buffers <= (uint32_t)nr_buffers);
+      CPPUNIT_ASSERT_EQUAL((size_t)digitizer_metrics_t::LATENCY_HISTOGRAM_SIZE, metrics.latency_histogram.size());
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(100000.0, metrics.samp_rate, 1e-6);
+
+      // Each processed chunk is accounted for, note some samples might still be held by throttle
+      uint64_t nr_chunks = 0;
+      for (auto count : metrics.latency_histogram) {
+        nr_chunks += count;
+      }
+      CPPUNIT_ASSERT(nr_chunks * buffer_size >= dataa.size());
+
+      CPPUNIT_ASSERT(msg_debug->num_messages() > 0);
+      auto msg = msg_debug->get_message(0);
+      CPPUNIT_ASSERT(pmt::is_dict(msg));
+      CPPUNIT_ASSERT(pmt::dict_has_key(msg, pmt::mp("free_buffers")));
+      CPPUNIT_ASSERT(pmt::dict_has_key(msg, pmt::mp("lost_buffers")));
+      CPPUNIT_ASSERT(pmt::dict_has_key(msg, pmt::mp("latency_histogram")));
+
+      CPPUNIT_ASSERT_THROW(fg.source->set_metrics_interval(-1.0), std::invalid_argument);
+    }
+
+    void
+    qa_digitizer_block::streaming_config_transaction()
+    {
+      int samples = 2000;
+      int presamples = 200;
+
+      fill_data(samples, presamples);
+
+      auto fg = make_test_flowgraph();
+
+      fg.source->set_buffer_size(samples + presamples);
+      fg.source->set_data(d_cha_vec, d_chb_vec, d_port_vec);
+      fg.source->set_streaming(0.0001);
+      fg.source->set_driver_buffer_size(100000);
+
+      CPPUNIT_ASSERT_THROW(fg.source->commit_config(), std::runtime_error);
+
+      fg.top->start();
+      std::this_thread::sleep_for(std::chrono::milliseconds(2));
+
+      // settings changed within the transaction are applied on commit, by a single rearm
+      fg.source->begin_config();
+      CPPUNIT_ASSERT_THROW(fg.source->begin_config(), std::runtime_error);
+      fg.source->set_driver_buffer_size(50000);
+      fg.source->set_aichan_range("A", 5.0);
+      std::this_thread::sleep_for(std::chrono::milliseconds(2));
+      CPPUNIT_ASSERT_EQUAL(uint32_t(100000), fg.source->get_metrics().driver_buffer_size);
+
+      fg.source->commit_config();
+      for (int i = 0; i < 100 && fg.source->get_metrics().driver_buffer_size != 50000; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+      CPPUNIT_ASSERT_EQUAL(uint32_t(50000), fg.source->get_metrics().driver_buffer_size);
+
+      fg.top->stop();
+      fg.top->wait();
+
+      CPPUNIT_ASSERT(fg.sink_sig_a->data().size() != 0);
+    }
+
+    static int64_t
+    first_acq_info_timestamp(const std::vector<gr::tag_t> &tags)
+    {
+      for (const auto &tag : tags) {
+        if (pmt::symbol_to_string(tag.key) == acq_info_tag_name) {
+          return decode_acq_info_tag(tag).timestamp;
+        }
+      }
+      return -1;
+    }
+
+    void
+    qa_digitizer_block::streaming_device_group()
+    {
+      int samples = 2000;
+      int presamples = 200;
+      int buffer_size = samples + presamples;
+
+      fill_data(samples, presamples);
+
+      // Two devices polled by the same group thread, the second one is offset by one second
+      auto fg1 = make_test_flowgraph();
+      auto fg2 = make_test_flowgraph();
+
+      for (auto source : {fg1.source, fg2.source}) {
+        source->set_buffer_size(buffer_size);
+        source->set_data(d_cha_vec, d_chb_vec, d_port_vec);
+        source->set_streaming(0.0001);
+      }
+
+      fg1.source->set_device_group("qa_group");
+      fg2.source->set_device_group("qa_group", 1.0);
+
+      fg1.top->start();
+      fg2.top->start();
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      fg1.top->stop();
+      fg2.top->stop();
+      fg1.top->wait();
+      fg2.top->wait();
+
+      CPPUNIT_ASSERT(fg1.sink_sig_a->data().size() != 0);
+      CPPUNIT_ASSERT(fg2.sink_sig_a->data().size() != 0);
+
+      auto timestamp1 = first_acq_info_timestamp(fg1.sink_sig_a->tags());
+      auto timestamp2 = first_acq_info_timestamp(fg2.sink_sig_a->tags());
+      CPPUNIT_ASSERT(timestamp1 > 0 && timestamp2 > 0);
+
+      // Both devices are started within a few milliseconds
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(1.0, (timestamp2 - timestamp1) / 1000000000.0, 0.1);
+    }
+
+    void
+    qa_digitizer_block::conversion_pool()
+    {
+      conversion_pool_t pool;
+      std::vector<int> results(8, 0);
+
+      auto task = [&](size_t idx) { results[idx] += static_cast<int>(idx) + 1; };
+
+      // no workers, executed inline
+      pool.run(results.size(), task);
+      CPPUNIT_ASSERT_EQUAL(0, pool.size());
+
+      pool.start(3, "qa", "convert");
+      CPPUNIT_ASSERT_EQUAL(3, pool.size());
+
+      for (int iteration = 0; iteration < 1000; iteration++) {
+        pool.run(results.size(), task);
+      }
+
+      pool.stop();
+      CPPUNIT_ASSERT_EQUAL(0, pool.size());
+
+      for (size_t i = 0; i < results.size(); i++) {
+        CPPUNIT_ASSERT_EQUAL(1001 * (static_cast<int>(i) + 1), results[i]);
+      }
+
+      auto source = simulation_source::make();
+      CPPUNIT_ASSERT_THROW(source->set_conversion_threads(-1), std::invalid_argument);
+    }
+
+    void
+    qa_digitizer_block::trigger_search()
+    {
+      // square wave with a period of 100 samples, fed in chunks not aligned to vector width
+      std::vector<float> values(1000);
+      std::vector<int16_t> raw(values.size());
+      for (size_t i = 0; i < values.size(); i++) {
+        raw[i] = (i % 100) < 50 ? -100 : 100;
+        values[i] = raw[i] * 0.01f;
+      }
+
+      std::vector<int> expected_rising;
+      std::vector<int> expected_falling;
+      for (int i = 50; i < 1000; i += 100) {
+        expected_rising.push_back(i);
+        expected_falling.push_back(i + 50);
+      }
+      expected_falling.pop_back(); // out of range
+
+      hysteresis_trigger_search_t<float> rising;
+      rising.configure(0.5f, -0.5f, true);
+
+      std::vector<int> offsets;
+      int state = 0;
+      const int chunk = 37;
+      for (int offset = 0; offset < (int)values.size(); offset += chunk) {
+        std::vector<int> chunk_offsets;
+        auto n = std::min(chunk, (int)values.size() - offset);
+        rising.search(&values[offset], n, state, chunk_offsets);
+        for (auto o : chunk_offsets) {
+          offsets.push_back(o + offset);
+        }
+      }
+      CPPUNIT_ASSERT(expected_rising == offsets);
+
+      hysteresis_trigger_search_t<int16_t> falling;
+      falling.configure(-50, 50, false);
+
+      offsets.clear();
+      state = 0;
+      falling.search(&raw[0], raw.size(), state, offsets);
+      CPPUNIT_ASSERT(expected_falling == offsets);
+
+      // never rearmed, a single trigger
+      rising.configure(0.5f, -2.0f, true);
+      offsets.clear();
+      state = 0;
+      rising.search(&values[0], values.size(), state, offsets);
+      CPPUNIT_ASSERT_EQUAL(size_t(1), offsets.size());
+      CPPUNIT_ASSERT_EQUAL(50, offsets[0]);
+    }
+
+    void
+    qa_digitizer_block::sample_clock_model()
+    {
+      // 1 MHz nominal, the digitizer clock is 50 ppm slow, callbacks arrive with a latency of
+      // 200 to 700 us
+      const double nominal_interval = 1000.0;
+      const double actual_interval = nominal_interval * (1.0 + 50e-6);
+      const uint64_t start = 1500000000000000000ull;
+      const double mean_latency = 450000.0;
+
+      std::mt19937 rng(42);
+      std::uniform_real_distribution<double> latency(200000.0, 700000.0);
+
+      sample_clock_model_t model;
+      model.reset(nominal_interval);
+
+      uint64_t samples = 0;
+      double max_error = 0.0;
+
+      for (int i = 0; i < 5000; i++) {
+        samples += 1000 + (i % 7) * 13;
+        auto truth = start + static_cast<uint64_t>(samples * actual_interval);
+        model.update(samples, truth + static_cast<uint64_t>(latency(rng)));
+
+        if (i > 1000) {
+          double error = static_cast<int64_t>(model.get_timestamp(samples) - truth) - mean_latency;
+          max_error = std::max(max_error, std::abs(error));
+        }
+      }
+
+      // jitter is suppressed at least by a factor of five
+      CPPUNIT_ASSERT(max_error < 50000.0);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(actual_interval, model.get_interval_ns(), 0.02);
+      CPPUNIT_ASSERT_EQUAL(uint64_t{0}, model.get_resync_count());
+
+      // a stall causes a resync
+      samples += 1000;
+      model.update(samples, start + static_cast<uint64_t>(samples * actual_interval) + 50000000);
+      CPPUNIT_ASSERT_EQUAL(uint64_t{1}, model.get_resync_count());
+    }
+
+    void
+    qa_digitizer_block::stream_watchdog()
+    {
+      // 1 MHz, polled every ms, 20 ms stall timeout and 80 ms rate window
+      const uint64_t ms = 1000000;
+      stream_watchdog_t watchdog;
+      watchdog.reset(0, 1e6, 0.75, 20 * ms, 80 * ms);
+
+      // start up latency is tolerated up to the rate window, bursty delivery is fine
+      uint64_t samples = 0;
+      uint64_t now = 50 * ms;
+      for (int i = 0; i < 500; i++, now += ms) {
+        if (i % 5 == 0) {
+          samples += 5000;
+        }
+        CPPUNIT_ASSERT_EQUAL(stream_watchdog_t::WATCHDOG_OK, watchdog.check(samples, now));
+      }
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(1e6, watchdog.get_rate(), 1e5);
+
+      // a stall is detected within the stall timeout plus a poll period, and reported once
+      int polls = 0;
+      auto verdict = stream_watchdog_t::WATCHDOG_OK;
+      while (verdict == stream_watchdog_t::WATCHDOG_OK && polls < 1000) {
+        now += ms;
+        polls++;
+        verdict = watchdog.check(samples, now);
+      }
+      CPPUNIT_ASSERT_EQUAL(stream_watchdog_t::WATCHDOG_STALLED, verdict);
+      CPPUNIT_ASSERT(polls <= 21);
+      CPPUNIT_ASSERT_EQUAL(stream_watchdog_t::WATCHDOG_OK, watchdog.check(samples, now + 100 * ms));
+      CPPUNIT_ASSERT(watchdog.is_triggered());
+
+      // half the expected rate is reported by the end of the first rate window
+      watchdog.reset(now, 1e6, 0.75, 20 * ms, 80 * ms);
+      samples = 0;
+      verdict = stream_watchdog_t::WATCHDOG_OK;
+      for (int i = 0; i < 200 && verdict == stream_watchdog_t::WATCHDOG_OK; i++) {
+        now += ms;
+        samples += 500;
+        verdict = watchdog.check(samples, now);
+      }
+      CPPUNIT_ASSERT_EQUAL(stream_watchdog_t::WATCHDOG_SLOW, verdict);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(5e5, watchdog.get_rate(), 1e4);
+
+      // no samples at all after arm
+      watchdog.reset(now, 1e6, 0.75, 20 * ms, 80 * ms);
+      CPPUNIT_ASSERT_EQUAL(stream_watchdog_t::WATCHDOG_OK, watchdog.check(0, now + 80 * ms));
+      CPPUNIT_ASSERT_EQUAL(stream_watchdog_t::WATCHDOG_STALLED, watchdog.check(0, now + 81 * ms));
+    }
+
+    void
+    qa_digitizer_block::poll_scheduler()
+    {
+      const uint64_t us = 1000;
+      const uint64_t ms = 1000000;
+      poll_scheduler_t scheduler;
+
+      // fixed period, the time spent polling doesn't add up, late polls don't cause a burst
+      scheduler.reset(ms, 1e6, 100000, false, 0.25, 50 * us, 100 * ms);
+      uint64_t now = 1000 * ms;
+      CPPUNIT_ASSERT_EQUAL(now + ms, scheduler.next(0, now));
+      CPPUNIT_ASSERT_EQUAL(now + 2 * ms, scheduler.next(0, now + ms + 300 * us));
+      CPPUNIT_ASSERT_EQUAL(now + 4 * ms + 500 * us, scheduler.next(0, now + 4 * ms + 500 * us));
+      CPPUNIT_ASSERT_EQUAL(now + 5 * ms + 500 * us, scheduler.next(0, now + 4 * ms + 600 * us));
+
+      // adaptive, 1 MS/s into a buffer of 100000 samples: a quarter of the buffer takes 25 ms
+      scheduler.reset(ms, 1e6, 100000, true, 0.25, 50 * us, 100 * ms);
+      CPPUNIT_ASSERT_EQUAL(uint64_t(25 * ms), scheduler.get_max_interval_ns());
+      uint64_t samples = 0;
+      uint64_t deadline = scheduler.next(samples, now);
+      for (int i = 0; i < 100; i++) {
+        samples += (deadline - now) / us;
+        now = deadline;
+        deadline = scheduler.next(samples, now);
+      }
+      CPPUNIT_ASSERT(scheduler.get_interval_ns() > 20 * ms);
+      CPPUNIT_ASSERT(scheduler.get_interval_ns() <= 25 * ms);
+
+      // a burst above the target fill halves the period
+      const auto interval = scheduler.get_interval_ns();
+      samples += 50000;
+      scheduler.next(samples, now);
+      CPPUNIT_ASSERT(scheduler.get_interval_ns() <= interval / 2 + 1);
+
+      // nothing to hand over, the period grows up to the bound
+      for (int i = 0; i < 100; i++) {
+        scheduler.next(samples, now);
+      }
+      CPPUNIT_ASSERT_EQUAL(uint64_t(25 * ms), scheduler.get_interval_ns());
+    }
+
+    void
+    qa_digitizer_block::buffer_tuner()
+    {
+      const uint64_t ms = 1000000;
+      const uint64_t window = 2000 * ms;
+      buffer_tuner_t tuner;
+
+      // disabled
+      tuner.reset(0.0, 1e6, 100000, window, 0);
+      CPPUNIT_ASSERT(!tuner.update(0, 3 * window));
+
+      // 1 MS/s polled every ms with a single 10 ms gap, 10000 samples times the margin are needed
+      // and a chunk of 40 ms meets the latency target of 50 ms. The buffer is way too large.
+      tuner.reset(0.05, 1e6, 500000, window, 0);
+      uint64_t now = 0;
+      uint64_t samples = 0;
+      bool retune = false;
+      while (now < window) {
+        const auto gap = (now == 500 * ms) ? 10 * ms : ms;
+        now += gap;
+        samples += gap / 1000;
+        retune = tuner.update(samples, now);
+      }
+      CPPUNIT_ASSERT(retune);
+      CPPUNIT_ASSERT_EQUAL(uint32_t(40960), tuner.get_driver_buffer_size());
+      CPPUNIT_ASSERT(tuner.get_chunk_size() >= 39999 && tuner.get_chunk_size() <= 40000);
+      CPPUNIT_ASSERT_EQUAL(10 * ms, tuner.get_max_gap_ns());
+
+      // same conditions, applied
+      tuner.reset(0.05, 1e6, 40960, window, 0);
+      now = 0;
+      samples = 0;
+      while (now < window) {
+        const auto gap = (now == 500 * ms) ? 10 * ms : ms;
+        now += gap;
+        samples += gap / 1000;
+        CPPUNIT_ASSERT(!tuner.update(samples, now));
+      }
+
+      // conditions change, a single poll receives 20000 samples and the buffer grows
+      now += ms;
+      samples += 20000;
+      CPPUNIT_ASSERT(!tuner.update(samples, now));
+      while (!tuner.update(samples, now)) {
+        now += ms;
+        samples += 1000;
+      }
+      CPPUNIT_ASSERT_EQUAL(uint32_t(80896), tuner.get_driver_buffer_size());
+
+      // polls slower than the latency target, the largest poll is recommended
+      tuner.reset(0.001, 1e6, 100000, window, 0);
+      now = 0;
+      samples = 0;
+      while (!tuner.update(samples, now)) {
+        now += 5 * ms;
+        samples += 5000;
+      }
+      CPPUNIT_ASSERT_EQUAL(uint32_t(5000), tuner.get_chunk_size());
+    }
+
+    void
+    qa_digitizer_block::config_snapshot()
+    {
+      rcu_snapshot_t<int, 2> snapshot;
+      CPPUNIT_ASSERT(snapshot.read() == nullptr);
+
+      // no reader online, replaced snapshots are freed right away
+      snapshot.publish(std::unique_ptr<const int>(new int(1)));
+      snapshot.publish(std::unique_ptr<const int>(new int(2)));
+      CPPUNIT_ASSERT_EQUAL(2, *snapshot.read());
+      CPPUNIT_ASSERT_EQUAL(size_t(0), snapshot.retired());
+
+      // the snapshot read is kept until the reader is quiescent
+      snapshot.set_online(0, true);
+      snapshot.set_online(1, true);
+      const int *held = snapshot.read();
+      snapshot.publish(std::unique_ptr<const int>(new int(3)));
+      snapshot.publish(std::unique_ptr<const int>(new int(4)));
+      CPPUNIT_ASSERT_EQUAL(2, *held);
+      CPPUNIT_ASSERT_EQUAL(4, *snapshot.read());
+      CPPUNIT_ASSERT_EQUAL(size_t(2), snapshot.retired());
+
+      snapshot.quiescent(0);
+      snapshot.publish(std::unique_ptr<const int>(new int(5)));
+      CPPUNIT_ASSERT_EQUAL(size_t(3), snapshot.retired());
+
+      // the first reader might have read 4 since, only 2 and 3 are freed
+      snapshot.quiescent(1);
+      snapshot.publish(std::unique_ptr<const int>(new int(6)));
+      CPPUNIT_ASSERT_EQUAL(size_t(2), snapshot.retired());
+
+      // offline readers don't hold anything
+      snapshot.set_online(0, false);
+      snapshot.set_online(1, false);
+      snapshot.publish(std::unique_ptr<const int>(new int(7)));
+      CPPUNIT_ASSERT_EQUAL(size_t(0), snapshot.retired());
+      CPPUNIT_ASSERT_EQUAL(7, *snapshot.read());
+
+      // the version of the configuration goes along with the acq_info tag
+      acq_info_t acq_info{};
+      acq_info.config_version = 42;
+      for (auto encoding : {TAG_ENCODING_TUPLE, TAG_ENCODING_BINARY}) {
+        auto decoded = decode_acq_info_tag(make_acq_info_tag(acq_info, 0, encoding));
+        CPPUNIT_ASSERT_EQUAL(uint32_t(42), decoded.config_version);
+      }
+    }
+
+    void
+    qa_digitizer_block::device_config_compare()
+    {
+      device_config_t applied {};
+      applied.channels.resize(2);
+      applied.ports.resize(1);
+      applied.channels[0].enabled = true;
+      applied.samp_rate = 1e6;
+
+      // host-side settings don't require a reconfiguration
+      auto config = applied;
+      config.channels[0].calibration_scale = 2.0;
+      config.channels[0].interlock_max = 1.0;
+      CPPUNIT_ASSERT(applied.same_device_settings(config));
+
+      config.channels[1].range = 5.0;
+      CPPUNIT_ASSERT(!applied.same_device_settings(config));
+
+      config = applied;
+      config.ports[0].enabled = true;
+      CPPUNIT_ASSERT(!applied.same_device_settings(config));
+
+      config = applied;
+      config.trigger.threshold = 0.5;
+      CPPUNIT_ASSERT(!applied.same_device_settings(config));
+
+      config = applied;
+      config.samp_rate = 2e6;
+      CPPUNIT_ASSERT(!applied.same_device_settings(config));
+    }
+
+    static void
+    count_fast_interlocks(int64_t timestamp, void *userdata)
+    {
+      (*static_cast<std::atomic<int> *>(userdata))++;
+    }
+
+    void
+    qa_digitizer_block::streaming_fast_interlock()
+    {
+      int samples = 2000;
+      int presamples = 200;
+      int buffer_size = samples + presamples;
+
+      // Channel A crosses 3.0 once per buffer, channel B never reaches it
+      fill_data(samples, presamples);
+
+      auto fg = make_test_flowgraph(10000.0);
+
+      std::atomic<int> calls(0);
+
+      fg.source->set_samp_rate(10000.0);
+      fg.source->set_buffer_size(buffer_size);
+      fg.source->set_data(d_cha_vec, d_chb_vec, d_port_vec);
+      fg.source->set_streaming(0.0001);
+      fg.source->set_fast_interlock("A", -std::numeric_limits<double>::infinity(), 3.0);
+      fg.source->set_fast_interlock("B", -std::numeric_limits<double>::infinity(), 3.0);
+      fg.source->set_fast_interlock_callback(&count_fast_interlocks, &calls);
+
+      CPPUNIT_ASSERT_THROW(fg.source->set_fast_interlock("A", 1.0, -1.0), std::invalid_argument);
+      CPPUNIT_ASSERT_THROW(fg.source->set_fast_interlock_latency_budget(-1), std::invalid_argument);
+
+      fg.top->start();
+      std::this_thread::sleep_for(std::chrono::microseconds(2000));
+      fg.top->stop();
+      fg.top->wait();
+
+      // One interlock per buffer, evaluated before the buffer is handed over to the work thread
+      int nbuffers = 0;
+      for (auto &tag: fg.sink_sig_a->tags()) {
+        if (pmt::symbol_to_string(tag.key) == acq_info_tag_name) {
+          nbuffers++;
+        }
+      }
+
+      CPPUNIT_ASSERT(nbuffers > 0);
+      CPPUNIT_ASSERT(calls.load() >= nbuffers);
+
+      auto metrics = fg.source->get_metrics();
+      CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(calls.load()), metrics.fast_interlocks);
+      CPPUNIT_ASSERT(metrics.max_fast_interlock_latency_ns >= metrics.fast_interlock_latency_ns);
+    }
+
+    void
+    qa_digitizer_block::streaming_event_driven()
+    {
+      auto fg = make_test_flowgraph();
+
+      // The driver buffer holds 50 ms of data, polling every 100 ms would lose samples. The
+      // paced generator wakes the poll thread once per 10 ms chunk instead.
+      fg.source->set_buffer_size(1000);
+      fg.source->set_nr_buffers(16);
+      fg.source->set_driver_buffer_size(5000);
+      fg.source->set_streaming(0.1);
+      fg.source->set_stream_generator(SIMULATION_WAVEFORM_SINE, 2.0, 1000.0);
+      fg.source->set_stream_pacing(1.0);
+
+      fg.top->start();
+      std::this_thread::sleep_for(std::chrono::milliseconds(300));
+      fg.top->stop();
+      fg.top->wait();
+
+      CPPUNIT_ASSERT(fg.sink_sig_a->data().size() >= 10000);
+      CPPUNIT_ASSERT_EQUAL(uint64_t {0}, fg.source->get_metrics().lost_buffers);
+    }
+
+    void
+    qa_digitizer_block::streaming_generator()
+    {
+      int buffer_size = 1000;
+
+      auto fg = make_test_flowgraph();
+
+      // 1 kHz sine, i.e. 100 samples per period, delivered as fast as possible in callbacks of
+      // varying size
+      fg.source->set_buffer_size(buffer_size);
+      fg.source->set_nr_buffers(16);
+      fg.source->set_streaming(0.0001);
+      fg.source->set_stream_generator(SIMULATION_WAVEFORM_SINE, 2.0, 1000.0);
+      fg.source->set_stream_pacing(0.0);
+      fg.source->set_stream_faults(0.5, 0.0);
+
+      fg.top->start();
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      fg.top->stop();
+      fg.top->wait();
+
+      auto dataa = fg.sink_sig_a->data();
+      CPPUNIT_ASSERT(dataa.size() >= 100);
+
+      float max_value = 0.0f;
+      for (auto value : dataa) {
+        max_value = std::max(max_value, std::abs(value));
+      }
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(2.0, max_value, 0.01);
+
+      // port bit 0 follows the sign of channel A
+      auto datap = fg.sink_port->data();
+      auto size = std::min(dataa.size(), datap.size());
+      for (size_t i = 0; i < size; i++) {
+        CPPUNIT_ASSERT_EQUAL(dataa[i] > 0.0f ? 1 : 0, static_cast<int>(datap[i]));
+      }
+
+      CPPUNIT_ASSERT_EQUAL(uint64_t {0}, fg.source->get_injected_overruns());
+
+      CPPUNIT_ASSERT_THROW(fg.source->set_stream_pacing(-1.0), std::invalid_argument);
+      CPPUNIT_ASSERT_THROW(fg.source->set_stream_faults(2.0, 0.0), std::invalid_argument);
+      CPPUNIT_ASSERT_THROW(fg.source->set_stream_generator(SIMULATION_WAVEFORM_SINE, 1.0, 0.0), std::invalid_argument);
+    }
+
+    void
+    qa_digitizer_block::streaming_replay()
+    {
+      const int buffer_size = 1000;
+      const int length = 10 * buffer_size;
+
+      // channel A raw samples, channel B voltages, the port is not recorded
+      std::vector<int16_t> raw(length);
+      for (int i = 0; i < length; i++) {
+        raw[i] = static_cast<int16_t>(i % 20000 - 10000);
+      }
+
+      const std::string raw_file = "/tmp/qa_digitizer_block_replay_a.raw";
+      const std::string csv_file = "/tmp/qa_digitizer_block_replay_b.csv";
+      {
+        std::ofstream a(raw_file, std::ios::binary);
+        a.write(reinterpret_cast<const char *>(raw.data()), raw.size() * sizeof(int16_t));
+
+        std::ofstream b(csv_file);
+        for (int i = 0; i < length; i++) {
+          b << (i % 2 ? 1.0 : -1.0) << "\n";
+        }
+      }
+
+      auto top = gr::make_top_block("test");
+      auto source = replay_source::make(raw_file, csv_file, "", false);
+      auto sink_sig_a = blocks::vector_sink_f::make(1);
+      auto sink_sig_b = blocks::vector_sink_f::make(1);
+      auto sink_port = blocks::vector_sink_b::make(1);
+
+      top->connect(source, 0, sink_sig_a, 0);
+      top->connect(source, 2, sink_sig_b, 0);
+      top->connect(source, 4, sink_port, 0);
+
+      CPPUNIT_ASSERT_EQUAL(uint64_t(length), source->get_recording_length());
+
+      source->set_auto_arm(true);
+      source->set_samp_rate(100000);
+      source->set_buffer_size(buffer_size);
+      source->set_nr_buffers(16);
+      source->set_streaming(0.0001);
+      source->set_replay_pacing(0.0);
+
+      top->start();
+      for (int i = 0; i < 1000 && !source->is_replay_finished(); i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      top->stop();
+      top->wait();
+
+      CPPUNIT_ASSERT(source->is_replay_finished());
+      CPPUNIT_ASSERT_EQUAL(uint64_t(length), source->get_replayed_samples());
+
+      auto dataa = sink_sig_a->data();
+      auto datab = sink_sig_b->data();
+      auto datap = sink_port->data();
+      CPPUNIT_ASSERT_EQUAL(size_t(length), dataa.size());
+      CPPUNIT_ASSERT_EQUAL(size_t(length), datab.size());
+
+      for (int i = 0; i < length; i++) {
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(raw[i] * 20.0 / 32767, dataa[i], 1e-4);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(i % 2 ? 1.0 : -1.0, datab[i], 1e-3);
+        CPPUNIT_ASSERT_EQUAL(0, static_cast<int>(datap[i]));
+      }
+
+      CPPUNIT_ASSERT_THROW(source->set_replay_pacing(-1.0), std::invalid_argument);
+      CPPUNIT_ASSERT_THROW(replay_source::make("", "", "", true), std::invalid_argument);
+
+      std::remove(raw_file.c_str());
+      std::remove(csv_file.c_str());
+    }
+
+    void
+    qa_digitizer_block::streaming_aggregated_output()
+    {
+      int samples = 2000;
+      int presamples = 200;
+      int buffer_size = samples + presamples;
+      int factor = 10;
+
+      fill_data(samples, presamples);
+
+      for (auto mode : {DOWNSAMPLING_MODE_MIN_MAX_AGG, DOWNSAMPLING_MODE_AVERAGE, DOWNSAMPLING_MODE_DECIMATE}) {
+        auto fg = make_test_flowgraph();
+
+        fg.source->set_buffer_size(buffer_size);
+        fg.source->set_data(d_cha_vec, d_chb_vec, d_port_vec);
+        fg.source->set_streaming(0.0001);
+        fg.source->set_aggregated_output(mode, factor);
+
+        auto aggregated = fg.source->get_aggregated_source();
+        CPPUNIT_ASSERT(aggregated);
+        CPPUNIT_ASSERT_EQUAL(2, aggregated->nchannels());
+
+        auto sink_agg_a = blocks::vector_sink_f::make(1);
+        auto sink_agg_err_a = blocks::vector_sink_f::make(1);
+        fg.top->connect(aggregated, 0, sink_agg_a, 0);
+        fg.top->connect(aggregated, 1, sink_agg_err_a, 0);
+        fg.top->connect(aggregated, 2, blocks::vector_sink_f::make(1), 0);
+        fg.top->connect(aggregated, 3, blocks::vector_sink_f::make(1), 0);
+
+        fg.top->start();
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        fg.top->stop();
+        fg.top->wait();
+
+        // Full-rate outputs are not affected
+        auto dataa = fg.sink_sig_a->data();
+        auto erra = fg.sink_err_a->data();
+        CPPUNIT_ASSERT(dataa.size() != 0);
+        auto size = std::min(dataa.size(), d_cha_vec.size());
+        ASSERT_VECTOR_EQUAL(d_cha_vec.begin(), d_cha_vec.begin() + size, dataa.begin());
+
+        // Aggregated items are computed from the same chunks
+        auto agg = sink_agg_a->data();
+        auto agg_err = sink_agg_err_a->data();
+        CPPUNIT_ASSERT(agg.size() != 0);
+        CPPUNIT_ASSERT(agg.size() <= dataa.size() / factor);
+
+        for (size_t k = 0; k < agg.size(); k++) {
+          auto first = dataa.begin() + k * factor;
+          float expected, expected_error;
+          if (mode == DOWNSAMPLING_MODE_MIN_MAX_AGG) {
+            auto minmax = std::minmax_element(first, first + factor);
+            expected = (*minmax.second + *minmax.first) / 2.0f;
+            expected_error = (*minmax.second - *minmax.first) / 4.0f;
+          }
+          else if (mode == DOWNSAMPLING_MODE_AVERAGE) {
+            expected = std::accumulate(first, first + factor, 0.0) / factor;
+            expected_error = std::accumulate(erra.begin() + k * factor, erra.begin() + (k + 1) * factor, 0.0)
+                    / factor / std::sqrt(factor);
+          }
+          else {
+            expected = *first;
+            expected_error = erra[k * factor];
+          }
+          CPPUNIT_ASSERT_DOUBLES_EQUAL(expected, agg[k], 1e-5);
+          CPPUNIT_ASSERT_DOUBLES_EQUAL(expected_error, agg_err[k], 1e-6);
+        }
+
+        // Timebase and acq_info tags report the aggregated timebase
+        int nr_timebase = 0;
+        int nr_acq_info = 0;
+        for (const auto &tag : sink_agg_a->tags()) {
+          if (get_tag_kind(tag) == TAG_KIND_TIMEBASE_INFO) {
+            CPPUNIT_ASSERT_DOUBLES_EQUAL(factor / 100000.0, decode_timebase_info_tag(tag), 1e-12);
+            nr_timebase++;
+          }
+          else if (get_tag_kind(tag) == TAG_KIND_ACQ_INFO) {
+            CPPUNIT_ASSERT_DOUBLES_EQUAL(factor / 100000.0, decode_acq_info_tag(tag).timebase, 1e-12);
+            nr_acq_info++;
+          }
+        }
+        CPPUNIT_ASSERT_EQUAL(1, nr_timebase);
+        CPPUNIT_ASSERT(nr_acq_info != 0);
+      }
+
+      // NONE disables the aggregated stream
+      auto source = simulation_source::make();
+      source->set_aggregated_output(DOWNSAMPLING_MODE_AVERAGE, 4);
+      CPPUNIT_ASSERT(source->get_aggregated_source());
+      source->set_aggregated_output(DOWNSAMPLING_MODE_NONE, 0);
+      CPPUNIT_ASSERT(!source->get_aggregated_source());
+      CPPUNIT_ASSERT_THROW(source->set_aggregated_output(DOWNSAMPLING_MODE_AVERAGE, 1), std::invalid_argument);
+    }
+
+    void
+    qa_digitizer_block::streaming_frame_output()
+    {
+      int samples = 2000;
+      int presamples = 200;
+      int buffer_size = samples + presamples;
+      int frame_samples = 110;  // the trigger (sample 200) is within the second frame
+      double samp_rate = 100000.0;
+
+      fill_data(samples, presamples);
+
+      auto top = gr::make_top_block("test");
+      auto source = gr::digitizers::simulation_source::make();
+      source->set_samp_rate(samp_rate);
+      source->set_buffer_size(buffer_size);
+      source->set_data(d_cha_vec, d_chb_vec, d_port_vec);
+      source->set_streaming(0.0001);
+      source->set_aichan_trigger("A", trigger_direction_t::TRIGGER_DIRECTION_RISING, 1.0);
+
+      // Buffer size must be a multiple of the frame
+      source->set_frame_output(frame_samples + 1);
+      CPPUNIT_ASSERT(!source->start());
+      source->stop();
+
+      source->set_frame_output(frame_samples);
+      auto layout = source->get_frame_layout();
+      CPPUNIT_ASSERT_EQUAL(frame_samples, layout.samples);
+      CPPUNIT_ASSERT_EQUAL(frame_samples * (2 * 2 * sizeof(float) + 1), layout.frame_size());
+
+      auto splitter = frame_splitter::make(2, 1, frame_samples);
+      auto sink_frames = blocks::vector_sink_b::make(layout.frame_size());
+      auto sink_sig_a = blocks::vector_sink_f::make(1);
+      auto sink_sig_b = blocks::vector_sink_f::make(1);
+      auto sink_port = blocks::vector_sink_b::make(1);
+
+      top->connect(source, 0, sink_frames, 0);
+      top->connect(source, 0, splitter, 0);
+      top->connect(splitter, 0, sink_sig_a, 0);
+      top->connect(splitter, 1, blocks::vector_sink_f::make(1), 0);
+      top->connect(splitter, 2, sink_sig_b, 0);
+      top->connect(splitter, 3, blocks::vector_sink_f::make(1), 0);
+      top->connect(splitter, 4, sink_port, 0);
+
+      top->start();
+      std::this_thread::sleep_for(std::chrono::milliseconds(2));
+      top->stop();
+      top->wait();
+
+      // Split streams are the same as the per-channel outputs
+      auto dataa = sink_sig_a->data();
+      CPPUNIT_ASSERT(dataa.size() != 0);
+      auto size = std::min(dataa.size(), d_cha_vec.size());
+      ASSERT_VECTOR_EQUAL(d_cha_vec.begin(), d_cha_vec.begin() + size, dataa.begin());
+
+      auto datab = sink_sig_b->data();
+      size = std::min(datab.size(), d_chb_vec.size());
+      ASSERT_VECTOR_EQUAL(d_chb_vec.begin(), d_chb_vec.begin() + size, datab.begin());
+
+      auto datap = sink_port->data();
+      size = std::min(datap.size(), d_port_vec.size());
+      ASSERT_VECTOR_EQUAL(d_port_vec.begin(), d_port_vec.begin() + size, reinterpret_cast<uint8_t *>(&datap[0]));
+
+      // Frames are channel-blocked
+      auto frames = sink_frames->data();
+      CPPUNIT_ASSERT(frames.size() >= layout.frame_size());
+      auto frame = static_cast<const void *>(frames.data());
+      ASSERT_VECTOR_EQUAL(d_cha_vec.begin(), d_cha_vec.begin() + frame_samples, layout.values(frame, 0));
+      ASSERT_VECTOR_EQUAL(d_chb_vec.begin(), d_chb_vec.begin() + frame_samples, layout.values(frame, 1));
+      ASSERT_VECTOR_EQUAL(d_port_vec.begin(), d_port_vec.begin() + frame_samples, layout.port(frame, 0));
+
+      // A single tag set on the frames, triggers carry the distance to the trigger sample
+      const auto frames_per_chunk = static_cast<uint64_t>(buffer_size / frame_samples);
+      int nr_acq_info = 0;
+      int nr_triggers = 0;
+      for (const auto &tag : sink_frames->tags()) {
+        if (get_tag_kind(tag) == TAG_KIND_ACQ_INFO) {
+          CPPUNIT_ASSERT_EQUAL(uint64_t(0), tag.offset % frames_per_chunk);
+          nr_acq_info++;
+        }
+        else if (get_tag_kind(tag) == TAG_KIND_TRIGGER) {
+          CPPUNIT_ASSERT_EQUAL(uint64_t(1), tag.offset % frames_per_chunk);
+          CPPUNIT_ASSERT_DOUBLES_EQUAL((presamples - frame_samples) / samp_rate,
+                  decode_trigger_tag(tag).trigger_offset, 1e-9);
+          nr_triggers++;
+        }
+      }
+      CPPUNIT_ASSERT_EQUAL(frames.size() / layout.frame_size() / frames_per_chunk, static_cast<size_t>(nr_acq_info));
+      CPPUNIT_ASSERT(nr_triggers != 0);
+
+      // The splitter moves the triggers back to the trigger sample
+      int nr_split_triggers = 0;
+      for (const auto &tag : sink_sig_a->tags()) {
+        if (get_tag_kind(tag) == TAG_KIND_TRIGGER) {
+          CPPUNIT_ASSERT_EQUAL(uint64_t(presamples), tag.offset % buffer_size);
+          CPPUNIT_ASSERT_DOUBLES_EQUAL(0.0, decode_trigger_tag(tag).trigger_offset, 1e-9);
+          nr_split_triggers++;
+        }
+      }
+      CPPUNIT_ASSERT_EQUAL(nr_triggers, nr_split_triggers);
+    }
+
+    void
+    qa_digitizer_block::streaming_packed_ports()
+    {
+      int samples = 2000;
+      int presamples = 200;
+      int buffer_size = samples + presamples;
+
+      fill_data(samples, presamples);
+
+      auto top = gr::make_top_block("test");
+      auto source = gr::digitizers::simulation_source::make();
+      source->set_samp_rate(100000.0);
+      source->set_buffer_size(buffer_size);
+      source->set_data(d_cha_vec, d_chb_vec, d_port_vec);
+      source->set_streaming(0.0001);
+      source->set_di_trigger(7, trigger_direction_t::TRIGGER_DIRECTION_RISING);
+
+      // Not together with the frame output
+      source->set_packed_ports(true);
+      source->set_frame_output(100);
+      CPPUNIT_ASSERT(!source->start());
+      source->stop();
+      source->set_frame_output(0);
+
+      // A single port is packed into 16-bit words
+      CPPUNIT_ASSERT_EQUAL(sizeof(uint16_t), source->get_packed_port_size());
+      CPPUNIT_ASSERT_EQUAL(5, source->output_signature()->max_streams());
+      CPPUNIT_ASSERT_EQUAL(static_cast<int>(sizeof(uint16_t)), source->output_signature()->sizeof_stream_item(4));
+
+      auto sink_sig_a = blocks::vector_sink_f::make(1);
+      auto sink_packed = blocks::vector_sink_s::make(1);
+
+      top->connect(source, 0, sink_sig_a, 0);
+      top->connect(source, 1, blocks::vector_sink_f::make(1), 0);
+      top->connect(source, 2, blocks::vector_sink_f::make(1), 0);
+      top->connect(source, 3, blocks::vector_sink_f::make(1), 0);
+      top->connect(source, 4, sink_packed, 0);
+
+      top->start();
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      top->stop();
+      top->wait();
+
+      // Port 0 occupies the low byte
+      auto packed = sink_packed->data();
+      CPPUNIT_ASSERT(packed.size() >= static_cast<size_t>(buffer_size));
+      for (int i = 0; i < buffer_size; i++) {
+        CPPUNIT_ASSERT_EQUAL(static_cast<int>(d_port_vec[i]), static_cast<int>(static_cast<uint16_t>(packed[i])));
+      }
+
+      // Pin 7 rises on every 128th sample out of 256, the trigger is tagged on the packed
+      // output and the channels alike
+      int nr_triggers = 0;
+      for (const auto &tag : sink_packed->tags()) {
+        if (get_tag_kind(tag) == TAG_KIND_TRIGGER) {
+          CPPUNIT_ASSERT_EQUAL(uint64_t(128), tag.offset % buffer_size % 256);
+          nr_triggers++;
+        }
+      }
+      CPPUNIT_ASSERT(nr_triggers != 0);
+
+      int nr_channel_triggers = 0;
+      for (const auto &tag : sink_sig_a->tags()) {
+        if (get_tag_kind(tag) == TAG_KIND_TRIGGER) {
+          nr_channel_triggers++;
+        }
+      }
+      CPPUNIT_ASSERT_EQUAL(nr_triggers, nr_channel_triggers);
+
+      // Per-port outputs are restored
+      source->set_packed_ports(false);
+      CPPUNIT_ASSERT_EQUAL(size_t(0), source->get_packed_port_size());
+      CPPUNIT_ASSERT_EQUAL(1, source->output_signature()->sizeof_stream_item(4));
+    }
+
+    void
+    qa_digitizer_block::streaming_triggered_windows()
+    {
+      int samples = 2000;
+      int presamples = 200;
+      int buffer_size = samples + presamples;
+      int window_pre = 100;
+      int window_post = 300;
+      int window_size = window_pre + window_post;
+
+      fill_data(samples, presamples);
+
+      auto top = gr::make_top_block("test");
+      auto source = gr::digitizers::simulation_source::make();
+      source->set_samp_rate(100000.0);
+      source->set_samples(window_pre, window_post);
+      source->set_buffer_size(buffer_size);
+      source->set_data(d_cha_vec, d_chb_vec, d_port_vec);
+      source->set_streaming(0.0001);
+      source->set_aichan_trigger("A", trigger_direction_t::TRIGGER_DIRECTION_RISING, 1.0);
+      source->set_triggered_windows(true);
+
+      auto sink_sig_a = blocks::vector_sink_f::make(1);
+      auto sink_sig_b = blocks::vector_sink_f::make(1);
+      auto sink_port = blocks::vector_sink_b::make(1);
+
+      top->connect(source, 0, sink_sig_a, 0);
+      top->connect(source, 1, blocks::vector_sink_f::make(1), 0);
+      top->connect(source, 2, sink_sig_b, 0);
+      top->connect(source, 3, blocks::vector_sink_f::make(1), 0);
+      top->connect(source, 4, sink_port, 0);
+
+      top->start();
+      std::this_thread::sleep_for(std::chrono::milliseconds(2));
+      top->stop();
+      top->wait();
+
+      // Only the windows around the trigger (sample 200 of each chunk) are delivered
+      auto dataa = sink_sig_a->data();
+      auto datab = sink_sig_b->data();
+      auto datap = sink_port->data();
+      CPPUNIT_ASSERT(dataa.size() != 0);
+      CPPUNIT_ASSERT_EQUAL(size_t(0), dataa.size() % window_size);
+
+      const auto first = presamples - window_pre;
+      for (size_t w = 0; w < dataa.size() / window_size; w++) {
+        ASSERT_VECTOR_EQUAL(d_cha_vec.begin() + first, d_cha_vec.begin() + first + window_size,
+                dataa.begin() + w * window_size);
+        ASSERT_VECTOR_EQUAL(d_chb_vec.begin() + first, d_chb_vec.begin() + first + window_size,
+                datab.begin() + w * window_size);
+        ASSERT_VECTOR_EQUAL(d_port_vec.begin() + first, d_port_vec.begin() + first + window_size,
+                reinterpret_cast<uint8_t *>(&datap[w * window_size]));
+      }
+
+      // Each window carries its acq_info tag and the trigger tag on the trigger sample
+      size_t nr_acq_info = 0;
+      size_t nr_triggers = 0;
+      for (const auto &tag : sink_sig_a->tags()) {
+        if (get_tag_kind(tag) == TAG_KIND_ACQ_INFO) {
+          CPPUNIT_ASSERT_EQUAL(uint64_t(0), tag.offset % window_size);
+          nr_acq_info++;
+        }
+        else if (get_tag_kind(tag) == TAG_KIND_TRIGGER) {
+          CPPUNIT_ASSERT_EQUAL(uint64_t(window_pre), tag.offset % window_size);
+          nr_triggers++;
+        }
+      }
+      CPPUNIT_ASSERT_EQUAL(dataa.size() / window_size, nr_acq_info);
+      CPPUNIT_ASSERT_EQUAL(dataa.size() / window_size, nr_triggers);
+
+      // Frame output can't be combined with the windows
+      auto frames = simulation_source::make();
+      frames->set_buffer_size(buffer_size);
+      frames->set_data(d_cha_vec, d_chb_vec, d_port_vec);
+      frames->set_streaming(0.0001);
+      frames->set_frame_output(100);
+      frames->set_triggered_windows(true);
+      CPPUNIT_ASSERT(!frames->start());
+      frames->stop();
+    }
+
+    void
+    qa_digitizer_block::streaming_acq_info_delta()
+    {
+      int samples = 2000;
+      int presamples = 200;
+      int buffer_size = samples + presamples;
+      int anchor_interval = 4;
+
+      fill_data(samples, presamples);
+
+      auto top = gr::make_top_block("test");
+      auto source = gr::digitizers::simulation_source::make();
+      source->set_buffer_size(buffer_size);
+      source->set_data(d_cha_vec, d_chb_vec, d_port_vec);
+      source->set_streaming(0.0001);
+      source->set_acq_info_anchor_interval(anchor_interval);
+
+      auto sink_sig_a = blocks::vector_sink_f::make(1);
+      auto sink_port = blocks::vector_sink_b::make(1);
+
+      top->connect(source, 0, sink_sig_a, 0);
+      top->connect(source, 1, blocks::vector_sink_f::make(1), 0);
+      top->connect(source, 2, blocks::vector_sink_f::make(1), 0);
+      top->connect(source, 3, blocks::vector_sink_f::make(1), 0);
+      top->connect(source, 4, sink_port, 0);
+
+      top->start();
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+      top->stop();
+      top->wait();
+
+      // The content doesn't change, the acq_info tags are attached to the anchor chunks only
+      const auto nchunks = sink_sig_a->data().size() / buffer_size;
+      CPPUNIT_ASSERT(nchunks != 0);
+
+      for (const auto &sink_tags : {sink_sig_a->tags(), sink_port->tags()}) {
+        size_t nr_acq_info = 0;
+        for (const auto &tag : sink_tags) {
+          if (get_tag_kind(tag) == TAG_KIND_ACQ_INFO) {
+            CPPUNIT_ASSERT_EQUAL(uint64_t(0), tag.offset % (anchor_interval * buffer_size));
+            nr_acq_info++;
+          }
+        }
+        CPPUNIT_ASSERT_EQUAL((nchunks + anchor_interval - 1) / anchor_interval, nr_acq_info);
+      }
+
+      CPPUNIT_ASSERT_THROW(source->set_acq_info_anchor_interval(-1), std::invalid_argument);
+    }
+
+    void
+    qa_digitizer_block::streaming_timing_realignment()
+    {
+      int samples = 2000;
+      int presamples = 200;
+      int buffer_size = samples + presamples;
+
+      fill_data(samples, presamples);
+
+      auto top = gr::make_top_block("test");
+      auto source = gr::digitizers::simulation_source::make();
+      source->set_buffer_size(buffer_size);
+      source->set_data(d_cha_vec, d_chb_vec, d_port_vec);
+      source->set_streaming(0.0001);
+      source->set_aichan_trigger("A", trigger_direction_t::TRIGGER_DIRECTION_RISING, 1.0);
+
+      // The first trigger is matched to the only WR event, the others time out right away
+      const int64_t wr_stamp = 42;
+      source->set_timing_realignment(true, 10.0f, 0.0f);
+      CPPUNIT_ASSERT(source->add_timing_event("event", wr_stamp, static_cast<int64_t>(get_timestamp_nano_utc())));
+
+      auto sink_sig_a = blocks::vector_sink_f::make(1);
+      auto sink_port = blocks::vector_sink_b::make(1);
+
+      top->connect(source, 0, sink_sig_a, 0);
+      top->connect(source, 1, blocks::vector_sink_f::make(1), 0);
+      top->connect(source, 2, blocks::vector_sink_f::make(1), 0);
+      top->connect(source, 3, blocks::vector_sink_f::make(1), 0);
+      top->connect(source, 4, sink_port, 0);
+
+      top->start();
+      std::this_thread::sleep_for(std::chrono::milliseconds(2));
+      top->stop();
+      top->wait();
+
+      // Samples are forwarded as they are
+      auto dataa = sink_sig_a->data();
+      CPPUNIT_ASSERT(dataa.size() != 0);
+      auto size = std::min(dataa.size(), d_cha_vec.size());
+      ASSERT_VECTOR_EQUAL(d_cha_vec.begin(), d_cha_vec.begin() + size, dataa.begin());
+
+      for (const auto &sink_tags : {sink_sig_a->tags(), sink_port->tags()}) {
+        std::vector<uint64_t> triggers;
+        std::vector<realignment_t> realignments;
+        for (const auto &tag : sink_tags) {
+          if (get_tag_kind(tag) == TAG_KIND_TRIGGER) {
+            triggers.push_back(tag.offset);
+          }
+          else if (tag.key == realignment_tag_key()) {
+            realignments.push_back(decode_realignment_tag(tag));
+            CPPUNIT_ASSERT(tag.offset >= realignments.back().trigger_offset);
+          }
+        }
+
+        // The last trigger might still be pending when stopped
+        CPPUNIT_ASSERT(!realignments.empty());
+        CPPUNIT_ASSERT(realignments.size() <= triggers.size());
+        for (size_t i = 0; i < realignments.size(); i++) {
+          CPPUNIT_ASSERT_EQUAL(triggers[i], realignments[i].trigger_offset);
+          if (i == 0) {
+            CPPUNIT_ASSERT_EQUAL(wr_stamp, realignments[i].timestamp);
+            CPPUNIT_ASSERT_EQUAL(uint32_t{0}, realignments[i].status);
+          }
+          else {
+            CPPUNIT_ASSERT_EQUAL(uint32_t{channel_status_t::CHANNEL_STATUS_TIMEOUT_WAITING_WR_OR_REALIGNMENT_EVENT},
+                    realignments[i].status);
+          }
+        }
+      }
+    }
+
+  } /* namespace digitizers */
+} /* namespace gr */
@@ -28,16 +28,88 @@ namespace gr {
       CPPUNIT_TEST_SUITE(qa_digitizer_block);
       CPPUNIT_TEST(rapid_block_basics);
       CPPUNIT_TEST(rapid_block_correct_tags);
+      CPPUNIT_TEST(rapid_block_bulk_readout);
+      CPPUNIT_TEST(rapid_block_overlapped_readout);
+      CPPUNIT_TEST(rapid_block_async_readout);
       CPPUNIT_TEST(streaming_basics);
       CPPUNIT_TEST(streaming_correct_tags);
+      CPPUNIT_TEST(streaming_shared_tags);
+      CPPUNIT_TEST(streaming_tag_encoding);
+      CPPUNIT_TEST(streaming_calibration);
+      CPPUNIT_TEST(streaming_condition_triggers);
+      CPPUNIT_TEST(streaming_wait_strategy);
+      CPPUNIT_TEST(streaming_thread_scheduling);
+      CPPUNIT_TEST(streaming_thread_scheduling_failed);
+      CPPUNIT_TEST(streaming_buffer_memory_policy);
+      CPPUNIT_TEST(streaming_realtime_memory);
+      CPPUNIT_TEST(streaming_buffer_growth);
+      CPPUNIT_TEST(streaming_chunk_consumers);
+      CPPUNIT_TEST(streaming_trigger_reserve);
+      CPPUNIT_TEST(streaming_metrics);
+      CPPUNIT_TEST(streaming_config_transaction);
+      CPPUNIT_TEST(streaming_device_group);
+      CPPUNIT_TEST(conversion_pool);
+      CPPUNIT_TEST(trigger_search);
+      CPPUNIT_TEST(sample_clock_model);
+      CPPUNIT_TEST(stream_watchdog);
+      CPPUNIT_TEST(poll_scheduler);
+      CPPUNIT_TEST(buffer_tuner);
+      CPPUNIT_TEST(config_snapshot);
+      CPPUNIT_TEST(device_config_compare);
+      CPPUNIT_TEST(streaming_fast_interlock);
+      CPPUNIT_TEST(streaming_generator);
+      CPPUNIT_TEST(streaming_event_driven);
+      CPPUNIT_TEST(streaming_replay);
+      CPPUNIT_TEST(streaming_aggregated_output);
+      CPPUNIT_TEST(streaming_frame_output);
+      CPPUNIT_TEST(streaming_packed_ports);
+      CPPUNIT_TEST(streaming_triggered_windows);
+      CPPUNIT_TEST(streaming_acq_info_delta);
+      CPPUNIT_TEST(streaming_timing_realignment);
       CPPUNIT_TEST_SUITE_END();
 
     private:
       void fill_data(unsigned samples, unsigned presamples);
       void rapid_block_basics();
       void rapid_block_correct_tags();
+      void rapid_block_bulk_readout();
+      void rapid_block_overlapped_readout();
+      void rapid_block_async_readout();
       void streaming_basics();
       void streaming_correct_tags();
+      void streaming_shared_tags();
+      void streaming_tag_encoding();
+      void streaming_calibration();
+      void streaming_condition_triggers();
+      void streaming_wait_strategy();
+      void streaming_thread_scheduling();
+      void streaming_thread_scheduling_failed();
+      void streaming_buffer_memory_policy();
+      void streaming_realtime_memory();
+      void streaming_buffer_growth();
+      void streaming_chunk_consumers();
+      void streaming_trigger_reserve();
+      void streaming_metrics();
+      void streaming_config_transaction();
+      void streaming_device_group();
+      void conversion_pool();
+      void trigger_search();
+      void sample_clock_model();
+      void stream_watchdog();
+      void poll_scheduler();
+      void buffer_tuner();
+      void config_snapshot();
+      void device_config_compare();
+      void streaming_fast_interlock();
+      void streaming_generator();
+      void streaming_event_driven();
+      void streaming_replay();
+      void streaming_aggregated_output();
+      void streaming_frame_output();
+      void streaming_packed_ports();
+      void streaming_triggered_windows();
+      void streaming_acq_info_delta();
+      void streaming_timing_realignment();
     };
 
   } /* namespace digitizers */
@@ -15,15 +15,39 @@
 #include "qa_picoscope_3000a.h"
 #include "qa_picoscope_4000a.h"
 #include "qa_picoscope_6000.h"
+#ifdef DIGITIZERS_PICOSDK_MOCK
+#include "qa_picosdk_mock.h"
+#endif
 
 #include "qa_stft_goertzl_dynamic.h"
 #include "qa_time_realignment_ff.h"
 #include "qa_interlock_generation_ff.h"
+#include "qa_interlock_matrix_ff.h"
 #include "qa_stream_to_vector_overlay_ff.h"
 #include "qa_stft_goertzl_dynamic_decimated.h"
 #include "qa_function_ff.h"
 #include "qa_cascade_sink.h"
 #include "qa_demux_ff.h"
+#include "qa_trigger_averager_ff.h"
+#include "qa_statistics_sink_f.h"
+#include "qa_block_stats.h"
+#include "qa_utils.h"
+#include "qa_wr_receiver_f.h"
+#include "qa_kernels.h"
+#include "qa_chunk_memory.h"
+#include "qa_design_cache.h"
+#include "qa_iir_sos_filter_ff.h"
+#include "qa_network_sink.h"
+#include "qa_network_source.h"
+#include "qa_archive_sink.h"
+#include "qa_raw_codec.h"
+#include "qa_lossy_codec.h"
+#include "qa_notification_hub.h"
+#include "qa_shm_export.h"
+#include "qa_state_file.h"
+#include "qa_delay_estimator_ff.h"
+#include "qa_multi_cascade_sink.h"
+#include "qa_multi_time_domain_sink.h"
 
 #include "qa_block_aggregation.h"
 #include "qa_block_amplitude_and_phase.h"
@@ -34,6 +58,7 @@
 #include "qa_block_spectral_peaks.h"
 #include "qa_median_and_average.h"
 #include "qa_post_mortem_sink.h"
+#include "qa_post_mortem_group.h"
 #include "qa_block_demux.h"
 #include "qa_decimate_and_adjust_timebase.h"
 #include "qa_signal_averager.h"
@@ -69,6 +94,9 @@ qa_digitizers::suite(bool add_ps3000a_tests, bool add_ps4000a_tests, bool add_ps
   if (add_ps6000_tests) {
     s->addTest(gr::digitizers::qa_picoscope_6000::suite());
   }
+#ifdef DIGITIZERS_PICOSDK_MOCK
+  s->addTest(gr::digitizers::qa_picosdk_mock::suite());
+#endif
   s->addTest(gr::digitizers::qa_block_amplitude_and_phase::suite());
   s->addTest(gr::digitizers::qa_digitizer_block::suite());
   s->addTest(gr::digitizers::qa_freq_estimator::suite());
@@ -77,6 +105,7 @@ qa_digitizers::suite(bool add_ps3000a_tests, bool add_ps4000a_tests, bool add_ps
   s->addTest(gr::digitizers::qa_block_spectral_peaks::suite());
   s->addTest(gr::digitizers::qa_median_and_average::suite());
   s->addTest(gr::digitizers::qa_post_mortem_sink::suite());
+  s->addTest(gr::digitizers::qa_post_mortem_group::suite());
   s->addTest(gr::digitizers::qa_block_demux::suite());
   s->addTest(gr::digitizers::qa_decimate_and_adjust_timebase::suite());
   s->addTest(gr::digitizers::qa_signal_averager::suite());
@@ -88,11 +117,32 @@ qa_digitizers::suite(bool add_ps3000a_tests, bool add_ps4000a_tests, bool add_ps
   s->addTest(gr::digitizers::qa_time_realignment_ff::suite());
   s->addTest(gr::digitizers::qa_stft_goertzl_dynamic::suite());
   s->addTest(gr::digitizers::qa_interlock_generation_ff::suite());
+  s->addTest(gr::digitizers::qa_interlock_matrix_ff::suite());
   s->addTest(gr::digitizers::qa_stream_to_vector_overlay_ff::suite());
   s->addTest(gr::digitizers::qa_stft_goertzl_dynamic_decimated::suite());
   s->addTest(gr::digitizers::qa_function_ff::suite());
   s->addTest(gr::digitizers::qa_cascade_sink::suite());
   s->addTest(gr::digitizers::qa_demux_ff::suite());
+  s->addTest(gr::digitizers::qa_trigger_averager_ff::suite());
+  s->addTest(gr::digitizers::qa_statistics_sink_f::suite());
+  s->addTest(gr::digitizers::qa_utils::suite());
+  s->addTest(gr::digitizers::qa_wr_receiver_f::suite());
+  s->addTest(gr::digitizers::qa_kernels::suite());
+  s->addTest(gr::digitizers::qa_chunk_memory::suite());
+  s->addTest(gr::digitizers::qa_design_cache::suite());
+  s->addTest(gr::digitizers::qa_block_stats::suite());
+  s->addTest(gr::digitizers::qa_iir_sos_filter_ff::suite());
+  s->addTest(gr::digitizers::qa_multi_cascade_sink::suite());
+  s->addTest(gr::digitizers::qa_multi_time_domain_sink::suite());
+  s->addTest(gr::digitizers::qa_network_sink::suite());
+  s->addTest(gr::digitizers::qa_network_source::suite());
+  s->addTest(gr::digitizers::qa_archive_sink::suite());
+  s->addTest(gr::digitizers::qa_raw_codec::suite());
+  s->addTest(gr::digitizers::qa_lossy_codec::suite());
+  s->addTest(gr::digitizers::qa_notification_hub::suite());
+  s->addTest(gr::digitizers::qa_shm_export::suite());
+  s->addTest(gr::digitizers::qa_state_file::suite());
+  s->addTest(gr::digitizers::qa_delay_estimator_ff::suite());
 
   return s;
 }
@@ -6,10 +6,19 @@
 
 
 #include <gnuradio/attributes.h>
+#include <cmath>
 #include <cppunit/TestAssert.h>
 #include "qa_edge_trigger_ff.h"
 #include <digitizers/edge_trigger_ff.h>
+#include <digitizers/edge_trigger_receiver_f.h>
 #include <digitizers/edge_trigger_utils.h>
+#include <digitizers/tags.h>
+#include <gnuradio/blocks/vector_source_f.h>
+#include <gnuradio/blocks/vector_sink_f.h>
+#include <gnuradio/top_block.h>
+#include <boost/asio.hpp>
+#include <chrono>
+#include <thread>
 
 namespace gr {
   namespace digitizers {
@@ -64,6 +73,262 @@ namespace gr {
       CPPUNIT_ASSERT_EQUAL(test_edge.samples_since_last_timing_event, edge.samples_since_last_timing_event);
     }
 
+    void
+    qa_edge_trigger_ff::encode_decode_batch()
+    {
+      std::vector<edge_detect_t> test_edges(3);
+      for (size_t i = 0; i < test_edges.size(); i++) {
+        test_edges[i].is_raising_edge = i % 2;
+        test_edges[i].value = -2.33 + i;
+        test_edges[i].timing_event_timestamp = -1;
+        test_edges[i].retrigger_event_timestamp = 1234567890 + i;
+        test_edges[i].delay_since_last_timing_event = 1000 * i;
+        test_edges[i].samples_since_last_timing_event = 50 + i;
+      }
+
+      std::string payload;
+      encode_edge_detect_batch(test_edges.data(), test_edges.size(), payload);
+      CPPUNIT_ASSERT_EQUAL(EDGE_DETECT_HEADER_SIZE + 3 * EDGE_DETECT_RECORD_SIZE, payload.size());
+      CPPUNIT_ASSERT(is_binary_edge_detect(payload));
+
+      std::vector<edge_detect_t> edges;
+      CPPUNIT_ASSERT_EQUAL(true, decode_edge_detect_batch(payload, edges));
+      CPPUNIT_ASSERT_EQUAL(test_edges.size(), edges.size());
+
+      for (size_t i = 0; i < edges.size(); i++) {
+        CPPUNIT_ASSERT_EQUAL(test_edges[i].is_raising_edge, edges[i].is_raising_edge);
+        CPPUNIT_ASSERT_EQUAL(test_edges[i].value, edges[i].value);
+        CPPUNIT_ASSERT_EQUAL(test_edges[i].timing_event_timestamp, edges[i].timing_event_timestamp);
+        CPPUNIT_ASSERT_EQUAL(test_edges[i].retrigger_event_timestamp, edges[i].retrigger_event_timestamp);
+        CPPUNIT_ASSERT_EQUAL(test_edges[i].delay_since_last_timing_event, edges[i].delay_since_last_timing_event);
+        CPPUNIT_ASSERT_EQUAL(test_edges[i].samples_since_last_timing_event, edges[i].samples_since_last_timing_event);
+      }
+
+      // truncated datagram
+      edges.clear();
+      payload.resize(payload.size() - 1);
+      CPPUNIT_ASSERT_EQUAL(false, decode_edge_detect_batch(payload, edges));
+      CPPUNIT_ASSERT(edges.empty());
+
+      // xml datagrams are still understood
+      CPPUNIT_ASSERT_EQUAL(true, decode_edge_detect_batch(encode_edge_detect(test_edges[0]), edges));
+      CPPUNIT_ASSERT_EQUAL(size_t {1}, edges.size());
+      CPPUNIT_ASSERT_EQUAL(test_edges[0].retrigger_event_timestamp, edges[0].retrigger_event_timestamp);
+    }
+
+    void
+    qa_edge_trigger_ff::udp_receiver_stats()
+    {
+      auto block = edge_trigger_ff::make(1000.0, 0.5, 1.0, 0.0, true, "localhost:2025, 127.0.0.1:2026");
+
+      auto stats = block->get_udp_receiver_stats();
+      CPPUNIT_ASSERT_EQUAL(size_t {2}, stats.size());
+      CPPUNIT_ASSERT_EQUAL(std::string("localhost:2025"), stats[0].host_and_port);
+      CPPUNIT_ASSERT_EQUAL(std::string("127.0.0.1:2026"), stats[1].host_and_port);
+
+      for (const auto &s : stats) {
+        CPPUNIT_ASSERT_EQUAL(uint64_t {0}, s.sent);
+        CPPUNIT_ASSERT_EQUAL(uint64_t {0}, s.dropped);
+        CPPUNIT_ASSERT_EQUAL(int64_t {0}, s.max_latency_ns);
+        CPPUNIT_ASSERT_EQUAL(int64_t {0}, s.max_tx_latency_ns);
+      }
+      CPPUNIT_ASSERT_EQUAL(uint64_t {0}, block->get_udp_queue_drops());
+    }
+
+    void
+    qa_edge_trigger_ff::event_id()
+    {
+      CPPUNIT_ASSERT(edge_detect_event_id("CMD_BEAM_INJECTION") != edge_detect_event_id("CMD_BEAM_EXTRACTION"));
+      CPPUNIT_ASSERT(edge_detect_event_id("") != 0);
+
+      edge_detect_t test_edge {};
+      test_edge.event_id = edge_detect_event_id("CMD_BEAM_INJECTION");
+      test_edge.samples_since_last_timing_event = 50;
+
+      std::string payload;
+      encode_edge_detect_batch(&test_edge, 1, payload);
+
+      std::vector<edge_detect_t> edges;
+      CPPUNIT_ASSERT_EQUAL(true, decode_edge_detect_batch(payload, edges));
+      CPPUNIT_ASSERT_EQUAL(test_edge.event_id, edges.at(0).event_id);
+
+      // version 1 datagrams have no event id (and no sequence number)
+      payload[2] = 1;
+      payload.erase(EDGE_DETECT_HEADER_SIZE_V2, EDGE_DETECT_HEADER_SIZE - EDGE_DETECT_HEADER_SIZE_V2);
+      payload.resize(EDGE_DETECT_HEADER_SIZE_V2 + EDGE_DETECT_RECORD_SIZE_V1);
+      edges.clear();
+      CPPUNIT_ASSERT_EQUAL(true, decode_edge_detect_batch(payload, edges));
+      CPPUNIT_ASSERT_EQUAL(uint64_t {0}, edges.at(0).event_id);
+      CPPUNIT_ASSERT_EQUAL(int64_t {50}, edges.at(0).samples_since_last_timing_event);
+    }
+
+    void
+    qa_edge_trigger_ff::hysteresis_output()
+    {
+      // Long enough to cover partial and whole bitmask words, NaNs keep the state
+      std::vector<float> values;
+      for (int i = 0; i < 1000; i++) {
+        values.push_back(static_cast<float>((i * 37) % 23) / 15.0f);
+      }
+      values[500] = std::nanf("");
+
+      std::vector<float> expected;
+      bool state = false;
+      for (auto value : values) {
+        if (!state && value > 1.0f) {
+          state = true;
+        }
+        else if (state && value < 0.5f) {
+          state = false;
+        }
+        expected.push_back(static_cast<float>(state));
+      }
+
+      auto top = gr::make_top_block("test");
+      auto src = gr::blocks::vector_source_f::make(values);
+      auto block = edge_trigger_ff::make(1000.0, 0.5, 1.0, 0.0, false, "");
+      auto sink = gr::blocks::vector_sink_f::make();
+
+      top->connect(src, 0, block, 0);
+      top->connect(block, 0, sink, 0);
+      top->run();
+
+      auto actual = sink->data();
+      CPPUNIT_ASSERT_EQUAL(expected.size(), actual.size());
+      for (size_t i = 0; i < expected.size(); i++) {
+        CPPUNIT_ASSERT_EQUAL(expected[i], actual[i]);
+      }
+    }
+
+    void
+    qa_edge_trigger_ff::udp_source_stats()
+    {
+      edge_detect_t test_edge {};
+      std::string payload;
+
+      encode_edge_detect_batch(&test_edge, 1, payload, 0xfffffffe, -5);
+      uint32_t sequence = 0;
+      int64_t send_timestamp = 0;
+      CPPUNIT_ASSERT(get_edge_detect_header(payload.data(), payload.size(), sequence, send_timestamp));
+      CPPUNIT_ASSERT_EQUAL(uint32_t {0xfffffffe}, sequence);
+      CPPUNIT_ASSERT_EQUAL(int64_t {-5}, send_timestamp);
+      const auto xml = encode_edge_detect(test_edge);
+      CPPUNIT_ASSERT(!get_edge_detect_header(xml.data(), xml.size(), sequence, send_timestamp));
+
+      auto receiver = edge_trigger_receiver_f::make("127.0.0.1", 2027);
+      CPPUNIT_ASSERT(receiver->get_udp_source_stats().empty());
+
+      boost::asio::io_service io_service;
+      boost::asio::ip::udp::socket socket(io_service,
+              boost::asio::ip::udp::endpoint(boost::asio::ip::udp::v4(), 0));
+      boost::asio::ip::udp::endpoint destination(boost::asio::ip::address::from_string("127.0.0.1"), 2027);
+
+      // sequence numbers wrap around, 2 and 4 are lost, 7 arrives late
+      for (uint32_t seq : {0xfffffffeu, 0xffffffffu, 0u, 1u, 3u, 5u, 6u, 8u, 7u, 9u}) {
+        const auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+        encode_edge_detect_batch(&test_edge, 1, payload, seq, now);
+        socket.send_to(boost::asio::buffer(payload), destination);
+      }
+      socket.send_to(boost::asio::buffer(xml), destination);
+
+      std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+      auto stats = receiver->get_udp_source_stats();
+      CPPUNIT_ASSERT_EQUAL(size_t {1}, stats.size());
+      CPPUNIT_ASSERT_EQUAL(std::string("127.0.0.1:") + std::to_string(socket.local_endpoint().port()),
+              stats[0].host_and_port);
+      CPPUNIT_ASSERT_EQUAL(uint64_t {11}, stats[0].received);
+      CPPUNIT_ASSERT_EQUAL(uint64_t {2}, stats[0].lost);
+      CPPUNIT_ASSERT_EQUAL(uint64_t {0}, stats[0].dropped);
+
+      // sender and receiver share the clock
+      CPPUNIT_ASSERT(stats[0].max_latency_ns >= 0);
+      CPPUNIT_ASSERT(stats[0].max_latency_ns < 200000000);
+
+      receiver->reset_udp_stats();
+      CPPUNIT_ASSERT_EQUAL(uint64_t {0}, receiver->get_udp_source_stats().at(0).received);
+    }
+
+    void
+    qa_edge_trigger_ff::edge_detect_datagrams()
+    {
+      boost::asio::io_service io_service;
+      boost::asio::ip::udp::socket socket(io_service,
+              boost::asio::ip::udp::endpoint(boost::asio::ip::address::from_string("127.0.0.1"), 0));
+      const auto host = "127.0.0.1:" + std::to_string(socket.local_endpoint().port());
+
+      // Rising edges 50 and 70 samples after the triggers
+      std::vector<float> values(1000, 0.0f);
+      std::fill(values.begin() + 150, values.begin() + 300, 2.0f);
+      std::fill(values.begin() + 470, values.begin() + 600, 2.0f);
+
+      const wr_event_t event {"CMD_BEAM_INJECTION", 1000000000, 1000000000};
+      std::vector<gr::tag_t> tags;
+      for (uint64_t trigger : {100, 400}) {
+        tags.push_back(make_trigger_tag(trigger));
+        tags.push_back(make_wr_event_tag(event, trigger));
+      }
+
+      for (bool binary : {true, false}) {
+        auto top = gr::make_top_block("test");
+        auto src = gr::blocks::vector_source_f::make(values, false, 1, tags);
+        auto block = edge_trigger_ff::make(1000.0, 0.5, 1.0, 0.0, true, host, true, 1.0, 10.0, binary);
+        auto sink = gr::blocks::vector_sink_f::make();
+
+        top->connect(src, 0, block, 0);
+        top->connect(block, 0, sink, 0);
+        top->run();
+
+        std::vector<uint64_t> tag_offsets;
+        for (const auto &tag : sink->tags()) {
+          if (pmt::eq(tag.key, edge_detect_tag_key())) {
+            tag_offsets.push_back(tag.offset);
+          }
+        }
+        CPPUNIT_ASSERT_EQUAL(size_t {2}, tag_offsets.size());
+        CPPUNIT_ASSERT_EQUAL(uint64_t {150}, tag_offsets[0]);
+        CPPUNIT_ASSERT_EQUAL(uint64_t {470}, tag_offsets[1]);
+
+        // Sent by the I/O thread
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+        std::vector<edge_detect_t> edges;
+        std::vector<char> buffer(65536);
+        size_t datagrams = 0;
+        while (socket.available()) {
+          const auto size = socket.receive(boost::asio::buffer(buffer));
+          const std::string payload(buffer.data(), size);
+          CPPUNIT_ASSERT(decode_edge_detect_batch(payload, edges));
+
+          uint32_t sequence = 0;
+          int64_t send_timestamp = 0;
+          CPPUNIT_ASSERT_EQUAL(binary, get_edge_detect_header(payload.data(), payload.size(), sequence, send_timestamp));
+          if (binary) {
+            CPPUNIT_ASSERT_EQUAL(uint32_t(datagrams), sequence);
+            CPPUNIT_ASSERT(send_timestamp > 0);
+          }
+          datagrams++;
+        }
+
+        // Both edges are within the batch window, the batch is sent when the flowgraph stops
+        CPPUNIT_ASSERT_EQUAL(binary ? size_t {1} : size_t {2}, datagrams);
+        CPPUNIT_ASSERT_EQUAL(size_t {2}, edges.size());
+
+        const int64_t samples[] = {50, 70};
+        for (size_t i = 0; i < edges.size(); i++) {
+          CPPUNIT_ASSERT(edges[i].is_raising_edge);
+          CPPUNIT_ASSERT_EQUAL(samples[i], edges[i].samples_since_last_timing_event);
+          CPPUNIT_ASSERT_EQUAL(samples[i] * 1000000, edges[i].delay_since_last_timing_event);
+          CPPUNIT_ASSERT_EQUAL(event.wr_trigger_stamp, edges[i].timing_event_timestamp);
+          CPPUNIT_ASSERT_EQUAL(event.wr_trigger_stamp + samples[i] * 1000000, edges[i].retrigger_event_timestamp);
+          CPPUNIT_ASSERT_EQUAL(binary ? edge_detect_event_id(event.event_id) : uint64_t {0}, edges[i].event_id);
+        }
+
+        CPPUNIT_ASSERT_EQUAL(uint64_t(datagrams), block->get_udp_receiver_stats().at(0).sent);
+      }
+    }
+
   } /* namespace digitizers */
 } /* namespace gr */
 
@@ -20,11 +20,23 @@ namespace gr {
       CPPUNIT_TEST_SUITE(qa_edge_trigger_ff);
       CPPUNIT_TEST(decode);
       CPPUNIT_TEST(encode_decode);
+      CPPUNIT_TEST(encode_decode_batch);
+      CPPUNIT_TEST(udp_receiver_stats);
+      CPPUNIT_TEST(event_id);
+      CPPUNIT_TEST(hysteresis_output);
+      CPPUNIT_TEST(udp_source_stats);
+      CPPUNIT_TEST(edge_detect_datagrams);
       CPPUNIT_TEST_SUITE_END();
 
     private:
       void decode();
       void encode_decode();
+      void encode_decode_batch();
+      void udp_receiver_stats();
+      void event_id();
+      void hysteresis_output();
+      void udp_source_stats();
+      void edge_detect_datagrams();
     };
 
   } /* namespace digitizers */
@@ -14,6 +14,8 @@
 #include <digitizers/freq_estimator.h>
 #include <gnuradio/blocks/vector_source_f.h>
 #include <gnuradio/blocks/vector_sink_f.h>
+#include <cmath>
+#include <random>
 #include <thread>
 #include <chrono>
 
@@ -47,6 +49,71 @@ namespace gr {
       }
     }
 
+    void
+    qa_freq_estimator::decimated_frequency_estimation()
+    {
+      int decim = 7;
+      auto top = gr::make_top_block("decimated_frequency_estimation");
+
+      std::vector<float> sig;
+      for(int i = 0; i < 36000; i++) {
+        sig.push_back(std::sin(2.0 * M_PI * 1000.0 * i / 36000.0));
+      }
+      auto src = gr::blocks::vector_source_f::make(sig);
+
+      // Every decim-th output of the non-decimated estimator
+      auto freq = digitizers::freq_estimator::make(36000, 4, 10, 1);
+      auto freq_decim = digitizers::freq_estimator::make(36000, 4, 10, decim);
+      auto sink = blocks::vector_sink_f::make(1);
+      auto sink_decim = blocks::vector_sink_f::make(1);
+
+      top->connect(src, 0, freq, 0);
+      top->connect(src, 0, freq_decim, 0);
+      top->connect(freq, 0, sink, 0);
+      top->connect(freq_decim, 0, sink_decim, 0);
+
+      top->run();
+
+      auto data = sink->data();
+      auto data_decim = sink_decim->data();
+      CPPUNIT_ASSERT_EQUAL(sig.size() / decim, data_decim.size());
+      for(size_t i = 0; i < data_decim.size(); i++){
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(data.at((i + 1) * decim - 1), data_decim.at(i), 1e-3);
+      }
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(1000, data_decim.back(), 1.0);
+    }
+
+    void
+    qa_freq_estimator::phase_increment_estimation()
+    {
+      int freq_avg_window = 1000;
+      auto top = gr::make_top_block("phase_increment_estimation");
+
+      // Noisy signal, the zero crossings are estimated off by orders of magnitude
+      std::vector<float> sig_i, sig_q;
+      std::mt19937 gen(42);
+      std::normal_distribution<float> noise(0.0, 0.5);
+      for(int i = 0; i < 36000; i++) {
+        sig_i.push_back(std::cos(2.0 * M_PI * 1000.0 * i / 36000.0) + noise(gen));
+        sig_q.push_back(std::sin(2.0 * M_PI * 1000.0 * i / 36000.0) + noise(gen));
+      }
+      auto src_i = gr::blocks::vector_source_f::make(sig_i);
+      auto src_q = gr::blocks::vector_source_f::make(sig_q);
+      auto freq = digitizers::freq_estimator::make(36000, 4, freq_avg_window, 10);
+      auto sink = blocks::vector_sink_f::make(1);
+
+      top->connect(src_i, 0, freq, 0);
+      top->connect(src_q, 0, freq, 1);
+      top->connect(freq, 0, sink, 0);
+
+      top->run();
+      auto data = sink->data();
+      CPPUNIT_ASSERT_EQUAL(sig_i.size() / 10, data.size());
+      for(size_t i = freq_avg_window / 10; i < data.size(); i++){
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(1000, data.at(i), 300.0);
+      }
+    }
+
   } /* namespace digitizers */
 } /* namespace gr */
 
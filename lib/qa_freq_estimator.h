@@ -19,10 +19,14 @@ namespace gr {
     public:
       CPPUNIT_TEST_SUITE(qa_freq_estimator);
       CPPUNIT_TEST(basic_frequency_estimation);
+      CPPUNIT_TEST(decimated_frequency_estimation);
+      CPPUNIT_TEST(phase_increment_estimation);
       CPPUNIT_TEST_SUITE_END();
 
     private:
       void basic_frequency_estimation();
+      void decimated_frequency_estimation();
+      void phase_increment_estimation();
     };
 
   } /* namespace digitizers */
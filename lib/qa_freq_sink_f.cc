@@ -17,6 +17,7 @@
 #include <gnuradio/blocks/tag_debug.h>
 #include <functional>
 #include <atomic>
+#include <stdexcept>
 
 namespace gr {
   namespace digitizers {
@@ -69,6 +70,10 @@ namespace gr {
         (*static_cast<std::function<void(const data_available_event_t *)>*>(ptr))(event);
     }
 
+    static void invoke_visitor(const spectrum_frame_t *frame, void *ptr) {
+        (*static_cast<std::function<void(const spectrum_frame_t *)>*>(ptr))(frame);
+    }
+
     static const float SAMP_RATE_1KHZ = 1000.0;
 
     void
@@ -212,6 +217,172 @@ namespace gr {
       ASSERT_VECTOR_EQUAL(fg.freq.begin(), fg.freq.begin() + (nmeasurements / 2 * nbins), freq.begin());
     }
 
+    void
+    qa_freq_sink_f::test_sink_frames()
+    {
+      auto nbins = 100, nmeasurements = 4, nframes = 20;
+      auto sink = freq_sink_f::make("test", SAMP_RATE_1KHZ, nbins, nmeasurements, 2, FREQ_SINK_MODE_STREAMING);
+
+      freq_test_flowgraph_t fg(sink, std::vector<tag_t>{}, nbins, nframes);
+      fg.run();
+
+      CPPUNIT_ASSERT_EQUAL(uint64_t{20}, sink->get_frame_sequence());
+      CPPUNIT_ASSERT_EQUAL(size_t{8}, sink->get_frame_capacity());
+
+      // in place access to the newest frame
+      spectrum_frame_t last_frame {};
+      std::function<void(const spectrum_frame_t *)> visitor = [&](const spectrum_frame_t *frame) {
+        last_frame = *frame;
+        CPPUNIT_ASSERT_EQUAL(uintptr_t{0}, reinterpret_cast<uintptr_t>(frame->magnitude) % 64);
+        CPPUNIT_ASSERT_EQUAL(uintptr_t{0}, reinterpret_cast<uintptr_t>(frame->phase) % 64);
+        ASSERT_VECTOR_EQUAL(fg.freq.begin() + 19 * nbins, fg.freq.begin() + 20 * nbins, frame->frequency);
+        ASSERT_VECTOR_EQUAL(fg.magnitude.begin() + 19 * nbins, fg.magnitude.begin() + 20 * nbins, frame->magnitude);
+        ASSERT_VECTOR_EQUAL(fg.phase.begin() + 19 * nbins, fg.phase.begin() + 20 * nbins, frame->phase);
+      };
+
+      CPPUNIT_ASSERT(sink->read_frame(19, &invoke_visitor, &visitor));
+      CPPUNIT_ASSERT_EQUAL(uint64_t{19}, last_frame.sequence);
+      CPPUNIT_ASSERT_EQUAL((uint32_t)nbins, last_frame.metadata.number_of_bins);
+
+      // overwritten and not written yet
+      CPPUNIT_ASSERT(!sink->read_frame(11, &invoke_visitor, &visitor));
+      CPPUNIT_ASSERT(!sink->read_frame(20, &invoke_visitor, &visitor));
+
+      // buffered readout continues with the oldest complete buffer
+      std::vector<spectra_measurement_t> minfo(nmeasurements);
+      std::vector<float> freq(nmeasurements * nbins), mag(nmeasurements * nbins), phase(nmeasurements * nbins);
+      auto retval = sink->get_measurements(nmeasurements, &minfo[0], &freq[0], &mag[0], &phase[0]);
+      CPPUNIT_ASSERT_EQUAL(nmeasurements, (int)retval);
+      CPPUNIT_ASSERT_EQUAL((uint32_t)12, minfo[0].lost_count);
+      ASSERT_VECTOR_EQUAL(fg.freq.begin() + 12 * nbins, fg.freq.begin() + 16 * nbins, freq.begin());
+      ASSERT_VECTOR_EQUAL(fg.magnitude.begin() + 12 * nbins, fg.magnitude.begin() + 16 * nbins, mag.begin());
+
+      // constant frequency axis is shared among frames
+      std::vector<float> axis(nbins * nframes);
+      for (int i = 0; i < nbins * nframes; i++) {
+        axis[i] = static_cast<float>(i % nbins);
+      }
+      fg.freq_src->set_data(axis);
+      fg.magnitude_src->rewind();
+      fg.phase_src->rewind();
+      fg.run();
+
+      std::vector<const float *> axes;
+      std::function<void(const spectrum_frame_t *)> axis_visitor = [&](const spectrum_frame_t *frame) {
+        axes.push_back(frame->frequency);
+      };
+
+      CPPUNIT_ASSERT(sink->read_frame(38, &invoke_visitor, &axis_visitor));
+      CPPUNIT_ASSERT(sink->read_frame(39, &invoke_visitor, &axis_visitor));
+      CPPUNIT_ASSERT_EQUAL(axes[0], axes[1]);
+      ASSERT_VECTOR_EQUAL(axis.begin(), axis.begin() + nbins, axes[1]);
+    }
+
+    void
+    qa_freq_sink_f::test_sink_freq_axis_tag()
+    {
+      auto nbins = 16, nmeasurements = 10;
+      auto samples = nbins * nmeasurements;
+      auto sink = freq_sink_f::make("test", SAMP_RATE_1KHZ, nbins, nmeasurements, 2, FREQ_SINK_MODE_STREAMING);
+
+      freq_axis_t axis0 { 0, (uint32_t)nbins, 0.0, 10.0 };
+      freq_axis_t axis1 { 1, (uint32_t)nbins, 100.0, 5.0 };
+      std::vector<tag_t> tags {
+        make_freq_axis_tag(axis0, 0),
+        make_freq_axis_tag(axis0, 3), // same version, no change
+        make_freq_axis_tag(axis1, 5)
+      };
+
+      auto magnitude = make_test_data(samples, 0.2);
+      auto phase = make_test_data(samples, 0.4);
+
+      // no frequency stream
+      auto top = gr::make_top_block("test");
+      auto magnitude_src = gr::blocks::vector_source_f::make(magnitude, false, nbins, tags);
+      auto phase_src = gr::blocks::vector_source_f::make(phase, false, nbins);
+      top->connect(magnitude_src, 0, sink, 0);
+      top->connect(phase_src, 0, sink, 1);
+      top->run();
+
+      std::vector<spectra_measurement_t> minfo(nmeasurements);
+      std::vector<float> freq(samples), mag(samples), ph(samples);
+      auto retval = sink->get_measurements(nmeasurements, &minfo[0], &freq[0], &mag[0], &ph[0]);
+      CPPUNIT_ASSERT_EQUAL(nmeasurements, (int)retval);
+      ASSERT_VECTOR_EQUAL(magnitude.begin(), magnitude.end(), mag.begin());
+
+      std::vector<float> expected(nbins);
+      for (auto i = 0; i < nmeasurements; i++) {
+        fill_freq_axis(i < 5 ? axis0 : axis1, &expected[0]);
+        ASSERT_VECTOR_EQUAL(expected.begin(), expected.end(), freq.begin() + i * nbins);
+      }
+    }
+
+    void
+    qa_freq_sink_f::test_sink_reduction()
+    {
+      auto nbins = 16, nmeasurements = 2, count = 3, nspectra = 12;
+      auto nframes = nspectra / count;
+
+      for (auto reduction : { FREQ_SINK_REDUCTION_AVERAGE, FREQ_SINK_REDUCTION_EXP_AVERAGE,
+                              FREQ_SINK_REDUCTION_MAX_HOLD }) {
+        auto sink = freq_sink_f::make("test", SAMP_RATE_1KHZ, nbins, nmeasurements, 2, FREQ_SINK_MODE_STREAMING);
+        sink->set_reduction(reduction, count);
+
+        // constant frequency axis, spectra are not combined across axes
+        freq_test_flowgraph_t fg(sink, std::vector<tag_t>{}, nbins, nspectra);
+        std::vector<float> axis(nbins * nspectra);
+        for (int i = 0; i < nbins * nspectra; i++) {
+          axis[i] = static_cast<float>(i % nbins);
+        }
+        fg.freq_src->set_data(axis);
+        fg.run();
+
+        CPPUNIT_ASSERT_EQUAL(uint64_t(nframes), sink->get_frame_sequence());
+
+        std::vector<float> exp_magnitude(nbins), exp_phase(nbins);
+        for (int f = 0; f < nframes; f++) {
+          std::vector<float> magnitude(nbins, 0.0f), phase(nbins, 0.0f);
+
+          for (int k = 0; k < count; k++) {
+            const int s = f * count + k;
+            for (int b = 0; b < nbins; b++) {
+              const float m = fg.magnitude[s * nbins + b];
+              const float p = fg.phase[s * nbins + b];
+
+              if (reduction == FREQ_SINK_REDUCTION_AVERAGE) {
+                magnitude[b] += m / count;
+                phase[b] += p / count;
+              }
+              else if (reduction == FREQ_SINK_REDUCTION_MAX_HOLD) {
+                if (k == 0 || m > magnitude[b]) {
+                  magnitude[b] = m;
+                  phase[b] = p;
+                }
+              }
+              else {
+                exp_magnitude[b] = s == 0 ? m : exp_magnitude[b] + (m - exp_magnitude[b]) / count;
+                exp_phase[b] = s == 0 ? p : exp_phase[b] + (p - exp_phase[b]) / count;
+                magnitude[b] = exp_magnitude[b];
+                phase[b] = exp_phase[b];
+              }
+            }
+          }
+
+          std::function<void(const spectrum_frame_t *)> visitor = [&](const spectrum_frame_t *frame) {
+            CPPUNIT_ASSERT_DOUBLES_EQUAL(count / SAMP_RATE_1KHZ, frame->metadata.timebase, 1e-6);
+            for (int b = 0; b < nbins; b++) {
+              CPPUNIT_ASSERT_DOUBLES_EQUAL(magnitude[b], frame->magnitude[b], 1e-4);
+              CPPUNIT_ASSERT_DOUBLES_EQUAL(phase[b], frame->phase[b], 1e-4);
+              CPPUNIT_ASSERT_EQUAL(axis[b], frame->frequency[b]);
+            }
+          };
+          CPPUNIT_ASSERT(sink->read_frame(f, &invoke_visitor, &visitor));
+        }
+
+        CPPUNIT_ASSERT_THROW(sink->set_reduction(reduction, 0), std::invalid_argument);
+      }
+    }
+
   } /* namespace digitizers */
 } /* namespace gr */
 
@@ -22,6 +22,9 @@ namespace gr {
       CPPUNIT_TEST(test_sink_no_tags);
       CPPUNIT_TEST(test_sink_tags);
       CPPUNIT_TEST(test_sink_callback);
+      CPPUNIT_TEST(test_sink_frames);
+      CPPUNIT_TEST(test_sink_freq_axis_tag);
+      CPPUNIT_TEST(test_sink_reduction);
       CPPUNIT_TEST_SUITE_END();
 
     private:
@@ -29,6 +32,9 @@ namespace gr {
       void test_sink_no_tags();
       void test_sink_tags();
       void test_sink_callback();
+      void test_sink_frames();
+      void test_sink_freq_axis_tag();
+      void test_sink_reduction();
     };
 
   } /* namespace digitizers */
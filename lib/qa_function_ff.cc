@@ -133,6 +133,55 @@ namespace gr {
       CPPUNIT_ASSERT_EQUAL(max[1], dmax[nsamples - 1]);
     }
 
+    void
+    qa_function_ff::test_interpolation()
+    {
+      std::vector<float> time = { 0.1, 0.5, 0.9 };
+      std::vector<float> ref  = { 0.0, 4.0, 2.0 };
+      std::vector<float> min  = { -1.0, 3.0, 1.0 };
+      std::vector<float> max  = { 1.0, 5.0, 3.0 };
+
+      const int decimation = 2;
+      auto func = function_ff::make(decimation);
+      func->set_function(time, ref, min, max);
+
+      // the function restarts with the second acq_info tag
+      size_t nsamples = 20000;
+      acq_info_t info {};
+      info.timebase = 1.0e-4;
+
+      function_test_flowgraph_t fg(nsamples, func, std::vector<gr::tag_t> {
+              make_acq_info_tag(info, 0), make_acq_info_tag(info, 10000) });
+      fg.run();
+
+      auto dref = fg.ref_sink->data();
+      auto dmin = fg.min_sink->data();
+      auto dmax = fg.max_sink->data();
+
+      CPPUNIT_ASSERT_EQUAL(nsamples / decimation, dref.size());
+
+      auto expected = [&time](const std::vector<float> &values, double t) -> double {
+        if (t <= time.front()) {
+          return values.front();
+        }
+        for (size_t i = 1; i < time.size(); i++) {
+          if (t <= time[i]) {
+            return values[i - 1] + (values[i] - values[i - 1]) * (t - time[i - 1]) / (time[i] - time[i - 1]);
+          }
+        }
+        return values.back();
+      };
+
+      for (size_t i = 0; i < dref.size(); i++) {
+        const auto sample = i * decimation;
+        const double t = (sample < 10000 ? sample : sample - 10000) * info.timebase;
+
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(expected(ref, t), dref[i], 1e-3);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(expected(min, t), dmin[i], 1e-3);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(expected(max, t), dmax[i], 1e-3);
+      }
+    }
+
   } /* namespace digitizers */
 } /* namespace gr */
 
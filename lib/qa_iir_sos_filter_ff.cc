@@ -0,0 +1,169 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#include <gnuradio/attributes.h>
+#include <cppunit/TestAssert.h>
+#include "qa_iir_sos_filter_ff.h"
+#include <digitizers/iir_sos_filter_ff.h>
+#include "sos_design.h"
+#include <gnuradio/top_block.h>
+#include <gnuradio/blocks/vector_source_f.h>
+#include <gnuradio/blocks/vector_sink_f.h>
+
+#include <cmath>
+#include <complex>
+#include <stdexcept>
+
+namespace gr {
+  namespace digitizers {
+
+    // Bilinear transform of an analog Butterworth low pass, expanded into the direct form
+    static void
+    butterworth_low_pass(int order, double cutoff, std::vector<double> &b, std::vector<double> &a)
+    {
+      typedef std::complex<double> complex_t;
+
+      const double wc = 2.0 * std::tan(M_PI * cutoff);
+      std::vector<complex_t> num {1.0}, den {1.0};
+      for (int k = 0; k < order; k++) {
+        const complex_t s = wc * std::polar(1.0, M_PI * (2 * k + order + 1) / (2.0 * order));
+        const complex_t pole = (1.0 + s / 2.0) / (1.0 - s / 2.0);
+
+        num.push_back(0.0);
+        den.push_back(0.0);
+        for (int i = k + 1; i > 0; i--) {
+          num[i] += num[i - 1];
+          den[i] -= pole * den[i - 1];
+        }
+      }
+
+      double num_sum = 0.0, den_sum = 0.0;
+      b.clear();
+      a.clear();
+      for (int i = 0; i <= order; i++) {
+        b.push_back(num[i].real());
+        a.push_back(den[i].real());
+        num_sum += b.back();
+        den_sum += a.back();
+      }
+
+      // unity gain at DC
+      for (auto &tap : b) {
+        tap *= den_sum / num_sum;
+      }
+    }
+
+    static std::vector<double>
+    direct_form_double(const std::vector<double> &b, const std::vector<double> &a, const std::vector<float> &x)
+    {
+      std::vector<double> y(x.size(), 0.0);
+      for (size_t n = 0; n < x.size(); n++) {
+        double acc = 0.0;
+        for (size_t k = 0; k < b.size() && k <= n; k++) {
+          acc += b[k] * x[n - k];
+        }
+        for (size_t k = 1; k < a.size() && k <= n; k++) {
+          acc -= a[k] * y[n - k];
+        }
+        y[n] = acc / a[0];
+      }
+      return y;
+    }
+
+    void
+    qa_iir_sos_filter_ff::high_order_design()
+    {
+      // eighth order, the direct form is unstable in single precision
+      std::vector<double> b, a;
+      butterworth_low_pass(8, 0.02, b, a);
+
+      auto sections = tf_to_sos(b, a);
+      CPPUNIT_ASSERT_EQUAL(size_t(4), sections.size());
+
+      const int n = 2000;
+      std::vector<float> impulse(n, 0.0f), out(n);
+      impulse[0] = 1.0f;
+      std::vector<float> state(2 * sections.size(), 0.0f);
+      sos_cascade(sections.data(), sections.size(), state.data(), impulse.data(), out.data(), 1, n);
+
+      auto expected = direct_form_double(b, a, impulse);
+      double dc_gain = 0.0;
+      for (int i = 0; i < n; i++) {
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(expected[i], out[i], 1e-6);
+        dc_gain += out[i];
+      }
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(1.0, dc_gain, 1e-4);
+    }
+
+    void
+    qa_iir_sos_filter_ff::delays_and_errors()
+    {
+      // leading zeros of the feed forward taps are kept as delays
+      auto sections = tf_to_sos({0.0, 0.9, -0.9}, {1.0, -0.9});
+      CPPUNIT_ASSERT_EQUAL(size_t(1), sections.size());
+      CPPUNIT_ASSERT_EQUAL(0.0f, sections[0].b0);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(0.9, sections[0].b1, 1e-6);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(-0.9, sections[0].b2, 1e-6);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(-0.9, sections[0].a1, 1e-6);
+      CPPUNIT_ASSERT_EQUAL(0.0f, sections[0].a2);
+
+      // three delays and the gain normalized by fb[0]
+      sections = tf_to_sos({0.0, 0.0, 0.0, 1.0}, {2.0});
+      CPPUNIT_ASSERT_EQUAL(size_t(2), sections.size());
+      std::vector<float> impulse(6, 0.0f), out(6);
+      impulse[0] = 1.0f;
+      std::vector<float> state(2 * sections.size(), 0.0f);
+      sos_cascade(sections.data(), sections.size(), state.data(), impulse.data(), out.data(), 1, 6);
+      const std::vector<float> expected {0.0f, 0.0f, 0.0f, 0.5f, 0.0f, 0.0f};
+      CPPUNIT_ASSERT(expected == out);
+
+      CPPUNIT_ASSERT_THROW(tf_to_sos({}, {1.0}), std::invalid_argument);
+      CPPUNIT_ASSERT_THROW(tf_to_sos({1.0}, {}), std::invalid_argument);
+      CPPUNIT_ASSERT_THROW(tf_to_sos({1.0}, {0.0, 1.0}), std::invalid_argument);
+      CPPUNIT_ASSERT_THROW(iir_sos_filter_ff::make(0, {1.0}, {1.0}), std::invalid_argument);
+    }
+
+    void
+    qa_iir_sos_filter_ff::multi_channel()
+    {
+      std::vector<double> b, a;
+      butterworth_low_pass(4, 0.05, b, a);
+
+      const int nchannels = 3, n = 5000;
+      auto top = gr::make_top_block("test");
+      auto filter = iir_sos_filter_ff::make(nchannels, b, a);
+      CPPUNIT_ASSERT_EQUAL(2, filter->nsections());
+
+      std::vector<std::vector<float>> inputs;
+      std::vector<gr::blocks::vector_sink_f::sptr> sinks;
+      for (int ch = 0; ch < nchannels; ch++) {
+        std::vector<float> data;
+        for (int i = 0; i < n; i++) {
+          data.push_back(std::sin(0.01 * (ch + 1) * i) + 0.3f * std::sin(1.3 * i));
+        }
+        inputs.push_back(data);
+
+        auto source = gr::blocks::vector_source_f::make(data);
+        auto sink = gr::blocks::vector_sink_f::make();
+        top->connect(source, 0, filter, ch);
+        top->connect(filter, ch, sink, 0);
+        sinks.push_back(sink);
+      }
+
+      top->run();
+
+      for (int ch = 0; ch < nchannels; ch++) {
+        auto expected = direct_form_double(b, a, inputs[ch]);
+        auto values = sinks[ch]->data();
+        CPPUNIT_ASSERT_EQUAL(size_t(n), values.size());
+        for (int i = 0; i < n; i++) {
+          CPPUNIT_ASSERT_DOUBLES_EQUAL(expected[i], values[i], 1e-4);
+        }
+      }
+    }
+
+  } /* namespace digitizers */
+} /* namespace gr */
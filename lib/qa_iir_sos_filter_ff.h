@@ -0,0 +1,35 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+
+#ifndef _QA_IIR_SOS_FILTER_FF_H_
+#define _QA_IIR_SOS_FILTER_FF_H_
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/TestCase.h>
+
+namespace gr {
+  namespace digitizers {
+
+    class qa_iir_sos_filter_ff : public CppUnit::TestCase
+    {
+    public:
+      CPPUNIT_TEST_SUITE(qa_iir_sos_filter_ff);
+      CPPUNIT_TEST(high_order_design);
+      CPPUNIT_TEST(delays_and_errors);
+      CPPUNIT_TEST(multi_channel);
+      CPPUNIT_TEST_SUITE_END();
+
+    private:
+      void high_order_design();
+      void delays_and_errors();
+      void multi_channel();
+    };
+
+  } /* namespace digitizers */
+} /* namespace gr */
+
+#endif /* _QA_IIR_SOS_FILTER_FF_H_ */
@@ -75,6 +75,68 @@ namespace gr {
 
     }
 
+    void
+    count_interlocks(int64_t timestamp, void *userdata)
+    {
+      (*static_cast<int *>(userdata))++;
+    }
+
+    void
+    qa_interlock_generation_ff::multiple_interlocks()
+    {
+      auto top = gr::make_top_block("multiple_interlocks");
+
+      // bursts of interlocks of different lengths, also crossing word boundaries
+      std::vector<float> sig_v;
+      std::vector<float> min_v;
+      std::vector<float> max_v;
+      int expected_calls = 0;
+      bool previous = false;
+
+      for (int i = 0; i < 5000; i++) {
+        const bool above = (i % 97) < (i % 13);
+        const bool below = (i % 251) > 240;
+        const bool disabled = (i % 1000) >= 900;   // max beyond max_max, no upper bound check
+
+        sig_v.push_back(0);
+        max_v.push_back(disabled ? 200.0 : (above ? -1.0 : 1.0));
+        min_v.push_back(below ? 1.0 : -1.0);
+
+        const bool interlock = (above && !disabled) || below;
+        if (interlock && !previous) {
+          expected_calls++;
+        }
+        previous = interlock;
+      }
+
+      auto sig = blocks::vector_source_f::make(sig_v);
+      auto min = blocks::vector_source_f::make(min_v);
+      auto max = blocks::vector_source_f::make(max_v);
+
+      int calls = 0;
+      auto i_lk = interlock_generation_ff::make(-100, 100);
+      i_lk->set_callback(&count_interlocks, &calls);
+
+      auto snk = blocks::vector_sink_f::make(1);
+
+      top->connect(sig, 0, i_lk, 0);
+      top->connect(min, 0, i_lk, 1);
+      top->connect(max, 0, i_lk, 2);
+      top->connect(i_lk, 0, snk, 0);
+
+      top->run();
+
+      auto interlocks = snk->data();
+
+      CPPUNIT_ASSERT_EQUAL(sig_v.size(), interlocks.size());
+      CPPUNIT_ASSERT_EQUAL(expected_calls, calls);
+      for (size_t i = 0; i < sig_v.size(); i++) {
+        const bool exp = (max_v.at(i) < 100 && sig_v.at(i) >= max_v.at(i))
+                || (min_v.at(i) > -100 && sig_v.at(i) <= min_v.at(i));
+        CPPUNIT_ASSERT_EQUAL(exp ? 1.0f : 0.0f, interlocks.at(i));
+      }
+    }
+
   } /* namespace digitizers */
 } /* namespace gr */
 
@@ -19,10 +19,12 @@ namespace gr {
     public:
       CPPUNIT_TEST_SUITE(qa_interlock_generation_ff);
       CPPUNIT_TEST(interlock_generation_test);
+      CPPUNIT_TEST(multiple_interlocks);
       CPPUNIT_TEST_SUITE_END();
 
     private:
       void interlock_generation_test();
+      void multiple_interlocks();
     };
 
   } /* namespace digitizers */
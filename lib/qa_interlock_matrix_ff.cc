@@ -0,0 +1,116 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+
+#include <gnuradio/top_block.h>
+
+
+#include <gnuradio/attributes.h>
+#include <cppunit/TestAssert.h>
+#include "qa_interlock_matrix_ff.h"
+#include <digitizers/interlock_matrix_ff.h>
+#include <gnuradio/blocks/vector_source_f.h>
+#include <gnuradio/blocks/vector_sink_f.h>
+#include <digitizers/tags.h>
+
+#include <stdexcept>
+#include <utility>
+
+namespace gr {
+  namespace digitizers {
+
+    typedef std::vector<std::pair<int64_t, uint64_t>> interlock_events_t;
+
+    static void
+    record_interlocks(int64_t timestamp, uint64_t channel_mask, void *userdata)
+    {
+      static_cast<interlock_events_t *>(userdata)->emplace_back(timestamp, channel_mask);
+    }
+
+    void
+    qa_interlock_matrix_ff::aggregated_interlocks()
+    {
+      const int nchannels = 3;
+      const int nsamples = 5000;
+
+      auto top = gr::make_top_block("aggregated_interlocks");
+
+      // bursts of different lengths per channel, some channels entering the interlock at the
+      // same sample
+      std::vector<std::vector<float>> sig_v(nchannels), min_v(nchannels), max_v(nchannels);
+      interlock_events_t expected;
+      uint64_t previous = 0;
+
+      for (int i = 0; i < nsamples; i++) {
+        uint64_t state = 0;
+        for (int c = 0; c < nchannels; c++) {
+          const bool above = (i % (97 + c)) < (i % 13);
+          const bool below = ((i + 50 * c) % 251) > 240;
+          const bool disabled = c == 1 && (i % 1000) >= 900;   // max beyond max_max
+
+          sig_v[c].push_back(0);
+          max_v[c].push_back(disabled ? 200.0 : (above ? -1.0 : 1.0));
+          min_v[c].push_back(below ? 1.0 : -1.0);
+
+          if ((above && !disabled) || below) {
+            state |= uint64_t {1} << c;
+          }
+        }
+
+        if (state & ~previous) {
+          expected.emplace_back(1000000000 + static_cast<int64_t>(i * 976562.5), state);
+        }
+        previous = state;
+      }
+
+      acq_info_t acq_info {};
+      acq_info.timestamp = 1000000000;
+      acq_info.timebase = 1.0 / 1024.0;
+      std::vector<gr::tag_t> tags { make_acq_info_tag(acq_info, 0) };
+
+      interlock_events_t events;
+      auto i_lk = interlock_matrix_ff::make(nchannels, -100, 100);
+      i_lk->set_callback(&record_interlocks, &events);
+
+      auto snk = blocks::vector_sink_f::make(1);
+
+      for (int c = 0; c < nchannels; c++) {
+        top->connect(blocks::vector_source_f::make(sig_v[c], false, 1, c == 0 ? tags : std::vector<gr::tag_t>()), 0, i_lk, 3 * c);
+        top->connect(blocks::vector_source_f::make(min_v[c]), 0, i_lk, 3 * c + 1);
+        top->connect(blocks::vector_source_f::make(max_v[c]), 0, i_lk, 3 * c + 2);
+      }
+      top->connect(i_lk, 0, snk, 0);
+
+      top->run();
+
+      auto interlocks = snk->data();
+      CPPUNIT_ASSERT_EQUAL(size_t {nsamples}, interlocks.size());
+
+      for (int i = 0; i < nsamples; i++) {
+        bool exp = false;
+        for (int c = 0; c < nchannels; c++) {
+          exp |= (max_v[c].at(i) < 100 && sig_v[c].at(i) >= max_v[c].at(i))
+                  || (min_v[c].at(i) > -100 && sig_v[c].at(i) <= min_v[c].at(i));
+        }
+        CPPUNIT_ASSERT_EQUAL(exp ? 1.0f : 0.0f, interlocks.at(i));
+      }
+
+      CPPUNIT_ASSERT_EQUAL(expected.size(), events.size());
+      for (size_t i = 0; i < expected.size(); i++) {
+        CPPUNIT_ASSERT_EQUAL(expected[i].first, events[i].first);
+        CPPUNIT_ASSERT_EQUAL(expected[i].second, events[i].second);
+      }
+    }
+
+    void
+    qa_interlock_matrix_ff::invalid_channels()
+    {
+      CPPUNIT_ASSERT_THROW(interlock_matrix_ff::make(0, -100, 100), std::invalid_argument);
+      CPPUNIT_ASSERT_THROW(interlock_matrix_ff::make(65, -100, 100), std::invalid_argument);
+    }
+
+  } /* namespace digitizers */
+} /* namespace gr */
@@ -0,0 +1,411 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#include <gnuradio/attributes.h>
+#include <cppunit/TestAssert.h>
+#include "qa_kernels.h"
+#include "conversion_kernel.h"
+#include "hysteresis_kernel.h"
+#include "interlock_kernel.h"
+#include "goertzel_kernel.h"
+#include "sos_kernel.h"
+#include "lane_fir_kernel.h"
+#include "half_kernel.h"
+#include "pipeline_kernel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <vector>
+
+namespace gr {
+  namespace digitizers {
+
+    // Lengths covering the vector bodies and the scalar remainders
+    static const int LENGTHS[] = {1, 7, 31, 32, 33, 100, 1000, 1027};
+
+    static std::vector<float>
+    random_samples(int n)
+    {
+      std::vector<float> samples(n);
+      for (int i = 0; i < n; i++) {
+        samples[i] = static_cast<float>(rand() % 2001 - 1000) / 100.0f;
+      }
+      // comparisons with NaN are false in all the variants
+      if (n > 3) {
+        samples[3] = std::numeric_limits<float>::quiet_NaN();
+      }
+      return samples;
+    }
+
+    void
+    qa_kernels::raw_convert_variants()
+    {
+      srand(10);
+
+      for (int isa = KERNEL_ISA_GENERIC; isa <= get_kernel_isa(); isa++) {
+        auto kernel = conversion_detail::raw_convert_kernel(static_cast<kernel_isa_t>(isa));
+
+        for (int n : LENGTHS) {
+          std::vector<int16_t> raw(n);
+          for (int i = 0; i < n; i++) {
+            raw[i] = static_cast<int16_t>(rand());
+          }
+          raw[0] = std::numeric_limits<int16_t>::min();
+
+          std::vector<float> values(n), ref_values(n);
+          conversion_detail::raw_convert_generic(raw.data(), 0.002f, 0.25f, ref_values.data(), n);
+          kernel(raw.data(), 0.002f, 0.25f, values.data(), n);
+
+          // variants may fuse multiply and subtract
+          for (int i = 0; i < n; i++) {
+            CPPUNIT_ASSERT_DOUBLES_EQUAL(ref_values[i], values[i], 1e-4);
+          }
+        }
+      }
+    }
+
+    void
+    qa_kernels::min_max_agg_convert_variants()
+    {
+      srand(11);
+
+      for (int isa = KERNEL_ISA_GENERIC; isa <= get_kernel_isa(); isa++) {
+        auto kernel = conversion_detail::min_max_agg_kernel(static_cast<kernel_isa_t>(isa));
+
+        for (int n : LENGTHS) {
+          std::vector<int16_t> raw_max(n), raw_min(n);
+          for (int i = 0; i < n; i++) {
+            raw_max[i] = static_cast<int16_t>(rand());
+            raw_min[i] = static_cast<int16_t>(rand());
+          }
+          raw_max[0] = std::numeric_limits<int16_t>::max();
+          raw_min[0] = std::numeric_limits<int16_t>::min();
+
+          std::vector<float> values(n), errors(n), ref_values(n), ref_errors(n);
+          conversion_detail::min_max_agg_convert_generic(raw_max.data(), raw_min.data(), 0.001f,
+                  1.0f, 0.0f, ref_values.data(), ref_errors.data(), n);
+          kernel(raw_max.data(), raw_min.data(), 0.001f, 1.0f, 0.0f, values.data(), errors.data(), n);
+
+          for (int i = 0; i < n; i++) {
+            CPPUNIT_ASSERT_EQUAL(ref_values[i], values[i]);
+            CPPUNIT_ASSERT_EQUAL(ref_errors[i], errors[i]);
+          }
+
+          // calibrated
+          conversion_detail::min_max_agg_convert_generic(raw_max.data(), raw_min.data(), 0.001f,
+                  2.5f, 0.75f, ref_values.data(), ref_errors.data(), n);
+          kernel(raw_max.data(), raw_min.data(), 0.001f, 2.5f, 0.75f, values.data(), errors.data(), n);
+
+          for (int i = 0; i < n; i++) {
+            CPPUNIT_ASSERT_DOUBLES_EQUAL(ref_values[i], values[i], 1e-4);
+            CPPUNIT_ASSERT_EQUAL(ref_errors[i], errors[i]);
+          }
+        }
+      }
+    }
+
+    void
+    qa_kernels::min_max_agg_convert_reference()
+    {
+      srand(17);
+
+      // The dispatched kernel (used by picoscope_impl) and the AVX2 variant against the
+      // documented formula, evaluated in double
+      std::vector<conversion_detail::min_max_agg_kernel_t> kernels = {min_max_agg_convert};
+#if defined(__x86_64__) || defined(__i386__)
+      if (get_kernel_isa() >= KERNEL_ISA_AVX2) {
+        kernels.push_back(conversion_detail::min_max_agg_convert_avx2);
+      }
+#endif
+
+      const float voltage_multiplier = 0.001f, scale = 2.5f, offset = 0.75f;
+
+      for (auto kernel : kernels) {
+        for (int n = 1; n <= 40; n++) {
+          std::vector<int16_t> raw_max(n), raw_min(n);
+          for (int i = 0; i < n; i++) {
+            raw_max[i] = static_cast<int16_t>(rand());
+            raw_min[i] = static_cast<int16_t>(rand());
+          }
+
+          // full range, i.e. the sum and the difference overflow int16_t, and equal extremes
+          raw_max[0] = std::numeric_limits<int16_t>::max();
+          raw_min[0] = std::numeric_limits<int16_t>::min();
+          raw_max[n - 1] = std::numeric_limits<int16_t>::min();
+          raw_min[n - 1] = std::numeric_limits<int16_t>::min();
+
+          std::vector<float> values(n), errors(n);
+          kernel(raw_max.data(), raw_min.data(), voltage_multiplier, scale, offset,
+                  values.data(), errors.data(), n);
+
+          for (int i = 0; i < n; i++) {
+            const double max = raw_max[i], min = raw_min[i];
+            const double value = (max + min) / 2.0 * voltage_multiplier * scale - offset;
+            const double error = (max - min) / 4.0 * voltage_multiplier * scale;
+
+            CPPUNIT_ASSERT_DOUBLES_EQUAL(value, values[i], 1e-4);
+            CPPUNIT_ASSERT_DOUBLES_EQUAL(error, errors[i], 1e-4);
+          }
+        }
+      }
+    }
+
+    void
+    qa_kernels::threshold_masks_variants()
+    {
+      srand(12);
+
+      for (int isa = KERNEL_ISA_GENERIC; isa <= get_kernel_isa(); isa++) {
+        auto kernel = hysteresis_detail::threshold_masks_kernel(static_cast<kernel_isa_t>(isa));
+
+        for (int n : LENGTHS) {
+          auto samples = random_samples(n);
+          const int nwords = hysteresis_words(n);
+
+          std::vector<uint32_t> above(nwords), below(nwords), ref_above(nwords), ref_below(nwords);
+          hysteresis_detail::threshold_masks_generic(samples.data(), n, -2.0f, 3.0f,
+                  ref_above.data(), ref_below.data());
+          kernel(samples.data(), n, -2.0f, 3.0f, above.data(), below.data());
+
+          CPPUNIT_ASSERT(ref_above == above);
+          CPPUNIT_ASSERT(ref_below == below);
+        }
+      }
+    }
+
+    void
+    qa_kernels::interlock_variants()
+    {
+      srand(13);
+      const float inf = std::numeric_limits<float>::infinity();
+
+      for (int isa = KERNEL_ISA_GENERIC; isa <= get_kernel_isa(); isa++) {
+        auto interlocks = interlock_detail::evaluate_interlocks_kernel(static_cast<kernel_isa_t>(isa));
+        auto limits = interlock_detail::evaluate_interlock_limits_kernel(static_cast<kernel_isa_t>(isa));
+
+        for (int n : LENGTHS) {
+          auto samples = random_samples(n);
+          auto min = random_samples(n);
+          auto max = random_samples(n);
+          const int nwords = interlock_words(n);
+
+          std::vector<float> out(n), ref_out(n);
+          std::vector<uint32_t> words(nwords), ref_words(nwords);
+          interlock_detail::evaluate_interlocks_generic(samples.data(), min.data(), max.data(), n,
+                  -5.0f, 5.0f, ref_out.data(), ref_words.data());
+          interlocks(samples.data(), min.data(), max.data(), n, -5.0f, 5.0f, out.data(), words.data());
+
+          CPPUNIT_ASSERT(ref_out == out);
+          CPPUNIT_ASSERT(ref_words == words);
+
+          for (float upper : {1.5f, inf}) {
+            interlock_detail::evaluate_interlock_limits_generic(samples.data(), n, -1.0f, upper, ref_words.data());
+            limits(samples.data(), n, -1.0f, upper, words.data());
+            CPPUNIT_ASSERT(ref_words == words);
+          }
+        }
+      }
+    }
+
+    void
+    qa_kernels::goertzel_variants()
+    {
+      srand(14);
+
+      const int nbins = 13, nsamples = 256;
+      const int padded = goertzel_padded_bins(nbins);
+
+      auto samples = random_samples(nsamples);
+      samples[3] = 0.5f;
+      std::vector<float> window(nsamples, 1.0f);
+      std::vector<double> coeffs(padded);
+      for (int b = 0; b < padded; b++) {
+        coeffs[b] = 2.0 * std::cos(2.0 * M_PI * b / nsamples);
+      }
+
+      std::vector<double> ref_d1(padded), ref_d2(padded);
+      goertzel_detail::goertzel_generic(samples.data(), window.data(), nsamples, coeffs.data(), padded,
+              ref_d1.data(), ref_d2.data());
+
+      for (int isa = KERNEL_ISA_GENERIC; isa <= get_kernel_isa(); isa++) {
+        auto kernel = goertzel_detail::select_kernel(static_cast<kernel_isa_t>(isa));
+
+        std::vector<double> d1(padded), d2(padded);
+        kernel(samples.data(), window.data(), nsamples, coeffs.data(), padded, d1.data(), d2.data());
+
+        // same operations in the same order, i.e. identical results
+        CPPUNIT_ASSERT(ref_d1 == d1);
+        CPPUNIT_ASSERT(ref_d2 == d2);
+      }
+    }
+
+    void
+    qa_kernels::sos_cascade_variants()
+    {
+      srand(14);
+
+      const std::vector<sos_section_t> sections {
+        {0.2f, 0.4f, 0.2f, -0.6f, 0.2f},
+        {1.0f, -2.0f, 1.0f, -1.8f, 0.85f},
+        {0.5f, 0.5f, 0.0f, -0.3f, 0.0f}
+      };
+      const int nsamples = 100;
+
+      // lane counts covering the 8 and 16 lane bodies and the remainders
+      for (int nlanes : {1, 3, 8, 13, 16, 24, 27}) {
+        auto in = random_samples(nsamples * nlanes);
+        in[3] = 0.0f;
+
+        std::vector<float> ref_out(in.size()), ref_state(2 * sections.size() * nlanes, 0.0f);
+        sos_detail::sos_cascade_generic(sections.data(), sections.size(), ref_state.data(), in.data(),
+                ref_out.data(), nlanes, nlanes, nsamples);
+
+        for (int isa = KERNEL_ISA_GENERIC; isa <= get_kernel_isa(); isa++) {
+          auto kernel = sos_detail::sos_cascade_kernel(static_cast<kernel_isa_t>(isa));
+
+          std::vector<float> out(in.size()), state(ref_state.size(), 0.0f);
+          kernel(sections.data(), sections.size(), state.data(), in.data(), out.data(), nlanes, nlanes, nsamples);
+
+          for (size_t i = 0; i < out.size(); i++) {
+            CPPUNIT_ASSERT_DOUBLES_EQUAL(ref_out[i], out[i], 1e-4);
+          }
+          for (size_t i = 0; i < state.size(); i++) {
+            CPPUNIT_ASSERT_DOUBLES_EQUAL(ref_state[i], state[i], 1e-4);
+          }
+        }
+      }
+    }
+
+    void
+    qa_kernels::lane_dot_prod_variants()
+    {
+      srand(15);
+
+      for (int ntaps : {1, 7, 64}) {
+        auto taps = random_samples(ntaps);
+        taps[std::min(ntaps - 1, 3)] = 0.5f;
+
+        // lane counts covering the 8 and 16 lane bodies and the remainders
+        for (int nlanes : {1, 3, 8, 13, 16, 24, 27}) {
+          auto in = random_samples(ntaps * nlanes);
+          in[std::min(ntaps * nlanes - 1, 3)] = 0.0f;
+
+          std::vector<float> ref_out(nlanes);
+          lane_fir_detail::lane_dot_prod_generic(taps.data(), ntaps, in.data(), ref_out.data(), nlanes, nlanes);
+
+          for (int isa = KERNEL_ISA_GENERIC; isa <= get_kernel_isa(); isa++) {
+            auto kernel = lane_fir_detail::lane_dot_prod_kernel(static_cast<kernel_isa_t>(isa));
+
+            std::vector<float> out(nlanes);
+            kernel(taps.data(), ntaps, in.data(), out.data(), nlanes, nlanes);
+
+            // products up to 100, summed in a different order
+            for (int l = 0; l < nlanes; l++) {
+              CPPUNIT_ASSERT_DOUBLES_EQUAL(ref_out[l], out[l], 1e-4 * ntaps);
+            }
+          }
+        }
+      }
+    }
+
+    void
+    qa_kernels::half_conversion_variants()
+    {
+      srand(16);
+
+      // All the half values, including subnormals, infinities and NaNs
+      std::vector<uint16_t> all_halves(65536);
+      for (int i = 0; i < 65536; i++) {
+        all_halves[i] = static_cast<uint16_t>(i);
+      }
+
+      for (int isa = KERNEL_ISA_GENERIC; isa <= get_kernel_isa(); isa++) {
+        auto to_half = half_detail::float_to_half_kernel(static_cast<kernel_isa_t>(isa));
+        auto to_float = half_detail::half_to_float_kernel(static_cast<kernel_isa_t>(isa));
+
+        // Exact round trip
+        std::vector<float> floats(all_halves.size());
+        std::vector<uint16_t> halves(all_halves.size());
+        to_float(all_halves.data(), floats.data(), floats.size());
+        to_half(floats.data(), halves.data(), halves.size());
+        for (size_t i = 0; i < all_halves.size(); i++) {
+          if (!std::isnan(floats[i])) {
+            CPPUNIT_ASSERT_EQUAL(all_halves[i], halves[i]);
+          }
+        }
+
+        for (int n : LENGTHS) {
+          auto samples = random_samples(n);
+          samples[0] = 1e6f;    // beyond the half range
+          samples[std::min(n - 1, 1)] = 1.00048828125f;   // tie, rounds to even
+
+          std::vector<uint16_t> ref_out(n), out(n);
+          half_detail::float_to_half_generic(samples.data(), ref_out.data(), n);
+          to_half(samples.data(), out.data(), n);
+
+          for (int i = 0; i < n; i++) {
+            CPPUNIT_ASSERT_EQUAL(ref_out[i], out[i]);
+          }
+          CPPUNIT_ASSERT(std::isinf(half_detail::half_to_float_scalar(out[0])));
+          if (n > 1) {
+            CPPUNIT_ASSERT_EQUAL(1.0f, half_detail::half_to_float_scalar(out[1]));
+          }
+        }
+      }
+    }
+
+    void
+    qa_kernels::fused_pipeline()
+    {
+      srand(17);
+
+      const std::vector<float> taps {0.1f, 0.2f, 0.4f, 0.2f, 0.1f};
+      const std::vector<sos_section_t> sections {{0.2f, 0.4f, 0.2f, -0.6f, 0.2f}};
+      const size_t delay = 3, decim = 4;
+      const size_t noutputs = 3000;  // more than a single strip
+      auto in = random_samples(noutputs * 2 * decim);
+      in[3] = 0.0f;
+
+      // reference, stage by stage over the whole input
+      std::vector<float> filtered(in.size());
+      for (size_t i = 0; i < in.size(); i++) {
+        for (size_t k = 0; k < taps.size() && k <= i; k++) {
+          filtered[i] += taps[k] * in[i - k];
+        }
+      }
+      std::vector<float> smoothed(filtered.size() / 2), state(2, 0.0f);
+      for (size_t m = 0; m < smoothed.size(); m++) {
+        smoothed[m] = filtered[2 * m];
+      }
+      sos_cascade(sections.data(), 1, state.data(), smoothed.data(), smoothed.data(), 1, smoothed.size());
+      std::vector<float> ref_out(noutputs);
+      for (size_t m = 0; m < noutputs; m++) {
+        const auto i = m * decim;
+        ref_out[m] = i >= delay ? smoothed[i - delay] : 0.0f;
+      }
+
+      fused_pipeline_t<fir_decimator_stage_t, sos_stage_t, delay_stage_t, keep_nth_stage_t> pipeline(
+              fir_decimator_stage_t(taps, 2), sos_stage_t(sections), delay_stage_t(delay),
+              keep_nth_stage_t(decim));
+      CPPUNIT_ASSERT_EQUAL(size_t(2 * decim), pipeline.decimation());
+
+      // state is carried between the calls, including calls shorter than the delay
+      std::vector<float> out(noutputs);
+      size_t done = 0;
+      for (size_t n : {size_t(1), size_t(2), size_t(997), noutputs - 1000}) {
+        pipeline.process(in.data() + done * pipeline.decimation(), out.data() + done, n);
+        done += n;
+      }
+
+      for (size_t m = 0; m < noutputs; m++) {
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(ref_out[m], out[m], 1e-4);
+      }
+    }
+
+  } /* namespace digitizers */
+} /* namespace gr */
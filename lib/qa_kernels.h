@@ -0,0 +1,52 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+
+#ifndef _QA_KERNELS_H_
+#define _QA_KERNELS_H_
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/TestCase.h>
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * Compares the kernel variants available on this CPU against the generic ones.
+     */
+    class qa_kernels : public CppUnit::TestCase
+    {
+    public:
+      CPPUNIT_TEST_SUITE(qa_kernels);
+      CPPUNIT_TEST(raw_convert_variants);
+      CPPUNIT_TEST(min_max_agg_convert_variants);
+      CPPUNIT_TEST(min_max_agg_convert_reference);
+      CPPUNIT_TEST(threshold_masks_variants);
+      CPPUNIT_TEST(interlock_variants);
+      CPPUNIT_TEST(goertzel_variants);
+      CPPUNIT_TEST(sos_cascade_variants);
+      CPPUNIT_TEST(lane_dot_prod_variants);
+      CPPUNIT_TEST(half_conversion_variants);
+      CPPUNIT_TEST(fused_pipeline);
+      CPPUNIT_TEST_SUITE_END();
+
+    private:
+      void raw_convert_variants();
+      void min_max_agg_convert_variants();
+      void min_max_agg_convert_reference();
+      void threshold_masks_variants();
+      void interlock_variants();
+      void goertzel_variants();
+      void sos_cascade_variants();
+      void lane_dot_prod_variants();
+      void half_conversion_variants();
+      void fused_pipeline();
+    };
+
+  } /* namespace digitizers */
+} /* namespace gr */
+
+#endif /* _QA_KERNELS_H_ */
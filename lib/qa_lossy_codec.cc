@@ -0,0 +1,125 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#include <gnuradio/attributes.h>
+#include <cppunit/TestAssert.h>
+#include "qa_lossy_codec.h"
+#include <digitizers/lossy_codec.h>
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+namespace gr {
+  namespace digitizers {
+
+    // Returns the encoded size, asserts each sample is within quantization / 2 of its bound
+    static size_t
+    assert_round_trip(const std::vector<float> &samples, const std::vector<float> &bounds,
+            float quantization)
+    {
+      std::vector<uint8_t> data(lossy_encode_bound(samples.size()));
+      auto size = lossy_encode(samples.data(), bounds.data(), samples.size(), quantization, data.data());
+      CPPUNIT_ASSERT(size <= data.size());
+
+      std::vector<float> decoded(samples.size());
+      CPPUNIT_ASSERT_EQUAL(size, lossy_decode(data.data(), size, decoded.data(), decoded.size()));
+      for (size_t i = 0; i < samples.size(); i++) {
+        CPPUNIT_ASSERT(std::fabs(decoded[i] - samples[i]) <= 0.5001f * quantization * bounds[i]);
+      }
+
+      return size;
+    }
+
+    void
+    qa_lossy_codec::round_trip()
+    {
+      const float quantization = 0.125f;
+
+      // Sizes around the block size, including the empty input
+      for (size_t n : {0, 1, 127, 128, 129, 1000}) {
+        // Slow sine with noise of the order of the errors
+        std::vector<float> sine(n), errors(n);
+        for (size_t i = 0; i < n; i++) {
+          errors[i] = 0.01f * (1.0f + 0.1f * (std::rand() % 10));
+          sine[i] = 5.0f * std::sin(i * 0.01f) + 0.01f * ((std::rand() % 200) / 100.0f - 1.0f);
+        }
+        auto size = assert_round_trip(sine, errors, quantization);
+        if (n >= LOSSY_CODEC_BLOCK_SIZE) {
+          CPPUNIT_ASSERT(size * 3 < n * sizeof(float));
+        }
+
+        // The errors encoded with themselves as bounds
+        assert_round_trip(errors, errors, quantization);
+
+        // Constant signal, a block header per block
+        std::vector<float> constant(n, 1.5f), bounds(n, 0.001f);
+        const size_t nblocks = (n + LOSSY_CODEC_BLOCK_SIZE - 1) / LOSSY_CODEC_BLOCK_SIZE;
+        CPPUNIT_ASSERT_EQUAL(nblocks * 13, assert_round_trip(constant, bounds, quantization));
+      }
+    }
+
+    void
+    qa_lossy_codec::verbatim_blocks()
+    {
+      const size_t n = 3 * LOSSY_CODEC_BLOCK_SIZE;
+      std::vector<float> samples(n), bounds(n, 0.01f);
+      for (size_t i = 0; i < n; i++) {
+        samples[i] = std::sin(i * 0.1f);
+      }
+
+      // A zero bound, a non-finite sample and a huge dynamic range, each in a block of its own
+      bounds[10] = 0.0f;
+      samples[LOSSY_CODEC_BLOCK_SIZE + 5] = std::numeric_limits<float>::quiet_NaN();
+      samples[2 * LOSSY_CODEC_BLOCK_SIZE + 5] = 1e30f;
+
+      std::vector<uint8_t> data(lossy_encode_bound(n));
+      auto size = lossy_encode(samples.data(), bounds.data(), n, 0.125f, data.data());
+      CPPUNIT_ASSERT_EQUAL(lossy_encode_bound(n), size);
+
+      std::vector<float> decoded(n);
+      CPPUNIT_ASSERT_EQUAL(size, lossy_decode(data.data(), size, decoded.data(), n));
+      for (size_t i = 0; i < n; i++) {
+        CPPUNIT_ASSERT(std::isnan(samples[i]) ? std::isnan(decoded[i]) : decoded[i] == samples[i]);
+      }
+
+      CPPUNIT_ASSERT_THROW(lossy_encode(samples.data(), bounds.data(), n, 0.0f, data.data()),
+              std::invalid_argument);
+    }
+
+    void
+    qa_lossy_codec::corrupt_data()
+    {
+      std::vector<float> samples(300), bounds(300, 0.1f);
+      for (size_t i = 0; i < samples.size(); i++) {
+        samples[i] = i * 0.7f;
+      }
+
+      std::vector<uint8_t> data(lossy_encode_bound(samples.size()));
+      auto size = lossy_encode(samples.data(), bounds.data(), samples.size(), 0.5f, data.data());
+      std::vector<float> decoded(samples.size());
+
+      // Truncated
+      CPPUNIT_ASSERT_THROW(lossy_decode(data.data(), size - 1, decoded.data(), decoded.size()),
+              std::invalid_argument);
+
+      // Invalid bit width
+      data[12] = 65;
+      CPPUNIT_ASSERT_THROW(lossy_decode(data.data(), size, decoded.data(), decoded.size()),
+              std::invalid_argument);
+
+      // Invalid step
+      const float step = -1.0f;
+      std::memcpy(data.data(), &step, sizeof(step));
+      CPPUNIT_ASSERT_THROW(lossy_decode(data.data(), size, decoded.data(), decoded.size()),
+              std::invalid_argument);
+    }
+
+  } /* namespace digitizers */
+} /* namespace gr */
@@ -0,0 +1,35 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+
+#ifndef _QA_LOSSY_CODEC_H_
+#define _QA_LOSSY_CODEC_H_
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/TestCase.h>
+
+namespace gr {
+  namespace digitizers {
+
+    class qa_lossy_codec : public CppUnit::TestCase
+    {
+    public:
+      CPPUNIT_TEST_SUITE(qa_lossy_codec);
+      CPPUNIT_TEST(round_trip);
+      CPPUNIT_TEST(verbatim_blocks);
+      CPPUNIT_TEST(corrupt_data);
+      CPPUNIT_TEST_SUITE_END();
+
+    private:
+      void round_trip();
+      void verbatim_blocks();
+      void corrupt_data();
+    };
+
+  } /* namespace digitizers */
+} /* namespace gr */
+
+#endif /* _QA_LOSSY_CODEC_H_ */
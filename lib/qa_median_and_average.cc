@@ -14,6 +14,8 @@
 #include <gnuradio/blocks/vector_source_f.h>
 #include <gnuradio/blocks/vector_sink_f.h>
 
+#include <algorithm>
+#include <cstdlib>
 #include <thread>
 #include <chrono>
 
@@ -44,6 +46,58 @@ namespace gr {
       }
     }
 
+    void
+    qa_median_and_average::sliding_median_reference()
+    {
+      const int vec_size = 257;
+      const int n_med = 5, n_lp = 3;
+
+      std::vector<float> data;
+      srand(42);
+      for (int i = 0; i < 2 * vec_size; i++) {
+        data.push_back(static_cast<float>(rand() % 100) / 10.0f);  // duplicates are likely
+      }
+
+      auto top = gr::make_top_block("sliding_median_reference");
+      auto src = blocks::vector_source_f::make(data, false, vec_size);
+      auto snk = blocks::vector_sink_f::make(vec_size);
+      auto flt = digitizers::median_and_average::make(vec_size, n_med, n_lp);
+      top->connect(src, 0, flt, 0);
+      top->connect(flt, 0, snk, 0);
+      top->run();
+
+      auto results = snk->data();
+      CPPUNIT_ASSERT_EQUAL(data.size(), results.size());
+
+      auto clamp = [vec_size](int k) { return std::min(std::max(k, 0), vec_size - 1); };
+
+      for (int v = 0; v < 2; v++) {
+        const float *in = &data[v * vec_size];
+
+        // brute force: median of the clamped window without the center, then average
+        std::vector<float> medians(vec_size);
+        for (int i = 0; i < vec_size; i++) {
+          std::vector<float> window;
+          for (int k = i - n_med; k <= i + n_med; k++) {
+            if (clamp(k) != i) {
+              window.push_back(in[clamp(k)]);
+            }
+          }
+          std::sort(window.begin(), window.end());
+          const size_t size = window.size();
+          medians[i] = size % 2 ? window[size / 2] : 0.5f * (window[size / 2] + window[size / 2 - 1]);
+        }
+
+        for (int i = 0; i < vec_size; i++) {
+          float sum = 0.0f;
+          for (int k = i - n_lp; k <= i + n_lp; k++) {
+            sum += medians[clamp(k)];
+          }
+          CPPUNIT_ASSERT_DOUBLES_EQUAL(sum / (2 * n_lp + 1), results[v * vec_size + i], 1e-4);
+        }
+      }
+    }
+
   } /* namespace digitizers */
 } /* namespace gr */
 
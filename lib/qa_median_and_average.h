@@ -19,10 +19,12 @@ namespace gr {
     public:
       CPPUNIT_TEST_SUITE(qa_median_and_average);
       CPPUNIT_TEST(basic_median_and_average);
+      CPPUNIT_TEST(sliding_median_reference);
       CPPUNIT_TEST_SUITE_END();
 
     private:
       void basic_median_and_average();
+      void sliding_median_reference();
     };
 
   } /* namespace digitizers */
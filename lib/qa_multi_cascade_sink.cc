@@ -0,0 +1,288 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#include <gnuradio/attributes.h>
+#include <cppunit/TestAssert.h>
+#include "qa_multi_cascade_sink.h"
+#include <digitizers/multi_cascade_sink.h>
+#include <digitizers/status.h>
+#include "fused_aggregation_impl.h"
+#include "multi_fused_aggregation_impl.h"
+#include "gpu_aggregation.h"
+#include <gnuradio/top_block.h>
+#include <gnuradio/blocks/vector_source_f.h>
+#include <gnuradio/blocks/vector_sink_f.h>
+
+#include <cmath>
+#include <initializer_list>
+#include <stdexcept>
+
+namespace gr {
+  namespace digitizers {
+
+    namespace {
+
+      // Host stand-in for the GPU, outputs constants
+      class host_backend_t : public gpu_aggregation_t
+      {
+      public:
+        explicit host_backend_t(int nchannels, int *processed)
+          : d_nchannels(nchannels),
+            d_processed(processed)
+        {
+        }
+
+        void set_taps(const std::vector<float> &, int, float) override
+        {
+        }
+
+        void reserve(size_t ninput, float **values, float **errors) override
+        {
+          d_values.resize(ninput * d_nchannels);
+          d_errors.resize(ninput * d_nchannels);
+          *values = &d_values[0];
+          *errors = &d_errors[0];
+        }
+
+        void process(size_t ninput, int decim, const float **values, const float **sigma) override
+        {
+          d_filtered.assign(ninput / decim * d_nchannels, 0.5f);
+          d_sigmas.assign(ninput / decim * d_nchannels, 0.25f);
+          *values = &d_filtered[0];
+          *sigma = &d_sigmas[0];
+          *d_processed += static_cast<int>(ninput);
+        }
+
+      private:
+        const int d_nchannels;
+        int *d_processed;
+        std::vector<float> d_values, d_errors, d_filtered, d_sigmas;
+      };
+
+      // Feeds n samples per channel to the block, offset by phase, returns the outputs per port
+      std::vector<std::vector<float>>
+      run_phase(multi_fused_aggregation_ff::sptr block, int n, int phase)
+      {
+        auto top = gr::make_top_block("test");
+        std::vector<gr::blocks::vector_sink_f::sptr> sinks;
+        for (int c = 0; c < block->nchannels(); c++) {
+          std::vector<float> values, errors;
+          for (int i = 0; i < n; i++) {
+            values.push_back(1.0f + phase + std::sin(0.01 * (c + 1) * (i + phase * n)));
+            errors.push_back(0.01f * (c + 1) * (phase + 1));
+          }
+
+          top->connect(gr::blocks::vector_source_f::make(values), 0, block, 2 * c);
+          top->connect(gr::blocks::vector_source_f::make(errors), 0, block, 2 * c + 1);
+          for (int port = 0; port < 2; port++) {
+            sinks.push_back(gr::blocks::vector_sink_f::make());
+            top->connect(block, 2 * c + port, sinks.back(), 0);
+          }
+        }
+
+        top->run();
+
+        std::vector<std::vector<float>> outputs;
+        for (const auto &sink : sinks) {
+          outputs.push_back(sink->data());
+        }
+        return outputs;
+      }
+
+    } // namespace
+
+    void
+    qa_multi_cascade_sink::fused_lanes()
+    {
+      // more channels than a single register holds, i.e. full lanes and a remainder
+      const int nchannels = 19, n = 4000, decim = 10, delay = 3;
+      const double samp_rate = 10000.0;
+
+      auto top = gr::make_top_block("test");
+      auto multi = multi_fused_aggregation_ff::make(nchannels, FIR_LP, decim, delay, {}, 0.0, 500.0, 100.0, samp_rate);
+      CPPUNIT_ASSERT_EQUAL(nchannels, multi->nchannels());
+
+      std::vector<gr::blocks::vector_sink_f::sptr> multi_sinks, reference_sinks;
+      for (int c = 0; c < nchannels; c++) {
+        std::vector<float> values, errors;
+        for (int i = 0; i < n; i++) {
+          values.push_back(std::sin(0.003 * (c + 1) * i) + 0.2f * std::cos(0.9 * i + c));
+          errors.push_back(0.01f * (c + 1));
+        }
+
+        auto value_source = gr::blocks::vector_source_f::make(values);
+        auto error_source = gr::blocks::vector_source_f::make(errors);
+        auto reference = fused_aggregation_ff::make(FIR_LP, decim, delay, {}, 0.0, 500.0, 100.0, samp_rate);
+        top->connect(value_source, 0, multi, 2 * c);
+        top->connect(error_source, 0, multi, 2 * c + 1);
+        top->connect(value_source, 0, reference, 0);
+        top->connect(error_source, 0, reference, 1);
+
+        for (int port = 0; port < 2; port++) {
+          auto multi_sink = gr::blocks::vector_sink_f::make();
+          auto reference_sink = gr::blocks::vector_sink_f::make();
+          top->connect(multi, 2 * c + port, multi_sink, 0);
+          top->connect(reference, port, reference_sink, 0);
+          multi_sinks.push_back(multi_sink);
+          reference_sinks.push_back(reference_sink);
+        }
+      }
+
+      top->run();
+
+      for (size_t s = 0; s < multi_sinks.size(); s++) {
+        auto expected = reference_sinks[s]->data();
+        auto actual = multi_sinks[s]->data();
+        CPPUNIT_ASSERT_EQUAL(size_t(n / decim), actual.size());
+        CPPUNIT_ASSERT_EQUAL(expected.size(), actual.size());
+        for (size_t i = 0; i < actual.size(); i++) {
+          CPPUNIT_ASSERT_DOUBLES_EQUAL(expected[i], actual[i], 1e-5);
+        }
+      }
+
+      CPPUNIT_ASSERT_THROW(multi_fused_aggregation_ff::make(0, FIR_LP, decim, delay, {}, 0.0, 500.0, 100.0, samp_rate),
+              std::invalid_argument);
+      CPPUNIT_ASSERT_THROW(multi_fused_aggregation_ff::make(2, IIR_LP, decim, delay, {}, 0.0, 500.0, 100.0, samp_rate),
+              std::invalid_argument);
+    }
+
+    void
+    qa_multi_cascade_sink::levels_and_sinks()
+    {
+      const double samp_rate = 100000.0;
+      const std::vector<cascade_level_t> levels = {
+        {"10kHz", "",      10,  0},
+        {"1kHz",  "10kHz", 10, 10},
+        {"500Hz", "10kHz", 20,  0},  // pruned
+        {"100Hz", "1kHz",  10,  1}
+      };
+      const std::vector<std::string> names {"a", "b", "c"};
+
+      CPPUNIT_ASSERT_THROW(multi_cascade_sink::make(AVERAGE, 0, {}, 10.0, 100.0, 10.0, {}, {}, samp_rate,
+              {}, "V", levels), std::invalid_argument);
+
+      // shared blocks (average) and one block_aggregation per channel (IIR)
+      for (auto alg_id : {AVERAGE, IIR_LP}) {
+        auto cascade = multi_cascade_sink::make(alg_id, 0, {}, 10.0, 100.0, 10.0, {}, {}, samp_rate,
+                names, "V", levels);
+        CPPUNIT_ASSERT_EQUAL(3, cascade->nchannels());
+        CPPUNIT_ASSERT_EQUAL(size_t(3), cascade->get_levels().size());
+
+        auto sinks = cascade->get_time_domain_sinks(1);
+        CPPUNIT_ASSERT_EQUAL(size_t(2), sinks.size());
+        CPPUNIT_ASSERT_EQUAL(std::string("b@100Hz"), sinks[0]->get_metadata().name);
+        CPPUNIT_ASSERT_EQUAL(std::string("b@1kHz"), sinks[1]->get_metadata().name);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(100.0, sinks[0]->get_sample_rate(), 1e-6);
+        CPPUNIT_ASSERT_EQUAL(size_t(6), cascade->get_time_domain_sinks().size());
+        CPPUNIT_ASSERT_THROW(cascade->get_time_domain_sinks(3), std::invalid_argument);
+
+        auto top = gr::make_top_block("test");
+        for (int c = 0; c < cascade->nchannels(); c++) {
+          auto values = gr::blocks::vector_source_f::make(std::vector<float>(10000, 1.0 + c));
+          auto errors = gr::blocks::vector_source_f::make(std::vector<float>(10000, 0.1));
+          top->connect(values, 0, cascade, 2 * c);
+          top->connect(errors, 0, cascade, 2 * c + 1);
+        }
+        top->run();
+      }
+    }
+
+    void
+    qa_multi_cascade_sink::gpu_offload()
+    {
+      const int nchannels = 37, n = 6000, decim = 10, delay = 3;
+      const double samp_rate = 10000.0;
+
+      auto top = gr::make_top_block("test");
+      auto cpu = multi_fused_aggregation_ff::make(nchannels, FIR_LP, decim, delay, {}, 0.0, 500.0, 100.0, samp_rate);
+      auto gpu = multi_fused_aggregation_ff::make(nchannels, FIR_LP, decim, delay, {}, 0.0, 500.0, 100.0, samp_rate);
+      if (!gpu->set_gpu_offload(true)) {
+        // built without OpenCL or no device, nothing else to test
+        CPPUNIT_ASSERT(gpu_aggregation_t::make(nchannels) == nullptr);
+        return;
+      }
+
+      std::vector<gr::blocks::vector_sink_f::sptr> cpu_sinks, gpu_sinks;
+      for (int c = 0; c < nchannels; c++) {
+        std::vector<float> values, errors;
+        for (int i = 0; i < n; i++) {
+          values.push_back(std::sin(0.002 * (c + 1) * i) + 0.1f * std::cos(0.7 * i + c));
+          errors.push_back(0.02f * (c % 5 + 1));
+        }
+
+        auto value_source = gr::blocks::vector_source_f::make(values);
+        auto error_source = gr::blocks::vector_source_f::make(errors);
+        for (auto block : {cpu, gpu}) {
+          top->connect(value_source, 0, block, 2 * c);
+          top->connect(error_source, 0, block, 2 * c + 1);
+        }
+
+        for (int port = 0; port < 2; port++) {
+          auto cpu_sink = gr::blocks::vector_sink_f::make();
+          auto gpu_sink = gr::blocks::vector_sink_f::make();
+          top->connect(cpu, 2 * c + port, cpu_sink, 0);
+          top->connect(gpu, 2 * c + port, gpu_sink, 0);
+          cpu_sinks.push_back(cpu_sink);
+          gpu_sinks.push_back(gpu_sink);
+        }
+      }
+
+      top->run();
+
+      // the GPU sums in a different order, i.e. not bit exact
+      for (size_t s = 0; s < cpu_sinks.size(); s++) {
+        auto expected = cpu_sinks[s]->data();
+        auto actual = gpu_sinks[s]->data();
+        CPPUNIT_ASSERT_EQUAL(size_t(n / decim), actual.size());
+        for (size_t i = 0; i < actual.size(); i++) {
+          CPPUNIT_ASSERT_DOUBLES_EQUAL(expected[i], actual[i], 1e-4);
+        }
+      }
+
+      CPPUNIT_ASSERT(!gpu->set_gpu_offload(false));
+    }
+
+    void
+    qa_multi_cascade_sink::backend_switch()
+    {
+      const int nchannels = 3, n = 2000, decim = 10, delay = 3;
+      const double samp_rate = 10000.0;
+
+      int processed = 0;
+      auto block = multi_fused_aggregation_ff::make(nchannels, FIR_LP, decim, delay, {}, 0.0, 500.0, 100.0, samp_rate);
+      CPPUNIT_ASSERT(!block->set_gpu_offload(false));
+
+      // fills the host histories
+      run_phase(block, n, 0);
+
+      // the backend is taken by the first work call
+      block->set_gpu_backend(std::unique_ptr<gpu_aggregation_t>(new host_backend_t(nchannels, &processed)));
+      auto offloaded = run_phase(block, n, 1);
+      CPPUNIT_ASSERT_EQUAL(n, processed);
+      for (size_t port = 0; port < offloaded.size(); port++) {
+        CPPUNIT_ASSERT_EQUAL(size_t(n / decim), offloaded[port].size());
+        for (auto value : offloaded[port]) {
+          CPPUNIT_ASSERT_EQUAL(port % 2 ? 0.25f : 0.5f, value);
+        }
+      }
+
+      // back on the CPU the histories restart from zero, i.e. as if the block was new
+      CPPUNIT_ASSERT(!block->set_gpu_offload(false));
+      auto actual = run_phase(block, n, 2);
+      auto fresh = multi_fused_aggregation_ff::make(nchannels, FIR_LP, decim, delay, {}, 0.0, 500.0, 100.0, samp_rate);
+      auto expected = run_phase(fresh, n, 2);
+      CPPUNIT_ASSERT_EQUAL(n, processed);
+      CPPUNIT_ASSERT_EQUAL(expected.size(), actual.size());
+      for (size_t port = 0; port < actual.size(); port++) {
+        CPPUNIT_ASSERT_EQUAL(size_t(n / decim), actual[port].size());
+        for (size_t i = 0; i < actual[port].size(); i++) {
+          CPPUNIT_ASSERT_DOUBLES_EQUAL(expected[port][i], actual[port][i], 1e-6);
+        }
+      }
+    }
+
+  } /* namespace digitizers */
+} /* namespace gr */
@@ -0,0 +1,37 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+
+#ifndef _QA_MULTI_CASCADE_SINK_H_
+#define _QA_MULTI_CASCADE_SINK_H_
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/TestCase.h>
+
+namespace gr {
+  namespace digitizers {
+
+    class qa_multi_cascade_sink : public CppUnit::TestCase
+    {
+    public:
+      CPPUNIT_TEST_SUITE(qa_multi_cascade_sink);
+      CPPUNIT_TEST(fused_lanes);
+      CPPUNIT_TEST(levels_and_sinks);
+      CPPUNIT_TEST(gpu_offload);
+      CPPUNIT_TEST(backend_switch);
+      CPPUNIT_TEST_SUITE_END();
+
+    private:
+      void fused_lanes();
+      void levels_and_sinks();
+      void gpu_offload();
+      void backend_switch();
+    };
+
+  } /* namespace digitizers */
+} /* namespace gr */
+
+#endif /* _QA_MULTI_CASCADE_SINK_H_ */
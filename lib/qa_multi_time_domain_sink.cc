@@ -0,0 +1,119 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#include "qa_multi_time_domain_sink.h"
+
+#include <cppunit/TestAssert.h>
+#include <digitizers/multi_time_domain_sink.h>
+#include <digitizers/status.h>
+#include <digitizers/tags.h>
+#include <gnuradio/top_block.h>
+#include <gnuradio/blocks/vector_source_f.h>
+
+#include <cstdlib>
+
+namespace gr {
+  namespace digitizers {
+
+    static void
+    multi_measurement_callback(const multi_measurement_package_sptr &measurement, void *userdata)
+    {
+        auto measurements = static_cast<std::vector<multi_measurement_package_sptr> *>(userdata);
+        measurements->push_back(measurement);
+    }
+
+    /*
+     * One callback per package, the timing is shared by the channels
+     */
+    void
+    qa_multi_time_domain_sink::triggered_channels()
+    {
+        auto top = gr::make_top_block("test multi measurements");
+
+        const uint32_t pre_samples = 10;
+        const uint32_t post_samples = 40;
+        const size_t package_size = pre_samples + post_samples;
+        const size_t npackages = 4;
+        const size_t nchannels = 3;
+
+        auto sink = multi_time_domain_sink::make({"ch0", "ch1", "ch2"}, "V", 1000.0, TIME_SINK_MODE_TRIGGERED,
+                static_cast<int>(pre_samples), static_cast<int>(post_samples));
+        CPPUNIT_ASSERT_EQUAL(int(nchannels), sink->nchannels());
+
+        std::vector<multi_measurement_package_sptr> measurements;
+        sink->set_measurement_callback(multi_measurement_callback, &measurements, 1);
+
+        // 1 ms per sample, only the first channel carries the timing
+        acq_info_t acq_info {};
+        acq_info.timestamp = 1000000;
+        acq_info.timebase = 0.001;
+        acq_info.user_delay = 0.1;
+
+        acq_info_t overflow_info = acq_info;
+        overflow_info.timestamp = -1;
+        overflow_info.status = CHANNEL_STATUS_OVERFLOW;
+
+        for (size_t c = 0; c < nchannels; c++) {
+            std::vector<float> values, errors;
+            for (size_t i = 0; i < npackages * package_size; i++) {
+                values.push_back(c * 1000.0f + i);
+                errors.push_back(c + 0.5f);
+            }
+
+            std::vector<gr::tag_t> tags;
+            if (c == 0) {
+                tags.push_back(make_acq_info_tag(acq_info, 0));
+            }
+            else if (c == 1) {
+                tags.push_back(make_acq_info_tag(overflow_info, 0));
+            }
+
+            for (size_t p = 0; p < npackages; p++) {
+                // The last channel is off by five samples in the last package
+                const size_t shift = (c == 2 && p == npackages - 1) ? 5 : 0;
+                tags.push_back(make_trigger_tag(1, 5000000000 + p, p * package_size + pre_samples + shift, 0));
+            }
+
+            auto values_src = gr::blocks::vector_source_f::make(values, false, 1, tags);
+            auto errors_src = gr::blocks::vector_source_f::make(errors);
+            top->connect(values_src, 0, sink, 2 * c);
+            top->connect(errors_src, 0, sink, 2 * c + 1);
+        }
+
+        top->run();
+
+        CPPUNIT_ASSERT_EQUAL(npackages, measurements.size());
+        CPPUNIT_ASSERT_EQUAL(uint64_t(1), sink->get_misaligned_count());
+
+        for (size_t p = 0; p < npackages; p++) {
+            const auto &measurement = measurements[p];
+            CPPUNIT_ASSERT_EQUAL(p * package_size, static_cast<size_t>(measurement->offset));
+            CPPUNIT_ASSERT_EQUAL(nchannels, measurement->values.size());
+            CPPUNIT_ASSERT_EQUAL(nchannels, measurement->errors.size());
+
+            for (size_t c = 0; c < nchannels; c++) {
+                CPPUNIT_ASSERT_EQUAL(package_size, measurement->values[c].size());
+                CPPUNIT_ASSERT_EQUAL(package_size, measurement->errors[c].size());
+                for (size_t i = 0; i < package_size; i++) {
+                    CPPUNIT_ASSERT_EQUAL(c * 1000.0f + p * package_size + i, measurement->values[c][i]);
+                    CPPUNIT_ASSERT_EQUAL(c + 0.5f, measurement->errors[c][i]);
+                }
+            }
+
+            const auto &info = measurement->info;
+            const int64_t expected_timestamp = 1000000 + static_cast<int64_t>(p * package_size) * 1000000;
+            CPPUNIT_ASSERT(std::abs(info.timestamp - expected_timestamp) <= 1);
+            CPPUNIT_ASSERT_EQUAL(int64_t(5000000000 + p), info.trigger_timestamp);
+            CPPUNIT_ASSERT_EQUAL(uint32_t(CHANNEL_STATUS_OVERFLOW), info.status);
+            CPPUNIT_ASSERT_EQUAL(pre_samples, info.pre_trigger_samples);
+            CPPUNIT_ASSERT_EQUAL(post_samples, info.post_trigger_samples);
+            CPPUNIT_ASSERT_EQUAL(0.001, info.timebase);
+            CPPUNIT_ASSERT_EQUAL(0.1, info.user_delay);
+        }
+    }
+
+  } /* namespace digitizers */
+} /* namespace gr */
@@ -0,0 +1,31 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+
+#ifndef _QA_MULTI_TIME_DOMAIN_SINK_H_
+#define _QA_MULTI_TIME_DOMAIN_SINK_H_
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/TestCase.h>
+
+namespace gr {
+  namespace digitizers {
+
+    class qa_multi_time_domain_sink : public CppUnit::TestCase
+    {
+    public:
+      CPPUNIT_TEST_SUITE(qa_multi_time_domain_sink);
+      CPPUNIT_TEST(triggered_channels);
+      CPPUNIT_TEST_SUITE_END();
+
+    private:
+      void triggered_channels();
+    };
+
+  } /* namespace digitizers */
+} /* namespace gr */
+
+#endif /* _QA_MULTI_TIME_DOMAIN_SINK_H_ */
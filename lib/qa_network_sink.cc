@@ -0,0 +1,291 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#include <gnuradio/attributes.h>
+#include <cppunit/TestAssert.h>
+#include "qa_network_sink.h"
+#include <digitizers/network_sink.h>
+#include <digitizers/lossy_codec.h>
+#include <digitizers/raw_codec.h>
+#include <digitizers/tags.h>
+#include <gnuradio/top_block.h>
+#include <gnuradio/blocks/vector_source_f.h>
+#include <gnuradio/blocks/vector_source_s.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+namespace gr {
+  namespace digitizers {
+
+    static int
+    connect_to_sink(int port)
+    {
+      int fd = socket(AF_INET, SOCK_STREAM, 0);
+      CPPUNIT_ASSERT(fd >= 0);
+
+      sockaddr_in addr;
+      std::memset(&addr, 0, sizeof(addr));
+      addr.sin_family = AF_INET;
+      addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+      addr.sin_port = htons(static_cast<uint16_t>(port));
+      CPPUNIT_ASSERT_EQUAL(0, connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)));
+
+      return fd;
+    }
+
+    // Reads until the sink closes the connection
+    static std::vector<char>
+    receive_all(int fd)
+    {
+      std::vector<char> data;
+      char buffer[4096];
+
+      while (true) {
+        auto n = recv(fd, buffer, sizeof(buffer), 0);
+        if (n <= 0) {
+          break;
+        }
+        data.insert(data.end(), buffer, buffer + n);
+      }
+
+      close(fd);
+      return data;
+    }
+
+    void
+    qa_network_sink::frames_and_decimation()
+    {
+      const int package_size = 100;
+      const int decimation = 2;
+
+      std::vector<float> values(800), errors(800);
+      for (size_t i = 0; i < values.size(); i++) {
+        values[i] = i;
+        errors[i] = i * 0.5f;
+      }
+
+      acq_info_t acq_info {};
+      acq_info.timestamp = 1000000000;
+      acq_info.timebase = 0.001;
+      acq_info.status = 0;
+
+      std::vector<gr::tag_t> tags {
+        make_acq_info_tag(acq_info, 0),
+        make_trigger_tag(1, 5000000000, 450, 0)
+      };
+
+      auto top = gr::make_top_block("network_sink");
+      auto value_src = gr::blocks::vector_source_f::make(values, false, 1, tags);
+      auto error_src = gr::blocks::vector_source_f::make(errors);
+      auto sink = network_sink::make(0, package_size, decimation);
+      CPPUNIT_ASSERT(sink->get_port() > 0);
+
+      top->connect(value_src, 0, sink, 0);
+      top->connect(error_src, 0, sink, 1);
+
+      // Pending connection is accepted on start
+      auto fd = connect_to_sink(sink->get_port());
+      top->run();
+
+      CPPUNIT_ASSERT_EQUAL(uint64_t(4), sink->get_sent_frames());
+      CPPUNIT_ASSERT_EQUAL(uint64_t(0), sink->get_skipped_frames());
+
+      auto data = receive_all(fd);
+      const size_t frame_size = sizeof(network_frame_header_t) + 2 * package_size * sizeof(float);
+      CPPUNIT_ASSERT_EQUAL(4 * frame_size, data.size());
+
+      for (int f = 0; f < 4; f++) {
+        network_frame_header_t header;
+        std::memcpy(&header, &data[f * frame_size], sizeof(header));
+
+        CPPUNIT_ASSERT_EQUAL(NETWORK_FRAME_MAGIC, header.magic);
+        CPPUNIT_ASSERT_EQUAL(NETWORK_FRAME_VERSION, header.version);
+        CPPUNIT_ASSERT_EQUAL(uint16_t(NETWORK_FRAME_HAS_ERRORS), header.flags);
+        CPPUNIT_ASSERT_EQUAL(uint32_t(sizeof(header)), header.header_size);
+        CPPUNIT_ASSERT_EQUAL(uint32_t(package_size), header.nsamples);
+        CPPUNIT_ASSERT_EQUAL(uint64_t(f), header.sequence);
+        CPPUNIT_ASSERT_EQUAL(uint64_t(f * package_size), header.offset);
+        CPPUNIT_ASSERT_EQUAL(uint64_t(0), header.info.samples_lost);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(0.002, header.info.timebase, 1e-12);
+        CPPUNIT_ASSERT_EQUAL(int64_t(1000000000 + f * 200000000), header.info.timestamp);
+
+        if (f == 2) {
+          CPPUNIT_ASSERT_EQUAL(int64_t(5000000000), header.info.trigger_timestamp);
+          CPPUNIT_ASSERT_EQUAL(uint32_t(25), header.info.pre_trigger_samples);
+          CPPUNIT_ASSERT_EQUAL(uint32_t(75), header.info.post_trigger_samples);
+        }
+        else {
+          CPPUNIT_ASSERT_EQUAL(int64_t(-1), header.info.trigger_timestamp);
+        }
+
+        const float *frame_values = reinterpret_cast<const float *>(&data[f * frame_size + sizeof(header)]);
+        const float *frame_errors = frame_values + package_size;
+        for (int i = 0; i < package_size; i++) {
+          const int input = (f * package_size + i) * decimation;
+          CPPUNIT_ASSERT_DOUBLES_EQUAL(values[input], frame_values[i], 1e-6);
+          CPPUNIT_ASSERT_DOUBLES_EQUAL(errors[input], frame_errors[i], 1e-6);
+        }
+      }
+    }
+
+    void
+    qa_network_sink::rate_limit()
+    {
+      const int package_size = 100;
+
+      std::vector<float> values(400);
+      for (size_t i = 0; i < values.size(); i++) {
+        values[i] = i;
+      }
+
+      auto top = gr::make_top_block("network_sink");
+      auto value_src = gr::blocks::vector_source_f::make(values);
+      auto sink = network_sink::make(0, package_size, 1, 1.0);
+      top->connect(value_src, 0, sink, 0);
+
+      auto fd = connect_to_sink(sink->get_port());
+      top->run();
+
+      // A single frame per second, the rest is skipped
+      CPPUNIT_ASSERT_EQUAL(uint64_t(1), sink->get_sent_frames());
+      CPPUNIT_ASSERT_EQUAL(uint64_t(3), sink->get_skipped_frames());
+
+      auto data = receive_all(fd);
+      CPPUNIT_ASSERT_EQUAL(sizeof(network_frame_header_t) + package_size * sizeof(float), data.size());
+
+      network_frame_header_t header;
+      std::memcpy(&header, &data[0], sizeof(header));
+      CPPUNIT_ASSERT_EQUAL(uint16_t(0), header.flags);
+      CPPUNIT_ASSERT_EQUAL(uint64_t(0), header.sequence);
+
+      const float *frame_values = reinterpret_cast<const float *>(&data[sizeof(header)]);
+      for (int i = 0; i < package_size; i++) {
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(values[i], frame_values[i], 1e-6);
+      }
+    }
+
+    void
+    qa_network_sink::raw_input()
+    {
+      const int package_size = 200;
+
+      std::vector<short> raw(600);
+      for (size_t i = 0; i < raw.size(); i++) {
+        raw[i] = static_cast<short>(3000.0 * std::sin(i * 0.05) + i % 5);
+      }
+
+      raw_scaling_t scaling {0.001, 0.5, 0.002};
+      std::vector<gr::tag_t> tags {
+        make_raw_scaling_tag(scaling, 0)
+      };
+
+      auto top = gr::make_top_block("network_sink");
+      auto raw_src = gr::blocks::vector_source_s::make(raw, false, 1, tags);
+      auto sink = network_sink::make(0, package_size, 1, 0.0, 8, true);
+      top->connect(raw_src, 0, sink, 0);
+
+      auto fd = connect_to_sink(sink->get_port());
+      top->run();
+
+      CPPUNIT_ASSERT_EQUAL(uint64_t(3), sink->get_sent_frames());
+
+      // Frames are of variable size, compressed below the raw size
+      auto data = receive_all(fd);
+      size_t position = 0;
+
+      for (int f = 0; f < 3; f++) {
+        network_frame_header_t header;
+        std::memcpy(&header, &data[position], sizeof(header));
+
+        CPPUNIT_ASSERT_EQUAL(uint16_t(NETWORK_FRAME_RAW_COMPRESSED), header.flags);
+        CPPUNIT_ASSERT_EQUAL(uint32_t(package_size), header.nsamples);
+        CPPUNIT_ASSERT(header.payload_size < package_size * sizeof(int16_t));
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(scaling.scale, header.scaling.scale, 1e-12);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(scaling.offset, header.scaling.offset, 1e-12);
+
+        std::vector<int16_t> decoded(package_size);
+        auto payload = reinterpret_cast<const uint8_t *>(&data[position + header.header_size]);
+        CPPUNIT_ASSERT_EQUAL(size_t(header.payload_size),
+                raw_decode(payload, header.payload_size, decoded.data(), decoded.size()));
+
+        for (int i = 0; i < package_size; i++) {
+          CPPUNIT_ASSERT_EQUAL(int16_t(raw[f * package_size + i]), decoded[i]);
+        }
+
+        position += header.header_size + header.payload_size;
+      }
+
+      CPPUNIT_ASSERT_EQUAL(data.size(), position);
+    }
+
+    void
+    qa_network_sink::lossy_compression()
+    {
+      const int package_size = 256;
+      const float quantization = 0.125f;
+
+      std::vector<float> values(512), errors(512);
+      for (size_t i = 0; i < values.size(); i++) {
+        values[i] = 2.0f * std::sin(i * 0.02f) + 0.01f * std::sin(i * 1.3f);
+        errors[i] = 0.01f + 0.001f * (i % 3);
+      }
+
+      auto top = gr::make_top_block("network_sink");
+      auto value_src = gr::blocks::vector_source_f::make(values);
+      auto error_src = gr::blocks::vector_source_f::make(errors);
+      auto sink = network_sink::make(0, package_size, 1, 0.0, 8, false, quantization);
+      top->connect(value_src, 0, sink, 0);
+      top->connect(error_src, 0, sink, 1);
+
+      auto fd = connect_to_sink(sink->get_port());
+      top->run();
+
+      CPPUNIT_ASSERT_EQUAL(uint64_t(2), sink->get_sent_frames());
+
+      auto data = receive_all(fd);
+      size_t position = 0;
+
+      for (int f = 0; f < 2; f++) {
+        network_frame_header_t header;
+        std::memcpy(&header, &data[position], sizeof(header));
+
+        CPPUNIT_ASSERT_EQUAL(uint16_t(NETWORK_FRAME_HAS_ERRORS | NETWORK_FRAME_LOSSY_COMPRESSED), header.flags);
+        CPPUNIT_ASSERT_EQUAL(quantization, header.quantization);
+        CPPUNIT_ASSERT(header.payload_size < package_size * sizeof(float));
+
+        // Values within quantization / 2 of their errors, followed by the errors
+        std::vector<float> decoded_values(package_size), decoded_errors(package_size);
+        auto payload = reinterpret_cast<const uint8_t *>(&data[position + header.header_size]);
+        auto consumed = lossy_decode(payload, header.payload_size, decoded_values.data(), package_size);
+        consumed += lossy_decode(payload + consumed, header.payload_size - consumed,
+                decoded_errors.data(), package_size);
+        CPPUNIT_ASSERT_EQUAL(size_t(header.payload_size), consumed);
+
+        for (int i = 0; i < package_size; i++) {
+          const int input = f * package_size + i;
+          CPPUNIT_ASSERT(std::fabs(values[input] - decoded_values[i]) <= 0.501f * quantization * errors[input]);
+          CPPUNIT_ASSERT(std::fabs(errors[input] - decoded_errors[i]) <= 0.501f * quantization * errors[input]);
+        }
+
+        position += header.header_size + header.payload_size;
+      }
+
+      CPPUNIT_ASSERT_EQUAL(data.size(), position);
+
+      // Raw counts are compressed losslessly only
+      CPPUNIT_ASSERT_THROW(network_sink::make(0, package_size, 1, 0.0, 8, true, quantization),
+              std::invalid_argument);
+    }
+
+  } /* namespace digitizers */
+} /* namespace gr */
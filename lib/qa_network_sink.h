@@ -0,0 +1,37 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+
+#ifndef _QA_NETWORK_SINK_H_
+#define _QA_NETWORK_SINK_H_
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/TestCase.h>
+
+namespace gr {
+  namespace digitizers {
+
+    class qa_network_sink : public CppUnit::TestCase
+    {
+    public:
+      CPPUNIT_TEST_SUITE(qa_network_sink);
+      CPPUNIT_TEST(frames_and_decimation);
+      CPPUNIT_TEST(rate_limit);
+      CPPUNIT_TEST(raw_input);
+      CPPUNIT_TEST(lossy_compression);
+      CPPUNIT_TEST_SUITE_END();
+
+    private:
+      void frames_and_decimation();
+      void rate_limit();
+      void raw_input();
+      void lossy_compression();
+    };
+
+  } /* namespace digitizers */
+} /* namespace gr */
+
+#endif /* _QA_NETWORK_SINK_H_ */
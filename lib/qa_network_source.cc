@@ -0,0 +1,167 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#include <gnuradio/attributes.h>
+#include <cppunit/TestAssert.h>
+#include "qa_network_source.h"
+#include <digitizers/network_sink.h>
+#include <digitizers/network_source.h>
+#include <digitizers/tags.h>
+#include <gnuradio/top_block.h>
+#include <gnuradio/blocks/vector_source_f.h>
+#include <gnuradio/blocks/vector_source_s.h>
+#include <gnuradio/blocks/vector_sink_f.h>
+
+#include <cmath>
+
+namespace gr {
+  namespace digitizers {
+
+    void
+    qa_network_source::values_and_info_tags()
+    {
+      const int package_size = 100;
+
+      std::vector<float> values(400), errors(400);
+      for (size_t i = 0; i < values.size(); i++) {
+        values[i] = i;
+        errors[i] = i * 0.5f;
+      }
+
+      acq_info_t acq_info {};
+      acq_info.timestamp = 1000000000;
+      acq_info.timebase = 0.001;
+
+      std::vector<gr::tag_t> tags {
+        make_acq_info_tag(acq_info, 0),
+        make_trigger_tag(1, 5000000000, 250, 0)
+      };
+
+      auto sink_top = gr::make_top_block("network_sink");
+      auto value_src = gr::blocks::vector_source_f::make(values, false, 1, tags);
+      auto error_src = gr::blocks::vector_source_f::make(errors);
+      auto sink = network_sink::make(0, package_size);
+      sink_top->connect(value_src, 0, sink, 0);
+      sink_top->connect(error_src, 0, sink, 1);
+
+      auto source_top = gr::make_top_block("network_source");
+      auto source = network_source::make("localhost", sink->get_port());
+      auto value_sink = gr::blocks::vector_sink_f::make();
+      auto error_sink = gr::blocks::vector_sink_f::make();
+      source_top->connect(source, 0, value_sink, 0);
+      source_top->connect(source, 1, error_sink, 0);
+
+      // The source connects on start, the sink accepts the pending connection on its start
+      source_top->start();
+      sink_top->run();
+      source_top->wait();
+
+      CPPUNIT_ASSERT_EQUAL(uint64_t(4), source->get_received_frames());
+      CPPUNIT_ASSERT_EQUAL(uint64_t(0), source->get_samples_lost());
+
+      auto received_values = value_sink->data();
+      auto received_errors = error_sink->data();
+      CPPUNIT_ASSERT_EQUAL(values.size(), received_values.size());
+      CPPUNIT_ASSERT_EQUAL(errors.size(), received_errors.size());
+      for (size_t i = 0; i < values.size(); i++) {
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(values[i], received_values[i], 1e-6);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(errors[i], received_errors[i], 1e-6);
+      }
+
+      // Tags derived from the measurement info, acq_info at the start of each frame
+      int nacq_info = 0, ntriggers = 0;
+      for (const auto &tag : value_sink->tags()) {
+        if (tag.key == acq_info_tag_key()) {
+          CPPUNIT_ASSERT_EQUAL(uint64_t(nacq_info * package_size), tag.offset);
+          auto decoded = decode_acq_info_tag(tag);
+          CPPUNIT_ASSERT_EQUAL(int64_t(1000000000 + nacq_info * 100000000), decoded.timestamp);
+          CPPUNIT_ASSERT_DOUBLES_EQUAL(0.001, decoded.timebase, 1e-12);
+          nacq_info++;
+        }
+        else if (tag.key == trigger_tag_key()) {
+          CPPUNIT_ASSERT_EQUAL(uint64_t(250), tag.offset);
+          CPPUNIT_ASSERT_EQUAL(int64_t(5000000000), decode_trigger_tag(tag).timestamp);
+          ntriggers++;
+        }
+      }
+      CPPUNIT_ASSERT_EQUAL(4, nacq_info);
+      CPPUNIT_ASSERT_EQUAL(1, ntriggers);
+    }
+
+    void
+    qa_network_source::raw_with_forwarded_tags()
+    {
+      const int package_size = 200;
+
+      std::vector<short> raw(600);
+      for (size_t i = 0; i < raw.size(); i++) {
+        raw[i] = static_cast<short>(3000.0 * std::sin(i * 0.05) + i % 5);
+      }
+
+      acq_info_t acq_info {};
+      acq_info.timestamp = 1000000000;
+      acq_info.timebase = 0.001;
+
+      raw_scaling_t scaling {0.001, 0.5, 0.002};
+      std::vector<gr::tag_t> tags {
+        make_raw_scaling_tag(scaling, 0),
+        make_acq_info_tag(acq_info, 0),
+        make_trigger_tag(1, 5000000000, 250, 0)
+      };
+
+      auto sink_top = gr::make_top_block("network_sink");
+      auto raw_src = gr::blocks::vector_source_s::make(raw, false, 1, tags);
+      auto sink = network_sink::make(0, package_size, 1, 0.0, 8, true);
+      sink->set_tag_forwarding(true);
+      sink_top->connect(raw_src, 0, sink, 0);
+
+      auto source_top = gr::make_top_block("network_source");
+      auto source = network_source::make("localhost", sink->get_port());
+      auto value_sink = gr::blocks::vector_sink_f::make();
+      auto error_sink = gr::blocks::vector_sink_f::make();
+      source_top->connect(source, 0, value_sink, 0);
+      source_top->connect(source, 1, error_sink, 0);
+
+      source_top->start();
+      sink_top->run();
+      source_top->wait();
+
+      CPPUNIT_ASSERT_EQUAL(uint64_t(3), source->get_received_frames());
+
+      auto received_values = value_sink->data();
+      auto received_errors = error_sink->data();
+      CPPUNIT_ASSERT_EQUAL(raw.size(), received_values.size());
+      for (size_t i = 0; i < raw.size(); i++) {
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(raw[i] * scaling.scale + scaling.offset, received_values[i], 1e-5);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(scaling.error, received_errors[i], 1e-6);
+      }
+
+      // Forwarded tags at their original offsets, no trigger tags are synthesized
+      int nraw_scaling = 0, nacq_info = 0, ntriggers = 0;
+      for (const auto &tag : value_sink->tags()) {
+        if (tag.key == raw_scaling_tag_key()) {
+          CPPUNIT_ASSERT_EQUAL(uint64_t(0), tag.offset);
+          CPPUNIT_ASSERT_DOUBLES_EQUAL(scaling.scale, decode_raw_scaling_tag(tag).scale, 1e-12);
+          nraw_scaling++;
+        }
+        else if (tag.key == acq_info_tag_key()) {
+          CPPUNIT_ASSERT_EQUAL(uint64_t(0), tag.offset);
+          CPPUNIT_ASSERT_EQUAL(int64_t(1000000000), decode_acq_info_tag(tag).timestamp);
+          nacq_info++;
+        }
+        else if (tag.key == trigger_tag_key()) {
+          CPPUNIT_ASSERT_EQUAL(uint64_t(250), tag.offset);
+          CPPUNIT_ASSERT_EQUAL(int64_t(5000000000), decode_trigger_tag(tag).timestamp);
+          ntriggers++;
+        }
+      }
+      CPPUNIT_ASSERT_EQUAL(1, nraw_scaling);
+      CPPUNIT_ASSERT(nacq_info >= 1);
+      CPPUNIT_ASSERT_EQUAL(1, ntriggers);
+    }
+
+  } /* namespace digitizers */
+} /* namespace gr */
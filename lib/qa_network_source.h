@@ -0,0 +1,33 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+
+#ifndef _QA_NETWORK_SOURCE_H_
+#define _QA_NETWORK_SOURCE_H_
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/TestCase.h>
+
+namespace gr {
+  namespace digitizers {
+
+    class qa_network_source : public CppUnit::TestCase
+    {
+    public:
+      CPPUNIT_TEST_SUITE(qa_network_source);
+      CPPUNIT_TEST(values_and_info_tags);
+      CPPUNIT_TEST(raw_with_forwarded_tags);
+      CPPUNIT_TEST_SUITE_END();
+
+    private:
+      void values_and_info_tags();
+      void raw_with_forwarded_tags();
+    };
+
+  } /* namespace digitizers */
+} /* namespace gr */
+
+#endif /* _QA_NETWORK_SOURCE_H_ */
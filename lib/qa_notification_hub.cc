@@ -0,0 +1,103 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#include <gnuradio/attributes.h>
+#include <cppunit/TestAssert.h>
+#include "qa_notification_hub.h"
+#include <digitizers/notification_hub.h>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/chrono.hpp>
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+namespace gr {
+  namespace digitizers {
+
+    struct batch_recorder_t
+    {
+      boost::mutex mutex;
+      std::vector<std::vector<notification_t>> batches;
+    };
+
+    static void
+    record_batch(const notification_t *notifications, size_t count, void *userdata)
+    {
+      auto recorder = static_cast<batch_recorder_t *>(userdata);
+      boost::mutex::scoped_lock lock(recorder->mutex);
+      recorder->batches.emplace_back(notifications, notifications + count);
+    }
+
+    void
+    qa_notification_hub::registration()
+    {
+      auto hub = notification_hub::make();
+
+      CPPUNIT_ASSERT_EQUAL(uint32_t{0}, hub->register_signal("a"));
+      CPPUNIT_ASSERT_EQUAL(uint32_t{1}, hub->register_signal("b"));
+      CPPUNIT_ASSERT_EQUAL(uint32_t{0}, hub->register_signal("a"));
+      CPPUNIT_ASSERT_EQUAL(size_t{2}, hub->get_signal_count());
+      CPPUNIT_ASSERT_EQUAL(std::string("b"), hub->get_signal_name(1));
+      CPPUNIT_ASSERT_THROW(hub->get_signal_name(2), std::invalid_argument);
+
+      CPPUNIT_ASSERT_THROW(notification_hub::make(-1.0), std::invalid_argument);
+    }
+
+    void
+    qa_notification_hub::batching()
+    {
+      batch_recorder_t recorder;
+      const int nsinks = 20;
+
+      {
+        // Long window, a trigger reaching all the sinks at once results in a single batch
+        auto hub = notification_hub::make(0.2);
+        hub->set_callback(record_batch, &recorder);
+
+        std::vector<boost::thread> sinks;
+        for (int i = 0; i < nsinks; i++) {
+          auto id = hub->register_signal("signal" + std::to_string(i));
+          sinks.emplace_back([hub, id]() { hub->notify(id, 1234); });
+        }
+        for (auto &sink : sinks) {
+          sink.join();
+        }
+
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(500));
+        CPPUNIT_ASSERT_EQUAL(uint64_t{1}, hub->get_batch_count());
+      }
+
+      CPPUNIT_ASSERT_EQUAL(size_t{1}, recorder.batches.size());
+      CPPUNIT_ASSERT_EQUAL(size_t{nsinks}, recorder.batches[0].size());
+
+      std::vector<bool> seen(nsinks, false);
+      for (const auto &notification : recorder.batches[0]) {
+        CPPUNIT_ASSERT(notification.signal_id < nsinks);
+        CPPUNIT_ASSERT_EQUAL(int64_t{1234}, notification.trigger_timestamp);
+        seen[notification.signal_id] = true;
+      }
+      CPPUNIT_ASSERT(std::find(seen.begin(), seen.end(), false) == seen.end());
+
+      // Bounded, pending notifications are delivered on destruction
+      recorder.batches.clear();
+      {
+        auto hub = notification_hub::make(10.0, 4);
+        hub->set_callback(record_batch, &recorder);
+        for (int i = 0; i < 10; i++) {
+          hub->notify(0, i);
+        }
+        CPPUNIT_ASSERT_EQUAL(uint64_t{6}, hub->get_dropped_count());
+      }
+
+      CPPUNIT_ASSERT_EQUAL(size_t{1}, recorder.batches.size());
+      CPPUNIT_ASSERT_EQUAL(size_t{4}, recorder.batches[0].size());
+      CPPUNIT_ASSERT_EQUAL(int64_t{3}, recorder.batches[0][3].trigger_timestamp);
+    }
+
+  } /* namespace digitizers */
+} /* namespace gr */
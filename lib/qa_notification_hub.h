@@ -0,0 +1,33 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+
+#ifndef _QA_NOTIFICATION_HUB_H_
+#define _QA_NOTIFICATION_HUB_H_
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/TestCase.h>
+
+namespace gr {
+  namespace digitizers {
+
+    class qa_notification_hub : public CppUnit::TestCase
+    {
+    public:
+      CPPUNIT_TEST_SUITE(qa_notification_hub);
+      CPPUNIT_TEST(registration);
+      CPPUNIT_TEST(batching);
+      CPPUNIT_TEST_SUITE_END();
+
+    private:
+      void registration();
+      void batching();
+    };
+
+  } /* namespace digitizers */
+} /* namespace gr */
+
+#endif /* _QA_NOTIFICATION_HUB_H_ */
@@ -16,6 +16,7 @@
 #include <gnuradio/blocks/vector_sink_f.h>
 #include <digitizers/median_and_average.h>
 
+#include <stdexcept>
 #include <thread>
 #include <chrono>
 
@@ -55,6 +56,113 @@ namespace gr {
       CPPUNIT_ASSERT_DOUBLES_EQUAL(46.32, stdevs.at(0), 0.02);
     }
 
+    void
+    qa_peak_detector::multiple_peaks()
+    {
+      // two symmetric peaks at bins 4 and 14, i.e. at 10 Hz and 35 Hz, two spectra
+      std::vector<float> spectrum(20, 1.0);
+      std::vector<float> peak0({2, 4, 8, 4, 2});
+      std::vector<float> peak1({3, 6, 9, 6, 3});
+      std::copy(peak0.begin(), peak0.end(), spectrum.begin() + 2);
+      std::copy(peak1.begin(), peak1.end(), spectrum.begin() + 12);
+
+      std::vector<float> data(spectrum);
+      data.insert(data.end(), spectrum.begin(), spectrum.end());
+
+      auto top = gr::make_top_block("multiple_peaks");
+      int vec_size = spectrum.size();
+      auto src = blocks::vector_source_f::make(data, false, vec_size);
+      auto flow = blocks::vector_source_f::make(std::vector<float>{5, 30, 5, 30}, false, 2);
+      auto fup = blocks::vector_source_f::make(std::vector<float>{15, 40, 15, 40}, false, 2);
+      auto max = blocks::vector_sink_f::make(2);
+      auto stdev = blocks::vector_sink_f::make(2);
+      auto detect = digitizers::peak_detector::make(100.0, vec_size, 2, 2);
+
+      top->connect(src, 0,  detect, 0);
+      top->connect(src, 0, detect, 1);
+      top->connect(flow, 0, detect, 2);
+      top->connect(fup, 0, detect, 3);
+      top->connect(detect, 0, max, 0);
+      top->connect(detect, 1, stdev, 0);
+
+      top->run();
+
+      auto maximum = max->data();
+      auto stdevs = stdev->data();
+      CPPUNIT_ASSERT_EQUAL(size_t(4), maximum.size());
+      CPPUNIT_ASSERT_EQUAL(size_t(4), stdevs.size());
+
+      for (int v = 0; v < 2; v++) {
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(10.0, maximum.at(2 * v), 1e-4);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(35.0, maximum.at(2 * v + 1), 1e-4);
+        CPPUNIT_ASSERT(stdevs.at(2 * v) > 0.0);
+        CPPUNIT_ASSERT(stdevs.at(2 * v + 1) > 0.0);
+      }
+    }
+
+    void
+    qa_peak_detector::tracking()
+    {
+      // 1 Hz per bin, the tracked peak drifts by a bin per spectrum and jumps once, a larger
+      // spurious peak shows up in one spectrum
+      const int vec_size = 200;
+      const std::vector<int> positions({50, 51, 52, 53, 54, 55, 56, 120, 121});
+      const int nspectra = positions.size();
+      const int spurious = 5;
+
+      std::vector<float> data;
+      for (int v = 0; v < nspectra; v++) {
+        std::vector<float> spectrum(vec_size, 1.0);
+        std::vector<float> peak({2, 4, 8, 4, 2});
+        std::copy(peak.begin(), peak.end(), spectrum.begin() + positions[v] - 2);
+        if (v == spurious) {
+          std::vector<float> other({5, 10, 20, 10, 5});
+          std::copy(other.begin(), other.end(), spectrum.begin() + 148);
+        }
+        data.insert(data.end(), spectrum.begin(), spectrum.end());
+      }
+
+      auto top = gr::make_top_block("tracking");
+      auto src = blocks::vector_source_f::make(data, false, vec_size);
+      auto flow = blocks::vector_source_f::make(std::vector<float>(nspectra, 10.0));
+      auto fup = blocks::vector_source_f::make(std::vector<float>(nspectra, 190.0));
+      auto max = blocks::vector_sink_f::make(1);
+      auto stdev = blocks::vector_sink_f::make(1);
+      auto untracked_max = blocks::vector_sink_f::make(1);
+      auto untracked_stdev = blocks::vector_sink_f::make(1);
+
+      auto detect = digitizers::peak_detector::make(400.0, vec_size, 2);
+      detect->set_tracking(5);
+      auto untracked = digitizers::peak_detector::make(400.0, vec_size, 2);
+
+      for (auto block : {detect, untracked}) {
+        top->connect(src, 0, block, 0);
+        top->connect(src, 0, block, 1);
+        top->connect(flow, 0, block, 2);
+        top->connect(fup, 0, block, 3);
+      }
+      top->connect(detect, 0, max, 0);
+      top->connect(detect, 1, stdev, 0);
+      top->connect(untracked, 0, untracked_max, 0);
+      top->connect(untracked, 1, untracked_stdev, 0);
+
+      top->run();
+
+      auto maximum = max->data();
+      CPPUNIT_ASSERT_EQUAL(size_t(nspectra), maximum.size());
+
+      // the spurious peak is outside the window, the jump is re-acquired
+      for (int v = 0; v < nspectra; v++) {
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(positions[v], maximum.at(v), 1e-3);
+      }
+
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(150.0, untracked_max->data().at(spurious), 1e-3);
+
+      CPPUNIT_ASSERT_THROW(detect->set_tracking(-1), std::invalid_argument);
+      CPPUNIT_ASSERT_THROW(detect->set_tracking(5, 0.0), std::invalid_argument);
+      CPPUNIT_ASSERT_THROW(detect->set_tracking(5, 1.0, 2.0), std::invalid_argument);
+    }
+
   } /* namespace digitizers */
 } /* namespace gr */
 
@@ -19,10 +19,14 @@ namespace gr {
     public:
       CPPUNIT_TEST_SUITE(qa_peak_detector);
       CPPUNIT_TEST(basic_peak_find);
+      CPPUNIT_TEST(multiple_peaks);
+      CPPUNIT_TEST(tracking);
       CPPUNIT_TEST_SUITE_END();
 
     private:
       void basic_peak_find();
+      void multiple_peaks();
+      void tracking();
     };
 
   } /* namespace digitizers */
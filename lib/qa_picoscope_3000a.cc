@@ -18,9 +18,11 @@
 #include <gnuradio/blocks/null_sink.h>
 #include <gnuradio/blocks/vector_sink_f.h>
 #include <gnuradio/blocks/vector_sink_b.h>
+#include <gnuradio/blocks/vector_sink_s.h>
 #include <gnuradio/blocks/null_sink.h>
 #include <gnuradio/blocks/tag_debug.h>
 #include "utils.h"
+#include "qa_common.h"
 
 using namespace std::chrono;
 
@@ -390,6 +392,93 @@ namespace gr {
 
     }
 
+    void
+    qa_picoscope_3000a::streaming_zero_copy()
+    {
+      auto top = gr::make_top_block("streaming_zero_copy");
+      auto ps = picoscope_3000a::make("", true);
+
+      ps->set_aichan("A", true, 5.0, AC_1M);
+      ps->set_samp_rate(10000.0);
+      ps->set_buffer_size(1000);
+      ps->set_zero_copy(true);
+      ps->set_streaming(0.0005);
+
+      auto sink = blocks::vector_sink_f::make(1);
+      auto errsink = blocks::vector_sink_f::make(1);
+
+      top->connect(ps, 0, sink, 0);
+      top->connect(ps, 1, errsink, 0);
+
+      ps->initialize();
+
+      top->start();
+      sleep(2);
+      top->stop();
+      top->wait();
+
+      auto data = sink->data();
+      auto errors = errsink->data();
+      CPPUNIT_ASSERT(data.size() <= 20000 && data.size() >= 5000);
+      CPPUNIT_ASSERT_EQUAL(data.size(), errors.size());
+
+      // raw samples are converted in the work thread, values must still be within range
+      for (auto value : data) {
+        CPPUNIT_ASSERT(std::fabs(value) <= 5.0);
+      }
+
+      // error estimate is a per-range constant
+      ASSERT_VECTOR_OF(errors, 5.0f * 0.03f);
+    }
+
+    void
+    qa_picoscope_3000a::streaming_raw_output()
+    {
+      auto top = gr::make_top_block("streaming_raw_output");
+      auto ps = picoscope_3000a::make("", true, true);
+
+      ps->set_aichan("A", true, 5.0, AC_1M);
+      ps->set_samp_rate(10000.0);
+      ps->set_buffer_size(1000);
+      ps->set_streaming(0.0005);
+
+      // single raw output per channel
+      auto sink = blocks::vector_sink_s::make(1);
+
+      top->connect(ps, 0, sink, 0);
+
+      ps->initialize();
+
+      top->start();
+      sleep(2);
+      top->stop();
+      top->wait();
+
+      auto data = sink->data();
+      CPPUNIT_ASSERT(data.size() <= 20000 && data.size() >= 5000);
+
+      // scaling is published once per arm
+      auto tags = sink->tags();
+      std::vector<gr::tag_t> scaling_tags;
+      for (const auto &tag : tags) {
+        if (pmt::symbol_to_string(tag.key) == raw_scaling_tag_name) {
+          scaling_tags.push_back(tag);
+        }
+      }
+
+      CPPUNIT_ASSERT_EQUAL(size_t(1), scaling_tags.size());
+
+      auto scaling = decode_raw_scaling_tag(scaling_tags.at(0));
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(5.0 / 255.0, scaling.scale, 1e-9);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(0.0, scaling.offset, 1e-9);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(5.0 * 0.03, scaling.error, 1e-6);
+
+      // raw output is streaming only
+      ps->set_samples(1000, 1000);
+      ps->set_rapid_block(1);
+      CPPUNIT_ASSERT_THROW(ps->configure(), std::invalid_argument);
+    }
+
   } /* namespace digitizers */
 } /* namespace gr */
 
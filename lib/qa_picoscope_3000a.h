@@ -26,6 +26,8 @@ namespace gr {
       CPPUNIT_TEST(rapid_block_downsampling_basics);
       CPPUNIT_TEST(rapid_block_downsampling);
       CPPUNIT_TEST(rapid_block_tags);
+      CPPUNIT_TEST(streaming_zero_copy);
+      CPPUNIT_TEST(streaming_raw_output);
       CPPUNIT_TEST_SUITE_END();
 
     private:
@@ -44,6 +46,8 @@ namespace gr {
       void rapid_block_trigger();
 
       void streaming_basics();
+      void streaming_zero_copy();
+      void streaming_raw_output();
     };
 
   } /* namespace digitizers */
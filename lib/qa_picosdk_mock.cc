@@ -0,0 +1,141 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+
+#include <gnuradio/attributes.h>
+#include <cppunit/TestAssert.h>
+#include "qa_picosdk_mock.h"
+#include "picosdk_mock.h"
+#include <digitizers/picoscope_4000a.h>
+#include <gnuradio/top_block.h>
+#include <gnuradio/blocks/null_sink.h>
+#include <gnuradio/blocks/vector_sink_f.h>
+#include <functional>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace gr {
+  namespace digitizers {
+
+    namespace {
+
+      // Streams channel A at 10 kHz for two seconds, calls inject after the first one, returns
+      // the samples received
+      size_t
+      run_streaming(std::function<void()> inject = std::function<void()>())
+      {
+        auto top = gr::make_top_block("picosdk_mock_streaming");
+        auto ps = picoscope_4000a::make("", true);
+
+        ps->set_aichan("A", true, 5.0, AC_1M);
+        ps->set_samp_rate(10000.0);
+        ps->set_buffer_size(100000);
+        ps->set_streaming(0.0005);
+
+        auto sink = blocks::vector_sink_f::make(1);
+        auto errsink = blocks::null_sink::make(sizeof(float));
+        top->connect(ps, 0, sink, 0);
+        top->connect(ps, 1, errsink, 0);
+
+        ps->initialize();
+        top->start();
+        sleep(1);
+        if (inject) {
+          inject();
+        }
+        sleep(1);
+        top->stop();
+        top->wait();
+
+        return sink->data().size();
+      }
+
+    } // namespace
+
+    void
+    qa_picosdk_mock::setUp()
+    {
+      picosdk_mock_t::instance().configure(picosdk_mock_config_t());
+      picosdk_mock_t::instance().reset_stats();
+    }
+
+    void
+    qa_picosdk_mock::tearDown()
+    {
+      picosdk_mock_t::instance().configure(picosdk_mock_config_t());
+    }
+
+    void
+    qa_picosdk_mock::config_parse()
+    {
+      auto config = picosdk_mock_config_t::parse("call_latency_us=50,max_callback_samples=128,stall_us=20000");
+      CPPUNIT_ASSERT_EQUAL(uint32_t{50}, config.call_latency_us);
+      CPPUNIT_ASSERT_EQUAL(uint32_t{128}, config.max_callback_samples);
+      CPPUNIT_ASSERT_EQUAL(uint32_t{20000}, config.stall_us);
+      CPPUNIT_ASSERT_EQUAL(picosdk_mock_config_t().nr_units, config.nr_units);
+
+      CPPUNIT_ASSERT_THROW(picosdk_mock_config_t::parse("unknown=1"), std::invalid_argument);
+      CPPUNIT_ASSERT_THROW(picosdk_mock_config_t::parse("stall_us=abc"), std::invalid_argument);
+    }
+
+    void
+    qa_picosdk_mock::streaming_chunks()
+    {
+      auto config = picosdk_mock_config_t();
+      config.call_latency_us = 200;
+      config.latency_jitter_us = 100;
+      config.max_callback_samples = 100;
+      picosdk_mock_t::instance().configure(config);
+
+      auto received = run_streaming();
+      CPPUNIT_ASSERT(received <= 20000 && received >= 5000);
+
+      auto stats = picosdk_mock_t::instance().stats();
+      CPPUNIT_ASSERT(stats.samples >= received);
+      CPPUNIT_ASSERT(stats.streaming_callbacks * 100 >= stats.samples);
+      CPPUNIT_ASSERT_EQUAL(uint64_t{0}, stats.overflows);
+      CPPUNIT_ASSERT_EQUAL(uint64_t{0}, stats.stalls);
+    }
+
+    void
+    qa_picosdk_mock::streaming_faults()
+    {
+      // The samples produced during the stall are delivered after it, the driver buffer holds 10 s
+      auto received = run_streaming([]() {
+        picosdk_mock_t::instance().inject_overflow();
+        picosdk_mock_t::instance().inject_stall(200000);
+      });
+      CPPUNIT_ASSERT(received <= 20000 && received >= 5000);
+
+      auto stats = picosdk_mock_t::instance().stats();
+      CPPUNIT_ASSERT_EQUAL(uint64_t{1}, stats.overflows);
+      CPPUNIT_ASSERT_EQUAL(uint64_t{1}, stats.stalls);
+    }
+
+    void
+    qa_picosdk_mock::rapid_block()
+    {
+      auto top = gr::make_top_block("picosdk_mock_rapid_block");
+
+      auto ps = picoscope_4000a::make("", true);
+      ps->set_aichan("A", true, 5.0, AC_1M);
+      ps->set_samp_rate(10000.0);
+      ps->set_samples(33, 1000);
+      ps->set_rapid_block(2);
+      ps->set_trigger_once(true);
+
+      auto sink = blocks::vector_sink_f::make(1);
+      auto errsink = blocks::null_sink::make(sizeof(float));
+      top->connect(ps, 0, sink, 0);
+      top->connect(ps, 1, errsink, 0);
+      top->run();
+
+      CPPUNIT_ASSERT_EQUAL(size_t{2 * 1033}, sink->data().size());
+      CPPUNIT_ASSERT(picosdk_mock_t::instance().stats().blocks >= 1);
+    }
+
+  } /* namespace digitizers */
+} /* namespace gr */
@@ -0,0 +1,40 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+
+#ifndef _QA_PICOSDK_MOCK_H_
+#define _QA_PICOSDK_MOCK_H_
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/TestCase.h>
+
+namespace gr {
+  namespace digitizers {
+
+    class qa_picosdk_mock : public CppUnit::TestCase
+    {
+    public:
+      void setUp();
+      void tearDown();
+
+      CPPUNIT_TEST_SUITE(qa_picosdk_mock);
+      CPPUNIT_TEST(config_parse);
+      CPPUNIT_TEST(streaming_chunks);
+      CPPUNIT_TEST(streaming_faults);
+      CPPUNIT_TEST(rapid_block);
+      CPPUNIT_TEST_SUITE_END();
+
+    private:
+      void config_parse();
+      void streaming_chunks();
+      void streaming_faults();
+      void rapid_block();
+    };
+
+  } /* namespace digitizers */
+} /* namespace gr */
+
+#endif /* _QA_PICOSDK_MOCK_H_ */
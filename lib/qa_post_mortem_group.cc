@@ -0,0 +1,110 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#include "qa_post_mortem_group.h"
+
+#include <cppunit/TestAssert.h>
+#include <digitizers/post_mortem_group.h>
+#include <digitizers/tags.h>
+#include <gnuradio/top_block.h>
+#include <gnuradio/blocks/vector_source_f.h>
+#include <gnuradio/blocks/vector_sink_f.h>
+#include <stdexcept>
+#include <vector>
+
+namespace gr {
+  namespace digitizers {
+
+    void
+    qa_post_mortem_group::membership()
+    {
+      auto group = post_mortem_group::make();
+      auto other = post_mortem_group::make();
+      auto sink = post_mortem_sink::make("a", "V", 1000.0f, 100);
+
+      group->add_sink(sink);
+      CPPUNIT_ASSERT_EQUAL(size_t(1), group->get_sinks().size());
+      CPPUNIT_ASSERT_THROW(other->add_sink(sink), std::invalid_argument);
+      CPPUNIT_ASSERT_THROW(group->add_sink(post_mortem_sink::sptr()), std::invalid_argument);
+
+      // Nothing to wait for without a freeze
+      CPPUNIT_ASSERT(group->wait_frozen(0.0));
+      CPPUNIT_ASSERT_EQUAL(uint64_t(1), group->freeze());
+      CPPUNIT_ASSERT(!group->wait_frozen(0.01));
+    }
+
+    // Channels of different sample rates, the snapshots end at the same timestamp
+    void
+    qa_post_mortem_group::aligned_freeze()
+    {
+      const std::vector<double> rates = {1000.0, 100.0};
+      const std::vector<size_t> buffer_sizes = {100, 10};
+
+      auto group = post_mortem_group::make();
+      auto top = gr::make_top_block("test");
+      std::vector<post_mortem_sink::sptr> sinks;
+
+      for (size_t i = 0; i < rates.size(); i++) {
+        const auto nitems = static_cast<size_t>(rates[i]);
+
+        std::vector<float> values;
+        for (size_t j = 0; j < nitems; j++) {
+          values.push_back(static_cast<float>(j));
+        }
+
+        acq_info_t info{};
+        info.timebase = 1.0 / rates[i];
+        info.timestamp = 0;
+        std::vector<gr::tag_t> tags = { make_acq_info_tag(info, 0) };
+
+        auto source = gr::blocks::vector_source_f::make(values, false, 1, tags);
+        auto source_errs = gr::blocks::vector_source_f::make(std::vector<float>(nitems, 0.1f));
+        auto pm = post_mortem_sink::make("ch", "V", rates[i], buffer_sizes[i]);
+        auto sink = gr::blocks::vector_sink_f::make();
+        auto sink_errs = gr::blocks::vector_sink_f::make();
+
+        top->connect(source, 0, pm, 0);
+        top->connect(source_errs, 0, pm, 1);
+        top->connect(pm, 0, sink, 0);
+        top->connect(pm, 1, sink_errs, 0);
+
+        group->add_sink(pm);
+        sinks.push_back(pm);
+      }
+
+      // Requested before the samples arrive, each member waits for the timestamp (500.1 ms)
+      const int64_t timestamp = 500100000;
+      CPPUNIT_ASSERT_EQUAL(uint64_t(1), group->freeze_at(timestamp));
+
+      top->run();
+      CPPUNIT_ASSERT(group->wait_frozen(1.0));
+
+      // Last samples up to the timestamp, i.e. 500 at 1 kHz and 50 at 100 Hz
+      const std::vector<float> last = {500.0f, 50.0f};
+      for (size_t i = 0; i < sinks.size(); i++) {
+        std::vector<float> values(buffer_sizes[i]);
+        std::vector<float> errors(buffer_sizes[i]);
+        measurement_info_t info;
+
+        auto nitems = sinks[i]->get_items(buffer_sizes[i], &values[0], &errors[0], &info);
+        CPPUNIT_ASSERT_EQUAL(buffer_sizes[i], nitems);
+        CPPUNIT_ASSERT_EQUAL(last[i], values.back());
+        CPPUNIT_ASSERT_EQUAL(last[i] - buffer_sizes[i] + 1, values.front());
+
+        const double expected = (last[i] - buffer_sizes[i] + 1) / rates[i] * 1000000000.0;
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(expected, static_cast<double>(info.timestamp), 1000.0);
+      }
+
+      // Read out, the next read takes a snapshot of the current content
+      std::vector<float> values(buffer_sizes[0]);
+      std::vector<float> errors(buffer_sizes[0]);
+      measurement_info_t info;
+      sinks[0]->get_items(buffer_sizes[0], &values[0], &errors[0], &info);
+      CPPUNIT_ASSERT_EQUAL(999.0f, values.back());
+    }
+
+  } /* namespace digitizers */
+} /* namespace gr */
@@ -0,0 +1,32 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef _QA_POST_MORTEM_GROUP_H_
+#define _QA_POST_MORTEM_GROUP_H_
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/TestCase.h>
+
+namespace gr {
+  namespace digitizers {
+
+    class qa_post_mortem_group : public CppUnit::TestCase
+    {
+    public:
+      CPPUNIT_TEST_SUITE(qa_post_mortem_group);
+      CPPUNIT_TEST(membership);
+      CPPUNIT_TEST(aligned_freeze);
+      CPPUNIT_TEST_SUITE_END();
+
+    private:
+      void membership();
+      void aligned_freeze();
+    };
+
+  } /* namespace digitizers */
+} /* namespace gr */
+
+#endif /* _QA_POST_MORTEM_GROUP_H_ */
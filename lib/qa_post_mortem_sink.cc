@@ -13,11 +13,16 @@
 #include <gnuradio/blocks/vector_sink_f.h>
 #include <gnuradio/blocks/tag_debug.h>
 #include "utils.h"
+#include "mirrored_ring_buffer.h"
 #include "qa_common.h"
 #include <digitizers/tags.h>
 #include <boost/thread.hpp>
 #include <boost/chrono.hpp>
+#include <cstdlib>
+#include <fstream>
 #include <functional>
+#include <stdexcept>
+#include <unistd.h>
 
 namespace gr {
   namespace digitizers {
@@ -229,6 +234,433 @@ namespace gr {
         CPPUNIT_ASSERT_EQUAL(timebase, minfo.timebase);
     }
 
+    // Views must be contiguous no matter where the window starts
+    void
+    qa_post_mortem_sink::ring_buffer_wrap_around()
+    {
+        mirrored_ring_buffer_t<float> ring;
+        ring.allocate(1000);
+
+        auto capacity = ring.capacity();
+        CPPUNIT_ASSERT(capacity >= 1000);
+        CPPUNIT_ASSERT_EQUAL(size_t{0}, capacity & (capacity - 1));
+
+        // push in odd sized chunks so that the write position wraps many times
+        size_t chunk_size = 333;
+        std::vector<float> chunk(chunk_size);
+        float value = 0.0f;
+
+        for (int i = 0; i < 20; i++) {
+            for (auto &v : chunk) {
+                v = value++;
+            }
+            ring.push(chunk.data(), chunk.size());
+
+            auto window = ring.tail(capacity);
+            for (size_t j = 0; j < capacity && ring.count() >= capacity; j++) {
+                CPPUNIT_ASSERT_EQUAL(static_cast<float>(ring.count() - capacity + j), window[j]);
+            }
+        }
+
+        CPPUNIT_ASSERT_EQUAL(uint64_t{20 * chunk_size}, ring.count());
+        CPPUNIT_ASSERT_EQUAL(ring.count() - capacity, ring.available_from());
+
+        // pushing more than capacity keeps the newest items only
+        std::vector<float> large(capacity + 10);
+        for (auto &v : large) {
+            v = value++;
+        }
+        ring.push(large.data(), large.size());
+
+        auto last = ring.tail(capacity);
+        assert_equal(large.begin() + 10, large.end(), last);
+    }
+
+    // Acquisition continues while frozen, the snapshot is not affected
+    void
+    qa_post_mortem_sink::freeze_snapshot()
+    {
+        size_t data_size = 100;
+        auto data = make_test_data(data_size);
+        auto data_next = make_test_data(data_size, 2.0);
+
+        auto top = gr::make_top_block("test");
+
+        auto source = gr::blocks::vector_source_f::make(data);
+        auto pm = post_mortem_sink::make("test", "unit", DEFAULT_SAMP_RATE, data_size);
+        auto sink = gr::blocks::vector_sink_f::make();
+        auto sink_errs = gr::blocks::vector_sink_f::make();
+
+        top->connect(source, 0, pm, 0);
+        top->connect(source, 0, pm, 1);
+        top->connect(pm, 0, sink, 0);
+        top->connect(pm, 1, sink_errs, 0);
+        top->run();
+
+        pm->freeze_buffer();
+
+        source->set_data(data_next);
+        source->rewind();
+        top->run();
+
+        float values[data_size];
+        float errors[data_size];
+        measurement_info_t info;
+
+        // frozen content
+        auto retval = pm->get_items(data_size, values, errors, &info);
+        CPPUNIT_ASSERT_EQUAL(data_size, retval);
+        assert_equal(data, values);
+
+        // samples acquired while frozen are kept as well
+        retval = pm->get_items(data_size, values, errors, &info);
+        CPPUNIT_ASSERT_EQUAL(data_size, retval);
+        assert_equal(data_next, values);
+    }
+
+    // Frozen samples can be read directly from the backing file
+    void
+    qa_post_mortem_sink::file_backed_buffer()
+    {
+        char path[] = "/tmp/qa_post_mortem_sink_XXXXXX";
+        int fd = mkstemp(path);
+        CPPUNIT_ASSERT(fd >= 0);
+        close(fd);
+
+        size_t data_size = 5000;
+        size_t buffer_size = 1000;
+        auto data = make_test_data(data_size);
+
+        auto top = gr::make_top_block("test");
+
+        auto source = gr::blocks::vector_source_f::make(data);
+        auto pm = post_mortem_sink::make("test", "unit", DEFAULT_SAMP_RATE, buffer_size);
+        pm->set_backing_file(path);
+        auto sink = gr::blocks::vector_sink_f::make();
+        auto sink_errs = gr::blocks::vector_sink_f::make();
+
+        top->connect(source, 0, pm, 0);
+        top->connect(source, 0, pm, 1);
+        top->connect(pm, 0, sink, 0);
+        top->connect(pm, 1, sink_errs, 0);
+        top->run();
+
+        pm->freeze_buffer();
+
+        std::ifstream file(path, std::ios::binary);
+        post_mortem_file_header_t header;
+        file.read(reinterpret_cast<char *>(&header), sizeof(header));
+        CPPUNIT_ASSERT(file.good());
+        CPPUNIT_ASSERT_EQUAL(std::string("DIGIPMB"), std::string(header.magic));
+        CPPUNIT_ASSERT_EQUAL(POST_MORTEM_FILE_VERSION, header.version);
+        CPPUNIT_ASSERT_EQUAL(uint32_t{1}, header.frozen);
+        CPPUNIT_ASSERT_EQUAL(uint64_t{data_size}, header.snapshot_end);
+        CPPUNIT_ASSERT_EQUAL(uint64_t{buffer_size}, header.snapshot_nitems);
+
+        for (auto i = header.snapshot_end - header.snapshot_nitems; i < header.snapshot_end; i++) {
+            float value;
+            file.seekg(header.values_offset + (i % header.capacity) * sizeof(float));
+            file.read(reinterpret_cast<char *>(&value), sizeof(value));
+            CPPUNIT_ASSERT_EQUAL(data[i], value);
+        }
+
+        // readout unfreezes
+        float values[buffer_size];
+        float errors[buffer_size];
+        measurement_info_t info;
+
+        auto retval = pm->get_items(buffer_size, values, errors, &info);
+        CPPUNIT_ASSERT_EQUAL(buffer_size, retval);
+        assert_equal(data.begin() + (data_size - buffer_size), data.end(), values);
+
+        file.seekg(0);
+        file.read(reinterpret_cast<char *>(&header), sizeof(header));
+        CPPUNIT_ASSERT_EQUAL(uint32_t{0}, header.frozen);
+
+        unlink(path);
+    }
+
+    void
+    qa_post_mortem_sink::pyramid_levels()
+    {
+        // 0.1 s of history: 10000 raw samples, 1000, 100 and 10 entries per level
+        size_t data_size = 25000;
+        size_t buffer_size = 10000;
+        std::vector<float> data(data_size);
+        for (size_t i = 0; i < data_size; i++) {
+            data[i] = static_cast<float>(i);
+        }
+
+        auto top = gr::make_top_block("test");
+
+        auto source = gr::blocks::vector_source_f::make(data);
+        auto pm = post_mortem_sink::make("test", "unit", DEFAULT_SAMP_RATE, buffer_size);
+        pm->set_pyramid(0.1);
+        auto sink = gr::blocks::vector_sink_f::make();
+        auto sink_errs = gr::blocks::vector_sink_f::make();
+
+        top->connect(source, 0, pm, 0);
+        top->connect(source, 0, pm, 1);
+        top->connect(pm, 0, sink, 0);
+        top->connect(pm, 1, sink_errs, 0);
+        top->run();
+
+        pm->freeze_buffer();
+
+        float min[1000], max[1000], mean[1000];
+        measurement_info_t info;
+
+        size_t decimation = 1;
+        for (int level = 1; level <= POST_MORTEM_PYRAMID_LEVELS; level++) {
+            decimation *= 10;
+            auto nitems = 10000 / decimation;
+
+            // more than available
+            auto retval = pm->get_pyramid_items(level, 1000, min, max, mean, &info);
+            CPPUNIT_ASSERT_EQUAL(nitems, retval);
+
+            // all levels span the last 10000 samples
+            for (size_t j = 0; j < nitems; j++) {
+                auto first = static_cast<float>(data_size - buffer_size + j * decimation);
+                CPPUNIT_ASSERT_EQUAL(first, min[j]);
+                CPPUNIT_ASSERT_EQUAL(first + decimation - 1, max[j]);
+                CPPUNIT_ASSERT_EQUAL(first + (decimation - 1) / 2.0f, mean[j]);
+            }
+        }
+
+        CPPUNIT_ASSERT_THROW(pm->get_pyramid_items(0, 10, min, max, mean, &info), std::invalid_argument);
+        CPPUNIT_ASSERT_THROW(pm->get_pyramid_items(4, 10, min, max, mean, &info), std::invalid_argument);
+
+        // raw samples from the same snapshot
+        std::vector<float> values(buffer_size), errors(buffer_size);
+        auto retval = pm->get_items(buffer_size, &values[0], &errors[0], &info);
+        CPPUNIT_ASSERT_EQUAL(buffer_size, retval);
+        assert_equal(data.begin() + (data_size - buffer_size), data.end(), values.begin());
+    }
+
+    void
+    qa_post_mortem_sink::time_range()
+    {
+        size_t data_size = 5000;
+        size_t buffer_size = 2000;
+
+        // 1 ms per sample, timestamps jump at sample 4000 (acquisition restarted)
+        double timebase = 0.001;
+        int64_t sample_ns = 1000000;
+        acq_info_t info{};
+        info.timebase = timebase;
+        info.timestamp = 1000000000;
+        info.status = 1<<1;
+        acq_info_t restart_info = info;
+        restart_info.timestamp = 100000000000;
+
+        std::vector<gr::tag_t> tags = {
+              make_acq_info_tag(info, 0),
+              make_acq_info_tag(restart_info, 4000)
+        };
+
+        auto timestamp = [&](int64_t i) {
+            return i < 4000 ? info.timestamp + i * sample_ns
+                    : restart_info.timestamp + (i - 4000) * sample_ns;
+        };
+
+        auto top = gr::make_top_block("test");
+
+        auto data = make_test_data(data_size);
+        auto data_errs = make_test_data(data_size, 0.01);
+
+        auto source = gr::blocks::vector_source_f::make(data, false, 1, tags);
+        auto source_errs = gr::blocks::vector_source_f::make(data_errs);
+        auto pm = post_mortem_sink::make("test", "unit", DEFAULT_SAMP_RATE, buffer_size);
+
+        top->connect(source, 0, pm, 0);
+        top->connect(source_errs, 0, pm, 1);
+
+        top->run();
+
+        std::vector<float> values(buffer_size);
+        std::vector<float> errors(buffer_size);
+        measurement_info_t minfo;
+
+        // Samples 3500 to 3700, bounds in between the samples
+        auto retval = pm->get_range(timestamp(3500) - sample_ns / 2, timestamp(3700) + sample_ns / 2,
+                buffer_size, values.data(), errors.data(), &minfo);
+        CPPUNIT_ASSERT_EQUAL(size_t{201}, retval);
+        assert_equal(data.begin() + 3500, data.begin() + 3701, values.begin());
+        assert_equal(data_errs.begin() + 3500, data_errs.begin() + 3701, errors.begin());
+        CPPUNIT_ASSERT(std::abs(minfo.timestamp - timestamp(3500)) <= 1);
+        CPPUNIT_ASSERT_EQUAL(timebase, minfo.timebase);
+        CPPUNIT_ASSERT_EQUAL(uint32_t{1<<1}, minfo.status);
+
+        // Across the timestamp jump
+        retval = pm->get_range(timestamp(3900) - sample_ns / 2, timestamp(4050) + sample_ns / 2,
+                buffer_size, values.data(), errors.data(), &minfo);
+        CPPUNIT_ASSERT_EQUAL(size_t{151}, retval);
+        assert_equal(data.begin() + 3900, data.begin() + 4051, values.begin());
+
+        // Limited number of items
+        retval = pm->get_range(timestamp(4100) - sample_ns / 2, timestamp(4900),
+                10, values.data(), errors.data(), &minfo);
+        CPPUNIT_ASSERT_EQUAL(size_t{10}, retval);
+        assert_equal(data.begin() + 4100, data.begin() + 4110, values.begin());
+        CPPUNIT_ASSERT(std::abs(minfo.timestamp - timestamp(4100)) <= 1);
+
+        // Range no longer in the buffer, and a range in between the timestamp jump
+        retval = pm->get_range(timestamp(1000), timestamp(1100), buffer_size,
+                values.data(), errors.data(), &minfo);
+        CPPUNIT_ASSERT_EQUAL(size_t{0}, retval);
+        retval = pm->get_range(timestamp(3999) + sample_ns, restart_info.timestamp - 1, buffer_size,
+                values.data(), errors.data(), &minfo);
+        CPPUNIT_ASSERT_EQUAL(size_t{0}, retval);
+
+        // Range queries don't unfreeze the buffer
+        pm->freeze_buffer();
+        retval = pm->get_range(timestamp(3000) - sample_ns / 2, timestamp(4999) + sample_ns / 2, buffer_size,
+                values.data(), errors.data(), &minfo);
+        CPPUNIT_ASSERT_EQUAL(buffer_size, retval);
+        assert_equal(data.begin() + 3000, data.end(), values.begin());
+        retval = pm->get_items(buffer_size, values.data(), errors.data(), &minfo);
+        CPPUNIT_ASSERT_EQUAL(buffer_size, retval);
+    }
+
+    void
+    qa_post_mortem_sink::views()
+    {
+        size_t data_size = 3000;
+        size_t buffer_size = 1000;
+
+        auto top = gr::make_top_block("test");
+
+        auto data = make_test_data(data_size);
+        auto data_errs = make_test_data(data_size, 0.01);
+
+        auto source = gr::blocks::vector_source_f::make(data);
+        auto source_errs = gr::blocks::vector_source_f::make(data_errs);
+        auto pm = post_mortem_sink::make("test", "unit", DEFAULT_SAMP_RATE, buffer_size);
+
+        top->connect(source, 0, pm, 0);
+        top->connect(source_errs, 0, pm, 1);
+
+        top->run();
+
+        // Last samples, no copy
+        auto view = pm->get_view(100);
+        CPPUNIT_ASSERT_EQUAL(size_t{100}, view->size());
+        assert_equal(data.end() - 100, data.end(), view->values());
+        assert_equal(data_errs.end() - 100, data_errs.end(), view->errors());
+
+        auto full_view = pm->get_view(data_size);
+        CPPUNIT_ASSERT_EQUAL(buffer_size, full_view->size());
+        assert_equal(data.end() - buffer_size, data.end(), full_view->values());
+
+        // Reads don't unfreeze the buffer while views are held
+        std::vector<float> values(buffer_size);
+        std::vector<float> errors(buffer_size);
+        measurement_info_t info;
+        auto retval = pm->get_items(buffer_size, values.data(), errors.data(), &info);
+        CPPUNIT_ASSERT_EQUAL(buffer_size, retval);
+        assert_equal(values, full_view->values());
+        CPPUNIT_ASSERT_EQUAL(full_view->values()[buffer_size - 1], pm->get_view(1)->values()[0]);
+
+        CPPUNIT_ASSERT_THROW(pm->set_backing_file(""), std::runtime_error);
+
+        // Released explicitly or by dropping the reference
+        view->release();
+        view->release();
+        full_view.reset();
+        pm->set_backing_file("");
+    }
+
+    void
+    qa_post_mortem_sink::half_precision()
+    {
+        size_t data_size = 3000;
+        size_t buffer_size = 1000;
+
+        auto data = make_test_data(data_size);
+        auto data_errs = make_test_data(data_size, 0.01);
+
+        // errors only, values and errors
+        for (bool half_values : {false, true}) {
+            auto top = gr::make_top_block("test");
+
+            auto source = gr::blocks::vector_source_f::make(data);
+            auto source_errs = gr::blocks::vector_source_f::make(data_errs);
+            auto pm = post_mortem_sink::make("test", "unit", DEFAULT_SAMP_RATE, buffer_size);
+            pm->set_half_precision(half_values, true);
+
+            top->connect(source, 0, pm, 0);
+            top->connect(source_errs, 0, pm, 1);
+
+            top->run();
+
+            std::vector<float> values(buffer_size);
+            std::vector<float> errors(buffer_size);
+            measurement_info_t info;
+            auto retval = pm->get_items(buffer_size, values.data(), errors.data(), &info);
+            CPPUNIT_ASSERT_EQUAL(buffer_size, retval);
+
+            // Half precision is good for three significant digits
+            for (size_t i = 0; i < buffer_size; i++) {
+                auto expected = data[data_size - buffer_size + i];
+                auto expected_err = data_errs[data_size - buffer_size + i];
+                if (half_values) {
+                    CPPUNIT_ASSERT_DOUBLES_EQUAL(expected, values[i], expected * 1e-3);
+                }
+                else {
+                    CPPUNIT_ASSERT_EQUAL(expected, values[i]);
+                }
+                CPPUNIT_ASSERT_DOUBLES_EQUAL(expected_err, errors[i], expected_err * 1e-3);
+            }
+
+            // Views and files need native floats
+            CPPUNIT_ASSERT_THROW(pm->get_view(100), std::runtime_error);
+            CPPUNIT_ASSERT_THROW(pm->set_backing_file("/tmp/qa_post_mortem_sink_half.bin"), std::runtime_error);
+
+            pm->set_half_precision(false, false);
+            CPPUNIT_ASSERT_EQUAL(size_t{0}, pm->get_view(100)->size());
+        }
+    }
+
+    // Huge pages are best-effort, the content must be the same either way
+    void
+    qa_post_mortem_sink::huge_pages()
+    {
+        mirrored_ring_buffer_t<float> ring;
+        ring.allocate(1000, true);
+        CPPUNIT_ASSERT(ring.capacity() * sizeof(float) >= mirrored_ring_buffer_t<float>::HUGE_PAGE_SIZE);
+        if (ring.is_mirrored()) {
+            CPPUNIT_ASSERT_EQUAL(size_t{0}, reinterpret_cast<size_t>(ring.view(0))
+                    % mirrored_ring_buffer_t<float>::HUGE_PAGE_SIZE);
+        }
+
+        size_t data_size = 3000;
+        size_t buffer_size = 1000;
+
+        auto data = make_test_data(data_size);
+        auto data_errs = make_test_data(data_size, 0.01);
+
+        auto top = gr::make_top_block("test");
+        auto source = gr::blocks::vector_source_f::make(data);
+        auto source_errs = gr::blocks::vector_source_f::make(data_errs);
+        auto pm = post_mortem_sink::make("test", "unit", DEFAULT_SAMP_RATE, buffer_size);
+        pm->set_huge_pages(true);
+
+        top->connect(source, 0, pm, 0);
+        top->connect(source_errs, 0, pm, 1);
+        top->run();
+
+        std::vector<float> values(buffer_size);
+        std::vector<float> errors(buffer_size);
+        measurement_info_t info;
+        auto retval = pm->get_items(buffer_size, values.data(), errors.data(), &info);
+        CPPUNIT_ASSERT_EQUAL(buffer_size, retval);
+        for (size_t i = 0; i < buffer_size; i++) {
+            CPPUNIT_ASSERT_EQUAL(data[data_size - buffer_size + i], values[i]);
+            CPPUNIT_ASSERT_EQUAL(data_errs[data_size - buffer_size + i], errors[i]);
+        }
+    }
+
   } /* namespace digitizers */
 } /* namespace gr */
 
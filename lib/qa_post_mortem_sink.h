@@ -23,6 +23,14 @@ namespace gr {
       CPPUNIT_TEST(buffer_full);
       CPPUNIT_TEST(buffer_overflow);
       CPPUNIT_TEST(acq_info);
+      CPPUNIT_TEST(ring_buffer_wrap_around);
+      CPPUNIT_TEST(freeze_snapshot);
+      CPPUNIT_TEST(file_backed_buffer);
+      CPPUNIT_TEST(pyramid_levels);
+      CPPUNIT_TEST(time_range);
+      CPPUNIT_TEST(views);
+      CPPUNIT_TEST(half_precision);
+      CPPUNIT_TEST(huge_pages);
       CPPUNIT_TEST_SUITE_END();
 
     private:
@@ -31,6 +39,14 @@ namespace gr {
       void buffer_full();
       void buffer_overflow();
       void acq_info();
+      void ring_buffer_wrap_around();
+      void freeze_snapshot();
+      void file_backed_buffer();
+      void pyramid_levels();
+      void time_range();
+      void views();
+      void half_precision();
+      void huge_pages();
     };
 
   } /* namespace digitizers */
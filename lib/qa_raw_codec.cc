@@ -0,0 +1,83 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#include <gnuradio/attributes.h>
+#include <cppunit/TestAssert.h>
+#include "qa_raw_codec.h"
+#include <digitizers/raw_codec.h>
+
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+namespace gr {
+  namespace digitizers {
+
+    static void
+    assert_round_trip(const std::vector<int16_t> &samples, size_t max_size)
+    {
+      std::vector<uint8_t> data(raw_encode_bound(samples.size()));
+      auto size = raw_encode(samples.data(), samples.size(), data.data());
+      CPPUNIT_ASSERT(size <= data.size());
+      CPPUNIT_ASSERT(size <= max_size);
+
+      std::vector<int16_t> decoded(samples.size());
+      CPPUNIT_ASSERT_EQUAL(size, raw_decode(data.data(), size, decoded.data(), decoded.size()));
+      CPPUNIT_ASSERT(samples == decoded);
+    }
+
+    void
+    qa_raw_codec::round_trip()
+    {
+      // Sizes around the block size, including the empty input
+      for (size_t n : {0, 1, 127, 128, 129, 1000}) {
+        // Constant signal, a byte per block plus the first value (12 bits)
+        std::vector<int16_t> constant(n, 1234);
+        const size_t nblocks = (n + RAW_CODEC_BLOCK_SIZE - 1) / RAW_CODEC_BLOCK_SIZE;
+        assert_round_trip(constant, nblocks + 12 * 16);
+
+        // Slow sine with a few bits of noise, deltas take at most 8 bits
+        std::vector<int16_t> sine(n);
+        for (size_t i = 0; i < n; i++) {
+          sine[i] = static_cast<int16_t>(8000.0 * std::sin(i * 0.01) + (std::rand() % 16) - 8);
+        }
+        assert_round_trip(sine, nblocks * (1 + 8 * 16));
+
+        // Full-scale jumps, the worst case
+        std::vector<int16_t> extremes(n);
+        for (size_t i = 0; i < n; i++) {
+          extremes[i] = i % 2 ? std::numeric_limits<int16_t>::min() : std::numeric_limits<int16_t>::max();
+        }
+        assert_round_trip(extremes, raw_encode_bound(n));
+      }
+    }
+
+    void
+    qa_raw_codec::corrupt_data()
+    {
+      std::vector<int16_t> samples(300);
+      for (size_t i = 0; i < samples.size(); i++) {
+        samples[i] = static_cast<int16_t>(i * 7);
+      }
+
+      std::vector<uint8_t> data(raw_encode_bound(samples.size()));
+      auto size = raw_encode(samples.data(), samples.size(), data.data());
+      std::vector<int16_t> decoded(samples.size());
+
+      // Truncated
+      CPPUNIT_ASSERT_THROW(raw_decode(data.data(), size - 1, decoded.data(), decoded.size()),
+              std::invalid_argument);
+
+      // Invalid bit width
+      data[0] = 18;
+      CPPUNIT_ASSERT_THROW(raw_decode(data.data(), size, decoded.data(), decoded.size()),
+              std::invalid_argument);
+    }
+
+  } /* namespace digitizers */
+} /* namespace gr */
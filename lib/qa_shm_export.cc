@@ -0,0 +1,92 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#include <gnuradio/attributes.h>
+#include <cppunit/TestAssert.h>
+#include "qa_shm_export.h"
+#include "shm_export.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace gr {
+  namespace digitizers {
+
+    void
+    qa_shm_export::publish_and_read()
+    {
+      const std::string name = "/qa_shm_export_" + std::to_string(getpid());
+      const size_t nslots = 4, nvalues = 100;
+
+      shm_export_t exporter;
+      exporter.open(name, SHM_EXPORT_TIME_DOMAIN, "test", nslots, nvalues, nvalues);
+      CPPUNIT_ASSERT(exporter.is_open());
+
+      // Consumer side, mapped read-only by name
+      int fd = shm_open(name.c_str(), O_RDONLY, 0);
+      CPPUNIT_ASSERT(fd >= 0);
+      struct stat st;
+      CPPUNIT_ASSERT_EQUAL(0, fstat(fd, &st));
+      auto addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+      ::close(fd);
+      CPPUNIT_ASSERT(addr != MAP_FAILED);
+
+      auto header = static_cast<const shm_export_header_t *>(addr);
+      CPPUNIT_ASSERT_EQUAL(std::string("DIGISHM"), std::string(header->magic));
+      CPPUNIT_ASSERT_EQUAL(SHM_EXPORT_VERSION, header->version);
+      CPPUNIT_ASSERT_EQUAL(static_cast<uint32_t>(SHM_EXPORT_TIME_DOMAIN), header->kind);
+      CPPUNIT_ASSERT_EQUAL(static_cast<uint32_t>(nslots), header->nslots);
+      CPPUNIT_ASSERT_EQUAL(static_cast<uint32_t>(nvalues), header->max_values);
+      CPPUNIT_ASSERT_EQUAL(std::string("test"), std::string(header->name));
+      CPPUNIT_ASSERT_EQUAL(uint64_t(0), header->write_sequence);
+
+      // More packages than slots, the oldest ones are overwritten
+      std::vector<float> values(nvalues), errors(nvalues / 2);
+      const size_t npackages = 6;
+      for (size_t p = 0; p < npackages; p++) {
+        for (size_t i = 0; i < nvalues; i++) {
+          values[i] = static_cast<float>(p * 1000 + i);
+        }
+        measurement_info_t info = {};
+        info.timestamp = 1000 + p;
+        info.status = 0;
+        exporter.publish(info, values.data(), values.size(), errors.data(), errors.size());
+      }
+
+      CPPUNIT_ASSERT_EQUAL(uint64_t(npackages), header->write_sequence);
+      CPPUNIT_ASSERT_EQUAL(uint32_t(npackages), header->futex);
+
+      for (uint64_t seq = npackages - nslots; seq < npackages; seq++) {
+        auto slot = reinterpret_cast<const shm_export_slot_t *>(static_cast<const char *>(addr)
+                + header->slots_offset + (seq % nslots) * header->slot_size);
+        CPPUNIT_ASSERT_EQUAL(seq, slot->sequence);
+        CPPUNIT_ASSERT_EQUAL(static_cast<uint32_t>(nvalues), slot->nvalues);
+        CPPUNIT_ASSERT_EQUAL(static_cast<uint32_t>(nvalues / 2), slot->nerrors);
+        CPPUNIT_ASSERT_EQUAL(static_cast<int64_t>(1000 + seq), slot->info.timestamp);
+
+        auto slot_values = reinterpret_cast<const float *>(reinterpret_cast<const char *>(slot)
+                + header->values_offset);
+        CPPUNIT_ASSERT_EQUAL(static_cast<float>(seq * 1000), slot_values[0]);
+        CPPUNIT_ASSERT_EQUAL(static_cast<float>(seq * 1000 + nvalues - 1), slot_values[nvalues - 1]);
+      }
+
+      // Closing unlinks the object, the mapping stays valid
+      exporter.close();
+      CPPUNIT_ASSERT(!exporter.is_open());
+      CPPUNIT_ASSERT(shm_open(name.c_str(), O_RDONLY, 0) < 0);
+      CPPUNIT_ASSERT_EQUAL(uint64_t(npackages), header->write_sequence);
+
+      munmap(addr, st.st_size);
+    }
+
+  } /* namespace digitizers */
+} /* namespace gr */
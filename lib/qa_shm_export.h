@@ -0,0 +1,31 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+
+#ifndef _QA_SHM_EXPORT_H_
+#define _QA_SHM_EXPORT_H_
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/TestCase.h>
+
+namespace gr {
+  namespace digitizers {
+
+    class qa_shm_export : public CppUnit::TestCase
+    {
+    public:
+      CPPUNIT_TEST_SUITE(qa_shm_export);
+      CPPUNIT_TEST(publish_and_read);
+      CPPUNIT_TEST_SUITE_END();
+
+    private:
+      void publish_and_read();
+    };
+
+  } /* namespace digitizers */
+} /* namespace gr */
+
+#endif /* _QA_SHM_EXPORT_H_ */
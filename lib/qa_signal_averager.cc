@@ -15,6 +15,7 @@
 #include <digitizers/signal_averager.h>
 #include <digitizers/tags.h>
 #include <gnuradio/blocks/vector_source_f.h>
+#include <gnuradio/blocks/vector_source_s.h>
 #include <gnuradio/blocks/vector_sink_f.h>
 
 namespace gr {
@@ -152,6 +153,51 @@ namespace gr {
     CPPUNIT_ASSERT_EQUAL(data.size(),size_t(size/decim));
   }
 
+  void
+  qa_signal_averager::raw_input_test()
+  {
+    // windows longer than the int32 partial sums
+    int decim = 70000;
+
+    std::vector<int16_t> samples(3 * decim);
+    std::fill(samples.begin(), samples.begin() + decim, 32767);
+    std::fill(samples.begin() + decim, samples.begin() + 2 * decim, -32768);
+    for (int i = 2 * decim; i < 3 * decim; i++) {
+      samples[i] = i % 2 ? 200 : 100;
+    }
+
+    // the second scaling starts within the second window, i.e. it applies from the third one
+    std::vector<gr::tag_t> tags = {
+      make_raw_scaling_tag(raw_scaling_t{0.001, 0.5, 0.01}, 0),
+      make_raw_scaling_tag(raw_scaling_t{0.002, 0.0, 0.02}, decim + 1)
+    };
+
+    auto top = gr::make_top_block("raw_input_test");
+    auto src = blocks::vector_source_s::make(samples, false, 1, tags);
+    auto avg = signal_averager::make(1, decim, 1000000.0, true);
+    auto snk = blocks::vector_sink_f::make(1);
+
+    top->connect(src, 0, avg, 0);
+    top->connect(avg, 0, snk, 0);
+    top->run();
+
+    auto data = snk->data();
+    CPPUNIT_ASSERT_EQUAL(size_t(3), data.size());
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(32.767 + 0.5, data[0], 1e-5);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(-32.768 + 0.5, data[1], 1e-5);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.3, data[2], 1e-6);
+
+    // the output is in volts, raw scaling tags become constant error tags
+    auto tags_out = snk->tags();
+    CPPUNIT_ASSERT_EQUAL(size_t(2), tags_out.size());
+    for (size_t i = 0; i < tags_out.size(); i++) {
+      CPPUNIT_ASSERT_EQUAL(TAG_KIND_CONSTANT_ERROR, get_tag_kind(tags_out[i]));
+      CPPUNIT_ASSERT_EQUAL(uint64_t(i), tags_out[i].offset);
+    }
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.01, decode_constant_error_tag(tags_out[0]), 1e-6);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.02, decode_constant_error_tag(tags_out[1]), 1e-6);
+  }
+
   } /* namespace digitizers */
 } /* namespace gr */
 
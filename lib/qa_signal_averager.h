@@ -21,12 +21,14 @@ namespace gr {
       CPPUNIT_TEST(single_input_test);
       CPPUNIT_TEST(multiple_input_test);
       CPPUNIT_TEST(offset_trigger_tag_test);
+      CPPUNIT_TEST(raw_input_test);
       CPPUNIT_TEST_SUITE_END();
 
     private:
       void single_input_test();
       void multiple_input_test();
       void offset_trigger_tag_test();
+      void raw_input_test();
     };
 
   } /* namespace digitizers */
@@ -0,0 +1,160 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#include <gnuradio/attributes.h>
+#include <cppunit/TestAssert.h>
+#include "qa_state_file.h"
+#include "state_file.h"
+#include "iir_sos_filter_ff_impl.h"
+#include "sos_design.h"
+#include <gnuradio/top_block.h>
+#include <gnuradio/blocks/vector_source_f.h>
+#include <gnuradio/blocks/vector_sink_f.h>
+
+#include <unistd.h>
+
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace gr {
+  namespace digitizers {
+
+    static std::string
+    temporary_path(const std::string &name)
+    {
+      return "/tmp/qa_state_file_" + name + "_" + std::to_string(getpid());
+    }
+
+    void
+    qa_state_file::save_and_restore()
+    {
+      const auto path = temporary_path("restore");
+      std::vector<float> a {1.0f, 2.0f, 3.0f}, b {4.0f, 5.0f};
+
+      {
+        auto file = state_file_t::sptr(new state_file_t(path, 1.0, 3600.0));
+        state_slot_t slot;
+        slot.attach(file, "level");
+
+        // nothing to restore on the first run
+        std::vector<float> ra(3, 0.0f), rb(2, 0.0f);
+        CPPUNIT_ASSERT(!slot.restore(42, {{ra.data(), ra.size()}, {rb.data(), rb.size()}}));
+        CPPUNIT_ASSERT(slot.is_due());
+        slot.save(42, {{a.data(), a.size()}, {b.data(), b.size()}});
+        CPPUNIT_ASSERT(!slot.is_due());
+      }
+
+      // restored once, into the same layout only
+      {
+        auto file = state_file_t::sptr(new state_file_t(path, 1.0, 3600.0));
+        state_slot_t slot;
+        std::vector<float> ra(3, 0.0f), rb(2, 0.0f);
+
+        slot.attach(file, "level");
+        CPPUNIT_ASSERT(!slot.restore(43, {{ra.data(), ra.size()}, {rb.data(), rb.size()}}));
+        CPPUNIT_ASSERT(ra == std::vector<float>(3, 0.0f));
+
+        slot.attach(file, "level");
+        CPPUNIT_ASSERT(!slot.restore(42, {{ra.data(), ra.size()}}));
+
+        slot.attach(file, "level");
+        CPPUNIT_ASSERT(slot.restore(42, {{ra.data(), ra.size()}, {rb.data(), rb.size()}}));
+        CPPUNIT_ASSERT(ra == a);
+        CPPUNIT_ASSERT(rb == b);
+        CPPUNIT_ASSERT(!slot.restore(42, {{ra.data(), ra.size()}, {rb.data(), rb.size()}}));
+
+        // other keys are independent
+        state_slot_t other;
+        other.attach(file, "other");
+        CPPUNIT_ASSERT(!other.restore(42, {{ra.data(), ra.size()}, {rb.data(), rb.size()}}));
+      }
+
+      // records are too old
+      {
+        auto file = state_file_t::sptr(new state_file_t(path, 1.0, 0.0));
+        CPPUNIT_ASSERT(file->find_valid("level") == nullptr);
+      }
+
+      CPPUNIT_ASSERT_THROW(state_file_t(path, 0.0, 1.0), std::invalid_argument);
+      CPPUNIT_ASSERT_THROW(state_file_t("/nonexistent/state", 1.0, 1.0), std::runtime_error);
+
+      std::remove(path.c_str());
+    }
+
+    void
+    qa_state_file::torn_record()
+    {
+      const auto path = temporary_path("torn");
+      std::vector<float> a {1.0f, 2.0f, 3.0f};
+
+      {
+        auto file = state_file_t::sptr(new state_file_t(path, 1.0, 3600.0));
+        state_slot_t slot;
+        slot.attach(file, "level");
+        slot.restore(1, {{a.data(), a.size()}});
+        slot.save(1, {{a.data(), a.size()}});
+        CPPUNIT_ASSERT(file->find_valid("level") != nullptr);
+
+        // a crash while saving leaves an odd sequence behind
+        file->get_record("level", a.size() * sizeof(float))->sequence |= 1;
+      }
+
+      auto file = state_file_t::sptr(new state_file_t(path, 1.0, 3600.0));
+      CPPUNIT_ASSERT(file->find_valid("level") == nullptr);
+
+      std::remove(path.c_str());
+    }
+
+    void
+    qa_state_file::iir_warm_restart()
+    {
+      const auto path = temporary_path("iir");
+      const int n = 4000;
+
+      // a slow low pass, far from settled after the first half
+      auto sections = tf_to_sos({0.001}, {1.0, -0.999});
+      std::vector<float> data;
+      for (int i = 0; i < n; i++) {
+        data.push_back(1.0f + 0.1f * std::sin(0.05 * i));
+      }
+
+      // the reference runs without a restart
+      std::vector<float> expected(n);
+      {
+        std::vector<float> state(2 * sections.size(), 0.0f);
+        sos_cascade(sections.data(), sections.size(), state.data(), data.data(), expected.data(), 1, n);
+      }
+
+      std::vector<float> values;
+      for (int run = 0; run < 2; run++) {
+        auto file = state_file_t::sptr(new state_file_t(path, 1.0, 3600.0));
+        auto filter = gnuradio::get_initial_sptr(new iir_sos_filter_ff_impl(1, sections));
+        filter->set_state_file(file, "filter");
+
+        auto top = gr::make_top_block("test");
+        auto source = gr::blocks::vector_source_f::make(
+                std::vector<float>(data.begin() + run * n / 2, data.begin() + (run + 1) * n / 2));
+        auto sink = gr::blocks::vector_sink_f::make();
+        top->connect(source, 0, filter, 0);
+        top->connect(filter, 0, sink, 0);
+        top->run();
+
+        auto part = sink->data();
+        values.insert(values.end(), part.begin(), part.end());
+      }
+
+      CPPUNIT_ASSERT_EQUAL(size_t(n), values.size());
+      for (int i = 0; i < n; i++) {
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(expected[i], values[i], 1e-5);
+      }
+
+      std::remove(path.c_str());
+    }
+
+  } /* namespace digitizers */
+} /* namespace gr */
@@ -0,0 +1,35 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+
+#ifndef _QA_STATE_FILE_H_
+#define _QA_STATE_FILE_H_
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/TestCase.h>
+
+namespace gr {
+  namespace digitizers {
+
+    class qa_state_file : public CppUnit::TestCase
+    {
+    public:
+      CPPUNIT_TEST_SUITE(qa_state_file);
+      CPPUNIT_TEST(save_and_restore);
+      CPPUNIT_TEST(torn_record);
+      CPPUNIT_TEST(iir_warm_restart);
+      CPPUNIT_TEST_SUITE_END();
+
+    private:
+      void save_and_restore();
+      void torn_record();
+      void iir_warm_restart();
+    };
+
+  } /* namespace digitizers */
+} /* namespace gr */
+
+#endif /* _QA_STATE_FILE_H_ */
@@ -0,0 +1,143 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#include <gnuradio/attributes.h>
+#include <cppunit/TestAssert.h>
+#include "qa_statistics_sink_f.h"
+#include <digitizers/statistics_sink_f.h>
+#include <digitizers/tags.h>
+#include <gnuradio/blocks/vector_source_f.h>
+#include <gnuradio/top_block.h>
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace gr {
+ namespace digitizers {
+
+    static std::vector<float>
+    make_statistics_data(size_t size)
+    {
+      std::vector<float> data;
+      for (size_t i = 0; i < size; i++) {
+        data.push_back(2.0f + std::sin(0.05 * i) + static_cast<float>((i * 7919) % 101) / 100.0f);
+      }
+      return data;
+    }
+
+    static void
+    count_records(const statistics_record_t *record, void *userdata)
+    {
+      (*static_cast<int *>(userdata))++;
+    }
+
+    void
+    qa_statistics_sink_f::test_statistics()
+    {
+      // 1024 Hz, i.e. exact window lengths and timestamps
+      const float samp_rate = 1024.0f;
+      const size_t size = 2500;
+      const auto data = make_statistics_data(size);
+
+      acq_info_t acq_info {};
+      acq_info.timestamp = 1000000000;
+      acq_info.timebase = 1.0 / 1024.0;
+      auto status_info = acq_info;
+      status_info.timestamp += static_cast<int64_t>(300 * 976562.5);
+      status_info.status = 1;
+      std::vector<gr::tag_t> tags = {
+        make_acq_info_tag(acq_info, 0),
+        make_acq_info_tag(status_info, 300)
+      };
+
+      auto top = gr::make_top_block("test");
+      auto source = gr::blocks::vector_source_f::make(data, false, 1, tags);
+      auto sink = statistics_sink_f::make("sig", "V", samp_rate, {0.125, 1.0}, 32);
+      int ncallbacks = 0;
+      sink->set_callback(&count_records, &ncallbacks);
+
+      top->connect(source, 0, sink, 0);
+      top->run();
+
+      auto lengths = sink->get_window_lengths();
+      CPPUNIT_ASSERT_EQUAL(size_t(2), lengths.size());
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(0.125, lengths[0], 1e-12);
+
+      std::vector<statistics_record_t> records(32);
+      const size_t window_samples[] = { 128, 1024 };
+      for (size_t w = 0; w < 2; w++) {
+        const auto n = sink->get_records(w, &records[0], records.size());
+        CPPUNIT_ASSERT_EQUAL(size / window_samples[w], n);
+
+        for (size_t r = 0; r < n; r++) {
+          const auto first = r * window_samples[w];
+          const auto last = first + window_samples[w];
+
+          double sum = 0.0, squares = 0.0;
+          for (size_t i = first; i < last; i++) {
+            sum += data[i];
+            squares += data[i] * data[i];
+          }
+          const double mean = sum / window_samples[w];
+          double m2 = 0.0;
+          for (size_t i = first; i < last; i++) {
+            m2 += (data[i] - mean) * (data[i] - mean);
+          }
+
+          const auto &record = records[r];
+          CPPUNIT_ASSERT_EQUAL(uint32_t(w), record.window);
+          CPPUNIT_ASSERT_DOUBLES_EQUAL(mean, record.mean, 1e-5);
+          CPPUNIT_ASSERT_DOUBLES_EQUAL(std::sqrt(squares / window_samples[w]), record.rms, 1e-5);
+          CPPUNIT_ASSERT_DOUBLES_EQUAL(std::sqrt(m2 / (window_samples[w] - 1)), record.stddev, 1e-5);
+          CPPUNIT_ASSERT_EQUAL(*std::min_element(&data[first], &data[last]), record.min);
+          CPPUNIT_ASSERT_EQUAL(*std::max_element(&data[first], &data[last]), record.max);
+
+          CPPUNIT_ASSERT_EQUAL(uint32_t(window_samples[w]), record.info.post_trigger_samples);
+          CPPUNIT_ASSERT_DOUBLES_EQUAL(window_samples[w] / 1024.0, record.info.timebase, 1e-12);
+          CPPUNIT_ASSERT_EQUAL(int64_t(1000000000 + first * 976562.5), record.info.timestamp);
+
+          // the status tag at sample 300 is merged into the windows containing it
+          const uint32_t status = first <= 300 && 300 < last ? 1 : 0;
+          CPPUNIT_ASSERT_EQUAL(status, record.info.status);
+        }
+      }
+
+      CPPUNIT_ASSERT_EQUAL(int(size / 128 + size / 1024), ncallbacks);
+    }
+
+    void
+    qa_statistics_sink_f::test_lost_records()
+    {
+      auto top = gr::make_top_block("test");
+      auto source = gr::blocks::vector_source_f::make(make_statistics_data(2000));
+      auto sink = statistics_sink_f::make("sig", "V", 1000.0f, {0.1}, 4);
+
+      top->connect(source, 0, sink, 0);
+      top->run();
+
+      // only the latest records are kept
+      std::vector<statistics_record_t> records(8);
+      CPPUNIT_ASSERT_EQUAL(size_t(4), sink->get_records(0, &records[0], records.size()));
+      CPPUNIT_ASSERT_EQUAL(uint64_t(16 * 100), records[0].info.samples_lost);
+      CPPUNIT_ASSERT_EQUAL(uint64_t(0), records[1].info.samples_lost);
+      CPPUNIT_ASSERT_EQUAL(size_t(0), sink->get_records(0, &records[0], records.size()));
+
+      CPPUNIT_ASSERT_THROW(sink->get_records(1, &records[0], records.size()), std::invalid_argument);
+    }
+
+    void
+    qa_statistics_sink_f::test_invalid_windows()
+    {
+      CPPUNIT_ASSERT_THROW(statistics_sink_f::make("sig", "V", 1000.0f, {}), std::invalid_argument);
+      CPPUNIT_ASSERT_THROW(statistics_sink_f::make("sig", "V", 1000.0f, {0.0001}), std::invalid_argument);
+      CPPUNIT_ASSERT_THROW(statistics_sink_f::make("sig", "V", 1000.0f, {1.0, 0.1}), std::invalid_argument);
+      CPPUNIT_ASSERT_THROW(statistics_sink_f::make("sig", "V", 1000.0f, {0.1, 0.25}), std::invalid_argument);
+      CPPUNIT_ASSERT_THROW(statistics_sink_f::make("sig", "V", 1000.0f, {0.1}, 0), std::invalid_argument);
+    }
+
+  } /* namespace digitizers */
+} /* namespace gr */
@@ -0,0 +1,35 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+
+#ifndef _QA_STATISTICS_SINK_F_H_
+#define _QA_STATISTICS_SINK_F_H_
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/TestCase.h>
+
+namespace gr {
+  namespace digitizers {
+
+    class qa_statistics_sink_f : public CppUnit::TestCase
+    {
+    public:
+      CPPUNIT_TEST_SUITE(qa_statistics_sink_f);
+      CPPUNIT_TEST(test_statistics);
+      CPPUNIT_TEST(test_lost_records);
+      CPPUNIT_TEST(test_invalid_windows);
+      CPPUNIT_TEST_SUITE_END();
+
+    private:
+      void test_statistics();
+      void test_lost_records();
+      void test_invalid_windows();
+    };
+
+  } /* namespace digitizers */
+} /* namespace gr */
+
+#endif /* _QA_STATISTICS_SINK_F_H_ */
@@ -11,8 +11,14 @@
 #include <cppunit/TestAssert.h>
 #include "qa_stft_algorithms.h"
 #include "digitizers/stft_algorithms.h"
+#include "fft_engine.h"
 #include <gnuradio/blocks/vector_source_f.h>
 #include <gnuradio/blocks/vector_sink_f.h>
+#include <gnuradio/blocks/head.h>
+
+#include <cmath>
+#include <complex>
+#include <stdexcept>
 
 
 namespace gr {
@@ -40,6 +46,248 @@ namespace gr {
     CPPUNIT_ASSERT_EQUAL((int)phas.size(), 8);
   }
 
+  void
+  qa_stft_algorithms::test_sliding_goertzel()
+  {
+    // hop of 4 samples and a window of 64, i.e. the sliding DFT is used
+    double samp_rate = 1024;
+    double delta_t = 1.0 / 256.0;
+    int window_size = 64;
+    int hop = 4;
+    int nbins = 10;
+    double fq_low = 50.0;
+    double fq_hi = 300.0;
+
+    std::vector<float> data;
+    for (int i = 0; i < 2000; i++) {
+      data.push_back(std::sin(2.0 * M_PI * i * 130.0 / samp_rate) + 0.1f * ((i * 7919) % 13 - 6));
+    }
+
+    auto top = gr::make_top_block("sliding_goertzel");
+    auto src = blocks::vector_source_f::make(data);
+    auto snk0 = blocks::vector_sink_f::make(nbins);
+    auto snk1 = blocks::vector_sink_f::make(nbins);
+    auto stft = stft_algorithms::make(samp_rate, delta_t, window_size, 0, GOERTZEL, fq_low, fq_hi, nbins);
+
+    top->connect(src, 0, stft, 0);
+    top->connect(stft, 0, snk0, 0);
+    top->connect(stft, 1, snk1, 0);
+    top->run();
+
+    auto ampl = snk0->data();
+    auto phas = snk1->data();
+    int nwindows = ampl.size() / nbins;
+    CPPUNIT_ASSERT(nwindows > 100);
+
+    // direct evaluation of each window, same as goertzel_fc
+    for (int k = 0; k < nwindows; k++) {
+      for (int i = 0; i < nbins; i++) {
+        double freq = fq_low + (static_cast<double>(i) / (nbins - 1)) * (fq_hi - fq_low);
+        double w = 2.0 * M_PI * freq / samp_rate;
+        std::complex<double> sum = 0.0;
+        for (int m = 0; m < window_size; m++) {
+          sum += static_cast<double>(data[k * hop + m]) * std::polar(1.0, w * (window_size - m));
+        }
+        sum /= window_size;
+
+        auto actual = std::polar(static_cast<double>(ampl.at(k * nbins + i)),
+                static_cast<double>(phas.at(k * nbins + i)));
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(std::abs(sum), ampl.at(k * nbins + i), 1e-4);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(0.0, std::abs(actual - sum), 1e-3);
+      }
+    }
+  }
+
+  void
+  qa_stft_algorithms::test_fft_shared_engine()
+  {
+    // two instances of the same size share the engine, results match a direct DFT
+    int window_size = 16;
+    double samp_rate = 1000;
+    std::vector<float> data;
+    for (int i = 0; i < 8 * window_size; i++) {
+      data.push_back(std::cos(2.0 * M_PI * i * 125.0 / samp_rate) + 0.01f * i);
+    }
+
+    auto top = gr::make_top_block("fft_shared_engine");
+    auto src = blocks::vector_source_f::make(data);
+    auto snk_a = blocks::vector_sink_f::make(window_size);
+    auto snk_b = blocks::vector_sink_f::make(window_size);
+    auto fft_a = stft_algorithms::make(samp_rate, 0.032, window_size, filter::firdes::WIN_RECTANGULAR, FFT, 0, 500, window_size);
+    auto fft_b = stft_algorithms::make(samp_rate, 0.032, window_size, filter::firdes::WIN_RECTANGULAR, FFT, 0, 500, window_size);
+
+    auto engine = fft_engine_t::get(2 * window_size);
+    CPPUNIT_ASSERT(engine == fft_engine_t::get(2 * window_size));
+    CPPUNIT_ASSERT(engine != fft_engine_t::get(window_size));
+
+    top->connect(src, 0, fft_a, 0);
+    top->connect(src, 0, fft_b, 0);
+    top->connect(fft_a, 0, snk_a, 0);
+    top->connect(fft_a, 1, blocks::vector_sink_f::make(window_size), 0);
+    top->connect(fft_b, 0, snk_b, 0);
+    top->connect(fft_b, 1, blocks::vector_sink_f::make(window_size), 0);
+    top->run();
+
+    auto ampl = snk_a->data();
+    CPPUNIT_ASSERT(ampl == snk_b->data());
+
+    // windows of 2 * window_size samples, 32 samples apart
+    int nwindows = ampl.size() / window_size;
+    CPPUNIT_ASSERT(nwindows >= 3);
+    for (int k = 0; k < nwindows; k++) {
+      for (int i = 0; i < window_size; i++) {
+        std::complex<double> sum = 0.0;
+        for (int m = 0; m < 2 * window_size; m++) {
+          sum += static_cast<double>(data[k * 32 + m]) * std::polar(1.0, -2.0 * M_PI * i * m / (2.0 * window_size));
+        }
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(std::abs(sum), ampl.at(k * window_size + i), 1e-3);
+      }
+    }
+  }
+
+  void
+  qa_stft_algorithms::test_auto_selection()
+  {
+    // few bins are evaluated by Goertzel, many by an FFT, the output is the one of GOERTZEL
+    double samp_rate = 10000;
+    double delta_t = 0.1;
+    int window_size = 1024;
+
+    std::vector<float> data;
+    for (int i = 0; i < 8 * window_size; i++) {
+      data.push_back(std::sin(2.0 * M_PI * i * 1250.0 / samp_rate) + 0.1f * ((i * 7919) % 13 - 6));
+    }
+
+    struct {
+      int nbins;
+      double fq_low;
+      double fq_hi;
+      stft_algorithm_id_t expected;
+    } cases[] = {
+      {2, 1000.0, 1500.0, GOERTZEL},
+      {400, 123.4, 4321.0, FFT},         // chirp-z transform
+      {513, 0.0, 5000.0, FFT},           // bins of a 1024 points FFT
+    };
+
+    for (const auto &c : cases) {
+      auto top = gr::make_top_block("auto_selection");
+      auto src = blocks::vector_source_f::make(data);
+      auto snk_auto = blocks::vector_sink_f::make(c.nbins);
+      auto snk_auto_phase = blocks::vector_sink_f::make(c.nbins);
+      auto snk_goertzel = blocks::vector_sink_f::make(c.nbins);
+      auto snk_goertzel_phase = blocks::vector_sink_f::make(c.nbins);
+      auto stft_auto = stft_algorithms::make(samp_rate, delta_t, window_size, 0, AUTO, c.fq_low, c.fq_hi, c.nbins);
+      auto stft_goertzel = stft_algorithms::make(samp_rate, delta_t, window_size, 0, GOERTZEL, c.fq_low, c.fq_hi, c.nbins);
+
+      CPPUNIT_ASSERT_EQUAL(c.expected, stft_auto->get_algorithm());
+      CPPUNIT_ASSERT_EQUAL(GOERTZEL, stft_goertzel->get_algorithm());
+
+      top->connect(src, 0, stft_auto, 0);
+      top->connect(src, 0, stft_goertzel, 0);
+      top->connect(stft_auto, 0, snk_auto, 0);
+      top->connect(stft_auto, 1, snk_auto_phase, 0);
+      top->connect(stft_goertzel, 0, snk_goertzel, 0);
+      top->connect(stft_goertzel, 1, snk_goertzel_phase, 0);
+      top->run();
+
+      auto ampl = snk_auto->data();
+      auto phas = snk_auto_phase->data();
+      auto expected_ampl = snk_goertzel->data();
+      auto expected_phas = snk_goertzel_phase->data();
+      CPPUNIT_ASSERT_EQUAL(expected_ampl.size(), ampl.size());
+      CPPUNIT_ASSERT(!ampl.empty());
+
+      for (size_t i = 0; i < ampl.size(); i++) {
+        auto actual = std::polar(ampl[i], phas[i]);
+        auto expected = std::polar(expected_ampl[i], expected_phas[i]);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(expected_ampl[i], ampl[i], 1e-4);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(0.0, std::abs(actual - expected), 1e-3);
+      }
+    }
+
+    // re-evaluated without a restart
+    auto stft = stft_algorithms::make(samp_rate, delta_t, window_size, 0, AUTO, 1000.0, 1500.0, 2);
+    CPPUNIT_ASSERT_EQUAL(GOERTZEL, stft->get_algorithm());
+    stft->set_freqs(0.0, 5000.0);
+    CPPUNIT_ASSERT_EQUAL(GOERTZEL, stft->get_algorithm());
+
+    auto stft_many = stft_algorithms::make(samp_rate, delta_t, window_size, 0, AUTO, 0.0, 5000.0, 513);
+    CPPUNIT_ASSERT_EQUAL(FFT, stft_many->get_algorithm());
+    stft_many->set_samp_rate(9999.0);  // off the FFT grid, chirp-z transform
+    CPPUNIT_ASSERT_EQUAL(FFT, stft_many->get_algorithm());
+  }
+
+  void
+  qa_stft_algorithms::test_down_conversion()
+  {
+    // narrow band around a tone, evaluated at a 16th of the rate after down-conversion
+    double samp_rate = 100000;
+    double delta_t = 0.1;
+    int window_size = 1600;
+    int decimation = 16;
+    int nbins = 15;
+    double fq_low = 12000.0;
+    double fq_hi = 12700.0;
+
+    std::vector<float> data;
+    for (int i = 0; i < 10 * 10000; i++) {
+      data.push_back(0.8 * std::cos(2.0 * M_PI * i * 12345.0 / samp_rate + 0.3)
+              + 0.5 * std::cos(2.0 * M_PI * i * 31000.0 / samp_rate));
+    }
+
+    for (auto alg_id : {GOERTZEL, FFT, AUTO}) {
+      auto top = gr::make_top_block("down_conversion");
+      auto src = blocks::vector_source_f::make(data);
+      auto snk_ddc = blocks::vector_sink_f::make(nbins);
+      auto snk_ddc_phase = blocks::vector_sink_f::make(nbins);
+      auto snk_ddc_freqs = blocks::vector_sink_f::make(nbins);
+      auto snk_goertzel = blocks::vector_sink_f::make(nbins);
+      auto snk_goertzel_phase = blocks::vector_sink_f::make(nbins);
+      auto head = blocks::head::make(sizeof(float) * nbins, 1);
+      auto stft_ddc = stft_algorithms::make(samp_rate, delta_t, window_size, 0, alg_id, fq_low, fq_hi, nbins,
+              12300.0, decimation);
+      auto stft_goertzel = stft_algorithms::make(samp_rate, delta_t, window_size, 0, GOERTZEL, fq_low, fq_hi, nbins);
+
+      top->connect(src, 0, stft_ddc, 0);
+      top->connect(src, 0, stft_goertzel, 0);
+      top->connect(stft_ddc, 0, snk_ddc, 0);
+      top->connect(stft_ddc, 1, snk_ddc_phase, 0);
+      top->connect(stft_ddc, 2, head, 0);
+      top->connect(head, 0, snk_ddc_freqs, 0);
+      top->connect(stft_goertzel, 0, snk_goertzel, 0);
+      top->connect(stft_goertzel, 1, snk_goertzel_phase, 0);
+      top->run();
+
+      // frequencies of the input
+      auto freqs = snk_ddc_freqs->data();
+      CPPUNIT_ASSERT_EQUAL(nbins, static_cast<int>(freqs.size()));
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(fq_low, freqs.front(), 1e-2);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(fq_hi, freqs.back(), 1e-2);
+
+      // the first window is in the settling time of the filter
+      auto ampl = snk_ddc->data();
+      auto expected = snk_goertzel->data();
+      CPPUNIT_ASSERT(ampl.size() >= static_cast<size_t>(5 * nbins));
+      CPPUNIT_ASSERT(expected.size() >= ampl.size());
+      for (size_t i = nbins; i < ampl.size(); i++) {
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(expected[i], ampl[i], 4e-3);
+      }
+    }
+
+    // bins must be within the passband, the window a multiple of the decimation
+    CPPUNIT_ASSERT_THROW(stft_algorithms::make(samp_rate, delta_t, window_size, 0, GOERTZEL, 10000.0, 12700.0,
+            nbins, 12300.0, decimation), std::invalid_argument);
+    CPPUNIT_ASSERT_THROW(stft_algorithms::make(samp_rate, delta_t, 1000, 0, GOERTZEL, fq_low, fq_hi,
+            nbins, 12300.0, decimation), std::invalid_argument);
+    CPPUNIT_ASSERT_THROW(stft_algorithms::make(samp_rate, delta_t, window_size, 0, DFT, fq_low, fq_hi,
+            nbins, 12300.0, decimation), std::invalid_argument);
+
+    auto stft = stft_algorithms::make(samp_rate, delta_t, window_size, 0, GOERTZEL, fq_low, fq_hi, nbins,
+            12300.0, decimation);
+    CPPUNIT_ASSERT_THROW(stft->set_freqs(fq_low, 25000.0), std::invalid_argument);
+    stft->set_freqs(12100.0, 12500.0);
+  }
+
   } /* namespace digitizers */
 } /* namespace gr */
 
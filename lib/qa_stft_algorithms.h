@@ -18,10 +18,18 @@ namespace gr {
     public:
       CPPUNIT_TEST_SUITE(qa_stft_algorithms);
       CPPUNIT_TEST(test_stft_fft);
+      CPPUNIT_TEST(test_sliding_goertzel);
+      CPPUNIT_TEST(test_fft_shared_engine);
+      CPPUNIT_TEST(test_auto_selection);
+      CPPUNIT_TEST(test_down_conversion);
       CPPUNIT_TEST_SUITE_END();
 
     private:
       void test_stft_fft();
+      void test_sliding_goertzel();
+      void test_fft_shared_engine();
+      void test_auto_selection();
+      void test_down_conversion();
     };
 
   } /* namespace digitizers */
@@ -13,6 +13,11 @@
 #include <gnuradio/blocks/vector_source_f.h>
 #include <gnuradio/blocks/vector_sink_f.h>
 #include <digitizers/tags.h>
+#include <gnuradio/fft/window.h>
+#include "chirp_z_spectrum.h"
+#include "goertzel_spectrum.h"
+#include <algorithm>
+#include <cmath>
 
 namespace gr {
   namespace digitizers {
@@ -73,6 +78,163 @@ namespace gr {
     CPPUNIT_ASSERT_EQUAL(size_t(100), max_i);
   }
 
+  void
+  qa_stft_goertzl_dynamic::batched_bins_reference()
+  {
+    // number of bins not a multiple of the lanes, limits changing with each window
+    auto top = gr::make_top_block("batched_bins_reference");
+    int win_size = 256;
+    double samp_rate = 10000;
+    int nbins = 37;
+    int nwins = 5;
+
+    std::vector<float> data;
+    for(int i = 0; i < win_size * nwins; i++) {
+      data.push_back(sin(2.0 * M_PI * i * 700.0 / samp_rate) + 0.25 * cos(2.0 * M_PI * i * 2100.0 / samp_rate));
+    }
+    std::vector<float> min_v, max_v;
+    for(int k = 0; k < nwins; k++) {
+      min_v.push_back(100.0 * k);
+      max_v.push_back(1000.0 + 800.0 * k);
+    }
+
+    auto src = blocks::vector_source_f::make(data, false, win_size);
+    auto min = blocks::vector_source_f::make(min_v);
+    auto max = blocks::vector_source_f::make(max_v);
+    auto snk0 = blocks::vector_sink_f::make(nbins);
+    auto snk2 = blocks::vector_sink_f::make(nbins);
+    auto stft = stft_goertzl_dynamic::make(samp_rate, win_size, nbins);
+
+    top->connect(src, 0, stft, 0);
+    top->connect(min, 0, stft, 1);
+    top->connect(max, 0, stft, 2);
+    top->connect(stft, 0, snk0, 0);
+    top->connect(stft, 2, snk2, 0);
+    top->run();
+
+    auto mag_data = snk0->data();
+    auto fqs_data = snk2->data();
+    CPPUNIT_ASSERT_EQUAL(size_t(nwins * nbins), mag_data.size());
+
+    auto window = fft::window::build(fft::window::win_type::WIN_HANN, win_size, 1.0);
+
+    // scalar recurrence, one pass per bin
+    for(int k = 0; k < nwins; k++) {
+      for(int i = 0; i < nbins; i++) {
+        double freq = min_v[k] + (static_cast<double>(i) / (nbins - 1)) * (max_v[k] - min_v[k]);
+        float w = 2.0 * M_PI * freq / samp_rate;
+        double wr = 2.0 * std::cos(w);
+        double wi = std::sin(w);
+        double d1 = 0.0, d2 = 0.0;
+        for(int j = 0; j < win_size; j++) {
+          double y = data[k * win_size + j] * window[j] + wr * d1 - d2;
+          d2 = d1;
+          d1 = y;
+        }
+        float expected = std::hypotf((0.5 * wr * d1 - d2) / win_size, (wi * d1) / win_size);
+
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(expected, mag_data.at(k * nbins + i), 1e-6);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(freq, fqs_data.at(k * nbins + i), 1e-3);
+      }
+    }
+  }
+
+  void
+  qa_stft_goertzl_dynamic::coefficient_cache()
+  {
+    // the same window for different bounds, alternating and drifting by less than the quantum
+    auto top = gr::make_top_block("coefficient_cache");
+    int win_size = 512;
+    double samp_rate = 10000;
+    int nbins = 20;
+
+    std::vector<float> window_data;
+    for(int i = 0; i < win_size; i++) {
+      window_data.push_back(sin(2.0 * M_PI * i * 1000.0 / samp_rate));
+    }
+
+    std::vector<float> min_v { 500.0f, 0.0f, 500.0f, 500.001f, 0.0f, 499.999f };
+    std::vector<float> max_v { 1500.0f, 4000.0f, 1500.0f, 1500.0f, 4000.0f, 1500.001f };
+    int nwins = min_v.size();
+
+    std::vector<float> data;
+    for(int k = 0; k < nwins; k++) {
+      data.insert(data.end(), window_data.begin(), window_data.end());
+    }
+
+    auto src = blocks::vector_source_f::make(data, false, win_size);
+    auto min = blocks::vector_source_f::make(min_v);
+    auto max = blocks::vector_source_f::make(max_v);
+    auto snk0 = blocks::vector_sink_f::make(nbins);
+    auto snk2 = blocks::vector_sink_f::make(nbins);
+    auto stft = stft_goertzl_dynamic::make(samp_rate, win_size, nbins);
+
+    top->connect(src, 0, stft, 0);
+    top->connect(min, 0, stft, 1);
+    top->connect(max, 0, stft, 2);
+    top->connect(stft, 0, snk0, 0);
+    top->connect(stft, 2, snk2, 0);
+    top->run();
+
+    auto mag_data = snk0->data();
+    auto fqs_data = snk2->data();
+    CPPUNIT_ASSERT_EQUAL(size_t(nwins * nbins), mag_data.size());
+
+    for (int k : { 2, 3, 5 }) {
+      for(int i = 0; i < nbins; i++) {
+        CPPUNIT_ASSERT_EQUAL(mag_data.at(i), mag_data.at(k * nbins + i));
+        CPPUNIT_ASSERT_EQUAL(fqs_data.at(i), fqs_data.at(k * nbins + i));
+      }
+    }
+    for(int i = 0; i < nbins; i++) {
+      CPPUNIT_ASSERT_EQUAL(mag_data.at(nbins + i), mag_data.at(4 * nbins + i));
+    }
+
+    // peak at 1000 Hz in both ranges
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(500.0, fqs_data.at(0), 1e-3);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(1500.0, fqs_data.at(nbins - 1), 1e-3);
+  }
+
+  void
+  qa_stft_goertzl_dynamic::chirp_z_reference()
+  {
+    // thousand bins are computed by the chirp-z transform, a hundred by Goertzel filters
+    CPPUNIT_ASSERT(chirp_z_spectrum_t::is_preferred(1024, 1000));
+    CPPUNIT_ASSERT(!chirp_z_spectrum_t::is_preferred(1024, 100));
+
+    int win_size = 512;
+    double samp_rate = 10000;
+    int nbins = 600;
+
+    std::vector<float> data;
+    for(int i = 0; i < win_size; i++) {
+      data.push_back(sin(2.0 * M_PI * i * 700.0 / samp_rate) + 0.25 * cos(2.0 * M_PI * i * 2100.0 / samp_rate));
+    }
+
+    auto window = fft::window::build(fft::window::win_type::WIN_HANN, win_size, 1.0);
+    goertzel_spectrum_t goertzel(samp_rate, win_size, nbins, window);
+    chirp_z_spectrum_t chirp_z(samp_rate, win_size, nbins, window);
+
+    std::vector<float> mag(nbins), phs(nbins), fqs(nbins);
+    std::vector<float> ref_mag(nbins), ref_phs(nbins), ref_fqs(nbins);
+
+    // wide and zoomed bounds, the first ones again from the cache
+    std::vector<float> min_v { 0.0f, 650.0f, 100.0f, 0.0f };
+    std::vector<float> max_v { 5000.0f, 750.0f, 2500.0f, 5000.0f };
+
+    for (size_t k = 0; k < min_v.size(); k++) {
+      goertzel.compute(&data[0], min_v[k], max_v[k], &ref_mag[0], &ref_phs[0], &ref_fqs[0]);
+      chirp_z.compute(&data[0], min_v[k], max_v[k], &mag[0], &phs[0], &fqs[0]);
+
+      const float peak = *std::max_element(ref_mag.begin(), ref_mag.end());
+      for(int i = 0; i < nbins; i++) {
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(ref_mag[i], mag[i], 1e-4 * peak);
+        CPPUNIT_ASSERT_EQUAL(ref_fqs[i], fqs[i]);
+        CPPUNIT_ASSERT_EQUAL(0.0f, phs[i]);
+      }
+    }
+  }
+
   } /* namespace digitizers */
 } /* namespace gr */
 
@@ -19,10 +19,16 @@ namespace gr {
     public:
       CPPUNIT_TEST_SUITE(qa_stft_goertzl_dynamic);
       CPPUNIT_TEST(basic_test);
+      CPPUNIT_TEST(batched_bins_reference);
+      CPPUNIT_TEST(coefficient_cache);
+      CPPUNIT_TEST(chirp_z_reference);
       CPPUNIT_TEST_SUITE_END();
 
     private:
       void basic_test();
+      void batched_bins_reference();
+      void coefficient_cache();
+      void chirp_z_reference();
     };
 
   } /* namespace digitizers */
@@ -13,6 +13,9 @@
 #include <cppunit/TestAssert.h>
 #include "qa_stft_goertzl_dynamic_decimated.h"
 #include <digitizers/stft_goertzl_dynamic_decimated.h>
+#include <digitizers/stft_goertzl_dynamic.h>
+#include <digitizers/stream_to_vector_overlay_ff.h>
+#include <digitizers/tags.h>
 #include <gnuradio/blocks/vector_source_f.h>
 #include <gnuradio/blocks/vector_sink_f.h>
 
@@ -79,6 +82,133 @@ namespace gr {
       CPPUNIT_ASSERT_EQUAL(size_t(100), max_i);
     }
 
+    void
+    qa_stft_goertzl_dynamic_decimated::in_place_framing()
+    {
+      // overlapping windows with a fractional hop, compared against the separate blocks
+      int win_size = 256;
+      double samp_rate = 10000;
+      double delta_t = 0.00375;   // 37.5 samples
+      int nbins = 30;
+
+      std::vector<float> sig_v, min_v, max_v;
+      for(int i = 0; i < 5000; i++) {
+        sig_v.push_back(sin(2.0 * M_PI * i * 800.0 / samp_rate) + 0.5 * sin(2.0 * M_PI * i * 2300.0 / samp_rate));
+        min_v.push_back(i < 2500 ? 100.0f : 500.0f);
+        max_v.push_back(i < 2500 ? 3000.0f : 2500.0f);
+      }
+
+      acq_info_t acq_info{};
+      acq_info.timestamp = 1000;
+      acq_info.timebase = 1.0 / samp_rate;
+      std::vector<gr::tag_t> tags = { make_acq_info_tag(acq_info, 0), make_acq_info_tag(acq_info, 3000) };
+
+      auto top = gr::make_top_block("in_place_framing");
+      auto src = blocks::vector_source_f::make(sig_v, false, 1, tags);
+      auto min = blocks::vector_source_f::make(min_v);
+      auto max = blocks::vector_source_f::make(max_v);
+
+      // in place
+      auto stft = stft_goertzl_dynamic_decimated::make(samp_rate, delta_t, win_size, nbins, 1);
+      auto snk0 = blocks::vector_sink_f::make(nbins);
+      auto snk2 = blocks::vector_sink_f::make(nbins);
+      top->connect(src, 0, stft, 0);
+      top->connect(min, 0, stft, 1);
+      top->connect(max, 0, stft, 2);
+      top->connect(stft, 0, snk0, 0);
+      top->connect(stft, 1, blocks::vector_sink_f::make(nbins), 0);
+      top->connect(stft, 2, snk2, 0);
+
+      // reference, framed vectors
+      auto str2vec_sig = stream_to_vector_overlay_ff::make(win_size, samp_rate, delta_t);
+      auto str2vec_min = stream_to_vector_overlay_ff::make(1, samp_rate, delta_t);
+      auto str2vec_max = stream_to_vector_overlay_ff::make(1, samp_rate, delta_t);
+      auto ref = stft_goertzl_dynamic::make(samp_rate, win_size, nbins);
+      auto ref0 = blocks::vector_sink_f::make(nbins);
+      auto ref2 = blocks::vector_sink_f::make(nbins);
+      top->connect(src, 0, str2vec_sig, 0);
+      top->connect(min, 0, str2vec_min, 0);
+      top->connect(max, 0, str2vec_max, 0);
+      top->connect(str2vec_sig, 0, ref, 0);
+      top->connect(str2vec_min, 0, ref, 1);
+      top->connect(str2vec_max, 0, ref, 2);
+      top->connect(ref, 0, ref0, 0);
+      top->connect(ref, 1, blocks::vector_sink_f::make(nbins), 0);
+      top->connect(ref, 2, ref2, 0);
+
+      top->run();
+
+      CPPUNIT_ASSERT(ref0->data().size() > 100 * size_t(nbins));
+      CPPUNIT_ASSERT(ref0->data() == snk0->data());
+      CPPUNIT_ASSERT(ref2->data() == snk2->data());
+
+      auto tags0 = snk0->tags();
+      auto ref_tags = ref0->tags();
+      CPPUNIT_ASSERT_EQUAL(ref_tags.size(), tags0.size());
+      for (size_t i = 0; i < tags0.size(); i++) {
+        CPPUNIT_ASSERT_EQUAL(ref_tags[i].offset, tags0[i].offset);
+        CPPUNIT_ASSERT_EQUAL(decode_acq_info_tag(ref_tags[i]).timestamp, decode_acq_info_tag(tags0[i]).timestamp);
+      }
+    }
+
+    void
+    qa_stft_goertzl_dynamic_decimated::decimated_bounds()
+    {
+      // bounds at a quarter of the sample rate, changing often, compared against the framers
+      int win_size = 200;
+      double samp_rate = 10000;
+      double delta_t = 0.0051;   // 51 samples, 12.75 bound samples
+      int nbins = 16;
+      int bounds_decimation = 4;
+
+      std::vector<float> sig_v, min_v, max_v;
+      for(int i = 0; i < 8000; i++) {
+        sig_v.push_back(sin(2.0 * M_PI * i * 1200.0 / samp_rate));
+      }
+      for(int i = 0; i < 2000; i++) {
+        min_v.push_back(100.0f + 10.0f * (i % 37));
+        max_v.push_back(2000.0f + 25.0f * (i % 23));
+      }
+
+      auto top = gr::make_top_block("decimated_bounds");
+      auto src = blocks::vector_source_f::make(sig_v);
+      auto min = blocks::vector_source_f::make(min_v);
+      auto max = blocks::vector_source_f::make(max_v);
+
+      auto stft = stft_goertzl_dynamic_decimated::make(samp_rate, delta_t, win_size, nbins, bounds_decimation);
+      auto snk0 = blocks::vector_sink_f::make(nbins);
+      auto snk2 = blocks::vector_sink_f::make(nbins);
+      top->connect(src, 0, stft, 0);
+      top->connect(min, 0, stft, 1);
+      top->connect(max, 0, stft, 2);
+      top->connect(stft, 0, snk0, 0);
+      top->connect(stft, 1, blocks::vector_sink_f::make(nbins), 0);
+      top->connect(stft, 2, snk2, 0);
+
+      // reference, framed vectors
+      auto str2vec_sig = stream_to_vector_overlay_ff::make(win_size, samp_rate, delta_t);
+      auto str2vec_min = stream_to_vector_overlay_ff::make(1, samp_rate / bounds_decimation, delta_t);
+      auto str2vec_max = stream_to_vector_overlay_ff::make(1, samp_rate / bounds_decimation, delta_t);
+      auto ref = stft_goertzl_dynamic::make(samp_rate, win_size, nbins);
+      auto ref0 = blocks::vector_sink_f::make(nbins);
+      auto ref2 = blocks::vector_sink_f::make(nbins);
+      top->connect(src, 0, str2vec_sig, 0);
+      top->connect(min, 0, str2vec_min, 0);
+      top->connect(max, 0, str2vec_max, 0);
+      top->connect(str2vec_sig, 0, ref, 0);
+      top->connect(str2vec_min, 0, ref, 1);
+      top->connect(str2vec_max, 0, ref, 2);
+      top->connect(ref, 0, ref0, 0);
+      top->connect(ref, 1, blocks::vector_sink_f::make(nbins), 0);
+      top->connect(ref, 2, ref2, 0);
+
+      top->run();
+
+      CPPUNIT_ASSERT(ref0->data().size() > 100 * size_t(nbins));
+      CPPUNIT_ASSERT(ref0->data() == snk0->data());
+      CPPUNIT_ASSERT(ref2->data() == snk2->data());
+    }
+
   } /* namespace digitizers */
 } /* namespace gr */
 
@@ -19,10 +19,14 @@ namespace gr {
     public:
       CPPUNIT_TEST_SUITE(qa_stft_goertzl_dynamic_decimated);
       CPPUNIT_TEST(t1);
+      CPPUNIT_TEST(in_place_framing);
+      CPPUNIT_TEST(decimated_bounds);
       CPPUNIT_TEST_SUITE_END();
 
     private:
       void t1();
+      void in_place_framing();
+      void decimated_bounds();
     };
 
   } /* namespace digitizers */
@@ -11,6 +11,7 @@
 #include <digitizers/status.h>
 #include <gnuradio/top_block.h>
 #include <gnuradio/blocks/vector_source_f.h>
+#include <gnuradio/blocks/vector_source_s.h>
 #include <gnuradio/blocks/tag_debug.h>
 
 #include "utils.h"
@@ -19,7 +20,10 @@
 #include <boost/thread.hpp>
 #include <boost/chrono.hpp>
 
+#include <algorithm>
+#include <cstdlib>
 #include <functional>
+#include <stdexcept>
 
 namespace gr {
   namespace digitizers {
@@ -111,7 +115,9 @@ namespace gr {
         std::vector<acq_info_t> acq_info_tags;
         for (auto tag : tags)
         {
-            acq_info_tags.push_back(decode_acq_info_tag(tag));
+            if (pmt::symbol_to_string(tag.key) == acq_info_tag_name) {
+                acq_info_tags.push_back(decode_acq_info_tag(tag));
+            }
         }
         tags_per_call_.push_back(acq_info_tags);
     }
@@ -263,6 +269,660 @@ namespace gr {
         }
     }
 
+    static void
+    package_callback(const sink_package_sptr &package, void *userdata)
+    {
+        auto packages = static_cast<std::vector<sink_package_sptr> *>(userdata);
+        packages->push_back(package);
+    }
+
+    /*
+     * Errors input is not connected, errors are described by constant_error tags
+     */
+    void
+    qa_time_domain_sink::stream_constant_errors()
+    {
+        size_t data_size = 300;
+        size_t package_size = 100;
+        std::vector<float> data = get_test_data(data_size);
+
+        std::vector<gr::tag_t> tags = {
+                make_constant_error_tag(0.5, 0),
+                make_constant_error_tag(0.25, 150)
+        };
+
+        // no expansion, errors are not passed to the callback
+        {
+            auto top = gr::make_top_block("test constant_error");
+            Test test(data_size);
+
+            auto source = gr::blocks::vector_source_f::make(data, false, 1, tags);
+            auto sink = time_domain_sink::make("test", "unit", 1000.0, TIME_SINK_MODE_STREAMING, package_size);
+            sink->set_callback(copy_data_callback, &test);
+
+            top->connect(source, 0, sink, 0);
+            top->run();
+
+            CPPUNIT_ASSERT_EQUAL(data_size, test.values_size_);
+            CPPUNIT_ASSERT_EQUAL(size_t(0), test.errors_size_);
+            test.check_values_equal(data);
+        }
+
+        // expanded on delivery
+        {
+            auto top = gr::make_top_block("test constant_error expansion");
+            Test test(data_size);
+
+            auto source = gr::blocks::vector_source_f::make(data, false, 1, tags);
+            auto sink = time_domain_sink::make("test", "unit", 1000.0, TIME_SINK_MODE_STREAMING, package_size);
+            sink->set_callback(copy_data_callback, &test);
+            sink->set_constant_error_expansion(true);
+
+            top->connect(source, 0, sink, 0);
+            top->run();
+
+            CPPUNIT_ASSERT_EQUAL(data_size, test.errors_size_);
+
+            std::vector<float> expected(data_size, 0.5);
+            std::fill(expected.begin() + 150, expected.end(), 0.25);
+            test.check_errors_equal(expected);
+        }
+
+        // first tag in mid-package, the package has no estimate for its first samples
+        {
+            auto top = gr::make_top_block("test constant_error mid-package");
+
+            std::vector<gr::tag_t> late_tags = {
+                    make_constant_error_tag(0.5, 50),
+                    make_constant_error_tag(0.25, 150)
+            };
+
+            auto source = gr::blocks::vector_source_f::make(data, false, 1, late_tags);
+            auto sink = time_domain_sink::make("test", "unit", 1000.0, TIME_SINK_MODE_STREAMING, package_size);
+            std::vector<sink_package_sptr> packages;
+            sink->set_package_callback(package_callback, &packages);
+            sink->set_constant_error_expansion(true);
+
+            top->connect(source, 0, sink, 0);
+            top->run();
+
+            CPPUNIT_ASSERT_EQUAL(size_t(3), packages.size());
+            CPPUNIT_ASSERT(packages[0]->errors.empty());
+
+            std::vector<float> expected(package_size, 0.5);
+            std::fill(expected.begin() + 50, expected.end(), 0.25);
+            CPPUNIT_ASSERT(expected == packages[1]->errors);
+            CPPUNIT_ASSERT(std::vector<float>(package_size, 0.25) == packages[2]->errors);
+        }
+    }
+
+    /*
+     * Packages are passed by reference and can be held after the callback returns
+     */
+    void
+    qa_time_domain_sink::stream_packages()
+    {
+        auto top = gr::make_top_block("test packages");
+
+        size_t data_size = 300;
+        size_t package_size = 100;
+        std::vector<float> data = get_test_data(data_size);
+        std::vector<float> data_errs = get_test_data(data_size, 0.01);
+
+        std::vector<gr::tag_t> tags = {
+                make_test_acq_info_tag(0, 0.001, 0.0, 0, 150)
+        };
+
+        auto source = gr::blocks::vector_source_f::make(data, false, 1, tags);
+        auto source_errs = gr::blocks::vector_source_f::make(data_errs);
+        auto sink = time_domain_sink::make("test", "unit", 1000.0, TIME_SINK_MODE_STREAMING, package_size);
+
+        // Pool is smaller than the number of packages held
+        std::vector<sink_package_sptr> packages;
+        sink->set_package_callback(package_callback, &packages, 1);
+
+        top->connect(source, 0, sink, 0);
+        top->connect(source_errs, 0, sink, 1);
+        top->run();
+
+        // flowgraph (and its buffers) is gone, packages are still valid
+        top.reset();
+        source.reset();
+        source_errs.reset();
+        sink.reset();
+
+        CPPUNIT_ASSERT_EQUAL(data_size / package_size, packages.size());
+
+        for (size_t p = 0; p < packages.size(); p++) {
+            const auto &package = packages[p];
+            CPPUNIT_ASSERT_EQUAL(p * package_size, static_cast<size_t>(package->offset));
+            CPPUNIT_ASSERT_EQUAL(package_size, package->values.size());
+            CPPUNIT_ASSERT_EQUAL(package_size, package->errors.size());
+
+            for (size_t i = 0; i < package_size; i++) {
+                CPPUNIT_ASSERT_EQUAL(data[p * package_size + i], package->values[i]);
+                CPPUNIT_ASSERT_EQUAL(data_errs[p * package_size + i], package->errors[i]);
+            }
+
+            CPPUNIT_ASSERT_EQUAL(p == 1 ? size_t(1) : size_t(0), package->tags.size());
+        }
+
+        CPPUNIT_ASSERT_EQUAL(uint64_t(150), packages[1]->tags.at(0).offset);
+    }
+
+    static void
+    slow_copy_data_callback(const float           *values,
+                 std::size_t             values_size,
+                 const float            *errors,
+                 std::size_t             errors_size,
+                 std::vector<gr::tag_t>& tags,
+                 void* userdata)
+    {
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(2));
+        copy_data_callback(values, values_size, errors, errors_size, tags, userdata);
+    }
+
+    /*
+     * Callbacks are invoked from the dispatch thread
+     */
+    void
+    qa_time_domain_sink::stream_async_dispatch()
+    {
+        size_t data_size = 2000;
+        size_t package_size = 100;
+        std::vector<float> data = get_test_data(data_size);
+
+        // blocking, all the data is delivered in order
+        {
+            auto top = gr::make_top_block("test async dispatch");
+            Test test(data_size);
+
+            auto source = gr::blocks::vector_source_f::make(data);
+            auto sink = time_domain_sink::make("test", "unit", 1000.0, TIME_SINK_MODE_STREAMING, package_size);
+            sink->set_callback(slow_copy_data_callback, &test);
+            sink->set_async_dispatch(DISPATCH_BLOCK, 2);
+
+            top->connect(source, 0, sink, 0);
+            top->run();
+
+            CPPUNIT_ASSERT_EQUAL(data_size, test.values_size_);
+            CPPUNIT_ASSERT_EQUAL(uint64_t(0), sink->get_dropped_count());
+            test.check_values_equal(data);
+        }
+
+        // slow callback doesn't throttle the flowgraph, packages are dropped instead
+        {
+            auto top = gr::make_top_block("test async dispatch drop");
+            Test test(data_size);
+
+            auto source = gr::blocks::vector_source_f::make(data);
+            auto sink = time_domain_sink::make("test", "unit", 1000.0, TIME_SINK_MODE_STREAMING, package_size);
+            sink->set_callback(slow_copy_data_callback, &test);
+            sink->set_async_dispatch(DISPATCH_DROP_NEWEST, 1);
+
+            top->connect(source, 0, sink, 0);
+            top->run();
+
+            auto delivered = test.values_size_ / package_size;
+            CPPUNIT_ASSERT(sink->get_dropped_count() > 0);
+            CPPUNIT_ASSERT_EQUAL(uint64_t(data_size / package_size), uint64_t(delivered) + sink->get_dropped_count());
+        }
+    }
+
+    /*
+     * Tags at package boundaries end up in the right package
+     */
+    void
+    qa_time_domain_sink::stream_tags_per_package()
+    {
+        auto top = gr::make_top_block("test tags per package");
+
+        size_t data_size = 400;
+        size_t package_size = 100;
+        std::vector<float> data = get_test_data(data_size);
+
+        std::vector<gr::tag_t> tags = {
+                make_test_acq_info_tag(0, 0.001, 0.0, 0, 0),
+                make_test_acq_info_tag(0, 0.001, 0.0, 0, 99),
+                make_test_acq_info_tag(0, 0.001, 0.0, 0, 100),
+                make_test_acq_info_tag(0, 0.001, 0.0, 0, 399)
+        };
+
+        auto source = gr::blocks::vector_source_f::make(data, false, 1, tags);
+        auto sink = time_domain_sink::make("test", "unit", 1000.0, TIME_SINK_MODE_STREAMING, package_size);
+
+        std::vector<sink_package_sptr> packages;
+        sink->set_package_callback(package_callback, &packages);
+
+        top->connect(source, 0, sink, 0);
+        top->run();
+
+        CPPUNIT_ASSERT_EQUAL(size_t(4), packages.size());
+        CPPUNIT_ASSERT_EQUAL(size_t(2), packages[0]->tags.size());
+        CPPUNIT_ASSERT_EQUAL(size_t(1), packages[1]->tags.size());
+        CPPUNIT_ASSERT_EQUAL(size_t(0), packages[2]->tags.size());
+        CPPUNIT_ASSERT_EQUAL(size_t(1), packages[3]->tags.size());
+
+        for (const auto &package : packages) {
+            for (const auto &tag : package->tags) {
+                CPPUNIT_ASSERT(tag.offset >= package->offset && tag.offset < package->offset + package_size);
+            }
+        }
+    }
+
+    struct batch_test_t
+    {
+        size_t batches = 0;
+        size_t max_batch = 0;
+        std::vector<float> values;
+        std::vector<float> errors;
+        std::vector<uint64_t> offsets;
+        std::vector<std::vector<gr::tag_t>> tags;
+    };
+
+    static void
+    batch_callback(const package_descriptor_t *packages, std::size_t npackages, void *userdata)
+    {
+        auto test = static_cast<batch_test_t *>(userdata);
+        test->batches++;
+        test->max_batch = std::max(test->max_batch, npackages);
+
+        for (size_t i = 0; i < npackages; i++) {
+            const auto &package = packages[i];
+            test->values.insert(test->values.end(), package.values, package.values + package.values_size);
+            test->errors.insert(test->errors.end(), package.errors, package.errors + package.errors_size);
+            test->offsets.push_back(package.offset);
+            test->tags.emplace_back(package.tags, package.tags + package.tags_size);
+        }
+    }
+
+    /*
+     * Consecutive packages are delivered at once, each one the same as with set_callback
+     */
+    void
+    qa_time_domain_sink::stream_batches()
+    {
+        auto top = gr::make_top_block("test batches");
+
+        size_t data_size = 400;
+        size_t package_size = 10;
+        std::vector<float> data = get_test_data(data_size);
+        std::vector<float> data_errs = get_test_data(data_size, 0.01);
+
+        std::vector<gr::tag_t> tags = {
+                make_test_acq_info_tag(0, 0.001, 0.0, 0, 0),
+                make_test_acq_info_tag(0, 0.001, 0.0, 0, 9),
+                make_test_acq_info_tag(0, 0.001, 0.0, 0, 10),
+                make_test_acq_info_tag(0, 0.001, 0.0, 0, 399)
+        };
+
+        auto source = gr::blocks::vector_source_f::make(data, false, 1, tags);
+        auto source_errs = gr::blocks::vector_source_f::make(data_errs);
+        auto sink = time_domain_sink::make("test", "unit", 1000.0, TIME_SINK_MODE_STREAMING, package_size);
+
+        batch_test_t test;
+        sink->set_batch_callback(batch_callback, &test, 8);
+
+        top->connect(source, 0, sink, 0);
+        top->connect(source_errs, 0, sink, 1);
+        top->run();
+
+        CPPUNIT_ASSERT_EQUAL(data_size / package_size, test.offsets.size());
+        CPPUNIT_ASSERT(test.batches >= data_size / package_size / 8);
+        CPPUNIT_ASSERT(test.max_batch <= 8);
+        ASSERT_VECTOR_EQUAL(data.begin(), data.end(), test.values.begin());
+        ASSERT_VECTOR_EQUAL(data_errs.begin(), data_errs.end(), test.errors.begin());
+
+        for (size_t i = 0; i < test.offsets.size(); i++) {
+            CPPUNIT_ASSERT_EQUAL(uint64_t(i * package_size), test.offsets[i]);
+        }
+
+        CPPUNIT_ASSERT_EQUAL(size_t(2), test.tags[0].size());
+        CPPUNIT_ASSERT_EQUAL(size_t(1), test.tags[1].size());
+        CPPUNIT_ASSERT_EQUAL(size_t(0), test.tags[2].size());
+        CPPUNIT_ASSERT_EQUAL(size_t(1), test.tags.back().size());
+        CPPUNIT_ASSERT_EQUAL(uint64_t(399), test.tags.back()[0].offset);
+
+        // Expanded errors are held by the sink until the batch is delivered
+        auto top2 = gr::make_top_block("test batches expanded errors");
+        std::vector<gr::tag_t> error_tags = {
+                make_constant_error_tag(0.5f, 0),
+                make_constant_error_tag(0.25f, 205)
+        };
+        auto source2 = gr::blocks::vector_source_f::make(data, false, 1, error_tags);
+        auto sink2 = time_domain_sink::make("test", "unit", 1000.0, TIME_SINK_MODE_STREAMING, package_size);
+        sink2->set_constant_error_expansion(true);
+
+        batch_test_t test2;
+        sink2->set_batch_callback(batch_callback, &test2);
+
+        top2->connect(source2, 0, sink2, 0);
+        top2->run();
+
+        CPPUNIT_ASSERT_EQUAL(data_size, test2.errors.size());
+        for (size_t i = 0; i < data_size; i++) {
+            CPPUNIT_ASSERT_EQUAL(i < 205 ? 0.5f : 0.25f, test2.errors[i]);
+        }
+    }
+
+    static void
+    measurement_callback(const measurement_package_sptr &measurement, void *userdata)
+    {
+        auto measurements = static_cast<std::vector<measurement_package_sptr> *>(userdata);
+        measurements->push_back(measurement);
+    }
+
+    /*
+     * Tags are decoded into the measurement info by the sink
+     */
+    void
+    qa_time_domain_sink::triggered_measurements()
+    {
+        auto top = gr::make_top_block("test measurements");
+
+        uint32_t pre_samples = 10;
+        uint32_t post_samples = 40;
+        size_t package_size = pre_samples + post_samples;
+        size_t npackages = 3;
+        std::vector<float> data = get_test_data(npackages * package_size);
+
+        // 1 ms per sample
+        std::vector<gr::tag_t> tags = {
+                make_test_acq_info_tag(1000000, 0.001, 0.1, 1<<1, 0)
+        };
+        for (size_t p = 0; p < npackages; p++) {
+            tags.push_back(make_trigger_tag(1, 5000000000 + p, p * package_size + pre_samples, 1<<3));
+        }
+
+        auto source = gr::blocks::vector_source_f::make(data, false, 1, tags);
+        auto sink = time_domain_sink::make("test", "unit", 1000.0, TIME_SINK_MODE_TRIGGERED,
+                static_cast<int>(pre_samples), static_cast<int>(post_samples));
+
+        std::vector<measurement_package_sptr> measurements;
+        sink->set_measurement_callback(measurement_callback, &measurements, 1);
+
+        top->connect(source, 0, sink, 0);
+        top->run();
+
+        CPPUNIT_ASSERT_EQUAL(npackages, measurements.size());
+
+        for (size_t p = 0; p < npackages; p++) {
+            const auto &measurement = measurements[p];
+            CPPUNIT_ASSERT_EQUAL(p * package_size, static_cast<size_t>(measurement->offset));
+            CPPUNIT_ASSERT_EQUAL(package_size, measurement->values.size());
+            CPPUNIT_ASSERT(measurement->errors.empty());
+            for (size_t i = 0; i < package_size; i++) {
+                CPPUNIT_ASSERT_EQUAL(data[p * package_size + i], measurement->values[i]);
+            }
+
+            const auto &info = measurement->info;
+            const int64_t expected_timestamp = 1000000 + static_cast<int64_t>(p * package_size) * 1000000;
+            CPPUNIT_ASSERT(std::abs(info.timestamp - expected_timestamp) <= 1);
+            CPPUNIT_ASSERT_EQUAL(int64_t(5000000000 + p), info.trigger_timestamp);
+            CPPUNIT_ASSERT_EQUAL(uint32_t{(1<<1) | (1<<3)}, info.status);
+            CPPUNIT_ASSERT_EQUAL(pre_samples, info.pre_trigger_samples);
+            CPPUNIT_ASSERT_EQUAL(post_samples, info.post_trigger_samples);
+            CPPUNIT_ASSERT_EQUAL(0.001, info.timebase);
+            CPPUNIT_ASSERT_EQUAL(0.1, info.user_delay);
+            CPPUNIT_ASSERT_EQUAL(uint64_t{0}, info.samples_lost);
+        }
+    }
+
+    static void
+    slow_measurement_callback(const measurement_package_sptr &measurement, void *userdata)
+    {
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(2));
+        measurement_callback(measurement, userdata);
+    }
+
+    /*
+     * A slow consumer gets a decimated stream, the gaps are reported as samples lost
+     */
+    void
+    qa_time_domain_sink::stream_adaptive_dispatch()
+    {
+        auto top = gr::make_top_block("test adaptive dispatch");
+
+        size_t package_size = 100;
+        size_t npackages = 200;
+        std::vector<float> data = get_test_data(npackages * package_size);
+
+        auto source = gr::blocks::vector_source_f::make(data);
+        auto sink = time_domain_sink::make("test", "unit", 1000.0, TIME_SINK_MODE_STREAMING, package_size);
+
+        std::vector<measurement_package_sptr> measurements;
+        sink->set_measurement_callback(slow_measurement_callback, &measurements);
+        sink->set_async_dispatch(DISPATCH_ADAPTIVE, 4);
+
+        top->connect(source, 0, sink, 0);
+        top->run();
+
+        CPPUNIT_ASSERT(sink->get_dropped_count() > 0);
+        CPPUNIT_ASSERT(sink->get_delivery_decimation() > 1);
+        CPPUNIT_ASSERT_EQUAL(uint64_t(npackages), uint64_t(measurements.size()) + sink->get_dropped_count());
+
+        // Every package skipped is accounted for by the next measurement delivered
+        uint64_t expected_offset = 0;
+        for (const auto &measurement : measurements) {
+            CPPUNIT_ASSERT_EQUAL(expected_offset + measurement->info.samples_lost, measurement->offset);
+            CPPUNIT_ASSERT_EQUAL(data[measurement->offset], measurement->values[0]);
+            expected_offset = measurement->offset + package_size;
+        }
+    }
+
+    /*
+     * A slow consumer with the drop oldest policy, the packages evicted from the queue are
+     * reported as samples lost by the measurement delivered next
+     */
+    void
+    qa_time_domain_sink::stream_drop_oldest_dispatch()
+    {
+        auto top = gr::make_top_block("test drop oldest dispatch");
+
+        size_t package_size = 100;
+        size_t npackages = 200;
+        std::vector<float> data = get_test_data(npackages * package_size);
+
+        auto source = gr::blocks::vector_source_f::make(data);
+        auto sink = time_domain_sink::make("test", "unit", 1000.0, TIME_SINK_MODE_STREAMING, package_size);
+
+        std::vector<measurement_package_sptr> measurements;
+        sink->set_measurement_callback(slow_measurement_callback, &measurements);
+        sink->set_async_dispatch(DISPATCH_DROP_OLDEST, 4);
+
+        top->connect(source, 0, sink, 0);
+        top->run();
+
+        CPPUNIT_ASSERT(sink->get_dropped_count() > 0);
+        CPPUNIT_ASSERT_EQUAL(uint64_t(npackages), uint64_t(measurements.size()) + sink->get_dropped_count());
+
+        uint64_t expected_offset = 0, samples_lost = 0;
+        for (const auto &measurement : measurements) {
+            CPPUNIT_ASSERT_EQUAL(expected_offset + measurement->info.samples_lost, measurement->offset);
+            CPPUNIT_ASSERT_EQUAL(data[measurement->offset], measurement->values[0]);
+            expected_offset = measurement->offset + package_size;
+            samples_lost += measurement->info.samples_lost;
+        }
+
+        // The newest package is never evicted
+        CPPUNIT_ASSERT_EQUAL(uint64_t(npackages * package_size), expected_offset);
+        CPPUNIT_ASSERT_EQUAL(sink->get_dropped_count() * package_size, samples_lost);
+    }
+
+    /*
+     * Display reduction, first, min, max and last sample of each bucket and their errors
+     */
+    void
+    qa_time_domain_sink::triggered_display_reduction()
+    {
+        auto top = gr::make_top_block("test display reduction");
+
+        uint32_t pre_samples = 100;
+        uint32_t post_samples = 900;
+        size_t package_size = pre_samples + post_samples;
+        size_t npackages = 3;
+        size_t bucket_size = 100;
+
+        std::vector<float> data, errors;
+        for (size_t i = 0; i < npackages * package_size; i++) {
+            data.push_back(static_cast<float>((i * 37) % 101) - 50.0f);
+            errors.push_back(static_cast<float>(i));
+        }
+
+        auto source = gr::blocks::vector_source_f::make(data);
+        auto source_errs = gr::blocks::vector_source_f::make(errors);
+        auto sink = time_domain_sink::make("test", "unit", 1000.0, TIME_SINK_MODE_TRIGGERED,
+                static_cast<int>(pre_samples), static_cast<int>(post_samples));
+
+        // not worth it for four samples per bucket
+        sink->set_display_reduction(package_size);
+        CPPUNIT_ASSERT_EQUAL(size_t{1}, sink->get_display_bucket_size());
+
+        sink->set_display_reduction(4 * package_size / bucket_size + 3);
+        CPPUNIT_ASSERT_EQUAL(bucket_size, sink->get_display_bucket_size());
+
+        std::vector<measurement_package_sptr> measurements;
+        sink->set_measurement_callback(measurement_callback, &measurements);
+
+        top->connect(source, 0, sink, 0);
+        top->connect(source_errs, 0, sink, 1);
+        top->run();
+
+        CPPUNIT_ASSERT_EQUAL(npackages, measurements.size());
+
+        for (size_t p = 0; p < npackages; p++) {
+            const auto &measurement = measurements[p];
+            CPPUNIT_ASSERT_EQUAL(p * package_size, static_cast<size_t>(measurement->offset));
+            CPPUNIT_ASSERT_EQUAL(4 * package_size / bucket_size, measurement->values.size());
+            CPPUNIT_ASSERT_EQUAL(measurement->values.size(), measurement->errors.size());
+            CPPUNIT_ASSERT_EQUAL(pre_samples, measurement->info.pre_trigger_samples);
+
+            for (size_t b = 0; b < package_size / bucket_size; b++) {
+                auto first = data.begin() + p * package_size + b * bucket_size;
+                auto last = first + bucket_size - 1;
+                auto min = std::min_element(first, last + 1);
+                auto max = std::max_element(first, last + 1);
+
+                CPPUNIT_ASSERT_EQUAL(*first, measurement->values[4 * b]);
+                CPPUNIT_ASSERT_EQUAL(*min, measurement->values[4 * b + 1]);
+                CPPUNIT_ASSERT_EQUAL(*max, measurement->values[4 * b + 2]);
+                CPPUNIT_ASSERT_EQUAL(*last, measurement->values[4 * b + 3]);
+
+                CPPUNIT_ASSERT_EQUAL(errors[first - data.begin()], measurement->errors[4 * b]);
+                CPPUNIT_ASSERT_EQUAL(errors[min - data.begin()], measurement->errors[4 * b + 1]);
+                CPPUNIT_ASSERT_EQUAL(errors[max - data.begin()], measurement->errors[4 * b + 2]);
+                CPPUNIT_ASSERT_EQUAL(errors[last - data.begin()], measurement->errors[4 * b + 3]);
+            }
+        }
+    }
+
+    /*
+     * Raw input is converted with the raw_scaling tags, their error estimate is used as
+     * constant error
+     */
+    void
+    qa_time_domain_sink::stream_raw_input()
+    {
+        auto top = gr::make_top_block("test raw input");
+
+        size_t package_size = 100;
+        size_t npackages = 3;
+
+        std::vector<int16_t> data;
+        for (size_t i = 0; i < npackages * package_size; i++) {
+            data.push_back(static_cast<int16_t>(i) - 150);
+        }
+
+        // the second scaling starts within the second package
+        const uint64_t change = package_size + 10;
+        std::vector<gr::tag_t> tags = {
+            make_raw_scaling_tag(raw_scaling_t{0.001, 0.5, 0.01}, 0),
+            make_raw_scaling_tag(raw_scaling_t{0.002, 0.0, 0.02}, change)
+        };
+
+        auto source = gr::blocks::vector_source_s::make(data, false, 1, tags);
+        auto sink = time_domain_sink::make("test", "unit", 1000.0, TIME_SINK_MODE_STREAMING, package_size, true);
+        sink->set_constant_error_expansion(true);
+
+        std::vector<measurement_package_sptr> measurements;
+        sink->set_measurement_callback(measurement_callback, &measurements);
+
+        top->connect(source, 0, sink, 0);
+        top->run();
+
+        CPPUNIT_ASSERT_EQUAL(npackages, measurements.size());
+
+        for (size_t p = 0; p < npackages; p++) {
+            const auto &measurement = measurements[p];
+            CPPUNIT_ASSERT_EQUAL(package_size, measurement->values.size());
+            CPPUNIT_ASSERT_EQUAL(package_size, measurement->errors.size());
+
+            for (size_t i = 0; i < package_size; i++) {
+                const auto offset = p * package_size + i;
+                const bool first = offset < change;
+                CPPUNIT_ASSERT_DOUBLES_EQUAL(first ? data[offset] * 0.001 + 0.5 : data[offset] * 0.002,
+                        measurement->values[i], 1e-5);
+                CPPUNIT_ASSERT_DOUBLES_EQUAL(first ? 0.01 : 0.02, measurement->errors[i], 1e-6);
+            }
+        }
+    }
+
+    /*
+     * Windows are kept without any callback, late clients look them up by trigger timestamp
+     */
+    void
+    qa_time_domain_sink::triggered_history()
+    {
+        auto top = gr::make_top_block("test history");
+
+        uint32_t pre_samples = 10;
+        uint32_t post_samples = 40;
+        size_t package_size = pre_samples + post_samples;
+        size_t npackages = 5;
+        std::vector<float> data = get_test_data(npackages * package_size);
+
+        std::vector<gr::tag_t> tags = {
+                make_test_acq_info_tag(1000000, 0.001, 0.1, 0, 0)
+        };
+        for (size_t p = 0; p < npackages; p++) {
+            tags.push_back(make_trigger_tag(1, 5000000000 + p, p * package_size + pre_samples, 0));
+        }
+
+        auto streaming = time_domain_sink::make("test", "unit", 1000.0, TIME_SINK_MODE_STREAMING, package_size);
+        CPPUNIT_ASSERT_THROW(streaming->set_trigger_history(3), std::invalid_argument);
+
+        auto source = gr::blocks::vector_source_f::make(data, false, 1, tags);
+        auto sink = time_domain_sink::make("test", "unit", 1000.0, TIME_SINK_MODE_TRIGGERED,
+                static_cast<int>(pre_samples), static_cast<int>(post_samples));
+        sink->set_trigger_history(3);
+        sink->set_display_reduction(10);
+
+        top->connect(source, 0, sink, 0);
+        top->run();
+
+        // Oldest windows dropped out, the kept ones are in full
+        CPPUNIT_ASSERT(!sink->get_trigger_window(5000000001));
+        auto window = sink->get_trigger_window(5000000003);
+        CPPUNIT_ASSERT(window);
+        CPPUNIT_ASSERT_EQUAL(3 * package_size, static_cast<size_t>(window->offset));
+        CPPUNIT_ASSERT_EQUAL(package_size, window->values.size());
+        for (size_t i = 0; i < package_size; i++) {
+            CPPUNIT_ASSERT_EQUAL(data[3 * package_size + i], window->values[i]);
+        }
+        CPPUNIT_ASSERT_EQUAL(pre_samples, window->info.pre_trigger_samples);
+
+        auto missed = sink->get_trigger_windows_since(5000000002);
+        CPPUNIT_ASSERT_EQUAL(size_t(2), missed.size());
+        CPPUNIT_ASSERT_EQUAL(int64_t(5000000003), missed[0]->info.trigger_timestamp);
+        CPPUNIT_ASSERT_EQUAL(int64_t(5000000004), missed[1]->info.trigger_timestamp);
+        CPPUNIT_ASSERT_EQUAL(size_t(3), sink->get_trigger_windows_since(-1).size());
+
+        // Shrinking keeps the newest
+        sink->set_trigger_history(1);
+        missed = sink->get_trigger_windows_since(-1);
+        CPPUNIT_ASSERT_EQUAL(size_t(1), missed.size());
+        CPPUNIT_ASSERT_EQUAL(int64_t(5000000004), missed[0]->info.trigger_timestamp);
+    }
+
   } /* namespace digitizers */
 } /* namespace gr */
-
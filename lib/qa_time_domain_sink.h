@@ -62,6 +62,17 @@ namespace gr {
       CPPUNIT_TEST(stream_values);
       CPPUNIT_TEST(stream_no_callback);
       CPPUNIT_TEST(stream_acq_info_tag);
+      CPPUNIT_TEST(stream_constant_errors);
+      CPPUNIT_TEST(stream_packages);
+      CPPUNIT_TEST(stream_async_dispatch);
+      CPPUNIT_TEST(stream_tags_per_package);
+      CPPUNIT_TEST(stream_batches);
+      CPPUNIT_TEST(triggered_measurements);
+      CPPUNIT_TEST(stream_adaptive_dispatch);
+      CPPUNIT_TEST(stream_drop_oldest_dispatch);
+      CPPUNIT_TEST(triggered_display_reduction);
+      CPPUNIT_TEST(stream_raw_input);
+      CPPUNIT_TEST(triggered_history);
       CPPUNIT_TEST_SUITE_END();
 
     private:
@@ -70,6 +81,17 @@ namespace gr {
       void stream_values();
       void stream_no_callback();
       void stream_acq_info_tag();
+      void stream_constant_errors();
+      void stream_packages();
+      void stream_async_dispatch();
+      void stream_tags_per_package();
+      void stream_batches();
+      void triggered_measurements();
+      void stream_adaptive_dispatch();
+      void stream_drop_oldest_dispatch();
+      void triggered_display_reduction();
+      void stream_raw_input();
+      void triggered_history();
     };
 
   } /* namespace digitizers */
@@ -12,6 +12,8 @@
 #include <digitizers/time_realignment_ff.h>
 #include <digitizers/status.h>
 #include "utils.h"
+#include "wr_event_store.h"
+#include "trigger_realigner.h"
 #include <digitizers/tags.h>
 #include <gnuradio/blocks/vector_source_f.h>
 #include <gnuradio/blocks/vector_sink_f.h>
@@ -38,7 +40,8 @@ namespace gr {
       std::vector<float> values;
       std::vector<float> errors;
 
-      realignment_test_flowgraph_t (float user_delay, float triggerstamp_matching_tolerance, float buffer_time, const std::vector<tag_t> &tags, const std::vector<sim_wr_event_t> &wr_events, size_t data_size=33333)
+      realignment_test_flowgraph_t (float user_delay, float triggerstamp_matching_tolerance, float buffer_time, const std::vector<tag_t> &tags, const std::vector<sim_wr_event_t> &wr_events, size_t data_size=33333,
+              bool streaming=false)
       {
         values = make_test_data(data_size);
         errors = make_test_data(data_size, 0.2);
@@ -46,7 +49,7 @@ namespace gr {
         top = gr::make_top_block("test");
         value_src = gr::blocks::vector_source_f::make(values, false, 1, tags);
         error_src = gr::blocks::vector_source_f::make(errors);
-        realign = gr::digitizers::time_realignment_ff::make("id", user_delay, triggerstamp_matching_tolerance, buffer_time);
+        realign = gr::digitizers::time_realignment_ff::make("id", user_delay, triggerstamp_matching_tolerance, buffer_time, streaming);
         for(auto event : wr_events)
             realign->add_timing_event(event.event_id, event.wr_trigger_stamp, event.wr_trigger_stamp_utc);
 
@@ -303,6 +306,180 @@ namespace gr {
         CPPUNIT_ASSERT_EQUAL(trigger_tag_data1.status, uint32_t(channel_status_t::CHANNEL_STATUS_TIMEOUT_WAITING_WR_OR_REALIGNMENT_EVENT));
     }
 
+    void
+    qa_time_realignment_ff::streaming()
+    {
+      trigger_t trigger;
+      trigger.downsampling_factor = 1;
+      trigger.status = 0;
+
+      std::vector<gr::tag_t> tags;
+      trigger.timestamp = 1000000;
+      tags.push_back(make_trigger_tag(trigger, 100));
+      trigger.timestamp = 2000000;
+      tags.push_back(make_trigger_tag(trigger, 5000));
+
+      // second trigger has no WR event within the tolerance
+      std::vector<sim_wr_event_t> wr_events = {{"event1", 1000037, 1000010}, {"event2", 9000037, 9000010}};
+
+      realignment_test_flowgraph_t flowgraph(0.0, 0.001, 0.1, tags, wr_events, 10000, true);
+      flowgraph.run();
+      flowgraph.verify_values();
+
+      std::vector<gr::tag_t> triggers, realignments;
+      for (const auto &tag : flowgraph.tags()) {
+        if (get_tag_kind(tag) == TAG_KIND_TRIGGER) {
+          triggers.push_back(tag);
+        }
+        else if (get_tag_kind(tag) == TAG_KIND_REALIGNMENT) {
+          realignments.push_back(tag);
+        }
+      }
+
+      // triggers are forwarded as they are
+      CPPUNIT_ASSERT_EQUAL(size_t {2}, triggers.size());
+      CPPUNIT_ASSERT_EQUAL(int64_t {1000000}, decode_trigger_tag(triggers.at(0)).timestamp);
+
+      CPPUNIT_ASSERT_EQUAL(size_t {2}, realignments.size());
+      auto realignment = decode_realignment_tag(realignments.at(0));
+      CPPUNIT_ASSERT_EQUAL(uint64_t {100}, realignment.trigger_offset);
+      CPPUNIT_ASSERT_EQUAL(int64_t {1000037}, realignment.timestamp);
+      CPPUNIT_ASSERT_EQUAL(uint32_t {0}, realignment.status);
+
+      realignment = decode_realignment_tag(realignments.at(1));
+      CPPUNIT_ASSERT_EQUAL(uint64_t {5000}, realignment.trigger_offset);
+      CPPUNIT_ASSERT_EQUAL(int64_t {2000000}, realignment.timestamp);
+      CPPUNIT_ASSERT_EQUAL(uint32_t(channel_status_t::CHANNEL_STATUS_TIMEOUT_WAITING_WR_OR_REALIGNMENT_EVENT), realignment.status);
+    }
+
+    void
+    qa_time_realignment_ff::streaming_channel_delay()
+    {
+      trigger_t trigger;
+      trigger.downsampling_factor = 1;
+      trigger.status = 0;
+
+      // the channel is 1.5 us late, the latest estimate applies
+      channel_delay_t channel_delay;
+      channel_delay.correlation = 0.9f;
+      std::vector<gr::tag_t> tags;
+      channel_delay.delay = 3e-6;
+      tags.push_back(make_channel_delay_tag(channel_delay, 0));
+      channel_delay.delay = 1.5e-6;
+      tags.push_back(make_channel_delay_tag(channel_delay, 50));
+      trigger.timestamp = 1000000;
+      tags.push_back(make_trigger_tag(trigger, 100));
+
+      std::vector<sim_wr_event_t> wr_events = {{"event1", 1000037, 1000010}};
+
+      realignment_test_flowgraph_t flowgraph(0.0, 0.001, 0.1, tags, wr_events, 1000, true);
+      flowgraph.run();
+      flowgraph.verify_values();
+
+      std::vector<gr::tag_t> realignments, channel_delays;
+      for (const auto &tag : flowgraph.tags()) {
+        if (get_tag_kind(tag) == TAG_KIND_REALIGNMENT) {
+          realignments.push_back(tag);
+        }
+        else if (get_tag_kind(tag) == TAG_KIND_CHANNEL_DELAY) {
+          channel_delays.push_back(tag);
+        }
+      }
+
+      // channel delay tags are forwarded
+      CPPUNIT_ASSERT_EQUAL(size_t {2}, channel_delays.size());
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(1.5e-6, flowgraph.realign->get_channel_delay(), 1e-12);
+
+      CPPUNIT_ASSERT_EQUAL(size_t {1}, realignments.size());
+      auto realignment = decode_realignment_tag(realignments.at(0));
+      CPPUNIT_ASSERT_EQUAL(uint64_t {100}, realignment.trigger_offset);
+      CPPUNIT_ASSERT_EQUAL(int64_t {1000037 - 1500}, realignment.timestamp);
+      CPPUNIT_ASSERT_EQUAL(uint32_t {0}, realignment.status);
+    }
+
+    void
+    qa_time_realignment_ff::event_store()
+    {
+      wr_event_store_t store(4);
+      wr_event_t event;
+
+      CPPUNIT_ASSERT(wr_event_store_t::match_result_t::PENDING == store.match(1000, 10, event));
+
+      // out of order arrival
+      for (int64_t stamp : {1000, 3000, 2000, 4000}) {
+        event.event_id = std::to_string(stamp);
+        event.wr_trigger_stamp = stamp + 37;
+        event.wr_trigger_stamp_utc = stamp;
+        CPPUNIT_ASSERT_EQUAL(false, store.add(event));
+      }
+
+      CPPUNIT_ASSERT(wr_event_store_t::match_result_t::MATCHED == store.match(2005, 10, event));
+      CPPUNIT_ASSERT_EQUAL(int64_t {2037}, event.wr_trigger_stamp);
+      CPPUNIT_ASSERT_EQUAL(uint64_t {1}, store.stale());
+      CPPUNIT_ASSERT_EQUAL(size_t {2}, store.size());
+
+      // newer event exists, but not within tolerance
+      CPPUNIT_ASSERT(wr_event_store_t::match_result_t::NO_MATCH == store.match(2500, 10, event));
+      CPPUNIT_ASSERT_EQUAL(size_t {2}, store.size());
+
+      CPPUNIT_ASSERT(wr_event_store_t::match_result_t::MATCHED == store.match(3995, 10, event));
+      CPPUNIT_ASSERT_EQUAL(std::string("4000"), event.event_id);
+      CPPUNIT_ASSERT_EQUAL(uint64_t {2}, store.stale());
+      CPPUNIT_ASSERT(wr_event_store_t::match_result_t::PENDING == store.match(5000, 10, event));
+
+      // the oldest event is evicted when full
+      for (int64_t stamp = 6000; stamp < 6005; stamp++) {
+        event.wr_trigger_stamp_utc = stamp;
+        store.add(event);
+      }
+      CPPUNIT_ASSERT_EQUAL(uint64_t {1}, store.evicted());
+      CPPUNIT_ASSERT(wr_event_store_t::match_result_t::NO_MATCH == store.match(6000, 0, event));
+      CPPUNIT_ASSERT(wr_event_store_t::match_result_t::MATCHED == store.match(6001, 0, event));
+      CPPUNIT_ASSERT_EQUAL(int64_t {6001}, event.wr_trigger_stamp_utc);
+    }
+
+    void
+    qa_time_realignment_ff::realigner()
+    {
+      trigger_realigner_t realigner(8);
+      realigner.set_tolerance(10);
+      realigner.set_max_buffer_time(100);
+
+      wr_event_t event;
+      event.wr_trigger_stamp = 42;
+      event.wr_trigger_stamp_utc = 1000;
+      CPPUNIT_ASSERT(realigner.add_event(event));
+
+      trigger_t trigger{};
+      trigger.timestamp = 1005;
+      realigner.add_trigger(5, trigger, 0);
+      trigger.timestamp = 2000;
+      realigner.add_trigger(9, trigger, 0);
+
+      // the second trigger waits for its event...
+      std::vector<std::pair<realignment_t, bool>> resolved;
+      auto collect = [&](const realignment_t &realignment, bool timed_out) {
+        resolved.emplace_back(realignment, timed_out);
+      };
+      realigner.realign(50, collect);
+      CPPUNIT_ASSERT_EQUAL(size_t {1}, resolved.size());
+      CPPUNIT_ASSERT_EQUAL(uint64_t {5}, resolved[0].first.trigger_offset);
+      CPPUNIT_ASSERT_EQUAL(int64_t {42}, resolved[0].first.timestamp);
+      CPPUNIT_ASSERT_EQUAL(uint32_t {0}, resolved[0].first.status);
+      CPPUNIT_ASSERT(!resolved[0].second);
+      CPPUNIT_ASSERT_EQUAL(size_t {1}, realigner.pending());
+
+      // ...up to max_buffer_time
+      realigner.realign(101, collect);
+      CPPUNIT_ASSERT_EQUAL(size_t {2}, resolved.size());
+      CPPUNIT_ASSERT_EQUAL(uint64_t {9}, resolved[1].first.trigger_offset);
+      CPPUNIT_ASSERT_EQUAL(int64_t {2000}, resolved[1].first.timestamp);
+      CPPUNIT_ASSERT_EQUAL(uint32_t {channel_status_t::CHANNEL_STATUS_TIMEOUT_WAITING_WR_OR_REALIGNMENT_EVENT},
+              resolved[1].first.status);
+      CPPUNIT_ASSERT(resolved[1].second);
+      CPPUNIT_ASSERT_EQUAL(size_t {0}, realigner.pending());
+    }
+
   } /* namespace digitizers */
 } /* namespace gr */
 
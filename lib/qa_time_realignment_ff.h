@@ -26,6 +26,10 @@ namespace gr {
 //      CPPUNIT_TEST(no_wr_events);
 //      CPPUNIT_TEST(out_of_tolerance_1);
 //      CPPUNIT_TEST(out_of_tolerance_2);
+      CPPUNIT_TEST(streaming);
+      CPPUNIT_TEST(streaming_channel_delay);
+      CPPUNIT_TEST(event_store);
+      CPPUNIT_TEST(realigner);
 
       CPPUNIT_TEST_SUITE_END();
 
@@ -35,6 +39,10 @@ namespace gr {
       void no_wr_events();
       void out_of_tolerance_1();
       void out_of_tolerance_2();
+      void streaming();
+      void streaming_channel_delay();
+      void event_store();
+      void realigner();
     };
 
   } /* namespace digitizers */
@@ -0,0 +1,180 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#include <gnuradio/attributes.h>
+#include <cppunit/TestAssert.h>
+#include "qa_trigger_averager_ff.h"
+#include <digitizers/trigger_averager_ff.h>
+#include <digitizers/tags.h>
+#include <gnuradio/blocks/vector_source_f.h>
+#include <gnuradio/blocks/vector_sink_f.h>
+#include <gnuradio/top_block.h>
+
+#include <cmath>
+#include <stdexcept>
+
+namespace gr {
+ namespace digitizers {
+
+    // Repetitive signal with a deterministic disturbance
+    static std::vector<float>
+    make_repetitive_data(size_t size, int period)
+    {
+      std::vector<float> data;
+      for (size_t i = 0; i < size; i++) {
+        const float noise = static_cast<float>((i * 7919) % 101) / 100.0f - 0.5f;
+        data.push_back(std::sin(2.0 * M_PI * (i % period) / period) + noise);
+      }
+      return data;
+    }
+
+    struct averager_test_result_t
+    {
+      std::vector<float> values;
+      std::vector<float> stddev;
+      std::vector<gr::tag_t> tags;
+    };
+
+    static averager_test_result_t
+    run_averager(const std::vector<float> &values, const std::vector<gr::tag_t> &tags,
+            unsigned pre_trigger_window, unsigned post_trigger_window, int nr_windows, double alpha)
+    {
+      auto top = gr::make_top_block("test");
+      auto src = gr::blocks::vector_source_f::make(values, false, 1, tags);
+      auto averager = trigger_averager_ff::make(post_trigger_window, pre_trigger_window, nr_windows, alpha);
+      auto value_sink = gr::blocks::vector_sink_f::make();
+      auto stddev_sink = gr::blocks::vector_sink_f::make();
+
+      top->connect(src, 0, averager, 0);
+      top->connect(averager, 0, value_sink, 0);
+      top->connect(averager, 1, stddev_sink, 0);
+      top->run();
+
+      return averager_test_result_t {value_sink->data(), stddev_sink->data(), value_sink->tags()};
+    }
+
+    void
+    qa_trigger_averager_ff::test_plain_average()
+    {
+      const unsigned pre = 50;
+      const unsigned post = 200;
+      const unsigned window_size = pre + post;
+      const int period = 500;
+      const int nr_windows = 4;
+      const int nr_triggers = 9;  // the last one is not output
+
+      auto values = make_repetitive_data(period * (nr_triggers + 2), period);
+
+      acq_info_t acq_info {};
+      std::vector<gr::tag_t> tags;
+      std::vector<uint64_t> triggers;
+      for (int t = 0; t < nr_triggers; t++) {
+        triggers.push_back(period + t * period);
+        tags.push_back(make_trigger_tag(triggers.back()));
+      }
+      acq_info.status = 0x2;
+      tags.push_back(make_acq_info_tag(acq_info, triggers[1] + 10));
+      acq_info.status = 0;
+      tags.push_back(make_acq_info_tag(acq_info, triggers[3] + 10));
+
+      auto result = run_averager(values, tags, pre, post, nr_windows, 0.0);
+
+      CPPUNIT_ASSERT_EQUAL(size_t(2 * window_size), result.values.size());
+      CPPUNIT_ASSERT_EQUAL(size_t(2 * window_size), result.stddev.size());
+
+      for (int w = 0; w < 2; w++) {
+        for (unsigned i = 0; i < window_size; i++) {
+          double sum = 0.0;
+          for (int k = 0; k < nr_windows; k++) {
+            sum += values[triggers[w * nr_windows + k] - pre + i];
+          }
+          const double mean = sum / nr_windows;
+
+          double squares = 0.0;
+          for (int k = 0; k < nr_windows; k++) {
+            const double d = values[triggers[w * nr_windows + k] - pre + i] - mean;
+            squares += d * d;
+          }
+
+          CPPUNIT_ASSERT_DOUBLES_EQUAL(mean, result.values[w * window_size + i], 1e-5);
+          CPPUNIT_ASSERT_DOUBLES_EQUAL(std::sqrt(squares / (nr_windows - 1)),
+                  result.stddev[w * window_size + i], 1e-4);
+        }
+      }
+
+      // Trigger tags on the trigger samples, the status of the first average includes the
+      // status of the second window
+      int nr_triggers_out = 0;
+      std::vector<uint32_t> statuses;
+      for (const auto &tag : result.tags) {
+        if (tag.key == trigger_tag_key()) {
+          CPPUNIT_ASSERT_EQUAL(uint64_t(nr_triggers_out * window_size + pre), tag.offset);
+          nr_triggers_out++;
+        }
+        else if (tag.key == acq_info_tag_key()) {
+          CPPUNIT_ASSERT_EQUAL(uint64_t(0), tag.offset % window_size);
+          statuses.push_back(decode_acq_info_tag(tag).status);
+        }
+      }
+      CPPUNIT_ASSERT_EQUAL(2, nr_triggers_out);
+      CPPUNIT_ASSERT_EQUAL(size_t(2), statuses.size());
+      CPPUNIT_ASSERT_EQUAL(uint32_t(0x2), statuses[0]);
+      CPPUNIT_ASSERT_EQUAL(uint32_t(0), statuses[1]);
+    }
+
+    void
+    qa_trigger_averager_ff::test_exponential_average()
+    {
+      const unsigned pre = 50;
+      const unsigned post = 200;
+      const unsigned window_size = pre + post;
+      const double alpha = 0.25;
+      const int spacing = 150;  // overlapping windows
+      const int nr_triggers = 20;
+
+      auto values = make_repetitive_data(spacing * (nr_triggers + 4), spacing);
+
+      std::vector<gr::tag_t> tags;
+      std::vector<uint64_t> triggers;
+      for (int t = 0; t < nr_triggers; t++) {
+        triggers.push_back(spacing + t * spacing);
+        tags.push_back(make_trigger_tag(triggers.back()));
+      }
+
+      auto result = run_averager(values, tags, pre, post, 1, alpha);
+
+      // An averaged window per trigger
+      CPPUNIT_ASSERT_EQUAL(size_t(nr_triggers * window_size), result.values.size());
+
+      std::vector<double> mean(window_size), var(window_size, 0.0);
+      for (int t = 0; t < nr_triggers; t++) {
+        for (unsigned i = 0; i < window_size; i++) {
+          const double x = values[triggers[t] - pre + i];
+          if (t == 0) {
+            mean[i] = x;
+          }
+          else {
+            const double delta = x - mean[i];
+            mean[i] += alpha * delta;
+            var[i] = (1.0 - alpha) * (var[i] + alpha * delta * delta);
+          }
+
+          CPPUNIT_ASSERT_DOUBLES_EQUAL(mean[i], result.values[t * window_size + i], 1e-5);
+          CPPUNIT_ASSERT_DOUBLES_EQUAL(std::sqrt(var[i]), result.stddev[t * window_size + i], 1e-4);
+        }
+      }
+    }
+
+    void
+    qa_trigger_averager_ff::test_invalid_arguments()
+    {
+      CPPUNIT_ASSERT_THROW(trigger_averager_ff::make(0, 0), std::invalid_argument);
+      CPPUNIT_ASSERT_THROW(trigger_averager_ff::make(100, 10, 0), std::invalid_argument);
+      CPPUNIT_ASSERT_THROW(trigger_averager_ff::make(100, 10, 4, 1.5), std::invalid_argument);
+    }
+
+ } /* namespace digitizers */
+} /* namespace gr */
@@ -0,0 +1,35 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+
+#ifndef _QA_TRIGGER_AVERAGER_FF_H_
+#define _QA_TRIGGER_AVERAGER_FF_H_
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/TestCase.h>
+
+namespace gr {
+  namespace digitizers {
+
+    class qa_trigger_averager_ff : public CppUnit::TestCase
+    {
+    public:
+      CPPUNIT_TEST_SUITE(qa_trigger_averager_ff);
+      CPPUNIT_TEST(test_plain_average);
+      CPPUNIT_TEST(test_exponential_average);
+      CPPUNIT_TEST(test_invalid_arguments);
+      CPPUNIT_TEST_SUITE_END();
+
+    private:
+      void test_plain_average();
+      void test_exponential_average();
+      void test_invalid_arguments();
+    };
+
+  } /* namespace digitizers */
+} /* namespace gr */
+
+#endif /* _QA_TRIGGER_AVERAGER_FF_H_ */
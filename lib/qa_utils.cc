@@ -0,0 +1,199 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+
+#include <gnuradio/attributes.h>
+#include <cppunit/TestAssert.h>
+#include "qa_utils.h"
+#include "utils.h"
+#include "event_log.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace gr {
+  namespace digitizers {
+
+    void
+    qa_utils::median_filter_reference()
+    {
+      srand(7);
+
+      for (int n : {1, 2, 3, 4, 5, 16, 101, 255}) {
+        median_filter<int64_t> filter(n);
+        std::deque<int64_t> window(n, 0);
+
+        for (int i = 0; i < 5000; i++) {
+          // duplicates are likely, values beyond float precision
+          const int64_t value = (int64_t(1) << 40) + rand() % 50;
+          window.push_back(value);
+          window.pop_front();
+
+          std::vector<int64_t> sorted(window.begin(), window.end());
+          std::sort(sorted.begin(), sorted.end());
+
+          CPPUNIT_ASSERT_EQUAL(sorted[(n - 1) / 2], filter.add(value));
+        }
+      }
+    }
+
+    void
+    qa_utils::spsc_ring_reference()
+    {
+      spsc_ring<std::unique_ptr<int>> ring(5);
+      CPPUNIT_ASSERT_EQUAL(size_t {8}, ring.capacity());
+
+      // wraps around several times, move-only values
+      int next_push = 0, next_pop = 0;
+      for (int round = 0; round < 10; round++) {
+        while (ring.emplace(std::unique_ptr<int>(new int(next_push)))) {
+          next_push++;
+        }
+        CPPUNIT_ASSERT_EQUAL(size_t {8}, ring.size());
+
+        std::unique_ptr<int> value;
+        CPPUNIT_ASSERT(ring.pop(value));
+        CPPUNIT_ASSERT_EQUAL(next_pop++, *value);
+
+        std::vector<std::unique_ptr<int>> values;
+        CPPUNIT_ASSERT_EQUAL(size_t {3}, ring.pop_batch(values, 3));
+        for (const auto &v : values) {
+          CPPUNIT_ASSERT_EQUAL(next_pop++, *v);
+        }
+      }
+
+      CPPUNIT_ASSERT_EQUAL(uint64_t {10}, ring.dropped());
+      ring.clear();
+      CPPUNIT_ASSERT_EQUAL(size_t {0}, ring.size());
+    }
+
+    void
+    qa_utils::mpsc_queue_reference()
+    {
+      const int producers = 3, items = 10000;
+      bounded_mpsc_queue<std::pair<int, int>> queue(64);
+
+      std::vector<std::thread> threads;
+      for (int p = 0; p < producers; p++) {
+        threads.emplace_back([&queue, p] {
+          for (int i = 0; i < items; i++) {
+            while (!queue.emplace(p, i)) {
+              std::this_thread::yield();
+            }
+          }
+        });
+      }
+
+      // values of each producer are received in order
+      std::vector<int> expected(producers, 0);
+      std::vector<std::pair<int, int>> values;
+      int received = 0;
+      while (received < producers * items) {
+        values.clear();
+        if (!queue.pop_batch(values, 16)) {
+          std::this_thread::yield();
+        }
+        for (const auto &v : values) {
+          CPPUNIT_ASSERT_EQUAL(expected[v.first]++, v.second);
+          received++;
+        }
+      }
+
+      for (auto &t : threads) {
+        t.join();
+      }
+      CPPUNIT_ASSERT_EQUAL(uint64_t(producers * items), queue.pushed());
+    }
+
+    void
+    qa_utils::event_log_reference()
+    {
+      event_log_t log(64, 16, 10000000000);
+
+      std::vector<std::pair<uint16_t, uint64_t>> logged;
+      log.set_logger([&logged](const event_record_t &record, uint64_t suppressed) {
+        logged.emplace_back(record.kind, suppressed);
+      });
+
+      // the first event is logged, the rest is folded until the interval elapses
+      log.push(EVENT_DRIVER_OVERRUN);
+      log.drain();
+      CPPUNIT_ASSERT_EQUAL(size_t(1), logged.size());
+      CPPUNIT_ASSERT_EQUAL(uint64_t(0), logged[0].second);
+
+      for (int i = 0; i < 10; i++) {
+        log.push(EVENT_DRIVER_OVERRUN);
+      }
+      log.push(EVENT_BUFFERS_LOST, std::error_code{}, 5);
+      log.drain();
+      CPPUNIT_ASSERT_EQUAL(size_t(2), logged.size());
+      CPPUNIT_ASSERT_EQUAL(uint16_t(EVENT_BUFFERS_LOST), logged[1].first);
+
+      log.flush();
+      CPPUNIT_ASSERT_EQUAL(size_t(3), logged.size());
+      CPPUNIT_ASSERT_EQUAL(uint16_t(EVENT_DRIVER_OVERRUN), logged[2].first);
+      CPPUNIT_ASSERT_EQUAL(uint64_t(9), logged[2].second);
+
+      // errors are not logged, the history keeps the last ones
+      for (int i = 0; i < 20; i++) {
+        log.push(std::make_error_code(std::errc::timed_out));
+      }
+      auto errors = log.get_errors();
+      CPPUNIT_ASSERT_EQUAL(size_t(16), errors.size());
+      CPPUNIT_ASSERT(errors.back().code == std::errc::timed_out);
+      CPPUNIT_ASSERT(log.get_errors().empty());
+      CPPUNIT_ASSERT_EQUAL(size_t(3), logged.size());
+
+      // records overwritten before being drained are counted
+      for (int i = 0; i < 100; i++) {
+        log.push(std::make_error_code(std::errc::timed_out));
+      }
+      CPPUNIT_ASSERT_EQUAL(size_t(16), log.get_errors().size());
+      CPPUNIT_ASSERT_EQUAL(uint64_t(36), log.lost());
+
+      // concurrent producers
+      event_log_t mt_log(4096, 4096);
+      std::vector<std::thread> threads;
+      for (int p = 0; p < 3; p++) {
+        threads.emplace_back([&mt_log] {
+          for (int i = 0; i < 1000; i++) {
+            mt_log.push(std::make_error_code(std::errc::io_error));
+          }
+        });
+      }
+      for (auto &t : threads) {
+        t.join();
+      }
+      CPPUNIT_ASSERT_EQUAL(size_t(3000), mt_log.get_errors().size());
+      CPPUNIT_ASSERT_EQUAL(uint64_t(0), mt_log.lost());
+    }
+
+    void
+    qa_utils::blocking_queue_wait()
+    {
+      blocking_queue<spsc_ring<int>> queue(16);
+      int value = 0;
+
+      auto start = std::chrono::steady_clock::now();
+      CPPUNIT_ASSERT_EQUAL(false, queue.wait_and_pop(value, std::chrono::milliseconds(20)));
+      CPPUNIT_ASSERT(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(20));
+
+      std::thread producer([&queue] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        queue.push(42);
+      });
+      CPPUNIT_ASSERT_EQUAL(true, queue.wait_and_pop(value, std::chrono::seconds(10)));
+      CPPUNIT_ASSERT_EQUAL(42, value);
+      producer.join();
+    }
+
+  } /* namespace digitizers */
+} /* namespace gr */
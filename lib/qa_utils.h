@@ -0,0 +1,39 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+
+#ifndef _QA_UTILS_H_
+#define _QA_UTILS_H_
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/TestCase.h>
+
+namespace gr {
+  namespace digitizers {
+
+    class qa_utils : public CppUnit::TestCase
+    {
+    public:
+      CPPUNIT_TEST_SUITE(qa_utils);
+      CPPUNIT_TEST(median_filter_reference);
+      CPPUNIT_TEST(spsc_ring_reference);
+      CPPUNIT_TEST(mpsc_queue_reference);
+      CPPUNIT_TEST(blocking_queue_wait);
+      CPPUNIT_TEST(event_log_reference);
+      CPPUNIT_TEST_SUITE_END();
+
+    private:
+      void median_filter_reference();
+      void spsc_ring_reference();
+      void mpsc_queue_reference();
+      void blocking_queue_wait();
+      void event_log_reference();
+    };
+
+  } /* namespace digitizers */
+} /* namespace gr */
+
+#endif /* _QA_UTILS_H_ */
@@ -13,9 +13,16 @@
 #include <gnuradio/top_block.h>
 #include <gnuradio/blocks/vector_source_f.h>
 #include <gnuradio/blocks/add_ff.h>
+#include <gnuradio/blocks/head.h>
+#include <gnuradio/blocks/null_sink.h>
 #include <gnuradio/blocks/vector_sink_f.h>
+#include <gnuradio/blocks/message_debug.h>
 #include "qa_common.h"
 
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+
 namespace gr {
   namespace digitizers {
 
@@ -37,8 +44,8 @@ namespace gr {
       top->connect(wr_source,     0, adder, 1);
       top->connect(adder, 0, vector_sink, 0);
 
-      // inject made up event
-      wr_source->add_timing_event("made up event", 987654321, 123456789, true, false);
+      // inject made up event, processed once the flowgraph is started
+      CPPUNIT_ASSERT(wr_source->add_timing_event("made up event", 987654321, 123456789));
 
       top->run();
 
@@ -49,15 +56,141 @@ namespace gr {
       auto tags = vector_sink->tags();
       CPPUNIT_ASSERT_EQUAL(size_t {1}, tags.size());
 
+      CPPUNIT_ASSERT_EQUAL(uint64_t {0}, tags.at(0).offset);
       auto event = decode_wr_event_tag(tags.at(0));
       CPPUNIT_ASSERT_EQUAL(std::string {"made up event"}, event.event_id);
-      CPPUNIT_ASSERT_EQUAL(int64_t {987654321}, event.timestamp);
-      CPPUNIT_ASSERT_EQUAL(int64_t {123456789}, event.last_beam_in_timestamp);
-      CPPUNIT_ASSERT_EQUAL(true, event.time_sync_only);
-      CPPUNIT_ASSERT_EQUAL(false, event.realignment_required);
-      CPPUNIT_ASSERT_EQUAL(uint64_t {0}, event.offset);
+      CPPUNIT_ASSERT_EQUAL(int64_t {987654321}, event.wr_trigger_stamp);
+      CPPUNIT_ASSERT_EQUAL(int64_t {123456789}, event.wr_trigger_stamp_utc);
+    }
+
+    void
+    qa_wr_receiver_f::event_stream()
+    {
+      auto top = make_top_block("WR");
+
+      auto wr_source = gr::digitizers::wr_receiver_f::make(true, 16);
+      auto head = gr::blocks::head::make(sizeof(float), 3);
+      auto vector_sink = gr::blocks::vector_sink_f::make();
+
+      top->connect(wr_source, 0, head, 0);
+      top->connect(head, 0, vector_sink, 0);
+
+      for (int i = 0; i < 3; i++) {
+        CPPUNIT_ASSERT(wr_source->add_timing_event("event " + std::to_string(i), 1000 + i, 2000 + i));
+      }
+
+      top->run();
+
+      // exactly one zero sample per event
+      auto data = vector_sink->data();
+      CPPUNIT_ASSERT_EQUAL(size_t {3}, data.size());
+      for (auto value : data) {
+        CPPUNIT_ASSERT_EQUAL(0.0f, value);
+      }
+
+      auto tags = vector_sink->tags();
+      CPPUNIT_ASSERT_EQUAL(size_t {3}, tags.size());
+      for (int i = 0; i < 3; i++) {
+        CPPUNIT_ASSERT_EQUAL(uint64_t(i), tags.at(i).offset);
+        auto event = decode_wr_event_tag(tags.at(i));
+        CPPUNIT_ASSERT_EQUAL("event " + std::to_string(i), event.event_id);
+        CPPUNIT_ASSERT_EQUAL(int64_t(1000 + i), event.wr_trigger_stamp);
+        CPPUNIT_ASSERT_EQUAL(int64_t(2000 + i), event.wr_trigger_stamp_utc);
+      }
+    }
+
+    void
+    qa_wr_receiver_f::dropped_events()
+    {
+      auto wr_source = gr::digitizers::wr_receiver_f::make(true, 4);
+
+      CPPUNIT_ASSERT_EQUAL(uint64_t {0}, wr_source->get_dropped_events());
+      CPPUNIT_ASSERT_EQUAL(uint64_t {0}, wr_source->get_max_queued_events());
+
+      // the queue overflows as nobody drains it
+      for (int i = 0; i < 6; i++) {
+        CPPUNIT_ASSERT_EQUAL(i < 4, wr_source->add_timing_event("event " + std::to_string(i), i, i));
+      }
+
+      CPPUNIT_ASSERT_EQUAL(uint64_t {2}, wr_source->get_dropped_events());
+      CPPUNIT_ASSERT_EQUAL(uint64_t {4}, wr_source->get_max_queued_events());
+
+      // the queued events are processed in order, the dropped ones are lost
+      auto top = make_top_block("WR");
+      auto head = gr::blocks::head::make(sizeof(float), 4);
+      auto vector_sink = gr::blocks::vector_sink_f::make();
+
+      top->connect(wr_source, 0, head, 0);
+      top->connect(head, 0, vector_sink, 0);
+      top->run();
+
+      auto tags = vector_sink->tags();
+      CPPUNIT_ASSERT_EQUAL(size_t {4}, tags.size());
+      for (int i = 0; i < 4; i++) {
+        CPPUNIT_ASSERT_EQUAL("event " + std::to_string(i), decode_wr_event_tag(tags.at(i)).event_id);
+      }
+
+      // drained, events are accepted again
+      CPPUNIT_ASSERT(wr_source->add_timing_event("event", 0, 0));
+      CPPUNIT_ASSERT_EQUAL(uint64_t {2}, wr_source->get_dropped_events());
+      CPPUNIT_ASSERT_EQUAL(uint64_t {4}, wr_source->get_max_queued_events());
+    }
+
+    void
+    qa_wr_receiver_f::events_port()
+    {
+      auto top = make_top_block("WR");
+
+      auto wr_source = gr::digitizers::wr_receiver_f::make(true, 16);
+      auto null_sink = gr::blocks::null_sink::make(sizeof(float));
+      auto msg_debug = gr::blocks::message_debug::make();
+
+      top->connect(wr_source, 0, null_sink, 0);
+      top->msg_connect(wr_source, "events", msg_debug, "store");
+
+      CPPUNIT_ASSERT(wr_source->add_timing_event("first", 1, 2));
+      CPPUNIT_ASSERT(wr_source->add_timing_event("second", 3, 4));
+
+      top->start();
+
+      for (int i = 0; i < 1000 && msg_debug->num_messages() < 2; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+
+      top->stop();
+      top->wait();
+
+      CPPUNIT_ASSERT_EQUAL(2, msg_debug->num_messages());
+
+      // (wr_event . value) pairs, value as in the tag
+      const char *ids[] = {"first", "second"};
+      for (int i = 0; i < 2; i++) {
+        auto msg = msg_debug->get_message(i);
+        CPPUNIT_ASSERT(pmt::is_pair(msg));
+        CPPUNIT_ASSERT(pmt::eqv(wr_event_tag_key(), pmt::car(msg)));
+
+        gr::tag_t tag;
+        tag.key = pmt::car(msg);
+        tag.value = pmt::cdr(msg);
+        auto event = decode_wr_event_tag(tag);
+        CPPUNIT_ASSERT_EQUAL(std::string(ids[i]), event.event_id);
+        CPPUNIT_ASSERT_EQUAL(int64_t(2 * i + 1), event.wr_trigger_stamp);
+        CPPUNIT_ASSERT_EQUAL(int64_t(2 * i + 2), event.wr_trigger_stamp_utc);
+      }
+
+      CPPUNIT_ASSERT_EQUAL(uint64_t {0}, wr_source->get_dropped_events());
+    }
+
+    void
+    qa_wr_receiver_f::invalid_queue_size()
+    {
+      CPPUNIT_ASSERT_THROW(gr::digitizers::wr_receiver_f::make(false, 0), std::invalid_argument);
+      CPPUNIT_ASSERT_THROW(gr::digitizers::wr_receiver_f::make(true, -1), std::invalid_argument);
+      CPPUNIT_ASSERT_THROW(gr::digitizers::wr_receiver_f::make(false, 65535), std::invalid_argument);
+
+      auto wr_source = gr::digitizers::wr_receiver_f::make(false, 65534);
+      CPPUNIT_ASSERT(wr_source->add_timing_event("event", 1, 2));
     }
 
   } /* namespace digitizers */
 } /* namespace gr */
-
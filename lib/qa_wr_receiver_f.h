@@ -19,10 +19,18 @@ namespace gr {
     public:
       CPPUNIT_TEST_SUITE(qa_wr_receiver_f);
       CPPUNIT_TEST(test);
+      CPPUNIT_TEST(event_stream);
+      CPPUNIT_TEST(dropped_events);
+      CPPUNIT_TEST(events_port);
+      CPPUNIT_TEST(invalid_queue_size);
       CPPUNIT_TEST_SUITE_END();
 
     private:
       void test();
+      void event_stream();
+      void dropped_events();
+      void events_port();
+      void invalid_queue_size();
     };
 
   } /* namespace digitizers */
@@ -0,0 +1,185 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <digitizers/raw_codec.h>
+#include "cpu_dispatch.h"
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+namespace gr {
+  namespace digitizers {
+
+    // Deltas of 16-bit samples need up to 17 bits once zigzag mapped
+    static const unsigned RAW_CODEC_MAX_WIDTH = 17;
+    static const size_t RAW_CODEC_PLANE_SIZE = RAW_CODEC_BLOCK_SIZE / 8;
+
+    size_t
+    raw_encode_bound(size_t nsamples)
+    {
+      const size_t nblocks = (nsamples + RAW_CODEC_BLOCK_SIZE - 1) / RAW_CODEC_BLOCK_SIZE;
+      return nblocks * (1 + RAW_CODEC_MAX_WIDTH * RAW_CODEC_PLANE_SIZE);
+    }
+
+    // The bit plane loops are vectorized by the compiler, the kernels are compiled for the
+    // baseline and for AVX2 (three times the throughput), see cpu_dispatch.h
+    __attribute__((always_inline))
+    static inline size_t
+    raw_encode_kernel(const int16_t *samples, size_t nsamples, uint8_t *data)
+    {
+      uint32_t mapped[RAW_CODEC_BLOCK_SIZE];
+      int32_t previous = 0;
+      uint8_t *out = data;
+
+      for (size_t start = 0; start < nsamples; start += RAW_CODEC_BLOCK_SIZE) {
+        const size_t n = std::min(RAW_CODEC_BLOCK_SIZE, nsamples - start);
+
+        // Delta and zigzag mapping, the padding maps to zero
+        uint32_t all = 0;
+        for (size_t i = 0; i < n; i++) {
+          const int32_t delta = static_cast<int32_t>(samples[start + i]) - previous;
+          previous = samples[start + i];
+          mapped[i] = (static_cast<uint32_t>(delta) << 1) ^ static_cast<uint32_t>(delta >> 31);
+          all |= mapped[i];
+        }
+        std::fill(mapped + n, mapped + RAW_CODEC_BLOCK_SIZE, 0);
+
+        unsigned width = 0;
+        while (all >> width) {
+          width++;
+        }
+        *out++ = static_cast<uint8_t>(width);
+
+        // Bit planes, collected in 64-bit words (sample i at bit i % 64)
+        for (unsigned b = 0; b < width; b++) {
+          for (size_t w = 0; w < RAW_CODEC_BLOCK_SIZE; w += 64) {
+            uint64_t plane = 0;
+            for (size_t i = 0; i < 64; i++) {
+              plane |= static_cast<uint64_t>((mapped[w + i] >> b) & 1) << i;
+            }
+            for (size_t k = 0; k < 8; k++) {
+              *out++ = static_cast<uint8_t>(plane >> (8 * k));
+            }
+          }
+        }
+      }
+
+      return out - data;
+    }
+
+    __attribute__((always_inline))
+    static inline size_t
+    raw_decode_kernel(const uint8_t *data, size_t size, int16_t *samples, size_t nsamples)
+    {
+      uint32_t mapped[RAW_CODEC_BLOCK_SIZE];
+      int32_t previous = 0;
+      const uint8_t *in = data;
+      const uint8_t *end = data + size;
+
+      auto corrupt = [&]() {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": corrupt raw data at byte "
+                << (in - data) << " of " << size;
+        throw std::invalid_argument(message.str());
+      };
+
+      for (size_t start = 0; start < nsamples; start += RAW_CODEC_BLOCK_SIZE) {
+        const size_t n = std::min(RAW_CODEC_BLOCK_SIZE, nsamples - start);
+
+        if (in == end) {
+          corrupt();
+        }
+        const unsigned width = *in;
+        if (width > RAW_CODEC_MAX_WIDTH
+                || static_cast<size_t>(end - in) < 1 + width * RAW_CODEC_PLANE_SIZE) {
+          corrupt();
+        }
+        in++;
+
+        std::fill(mapped, mapped + RAW_CODEC_BLOCK_SIZE, 0);
+        for (unsigned b = 0; b < width; b++) {
+          for (size_t w = 0; w < RAW_CODEC_BLOCK_SIZE; w += 64) {
+            uint64_t plane = 0;
+            for (size_t k = 0; k < 8; k++) {
+              plane |= static_cast<uint64_t>(*in++) << (8 * k);
+            }
+            for (size_t i = 0; i < 64; i++) {
+              mapped[w + i] |= static_cast<uint32_t>((plane >> i) & 1) << b;
+            }
+          }
+        }
+
+        for (size_t i = 0; i < n; i++) {
+          const int32_t delta = static_cast<int32_t>(mapped[i] >> 1) ^ -static_cast<int32_t>(mapped[i] & 1);
+          previous += delta;
+          samples[start + i] = static_cast<int16_t>(previous);
+        }
+      }
+
+      return in - data;
+    }
+
+    static size_t
+    raw_encode_generic(const int16_t *samples, size_t nsamples, uint8_t *data)
+    {
+      return raw_encode_kernel(samples, nsamples, data);
+    }
+
+    static size_t
+    raw_decode_generic(const uint8_t *data, size_t size, int16_t *samples, size_t nsamples)
+    {
+      return raw_decode_kernel(data, size, samples, nsamples);
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    __attribute__((target("avx2")))
+    static size_t
+    raw_encode_avx2(const int16_t *samples, size_t nsamples, uint8_t *data)
+    {
+      return raw_encode_kernel(samples, nsamples, data);
+    }
+
+    __attribute__((target("avx2")))
+    static size_t
+    raw_decode_avx2(const uint8_t *data, size_t size, int16_t *samples, size_t nsamples)
+    {
+      return raw_decode_kernel(data, size, samples, nsamples);
+    }
+#endif
+
+    size_t
+    raw_encode(const int16_t *samples, size_t nsamples, uint8_t *data)
+    {
+#if defined(__x86_64__) || defined(__i386__)
+      // kernel is selected once, on first use
+      static const bool avx2 = get_kernel_isa() >= KERNEL_ISA_AVX2;
+      if (avx2) {
+        return raw_encode_avx2(samples, nsamples, data);
+      }
+#endif
+      return raw_encode_generic(samples, nsamples, data);
+    }
+
+    size_t
+    raw_decode(const uint8_t *data, size_t size, int16_t *samples, size_t nsamples)
+    {
+#if defined(__x86_64__) || defined(__i386__)
+      static const bool avx2 = get_kernel_isa() >= KERNEL_ISA_AVX2;
+      if (avx2) {
+        return raw_decode_avx2(data, size, samples, nsamples);
+      }
+#endif
+      return raw_decode_generic(data, size, samples, nsamples);
+    }
+
+  } /* namespace digitizers */
+} /* namespace gr */
@@ -0,0 +1,130 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_RCU_SNAPSHOT_H
+#define INCLUDED_DIGITIZERS_RCU_SNAPSHOT_H
+
+#include <boost/thread/mutex.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <utility>
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Immutable snapshot published by writers and read lock-free by a fixed set of
+     * reader threads (read-copy-update with quiescent states).
+     *
+     * Readers load the current snapshot with a single atomic load. A snapshot read remains valid
+     * until the reader reports a quiescent state, i.e. a point where it holds no snapshot (e.g.
+     * between two work calls). Readers not running are offline and don't hold up anything.
+     *
+     * Writers publish a new snapshot, the replaced one is retired and freed by a later publish
+     * once all the online readers have passed a quiescent state. Readers never wait, writers
+     * only wait for each other.
+     */
+    template<typename T, size_t NREADERS>
+    class rcu_snapshot_t
+    {
+    public:
+
+      rcu_snapshot_t()
+        : d_current(nullptr),
+          d_epoch(1)
+      {
+        for (auto &epoch : d_reader_epochs) {
+          epoch = OFFLINE;
+        }
+      }
+
+      ~rcu_snapshot_t()
+      {
+        delete d_current.load();
+      }
+
+      rcu_snapshot_t(const rcu_snapshot_t &) = delete;
+      rcu_snapshot_t &operator=(const rcu_snapshot_t &) = delete;
+
+      /*!
+       * \brief Current snapshot, nullptr if none has been published yet. Readers only.
+       */
+      const T *read() const
+      {
+        return d_current.load(std::memory_order_acquire);
+      }
+
+      /*!
+       * \brief Reports that the reader holds no snapshot.
+       */
+      void quiescent(size_t reader)
+      {
+        d_reader_epochs[reader].store(d_epoch.load());
+      }
+
+      /*!
+       * \brief Marks the reader online (before its first read) or offline (holds no snapshot
+       * until it gets online again).
+       */
+      void set_online(size_t reader, bool online)
+      {
+        d_reader_epochs[reader].store(online ? d_epoch.load() : OFFLINE);
+      }
+
+      /*!
+       * \brief Publishes the snapshot, takes effect with the next read.
+       */
+      void publish(std::unique_ptr<const T> snapshot)
+      {
+        boost::mutex::scoped_lock lock(d_mutex);
+
+        const T *old = d_current.exchange(snapshot.release());
+
+        // Readers reporting this epoch (or a later one) don't hold the old snapshot
+        const auto epoch = d_epoch.fetch_add(1) + 1;
+        if (old) {
+          d_retired.emplace_back(epoch, std::unique_ptr<const T>(old));
+        }
+
+        uint64_t min_epoch = OFFLINE;
+        for (const auto &reader_epoch : d_reader_epochs) {
+          min_epoch = std::min(min_epoch, reader_epoch.load());
+        }
+        while (!d_retired.empty() && d_retired.front().first <= min_epoch) {
+          d_retired.pop_front();
+        }
+      }
+
+      /*!
+       * \brief Number of snapshots retired but not freed yet.
+       */
+      size_t retired()
+      {
+        boost::mutex::scoped_lock lock(d_mutex);
+        return d_retired.size();
+      }
+
+    private:
+      static const uint64_t OFFLINE = std::numeric_limits<uint64_t>::max();
+
+      std::atomic<const T *> d_current;
+      std::atomic<uint64_t> d_epoch;
+      std::array<std::atomic<uint64_t>, NREADERS> d_reader_epochs;
+
+      boost::mutex d_mutex;
+      std::deque<std::pair<uint64_t, std::unique_ptr<const T>>> d_retired;
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_RCU_SNAPSHOT_H */
@@ -0,0 +1,593 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gnuradio/io_signature.h>
+#include "replay_source_impl.h"
+#include <digitizers/status.h>
+#include "conversion_kernel.h"
+#include "probes.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+namespace gr {
+  namespace digitizers {
+
+    // Full scale of the raw samples, same as for the 16-bit PicoScopes
+    static const int16_t REPLAY_MAX_RAW = 32767;
+
+    static bool
+    ends_with(const std::string &str, const std::string &suffix)
+    {
+      return str.size() >= suffix.size()
+              && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+
+    replay_file_t::replay_file_t(const std::string &filename)
+      : d_filename(filename),
+        d_csv(ends_with(filename, ".csv")),
+        d_data(nullptr),
+        d_size(0)
+    {
+      if (d_filename.empty()) {
+        return;
+      }
+
+      if (d_csv) {
+        std::ifstream file(d_filename);
+        if (!file) {
+          std::ostringstream message;
+          message << "Exception in " << __FILE__ << ":" << __LINE__ << ": cannot open " << d_filename;
+          throw std::runtime_error(message.str());
+        }
+
+        double value;
+        while (file >> value) {
+          d_values.push_back(value);
+        }
+
+        if (!file.eof()) {
+          std::ostringstream message;
+          message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid value in " << d_filename
+                  << " after " << d_values.size() << " values";
+          throw std::runtime_error(message.str());
+        }
+        return;
+      }
+
+      int fd = ::open(d_filename.c_str(), O_RDONLY);
+      if (fd < 0) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": cannot open " << d_filename
+                << ": " << std::strerror(errno);
+        throw std::runtime_error(message.str());
+      }
+
+      struct stat st;
+      if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+        d_size = static_cast<size_t>(st.st_size);
+        d_data = ::mmap(nullptr, d_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      }
+      ::close(fd);
+
+      if (d_data == MAP_FAILED || d_data == nullptr) {
+        d_data = nullptr;
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": cannot map " << d_filename;
+        throw std::runtime_error(message.str());
+      }
+
+      // replayed front to back
+      ::madvise(d_data, d_size, MADV_SEQUENTIAL);
+    }
+
+    replay_file_t::~replay_file_t()
+    {
+      if (d_data != nullptr) {
+        ::munmap(d_data, d_size);
+      }
+    }
+
+    size_t
+    replay_file_t::length(size_t sample_size) const
+    {
+      return d_csv ? d_values.size() : d_size / sample_size;
+    }
+
+    replay_source::sptr
+    replay_source::make(const std::string &ch_a_file, const std::string &ch_b_file,
+            const std::string &port_file, bool loop)
+    {
+      return gnuradio::get_initial_sptr
+        (new replay_source_impl(ch_a_file, ch_b_file, port_file, loop));
+    }
+
+    /*
+     * The private constructor
+     */
+    replay_source_impl::replay_source_impl(const std::string &ch_a_file, const std::string &ch_b_file,
+            const std::string &port_file, bool loop)
+      : gr::sync_block("replay_source",
+              gr::io_signature::make(0, 0, 0),
+              gr::io_signature::makev(1, 5, std::vector<int>({4, 4, 4, 4, 1}))),
+      digitizer_block_impl(2, 1, false),
+      d_length(0),
+      d_loop(loop),
+      d_pacing(1.0),
+      d_raw{{nullptr, nullptr}},
+      d_raw_port(nullptr),
+      d_position(0),
+      d_replayed_samples(0),
+      d_finished(false),
+      d_tmp_buffer(nullptr),
+      d_tmp_buffer_size(0),
+      d_lost_count(0)
+    {
+      d_ranges.push_back(range_t(20));
+
+      d_files[0].reset(new replay_file_t(ch_a_file));
+      d_files[1].reset(new replay_file_t(ch_b_file));
+      d_port_file.reset(new replay_file_t(port_file));
+
+      bool recorded = false;
+      d_length = std::numeric_limits<uint64_t>::max();
+      for (const auto &file : d_files) {
+        if (!file->empty()) {
+          d_length = std::min(d_length, static_cast<uint64_t>(file->length(sizeof(int16_t))));
+          recorded = true;
+        }
+      }
+      if (!d_port_file->empty()) {
+        d_length = std::min(d_length, static_cast<uint64_t>(d_port_file->length(sizeof(uint8_t))));
+        recorded = true;
+      }
+
+      if (!recorded || d_length == 0) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": empty recording";
+        throw std::invalid_argument(message.str());
+      }
+
+      // Enable all channels and ports
+      set_aichan("A", true, 20.0, AC_1M);
+      set_aichan("B", true, 20.0, AC_1M);
+      set_diport("port0", true, 0.7);
+    }
+
+    /*
+     * Our virtual destructor.
+     */
+    replay_source_impl::~replay_source_impl()
+    {
+    }
+
+    void
+    replay_source_impl::set_replay_pacing(float rate_factor)
+    {
+      if (rate_factor < 0) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid pacing: " << rate_factor;
+        throw std::invalid_argument(message.str());
+      }
+
+      d_pacing = rate_factor;
+    }
+
+    uint64_t
+    replay_source_impl::get_recording_length() const
+    {
+      return d_length;
+    }
+
+    uint64_t
+    replay_source_impl::get_replayed_samples() const
+    {
+      return d_replayed_samples.load(std::memory_order_relaxed);
+    }
+
+    bool
+    replay_source_impl::is_replay_finished() const
+    {
+      return d_finished.load(std::memory_order_relaxed);
+    }
+
+    std::vector<std::string>
+    replay_source_impl::get_aichan_ids()
+    {
+      return std::vector<std::string> {"A", "B"};
+    }
+
+    meta_range_t
+    replay_source_impl::get_aichan_ranges()
+    {
+      return d_ranges;
+    }
+
+    std::string
+    replay_source_impl::get_driver_version()
+    {
+      return "replay";
+    }
+
+    std::string
+    replay_source_impl::get_hardware_version()
+    {
+      return "replay";
+    }
+
+    std::error_code
+    replay_source_impl::driver_initialize()
+    {
+      return std::error_code{};
+    }
+
+    std::error_code
+    replay_source_impl::driver_configure()
+    {
+      // The application buffer is (re)initialized, a chunk being assembled is gone
+      d_tmp_buffer = nullptr;
+      d_tmp_buffer_size = 0;
+      return std::error_code{};
+    }
+
+    void
+    replay_source_impl::prepare_recording()
+    {
+      for (size_t channel = 0; channel < d_files.size(); channel++) {
+        const auto &file = *d_files[channel];
+
+        if (file.empty()) {
+          d_raw[channel] = nullptr;
+        }
+        else if (file.is_csv()) {
+          const auto range = d_channel_settings[channel].range;
+          const auto &values = file.values();
+
+          auto &quantized = d_quantized[channel];
+          quantized.resize(d_length);
+          for (size_t i = 0; i < d_length; i++) {
+            const auto raw = std::lround(values[i] / range * REPLAY_MAX_RAW);
+            quantized[i] = static_cast<int16_t>(std::max(std::min(raw, long{REPLAY_MAX_RAW}), -long{REPLAY_MAX_RAW}));
+          }
+          d_raw[channel] = quantized.data();
+        }
+        else {
+          d_raw[channel] = static_cast<const int16_t *>(file.data());
+        }
+      }
+
+      if (d_port_file->empty()) {
+        d_raw_port = nullptr;
+      }
+      else if (d_port_file->is_csv()) {
+        const auto &values = d_port_file->values();
+        d_port_values.resize(d_length);
+        for (size_t i = 0; i < d_length; i++) {
+          d_port_values[i] = static_cast<uint8_t>(std::lround(values[i]));
+        }
+        d_raw_port = d_port_values.data();
+      }
+      else {
+        d_raw_port = static_cast<const uint8_t *>(d_port_file->data());
+      }
+
+      // Callbacks deliver at most one chunk, missing channels read from here
+      d_zero_raw.assign(d_buffer_size, 0);
+      d_zero_port.assign(d_buffer_size, 0);
+    }
+
+    std::error_code
+    replay_source_impl::driver_arm()
+    {
+      prepare_recording();
+
+      if (d_acquisition_mode == acquisition_mode_t::RAPID_BLOCK) {
+        // The captures are read from consecutive samples of the recording, the recording
+        // always loops in rapid block mode
+        const auto block_size = static_cast<uint64_t>(get_block_size());
+        d_segment_positions.resize(get_nr_memory_segments());
+        for (uint32_t i = 0; i < d_nr_captures; i++) {
+          d_segment_positions.at(d_capture_segment + i) = (d_position + i * block_size) % d_length;
+        }
+        d_position = (d_position + d_nr_captures * block_size) % d_length;
+
+        // The whole recording is at hand
+        notify_data_ready(std::error_code{});
+      }
+      else {
+        // Each streaming acquisition replays the recording from the beginning, a partially
+        // filled chunk is reused
+        d_position = 0;
+        d_tmp_buffer_size = 0;
+        d_lost_count = 0;
+        d_replayed_samples.store(0, std::memory_order_relaxed);
+        d_finished.store(false, std::memory_order_relaxed);
+        d_stream_start = boost::chrono::high_resolution_clock::now();
+      }
+
+      return std::error_code{};
+    }
+
+    std::error_code
+    replay_source_impl::driver_disarm()
+    {
+      return std::error_code{};
+    }
+
+    std::error_code
+    replay_source_impl::driver_close()
+    {
+      return std::error_code{};
+    }
+
+    std::error_code
+    replay_source_impl::driver_prefetch_block(size_t length, size_t block_number)
+    {
+      return std::error_code{};
+    }
+
+    std::error_code
+    replay_source_impl::driver_prefetch_blocks(size_t length, size_t first_block, size_t nr_blocks)
+    {
+      // the recording is always at hand
+      return std::error_code{};
+    }
+
+    std::error_code
+    replay_source_impl::driver_get_rapid_block_data(size_t offset, size_t length, size_t waveform,
+                  gr_vector_void_star &arrays, std::vector<uint32_t> &status)
+    {
+      if (waveform >= d_segment_positions.size())
+      {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": cannot fetch rapid block data, invalid segment: " << waveform;
+        throw std::runtime_error(message.str());
+      }
+
+      if (arrays.size() != 5)
+      {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": all channels should be passed in";
+        throw std::runtime_error(message.str());
+      }
+
+      for (auto &s : status) {
+        s = 0;
+      };
+
+      auto position = (d_segment_positions[waveform] + offset) % d_length;
+
+      for (size_t i = 0; i < length; ) {
+        const auto n = std::min(static_cast<uint64_t>(length - i), d_length - position);
+
+        for (size_t channel = 0; channel < d_raw.size(); channel++) {
+          float *values = static_cast<float *>(arrays[2 * channel]) + i;
+          float *errors = static_cast<float *>(arrays[2 * channel + 1]) + i;
+
+          const auto &settings = get_config_snapshot().config.channels[channel];
+          if (d_raw[channel] != nullptr) {
+            const float voltage_multiplier = static_cast<float>(settings.range) / REPLAY_MAX_RAW;
+            raw_convert(d_raw[channel] + position, voltage_multiplier * settings.calibration_scale,
+                    settings.calibration_offset, values, n);
+          }
+          else {
+            std::fill(values, values + n, -settings.calibration_offset);
+          }
+          std::fill(errors, errors + n, 0.005f * settings.calibration_scale);
+        }
+
+        uint8_t *port = static_cast<uint8_t *>(arrays[4]) + i;
+        if (d_raw_port != nullptr) {
+          memcpy(port, d_raw_port + position, n);
+        }
+        else {
+          std::fill(port, port + n, 0);
+        }
+
+        i += n;
+        position = 0;
+      }
+
+      return std::error_code {};
+    }
+
+    std::error_code
+    replay_source_impl::driver_poll()
+    {
+      replay_stream();
+      return std::error_code {};
+    }
+
+    std::error_code
+    replay_source_impl::driver_wait_ready(uint64_t timeout_ns)
+    {
+      // Without pacing the data is generated as fast as the application buffer drains
+      if (d_pacing <= 0) {
+        return std::make_error_code(std::errc::operation_not_supported);
+      }
+
+      // Time at which the samples of the next chunk have been acquired
+      const double due_s = static_cast<double>(d_replayed_samples.load(std::memory_order_relaxed) + d_buffer_size) / (get_samp_rate() * d_pacing);
+      const auto due = d_stream_start + boost::chrono::duration_cast<boost::chrono::nanoseconds>(
+              boost::chrono::duration<double>(due_s));
+      const auto timeout = boost::chrono::high_resolution_clock::now() + boost::chrono::nanoseconds(timeout_ns);
+
+      boost::this_thread::sleep_until(std::min<boost::chrono::high_resolution_clock::time_point>(due, timeout));
+      return std::error_code {};
+    }
+
+    bool
+    replay_source_impl::driver_stream_ended() const
+    {
+      return d_finished.load(std::memory_order_relaxed);
+    }
+
+    void
+    replay_source_impl::replay_stream()
+    {
+      if (d_finished.load(std::memory_order_relaxed)) {
+        return;
+      }
+
+      auto replayed = d_replayed_samples.load(std::memory_order_relaxed);
+
+      // Samples the driver would have acquired since the last poll
+      uint64_t due;
+      if (d_pacing > 0) {
+        boost::chrono::duration<double> elapsed = boost::chrono::high_resolution_clock::now() - d_stream_start;
+        const auto target = static_cast<uint64_t>(elapsed.count() * get_samp_rate() * d_pacing);
+        due = target > replayed ? target - replayed : 0;
+
+        // The driver buffer holds at most d_driver_buffer_size samples, the rest is lost the
+        // same way as if the poll thread was late with a real device
+        if (due > d_driver_buffer_size) {
+          auto lost = due - d_driver_buffer_size;
+          if (!d_loop) {
+            lost = std::min(lost, d_length - d_position);
+          }
+          d_position = (d_position + lost) % d_length;
+          d_samples_received += lost;
+          d_lost_count += static_cast<int>(lost / d_buffer_size);
+          replayed += lost;
+          due = d_driver_buffer_size;
+        }
+      }
+      else {
+        // As fast as possible, i.e. as fast as the application buffer is drained
+        const auto room = d_app_buffer.get_nr_free_chunks() * d_buffer_size
+                + (d_tmp_buffer != nullptr ? d_buffer_size - d_tmp_buffer_size : 0);
+        due = std::min(static_cast<uint64_t>(room), static_cast<uint64_t>(d_driver_buffer_size));
+      }
+
+      while (due > 0) {
+        if (d_position >= d_length) {
+          if (!d_loop) {
+            d_finished.store(true, std::memory_order_relaxed);
+            break;
+          }
+          d_position = 0;
+        }
+
+        // The callback never wraps around the end of the recording
+        const auto nr_samples = std::min({due, static_cast<uint64_t>(d_buffer_size), d_length - d_position});
+        streaming_callback(d_position, static_cast<uint32_t>(nr_samples));
+
+        d_position += nr_samples;
+        replayed += nr_samples;
+        due -= nr_samples;
+      }
+
+      if (!d_loop && d_position >= d_length) {
+        d_finished.store(true, std::memory_order_relaxed);
+      }
+
+      d_replayed_samples.store(replayed, std::memory_order_relaxed);
+    }
+
+    void
+    replay_source_impl::streaming_callback(uint64_t position, uint32_t nr_samples)
+    {
+      DIGITIZERS_PROBE2(streaming_callback, nr_samples, 0);
+
+      // Same structure as the PicoScope streaming callback, see picoscope_impl
+      uint64_t sample_index = d_samples_received;
+      d_samples_received += nr_samples;
+      update_sample_clock(d_samples_received, get_chunk_timestamp_ns());
+
+      // Driver buffers, missing channels are all zero
+      std::array<const int16_t *, 2> raw;
+      for (size_t channel = 0; channel < raw.size(); channel++) {
+        raw[channel] = d_raw[channel] != nullptr ? d_raw[channel] + position : d_zero_raw.data();
+      }
+      const uint8_t *raw_port = d_raw_port != nullptr ? d_raw_port + position : d_zero_port.data();
+
+      const auto buffer_size_channel_bytes = d_buffer_size * sizeof(float);
+      uint32_t start_index = 0;
+
+      while (nr_samples > 0) {
+
+        if (d_tmp_buffer_size == 0 && d_tmp_buffer == nullptr) {
+          d_tmp_buffer = d_app_buffer.get_free_data_chunk();
+
+          if (d_tmp_buffer == nullptr) {
+            d_lost_count++;
+            DIGITIZERS_PROBE1(chunk_lost, d_lost_count);
+            const auto lost = std::min(nr_samples, d_buffer_size);
+            nr_samples -= lost;
+            start_index += lost;
+            sample_index += lost;
+            continue;
+          }
+        }
+
+        uint32_t samples_to_convert = std::min(nr_samples, d_buffer_size - d_tmp_buffer_size);
+        if (get_fast_interlock_budget()) {
+          samples_to_convert = std::min(samples_to_convert, get_fast_interlock_budget());
+        }
+        nr_samples -= samples_to_convert;
+
+        // Buffer organization:
+        //   <chan A values> <chan A errors> <chan B values> <chan B errors> <port>
+        auto conversion_start = boost::chrono::high_resolution_clock::now();
+        for (size_t channel = 0; channel < raw.size(); channel++) {
+          uint8_t *channel_region = &d_tmp_buffer->d_data[buffer_size_channel_bytes * 2 * channel];
+          float *values = reinterpret_cast<float *>(channel_region) + d_tmp_buffer_size;
+          float *errors = reinterpret_cast<float *>(channel_region + buffer_size_channel_bytes) + d_tmp_buffer_size;
+
+          const auto &settings = get_config_snapshot().config.channels[channel];
+          const float voltage_multiplier = static_cast<float>(settings.range) / REPLAY_MAX_RAW;
+          raw_convert(raw[channel] + start_index, voltage_multiplier * settings.calibration_scale,
+                  settings.calibration_offset, values, samples_to_convert);
+          std::fill(errors, errors + samples_to_convert, 0.005f * settings.calibration_scale);
+
+          if (has_fast_interlock(channel)) {
+            evaluate_fast_interlock(channel, values, samples_to_convert, sample_index);
+          }
+        }
+        auto conversion_duration = boost::chrono::high_resolution_clock::now() - conversion_start;
+        record_conversion_time(boost::chrono::duration_cast<boost::chrono::nanoseconds>(conversion_duration).count(),
+                samples_to_convert * raw.size());
+
+        memcpy(&d_tmp_buffer->d_data[buffer_size_channel_bytes * 4] + d_tmp_buffer_size,
+                raw_port + start_index, samples_to_convert);
+
+        d_tmp_buffer_size += samples_to_convert;
+        start_index += samples_to_convert;
+        sample_index += samples_to_convert;
+
+        // Temporary buffer is full, push data into application buffer
+        if (d_tmp_buffer_size == d_buffer_size) {
+          // Timestamp refers to the end of the chunk
+          d_tmp_buffer->d_local_timestamp = get_sample_timestamp_ns(sample_index);
+
+          d_tmp_buffer->d_lost_count = d_lost_count;
+          d_lost_count = 0;
+
+          // reuses the capacity of the chunk, i.e. no allocation once the pool has been cycled
+          d_tmp_buffer->d_status.assign(2, 0);
+
+          d_app_buffer.add_full_data_chunk(d_tmp_buffer);
+
+          d_tmp_buffer = nullptr;
+          d_tmp_buffer_size = 0;
+        }
+      }
+    }
+
+  } /* namespace digitizers */
+} /* namespace gr */
+
@@ -0,0 +1,148 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_REPLAY_SOURCE_IMPL_H
+#define INCLUDED_DIGITIZERS_REPLAY_SOURCE_IMPL_H
+
+#include <digitizers/replay_source.h>
+#include "digitizer_block_impl.h"
+#include <system_error>
+#include <string>
+#include <array>
+#include <atomic>
+#include <memory>
+#include "digitizers/range.h"
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Contents of one recorded channel, either memory mapped (raw samples) or parsed
+     * (CSV file). An empty file name yields an empty recording.
+     */
+    class replay_file_t
+    {
+    public:
+      explicit replay_file_t(const std::string &filename);
+      ~replay_file_t();
+
+      replay_file_t(const replay_file_t &) = delete;
+      replay_file_t &operator=(const replay_file_t &) = delete;
+
+      bool empty() const { return d_filename.empty(); }
+      bool is_csv() const { return d_csv; }
+
+      /*!
+       * \brief Number of samples, sample_size is the size of a raw sample in bytes.
+       */
+      size_t length(size_t sample_size) const;
+
+      const std::vector<double> &values() const { return d_values; }
+
+      const void *data() const { return d_data; }
+
+    private:
+      std::string d_filename;
+      bool d_csv;
+      std::vector<double> d_values;
+      void *d_data;
+      size_t d_size;
+    };
+
+    class replay_source_impl : public digitizer_block_impl, public replay_source
+    {
+    private:
+      meta_range_t d_ranges;
+
+      std::array<std::unique_ptr<replay_file_t>, 2> d_files;
+      std::unique_ptr<replay_file_t> d_port_file;
+      uint64_t d_length;
+      bool d_loop;
+      float d_pacing;
+
+      // Samples of CSV recordings, quantized on arm
+      std::array<std::vector<int16_t>, 2> d_quantized;
+      std::vector<uint8_t> d_port_values;
+
+      // Recorded raw samples, nullptr if the channel is not recorded
+      std::array<const int16_t *, 2> d_raw;
+      const uint8_t *d_raw_port;
+      std::vector<int16_t> d_zero_raw;
+      std::vector<uint8_t> d_zero_port;
+
+      // Position of the next sample to replay
+      uint64_t d_position;
+      boost::chrono::high_resolution_clock::time_point d_stream_start;
+      std::atomic<uint64_t> d_replayed_samples;
+      std::atomic<bool> d_finished;
+
+      // Recording position of each capture segment (rapid block mode)
+      std::vector<uint64_t> d_segment_positions;
+
+      // Chunk being assembled by the streaming callback
+      app_buffer_t::data_chunk_t *d_tmp_buffer;
+      uint32_t d_tmp_buffer_size;
+      int d_lost_count;
+
+    public:
+      replay_source_impl(const std::string &ch_a_file, const std::string &ch_b_file,
+              const std::string &port_file, bool loop);
+      ~replay_source_impl();
+
+      void set_replay_pacing(float rate_factor) override;
+
+      uint64_t get_recording_length() const override;
+
+      uint64_t get_replayed_samples() const override;
+
+      bool is_replay_finished() const override;
+
+      std::vector<std::string> get_aichan_ids() override;
+
+      meta_range_t get_aichan_ranges() override;
+
+      std::string get_driver_version() override;
+
+      std::string get_hardware_version() override;
+
+      std::error_code driver_initialize() override;
+
+      std::error_code driver_configure() override;
+
+      std::error_code driver_arm() override;
+
+      std::error_code driver_disarm() override;
+
+      std::error_code driver_close() override;
+
+      std::error_code driver_prefetch_block(size_t length, size_t block_number) override;
+
+      std::error_code driver_prefetch_blocks(size_t length, size_t first_block, size_t nr_blocks) override;
+
+      std::error_code driver_get_rapid_block_data(size_t offset, size_t length, size_t waveform,
+              gr_vector_void_star &arrays, std::vector<uint32_t> &status) override;
+
+      std::error_code driver_poll() override;
+
+      // Paced streams sleep until the next chunk is due
+      std::error_code driver_wait_ready(uint64_t timeout_ns) override;
+
+      // End of the recording (loop disabled) is not a stall
+      bool driver_stream_ended() const override;
+
+    private:
+      void prepare_recording();
+
+      void replay_stream();
+
+      void streaming_callback(uint64_t position, uint32_t nr_samples);
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_REPLAY_SOURCE_IMPL_H */
+
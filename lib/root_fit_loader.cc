@@ -0,0 +1,75 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "root_fit_module.h"
+
+#include <boost/thread/mutex.hpp>
+
+#include <dlfcn.h>
+#include <sstream>
+#include <stdexcept>
+
+namespace gr {
+  namespace digitizers {
+
+    static const char *ROOT_FIT_MODULE_NAME = "libgnuradio-digitizers-root.so";
+
+    // Directory of the shared object holding this function, i.e. of the library itself
+    static std::string
+    library_directory()
+    {
+      Dl_info info;
+      if (!dladdr(reinterpret_cast<void *>(&library_directory), &info) || !info.dli_fname) {
+        return std::string();
+      }
+
+      const std::string path(info.dli_fname);
+      const auto slash = path.rfind('/');
+      return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+    }
+
+    root_fit_module_t &
+    root_fit_module()
+    {
+      static boost::mutex mutex;
+      static root_fit_module_t *module = nullptr;
+
+      boost::mutex::scoped_lock lock(mutex);
+      if (module) {
+        return *module;
+      }
+
+      // The module stays loaded for the lifetime of the process, ROOT doesn't support unloading
+      const auto local_path = library_directory() + ROOT_FIT_MODULE_NAME;
+      void *handle = dlopen(local_path.c_str(), RTLD_NOW | RTLD_LOCAL);
+      if (!handle) {
+        handle = dlopen(ROOT_FIT_MODULE_NAME, RTLD_NOW | RTLD_LOCAL);
+      }
+
+      if (!handle) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": ROOT fitting module not available: " << dlerror();
+        throw std::runtime_error(message.str());
+      }
+
+      typedef root_fit_module_t *(*entry_t)();
+      auto entry = reinterpret_cast<entry_t>(dlsym(handle, DIGITIZERS_ROOT_FIT_MODULE_ENTRY));
+      if (!entry) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid ROOT fitting module: " << dlerror();
+        throw std::runtime_error(message.str());
+      }
+
+      module = entry();
+      return *module;
+    }
+
+  } // namespace digitizers
+} // namespace gr
@@ -0,0 +1,124 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+// ROOT fitting module, built as a separate shared object and loaded on demand (see
+// root_fit_module.h). Not part of the gnuradio-digitizers library.
+
+#include "root_fit_module.h"
+
+#include <TF1.h>
+#include <TGraphErrors.h>
+#include <RVersion.h>
+#include <TROOT.h>
+#include <Math/MinimizerOptions.h>
+
+#include <algorithm>
+
+namespace gr {
+  namespace digitizers {
+
+    class root_fitter_impl_t : public root_fitter_t
+    {
+    public:
+
+      root_fitter_impl_t(const TF1 &func, const std::vector<float> &xvals)
+        : d_func(func),
+          d_samps(static_cast<Int_t>(xvals.size()))
+      {
+        std::copy(xvals.begin(), xvals.end(), d_samps.GetX());
+      }
+
+      root_fitter_impl_t(const root_fitter_impl_t &other)
+        : d_func(other.d_func),
+          d_samps(other.d_samps.GetN())
+      {
+        std::copy(other.d_samps.GetX(), other.d_samps.GetX() + other.d_samps.GetN(), d_samps.GetX());
+      }
+
+      std::unique_ptr<root_fitter_t> clone() const override
+      {
+        return std::unique_ptr<root_fitter_t>(new root_fitter_impl_t(*this));
+      }
+
+      void set_data(const float *y) override
+      {
+        std::copy(y, y + d_samps.GetN(), d_samps.GetY());
+      }
+
+      int fit(const std::vector<double> &start_values, const std::vector<bool> &fixed,
+              const std::vector<double> &lower_limits, const std::vector<double> &upper_limits,
+              std::vector<double> &solution, std::vector<double> &errors, double &chi_square, int &ndf) override
+      {
+        const auto n_params = static_cast<int>(start_values.size());
+
+        for (int i = 0; i < n_params; i++) {
+          d_func.SetParameter(i, start_values[i]);
+          d_func.SetParLimits(i, lower_limits[i], upper_limits[i]);
+          if (fixed[i]) {
+            d_func.FixParameter(i, start_values[i]);
+          }
+        }
+
+        const Char_t *fitterOptions = "0NEQR";
+        const int status = d_samps.Fit(&d_func, fitterOptions);
+
+        solution.resize(n_params);
+        errors.resize(n_params);
+        for (int i = 0; i < n_params; i++) {
+          solution[i] = d_func.GetParameter(i);
+          errors[i] = d_func.GetParError(i);
+        }
+        chi_square = d_func.GetChisquare();
+        ndf = d_func.GetNDF();
+
+        return status;
+      }
+
+    private:
+      TF1 d_func;
+      TGraphErrors d_samps;
+    };
+
+    class root_fit_module_impl_t : public root_fit_module_t
+    {
+    public:
+
+      bool enable_thread_safety() override
+      {
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,6,0)
+        static const bool enabled = []() {
+          ROOT::EnableThreadSafety();
+          // TMinuit (the default) relies on a global instance
+          ROOT::Math::MinimizerOptions::SetDefaultMinimizer("Minuit2");
+          return true;
+        }();
+        return enabled;
+#else
+        return false;
+#endif
+      }
+
+      std::unique_ptr<root_fitter_t> make_fitter(const std::string &formula, double lower_limit,
+              double upper_limit, const std::vector<std::string> &par_names, const std::vector<float> &xvals) override
+      {
+        TF1 func("func", formula.c_str(), lower_limit, upper_limit);
+        for (size_t i = 0; i < par_names.size(); i++) {
+          func.SetParName(static_cast<Int_t>(i), par_names[i].c_str());
+        }
+
+        return std::unique_ptr<root_fitter_t>(new root_fitter_impl_t(func, xvals));
+      }
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+extern "C" __attribute__((visibility("default"))) gr::digitizers::root_fit_module_t *
+digitizers_root_fit_module()
+{
+  static gr::digitizers::root_fit_module_impl_t module;
+  return &module;
+}
@@ -0,0 +1,84 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_ROOT_FIT_MODULE_H
+#define INCLUDED_DIGITIZERS_ROOT_FIT_MODULE_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Fits a formula interpreted by ROOT (TF1) to the samples of a vector, see
+     * chi_square_fit. Each instance is used by a single thread at a time.
+     */
+    class root_fitter_t
+    {
+    public:
+
+      virtual ~root_fitter_t() {}
+
+      /*!
+       * \brief Returns an independent fitter of the same formula and x values, e.g. for
+       * another thread. Cheaper than interpreting the formula again.
+       */
+      virtual std::unique_ptr<root_fitter_t> clone() const = 0;
+
+      /*!
+       * \brief Sets the samples (y values) to be fitted, as many as x values.
+       */
+      virtual void set_data(const float *y) = 0;
+
+      /*!
+       * \brief Fits the formula starting at the given parameters, fixed parameters keep their
+       * start values. Returns the fit status, 0 if converged (see TGraph::Fit).
+       */
+      virtual int fit(const std::vector<double> &start_values, const std::vector<bool> &fixed,
+              const std::vector<double> &lower_limits, const std::vector<double> &upper_limits,
+              std::vector<double> &solution, std::vector<double> &errors, double &chi_square, int &ndf) = 0;
+    };
+
+    /*!
+     * \brief Entry point of the ROOT fitting module (libgnuradio-digitizers-root).
+     *
+     * The module is the only part of the library linked against ROOT. It is loaded on demand,
+     * i.e. processes not fitting interpreted formulas never load ROOT (see root_fit_module).
+     */
+    class root_fit_module_t
+    {
+    public:
+
+      virtual ~root_fit_module_t() {}
+
+      /*!
+       * \brief Prepares ROOT for concurrent fits, once per process. Returns false if the ROOT
+       * version doesn't support it.
+       */
+      virtual bool enable_thread_safety() = 0;
+
+      virtual std::unique_ptr<root_fitter_t> make_fitter(const std::string &formula, double lower_limit,
+              double upper_limit, const std::vector<std::string> &par_names, const std::vector<float> &xvals) = 0;
+    };
+
+    /*!
+     * \brief Loads the module on first use, thread safe. The module is looked up next to the
+     * library and then in the default library search path.
+     *
+     * Throws std::runtime_error if the module isn't installed (the library was built without
+     * ROOT) or can't be loaded.
+     */
+    root_fit_module_t &root_fit_module();
+
+  } // namespace digitizers
+} // namespace gr
+
+// Exported by the module, resolved with dlsym
+#define DIGITIZERS_ROOT_FIT_MODULE_ENTRY "digitizers_root_fit_module"
+
+#endif /* INCLUDED_DIGITIZERS_ROOT_FIT_MODULE_H */
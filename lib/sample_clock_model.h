@@ -0,0 +1,168 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_SAMPLE_CLOCK_MODEL_H
+#define INCLUDED_DIGITIZERS_SAMPLE_CLOCK_MODEL_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Reconstructs sample timestamps from the sample counter.
+     *
+     * The time of sample n is modeled as t_ref + (n - n_ref) * T, where T is the actual sample
+     * interval. The model is disciplined by a second order PLL against the host time observed
+     * when samples are received (e.g. at callback time): each observation corrects the phase by
+     * a fraction of the error and the sample interval by a smaller fraction. The digitizer
+     * clock drift is therefore tracked while the poll jitter is filtered out.
+     *
+     * Note the host time is observed after the samples were acquired, hence the timestamps
+     * include the average acquisition-to-callback latency but not its jitter.
+     *
+     * If the error exceeds the resync threshold (e.g. after a stall or lost data) the phase is
+     * reset to the observation.
+     */
+    class sample_clock_model_t
+    {
+    public:
+
+      sample_clock_model_t()
+        : d_nominal_interval_ns(0.0),
+          d_phase_gain(DEFAULT_PHASE_GAIN),
+          d_frequency_gain(DEFAULT_FREQUENCY_GAIN),
+          d_resync_threshold_ns(DEFAULT_RESYNC_THRESHOLD_NS),
+          d_interval_ns(0.0),
+          d_ref_time_ns(0),
+          d_ref_sample(0),
+          d_synced(false),
+          d_error_ns(0.0),
+          d_resync_count(0)
+      {
+      }
+
+      // Critically damped loop, the jitter is averaged over roughly 1 / phase_gain observations
+      static constexpr double DEFAULT_PHASE_GAIN = 0.01;
+      static constexpr double DEFAULT_FREQUENCY_GAIN = DEFAULT_PHASE_GAIN * DEFAULT_PHASE_GAIN / 4.0;
+      static constexpr double DEFAULT_RESYNC_THRESHOLD_NS = 10000000.0;
+
+      // Sample interval is allowed to deviate from the nominal value for up to 500 ppm
+      static constexpr double MAX_INTERVAL_DEVIATION = 0.0005;
+
+      /*!
+       * \brief Resets the model, the first observation defines the phase.
+       */
+      void reset(double nominal_interval_ns,
+              double phase_gain=DEFAULT_PHASE_GAIN,
+              double frequency_gain=DEFAULT_FREQUENCY_GAIN,
+              double resync_threshold_ns=DEFAULT_RESYNC_THRESHOLD_NS)
+      {
+        d_nominal_interval_ns = nominal_interval_ns;
+        d_phase_gain = phase_gain;
+        d_frequency_gain = frequency_gain;
+        d_resync_threshold_ns = resync_threshold_ns;
+        d_interval_ns = nominal_interval_ns;
+        d_ref_time_ns = 0;
+        d_ref_sample = 0;
+        d_synced = false;
+        d_error_ns = 0.0;
+        d_resync_count = 0;
+      }
+
+      /*!
+       * \brief Feeds an observation: sample_count samples were received by host time host_time_ns.
+       */
+      void update(uint64_t sample_count, uint64_t host_time_ns)
+      {
+        if (!d_synced) {
+          resync(sample_count, host_time_ns);
+          return;
+        }
+
+        // Note, absolute times don't fit into double precision, only differences are
+        const double elapsed = static_cast<double>(sample_count) - static_cast<double>(d_ref_sample);
+        const double predicted = elapsed * d_interval_ns;
+        const double error = static_cast<double>(static_cast<int64_t>(host_time_ns - d_ref_time_ns)) - predicted;
+
+        if (std::fabs(error) > d_resync_threshold_ns) {
+          resync(sample_count, host_time_ns);
+          d_resync_count++;
+          return;
+        }
+
+        d_ref_time_ns += static_cast<int64_t>(std::llround(predicted + d_phase_gain * error));
+        d_ref_sample = sample_count;
+
+        if (elapsed > 0.0) {
+          const double max_deviation = d_nominal_interval_ns * MAX_INTERVAL_DEVIATION;
+          d_interval_ns += d_frequency_gain * error / elapsed;
+          d_interval_ns = std::min(std::max(d_interval_ns, d_nominal_interval_ns - max_deviation),
+                  d_nominal_interval_ns + max_deviation);
+        }
+
+        // smoothed absolute error, for diagnostics
+        d_error_ns += 0.05 * (std::fabs(error) - d_error_ns);
+      }
+
+      /*!
+       * \brief Modeled host time (UTC nanoseconds) the given sample was acquired at.
+       */
+      uint64_t get_timestamp(uint64_t sample) const
+      {
+        const double elapsed = static_cast<double>(sample) - static_cast<double>(d_ref_sample);
+        return d_ref_time_ns + static_cast<int64_t>(std::llround(elapsed * d_interval_ns));
+      }
+
+      bool is_synced() const
+      {
+        return d_synced;
+      }
+
+      double get_interval_ns() const
+      {
+        return d_interval_ns;
+      }
+
+      double get_error_ns() const
+      {
+        return d_error_ns;
+      }
+
+      uint64_t get_resync_count() const
+      {
+        return d_resync_count;
+      }
+
+    private:
+
+      void resync(uint64_t sample_count, uint64_t host_time_ns)
+      {
+        d_ref_time_ns = host_time_ns;
+        d_ref_sample = sample_count;
+        d_synced = true;
+      }
+
+      double d_nominal_interval_ns;
+      double d_phase_gain;
+      double d_frequency_gain;
+      double d_resync_threshold_ns;
+
+      double d_interval_ns;
+      uint64_t d_ref_time_ns;
+      uint64_t d_ref_sample;
+      bool d_synced;
+
+      double d_error_ns;
+      uint64_t d_resync_count;
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_SAMPLE_CLOCK_MODEL_H */
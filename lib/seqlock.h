@@ -0,0 +1,72 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_SEQLOCK_H
+#define INCLUDED_DIGITIZERS_SEQLOCK_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Single writer sequence lock holding a trivially copyable value.
+     *
+     * The writer never blocks nor waits. Readers retry if the value was modified while being
+     * copied, i.e. reads are wait-free as long as the value is not written continuously.
+     */
+    template <typename T>
+    class seqlock_t
+    {
+      static_assert(std::is_trivially_copyable<T>::value, "value must be trivially copyable");
+
+    public:
+
+      seqlock_t()
+        : d_seq(0),
+          d_value()
+      {
+      }
+
+      void store(const T &value)
+      {
+        auto seq = d_seq.load(std::memory_order_relaxed);
+        d_seq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        std::memcpy(&d_value, &value, sizeof(T));
+
+        d_seq.store(seq + 2, std::memory_order_release);
+      }
+
+      T load() const
+      {
+        T value;
+        uint32_t seq_before, seq_after;
+
+        do {
+          seq_before = d_seq.load(std::memory_order_acquire);
+          std::memcpy(&value, &d_value, sizeof(T));
+          std::atomic_thread_fence(std::memory_order_acquire);
+          seq_after = d_seq.load(std::memory_order_relaxed);
+        } while ((seq_before & 1) || seq_before != seq_after);
+
+        return value;
+      }
+
+    private:
+
+      std::atomic<uint32_t> d_seq;
+      T d_value;
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_SEQLOCK_H */
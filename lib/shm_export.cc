@@ -0,0 +1,192 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "shm_export.h"
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+namespace gr {
+  namespace digitizers {
+
+    // Slots and the arrays within are cache line aligned
+    static const size_t SHM_EXPORT_ALIGNMENT = 64;
+
+    static size_t
+    align_up(size_t size)
+    {
+      return (size + SHM_EXPORT_ALIGNMENT - 1) / SHM_EXPORT_ALIGNMENT * SHM_EXPORT_ALIGNMENT;
+    }
+
+    // Fields shared with the consumers are accessed atomically, the layout is plain integers
+    template <typename T>
+    static std::atomic<T> &
+    as_atomic(T &value)
+    {
+      static_assert(sizeof(std::atomic<T>) == sizeof(T), "atomic must be lock free");
+      return reinterpret_cast<std::atomic<T> &>(value);
+    }
+
+    shm_export_t::shm_export_t()
+      : d_header(nullptr),
+        d_size(0),
+        d_sequence(0)
+    {
+    }
+
+    shm_export_t::~shm_export_t()
+    {
+      close();
+    }
+
+    void
+    shm_export_t::open(const std::string &name, shm_export_kind_t kind, const std::string &signal_name,
+            size_t nslots, size_t max_values, size_t max_errors)
+    {
+      close();
+
+      if (nslots == 0 || max_values > std::numeric_limits<uint32_t>::max()
+              || max_errors > std::numeric_limits<uint32_t>::max()) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid shared memory export size, slots: "
+                << nslots << ", values: " << max_values << ", errors: " << max_errors;
+        throw std::invalid_argument(message.str());
+      }
+
+      const size_t values_offset = align_up(sizeof(shm_export_slot_t));
+      const size_t errors_offset = values_offset + align_up(max_values * sizeof(float));
+      const size_t slot_size = errors_offset + align_up(max_errors * sizeof(float));
+      const size_t slots_offset = align_up(sizeof(shm_export_header_t));
+      const size_t size = slots_offset + nslots * slot_size;
+
+      // Consumers still mapping a previous object keep it, the new one is created from scratch
+      shm_unlink(name.c_str());
+      int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+      void *addr = MAP_FAILED;
+      if (fd >= 0 && ftruncate(fd, static_cast<off_t>(size)) == 0) {
+        addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      }
+      auto error = errno;
+
+      if (fd >= 0) {
+        ::close(fd);
+      }
+
+      if (addr == MAP_FAILED) {
+        if (fd >= 0) {
+          shm_unlink(name.c_str());
+        }
+
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": failed to create shared memory "
+                << name << ": " << strerror(error);
+        throw std::runtime_error(message.str());
+      }
+
+      // Freshly created object is zeroed
+      d_header = static_cast<shm_export_header_t *>(addr);
+      d_size = size;
+      d_name = name;
+      d_sequence = 0;
+
+      strncpy(d_header->magic, "DIGISHM", sizeof(d_header->magic));
+      d_header->version = SHM_EXPORT_VERSION;
+      d_header->header_size = sizeof(shm_export_header_t);
+      d_header->kind = kind;
+      d_header->nslots = static_cast<uint32_t>(nslots);
+      d_header->slot_size = slot_size;
+      d_header->slots_offset = slots_offset;
+      d_header->values_offset = static_cast<uint32_t>(values_offset);
+      d_header->errors_offset = static_cast<uint32_t>(errors_offset);
+      d_header->max_values = static_cast<uint32_t>(max_values);
+      d_header->max_errors = static_cast<uint32_t>(max_errors);
+      strncpy(d_header->name, signal_name.c_str(), sizeof(d_header->name) - 1);
+
+      for (size_t i = 0; i < nslots; i++) {
+        auto slot = reinterpret_cast<shm_export_slot_t *>(reinterpret_cast<char *>(d_header)
+                + slots_offset + i * slot_size);
+        slot->sequence = std::numeric_limits<uint64_t>::max();
+      }
+      std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    void
+    shm_export_t::close()
+    {
+      if (!d_header) {
+        return;
+      }
+
+      munmap(d_header, d_size);
+      shm_unlink(d_name.c_str());
+      d_header = nullptr;
+      d_size = 0;
+    }
+
+    shm_export_slot_t *
+    shm_export_t::begin_write()
+    {
+      auto slot = reinterpret_cast<shm_export_slot_t *>(reinterpret_cast<char *>(d_header)
+              + d_header->slots_offset + (d_sequence % d_header->nslots) * d_header->slot_size);
+
+      // Readers of the previous content detect the change, see shm_export_header_t
+      as_atomic(slot->sequence).store(std::numeric_limits<uint64_t>::max(), std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+      return slot;
+    }
+
+    void
+    shm_export_t::commit(shm_export_slot_t *slot, const measurement_info_t &info, size_t nvalues, size_t nerrors)
+    {
+      slot->nvalues = static_cast<uint32_t>(nvalues);
+      slot->nerrors = static_cast<uint32_t>(nerrors);
+      slot->info = info;
+
+      as_atomic(slot->sequence).store(d_sequence, std::memory_order_release);
+      d_sequence++;
+      as_atomic(d_header->write_sequence).store(d_sequence, std::memory_order_release);
+      as_atomic(d_header->futex).fetch_add(1);
+
+      // The syscall is skipped unless someone waits
+      if (as_atomic(d_header->waiters).load() != 0) {
+        syscall(SYS_futex, &d_header->futex, FUTEX_WAKE, std::numeric_limits<int>::max(),
+                nullptr, nullptr, 0);
+      }
+    }
+
+    void
+    shm_export_t::publish(const measurement_info_t &info, const float *values, size_t nvalues,
+            const float *errors, size_t nerrors)
+    {
+      nvalues = std::min(nvalues, max_values());
+      nerrors = errors ? std::min(nerrors, max_errors()) : 0;
+
+      auto slot = begin_write();
+      memcpy(this->values(slot), values, nvalues * sizeof(float));
+      if (nerrors) {
+        memcpy(this->errors(slot), errors, nerrors * sizeof(float));
+      }
+      commit(slot, info, nvalues, nerrors);
+    }
+
+  } /* namespace digitizers */
+} /* namespace gr */
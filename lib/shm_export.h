@@ -0,0 +1,104 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_SHM_EXPORT_H
+#define INCLUDED_DIGITIZERS_SHM_EXPORT_H
+
+#include <digitizers/sink_common.h>
+#include <boost/noncopyable.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Writer side of a shared memory export, see shm_export_header_t for the layout and
+     * the consumer protocol.
+     *
+     * The writer is meant to be used by a single thread (the work function). Publishing never
+     * blocks, the futex is woken only if consumers are waiting.
+     */
+    class shm_export_t : boost::noncopyable
+    {
+    public:
+
+      shm_export_t();
+
+      ~shm_export_t();
+
+      /*!
+       * \brief Creates (or replaces) the shared memory object, a previously opened one is closed.
+       * Throws std::runtime_error on failure.
+       *
+       * \param name object name as passed to shm_open, e.g. "/digitizer_ch1"
+       * \param kind content, see shm_export_kind_t
+       * \param signal_name stored in the header
+       * \param nslots number of slots
+       * \param max_values capacity of a slot in values
+       * \param max_errors capacity of a slot in errors
+       */
+      void open(const std::string &name, shm_export_kind_t kind, const std::string &signal_name,
+              size_t nslots, size_t max_values, size_t max_errors);
+
+      /*!
+       * \brief Unmaps and unlinks the object, consumers keep their mappings.
+       */
+      void close();
+
+      bool is_open() const
+      {
+        return d_header != nullptr;
+      }
+
+      /*!
+       * \brief Marks the next slot as being written, the data is written in place (see values
+       * and errors) and published by commit.
+       */
+      shm_export_slot_t *begin_write();
+
+      float *values(shm_export_slot_t *slot) const
+      {
+        return reinterpret_cast<float *>(reinterpret_cast<char *>(slot) + d_header->values_offset);
+      }
+
+      float *errors(shm_export_slot_t *slot) const
+      {
+        return reinterpret_cast<float *>(reinterpret_cast<char *>(slot) + d_header->errors_offset);
+      }
+
+      void commit(shm_export_slot_t *slot, const measurement_info_t &info, size_t nvalues, size_t nerrors);
+
+      /*!
+       * \brief Copies the data into the next slot and publishes it, sizes beyond the capacity are
+       * truncated.
+       */
+      void publish(const measurement_info_t &info, const float *values, size_t nvalues,
+              const float *errors, size_t nerrors);
+
+      size_t max_values() const
+      {
+        return d_header ? d_header->max_values : 0;
+      }
+
+      size_t max_errors() const
+      {
+        return d_header ? d_header->max_errors : 0;
+      }
+
+    private:
+      std::string d_name;
+      shm_export_header_t *d_header;
+      size_t d_size;
+      uint64_t d_sequence;
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_SHM_EXPORT_H */
@@ -12,23 +12,29 @@
 #include "signal_averager_impl.h"
 #include <digitizers/tags.h>
 #include <boost/optional.hpp>
+#include <volk/volk.h>
+#include "utils.h"
+
+#include <algorithm>
 
 namespace gr {
   namespace digitizers {
 
     signal_averager::sptr
-    signal_averager::make(int num_inputs, int window_size, float samp_rate)
+    signal_averager::make(int num_inputs, int window_size, float samp_rate, bool raw_input)
     {
       return gnuradio::get_initial_sptr
-        (new signal_averager_impl(num_inputs, window_size, samp_rate));
+        (new signal_averager_impl(num_inputs, window_size, samp_rate, raw_input));
     }
 
-    signal_averager_impl::signal_averager_impl(int num_inputs, int window_size, float samp_rate)
+    signal_averager_impl::signal_averager_impl(int num_inputs, int window_size, float samp_rate, bool raw_input)
       : gr::sync_decimator("signal_averager",
-              gr::io_signature::make(num_inputs, num_inputs, sizeof(float)),
+              gr::io_signature::make(num_inputs, num_inputs, raw_input ? sizeof(int16_t) : sizeof(float)),
               gr::io_signature::make(num_inputs, num_inputs, sizeof(float)),
               window_size),
-        d_num_ports(num_inputs)
+        d_num_ports(num_inputs),
+        d_raw_input(raw_input),
+        d_raw_scaling(num_inputs, default_raw_scaling())
     {
       set_tag_propagation_policy(tag_propagation_policy_t::TPP_CUSTOM);
 
@@ -40,64 +46,110 @@ namespace gr {
     {
     }
 
+    bool
+    signal_averager_impl::start()
+    {
+      std::fill(d_raw_scaling.begin(), d_raw_scaling.end(), default_raw_scaling());
+      return true;
+    }
+
+    // Sum of the raw samples, int32 partial sums can't overflow within 65536 samples. The inner
+    // loop is vectorized by the compiler, twice as many samples per vector as with floats.
+    static int64_t
+    sum_raw(const int16_t *in, unsigned nsamples)
+    {
+      static const unsigned MAX_PARTIAL = 65536;
+
+      int64_t sum = 0;
+      while (nsamples) {
+        const unsigned n = std::min(nsamples, MAX_PARTIAL);
+        int32_t partial = 0;
+        for (unsigned i = 0; i < n; i++) {
+          partial += in[i];
+        }
+        sum += partial;
+        in += n;
+        nsamples -= n;
+      }
+      return sum;
+    }
+
+    void
+    signal_averager_impl::average(int noutput_items, const float *in, float *out)
+    {
+      const unsigned decim = decimation();
+      const float scale = 1.0f / static_cast<float>(decim);
+
+      if (decim >= MIN_VECTORIZED_WINDOW) {
+        for(int i_out = 0; i_out < noutput_items; i_out++) {
+          float sum;
+          volk_32f_accumulator_s32f(&sum, in + i_out * decim, decim);
+          out[i_out] = sum * scale;
+        }
+      }
+      else {
+        for(int i_out = 0; i_out < noutput_items; i_out++) {
+          const float *window = in + i_out * decim;
+          float sum = 0.0f;
+          for(unsigned i = 0; i < decim; i++)
+            sum += window[i];
+          out[i_out] = sum * scale;
+        }
+      }
+    }
+
+    void
+    signal_averager_impl::average_raw(int port, int noutput_items, const int16_t *in, float *out,
+            const std::vector<gr::tag_t> &tags)
+    {
+      const unsigned decim = decimation();
+
+      apply_raw_scaling(tags, nitems_read(port), decim, noutput_items, d_raw_scaling[port],
+              [decim, in, out](int first, int nitems, const raw_scaling_t &scaling) {
+        // scale applied once per output, in double precision (sums up to 2^47)
+        const double scale = scaling.scale / decim;
+        for (int i_out = first; i_out < first + nitems; i_out++) {
+          const auto sum = sum_raw(in + static_cast<size_t>(i_out) * decim, decim);
+          out[i_out] = static_cast<float>(sum * scale + scaling.offset);
+        }
+      });
+    }
+
     int
     signal_averager_impl::work(int noutput_items,
         gr_vector_const_void_star &input_items,
         gr_vector_void_star &output_items)
     {
-      unsigned decim = decimation();
+      block_stats_scope_t stats(d_stats);
+      const unsigned decim = decimation();
+
       for(int port = 0; port < d_num_ports; port++)
       {
         float *out = (float *) output_items[port];
-        const float *in = (const float *) input_items[port];
-        int i_in = 0, i_out = 0;
-        for(i_out = 0; i_out < noutput_items; i_out++)
-        {
-          float sum = 0.0f;
-          for(unsigned temp = 0; temp < decim; temp++)
-            sum += in[i_in + temp];
-
-          out[i_out] = sum / static_cast<float>(decim);
-
-          std::vector<gr::tag_t> tags;
-          get_tags_in_range(tags, port, nitems_read(port) + i_in, nitems_read(port) + i_in + decim );
-          // required to merge acq_infotags due to this bug: https://github.com/gnuradio/gnuradio/issues/2364
-          // otherwise we will eat to much memory
-          // TODO: Fix bug in gnuradio (https://gitlab.com/al.schwinn/gr-digitizers/issues/33)
-          acq_info_t merged_acq_info;
-          merged_acq_info.status = 0;
-          bool found_acq_info = false;
-          for(auto tag : tags)
-          {
-              //std::cout << "tag found: " << tag.key << std::endl;
-              if(tag.key == pmt::string_to_symbol(trigger_tag_name))
-              {
-                  trigger_t trigger_tag_data = decode_trigger_tag(tag);
-
-//                  std::cout << "tag.offset: " << tag.offset << std::endl;
-//                  std::cout << "nitems_read(port): " << nitems_read(port) << std::endl;
-//                  std::cout << "i_in: " << i_in << std::endl;
-//                  std::cout << "decim/2: " << decim/2 << std::endl;
-
-                  add_item_tag(port, make_trigger_tag(trigger_tag_data, nitems_written(port) + i_out));
-                  //std::cout << "trigger tag added" << std::endl;
-              }
-              else if(tag.key == pmt::string_to_symbol(acq_info_tag_name))
-              {
-                  found_acq_info = true;
-                  merged_acq_info.status |= decode_acq_info_tag(tag).status;
-              }
-              else
-              {
-                  tag.offset = nitems_written(port) + i_out;
-                  add_item_tag(port, tag);
-              }
-          }
-          if(found_acq_info)
-              add_item_tag(port, make_acq_info_tag(merged_acq_info, nitems_written(port) + i_out));
 
-          i_in += decim;
+        // a single tag query per work call and port
+        auto &tags = d_tags;
+        tags.clear();
+        get_tags_in_range(tags, port, nitems_read(port), nitems_read(port) + noutput_items * decim);
+
+        if (d_raw_input) {
+          std::stable_sort(tags.begin(), tags.end(), gr::tag_t::offset_compare);
+          average_raw(port, noutput_items, (const int16_t *) input_items[port], out, tags);
         }
+        else {
+          average(noutput_items, (const float *) input_items[port], out);
+        }
+
+        decimate_tags(tags, nitems_read(port), nitems_written(port), decim,
+                [this, port](const gr::tag_t &tag) {
+          // the output is in volts, the error estimate is what remains of the scaling
+          if (d_raw_input && get_tag_kind(tag) == TAG_KIND_RAW_SCALING) {
+            add_item_tag(port, make_constant_error_tag(decode_raw_scaling_tag(tag).error, tag.offset));
+          }
+          else {
+            add_item_tag(port, tag);
+          }
+        });
       }
       return noutput_items;
     }
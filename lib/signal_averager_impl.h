@@ -8,6 +8,10 @@
 #define INCLUDED_DIGITIZERS_SIGNAL_AVERAGER_IMPL_H
 
 #include <digitizers/signal_averager.h>
+#include <digitizers/tags.h>
+#include "block_stats_impl.h"
+
+#include <vector>
 
 namespace gr {
   namespace digitizers {
@@ -15,16 +19,35 @@ namespace gr {
     class signal_averager_impl : public signal_averager
     {
      private:
+      // windows shorter than this are summed by a plain loop, the volk call doesn't pay off
+      static const unsigned MIN_VECTORIZED_WINDOW = 16;
+
       int d_num_ports;
       int64_t d_sample_sample_distance_input_ns; // sample to sample distance on input ports in nanoseconds
 
+      bool d_raw_input;
+      std::vector<raw_scaling_t> d_raw_scaling;  // per port, raw input only
+
+      // Reused in order to avoid allocations per work call
+      std::vector<gr::tag_t> d_tags;
+
+      block_stats_recorder_t d_stats {this};
+
      public:
-      signal_averager_impl(int num_inputs, int window_size, float samp_rate);
+      signal_averager_impl(int num_inputs, int window_size, float samp_rate, bool raw_input);
       ~signal_averager_impl();
 
+      bool start() override;
+
       int work(int noutput_items,
          gr_vector_const_void_star &input_items,
          gr_vector_void_star &output_items);
+
+     private:
+      void average(int noutput_items, const float *in, float *out);
+
+      void average_raw(int port, int noutput_items, const int16_t *in, float *out,
+              const std::vector<gr::tag_t> &tags);
     };
 
   } // namespace digitizers
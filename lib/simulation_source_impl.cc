@@ -10,12 +10,23 @@
 
 #include <gnuradio/io_signature.h>
 #include "simulation_source_impl.h"
-#include <future>
 #include <digitizers/status.h>
+#include "conversion_kernel.h"
+#include "probes.h"
+#include "thread_registry.h"
 
 namespace gr {
   namespace digitizers {
 
+    // Full scale of the generated raw samples, same as for the 16-bit PicoScopes
+    static const int16_t SIMULATION_MAX_RAW = 32767;
+
+    // Upper bound of the generated waveform period, lower frequencies are approximated
+    static const size_t SIMULATION_MAX_PERIOD = 1 << 22;
+
+    // Generated noise repeats after this many samples
+    static const size_t SIMULATION_NOISE_PERIOD = 1 << 16;
+
     simulation_source::sptr
     simulation_source::make()
     {
@@ -30,7 +41,19 @@ namespace gr {
       : gr::sync_block("simulation_source",
               gr::io_signature::make(0, 0, 0),
               gr::io_signature::makev(1, 5, std::vector<int>({4, 4, 4, 4, 1}))),
-      digitizer_block_impl(2, 1, false)
+      digitizer_block_impl(2, 1, false),
+      d_waveform(SIMULATION_WAVEFORM_DATA),
+      d_amplitude(1.0),
+      d_frequency(1000.0),
+      d_pacing(1.0),
+      d_jitter(0.0),
+      d_overrun_probability(0.0),
+      d_samples_generated(0),
+      d_rng(42),
+      d_injected_overruns(0),
+      d_tmp_buffer(nullptr),
+      d_tmp_buffer_size(0),
+      d_lost_count(0)
     {
       d_ranges.push_back(range_t(20));
 
@@ -45,6 +68,8 @@ namespace gr {
      */
     simulation_source_impl::~simulation_source_impl()
     {
+      d_rapid_block_timer.interrupt();
+      d_rapid_block_timer.join();
     }
 
     void
@@ -70,6 +95,54 @@ namespace gr {
       d_port_data = port_vec;
     }
 
+    void
+    simulation_source_impl::set_stream_generator(simulation_waveform_t waveform, float amplitude,
+            float frequency)
+    {
+      if (amplitude < 0 || (waveform != SIMULATION_WAVEFORM_DATA && !(frequency > 0))) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid generator settings, amplitude: "
+                << amplitude << ", frequency: " << frequency;
+        throw std::invalid_argument(message.str());
+      }
+
+      d_waveform = waveform;
+      d_amplitude = amplitude;
+      d_frequency = frequency;
+    }
+
+    void
+    simulation_source_impl::set_stream_pacing(float rate_factor)
+    {
+      if (rate_factor < 0) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid pacing: " << rate_factor;
+        throw std::invalid_argument(message.str());
+      }
+
+      d_pacing = rate_factor;
+    }
+
+    void
+    simulation_source_impl::set_stream_faults(float jitter, float overrun_probability)
+    {
+      if (jitter < 0 || jitter > 1 || overrun_probability < 0 || overrun_probability > 1) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid faults, jitter: "
+                << jitter << ", overrun probability: " << overrun_probability;
+        throw std::invalid_argument(message.str());
+      }
+
+      d_jitter = jitter;
+      d_overrun_probability = overrun_probability;
+    }
+
+    uint64_t
+    simulation_source_impl::get_injected_overruns() const
+    {
+      return d_injected_overruns.load(std::memory_order_relaxed);
+    }
+
     std::vector<std::string>
     simulation_source_impl::get_aichan_ids()
     {
@@ -103,6 +176,9 @@ namespace gr {
     std::error_code
     simulation_source_impl:: driver_configure()
     {
+      // The application buffer is (re)initialized, a chunk being assembled is gone
+      d_tmp_buffer = nullptr;
+      d_tmp_buffer_size = 0;
       return std::error_code{};
     }
 
@@ -110,12 +186,25 @@ namespace gr {
     simulation_source_impl::driver_arm()
     {
       if (d_acquisition_mode == acquisition_mode_t::RAPID_BLOCK) {
-        // rapid block data gets available after one second
-        std::async(std::launch::async, [this] () {
+        // rapid block data gets available after one second, disarm cancels it
+        d_rapid_block_timer.interrupt();
+        d_rapid_block_timer.join();
+        d_rapid_block_timer = boost::thread([this] () {
+          thread_scope_t thread(get_block_name(this), "rapid-block");
           boost::this_thread::sleep_for(boost::chrono::seconds{1});
           notify_data_ready(std::error_code{});
         });
       }
+      else if (d_waveform != SIMULATION_WAVEFORM_DATA) {
+        generate_period();
+
+        // A partially filled chunk is reused
+        d_tmp_buffer_size = 0;
+        d_lost_count = 0;
+        d_samples_generated = 0;
+        d_injected_overruns.store(0, std::memory_order_relaxed);
+        d_stream_start = boost::chrono::high_resolution_clock::now();
+      }
 
       return std::error_code{};
     }
@@ -123,6 +212,8 @@ namespace gr {
     std::error_code
     simulation_source_impl::driver_disarm()
     {
+      d_rapid_block_timer.interrupt();
+      d_rapid_block_timer.join();
       return std::error_code{};
     }
 
@@ -138,6 +229,13 @@ namespace gr {
       return std::error_code{};
     }
 
+    std::error_code
+    simulation_source_impl::driver_prefetch_blocks(size_t length, size_t first_block, size_t nr_blocks)
+    {
+      // all the waveforms are the same and always at hand
+      return std::error_code{};
+    }
+
     std::error_code
     simulation_source_impl::driver_get_rapid_block_data(size_t offset, size_t length, size_t waveform,
                   gr_vector_void_star &arrays, std::vector<uint32_t> &status)
@@ -168,12 +266,15 @@ namespace gr {
       float *err_b = static_cast<float *>(arrays[3]);
       uint8_t *port  = static_cast<uint8_t *>(arrays[4]);
 
+      const auto &cal_a = get_config_snapshot().config.channels[0];
+      const auto &cal_b = get_config_snapshot().config.channels[1];
+
       for (size_t i = 0; i < length; i++) {
-        val_a[i] = d_ch_a_data[offset + i];
-        err_a[i] = 0.005;
+        val_a[i] = d_ch_a_data[offset + i] * cal_a.calibration_scale - cal_a.calibration_offset;
+        err_a[i] = 0.005 * cal_a.calibration_scale;
 
-        val_b[i] = d_ch_b_data[offset + i];
-        err_b[i] = 0.005;
+        val_b[i] = d_ch_b_data[offset + i] * cal_b.calibration_scale - cal_b.calibration_offset;
+        err_b[i] = 0.005 * cal_b.calibration_scale;
 
         port[i] = d_port_data[offset + i];
       }
@@ -184,6 +285,11 @@ namespace gr {
     std::error_code
     simulation_source_impl::driver_poll()
     {
+      if (d_waveform != SIMULATION_WAVEFORM_DATA) {
+        generate_stream();
+        return std::error_code {};
+      }
+
       for (size_t i = 0; i < 1000; i++) {
         if (fill_in_data_chunk() == false)
             break;
@@ -192,6 +298,25 @@ namespace gr {
       return std::error_code {};
     }
 
+    std::error_code
+    simulation_source_impl::driver_wait_ready(uint64_t timeout_ns)
+    {
+      // Without pacing the data is generated as fast as the application buffer drains,
+      // the recorded data of the DATA waveform as well
+      if (d_waveform == SIMULATION_WAVEFORM_DATA || d_pacing <= 0) {
+        return std::make_error_code(std::errc::operation_not_supported);
+      }
+
+      // Time at which the samples of the next chunk have been acquired
+      const double due_s = static_cast<double>(d_samples_generated + d_buffer_size) / (get_samp_rate() * d_pacing);
+      const auto due = d_stream_start + boost::chrono::duration_cast<boost::chrono::nanoseconds>(
+              boost::chrono::duration<double>(due_s));
+      const auto timeout = boost::chrono::high_resolution_clock::now() + boost::chrono::nanoseconds(timeout_ns);
+
+      boost::this_thread::sleep_until(std::min<boost::chrono::high_resolution_clock::time_point>(due, timeout));
+      return std::error_code {};
+    }
+
     bool
     simulation_source_impl::fill_in_data_chunk()
     {
@@ -207,27 +332,40 @@ namespace gr {
         return false;
       }
 
-      assert(buffer->d_data.size() == buffer_size_bytes);
+      assert(buffer->d_size == buffer_size_bytes);
 
       // just in case
       d_ch_a_data.resize(d_buffer_size);
       d_ch_b_data.resize(d_buffer_size);
       d_port_data.resize(d_buffer_size);
 
-      // fill up tmp buffer
-      memcpy(&buffer->d_data[buffer_size_channel_bytes * 0], &d_ch_a_data[0], buffer_size_channel_bytes);
-      memcpy(&buffer->d_data[buffer_size_channel_bytes * 2], &d_ch_b_data[0], buffer_size_channel_bytes);
-      memcpy(&buffer->d_data[buffer_size_channel_bytes * 4], &d_port_data[0], d_buffer_size);
-
-      // error band
+      // fill up tmp buffer, the data is taken as voltages and calibrated like the raw samples of
+      // the real drivers
+      float *val_a = reinterpret_cast<float *>(&buffer->d_data[buffer_size_channel_bytes * 0]);
       float *err_a = reinterpret_cast<float *>(&buffer->d_data[buffer_size_channel_bytes * 1]);
+      float *val_b = reinterpret_cast<float *>(&buffer->d_data[buffer_size_channel_bytes * 2]);
       float *err_b = reinterpret_cast<float *>(&buffer->d_data[buffer_size_channel_bytes * 3]);
+      const auto &cal_a = get_config_snapshot().config.channels[0];
+      const auto &cal_b = get_config_snapshot().config.channels[1];
+
       for (uint32_t i = 0; i < d_buffer_size; i++) {
-        err_a[i] = 0.005;
-        err_b[i] = 0.005;
+        val_a[i] = d_ch_a_data[i] * cal_a.calibration_scale - cal_a.calibration_offset;
+        err_a[i] = 0.005 * cal_a.calibration_scale;
+        val_b[i] = d_ch_b_data[i] * cal_b.calibration_scale - cal_b.calibration_offset;
+        err_b[i] = 0.005 * cal_b.calibration_scale;
       }
+      memcpy(&buffer->d_data[buffer_size_channel_bytes * 4], &d_port_data[0], d_buffer_size);
 
-      buffer->d_local_timestamp = get_timestamp_nano_utc();
+      // low-latency interlocks, same as evaluated by the real drivers
+      if (has_fast_interlock(0)) {
+        evaluate_fast_interlock(0, val_a, d_buffer_size, d_samples_received);
+      }
+      if (has_fast_interlock(1)) {
+        evaluate_fast_interlock(1, val_b, d_buffer_size, d_samples_received);
+      }
+      d_samples_received += d_buffer_size;
+
+      buffer->d_local_timestamp = get_chunk_timestamp_ns();
       buffer->d_status = std::vector<uint32_t> { 0, 0 };
 
       d_app_buffer.add_full_data_chunk(buffer);
@@ -236,6 +374,200 @@ namespace gr {
     }
 
 
+    void
+    simulation_source_impl::generate_period()
+    {
+      const auto range = d_channel_settings[0].range;
+      const auto amplitude = static_cast<float>(SIMULATION_MAX_RAW)
+              * std::min(d_amplitude / static_cast<float>(range), 1.0f);
+
+      size_t period = SIMULATION_NOISE_PERIOD;
+      if (d_waveform != SIMULATION_WAVEFORM_NOISE) {
+        period = static_cast<size_t>(std::llround(get_samp_rate() / d_frequency));
+        period = std::min(std::max(period, size_t{2}), SIMULATION_MAX_PERIOD);
+      }
+
+      d_period.resize(period);
+
+      std::normal_distribution<float> noise(0.0f, amplitude / 3.0f);
+
+      for (size_t i = 0; i < period; i++) {
+        float value = 0.0f;
+        switch (d_waveform) {
+        case SIMULATION_WAVEFORM_SINE:
+          value = amplitude * std::sin(2.0f * static_cast<float>(M_PI) * i / period);
+          break;
+        case SIMULATION_WAVEFORM_SQUARE:
+          value = i < period / 2 ? amplitude : -amplitude;
+          break;
+        case SIMULATION_WAVEFORM_SAWTOOTH:
+          value = amplitude * (2.0f * i / period - 1.0f);
+          break;
+        case SIMULATION_WAVEFORM_NOISE:
+          value = std::max(-amplitude, std::min(amplitude, noise(d_rng)));
+          break;
+        default:
+          break;
+        }
+        d_period[i] = static_cast<int16_t>(std::lrint(value));
+      }
+    }
+
+    void
+    simulation_source_impl::generate_stream()
+    {
+      // Samples the driver would have acquired since the last poll
+      uint64_t due;
+      if (d_pacing > 0) {
+        boost::chrono::duration<double> elapsed = boost::chrono::high_resolution_clock::now() - d_stream_start;
+        const auto target = static_cast<uint64_t>(elapsed.count() * get_samp_rate() * d_pacing);
+        due = target > d_samples_generated ? target - d_samples_generated : 0;
+
+        // The driver buffer holds at most d_driver_buffer_size samples, the rest is lost the
+        // same way as if the poll thread was late with a real device
+        if (due > d_driver_buffer_size) {
+          d_samples_generated += due - d_driver_buffer_size;
+          d_samples_received += due - d_driver_buffer_size;
+          d_lost_count += static_cast<int>((due - d_driver_buffer_size) / d_buffer_size);
+          due = d_driver_buffer_size;
+        }
+      }
+      else {
+        // As fast as possible, i.e. as fast as the application buffer is drained
+        const auto room = d_app_buffer.get_nr_free_chunks() * d_buffer_size
+                + (d_tmp_buffer != nullptr ? d_buffer_size - d_tmp_buffer_size : 0);
+        due = std::min(static_cast<uint64_t>(room), static_cast<uint64_t>(d_driver_buffer_size));
+      }
+
+      std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+      while (due > 0) {
+        auto nr_samples = static_cast<uint64_t>(d_buffer_size);
+        if (d_jitter > 0) {
+          nr_samples = static_cast<uint64_t>(nr_samples * (1.0f + d_jitter * (2.0f * uniform(d_rng) - 1.0f)));
+        }
+        nr_samples = std::max(std::min(nr_samples, due), uint64_t{1});
+
+        // Driver buffers, channel B is shifted by a quarter of a period
+        const auto period = d_period.size();
+        for (size_t channel = 0; channel < d_raw.size(); channel++) {
+          auto &raw = d_raw[channel];
+          raw.resize(nr_samples);
+
+          size_t phase = (d_samples_generated + channel * (period / 4)) % period;
+          for (size_t i = 0; i < nr_samples; ) {
+            const auto n = std::min(period - phase, nr_samples - i);
+            memcpy(&raw[i], &d_period[phase], n * sizeof(int16_t));
+            i += n;
+            phase = 0;
+          }
+        }
+
+        d_raw_port.resize(nr_samples);
+        for (size_t i = 0; i < nr_samples; i++) {
+          d_raw_port[i] = d_raw[0][i] > 0 ? 1 : 0;
+        }
+
+        int16_t overflow = 0;
+        if (d_overrun_probability > 0 && uniform(d_rng) < d_overrun_probability) {
+          overflow = static_cast<int16_t>(0xFFFF);
+          d_injected_overruns.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        streaming_callback(static_cast<uint32_t>(nr_samples), overflow);
+
+        d_samples_generated += nr_samples;
+        due -= nr_samples;
+      }
+    }
+
+    void
+    simulation_source_impl::streaming_callback(uint32_t nr_samples, int16_t overflow)
+    {
+      DIGITIZERS_PROBE2(streaming_callback, nr_samples, 0);
+
+      // Same structure as the PicoScope streaming callback, see picoscope_impl
+      uint64_t sample_index = d_samples_received;
+      d_samples_received += nr_samples;
+      update_sample_clock(d_samples_received, get_chunk_timestamp_ns());
+
+      if (static_cast<uint16_t>(overflow) == 0xFFFF) {
+        add_event(EVENT_DRIVER_OVERRUN);
+      }
+
+      const auto buffer_size_channel_bytes = d_buffer_size * sizeof(float);
+      uint32_t start_index = 0;
+
+      while (nr_samples > 0) {
+
+        if (d_tmp_buffer_size == 0 && d_tmp_buffer == nullptr) {
+          d_tmp_buffer = d_app_buffer.get_free_data_chunk();
+
+          if (d_tmp_buffer == nullptr) {
+            d_lost_count++;
+            DIGITIZERS_PROBE1(chunk_lost, d_lost_count);
+            const auto lost = std::min(nr_samples, d_buffer_size);
+            nr_samples -= lost;
+            start_index += lost;
+            sample_index += lost;
+            continue;
+          }
+        }
+
+        uint32_t samples_to_convert = std::min(nr_samples, d_buffer_size - d_tmp_buffer_size);
+        if (get_fast_interlock_budget()) {
+          samples_to_convert = std::min(samples_to_convert, get_fast_interlock_budget());
+        }
+        nr_samples -= samples_to_convert;
+
+        // Buffer organization:
+        //   <chan A values> <chan A errors> <chan B values> <chan B errors> <port>
+        auto conversion_start = boost::chrono::high_resolution_clock::now();
+        for (size_t channel = 0; channel < d_raw.size(); channel++) {
+          uint8_t *channel_region = &d_tmp_buffer->d_data[buffer_size_channel_bytes * 2 * channel];
+          float *values = reinterpret_cast<float *>(channel_region) + d_tmp_buffer_size;
+          float *errors = reinterpret_cast<float *>(channel_region + buffer_size_channel_bytes) + d_tmp_buffer_size;
+
+          const auto &settings = get_config_snapshot().config.channels[channel];
+          const float voltage_multiplier = static_cast<float>(settings.range) / SIMULATION_MAX_RAW;
+          raw_convert(&d_raw[channel][start_index], voltage_multiplier * settings.calibration_scale,
+                  settings.calibration_offset, values, samples_to_convert);
+          std::fill(errors, errors + samples_to_convert, 0.005f * settings.calibration_scale);
+
+          if (has_fast_interlock(channel)) {
+            evaluate_fast_interlock(channel, values, samples_to_convert, sample_index);
+          }
+        }
+        auto conversion_duration = boost::chrono::high_resolution_clock::now() - conversion_start;
+        record_conversion_time(boost::chrono::duration_cast<boost::chrono::nanoseconds>(conversion_duration).count(),
+                samples_to_convert * d_raw.size());
+
+        memcpy(&d_tmp_buffer->d_data[buffer_size_channel_bytes * 4] + d_tmp_buffer_size,
+                &d_raw_port[start_index], samples_to_convert);
+
+        d_tmp_buffer_size += samples_to_convert;
+        start_index += samples_to_convert;
+        sample_index += samples_to_convert;
+
+        // Temporary buffer is full, push data into application buffer
+        if (d_tmp_buffer_size == d_buffer_size) {
+          // Timestamp refers to the end of the chunk
+          d_tmp_buffer->d_local_timestamp = get_sample_timestamp_ns(sample_index);
+
+          d_tmp_buffer->d_lost_count = d_lost_count;
+          d_lost_count = 0;
+
+          const uint32_t status = overflow ? channel_status_t::CHANNEL_STATUS_OVERFLOW : 0;
+          d_tmp_buffer->d_status = std::vector<uint32_t> { status, status };
+
+          d_app_buffer.add_full_data_chunk(d_tmp_buffer);
+
+          d_tmp_buffer = nullptr;
+          d_tmp_buffer_size = 0;
+        }
+      }
+    }
+
   } /* namespace digitizers */
 } /* namespace gr */
 
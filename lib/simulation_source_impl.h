@@ -11,6 +11,9 @@
 #include "digitizer_block_impl.h"
 #include <system_error>
 #include <string>
+#include <array>
+#include <atomic>
+#include <random>
 #include "digitizers/range.h"
 
 namespace gr {
@@ -24,6 +27,34 @@ namespace gr {
       std::vector<float> d_ch_b_data;
       std::vector<uint8_t> d_port_data;
 
+      // Streaming generator, see set_stream_generator
+      simulation_waveform_t d_waveform;
+      float d_amplitude;
+      float d_frequency;
+      float d_pacing;
+      float d_jitter;
+      float d_overrun_probability;
+
+      // One period of the waveform in raw ADC counts, generated samples are read from it
+      std::vector<int16_t> d_period;
+
+      // Raw samples of the current callback (driver buffers)
+      std::array<std::vector<int16_t>, 2> d_raw;
+      std::vector<int16_t> d_raw_port;
+
+      boost::chrono::high_resolution_clock::time_point d_stream_start;
+      uint64_t d_samples_generated;
+      std::mt19937 d_rng;
+      std::atomic<uint64_t> d_injected_overruns;
+
+      // Signals rapid block data being available a second after arm, without blocking arm
+      boost::thread d_rapid_block_timer;
+
+      // Chunk being assembled by the streaming callback
+      app_buffer_t::data_chunk_t *d_tmp_buffer;
+      uint32_t d_tmp_buffer_size;
+      int d_lost_count;
+
     public:
       simulation_source_impl();
       ~simulation_source_impl();
@@ -31,6 +62,15 @@ namespace gr {
       void set_data(const std::vector<float> &ch_a_vec, const std::vector<float> &ch_b_vec,
               const std::vector<uint8_t> &port_vec) override;
 
+      void set_stream_generator(simulation_waveform_t waveform, float amplitude,
+              float frequency) override;
+
+      void set_stream_pacing(float rate_factor) override;
+
+      void set_stream_faults(float jitter, float overrun_probability) override;
+
+      uint64_t get_injected_overruns() const override;
+
       std::vector<std::string> get_aichan_ids() override;
 
       meta_range_t get_aichan_ranges() override;
@@ -51,13 +91,24 @@ namespace gr {
 
       std::error_code driver_prefetch_block(size_t length, size_t block_number) override;
 
+      std::error_code driver_prefetch_blocks(size_t length, size_t first_block, size_t nr_blocks) override;
+
       std::error_code driver_get_rapid_block_data(size_t offset, size_t length, size_t waveform,
               gr_vector_void_star &arrays, std::vector<uint32_t> &status) override;
 
       std::error_code driver_poll() override;
 
+      // Paced streams sleep until the next chunk is due
+      std::error_code driver_wait_ready(uint64_t timeout_ns) override;
+
     private:
       bool fill_in_data_chunk();
+
+      void generate_period();
+
+      void generate_stream();
+
+      void streaming_callback(uint32_t nr_samples, int16_t overflow);
     };
 
   } // namespace digitizers
@@ -0,0 +1,206 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gnuradio/io_signature.h>
+#include "sliding_dft_impl.h"
+#include "goertzel_kernel.h"
+
+#include <cmath>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+namespace gr {
+  namespace digitizers {
+
+    sliding_dft_vfc::sptr
+    sliding_dft_vfc::make(int window_size, double samp_rate, double hop, const std::vector<float> &freqs)
+    {
+      return gnuradio::get_initial_sptr
+        (new sliding_dft_vfc(window_size, samp_rate, hop, freqs));
+    }
+
+    bool
+    sliding_dft_vfc::use_sliding_dft(int window_size, double hop)
+    {
+      return hop > 0.0 && hop <= 0.25 * window_size;
+    }
+
+    sliding_dft_vfc::sliding_dft_vfc(int window_size, double samp_rate, double hop, const std::vector<float> &freqs)
+      : gr::sync_block("sliding_dft_vfc",
+              gr::io_signature::make(1, 1, sizeof(float) * window_size),
+              gr::io_signature::make(1, 1, sizeof(gr_complex) * freqs.size())),
+        d_window_size(window_size),
+        d_nbins(static_cast<int>(freqs.size())),
+        d_samp_rate(samp_rate),
+        d_hop(hop),
+        d_freqs(freqs),
+        d_rot_re(goertzel_padded_bins(d_nbins)),
+        d_rot_im(goertzel_padded_bins(d_nbins)),
+        d_wrap_re(goertzel_padded_bins(d_nbins)),
+        d_wrap_im(goertzel_padded_bins(d_nbins)),
+        d_state_re(goertzel_padded_bins(d_nbins)),
+        d_state_im(goertzel_padded_bins(d_nbins)),
+        d_prev(window_size),
+        d_ones(window_size, 1.0f),
+        d_coeffs(goertzel_padded_bins(d_nbins)),
+        d_d1(goertzel_padded_bins(d_nbins)),
+        d_d2(goertzel_padded_bins(d_nbins)),
+        d_offset(0.0),
+        d_first(true),
+        d_valid(false),
+        d_windows_since_resync(0)
+    {
+      if (window_size < 1 || freqs.empty() || hop <= 0.0) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid window size, hop or number of bins";
+        throw std::invalid_argument(message.str());
+      }
+
+      update_coefficients();
+    }
+
+    sliding_dft_vfc::~sliding_dft_vfc()
+    {
+    }
+
+    bool
+    sliding_dft_vfc::start()
+    {
+      d_valid = false;
+      return true;
+    }
+
+    void
+    sliding_dft_vfc::set_samp_rate(double samp_rate)
+    {
+      gr::thread::scoped_lock lock(d_setlock);
+      d_samp_rate = samp_rate;
+      update_coefficients();
+    }
+
+    void
+    sliding_dft_vfc::set_freqs(const std::vector<float> &freqs)
+    {
+      if (static_cast<int>(freqs.size()) != d_nbins) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": expected " << d_nbins
+                << " frequencies, got " << freqs.size();
+        throw std::invalid_argument(message.str());
+      }
+
+      gr::thread::scoped_lock lock(d_setlock);
+      d_freqs = freqs;
+      update_coefficients();
+    }
+
+    void
+    sliding_dft_vfc::update_coefficients()
+    {
+      for (int i = 0; i < d_nbins; i++) {
+        const double w = 2.0 * M_PI * d_freqs[i] / d_samp_rate;
+        d_rot_re[i] = std::cos(w);
+        d_rot_im[i] = std::sin(w);
+        d_wrap_re[i] = std::cos(w * d_window_size);
+        d_wrap_im[i] = std::sin(w * d_window_size);
+        d_coeffs[i] = 2.0 * d_rot_re[i];
+      }
+
+      d_valid = false;
+    }
+
+    void
+    sliding_dft_vfc::resync(const float *window)
+    {
+      // exp(j w) * y[N-1] - y[N-2] equals the sum over the window
+      goertzel_bins(window, &d_ones[0], d_window_size, &d_coeffs[0], d_nbins, &d_d1[0], &d_d2[0]);
+
+      for (int i = 0; i < d_nbins; i++) {
+        d_state_re[i] = d_rot_re[i] * d_d1[i] - d_d2[i];
+        d_state_im[i] = d_rot_im[i] * d_d1[i];
+      }
+
+      d_valid = true;
+      d_windows_since_resync = 0;
+    }
+
+    void
+    sliding_dft_vfc::slide(const float *window, int nsamples)
+    {
+      const int nbins = d_nbins;
+      const double *rot_re = &d_rot_re[0];
+      const double *rot_im = &d_rot_im[0];
+      const double *wrap_re = &d_wrap_re[0];
+      const double *wrap_im = &d_wrap_im[0];
+      double *state_re = &d_state_re[0];
+      double *state_im = &d_state_im[0];
+
+      // samples leaving are the oldest of the previous window, the ones entering the newest
+      const float *leaving = &d_prev[0];
+      const float *entering = window + d_window_size - nsamples;
+
+      for (int j = 0; j < nsamples; j++) {
+        const double x_old = leaving[j];
+        const double x_new = entering[j];
+
+        // independent bins, vectorized by the compiler
+        for (int i = 0; i < nbins; i++) {
+          const double re = state_re[i] - x_old * wrap_re[i] + x_new;
+          const double im = state_im[i] - x_old * wrap_im[i];
+          state_re[i] = re * rot_re[i] - im * rot_im[i];
+          state_im[i] = re * rot_im[i] + im * rot_re[i];
+        }
+      }
+
+      d_windows_since_resync++;
+    }
+
+    int
+    sliding_dft_vfc::work(int noutput_items,
+        gr_vector_const_void_star &input_items,
+        gr_vector_void_star &output_items)
+    {
+      block_stats_scope_t stats(d_stats);
+      const float *in = (const float *) input_items[0];
+      gr_complex *out = (gr_complex *) output_items[0];
+
+      const double scale = 1.0 / d_window_size;
+
+      for (int k = 0; k < noutput_items; k++) {
+        const float *window = in + k * d_window_size;
+
+        // number of samples the window moved, see stream_to_vector_overlay_ff
+        int64_t advance = 0;
+        if (!d_first) {
+          d_offset += d_hop;
+          advance = static_cast<int64_t>(d_offset);
+          d_offset -= advance;
+        }
+        d_first = false;
+
+        if (!d_valid || advance >= d_window_size || d_windows_since_resync >= RESYNC_INTERVAL) {
+          resync(window);
+        }
+        else if (advance > 0) {
+          slide(window, static_cast<int>(advance));
+        }
+
+        for (int i = 0; i < d_nbins; i++) {
+          out[k * d_nbins + i] = gr_complex(d_state_re[i] * scale, d_state_im[i] * scale);
+        }
+
+        memcpy(&d_prev[0], window, d_window_size * sizeof(float));
+      }
+
+      return noutput_items;
+    }
+
+  } /* namespace digitizers */
+} /* namespace gr */
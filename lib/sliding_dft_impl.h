@@ -0,0 +1,113 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_SLIDING_DFT_IMPL_H
+#define INCLUDED_DIGITIZERS_SLIDING_DFT_IMPL_H
+
+#include <gnuradio/sync_block.h>
+#include <gnuradio/gr_complex.h>
+
+#include <vector>
+#include "block_stats_impl.h"
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Sliding DFT over the overlapped windows produced by stream_to_vector_overlay_ff.
+     *
+     * Computes the same as a bank of goertzel_fc blocks, i.e. for each bin frequency w
+     *
+     *   out = 1/N * sum_{m=0}^{N-1} x[m] exp(j w (N - m))
+     *
+     * but instead of evaluating each window from scratch the bins are updated recursively for
+     * the samples entering and leaving the window:
+     *
+     *   Z <- exp(j w) * (Z - x_old * exp(j w N) + x_new)
+     *
+     * The hop between the windows is derived from delta_t * samp_rate the same way as done by
+     * stream_to_vector_overlay_ff (fractional hops included). Bins are evaluated from scratch
+     * for the first window, if the hop is not smaller than the window, after set_freqs or
+     * set_samp_rate, and every RESYNC_INTERVAL windows in order to bound rounding errors.
+     *
+     * Pays off for large overlaps only, see use_sliding_dft.
+     */
+    class sliding_dft_vfc : public gr::sync_block
+    {
+     public:
+      typedef boost::shared_ptr<sliding_dft_vfc> sptr;
+
+      static const int RESYNC_INTERVAL = 1024;
+
+      static sptr make(int window_size, double samp_rate, double hop, const std::vector<float> &freqs);
+
+      /*!
+       * \brief Returns true if the recursive update is cheaper than evaluating each window,
+       * i.e. if the windows overlap by 75% or more.
+       */
+      static bool use_sliding_dft(int window_size, double hop);
+
+      sliding_dft_vfc(int window_size, double samp_rate, double hop, const std::vector<float> &freqs);
+
+      ~sliding_dft_vfc();
+
+      bool start() override;
+
+      void set_samp_rate(double samp_rate);
+
+      /*!
+       * \brief Sets the bin frequencies, the number of bins can not be changed.
+       */
+      void set_freqs(const std::vector<float> &freqs);
+
+      int work(int noutput_items,
+          gr_vector_const_void_star &input_items,
+          gr_vector_void_star &output_items) override;
+
+     private:
+
+      void update_coefficients();
+
+      // Evaluates all the bins over the given window
+      void resync(const float *window);
+
+      // Moves the window by nsamples, nsamples < window size
+      void slide(const float *window, int nsamples);
+
+      const int d_window_size;
+      const int d_nbins;
+      double d_samp_rate;
+      const double d_hop;
+      std::vector<float> d_freqs;
+
+      // exp(j w) and exp(j w N) of each bin, padded to a whole number of goertzel lanes
+      std::vector<double> d_rot_re;
+      std::vector<double> d_rot_im;
+      std::vector<double> d_wrap_re;
+      std::vector<double> d_wrap_im;
+
+      // State of each bin, i.e. N * output
+      std::vector<double> d_state_re;
+      std::vector<double> d_state_im;
+
+      std::vector<float> d_prev;      // previous window
+      std::vector<float> d_ones;      // rectangular window used for resync
+      std::vector<double> d_coeffs;   // goertzel coefficients, 2 cos(w)
+      std::vector<double> d_d1;
+      std::vector<double> d_d2;
+
+      double d_offset;                // fractional part of the hop, see stream_to_vector_overlay_ff
+      bool d_first;
+      bool d_valid;
+      int d_windows_since_resync;
+
+      block_stats_recorder_t d_stats {this};
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_SLIDING_DFT_IMPL_H */
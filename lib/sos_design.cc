@@ -0,0 +1,391 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "sos_design.h"
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <sstream>
+#include <stdexcept>
+
+namespace gr {
+  namespace digitizers {
+
+    namespace {
+
+      typedef std::complex<double> complex_t;
+
+      // Quadratic factor 1 + c1 w + c2 w^2 (w = z^-1) of up to two roots, root is the one with
+      // the non-negative imaginary part
+      struct factor_t
+      {
+        double c1, c2;
+        complex_t root;
+      };
+
+      /*
+       * Balances the matrix by powers of two, such that the eigenvalues are found with a
+       * similar relative accuracy (Parlett and Reinsch).
+       */
+      void
+      balance_matrix(std::vector<std::vector<double>> &a)
+      {
+        const int n = a.size();
+        bool done = false;
+
+        while (!done) {
+          done = true;
+          for (int i = 0; i < n; i++) {
+            double c = 0.0, r = 0.0;
+            for (int j = 0; j < n; j++) {
+              if (j != i) {
+                c += std::fabs(a[j][i]);
+                r += std::fabs(a[i][j]);
+              }
+            }
+            if (c == 0.0 || r == 0.0) {
+              continue;
+            }
+
+            const double s = c + r;
+            double f = 1.0;
+            while (c < r / 2.0) {
+              f *= 2.0;
+              c *= 4.0;
+            }
+            while (c > r * 2.0) {
+              f /= 2.0;
+              c /= 4.0;
+            }
+
+            if ((c + r) / f < 0.95 * s) {
+              done = false;
+              for (int j = 0; j < n; j++) {
+                a[i][j] /= f;
+                a[j][i] *= f;
+              }
+            }
+          }
+        }
+      }
+
+      /*
+       * Eigenvalues of an upper Hessenberg matrix, shifted QR iteration (Francis double shift).
+       * Complex eigenvalues are returned as exact conjugate pairs.
+       */
+      std::vector<complex_t>
+      hessenberg_eigenvalues(std::vector<std::vector<double>> a)
+      {
+        const int n = a.size();
+        std::vector<complex_t> eigenvalues(n);
+
+        double norm = 0.0;
+        for (int i = 0; i < n; i++) {
+          for (int j = std::max(i - 1, 0); j < n; j++) {
+            norm += std::fabs(a[i][j]);
+          }
+        }
+
+        int nn = n - 1;
+        double t = 0.0;
+        while (nn >= 0) {
+          int its = 0, l;
+          do {
+            // look for a single small subdiagonal element
+            for (l = nn; l >= 1; l--) {
+              double s = std::fabs(a[l - 1][l - 1]) + std::fabs(a[l][l]);
+              if (s == 0.0) {
+                s = norm;
+              }
+              if (std::fabs(a[l][l - 1]) + s == s) {
+                a[l][l - 1] = 0.0;
+                break;
+              }
+            }
+
+            double x = a[nn][nn];
+            if (l == nn) {
+              // one root found
+              eigenvalues[nn--] = x + t;
+              continue;
+            }
+
+            double y = a[nn - 1][nn - 1];
+            double w = a[nn][nn - 1] * a[nn - 1][nn];
+            if (l == nn - 1) {
+              // two roots found
+              const double p = 0.5 * (y - x);
+              const double q = p * p + w;
+              double z = std::sqrt(std::fabs(q));
+              x += t;
+              if (q >= 0.0) {
+                z = p + std::copysign(z, p);
+                eigenvalues[nn - 1] = eigenvalues[nn] = x + z;
+                if (z != 0.0) {
+                  eigenvalues[nn] = x - w / z;
+                }
+              }
+              else {
+                eigenvalues[nn - 1] = complex_t(x + p, z);
+                eigenvalues[nn] = complex_t(x + p, -z);
+              }
+              nn -= 2;
+              continue;
+            }
+
+            if (its == 60) {
+              std::ostringstream message;
+              message << "Exception in " << __FILE__ << ":" << __LINE__ << ": no convergence finding the roots";
+              throw std::invalid_argument(message.str());
+            }
+            if (its == 10 || its == 20) {
+              // exceptional shift
+              t += x;
+              for (int i = 0; i <= nn; i++) {
+                a[i][i] -= x;
+              }
+              const double s = std::fabs(a[nn][nn - 1]) + std::fabs(a[nn - 1][nn - 2]);
+              y = x = 0.75 * s;
+              w = -0.4375 * s * s;
+            }
+            its++;
+
+            // look for two consecutive small subdiagonal elements
+            int m;
+            double p = 0.0, q = 0.0, r = 0.0, z;
+            for (m = nn - 2; m >= l; m--) {
+              z = a[m][m];
+              r = x - z;
+              const double s0 = y - z;
+              p = (r * s0 - w) / a[m + 1][m] + a[m][m + 1];
+              q = a[m + 1][m + 1] - z - r - s0;
+              r = a[m + 2][m + 1];
+              const double s = std::fabs(p) + std::fabs(q) + std::fabs(r);
+              p /= s;
+              q /= s;
+              r /= s;
+              if (m == l) {
+                break;
+              }
+              const double u = std::fabs(a[m][m - 1]) * (std::fabs(q) + std::fabs(r));
+              const double v = std::fabs(p) * (std::fabs(a[m - 1][m - 1]) + std::fabs(z) + std::fabs(a[m + 1][m + 1]));
+              if (u + v == v) {
+                break;
+              }
+            }
+
+            for (int i = m + 2; i <= nn; i++) {
+              a[i][i - 2] = 0.0;
+              if (i != m + 2) {
+                a[i][i - 3] = 0.0;
+              }
+            }
+
+            // double QR step on rows l to nn and columns m to nn
+            for (int k = m; k <= nn - 1; k++) {
+              if (k != m) {
+                p = a[k][k - 1];
+                q = a[k + 1][k - 1];
+                r = (k != nn - 1) ? a[k + 2][k - 1] : 0.0;
+                x = std::fabs(p) + std::fabs(q) + std::fabs(r);
+                if (x != 0.0) {
+                  p /= x;
+                  q /= x;
+                  r /= x;
+                }
+              }
+
+              const double s = std::copysign(std::sqrt(p * p + q * q + r * r), p);
+              if (s == 0.0) {
+                continue;
+              }
+
+              if (k == m) {
+                if (l != m) {
+                  a[k][k - 1] = -a[k][k - 1];
+                }
+              }
+              else {
+                a[k][k - 1] = -s * x;
+              }
+              p += s;
+              x = p / s;
+              y = q / s;
+              z = r / s;
+              q /= p;
+              r /= p;
+
+              for (int j = k; j <= nn; j++) {
+                double h = a[k][j] + q * a[k + 1][j];
+                if (k != nn - 1) {
+                  h += r * a[k + 2][j];
+                  a[k + 2][j] -= h * z;
+                }
+                a[k + 1][j] -= h * y;
+                a[k][j] -= h * x;
+              }
+
+              const int last = std::min(nn, k + 3);
+              for (int i = l; i <= last; i++) {
+                double h = x * a[i][k] + y * a[i][k + 1];
+                if (k != nn - 1) {
+                  h += z * a[i][k + 2];
+                  a[i][k + 2] -= h * r;
+                }
+                a[i][k + 1] -= h * q;
+                a[i][k] -= h;
+              }
+            }
+          } while (nn >= 0 && l < nn - 1);
+        }
+
+        return eigenvalues;
+      }
+
+      /*
+       * Roots of c[0] z^n + c[1] z^(n-1) + ... + c[n], c[0] not zero, as the eigenvalues of the
+       * balanced companion matrix. Unlike iterating on the roots directly this is backward
+       * stable, i.e. the product of the root factors reproduces the polynomial even where the
+       * roots are ill-conditioned (clustered poles of narrow filters, multiple zeros).
+       */
+      std::vector<complex_t>
+      polynomial_roots(const std::vector<double> &c)
+      {
+        const int n = static_cast<int>(c.size()) - 1;
+        if (n < 1) {
+          return std::vector<complex_t>();
+        }
+
+        std::vector<std::vector<double>> companion(n, std::vector<double>(n, 0.0));
+        for (int j = 0; j < n; j++) {
+          companion[0][j] = -c[j + 1] / c[0];
+        }
+        for (int i = 1; i < n; i++) {
+          companion[i][i - 1] = 1.0;
+        }
+
+        balance_matrix(companion);
+        return hessenberg_eigenvalues(companion);
+      }
+
+      /*
+       * Quadratic factors of the polynomial c[0] + c[1] w + ... (w = z^-1) divided by c[0].
+       * Complex conjugates are paired, remaining real roots are paired in order.
+       */
+      std::vector<factor_t>
+      make_factors(std::vector<double> c)
+      {
+        // trailing zeros are roots at z = 0, i.e. factors of one
+        while (c.size() > 1 && c.back() == 0.0) {
+          c.pop_back();
+        }
+
+        auto roots = polynomial_roots(c);
+        std::sort(roots.begin(), roots.end(), [](const complex_t &a, const complex_t &b) {
+          return a.imag() > b.imag();
+        });
+
+        std::vector<factor_t> factors;
+        while (!roots.empty()) {
+          const complex_t first = roots.front();
+          roots.erase(roots.begin());
+
+          if (roots.empty()) {
+            factors.push_back(factor_t {-first.real(), 0.0, complex_t(first.real(), 0.0)});
+            break;
+          }
+
+          auto partner = std::min_element(roots.begin(), roots.end(),
+                  [&first](const complex_t &a, const complex_t &b) {
+                    return std::abs(a - std::conj(first)) < std::abs(b - std::conj(first));
+                  });
+          const complex_t second = *partner;
+          roots.erase(partner);
+
+          factors.push_back(factor_t {-(first + second).real(), (first * second).real(),
+                  first.imag() >= 0.0 ? first : second});
+        }
+
+        return factors;
+      }
+
+    } // namespace
+
+    std::vector<sos_section_t>
+    tf_to_sos(const std::vector<double> &fw_taps, const std::vector<double> &fb_taps)
+    {
+      if (fw_taps.empty() || fb_taps.empty() || fb_taps[0] == 0.0) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__
+                << ": feed forward taps and feed backward taps with a non-zero first tap required";
+        throw std::invalid_argument(message.str());
+      }
+
+      // leading zeros of the numerator are pure delays
+      size_t delays = 0;
+      while (delays < fw_taps.size() && fw_taps[delays] == 0.0) {
+        delays++;
+      }
+      if (delays == fw_taps.size()) {
+        return std::vector<sos_section_t> {sos_section_t {0.0f, 0.0f, 0.0f, 0.0f, 0.0f}};
+      }
+
+      const double gain = fw_taps[delays] / fb_taps[0];
+      auto zeros = make_factors(std::vector<double>(fw_taps.begin() + delays, fw_taps.end()));
+      auto poles = make_factors(fb_taps);
+
+      const size_t nsections = std::max(std::max(zeros.size(), poles.size()), size_t {1});
+      zeros.resize(nsections, factor_t {0.0, 0.0, 0.0});
+      poles.resize(nsections, factor_t {0.0, 0.0, 0.0});
+
+      // most resonant pole pairs first pick the nearest zeros
+      std::sort(poles.begin(), poles.end(), [](const factor_t &a, const factor_t &b) {
+        return std::abs(a.root) > std::abs(b.root);
+      });
+
+      std::vector<sos_section_t> sections;
+      for (const auto &pole : poles) {
+        auto zero = std::min_element(zeros.begin(), zeros.end(), [&pole](const factor_t &a, const factor_t &b) {
+          return std::abs(a.root - pole.root) < std::abs(b.root - pole.root);
+        });
+
+        sections.push_back(sos_section_t {1.0f, static_cast<float>(zero->c1), static_cast<float>(zero->c2),
+                static_cast<float>(pole.c1), static_cast<float>(pole.c2)});
+        zeros.erase(zero);
+      }
+
+      // least resonant section first
+      std::reverse(sections.begin(), sections.end());
+
+      auto &first = sections.front();
+      first.b0 = static_cast<float>(first.b0 * gain);
+      first.b1 = static_cast<float>(first.b1 * gain);
+      first.b2 = static_cast<float>(first.b2 * gain);
+
+      for (size_t d = 0; d < delays; d++) {
+        auto section = std::find_if(sections.begin(), sections.end(), [](const sos_section_t &s) {
+          return s.b2 == 0.0f;
+        });
+        if (section == sections.end()) {
+          sections.push_back(sos_section_t {1.0f, 0.0f, 0.0f, 0.0f, 0.0f});
+          section = sections.end() - 1;
+        }
+
+        section->b2 = section->b1;
+        section->b1 = section->b0;
+        section->b0 = 0.0f;
+      }
+
+      return sections;
+    }
+
+  } // namespace digitizers
+} // namespace gr
@@ -0,0 +1,39 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_SOS_DESIGN_H
+#define INCLUDED_DIGITIZERS_SOS_DESIGN_H
+
+#include "sos_kernel.h"
+
+#include <vector>
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Converts the transfer function
+     *
+     *   H(z) = (fw[0] + fw[1] z^-1 + ... ) / (fb[0] + fb[1] z^-1 + ... )
+     *
+     * into a cascade of second-order sections. The taps use the same convention as
+     * gr::filter::iir_filter_ffd with oldstyle set to false, except that fb[0] is not assumed
+     * to be one.
+     *
+     * Zeros and poles are found in double precision, complex conjugates are paired. Each pole
+     * pair is matched with the nearest zeros and the sections are ordered from the least to the
+     * most resonant one, the gain is applied to the first section. Leading zeros of fw (pure
+     * delays) are kept.
+     *
+     * Throws std::invalid_argument if fw is empty, fb is empty or fb[0] is zero.
+     */
+    std::vector<sos_section_t> tf_to_sos(const std::vector<double> &fw_taps,
+            const std::vector<double> &fb_taps);
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_SOS_DESIGN_H */
@@ -0,0 +1,163 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_SOS_KERNEL_H
+#define INCLUDED_DIGITIZERS_SOS_KERNEL_H
+
+#include "cpu_dispatch.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace gr {
+  namespace digitizers {
+
+    /**********************************************************************
+     * Biquad cascade (second-order sections) kernels. The recursion prevents vectorizing
+     * across samples, therefore the channels are processed in SIMD lanes instead. Samples are
+     * interleaved, sample i of lane l is at [i * stride + l]. The state holds two floats per
+     * section and lane, at [(2 * s + k) * stride + l].
+     *********************************************************************/
+
+    /*!
+     * \brief Second-order section in transposed direct form II:
+     *   y = b0 * x + s1
+     *   s1 = b1 * x - a1 * y + s2
+     *   s2 = b2 * x - a2 * y
+     */
+    struct sos_section_t
+    {
+      float b0, b1, b2;
+      float a1, a2;
+    };
+
+    namespace sos_detail {
+
+      static inline void
+      sos_cascade_generic(const sos_section_t *sections, int nsections, float *state,
+              const float *in, float *out, int stride, int nlanes, int nsamples)
+      {
+        for (int l = 0; l < nlanes; l++) {
+          for (int i = 0; i < nsamples; i++) {
+            float x = in[i * stride + l];
+            for (int s = 0; s < nsections; s++) {
+              const sos_section_t &section = sections[s];
+              float &s1 = state[2 * s * stride + l];
+              float &s2 = state[(2 * s + 1) * stride + l];
+
+              const float y = section.b0 * x + s1;
+              s1 = section.b1 * x - section.a1 * y + s2;
+              s2 = section.b2 * x - section.a2 * y;
+              x = y;
+            }
+            out[i * stride + l] = x;
+          }
+        }
+      }
+
+#if defined(__x86_64__) || defined(__i386__)
+      __attribute__((target("avx2")))
+      static inline void
+      sos_cascade_avx2(const sos_section_t *sections, int nsections, float *state,
+              const float *in, float *out, int stride, int nlanes, int nsamples)
+      {
+        int l = 0;
+        for (; l + 8 <= nlanes; l += 8) {
+          for (int i = 0; i < nsamples; i++) {
+            __m256 x = _mm256_loadu_ps(in + i * stride + l);
+            for (int s = 0; s < nsections; s++) {
+              const sos_section_t &section = sections[s];
+              float *s1 = state + 2 * s * stride + l;
+              float *s2 = state + (2 * s + 1) * stride + l;
+
+              const __m256 y = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(section.b0), x), _mm256_loadu_ps(s1));
+              _mm256_storeu_ps(s1, _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(_mm256_set1_ps(section.b1), x),
+                      _mm256_mul_ps(_mm256_set1_ps(section.a1), y)), _mm256_loadu_ps(s2)));
+              _mm256_storeu_ps(s2, _mm256_sub_ps(_mm256_mul_ps(_mm256_set1_ps(section.b2), x),
+                      _mm256_mul_ps(_mm256_set1_ps(section.a2), y)));
+              x = y;
+            }
+            _mm256_storeu_ps(out + i * stride + l, x);
+          }
+        }
+
+        // remainder
+        if (l < nlanes) {
+          sos_cascade_generic(sections, nsections, state + l, in + l, out + l, stride, nlanes - l, nsamples);
+        }
+      }
+
+      __attribute__((target("avx512f")))
+      static inline void
+      sos_cascade_avx512(const sos_section_t *sections, int nsections, float *state,
+              const float *in, float *out, int stride, int nlanes, int nsamples)
+      {
+        int l = 0;
+        for (; l + 16 <= nlanes; l += 16) {
+          for (int i = 0; i < nsamples; i++) {
+            __m512 x = _mm512_loadu_ps(in + i * stride + l);
+            for (int s = 0; s < nsections; s++) {
+              const sos_section_t &section = sections[s];
+              float *s1 = state + 2 * s * stride + l;
+              float *s2 = state + (2 * s + 1) * stride + l;
+
+              const __m512 y = _mm512_add_ps(_mm512_mul_ps(_mm512_set1_ps(section.b0), x), _mm512_loadu_ps(s1));
+              _mm512_storeu_ps(s1, _mm512_add_ps(_mm512_sub_ps(_mm512_mul_ps(_mm512_set1_ps(section.b1), x),
+                      _mm512_mul_ps(_mm512_set1_ps(section.a1), y)), _mm512_loadu_ps(s2)));
+              _mm512_storeu_ps(s2, _mm512_sub_ps(_mm512_mul_ps(_mm512_set1_ps(section.b2), x),
+                      _mm512_mul_ps(_mm512_set1_ps(section.a2), y)));
+              x = y;
+            }
+            _mm512_storeu_ps(out + i * stride + l, x);
+          }
+        }
+
+        // remainder, e.g. 8 channels
+        if (l < nlanes) {
+          sos_cascade_avx2(sections, nsections, state + l, in + l, out + l, stride, nlanes - l, nsamples);
+        }
+      }
+#endif
+
+      typedef void (*sos_cascade_kernel_t)(const sos_section_t *sections, int nsections,
+              float *state, const float *in, float *out, int stride, int nlanes, int nsamples);
+
+      // Best variant available for the given instruction set
+      static inline sos_cascade_kernel_t
+      sos_cascade_kernel(kernel_isa_t isa)
+      {
+#if defined(__x86_64__) || defined(__i386__)
+        if (isa >= KERNEL_ISA_AVX512) {
+          return sos_cascade_avx512;
+        }
+        if (isa >= KERNEL_ISA_AVX2) {
+          return sos_cascade_avx2;
+        }
+#endif
+        return sos_cascade_generic;
+      }
+
+    } // namespace sos_detail
+
+    /*!
+     * \brief Filters nlanes interleaved channels with the same biquad cascade.
+     */
+    static inline void
+    sos_cascade(const sos_section_t *sections, int nsections, float *state,
+            const float *in, float *out, int nlanes, int nsamples)
+    {
+      // kernel is selected once, on first use
+      static const sos_detail::sos_cascade_kernel_t kernel =
+              sos_detail::sos_cascade_kernel(get_kernel_isa());
+
+      kernel(sections, nsections, state, in, out, nlanes, nlanes, nsamples);
+    }
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_SOS_KERNEL_H */
@@ -0,0 +1,108 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_SPECTRAL_SMOOTHING_H
+#define INCLUDED_DIGITIZERS_SPECTRAL_SMOOTHING_H
+
+#include "utils.h"
+#include <algorithm>
+
+namespace gr {
+  namespace digitizers {
+
+    /**********************************************************************
+     * Spectrum smoothing filters of median_and_average, evaluated for the bins [first, last]
+     * of an n bin vector. Indices beyond the vector are clamped, i.e. the edge values are
+     * repeated, hence the filtered bins are the same as when filtering the whole vector (up
+     * to the rounding of the running sum).
+     *
+     * Both filters return the bin of the first maximum of the filtered range.
+     *********************************************************************/
+
+    /*!
+     * \brief Median of the 2m+1 values centered at each bin. Reads the input bins
+     * [first-m, last+m] (clamped) and writes out[first..last].
+     */
+    static inline int
+    median_filter(const float *in, int n, int m, int first, int last, float *out,
+            sliding_median<float> &window)
+    {
+      // Input with clamped indices
+      auto at = [in, n](int k) { return in[std::min(std::max(k, 0), n - 1)]; };
+
+      // Window of 2m+1 values centered at bin i, updated incrementally
+      window.clear();
+      for (int k = first - m; k <= first + m; k++) {
+        window.insert(at(k));
+      }
+
+      int max_i = first;
+      for (int i = first; i <= last; i++) {
+        if (i > first) {
+          window.erase(at(i - m - 1));
+          window.insert(at(i + m));
+        }
+
+        // The median excludes the values whose clamped index is i itself, i.e. the
+        // center and at the edges all the repeated edge values
+        const int lower = i == 0 ? i - m : i;
+        const int upper = i == n - 1 ? i + m : i;
+        const int copies = upper - lower + 1;
+
+        for (int c = 0; c < copies; c++) {
+          window.erase(in[i]);
+        }
+
+        out[i] = window.median();
+
+        for (int c = 0; c < copies; c++) {
+          window.insert(in[i]);
+        }
+
+        if (out[i] > out[max_i]) {
+          max_i = i;
+        }
+      }
+
+      return max_i;
+    }
+
+    /*!
+     * \brief Mean of the 2a+1 values centered at each bin. Reads the input bins
+     * [first-a, last+a] (clamped) and writes out[first..last].
+     */
+    static inline int
+    average_filter(const float *in, int n, int a, int first, int last, float *out)
+    {
+      const double count = 2 * a + 1;
+
+      auto at = [in, n](int k) { return in[std::min(std::max(k, 0), n - 1)]; };
+
+      // running sum over the 2a+1 clamped values centered at bin i
+      double sum = 0.0;
+      for (int k = first - a; k <= first + a; k++) {
+        sum += at(k);
+      }
+
+      int max_i = first;
+      for (int i = first; i <= last; i++) {
+        if (i > first) {
+          sum += at(i + a) - at(i - a - 1);
+        }
+        out[i] = static_cast<float>(sum / count);
+
+        if (out[i] > out[max_i]) {
+          max_i = i;
+        }
+      }
+
+      return max_i;
+    }
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_SPECTRAL_SMOOTHING_H */
@@ -0,0 +1,229 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_SPECTRUM_FRAME_RING_H
+#define INCLUDED_DIGITIZERS_SPECTRUM_FRAME_RING_H
+
+#include <digitizers/freq_sink_f.h>
+
+#include <boost/noncopyable.hpp>
+
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <new>
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Single producer, multiple consumer ring of fixed size spectrum frames.
+     *
+     * Magnitude and phase spectra are stored in two separate arrays (SoA), each frame starting
+     * at a 64 byte boundary. Frames are addressed by sequence number, the frame with sequence
+     * number s is stored in slot s % capacity.
+     *
+     * The writer never waits for the readers. Each slot carries the sequence number of the frame
+     * it holds, readers check it before and after accessing the frame in place, i.e. a frame
+     * overwritten while being read is detected (the same way as with seqlock_t).
+     */
+    class spectrum_frame_ring_t : boost::noncopyable
+    {
+    public:
+
+      static const size_t ALIGNMENT = 64;
+
+      spectrum_frame_ring_t()
+        : d_data(nullptr),
+          d_data_bytes(0),
+          d_capacity(0),
+          d_mask(0),
+          d_nbins(0),
+          d_stride(0),
+          d_next(0),
+          d_published(0)
+      {
+      }
+
+      ~spectrum_frame_ring_t()
+      {
+        release();
+      }
+
+      /*!
+       * \brief Allocates the ring, throws std::bad_alloc if no memory is available.
+       *
+       * \param min_frames minimum capacity, rounded up to a power of two
+       * \param nbins number of bins per frame
+       */
+      void allocate(size_t min_frames, size_t nbins)
+      {
+        release();
+
+        size_t capacity = 1;
+        while (capacity < min_frames) {
+          capacity <<= 1;
+        }
+
+        const size_t floats_per_line = ALIGNMENT / sizeof(float);
+        d_stride = (nbins + floats_per_line - 1) / floats_per_line * floats_per_line;
+        d_data_bytes = std::max(size_t{1}, 2 * capacity * d_stride * sizeof(float));
+
+        // Mappings are page aligned
+        void *addr = mmap(nullptr, d_data_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (addr == MAP_FAILED) {
+          throw std::bad_alloc();
+        }
+
+        d_data = static_cast<float *>(addr);
+        d_slots.reset(new slot_t[capacity]);
+        for (size_t i = 0; i < capacity; i++) {
+          d_slots[i].sequence.store(INVALID_SEQUENCE, std::memory_order_relaxed);
+        }
+
+        d_capacity = capacity;
+        d_mask = capacity - 1;
+        d_nbins = nbins;
+        d_next = 0;
+        d_published.store(0);
+      }
+
+      void release()
+      {
+        if (d_data != nullptr) {
+          munmap(d_data, d_data_bytes);
+        }
+
+        d_data = nullptr;
+        d_data_bytes = 0;
+        d_slots.reset();
+        d_capacity = 0;
+        d_mask = 0;
+        d_next = 0;
+        d_published.store(0);
+      }
+
+      size_t capacity() const
+      {
+        return d_capacity;
+      }
+
+      size_t nbins() const
+      {
+        return d_nbins;
+      }
+
+      /*!
+       * \brief Sequence number of the next frame to be published, i.e. frames
+       * [published - capacity, published) might be available.
+       */
+      uint64_t published() const
+      {
+        return d_published.load(std::memory_order_acquire);
+      }
+
+      /**********************************************************************
+       * Writer
+       *********************************************************************/
+
+      /*!
+       * \brief Starts writing the next frame, returns its sequence number. The frame is
+       * available to readers once published.
+       */
+      uint64_t begin_write()
+      {
+        d_slots[d_next & d_mask].sequence.store(INVALID_SEQUENCE, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        return d_next;
+      }
+
+      float *magnitude(uint64_t sequence)
+      {
+        return d_data + (sequence & d_mask) * d_stride;
+      }
+
+      float *phase(uint64_t sequence)
+      {
+        return d_data + (d_capacity + (sequence & d_mask)) * d_stride;
+      }
+
+      spectra_measurement_t &metadata(uint64_t sequence)
+      {
+        return d_slots[sequence & d_mask].metadata;
+      }
+
+      void publish()
+      {
+        d_slots[d_next & d_mask].sequence.store(d_next, std::memory_order_release);
+        d_next++;
+        d_published.store(d_next, std::memory_order_release);
+      }
+
+      /**********************************************************************
+       * Readers
+       *********************************************************************/
+
+      /*!
+       * \brief Invokes visitor(metadata, magnitude, phase) on the frame in place. Returns false
+       * if the frame is not available or was overwritten while being visited, in which case
+       * whatever the visitor did with the frame must be discarded.
+       */
+      template <typename Visitor>
+      bool read(uint64_t sequence, Visitor &&visitor) const
+      {
+        if (d_capacity == 0) {
+          return false;
+        }
+
+        const auto &slot = d_slots[sequence & d_mask];
+        if (slot.sequence.load(std::memory_order_acquire) != sequence) {
+          return false;
+        }
+
+        spectra_measurement_t metadata;
+        std::memcpy(&metadata, &slot.metadata, sizeof(metadata));
+
+        const auto base = d_data + (sequence & d_mask) * d_stride;
+        visitor(metadata, static_cast<const float *>(base),
+                static_cast<const float *>(base + d_capacity * d_stride));
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return slot.sequence.load(std::memory_order_relaxed) == sequence;
+      }
+
+    private:
+
+      static const uint64_t INVALID_SEQUENCE = std::numeric_limits<uint64_t>::max();
+
+      struct slot_t
+      {
+        std::atomic<uint64_t> sequence;
+        spectra_measurement_t metadata;
+      };
+
+      float *d_data;
+      size_t d_data_bytes;
+      std::unique_ptr<slot_t[]> d_slots;
+
+      size_t d_capacity;
+      size_t d_mask;
+      size_t d_nbins;
+      size_t d_stride;   // floats per frame, padded to ALIGNMENT bytes
+
+      // writer position and sequence published to the readers
+      uint64_t d_next;
+      std::atomic<uint64_t> d_published;
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_SPECTRUM_FRAME_RING_H */
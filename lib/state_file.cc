@@ -0,0 +1,289 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "state_file.h"
+#include "thread_registry.h"
+#include "utils.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+namespace gr {
+  namespace digitizers {
+
+    // Records and their payloads are 8 byte aligned
+    static const size_t STATE_FILE_ALIGNMENT = 8;
+
+    static size_t
+    align_up(size_t size)
+    {
+      return (size + STATE_FILE_ALIGNMENT - 1) / STATE_FILE_ALIGNMENT * STATE_FILE_ALIGNMENT;
+    }
+
+    // The layout is plain integers, the sequence is accessed atomically
+    static std::atomic<uint32_t> &
+    as_atomic(uint32_t &value)
+    {
+      static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "atomic must be lock free");
+      return reinterpret_cast<std::atomic<uint32_t> &>(value);
+    }
+
+    state_file_t::state_file_t(const std::string &path, double period, double max_age, size_t capacity)
+      : d_path(path),
+        d_period(period),
+        d_max_age(max_age),
+        d_header(nullptr),
+        d_size(align_up(sizeof(state_file_header_t)) + align_up(capacity))
+    {
+      if (!(period > 0.0) || !(max_age >= 0.0)) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid state file period or max age, period: "
+                << period << ", max age: " << max_age;
+        throw std::invalid_argument(message.str());
+      }
+
+      int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+      if (fd < 0) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": failed to open " << path
+                << ": " << strerror(errno);
+        throw std::runtime_error(message.str());
+      }
+
+      // The file is sparse, records of a previous run are kept if the size matches
+      struct stat st;
+      bool mapped = fstat(fd, &st) == 0
+              && (static_cast<size_t>(st.st_size) == d_size || ftruncate(fd, static_cast<off_t>(d_size)) == 0);
+      void *addr = MAP_FAILED;
+      if (mapped) {
+        addr = mmap(nullptr, d_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        mapped = addr != MAP_FAILED;
+      }
+      auto error = errno;
+
+      // the mapping keeps the file open
+      ::close(fd);
+
+      if (!mapped) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": failed to map " << path
+                << ": " << strerror(error);
+        throw std::runtime_error(message.str());
+      }
+
+      d_header = static_cast<state_file_header_t *>(addr);
+
+      const bool valid = strncmp(d_header->magic, "DIGISTF", sizeof(d_header->magic)) == 0
+              && d_header->version == STATE_FILE_VERSION
+              && d_header->header_size == sizeof(state_file_header_t)
+              && d_header->capacity == align_up(capacity)
+              && d_header->used <= d_header->capacity;
+      if (!valid) {
+        memset(d_header, 0, sizeof(state_file_header_t));
+        d_header->version = STATE_FILE_VERSION;
+        d_header->header_size = sizeof(state_file_header_t);
+        d_header->capacity = align_up(capacity);
+        d_header->used = 0;
+        std::atomic_thread_fence(std::memory_order_release);
+        strncpy(d_header->magic, "DIGISTF", sizeof(d_header->magic));
+      }
+
+      d_sync_thread = boost::thread(&state_file_t::sync_work_function, this);
+    }
+
+    state_file_t::~state_file_t()
+    {
+      d_sync_thread.interrupt();
+      d_sync_thread.join();
+
+      sync();
+      munmap(d_header, d_size);
+    }
+
+    state_record_header_t *
+    state_file_t::find_locked(const std::string &key)
+    {
+      char *records = reinterpret_cast<char *>(d_header) + align_up(sizeof(state_file_header_t));
+      state_record_header_t *found = nullptr;
+
+      for (size_t offset = 0; offset < d_header->used; ) {
+        auto record = reinterpret_cast<state_record_header_t *>(records + offset);
+        if (strncmp(record->key, key.c_str(), sizeof(record->key)) == 0) {
+          found = record;
+        }
+        offset += sizeof(state_record_header_t) + record->capacity;
+      }
+
+      return found;
+    }
+
+    state_record_header_t *
+    state_file_t::get_record(const std::string &key, size_t nbytes)
+    {
+      boost::mutex::scoped_lock lock(d_mutex);
+
+      auto record = find_locked(key);
+      if (record && record->capacity >= nbytes) {
+        return record;
+      }
+
+      // Grown states get a new record, the last one with the key is the valid one
+      const size_t capacity = align_up(nbytes);
+      const size_t offset = d_header->used;
+      if (key.size() >= sizeof(record->key)
+              || offset + sizeof(state_record_header_t) + capacity > d_header->capacity) {
+        return nullptr;
+      }
+
+      char *records = reinterpret_cast<char *>(d_header) + align_up(sizeof(state_file_header_t));
+      record = reinterpret_cast<state_record_header_t *>(records + offset);
+      memset(record, 0, sizeof(state_record_header_t));
+      strncpy(record->key, key.c_str(), sizeof(record->key));
+      record->capacity = capacity;
+
+      std::atomic_thread_fence(std::memory_order_release);
+      d_header->used = offset + sizeof(state_record_header_t) + capacity;
+
+      return record;
+    }
+
+    const state_record_header_t *
+    state_file_t::find_valid(const std::string &key)
+    {
+      boost::mutex::scoped_lock lock(d_mutex);
+
+      auto record = find_locked(key);
+      if (!record) {
+        return nullptr;
+      }
+
+      const auto sequence = as_atomic(record->sequence).load(std::memory_order_acquire);
+      const double age = (static_cast<double>(get_timestamp_nano_utc()) - record->saved) * 1e-9;
+      if (sequence == 0 || (sequence & 1) || record->nbytes > record->capacity || age > d_max_age) {
+        return nullptr;
+      }
+
+      return record;
+    }
+
+    void
+    state_file_t::sync()
+    {
+      msync(d_header, d_size, MS_SYNC);
+    }
+
+    void
+    state_file_t::sync_work_function()
+    {
+      thread_scope_t scope("state_file", "sync");
+      const auto period = boost::chrono::microseconds(static_cast<int64_t>(d_period * 1e6));
+
+      try {
+        while (true) {
+          boost::this_thread::sleep_for(period);
+          msync(d_header, d_size, MS_ASYNC);
+        }
+      }
+      catch (const boost::thread_interrupted &) { }
+    }
+
+    state_slot_t::state_slot_t()
+      : d_record(nullptr),
+        d_restore_pending(false)
+    {
+    }
+
+    void
+    state_slot_t::attach(const state_file_t::sptr &file, const std::string &key)
+    {
+      d_file = file;
+      d_key = key;
+      d_record = nullptr;
+      d_restore_pending = file != nullptr;
+      d_next_save = std::chrono::steady_clock::now();
+    }
+
+    bool
+    state_slot_t::restore(uint64_t layout, std::initializer_list<std::pair<float *, size_t>> parts)
+    {
+      if (!d_restore_pending) {
+        return false;
+      }
+      d_restore_pending = false;
+
+      auto record = d_file->find_valid(d_key);
+      size_t nbytes = 0;
+      for (const auto &part : parts) {
+        nbytes += part.second * sizeof(float);
+      }
+      if (!record || record->layout != layout || record->nbytes != nbytes) {
+        return false;
+      }
+
+      auto src = state_file_t::payload(record);
+      for (const auto &part : parts) {
+        memcpy(part.first, src, part.second * sizeof(float));
+        src += part.second * sizeof(float);
+      }
+
+      return true;
+    }
+
+    void
+    state_slot_t::save(uint64_t layout, std::initializer_list<state_part_t> parts)
+    {
+      // The record of the previous run is kept until the state was restored (or not)
+      if (!d_file || d_restore_pending) {
+        return;
+      }
+
+      d_next_save = std::chrono::steady_clock::now()
+              + std::chrono::microseconds(static_cast<int64_t>(d_file->period() * 1e6));
+
+      size_t nbytes = 0;
+      for (const auto &part : parts) {
+        nbytes += part.second * sizeof(float);
+      }
+
+      // A grown state takes a new record (rare, on design changes only)
+      if (!d_record || d_record->capacity < nbytes) {
+        d_record = d_file->get_record(d_key, nbytes);
+        if (!d_record) {
+          return;
+        }
+      }
+
+      auto &sequence = as_atomic(d_record->sequence);
+      const auto seq = sequence.load(std::memory_order_relaxed);
+      sequence.store(seq | 1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+
+      auto dst = state_file_t::payload(d_record);
+      for (const auto &part : parts) {
+        memcpy(dst, part.first, part.second * sizeof(float));
+        dst += part.second * sizeof(float);
+      }
+      d_record->layout = layout;
+      d_record->nbytes = nbytes;
+      d_record->saved = static_cast<int64_t>(get_timestamp_nano_utc());
+
+      sequence.store((seq | 1) + 1, std::memory_order_release);
+    }
+
+  } /* namespace digitizers */
+} /* namespace gr */
@@ -0,0 +1,221 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_STATE_FILE_H
+#define INCLUDED_DIGITIZERS_STATE_FILE_H
+
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <utility>
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Header of a block state file, see state_file_t.
+     *
+     * The header is followed by the records, each a state_record_header_t followed by its
+     * payload (8 byte aligned). Records are appended and never move, used is the number of
+     * bytes taken by the records so far.
+     */
+    struct state_file_header_t
+    {
+      char     magic[8];          // "DIGISTF", zero terminated
+      uint32_t version;           // STATE_FILE_VERSION
+      uint32_t header_size;       // sizeof(state_file_header_t)
+      uint64_t capacity;          // bytes available to the records
+      uint64_t used;              // bytes taken by the records
+    };
+
+    /*!
+     * \brief Record of a state file, written by a single block.
+     *
+     * The payload is valid if sequence is even and non-zero, it is odd while being written,
+     * i.e. a state torn by a crash is not restored.
+     */
+    struct state_record_header_t
+    {
+      char     key[64];           // zero terminated, unique within the file
+      uint64_t capacity;          // payload bytes reserved
+      uint64_t layout;            // defined by the block, see state_slot_t
+      uint64_t nbytes;            // payload bytes stored
+      int64_t  saved;             // nanoseconds UTC
+      uint32_t sequence;          // accessed atomically
+      uint32_t reserved;
+    };
+
+    static const uint32_t STATE_FILE_VERSION = 1;
+
+    /*!
+     * \brief Memory mapped file persisting the state of blocks (e.g. filter histories) across
+     * process restarts.
+     *
+     * Blocks copy their state into their record from the work function (a memcpy every period,
+     * see state_slot_t), the kernel writes the pages back. A background thread additionally
+     * syncs the file every period. The file is mapped with its whole capacity, it is sparse,
+     * i.e. only the records take disk space.
+     *
+     * Records of a previous run are kept, blocks restore their state from the record with the
+     * same key. Records stored longer than max_age ago are not restored.
+     */
+    class state_file_t : boost::noncopyable
+    {
+    public:
+      typedef boost::shared_ptr<state_file_t> sptr;
+
+      static const size_t DEFAULT_CAPACITY = 16 * 1024 * 1024;
+
+      /*!
+       * \brief Opens or creates the file. A file not being a state file (or of a different
+       * version or capacity) is reinitialized. Throws std::runtime_error on failure.
+       *
+       * \param path file path
+       * \param period save and sync period (in seconds)
+       * \param max_age records stored longer ago are discarded (in seconds)
+       * \param capacity bytes available to the records
+       */
+      state_file_t(const std::string &path, double period, double max_age,
+              size_t capacity=DEFAULT_CAPACITY);
+
+      ~state_file_t();
+
+      const std::string &path() const
+      {
+        return d_path;
+      }
+
+      double period() const
+      {
+        return d_period;
+      }
+
+      /*!
+       * \brief Record with the given key holding at least nbytes. A record of the previous run
+       * is reused if large enough, its content is kept. Returns null if the file is full.
+       */
+      state_record_header_t *get_record(const std::string &key, size_t nbytes);
+
+      /*!
+       * \brief Record with the given key if it holds a valid state not older than max_age,
+       * null otherwise.
+       */
+      const state_record_header_t *find_valid(const std::string &key);
+
+      static char *payload(state_record_header_t *record)
+      {
+        return reinterpret_cast<char *>(record) + sizeof(state_record_header_t);
+      }
+
+      static const char *payload(const state_record_header_t *record)
+      {
+        return reinterpret_cast<const char *>(record) + sizeof(state_record_header_t);
+      }
+
+      /*!
+       * \brief Writes back the dirty pages synchronously.
+       */
+      void sync();
+
+    private:
+
+      // Last record with the given key, null if none, d_mutex must be held
+      state_record_header_t *find_locked(const std::string &key);
+
+      void sync_work_function();
+
+      std::string d_path;
+      double d_period;
+      double d_max_age;
+
+      state_file_header_t *d_header;
+      size_t d_size;
+
+      // Serializes the record allocation, never taken while saving
+      boost::mutex d_mutex;
+
+      boost::thread d_sync_thread;
+    };
+
+    /*!
+     * \brief FNV-1a hash of the given bytes, e.g. of filter coefficients to be used as the
+     * layout of a state_slot_t.
+     */
+    static inline uint64_t
+    state_layout_hash(const void *data, size_t nbytes, uint64_t hash=14695981039346656037ull)
+    {
+      auto bytes = static_cast<const unsigned char *>(data);
+      for (size_t i = 0; i < nbytes; i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+      }
+      return hash;
+    }
+
+    /*!
+     * \brief Part of a state, a contiguous array of floats.
+     */
+    typedef std::pair<const float *, size_t> state_part_t;
+
+    /*!
+     * \brief Block side of a state_file_t record, meant to be used by the work function only.
+     *
+     * The layout identifies the meaning of the state (e.g. the history lengths or a hash of
+     * the design), a state is only restored into the same layout with the same size.
+     */
+    class state_slot_t
+    {
+    public:
+      state_slot_t();
+
+      /*!
+       * \brief Attaches the slot to the record key of the file, null to detach. The state is
+       * restored by the next restore call. Must be called before the flowgraph is started.
+       */
+      void attach(const state_file_t::sptr &file, const std::string &key);
+
+      bool is_attached() const
+      {
+        return d_file != nullptr;
+      }
+
+      /*!
+       * \brief Restores the parts from the record once after attach, does nothing on later
+       * calls. Returns true if restored, the parts are unchanged otherwise.
+       */
+      bool restore(uint64_t layout, std::initializer_list<std::pair<float *, size_t>> parts);
+
+      /*!
+       * \brief Returns true if the period elapsed since the last save.
+       */
+      bool is_due()
+      {
+        return d_file && std::chrono::steady_clock::now() >= d_next_save;
+      }
+
+      /*!
+       * \brief Copies the parts into the record, does nothing before restore was called.
+       */
+      void save(uint64_t layout, std::initializer_list<state_part_t> parts);
+
+    private:
+      state_file_t::sptr d_file;
+      std::string d_key;
+      state_record_header_t *d_record;
+      bool d_restore_pending;
+      std::chrono::steady_clock::time_point d_next_save;
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_STATE_FILE_H */
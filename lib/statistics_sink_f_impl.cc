@@ -0,0 +1,346 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gnuradio/io_signature.h>
+#include "statistics_sink_f_impl.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+namespace gr {
+  namespace digitizers {
+
+    // Independent accumulators of the reductions, the loops over the lanes are vectorized by
+    // the compiler
+    static const size_t LANES = 8;
+
+    moments_t
+    block_moments(const float *x, size_t n)
+    {
+      float sum[LANES], lo[LANES], hi[LANES];
+      for (size_t l = 0; l < LANES; l++) {
+        sum[l] = 0.0f;
+        lo[l] = std::numeric_limits<float>::infinity();
+        hi[l] = -std::numeric_limits<float>::infinity();
+      }
+
+      const size_t nlanes = n - n % LANES;
+      for (size_t i = 0; i < nlanes; i += LANES) {
+        for (size_t l = 0; l < LANES; l++) {
+          sum[l] += x[i + l];
+          lo[l] = x[i + l] < lo[l] ? x[i + l] : lo[l];
+          hi[l] = x[i + l] > hi[l] ? x[i + l] : hi[l];
+        }
+      }
+
+      moments_t m {n, 0.0, 0.0, lo[0], hi[0]};
+      double total = 0.0;
+      for (size_t l = 0; l < LANES; l++) {
+        total += sum[l];
+        m.min = std::min(m.min, lo[l]);
+        m.max = std::max(m.max, hi[l]);
+      }
+      for (size_t i = nlanes; i < n; i++) {
+        total += x[i];
+        m.min = std::min(m.min, x[i]);
+        m.max = std::max(m.max, x[i]);
+      }
+      m.mean = total / n;
+
+      // squared deviations from the mean in a second pass, the block is in the cache already
+      const float mean = static_cast<float>(m.mean);
+      float squares[LANES] = {};
+      for (size_t i = 0; i < nlanes; i += LANES) {
+        for (size_t l = 0; l < LANES; l++) {
+          const float delta = x[i + l] - mean;
+          squares[l] += delta * delta;
+        }
+      }
+      for (size_t l = 0; l < LANES; l++) {
+        m.m2 += squares[l];
+      }
+      for (size_t i = nlanes; i < n; i++) {
+        const double delta = x[i] - m.mean;
+        m.m2 += delta * delta;
+      }
+
+      return m;
+    }
+
+    void
+    merge_moments(moments_t &a, const moments_t &b)
+    {
+      if (b.count == 0) {
+        return;
+      }
+      if (a.count == 0) {
+        a = b;
+        return;
+      }
+
+      const double count = static_cast<double>(a.count + b.count);
+      const double delta = b.mean - a.mean;
+      a.mean += delta * b.count / count;
+      a.m2 += b.m2 + delta * delta * a.count * b.count / count;
+      a.count += b.count;
+      a.min = std::min(a.min, b.min);
+      a.max = std::max(a.max, b.max);
+    }
+
+    statistics_sink_f::sptr
+    statistics_sink_f::make(std::string name, std::string unit, float samp_rate,
+            const std::vector<double> &window_lengths, size_t nrecords)
+    {
+      return gnuradio::get_initial_sptr
+        (new statistics_sink_f_impl(name, unit, samp_rate, window_lengths, nrecords));
+    }
+
+    statistics_sink_f_impl::statistics_sink_f_impl(std::string name, std::string unit,
+            float samp_rate, const std::vector<double> &window_lengths, size_t nrecords)
+      : gr::sync_block("statistics_sink_f",
+              gr::io_signature::make(1, 1, sizeof(float)),
+              gr::io_signature::make(0, 0, 0)),
+        d_samp_rate(samp_rate),
+        d_nrecords(nrecords),
+        d_acq_info(),
+        d_acq_info_offset(0),
+        d_callback(nullptr),
+        d_user_data(nullptr)
+    {
+      d_metadata.name = name;
+      d_metadata.unit = unit;
+      d_acq_info.timestamp = -1;
+
+      if (window_lengths.empty() || nrecords == 0) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": at least one window and record required";
+        throw std::invalid_argument(message.str());
+      }
+
+      for (auto length : window_lengths) {
+        const auto samples = std::llround(length * samp_rate);
+        if (samples < 1 || (!d_lengths.empty()
+                && (static_cast<uint64_t>(samples) <= d_lengths.back()
+                || static_cast<uint64_t>(samples) % d_lengths.back() != 0))) {
+          std::ostringstream message;
+          message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid window length: " << length
+                  << ", has to be a multiple of the previous one";
+          throw std::invalid_argument(message.str());
+        }
+        d_lengths.push_back(static_cast<uint64_t>(samples));
+      }
+
+      d_windows.resize(d_lengths.size());
+      d_records.resize(d_lengths.size());
+      d_lost.assign(d_lengths.size(), 0);
+    }
+
+    statistics_sink_f_impl::~statistics_sink_f_impl()
+    {
+    }
+
+    bool
+    statistics_sink_f_impl::start()
+    {
+      d_acq_info = acq_info_t {};
+      d_acq_info.timestamp = -1;
+      d_acq_info_offset = 0;
+
+      for (auto &window : d_windows) {
+        window.moments.count = 0;
+      }
+
+      boost::mutex::scoped_lock lock(d_mutex);
+      for (size_t k = 0; k < d_records.size(); k++) {
+        d_records[k].clear();
+        d_lost[k] = 0;
+      }
+      return true;
+    }
+
+    int64_t
+    statistics_sink_f_impl::get_timestamp(uint64_t offset) const
+    {
+      if (d_acq_info.timestamp == -1) {
+        return -1;
+      }
+
+      const auto distance = static_cast<double>(offset - d_acq_info_offset);
+      return d_acq_info.timestamp + static_cast<int64_t>(distance * d_acq_info.timebase * 1000000000.0);
+    }
+
+    void
+    statistics_sink_f_impl::start_window(size_t k, uint64_t offset)
+    {
+      auto &window = d_windows[k];
+      window.moments.count = 0;
+      window.status = 0;
+      window.timestamp = get_timestamp(offset);
+      window.user_delay = d_acq_info.user_delay;
+      window.actual_delay = d_acq_info.actual_delay;
+    }
+
+    void
+    statistics_sink_f_impl::complete_window(size_t k)
+    {
+      auto &window = d_windows[k];
+      const auto &m = window.moments;
+
+      statistics_record_t record;
+      record.window = static_cast<uint32_t>(k);
+      record.mean = static_cast<float>(m.mean);
+      record.rms = static_cast<float>(std::sqrt(m.m2 / m.count + m.mean * m.mean));
+      record.stddev = m.count > 1 ? static_cast<float>(std::sqrt(m.m2 / (m.count - 1))) : 0.0f;
+      record.min = m.min;
+      record.max = m.max;
+      record.info.timebase = d_lengths[k] / static_cast<double>(d_samp_rate);
+      record.info.user_delay = window.user_delay;
+      record.info.actual_delay = window.actual_delay;
+      record.info.timestamp = window.timestamp;
+      record.info.trigger_timestamp = window.timestamp;
+      record.info.status = window.status;
+      record.info.pre_trigger_samples = 0;
+      record.info.post_trigger_samples = static_cast<uint32_t>(m.count);
+      record.info.samples_lost = 0;
+
+      {
+        boost::mutex::scoped_lock lock(d_mutex);
+        auto &records = d_records[k];
+        if (records.size() >= d_nrecords) {
+          records.pop_front();
+          d_lost[k] += d_lengths[k];
+        }
+        records.push_back(record);
+      }
+
+      if (d_callback) {
+        d_callback(&record, d_user_data);
+      }
+
+      if (k + 1 < d_windows.size()) {
+        auto &next = d_windows[k + 1];
+        merge_moments(next.moments, m);
+        next.status |= window.status;
+        if (next.moments.count == d_lengths[k + 1]) {
+          complete_window(k + 1);
+        }
+      }
+
+      window.moments.count = 0;
+    }
+
+    int
+    statistics_sink_f_impl::work(int noutput_items,
+        gr_vector_const_void_star &input_items,
+        gr_vector_void_star &output_items)
+    {
+      block_stats_scope_t stats(d_stats);
+
+      const float *in = (const float *) input_items[0];
+      const uint64_t first_offset = nitems_read(0);
+
+      d_tags.clear();
+      get_tags_in_range(d_tags, 0, first_offset, first_offset + noutput_items, acq_info_tag_key());
+      size_t tag_idx = 0;
+
+      // The samples are visited once, in chunks ending at the boundaries of the shortest window
+      int i = 0;
+      while (i < noutput_items) {
+        auto &window = d_windows[0];
+        const uint64_t offset = first_offset + i;
+        const auto n = static_cast<int>(std::min<uint64_t>(noutput_items - i,
+                d_lengths[0] - window.moments.count));
+
+        if (window.moments.count == 0) {
+          // acq_info in effect at the first sample of the window
+          for (size_t t = tag_idx; t < d_tags.size() && d_tags[t].offset <= offset; t++) {
+            d_acq_info = decode_acq_info_tag(d_tags[t]);
+            d_acq_info_offset = d_tags[t].offset;
+          }
+
+          // windows are aligned, the longer ones start with the shortest one
+          for (size_t k = 0; k < d_windows.size() && d_windows[k].moments.count == 0; k++) {
+            start_window(k, offset);
+          }
+        }
+
+        for (; tag_idx < d_tags.size() && d_tags[tag_idx].offset < offset + n; tag_idx++) {
+          d_acq_info = decode_acq_info_tag(d_tags[tag_idx]);
+          d_acq_info_offset = d_tags[tag_idx].offset;
+          window.status |= d_acq_info.status;
+        }
+
+        merge_moments(window.moments, block_moments(in + i, n));
+        if (window.moments.count == d_lengths[0]) {
+          complete_window(0);
+        }
+
+        i += n;
+      }
+
+      return noutput_items;
+    }
+
+    signal_metadata_t
+    statistics_sink_f_impl::get_metadata()
+    {
+      return d_metadata;
+    }
+
+    float
+    statistics_sink_f_impl::get_sample_rate()
+    {
+      return d_samp_rate;
+    }
+
+    std::vector<double>
+    statistics_sink_f_impl::get_window_lengths()
+    {
+      std::vector<double> lengths;
+      for (auto length : d_lengths) {
+        lengths.push_back(length / static_cast<double>(d_samp_rate));
+      }
+      return lengths;
+    }
+
+    size_t
+    statistics_sink_f_impl::get_records(size_t window, statistics_record_t *records, size_t max_records)
+    {
+      if (window >= d_records.size()) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid window index: " << window;
+        throw std::invalid_argument(message.str());
+      }
+
+      boost::mutex::scoped_lock lock(d_mutex);
+      auto &queue = d_records[window];
+      const auto count = std::min(max_records, queue.size());
+      std::copy(queue.begin(), queue.begin() + count, records);
+      queue.erase(queue.begin(), queue.begin() + count);
+
+      if (count) {
+        records[0].info.samples_lost = d_lost[window];
+        d_lost[window] = 0;
+      }
+      return count;
+    }
+
+    void
+    statistics_sink_f_impl::set_callback(statistics_cb_t callback, void *ptr)
+    {
+      d_callback = callback;
+      d_user_data = ptr;
+    }
+
+  } /* namespace digitizers */
+} /* namespace gr */
@@ -0,0 +1,115 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_STATISTICS_SINK_F_IMPL_H
+#define INCLUDED_DIGITIZERS_STATISTICS_SINK_F_IMPL_H
+
+#include <digitizers/statistics_sink_f.h>
+#include <digitizers/tags.h>
+
+#include <boost/thread/mutex.hpp>
+#include <deque>
+#include <vector>
+
+#include "block_stats_impl.h"
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Count, mean, sum of squared deviations, min and max of a set of samples.
+     */
+    struct moments_t
+    {
+      uint64_t count;
+      double mean;
+      double m2;
+      float min;
+      float max;
+    };
+
+    /*!
+     * \brief Moments of n samples (n > 0).
+     */
+    moments_t block_moments(const float *x, size_t n);
+
+    /*!
+     * \brief Merges the moments b into a (Chan et al.).
+     */
+    void merge_moments(moments_t &a, const moments_t &b);
+
+    class statistics_sink_f_impl : public statistics_sink_f
+    {
+     private:
+
+      // Window being accumulated, the timing is the one of its first sample
+      struct window_state_t
+      {
+        moments_t moments;
+        uint32_t status;
+        int64_t timestamp;
+        double user_delay;
+        double actual_delay;
+      };
+
+      signal_metadata_t d_metadata;
+      float d_samp_rate;
+      size_t d_nrecords;
+
+      // Window lengths in samples, ascending
+      std::vector<uint64_t> d_lengths;
+      std::vector<window_state_t> d_windows;
+
+      // timing, the last acq_info tag
+      acq_info_t d_acq_info;
+      uint64_t d_acq_info_offset;
+      std::vector<gr::tag_t> d_tags;
+
+      // Records not read yet and the samples of the dropped ones, per window length
+      boost::mutex d_mutex;
+      std::vector<std::deque<statistics_record_t>> d_records;
+      std::vector<uint64_t> d_lost;
+
+      statistics_cb_t d_callback;
+      void *d_user_data;
+
+      block_stats_recorder_t d_stats {this};
+
+      int64_t get_timestamp(uint64_t offset) const;
+
+      // Starts window k at the given offset
+      void start_window(size_t k, uint64_t offset);
+
+      // Records the complete window k and merges it into the next longer one
+      void complete_window(size_t k);
+
+     public:
+      statistics_sink_f_impl(std::string name, std::string unit, float samp_rate,
+              const std::vector<double> &window_lengths, size_t nrecords);
+
+      ~statistics_sink_f_impl();
+
+      bool start() override;
+
+      int work(int noutput_items,
+         gr_vector_const_void_star &input_items,
+         gr_vector_void_star &output_items) override;
+
+      signal_metadata_t get_metadata() override;
+
+      float get_sample_rate() override;
+
+      std::vector<double> get_window_lengths() override;
+
+      size_t get_records(size_t window, statistics_record_t *records, size_t max_records) override;
+
+      void set_callback(statistics_cb_t callback, void *ptr) override;
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_STATISTICS_SINK_F_IMPL_H */
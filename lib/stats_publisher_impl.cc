@@ -0,0 +1,134 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gnuradio/io_signature.h>
+#include "stats_publisher_impl.h"
+#include "thread_registry.h"
+#include "trace_registry.h"
+
+namespace gr {
+  namespace digitizers {
+
+    stats_publisher::sptr
+    stats_publisher::make(double interval, const std::string &shm_name)
+    {
+      return gnuradio::get_initial_sptr
+        (new stats_publisher_impl(interval, shm_name));
+    }
+
+    stats_publisher_impl::stats_publisher_impl(double interval, const std::string &shm_name)
+      : gr::block("stats_publisher",
+              gr::io_signature::make(0, 0, 0),
+              gr::io_signature::make(0, 0, 0)),
+        d_interval(static_cast<long>(interval * 1000.0))
+    {
+      if (interval <= 0.0) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": interval must be positive";
+        throw std::invalid_argument(message.str());
+      }
+
+      message_port_register_out(pmt::mp("stats"));
+      message_port_register_out(pmt::mp("threads"));
+
+      if (!shm_name.empty()) {
+        d_export.open(shm_name, interval);
+      }
+    }
+
+    stats_publisher_impl::~stats_publisher_impl()
+    {
+      d_thread.interrupt();
+      d_thread.join();
+    }
+
+    bool
+    stats_publisher_impl::start()
+    {
+      set_block_stats_enabled(true);
+      d_thread = boost::thread(&stats_publisher_impl::publish_work_function, this);
+      return true;
+    }
+
+    bool
+    stats_publisher_impl::stop()
+    {
+      d_thread.interrupt();
+      d_thread.join();
+
+      // Publish the final state, e.g. for flowgraphs running to completion
+      publish();
+      set_block_stats_enabled(false);
+      return true;
+    }
+
+    void
+    stats_publisher_impl::publish()
+    {
+      const auto block_stats = get_block_stats();
+      const auto thread_stats = get_thread_stats();
+
+      if (d_export.is_open()) {
+        d_export.publish(block_stats, thread_stats);
+      }
+
+      for (const auto &stats : block_stats) {
+        auto dict = pmt::make_dict();
+        dict = pmt::dict_add(dict, pmt::mp("name"), pmt::mp(stats.name));
+        dict = pmt::dict_add(dict, pmt::mp("work_calls"), pmt::from_uint64(stats.work_calls));
+        dict = pmt::dict_add(dict, pmt::mp("work_time_ns"), pmt::from_uint64(stats.work_time_ns));
+        dict = pmt::dict_add(dict, pmt::mp("items"), pmt::from_uint64(stats.items));
+        dict = pmt::dict_add(dict, pmt::mp("tags"), pmt::from_uint64(stats.tags));
+        dict = pmt::dict_add(dict, pmt::mp("items_per_second"), pmt::from_double(stats.items_per_second));
+        dict = pmt::dict_add(dict, pmt::mp("load"), pmt::from_double(stats.load));
+        dict = pmt::dict_add(dict, pmt::mp("data_age_ns"), pmt::from_long(stats.data_age_ns));
+        dict = pmt::dict_add(dict, pmt::mp("max_data_age_ns"), pmt::from_long(stats.max_data_age_ns));
+        dict = pmt::dict_add(dict, pmt::mp("avg_data_age_ns"), pmt::from_double(stats.avg_data_age_ns));
+        dict = pmt::dict_add(dict, pmt::mp("allocations"), pmt::from_uint64(stats.allocations));
+        dict = pmt::dict_add(dict, pmt::mp("allocating_calls"), pmt::from_uint64(stats.allocating_calls));
+        dict = pmt::dict_add(dict, pmt::mp("buffer_occupancy"), pmt::from_double(stats.buffer_occupancy));
+        dict = pmt::dict_add(dict, pmt::mp("max_buffer_occupancy"), pmt::from_double(stats.max_buffer_occupancy));
+        dict = pmt::dict_add(dict, pmt::mp("lost"), pmt::from_uint64(stats.lost));
+
+        message_port_pub(pmt::mp("stats"), dict);
+      }
+
+      for (const auto &stats : thread_stats) {
+        auto dict = pmt::make_dict();
+        dict = pmt::dict_add(dict, pmt::mp("name"), pmt::mp(stats.name));
+        dict = pmt::dict_add(dict, pmt::mp("tid"), pmt::from_long(stats.tid));
+        dict = pmt::dict_add(dict, pmt::mp("cpu"), pmt::from_long(stats.cpu));
+        dict = pmt::dict_add(dict, pmt::mp("cpu_time_ns"), pmt::from_uint64(stats.cpu_time_ns));
+        dict = pmt::dict_add(dict, pmt::mp("voluntary_switches"), pmt::from_uint64(stats.voluntary_switches));
+        dict = pmt::dict_add(dict, pmt::mp("involuntary_switches"), pmt::from_uint64(stats.involuntary_switches));
+        dict = pmt::dict_add(dict, pmt::mp("scheduling_failed"), pmt::from_bool(stats.scheduling_failed));
+
+        message_port_pub(pmt::mp("threads"), dict);
+      }
+    }
+
+    void
+    stats_publisher_impl::publish_work_function()
+    {
+      thread_scope_t thread(get_block_name(this), "publish");
+
+      try {
+        while (true) {
+          boost::this_thread::sleep(d_interval);
+          publish();
+        }
+      }
+      catch (const boost::thread_interrupted &) {
+        // stopped
+      }
+    }
+
+  } // namespace digitizers
+} // namespace gr
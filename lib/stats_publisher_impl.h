@@ -0,0 +1,42 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_STATS_PUBLISHER_IMPL_H
+#define INCLUDED_DIGITIZERS_STATS_PUBLISHER_IMPL_H
+
+#include <digitizers/stats_publisher.h>
+#include <digitizers/block_stats.h>
+#include <digitizers/thread_stats.h>
+#include "telemetry_export.h"
+#include <boost/thread/thread.hpp>
+
+namespace gr {
+  namespace digitizers {
+
+    class stats_publisher_impl : public stats_publisher
+    {
+     private:
+      boost::posix_time::milliseconds d_interval;
+      boost::thread d_thread;
+      telemetry_export_t d_export;
+
+      void publish_work_function();
+
+     public:
+      stats_publisher_impl(double interval, const std::string &shm_name);
+      ~stats_publisher_impl();
+
+      bool start() override;
+
+      bool stop() override;
+
+      void publish();
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_STATS_PUBLISHER_IMPL_H */
@@ -10,14 +10,47 @@
 
 #include <gnuradio/io_signature.h>
 #include "stft_algorithms_impl.h"
+#include "design_cache.h"
 #include <gnuradio/block.h>
 
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
 namespace gr {
   namespace digitizers {
 
+    // Same spacing as the frequency vector, bins span [fq_low, fq_hi]
+    static freq_axis_t
+    make_linear_freq_axis(uint32_t version, double fq_low, double fq_hi, int nbins)
+    {
+      freq_axis_t axis;
+      axis.version = version;
+      axis.nbins = static_cast<uint32_t>(nbins);
+      axis.fq_low = nbins > 1 ? fq_low : (fq_low + fq_hi) / 2.0;
+      axis.fq_step = nbins > 1 ? (fq_hi - fq_low) / static_cast<double>(nbins - 1) : 0.0;
+      return axis;
+    }
+
+    static std::vector<float>
+    make_linear_freqs(const freq_axis_t &axis)
+    {
+      std::vector<float> freqs(axis.nbins);
+      for (uint32_t i = 0; i < axis.nbins; i++) {
+        freqs[i] = axis.fq_low + i * axis.fq_step;
+      }
+      return freqs;
+    }
+
     stft_algorithms::sptr
-    stft_algorithms::make(double samp_rate, double delta_t, int window_size, int wintype, stft_algorithm_id_t alg_id, double fq_low, double fq_hi, int nbins)
+    stft_algorithms::make(double samp_rate, double delta_t, int window_size, int wintype, stft_algorithm_id_t alg_id, double fq_low, double fq_hi, int nbins,
+            double center_freq, int decimation)
     {
+      if (decimation > 1) {
+        return gnuradio::get_initial_sptr
+            (new ddc_stft_impl(samp_rate, delta_t, window_size, alg_id, fq_low, fq_hi, nbins, center_freq, decimation));
+      }
+
       switch(alg_id) {
       case FFT:
         return gnuradio::get_initial_sptr
@@ -31,8 +64,12 @@ namespace gr {
         return gnuradio::get_initial_sptr
             (new goertzel_impl(samp_rate, delta_t, window_size, 0, samp_rate/2, window_size, true));
         break;
+      case AUTO:
+        return gnuradio::get_initial_sptr
+            (new auto_impl(samp_rate, delta_t, window_size, fq_low, fq_hi, nbins));
+        break;
       default:
-        std::cout<<"STFT alg_id must be either 0-FFT, 1-Goertzel, 2-DFT!\nis:"<<alg_id<<" -> Defaulting to FFT!\n";
+        std::cout<<"STFT alg_id must be either 0-FFT, 1-Goertzel, 2-DFT, 3-Auto!\nis:"<<alg_id<<" -> Defaulting to FFT!\n";
         return gnuradio::get_initial_sptr
             (new fft_impl(samp_rate, delta_t, window_size, static_cast<filter::firdes::win_type>(wintype),fq_low, fq_hi, nbins));
         break;
@@ -49,7 +86,7 @@ namespace gr {
         int nbins)
     : gr::hier_block2("stft_algorithms",
         gr::io_signature::make(1, 1, sizeof(float)),
-        gr::io_signature::make(3, 3, sizeof(float)*window_size)),
+        gr::io_signature::make(2, 3, sizeof(float)*window_size)),
       d_wintype(wintype),
       d_samp_rate(samp_rate),
       d_window_size(window_size)
@@ -70,29 +107,19 @@ namespace gr {
       }
       d_str2vec = stream_to_vector_overlay_ff::make(d_window_size * 2, samp_rate, delta_t);
       d_com2magphase = blocks::complex_to_magphase::make(d_window_size);
-      d_fft = fft::fft_vfc::make(d_window_size * 2,
-        true,
-        filter::firdes::window(d_wintype, d_window_size * 2,
+      d_fft = batched_fft_vfc::make(d_window_size * 2,
+        d_window_size,
+        cached_firdes_window(d_wintype, d_window_size * 2,
         6.76));
-      d_vec2str = blocks::vector_to_stream::make(sizeof(gr_complex),
-          d_window_size*2);
-      d_keep_m = blocks::keep_m_in_n::make(sizeof(gr_complex),
-          d_window_size,
-          d_window_size * 2,
-          0);
-      d_half_str2vec = blocks::stream_to_vector::make(sizeof(gr_complex),
-          d_window_size);
       d_freqs = blocks::vector_source_f::make(freqs, true, d_window_size);
+      d_str2vec->set_freq_axis(make_linear_freq_axis(0, fq_low, fq_hi, d_window_size));
 
       /* Connections */
       //input
       connect(self(), 0, d_str2vec, 0);
-      //stream->vector -> FFT -> keep front half -> post
+      //stream->vector -> FFT (front half) -> post
       connect(d_str2vec,0, d_fft, 0);
-      connect(d_fft, 0, d_vec2str, 0);
-      connect(d_vec2str, 0, d_keep_m, 0);
-      connect(d_keep_m, 0, d_half_str2vec, 0);
-      connect(d_half_str2vec, 0, d_com2magphase, 0);
+      connect(d_fft, 0, d_com2magphase, 0);
       //output
       connect(d_com2magphase, 0, self(), 0);
       connect(d_com2magphase, 1, self(), 1);
@@ -108,7 +135,7 @@ namespace gr {
     fft_impl::set_window_type(int wintype)
     {
       d_wintype = static_cast<filter::firdes::win_type>(wintype);
-      d_fft->set_window(filter::firdes::window(d_wintype, d_window_size * 2, 6.76));
+      d_fft->set_window(cached_firdes_window(d_wintype, d_window_size * 2, 6.76));
     }
 
     void
@@ -121,6 +148,12 @@ namespace gr {
     {
     }
 
+    stft_algorithm_id_t
+    fft_impl::get_algorithm()
+    {
+      return FFT;
+    }
+
 
     //alg_id = 1 (Goertzel)
     goertzel_impl::goertzel_impl(double samp_rate,
@@ -132,7 +165,7 @@ namespace gr {
         bool range_fixed)
     : gr::hier_block2("stft_algorithms",
         gr::io_signature::make(1, 1, sizeof(float)),
-        gr::io_signature::make(3, 3, sizeof(float)*nbins)),
+        gr::io_signature::make(2, 3, sizeof(float)*nbins)),
       d_samp_rate(samp_rate),
       d_window_size(window_size),
       d_fq_lo(fq_low),
@@ -159,24 +192,36 @@ namespace gr {
       d_goe.clear();
       d_goe.reserve(d_nbins);
       d_freqs = blocks::vector_source_f::make(freqs, true, d_nbins);
+      d_freq_axis = make_linear_freq_axis(0, fq_low, fq_hi, d_nbins);
+      d_str2vec->set_freq_axis(d_freq_axis);
 
       /* Connections */
       //input
       connect(self(), 0, d_str2vec, 0);
-      connect(d_str2vec, 0, d_vec2str, 0);
-      for(int i = 0; i < d_nbins; i++) {
-        d_goe.push_back(
-            fft::goertzel_fc::make(d_samp_rate, d_window_size, freqs.at(i))
-        );
-        connect(d_vec2str, 0, d_goe.at(i), 0);
-        connect(d_goe.at(i), 0, d_strs2vec, i);
-
-        if (i >= 1) {
-            d_goe.at(i)->set_tag_propagation_policy(gr::block::tag_propagation_policy_t::TPP_DONT);
-        }
 
+      // same hop as used by stream_to_vector_overlay_ff
+      const double hop = delta_t * samp_rate;
+      if (sliding_dft_vfc::use_sliding_dft(d_window_size, hop)) {
+        d_sliding_dft = sliding_dft_vfc::make(d_window_size, d_samp_rate, hop, freqs);
+        connect(d_str2vec, 0, d_sliding_dft, 0);
+        connect(d_sliding_dft, 0, d_com2magphase, 0);
+      }
+      else {
+        connect(d_str2vec, 0, d_vec2str, 0);
+        for(int i = 0; i < d_nbins; i++) {
+          d_goe.push_back(
+              fft::goertzel_fc::make(d_samp_rate, d_window_size, freqs.at(i))
+          );
+          connect(d_vec2str, 0, d_goe.at(i), 0);
+          connect(d_goe.at(i), 0, d_strs2vec, i);
+
+          if (i >= 1) {
+              d_goe.at(i)->set_tag_propagation_policy(gr::block::tag_propagation_policy_t::TPP_DONT);
+          }
+
+        }
+        connect(d_strs2vec, 0, d_com2magphase, 0);
       }
-      connect(d_strs2vec, 0, d_com2magphase, 0);
 
       //output
       connect(d_com2magphase, 0, self(), 0);
@@ -193,12 +238,21 @@ namespace gr {
     goertzel_impl::set_window_type(int wintype)
     {}
 
+    stft_algorithm_id_t
+    goertzel_impl::get_algorithm()
+    {
+      return d_range_fixed ? DFT : GOERTZEL;
+    }
+
     void
     goertzel_impl::set_samp_rate(double samp_rate)
     {
 
       d_samp_rate = samp_rate;
-      for(int i = 0; i < d_nbins; i++) {
+      if (d_sliding_dft) {
+        d_sliding_dft->set_samp_rate(d_samp_rate);
+      }
+      for(size_t i = 0; i < d_goe.size(); i++) {
         d_goe.at(i)->set_rate(d_samp_rate);
       }
       if(d_range_fixed){
@@ -217,14 +271,184 @@ namespace gr {
 
         for(int i = 0; i < d_nbins; i++) {
           double ith_freq = d_fq_lo + (i * fq_step);
-          d_goe.at(i)->set_freq(ith_freq);
+          if (!d_goe.empty()) {
+            d_goe.at(i)->set_freq(ith_freq);
+          }
           freqs.at(i) = ith_freq;
         }
+        if (d_sliding_dft) {
+          d_sliding_dft->set_freqs(freqs);
+        }
         d_freqs->set_data(freqs);
+
+        d_freq_axis.version++;
+        d_freq_axis.fq_low = d_fq_lo;
+        d_freq_axis.fq_step = fq_step;
+        d_str2vec->set_freq_axis(d_freq_axis);
       }
     }
 
 
+    //alg_id = 3 (Auto)
+    auto_impl::auto_impl(double samp_rate,
+        double delta_t,
+        int window_size,
+        double fq_low,
+        double fq_hi,
+        int nbins)
+    : gr::hier_block2("stft_algorithms",
+        gr::io_signature::make(1, 1, sizeof(float)),
+        gr::io_signature::make(2, 3, sizeof(float)*nbins)),
+      d_nbins(nbins)
+    {
+      d_freq_axis = make_linear_freq_axis(0, fq_low, fq_hi, d_nbins);
+
+      d_str2vec = stream_to_vector_overlay_ff::make(window_size, samp_rate, delta_t);
+      d_dtft = dtft_bins_vfc::make(window_size, samp_rate, d_freq_axis.fq_low, d_freq_axis.fq_step, d_nbins, AUTO);
+      d_com2magphase = blocks::complex_to_magphase::make(d_nbins);
+      d_freqs = blocks::vector_source_f::make(make_linear_freqs(d_freq_axis), true, d_nbins);
+      d_str2vec->set_freq_axis(d_freq_axis);
+
+      /* Connections */
+      connect(self(), 0, d_str2vec, 0);
+      connect(d_str2vec, 0, d_dtft, 0);
+      connect(d_dtft, 0, d_com2magphase, 0);
+      connect(d_com2magphase, 0, self(), 0);
+      connect(d_com2magphase, 1, self(), 1);
+      connect(d_freqs, 0, self(), 2);
+    }
+
+    auto_impl::~auto_impl()
+    {
+
+    }
+
+    void
+    auto_impl::set_window_type(int wintype)
+    {}
+
+    void
+    auto_impl::set_samp_rate(double samp_rate)
+    {
+      d_dtft->set_samp_rate(samp_rate);
+    }
+
+    void
+    auto_impl::set_freqs(double fq_low, double fq_hi)
+    {
+      d_freq_axis = make_linear_freq_axis(d_freq_axis.version + 1, fq_low, fq_hi, d_nbins);
+      d_dtft->set_freqs(d_freq_axis.fq_low, d_freq_axis.fq_step);
+      d_freqs->set_data(make_linear_freqs(d_freq_axis));
+      d_str2vec->set_freq_axis(d_freq_axis);
+    }
+
+    stft_algorithm_id_t
+    auto_impl::get_algorithm()
+    {
+      return d_dtft->active_algorithm();
+    }
+
+
+    //decimation > 1 (down-converter)
+    ddc_stft_impl::ddc_stft_impl(double samp_rate,
+        double delta_t,
+        int window_size,
+        stft_algorithm_id_t alg_id,
+        double fq_low,
+        double fq_hi,
+        int nbins,
+        double center_freq,
+        int decimation)
+    : gr::hier_block2("stft_algorithms",
+        gr::io_signature::make(1, 1, sizeof(float)),
+        gr::io_signature::make(2, 3, sizeof(float)*nbins)),
+      d_samp_rate(samp_rate),
+      d_center_freq(center_freq),
+      d_decimation(decimation),
+      d_nbins(nbins)
+    {
+      if (alg_id != FFT && alg_id != GOERTZEL && alg_id != AUTO) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": down-converter requires FFT, GOERTZEL or AUTO, is: " << alg_id;
+        throw std::invalid_argument(message.str());
+      }
+      if (window_size % decimation) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": decimation " << decimation
+                << " doesn't divide window size " << window_size;
+        throw std::invalid_argument(message.str());
+      }
+      check_passband(fq_low, fq_hi);
+
+      // bins are evaluated at baseband, the axis refers to the input
+      const double baseband_rate = samp_rate / decimation;
+      d_freq_axis = make_linear_freq_axis(0, fq_low, fq_hi, d_nbins);
+
+      d_ddc = ddc_fc::make(decimation, samp_rate, center_freq);
+      d_str2vec = stream_to_vector_overlay_cc::make(window_size / decimation, baseband_rate, delta_t);
+      d_dtft = dtft_bins_vcc::make(window_size / decimation, baseband_rate, d_freq_axis.fq_low - center_freq,
+              d_freq_axis.fq_step, d_nbins, alg_id);
+      d_com2magphase = blocks::complex_to_magphase::make(d_nbins);
+      d_freqs = blocks::vector_source_f::make(make_linear_freqs(d_freq_axis), true, d_nbins);
+      d_str2vec->set_freq_axis(d_freq_axis);
+
+      /* Connections */
+      connect(self(), 0, d_ddc, 0);
+      connect(d_ddc, 0, d_str2vec, 0);
+      connect(d_str2vec, 0, d_dtft, 0);
+      connect(d_dtft, 0, d_com2magphase, 0);
+      connect(d_com2magphase, 0, self(), 0);
+      connect(d_com2magphase, 1, self(), 1);
+      connect(d_freqs, 0, self(), 2);
+    }
+
+    ddc_stft_impl::~ddc_stft_impl()
+    {
+
+    }
+
+    void
+    ddc_stft_impl::check_passband(double fq_low, double fq_hi)
+    {
+      const double passband = ddc_fc::PASSBAND * d_samp_rate / d_decimation;
+      if (std::abs(fq_low - d_center_freq) > passband || std::abs(fq_hi - d_center_freq) > passband) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": bins [" << fq_low << ", " << fq_hi
+                << "] outside of the down-converter passband " << d_center_freq << " +/- " << passband;
+        throw std::invalid_argument(message.str());
+      }
+    }
+
+    void
+    ddc_stft_impl::set_window_type(int wintype)
+    {}
+
+    void
+    ddc_stft_impl::set_samp_rate(double samp_rate)
+    {
+      d_samp_rate = samp_rate;
+      d_ddc->set_samp_rate(samp_rate);
+      d_dtft->set_samp_rate(samp_rate / d_decimation);
+    }
+
+    void
+    ddc_stft_impl::set_freqs(double fq_low, double fq_hi)
+    {
+      check_passband(fq_low, fq_hi);
+
+      d_freq_axis = make_linear_freq_axis(d_freq_axis.version + 1, fq_low, fq_hi, d_nbins);
+      d_dtft->set_freqs(d_freq_axis.fq_low - d_center_freq, d_freq_axis.fq_step);
+      d_freqs->set_data(make_linear_freqs(d_freq_axis));
+      d_str2vec->set_freq_axis(d_freq_axis);
+    }
+
+    stft_algorithm_id_t
+    ddc_stft_impl::get_algorithm()
+    {
+      return d_dtft->active_algorithm();
+    }
+
+
 
 
   } /* namespace digitizers */
@@ -12,13 +12,16 @@
 #include <gnuradio/blocks/vector_to_stream.h>
 #include <gnuradio/blocks/stream_to_vector.h>
 #include <gnuradio/blocks/vector_source_f.h>
-#include <gnuradio/fft/fft_vfc.h>
 #include <gnuradio/fft/goertzel_fc.h>
 #include <gnuradio/blocks/vector_to_stream.h>
-#include <gnuradio/blocks/keep_m_in_n.h>
 #include <gnuradio/blocks/complex_to_magphase.h>
 #include <gnuradio/blocks/streams_to_vector.h>
 #include <gnuradio/filter/firdes.h>
+#include "sliding_dft_impl.h"
+#include "batched_fft_impl.h"
+#include "dtft_bins_impl.h"
+#include "ddc_impl.h"
+#include "stream_to_vector_overlay_cc_impl.h"
 
 namespace gr {
   namespace digitizers {
@@ -31,10 +34,7 @@ namespace gr {
       filter::firdes::win_type d_wintype;
       stream_to_vector_overlay_ff::sptr d_str2vec;
       blocks::complex_to_magphase::sptr d_com2magphase;
-      fft::fft_vfc::sptr d_fft;
-      blocks::vector_to_stream::sptr d_vec2str;
-      blocks::keep_m_in_n::sptr d_keep_m;
-      blocks::stream_to_vector::sptr d_half_str2vec;
+      batched_fft_vfc::sptr d_fft;      // keeps the front half
       blocks::vector_source_f::sptr d_freqs;
       double d_samp_rate;
       int d_window_size;
@@ -59,6 +59,8 @@ namespace gr {
 
       void set_window_type(int wintype);
 
+      stft_algorithm_id_t get_algorithm();
+
     };
 
     //alg_id = 1, 2
@@ -70,6 +72,7 @@ namespace gr {
       blocks::complex_to_magphase::sptr d_com2magphase;
       std::vector<fft::goertzel_fc::sptr> d_goe;
       blocks::streams_to_vector::sptr d_strs2vec;
+      sliding_dft_vfc::sptr d_sliding_dft;     // used instead of d_goe for large overlaps
       blocks::vector_source_f::sptr d_freqs;
       double d_samp_rate;
       int d_window_size;
@@ -77,6 +80,7 @@ namespace gr {
       double d_fq_hi;
       int d_nbins;
       bool d_range_fixed;
+      freq_axis_t d_freq_axis;
 
     public:
 
@@ -97,6 +101,80 @@ namespace gr {
       void set_freqs(double fq_low, double fq_hi);
 
       void set_window_type(int wintype);
+
+      stft_algorithm_id_t get_algorithm();
+    };
+
+    //alg_id = 3, same output as goertzel_impl
+    class auto_impl : public stft_algorithms
+    {
+    private:
+      stream_to_vector_overlay_ff::sptr d_str2vec;
+      dtft_bins_vfc::sptr d_dtft;
+      blocks::complex_to_magphase::sptr d_com2magphase;
+      blocks::vector_source_f::sptr d_freqs;
+      int d_nbins;
+      freq_axis_t d_freq_axis;
+
+    public:
+
+      auto_impl(double samp_rate,
+          double delta_t,
+          int window_size,
+          double fq_low,
+          double fq_hi,
+          int nbins);
+
+      ~auto_impl();
+
+      void set_samp_rate(double samp_rate);
+
+      void set_freqs(double fq_low, double fq_hi);
+
+      void set_window_type(int wintype);
+
+      stft_algorithm_id_t get_algorithm();
+    };
+
+    //decimation > 1, same output as goertzel_impl
+    class ddc_stft_impl : public stft_algorithms
+    {
+    private:
+      ddc_fc::sptr d_ddc;
+      stream_to_vector_overlay_cc::sptr d_str2vec;
+      dtft_bins_vcc::sptr d_dtft;
+      blocks::complex_to_magphase::sptr d_com2magphase;
+      blocks::vector_source_f::sptr d_freqs;
+      double d_samp_rate;
+      double d_center_freq;
+      int d_decimation;
+      int d_nbins;
+      freq_axis_t d_freq_axis;
+
+      // Throws if the bins are outside of the down-converter passband
+      void check_passband(double fq_low, double fq_hi);
+
+    public:
+
+      ddc_stft_impl(double samp_rate,
+          double delta_t,
+          int window_size,
+          stft_algorithm_id_t alg_id,
+          double fq_low,
+          double fq_hi,
+          int nbins,
+          double center_freq,
+          int decimation);
+
+      ~ddc_stft_impl();
+
+      void set_samp_rate(double samp_rate);
+
+      void set_freqs(double fq_low, double fq_hi);
+
+      void set_window_type(int wintype);
+
+      stft_algorithm_id_t get_algorithm();
     };
 
   } // namespace digitizers
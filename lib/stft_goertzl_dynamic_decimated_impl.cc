@@ -33,18 +33,11 @@ namespace gr {
               gr::io_signature::make(3, 3, sizeof(float)),
               gr::io_signature::make(3, 3, sizeof(float) * nbins))
     {
-      double samp_rate_decimated = samp_rate / (1.0 * bounds_decimation);
-      d_str2vec_sig = stream_to_vector_overlay_ff::make(window_size, samp_rate , delta_t);
-      d_str2vec_min = stream_to_vector_overlay_ff::make(1, samp_rate_decimated , delta_t);
-      d_str2vec_max = stream_to_vector_overlay_ff::make(1, samp_rate_decimated , delta_t);
-      d_stft = stft_goertzl_dynamic::make(samp_rate, window_size, nbins);
+      d_stft = stft_goertzl_overlay_ff::make(samp_rate, delta_t, window_size, nbins, bounds_decimation);
 
-      connect(self(), 0, d_str2vec_sig, 0);
-      connect(self(), 1, d_str2vec_min, 0);
-      connect(self(), 2, d_str2vec_max, 0);
-      connect(d_str2vec_sig, 0, d_stft, 0);
-      connect(d_str2vec_min, 0, d_stft, 1);
-      connect(d_str2vec_max, 0, d_stft, 2);
+      connect(self(), 0, d_stft, 0);
+      connect(self(), 1, d_stft, 1);
+      connect(self(), 2, d_stft, 2);
 
       connect(d_stft, 0, self(), 0);
       connect(d_stft, 1, self(), 1);
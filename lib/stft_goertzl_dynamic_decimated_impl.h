@@ -8,9 +8,7 @@
 #define INCLUDED_DIGITIZERS_STFT_GOERTZL_DYNAMIC_DECIMATED_IMPL_H
 
 #include <digitizers/stft_goertzl_dynamic_decimated.h>
-#include <digitizers/stft_goertzl_dynamic.h>
-#include <digitizers/stream_to_vector_overlay_ff.h>
-#include <gnuradio/blocks/vector_to_stream.h>
+#include "stft_goertzl_overlay_impl.h"
 
 
 namespace gr {
@@ -19,10 +17,7 @@ namespace gr {
     class stft_goertzl_dynamic_decimated_impl : public stft_goertzl_dynamic_decimated
     {
      private:
-      stft_goertzl_dynamic::sptr d_stft;
-      stream_to_vector_overlay_ff::sptr d_str2vec_sig;
-      stream_to_vector_overlay_ff::sptr d_str2vec_min;
-      stream_to_vector_overlay_ff::sptr d_str2vec_max;
+      stft_goertzl_overlay_ff::sptr d_stft;    // frames the signal in place and samples the bounds
 
      public:
       stft_goertzl_dynamic_decimated_impl(double samp_rate, double delta_t, int window_size, int nbins, int bounds_decimation);
@@ -11,7 +11,9 @@
 #include <gnuradio/io_signature.h>
 #include <gnuradio/math.h>
 #include "stft_goertzl_dynamic_impl.h"
+#include "design_cache.h"
 #include "digitizers/tags.h"
+#include "goertzel_spectrum.h"
 
 #include <gnuradio/fft/window.h>
 
@@ -36,8 +38,13 @@ namespace gr {
               d_samp_length(1.0/samp_rate),
               d_winsize(winsize),
               d_nbins(nbins),
-              d_window_function(fft::window::build(fft::window::win_type::WIN_HANN, winsize, 1.0))
+              d_window_function(cached_fft_window(fft::window::win_type::WIN_HANN, winsize, 1.0)),
+              d_spectrum(samp_rate, winsize, nbins, d_window_function)
     {
+      if (chirp_z_spectrum_t::is_preferred(winsize, nbins)) {
+        d_chirp_z.reset(new chirp_z_spectrum_t(samp_rate, winsize, nbins, d_window_function));
+      }
+
       set_tag_propagation_policy(TPP_DONT);
     }
 
@@ -105,68 +112,32 @@ namespace gr {
         gr_vector_const_void_star &input_items,
         gr_vector_void_star &output_items)
     {
+        block_stats_scope_t stats(d_stats);
         const float *in = (const float *) input_items[0];
         const float *f_min = (const float *) input_items[1];
         const float *f_max = (const float *) input_items[2];
         float *mag = (float *) output_items[0];
         float *phs = (float *) output_items[1];
         float *fqs = (float *) output_items[2];
-        
-        double f_range = f_max[0] - f_min[0];
-        //printf("noutput_items = %i, d_winsize =%i\n", noutput_items, d_winsize);
-        
-        //do frequency analysis for each bin
-        for(int i = 0; i < d_nbins; i++){
-            double bin_f_range_factor = static_cast<double>(i) / static_cast<double>(d_nbins-1);
-            double freq = f_min[0] + (bin_f_range_factor * f_range);
-            
-            // Goertzel vs DFT
-            if (1) {
-                float w = 2.0 * M_PI * freq * d_samp_length;
-                double wr = 2.0 * std::cos(w);
-                double wi = std::sin(w);
-                double d1 = 0.0; //resets for each iteration
-                double d2 = 0.0; //resets for each iteration
-                
-                //goertzel magic
-                for(int j = 0; j < d_winsize; j++) {
-                    //double y = in[j] + wr * d1 - d2;
-                    double y = in[j]*d_window_function[j] + wr * d1 - d2;
-                    d2 = d1;
-                    d1 = y;
-                }
-                double re = (0.5*wr*d1-d2)/d_winsize;
-                double im = (wi*d1)/d_winsize;
-                
-                //transform from carthesian to polar components
-                mag[i] = std::sqrt((re * re) + (im * im)); // this usually should be hypotf(re,im) /over-/under-flow  protected/performance
-                mag[i] = std::hypotf(re,im); // faster and over-/under-flow  protected
-                phs[i] = gr::fast_atan2f(re, im);
-                phs[i] = 0.0;
-            } else {
-                float re;
-                float im;
-                if (1) {
-                    goertzel(in, d_winsize, d_samp_length, freq, d_winsize, re, im);
-                } else {
-                    dft(in, d_winsize, d_samp_length, freq, re, im);
-                }
-                mag[i] = std::hypotf(re,im); // faster and over-/under-flow  protected
-                phs[i] = gr::fast_atan2f(re, im);
-            }
-            
-            
-            //post frequency of each bin
-            fqs[i] = freq;
+
+        for (int k = 0; k < noutput_items; k++) {
+          if (d_chirp_z) {
+            d_chirp_z->compute(in + k * d_winsize, f_min[k], f_max[k],
+                    mag + k * d_nbins, phs + k * d_nbins, fqs + k * d_nbins);
+          }
+          else {
+            d_spectrum.compute(in + k * d_winsize, f_min[k], f_max[k],
+                    mag + k * d_nbins, phs + k * d_nbins, fqs + k * d_nbins);
+          }
         }
 
       std::vector<tag_t> tags;
-      get_tags_in_range(tags, 0, nitems_read(0), nitems_read(0)+1);
+      get_tags_in_range(tags, 0, nitems_read(0), nitems_read(0) + noutput_items);
       for(auto tag : tags) {
-        tag.offset = nitems_written(0);
+        tag.offset = nitems_written(0) + (tag.offset - nitems_read(0));
         add_item_tag(0, tag);
       }
-      return 1;
+      return noutput_items;
     }
 
     //update interface
@@ -174,7 +145,12 @@ namespace gr {
     void
     stft_goertzl_dynamic_impl::set_samp_rate(double samp_rate)
     {
+      gr::thread::scoped_lock lock(d_setlock);
       d_samp_length = 1.0/samp_rate;
+      d_spectrum.set_samp_rate(samp_rate);
+      if (d_chirp_z) {
+        d_chirp_z->set_samp_rate(samp_rate);
+      }
     }
   } /* namespace digitizers */
 } /* namespace gr */
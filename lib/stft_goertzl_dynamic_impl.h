@@ -8,8 +8,12 @@
 #define INCLUDED_DIGITIZERS_STFT_GOERTZL_DYNAMIC_IMPL_H
 
 #include <digitizers/stft_goertzl_dynamic.h>
+#include "goertzel_spectrum.h"
+#include "chirp_z_spectrum.h"
+#include <memory>
 #include <tuple>
 #include <mutex>
+#include "block_stats_impl.h"
 
 namespace gr {
   namespace digitizers {
@@ -21,10 +25,17 @@ namespace gr {
       int d_winsize;
       int d_nbins;
       std::vector< float >  d_window_function;
+
+      goertzel_spectrum_t d_spectrum;
+
+      // used instead of d_spectrum for many bins, see chirp_z_spectrum_t::is_preferred
+      std::unique_ptr<chirp_z_spectrum_t> d_chirp_z;
       
       void goertzel(const float* data, const long data_len, float Ts, float frequency, int filter_size, float &real, float &imag);
       void dft(const float* data, const long data_len, float Ts, float frequency, float& real, float& imag);
 
+      block_stats_recorder_t d_stats {this};
+
      public:
 
       stft_goertzl_dynamic_impl(double samp_rate, int winsize, int nbins, std::vector<int> in_sig);
@@ -0,0 +1,162 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gnuradio/io_signature.h>
+#include <gnuradio/fft/window.h>
+#include "stft_goertzl_overlay_impl.h"
+#include "design_cache.h"
+#include <digitizers/tags.h>
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+namespace gr {
+  namespace digitizers {
+
+    stft_goertzl_overlay_ff::sptr
+    stft_goertzl_overlay_ff::make(double samp_rate, double delta_t, int winsize, int nbins, int bounds_decimation)
+    {
+      if (bounds_decimation < 1) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid bounds decimation: "
+                << bounds_decimation;
+        throw std::invalid_argument(message.str());
+      }
+
+      return gnuradio::get_initial_sptr
+        (new stft_goertzl_overlay_ff(samp_rate, delta_t, winsize, nbins, bounds_decimation));
+    }
+
+    stft_goertzl_overlay_ff::stft_goertzl_overlay_ff(double samp_rate, double delta_t, int winsize,
+            int nbins, int bounds_decimation)
+      : gr::block("stft_goertzl_overlay_ff",
+              gr::io_signature::make(3, 3, sizeof(float)),
+              gr::io_signature::make(3, 3, sizeof(float) * nbins)),
+        d_winsize(winsize),
+        d_nbins(nbins),
+        d_framer(winsize, samp_rate, delta_t),
+        d_spectrum(samp_rate, winsize, nbins,
+                cached_fft_window(fft::window::win_type::WIN_HANN, winsize, 1.0)),
+        d_min_framer(1, samp_rate / bounds_decimation, delta_t),
+        d_max_framer(1, samp_rate / bounds_decimation, delta_t)
+    {
+      set_tag_propagation_policy(TPP_DONT);
+    }
+
+    stft_goertzl_overlay_ff::~stft_goertzl_overlay_ff()
+    {
+    }
+
+    bool
+    stft_goertzl_overlay_ff::start()
+    {
+      d_framer.reset_acq_info();
+      d_pending_min.clear();
+      d_pending_max.clear();
+      return true;
+    }
+
+    void
+    stft_goertzl_overlay_ff::set_samp_rate(double samp_rate)
+    {
+      // Note, framing is not affected, same as with stream_to_vector_overlay_ff
+      gr::thread::scoped_lock lock(d_setlock);
+      d_spectrum.set_samp_rate(samp_rate);
+    }
+
+    void
+    stft_goertzl_overlay_ff::forecast(int noutput_items, gr_vector_int &ninput_items_required)
+    {
+      ninput_items_required[0] = d_winsize;
+      ninput_items_required[1] = static_cast<int>(d_pending_min.size()) < noutput_items ? 1 : 0;
+      ninput_items_required[2] = static_cast<int>(d_pending_max.size()) < noutput_items ? 1 : 0;
+    }
+
+    int
+    stft_goertzl_overlay_ff::sample_bounds(overlay_framer_t &framer, uint64_t first_offset,
+            const float *in, int ninput, int max_values, std::vector<float> &pending)
+    {
+      const int wanted = max_values - static_cast<int>(pending.size());
+      if (wanted <= 0) {
+        return 0;
+      }
+
+      // tags of the bounds are not propagated
+      const int consumed = framer.next_frames(first_offset, ninput, wanted, d_bound_frames,
+              [](int, int) { return std::vector<tag_t>(); });
+
+      for (const auto &frame : d_bound_frames) {
+        pending.push_back(in[frame.start]);
+      }
+
+      return consumed;
+    }
+
+    int
+    stft_goertzl_overlay_ff::general_work(int noutput_items,
+        gr_vector_int &ninput_items,
+        gr_vector_const_void_star &input_items,
+        gr_vector_void_star &output_items)
+    {
+      block_stats_scope_t stats(d_stats);
+      const float *in = (const float *) input_items[0];
+      const float *f_min = (const float *) input_items[1];
+      const float *f_max = (const float *) input_items[2];
+      float *mag = (float *) output_items[0];
+      float *phs = (float *) output_items[1];
+      float *fqs = (float *) output_items[2];
+
+      const int consumed_min = sample_bounds(d_min_framer, nitems_read(1), f_min, ninput_items[1],
+              noutput_items, d_pending_min);
+      const int consumed_max = sample_bounds(d_max_framer, nitems_read(2), f_max, ninput_items[2],
+              noutput_items, d_pending_max);
+
+      const int max_frames = std::min(noutput_items,
+              static_cast<int>(std::min(d_pending_min.size(), d_pending_max.size())));
+
+      const int consumed = d_framer.next_frames(nitems_read(0), ninput_items[0], max_frames, d_frames,
+              [this](int start, int count) {
+        std::vector<tag_t> tags;
+        get_tags_in_range(tags, 0, nitems_read(0) + start, nitems_read(0) + start + count, acq_info_tag_key());
+        return tags;
+      });
+
+      const int nframes = static_cast<int>(d_frames.size());
+      for (int k = 0; k < nframes; k++) {
+        // in place, frames are overlapping views into the input buffer
+        d_spectrum.compute(in + d_frames[k].start, d_pending_min[k], d_pending_max[k],
+                mag + k * d_nbins, phs + k * d_nbins, fqs + k * d_nbins);
+
+        add_item_tag(0, make_acq_info_tag(d_frames[k].acq_info, nitems_written(0) + k));
+      }
+
+      // Trace tags of the consumed samples go with the first frame
+      if (nframes && trace_registry_t::active()) {
+        std::vector<tag_t> tags;
+        get_tags_in_range(tags, 0, nitems_read(0), nitems_read(0) + consumed, trace_tag_key());
+        for (auto tag : tags) {
+          tag.offset = nitems_written(0);
+          add_item_tag(0, tag);
+        }
+      }
+
+      d_pending_min.erase(d_pending_min.begin(), d_pending_min.begin() + nframes);
+      d_pending_max.erase(d_pending_max.begin(), d_pending_max.begin() + nframes);
+
+      consume(0, consumed);
+      consume(1, consumed_min);
+      consume(2, consumed_max);
+
+      return nframes;
+    }
+
+  } /* namespace digitizers */
+} /* namespace gr */
@@ -0,0 +1,82 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_STFT_GOERTZL_OVERLAY_IMPL_H
+#define INCLUDED_DIGITIZERS_STFT_GOERTZL_OVERLAY_IMPL_H
+
+#include <gnuradio/block.h>
+#include "goertzel_spectrum.h"
+#include "overlay_framer.h"
+
+#include <vector>
+#include "block_stats_impl.h"
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief stream_to_vector_overlay_ff (for the signal and both bounds) followed by
+     * stft_goertzl_dynamic, in a single block.
+     *
+     * The frames are read in place from the input buffer (GNU Radio buffers are contiguous for
+     * any window up to the buffer size), i.e. no frame is copied and the memory traffic does
+     * not depend on the overlap. Outputs and tags are the same as produced by the four blocks.
+     *
+     * The bound streams (decimated by bounds_decimation) are sampled every delta_t as well and
+     * paired with the signal frames in order. Bound values sampled ahead of their signal frame
+     * are kept until the frame is complete.
+     *
+     * Inputs: signal stream, lower and upper frequency bound streams.
+     */
+    class stft_goertzl_overlay_ff : public gr::block
+    {
+     public:
+      typedef boost::shared_ptr<stft_goertzl_overlay_ff> sptr;
+
+      static sptr make(double samp_rate, double delta_t, int winsize, int nbins, int bounds_decimation=1);
+
+      stft_goertzl_overlay_ff(double samp_rate, double delta_t, int winsize, int nbins, int bounds_decimation);
+
+      ~stft_goertzl_overlay_ff();
+
+      bool start() override;
+
+      void set_samp_rate(double samp_rate);
+
+      void forecast(int noutput_items, gr_vector_int &ninput_items_required) override;
+
+      int general_work(int noutput_items,
+          gr_vector_int &ninput_items,
+          gr_vector_const_void_star &input_items,
+          gr_vector_void_star &output_items) override;
+
+     private:
+
+      // Samples the bound stream into pending, up to max_values pending, returns the number of
+      // items to consume
+      int sample_bounds(overlay_framer_t &framer, uint64_t first_offset, const float *in, int ninput,
+              int max_values, std::vector<float> &pending);
+
+      int d_winsize;
+      int d_nbins;
+      overlay_framer_t d_framer;
+      goertzel_spectrum_t d_spectrum;
+      std::vector<overlay_frame_t> d_frames;
+
+      // bounds sampled but not paired with a signal frame yet, reused across work calls
+      overlay_framer_t d_min_framer;
+      overlay_framer_t d_max_framer;
+      std::vector<overlay_frame_t> d_bound_frames;
+      std::vector<float> d_pending_min;
+      std::vector<float> d_pending_max;
+
+      block_stats_recorder_t d_stats {this};
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_STFT_GOERTZL_OVERLAY_IMPL_H */
@@ -0,0 +1,105 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gnuradio/io_signature.h>
+#include "stream_to_vector_overlay_cc_impl.h"
+
+namespace gr {
+  namespace digitizers {
+
+    stream_to_vector_overlay_cc::sptr
+    stream_to_vector_overlay_cc::make(int vec_size, double samp_rate, double delta_t)
+    {
+      return gnuradio::get_initial_sptr
+        (new stream_to_vector_overlay_cc(vec_size, samp_rate, delta_t));
+    }
+
+    stream_to_vector_overlay_cc::stream_to_vector_overlay_cc(int vec_size, double samp_rate, double delta_t)
+      : gr::block("stream_to_vector_overlay_cc",
+              gr::io_signature::make(1,1, sizeof(gr_complex)),
+              gr::io_signature::make(1,1, sizeof(gr_complex) * vec_size)),
+              d_vec_size(vec_size),
+              d_framer(vec_size, samp_rate, delta_t),
+              d_freq_axis(),
+              d_freq_axis_pending(false)
+    {
+      set_tag_propagation_policy(TPP_DONT);
+    }
+
+    bool
+    stream_to_vector_overlay_cc::start()
+    {
+      d_framer.reset_acq_info();
+      d_freq_axis_pending = d_freq_axis.nbins > 0;
+      return true;
+    }
+
+    void
+    stream_to_vector_overlay_cc::set_freq_axis(const freq_axis_t &axis)
+    {
+      gr::thread::scoped_lock guard(d_setlock);
+      d_freq_axis = axis;
+      d_freq_axis_pending = true;
+    }
+
+    stream_to_vector_overlay_cc::~stream_to_vector_overlay_cc()
+    {
+    }
+
+    void
+    stream_to_vector_overlay_cc::forecast (int noutput_items, gr_vector_int &ninput_items_required)
+    {
+      ninput_items_required[0] = d_vec_size;
+    }
+
+    int
+    stream_to_vector_overlay_cc::general_work (int noutput_items,
+                       gr_vector_int &ninput_items,
+                       gr_vector_const_void_star &input_items,
+                       gr_vector_void_star &output_items)
+    {
+      block_stats_scope_t stats(d_stats);
+      const gr_complex *in = (const gr_complex *) input_items[0];
+      gr_complex *out = (gr_complex *) output_items[0];
+
+      const int consumed = d_framer.next_frames(nitems_read(0), ninput_items[0], noutput_items, d_frames,
+              [this](int start, int count) {
+        std::vector<tag_t> tags;
+        get_tags_in_range(tags, 0, nitems_read(0) + start, nitems_read(0) + start + count, acq_info_tag_key());
+        return tags;
+      });
+
+      for (size_t i = 0; i < d_frames.size(); i++) {
+        memcpy(out + i * d_vec_size, in + d_frames[i].start, d_vec_size*sizeof(gr_complex));
+
+        add_item_tag(0, make_acq_info_tag(d_frames[i].acq_info, nitems_written(0) + i));
+        if (d_freq_axis_pending) {
+          add_item_tag(0, make_freq_axis_tag(d_freq_axis, nitems_written(0) + i));
+          d_freq_axis_pending = false;
+        }
+      }
+
+      // Trace tags of the consumed samples go with the first frame
+      if (!d_frames.empty() && trace_registry_t::active()) {
+        std::vector<tag_t> tags;
+        get_tags_in_range(tags, 0, nitems_read(0), nitems_read(0) + consumed, trace_tag_key());
+        for (auto tag : tags) {
+          tag.offset = nitems_written(0);
+          add_item_tag(0, tag);
+        }
+      }
+
+      consume_each(consumed);
+      return static_cast<int>(d_frames.size());
+    }
+
+  } /* namespace digitizers */
+} /* namespace gr */
+
@@ -0,0 +1,59 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_STREAM_TO_VECTOR_OVERLAY_CC_IMPL_H
+#define INCLUDED_DIGITIZERS_STREAM_TO_VECTOR_OVERLAY_CC_IMPL_H
+
+#include <gnuradio/block.h>
+#include <gnuradio/gr_complex.h>
+#include <digitizers/tags.h>
+#include "overlay_framer.h"
+#include "block_stats_impl.h"
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief stream_to_vector_overlay_ff for complex streams, e.g. the baseband of ddc_fc.
+     */
+    class stream_to_vector_overlay_cc : public gr::block
+    {
+     private:
+      int d_vec_size;
+      overlay_framer_t d_framer;
+      std::vector<overlay_frame_t> d_frames;
+      freq_axis_t d_freq_axis;
+      bool d_freq_axis_pending;
+
+      block_stats_recorder_t d_stats {this};
+
+     public:
+      typedef boost::shared_ptr<stream_to_vector_overlay_cc> sptr;
+
+      static sptr make(int vec_size, double samp_rate, double delta_t);
+
+      stream_to_vector_overlay_cc(int vec_size, double samp_rate, double delta_t);
+      ~stream_to_vector_overlay_cc();
+
+      bool start() override;
+
+      /*!
+       * \brief Attaches the axis to the next frame, see stream_to_vector_overlay_ff.
+       */
+      void set_freq_axis(const freq_axis_t &axis);
+
+      void forecast (int noutput_items, gr_vector_int &ninput_items_required);
+
+      int general_work(int noutput_items,
+           gr_vector_int &ninput_items,
+           gr_vector_const_void_star &input_items,
+           gr_vector_void_star &output_items);
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_STREAM_TO_VECTOR_OVERLAY_CC_IMPL_H */
@@ -28,25 +28,30 @@ namespace gr {
       : gr::block("stream_to_vector_overlay_ff",
               gr::io_signature::make(1,1, sizeof(float)),
               gr::io_signature::make(1,1, sizeof(float) * vec_size)),
-              d_samp_rate(samp_rate),
-              d_delta_t(delta_t),
               d_vec_size(vec_size),
-              d_offset(0),
-              d_acq_info(),
-              d_tag_offset(0)
+              d_framer(vec_size, samp_rate, delta_t),
+              d_freq_axis(),
+              d_freq_axis_pending(false)
     {
       set_tag_propagation_policy(TPP_DONT);
-
-      d_acq_info.timestamp = -1;
     }
 
     bool
     stream_to_vector_overlay_ff_impl::start()
     {
-      d_acq_info.timestamp = -1;
+      d_framer.reset_acq_info();
+      d_freq_axis_pending = d_freq_axis.nbins > 0;
       return true;
     }
 
+    void
+    stream_to_vector_overlay_ff_impl::set_freq_axis(const freq_axis_t &axis)
+    {
+      gr::thread::scoped_lock guard(d_setlock);
+      d_freq_axis = axis;
+      d_freq_axis_pending = true;
+    }
+
     /*
      * Our virtual destructor.
      */
@@ -60,61 +65,45 @@ namespace gr {
       ninput_items_required[0] = d_vec_size;
     }
 
-    void
-    stream_to_vector_overlay_ff_impl::save_tags(int count)
-    {
-      std::vector<tag_t> this_tags;
-      get_tags_in_range(this_tags, 0, nitems_read(0), nitems_read(0)+count, pmt::string_to_symbol(acq_info_tag_name));
-      if(this_tags.size() != 0) {
-        d_acq_info = decode_acq_info_tag(this_tags.back());
-        d_tag_offset = this_tags.back().offset;
-      }
-    }
-
-    void
-    stream_to_vector_overlay_ff_impl::push_tags()
-    {
-      //fix offset.
-      if (d_acq_info.timestamp != -1) {
-        d_acq_info.timestamp += ((nitems_read(0) - d_tag_offset) * d_samp_rate);
-      }
-      tag_t tag = make_acq_info_tag(d_acq_info, nitems_written(0));
-      add_item_tag(0, tag);
-    }
-
     int
     stream_to_vector_overlay_ff_impl::general_work (int noutput_items,
                        gr_vector_int &ninput_items,
                        gr_vector_const_void_star &input_items,
                        gr_vector_void_star &output_items)
     {
+      block_stats_scope_t stats(d_stats);
       const float *in = (const float *) input_items[0];
       float *out = (float *) output_items[0];
 
-      if(d_offset >= 1.0) {
-        //move along until new samples arrive
-        int consumable_count = std::min(ninput_items[0], static_cast<int>(d_offset));
-        save_tags(consumable_count);
-        d_offset -= consumable_count;
-        consume_each(consumable_count);
-        return 0;
-      }
-      else {
-        //enough samples on input!
-        save_tags(d_vec_size);
-        /*
-        for(int i = 0; i < d_vec_size; i++){
-          out[i] = in[i];            
+      const int consumed = d_framer.next_frames(nitems_read(0), ninput_items[0], noutput_items, d_frames,
+              [this](int start, int count) {
+        std::vector<tag_t> tags;
+        get_tags_in_range(tags, 0, nitems_read(0) + start, nitems_read(0) + start + count, acq_info_tag_key());
+        return tags;
+      });
+
+      for (size_t i = 0; i < d_frames.size(); i++) {
+        memcpy(out + i * d_vec_size, in + d_frames[i].start, d_vec_size*sizeof(float));
+
+        add_item_tag(0, make_acq_info_tag(d_frames[i].acq_info, nitems_written(0) + i));
+        if (d_freq_axis_pending) {
+          add_item_tag(0, make_freq_axis_tag(d_freq_axis, nitems_written(0) + i));
+          d_freq_axis_pending = false;
         }
-        */
-        memcpy(out, in, d_vec_size*sizeof(float));
-        push_tags();
-        consume_each (0);
-        d_offset += d_delta_t * d_samp_rate;
+      }
 
-        return 1;
+      // Trace tags of the consumed samples go with the first frame
+      if (!d_frames.empty() && trace_registry_t::active()) {
+        std::vector<tag_t> tags;
+        get_tags_in_range(tags, 0, nitems_read(0), nitems_read(0) + consumed, trace_tag_key());
+        for (auto tag : tags) {
+          tag.offset = nitems_written(0);
+          add_item_tag(0, tag);
+        }
       }
 
+      consume_each(consumed);
+      return static_cast<int>(d_frames.size());
     }
 
   } /* namespace digitizers */
@@ -9,6 +9,8 @@
 
 #include <digitizers/stream_to_vector_overlay_ff.h>
 #include <digitizers/tags.h>
+#include "overlay_framer.h"
+#include "block_stats_impl.h"
 
 namespace gr {
   namespace digitizers {
@@ -16,22 +18,22 @@ namespace gr {
     class stream_to_vector_overlay_ff_impl : public stream_to_vector_overlay_ff
     {
      private:
-      double d_samp_rate;
-      double d_delta_t;
       int d_vec_size;
-      double d_offset;
-      acq_info_t d_acq_info;
-      uint64_t d_tag_offset;
+      overlay_framer_t d_framer;
+      std::vector<overlay_frame_t> d_frames;
+      freq_axis_t d_freq_axis;
+      bool d_freq_axis_pending;
 
-      void save_tags(int count);
+      block_stats_recorder_t d_stats {this};
 
-      void push_tags();
      public:
       stream_to_vector_overlay_ff_impl(int vec_size, double samp_rate, double delta_t);
       ~stream_to_vector_overlay_ff_impl();
 
       bool start() override;
 
+      void set_freq_axis(const freq_axis_t &axis) override;
+
       // Where all the action really happens
       void forecast (int noutput_items, gr_vector_int &ninput_items_required);
 
@@ -0,0 +1,162 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_STREAM_WATCHDOG_H
+#define INCLUDED_DIGITIZERS_STREAM_WATCHDOG_H
+
+#include <algorithm>
+#include <cstdint>
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Streaming watchdog driven by the sample counter.
+     *
+     * The counter (samples received since arm) is checked after each poll. Two conditions are
+     * detected:
+     *  - stall: the counter didn't advance for the stall timeout, e.g. a couple of poll periods
+     *  - slow: fewer samples than the threshold fraction of the expected number were received
+     *    within a rate window
+     *
+     * Before the first sample after arm the rate window is used as the stall timeout, allowing
+     * the device to start up. Once triggered the watchdog stays quiet until reset, i.e. a stall
+     * is reported once per arm.
+     *
+     * The counter is updated by the streaming callback executed by the poll thread, the same
+     * thread checks the watchdog, hence no locking is needed.
+     */
+    class stream_watchdog_t
+    {
+    public:
+
+      enum verdict_t
+      {
+        WATCHDOG_OK,
+        WATCHDOG_STALLED,
+        WATCHDOG_SLOW
+      };
+
+      stream_watchdog_t()
+        : d_expected_rate(0.0),
+          d_threshold(0.0),
+          d_stall_timeout_ns(0),
+          d_rate_window_ns(0),
+          d_last_samples(0),
+          d_last_progress_ns(0),
+          d_window_start_ns(0),
+          d_window_start_samples(0),
+          d_started(false),
+          d_triggered(false),
+          d_rate(0.0)
+      {
+      }
+
+      /*!
+       * \brief Restarts the supervision, called on arm.
+       *
+       * \param now_ns current (monotonic) time
+       * \param expected_rate expected number of samples per second
+       * \param threshold minimum fraction of the expected rate, zero disables the rate check
+       * \param stall_timeout_ns max time without samples
+       * \param rate_window_ns time over which the rate is measured
+       */
+      void reset(uint64_t now_ns, double expected_rate, double threshold, uint64_t stall_timeout_ns,
+              uint64_t rate_window_ns)
+      {
+        d_expected_rate = expected_rate;
+        d_threshold = threshold;
+        d_stall_timeout_ns = stall_timeout_ns;
+        d_rate_window_ns = std::max(rate_window_ns, stall_timeout_ns);
+        d_last_samples = 0;
+        d_last_progress_ns = now_ns;
+        d_window_start_ns = now_ns;
+        d_window_start_samples = 0;
+        d_started = false;
+        d_triggered = false;
+        d_rate = expected_rate;
+      }
+
+      /*!
+       * \brief Checks the sample counter (samples received since reset).
+       */
+      verdict_t check(uint64_t samples, uint64_t now_ns)
+      {
+        if (samples != d_last_samples) {
+          if (!d_started) {
+            // Rate is measured from the first sample on, i.e. without the start up latency
+            d_started = true;
+            d_window_start_ns = now_ns;
+            d_window_start_samples = samples;
+          }
+          d_last_samples = samples;
+          d_last_progress_ns = now_ns;
+        }
+
+        const auto since_progress = now_ns > d_last_progress_ns ? now_ns - d_last_progress_ns : 0;
+        if (since_progress > (d_started ? d_stall_timeout_ns : d_rate_window_ns)) {
+          d_rate = 0.0;
+          return trigger(WATCHDOG_STALLED);
+        }
+
+        const auto window = now_ns > d_window_start_ns ? now_ns - d_window_start_ns : 0;
+        if (d_started && window >= d_rate_window_ns) {
+          d_rate = static_cast<double>(samples - d_window_start_samples) * 1e9 / window;
+          d_window_start_ns = now_ns;
+          d_window_start_samples = samples;
+
+          if (d_rate < d_expected_rate * d_threshold) {
+            return trigger(WATCHDOG_SLOW);
+          }
+        }
+
+        return WATCHDOG_OK;
+      }
+
+      /*!
+       * \brief Returns the sample rate measured over the last rate window, zero if stalled and
+       * the expected rate until the first window completes.
+       */
+      double get_rate() const
+      {
+        return d_rate;
+      }
+
+      bool is_triggered() const
+      {
+        return d_triggered;
+      }
+
+    private:
+
+      verdict_t trigger(verdict_t verdict)
+      {
+        if (d_triggered) {
+          return WATCHDOG_OK;
+        }
+        d_triggered = true;
+        return verdict;
+      }
+
+      double d_expected_rate;
+      double d_threshold;
+      uint64_t d_stall_timeout_ns;
+      uint64_t d_rate_window_ns;
+
+      uint64_t d_last_samples;
+      uint64_t d_last_progress_ns;
+      uint64_t d_window_start_ns;
+      uint64_t d_window_start_samples;
+      bool d_started;
+      bool d_triggered;
+
+      double d_rate;
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_STREAM_WATCHDOG_H */
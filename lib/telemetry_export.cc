@@ -0,0 +1,184 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "telemetry_export.h"
+#include "utils.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+namespace gr {
+  namespace digitizers {
+
+    // Records are read with fixed formats, see telemetry_header_t
+    static_assert(sizeof(telemetry_header_t) == 80, "telemetry header must not be padded");
+    static_assert(sizeof(telemetry_block_t) == 176, "telemetry block record must not be padded");
+    static_assert(sizeof(telemetry_thread_t) == 104, "telemetry thread record must not be padded");
+
+    const size_t telemetry_export_t::MAX_BLOCKS;
+    const size_t telemetry_export_t::MAX_THREADS;
+
+    static std::atomic<uint64_t> &
+    as_atomic(uint64_t &value)
+    {
+      static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t), "atomic must be lock free");
+      return reinterpret_cast<std::atomic<uint64_t> &>(value);
+    }
+
+    template <size_t N>
+    static void
+    copy_name(char (&dst)[N], const std::string &src)
+    {
+      std::memset(dst, 0, N);
+      std::strncpy(dst, src.c_str(), N - 1);
+    }
+
+    telemetry_export_t::telemetry_export_t()
+      : d_header(nullptr),
+        d_size(0)
+    {
+    }
+
+    telemetry_export_t::~telemetry_export_t()
+    {
+      close();
+    }
+
+    void
+    telemetry_export_t::open(const std::string &name, double interval)
+    {
+      close();
+
+      const size_t blocks_offset = sizeof(telemetry_header_t);
+      const size_t threads_offset = blocks_offset + MAX_BLOCKS * sizeof(telemetry_block_t);
+      const size_t size = threads_offset + MAX_THREADS * sizeof(telemetry_thread_t);
+
+      // Readers still mapping a previous object keep it, the new one is created from scratch
+      shm_unlink(name.c_str());
+      int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+      void *addr = MAP_FAILED;
+      if (fd >= 0 && ftruncate(fd, static_cast<off_t>(size)) == 0) {
+        addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      }
+      auto error = errno;
+
+      if (fd >= 0) {
+        ::close(fd);
+      }
+
+      if (addr == MAP_FAILED) {
+        if (fd >= 0) {
+          shm_unlink(name.c_str());
+        }
+
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": failed to create shared memory "
+                << name << ": " << strerror(error);
+        throw std::runtime_error(message.str());
+      }
+
+      // Freshly created object is zeroed
+      d_header = static_cast<telemetry_header_t *>(addr);
+      d_size = size;
+      d_name = name;
+
+      d_header->version = TELEMETRY_VERSION;
+      d_header->header_size = sizeof(telemetry_header_t);
+      d_header->block_record_size = sizeof(telemetry_block_t);
+      d_header->thread_record_size = sizeof(telemetry_thread_t);
+      d_header->max_blocks = MAX_BLOCKS;
+      d_header->max_threads = MAX_THREADS;
+      d_header->blocks_offset = blocks_offset;
+      d_header->threads_offset = threads_offset;
+      d_header->pid = getpid();
+      d_header->interval = static_cast<float>(interval);
+      std::atomic_thread_fence(std::memory_order_release);
+      strncpy(d_header->magic, "DIGITEL", sizeof(d_header->magic));
+    }
+
+    void
+    telemetry_export_t::close()
+    {
+      if (!d_header) {
+        return;
+      }
+
+      munmap(d_header, d_size);
+      shm_unlink(d_name.c_str());
+      d_header = nullptr;
+      d_size = 0;
+    }
+
+    void
+    telemetry_export_t::publish(const std::vector<block_stats_t> &blocks,
+            const std::vector<thread_stats_t> &threads)
+    {
+      auto &sequence = as_atomic(d_header->sequence);
+      const auto seq = sequence.load(std::memory_order_relaxed);
+      sequence.store(seq | 1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+
+      auto block_records = reinterpret_cast<telemetry_block_t *>(
+              reinterpret_cast<char *>(d_header) + d_header->blocks_offset);
+      const size_t nblocks = std::min(blocks.size(), MAX_BLOCKS);
+      for (size_t i = 0; i < nblocks; i++) {
+        const auto &stats = blocks[i];
+        auto &record = block_records[i];
+        copy_name(record.name, stats.name);
+        record.work_calls = stats.work_calls;
+        record.work_time_ns = stats.work_time_ns;
+        record.items = stats.items;
+        record.tags = stats.tags;
+        record.lost = stats.lost;
+        record.allocations = stats.allocations;
+        record.allocating_calls = stats.allocating_calls;
+        record.data_age_ns = stats.data_age_ns;
+        record.max_data_age_ns = stats.max_data_age_ns;
+        record.avg_data_age_ns = stats.avg_data_age_ns;
+        record.items_per_second = stats.items_per_second;
+        record.load = stats.load;
+        record.buffer_occupancy = stats.buffer_occupancy;
+        record.max_buffer_occupancy = stats.max_buffer_occupancy;
+      }
+
+      auto thread_records = reinterpret_cast<telemetry_thread_t *>(
+              reinterpret_cast<char *>(d_header) + d_header->threads_offset);
+      const size_t nthreads = std::min(threads.size(), MAX_THREADS);
+      for (size_t i = 0; i < nthreads; i++) {
+        const auto &stats = threads[i];
+        auto &record = thread_records[i];
+        copy_name(record.name, stats.name);
+        record.tid = stats.tid;
+        record.cpu = stats.cpu;
+        record.rt_priority = stats.rt_priority;
+        record.scheduling_failed = stats.scheduling_failed;
+        record.cpu_time_ns = stats.cpu_time_ns;
+        record.voluntary_switches = stats.voluntary_switches;
+        record.involuntary_switches = stats.involuntary_switches;
+      }
+
+      d_header->nblocks = static_cast<uint32_t>(nblocks);
+      d_header->nthreads = static_cast<uint32_t>(nthreads);
+      d_header->timestamp = static_cast<int64_t>(get_timestamp_nano_utc());
+
+      sequence.store((seq | 1) + 1, std::memory_order_release);
+    }
+
+  } /* namespace digitizers */
+} /* namespace gr */
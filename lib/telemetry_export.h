@@ -0,0 +1,69 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_TELEMETRY_EXPORT_H
+#define INCLUDED_DIGITIZERS_TELEMETRY_EXPORT_H
+
+#include <digitizers/stats_publisher.h>
+#include <digitizers/block_stats.h>
+#include <digitizers/thread_stats.h>
+#include <boost/noncopyable.hpp>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Writer side of the telemetry export, see telemetry_header_t for the layout and the
+     * reader protocol. Meant to be used by a single thread.
+     */
+    class telemetry_export_t : boost::noncopyable
+    {
+    public:
+      static const size_t MAX_BLOCKS = 512;
+      static const size_t MAX_THREADS = 256;
+
+      telemetry_export_t();
+
+      ~telemetry_export_t();
+
+      /*!
+       * \brief Creates (or replaces) the shared memory object, a previously opened one is closed.
+       * Throws std::runtime_error on failure.
+       *
+       * \param name object name as passed to shm_open, e.g. "/digitizers_telemetry"
+       * \param interval publishing interval in seconds, stored in the header
+       */
+      void open(const std::string &name, double interval);
+
+      /*!
+       * \brief Unmaps and unlinks the object, readers keep their mappings.
+       */
+      void close();
+
+      bool is_open() const
+      {
+        return d_header != nullptr;
+      }
+
+      /*!
+       * \brief Replaces the snapshot, records beyond the capacity are dropped.
+       */
+      void publish(const std::vector<block_stats_t> &blocks, const std::vector<thread_stats_t> &threads);
+
+    private:
+      std::string d_name;
+      telemetry_header_t *d_header;
+      size_t d_size;
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_TELEMETRY_EXPORT_H */
@@ -42,17 +42,24 @@ main (int argc, char **argv)
     return 1;
   }
 
-  bool enable_ps3000a_tests = false;
+  // With simulated units (see picosdk_mock.h) the hardware tests run by default
+#ifdef DIGITIZERS_PICOSDK_MOCK
+  const bool simulated = true;
+#else
+  const bool simulated = false;
+#endif
+
+  bool enable_ps3000a_tests = simulated;
   if (vm.count("enable-ps3000a-tests")) {
     enable_ps3000a_tests = true;
   }
 
-  bool enable_ps4000a_tests = false;
+  bool enable_ps4000a_tests = simulated;
   if (vm.count("enable-ps4000a-tests")) {
     enable_ps4000a_tests = true;
   }
 
-  bool enable_ps6000_tests = false;
+  bool enable_ps6000_tests = simulated;
   if (vm.count("enable-ps6000-tests")) {
     enable_ps6000_tests = true;
   }
@@ -0,0 +1,227 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "thread_registry.h"
+
+#include <sched.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+namespace gr {
+  namespace digitizers {
+
+    // Limit of the kernel, excluding the terminating null character
+    static const size_t MAX_KERNEL_NAME = 15;
+
+    // Reads the context switch counters and the last CPU of a thread of this process
+    static void
+    read_task_counters(int tid, thread_stats_t &stats)
+    {
+      const auto task = "/proc/self/task/" + std::to_string(tid);
+
+      std::ifstream status(task + "/status");
+      std::string line;
+      while (std::getline(status, line)) {
+        std::istringstream fields(line);
+        std::string key;
+        fields >> key;
+        if (key == "voluntary_ctxt_switches:") {
+          fields >> stats.voluntary_switches;
+        }
+        else if (key == "nonvoluntary_ctxt_switches:") {
+          fields >> stats.involuntary_switches;
+        }
+      }
+
+      // The processor is the 39th field, the second field (the name) may contain spaces
+      std::ifstream stat(task + "/stat");
+      if (std::getline(stat, line)) {
+        const auto name_end = line.rfind(')');
+        if (name_end != std::string::npos) {
+          std::istringstream fields(line.substr(name_end + 1));
+          std::string field;
+          for (int i = 3; i <= 39 && fields >> field; i++) {
+            if (i == 39) {
+              stats.cpu = std::stoi(field);
+            }
+          }
+        }
+      }
+    }
+
+    thread_registry_t::thread_registry_t()
+      : d_next_id(1)
+    {
+    }
+
+    thread_registry_t &
+    thread_registry_t::instance()
+    {
+      static thread_registry_t registry;
+      return registry;
+    }
+
+    std::string
+    thread_registry_t::kernel_name(const std::string &owner, const std::string &role)
+    {
+      if (role.size() >= MAX_KERNEL_NAME - 1) {
+        return role.substr(0, MAX_KERNEL_NAME);
+      }
+
+      const auto owner_size = std::min(owner.size(), MAX_KERNEL_NAME - 1 - role.size());
+      return owner.substr(0, owner_size) + ":" + role;
+    }
+
+    uint64_t
+    thread_registry_t::add(const std::string &owner, const std::string &role)
+    {
+      entry_t entry;
+      entry.owner = owner;
+      entry.role = role;
+      entry.handle = pthread_self();
+      entry.tid = static_cast<int>(syscall(SYS_gettid));
+      entry.config = thread_config_t {{}, 0};
+      entry.scheduling_failed = false;
+
+      pthread_setname_np(entry.handle, kernel_name(owner, role).c_str());
+
+      std::lock_guard<std::mutex> lock(d_mutex);
+      entry.id = d_next_id++;
+      apply_config(entry);
+      d_threads.push_back(std::move(entry));
+
+      return d_threads.back().id;
+    }
+
+    void
+    thread_registry_t::remove(uint64_t id)
+    {
+      std::lock_guard<std::mutex> lock(d_mutex);
+      d_threads.remove_if([id](const entry_t &entry) { return entry.id == id; });
+    }
+
+    void
+    thread_registry_t::set_config(const std::string &key, const thread_config_t &config)
+    {
+      std::lock_guard<std::mutex> lock(d_mutex);
+      d_configs[key] = config;
+
+      for (auto &entry : d_threads) {
+        apply_config(entry);
+      }
+    }
+
+    void
+    thread_registry_t::clear_config(const std::string &key)
+    {
+      std::lock_guard<std::mutex> lock(d_mutex);
+      d_configs.erase(key);
+    }
+
+    const thread_config_t *
+    thread_registry_t::find_config(const entry_t &entry) const
+    {
+      auto config = d_configs.find(entry.owner + ":" + entry.role);
+      if (config == d_configs.end()) {
+        config = d_configs.find(entry.role);
+      }
+
+      return config == d_configs.end() ? nullptr : &config->second;
+    }
+
+    void
+    thread_registry_t::apply_config(entry_t &entry)
+    {
+      auto config = find_config(entry);
+      if (config == nullptr) {
+        return;
+      }
+
+      entry.config = *config;
+      entry.scheduling_failed = false;
+
+      if (!config->cpus.empty()) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (auto cpu : config->cpus) {
+          CPU_SET(cpu, &set);
+        }
+
+        if (pthread_setaffinity_np(entry.handle, sizeof(set), &set) != 0) {
+          entry.scheduling_failed = true;
+        }
+      }
+
+      if (config->rt_priority > 0) {
+        sched_param param {};
+        param.sched_priority = config->rt_priority;
+
+        if (pthread_setschedparam(entry.handle, SCHED_FIFO, &param) != 0) {
+          entry.scheduling_failed = true;
+        }
+      }
+    }
+
+    std::vector<thread_stats_t>
+    thread_registry_t::stats()
+    {
+      std::vector<thread_stats_t> result;
+
+      std::lock_guard<std::mutex> lock(d_mutex);
+      for (const auto &entry : d_threads) {
+        thread_stats_t stats {};
+        stats.name = entry.owner + ":" + entry.role;
+        stats.owner = entry.owner;
+        stats.role = entry.role;
+        stats.tid = entry.tid;
+        stats.cpu = -1;
+        stats.cpus = entry.config.cpus;
+        stats.rt_priority = entry.config.rt_priority;
+        stats.scheduling_failed = entry.scheduling_failed;
+
+        clockid_t clock;
+        timespec ts;
+        if (pthread_getcpuclockid(entry.handle, &clock) == 0 && clock_gettime(clock, &ts) == 0) {
+          stats.cpu_time_ns = static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL
+                  + static_cast<uint64_t>(ts.tv_nsec);
+        }
+
+        read_task_counters(entry.tid, stats);
+        result.push_back(std::move(stats));
+      }
+
+      return result;
+    }
+
+    void
+    set_thread_config(const std::string &key, const thread_config_t &config)
+    {
+      thread_registry_t::instance().set_config(key, config);
+    }
+
+    void
+    clear_thread_config(const std::string &key)
+    {
+      thread_registry_t::instance().clear_config(key);
+    }
+
+    std::vector<thread_stats_t>
+    get_thread_stats()
+    {
+      return thread_registry_t::instance().stats();
+    }
+
+  } // namespace digitizers
+} // namespace gr
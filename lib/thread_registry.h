@@ -0,0 +1,102 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_THREAD_REGISTRY_H
+#define INCLUDED_DIGITIZERS_THREAD_REGISTRY_H
+
+#include <digitizers/thread_stats.h>
+
+#include <boost/noncopyable.hpp>
+
+#include <pthread.h>
+#include <list>
+#include <map>
+#include <mutex>
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Internal threads of this module, see thread_stats.h.
+     *
+     * Threads register themselves (see thread_scope_t), i.e. the native handle of a registered
+     * thread is valid until it unregisters, which happens under the same lock used to apply the
+     * configuration.
+     */
+    class thread_registry_t
+    {
+    public:
+      static thread_registry_t &instance();
+
+      /*!
+       * \brief Registers the calling thread, names it and applies its configuration. Returns
+       * the registration used to unregister.
+       */
+      uint64_t add(const std::string &owner, const std::string &role);
+
+      void remove(uint64_t id);
+
+      void set_config(const std::string &key, const thread_config_t &config);
+
+      void clear_config(const std::string &key);
+
+      std::vector<thread_stats_t> stats();
+
+      /*!
+       * \brief Kernel thread name, owner:role truncated to 15 characters by shortening the owner.
+       */
+      static std::string kernel_name(const std::string &owner, const std::string &role);
+
+    private:
+      struct entry_t
+      {
+        uint64_t id;
+        std::string owner;
+        std::string role;
+        pthread_t handle;
+        int tid;
+        thread_config_t config;
+        bool scheduling_failed;
+      };
+
+      thread_registry_t();
+
+      // Configuration by name, else by role, else none. Called with the lock held.
+      const thread_config_t *find_config(const entry_t &entry) const;
+
+      void apply_config(entry_t &entry);
+
+      std::mutex d_mutex;
+      std::list<entry_t> d_threads;
+      std::map<std::string, thread_config_t> d_configs;
+      uint64_t d_next_id;
+    };
+
+    /*!
+     * \brief Registers the calling thread for its lifetime, the first statement of the thread
+     * functions.
+     */
+    class thread_scope_t : boost::noncopyable
+    {
+    public:
+      thread_scope_t(const std::string &owner, const std::string &role)
+        : d_id(thread_registry_t::instance().add(owner, role))
+      {
+      }
+
+      ~thread_scope_t()
+      {
+        thread_registry_t::instance().remove(d_id);
+      }
+
+    private:
+      uint64_t d_id;
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_THREAD_REGISTRY_H */
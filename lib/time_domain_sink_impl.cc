@@ -11,22 +11,78 @@
 #include <gnuradio/io_signature.h>
 #include <digitizers/status.h>
 #include "time_domain_sink_impl.h"
+#include "probes.h"
+#include "memory_lock.h"
 
 #include <boost/make_shared.hpp>
+#include <algorithm>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
 
 namespace gr {
   namespace digitizers {
 
+    // Independent accumulators of the min-max reduction, the loop over the lanes is vectorized
+    // by the compiler
+    static const size_t ENVELOPE_LANES = 8;
+
+    static void
+    bucket_envelope(const float *x, size_t n, float &min, float &max)
+    {
+      float lo[ENVELOPE_LANES], hi[ENVELOPE_LANES];
+      for (size_t l = 0; l < ENVELOPE_LANES; l++) {
+        lo[l] = std::numeric_limits<float>::infinity();
+        hi[l] = -std::numeric_limits<float>::infinity();
+      }
+
+      const size_t nlanes = n - n % ENVELOPE_LANES;
+      for (size_t i = 0; i < nlanes; i += ENVELOPE_LANES) {
+        for (size_t l = 0; l < ENVELOPE_LANES; l++) {
+          lo[l] = x[i + l] < lo[l] ? x[i + l] : lo[l];
+          hi[l] = x[i + l] > hi[l] ? x[i + l] : hi[l];
+        }
+      }
+
+      min = x[0];
+      max = x[0];
+      for (size_t l = 0; l < ENVELOPE_LANES; l++) {
+        min = std::min(min, lo[l]);
+        max = std::max(max, hi[l]);
+      }
+      for (size_t i = nlanes; i < n; i++) {
+        min = std::min(min, x[i]);
+        max = std::max(max, x[i]);
+      }
+    }
+
+    // The error estimate of raw input is the one of the raw_scaling tags
+    static bool
+    decode_error_tag(const gr::tag_t &tag, float &error)
+    {
+      if (tag.key == constant_error_tag_key()) {
+        error = decode_constant_error_tag(tag);
+        return true;
+      }
+      if (tag.key == raw_scaling_tag_key()) {
+        error = static_cast<float>(decode_raw_scaling_tag(tag).error);
+        return true;
+      }
+      return false;
+    }
+
     time_domain_sink::sptr
-    time_domain_sink::make(std::string name, std::string unit, float samp_rate, time_sink_mode_t mode, size_t output_package_size)
+    time_domain_sink::make(std::string name, std::string unit, float samp_rate, time_sink_mode_t mode, size_t output_package_size,
+            bool raw_input)
     {
-      return gnuradio::get_initial_sptr(new time_domain_sink_impl(name, unit, samp_rate, mode, output_package_size));
+      return gnuradio::get_initial_sptr(new time_domain_sink_impl(name, unit, samp_rate, mode, output_package_size, raw_input));
     }
 
     time_domain_sink::sptr
-    time_domain_sink::make(std::string name, std::string unit, float samp_rate, time_sink_mode_t mode, int pre_samples, int post_samples)
+    time_domain_sink::make(std::string name, std::string unit, float samp_rate, time_sink_mode_t mode, int pre_samples, int post_samples,
+            bool raw_input)
     {
-      return gnuradio::get_initial_sptr(new time_domain_sink_impl(name, unit, samp_rate, mode, pre_samples, post_samples));
+      return gnuradio::get_initial_sptr(new time_domain_sink_impl(name, unit, samp_rate, mode, pre_samples, post_samples, raw_input));
     }
 
     void time_domain_sink_impl::set_output_multiple_(size_t multiple)
@@ -51,9 +107,10 @@ namespace gr {
         }
     }
 
-    time_domain_sink_impl::time_domain_sink_impl(std::string name, std::string unit, float samp_rate, time_sink_mode_t mode, size_t output_package_size)
+    time_domain_sink_impl::time_domain_sink_impl(std::string name, std::string unit, float samp_rate, time_sink_mode_t mode, size_t output_package_size,
+            bool raw_input)
       : gr::sync_block("time_domain_sink",
-              gr::io_signature::make(2, 2, sizeof(float)),
+              raw_input ? gr::io_signature::make(1, 1, sizeof(int16_t)) : gr::io_signature::make(1, 2, sizeof(float)),
               gr::io_signature::make(0, 0, 0)),
         d_samp_rate(samp_rate),
         d_sink_mode(mode),
@@ -61,7 +118,30 @@ namespace gr {
         d_pre_samples(0),
         d_post_samples(0),
         d_cb_copy_data(nullptr),
-        d_userdata(nullptr)
+        d_userdata(nullptr),
+        d_cb_batch(nullptr),
+        d_batch_userdata(nullptr),
+        d_batch_max_packages(0),
+        d_batch_max_latency(0.0),
+        d_cb_package(nullptr),
+        d_package_userdata(nullptr),
+        d_package_pool(object_pool_t<sink_package_t>::make(16)),
+        d_cb_measurement(nullptr),
+        d_measurement_userdata(nullptr),
+        d_measurement_pool(object_pool_t<measurement_package_t>::make(16)),
+        d_acq_info(),
+        d_acq_info_offset(0),
+        d_acq_info_valid(false),
+        d_next_offset(0),
+        d_expand_constant_errors(false),
+        d_constant_error_valid(false),
+        d_constant_error(0.0),
+        d_raw_input(raw_input),
+        d_raw_scaling(default_raw_scaling()),
+        d_bucket_size(1),
+        d_history_size(0),
+        d_realtime_memory(false),
+        d_locked_bytes(0)
     {
       d_metadata.name = name;
       d_metadata.unit = unit;
@@ -71,11 +151,16 @@ namespace gr {
 
       // This is a sink
       set_tag_propagation_policy(tag_propagation_policy_t::TPP_DONT);
+
+      message_port_register_out(pmt::mp("trace"));
+
+      d_stats.set_loss_counter([this] { return d_dispatcher.get_dropped_count(); });
     }
 
-    time_domain_sink_impl::time_domain_sink_impl(std::string name, std::string unit, float samp_rate, time_sink_mode_t mode, int pre_samples, int post_samples)
+    time_domain_sink_impl::time_domain_sink_impl(std::string name, std::string unit, float samp_rate, time_sink_mode_t mode, int pre_samples, int post_samples,
+            bool raw_input)
       : gr::sync_block("time_domain_sink",
-              gr::io_signature::make(2, 2, sizeof(float)),
+              raw_input ? gr::io_signature::make(1, 1, sizeof(int16_t)) : gr::io_signature::make(1, 2, sizeof(float)),
               gr::io_signature::make(0, 0, 0)),
         d_samp_rate(samp_rate),
         d_sink_mode(mode),
@@ -83,7 +168,30 @@ namespace gr {
         d_pre_samples(pre_samples),
         d_post_samples(post_samples),
         d_cb_copy_data(nullptr),
-        d_userdata(nullptr)
+        d_userdata(nullptr),
+        d_cb_batch(nullptr),
+        d_batch_userdata(nullptr),
+        d_batch_max_packages(0),
+        d_batch_max_latency(0.0),
+        d_cb_package(nullptr),
+        d_package_userdata(nullptr),
+        d_package_pool(object_pool_t<sink_package_t>::make(16)),
+        d_cb_measurement(nullptr),
+        d_measurement_userdata(nullptr),
+        d_measurement_pool(object_pool_t<measurement_package_t>::make(16)),
+        d_acq_info(),
+        d_acq_info_offset(0),
+        d_acq_info_valid(false),
+        d_next_offset(0),
+        d_expand_constant_errors(false),
+        d_constant_error_valid(false),
+        d_constant_error(0.0),
+        d_raw_input(raw_input),
+        d_raw_scaling(default_raw_scaling()),
+        d_bucket_size(1),
+        d_history_size(0),
+        d_realtime_memory(false),
+        d_locked_bytes(0)
     {
       d_metadata.name = name;
       d_metadata.unit = unit;
@@ -93,6 +201,10 @@ namespace gr {
 
       // This is a sink
       set_tag_propagation_policy(tag_propagation_policy_t::TPP_DONT);
+
+      message_port_register_out(pmt::mp("trace"));
+
+      d_stats.set_loss_counter([this] { return d_dispatcher.get_dropped_count(); });
     }
 
     /*
@@ -102,47 +214,494 @@ namespace gr {
     {
     }
 
+    bool
+    time_domain_sink_impl::start()
+    {
+      d_raw_scaling = default_raw_scaling();
+      d_locked_bytes = d_realtime_memory ? lock_input_buffers(*this) : 0;
+      d_next_offset = 0;
+
+      d_dispatcher.start([this](queued_package_t &item) {
+        dispatch_package(item);
+      }, get_block_name(this), "dispatch");
+
+      return true;
+    }
+
+    bool
+    time_domain_sink_impl::stop()
+    {
+      // delivers the queued packages
+      d_dispatcher.stop();
+      return true;
+    }
+
     int
     time_domain_sink_impl::work(int ninput_items, gr_vector_const_void_star &input_items, gr_vector_void_star &output_items)
     {
+      block_stats_scope_t stats(d_stats);
       assert(ninput_items % d_output_package_size == 0);
 
-      if(d_cb_copy_data == nullptr )
+      const bool history = d_history_size.load() > 0;
+      if(d_cb_copy_data == nullptr && d_cb_batch == nullptr && d_cb_package == nullptr && d_cb_measurement == nullptr
+              && !d_shm_export.is_open() && !history)
       {   // FIXME: uncomment when all sink types are supported by FESA
           //GR_LOG_WARN(d_logger, "Callback for sink '" + d_metadata.name + "' is not initialized");
           return ninput_items;
       }
 
-      const float *input_values = static_cast<const float *>(input_items[0]);
-      const float *input_errors = static_cast<const float *>(input_items[1]);
+      const float *input_values = d_raw_input ? nullptr : static_cast<const float *>(input_items[0]);
+      const float *input_errors = nullptr;
 
       std::size_t  input_errors_size = 0;
-      if (input_items.size() > 1)
+      if (input_items.size() > 1) {
+          input_errors = static_cast<const float *>(input_items[1]);
           input_errors_size = d_output_package_size;
+      }
 
       auto tag_index = nitems_read(0);
 
-      std::vector<gr::tag_t> tags;
+      // Tags of the whole window are read at once and partitioned into packages, note
+      // get_tags_in_range returns tags sorted by offset
+      d_work_tags.clear();
+      get_tags_in_range(d_work_tags, 0, tag_index, tag_index + ninput_items);
+
+      if (trace_registry_t::active()) {
+        publish_traces(this, d_work_tags, pmt::mp("trace"));
+      }
+
+      auto &tags = d_package_tags;
+      auto next_tag = d_work_tags.cbegin();
 
       // consume package by package
       for (int i = 0; i < ninput_items; i+= d_output_package_size)
       {
         /* get tags for this package */
-        get_tags_in_range(tags, 0, tag_index, tag_index + d_output_package_size);
+        auto package_tags_end = std::find_if(next_tag, d_work_tags.cend(), [&](const gr::tag_t &tag) {
+          return tag.offset >= tag_index + d_output_package_size; });
+        tags.assign(next_tag, package_tags_end);
+        next_tag = package_tags_end;
+
+        const float *package_input = input_values ? &input_values[i] : nullptr;
+        if (d_raw_input) {
+          convert_raw_package(static_cast<const int16_t *>(input_items[0]) + i, tags, tag_index);
+          package_input = &d_converted_values[0];
+        }
+
+        const float *package_errors = input_errors ? &input_errors[i] : nullptr;
+        std::size_t package_errors_size = input_errors_size;
+
+        /* errors are described by constant_error tags */
+        if (input_errors == nullptr) {
+          if (expand_constant_errors(tags, tag_index)) {
+            package_errors = &d_expanded_errors[0];
+            package_errors_size = d_output_package_size;
+          }
+        }
+
+        measurement_info_t info;
+        if (d_cb_measurement || d_shm_export.is_open() || history) {
+          decode_measurement_info(tags, tag_index, info);
+        }
+
+        if (d_shm_export.is_open()) {
+          d_shm_export.publish(info, package_input, d_output_package_size, package_errors, package_errors_size);
+        }
+
+        /* the history is not reduced either */
+        if (history) {
+          auto window = make_measurement(d_history_pool, package_input, d_output_package_size, package_errors,
+                  package_errors_size, info, tag_index);
+          boost::mutex::scoped_lock lock(d_history_mutex);
+          d_history.push_back(window);
+        }
+
+        /* the shm export is not reduced */
+        const float *package_values = package_input;
+        std::size_t package_values_size = d_output_package_size;
+        if (d_bucket_size > 1 && (d_cb_copy_data || d_cb_batch || d_cb_package || d_cb_measurement)) {
+          reduce_package(package_values, package_errors);
+          package_values = &d_display_values[0];
+          package_values_size = d_display_values.size();
+          if (package_errors) {
+            package_errors = &d_display_errors[0];
+            package_errors_size = d_display_errors.size();
+          }
+        }
+
+        if (d_cb_batch) {
+          add_to_batch(package_values, package_values_size, package_errors, package_errors_size,
+                  package_values == package_input && !d_raw_input,
+                  input_errors && package_errors == &input_errors[i], tags, tag_index);
+        }
+
+        if (d_dispatcher.is_async()) {
+          queued_package_t item;
+          if (d_cb_copy_data || d_cb_package) {
+            item.package = make_package(package_values, package_values_size, package_errors, package_errors_size,
+                    tags, tag_index);
+          }
+          if (d_cb_measurement) {
+            item.measurement = make_measurement(d_measurement_pool, package_values, package_values_size, package_errors,
+                    package_errors_size, info, tag_index);
+          }
+          if (item.package || item.measurement) {
+            d_dispatcher.push(std::move(item));
+          }
+          tag_index += d_output_package_size;
+          continue;
+        }
+
+        DIGITIZERS_PROBE1(sink_callback_start, d_metadata.name.c_str());
+
+        if (d_cb_package) {
+          d_cb_package(make_package(package_values, package_values_size, package_errors, package_errors_size,
+                  tags, tag_index),
+                  d_package_userdata);
+        }
+
+        if (d_cb_measurement) {
+          d_cb_measurement(make_measurement(d_measurement_pool, package_values, package_values_size, package_errors,
+                  package_errors_size, info, tag_index),
+                  d_measurement_userdata);
+        }
+
         tag_index += d_output_package_size;
 
         /* trigger callback of host application to copy the data*/
-        d_cb_copy_data(&input_values[i],
-                      d_output_package_size,
-                     &input_errors[i],
-                     input_errors_size,
-                     tags,
-                     d_userdata);
+        if (d_cb_copy_data) {
+          d_cb_copy_data(package_values,
+                        package_values_size,
+                       package_errors,
+                       package_errors_size,
+                       tags,
+                       d_userdata);
+        }
+
+        DIGITIZERS_PROBE1(sink_callback_end, d_metadata.name.c_str());
       }
 
+      flush_batch();
+
       return ninput_items;
     }
 
+    void
+    time_domain_sink_impl::add_to_batch(const float *values, std::size_t values_size, const float *errors,
+            std::size_t errors_size, bool input_values, bool input_errors, const std::vector<gr::tag_t> &tags,
+            uint64_t package_offset)
+    {
+      if (d_batch.empty() && d_batch_max_latency > 0.0) {
+        d_batch_start = std::chrono::steady_clock::now();
+      }
+
+      batch_entry_t entry;
+      entry.values = input_values ? values : nullptr;
+      entry.values_pos = d_batch_arena.size();
+      entry.values_size = values_size;
+      if (!input_values) {
+        d_batch_arena.insert(d_batch_arena.end(), values, values + values_size);
+      }
+
+      entry.errors = errors && input_errors ? errors : nullptr;
+      entry.errors_pos = d_batch_arena.size();
+      entry.errors_size = errors ? errors_size : 0;
+      if (errors && !input_errors) {
+        d_batch_arena.insert(d_batch_arena.end(), errors, errors + errors_size);
+      }
+
+      entry.tags_pos = d_batch_tags.size();
+      entry.tags_size = tags.size();
+      d_batch_tags.insert(d_batch_tags.end(), tags.begin(), tags.end());
+
+      entry.offset = package_offset;
+      d_batch.push_back(entry);
+
+      if (d_batch.size() == d_batch_max_packages) {
+        flush_batch();
+      }
+      else if (d_batch_max_latency > 0.0) {
+        const std::chrono::duration<double> waited = std::chrono::steady_clock::now() - d_batch_start;
+        if (waited.count() >= d_batch_max_latency) {
+          flush_batch();
+        }
+      }
+    }
+
+    void
+    time_domain_sink_impl::flush_batch()
+    {
+      if (d_batch.empty()) {
+        return;
+      }
+
+      d_batch_descriptors.resize(d_batch.size());
+      for (size_t i = 0; i < d_batch.size(); i++) {
+        const auto &entry = d_batch[i];
+        auto &descriptor = d_batch_descriptors[i];
+        descriptor.values = entry.values ? entry.values : &d_batch_arena[entry.values_pos];
+        descriptor.values_size = entry.values_size;
+        descriptor.errors = entry.errors ? entry.errors
+                : entry.errors_size ? &d_batch_arena[entry.errors_pos] : nullptr;
+        descriptor.errors_size = entry.errors_size;
+        descriptor.tags = entry.tags_size ? &d_batch_tags[entry.tags_pos] : nullptr;
+        descriptor.tags_size = entry.tags_size;
+        descriptor.offset = entry.offset;
+      }
+
+      DIGITIZERS_PROBE1(sink_callback_start, d_metadata.name.c_str());
+      d_cb_batch(d_batch_descriptors.data(), d_batch_descriptors.size(), d_batch_userdata);
+      DIGITIZERS_PROBE1(sink_callback_end, d_metadata.name.c_str());
+
+      d_batch.clear();
+      d_batch_arena.clear();
+      d_batch_tags.clear();
+    }
+
+    void
+    time_domain_sink_impl::convert_raw_package(const int16_t *raw, const std::vector<gr::tag_t> &tags,
+            uint64_t package_offset)
+    {
+      d_converted_values.resize(d_output_package_size);
+      float *out = &d_converted_values[0];
+
+      apply_raw_scaling(tags, package_offset, 1, static_cast<int>(d_output_package_size), d_raw_scaling,
+              [raw, out](int first, int nitems, const raw_scaling_t &scaling) {
+        const auto scale = static_cast<float>(scaling.scale);
+        const auto offset = static_cast<float>(scaling.offset);
+        for (int i = first; i < first + nitems; i++) {
+          out[i] = raw[i] * scale + offset;
+        }
+      });
+    }
+
+    bool
+    time_domain_sink_impl::expand_constant_errors(const std::vector<gr::tag_t> &tags, uint64_t package_offset)
+    {
+      // No expansion requested, just keep track of the current error estimate
+      if (!d_expand_constant_errors) {
+        for (const auto &tag : tags) {
+          if (decode_error_tag(tag, d_constant_error)) {
+            d_constant_error_valid = true;
+          }
+        }
+        return false;
+      }
+
+      // The samples before the first tag have no estimate unless one was known already
+      bool valid = d_constant_error_valid;
+
+      d_expanded_errors.resize(d_output_package_size);
+
+      // Note, get_tags_in_range returns tags sorted by offset
+      std::size_t idx = 0;
+
+      for (const auto &tag : tags) {
+        float error;
+        if (!decode_error_tag(tag, error)) {
+          continue;
+        }
+
+        auto tag_idx = static_cast<std::size_t>(tag.offset - package_offset);
+        std::fill(d_expanded_errors.begin() + idx, d_expanded_errors.begin() + tag_idx, d_constant_error);
+        idx = tag_idx;
+        valid = valid || tag_idx == 0;
+
+        d_constant_error = error;
+        d_constant_error_valid = true;
+      }
+
+      std::fill(d_expanded_errors.begin() + idx, d_expanded_errors.end(), d_constant_error);
+      return valid;
+    }
+
+    void
+    time_domain_sink_impl::reduce_package(const float *values, const float *errors)
+    {
+      d_display_values.clear();
+      d_display_errors.clear();
+
+      for (std::size_t first = 0; first < d_output_package_size; first += d_bucket_size) {
+        const auto n = std::min(d_bucket_size, d_output_package_size - first);
+        const float *x = values + first;
+
+        float min, max;
+        bucket_envelope(x, n, min, max);
+
+        d_display_values.push_back(x[0]);
+        d_display_values.push_back(min);
+        d_display_values.push_back(max);
+        d_display_values.push_back(x[n - 1]);
+
+        // errors of the extrema, located only if needed (NaNs aren't found)
+        if (errors) {
+          const float *e = errors + first;
+          const auto imin = std::min<std::size_t>(std::find(x, x + n, min) - x, n - 1);
+          const auto imax = std::min<std::size_t>(std::find(x, x + n, max) - x, n - 1);
+
+          d_display_errors.push_back(e[0]);
+          d_display_errors.push_back(e[imin]);
+          d_display_errors.push_back(e[imax]);
+          d_display_errors.push_back(e[n - 1]);
+        }
+      }
+    }
+
+    boost::shared_ptr<sink_package_t>
+    time_domain_sink_impl::make_package(const float *values, std::size_t values_size, const float *errors,
+            std::size_t errors_size, const std::vector<gr::tag_t> &tags, uint64_t package_offset)
+    {
+      // Note, assign reuses the capacity of pooled packages
+      auto package = d_package_pool->acquire();
+      package->values.assign(values, values + values_size);
+      if (errors) {
+        package->errors.assign(errors, errors + errors_size);
+      }
+      else {
+        package->errors.clear();
+      }
+      package->tags.assign(tags.begin(), tags.end());
+      package->offset = package_offset;
+
+      return package;
+    }
+
+    boost::shared_ptr<measurement_package_t>
+    time_domain_sink_impl::make_measurement(const object_pool_t<measurement_package_t>::sptr &pool,
+            const float *values, std::size_t values_size, const float *errors, std::size_t errors_size,
+            const measurement_info_t &info, uint64_t package_offset)
+    {
+      auto measurement = pool->acquire();
+      measurement->values.assign(values, values + values_size);
+      if (errors) {
+        measurement->errors.assign(errors, errors + errors_size);
+      }
+      else {
+        measurement->errors.clear();
+      }
+      measurement->offset = package_offset;
+      measurement->info = info;
+
+      return measurement;
+    }
+
+    void
+    time_domain_sink_impl::decode_measurement_info(const std::vector<gr::tag_t> &tags, uint64_t package_offset,
+            measurement_info_t &info)
+    {
+      info.trigger_timestamp = -1;
+      info.status = 0;
+      info.pre_trigger_samples = d_pre_samples;
+      info.post_trigger_samples = d_sink_mode == TIME_SINK_MODE_TRIGGERED ? d_post_samples
+              : static_cast<uint32_t>(d_output_package_size);
+      info.samples_lost = 0;
+
+      for (const auto &tag : tags) {
+        const auto kind = get_tag_kind(tag);
+        if (kind == TAG_KIND_ACQ_INFO) {
+          d_acq_info = decode_acq_info_tag(tag);
+          d_acq_info_offset = tag.offset;
+          d_acq_info_valid = true;
+        }
+        else if (kind == TAG_KIND_TRIGGER && info.trigger_timestamp < 0) {
+          auto trigger = decode_trigger_tag(tag);
+          info.trigger_timestamp = trigger.timestamp;
+          info.pre_trigger_samples = static_cast<uint32_t>(tag.offset - package_offset);
+          info.post_trigger_samples = static_cast<uint32_t>(d_output_package_size) - info.pre_trigger_samples;
+          info.status |= trigger.status;
+        }
+      }
+
+      if (!d_acq_info_valid) {
+        info.timebase = 0.0;
+        info.user_delay = 0.0;
+        info.actual_delay = 0.0;
+        info.timestamp = -1;
+        return;
+      }
+
+      info.timebase = d_acq_info.timebase;
+      info.user_delay = d_acq_info.user_delay;
+      info.actual_delay = d_acq_info.actual_delay;
+      info.status |= d_acq_info.status;
+
+      // Timestamp of the first sample, the acq_info tag might be within the package
+      const double distance = static_cast<double>(package_offset) - static_cast<double>(d_acq_info_offset);
+      info.timestamp = d_acq_info.timestamp < 0 ? -1
+              : d_acq_info.timestamp + static_cast<int64_t>(distance * d_acq_info.timebase * 1000000000.0);
+    }
+
+    void
+    time_domain_sink_impl::dispatch_package(queued_package_t &item)
+    {
+      DIGITIZERS_PROBE1(sink_callback_start, d_metadata.name.c_str());
+
+      auto &package = item.package;
+      if (package && d_cb_copy_data) {
+        d_cb_copy_data(&package->values[0],
+                package->values.size(),
+                package->errors.empty() ? nullptr : &package->errors[0],
+                package->errors.size(),
+                package->tags,
+                d_userdata);
+      }
+
+      if (package && d_cb_package) {
+        d_cb_package(package, d_package_userdata);
+      }
+
+      if (item.measurement && d_cb_measurement) {
+        // Packages dropped since the previous measurement (queue full, decimated or evicted),
+        // i.e. the gap to the previous measurement delivered
+        const auto offset = item.measurement->offset;
+        if (offset > d_next_offset) {
+          item.measurement->info.samples_lost = offset - d_next_offset;
+        }
+        d_next_offset = offset + d_output_package_size;
+
+        d_cb_measurement(item.measurement, d_measurement_userdata);
+      }
+
+      DIGITIZERS_PROBE1(sink_callback_end, d_metadata.name.c_str());
+    }
+
+    void
+    time_domain_sink_impl::set_constant_error_expansion(bool enabled)
+    {
+      d_expand_constant_errors = enabled;
+    }
+
+    void
+    time_domain_sink_impl::set_display_reduction(size_t max_points)
+    {
+      d_bucket_size = 1;
+      d_display_values.clear();
+      d_display_errors.clear();
+
+      const auto nbuckets = max_points / 4;
+      if (nbuckets == 0) {
+        return;
+      }
+
+      // Buckets of a single sample would enlarge the packages, buckets of up to four samples
+      // don't reduce them
+      const auto bucket_size = (d_output_package_size + nbuckets - 1) / nbuckets;
+      if (bucket_size <= 4) {
+        return;
+      }
+
+      d_bucket_size = bucket_size;
+      const auto npoints = 4 * ((d_output_package_size + bucket_size - 1) / bucket_size);
+      d_display_values.reserve(npoints);
+      d_display_errors.reserve(npoints);
+    }
+
+    size_t
+    time_domain_sink_impl::get_display_bucket_size()
+    {
+      return d_bucket_size;
+    }
+
     signal_metadata_t
     time_domain_sink_impl::get_metadata()
     {
@@ -154,6 +713,144 @@ namespace gr {
     {
       d_cb_copy_data = cb_copy_data;
       d_userdata = userdata;
+      update_demand();
+    }
+
+    void
+    time_domain_sink_impl::set_batch_callback(cb_batch_t cb_batch, void* userdata, size_t max_packages,
+            double max_latency)
+    {
+      if (max_latency < 0.0) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": batch latency of "
+                << d_metadata.name << " can't be negative: " << max_latency;
+        throw std::invalid_argument(message.str());
+      }
+
+      d_cb_batch = cb_batch;
+      d_batch_userdata = userdata;
+      d_batch_max_packages = max_packages;
+      d_batch_max_latency = max_latency;
+      update_demand();
+    }
+
+    void
+    time_domain_sink_impl::set_package_callback(cb_package_t cb_package, void* userdata, size_t pool_size)
+    {
+      // Packages still held by the host application are not affected
+      d_package_pool = object_pool_t<sink_package_t>::make(pool_size);
+      d_cb_package = cb_package;
+      d_package_userdata = userdata;
+      update_demand();
+    }
+
+    void
+    time_domain_sink_impl::set_measurement_callback(cb_measurement_t cb_measurement, void* userdata, size_t pool_size)
+    {
+      // Measurements still held by the host application are not affected
+      d_measurement_pool = object_pool_t<measurement_package_t>::make(pool_size);
+      d_cb_measurement = cb_measurement;
+      d_measurement_userdata = userdata;
+      update_demand();
+    }
+
+    void
+    time_domain_sink_impl::set_shm_export(const std::string &name, size_t nslots)
+    {
+      if (name.empty()) {
+        d_shm_export.close();
+      }
+      else {
+        d_shm_export.open(name, SHM_EXPORT_TIME_DOMAIN, d_metadata.name, nslots,
+                d_output_package_size, d_output_package_size);
+      }
+      update_demand();
+    }
+
+    void
+    time_domain_sink_impl::set_demand(const demand_node_t::sptr &demand)
+    {
+      d_demand = demand;
+      update_demand();
+    }
+
+    void
+    time_domain_sink_impl::set_realtime_memory(bool enabled)
+    {
+      d_realtime_memory = enabled;
+    }
+
+    size_t
+    time_domain_sink_impl::get_locked_memory() const
+    {
+      return d_locked_bytes.load();
+    }
+
+    void
+    time_domain_sink_impl::update_demand()
+    {
+      if (d_demand) {
+        d_demand->set_consumer(d_cb_copy_data || d_cb_batch || d_cb_package || d_cb_measurement
+                || d_shm_export.is_open() || d_history_size.load() > 0);
+      }
+    }
+
+    void
+    time_domain_sink_impl::set_trigger_history(size_t nwindows)
+    {
+      if (d_sink_mode != TIME_SINK_MODE_TRIGGERED) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": trigger history of "
+                << d_metadata.name << " requires triggered mode";
+        throw std::invalid_argument(message.str());
+      }
+
+      {
+        boost::mutex::scoped_lock lock(d_history_mutex);
+        if (!d_history_pool || nwindows > d_history.capacity()) {
+          d_history_pool = object_pool_t<measurement_package_t>::make(nwindows);
+        }
+        // newest windows are kept
+        d_history.rset_capacity(nwindows);
+        d_history_size = nwindows;
+      }
+      update_demand();
+    }
+
+    measurement_package_sptr
+    time_domain_sink_impl::get_trigger_window(int64_t trigger_timestamp)
+    {
+      boost::mutex::scoped_lock lock(d_history_mutex);
+      auto it = std::find_if(d_history.rbegin(), d_history.rend(), [trigger_timestamp](const measurement_package_sptr &window) {
+        return window->info.trigger_timestamp == trigger_timestamp; });
+      return it == d_history.rend() ? measurement_package_sptr() : *it;
+    }
+
+    std::vector<measurement_package_sptr>
+    time_domain_sink_impl::get_trigger_windows_since(int64_t trigger_timestamp)
+    {
+      boost::mutex::scoped_lock lock(d_history_mutex);
+      auto it = std::find_if(d_history.rbegin(), d_history.rend(), [trigger_timestamp](const measurement_package_sptr &window) {
+        return window->info.trigger_timestamp <= trigger_timestamp; });
+      return std::vector<measurement_package_sptr>(it.base(), d_history.end());
+    }
+
+    void
+    time_domain_sink_impl::set_async_dispatch(dispatch_policy_t policy, size_t queue_size)
+    {
+      d_dispatcher.configure(policy, queue_size);
+    }
+
+    uint64_t
+    time_domain_sink_impl::get_dropped_count()
+    {
+      return d_dispatcher.get_dropped_count();
+    }
+
+    uint32_t
+    time_domain_sink_impl::get_delivery_decimation()
+    {
+      return d_dispatcher.get_decimation();
     }
 
     size_t
@@ -10,6 +10,14 @@
 #include <digitizers/time_domain_sink.h>
 #include <digitizers/tags.h>
 #include "utils.h"
+#include "package_pool.h"
+#include "async_dispatcher.h"
+#include "block_stats_impl.h"
+#include "shm_export.h"
+#include "demand.h"
+
+#include <boost/circular_buffer.hpp>
+#include <chrono>
 
 namespace gr {
 	namespace digitizers {
@@ -30,21 +38,195 @@ namespace gr {
       cb_copy_data_t d_cb_copy_data;
       void* d_userdata;
 
+      // Batched delivery (see set_batch_callback). Values and errors not pointing into the input
+      // buffers (converted, expanded or reduced) are copied into the arena, the descriptors are
+      // resolved on flush since the arena might grow in between.
+      cb_batch_t d_cb_batch;
+      void* d_batch_userdata;
+      size_t d_batch_max_packages;
+      double d_batch_max_latency;
+
+      struct batch_entry_t
+      {
+        const float *values;       // nullptr if held by the arena
+        size_t values_pos;
+        size_t values_size;
+        const float *errors;       // nullptr if held by the arena or not available
+        size_t errors_pos;
+        size_t errors_size;
+        size_t tags_pos;
+        size_t tags_size;
+        uint64_t offset;
+      };
+
+      std::vector<batch_entry_t> d_batch;
+      std::vector<float> d_batch_arena;
+      std::vector<gr::tag_t> d_batch_tags;
+      std::vector<package_descriptor_t> d_batch_descriptors;
+      std::chrono::steady_clock::time_point d_batch_start;
+
+      /*!
+       * \brief Adds the package to the current batch, values and errors within the input buffers
+       * are referenced.
+       */
+      void add_to_batch(const float *values, std::size_t values_size, const float *errors, std::size_t errors_size,
+              bool input_values, bool input_errors, const std::vector<gr::tag_t> &tags, uint64_t package_offset);
+
+      /*!
+       * \brief Delivers the current batch, if any.
+       */
+      void flush_batch();
+
+      cb_package_t d_cb_package;
+      void* d_package_userdata;
+      object_pool_t<sink_package_t>::sptr d_package_pool;
+
+      cb_measurement_t d_cb_measurement;
+      void* d_measurement_userdata;
+      object_pool_t<measurement_package_t>::sptr d_measurement_pool;
+
+      // Tag state used to decode the measurement info
+      acq_info_t d_acq_info;
+      uint64_t d_acq_info_offset;
+      bool d_acq_info_valid;
+
+      // Offset following the last measurement delivered, dispatch thread only
+      uint64_t d_next_offset;
+
+      shm_export_t d_shm_export;
+
+      // Either of the packages is set, depending on the callbacks registered
+      struct queued_package_t
+      {
+        boost::shared_ptr<sink_package_t> package;
+        boost::shared_ptr<measurement_package_t> measurement;
+      };
+
+      // Used if the callbacks are invoked from a dispatch thread
+      async_dispatcher_t<queued_package_t> d_dispatcher;
+
+      // Reused in order to avoid allocations per package
+      std::vector<gr::tag_t> d_work_tags;
+      std::vector<gr::tag_t> d_package_tags;
+
+      // Sparse error representation, used if the errors input is not connected
+      bool d_expand_constant_errors;
+      bool d_constant_error_valid;
+      float d_constant_error;
+      std::vector<float> d_expanded_errors;
+
+      // Raw input, packages are converted to volts with the scaling of the raw_scaling tags
+      bool d_raw_input;
+      raw_scaling_t d_raw_scaling;
+      std::vector<float> d_converted_values;
+
+      /*!
+       * \brief Converts the raw package starting at the given offset into d_converted_values.
+       */
+      void convert_raw_package(const int16_t *raw, const std::vector<gr::tag_t> &tags, uint64_t package_offset);
+
+      // Display reduction, 1 for the full packages
+      std::size_t d_bucket_size;
+      std::vector<float> d_display_values;
+      std::vector<float> d_display_errors;
+
+      /*!
+       * \brief Fills d_display_values (and d_display_errors if errors are given) with the
+       * first, min, max and last sample of each bucket of the package.
+       */
+      void reduce_package(const float *values, const float *errors);
+
+      /*!
+       * \brief Fills d_expanded_errors for the package starting at the given offset by applying
+       * constant_error tags found within the package. Returns false if not expanded or if no
+       * estimate was known at the start of the package, i.e. the package has no errors.
+       */
+      bool expand_constant_errors(const std::vector<gr::tag_t> &tags, uint64_t package_offset);
+
+      boost::shared_ptr<sink_package_t> make_package(const float *values, std::size_t values_size,
+              const float *errors, std::size_t errors_size, const std::vector<gr::tag_t> &tags, uint64_t package_offset);
+
+      /*!
+       * \brief Decodes the tags of the package into the measurement info.
+       */
+      void decode_measurement_info(const std::vector<gr::tag_t> &tags, uint64_t package_offset,
+              measurement_info_t &info);
+
+      boost::shared_ptr<measurement_package_t> make_measurement(const object_pool_t<measurement_package_t>::sptr &pool,
+              const float *values, std::size_t values_size, const float *errors, std::size_t errors_size,
+              const measurement_info_t &info, uint64_t package_offset);
+
+      // Last triggered windows in full, see set_trigger_history. The work function takes the
+      // lock only if the history is enabled.
+      std::atomic<size_t> d_history_size;
+      boost::circular_buffer<measurement_package_sptr> d_history;
+      object_pool_t<measurement_package_t>::sptr d_history_pool;
+      boost::mutex d_history_mutex;
+
+      /*!
+       * \brief Invokes the callbacks for a queued package, called from the dispatch thread.
+       */
+      void dispatch_package(queued_package_t &item);
+
+      // Consumer of the branch feeding the sink, if tracked
+      demand_node_t::sptr d_demand;
+
+      // Reports whether a callback or the shm export is set
+      void update_demand();
+
+      // Real-time memory mode, see set_realtime_memory
+      bool d_realtime_memory;
+      std::atomic<size_t> d_locked_bytes;
+
+      block_stats_recorder_t d_stats {this};
+
      public:
       
-      time_domain_sink_impl(std::string name, std::string unit, float samp_rate, time_sink_mode_t mode, size_t output_package_size);
+      time_domain_sink_impl(std::string name, std::string unit, float samp_rate, time_sink_mode_t mode, size_t output_package_size,
+              bool raw_input);
 
-      time_domain_sink_impl(std::string name, std::string unit, float samp_rate, time_sink_mode_t mode, int pre_samples, int post_samples);
+      time_domain_sink_impl(std::string name, std::string unit, float samp_rate, time_sink_mode_t mode, int pre_samples, int post_samples,
+              bool raw_input);
 
       ~time_domain_sink_impl();
 
       // To simplify data copy in chunks
       void set_output_multiple_(size_t multiple);
 
+      bool start() override;
+
+      bool stop() override;
+
       int work(int noutput_items, gr_vector_const_void_star &input_items, gr_vector_void_star &output_items) override;
 
       void set_callback(cb_copy_data_t cb_copy_data, void* userdata) override;
 
+      void set_batch_callback(cb_batch_t cb_batch, void* userdata, size_t max_packages, double max_latency) override;
+
+      void set_package_callback(cb_package_t cb_package, void* userdata, size_t pool_size) override;
+
+      void set_measurement_callback(cb_measurement_t cb_measurement, void* userdata, size_t pool_size) override;
+
+      void set_shm_export(const std::string &name, size_t nslots) override;
+
+      void set_async_dispatch(dispatch_policy_t policy, size_t queue_size) override;
+
+      uint64_t get_dropped_count() override;
+
+      uint32_t get_delivery_decimation() override;
+
+      void set_constant_error_expansion(bool enabled) override;
+
+      void set_display_reduction(size_t max_points) override;
+
+      size_t get_display_bucket_size() override;
+
+      void set_trigger_history(size_t nwindows) override;
+
+      measurement_package_sptr get_trigger_window(int64_t trigger_timestamp) override;
+
+      std::vector<measurement_package_sptr> get_trigger_windows_since(int64_t trigger_timestamp) override;
+
       size_t get_output_package_size() override;
 
       float get_sample_rate() override;
@@ -57,6 +239,22 @@ namespace gr {
 
       uint32_t get_post_samples() override;
 
+      /*!
+       * \brief Reports the consumers of the sink to the given demand, see demand_node_t.
+       */
+      void set_demand(const demand_node_t::sptr &demand);
+
+      /*!
+       * \brief Prefaults and locks the buffers the sink reads into RAM on start, i.e. the
+       * output buffers of its producer, see lock_input_buffers.
+       */
+      void set_realtime_memory(bool enabled);
+
+      /*!
+       * \brief Number of bytes locked on the last start.
+       */
+      size_t get_locked_memory() const;
+
     };
 
   } // namespace digitizers
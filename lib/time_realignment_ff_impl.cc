@@ -9,6 +9,7 @@
 #endif
 
 #include <stdlib.h>
+#include <cmath>
 
 #include <gnuradio/io_signature.h>
 #include <digitizers/tags.h>
@@ -18,32 +19,40 @@
 #define NUMBER_OF_PENDING_TRIGGERS_WARNING 100
 #define NUMBER_OF_PENDING_TRIGGERS_ERROR 1000
 
+// Matching is a binary search, i.e. a deep store is cheap when WR events back up
+#define WR_EVENT_STORE_CAPACITY 1024
+
 
 namespace gr {
   namespace digitizers {
 
     time_realignment_ff::sptr
-    time_realignment_ff::make(const std::string id, float user_delay, float triggerstamp_matching_tolerance, float max_buffer_time)
+    time_realignment_ff::make(const std::string id, float user_delay, float triggerstamp_matching_tolerance, float max_buffer_time,
+            bool streaming)
     {
       return gnuradio::get_initial_sptr
-        (new time_realignment_ff_impl(id, user_delay, triggerstamp_matching_tolerance, max_buffer_time));
+        (new time_realignment_ff_impl(id, user_delay, triggerstamp_matching_tolerance, max_buffer_time, streaming));
     }
 
     /*
      * The private constructor
      */
-    time_realignment_ff_impl::time_realignment_ff_impl(const std::string id, float user_delay, float triggerstamp_matching_tolerance, float max_buffer_time)
+    time_realignment_ff_impl::time_realignment_ff_impl(const std::string id, float user_delay, float triggerstamp_matching_tolerance, float max_buffer_time,
+            bool streaming)
       : gr::block(id,
                   gr::io_signature::make(2, 3, sizeof(float)),
                   gr::io_signature::make(2, 2, sizeof(float))),
                   d_user_delay(user_delay),
-                  d_wr_events_size(10) // Maximum buffer of 10 WR-Events
+                  d_channel_delay(0.0),
+                  d_realigner(WR_EVENT_STORE_CAPACITY),
+                  d_diag_interval_ns(1000000000),
+                  d_last_diag_ns(0),
+                  d_unmatched_triggers(0),
+                  d_reported_unmatched(0),
+                  d_reported_stale(0),
+                  d_reported_evicted(0),
+                  d_streaming(streaming)
     {
-      wr_event_t empty;
-      for( size_t i = 0; i< d_wr_events_size; i++)
-          d_wr_events.push_back(empty);
-      d_wr_events_write_iter = d_wr_events.begin();
-      d_wr_events_read_iter = d_wr_events.begin();
       d_not_found_stamp_utc = 0;
       set_triggerstamp_matching_tolerance(triggerstamp_matching_tolerance);
       set_max_buffer_time(max_buffer_time);
@@ -70,26 +79,32 @@ namespace gr {
       return d_user_delay;
     }
 
+    double
+    time_realignment_ff_impl::get_channel_delay()
+    {
+      return d_channel_delay;
+    }
+
     void time_realignment_ff_impl::set_triggerstamp_matching_tolerance(float triggerstamp_matching_tolerance)
     {
         //std::cout << "set_timeout: " << triggerstamp_matching_tolerance << std::endl;
-        d_triggerstamp_matching_tolerance_ns = int64_t(triggerstamp_matching_tolerance * 1000000000 );
+        d_realigner.set_tolerance(int64_t(triggerstamp_matching_tolerance * 1000000000 ));
         //std::cout << "d_timeout_ns: " << d_triggerstamp_matching_tolerance_ns << std::endl;
     }
 
     float time_realignment_ff_impl::get_triggerstamp_matching_tolerance()
     {
-        return float(d_triggerstamp_matching_tolerance_ns / 1000000000.);
+        return float(d_realigner.get_tolerance() / 1000000000.);
     }
 
     void time_realignment_ff_impl::set_max_buffer_time(float max_buffer_time)
     {
-        d_max_buffer_time_ns = int64_t(max_buffer_time * 1000000000 );
+        d_realigner.set_max_buffer_time(int64_t(max_buffer_time * 1000000000 ));
     }
 
     float time_realignment_ff_impl::get_max_buffer_time()
     {
-        return float(d_max_buffer_time_ns / 1000000000.);
+        return float(d_realigner.get_max_buffer_time() / 1000000000.);
     }
 
     int time_realignment_ff_impl::general_work(int noutput_items,
@@ -97,6 +112,7 @@ namespace gr {
          gr_vector_const_void_star &input_items,
          gr_vector_void_star &output_items)
     {
+      block_stats_scope_t stats(d_stats);
 // FIXME: Currently time_realiggment does nothing !!
       uint64_t ninput_items_min;
  //     uint64_t sample_to_start_processing_abs;
@@ -119,7 +135,7 @@ namespace gr {
 //      get_tags_in_range(tags, 0, sample_to_start_processing_abs, max_sample_to_end_processing_abs);
 //      for (auto tag: tags)
 //      {
-//        if (tag.key == pmt::string_to_symbol(trigger_tag_name))
+//        if (tag.key == trigger_tag_key())
 //        {
 //          //std::cout << "trigger tag incoming. Offset: " << tag.offset << std::endl;
 //          //std::cout << "Trigger Tag incoming : " << get_timestamp_milli_utc() << std::endl;
@@ -155,6 +171,28 @@ namespace gr {
 //        }
 //      }
 
+      // Samples and tags (one to one) are forwarded right away, corrections follow as realignment tags
+      if (d_streaming && copy_data_len > 0)
+      {
+          const auto first_offset = nitems_read(0);
+          d_tags.clear();
+          get_tags_in_range(d_tags, 0, first_offset, first_offset + copy_data_len, channel_delay_tag_key());
+          if (!d_tags.empty())
+          {
+              d_channel_delay = decode_channel_delay_tag(d_tags.back()).delay;
+          }
+
+          d_tags.clear();
+          get_tags_in_range(d_tags, 0, first_offset, first_offset + copy_data_len, trigger_tag_key());
+          const auto now = static_cast<int64_t>(get_timestamp_nano_utc());
+          for (const auto &tag : d_tags)
+          {
+              d_realigner.add_trigger(tag.offset, decode_trigger_tag(tag), now);
+          }
+
+          realign_pending_triggers(nitems_written(0), nitems_written(0) + copy_data_len);
+      }
+
       //std::cout << "memcpy: copy_data_len: " << copy_data_len << std::endl;
 
       //copy data
@@ -173,64 +211,88 @@ namespace gr {
     bool
     time_realignment_ff_impl::fill_wr_stamp(trigger_t &trigger_tag_data)
     {
-        // we dont have a wr-event for this trigger tag yet
-        if(d_wr_events_write_iter->wr_trigger_stamp == d_wr_events_read_iter->wr_trigger_stamp)
+        wr_event_t event;
+        const auto result = d_realigner.match(trigger_tag_data.timestamp, event);
+
+        if (result == wr_event_store_t::match_result_t::MATCHED)
         {
-            if( d_not_found_stamp_utc == 0)
-                d_not_found_stamp_utc = get_timestamp_nano_utc();
+            d_not_found_stamp_utc = 0; // reset stamp
+            trigger_tag_data.timestamp = event.wr_trigger_stamp;
+            report_matching_diagnostics();
+            return true;
+        }
 
-            if( d_not_found_stamp_utc != 0 && abs( get_timestamp_nano_utc() - d_not_found_stamp_utc ) > d_max_buffer_time_ns )
-            {
-                d_not_found_stamp_utc = 0; //reset stamp
-                GR_LOG_ERROR(d_logger, name() + ": No WR-Tag found for trigger tag after waiting " + std::to_string(get_max_buffer_time())+ "s. Trigger will be forwarded without realligment. Possibly max_buffer_time needs to be adjusted." );
-                trigger_tag_data.status |= channel_status_t::CHANNEL_STATUS_TIMEOUT_WAITING_WR_OR_REALIGNMENT_EVENT;
-                return true;
-            }
+        if (result == wr_event_store_t::match_result_t::NO_MATCH)
+        {
+            // Forward the trigger tag with bad status .. for some reason it did not match any of our wr-events
+            d_not_found_stamp_utc = 0;
+            d_unmatched_triggers++;
+            trigger_tag_data.status |= channel_status_t::CHANNEL_STATUS_TIMEOUT_WAITING_WR_OR_REALIGNMENT_EVENT;
+            report_matching_diagnostics();
+            return true;
+        }
+
+        // we dont have a wr-event for this trigger tag yet
+        if( d_not_found_stamp_utc == 0)
+            d_not_found_stamp_utc = get_timestamp_nano_utc();
 
-            // this may happen often.. possibly better to dont print a warning
-            //GR_LOG_WARN(d_logger, "We dont have a wr-event for this trigger tag yet ... buffering will be used");
-            return false; // all trigger and samples before this trigger will be kept on input, better luck on the next work call
+        if( abs( get_timestamp_nano_utc() - d_not_found_stamp_utc ) > d_realigner.get_max_buffer_time() )
+        {
+            d_not_found_stamp_utc = 0; //reset stamp
+            GR_LOG_ERROR(d_logger, name() + ": No WR-Tag found for trigger tag after waiting " + std::to_string(get_max_buffer_time())+ "s. Trigger will be forwarded without realligment. Possibly max_buffer_time needs to be adjusted." );
+            trigger_tag_data.status |= channel_status_t::CHANNEL_STATUS_TIMEOUT_WAITING_WR_OR_REALIGNMENT_EVENT;
+            return true;
         }
 
-        while(true)
+        return false; // all trigger and samples before this trigger will be kept on input, better luck on the next work call
+    }
+
+    void
+    time_realignment_ff_impl::realign_pending_triggers(uint64_t first_offset, uint64_t end_offset)
+    {
+        const auto now = static_cast<int64_t>(get_timestamp_nano_utc());
+        const auto channel_delay_ns = static_cast<int64_t>(std::llround(d_channel_delay * 1000000000.0));
+        d_realigner.realign(now, [&](const realignment_t &resolved, bool timed_out)
         {
-            int64_t delta_t = abs ( trigger_tag_data.timestamp - d_wr_events_read_iter->wr_trigger_stamp_utc );
-            if(  delta_t > d_triggerstamp_matching_tolerance_ns )
-            {
-                GR_LOG_WARN(d_logger, name() + ": WR Stamps was out of matching tolerance by " + std::to_string(delta_t/1000)+ "µs. Will be ignored");
-                GR_LOG_WARN(d_logger, name() + ": trigger_tag_data.timestamp                  " + std::to_string(trigger_tag_data.timestamp / 1000000)  + "ms");
-                GR_LOG_WARN(d_logger, name() + ": d_wr_events_read_iter->wr_trigger_stamp_utc " + std::to_string(d_wr_events_read_iter->wr_trigger_stamp_utc /1000000) + "ms");
-
-//                {
-//                    time_t wrStampSeconds = trigger_tag_data.timestamp / 1000000000;
-//                    struct tm * timeinfo;
-//                    timeinfo = localtime (&wrStampSeconds);
-//                    printf ("trigger_tag_data.timestamp: %s", asctime(timeinfo));
-//                }
-//                {
-//                    time_t wrStampSeconds = d_wr_events_read_iter->wr_trigger_stamp_utc / 1000000000;
-//                    struct tm * timeinfo;
-//                    timeinfo = localtime (&wrStampSeconds);
-//                    printf ("d_wr_events_read_iter->wr_trigger_stamp_utc: %s", asctime(timeinfo));
-//                }
-                trigger_tag_data.status |= channel_status_t::CHANNEL_STATUS_TIMEOUT_WAITING_WR_OR_REALIGNMENT_EVENT;
-                d_wr_events_read_iter++;
-                if(d_wr_events_read_iter == d_wr_events.end())
-                    d_wr_events_read_iter = d_wr_events.begin();
-                if(d_wr_events_write_iter->wr_trigger_stamp == d_wr_events_read_iter->wr_trigger_stamp)
-                    return true; // Forward the trigger tag with bad status .. for some reason it did not match any of our wr-events
-            }
-            else
+            if (timed_out)
             {
-                d_not_found_stamp_utc = 0; // reset stamp
-                //std::cout << "delta_t [sec]                      : " << delta_t/1000000000.f << std::endl;
-                trigger_tag_data.timestamp = d_wr_events_read_iter->wr_trigger_stamp;
-                d_wr_events_read_iter++;
-                if(d_wr_events_read_iter == d_wr_events.end())
-                    d_wr_events_read_iter = d_wr_events.begin();
-                return true;
+                GR_LOG_ERROR(d_logger, name() + ": No WR-Tag found for trigger tag after waiting " + std::to_string(get_max_buffer_time())+ "s. Trigger will not be realigned. Possibly max_buffer_time needs to be adjusted." );
             }
-        }
+
+            realignment_t realignment = resolved;
+            realignment.timestamp -= channel_delay_ns;
+
+            // Placed on the trigger itself if it is still within the output range
+            const auto offset = std::min(std::max(realignment.trigger_offset, first_offset), end_offset - 1);
+            add_item_tag(0, make_realignment_tag(realignment, offset));
+        });
+
+        report_matching_diagnostics();
+    }
+
+    void
+    time_realignment_ff_impl::report_matching_diagnostics()
+    {
+        const auto now = static_cast<int64_t>(get_timestamp_nano_utc());
+        if (now - d_last_diag_ns < d_diag_interval_ns)
+            return;
+
+        uint64_t stale, evicted;
+        d_realigner.get_event_counters(stale, evicted);
+
+        const auto unmatched = d_unmatched_triggers + d_realigner.unmatched();
+        if (unmatched == d_reported_unmatched && stale == d_reported_stale && evicted == d_reported_evicted)
+            return;
+
+        GR_LOG_WARN(d_logger, name() + ": WR event matching since last report: "
+                + std::to_string(unmatched - d_reported_unmatched) + " triggers out of matching tolerance, "
+                + std::to_string(stale - d_reported_stale) + " WR events ignored, "
+                + std::to_string(evicted - d_reported_evicted) + " WR events dropped (too few trigger tags)");
+
+        d_last_diag_ns = now;
+        d_reported_unmatched = unmatched;
+        d_reported_stale = stale;
+        d_reported_evicted = evicted;
     }
 
     int64_t
@@ -242,20 +304,13 @@ namespace gr {
     bool
     time_realignment_ff_impl::add_timing_event(const std::string &event_id, int64_t wr_trigger_stamp, int64_t wr_trigger_stamp_utc)
     {
-      d_wr_events_write_iter->event_id = event_id;
-      d_wr_events_write_iter->wr_trigger_stamp = wr_trigger_stamp;
-      d_wr_events_write_iter->wr_trigger_stamp_utc = wr_trigger_stamp_utc;
-      d_wr_events_write_iter++;
-      if(d_wr_events_write_iter == d_wr_events.end())
-          d_wr_events_write_iter = d_wr_events.begin();
-      if(d_wr_events_write_iter->wr_trigger_stamp == d_wr_events_read_iter->wr_trigger_stamp)
-      {
-          GR_LOG_ERROR(d_logger, name() + ": Write Iter reached read iter ...to few trigger tags");
-          return false;
-      }
-      return true;
+      wr_event_t event;
+      event.event_id = event_id;
+      event.wr_trigger_stamp = wr_trigger_stamp;
+      event.wr_trigger_stamp_utc = wr_trigger_stamp_utc;
 
-      //std::cout << "WR-Event Processing 5: " << get_timestamp_milli_utc() << std::endl;
+      // Evictions are reported by the rate limited matching diagnostics
+      return d_realigner.add_event(event);
     }
 
 
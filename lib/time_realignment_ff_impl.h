@@ -10,9 +10,11 @@
 #include <digitizers/time_realignment_ff.h>
 #include <digitizers/tags.h>
 
-#include <mutex>
-
 #include "utils.h"
+#include "trigger_realigner.h"
+#include "block_stats_impl.h"
+
+#include <atomic>
 
 namespace gr {
   namespace digitizers {
@@ -23,26 +25,36 @@ namespace gr {
      private:
       float d_user_delay;
 
-      // stored in ns to allow fast comparioson
-      int64_t d_triggerstamp_matching_tolerance_ns;
+      // of the latest channel_delay tag, subtracted from the realigned timestamps
+      std::atomic<double> d_channel_delay;
 
-      // maximum time incoming triggers and samples will be buffered before forwarding them without realligment of the trigger tags
-      int64_t d_max_buffer_time_ns;
+      // white rabbit events ordered by UTC stamp, filled from the timing receiver thread, the
+      // matching tolerance and the maximum time triggers wait for their WR event
+      trigger_realigner_t d_realigner;
       uint64_t d_not_found_stamp_utc;
 
-      // cyclic buffer of white rabbit events
-      std::vector< wr_event_t > d_wr_events;
-      size_t d_wr_events_size;
+      // matching diagnostics are summarized at most once per d_diag_interval_ns
+      int64_t d_diag_interval_ns;
+      int64_t d_last_diag_ns;
+      uint64_t d_unmatched_triggers;
+      uint64_t d_reported_unmatched;
+      uint64_t d_reported_stale;
+      uint64_t d_reported_evicted;
+
+      // streaming mode, triggers already forwarded are pending in the realigner
+      bool d_streaming;
+      std::vector<gr::tag_t> d_tags;
 
-      std::vector< wr_event_t >::iterator d_wr_events_write_iter;
-      std::vector< wr_event_t >::iterator d_wr_events_read_iter;
+      block_stats_recorder_t d_stats {this};
 
      public:
-      time_realignment_ff_impl(const std::string id, float user_delay, float triggerstamp_matching_tolerance, float max_buffer_time);
+      time_realignment_ff_impl(const std::string id, float user_delay, float triggerstamp_matching_tolerance, float max_buffer_time,
+              bool streaming);
       ~time_realignment_ff_impl();
 
       void set_user_delay(float user_delay) override;
       float get_user_delay() override;
+      double get_channel_delay() override;
       void set_triggerstamp_matching_tolerance(float triggerstamp_matching_tolerance);
       float get_triggerstamp_matching_tolerance();
 
@@ -66,6 +78,10 @@ namespace gr {
 
       bool fill_wr_stamp(trigger_t &trigger_tag_data);
 
+      void report_matching_diagnostics();
+
+      void realign_pending_triggers(uint64_t first_offset, uint64_t end_offset);
+
       int64_t get_user_delay_ns() const;
     };
 
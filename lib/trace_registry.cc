@@ -0,0 +1,159 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "trace_registry.h"
+#include "utils.h"
+#include <digitizers/tags.h>
+
+#include <algorithm>
+
+namespace gr {
+  namespace digitizers {
+
+    trace_registry_t::trace_registry_t()
+      : d_next_id(1)
+    {
+    }
+
+    trace_registry_t &
+    trace_registry_t::instance()
+    {
+      static trace_registry_t registry;
+      return registry;
+    }
+
+    std::atomic<int> &
+    trace_registry_t::sources()
+    {
+      static std::atomic<int> count(0);
+      return count;
+    }
+
+    uint64_t
+    trace_registry_t::begin_trace(int64_t timestamp)
+    {
+      std::lock_guard<std::mutex> lock(d_mutex);
+
+      if (d_traces.size() >= MAX_TRACES) {
+        d_traces.pop_front();
+      }
+
+      trace_record_t record;
+      record.id = d_next_id++;
+      record.timestamp = timestamp;
+      d_traces.push_back(std::move(record));
+
+      return d_traces.back().id;
+    }
+
+    void
+    trace_registry_t::add_hop(uint64_t id, const std::string &block, int64_t timestamp)
+    {
+      std::lock_guard<std::mutex> lock(d_mutex);
+
+      if (d_traces.empty() || id < d_traces.front().id || id > d_traces.back().id) {
+        return;
+      }
+
+      auto &hops = d_traces[id - d_traces.front().id].hops;
+      auto known = std::find_if(hops.begin(), hops.end(), [&block](const trace_hop_t &hop) {
+        return hop.block == block; });
+      if (known == hops.end()) {
+        hops.push_back(trace_hop_t {block, timestamp});
+      }
+    }
+
+    bool
+    trace_registry_t::get(uint64_t id, trace_record_t &record)
+    {
+      std::lock_guard<std::mutex> lock(d_mutex);
+
+      if (d_traces.empty() || id < d_traces.front().id || id > d_traces.back().id) {
+        return false;
+      }
+
+      record = d_traces[id - d_traces.front().id];
+      return true;
+    }
+
+    std::vector<trace_record_t>
+    trace_registry_t::recent()
+    {
+      std::lock_guard<std::mutex> lock(d_mutex);
+      return std::vector<trace_record_t>(d_traces.begin(), d_traces.end());
+    }
+
+    pmt::pmt_t
+    trace_record_to_pmt(const trace_record_t &record)
+    {
+      auto hops = pmt::make_vector(record.hops.size(), pmt::PMT_NIL);
+      auto previous = record.timestamp;
+
+      for (size_t i = 0; i < record.hops.size(); i++) {
+        const auto &hop = record.hops[i];
+
+        auto dict = pmt::make_dict();
+        dict = pmt::dict_add(dict, pmt::mp("block"), pmt::mp(hop.block));
+        dict = pmt::dict_add(dict, pmt::mp("timestamp"), pmt::from_long(hop.timestamp));
+        dict = pmt::dict_add(dict, pmt::mp("latency_ns"), pmt::from_long(hop.timestamp - record.timestamp));
+        dict = pmt::dict_add(dict, pmt::mp("delta_ns"), pmt::from_long(hop.timestamp - previous));
+        pmt::vector_set(hops, i, dict);
+
+        previous = hop.timestamp;
+      }
+
+      auto dict = pmt::make_dict();
+      dict = pmt::dict_add(dict, pmt::mp("id"), pmt::from_uint64(record.id));
+      dict = pmt::dict_add(dict, pmt::mp("timestamp"), pmt::from_long(record.timestamp));
+      dict = pmt::dict_add(dict, pmt::mp("latency_ns"), pmt::from_long(previous - record.timestamp));
+      dict = pmt::dict_add(dict, pmt::mp("hops"), hops);
+
+      return dict;
+    }
+
+    void
+    publish_traces(gr::block *sink, const std::vector<gr::tag_t> &tags, const pmt::pmt_t &port)
+    {
+      auto &registry = trace_registry_t::instance();
+      std::string name;
+
+      for (const auto &tag : tags) {
+        if (tag.key != trace_tag_key()) {
+          continue;
+        }
+
+        if (name.empty()) {
+          name = get_block_name(sink);
+        }
+
+        auto trace = decode_trace_tag(tag);
+        registry.add_hop(trace.id, name, static_cast<int64_t>(get_timestamp_nano_utc()));
+
+        trace_record_t record;
+        if (registry.get(trace.id, record)) {
+          sink->message_port_pub(port, trace_record_to_pmt(record));
+        }
+      }
+    }
+
+    bool
+    get_trace(uint64_t id, trace_record_t &record)
+    {
+      return trace_registry_t::instance().get(id, record);
+    }
+
+    std::vector<trace_record_t>
+    get_recent_traces()
+    {
+      return trace_registry_t::instance().recent();
+    }
+
+  } // namespace digitizers
+} // namespace gr
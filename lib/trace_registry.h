@@ -0,0 +1,94 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_TRACE_REGISTRY_H
+#define INCLUDED_DIGITIZERS_TRACE_REGISTRY_H
+
+#include <digitizers/trace.h>
+#include <gnuradio/block.h>
+#include <gnuradio/tags.h>
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Hops of the recent traces.
+     *
+     * Trace tags only carry the trace identifier, GNU Radio propagates tags unmodified hence the
+     * hops are recorded here instead of being appended to the tag.
+     */
+    class trace_registry_t
+    {
+    public:
+      // Number of traces kept
+      static const size_t MAX_TRACES = 256;
+
+      static trace_registry_t &instance();
+
+      /*!
+       * \brief Number of blocks injecting trace tags. The blocks only look for trace tags if
+       * there is at least one.
+       */
+      static std::atomic<int> &sources();
+
+      static bool
+      active()
+      {
+        return sources().load(std::memory_order_relaxed) > 0;
+      }
+
+      /*!
+       * \brief Starts a new trace, returns its identifier.
+       */
+      uint64_t begin_trace(int64_t timestamp);
+
+      /*!
+       * \brief Records a hop, ignored for expired traces and blocks already recorded.
+       */
+      void add_hop(uint64_t id, const std::string &block, int64_t timestamp);
+
+      bool get(uint64_t id, trace_record_t &record);
+
+      std::vector<trace_record_t> recent();
+
+    private:
+      trace_registry_t();
+
+      std::mutex d_mutex;
+      std::deque<trace_record_t> d_traces;  // consecutive identifiers
+      uint64_t d_next_id;
+    };
+
+    /*!
+     * \brief Block name used for the hops and the performance counters.
+     */
+    inline std::string
+    get_block_name(const gr::block *block)
+    {
+      return block->alias_set() ? block->alias() : block->identifier();
+    }
+
+    /*!
+     * \brief Converts a trace to a PMT dictionary with the keys id, timestamp, latency_ns (of the
+     * last hop) and hops, a vector of dictionaries with the keys block, timestamp, latency_ns
+     * (since the chunk callback) and delta_ns (since the previous hop).
+     */
+    pmt::pmt_t trace_record_to_pmt(const trace_record_t &record);
+
+    /*!
+     * \brief Records the hop of the sink for the trace tags among the given tags and publishes
+     * the traces on the given message port.
+     */
+    void publish_traces(gr::block *sink, const std::vector<gr::tag_t> &tags, const pmt::pmt_t &port);
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_TRACE_REGISTRY_H */
@@ -0,0 +1,336 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gnuradio/io_signature.h>
+#include "trigger_averager_ff_impl.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+namespace gr {
+  namespace digitizers {
+
+    // Upper bound for the number of windows waiting for samples or output space
+    static const size_t MAX_PENDING_WINDOWS = 4096;
+
+    // Minimum size of the sample ring, i.e. the number of samples consumed per work call
+    // while a large window is pending
+    static const uint64_t MIN_RING_SIZE = 8192;
+
+    /**********************************************************************
+     * Accumulation kernels, the samples are independent hence the loops are vectorized by
+     * the compiler
+     *********************************************************************/
+
+    // Welford update of the mean and the sum of squared deviations by the k-th window
+    static inline void
+    accumulate_mean(const float * __restrict x, float * __restrict mean, float * __restrict m2,
+            size_t n, float k)
+    {
+      const float inv_k = 1.0f / k;
+      for (size_t i = 0; i < n; i++) {
+        const float delta = x[i] - mean[i];
+        mean[i] += delta * inv_k;
+        m2[i] += delta * (x[i] - mean[i]);
+      }
+    }
+
+    // Exponentially weighted update of the mean and the variance
+    static inline void
+    accumulate_ewm(const float * __restrict x, float * __restrict mean, float * __restrict var,
+            size_t n, float alpha)
+    {
+      for (size_t i = 0; i < n; i++) {
+        const float delta = x[i] - mean[i];
+        mean[i] += alpha * delta;
+        var[i] = (1.0f - alpha) * (var[i] + alpha * delta * delta);
+      }
+    }
+
+    trigger_averager_ff::sptr
+    trigger_averager_ff::make(unsigned post_trigger_window, unsigned pre_trigger_window,
+            int nr_windows, double alpha)
+    {
+      return gnuradio::get_initial_sptr
+        (new trigger_averager_ff_impl(post_trigger_window, pre_trigger_window, nr_windows, alpha));
+    }
+
+    trigger_averager_ff_impl::trigger_averager_ff_impl(unsigned post_trigger_window,
+            unsigned pre_trigger_window, int nr_windows, double alpha)
+      : gr::block("trigger_averager_ff",
+              gr::io_signature::make(1, 1, sizeof(float)),
+              gr::io_signature::make(1, 2, sizeof(float))),
+      d_pre_trigger_window(pre_trigger_window),
+      d_post_trigger_window(post_trigger_window),
+      d_nr_windows(nr_windows),
+      d_alpha(static_cast<float>(alpha)),
+      d_pending(),
+      d_acq_info_tags(),
+      d_scanned_until(0),
+      d_skipped_triggers(0),
+      d_count(0),
+      d_status(0)
+    {
+      if (post_trigger_window + pre_trigger_window == 0) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": window can't be empty";
+        throw std::invalid_argument(message.str());
+      }
+
+      if (nr_windows < 1) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid number of windows: " << nr_windows;
+        throw std::invalid_argument(message.str());
+      }
+
+      if (!(alpha >= 0.0 && alpha <= 1.0)) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": alpha must be within [0, 1]: " << alpha;
+        throw std::invalid_argument(message.str());
+      }
+
+      uint64_t ring_size = MIN_RING_SIZE;
+      while (ring_size < 2 * static_cast<uint64_t>(pre_trigger_window + post_trigger_window)) {
+        ring_size <<= 1;
+      }
+      d_ring_mask = ring_size - 1;
+
+      // a complete averaged window is sent at once
+      set_output_multiple(pre_trigger_window + post_trigger_window);
+
+      set_tag_propagation_policy(TPP_DONT);
+    }
+
+    trigger_averager_ff_impl::~trigger_averager_ff_impl()
+    {
+    }
+
+    bool
+    trigger_averager_ff_impl::start()
+    {
+      const auto window_size = d_pre_trigger_window + d_post_trigger_window;
+
+      d_pending.clear();
+      d_acq_info_tags.clear();
+      d_scanned_until = 0;
+      d_skipped_triggers = 0;
+      d_ring.assign(d_ring_mask + 1, 0.0f);
+      d_mean.assign(window_size, 0.0f);
+      d_m2.assign(window_size, 0.0f);
+      d_count = 0;
+      d_status = 0;
+      return true;
+    }
+
+    void
+    trigger_averager_ff_impl::forecast(int noutput_items, gr_vector_int &ninput_items_required)
+    {
+      // As by demux_ff, no new sample is needed if the oldest pending window is complete
+      int required = 1;
+      if (!d_pending.empty()
+              && d_pending.front().trigger_offset + d_post_trigger_window <= nitems_read(0)) {
+        required = 0;
+      }
+
+      for (auto &items : ninput_items_required) {
+        items = required;
+      }
+    }
+
+    uint64_t
+    trigger_averager_ff_impl::get_skipped_triggers() const
+    {
+      return d_skipped_triggers;
+    }
+
+    void
+    trigger_averager_ff_impl::skip_trigger(uint64_t trigger_offset, const char *reason)
+    {
+      d_skipped_triggers++;
+      GR_LOG_WARN(d_logger, "trigger at offset " + std::to_string(trigger_offset) + " skipped, " + reason);
+    }
+
+    void
+    trigger_averager_ff_impl::scan_tags(uint64_t end)
+    {
+      const auto begin = std::max(d_scanned_until, nitems_read(0));
+      if (begin >= end) {
+        return;
+      }
+
+      d_tags.clear();
+      get_tags_in_range(d_tags, 0, begin, end, acq_info_tag_key());
+      for (const auto &tag : d_tags) {
+        d_acq_info_tags.push_back(std::make_pair(decode_acq_info_tag(tag), tag.offset));
+      }
+
+      d_tags.clear();
+      get_tags_in_range(d_tags, 0, begin, end, trigger_tag_key());
+      for (const auto &tag : d_tags) {
+        if (tag.offset < d_pre_trigger_window) {
+          skip_trigger(tag.offset, "not enough pre-trigger samples");
+        }
+        else if (d_pending.size() >= MAX_PENDING_WINDOWS) {
+          skip_trigger(tag.offset, "too many pending windows");
+        }
+        else {
+          d_pending.push_back(pending_window_t {decode_trigger_tag(tag), tag.offset});
+        }
+      }
+
+      d_scanned_until = end;
+    }
+
+    uint64_t
+    trigger_averager_ff_impl::retain_from() const
+    {
+      if (!d_pending.empty()) {
+        return d_pending.front().trigger_offset - d_pre_trigger_window;
+      }
+      return d_scanned_until > d_pre_trigger_window ? d_scanned_until - d_pre_trigger_window : 0;
+    }
+
+    void
+    trigger_averager_ff_impl::accumulate(const pending_window_t &window)
+    {
+      const auto window_size = d_pre_trigger_window + d_post_trigger_window;
+      const auto window_start = window.trigger_offset - d_pre_trigger_window;
+
+      // acq_info in effect at the trigger
+      for (auto it = d_acq_info_tags.rbegin(); it != d_acq_info_tags.rend(); ++it) {
+        if (it->second <= window.trigger_offset) {
+          d_status |= it->first.status;
+          break;
+        }
+      }
+
+      d_count++;
+
+      // The window is read in place, in two parts if it wraps around the ring
+      const auto index = window_start & d_ring_mask;
+      const auto first = std::min<uint64_t>(window_size, d_ring_mask + 1 - index);
+      const float *parts[2] = { &d_ring[index], &d_ring[0] };
+      const uint64_t sizes[2] = { first, window_size - first };
+
+      size_t pos = 0;
+      for (int p = 0; p < 2; p++) {
+        if (d_count == 1) {
+          memcpy(&d_mean[pos], parts[p], sizes[p] * sizeof(float));
+          std::fill(d_m2.begin() + pos, d_m2.begin() + pos + sizes[p], 0.0f);
+        }
+        else if (d_alpha > 0.0f) {
+          accumulate_ewm(parts[p], &d_mean[pos], &d_m2[pos], sizes[p], d_alpha);
+        }
+        else {
+          accumulate_mean(parts[p], &d_mean[pos], &d_m2[pos], sizes[p], static_cast<float>(d_count));
+        }
+        pos += sizes[p];
+      }
+    }
+
+    void
+    trigger_averager_ff_impl::output_average(const pending_window_t &window, int out_idx,
+            gr_vector_void_star &output_items)
+    {
+      const auto window_size = d_pre_trigger_window + d_post_trigger_window;
+
+      memcpy((float *)output_items[0] + out_idx, &d_mean[0], window_size * sizeof(float));
+
+      if (output_items.size() > 1) {
+        float *out = (float *)output_items[1] + out_idx;
+
+        if (d_alpha > 0.0f) {
+          for (unsigned i = 0; i < window_size; i++) {
+            out[i] = std::sqrt(d_m2[i]);
+          }
+        }
+        else {
+          const float scale = d_count > 1 ? 1.0f / (d_count - 1) : 0.0f;
+          for (unsigned i = 0; i < window_size; i++) {
+            out[i] = std::sqrt(d_m2[i] * scale);
+          }
+        }
+      }
+
+      const auto out_offset = nitems_written(0) + out_idx;
+      auto trigger = window.trigger;
+      add_item_tag(0, make_trigger_tag(trigger, out_offset + d_pre_trigger_window));
+
+      for (auto it = d_acq_info_tags.rbegin(); it != d_acq_info_tags.rend(); ++it) {
+        if (it->second <= window.trigger_offset) {
+          auto acq_info = it->first;
+          acq_info.status = d_status;
+          add_item_tag(0, make_acq_info_tag(acq_info, out_offset));
+          break;
+        }
+      }
+
+      d_status = 0;
+    }
+
+    int
+    trigger_averager_ff_impl::general_work(int noutput_items,
+                               gr_vector_int &ninput_items,
+                               gr_vector_const_void_star &input_items,
+                               gr_vector_void_star &output_items)
+    {
+      block_stats_scope_t stats(d_stats);
+      const auto samp0_count = nitems_read(0);
+      const auto window_size = d_pre_trigger_window + d_post_trigger_window;
+
+      // New samples must not overwrite the samples still needed by the pending windows
+      const auto ring_space = d_ring_mask + 1 - (samp0_count - retain_from());
+      const auto nappend = std::min(static_cast<uint64_t>(ninput_items[0]), ring_space);
+      const auto end_offset = samp0_count + nappend;
+
+      scan_tags(end_offset);
+
+      const auto in = (const float *)input_items[0];
+      const auto index = samp0_count & d_ring_mask;
+      const auto first = std::min(nappend, d_ring_mask + 1 - index);
+      memcpy(&d_ring[index], in, first * sizeof(float));
+      memcpy(&d_ring[0], in + first, (nappend - first) * sizeof(float));
+
+      // Accumulate the complete windows, as long as there is space for the averaged ones
+      int retval = 0;
+      while (!d_pending.empty()
+              && d_pending.front().trigger_offset + d_post_trigger_window <= end_offset) {
+        const bool completes = d_alpha > 0.0f || d_count + 1 >= d_nr_windows;
+        if (completes && retval + static_cast<int>(window_size) > noutput_items) {
+          break;
+        }
+
+        accumulate(d_pending.front());
+
+        if (completes) {
+          output_average(d_pending.front(), retval, output_items);
+          retval += window_size;
+          // the exponentially weighted mean goes on from the current one
+          d_count = d_alpha > 0.0f ? 1 : 0;
+        }
+
+        d_pending.pop_front();
+      }
+
+      // Drop the acq_info tags superseded before all the pending and the future windows
+      const auto keep_from = retain_from();
+      while (d_acq_info_tags.size() > 1 && d_acq_info_tags[1].second <= keep_from) {
+        d_acq_info_tags.pop_front();
+      }
+
+      consume_each(static_cast<int>(nappend));
+      return retval;
+    }
+
+  } /* namespace digitizers */
+} /* namespace gr */
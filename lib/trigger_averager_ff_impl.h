@@ -0,0 +1,99 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_TRIGGER_AVERAGER_FF_IMPL_H
+#define INCLUDED_DIGITIZERS_TRIGGER_AVERAGER_FF_IMPL_H
+
+#include <digitizers/trigger_averager_ff.h>
+#include <digitizers/tags.h>
+
+#include <deque>
+#include <vector>
+
+#include "block_stats_impl.h"
+
+namespace gr {
+  namespace digitizers {
+
+    class trigger_averager_ff_impl : public trigger_averager_ff
+    {
+     private:
+
+      // Trigger waiting for the post-trigger samples
+      struct pending_window_t
+      {
+        trigger_t trigger;
+        uint64_t trigger_offset;
+      };
+
+      unsigned d_pre_trigger_window;
+      unsigned d_post_trigger_window;
+      int d_nr_windows;
+      float d_alpha;
+
+      // Pending windows (ordered by trigger offset) and acq_info tags which might apply to a
+      // pending or a future window, <tag, absolute offset>. The latest tag preceding the
+      // retained samples is kept.
+      std::deque<pending_window_t> d_pending;
+      std::deque<std::pair<acq_info_t, uint64_t>> d_acq_info_tags;
+
+      // Tags are scanned only once, up to this offset (exclusive)
+      uint64_t d_scanned_until;
+
+      uint64_t d_skipped_triggers;
+
+      std::vector<gr::tag_t> d_tags;
+
+      // Recent samples, sample at offset o is stored at index o & d_ring_mask (see demux_ff)
+      std::vector<float> d_ring;
+      uint64_t d_ring_mask;
+
+      // Running mean and sum of squared deviations (plain mean) or variance (exponentially
+      // weighted mean) of each window sample, over d_count windows
+      std::vector<float> d_mean;
+      std::vector<float> d_m2;
+      int d_count;
+
+      // acq_info status of the accumulated windows
+      uint32_t d_status;
+
+      block_stats_recorder_t d_stats {this};
+
+      void scan_tags(uint64_t end);
+
+      void skip_trigger(uint64_t trigger_offset, const char *reason);
+
+      // Offset of the oldest sample needed by the pending or the future windows
+      uint64_t retain_from() const;
+
+      // Accumulates the window of the given trigger
+      void accumulate(const pending_window_t &window);
+
+      // Outputs the averaged window at index out_idx
+      void output_average(const pending_window_t &window, int out_idx, gr_vector_void_star &output_items);
+
+     public:
+      trigger_averager_ff_impl(unsigned post_trigger_window, unsigned pre_trigger_window,
+              int nr_windows, double alpha);
+      ~trigger_averager_ff_impl();
+
+      bool start() override;
+
+      void forecast(int noutput_items, gr_vector_int &ninput_items_required) override;
+
+      uint64_t get_skipped_triggers() const override;
+
+      int general_work(int noutput_items,
+           gr_vector_int &ninput_items,
+           gr_vector_const_void_star &input_items,
+           gr_vector_void_star &output_items) override;
+
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_TRIGGER_AVERAGER_FF_IMPL_H */
@@ -0,0 +1,161 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_TRIGGER_REALIGNER_H
+#define INCLUDED_DIGITIZERS_TRIGGER_REALIGNER_H
+
+#include <digitizers/tags.h>
+#include <digitizers/status.h>
+
+#include <cstdint>
+#include <deque>
+#include <mutex>
+
+#include "wr_event_store.h"
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Matches triggers already forwarded to WR events, see realignment_t.
+     *
+     * Triggers are resolved in order, once their WR event is received, once it is known to be
+     * missing (newer events only) or once max_buffer_time passed since the trigger was added.
+     * Events can be added from any thread (e.g. the timing receiver), the rest is meant to be
+     * used from the work function only.
+     */
+    class trigger_realigner_t
+    {
+    public:
+
+      explicit trigger_realigner_t(size_t capacity)
+        : d_events(capacity),
+          d_tolerance_ns(0),
+          d_max_buffer_time_ns(0),
+          d_unmatched(0)
+      {
+      }
+
+      void set_tolerance(int64_t tolerance_ns) { d_tolerance_ns = tolerance_ns; }
+      int64_t get_tolerance() const { return d_tolerance_ns; }
+
+      void set_max_buffer_time(int64_t max_buffer_time_ns) { d_max_buffer_time_ns = max_buffer_time_ns; }
+      int64_t get_max_buffer_time() const { return d_max_buffer_time_ns; }
+
+      /*!
+       * \brief Adds a WR event, returns false if the oldest event had to be evicted.
+       */
+      bool
+      add_event(const wr_event_t &event)
+      {
+        std::lock_guard<std::mutex> lock(d_mutex);
+        return !d_events.add(event);
+      }
+
+      /*!
+       * \brief Matches a single stamp right away, see wr_event_store_t::match.
+       */
+      wr_event_store_t::match_result_t
+      match(int64_t stamp_utc, wr_event_t &event)
+      {
+        std::lock_guard<std::mutex> lock(d_mutex);
+        return d_events.match(stamp_utc, d_tolerance_ns, event);
+      }
+
+      /*!
+       * \brief Adds a forwarded trigger, received (UTC ns) is the time it was forwarded.
+       */
+      void
+      add_trigger(uint64_t offset, const trigger_t &trigger, int64_t received_ns)
+      {
+        d_pending.push_back(pending_trigger_t {offset, trigger, received_ns});
+      }
+
+      /*!
+       * \brief Resolves the pending triggers in order, resolved(realignment, timed_out) is
+       * called for each one. Stops at the first trigger whose event might still arrive.
+       */
+      template <typename F>
+      void
+      realign(int64_t now_ns, F resolved)
+      {
+        while (!d_pending.empty()) {
+          const auto &pending = d_pending.front();
+
+          wr_event_t event;
+          const auto result = match(pending.trigger.timestamp, event);
+
+          realignment_t realignment;
+          realignment.trigger_offset = pending.offset;
+          realignment.timestamp = pending.trigger.timestamp;
+          realignment.status = 0;
+          bool timed_out = false;
+
+          if (result == wr_event_store_t::match_result_t::MATCHED) {
+            realignment.timestamp = event.wr_trigger_stamp;
+          }
+          else if (result == wr_event_store_t::match_result_t::NO_MATCH) {
+            d_unmatched++;
+            realignment.status = channel_status_t::CHANNEL_STATUS_TIMEOUT_WAITING_WR_OR_REALIGNMENT_EVENT;
+          }
+          else if (now_ns - pending.received_ns > d_max_buffer_time_ns) {
+            realignment.status = channel_status_t::CHANNEL_STATUS_TIMEOUT_WAITING_WR_OR_REALIGNMENT_EVENT;
+            timed_out = true;
+          }
+          else {
+            // Later triggers can't be matched either, the store holds no event recent enough
+            break;
+          }
+
+          d_pending.pop_front();
+          resolved(realignment, timed_out);
+        }
+      }
+
+      size_t pending() const { return d_pending.size(); }
+
+      /*!
+       * \brief Drops the pending triggers, the events are kept.
+       */
+      void clear_pending() { d_pending.clear(); }
+
+      /*!
+       * \brief Number of triggers with newer events but none within the tolerance.
+       */
+      uint64_t unmatched() const { return d_unmatched; }
+
+      /*!
+       * \brief Counters of the events store, see wr_event_store_t.
+       */
+      void
+      get_event_counters(uint64_t &stale, uint64_t &evicted)
+      {
+        std::lock_guard<std::mutex> lock(d_mutex);
+        stale = d_events.stale();
+        evicted = d_events.evicted();
+      }
+
+    private:
+
+      struct pending_trigger_t
+      {
+        uint64_t offset;
+        trigger_t trigger;
+        int64_t received_ns;
+      };
+
+      std::mutex d_mutex;
+      wr_event_store_t d_events;
+      int64_t d_tolerance_ns;
+      int64_t d_max_buffer_time_ns;
+      std::deque<pending_trigger_t> d_pending;
+      uint64_t d_unmatched;
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_TRIGGER_REALIGNER_H */
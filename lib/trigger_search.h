@@ -0,0 +1,599 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_TRIGGER_SEARCH_H
+#define INCLUDED_DIGITIZERS_TRIGGER_SEARCH_H
+
+#include "cpu_dispatch.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace gr {
+  namespace digitizers {
+
+    /**********************************************************************
+     * Search kernels, return index of the first matching sample or nsamples if none
+     *********************************************************************/
+
+    namespace trigger_search_detail {
+
+      template <typename T>
+      static inline int
+      find_first_ge_generic(const T *samples, int nsamples, T threshold)
+      {
+        for (int i = 0; i < nsamples; i++) {
+          if (samples[i] >= threshold) {
+            return i;
+          }
+        }
+        return nsamples;
+      }
+
+      template <typename T>
+      static inline int
+      find_first_le_generic(const T *samples, int nsamples, T threshold)
+      {
+        for (int i = 0; i < nsamples; i++) {
+          if (samples[i] <= threshold) {
+            return i;
+          }
+        }
+        return nsamples;
+      }
+
+#if defined(__x86_64__) || defined(__i386__)
+      __attribute__((target("avx2")))
+      static inline int
+      find_first_ge_avx2(const float *samples, int nsamples, float threshold)
+      {
+        const __m256 thr = _mm256_set1_ps(threshold);
+        int i = 0;
+
+        for (; i + 8 <= nsamples; i += 8) {
+          auto mask = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(samples + i), thr, _CMP_GE_OQ));
+          if (mask) {
+            return i + __builtin_ctz(mask);
+          }
+        }
+
+        return i + find_first_ge_generic(samples + i, nsamples - i, threshold);
+      }
+
+      __attribute__((target("avx2")))
+      static inline int
+      find_first_le_avx2(const float *samples, int nsamples, float threshold)
+      {
+        const __m256 thr = _mm256_set1_ps(threshold);
+        int i = 0;
+
+        for (; i + 8 <= nsamples; i += 8) {
+          auto mask = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(samples + i), thr, _CMP_LE_OQ));
+          if (mask) {
+            return i + __builtin_ctz(mask);
+          }
+        }
+
+        return i + find_first_le_generic(samples + i, nsamples - i, threshold);
+      }
+
+      // Note, integer comparison: a >= t equals !(t > a), each sample yields two mask bits
+      __attribute__((target("avx2")))
+      static inline int
+      find_first_ge_avx2(const int16_t *samples, int nsamples, int16_t threshold)
+      {
+        const __m256i thr = _mm256_set1_epi16(threshold);
+        int i = 0;
+
+        for (; i + 16 <= nsamples; i += 16) {
+          auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(samples + i));
+          auto mask = ~_mm256_movemask_epi8(_mm256_cmpgt_epi16(thr, v));
+          if (mask) {
+            return i + __builtin_ctz(mask) / 2;
+          }
+        }
+
+        return i + find_first_ge_generic(samples + i, nsamples - i, threshold);
+      }
+
+      __attribute__((target("avx2")))
+      static inline int
+      find_first_le_avx2(const int16_t *samples, int nsamples, int16_t threshold)
+      {
+        const __m256i thr = _mm256_set1_epi16(threshold);
+        int i = 0;
+
+        for (; i + 16 <= nsamples; i += 16) {
+          auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(samples + i));
+          auto mask = ~_mm256_movemask_epi8(_mm256_cmpgt_epi16(v, thr));
+          if (mask) {
+            return i + __builtin_ctz(mask) / 2;
+          }
+        }
+
+        return i + find_first_le_generic(samples + i, nsamples - i, threshold);
+      }
+#endif
+
+      template <typename T>
+      struct kernels_t
+      {
+        typedef int (*kernel_t)(const T *, int, T);
+        kernel_t find_first_ge;
+        kernel_t find_first_le;
+      };
+
+      template <typename T>
+      static inline kernels_t<T>
+      select_kernels()
+      {
+        kernels_t<T> kernels;
+        kernels.find_first_ge = find_first_ge_generic<T>;
+        kernels.find_first_le = find_first_le_generic<T>;
+
+#if defined(__x86_64__) || defined(__i386__)
+        if (get_kernel_isa() >= KERNEL_ISA_AVX2) {
+          kernels.find_first_ge = find_first_ge_avx2;
+          kernels.find_first_le = find_first_le_avx2;
+        }
+#endif
+        return kernels;
+      }
+
+      // Kernels are selected once, on first use
+      template <typename T>
+      static inline const kernels_t<T> &
+      get_kernels()
+      {
+        static const kernels_t<T> kernels = select_kernels<T>();
+        return kernels;
+      }
+
+    } // namespace trigger_search_detail
+
+    /*!
+     * \brief Threshold crossing detection with hysteresis.
+     *
+     * In case of rising edges a trigger is generated when the signal reaches the threshold,
+     * the next one only after the signal falls to or below the rearm value (threshold - band).
+     * Falling edges work the other way around. The state is kept between calls, meaning that
+     * the samples can be fed in consecutive chunks.
+     *
+     * Instead of evaluating the state machine sample by sample the next sample that can change
+     * the state is searched for with SIMD kernels, therefore the cost for samples not changing the
+     * state is a single vector compare.
+     */
+    template <typename T>
+    class hysteresis_trigger_search_t
+    {
+    public:
+
+      hysteresis_trigger_search_t()
+        : d_threshold(0),
+          d_rearm(0),
+          d_rising(true)
+      {
+      }
+
+      /*!
+       * \param threshold trigger threshold
+       * \param rearm value the signal needs to cross in the opposite direction in order to rearm
+       * \param rising true for rising, false for falling edges
+       */
+      void configure(T threshold, T rearm, bool rising)
+      {
+        d_threshold = threshold;
+        d_rearm = rearm;
+        d_rising = rising;
+      }
+
+      /*!
+       * \brief Appends offsets of detected triggers to trigger_offsets.
+       *
+       * The state is encoded the same way as in the scalar implementation, one means the signal
+       * is above (rising: armed for falling back, falling: armed for the trigger), zero below.
+       */
+      void search(const T *samples, int nsamples, int &state, std::vector<int> &trigger_offsets) const
+      {
+        const auto &kernels = trigger_search_detail::get_kernels<T>();
+
+        int i = 0;
+
+        while (i < nsamples) {
+          if (d_rising) {
+            if (!state) {
+              i += kernels.find_first_ge(samples + i, nsamples - i, d_threshold);
+              if (i < nsamples) {
+                state = 1;
+                trigger_offsets.push_back(i);
+              }
+            }
+            else {
+              i += kernels.find_first_le(samples + i, nsamples - i, d_rearm);
+              if (i < nsamples) {
+                state = 0;
+              }
+            }
+          }
+          else {
+            if (state) {
+              i += kernels.find_first_le(samples + i, nsamples - i, d_threshold);
+              if (i < nsamples) {
+                state = 0;
+                trigger_offsets.push_back(i);
+              }
+            }
+            else {
+              i += kernels.find_first_ge(samples + i, nsamples - i, d_rearm);
+              if (i < nsamples) {
+                state = 1;
+              }
+            }
+          }
+
+          // The sample changing the state can't change it once again
+          i++;
+        }
+      }
+
+    private:
+
+      T d_threshold;
+      T d_rearm;
+      bool d_rising;
+    };
+
+    /*!
+     * \brief Trigger search over a combination of per-channel level and window conditions,
+     * optionally qualified by a minimum pulse width.
+     *
+     * Conditions are evaluated into a per-sample mask (branch-free loops the compiler can
+     * vectorize) and combined with AND or OR logic. A trigger is generated once the combined
+     * condition has been true for the minimum pulse width, i.e. at the first sample of the run
+     * if no pulse width is set. Runs spanning multiple chunks are accounted for.
+     *
+     * Usage per chunk: begin, add_condition for each condition, search.
+     */
+    class condition_trigger_search_t
+    {
+    public:
+
+      enum condition_t
+      {
+        ABOVE,    // x >= lower
+        BELOW,    // x <= lower
+        INSIDE,   // lower <= x <= upper
+        OUTSIDE   // x < lower or x > upper
+      };
+
+      condition_trigger_search_t()
+        : d_and_logic(true),
+          d_min_width(1),
+          d_nconditions(0),
+          d_nsamples(0),
+          d_in_run(false),
+          d_run_length(0),
+          d_fired(false)
+      {
+      }
+
+      /*!
+       * \param and_logic combine conditions with AND logic if true, OR otherwise
+       * \param min_width minimum number of samples the combined condition needs to hold
+       */
+      void configure(bool and_logic, uint32_t min_width)
+      {
+        d_and_logic = and_logic;
+        d_min_width = std::max(min_width, 1u);
+      }
+
+      /*!
+       * \brief Forget about the ongoing run, e.g. on rearm.
+       */
+      void reset()
+      {
+        d_in_run = false;
+        d_run_length = 0;
+        d_fired = false;
+      }
+
+      void begin(int nsamples)
+      {
+        d_nsamples = nsamples;
+        d_nconditions = 0;
+        d_mask.resize(nsamples);
+        d_tmp.resize(nsamples);
+      }
+
+      template <typename T>
+      void add_condition(const T *samples, condition_t condition, T lower, T upper)
+      {
+        // first condition is evaluated directly into the mask
+        uint8_t *out = d_nconditions ? &d_tmp[0] : &d_mask[0];
+        const int n = d_nsamples;
+
+        switch (condition) {
+          case ABOVE:
+            for (int i = 0; i < n; i++) {
+              out[i] = samples[i] >= lower;
+            }
+            break;
+          case BELOW:
+            for (int i = 0; i < n; i++) {
+              out[i] = samples[i] <= lower;
+            }
+            break;
+          case INSIDE:
+            for (int i = 0; i < n; i++) {
+              out[i] = (samples[i] >= lower) & (samples[i] <= upper);
+            }
+            break;
+          case OUTSIDE:
+            for (int i = 0; i < n; i++) {
+              out[i] = (samples[i] < lower) | (samples[i] > upper);
+            }
+            break;
+        }
+
+        if (d_nconditions) {
+          uint8_t *mask = &d_mask[0];
+          if (d_and_logic) {
+            for (int i = 0; i < n; i++) {
+              mask[i] &= out[i];
+            }
+          }
+          else {
+            for (int i = 0; i < n; i++) {
+              mask[i] |= out[i];
+            }
+          }
+        }
+
+        d_nconditions++;
+      }
+
+      /*!
+       * \brief Appends offsets of detected triggers to trigger_offsets.
+       */
+      void search(std::vector<int> &trigger_offsets)
+      {
+        if (d_nconditions == 0 || d_nsamples == 0) {
+          return;
+        }
+
+        const uint8_t *begin = &d_mask[0];
+        const uint8_t *end = begin + d_nsamples;
+        const uint8_t *pos = begin;
+
+        while (pos < end) {
+          if (!d_in_run) {
+            pos = static_cast<const uint8_t *>(find_byte(pos, 1, end - pos));
+            if (pos == end) {
+              break;
+            }
+
+            d_in_run = true;
+            d_run_length = 0;
+            d_fired = false;
+          }
+
+          // find the end of the run within this chunk
+          auto run_end = static_cast<const uint8_t *>(find_byte(pos, 0, end - pos));
+          uint64_t length = run_end - pos;
+
+          if (!d_fired && d_run_length + length >= d_min_width) {
+            trigger_offsets.push_back(static_cast<int>((pos - begin) + (d_min_width - d_run_length) - 1));
+            d_fired = true;
+          }
+
+          d_run_length += length;
+          pos = run_end;
+
+          if (run_end < end) {
+            d_in_run = false;
+          }
+        }
+      }
+
+    private:
+
+      // memchr is vectorized by the C library, returns end if not found
+      static const void *find_byte(const uint8_t *data, int value, size_t size)
+      {
+        auto found = std::memchr(data, value, size);
+        return found ? found : data + size;
+      }
+
+      bool d_and_logic;
+      uint64_t d_min_width;
+
+      int d_nconditions;
+      int d_nsamples;
+      std::vector<uint8_t> d_mask;
+      std::vector<uint8_t> d_tmp;
+
+      // state of the ongoing run (kept between chunks)
+      bool d_in_run;
+      uint64_t d_run_length;
+      bool d_fired;
+    };
+
+    /*!
+     * \brief Classifies streaming chunks by the triggers they hold, see
+     * app_buffer_t::set_priority_reserve.
+     *
+     * The poll thread feeds the raw samples of the trigger source as they arrive (scan), analog
+     * triggers are searched with the same hysteresis as by the work thread. A chunk is a priority
+     * chunk if it overlaps the window of a trigger, i.e. holds the trigger or some of its pre- or
+     * post-trigger samples. Pre-trigger samples are recognized as such only if the trigger was
+     * scanned before the chunk is classified, that is if the driver delivered both within the
+     * same callback.
+     *
+     * Samples are identified by their index within the stream, chunks must be classified in
+     * order. Nothing is allocated once configured.
+     */
+    class chunk_priority_tracker_t
+    {
+    public:
+
+      // Windows of triggers ahead of the classified chunks, further triggers extend the last one
+      static const size_t MAX_WINDOWS = 64;
+
+      // Analog samples are searched in slices of twice this, a trigger and its rearm take a
+      // sample each, i.e. the trigger offsets of a slice never exceed the reserved capacity
+      static const uint32_t MAX_OFFSETS = 1024;
+
+      chunk_priority_tracker_t()
+        : d_mode(DISABLED),
+          d_mask(0),
+          d_rising(true),
+          d_pre_samples(0),
+          d_post_samples(0),
+          d_state(0)
+      {
+        d_offsets.reserve(MAX_OFFSETS);
+        d_windows.reserve(MAX_WINDOWS);
+      }
+
+      /*!
+       * \brief Analog trigger source, threshold and rearm value in raw ADC counts, see
+       * hysteresis_trigger_search_t.
+       */
+      void configure_analog(int16_t threshold, int16_t rearm, bool rising, uint32_t pre_samples,
+              uint32_t post_samples)
+      {
+        d_mode = ANALOG;
+        d_analog.configure(threshold, rearm, rising);
+        d_rising = rising;
+        d_pre_samples = pre_samples;
+        d_post_samples = post_samples;
+        reset();
+      }
+
+      /*!
+       * \brief Digital trigger source, an edge of the pin(s) selected by mask of the raw port
+       * samples.
+       */
+      void configure_digital(int16_t mask, bool rising, uint32_t pre_samples, uint32_t post_samples)
+      {
+        d_mode = DIGITAL;
+        d_mask = mask;
+        d_rising = rising;
+        d_pre_samples = pre_samples;
+        d_post_samples = post_samples;
+        reset();
+      }
+
+      void disable()
+      {
+        d_mode = DISABLED;
+        reset();
+      }
+
+      bool is_enabled() const
+      {
+        return d_mode != DISABLED;
+      }
+
+      /*!
+       * \brief Forgets the triggers and the signal state, e.g. on arm.
+       */
+      void reset()
+      {
+        d_state = d_mode == DIGITAL ? -1 : 0;
+        d_windows.clear();
+      }
+
+      /*!
+       * \brief Searches the samples [first_sample, first_sample + nsamples) of the stream for
+       * triggers.
+       */
+      void scan(const int16_t *samples, uint32_t nsamples, uint64_t first_sample)
+      {
+        if (d_mode == ANALOG) {
+          for (uint32_t slice = 0; slice < nsamples; slice += 2 * MAX_OFFSETS) {
+            d_offsets.clear();
+            d_analog.search(samples + slice, static_cast<int>(std::min(nsamples - slice, 2 * MAX_OFFSETS)),
+                    d_state, d_offsets);
+            for (auto offset : d_offsets) {
+              add_trigger(first_sample + slice + offset);
+            }
+          }
+        }
+        else if (d_mode == DIGITAL) {
+          // The first sample after reset only sets the state
+          for (uint32_t i = 0; i < nsamples; i++) {
+            const int level = (samples[i] & d_mask) != 0;
+            if (d_state >= 0 && level != d_state && level == static_cast<int>(d_rising)) {
+              add_trigger(first_sample + i);
+            }
+            d_state = level;
+          }
+        }
+      }
+
+      /*!
+       * \brief Returns true if the chunk [chunk_start, chunk_start + chunk_size) overlaps the
+       * window of a trigger scanned so far. Windows ending before the chunk are dropped.
+       */
+      bool is_priority(uint64_t chunk_start, uint32_t chunk_size)
+      {
+        size_t passed = 0;
+        while (passed < d_windows.size() && d_windows[passed].second <= chunk_start) {
+          passed++;
+        }
+        d_windows.erase(d_windows.begin(), d_windows.begin() + passed);
+
+        return !d_windows.empty() && d_windows.front().first < chunk_start + chunk_size;
+      }
+
+    private:
+
+      void add_trigger(uint64_t trigger)
+      {
+        const uint64_t begin = trigger > d_pre_samples ? trigger - d_pre_samples : 0;
+        const uint64_t end = trigger + d_post_samples + 1;
+
+        // Triggers come in order, overlapping windows are merged
+        if (!d_windows.empty() && (begin <= d_windows.back().second || d_windows.size() == MAX_WINDOWS)) {
+          d_windows.back().second = std::max(d_windows.back().second, end);
+        }
+        else {
+          d_windows.emplace_back(begin, end);
+        }
+      }
+
+      enum mode_t
+      {
+        DISABLED,
+        ANALOG,
+        DIGITAL
+      };
+
+      mode_t d_mode;
+      hysteresis_trigger_search_t<int16_t> d_analog;
+      int16_t d_mask;
+      bool d_rising;
+      uint32_t d_pre_samples;
+      uint32_t d_post_samples;
+
+      // Analog: see hysteresis_trigger_search_t, digital: last pin level, -1 if unknown
+      int d_state;
+
+      std::vector<int> d_offsets;
+      std::vector<std::pair<uint64_t, uint64_t>> d_windows;   // [begin, end) in samples
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_TRIGGER_SEARCH_H */
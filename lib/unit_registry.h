@@ -0,0 +1,158 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_UNIT_REGISTRY_H
+#define INCLUDED_DIGITIZERS_UNIT_REGISTRY_H
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Result of opening a unit.
+     */
+    struct opened_unit_t
+    {
+      opened_unit_t()
+        : handle(0),
+          status(0),
+          max_value(0)
+      {}
+
+      int16_t handle;
+      uint32_t status;                        // PICO_STATUS of the open, the handle is valid if zero
+      std::string failed_call;                // for error reporting if the status is non-zero
+      int16_t max_value;                      // used for conversion to volts
+      std::map<uint32_t, std::string> info;   // unit info by PICO_INFO, queried once on open
+    };
+
+    /*!
+     * \brief Opens units of a driver family in the background and hands them over to the
+     * digitizer blocks by serial number.
+     *
+     * Opening a unit can take seconds (e.g. firmware upload). Applications owning several units
+     * request them all at process start (see open_units), the units are then opened while the
+     * flowgraph is being built and the blocks pick up the opened handles in driver_initialize
+     * (see take). Units of different driver families are opened concurrently, the opening of
+     * the units of the same family is serialized by the open function if the driver requires so.
+     *
+     * Units requested but never taken are closed when the registry is destroyed.
+     */
+    class unit_registry_t : boost::noncopyable
+    {
+    public:
+
+      typedef std::function<opened_unit_t(const std::string &serial_number)> open_function_t;
+      typedef std::function<void(int16_t handle)> close_function_t;
+
+      unit_registry_t(open_function_t open, close_function_t close)
+        : d_open(open),
+          d_close(close)
+      {
+      }
+
+      ~unit_registry_t()
+      {
+        // Only the open threads might still be running at this point
+        for (auto &entry : d_units) {
+          entry.second->thread.join();
+
+          if (entry.second->unit.status == 0) {
+            d_close(entry.second->unit.handle);
+          }
+        }
+      }
+
+      /*!
+       * \brief Starts opening of the given units, a thread per unit. Units which are already
+       * being opened or waiting to be taken are skipped.
+       */
+      void open_units(const std::vector<std::string> &serial_numbers)
+      {
+        boost::mutex::scoped_lock lock(d_mutex);
+
+        for (const auto &serial_number : serial_numbers) {
+          if (d_units.count(serial_number)) {
+            continue;
+          }
+
+          auto pending = std::make_shared<pending_unit_t>();
+          d_units[serial_number] = pending;
+          pending->thread = boost::thread([this, pending, serial_number] {
+            auto unit = d_open(serial_number);
+
+            boost::mutex::scoped_lock lock(d_mutex);
+            pending->unit = unit;
+            pending->done = true;
+            d_cv.notify_all();
+          });
+        }
+      }
+
+      /*!
+       * \brief Hands over the unit with the given serial number, waiting for the open to
+       * complete. Returns false if the unit was not requested, the caller is expected to open
+       * the unit itself in that case.
+       */
+      bool take(const std::string &serial_number, opened_unit_t &unit)
+      {
+        boost::mutex::scoped_lock lock(d_mutex);
+
+        auto it = d_units.find(serial_number);
+        if (it == d_units.end()) {
+          return false;
+        }
+
+        auto pending = it->second;
+        d_units.erase(it);
+
+        while (!pending->done) {
+          d_cv.wait(lock);
+        }
+
+        lock.unlock();
+        pending->thread.join();
+
+        unit = pending->unit;
+        return true;
+      }
+
+    private:
+
+      struct pending_unit_t
+      {
+        pending_unit_t()
+          : done(false)
+        {}
+
+        boost::thread thread;
+        bool done;
+        opened_unit_t unit;
+      };
+
+      const open_function_t d_open;
+      const close_function_t d_close;
+
+      boost::mutex d_mutex;
+      boost::condition_variable d_cv;
+      std::map<std::string, std::shared_ptr<pending_unit_t>> d_units;
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_UNIT_REGISTRY_H */
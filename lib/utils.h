@@ -14,6 +14,7 @@
 #include <chrono>
 #include <system_error>
 #include <boost/circular_buffer.hpp>
+#include <boost/lockfree/queue.hpp>
 #include <pmt/pmt.h>
 #include <gnuradio/tags.h>
 #include <iostream>
@@ -21,8 +22,17 @@
 #include <math.h>
 #include <queue>
 #include <list>
+#include <set>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <iterator>
 #include <digitizers/tags.h>
 
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
 namespace gr {
   namespace digitizers {
 
@@ -38,6 +48,118 @@ namespace gr {
       return uint64_t( get_timestamp_nano_utc() / 1000000 );
     }
 
+    /*!
+     * \brief Maps the tags of a decimating block onto its output items.
+     *
+     * Tags within the input window [first_input + i * decim, first_input + (i + 1) * decim) are
+     * placed on output item first_output + i. Trigger tags are re-encoded at the new offset and
+     * the acq_info tags of a window are merged into a single one, status being the logical OR
+     * of all the stati, the other fields are taken from the first tag. Merging is required due
+     * to this bug: https://github.com/gnuradio/gnuradio/issues/2364, otherwise we will eat to
+     * much memory.
+     *
+     * The tags of the whole work call are walked once, i.e. the cost is proportional to the
+     * number of tags and not to the number of output items.
+     *
+     * \param tags input tags, e.g. from a single get_tags_in_range call, sorted if needed
+     * \param add_tag callback invoked with each output tag, in order of the offset
+     */
+    template <typename AddTag>
+    inline void decimate_tags(std::vector<gr::tag_t> &tags, uint64_t first_input,
+            uint64_t first_output, unsigned decim, AddTag add_tag)
+    {
+      if (tags.empty()) {
+        return;
+      }
+
+      if (!std::is_sorted(tags.begin(), tags.end(), gr::tag_t::offset_compare)) {
+        std::stable_sort(tags.begin(), tags.end(), gr::tag_t::offset_compare);
+      }
+
+      auto it = tags.begin();
+      while (it != tags.end()) {
+        const uint64_t window = (it->offset - first_input) / decim;
+        const uint64_t offset = first_output + window;
+        const uint64_t window_end = first_input + (window + 1) * decim;
+
+        acq_info_t merged_acq_info;
+        bool found_acq_info = false;
+
+        for (; it != tags.end() && it->offset < window_end; ++it) {
+          const auto kind = get_tag_kind(*it);
+          if (kind == TAG_KIND_TRIGGER) {
+            auto trigger = decode_trigger_tag(*it);
+            add_tag(make_trigger_tag(trigger, offset));
+          }
+          else if (kind == TAG_KIND_ACQ_INFO) {
+            auto acq_info = decode_acq_info_tag(*it);
+            if (!found_acq_info) {
+              merged_acq_info = acq_info;
+              found_acq_info = true;
+            }
+            else {
+              merged_acq_info.status |= acq_info.status;
+            }
+          }
+          else {
+            gr::tag_t tag = *it;
+            tag.offset = offset;
+            add_tag(tag);
+          }
+        }
+
+        if (found_acq_info) {
+          add_tag(make_acq_info_tag(merged_acq_info, offset));
+        }
+      }
+    }
+
+    /*!
+     * \brief Scaling assumed for raw (int16_t) inputs until the first raw_scaling tag, i.e.
+     * the output is in ADC counts.
+     */
+    inline raw_scaling_t
+    default_raw_scaling()
+    {
+      return raw_scaling_t{1.0, 0.0, 0.0};
+    }
+
+    /*!
+     * \brief Applies the raw_scaling tags of a raw (int16_t) input to its decimated output.
+     *
+     * Output item i is derived from the input window [first_input + i * decim, first_input +
+     * (i + 1) * decim), it is scaled with the raw_scaling tag valid at the first sample of the
+     * window. The output items are handed to convert in runs sharing the same scaling, i.e.
+     * convert(first_item, nitems, scaling) is invoked once per raw_scaling tag at most.
+     *
+     * \param tags input tags, sorted by offset (see decimate_tags)
+     * \param scaling scaling valid before the first tag, updated to the last one
+     */
+    template <typename Convert>
+    inline void apply_raw_scaling(const std::vector<gr::tag_t> &tags, uint64_t first_input,
+            unsigned decim, int noutput_items, raw_scaling_t &scaling, Convert convert)
+    {
+      int item = 0;
+
+      for (const auto &tag : tags) {
+        if (get_tag_kind(tag) != TAG_KIND_RAW_SCALING) {
+          continue;
+        }
+
+        // First window starting at or after the tag
+        const auto window = std::min<uint64_t>(noutput_items, (tag.offset - first_input + decim - 1) / decim);
+        if (static_cast<int>(window) > item) {
+          convert(item, static_cast<int>(window) - item, scaling);
+          item = static_cast<int>(window);
+        }
+        scaling = decode_raw_scaling_tag(tag);
+      }
+
+      if (item < noutput_items) {
+        convert(item, noutput_items - item, scaling);
+      }
+    }
+
     /*!
      * \brief Converts an integer value to hex (string).
      */
@@ -75,7 +197,7 @@ namespace gr {
         {
             {
               boost::lock_guard<boost::mutex> lg(mut);
-                data_queue.push(new_value);
+                data_queue.push(std::move(new_value));
             }
             data_cond.notify_one();
         }
@@ -89,7 +211,7 @@ namespace gr {
             boost::unique_lock<boost::mutex> lk(mut);
             auto retval = data_cond.wait_for(lk, timeout, [this]{return !data_queue.empty();});
             if (retval) { // true is returned if condition evaluates to true...
-                value = data_queue.front();
+                value = std::move(data_queue.front());
                 data_queue.pop();
             }
 
@@ -107,7 +229,7 @@ namespace gr {
                 return false;
             }
 
-            value = data_queue.front();
+            value = std::move(data_queue.front());
             data_queue.pop();
 
             return true;
@@ -134,6 +256,415 @@ namespace gr {
         }
     };
 
+    /*!
+     * \brief Bounded lock-free multi-producer single-consumer queue.
+     *
+     * Values are kept in preallocated slots, indices of free and ready slots are exchanged
+     * through two lock-free queues, i.e. T doesn't need to be trivially copyable. Producers
+     * never block nor allocate, a push into a full queue fails and is counted as a drop.
+     *
+     * The capacity is limited to MAX_CAPACITY, the fixed-size lock-free queues index their
+     * nodes (capacity plus one) with 16 bits.
+     */
+    template <typename T>
+    class bounded_mpsc_queue
+    {
+      public:
+        static const size_t MAX_CAPACITY = 65534;
+
+        explicit bounded_mpsc_queue(size_t capacity)
+          : d_slots(capacity),
+            d_free(capacity),
+            d_ready(capacity),
+            d_pushed(0),
+            d_popped(0),
+            d_dropped(0)
+        {
+            for (size_t i = 0; i < capacity; i++) {
+                d_free.bounded_push(i);
+            }
+        }
+
+        /*!
+         *\returns false if the queue is full, otherwise true.
+         */
+        bool push(T value)
+        {
+            return emplace(std::move(value));
+        }
+
+        /*!
+         *\returns false if the queue is full, otherwise true. The slot is assigned T(args...).
+         */
+        template <typename... Args>
+        bool emplace(Args&&... args)
+        {
+            size_t slot;
+            if (!d_free.pop(slot)) {
+                d_dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+
+            d_slots[slot] = T(std::forward<Args>(args)...);
+            d_ready.bounded_push(slot);
+            d_pushed.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+
+        /*!
+         *\returns false if no data is available, otherwise true. Consumer only.
+         */
+        bool pop(T& value)
+        {
+            size_t slot;
+            if (!d_ready.pop(slot)) {
+                return false;
+            }
+
+            value = std::move(d_slots[slot]);
+            d_free.bounded_push(slot);
+            d_popped.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+
+        /*!
+         * \brief Pops up to max_items values, appended to values. Consumer only.
+         *\returns number of values popped.
+         */
+        size_t pop_batch(std::vector<T>& values, size_t max_items)
+        {
+            size_t n = 0;
+            size_t slot;
+            while (n < max_items && d_ready.pop(slot)) {
+                values.push_back(std::move(d_slots[slot]));
+                d_free.bounded_push(slot);
+                n++;
+            }
+            d_popped.fetch_add(n, std::memory_order_relaxed);
+            return n;
+        }
+
+        /*!
+         * \brief Discards all the queued values. Consumer only.
+         */
+        void clear()
+        {
+            T value;
+            while (pop(value)) {}
+        }
+
+        size_t capacity() const
+        {
+            return d_slots.size();
+        }
+
+        uint64_t pushed() const
+        {
+            return d_pushed.load(std::memory_order_relaxed);
+        }
+
+        /*!
+         * \brief Number of queued values, approximate while values are pushed or popped.
+         */
+        size_t size() const
+        {
+            const auto popped = d_popped.load(std::memory_order_relaxed);
+            const auto pushed = d_pushed.load(std::memory_order_relaxed);
+            return pushed > popped ? static_cast<size_t>(pushed - popped) : 0;
+        }
+
+        uint64_t dropped() const
+        {
+            return d_dropped.load(std::memory_order_relaxed);
+        }
+
+      private:
+        std::vector<T> d_slots;
+        boost::lockfree::queue<size_t, boost::lockfree::fixed_sized<true>> d_free;
+        boost::lockfree::queue<size_t, boost::lockfree::fixed_sized<true>> d_ready;
+        std::atomic<uint64_t> d_pushed;
+        std::atomic<uint64_t> d_popped;
+        std::atomic<uint64_t> d_dropped;
+    };
+
+    /*!
+     * \brief Bounded lock-free single-producer single-consumer ring.
+     *
+     * Capacity is rounded up to a power of two. Head and tail live on separate cache lines and
+     * each side caches the other side's index, i.e. the shared indices are only reloaded when
+     * the ring looks full (producer) or empty (consumer). A push into a full ring fails and is
+     * counted as a drop.
+     */
+    template <typename T>
+    class spsc_ring
+    {
+      public:
+        explicit spsc_ring(size_t capacity)
+          : d_mask(round_up_pow2(std::max(capacity, size_t{2})) - 1),
+            d_slots(d_mask + 1),
+            d_head(0),
+            d_cached_tail(0),
+            d_tail(0),
+            d_cached_head(0),
+            d_dropped(0)
+        {
+        }
+
+        /*!
+         *\returns false if the ring is full, otherwise true. Producer only.
+         */
+        bool push(T value)
+        {
+            return emplace(std::move(value));
+        }
+
+        /*!
+         *\returns false if the ring is full, otherwise true. Producer only.
+         */
+        template <typename... Args>
+        bool emplace(Args&&... args)
+        {
+            const auto head = d_head.load(std::memory_order_relaxed);
+            if (head - d_cached_tail > d_mask) {
+                d_cached_tail = d_tail.load(std::memory_order_acquire);
+                if (head - d_cached_tail > d_mask) {
+                    d_dropped.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                }
+            }
+
+            d_slots[head & d_mask] = T(std::forward<Args>(args)...);
+            d_head.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+        /*!
+         *\returns false if no data is available, otherwise true. Consumer only.
+         */
+        bool pop(T& value)
+        {
+            const auto tail = d_tail.load(std::memory_order_relaxed);
+            if (tail == d_cached_head) {
+                d_cached_head = d_head.load(std::memory_order_acquire);
+                if (tail == d_cached_head) {
+                    return false;
+                }
+            }
+
+            value = std::move(d_slots[tail & d_mask]);
+            d_tail.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        /*!
+         * \brief Pops up to max_items values, appended to values. Consumer only.
+         *\returns number of values popped.
+         */
+        size_t pop_batch(std::vector<T>& values, size_t max_items)
+        {
+            const auto tail = d_tail.load(std::memory_order_relaxed);
+            d_cached_head = d_head.load(std::memory_order_acquire);
+            const auto n = std::min(static_cast<size_t>(d_cached_head - tail), max_items);
+
+            for (size_t i = 0; i < n; i++) {
+                values.push_back(std::move(d_slots[(tail + i) & d_mask]));
+            }
+            d_tail.store(tail + n, std::memory_order_release);
+            return n;
+        }
+
+        /*!
+         * \brief Discards all the queued values. Consumer only.
+         */
+        void clear()
+        {
+            T value;
+            while (pop(value)) {}
+        }
+
+        size_t capacity() const
+        {
+            return d_mask + 1;
+        }
+
+        size_t size() const
+        {
+            return static_cast<size_t>(d_head.load(std::memory_order_acquire)
+                    - d_tail.load(std::memory_order_acquire));
+        }
+
+        uint64_t dropped() const
+        {
+            return d_dropped.load(std::memory_order_relaxed);
+        }
+
+      private:
+        static size_t round_up_pow2(size_t n)
+        {
+            size_t p = 1;
+            while (p < n) {
+                p <<= 1;
+            }
+            return p;
+        }
+
+        const size_t d_mask;
+        std::vector<T> d_slots;
+
+        // producer side, padded rather than alignas, which C++11 doesn't honour for new
+        char d_producer_pad[64];
+        std::atomic<uint64_t> d_head;
+        uint64_t d_cached_tail;
+
+        // consumer side
+        char d_consumer_pad[64];
+        std::atomic<uint64_t> d_tail;
+        uint64_t d_cached_head;
+
+        char d_dropped_pad[64];
+        std::atomic<uint64_t> d_dropped;
+    };
+
+    /*!
+     * \brief Adds a blocking wait to one of the lock-free queues above (spsc_ring or
+     * bounded_mpsc_queue).
+     *
+     * The consumer sleeps on an eventfd. Producers only signal the eventfd (a syscall) if the
+     * consumer announced it's about to sleep, i.e. pushes stay lock and syscall free while the
+     * consumer keeps up.
+     */
+    template <typename Queue>
+    class blocking_queue
+    {
+      public:
+        explicit blocking_queue(size_t capacity)
+          : d_queue(capacity),
+            d_sleeping(false),
+            d_fd(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+        {
+            if (d_fd < 0) {
+                throw std::system_error(errno, std::system_category(), "eventfd");
+            }
+        }
+
+        ~blocking_queue()
+        {
+            ::close(d_fd);
+        }
+
+        blocking_queue(const blocking_queue&) = delete;
+        blocking_queue& operator=(const blocking_queue&) = delete;
+
+        template <typename V>
+        bool push(V&& value)
+        {
+            if (!d_queue.push(std::forward<V>(value))) {
+                return false;
+            }
+            wake();
+            return true;
+        }
+
+        template <typename... Args>
+        bool emplace(Args&&... args)
+        {
+            if (!d_queue.emplace(std::forward<Args>(args)...)) {
+                return false;
+            }
+            wake();
+            return true;
+        }
+
+        template <typename V>
+        bool pop(V& value)
+        {
+            return d_queue.pop(value);
+        }
+
+        template <typename V>
+        size_t pop_batch(std::vector<V>& values, size_t max_items)
+        {
+            return d_queue.pop_batch(values, max_items);
+        }
+
+        /*!
+         *\returns false if no data is available in time, otherwise true. Consumer only.
+         */
+        template <typename V>
+        bool wait_and_pop(V& value, std::chrono::milliseconds timeout)
+        {
+            if (d_queue.pop(value)) {
+                return true;
+            }
+
+            const auto deadline = std::chrono::steady_clock::now() + timeout;
+            while (true) {
+                d_sleeping.store(true, std::memory_order_seq_cst);
+
+                // recheck, the producer might have pushed before seeing the flag
+                if (d_queue.pop(value)) {
+                    d_sleeping.store(false, std::memory_order_relaxed);
+                    return true;
+                }
+
+                const auto remaining_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                        deadline - std::chrono::steady_clock::now()).count();
+                if (remaining_us <= 0) {
+                    d_sleeping.store(false, std::memory_order_relaxed);
+                    return false;
+                }
+
+                pollfd pfd = {d_fd, POLLIN, 0};
+                ::poll(&pfd, 1, static_cast<int>((remaining_us + 999) / 1000));
+                d_sleeping.store(false, std::memory_order_relaxed);
+
+                uint64_t counter;
+                while (::read(d_fd, &counter, sizeof(counter)) > 0) {}
+
+                if (d_queue.pop(value)) {
+                    return true;
+                }
+            }
+        }
+
+        /*!
+         * \brief Wakes up the consumer, e.g. when stopping.
+         */
+        void notify()
+        {
+            const uint64_t one = 1;
+            ssize_t ret = ::write(d_fd, &one, sizeof(one));
+            (void) ret;
+        }
+
+        void clear()
+        {
+            d_queue.clear();
+        }
+
+        Queue& queue()
+        {
+            return d_queue;
+        }
+
+        const Queue& queue() const
+        {
+            return d_queue;
+        }
+
+      private:
+        void wake()
+        {
+            if (d_sleeping.load(std::memory_order_seq_cst)) {
+                notify();
+            }
+        }
+
+        Queue d_queue;
+        std::atomic<bool> d_sleeping;
+        int d_fd;
+    };
+
     template <class T>
     class circular_buffer
     {
@@ -227,59 +758,147 @@ namespace gr {
     static const double whm2stdev = 2.0*fwhm2stdev;
 
 
+  /*!
+   * \brief Running median of the last n samples.
+   *
+   * Samples are kept in chronological order in a ring and in ascending order in a sorted array.
+   * On each add the oldest sample is located by binary search and the array is shifted by one
+   * element between its position and the insertion point, i.e. O(log n) comparisons and a single
+   * memmove over a contiguous array, which is faster than node based structures for the window
+   * sizes used in practice.
+   *
+   * The window is initially filled with zeros. For even n the lower of the two middle samples
+   * is returned.
+   */
   template<typename T>
   class median_filter
   {
   private:
-    std::queue<T> vals;
-    std::list<T> ord_vals;
-    int num;
-    int middle;
+    std::vector<T> d_ring;     // chronological order
+    std::vector<T> d_sorted;   // ascending order
+    size_t d_oldest;           // ring position of the oldest sample
+    size_t d_middle;           // index of the median in the sorted array
 
   public:
     median_filter(int n):
-    num(n),middle(n/2)
+      d_ring(std::max(n, 1), T(0)),
+      d_sorted(std::max(n, 1), T(0)),
+      d_oldest(0),
+      d_middle((d_sorted.size() - 1) / 2)
     {
-      //fill wit zeroes as starter.
-      for(int i = 0; i < num; i++) {
-        vals.push(0.0);
-        ord_vals.push_back(0.0);
-      }
     }
 
     T add(T new_el)
     {
-      //track sample chronological order and remove oldest one
-      vals.push(new_el);
-      float oldest = vals.front();
-      vals.pop();
+      const T oldest = d_ring[d_oldest];
+      d_ring[d_oldest] = new_el;
+      d_oldest = d_oldest + 1 == d_ring.size() ? 0 : d_oldest + 1;
+
+      // replace the oldest sample in the sorted array, shifting the ones in between
+      auto first = d_sorted.begin();
+      auto pos = std::lower_bound(first, d_sorted.end(), oldest);
+
+      if (new_el > oldest) {
+        auto insert = std::lower_bound(pos + 1, d_sorted.end(), new_el);
+        std::move(pos + 1, insert, pos);
+        *(insert - 1) = new_el;
+      }
+      else if (new_el < oldest) {
+        auto insert = std::upper_bound(first, pos, new_el);
+        std::move_backward(insert, pos, pos + 1);
+        *insert = new_el;
+      }
 
-      //remove from ordered list the oldest value
-      for(auto it = ord_vals.begin(); it != ord_vals.end(); ++it){
-        if(*it == oldest){
-          ord_vals.erase(it);
-          break;
-        }
+      return d_sorted[d_middle];
+    }
+
+    size_t size() const
+    {
+      return d_ring.size();
+    }
+  };
+
+  /*!
+   * \brief Multiset of values with O(log n) insert, erase and median, e.g. for sliding window
+   * medians where the window is updated incrementally.
+   *
+   * The values are split into two sorted halves, the lower one holding the extra element if
+   * the number of values is odd. The median of an even number of values is the mean of the
+   * two middle ones.
+   */
+  template<typename T>
+  class sliding_median
+  {
+  public:
+
+    void clear()
+    {
+      d_lower.clear();
+      d_upper.clear();
+    }
+
+    size_t size() const
+    {
+      return d_lower.size() + d_upper.size();
+    }
+
+    void insert(T value)
+    {
+      if (d_lower.empty() || value <= *d_lower.rbegin()) {
+        d_lower.insert(value);
       }
-      //add to the ordered list by insertion
-      bool added_in = false;
-      for(auto it = ord_vals.begin(); it != ord_vals.end(); ++it) {
-        if(*it <= new_el) {
-          ord_vals.insert(it, new_el);
-          added_in = true;
-          break;
-        }
+      else {
+        d_upper.insert(value);
       }
-      //the value hasn't been inserted into the list.
-      //add it to end, i.e. biggest sample in this window.
-      if(!added_in) { ord_vals.push_back(new_el); }
-
-      //middle value of the new ordered list is
-      //the median of the last n samples
-      auto mean_val = ord_vals.begin();
-      std::advance(mean_val, middle);
-      return *mean_val;
+      rebalance();
     }
+
+    /*!
+     * \brief Removes a single instance of the value, the value must be present.
+     */
+    void erase(T value)
+    {
+      if (!d_lower.empty() && value <= *d_lower.rbegin()) {
+        d_lower.erase(d_lower.find(value));
+      }
+      else {
+        d_upper.erase(d_upper.find(value));
+      }
+      rebalance();
+    }
+
+    /*!
+     * \brief Returns the median, or zero if empty.
+     */
+    T median() const
+    {
+      if (d_lower.empty()) {
+        return T(0);
+      }
+      if (d_lower.size() > d_upper.size()) {
+        return *d_lower.rbegin();
+      }
+      return T(0.5) * (*d_lower.rbegin() + *d_upper.begin());
+    }
+
+  private:
+
+    void rebalance()
+    {
+      if (d_lower.size() > d_upper.size() + 1) {
+        auto last = std::prev(d_lower.end());
+        d_upper.insert(*last);
+        d_lower.erase(last);
+      }
+      else if (d_upper.size() > d_lower.size()) {
+        auto first = d_upper.begin();
+        d_lower.insert(*first);
+        d_upper.erase(first);
+      }
+    }
+
+    std::multiset<T> d_lower;
+    std::multiset<T> d_upper;
   };
 
   template<typename T>
@@ -0,0 +1,136 @@
+/* -*- c++ -*- */
+/* Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+ * co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+ * You may use, distribute and modify this code under the terms of the GPL v.3  license.
+ */
+
+#ifndef INCLUDED_DIGITIZERS_WR_EVENT_STORE_H
+#define INCLUDED_DIGITIZERS_WR_EVENT_STORE_H
+
+#include <digitizers/tags.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+
+namespace gr {
+  namespace digitizers {
+
+    /*!
+     * \brief Bounded store of WR events ordered by wr_trigger_stamp_utc.
+     *
+     * Events normally arrive in order and are appended, late events are inserted at their
+     * place. When full the oldest event is evicted. Matching is a binary search, i.e. it doesn't
+     * degrade when events back up. Not thread safe.
+     */
+    class wr_event_store_t
+    {
+    public:
+
+      enum class match_result_t
+      {
+        MATCHED,   // event within tolerance found and removed from the store
+        NO_MATCH,  // there are newer events but none within tolerance
+        PENDING    // no event at or after the stamp (minus tolerance) yet
+      };
+
+      explicit wr_event_store_t(size_t capacity)
+        : d_capacity(std::max(capacity, size_t{1})),
+          d_evicted(0),
+          d_stale(0)
+      {
+      }
+
+      /*!
+       * \brief Adds an event, returns false if the oldest event had to be evicted.
+       */
+      bool
+      add(const wr_event_t &event)
+      {
+        bool evicted = false;
+        if (d_events.size() >= d_capacity) {
+          d_events.pop_front();
+          d_evicted++;
+          evicted = true;
+        }
+
+        if (d_events.empty() || d_events.back().wr_trigger_stamp_utc <= event.wr_trigger_stamp_utc) {
+          d_events.push_back(event);
+        }
+        else {
+          d_events.insert(std::upper_bound(d_events.begin(), d_events.end(), event, stamp_less), event);
+        }
+        return evicted;
+      }
+
+      /*!
+       * \brief Finds the event nearest to stamp_utc (UTC nanoseconds) within the tolerance.
+       *
+       * Events older than stamp_utc - tolerance_ns can't match this or any later stamp and are
+       * dropped (counted as stale). The matched event is removed together with all older ones.
+       */
+      match_result_t
+      match(int64_t stamp_utc, int64_t tolerance_ns, wr_event_t &event)
+      {
+        wr_event_t key;
+        key.wr_trigger_stamp_utc = stamp_utc - tolerance_ns;
+        auto first = std::lower_bound(d_events.begin(), d_events.end(), key, stamp_less);
+        d_stale += static_cast<uint64_t>(first - d_events.begin());
+        d_events.erase(d_events.begin(), first);
+
+        if (d_events.empty()) {
+          return match_result_t::PENDING;
+        }
+
+        // candidates are the first events on either side of the stamp
+        key.wr_trigger_stamp_utc = stamp_utc;
+        auto after = std::lower_bound(d_events.begin(), d_events.end(), key, stamp_less);
+        auto nearest = after;
+        if (after == d_events.end()
+                || (after != d_events.begin()
+                    && stamp_utc - std::prev(after)->wr_trigger_stamp_utc < after->wr_trigger_stamp_utc - stamp_utc)) {
+          nearest = std::prev(after);
+        }
+
+        if (nearest->wr_trigger_stamp_utc - stamp_utc > tolerance_ns) {
+          return match_result_t::NO_MATCH;
+        }
+
+        event = *nearest;
+        d_stale += static_cast<uint64_t>(nearest - d_events.begin());
+        d_events.erase(d_events.begin(), nearest + 1);
+        return match_result_t::MATCHED;
+      }
+
+      size_t size() const { return d_events.size(); }
+      bool empty() const { return d_events.empty(); }
+      void clear() { d_events.clear(); }
+
+      /*!
+       * \brief Number of events evicted because the store was full.
+       */
+      uint64_t evicted() const { return d_evicted; }
+
+      /*!
+       * \brief Number of events dropped without being matched to any stamp.
+       */
+      uint64_t stale() const { return d_stale; }
+
+    private:
+
+      static bool
+      stamp_less(const wr_event_t &a, const wr_event_t &b)
+      {
+        return a.wr_trigger_stamp_utc < b.wr_trigger_stamp_utc;
+      }
+
+      size_t d_capacity;
+      std::deque<wr_event_t> d_events;
+      uint64_t d_evicted;
+      uint64_t d_stale;
+    };
+
+  } // namespace digitizers
+} // namespace gr
+
+#endif /* INCLUDED_DIGITIZERS_WR_EVENT_STORE_H */
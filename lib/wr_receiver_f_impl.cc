@@ -25,24 +25,45 @@
 #include <gnuradio/io_signature.h>
 #include "wr_receiver_f_impl.h"
 
+#include <sstream>
+#include <stdexcept>
+
 namespace gr {
   namespace digitizers {
 
+    // Upper bound of the time work waits for events in the event_stream mode, i.e. how long
+    // it takes to notice the flowgraph is being stopped
+    static const std::chrono::milliseconds EVENT_WAIT_TIMEOUT(100);
+
     wr_receiver_f::sptr
-    wr_receiver_f::make()
+    wr_receiver_f::make(bool event_stream, int queue_size)
     {
+      typedef bounded_mpsc_queue<wr_event_t> queue_t;
+
+      if (queue_size < 1 || static_cast<size_t>(queue_size) > queue_t::MAX_CAPACITY) {
+        std::ostringstream message;
+        message << "Exception in " << __FILE__ << ":" << __LINE__ << ": invalid queue size: " << queue_size
+                << ", valid range is 1 to " << queue_t::MAX_CAPACITY;
+        throw std::invalid_argument(message.str());
+      }
+
       return gnuradio::get_initial_sptr
-        (new wr_receiver_f_impl());
+        (new wr_receiver_f_impl(event_stream, queue_size));
     }
 
     /*
      * The private constructor
      */
-    wr_receiver_f_impl::wr_receiver_f_impl()
+    wr_receiver_f_impl::wr_receiver_f_impl(bool event_stream, int queue_size)
       : gr::sync_block("wr_receiver_f",
               gr::io_signature::make(0, 0, 0),
-              gr::io_signature::make(1, 1, sizeof(float)))
-    {}
+              gr::io_signature::make(1, 1, sizeof(float))),
+        d_event_stream(event_stream),
+        d_event_queue(static_cast<size_t>(queue_size)),
+        d_max_queued(0)
+    {
+      message_port_register_out(pmt::mp("events"));
+    }
 
     /*
      * Our virtual destructor.
@@ -51,28 +72,59 @@ namespace gr {
     {
     }
 
+    void
+    wr_receiver_f_impl::publish(const wr_event_t &event, uint64_t offset)
+    {
+      auto tag = make_wr_event_tag(event, offset);
+      add_item_tag(0, tag);
+      message_port_pub(pmt::mp("events"), pmt::cons(tag.key, tag.value));
+    }
+
     int
     wr_receiver_f_impl::work(int noutput_items,
         gr_vector_const_void_star &input_items,
         gr_vector_void_star &output_items)
     {
-      // Zero the output
-      memset(output_items[0], 0, noutput_items * sizeof(float));
-
-      // Attach event tags
+      block_stats_scope_t stats(d_stats);
       wr_event_t event;
-      while (d_event_queue.pop(event))
-      {
-        auto tag = make_wr_event_tag(event, nitems_written(0));
-        add_item_tag(0, tag);
+      int nevents = 0;
+
+      if (d_event_stream) {
+        // One sample per event, wait a bit if there is nothing to do
+        if (!d_event_queue.wait_and_pop(event, EVENT_WAIT_TIMEOUT)) {
+          return 0;
+        }
+
+        do {
+          publish(event, nitems_written(0) + nevents);
+          nevents++;
+        } while (nevents < noutput_items && d_event_queue.pop(event));
+
+        noutput_items = nevents;
+      }
+      else {
+        // Attach event tags
+        while (d_event_queue.pop(event)) {
+          publish(event, nitems_written(0));
+        }
       }
 
+      // Zero the output
+      memset(output_items[0], 0, noutput_items * sizeof(float));
+
       // Tell runtime system how many output items we produced.
       return noutput_items;
     }
 
     bool wr_receiver_f_impl::start()
     {
+      return true;
+    }
+
+    bool wr_receiver_f_impl::stop()
+    {
+      // Called by the thread of the block after its last work call, i.e. as the consumer. Events
+      // added before the flowgraph is started again are kept.
       d_event_queue.clear();
       return true;
     }
@@ -84,10 +136,32 @@ namespace gr {
       event.event_id = event_id;
       event.wr_trigger_stamp = wr_trigger_stamp;
       event.wr_trigger_stamp_utc = wr_trigger_stamp_utc;
-      d_event_queue.push(event);
+      if (!d_event_queue.push(std::move(event))) {
+        return false;
+      }
+
+      // Producers race for the watermark
+      const uint64_t queued = d_event_queue.queue().size();
+      auto max_queued = d_max_queued.load(std::memory_order_relaxed);
+      while (queued > max_queued
+              && !d_max_queued.compare_exchange_weak(max_queued, queued, std::memory_order_relaxed)) {
+      }
+
       return true;
     }
 
+    uint64_t
+    wr_receiver_f_impl::get_dropped_events() const
+    {
+      return d_event_queue.queue().dropped();
+    }
+
+    uint64_t
+    wr_receiver_f_impl::get_max_queued_events() const
+    {
+      return d_max_queued.load(std::memory_order_relaxed);
+    }
+
   } /* namespace digitizers */
 } /* namespace gr */
 
@@ -24,6 +24,7 @@
 #include <digitizers/wr_receiver_f.h>
 #include <digitizers/tags.h>
 #include "utils.h"
+#include "block_stats_impl.h"
 
 namespace gr {
   namespace digitizers {
@@ -31,10 +32,15 @@ namespace gr {
     class wr_receiver_f_impl : public wr_receiver_f
     {
      private:
-      concurrent_queue<wr_event_t> d_event_queue;
+      bool d_event_stream;
+      // in the event_stream mode work waits for events instead of spinning
+      blocking_queue<bounded_mpsc_queue<wr_event_t>> d_event_queue;
+      std::atomic<uint64_t> d_max_queued;
+
+      block_stats_recorder_t d_stats {this};
 
      public:
-      wr_receiver_f_impl();
+      wr_receiver_f_impl(bool event_stream, int queue_size);
       ~wr_receiver_f_impl();
 
       // Where all the action really happens
@@ -44,11 +50,20 @@ namespace gr {
 
       bool start() override;
 
+      bool stop() override;
+
       bool add_timing_event(const std::string &event_id, int64_t wr_trigger_stamp, int64_t wr_trigger_stamp_utc) override;
+
+      uint64_t get_dropped_events() const override;
+
+      uint64_t get_max_queued_events() const override;
+
+     private:
+
+      void publish(const wr_event_t &event, uint64_t offset);
     };
 
   } // namespace digitizers
 } // namespace gr
 
 #endif /* INCLUDED_DIGITIZERS_WR_RECEIVER_F_IMPL_H */
-
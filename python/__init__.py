@@ -31,4 +31,8 @@ except ImportError:
 	pass
 
 # import any pure python here
+try:
+	from buffers import post_mortem_arrays
+except ImportError:
+	pass
 #
@@ -0,0 +1,40 @@
+#
+# Copyright (C) 2018 GSI Darmstadt, Germany - All Rights Reserved
+# co-developed with: Cosylab, Ljubljana, Slovenia and CERN, Geneva, Switzerland
+# You may use, distribute and modify this code under the terms of the GPL v.3  license.
+#
+
+'''
+Zero-copy NumPy access to the sink buffers.
+'''
+
+import ctypes
+import numpy
+
+
+def _float_array(address, size, handle):
+    '''
+    Read-only float32 array of the given size at the given address. The array references the
+    handle, i.e. the memory stays valid for as long as the array (or any slice of it) is alive.
+    '''
+    if size == 0:
+        return numpy.zeros(0, dtype=numpy.float32)
+
+    memory = (ctypes.c_float * size).from_address(address)
+    memory._handle = handle
+    array = numpy.frombuffer(memory, dtype=numpy.float32)
+    array.flags.writeable = False
+    return array
+
+
+def post_mortem_arrays(sink, nr_items_to_read):
+    '''
+    Returns the last samples of a post-mortem sink as (values, errors, info) without copying.
+
+    The arrays point into the frozen buffer, which stays frozen until both arrays are
+    garbage collected. Use numpy.copy to keep a part of the data while releasing the buffer.
+    '''
+    view = sink.get_view(nr_items_to_read)
+    values = _float_array(view.values_address(), view.size(), view)
+    errors = _float_array(view.errors_address(), view.size(), view)
+    return values, errors, view.get_info()
@@ -8,7 +8,10 @@
 %include "digitizers_swig_doc.i"
 
 %{
+#include "digitizers/aggregated_source.h"
+#include "digitizers/frame_splitter.h"
 #include "digitizers/simulation_source.h"
+#include "digitizers/replay_source.h"
 #include "digitizers/time_domain_sink.h"
 //#include "digitizers/extractor.h"
 #include "digitizers/picoscope_3000a.h"
@@ -25,6 +28,7 @@
 #include "digitizers/block_spectral_peaks.h"
 #include "digitizers/median_and_average.h"
 #include "digitizers/post_mortem_sink.h"
+#include "digitizers/post_mortem_group.h"
 #include "digitizers/block_demux.h"
 #include "digitizers/decimate_and_adjust_timebase.h"
 #include "digitizers/signal_averager.h"
@@ -36,6 +40,7 @@
 #include "digitizers/stft_goertzl_dynamic.h"
 #include "digitizers/time_realignment_ff.h"
 #include "digitizers/interlock_generation_ff.h"
+#include "digitizers/interlock_matrix_ff.h"
 #include "digitizers/stream_to_vector_overlay_ff.h"
 #include "digitizers/stft_goertzl_dynamic_decimated.h"
 #include "digitizers/function_ff.h"
@@ -44,15 +49,38 @@
 #include "digitizers/cascade_sink.h"
 #include "digitizers/wr_receiver_f.h"
 #include "digitizers/demux_ff.h"
+#include "digitizers/trigger_averager_ff.h"
+#include "digitizers/statistics_sink_f.h"
+#include "digitizers/stats_publisher.h"
+#include "digitizers/iir_sos_filter_ff.h"
+#include "digitizers/multi_cascade_sink.h"
+#include "digitizers/multi_time_domain_sink.h"
+#include "digitizers/network_sink.h"
+#include "digitizers/network_source.h"
+#include "digitizers/archive_sink.h"
+#include "digitizers/notification_hub.h"
+#include "digitizers/delay_estimator_ff.h"
 %}
 
 %include "digitizers/range.h"
 %include "digitizers/status.h"
 %include "digitizers/sink_common.h"
+%include "digitizers/notification_hub.h"
+%template(notification_hub_sptr) boost::shared_ptr<gr::digitizers::notification_hub>;
+%pythoncode %{
+notification_hub = notification_hub.make;
+%}
+%include "digitizers/frame_layout.h"
 %include "digitizers/digitizer_block.h"
+%include "digitizers/aggregated_source.h"
+GR_SWIG_BLOCK_MAGIC2(digitizers, aggregated_source);
+%include "digitizers/frame_splitter.h"
+GR_SWIG_BLOCK_MAGIC2(digitizers, frame_splitter);
 
 %include "digitizers/simulation_source.h"
 GR_SWIG_BLOCK_MAGIC2(digitizers, simulation_source);
+%include "digitizers/replay_source.h"
+GR_SWIG_BLOCK_MAGIC2(digitizers, replay_source);
 %include "digitizers/time_domain_sink.h"
 GR_SWIG_BLOCK_MAGIC2(digitizers, time_domain_sink);
 //%include "digitizers/extractor.h"
@@ -85,7 +113,13 @@ GR_SWIG_BLOCK_MAGIC2(digitizers, block_spectral_peaks);
 %include "digitizers/median_and_average.h"
 GR_SWIG_BLOCK_MAGIC2(digitizers, median_and_average);
 %include "digitizers/post_mortem_sink.h"
+%template(post_mortem_view_sptr) boost::shared_ptr<gr::digitizers::post_mortem_view>;
 GR_SWIG_BLOCK_MAGIC2(digitizers, post_mortem_sink);
+%include "digitizers/post_mortem_group.h"
+%template(post_mortem_group_sptr) boost::shared_ptr<gr::digitizers::post_mortem_group>;
+%pythoncode %{
+post_mortem_group = post_mortem_group.make;
+%}
 %include "digitizers/block_demux.h"
 GR_SWIG_BLOCK_MAGIC2(digitizers, block_demux);
 %include "digitizers/decimate_and_adjust_timebase.h"
@@ -111,6 +145,8 @@ GR_SWIG_BLOCK_MAGIC2(digitizers, time_realignment_ff);
 
 %include "digitizers/interlock_generation_ff.h"
 GR_SWIG_BLOCK_MAGIC2(digitizers, interlock_generation_ff);
+%include "digitizers/interlock_matrix_ff.h"
+GR_SWIG_BLOCK_MAGIC2(digitizers, interlock_matrix_ff);
 %include "digitizers/stream_to_vector_overlay_ff.h"
 GR_SWIG_BLOCK_MAGIC2(digitizers, stream_to_vector_overlay_ff);
 
@@ -129,3 +165,23 @@ GR_SWIG_BLOCK_MAGIC2(digitizers, cascade_sink);
 GR_SWIG_BLOCK_MAGIC2(digitizers, wr_receiver_f);
 %include "digitizers/demux_ff.h"
 GR_SWIG_BLOCK_MAGIC2(digitizers, demux_ff);
+%include "digitizers/trigger_averager_ff.h"
+GR_SWIG_BLOCK_MAGIC2(digitizers, trigger_averager_ff);
+%include "digitizers/statistics_sink_f.h"
+GR_SWIG_BLOCK_MAGIC2(digitizers, statistics_sink_f);
+%include "digitizers/stats_publisher.h"
+GR_SWIG_BLOCK_MAGIC2(digitizers, stats_publisher);
+%include "digitizers/iir_sos_filter_ff.h"
+GR_SWIG_BLOCK_MAGIC2(digitizers, iir_sos_filter_ff);
+%include "digitizers/multi_cascade_sink.h"
+GR_SWIG_BLOCK_MAGIC2(digitizers, multi_cascade_sink);
+%include "digitizers/multi_time_domain_sink.h"
+GR_SWIG_BLOCK_MAGIC2(digitizers, multi_time_domain_sink);
+%include "digitizers/network_sink.h"
+GR_SWIG_BLOCK_MAGIC2(digitizers, network_sink);
+%include "digitizers/network_source.h"
+GR_SWIG_BLOCK_MAGIC2(digitizers, network_source);
+%include "digitizers/archive_sink.h"
+GR_SWIG_BLOCK_MAGIC2(digitizers, archive_sink);
+%include "digitizers/delay_estimator_ff.h"
+GR_SWIG_BLOCK_MAGIC2(digitizers, delay_estimator_ff);